@@ -0,0 +1,51 @@
+# Decoding of tracker data points (dataPoint_t) by libdpdec.so, built with
+# make dp-lib in tracker/software. The fields and their layout come from
+# source/threads/datapoint.h which the tracker checks against dataPoint_t.
+
+import ctypes
+import struct
+
+try:
+	dpdec = ctypes.CDLL('./libdpdec.so')
+except OSError:
+	raise ImportError('libdpdec.so not found, build it with make dp-lib in tracker/software')
+
+dpdec.dpdec_field_name.restype = ctypes.c_char_p
+dpdec.dpdec_base91.argtypes = [ctypes.c_char_p, ctypes.c_size_t, ctypes.c_char_p]
+dpdec.dpdec_base91.restype = ctypes.c_size_t
+dpdec.dpdec_records.argtypes = [ctypes.c_char_p, ctypes.c_size_t, ctypes.c_char_p, ctypes.c_size_t]
+dpdec.dpdec_records.restype = ctypes.c_size_t
+dpdec.dpdec_values.argtypes = [ctypes.c_char_p, ctypes.c_size_t, ctypes.POINTER(ctypes.c_int64)]
+dpdec.dpdec_packet.argtypes = [ctypes.c_char_p, ctypes.c_size_t, ctypes.c_int, ctypes.POINTER(ctypes.c_int64), ctypes.c_size_t]
+dpdec.dpdec_packet.restype = ctypes.c_size_t
+
+VERSION = dpdec.dpdec_version()
+POINT_SIZE = dpdec.dpdec_point_size() # sizeof(dataPoint_t) on the tracker
+FIELDS = tuple(dpdec.dpdec_field_name(i).decode('ascii') for i in range(dpdec.dpdec_field_count()))
+
+def _rows(values, count):
+	return list(struct.iter_unpack('%dq' % len(FIELDS), bytes(values)[:count*8*len(FIELDS)]))
+
+def decode_packet(text, records=False):
+	# Points of a telemetry comment or log packet, or of the records of a multi point log packet
+	text = text.encode('latin-1')
+	# A record takes at least two characters
+	count = len(text)//2 + 1 if records else 1
+	values = (ctypes.c_int64 * (count*len(FIELDS)))()
+	return _rows(values, dpdec.dpdec_packet(text, len(text), records, values, count))
+
+def decode_records(data):
+	# Points of keyframe and delta records of the flash log
+	data = bytes(data)
+	count = dpdec.dpdec_records(data, len(data), None, len(data))
+	points = ctypes.create_string_buffer(count*POINT_SIZE)
+	dpdec.dpdec_records(data, len(data), points, count)
+	return decode_points(points.raw)
+
+def decode_points(data):
+	# Points of POINT_SIZE bytes each
+	data = bytes(data)
+	count = len(data)//POINT_SIZE
+	values = (ctypes.c_int64 * (count*len(FIELDS)))()
+	dpdec.dpdec_values(data, count, values)
+	return _rows(values, count)
@@ -8,6 +8,7 @@ import time
 import mysql.connector as mariadb
 import image
 import position
+import schema
 
 # Parse arguments from terminal
 parser = argparse.ArgumentParser(description='APRS/SSDV decoder')
@@ -19,74 +20,7 @@ args = parser.parse_args()
 
 # Open SQLite database
 db = mariadb.connect(user='decoder', password='decoder', database='decoder')
-db.cursor().execute("""
-	CREATE TABLE IF NOT EXISTS `position`
-	(
-		`call` VARCHAR(10),
-		`rxtime` INTEGER,
-		`org` VARCHAR(3),
-
-		`reset` INTEGER,
-		`id` INTEGER,
-		`time` INTEGER,
-
-		`adc_vsol` INTEGER,
-		`adc_vbat` INTEGER,
-		`pac_vsol` INTEGER,
-		`pac_vbat` INTEGER,
-		`pac_pbat` INTEGER,
-		`pac_psol` INTEGER,
-
-		`light_intensity` INTEGER,
-
-		`gps_time` INTEGER,
-		`gps_lock` INTEGER,
-		`gps_sats` INTEGER,
-		`gps_ttff` INTEGER,
-		`gps_pdop` INTEGER,
-		`gps_alt` INTEGER,
-		`gps_lat` INTEGER,
-		`gps_lon` INTEGER,
-
-		`sen_i1_press` INTEGER,
-		`sen_e1_press` INTEGER,
-		`sen_e2_press` INTEGER,
-		`sen_i1_temp` INTEGER,
-		`sen_e1_temp` INTEGER,
-		`sen_e2_temp` INTEGER,
-		`sen_i1_hum` INTEGER,
-		`sen_e1_hum` INTEGER,
-		`sen_e2_hum` INTEGER,
-
-		`stm32_temp` INTEGER,
-		`si4464_temp` INTEGER,
-
-		`sys_time` INTEGER,
-		`sys_error` INTEGER,
-		PRIMARY KEY (`call`,`reset`,`id`,`rxtime`)
-	)
-""")
-db.cursor().execute("""
-	CREATE TABLE IF NOT EXISTS `image`
-	(
-		`id` INTEGER,
-		`call` VARCHAR(10),
-		`rxtime` INTEGER,
-		`imageID` INTEGER,
-		`packetID` INTEGER,
-		`data` VARCHAR(1024),
-		PRIMARY KEY (`call`,`id`,`packetID`)
-	)
-""")
-db.cursor().execute("""
-	CREATE TABLE IF NOT EXISTS `directs`
-	(
-		`call` VARCHAR(10),
-		`rxtime` INTEGER,
-		`directs` VARCHAR(256),
-		PRIMARY KEY (`call`,`rxtime`)
-	)
-""")
+schema.create_tables(db)
 
 
 """ Packet handler for received APRS packets"""
@@ -99,7 +33,7 @@ def received_data(data):
 
 	all = re.search("^" + callreg + "\>APECAN(.*?):", data)
 	pos = re.search("^" + callreg + "\>APECAN(.*?):[\=|!](.{13})(.*?)\|(.*)\|", data)
-	dat = re.search("^" + callreg + "\>APECAN(.*?):\{\{(I|L)(.*)", data)
+	dat = re.search("^" + callreg + "\>APECAN(.*?):\{\{(I|L|M)(.*)", data)
 	dir = re.search("^" + callreg + "\>APECAN(.*?)::(.{9}):Directs=(.*)", data)
 
 	if pos or dat or dir:
@@ -127,6 +61,8 @@ def received_data(data):
 				image.insert_image(db, rxer, call, data)
 			elif typ is 'L': # Log packet
 				position.insert_position(db, call, data, 'log')
+			elif typ is 'M': # Multi point log packet
+				position.insert_log_records(db, call, data)
 
 		elif dir: # Directs packet
 			position.insert_directs(db, call, dir.group(4))
@@ -1,4 +1,5 @@
 import binascii
+import ctypes
 import urllib.request
 import urllib.error
 from datetime import datetime
@@ -37,6 +38,43 @@ imageData = {}
 imageDataLcl = {}
 lock = threading.RLock()
 
+# Incremental decoder (make ssdv-lib in tracker/software). Each image keeps
+# its decoder so a packet is decoded once. Without it every update runs
+# ./ssdv on all packets of the image.
+try:
+	ssdvdec = ctypes.CDLL('./libssdvdec.so')
+	ssdvdec.ssdvdec_open.restype = ctypes.c_void_p
+	ssdvdec.ssdvdec_close.argtypes = [ctypes.c_void_p]
+	ssdvdec.ssdvdec_feed.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+	ssdvdec.ssdvdec_get_jpeg.argtypes = [ctypes.c_void_p,
+		ctypes.POINTER(ctypes.POINTER(ctypes.c_uint8)),
+		ctypes.POINTER(ctypes.c_size_t)]
+except OSError:
+	ssdvdec = None
+decoders = {} # Server ID => [decoder, time of last packet]
+
+def ssdv_packet(data):
+	# Packets from APRS are stored without padding, from captures (ssdvimport.py) with FEC
+	return binascii.unhexlify('55' + data + '00'*(255 - len(data)//2))
+
+def ssdv_get_jpeg(_id):
+	# Called with lock held, the library is not thread safe
+	if _id not in decoders:
+		return None
+	jpeg = ctypes.POINTER(ctypes.c_uint8)()
+	length = ctypes.c_size_t()
+	if ssdvdec.ssdvdec_get_jpeg(decoders[_id][0], ctypes.byref(jpeg), ctypes.byref(length)) != 0:
+		return None
+	return ctypes.string_at(jpeg, length.value)
+
+def ssdv_close_idle():
+	# Images get a new server ID after 5 minutes without packets
+	with lock:
+		for _id in list(decoders):
+			if decoders[_id][1]+5*60 < time.time():
+				ssdvdec.ssdvdec_close(decoders[_id][0])
+				del decoders[_id]
+
 def imgproc():
 	global imageData
 
@@ -49,28 +87,31 @@ def imgproc():
 		for _id in imageDataCpy:
 			(call, data) = imageDataCpy[_id]
 			filename = 'html/images/%s-%d.jpg' % (call.replace('-',''), _id)
-			f = open(filename, 'wb')
-			process = Popen(['./ssdv', '-d'], stdin=PIPE, stdout=f, stderr=PIPE)
-			process.stdin.write(data)
-			dummy,err = process.communicate()
-			f.close()
+			if data is None: # Decoded by the library
+				with lock:
+					jpeg = ssdv_get_jpeg(_id)
+				if jpeg is None:
+					continue
+				f = open(filename, 'wb')
+				f.write(jpeg)
+				f.close()
+			else:
+				f = open(filename, 'wb')
+				process = Popen(['./ssdv', '-d'], stdin=PIPE, stdout=f, stderr=PIPE)
+				process.stdin.write(data)
+				dummy,err = process.communicate()
+				f.close()
 
 			filename2 = 'html/images/%s.jpg' % (call.replace('-',''))
 			copyfile(filename, filename2)
 
-		time.sleep(1)
+		if ssdvdec is not None:
+			ssdv_close_idle()
 
-w = time.time()
-def insert_image(db, receiver, call, data_b91):
-	global imageProcessor,imageData,imageDataLcl,w
-
-	data = base91.decode(data_b91)
-	if len(data) != 174:
-		return # APRS message has invalid type or length (or both)
-
-	cur = db.cursor()
+		time.sleep(1)
 
-	# Decode various meta data
+def ssdv_row(call, data):
+	# Image ID, packet ID and the SSDV packet (without sync byte and FEC) in hex of a decoded image packet
 	imageID  = data[0]
 	packetID = (data[1] << 8) | data[2]
 	data = binascii.hexlify(data[3:]).decode("ascii")
@@ -88,25 +129,62 @@ def insert_image(db, receiver, call, data_b91):
 
 	data  = ('68%08x%02x%04x' % (encode_callsign(bcall), imageID, packetID)) + data
 	data += "%08x" % (binascii.crc32(binascii.unhexlify(data)) & 0xffffffff)
+	return (imageID, packetID, data)
 
-	timd = int(datetime.now().timestamp())
-
+def server_id(cur, call, imageID, timd):
 	# Find image ID (or generate new one)
-	_id = None
-	cur.execute("SELECT `id`,`packetID` FROM `image` WHERE `call` = %s AND `imageID` = %s AND `rxtime`+5*60 >= %s ORDER BY `rxtime` DESC LIMIT 1", (call, imageID, timd))
+	cur.execute("SELECT `id` FROM `image` WHERE `call` = %s AND `imageID` = %s AND `rxtime`+5*60 >= %s ORDER BY `rxtime` DESC LIMIT 1", (call, imageID, timd))
 	fetch = cur.fetchall()
 	if len(fetch):
-		_id = fetch[0][0]
-		lastPacketId = fetch[0][1]
-
-	if _id is None:
-		# Generate ID
-		cur.execute("SELECT `id`+1 FROM `image` ORDER BY `id` DESC LIMIT 1")
-		fetch = cur.fetchall()
-		if len(fetch):
-			_id = fetch[0][0]
-		else: # No entries in the database
-			_id = 0
+		return fetch[0][0]
+
+	# Generate ID
+	cur.execute("SELECT `id`+1 FROM `image` ORDER BY `id` DESC LIMIT 1")
+	fetch = cur.fetchall()
+	if len(fetch):
+		return fetch[0][0]
+	return 0 # No entries in the database
+
+def start_processor():
+	global imageProcessor
+	if imageProcessor is None:
+		imageProcessor = threading.Thread(target=imgproc)
+		imageProcessor.start()
+
+def feed_decoder(cur, _id, call, packets):
+	# Called with lock held
+	if _id in decoders:
+		for data in packets:
+			ssdvdec.ssdvdec_feed(decoders[_id][0], ssdv_packet(data))
+	else:
+		# Also takes the packets stored before a restart
+		decoders[_id] = [ssdvdec.ssdvdec_open(), 0]
+		cur.execute("SELECT `data` FROM `image` WHERE `id` = %s ORDER BY `packetID`", (_id,))
+		for packet, in cur.fetchall():
+			ssdvdec.ssdvdec_feed(decoders[_id][0], ssdv_packet(packet))
+	decoders[_id][1] = time.time()
+	imageData[_id] = (call, None)
+
+def image_data(cur, _id):
+	# All packets of an image for ./ssdv
+	allData = ''
+	cur.execute("SELECT `data` FROM `image` WHERE `id` = %s ORDER BY `packetID`", (_id,))
+	for data, in cur.fetchall():
+		allData += '55' + data + '00'*(255 - len(data)//2)
+	return binascii.unhexlify(allData)
+
+w = time.time()
+def insert_image(db, receiver, call, data_b91):
+	global imageData,imageDataLcl,w
+
+	data = base91.decode(data_b91)
+	if len(data) != 174:
+		return # APRS message has invalid type or length (or both)
+
+	cur = db.cursor()
+	(imageID, packetID, data) = ssdv_row(call, data)
+	timd = int(datetime.now().timestamp())
+	_id = server_id(cur, call, imageID, timd)
 
 	# Debug
 	print('Received image packet Call=%s ImageID=%d PacketID=%d ServerID=%d' % (call, imageID, packetID, _id))
@@ -118,6 +196,17 @@ def insert_image(db, receiver, call, data_b91):
 		(call, timd, imageID, packetID, data, _id)
 	)
 
+	start_processor()
+
+	if ssdvdec is not None:
+		with lock:
+			feed_decoder(cur, _id, call, [data])
+
+		if w+1 < time.time():
+			db.commit()
+			w = time.time()
+		return
+
 	if w+1 < time.time():
 		db.commit()
 		with lock:
@@ -125,15 +214,31 @@ def insert_image(db, receiver, call, data_b91):
 			imageDataLcl = {}
 		w = time.time()
 
-	allData = ''
-
-	cur.execute("SELECT `data` FROM `image` WHERE `id` = %s ORDER BY `packetID`", (_id,))
-	for data, in cur.fetchall():
-		allData += '55' + data + (144*'0')
-
-	imageDataLcl[_id] = (call, binascii.unhexlify(allData))
+	imageDataLcl[_id] = (call, image_data(cur, _id))
 
-	if imageProcessor is None:
-		imageProcessor = threading.Thread(target=imgproc)
-		imageProcessor.start()
+def insert_images(db, packets):
+	# Decoded image packets (call, data) of a batch, committed by the caller.
+	# Packets of an image are inserted at once.
+	cur = db.cursor()
+	timd = int(datetime.now().timestamp())
+	images = {}
+	for call, data in packets:
+		(imageID, packetID, data) = ssdv_row(call, data)
+		images.setdefault((call, imageID), []).append((packetID, data))
+
+	for (call, imageID), rows in images.items():
+		_id = server_id(cur, call, imageID, timd)
+		print('Received %d image packets Call=%s ImageID=%d ServerID=%d' % (len(rows), call, imageID, _id))
+		cur.executemany("""
+			INSERT IGNORE INTO `image` (`call`,`rxtime`,`imageID`,`packetID`,`data`,`id`)
+			VALUES (%s,%s,%s,%s,%s,%s)""",
+			[(call, timd, imageID, packetID, data, _id) for packetID, data in rows]
+		)
+		with lock:
+			if ssdvdec is not None:
+				feed_decoder(cur, _id, call, [data for packetID, data in rows])
+			else:
+				imageData[_id] = (call, image_data(cur, _id))
 
+	if len(images):
+		start_processor()
@@ -0,0 +1,110 @@
+#!/usr/bin/python3
+
+# Ingests the packets of the trackers from any number of APRS-IS servers,
+# TNC2 monitors and KISS receivers. aprsin (make aprs-in in tracker/software)
+# merges the sources, drops the copies of a packet heard by several
+# receivers and decodes the data points and image packets. The records are
+# written to the database in batches.
+
+import argparse
+import binascii
+import queue
+import subprocess
+import sys
+import threading
+import time
+from datetime import datetime, timezone
+import mysql.connector as mariadb
+
+import image
+import position
+import schema
+
+parser = argparse.ArgumentParser(description='APRS packet ingest')
+parser.add_argument('-c', '--call', help='APRS-IS login and receiver of packets without path (default: DL7AD)')
+parser.add_argument('-i', '--aprsis', action='append', default=[], help='APRS-IS server host:port (default: euro.aprs2.net:14580 without other sources)')
+parser.add_argument('-t', '--tnc2', action='append', default=[], help='Receiver giving TNC2 monitor lines device[:baud], - for stdin')
+parser.add_argument('-k', '--kiss', action='append', default=[], help='KISS receiver device[:baud]')
+parser.add_argument('-w', '--window', help='Dedupe window in seconds', type=int)
+parser.add_argument('-b', '--batch', help='Seconds of packets written at once', type=float, default=1)
+parser.add_argument('--aprsin', help='Path of aprsin', default='../tracker/software/build/aprsin/aprsin')
+args = parser.parse_args()
+
+if not args.aprsis and not args.tnc2 and not args.kiss:
+	args.aprsis = ['euro.aprs2.net:14580']
+
+cmd = [args.aprsin]
+if args.call:
+	cmd += ['-c', args.call]
+if args.window:
+	cmd += ['-w', str(args.window)]
+for src in args.aprsis:
+	cmd += ['-i', src]
+for src in args.tnc2:
+	cmd += ['-t', src]
+for src in args.kiss:
+	cmd += ['-k', src]
+
+db = mariadb.connect(user='decoder', password='decoder', database='decoder')
+schema.create_tables(db)
+
+# A stdin source of aprsin reads the stdin of the ingest
+process = subprocess.Popen(cmd, stdout=subprocess.PIPE, universal_newlines=True)
+lines = queue.Queue()
+
+def reader():
+	for line in process.stdout:
+		lines.put(line)
+	lines.put(None)
+
+threading.Thread(target=reader, daemon=True).start()
+
+def write(points, images, directs):
+	cur = db.cursor()
+	if len(points):
+		cur.executemany(position.INSERT_POINTS, points)
+	if len(images):
+		image.insert_images(db, images)
+	if len(directs):
+		cur.executemany(position.INSERT_DIRECTS, directs)
+	db.commit()
+
+	print('%s: %d data points, %d image packets, %d directs' % (
+		datetime.now().strftime('%H:%M:%S'), len(points), len(images), len(directs)))
+
+done = False
+while not done:
+	points = []
+	images = []
+	directs = []
+	end = time.time() + args.batch
+
+	while True:
+		try:
+			line = lines.get(timeout=max(end - time.time(), 0))
+		except queue.Empty:
+			break
+		if line is None:
+			done = True
+			break
+
+		rec = line.rstrip('\n').split('\t')
+		rxtime = int(datetime.now(timezone.utc).timestamp())
+		try:
+			if rec[0] == 'P' and len(rec) == 5:
+				point = [int(v) for v in rec[4].split(',')]
+				points.append(position.point_row(rec[1], rxtime, rec[3], point))
+			elif rec[0] == 'I' and len(rec) == 4:
+				images.append((rec[1], binascii.unhexlify(rec[3])))
+			elif rec[0] == 'D' and len(rec) == 3:
+				directs.append((rec[1], rxtime, rec[2]))
+		except (ValueError, binascii.Error):
+			print('Invalid record: %s' % line.rstrip('\n'))
+
+		if time.time() >= end:
+			break
+
+	if len(points) or len(images) or len(directs):
+		write(points, images, directs)
+
+sys.exit(process.wait())
@@ -0,0 +1,105 @@
+#!/usr/bin/python3
+
+# Reads the flash log of a tracker over the USB console (log_bin command)
+# and writes the points as CSV. With a state file only the points which
+# were not read before are fetched. A transfer can be saved and read
+# again, and its points inserted into the position table at once.
+
+import struct
+import sys
+import argparse
+import datapoint
+
+HEADER = '<IBBHIII'
+HEADER_SIZE = struct.calcsize(HEADER)
+MAGIC = 0x47584C50
+ENCODING_RAW = 0
+ENCODING_DELTA = 1
+
+def crc16_x25(data):
+	crc = 0xFFFF
+	for b in data:
+		crc ^= b
+		for i in range(8):
+			crc = (crc >> 1) ^ 0x8408 if crc & 1 else crc >> 1
+	return crc ^ 0xFFFF
+
+def read_transfer(port):
+	# Header line "BIN <type>,<length>", data and CRC low byte first
+	while True:
+		line = port.readline()
+		if not line:
+			sys.exit('No response from tracker')
+		line = line.decode('ascii', 'replace').strip()
+		if line.startswith('BIN '):
+			break
+	typ, length = line[4:].split(',')
+	data = port.read(int(length))
+	fcs = port.read(2)
+	if len(data) != int(length) or len(fcs) != 2:
+		sys.exit('Transfer of %s incomplete' % typ)
+	if crc16_x25(data) != fcs[0] | fcs[1] << 8:
+		sys.exit('Transfer of %s has a CRC error' % typ)
+	return data
+
+def main():
+	parser = argparse.ArgumentParser(description='Tracker flash log reader')
+	parser.add_argument('-d', '--device', help='USB serial device', default='/dev/ttyACM0')
+	parser.add_argument('-f', '--first', help='Number of the first point', default=0, type=int)
+	parser.add_argument('-n', '--count', help='Number of points', type=int)
+	parser.add_argument('-s', '--state', help='File holding the next point number to read')
+	parser.add_argument('-r', '--raw', help='Transfer points uncompressed', action='store_true')
+	parser.add_argument('-i', '--input', help='Read a transfer saved with --write instead of the tracker')
+	parser.add_argument('-w', '--write', help='Save the transfer to a file')
+	parser.add_argument('--insert', help='Insert the points into the position table with this callsign instead of writing CSV')
+	args = parser.parse_args()
+
+	first = args.first
+	if args.state:
+		try:
+			first = int(open(args.state).read())
+		except (IOError, ValueError):
+			pass
+
+	if args.input:
+		data = open(args.input, 'rb').read()
+	else:
+		import serial
+		port = serial.Serial(args.device, timeout=5)
+		cmd = 'log_bin %s %d' % ('raw' if args.raw else 'delta', first)
+		if args.count is not None:
+			cmd += ' %d' % args.count
+		port.write((cmd + '\r\n').encode('ascii'))
+		data = read_transfer(port)
+	if args.write:
+		open(args.write, 'wb').write(data)
+
+	magic, version, encoding, size, first, count, end = struct.unpack(HEADER, data[:HEADER_SIZE])
+	if magic != MAGIC:
+		sys.exit('Not a log export')
+	if version != datapoint.VERSION or size != datapoint.POINT_SIZE:
+		sys.exit('Unknown point layout version %d size %d' % (version, size))
+	data = data[HEADER_SIZE:]
+	if encoding == ENCODING_DELTA:
+		points = datapoint.decode_records(data)
+	else:
+		points = datapoint.decode_points(data)
+	if len(points) != count:
+		sys.exit('Expected %d points, decoded %d' % (count, len(points)))
+
+	if args.insert:
+		import mysql.connector as mariadb
+		import position
+		db = mariadb.connect(user='decoder', password='decoder', database='decoder')
+		position.insert_points(db, args.insert, points, 'log')
+	else:
+		print(','.join(datapoint.FIELDS))
+		for p in points:
+			print(','.join(str(v) for v in p))
+
+	sys.stderr.write('Read points %d to %d, log ends at %d\n' % (first, first + count, end))
+	if args.state:
+		open(args.state, 'w').write(str(first + count))
+
+if __name__ == '__main__':
+	main()
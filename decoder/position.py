@@ -1,40 +1,49 @@
-from datetime import datetime,timedelta,timezone
-import base91
-import struct
+from datetime import datetime,timezone
+import datapoint
+
+# Columns of the position table by data point field (fields without a column are not stored)
+COLUMNS = dict((f, f) for f in datapoint.FIELDS)
+COLUMNS.update({'gps_state': 'gps_lock', 'si446x_temp': 'si4464_temp'})
+del COLUMNS['dummy2'], COLUMNS['gpio']
+
+INDEX = [i for i,f in enumerate(datapoint.FIELDS) if f in COLUMNS]
+INSERT_POINTS = "INSERT IGNORE INTO `position` (`call`,`rxtime`,`org`,%s) VALUES (%s)" % (
+	','.join('`%s`' % COLUMNS[datapoint.FIELDS[i]] for i in INDEX), ','.join(['%s']*(len(INDEX)+3)))
+INSERT_DIRECTS = "INSERT IGNORE INTO `directs` (`call`,`rxtime`,`directs`) VALUES (%s,%s,%s)"
+
+def point_row(call, rxtime, typ, point):
+	# Row of INSERT_POINTS
+	return (call,rxtime,typ) + tuple(point[i] for i in INDEX)
 
 def insert_position(db, call, comm, typ):
-	try:
-		# Decode comment
-		data = base91.decode(comm)
-		(adc_vsol,adc_vbat,pac_vsol,pac_vbat,pac_pbat,pac_psol,light_intensity,
-		 gps_lock,gps_sats,gps_ttff,gps_pdop,gps_alt,gps_lat,
-		 gps_lon,sen_i1_press,sen_e1_press,sen_e2_press,sen_i1_temp,sen_e1_temp,
-		 sen_e2_temp,sen_i1_hum,sen_e1_hum,sen_e2_hum,dummy2,stm32_temp,
-		 si4464_temp,reset,_id,gps_time,sys_time,sys_error) = struct.unpack('HHHHhhHBBBBHiiIIIhhhBBBBhhHIIII', data[:72])
-
-		# Insert
-		rxtime = int(datetime.now(timezone.utc).timestamp())
-		db.cursor().execute(
-			"""INSERT INTO `position` (`call`,`rxtime`,`org`,`adc_vsol`,`adc_vbat`,`pac_vsol`,`pac_vbat`,`pac_pbat`,`pac_psol`,`light_intensity`,`gps_lock`,
-				`gps_sats`,`gps_ttff`,`gps_pdop`,`gps_alt`,`gps_lat`,`gps_lon`,`sen_i1_press`,`sen_e1_press`,`sen_e2_press`,`sen_i1_temp`,`sen_e1_temp`,
-				`sen_e2_temp`,`sen_i1_hum`,`sen_e1_hum`,`sen_e2_hum`,`sys_error`,`stm32_temp`,`si4464_temp`,`reset`,`id`,`sys_time`,`gps_time`)
-				VALUES (%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s)""",
-			(call,rxtime,typ,adc_vsol,adc_vbat,pac_vsol,pac_vbat,pac_pbat,pac_psol,light_intensity,gps_lock,gps_sats,gps_ttff,
-			 gps_pdop,gps_alt,gps_lat,gps_lon,sen_i1_press,sen_e1_press,sen_e2_press,sen_i1_temp,sen_e1_temp,sen_e2_temp,sen_i1_hum,
-			 sen_e1_hum,sen_e2_hum,sys_error,stm32_temp,si4464_temp,reset,_id,sys_time,gps_time)
-		)
-		db.commit()
-
-		# Debug
-		print('Received %s packet packet Call=%s Reset=%d ID=%d' % (typ, call, reset, _id))
-
-	except struct.error:
-
-			print('Received erroneous %s packet Call=%s' % (typ, call))
+	insert_points(db, call, datapoint.decode_packet(comm), typ)
+
+def insert_log_records(db, call, comm):
+	# Multi point log packets hold the records of the tracker flash log
+	insert_points(db, call, datapoint.decode_packet(comm, records=True), 'log')
+
+def insert_points(db, call, points, typ):
+	if not len(points):
+		print('Received erroneous %s packet Call=%s' % (typ, call))
+		return
+
+	# Insert all points at once
+	rxtime = int(datetime.now(timezone.utc).timestamp())
+	db.cursor().executemany(INSERT_POINTS, [point_row(call, rxtime, typ, p) for p in points])
+	db.commit()
+
+	# Debug
+	reset = datapoint.FIELDS.index('reset')
+	_id = datapoint.FIELDS.index('id')
+	if len(points) == 1:
+		print('Received %s packet packet Call=%s Reset=%d ID=%d' % (typ, call, points[0][reset], points[0][_id]))
+	else:
+		print('Received %d %s points Call=%s Reset=%d ID=%d to Reset=%d ID=%d' % (len(points), typ, call,
+			points[0][reset], points[0][_id], points[-1][reset], points[-1][_id]))
 
 def insert_directs(db, call, dir):
 	rxtime = int(datetime.now(timezone.utc).timestamp())
-	db.cursor().execute("INSERT INTO `directs` (`call`,`rxtime`,`directs`) VALUES (%s,%s,%s)", (call,rxtime,dir))
+	db.cursor().execute(INSERT_DIRECTS, (call,rxtime,dir))
 	db.commit()
 
 	# Debug
@@ -0,0 +1,71 @@
+# Tables of the decoder database, made by decoder.py and ingest.py
+
+def create_tables(db):
+	db.cursor().execute("""
+		CREATE TABLE IF NOT EXISTS `position`
+		(
+			`call` VARCHAR(10),
+			`rxtime` INTEGER,
+			`org` VARCHAR(3),
+
+			`reset` INTEGER,
+			`id` INTEGER,
+			`time` INTEGER,
+
+			`adc_vsol` INTEGER,
+			`adc_vbat` INTEGER,
+			`pac_vsol` INTEGER,
+			`pac_vbat` INTEGER,
+			`pac_pbat` INTEGER,
+			`pac_psol` INTEGER,
+
+			`light_intensity` INTEGER,
+
+			`gps_time` INTEGER,
+			`gps_lock` INTEGER,
+			`gps_sats` INTEGER,
+			`gps_ttff` INTEGER,
+			`gps_pdop` INTEGER,
+			`gps_alt` INTEGER,
+			`gps_lat` INTEGER,
+			`gps_lon` INTEGER,
+
+			`sen_i1_press` INTEGER,
+			`sen_e1_press` INTEGER,
+			`sen_e2_press` INTEGER,
+			`sen_i1_temp` INTEGER,
+			`sen_e1_temp` INTEGER,
+			`sen_e2_temp` INTEGER,
+			`sen_i1_hum` INTEGER,
+			`sen_e1_hum` INTEGER,
+			`sen_e2_hum` INTEGER,
+
+			`stm32_temp` INTEGER,
+			`si4464_temp` INTEGER,
+
+			`sys_time` INTEGER,
+			`sys_error` INTEGER,
+			PRIMARY KEY (`call`,`reset`,`id`,`rxtime`)
+		)
+	""")
+	db.cursor().execute("""
+		CREATE TABLE IF NOT EXISTS `image`
+		(
+			`id` INTEGER,
+			`call` VARCHAR(10),
+			`rxtime` INTEGER,
+			`imageID` INTEGER,
+			`packetID` INTEGER,
+			`data` VARCHAR(1024),
+			PRIMARY KEY (`call`,`id`,`packetID`)
+		)
+	""")
+	db.cursor().execute("""
+		CREATE TABLE IF NOT EXISTS `directs`
+		(
+			`call` VARCHAR(10),
+			`rxtime` INTEGER,
+			`directs` VARCHAR(256),
+			PRIMARY KEY (`call`,`rxtime`)
+		)
+	""")
@@ -0,0 +1,59 @@
+#!/usr/bin/python3
+
+# Imports the SSDV packets of recorded 2FSK captures into the image table.
+# The captures are checked, repaired and deduplicated by ssdvfix
+# (make ssdv-fix in tracker/software). Packets already in the table are
+# ignored, so captures can be imported again.
+
+import argparse
+import subprocess
+import sys
+import time
+import mysql.connector as mariadb
+
+parser = argparse.ArgumentParser(description='SSDV capture import')
+parser.add_argument('capture', nargs='+', help='Capture files (raw bytes)')
+parser.add_argument('-c', '--call', help='APRS callsign of the tracker (default: SSDV callsign)')
+parser.add_argument('-j', '--threads', help='Scan threads of ssdvfix', type=int)
+parser.add_argument('--ssdvfix', help='Path of ssdvfix', default='../tracker/software/build/ssdvfix/ssdvfix')
+args = parser.parse_args()
+
+cmd = [args.ssdvfix, '-l']
+if args.threads:
+	cmd += ['-j', str(args.threads)]
+process = subprocess.run(cmd + args.capture, stdout=subprocess.PIPE, universal_newlines=True)
+if process.returncode != 0:
+	sys.exit(process.returncode)
+
+db = mariadb.connect(user='decoder', password='decoder', database='decoder')
+cur = db.cursor()
+timd = int(time.time())
+
+# Lines are sorted by callsign and image ID, each image gets one server ID
+ids = {}
+inserted = 0
+for line in process.stdout.splitlines():
+	(scall, imageID, packetID, errors, data) = line.split()
+	imageID = int(imageID)
+	packetID = int(packetID)
+	call = args.call if args.call else scall
+
+	if (call,imageID) not in ids:
+		# Continue an image received within the last 5 minutes (as image.py)
+		cur.execute("SELECT `id` FROM `image` WHERE `call` = %s AND `imageID` = %s AND `rxtime`+5*60 >= %s ORDER BY `rxtime` DESC LIMIT 1", (call, imageID, timd))
+		fetch = cur.fetchall()
+		if not len(fetch):
+			cur.execute("SELECT `id`+1 FROM `image` ORDER BY `id` DESC LIMIT 1")
+			fetch = cur.fetchall()
+		ids[(call,imageID)] = fetch[0][0] if len(fetch) else 0
+		print('Importing image Call=%s ImageID=%d ServerID=%d' % (call, imageID, ids[(call,imageID)]))
+
+	cur.execute("""
+		INSERT IGNORE INTO `image` (`call`,`rxtime`,`imageID`,`packetID`,`data`,`id`)
+		VALUES (%s,%s,%s,%s,%s,%s)""",
+		(call, timd, imageID, packetID, data, ids[(call,imageID)])
+	)
+	inserted += cur.rowcount
+
+db.commit()
+print('%d packets imported' % inserted)
@@ -488,7 +488,8 @@
  * @details User fields added to the end of the @p thread_t structure.
  */
 #define CH_CFG_THREAD_EXTRA_FIELDS                                          \
-  /* Add threads custom fields here.*/
+  /* Add threads custom fields here.*/                                      \
+  uint64_t              cycles;     /* CPU cycles used (threadprof.c).*/
 
 /**
  * @brief   Threads initialization hook.
@@ -499,6 +500,7 @@
  */
 #define CH_CFG_THREAD_INIT_HOOK(tp) {                                       \
   /* Add threads initialization code here.*/                                \
+  (tp)->cycles = 0;                                                         \
 }
 
 /**
@@ -519,6 +521,11 @@
  */
 #define CH_CFG_CONTEXT_SWITCH_HOOK(ntp, otp) {                              \
   /* Context switch code here.*/                                            \
+  extern uint32_t threadprof_switch_time;                                   \
+  uint32_t now = port_rt_get_counter_value();                               \
+  (otp)->cycles += now - threadprof_switch_time;                            \
+  threadprof_switch_time = now;                                             \
+  (void)(ntp);                                                              \
 }
 
 /**
@@ -561,7 +568,9 @@
 #define CH_CFG_IDLE_LOOP_HOOK() {                                           \
   /* Idle loop code here.*/                                                 \
   extern void pktIdleThread(void);                                          \
+  extern void enterStopIfIdle(void);                                        \
   pktIdleThread();                                                          \
+  enterStopIfIdle();                                                        \
 }
 
 /**
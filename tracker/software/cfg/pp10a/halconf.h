@@ -70,6 +70,10 @@
  */
 #if !defined(HAL_USE_GPT) || defined(__DOXYGEN__)
 #define HAL_USE_GPT                 FALSE
+/* Driver extension to add user fields. */
+#define GPT_DRIVER_EXT_FIELDS                                                \
+                        void *link;                                          \
+                        vtfunc_t cca_cb;
 #endif
 
 /**
@@ -94,6 +98,8 @@
 /* Driver extension to add user fields. */
 #define ICU_DRIVER_EXT_FIELDS                                                \
                         void *link;                                          \
+                        void *dma;                                           \
+                        void *gpt;                                           \
                         virtual_timer_t cca_timer;                           \
                         virtual_timer_t icu_timer;                           \
                         virtual_timer_t pwm_timer;
@@ -67,6 +67,45 @@ si446x_data_t radio1_dat = {
          */
 };
 
+#if PKT_SVC_USE_RADIO2 == TRUE
+/*
+ * Definition of PKT_RADIO_2.
+ * The board must define the radio 2 IO lines, SPI and ICU.
+ */
+#if !defined(LINE_RADIO2_CS) || !defined(LINE_RADIO2_SDN)                    \
+    || !defined(LINE_RADIO2_NIRQ) || !defined(LINE_RADIO2_GPIO0)              \
+    || !defined(LINE_RADIO2_GPIO1) || !defined(PKT_RADIO2_SPI)                \
+    || !defined(PKT_RADIO2_ICU)
+#error "radio 2 IO is not defined for this board"
+#endif
+
+const si446x_mcucfg_t radio2_cfg = {
+        .gpio0  = LINE_RADIO2_GPIO0,
+        .gpio1  = LINE_RADIO2_GPIO1,
+        .gpio2  = PAL_NOLINE,
+        .gpio3  = PAL_NOLINE,
+        .nirq   = LINE_RADIO2_NIRQ,
+        .sdn    = LINE_RADIO2_SDN,
+        .cs     = LINE_RADIO2_CS,
+        .spi    = PKT_RADIO2_SPI,
+        .icu    = PKT_RADIO2_ICU,
+        .alt    = (PAL_MODE_INPUT | PAL_MODE_ALTERNATE(2)),
+        .cfg    =  {
+                      ICU_INPUT_ACTIVE_HIGH,
+                      ICU_COUNT_FREQUENCY,      /* ICU clock frequency. */
+                      NULL,                     /* ICU width callback. */
+                      pktRadioICUPeriod,        /* ICU period callback. */
+                      pktRadioICUOverflow,      /* ICU overflow callback. */
+                      ICU_CHANNEL_1,            /* Timer channel. */
+                      0
+                    }
+};
+
+si446x_data_t radio2_dat = {
+        .lastTemp = 0x7FFF
+};
+#endif
+
 /* List of bands in this radio. */
 const radio_band_t *const radio_bands[] = {
                 (radio_band_t *const)&band_2m,
@@ -84,6 +123,17 @@ const radio_config_t radio_list[] = {
     .dat    = (si446x_data_t *)&radio1_dat,
     .bands  = (radio_band_t **const)radio_bands
   }, /* End radio1 */
+#if PKT_SVC_USE_RADIO2 == TRUE
+  { /* Radio #2 */
+    .unit   = PKT_RADIO_2,
+    .type   = SI446X,
+    .pkt    = (pkt_service_t *const)&RPKTD2,
+    .afsk   = (AFSKDemodDriver *const)&AFSKD2,
+    .cfg    = (si446x_mcucfg_t *const)&radio2_cfg,
+    .dat    = (si446x_data_t *)&radio2_dat,
+    .bands  = (radio_band_t **const)radio_bands
+  }, /* End radio2 */
+#endif
   {
      .unit = PKT_RADIO_NONE
   }
@@ -118,11 +118,26 @@
 #error "Default operating frequency must be an absolute value in Hz"
 #endif
 
+/* Command and control receive frequency (FREQ_RX_CMDC). */
+#define DEFAULT_CMDC_FREQ           144860000
+#if DEFAULT_CMDC_FREQ < BAND_MIN_2M_FREQ
+#error "Command and control frequency must be an absolute value in Hz"
+#endif
+
 /* Si446x clock setup. */
 #define Si446x_CLK					STM32_HSECLK			/* Oscillator frequency in Hz */
 #define Si446x_CLK_OFFSET			22						/* Oscillator frequency drift in ppm */
 #define Si446x_CLK_TCXO_EN			true					/* Set this true, if a TCXO is used, false for XTAL */
 
+/*
+ * Oscillator drift by chip temperature in ppb (added to the fixed offset).
+ * Entries start at Si446x_CLK_TEMP_BASE in Si446x_CLK_TEMP_STEP degree C steps.
+ * Fill from calibration of the oscillator. Zero applies no correction.
+ */
+#define Si446x_CLK_TEMP_BASE            (-50)
+#define Si446x_CLK_TEMP_STEP            15
+#define Si446x_CLK_TEMP_PPB             {0, 0, 0, 0, 0, 0, 0, 0, 0, 0}
+
 /* LED status indicators (set to PAL_NOLINE if not available). */
 #define LINE_OVERFLOW_LED               PAL_NOLINE
 #define LINE_DECODER_LED                LINE_IO_BLUE
@@ -142,6 +157,18 @@
 #define EI2C_SCL                        LINE_GPIO_PIN1 /* SCL */
 #define EI2C_SDA                        LINE_GPIO_PIN2 /* SDA */
 
+/*
+ * Hardware I2C with DMA for the external bus.
+ * GPIO_PIN1 (PA8) is I2C3 SCL but GPIO_PIN2 (PC15) has no I2C function
+ * so the bus is bit banged.
+ * A board with the pins on an I2C peripheral sets the driver and pin AF.
+ * The peripheral must also be enabled in mcuconf.h.
+ */
+#define EI2C_USE_HARDWARE               FALSE
+#define EI2C_DRIVER                     (&I2CD3)
+#define EI2C_AF                         4
+#define EI2C_SPEED                      100000
+
 /* To use IO_TXD/IO_RXD for UART debug channel. */
 #define ENABLE_SERIAL_DEBUG             TRUE
 
@@ -177,7 +204,58 @@
 #error "Invalid ICU frequency for APBx clock setting"
 #endif
 
-#define USE_12_BIT_PWM                  FALSE
+/*
+ * Pack PWM impulse and valley as two 12 bit counts in 3 bytes.
+ * Saves 25% of PWM buffer memory per entry over 16 bit counts.
+ * Requires half a cycle of the lowest tone to be within 0xFFF ICU counts.
+ */
+#define USE_12_BIT_PWM                  TRUE
+
+/*
+ * Check PWM after a CCA break is de-glitched before opening a PWM stream.
+ * The first edges must mostly be plausible AFSK half cycles.
+ * Noise is then rejected without using a stream or buffer object.
+ * Not available with PWM DMA capture.
+ */
+#define USE_PWM_PREQUALIFY              TRUE
+/* Number of edges checked and the number that must be plausible. */
+#define PWM_QUALIFY_EDGES               16U
+#define PWM_QUALIFY_PASS                12U
+
+/*
+ * Replay recorded PWM into the decoder in place of the ICU.
+ * Recordings are byte packed PWM entries as read from the PWM stream.
+ * Used to benchmark the decoder against captured signals.
+ */
+#define USE_PWM_REPLAY                  TRUE
+/* Linked PWM buffer objects a replay may have outstanding. */
+#define PWM_REPLAY_BUFFERS              2U
+/* Number of PWM entries read from the replay source at a time. */
+#define PWM_REPLAY_CHUNK                64U
+
+/*
+ * Capture PWM by timer DMA into a circular buffer.
+ * PWM is moved to the decoder on DMA half and full transfer.
+ * This replaces the ICU period interrupt on each PWM edge.
+ * Requires ICU_CHANNEL_1 (TIM4_CH1 is DMA1 stream 0 channel 2).
+ */
+#define USE_PWM_DMA_CAPTURE             FALSE
+#define PKT_RADIO1_PWM_DMA_STREAM       STM32_DMA_STREAM_ID(1, 0)
+#define PKT_RADIO1_PWM_DMA_CHANNEL      2U
+#define PKT_RADIO1_PWM_DMA_PRIORITY     3U
+#define PKT_RADIO1_PWM_DMA_IRQ_PRIORITY 7U
+/* Number of captures in the DMA buffer. Half are moved per interrupt. */
+#define PWM_DMA_SLOTS                   64U
+
+/*
+ * De-glitch CCA edges in a hardware one-shot timer instead of virtual timers.
+ * A CCA edge starts the timer and expiry is the qualified open or close.
+ * Requires HAL_USE_GPT and the timer enabled in mcuconf.
+ */
+#define USE_CCA_GPT_DEBOUNCE            FALSE
+#define PKT_RADIO1_CCA_GPT              &GPTD5
+/* Timer count frequency. */
+#define CCA_GPT_FREQUENCY               100000U
 
 /*
  * Allocate PWM buffers from a CCM heap/pool.
@@ -195,13 +273,30 @@
 /* Use factory FIFO as stream control with separate chained PWM buffers. */
 #define NUMBER_PWM_FIFOS                5U
 /* Number of PWM data entries per queue object. */
+#if USE_12_BIT_PWM == TRUE
+/* Same object memory as 200 entries of 16 bit PWM. */
+#define PWM_DATA_SLOTS                  266
+#else
 #define PWM_DATA_SLOTS                  200
-/* Number of PWM queue objects in total. */
+#endif
+/*
+ * The PWM queue object pool is sized at run time from measured usage.
+ * It grows when a session runs short and shrinks back when idle.
+ */
+/* Maximum number of PWM queue objects in total. */
 #define PWM_DATA_BUFFERS                30
+/* Number of PWM queue objects allocated at start. */
+#define PWM_DATA_BUFFERS_MIN            8
+/* Objects of headroom and the most added or removed per adjustment. */
+#define PWM_POOL_ADJUST_STEP            4
 #else /* USE_HEAP_PWM_BUFFER != TRUE */
 /* Use factory FIFO as stream control with integrated PWM buffer. */
 #define NUMBER_PWM_FIFOS                3U
+#if USE_12_BIT_PWM == TRUE
+#define PWM_DATA_SLOTS                  8000
+#else
 #define PWM_DATA_SLOTS                  6000
+#endif
 #endif /* USE_HEAP_PWM_BUFFER == TRUE */
 
 /* Number of frame receive buffers. */
@@ -211,13 +306,191 @@
 /* Set TRUE to use the idle thread sweeper to release terminated threads. */
 #define PKT_RX_RLS_USE_NO_FIFO          TRUE
 
+/*
+ * Run receive callbacks in a fixed pool of persistent worker threads.
+ * Frames are queued to the workers instead of creating a thread per frame.
+ * Each worker has a PKT_CALLBACK_WA_SIZE stack allocated at receive open.
+ */
+#define PKT_RX_USE_CALLBACK_POOL        TRUE
+#define PKT_RX_CALLBACK_WORKERS         2U
+
+/*
+ * Pass received frames to APRS processing as a read-only view of the
+ * receive buffer instead of copying into a packet object.
+ */
+#define PKT_RX_USE_PACKET_VIEW          TRUE
+
+/*
+ * Hold the decoder thread across a transmit and only stop the PWM stream.
+ * Receive resumes without the decoder stop and start handshake.
+ */
+#define PKT_RX_FAST_TURNAROUND          TRUE
+
+/*
+ * Receive 2FSK using the radio 2FSK demodulator and clock recovery.
+ * The recovered data is decoded through the PWM decoder path.
+ * Long runs at 9600 baud need 16 bit PWM (USE_12_BIT_PWM FALSE).
+ */
+#define PKT_RX_USE_2FSK                 FALSE
+#define PKT_RX_2FSK_SPEED               9600U
+
+/*
+ * Receive duty cycle.
+ * The radio is put in standby between receive windows to save power.
+ * The cycle alternates on and off periods. A zero period disables cycling.
+ * An echo window keeps receive on after transmit for digipeat echoes.
+ * Windows can also be scheduled by the application (e.g. command windows).
+ */
+#define PKT_RX_USE_DUTY_CYCLE           TRUE
+#define PKT_RX_DUTY_ON_MS               0
+#define PKT_RX_DUTY_OFF_MS              0
+#define PKT_RX_ECHO_WINDOW_MS           0
+/* Number of scheduled receive windows. */
+#define PKT_RX_DUTY_WINDOWS             4U
+/* Retry interval when a packet is being received at an off transition. */
+#define PKT_RX_DUTY_BUSY_MS             100
+
+/*
+ * Transmit channel access using p-persistent CSMA (KISS PERSIST/SLOTTIME).
+ * On a clear channel a send starts with probability (PERSIST + 1) / 256.
+ * Otherwise it is deferred by a slot and other sends can use the radio.
+ * A send starts regardless once it has waited the maximum time.
+ */
+#define PKT_TX_CSMA_PERSIST             63U
+#define PKT_TX_CSMA_SLOT_MS             100
+#define PKT_TX_CSMA_MAX_WAIT_MS         10000
+
+/*
+ * Transmit time slots (TDMA) for trackers sharing a frequency.
+ * Sends start in the slot of the tracker by GPS set RTC time. None start
+ * in the guard time at the slot end so the packet on air ends in the slot.
+ */
+#define PKT_TX_TDMA_GUARD_MS            2000
+
+/*
+ * Receive frequency scan (FREQ_SCAN).
+ * The radio manager steps through the APRS frequencies listening on each.
+ * RSSI at or above the squelch (or the scan RSSI if none) extends the dwell.
+ * A channel with decoded frames is held while frames continue to be heard.
+ */
+#define PKT_RX_USE_SCAN                 TRUE
+#define PKT_RX_SCAN_LISTEN_MS           1500
+#define PKT_RX_SCAN_ACTIVE_MS           5000
+#define PKT_RX_SCAN_HOLD_MS             300000
+#define PKT_RX_SCAN_SAMPLE_MS           100
+#define PKT_RX_SCAN_RSSI                0x3C
+
+/*
+ * Adaptive squelch from the receive noise floor.
+ * RSSI is sampled while receive is idle and no frame is being received.
+ * The floor follows a drop quickly and a rise slowly so signals do not
+ * pull it up. The receive squelch and the transmit CCA level are set to
+ * the floor plus the margin when above the configured level.
+ * The active level is only changed by more than the hysteresis.
+ * RSSI counts are 0.5dB.
+ */
+#define PKT_RX_USE_NOISE_FLOOR          TRUE
+#define PKT_RX_NOISE_SAMPLE_MS          1000
+#define PKT_RX_NOISE_MARGIN             12
+#define PKT_RX_NOISE_HYSTERESIS         4
+#define PKT_RX_NOISE_MIN_SQUELCH        0x20
+#define PKT_RX_NOISE_MAX_SQUELCH        0x80
+
+/*
+ * Recover received frames with a bad CRC by inverting one bit or two
+ * adjacent bits (a single NRZI error). The bits are found from the CRC
+ * syndrome in one pass over the frame. A repaired frame must have valid
+ * AX.25 addresses and a UI control field or it is dropped as before.
+ * Recovery is skipped while more than the set number of received frames
+ * wait for the callback workers.
+ */
+#define PKT_RX_FIX_BITS                 TRUE
+#define PKT_RX_FIX_BITS_QUEUED          0
+
+/*
+ * FX.25 forward error correction.
+ * Transmitted frames are sent in the smallest FX.25 block which holds
+ * them. Frames too large for a block are sent as plain HDLC. Receivers
+ * without FX.25 decode the HDLC frame inside the block.
+ * Received FX.25 blocks are corrected and used when plain HDLC decoding
+ * of the frame fails. The blocks have 32 check bytes (RS(255,223) of the
+ * SSDV codec) which correct up to 16 byte errors.
+ */
+#define PKT_TX_USE_FX25                 TRUE
+#define PKT_RX_USE_FX25                 TRUE
+
+/*
+ * IL2P framing.
+ * Image and log packets are sent as IL2P frames when their link setting
+ * is LINK_IL2P. There is no bit stuffing and the header of a UI frame
+ * with two addresses is compacted. Header and payload blocks have 32
+ * check bytes (RS(255,223) of the SSDV codec) so the frames are only
+ * decoded by stations using this framing.
+ * Received IL2P frames are rebuilt as AX.25 frames.
+ */
+#define PKT_TX_USE_IL2P                 TRUE
+#define PKT_RX_USE_IL2P                 TRUE
+
+/*
+ * Software data carrier detect.
+ * The decoder counts HDLC flags and tone transitions over a window of
+ * symbols. A window has carrier with enough flags or if enough of the
+ * transitions are at the symbol clock or at the phase of the transition
+ * before (a clock offset). Noise has about a quarter of each. A session
+ * is ended after the hold count of windows without carrier.
+ * If CCA is still asserted the channel is qualified again so the radio
+ * squelch can be set low with the CPU only held by real signals.
+ * The lock threshold is the percentage of transitions.
+ */
+#define PKT_RX_USE_SOFT_DCD             TRUE
+#define PKT_RX_DCD_WINDOW               32
+#define PKT_RX_DCD_FLAGS                2
+#define PKT_RX_DCD_LOCK                 40
+#define PKT_RX_DCD_HOLD                 3
+
+/*
+ * PWM period tone discriminator.
+ * The tone is taken from the length of each PWM half cycle without the
+ * correlator filters and the votes of the last decode samples. Strong
+ * signals are decoded at under half the correlator cost. While searching
+ * for a frame each window of half cycles selects the discriminator if no
+ * more than the outlier percentage are outside the tone lengths (by the
+ * tolerance percentage) and the correlator otherwise. A frame keeps the
+ * decoder it started with. Weak frames a clean preamble hands to the
+ * discriminator are lost so it is off where sensitivity matters most.
+ */
+#define PKT_RX_USE_PERIOD_DISC          FALSE
+#define PKT_RX_PERIOD_WINDOW            64
+#define PKT_RX_PERIOD_OUTLIERS          0
+#define PKT_RX_PERIOD_TOLERANCE         15
+#define PKT_RX_PERIOD_VOTES             5
+
+/*
+ * Decoder priority boost.
+ * A session is decoded below the shell, USB and watchdog threads. When the
+ * PWM entries waiting to be decoded (in the ring and the linked buffers)
+ * reach the boost depth the decoder is raised above them until the backlog
+ * is down to the release depth. Threads at low priority such as SSDV image
+ * encoding are pre-empted by the decoder at either priority.
+ */
+#define PKT_RX_USE_DECODER_BOOST        TRUE
+#define PKT_RX_BOOST_DEPTH              800
+#define PKT_RX_BOOST_RELEASE            200
+
 /*
  * Number of general AX25/APRS processing & frame send buffers.
  * Can configured as being in CCM to save system core memory use.
+ * Buffers are in size classes by frame length.
+ * Small for beacons and telemetry, medium for SSDV and max for any frame.
  */
-#define NUMBER_COMMON_PKT_BUFFERS       10U
+#define NUMBER_SMALL_PKT_BUFFERS        8U
+#define NUMBER_MEDIUM_PKT_BUFFERS       12U
+#define NUMBER_MAX_PKT_BUFFERS          2U
+#define NUMBER_COMMON_PKT_BUFFERS       (NUMBER_SMALL_PKT_BUFFERS +           \
+                                         NUMBER_MEDIUM_PKT_BUFFERS +          \
+                                         NUMBER_MAX_PKT_BUFFERS)
 #define RESERVE_BUFFERS_FOR_INTERNAL    2U
-#define MAX_BUFFERS_FOR_BURST_SEND      5U
+#define MAX_BUFFERS_FOR_BURST_SEND      10U
 #if (MAX_BUFFERS_FOR_BURST_SEND >                                            \
     (NUMBER_COMMON_PKT_BUFFERS - RESERVE_BUFFERS_FOR_INTERNAL))
 #warning "Can not allocate requested buffers for burst send - set to 50%"
@@ -232,6 +505,15 @@
 #define PKT_SVC_USE_RADIO1  TRUE
 #define PKT_SVC_USE_RADIO2  FALSE
 
+/*
+ * Radio used for all transmit when the board has more than one radio.
+ * The other radios then receive without pausing for transmit.
+ * Transmit falls back to any radio for the frequency if this radio is not
+ * on the board or can not be used.
+ * PKT_RADIO_NONE shares each radio between receive and transmit.
+ */
+#define PKT_TX_OFFLOAD_RADIO    PKT_RADIO_2
+
 /*===========================================================================*/
 /* Derived constants and error checks.                                       */
 /*===========================================================================*/
@@ -253,6 +535,10 @@ extern const radio_band_t band_70cm;
 extern const radio_config_t radio_list[];
 extern pkt_service_t RPKTD1;
 extern AFSKDemodDriver AFSKD1;
+#if PKT_SVC_USE_RADIO2 == TRUE
+extern pkt_service_t RPKTD2;
+extern AFSKDemodDriver AFSKD2;
+#endif
 
 #ifdef __cplusplus
 extern "C" {
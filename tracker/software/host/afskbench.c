@@ -0,0 +1,344 @@
+/**
+  * Offline benchmark of the AFSK decoder.
+  * Runs the firmware DSP chain (afskdsp.c, corr_q31.c, firfilter_q31.c,
+  * rxhdlc.c) over recordings and reports the frames decoded and the time
+  * the decoder takes per second of signal.
+  *
+  * Inputs are PWM recordings as made with AFSK_PWM_REPLAY_CAPTURE_DEBUG or
+  * 16 bit PCM WAV files. WAV audio is sliced at zero the same as the radio
+  * does and the run lengths are converted to ICU counts.
+  *
+  * Times are nanoseconds of host CPU time. They compare decoder versions,
+  * they are not cycles of the STM32.
+  */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pktconf.h"
+#include "shim.h"
+
+typedef struct {
+	uint32_t	entries;
+	uint32_t	dropped;
+	uint32_t	sessions;
+	uint32_t	frames;
+	uint32_t	good;
+	uint64_t	counts;		/* ICU counts of signal */
+} bench_result_t;
+
+typedef struct {
+	bool		active;		/* Session open */
+	bool		skip;		/* Drop entries until the next session */
+	bool		restart;	/* Open a new session after a frame (WAV) */
+} bench_session_t;
+
+static AFSKDemodDriver bench_afsk;
+static packet_svc_t bench_handler;
+static pkt_data_object_t bench_packet;
+static ax25char_t bench_buffer[PKT_RX_BUFFER_SIZE];
+static bool verbose;
+
+static void printFrame(uint32_t n, pkt_data_object_t *pkt)
+{
+	bool good = pktIsBufferGoodCRC(pkt);
+	printf("frame %u: %zu bytes, CRC %s, tone level %u, PLL lock %u%%",
+		   n, pkt->packet_size, good ? "ok" : "bad",
+		   pkt->quality.tone_level, pkt->quality.pll_lock);
+
+	/* Source and destination address, shifted left by one in the frame. */
+	if(good && pkt->packet_size >= PKT_MIN_FRAME) {
+		char call[2][PKT_DS_ADDRESS_LEN + 3];
+		int a;
+		for(a = 0; a < 2; a++) {
+			const ax25char_t *f = &pkt->buffer[a * PKT_DS_ADDRESS_LEN];
+			int i, n = 0;
+			for(i = 0; i < 6 && (f[i] >> 1) != ' '; i++)
+				call[a][n++] = f[i] >> 1;
+			uint8_t ssid = (f[6] >> 1) & 0x0F;
+			n += sprintf(&call[a][n], ssid ? "-%u" : "", ssid);
+			call[a][n] = 0;
+		}
+		printf(", %s>%s", call[PKT_SOURCE], call[PKT_DESTINATION]);
+	}
+	printf("\n");
+}
+
+static void openSession(bench_session_t *s, bench_result_t *r)
+{
+	bench_packet.buffer = bench_buffer;
+	bench_packet.buffer_size = sizeof(bench_buffer);
+	bench_packet.status = 0;
+	memset(&bench_packet.quality, 0, sizeof(bench_packet.quality));
+	pktResetDataCount(&bench_packet);
+	bench_handler.active_packet_object = &bench_packet;
+	memset(&bench_afsk.quality, 0, sizeof(afsk_quality_t));
+	s->active = true;
+	r->sessions++;
+}
+
+/*
+ * End the session as the decoder thread does in its RESET state.
+ */
+static void closeSession(bench_session_t *s)
+{
+	if(!s->active)
+		return;
+	bench_handler.active_packet_object = NULL;
+	pktResetAFSKDecoder(&bench_afsk);
+	s->active = false;
+}
+
+/*
+ * Decode one PWM entry. Follows the ACTIVE and DISPATCH states of
+ * pktAFSKDecoder() and the session handling of pktReplayPWM().
+ */
+static void decodeEntry(byte_packed_pwm_t pack, bench_session_t *s,
+						bench_result_t *r)
+{
+	array_min_pwm_counts_t stream;
+	pktUnpackPWMData(pack, &stream);
+
+	if(stream.pwm.impulse == PWM_IN_BAND_PREFIX) {
+		/* Buffer swaps belong to the stream that was recorded. */
+		if(stream.pwm.valley == PWM_INFO_QUEUE_SWAP)
+			return;
+		closeSession(s);
+		s->skip = false;
+		return;
+	}
+	if(s->skip) {
+		r->dropped++;
+		return;
+	}
+	if(!s->active)
+		openSession(s, r);
+
+	r->entries++;
+	r->counts += stream.pwm.impulse + stream.pwm.valley;
+
+	if(!pktProcessAFSK(&bench_afsk, stream.array)) {
+		/* Buffer full. */
+		closeSession(s);
+		s->skip = !s->restart;
+		return;
+	}
+#if PKT_RX_USE_SOFT_DCD == TRUE
+	if(pktIsAFSKCarrierLost(&bench_afsk)) {
+		/* The radio side qualifies CCA again (WAV restarts). */
+		bench_afsk.stats.dcd_drops++;
+		closeSession(s);
+		s->skip = !s->restart;
+		return;
+	}
+#endif
+	switch(bench_afsk.frame_state) {
+	case FRAME_RESET:
+		closeSession(s);
+		s->skip = !s->restart;
+		break;
+
+	case FRAME_CLOSE:
+		pktAddAFSKDispatchLatency(&bench_afsk.stats);
+		pktSetAFSKFrameQuality(&bench_afsk, &bench_packet);
+		r->frames++;
+		if(pktIsBufferGoodCRC(&bench_packet))
+			r->good++;
+		if(verbose)
+			printFrame(r->frames, &bench_packet);
+		closeSession(s);
+		s->skip = !s->restart;
+		break;
+
+	default:
+		break;
+	}
+}
+
+/*
+ * Replay a PWM recording.
+ */
+static int readPWM(FILE *f, bench_result_t *r)
+{
+	bench_session_t s = {0};
+	byte_packed_pwm_t pack;
+	while(fread(pack.bytes, sizeof(pack), 1, f) == 1)
+		decodeEntry(pack, &s, r);
+	closeSession(&s);
+	return 0;
+}
+
+static uint32_t getLE(const uint8_t *p, int n)
+{
+	uint32_t v = 0;
+	while(n--)
+		v = (v << 8) | p[n];
+	return v;
+}
+
+/*
+ * Slice a WAV file into PWM. A run longer than the ICU timer ends the
+ * session as an ICU overflow does on the radio.
+ */
+static int readWAV(FILE *f, bench_result_t *r)
+{
+	uint8_t hdr[12];
+	if(fread(hdr, sizeof(hdr), 1, f) != 1 || memcmp(hdr, "RIFF", 4)
+	   || memcmp(&hdr[8], "WAVE", 4)) {
+		fprintf(stderr, "not a WAV file\n");
+		return -1;
+	}
+
+	uint32_t rate = 0;
+	uint16_t channels = 0, bits = 0;
+	uint8_t chunk[8];
+	while(fread(chunk, sizeof(chunk), 1, f) == 1) {
+		uint32_t size = getLE(&chunk[4], 4);
+		if(!memcmp(chunk, "fmt ", 4)) {
+			uint8_t fmt[16];
+			if(size < sizeof(fmt) || fread(fmt, sizeof(fmt), 1, f) != 1)
+				break;
+			channels = getLE(&fmt[2], 2);
+			rate = getLE(&fmt[4], 4);
+			bits = getLE(&fmt[14], 2);
+			fseek(f, size - sizeof(fmt) + (size & 1), SEEK_CUR);
+		} else if(!memcmp(chunk, "data", 4)) {
+			break;
+		} else {
+			fseek(f, size + (size & 1), SEEK_CUR);
+		}
+	}
+	if(rate == 0 || channels == 0 || bits != 16) {
+		fprintf(stderr, "only 16 bit PCM WAV files are supported\n");
+		return -1;
+	}
+
+	bench_session_t s = {.restart = true};
+	int16_t frame[channels];
+	bool level = false;
+	icucnt_t run[2] = {0, 0};
+	uint64_t frac = 0;
+	while(fread(frame, sizeof(frame), 1, f) == 1) {
+		/* First channel only. */
+		bool high = frame[0] > 0;
+		frac += ICU_COUNT_FREQUENCY;
+		icucnt_t counts = frac / rate;
+		frac -= (uint64_t)counts * rate;
+
+		if(high && !level) {
+			/* Rising edge closes a period of impulse and valley. */
+			if(run[0] != 0 && run[1] != 0) {
+				byte_packed_pwm_t pack;
+				pktConvertCaptureToPWM(run[0], run[0] + run[1], &pack);
+				decodeEntry(pack, &s, r);
+			}
+			run[0] = run[1] = 0;
+		}
+		level = high;
+		run[!high] += counts;
+		if(run[!high] > 0xFFFF) {
+			closeSession(&s);
+			run[0] = run[1] = 0;
+			/* Wait for the next rising edge. */
+			level = true;
+		}
+	}
+	closeSession(&s);
+	return 0;
+}
+
+static void printStats(const bench_result_t *r, double cpu_s)
+{
+	const afsk_decoder_stats_t *st = &bench_afsk.stats;
+	double signal_s = (double)r->counts / ICU_COUNT_FREQUENCY;
+
+	printf("sessions %u, PWM entries %u, dropped %u\n",
+		   r->sessions, r->entries, r->dropped);
+	printf("frames %u, good CRC %u\n", r->frames, r->good);
+	printf("carrier detect drops %u\n", st->dcd_drops);
+	printf("period discriminator fallbacks %u\n", st->period_fallbacks);
+	printf("signal %.3f s, samples %u, symbols %u\n",
+		   signal_s, st->samples, st->symbols);
+	printf("decoder %.3f ms, %.0f ns per signal second, %.1fx real time\n",
+		   st->process_cycles / 1e6,
+		   signal_s > 0 ? st->process_cycles / signal_s : 0.0,
+		   st->process_cycles > 0 ? signal_s * 1e9 / st->process_cycles : 0.0);
+	printf("total %.3f ms\n", cpu_s * 1e3);
+
+	printf("%-10s %10s %10s %10s\n", "stage", "count", "avg ns", "peak ns");
+	afsk_stage_t i;
+	for(i = 0; i < AFSK_STAGE_COUNT; i++) {
+		const afsk_stage_stats_t *sp = &st->stage[i];
+		if(sp->count == 0)
+			continue;
+		printf("%-10s %10u %10.0f %10u\n", pktGetAFSKStageName(i), sp->count,
+			   (double)sp->total / sp->count, sp->peak);
+	}
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+			"usage: %s [-v] [-p] file...\n"
+			"  -v  print each frame\n"
+			"  -p  files are PWM recordings (default: by .wav extension)\n",
+			name);
+}
+
+int main(int argc, char *argv[])
+{
+	bool pwm = false;
+	int opt;
+	while((opt = getopt(argc, argv, "vp")) != -1) {
+		switch(opt) {
+		case 'v':
+			verbose = true;
+			break;
+		case 'p':
+			pwm = true;
+			break;
+		default:
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	if(optind >= argc) {
+		usage(argv[0]);
+		return 2;
+	}
+
+	bench_handler.radio = PKT_RADIO_1;
+	bench_handler.link_controller = &bench_afsk;
+	bench_afsk.packet_handler = &bench_handler;
+	hostInit(&bench_handler);
+	pktClearAFSKStats(&bench_afsk.stats);
+	pktInitAFSKDSP(&bench_afsk);
+	pktResetAFSKDecoder(&bench_afsk);
+
+	bench_result_t result = {0};
+	clock_t start = clock();
+	int i;
+	for(i = optind; i < argc; i++) {
+		FILE *f = fopen(argv[i], "rb");
+		if(f == NULL) {
+			fprintf(stderr, "%s: %s\n", argv[i], strerror(errno));
+			return 1;
+		}
+		const char *ext = strrchr(argv[i], '.');
+		bool wav = !pwm && ext != NULL && !strcasecmp(ext, ".wav");
+		int err = wav ? readWAV(f, &result) : readPWM(f, &result);
+		fclose(f);
+		if(err) {
+			fprintf(stderr, "%s: failed\n", argv[i]);
+			return 1;
+		}
+	}
+
+	printStats(&result, (double)(clock() - start) / CLOCKS_PER_SEC);
+	return result.frames > 0 ? 0 : 1;
+}
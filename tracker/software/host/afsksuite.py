@@ -0,0 +1,149 @@
+# AFSK decode rate benchmark suite.
+#
+# Generates the reference recordings and runs the host decoder build
+# (make bench) over them. Prints the packets decoded and the decoder time
+# per packet for each recording and a total score of packets decoded.
+#
+# The recordings are 1200 baud AFSK as WAV files with graded
+#   - SNR (white noise over the audio band)
+#   - twist, the space tone level relative to mark. Negative is a
+#     de-emphasised transmitter, positive a pre-emphasised one.
+#   - clock offset of the transmitter, which scales baud rate and tones.
+# They are made from a fixed seed so they are the same on every run.
+#
+# Usage: python3 host/afsksuite.py [--bench PATH] [--dir DIR] [--min SCORE]
+# Run from tracker/software. make bench-suite builds and runs it.
+
+import argparse
+import math
+import os
+import random
+import re
+import struct
+import subprocess
+import sys
+import wave
+
+RATE = 48000
+BAUD = 1200
+MARK = 1200
+SPACE = 2200
+FRAMES = 25
+SEED = 1200
+
+# (set, name, snr dB or None for no noise, twist dB, clock offset ppm)
+SUITE = [('snr', 'clean', None, 0, 0)] \
+	+ [('snr', '%d dB' % s, s, 0, 0) for s in (20, 15, 12, 10, 8, 6, 4)] \
+	+ [('twist', '%+d dB' % t, 12, t, 0) for t in (-9, -6, -3, 3, 6)] \
+	+ [('clock', '%+d ppm' % c, 12, 0, c) for c in (-20000, -10000, 10000, 20000)]
+
+def crc16(data):
+	crc = 0xFFFF
+	for b in data:
+		crc ^= b
+		for _ in range(8):
+			crc = (crc >> 1) ^ 0x8408 if crc & 1 else crc >> 1
+	return ~crc & 0xFFFF
+
+def address(call, ssid, last):
+	return bytes(ord(c) << 1 for c in call.ljust(6)) \
+		+ bytes([0x60 | (ssid << 1) | (1 if last else 0)])
+
+def frame(rnd, n):
+	info = '!%04.2fS/%05.2fE-suite frame %d %s' % (rnd.uniform(0, 9000),
+		rnd.uniform(0, 18000), n, 'x' * rnd.randint(0, 150))
+	f = address('APRS', 0, False) + address('VK2GJ', 11, True) \
+		+ bytes([0x03, 0xF0]) + info.encode()
+	crc = crc16(f)
+	return f + bytes([crc & 0xFF, crc >> 8])
+
+def hdlc(data):
+	# Bits LSB first with a zero stuffed after five ones.
+	bits = []
+	ones = 0
+	for b in data:
+		for i in range(8):
+			bit = (b >> i) & 1
+			bits.append(bit)
+			ones = ones + 1 if bit else 0
+			if ones == 5:
+				bits.append(0)
+				ones = 0
+	return bits
+
+def generate(path, snr, twist, ppm, seed):
+	rnd = random.Random(seed)
+	clock = 1.0 + ppm / 1e6
+	space = math.pow(10, twist / 20.0)
+	flag = [0, 1, 1, 1, 1, 1, 1, 0]
+	# Signal power of the louder tone is the reference for the noise.
+	amp = 1.0 / max(1.0, space)
+	signal_power = (amp * amp * (1 + space * space) / 2) / 2
+	sigma = 0.0 if snr is None else math.sqrt(signal_power / math.pow(10, snr / 10.0))
+	samples = []
+	phase = 0.0
+	tone = 0
+	for n in range(FRAMES):
+		gap = int(RATE * rnd.uniform(0.1, 0.3))
+		samples.extend(rnd.gauss(0, sigma) if sigma else 0.0 for _ in range(gap))
+		bits = flag * rnd.randint(20, 40) + hdlc(frame(rnd, n)) + flag * 3
+		spb = RATE / (BAUD * clock)
+		acc = 0.0
+		for b in bits:
+			# NRZI, a zero changes the tone.
+			if b == 0:
+				tone ^= 1
+			step = 2 * math.pi * (SPACE if tone else MARK) * clock / RATE
+			level = amp * (space if tone else 1.0)
+			acc += spb
+			for _ in range(int(acc)):
+				phase += step
+				samples.append(level * math.sin(phase) + (rnd.gauss(0, sigma) if sigma else 0.0))
+			acc -= int(acc)
+	samples.extend(rnd.gauss(0, sigma) if sigma else 0.0 for _ in range(RATE // 4))
+	peak = max(abs(s) for s in samples)
+	with wave.open(path, 'wb') as w:
+		w.setnchannels(1)
+		w.setsampwidth(2)
+		w.setframerate(RATE)
+		w.writeframes(b''.join(struct.pack('<h', int(s / peak * 30000)) for s in samples))
+
+def run(bench, path):
+	out = subprocess.run([bench, path], stdout=subprocess.PIPE,
+		universal_newlines=True).stdout
+	good = int(re.search(r'good CRC (\d+)', out).group(1))
+	ns = float(re.search(r'decoder ([\d.]+) ms', out).group(1)) * 1e6
+	signal = float(re.search(r'signal ([\d.]+) s', out).group(1))
+	return good, ns, signal
+
+def main():
+	p = argparse.ArgumentParser(description='AFSK decode rate benchmark suite')
+	p.add_argument('--bench', default='build/afskbench/afskbench')
+	p.add_argument('--dir', default='build/afskbench/suite')
+	p.add_argument('--min', type=int, default=0,
+		help='fail if fewer packets are decoded')
+	a = p.parse_args()
+
+	os.makedirs(a.dir, exist_ok=True)
+	score = total = 0
+	ns_total = 0.0
+	current = None
+	for i, (group, name, snr, twist, ppm) in enumerate(SUITE):
+		path = os.path.join(a.dir, '%s_%s.wav' % (group, re.sub(r'\W+', '', name)))
+		if not os.path.exists(path):
+			generate(path, snr, twist, ppm, SEED + i)
+		good, ns, signal = run(a.bench, path)
+		if group != current:
+			current = group
+			print('\n%-8s %-10s %8s %8s %12s %12s' % (group, '', 'decoded', 'of',
+				'us/packet', 'us/signal s'))
+		print('%-8s %-10s %8d %8d %12.1f %12.1f' % ('', name, good, FRAMES,
+			ns / good / 1e3 if good else 0, ns / signal / 1e3 if signal else 0))
+		score += good
+		total += FRAMES
+		ns_total += ns
+	print('\nscore %d of %d packets, decoder %.1f ms' % (score, total, ns_total / 1e6))
+	return 0 if score >= a.min else 1
+
+if __name__ == '__main__':
+	sys.exit(main())
@@ -0,0 +1,617 @@
+/**
+  * Ingest of tracker packets for the ground station (decoder/ingest.py).
+  * APRS-IS servers and serial receivers are read at the same time. A
+  * receiver gives TNC2 monitor lines or KISS frames. Packets are parsed by
+  * ax25_pad.c and their data points decoded by dpdec.c so the ground
+  * station reads packets with the code which makes them on the tracker.
+  *
+  * A packet heard by several receivers or gated by several iGates is
+  * passed once. Copies are matched by source, destination and information
+  * field within the dedupe window as ax25_dedupe_crc() does for the
+  * digipeater. A 32 bit hash is added to its 16 bit CRC as the window of
+  * a busy feed holds many packets.
+  *
+  * Records are written to stdout, one per line with tab separated fields.
+  * Each read of the sources is flushed at once.
+  *   P <call> <receiver> <pos|log> <values of DATAPOINT_FIELDS>
+  *   I <call> <receiver> <image packet in hex>
+  *   D <call> <directs>
+  *
+  * The kernel runs for the packet pools of ax25_pad.c only. The main
+  * thread never waits in the kernel so no other thread runs.
+  */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ch.h"
+#include "hal.h"
+#include "pktconf.h"
+#include "debug.h"
+#include "sim.h"
+#include "dpdec.h"
+
+#define IN_MAX_SOURCES		8
+#define IN_BUF_SIZE			(AX25_MAX_PACKET_LEN + 2)
+#define IN_DEDUPE_SIZE		4096		/* Power of 2 */
+#define IN_DEDUPE_PROBES	32
+#define IN_DEDUPE_TIME		30			/* s */
+#define IN_APRSIS_TIMEOUT	60			/* s without data, servers send a comment every 20 s */
+#define IN_RETRY_TIME		10			/* s */
+#define IN_STATS_TIME		600			/* s */
+#define IN_DEST				"APECAN"
+#define IN_IMAGE_SIZE		174			/* Image ID, packet ID and SSDV payload */
+
+#define KISS_FEND			0xC0
+#define KISS_FESC			0xDB
+#define KISS_TFEND			0xDC
+#define KISS_TFESC			0xDD
+
+typedef enum {
+	IN_APRSIS,
+	IN_TNC2,
+	IN_KISS
+} in_type_t;
+
+typedef struct {
+	in_type_t	type;
+	char		*name;			/* host:port or device, - for stdin */
+	speed_t		baud;
+	int			fd;
+	time_t		last;			/* Last data */
+	time_t		retry;			/* Next open */
+	uint8_t		buf[IN_BUF_SIZE];
+	size_t		len;
+	bool		escape;			/* KISS escape received */
+	bool		drop;			/* Rest of an overlong line or frame */
+	uint32_t	passed;
+	uint32_t	dups;
+	uint32_t	errors;			/* Packets not parsed or decoded */
+} in_source_t;
+
+typedef struct {
+	uint64_t	key;
+	time_t		expiry;
+} in_seen_t;
+
+static in_source_t in_sources[IN_MAX_SOURCES];
+static uint8_t in_num_sources;
+static in_seen_t in_seen[IN_DEDUPE_SIZE];
+static time_t in_dedupe_time = IN_DEDUPE_TIME;
+static const char *in_call = "DL7AD";
+
+static const char *const in_type_names[] = {
+	"APRS-IS", "TNC2", "KISS"
+};
+
+static time_t now_s(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec;
+}
+
+/*
+ * Same as in pktservice.c without the semaphore of the send buffers.
+ * Packets are released before the next is parsed.
+ */
+msg_t pktGetPacketBuffer(packet_t *pp, uint16_t frame_len,
+						 sysinterval_t timeout) {
+	(void)timeout;
+	*pp = ax25_new(frame_len);
+	return *pp == NULL ? MSG_TIMEOUT : MSG_OK;
+}
+
+void pktReleasePacketBuffer(packet_t pp) {
+	if(ax25_is_view(pp) || !ax25_unref(pp))
+		return;
+	ax25_delete(pp);
+}
+
+/*
+ * Source callsign of a tracker, also filters badly gated packets.
+ * Two letters, a digit, one to three letters and an optional SSID.
+ */
+static bool is_tracker_call(const char *call) {
+	const char *p = call;
+	int n;
+	for(n = 0; n < 2; n++, p++)
+		if(*p < 'A' || *p > 'Z')
+			return false;
+	if(*p < '0' || *p > '9')
+		return false;
+	p++;
+	for(n = 0; *p >= 'A' && *p <= 'Z'; n++, p++);
+	if(n < 1 || n > 3)
+		return false;
+	if(*p == '\0')
+		return true;
+	if(*p++ != '-')
+		return false;
+	for(n = 0; *p >= '0' && *p <= '9'; n++, p++);
+	return n >= 1 && n <= 2 && *p == '\0';
+}
+
+/*
+ * Check a packet against the packets of the dedupe window and remember it.
+ * When the probes are full the record expiring first is replaced.
+ */
+static bool is_duplicate(uint64_t key, time_t now) {
+	uint32_t home = (uint32_t)(key ^ (key >> 32)) & (IN_DEDUPE_SIZE - 1);
+	in_seen_t *slot = NULL, *oldest = &in_seen[home];
+	for(uint32_t i = 0; i < IN_DEDUPE_PROBES; i++) {
+		in_seen_t *s = &in_seen[(home + i) & (IN_DEDUPE_SIZE - 1)];
+		if(s->expiry <= now) {
+			if(slot == NULL)
+				slot = s;
+			continue;
+		}
+		if(s->key == key)
+			return true;
+		if(s->expiry < oldest->expiry)
+			oldest = s;
+	}
+	if(slot == NULL)
+		slot = oldest;
+	slot->key = key;
+	slot->expiry = now + in_dedupe_time;
+	return false;
+}
+
+/* FNV-1a */
+static uint32_t hash_add(uint32_t h, const void *data, size_t len) {
+	const uint8_t *d = data;
+	while(len--)
+		h = (h ^ *d++) * 16777619U;
+	return h;
+}
+
+static uint64_t dedupe_key(packet_t pp, const char *call, const char *dest,
+						   const uint8_t *info, size_t len) {
+	uint32_t h = hash_add(2166136261U, call, strlen(call) + 1);
+	h = hash_add(h, dest, strlen(dest) + 1);
+	h = hash_add(h, info, len);
+	return (uint64_t)ax25_dedupe_crc(pp) << 32 | h;
+}
+
+static void emit_points(const char *call, const char *rxer, const char *org,
+						const char *text, size_t len, bool records) {
+	uint32_t fields = dpdec_field_count();
+	size_t max = records ? len / 2 + 1 : 1;
+	int64_t *values = malloc(max * fields * sizeof(int64_t));
+	if(values == NULL) {
+		perror("malloc");
+		exit(1);
+	}
+	size_t count = dpdec_packet(text, len, records, values, max);
+	for(size_t i = 0; i < count; i++) {
+		printf("P\t%s\t%s\t%s\t", call, rxer, org);
+		for(uint32_t f = 0; f < fields; f++)
+			printf(f ? ",%lld" : "%lld", (long long)values[i * fields + f]);
+		printf("\n");
+	}
+	free(values);
+	if(count == 0)
+		TRACE_ERROR("IN   > Erroneous %s packet from %s", org, call);
+}
+
+static bool emit_image(const char *call, const char *rxer, const char *text,
+					   size_t len) {
+	uint8_t data[len * 7 / 8 + 1];
+	if(dpdec_base91(text, len, data) != IN_IMAGE_SIZE)
+		return false;
+	printf("I\t%s\t%s\t", call, rxer);
+	for(uint32_t i = 0; i < IN_IMAGE_SIZE; i++)
+		printf("%02x", data[i]);
+	printf("\n");
+	return true;
+}
+
+/*
+ * Pass a parsed packet of a tracker. Other packets are ignored.
+ */
+static void handle_packet(in_source_t *src, packet_t pp) {
+	char dest[AX25_MAX_ADDR_LEN], call[AX25_MAX_ADDR_LEN];
+	char rxer[AX25_MAX_ADDR_LEN];
+	uint8_t *info;
+
+	ax25_get_addr_no_ssid(pp, AX25_DESTINATION, dest);
+	if(strcmp(dest, IN_DEST) != 0)
+		return;
+	ax25_get_addr_with_ssid(pp, AX25_SOURCE, call);
+	if(!is_tracker_call(call))
+		return;
+	size_t len = ax25_get_info(pp, &info);
+	while(len > 0 && (info[len - 1] == '\r' || info[len - 1] == '\n'))
+		len--;
+
+	/* Kind of packet and its data. */
+	const char *text = (const char *)info;
+	const char *end = text + len;
+	char kind;
+	if(len > 14 && (text[0] == '!' || text[0] == '=')) {
+		/* Position with the point between the position and the first bar. */
+		const char *bar = memchr(text + 14, '|', end - text - 14);
+		if(bar == NULL || memchr(bar + 1, '|', end - bar - 1) == NULL)
+			return;
+		kind = 'P';
+		end = bar;
+		text += 14;
+	} else if(len > 3 && text[0] == '{' && text[1] == '{'
+			  && strchr("ILM", text[2]) != NULL) {
+		kind = text[2];
+		text += 3;
+	} else if(len >= 19 && text[0] == ':' && text[10] == ':'
+			  && memcmp(text + 11, "Directs=", 8) == 0) {
+		kind = 'D';
+		text += 19;
+	} else {
+		return;
+	}
+
+	time_t now = now_s();
+	if(is_duplicate(dedupe_key(pp, call, dest, info, len), now)) {
+		src->dups++;
+		return;
+	}
+	src->passed++;
+
+	/* The receiver is the iGate or the last digipeater of the path. */
+	int n = ax25_get_num_addr(pp);
+	if(n > AX25_REPEATER_1)
+		ax25_get_addr_with_ssid(pp, n - 1, rxer);
+	else
+		strlcpy(rxer, in_call, sizeof(rxer));
+
+	switch(kind) {
+	case 'P':
+		emit_points(call, rxer, "pos", text, end - text, false);
+		break;
+	case 'L':
+		emit_points(call, rxer, "log", text, end - text, false);
+		break;
+	case 'M':
+		emit_points(call, rxer, "log", text, end - text, true);
+		break;
+	case 'I':
+		if(!emit_image(call, rxer, text, end - text))
+			src->errors++;
+		break;
+	case 'D':
+		/* Control characters would split the record. */
+		printf("D\t%s\t", call);
+		for(; text < end; text++)
+			putchar((uint8_t)*text < ' ' ? '?' : *text);
+		printf("\n");
+		break;
+	}
+}
+
+static void handle_line(in_source_t *src, char *line) {
+	if(line[0] == '\0')
+		return;
+	if(line[0] == '#') {
+		/* APRS-IS server comment. */
+		TRACE_INFO("IN   > %s: %s", src->name, line);
+		return;
+	}
+	packet_t pp = ax25_from_text(line, 0);
+	if(pp == NULL) {
+		src->errors++;
+		return;
+	}
+	handle_packet(src, pp);
+	pktReleasePacketBuffer(pp);
+}
+
+static void handle_frame(in_source_t *src) {
+	/* Data frames of any port, the command byte is first. */
+	if(src->len < 2 || (src->buf[0] & 0x0F) != 0)
+		return;
+	packet_gen_t view;
+	packet_t pp = ax25_view_frame(&view, src->buf + 1, src->len - 1);
+	if(pp == NULL) {
+		src->errors++;
+		return;
+	}
+	handle_packet(src, pp);
+}
+
+static void receive_text(in_source_t *src, const uint8_t *data, size_t len) {
+	for(size_t i = 0; i < len; i++) {
+		uint8_t c = data[i];
+		if(c == '\r' || c == '\n') {
+			if(!src->drop) {
+				src->buf[src->len] = '\0';
+				handle_line(src, (char *)src->buf);
+			}
+			src->len = 0;
+			src->drop = false;
+		} else if(src->len < IN_BUF_SIZE - 1) {
+			src->buf[src->len++] = c;
+		} else {
+			src->drop = true;
+		}
+	}
+}
+
+static void receive_kiss(in_source_t *src, const uint8_t *data, size_t len) {
+	for(size_t i = 0; i < len; i++) {
+		uint8_t c = data[i];
+		if(c == KISS_FEND) {
+			if(!src->drop)
+				handle_frame(src);
+			src->len = 0;
+			src->drop = false;
+			src->escape = false;
+			continue;
+		}
+		if(src->escape) {
+			c = c == KISS_TFEND ? KISS_FEND : c == KISS_TFESC ? KISS_FESC : c;
+			src->escape = false;
+		} else if(c == KISS_FESC) {
+			src->escape = true;
+			continue;
+		}
+		/* The view needs a byte after the frame. */
+		if(src->len < IN_BUF_SIZE - 1)
+			src->buf[src->len++] = c;
+		else
+			src->drop = true;
+	}
+}
+
+static speed_t baud_rate(unsigned long baud) {
+	switch(baud) {
+	case 1200:		return B1200;
+	case 4800:		return B4800;
+	case 9600:		return B9600;
+	case 19200:		return B19200;
+	case 38400:		return B38400;
+	case 57600:		return B57600;
+	case 115200:	return B115200;
+	default:		return B0;
+	}
+}
+
+static int open_serial(in_source_t *src) {
+	if(strcmp(src->name, "-") == 0)
+		return STDIN_FILENO;
+	int fd = open(src->name, O_RDWR | O_NOCTTY | O_NONBLOCK);
+	if(fd < 0)
+		return -1;
+	struct termios tio;
+	if(tcgetattr(fd, &tio) == 0) {
+		cfmakeraw(&tio);
+		cfsetspeed(&tio, src->baud);
+		tio.c_cflag |= CLOCAL | CREAD;
+		tcsetattr(fd, TCSANOW, &tio);
+	}
+	return fd;
+}
+
+static int open_aprsis(in_source_t *src) {
+	char host[256];
+	strlcpy(host, src->name, sizeof(host));
+	char *port = strrchr(host, ':');
+	if(port == NULL)
+		return -1;
+	*port++ = '\0';
+
+	struct addrinfo hints = {
+		.ai_family = AF_UNSPEC,
+		.ai_socktype = SOCK_STREAM
+	}, *res, *ai;
+	if(getaddrinfo(host, port, &hints, &res) != 0)
+		return -1;
+	int fd = -1;
+	for(ai = res; ai != NULL && fd < 0; ai = ai->ai_next) {
+		fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if(fd < 0)
+			continue;
+		/* Connect gives up after the send timeout. */
+		struct timeval tv = { .tv_sec = 5 };
+		setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+		if(connect(fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+			close(fd);
+			fd = -1;
+		}
+	}
+	freeaddrinfo(res);
+	if(fd < 0)
+		return -1;
+
+	/* Receive only login with a filter for the trackers. */
+	char login[128];
+	int n = snprintf(login, sizeof(login),
+					 "user %s pass -1 vers aprsin 1.0 filter u/%s\r\n",
+					 in_call, IN_DEST);
+	if(write(fd, login, n) != n) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static void open_source(in_source_t *src, time_t now) {
+	src->fd = src->type == IN_APRSIS ? open_aprsis(src) : open_serial(src);
+	src->len = 0;
+	src->drop = false;
+	src->escape = false;
+	if(src->fd < 0) {
+		fprintf(stderr, "%s %s not opened, retry in %d s\n",
+				in_type_names[src->type], src->name, IN_RETRY_TIME);
+		src->retry = now + IN_RETRY_TIME;
+		return;
+	}
+	fprintf(stderr, "%s %s opened\n", in_type_names[src->type], src->name);
+	src->last = now;
+}
+
+static void close_source(in_source_t *src, time_t now, const char *reason) {
+	fprintf(stderr, "%s %s %s\n", in_type_names[src->type], src->name, reason);
+	/* Standard input is not opened again. */
+	if(src->fd != STDIN_FILENO) {
+		close(src->fd);
+		src->retry = now + IN_RETRY_TIME;
+	} else {
+		src->retry = (time_t)-1;
+	}
+	src->fd = -1;
+}
+
+static void print_stats(void) {
+	for(uint8_t i = 0; i < in_num_sources; i++) {
+		in_source_t *src = &in_sources[i];
+		fprintf(stderr, "%s %s: %u passed, %u duplicates, %u errors\n",
+				in_type_names[src->type], src->name, src->passed, src->dups,
+				src->errors);
+	}
+}
+
+static bool add_source(in_type_t type, char *arg) {
+	if(in_num_sources == IN_MAX_SOURCES)
+		return false;
+	in_source_t *src = &in_sources[in_num_sources];
+	src->type = type;
+	src->name = arg;
+	src->fd = -1;
+	src->baud = B9600;
+	if(type != IN_APRSIS) {
+		char *baud = strchr(arg, ':');
+		if(baud != NULL) {
+			*baud++ = '\0';
+			src->baud = baud_rate(strtoul(baud, NULL, 10));
+			if(src->baud == B0)
+				return false;
+		}
+	} else if(strchr(arg, ':') == NULL) {
+		return false;
+	}
+	in_num_sources++;
+	return true;
+}
+
+static void usage(const char *name) {
+	fprintf(stderr,
+		"usage: %s [-c call] [-w secs] [-v level] source...\n"
+		"  -i host:port     APRS-IS server\n"
+		"  -t device[:baud] receiver giving TNC2 monitor lines, - for stdin\n"
+		"  -k device[:baud] KISS receiver\n"
+		"  -c call          APRS-IS login and receiver of packets without path\n"
+		"  -w secs          dedupe window (%d)\n"
+		"  -v level         trace level\n",
+		name, IN_DEDUPE_TIME);
+}
+
+int main(int argc, char *argv[]) {
+	int opt;
+	sim_trace_level = 0;
+	while((opt = getopt(argc, argv, "i:t:k:c:w:v:")) != -1) {
+		bool ok = true;
+		switch(opt) {
+		case 'i':
+			ok = add_source(IN_APRSIS, optarg);
+			break;
+		case 't':
+			ok = add_source(IN_TNC2, optarg);
+			break;
+		case 'k':
+			ok = add_source(IN_KISS, optarg);
+			break;
+		case 'c':
+			in_call = optarg;
+			break;
+		case 'w':
+			in_dedupe_time = strtoul(optarg, NULL, 0);
+			break;
+		case 'v':
+			sim_trace_level = atoi(optarg);
+			break;
+		default:
+			ok = false;
+			break;
+		}
+		if(!ok) {
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	if(optind != argc || in_num_sources == 0) {
+		usage(argv[0]);
+		return 2;
+	}
+
+	chSysInit();
+	ax25_pool_init();
+	signal(SIGPIPE, SIG_IGN);
+
+	time_t now = now_s(), stats = now + IN_STATS_TIME;
+	for(uint8_t i = 0; i < in_num_sources; i++)
+		open_source(&in_sources[i], now);
+
+	while(true) {
+		struct pollfd fds[IN_MAX_SOURCES];
+		bool active = false;
+		for(uint8_t i = 0; i < in_num_sources; i++) {
+			fds[i].fd = in_sources[i].fd;
+			fds[i].events = POLLIN;
+			fds[i].revents = 0;
+			active |= in_sources[i].fd >= 0
+					  || in_sources[i].retry != (time_t)-1;
+		}
+		if(!active)
+			break;
+		if(poll(fds, in_num_sources, 1000) < 0 && errno != EINTR) {
+			perror("poll");
+			return 1;
+		}
+
+		now = now_s();
+		for(uint8_t i = 0; i < in_num_sources; i++) {
+			in_source_t *src = &in_sources[i];
+			if(src->fd < 0) {
+				if(src->retry != (time_t)-1 && now >= src->retry)
+					open_source(src, now);
+				continue;
+			}
+			if(fds[i].revents == 0) {
+				if(src->type == IN_APRSIS
+				   && now - src->last > IN_APRSIS_TIMEOUT)
+					close_source(src, now, "timed out");
+				continue;
+			}
+			uint8_t data[4096];
+			ssize_t n = read(src->fd, data, sizeof(data));
+			if(n < 0 && (errno == EAGAIN || errno == EINTR))
+				continue;
+			if(n <= 0) {
+				close_source(src, now, n == 0 ? "closed" : strerror(errno));
+				continue;
+			}
+			src->last = now;
+			if(src->type == IN_KISS)
+				receive_kiss(src, data, n);
+			else
+				receive_text(src, data, n);
+		}
+		if(fflush(stdout) != 0)
+			return 1;
+
+		if(now >= stats) {
+			print_stats();
+			stats = now + IN_STATS_TIME;
+		}
+	}
+	print_stats();
+	return 0;
+}
@@ -0,0 +1,13 @@
+/*
+ * Host stand-in for the CMSIS-DSP common tables.
+ * Only the sine table is used. It is filled by hostInit().
+ */
+
+#ifndef HOST_ARM_COMMON_TABLES_H_
+#define HOST_ARM_COMMON_TABLES_H_
+
+#include "arm_math.h"
+
+extern const float32_t sinTable_f32[FAST_MATH_TABLE_SIZE + 1];
+
+#endif /* HOST_ARM_COMMON_TABLES_H_ */
@@ -0,0 +1 @@
+/* Host build: ax25_dump.h is not used by the DSP chain. */
@@ -0,0 +1,104 @@
+/*
+ * Host stand-in for the ChibiOS kernel API.
+ * Only the types and calls reached by the AFSK DSP chain are provided.
+ * The decoder runs in a single thread so locks are empty and nothing waits.
+ */
+
+#ifndef HOST_CH_H_
+#define HOST_CH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define FALSE                   0
+#define TRUE                    1
+
+#define CH_CFG_ST_FREQUENCY     10000
+#define CH_CFG_FACTORY_MAX_NAMES_LENGTH 8
+
+typedef int32_t     msg_t;
+typedef uint32_t    eventflags_t;
+typedef uint32_t    eventmask_t;
+typedef uint32_t    sysinterval_t;
+typedef uint32_t    systime_t;
+typedef uint32_t    rtcnt_t;
+typedef uint32_t    tprio_t;
+typedef uint32_t    ucnt_t;
+
+#define MSG_OK                  (msg_t)0
+#define MSG_TIMEOUT             (msg_t)-1
+#define MSG_RESET               (msg_t)-2
+
+#define TIME_IMMEDIATE          ((sysinterval_t)0)
+#define TIME_INFINITE           ((sysinterval_t)-1)
+#define TIME_MS2I(msec)         ((sysinterval_t)(msec) * CH_CFG_ST_FREQUENCY / 1000)
+#define TIME_US2I(usec)         ((sysinterval_t)(usec) * CH_CFG_ST_FREQUENCY / 1000000)
+#define chTimeUS2I(usec)        TIME_US2I(usec)
+
+#define NORMALPRIO              128
+
+#define EVENT_MASK(eid)         ((eventmask_t)1 << (eventmask_t)(eid))
+
+typedef struct thread thread_t;
+typedef thread_t *thread_reference_t;
+
+typedef struct {
+  eventflags_t              flags;
+} event_source_t;
+
+typedef struct {
+  int32_t                   cnt;
+} binary_semaphore_t;
+
+typedef struct {
+  int32_t                   locked;
+} mutex_t;
+
+struct pool_header {
+  struct pool_header        *next;
+};
+
+typedef struct memory_heap memory_heap_t;
+
+typedef struct {
+  struct pool_header        *next;
+  size_t                    object_size;
+} memory_pool_t;
+
+typedef struct {
+  memory_pool_t             free;
+} objects_fifo_t;
+
+typedef struct {
+  objects_fifo_t            fifo;
+} dyn_objects_fifo_t;
+
+#define MUTEX_DECL(name)        mutex_t name = {0}
+
+#define chDbgAssert(c, r)       do { (void)(c); } while(false)
+#define chDbgCheck(c)           do { (void)(c); } while(false)
+
+#define chSysLock()
+#define chSysUnlock()
+#define chSysLockFromISR()
+#define chSysUnlockFromISR()
+#define chMtxLock(mp)           (void)(mp)
+#define chMtxUnlock(mp)         (void)(mp)
+
+#define chThdResumeI(trp, msg)  (void)(trp)
+#define chThdSuspendTimeoutS(trp, timeout) MSG_TIMEOUT
+
+#define chEvtBroadcastFlags(esp, fl)  ((esp)->flags |= (fl))
+#define chEvtBroadcastFlagsI(esp, fl) ((esp)->flags |= (fl))
+
+void *chPoolAllocI(memory_pool_t *mp);
+void chPoolFreeI(memory_pool_t *mp, void *objp);
+
+/*
+ * The realtime counter counts nanoseconds of process CPU time.
+ * The DSP statistics are in counter units the same as on target.
+ */
+rtcnt_t chSysGetRealtimeCounterX(void);
+
+#endif /* HOST_CH_H_ */
@@ -0,0 +1,12 @@
+/*
+ * Host stand-in for the ChibiOS formatted output.
+ */
+
+#ifndef HOST_CHPRINTF_H_
+#define HOST_CHPRINTF_H_
+
+#include <stdio.h>
+
+#define chsnprintf              snprintf
+
+#endif /* HOST_CHPRINTF_H_ */
@@ -0,0 +1,20 @@
+/*
+ * Host stand-in for the CMSIS core header.
+ * CMSIS-DSP is built for the generic (Cortex-M0) path which is plain C.
+ */
+
+#ifndef HOST_CORE_CM0_H_
+#define HOST_CORE_CM0_H_
+
+#include <stdint.h>
+
+#define __INLINE                inline
+#define __STATIC_INLINE         static inline
+#define __ASM                   __asm
+#define __FPU_USED              0U
+
+static inline uint32_t __CLZ(uint32_t v) {
+  return (v == 0) ? 32U : (uint32_t)__builtin_clz(v);
+}
+
+#endif /* HOST_CORE_CM0_H_ */
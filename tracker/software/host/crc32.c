@@ -0,0 +1,19 @@
+/*
+ * Software CRC-32 (zlib) for host builds which check packets.
+ * Linked instead of pcrc.c as the CRC unit of hal.h is not emulated.
+ */
+
+#include "pcrc.h"
+
+uint32_t crc32_calc(const void *data, size_t length)
+{
+	const uint8_t *d = data;
+	uint32_t crc = CRC32_INIT;
+
+	while(length--) {
+		crc ^= *d++;
+		for(uint8_t i = 8; i > 0; i--)
+			crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+	}
+	return crc ^ CRC32_INIT;
+}
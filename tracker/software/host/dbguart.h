@@ -0,0 +1 @@
+/* Host build: dbguart.h is not used by the DSP chain. */
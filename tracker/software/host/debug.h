@@ -0,0 +1,22 @@
+/*
+ * Host stand-in for the trace output.
+ * Errors go to stderr, other levels are dropped. Libraries define
+ * HOST_TRACE_QUIET to drop errors too.
+ */
+
+#ifndef HOST_DEBUG_H_
+#define HOST_DEBUG_H_
+
+#include <stdio.h>
+
+#ifdef HOST_TRACE_QUIET
+#define TRACE_ERROR(format, args...)
+#else
+#define TRACE_ERROR(format, args...) fprintf(stderr, format "\n", ##args)
+#endif
+#define TRACE_WARN(format, args...)
+#define TRACE_MON(format, args...)
+#define TRACE_INFO(format, args...)
+#define TRACE_DEBUG(format, args...)
+
+#endif /* HOST_DEBUG_H_ */
@@ -0,0 +1,204 @@
+/**
+  * Decoder of tracker data points for the ground station.
+  *
+  * The field table is generated from DATAPOINT_FIELDS so the decoder
+  * follows datapoint.h. Fields are read little endian at their offsets,
+  * which does not depend on the layout of the host compiler.
+  *
+  * Log records are the keyframe and delta records of the flash log
+  * (flash_encodeLogRecord() in pflash.c) as sent in multi point log
+  * packets and by the log_bin command.
+  */
+
+#include <string.h>
+
+#include "datapoint.h"
+#include "dpdec.h"
+
+#define DPDEC_REC_KEY			0x00
+#define DPDEC_REC_DELTA			0x01
+#define DPDEC_HALFWORDS			(DATAPOINT_SIZE / 2)
+#define DPDEC_DELTA_MAP_SIZE	((DPDEC_HALFWORDS + 7) / 8)
+
+typedef struct {
+	const char	*name;
+	uint8_t		offset;
+	uint8_t		size;
+	uint8_t		is_signed;
+} dpdec_field_t;
+
+#define DPDEC_FIELD(name, type, offset) \
+	{ #name, offset, sizeof(type), (type)-1 < 0 },
+
+static const dpdec_field_t fields[] = {
+	DATAPOINT_FIELDS(DPDEC_FIELD)
+};
+
+#define DPDEC_FIELD_COUNT		(sizeof(fields) / sizeof(fields[0]))
+
+static const char b91_alphabet[] =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789"
+	"!#$%&()*+,./:;<=>?@[]^_`{-}~\"";
+
+uint32_t dpdec_version(void)
+{
+	return DATAPOINT_VERSION;
+}
+
+uint32_t dpdec_point_size(void)
+{
+	return DATAPOINT_SIZE;
+}
+
+uint32_t dpdec_field_count(void)
+{
+	return DPDEC_FIELD_COUNT;
+}
+
+const char *dpdec_field_name(uint32_t i)
+{
+	return i < DPDEC_FIELD_COUNT ? fields[i].name : NULL;
+}
+
+/*
+ * Decode base91 text as decoder/base91.py. Characters out of the alphabet
+ * are skipped. out holds at least len * 7 / 8 + 1 bytes.
+ * Returns the number of bytes decoded.
+ */
+size_t dpdec_base91(const char *text, size_t len, uint8_t *out)
+{
+	static int8_t table[256];
+	static int table_ready;
+	uint32_t b = 0;
+	int v = -1, n = 0;
+	size_t i, o = 0;
+
+	if(!table_ready) {
+		memset(table, -1, sizeof(table));
+		for(i = 0; i < sizeof(b91_alphabet) - 1; i++)
+			table[(uint8_t)b91_alphabet[i]] = i;
+		table_ready = 1;
+	}
+	for(i = 0; i < len; i++) {
+		int c = table[(uint8_t)text[i]];
+		if(c < 0)
+			continue;
+		if(v < 0) {
+			v = c;
+			continue;
+		}
+		v += c * 91;
+		b |= (uint32_t)v << n;
+		n += (v & 8191) > 88 ? 13 : 14;
+		do {
+			out[o++] = b & 0xFF;
+			b >>= 8;
+			n -= 8;
+		} while(n > 7);
+		v = -1;
+	}
+	if(v >= 0)
+		out[o++] = (b | (uint32_t)v << n) & 0xFF;
+	return o;
+}
+
+/*
+ * Decode log records to points of DATAPOINT_SIZE bytes. Without points
+ * the records are only counted. Decoding stops at a corrupt record, a
+ * delta without a keyframe before or after max points.
+ * Returns the number of points.
+ */
+size_t dpdec_records(const uint8_t *data, size_t len, uint8_t *points,
+					 size_t max)
+{
+	const uint8_t *p = data, *end = data + len;
+	uint16_t cur[DPDEC_HALFWORDS];
+	int have_key = 0;
+	size_t count = 0;
+	uint32_t i;
+
+	while(p < end && count < max) {
+		uint8_t type = *p++;
+		if(type == DPDEC_REC_KEY) {
+			if(end - p < DATAPOINT_SIZE)
+				break;
+			for(i = 0; i < DPDEC_HALFWORDS; i++)
+				cur[i] = p[2 * i] | p[2 * i + 1] << 8;
+			p += DATAPOINT_SIZE;
+			have_key = 1;
+		} else if(type == DPDEC_REC_DELTA && have_key) {
+			if(end - p < DPDEC_DELTA_MAP_SIZE)
+				break;
+			const uint8_t *map = p;
+			p += DPDEC_DELTA_MAP_SIZE;
+			for(i = 0; i < DPDEC_HALFWORDS; i++) {
+				if(!(map[i / 8] & (1 << (i % 8))))
+					continue;
+				/* Zigzag varint of the half word delta */
+				uint32_t z = 0;
+				int shift = 0;
+				while(p < end) {
+					uint8_t c = *p++;
+					z |= (uint32_t)(c & 0x7F) << shift;
+					shift += 7;
+					if(!(c & 0x80))
+						break;
+				}
+				cur[i] += (uint16_t)((z >> 1) ^ -(z & 1));
+			}
+		} else {
+			break;
+		}
+		if(points != NULL) {
+			uint8_t *q = &points[count * DATAPOINT_SIZE];
+			for(i = 0; i < DPDEC_HALFWORDS; i++) {
+				q[2 * i] = cur[i] & 0xFF;
+				q[2 * i + 1] = cur[i] >> 8;
+			}
+		}
+		count++;
+	}
+	return count;
+}
+
+void dpdec_values(const uint8_t *points, size_t count, int64_t *values)
+{
+	size_t n;
+	uint32_t f, i;
+
+	for(n = 0; n < count; n++, points += DATAPOINT_SIZE) {
+		for(f = 0; f < DPDEC_FIELD_COUNT; f++) {
+			const dpdec_field_t *d = &fields[f];
+			uint64_t v = 0;
+			for(i = 0; i < d->size; i++)
+				v |= (uint64_t)points[d->offset + i] << (8 * i);
+			if(d->is_signed && (v >> (8 * d->size - 1)) & 1)
+				v |= ~(uint64_t)0 << (8 * d->size);
+			*values++ = (int64_t)v;
+		}
+	}
+}
+
+/*
+ * Decode the base91 text of a telemetry comment or log packet (one point)
+ * or of a multi point log packet (records). values holds max points.
+ * Returns the number of points, 0 if the data is too short.
+ */
+size_t dpdec_packet(const char *text, size_t len, int records,
+					int64_t *values, size_t max)
+{
+	uint8_t data[len * 7 / 8 + 1];
+	size_t n = dpdec_base91(text, len, data);
+
+	if(!records) {
+		if(n < DATAPOINT_SIZE || max < 1)
+			return 0;
+		dpdec_values(data, 1, values);
+		return 1;
+	}
+	size_t count = dpdec_records(data, n, NULL, max);
+	uint8_t points[count * DATAPOINT_SIZE + 1];
+	dpdec_records(data, n, points, count);
+	dpdec_values(points, count, values);
+	return count;
+}
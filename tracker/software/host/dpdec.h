@@ -0,0 +1,34 @@
+/**
+  * Decoder of tracker data points (dataPoint_t) for the ground station.
+  * Built as a shared library for decoder/position.py and decoder/logexport.py.
+  * The fields are read by the layout in source/threads/datapoint.h which
+  * the firmware checks against dataPoint_t.
+  *
+  * Values are returned as dpdec_field_count() numbers per point in the order
+  * of DATAPOINT_FIELDS.
+  */
+
+#ifndef HOST_DPDEC_H_
+#define HOST_DPDEC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+	uint32_t dpdec_version(void);
+	uint32_t dpdec_point_size(void);
+	uint32_t dpdec_field_count(void);
+	const char *dpdec_field_name(uint32_t i);
+	size_t dpdec_base91(const char *text, size_t len, uint8_t *out);
+	size_t dpdec_records(const uint8_t *data, size_t len, uint8_t *points,
+						 size_t max);
+	void dpdec_values(const uint8_t *points, size_t count, int64_t *values);
+	size_t dpdec_packet(const char *text, size_t len, int records,
+						int64_t *values, size_t max);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HOST_DPDEC_H_ */
@@ -0,0 +1,8 @@
+/*
+ * Host registers behind the stand-in HAL.
+ */
+
+#include "hal.h"
+
+host_rcc_t host_rcc;
+host_crc_t host_crc;
@@ -0,0 +1 @@
+/* Host build: ihex_out.h is not used by the DSP chain. */
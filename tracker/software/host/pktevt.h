@@ -0,0 +1 @@
+/* Host build: pktevt.h is not used by the DSP chain. */
@@ -0,0 +1,25 @@
+/*
+ * Host stand-in for the radio manager.
+ * Declares what the inline helpers of pktconf.h refer to.
+ */
+
+#ifndef HOST_PKTRADIO_H_
+#define HOST_PKTRADIO_H_
+
+typedef struct radioTask {
+  radio_unit_t              radio;
+} radio_task_object_t;
+
+typedef void (*radio_task_cb_t)(radio_task_object_t *task);
+
+typedef struct packet_s {
+  struct packet_s           *nextp;
+} *packet_t;
+
+msg_t pktGetRadioTaskObject(radio_unit_t radio, sysinterval_t timeout,
+                            radio_task_object_t **rt);
+void pktSubmitRadioTask(radio_unit_t radio, radio_task_object_t *object,
+                        radio_task_cb_t cb);
+void pktReleasePacketBuffer(packet_t pp);
+
+#endif /* HOST_PKTRADIO_H_ */
@@ -0,0 +1,62 @@
+/*
+ * Host stand-in for the packet service.
+ * Holds the packet handler members used by the HDLC decoder and the
+ * receive buffer with its running CRC. The buffer is owned by the bench.
+ */
+
+#ifndef HOST_PKTSERVICE_H_
+#define HOST_PKTSERVICE_H_
+
+#define PKT_RX_BUFFER_SIZE              PKT_MAX_RX_PACKET_LEN
+
+typedef enum HDLCFrameStates {
+  FRAME_SEARCH,
+  FRAME_OPEN,
+  FRAME_DATA,
+  FRAME_CLOSE,
+  FRAME_RESET
+} frame_state_t;
+
+typedef struct packetBuffer pkt_data_object_t;
+
+typedef struct packetQuality {
+  radio_signal_t            rssi;
+  uint32_t                  tone_level;
+  uint8_t                   pll_lock;
+} pkt_quality_t;
+
+typedef struct packetBuffer {
+  volatile eventflags_t     status;
+  size_t                    buffer_size;
+  size_t                    packet_size;
+  uint16_t                  crc;
+  pkt_quality_t             quality;
+  ax25char_t                *buffer;
+} pkt_data_object_t;
+
+typedef struct packetHandlerData {
+  radio_unit_t              radio;
+  event_source_t            event;
+  void                      *link_controller;
+  pkt_data_object_t         *active_packet_object;
+  uint16_t                  sync_count;
+  uint16_t                  frame_count;
+} packet_svc_t;
+
+#define pktAddEventFlags(ip, flags) {                                        \
+    chEvtBroadcastFlags(&(ip)->event, flags);                                \
+}
+
+static inline void pktResetDataCount(pkt_data_object_t *object) {
+  object->packet_size = 0;
+  object->crc = CRC16_INIT_VALUE;
+}
+
+static inline bool pktIsBufferGoodCRC(pkt_data_object_t *object) {
+  return object->crc == (uint16_t)~CRC_INCLUSIVE_CONSTANT;
+}
+
+bool pktStoreBufferData(pkt_data_object_t *pkt_buffer, ax25char_t data);
+packet_svc_t *pktGetServiceObject(radio_unit_t radio);
+
+#endif /* HOST_PKTSERVICE_H_ */
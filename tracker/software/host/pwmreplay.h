@@ -0,0 +1 @@
+/* Host build: pwmreplay.h is not used by the DSP chain. */
@@ -0,0 +1 @@
+/* Host build: shell.h is not used by the DSP chain. */
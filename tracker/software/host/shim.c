@@ -0,0 +1,50 @@
+/*
+ * Host implementations behind the stand-in headers.
+ */
+
+#include <math.h>
+#include <time.h>
+
+#include "pktconf.h"
+#include "shim.h"
+
+/* Defined without const so it can be filled at start up. */
+float32_t sinTable_f32[FAST_MATH_TABLE_SIZE + 1];
+
+static packet_svc_t *host_handler;
+
+/*
+ * Fill the CMSIS sine table. The vendored CMSIS-DSP has no common tables.
+ */
+void hostInit(packet_svc_t *handler)
+{
+	int i;
+	for(i = 0; i <= FAST_MATH_TABLE_SIZE; i++)
+		sinTable_f32[i] = (float32_t)sin(2.0 * M_PI * i / FAST_MATH_TABLE_SIZE);
+	host_handler = handler;
+}
+
+rtcnt_t chSysGetRealtimeCounterX(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return (rtcnt_t)((uint64_t)ts.tv_sec * 1000000000U + ts.tv_nsec);
+}
+
+/*
+ * Same as in pktservice.c.
+ */
+bool pktStoreBufferData(pkt_data_object_t *pkt_buffer, ax25char_t data)
+{
+	if((pkt_buffer->packet_size + 1U) > pkt_buffer->buffer_size)
+		return false;
+	pkt_buffer->buffer[pkt_buffer->packet_size++] = data;
+	pkt_buffer->crc = calc_crc16_update(pkt_buffer->crc, data);
+	return true;
+}
+
+packet_svc_t *pktGetServiceObject(radio_unit_t radio)
+{
+	(void)radio;
+	return host_handler;
+}
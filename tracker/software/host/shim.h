@@ -0,0 +1,10 @@
+/*
+ * Host set up of the stand-in OS.
+ */
+
+#ifndef HOST_SHIM_H_
+#define HOST_SHIM_H_
+
+void hostInit(packet_svc_t *handler);
+
+#endif /* HOST_SHIM_H_ */
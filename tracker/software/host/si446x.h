@@ -0,0 +1 @@
+/* Host build: si446x.h is not used by the DSP chain. */
@@ -0,0 +1,40 @@
+/*
+ * Kernel configuration of the host simulation.
+ * The kernel options are those of the target. Only the hooks which reach
+ * target hardware and the stack check the port does not support change.
+ */
+
+#ifndef SIM_CHCONF_H
+#define SIM_CHCONF_H
+
+#include "../../cfg/pp10a/chconf.h"
+
+/* The core memory is a static array instead of the linker heap. */
+#undef CH_CFG_MEMCORE_SIZE
+#define CH_CFG_MEMCORE_SIZE                 (64 * 1024 * 1024)
+
+#undef CH_DBG_ENABLE_STACK_CHECK
+#define CH_DBG_ENABLE_STACK_CHECK           FALSE
+
+/* The CPU time of threads is not simulated. */
+#undef CH_CFG_CONTEXT_SWITCH_HOOK
+#define CH_CFG_CONTEXT_SWITCH_HOOK(ntp, otp) {                              \
+  (void)(ntp);                                                              \
+  (void)(otp);                                                              \
+}
+
+/* Terminated threads are released as on target. There is no stop mode. */
+#undef CH_CFG_IDLE_LOOP_HOOK
+#define CH_CFG_IDLE_LOOP_HOOK() {                                           \
+  extern void pktIdleThread(void);                                          \
+  pktIdleThread();                                                          \
+}
+
+/* A failed assertion or check ends the run with the reason. */
+#undef CH_CFG_SYSTEM_HALT_HOOK
+#define CH_CFG_SYSTEM_HALT_HOOK(reason) {                                   \
+  extern void simHalt(const char *r);                                       \
+  simHalt(reason);                                                          \
+}
+
+#endif /* SIM_CHCONF_H */
@@ -0,0 +1,71 @@
+/*
+ * ChibiOS/RT port for the host simulation. See chcore.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ch.h"
+#include "sim.h"
+
+bool port_isr_context_flag;
+syssts_t port_irq_sts;
+
+/*
+ * Entry of a new thread. The thread function is taken from the context as
+ * makecontext() only passes int arguments.
+ */
+static void _port_thread_start(void) {
+  thread_t *tp = chThdGetSelfX();
+
+  chSysUnlock();
+  tp->ctx.pf(tp->ctx.arg);
+  chThdExit(MSG_OK);
+  while(true);
+}
+
+void _port_setup_context(struct port_context *ctx, void *wbase, void *wtop,
+                         void (*pf)(void *p), void *arg) {
+  if(getcontext(&ctx->uc) != 0) {
+    perror("getcontext");
+    abort();
+  }
+  ctx->uc.uc_stack.ss_sp = wbase;
+  ctx->uc.uc_stack.ss_size = (uint8_t *)wtop - (uint8_t *)wbase;
+  ctx->uc.uc_link = NULL;
+  ctx->pf = pf;
+  ctx->arg = arg;
+  makecontext(&ctx->uc, _port_thread_start, 0);
+}
+
+void port_switch(thread_t *ntp, thread_t *otp) {
+  if(swapcontext(&otp->ctx.uc, &ntp->ctx.uc) != 0) {
+    perror("swapcontext");
+    abort();
+  }
+}
+
+/*
+ * The realtime counter runs at the core clock of the target in step with
+ * the virtual system time.
+ */
+rtcnt_t port_rt_get_counter_value(void) {
+  return (rtcnt_t)(simGetTicks() * (SIM_CORE_CLOCK / CH_CFG_ST_FREQUENCY));
+}
+
+/*
+ * Advance the virtual time by one system tick as the SysTick interrupt.
+ */
+void _sim_tick(void) {
+  simAdvanceTick();
+
+  CH_IRQ_PROLOGUE();
+  chSysLockFromISR();
+  chSysTimerHandlerI();
+  chSysUnlockFromISR();
+  CH_IRQ_EPILOGUE();
+
+  chSysLock();
+  chSchRescheduleS();
+  chSysUnlock();
+}
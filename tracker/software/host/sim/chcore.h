@@ -0,0 +1,165 @@
+/*
+ * ChibiOS/RT port for the host simulation.
+ * Threads are ucontext coroutines switched by the kernel scheduler, so the
+ * real kernel runs unchanged in one host thread. There is no preemption
+ * and no interrupts. Time is virtual: the system tick only advances when
+ * the idle thread runs, that is when every thread waits. A run therefore
+ * gives the same result each time and code takes no time to execute.
+ */
+
+#ifndef CHCORE_H
+#define CHCORE_H
+
+#include <ucontext.h>
+
+#define PORT_SUPPORTS_RT                TRUE
+#define PORT_NATURAL_ALIGN              sizeof (void *)
+#define PORT_STACK_ALIGN                sizeof (stkalign_t)
+#define PORT_WORKING_AREA_ALIGN         sizeof (stkalign_t)
+
+#define PORT_ARCHITECTURE_SIMHOST
+#define PORT_ARCHITECTURE_NAME          "Host simulation"
+#define PORT_CORE_VARIANT_NAME          "ucontext"
+#define PORT_COMPILER_NAME              "GCC " __VERSION__
+#define PORT_INFO                       "No preemption, virtual time"
+
+#if !defined(PORT_IDLE_THREAD_STACK_SIZE)
+#define PORT_IDLE_THREAD_STACK_SIZE     256
+#endif
+
+/*
+ * Added to every working area. Host code, the C library in particular,
+ * needs far more stack than the firmware sizes its threads for.
+ */
+#if !defined(PORT_INT_REQUIRED_STACK)
+#define PORT_INT_REQUIRED_STACK         65536
+#endif
+
+#define PORT_USE_ALT_TIMER              FALSE
+
+#if CH_DBG_ENABLE_STACK_CHECK
+#error "option CH_DBG_ENABLE_STACK_CHECK not supported by this port"
+#endif
+
+#if CH_CFG_ST_TIMEDELTA > 0
+#error "the simulation port only supports the periodic tick"
+#endif
+
+typedef struct {
+  uint8_t a[16];
+} stkalign_t __attribute__((aligned(16)));
+
+struct port_extctx {
+};
+
+struct port_intctx {
+};
+
+struct port_context {
+  ucontext_t            uc;
+  void                  (*pf)(void *p);
+  void                  *arg;
+};
+
+#define PORT_SETUP_CONTEXT(tp, wbase, wtop, pf, arg)                        \
+  _port_setup_context(&(tp)->ctx, (void *)(wbase), (void *)(wtop),          \
+                      (void (*)(void *))(pf), (void *)(arg))
+
+#define PORT_WA_SIZE(n) (sizeof (struct port_intctx) +                      \
+                         ((size_t)(n)) +                                    \
+                         ((size_t)(PORT_INT_REQUIRED_STACK)))
+
+#define PORT_WORKING_AREA(s, n)                                             \
+  stkalign_t s[THD_WORKING_AREA_SIZE(n) / sizeof (stkalign_t)]
+
+#define PORT_IRQ_PROLOGUE() {                                               \
+  port_isr_context_flag = true;                                             \
+}
+
+#define PORT_IRQ_EPILOGUE() {                                               \
+  port_isr_context_flag = false;                                            \
+}
+
+#define PORT_IRQ_HANDLER(id) void id(void)
+#define PORT_FAST_IRQ_HANDLER(id) void id(void)
+
+extern bool port_isr_context_flag;
+extern syssts_t port_irq_sts;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  void _port_setup_context(struct port_context *ctx, void *wbase, void *wtop,
+                           void (*pf)(void *p), void *arg);
+  void port_switch(thread_t *ntp, thread_t *otp);
+  rtcnt_t port_rt_get_counter_value(void);
+  void _sim_tick(void);
+#ifdef __cplusplus
+}
+#endif
+
+static inline void port_init(void) {
+
+  port_irq_sts = (syssts_t)0;
+  port_isr_context_flag = false;
+}
+
+static inline syssts_t port_get_irq_status(void) {
+
+  return port_irq_sts;
+}
+
+static inline bool port_irq_enabled(syssts_t sts) {
+
+  return sts == (syssts_t)0;
+}
+
+static inline bool port_is_isr_context(void) {
+
+  return port_isr_context_flag;
+}
+
+static inline void port_lock(void) {
+
+  port_irq_sts = (syssts_t)1;
+}
+
+static inline void port_unlock(void) {
+
+  port_irq_sts = (syssts_t)0;
+}
+
+static inline void port_lock_from_isr(void) {
+
+  port_irq_sts = (syssts_t)1;
+}
+
+static inline void port_unlock_from_isr(void) {
+
+  port_irq_sts = (syssts_t)0;
+}
+
+static inline void port_disable(void) {
+
+  port_irq_sts = (syssts_t)1;
+}
+
+static inline void port_suspend(void) {
+
+  port_irq_sts = (syssts_t)1;
+}
+
+static inline void port_enable(void) {
+
+  port_irq_sts = (syssts_t)0;
+}
+
+/*
+ * Called by the idle thread. Every thread waits so time moves on.
+ */
+static inline void port_wait_for_interrupt(void) {
+
+  _sim_tick();
+}
+
+#endif /* CHCORE_H */
@@ -0,0 +1,22 @@
+/*
+ * The ChibiOS heap takes its allocation unit from the pointer size and
+ * only knows 16 and 32 bit pointers. Its block header is one unit, which
+ * is 16 bytes with 64 bit pointers. The library is read as for 32 bit
+ * pointers and the unit is then set to the size of the header.
+ * chmemheaps.h is included by chlib.h from its own directory so the
+ * library header is the one taken in place.
+ */
+
+#ifndef SIM_CHLIB_H
+#define SIM_CHLIB_H
+
+#undef SIZEOF_PTR
+#define SIZEOF_PTR          4
+#include_next "chlib.h"
+#undef SIZEOF_PTR
+#define SIZEOF_PTR          8
+
+#undef CH_HEAP_ALIGNMENT
+#define CH_HEAP_ALIGNMENT   16U
+
+#endif /* SIM_CHLIB_H */
@@ -0,0 +1,44 @@
+/*
+ * Port types of the host simulation port (x86-64 and other 64 bit hosts).
+ * Same as the SIMIA32 port except for the pointer size. Messages are
+ * pointer sized as mailboxes and object FIFOs post pointers as messages.
+ */
+
+#ifndef CHTYPES_H
+#define CHTYPES_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef volatile int8_t     vint8_t;
+typedef volatile uint8_t    vuint8_t;
+typedef volatile int16_t    vint16_t;
+typedef volatile uint16_t   vuint16_t;
+typedef volatile int32_t    vint32_t;
+typedef volatile uint32_t   vuint32_t;
+
+typedef uint32_t            rtcnt_t;
+typedef uint64_t            rttime_t;
+typedef uint32_t            syssts_t;
+typedef uint8_t             tmode_t;
+typedef uint8_t             tstate_t;
+typedef uint8_t             trefs_t;
+typedef uint8_t             tslices_t;
+typedef uint32_t            tprio_t;
+typedef int64_t             msg_t;          /* Holds a pointer in mailboxes */
+typedef int32_t             eventid_t;
+typedef uint32_t            eventmask_t;
+typedef uint32_t            eventflags_t;
+typedef int32_t             cnt_t;
+typedef uint32_t            ucnt_t;
+
+#define ROMCONST            const
+#define NOINLINE            __attribute__((noinline))
+#define PORT_THD_FUNCTION(tname, arg) void tname(void *arg)
+#define PACKED_VAR          __attribute__((packed))
+#define ALIGNED_VAR(n)      __attribute__((aligned(n)))
+#define SIZEOF_PTR          8
+#define REVERSE_ORDER       1
+
+#endif /* CHTYPES_H */
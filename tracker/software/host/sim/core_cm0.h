@@ -0,0 +1,4 @@
+/*
+ * Same stand-in for the CMSIS core header as the other host builds.
+ */
+#include "../core_cm0.h"
@@ -0,0 +1,32 @@
+/*
+ * Trace output of the simulation. Messages are printed with the virtual
+ * time when the level is at most the level set with -v.
+ */
+
+#ifndef SIM_DEBUG_H_
+#define SIM_DEBUG_H_
+
+#include <stdio.h>
+#include <string.h>
+
+#define TRACE_LEVEL_ERROR   1
+#define TRACE_LEVEL_WARN    2
+#define TRACE_LEVEL_MON     3
+#define TRACE_LEVEL_INFO    4
+#define TRACE_LEVEL_DEBUG   5
+
+#define TRACE_TAB           "            "
+
+extern int sim_trace_level;
+void simTrace(const char *level, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+#define TRACE_ACTIVE(level) (sim_trace_level >= (level))
+
+#define TRACE_DEBUG(format, args...) if(TRACE_ACTIVE(TRACE_LEVEL_DEBUG)) { simTrace("DEBUG", format, ##args); }
+#define TRACE_INFO(format, args...)  if(TRACE_ACTIVE(TRACE_LEVEL_INFO)) { simTrace("     ", format, ##args); }
+#define TRACE_MON(format, args...)   if(TRACE_ACTIVE(TRACE_LEVEL_MON)) { simTrace("     ", format, ##args); }
+#define TRACE_WARN(format, args...)  if(TRACE_ACTIVE(TRACE_LEVEL_WARN)) { simTrace("WARN ", format, ##args); }
+#define TRACE_ERROR(format, args...) if(TRACE_ACTIVE(TRACE_LEVEL_ERROR)) { simTrace("ERROR", format, ##args); }
+
+#endif /* SIM_DEBUG_H_ */
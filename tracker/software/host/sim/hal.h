@@ -0,0 +1,87 @@
+/*
+ * HAL stand-in of the host simulation.
+ * The radio manager and packet service name the ICU, PAL, SPI and serial
+ * types but the simulated radio does not reach them. The CRC unit is the
+ * register stand-in of host/hal.h for pcrc.c.
+ */
+
+#ifndef SIM_HAL_H_
+#define SIM_HAL_H_
+
+#include "ch.h"
+#include "hal_objects.h"
+#include "hal_streams.h"
+#include "sim.h"
+
+#define STM32_SYSCLK            SIM_CORE_CLOCK
+
+typedef uint32_t    icucnt_t;
+typedef uint32_t    ioline_t;
+typedef uint32_t    iomode_t;
+typedef void        (*palcallback_t)(void *arg);
+
+typedef struct {
+  icucnt_t                  width;
+  icucnt_t                  period;
+  void                      *link;
+} ICUDriver;
+
+typedef struct {
+  int                       dummy;
+} ICUConfig;
+
+typedef struct {
+  int                       dummy;
+} SPIDriver;
+
+typedef struct {
+  int                       dummy;
+} SerialDriver;
+
+typedef struct {
+  int                       dummy;
+} stm32_tim_t;
+
+#define icuGetWidthX(icup)      ((icup)->width)
+#define icuGetPeriodX(icup)     ((icup)->period)
+
+#define PAL_NOLINE              0U
+#define PAL_LOW                 0U
+#define PAL_HIGH                1U
+#define PAL_MODE_UNCONNECTED    0U
+#define palSetLineMode(line, mode)  do { (void)(line); (void)(mode); } while(false)
+#define palWriteLine(line, value)   do { (void)(line); (void)(value); } while(false)
+#define palToggleLine(line)         do { (void)(line); } while(false)
+#define palReadLine(line)           ((void)(line), PAL_LOW)
+
+/* Registers of the CRC unit, defined in host/hal.c. */
+typedef struct {
+  volatile uint32_t         AHB1ENR;
+} host_rcc_t;
+
+typedef struct {
+  volatile uint32_t         DR;
+  volatile uint32_t         CR;
+} host_crc_t;
+
+extern host_rcc_t host_rcc;
+extern host_crc_t host_crc;
+
+#define RCC                     (&host_rcc)
+#define CRC                     (&host_crc)
+#define RCC_AHB1ENR_CRCEN       (1U << 12)
+#define CRC_CR_RESET            1U
+#define rccEnableCRC(lp)        (RCC->AHB1ENR |= RCC_AHB1ENR_CRCEN)
+
+#define __DMB()                 __sync_synchronize()
+#define __RBIT(v)               host_rbit(v)
+
+static inline uint32_t host_rbit(uint32_t v) {
+  uint32_t r = 0;
+  int i;
+  for(i = 0; i < 32; i++, v >>= 1)
+    r = (r << 1) | (v & 1U);
+  return r;
+}
+
+#endif /* SIM_HAL_H_ */
@@ -0,0 +1,180 @@
+/*
+ * Virtual time and the firmware services the packet system calls which
+ * are not part of the simulation. Memory regions come from the kernel
+ * heap, heartbeats and the processor clock are ignored.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "ch.h"
+#include "hal.h"
+#include "debug.h"
+#include "config.h"
+#include "memregion.h"
+#include "watchdog.h"
+#include "pclock.h"
+#include "threads.h"
+#include "geofence.h"
+#include "padc.h"
+#include "ptime.h"
+#include "sim.h"
+
+int sim_trace_level = TRACE_LEVEL_ERROR;
+
+conf_t conf_sram = {
+  .freq = 144800000
+};
+
+static uint64_t sim_ticks;
+
+/*
+ * CCM of the target (64k). The heap is made there by pktSystemInit().
+ */
+#define SIM_CCM_SIZE    (64 * 1024)
+#define SIM_STR(x)      #x
+#define SIM_XSTR(x)     SIM_STR(x)
+
+__asm__(".bss\n"
+        ".balign 16\n"
+        ".globl __ram4_free__\n"
+        "__ram4_free__:\n"
+        ".zero " SIM_XSTR(SIM_CCM_SIZE) "\n"
+        ".globl __ram4_end__\n"
+        "__ram4_end__:\n"
+        ".text\n");
+
+uint64_t simGetTicks(void) {
+  return sim_ticks;
+}
+
+void simAdvanceTick(void) {
+  sim_ticks++;
+}
+
+void simHalt(const char *reason) {
+  fprintf(stderr, "[%10.3f] HALT  %s\n",
+          (double)sim_ticks / CH_CFG_ST_FREQUENCY,
+          reason != NULL ? reason : "");
+  exit(2);
+}
+
+void simTrace(const char *level, const char *format, ...) {
+  va_list ap;
+
+  printf("[%10.3f] %s %-8s ", (double)sim_ticks / CH_CFG_ST_FREQUENCY,
+         level, chRegGetThreadNameX(chThdGetSelfX()));
+  va_start(ap, format);
+  vprintf(format, ap);
+  va_end(ap);
+  printf("\n");
+}
+
+void *mem_alloc(mem_region_t region, size_t size, unsigned align) {
+  (void)region;
+  return chHeapAllocAligned(NULL, size, align != 0 ? align : PORT_NATURAL_ALIGN);
+}
+
+void *mem_scratch_get(size_t size) {
+  return chHeapAlloc(NULL, size);
+}
+
+void mem_scratch_release(void *pp) {
+  void *p = *(void **)pp;
+  if(p != NULL)
+    chHeapFree(p);
+}
+
+thread_t *mem_thread_create(mem_region_t region, size_t size, const char *name,
+                            tprio_t prio, tfunc_t pf, void *arg) {
+  (void)region;
+  return chThdCreateFromHeap(NULL, size, name, prio, pf, arg);
+}
+
+void wdg_register(wdg_beat_t *b, const char *name, sysinterval_t cycle) {
+  (void)b;
+  (void)name;
+  (void)cycle;
+}
+
+void wdg_unregister(wdg_beat_t *b) {
+  (void)b;
+}
+
+void wdg_beat(wdg_beat_t *b) {
+  (void)b;
+}
+
+void allowLateWakeup(void) {
+}
+
+void cancelLateWakeup(void) {
+}
+
+void pclkAcquire(void) {
+}
+
+void pclkRelease(void) {
+}
+
+uint32_t getAPRSRegionFrequency(void) {
+  return conf_sram.freq;
+}
+
+/* The RTC is not set so sends are not held for a TDMA slot. */
+sysinterval_t getSlotWait(uint8_t slot, uint8_t slots,
+                          sysinterval_t slot_time, sysinterval_t guard) {
+  (void)slot;
+  (void)slots;
+  (void)slot_time;
+  (void)guard;
+  return 0;
+}
+
+/* Packet events are not traced in the simulation. */
+void pktLogEventI(event_source_t *esp, eventflags_t flags, uint32_t arg) {
+  (void)esp;
+  (void)flags;
+  (void)arg;
+}
+
+/* The battery is good so the radio is kept in standby. */
+uint16_t stm32_get_vbat(void) {
+  return 4000;
+}
+
+/*
+ * Same as on target. Threads which end themselves are released here.
+ */
+void pktIdleThread(void) {
+  chSysLock();
+  if(!chMsgIsPendingI(chThdGetSelfX())) {
+    chSysUnlock();
+    return;
+  }
+  chSysUnlock();
+  thread_t *tp = chMsgWait();
+  (void)chMsgGet(tp);
+  chMsgRelease(tp, MSG_OK);
+  (void)chThdWait(tp);
+}
+
+/* From newlib on target. */
+size_t strlcpy(char *dst, const char *src, size_t size) {
+  size_t n = strlen(src);
+  if(size != 0) {
+    size_t c = (n >= size) ? size - 1 : n;
+    memcpy(dst, src, c);
+    dst[c] = '\0';
+  }
+  return n;
+}
+
+size_t strlcat(char *dst, const char *src, size_t size) {
+  size_t d = strnlen(dst, size);
+  if(d == size)
+    return size + strlen(src);
+  return d + strlcpy(dst + d, src, size - d);
+}
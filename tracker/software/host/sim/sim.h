@@ -0,0 +1,22 @@
+/*
+ * Host simulation of the radio manager and packet service.
+ */
+
+#ifndef SIM_H_
+#define SIM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Core clock of the target for the realtime counter. */
+#define SIM_CORE_CLOCK      48000000U
+
+uint64_t simGetTicks(void);
+void simAdvanceTick(void);
+void simHalt(const char *reason);
+
+/* In newlib on target but not in every host C library. */
+size_t strlcpy(char *dst, const char *src, size_t size);
+size_t strlcat(char *dst, const char *src, size_t size);
+
+#endif /* SIM_H_ */
@@ -0,0 +1,376 @@
+/**
+  * Host simulation of the radio manager and the packet service.
+  * The firmware pktradio.c and pktservice.c run on the real kernel with a
+  * simulated radio beneath them (simradio.c). A scripted load of frames
+  * from other stations is received while scripted sources send packets.
+  * The run reports throughput, frames dropped and where, and latencies.
+  *
+  * Time is virtual. It only moves on when every thread waits so the code
+  * itself takes no time. A run gives the same result each time.
+  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include "ch.h"
+#include "hal.h"
+#include "pktconf.h"
+#include "debug.h"
+#include "simradio.h"
+
+#define SIM_MAX_SOURCES		8
+#define SIM_TX_TIME_OFFSET	16U		/* Submit time in a sent frame */
+#define SIM_TX_MIN_LEN		(SIM_TX_TIME_OFFSET + 5U)
+#define SIM_FREQ			144800000
+
+typedef struct {
+	uint32_t	*v;
+	uint32_t	n;
+	uint32_t	size;
+} sim_samples_t;
+
+typedef struct {
+	uint32_t		period_ms;
+	uint16_t		len;
+	tx_priority_t	prio;
+	uint8_t			burst;			/* Packets per send */
+	radio_squelch_t	cca;
+	uint32_t		sends;
+	uint32_t		failed;			/* No packet buffer or refused */
+	uint32_t		on_air;
+	sim_samples_t	latency;		/* Submit to on air (ms) */
+} sim_source_t;
+
+static sim_source_t sim_sources[SIM_MAX_SOURCES];
+static uint8_t sim_num_sources;
+static sim_samples_t sim_rx_latency;	/* End of frame to callback (ms) */
+static uint32_t sim_rx_delivered;
+static uint32_t sim_callback_ms;
+
+static const char *const sim_prio_names[] = {
+	"command", "position", "digipeat", "bulk"
+};
+
+static void sample(sim_samples_t *s, uint32_t v) {
+	if(s->n == s->size) {
+		s->size = s->size ? s->size * 2 : 256;
+		s->v = realloc(s->v, s->size * sizeof(uint32_t));
+		if(s->v == NULL) {
+			perror("realloc");
+			exit(1);
+		}
+	}
+	s->v[s->n++] = v;
+}
+
+static int cmp_u32(const void *a, const void *b) {
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+	return (x > y) - (x < y);
+}
+
+static void print_samples(const char *what, sim_samples_t *s) {
+	if(s->n == 0) {
+		printf("  %-28s none\n", what);
+		return;
+	}
+	qsort(s->v, s->n, sizeof(uint32_t), cmp_u32);
+	printf("  %-28s p50 %5u  p90 %5u  p99 %5u  max %5u ms\n", what,
+		   s->v[(s->n - 1) * 50 / 100], s->v[(s->n - 1) * 90 / 100],
+		   s->v[(s->n - 1) * 99 / 100], s->v[s->n - 1]);
+}
+
+/*
+ * Receive callback, run by the callback workers of the packet service.
+ */
+static void sim_receive(pkt_data_object_t *pkt_buffer) {
+	if(!pktIsBufferGoodCRC(pkt_buffer)) {
+		TRACE_ERROR("SIM  > Frame with bad CRC received");
+		return;
+	}
+	systime_t end = simRadioArrival(pkt_buffer);
+	sample(&sim_rx_latency, chTimeI2MS(chTimeDiffX(end, chVTGetSystemTime())));
+	sim_rx_delivered++;
+	TRACE_INFO("SIM  > Frame received %d ms after it ended",
+			   chTimeI2MS(chTimeDiffX(end, chVTGetSystemTime())));
+	/* Work of the application on the frame (APRS, digipeat). */
+	if(sim_callback_ms != 0)
+		chThdSleep(TIME_MS2I(sim_callback_ms));
+}
+
+/*
+ * A sent frame carries its source and submit time.
+ */
+static void sim_on_air(packet_t pp) {
+	const uint8_t *t = pp->frame_data + SIM_TX_TIME_OFFSET;
+	systime_t submitted = (systime_t)(t[0] | (t[1] << 8) | (t[2] << 16)
+									  | ((uint32_t)t[3] << 24));
+	sim_source_t *src = &sim_sources[t[4] % SIM_MAX_SOURCES];
+	src->on_air++;
+	sample(&src->latency,
+		   chTimeI2MS(chTimeDiffX(submitted, chVTGetSystemTime())));
+}
+
+static packet_t sim_make_packet(sim_source_t *src, uint8_t n) {
+	packet_t pp;
+	if(pktGetPacketBuffer(&pp, src->len, TIME_MS2I(100)) != MSG_OK)
+		return NULL;
+	static const uint8_t hdr[SIM_TX_TIME_OFFSET] = {
+		'A' << 1, 'P' << 1, 'Z' << 1, 'S' << 1, 'I' << 1, 'M' << 1, 0x60,
+		'D' << 1, 'U' << 1, 'T' << 1, ' ' << 1, ' ' << 1, ' ' << 1, 0x61,
+		0x03, 0xF0
+	};
+	systime_t now = chVTGetSystemTime();
+	memset(pp->frame_data, 'x', src->len);
+	memcpy(pp->frame_data, hdr, sizeof(hdr));
+	for(uint8_t i = 0; i < 4; i++)
+		pp->frame_data[SIM_TX_TIME_OFFSET + i] = (uint8_t)(now >> (i * 8));
+	pp->frame_data[SIM_TX_TIME_OFFSET + 4] = n;
+	pp->frame_len = src->len;
+	pp->num_addr = 2;
+	return pp;
+}
+
+/*
+ * Send a chain of packets the way transmitOnRadio() does.
+ */
+static bool sim_send(sim_source_t *src, uint8_t n) {
+	packet_t head = NULL, tail = NULL;
+	for(uint8_t i = 0; i < src->burst; i++) {
+		packet_t pp = sim_make_packet(src, n);
+		if(pp == NULL)
+			break;
+		if(head == NULL)
+			head = pp;
+		else
+			tail->nextp = pp;
+		tail = pp;
+	}
+	if(head == NULL)
+		return false;
+
+	radio_unit_t radio = PKT_RADIO_1;
+	packet_svc_t *handler = pktGetServiceObject(radio);
+	radio_task_object_t rt = handler->radio_tx_config;
+
+	rt.handler = handler;
+	rt.command = PKT_RADIO_TX_SEND;
+	rt.type = MOD_AFSK;
+	rt.base_frequency = SIM_FREQ;
+	rt.step_hz = 0;
+	rt.channel = 0;
+	rt.tx_power = 0x7F;
+	rt.tx_speed = SIM_AFSK_BAUD;
+	rt.squelch = src->cca;
+	rt.packet_out = head;
+	rt.tx_priority = src->prio;
+
+	handler->radio_tx_config = rt;
+
+	if(pktSendRadioCommand(radio, &rt, NULL) != MSG_OK) {
+		pktReleaseBufferChain(head);
+		return false;
+	}
+	return true;
+}
+
+static THD_FUNCTION(simSource, arg) {
+	sim_source_t *src = arg;
+	uint8_t n = src - sim_sources;
+	/* Sources start apart so they do not all send at once. */
+	systime_t next = chTimeAddX(chVTGetSystemTime(),
+								TIME_MS2I(src->period_ms * (n + 1)
+										  / (sim_num_sources + 1)));
+	while(true) {
+		chThdSleepUntil(next);
+		next = chTimeAddX(next, TIME_MS2I(src->period_ms));
+		src->sends++;
+		if(!sim_send(src, n))
+			src->failed++;
+	}
+}
+
+/*
+ * Parse period_ms[:len[:prio[:burst[:cca]]]].
+ */
+static bool parse_source(char *s, sim_source_t *src) {
+	char *f[5] = {NULL};
+	uint8_t n = 0;
+	for(char *p = strtok(s, ":"); p != NULL && n < 5; p = strtok(NULL, ":"))
+		f[n++] = p;
+	if(n == 0)
+		return false;
+	src->period_ms = strtoul(f[0], NULL, 0);
+	src->len = f[1] ? strtoul(f[1], NULL, 0) : 60;
+	src->prio = TX_PRIO_POSITION;
+	if(f[2] != NULL) {
+		uint8_t i;
+		for(i = 0; i <= TX_PRIO_BULK; i++) {
+			if(strcasecmp(f[2], sim_prio_names[i]) == 0)
+				break;
+		}
+		if(i > TX_PRIO_BULK)
+			i = strtoul(f[2], NULL, 0);
+		if(i > TX_PRIO_BULK)
+			return false;
+		src->prio = i;
+	}
+	src->burst = f[3] ? strtoul(f[3], NULL, 0) : 1;
+	src->cca = f[4] ? strtoul(f[4], NULL, 0) : PKT_SI446X_NO_CCA_RSSI;
+	if(src->len < SIM_TX_MIN_LEN)
+		src->len = SIM_TX_MIN_LEN;
+	return src->period_ms != 0 && src->burst != 0;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+			"usage: %s [options]\n"
+			"  -s sec      simulated time (default 600)\n"
+			"  -r ms[:len] receive a frame every ms (mean) of len byte\n"
+			"  -R          random (exponential) receive intervals\n"
+			"  -d ms       decoder time after the end of a frame\n"
+			"  -c ms       callback time per received frame\n"
+			"  -t ms[:len[:prio[:burst[:cca]]]]\n"
+			"              send burst packets every ms, repeat for more sources\n"
+			"              prio command|position|digipeat|bulk, cca RSSI (none)\n"
+			"  -S seed     seed of the random intervals\n"
+			"  -v level    trace level (1 error ... 5 debug)\n",
+			name);
+}
+
+static void report(uint32_t secs, const sim_radio_config_t *cfg) {
+	const sim_radio_stats_t *st = simRadioGetStats();
+	packet_svc_t *handler = pktGetServiceObject(PKT_RADIO_1);
+	double min = secs / 60.0;
+
+	printf("Simulated %u s. PWM queue %u, RX buffers %u, callback workers %u\n",
+		   secs, NUMBER_PWM_FIFOS, NUMBER_RX_PKT_BUFFERS,
+		   PKT_RX_CALLBACK_WORKERS);
+
+	printf("Receive\n");
+	if(cfg->rx_interval_ms != 0) {
+		printf("  load %s every %u ms, %u byte (%u ms on air),"
+			   " decode %u ms, callback %u ms\n",
+			   cfg->rx_random ? "mean" : "frame", cfg->rx_interval_ms,
+			   cfg->rx_len, chTimeI2MS(simRadioAirTime(cfg->rx_len,
+													   SIM_AFSK_BAUD)),
+			   cfg->decode_ms, sim_callback_ms);
+	}
+	printf("  on air %u, delivered %u (%.1f/min)\n", st->rx_frames,
+		   sim_rx_delivered, sim_rx_delivered / min);
+	printf("  missed in TX or off %u, cut by TX %u\n", st->rx_missed,
+		   st->rx_cut);
+	printf("  EVT_PWM_QUEUE_FULL %u, EVT_PKT_NO_BUFFER %u\n",
+		   st->rx_queue_full, st->rx_no_buffer);
+	print_samples("latency end of frame to cb", &sim_rx_latency);
+
+	printf("Transmit\n");
+	for(uint8_t i = 0; i < sim_num_sources; i++) {
+		sim_source_t *src = &sim_sources[i];
+		char what[40];
+		printf("  source %u: every %u ms, %u x %u byte, %s, CCA %s\n", i,
+			   src->period_ms, src->burst, src->len,
+			   sim_prio_names[src->prio],
+			   src->cca == PKT_SI446X_NO_CCA_RSSI ? "off" : "on");
+		printf("    sends %u, failed %u, packets on air %u (%.1f/min)\n",
+			   src->sends, src->failed, src->on_air, src->on_air / min);
+		snprintf(what, sizeof(what), "  latency submit to RF");
+		print_samples(what, &src->latency);
+	}
+	printf("  packets %u in %u sessions, on air %u ms (%.1f%%)\n",
+		   st->tx_frames, st->tx_sessions, chTimeI2MS(st->tx_air),
+		   100.0 * chTimeI2MS(st->tx_air) / (secs * 1000.0));
+	printf("  CSMA granted %u, persisted %u, busy %u, forced %u\n",
+		   handler->tx_csma.granted, handler->tx_csma.persisted,
+		   handler->tx_csma.busy, handler->tx_csma.forced);
+}
+
+static uint32_t sim_secs = 600;
+static sim_radio_config_t sim_cfg = {
+	.rx_len = 60,
+	.seed = 1,
+	.on_air = sim_on_air
+};
+
+static THD_FUNCTION(simMain, arg) {
+	(void)arg;
+
+	if(!pktSystemInit() || !pktServiceCreate(PKT_RADIO_1)) {
+		fprintf(stderr, "packet service not created\n");
+		exit(1);
+	}
+	if(pktOpenRadioReceive(PKT_RADIO_1, MOD_AFSK, SIM_FREQ, 0) != MSG_OK
+	   || pktEnableDataReception(PKT_RADIO_1, 0, 0x4F, sim_receive)
+		  != MSG_OK) {
+		fprintf(stderr, "receive not started\n");
+		exit(1);
+	}
+
+	simRadioInit(&sim_cfg);
+	for(uint8_t i = 0; i < sim_num_sources; i++)
+		chThdCreateFromHeap(NULL, THD_WORKING_AREA_SIZE(1024), "source",
+							NORMALPRIO, simSource, &sim_sources[i]);
+
+	chThdSleep(TIME_S2I(sim_secs));
+	report(sim_secs, &sim_cfg);
+	exit(0);
+}
+
+int main(int argc, char *argv[])
+{
+	int opt;
+	while((opt = getopt(argc, argv, "s:r:Rd:c:t:S:v:")) != -1) {
+		switch(opt) {
+		case 's':
+			sim_secs = strtoul(optarg, NULL, 0);
+			break;
+		case 'r': {
+			char *len = strchr(optarg, ':');
+			sim_cfg.rx_interval_ms = strtoul(optarg, NULL, 0);
+			if(len != NULL)
+				sim_cfg.rx_len = strtoul(len + 1, NULL, 0);
+			break;
+		}
+		case 'R':
+			sim_cfg.rx_random = true;
+			break;
+		case 'd':
+			sim_cfg.decode_ms = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			sim_callback_ms = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			if(sim_num_sources == SIM_MAX_SOURCES
+			   || !parse_source(optarg, &sim_sources[sim_num_sources])) {
+				usage(argv[0]);
+				return 2;
+			}
+			sim_num_sources++;
+			break;
+		case 'S':
+			sim_cfg.seed = strtoul(optarg, NULL, 0);
+			break;
+		case 'v':
+			sim_trace_level = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	if(optind != argc || sim_secs == 0) {
+		usage(argv[0]);
+		return 2;
+	}
+
+	chSysInit();
+	chThdCreateFromHeap(NULL, THD_WORKING_AREA_SIZE(2048), "sim",
+						NORMALPRIO, simMain, NULL);
+	/* main() is now the main thread of the kernel and has nothing to do. */
+	chThdSleep(TIME_INFINITE);
+	return 0;
+}
@@ -0,0 +1,525 @@
+/*
+ * Simulated radio and AFSK decoder. See simradio.h.
+ *
+ * Receive follows the PWM path of the target. A frame takes a PWM queue
+ * object when it starts on air (carrier detect) and the decoder takes a
+ * packet buffer when it picks the object up. The frame is dispatched when
+ * it has ended and the decode time has passed. A frame which starts with
+ * every queue object in use raises EVT_PWM_QUEUE_FULL and one which finds
+ * no packet buffer raises EVT_PKT_NO_BUFFER, as rxpwm.c and rxafsk.c do.
+ * Stopping the PWM stream or the receiver cuts the frame on air.
+ */
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "ch.h"
+#include "hal.h"
+#include "pktconf.h"
+#include "si446x.h"
+#include "debug.h"
+#include "txlatency.h"
+#include "txhdlc.h"
+#include "simradio.h"
+
+/* Object of the simulated PWM queue, one per frame on air. */
+typedef struct {
+  systime_t                 end;
+  uint16_t                  len;
+  bool                      cut;
+} sim_pwm_object_t;
+
+static struct {
+  bool                      rx_on;
+  bool                      pwm_on;
+  bool                      tx_on;
+  bool                      busy;       /* A frame of the load is on air */
+  sim_pwm_object_t          *active;    /* Frame being streamed */
+  dyn_objects_fifo_t        *pwm_factory;
+  objects_fifo_t            *pwm_fifo;
+} sim_radio;
+
+static sim_radio_config_t sim_cfg;
+static sim_radio_stats_t sim_stats;
+
+static ICUDriver sim_icu;
+static const ICUConfig sim_icucfg;
+
+AFSKDemodDriver AFSKD1;
+
+/*
+ * Commands to the chip block the caller on the SPI bus on target. Threads
+ * made ready meanwhile (the decoder started by an open) get to run.
+ */
+#define SIM_SPI_COMMAND_TIME    TIME_MS2I(1)
+
+static void sim_spi_command(void) {
+  chThdSleep(SIM_SPI_COMMAND_TIME);
+}
+
+/* Configuration objects for radios of the simulation. */
+static const radio_band_t *const sim_bands[] = {
+  &band_2m,
+  NULL
+};
+
+const radio_config_t radio_list[] = {
+  {
+    .unit   = PKT_RADIO_1,
+    .type   = SI446X,
+    .pkt    = (pkt_service_t *const)&RPKTD1,
+    .afsk   = &AFSKD1,
+    .bands  = (radio_band_t **const)sim_bands
+  },
+  {
+    .unit   = PKT_RADIO_NONE
+  }
+};
+
+/**
+ * Time on air of a frame of len bytes (without FCS) sent as the Si446x
+ * feeder frames it. Bit stuffing is not counted.
+ */
+sysinterval_t simRadioAirTime(uint16_t len, uint32_t speed) {
+  uint32_t bytes = SI446X_AFSK_PREAMBLE + len + 2 + SI446X_AFSK_POSTAMBLE
+                   + SI446X_AFSK_TAIL;
+  return TIME_US2I((uint64_t)bytes * 8 * 1000000 / speed);
+}
+
+/**
+ * Time the end of a load frame was on air.
+ */
+systime_t simRadioArrival(const pkt_data_object_t *pkt_buffer) {
+  const uint8_t *t = pkt_buffer->buffer + SIM_RX_TIME_OFFSET;
+  return (systime_t)(t[0] | (t[1] << 8) | (t[2] << 16)
+                     | ((uint32_t)t[3] << 24));
+}
+
+const sim_radio_stats_t *simRadioGetStats(void) {
+  return &sim_stats;
+}
+
+/*
+ * The frame being streamed loses its PWM data.
+ */
+static void sim_cut(void) {
+  chSysLock();
+  if(sim_radio.active != NULL) {
+    sim_radio.active->cut = true;
+    sim_radio.active = NULL;
+    sim_stats.rx_cut++;
+  }
+  chSysUnlock();
+}
+
+/*===========================================================================*/
+/* Air.                                                                      */
+/*===========================================================================*/
+
+static uint32_t sim_next_interval(void) {
+  if(!sim_cfg.rx_random)
+    return sim_cfg.rx_interval_ms;
+  double u = (rand_r(&sim_cfg.seed) + 1.0) / (RAND_MAX + 2.0);
+  return (uint32_t)(-log(u) * sim_cfg.rx_interval_ms);
+}
+
+/*
+ * Frames of other stations. Frames do not overlap.
+ */
+static THD_FUNCTION(simAir, arg) {
+  (void)arg;
+  packet_svc_t *handler = pktGetServiceObject(PKT_RADIO_1);
+  sysinterval_t air = simRadioAirTime(sim_cfg.rx_len, SIM_AFSK_BAUD);
+  systime_t start = chVTGetSystemTime();
+
+  while(true) {
+    sysinterval_t gap = TIME_MS2I(sim_next_interval());
+    start = chTimeAddX(start, gap > air ? gap : air);
+    chThdSleepUntil(start);
+
+    sim_stats.rx_frames++;
+    sim_radio.busy = true;
+    if(!sim_radio.rx_on || !sim_radio.pwm_on || sim_radio.tx_on) {
+      sim_stats.rx_missed++;
+    } else {
+      sim_pwm_object_t *obj = chFifoTakeObjectTimeout(sim_radio.pwm_fifo,
+                                                      TIME_IMMEDIATE);
+      if(obj == NULL) {
+        sim_stats.rx_queue_full++;
+        pktAddEventFlags(handler, EVT_PWM_QUEUE_FULL);
+      } else {
+        obj->end = chTimeAddX(start, air);
+        obj->len = sim_cfg.rx_len;
+        obj->cut = false;
+        sim_radio.active = obj;
+        chFifoSendObject(sim_radio.pwm_fifo, obj);
+      }
+    }
+    chThdSleepUntil(chTimeAddX(start, air));
+    sim_radio.busy = false;
+    sim_radio.active = NULL;
+  }
+}
+
+void simRadioInit(const sim_radio_config_t *cfg) {
+  sim_cfg = *cfg;
+  if(sim_cfg.rx_len < SIM_RX_MIN_LEN)
+    sim_cfg.rx_len = SIM_RX_MIN_LEN;
+  if(sim_cfg.rx_len > PKT_RX_BUFFER_SIZE - 2)
+    sim_cfg.rx_len = PKT_RX_BUFFER_SIZE - 2;
+  if(sim_cfg.rx_interval_ms != 0)
+    chThdCreateFromHeap(NULL, THD_WORKING_AREA_SIZE(1024), "air",
+                        HIGHPRIO, simAir, NULL);
+}
+
+/*===========================================================================*/
+/* Si446x driver.                                                            */
+/*===========================================================================*/
+
+bool Si446x_conditional_init(radio_unit_t radio) {
+  (void)radio;
+  sim_spi_command();
+  return true;
+}
+
+void Si446x_radioStandby(const radio_unit_t radio) {
+  (void)radio;
+  sim_radio.rx_on = false;
+  sim_cut();
+}
+
+void Si446x_radioShutdown(const radio_unit_t radio) {
+  Si446x_radioStandby(radio);
+}
+
+bool Si4464_enableReceive(const radio_unit_t radio,
+                          radio_freq_t rx_frequency,
+                          channel_hz_t rx_step,
+                          radio_ch_t chan,
+                          radio_squelch_t rssi,
+                          mod_t mod) {
+  (void)radio;
+  (void)rx_frequency;
+  (void)rx_step;
+  (void)chan;
+  (void)rssi;
+  (void)mod;
+  sim_spi_command();
+  sim_radio.rx_on = true;
+  return true;
+}
+
+void Si446x_disableReceive(radio_unit_t radio) {
+  Si446x_radioStandby(radio);
+}
+
+radio_signal_t Si446x_getCurrentRSSI(const radio_unit_t radio) {
+  (void)radio;
+  return sim_radio.busy ? 0x80 : 0x20;
+}
+
+void Si446x_setSquelch(const radio_unit_t radio, const radio_squelch_t rssi) {
+  (void)radio;
+  (void)rssi;
+  sim_spi_command();
+}
+
+uint8_t Si446x_readCCA(const radio_unit_t radio) {
+  (void)radio;
+  return sim_radio.busy ? PAL_HIGH : PAL_LOW;
+}
+
+ICUDriver *Si446x_attachPWM(const radio_unit_t radio) {
+  (void)radio;
+  return &sim_icu;
+}
+
+const ICUConfig *Si446x_enablePWMevents(const radio_unit_t radio,
+                                        palcallback_t cb) {
+  (void)radio;
+  (void)cb;
+  return &sim_icucfg;
+}
+
+void Si446x_disablePWMevents(const radio_unit_t radio) {
+  (void)radio;
+}
+
+/*
+ * Feeder as in si446x.c. The packets of a chain are sent in bursts framed
+ * by the encoder of the target and the send gives way between bursts to a
+ * higher priority one. The burst limit is in encoded bytes.
+ */
+static msg_t Si446x_feed(radio_task_object_t *rto, uint8_t pre,
+                         uint8_t post, uint8_t tail, bool scramble,
+                         uint16_t limit) {
+  radio_unit_t radio = rto->handler->radio;
+
+  packet_t pp = rto->packet_out;
+
+  chDbgAssert(pp != NULL, "no packet in radio task");
+
+  txlat_mark(pp, TXLAT_FEED, true);
+
+  if(pktLockRadioTransmit(radio, TIME_INFINITE) == MSG_RESET) {
+    pktReleaseBufferChain(pp);
+    rto->packet_out = NULL;
+    return MSG_RESET;
+  }
+
+  /* The radio leaves receive to transmit. */
+  sim_radio.rx_on = false;
+  sim_cut();
+
+  radio_squelch_t rssi = rto->squelch;
+  sim_stats.tx_sessions++;
+
+  do {
+    /* Defer to the TX worker if channel access is not granted. */
+    if(rssi != PKT_SI446X_NO_CCA_RSSI
+        && !pktCheckRadioChannelAccess(rto, !sim_radio.busy))
+      break;
+    rssi = PKT_SI446X_NO_CCA_RSSI;
+
+    tx_iterator_t iterator;
+    pktStreamIteratorInitBurst(&iterator, pp, pre, SI446X_BURST_GAP, post,
+                               tail, scramble, limit);
+    uint16_t all = pktStreamEncodingIterator(&iterator, NULL, 0);
+    sysinterval_t air = TIME_US2I((uint64_t)all * 8 * 1000000
+                                  / rto->tx_speed);
+
+    sim_radio.tx_on = true;
+    packet_t np = pp;
+    uint8_t n;
+    for(n = 0; n < iterator.frames; n++, np = np->nextp) {
+      txlat_mark(np, TXLAT_RF, false);
+      if(sim_cfg.on_air != NULL)
+        sim_cfg.on_air(np);
+    }
+    TRACE_DEBUG("SIM  > TX %d frame(s) %d byte for %d ms", iterator.frames,
+                all, chTimeI2MS(air));
+    chThdSleep(air);
+    sim_radio.tx_on = false;
+
+    sim_stats.tx_frames += iterator.frames;
+    sim_stats.tx_air += air;
+    while(pp != np) {
+      packet_t next = pp->nextp;
+      pktReleaseBufferObject(pp);
+      pp = next;
+    }
+
+    /* A queued higher priority send takes the radio between bursts. */
+    if(pp != NULL && pktIsRadioTransmitPreempted(rto))
+      break;
+
+    /* Let a waiting higher priority radio user in between bursts. */
+    if(pp != NULL && pktYieldRadioTransmit(radio))
+      rssi = rto->squelch;
+  } while(pp != NULL);
+
+  /* Packets not sent (if any) are resumed by the TX worker. */
+  rto->packet_out = pp;
+
+  pktUnlockRadioTransmit(radio);
+
+  return MSG_OK;
+}
+
+msg_t Si446x_feedAFSK(radio_task_object_t *rto) {
+  return Si446x_feed(rto, SI446X_AFSK_PREAMBLE, SI446X_AFSK_POSTAMBLE,
+                     SI446X_AFSK_TAIL, false,
+                     SI446X_TX_MAX_LEN / SAMPLES_PER_BAUD);
+}
+
+msg_t Si446x_feed2FSK(radio_task_object_t *rto) {
+  return Si446x_feed(rto, SI446X_2FSK_PREAMBLE, SI446X_2FSK_POSTAMBLE,
+                     SI446X_2FSK_TAIL, true, SI446X_TX_MAX_LEN);
+}
+
+bool Si446x_blocSendAFSK(radio_task_object_t *rt) {
+  if(!pktQueueRadioTransmit(rt)) {
+    TRACE_ERROR("SI   > No transmit worker for AFSK send");
+    return false;
+  }
+  return true;
+}
+
+bool Si446x_blocSend2FSK(radio_task_object_t *rt) {
+  if(!pktQueueRadioTransmit(rt)) {
+    TRACE_ERROR("SI   > No transmit worker for 2FSK send");
+    return false;
+  }
+  return true;
+}
+
+/*===========================================================================*/
+/* AFSK decoder.                                                             */
+/*===========================================================================*/
+
+void pktEnableRadioPWM(const radio_unit_t radio) {
+  (void)radio;
+  sim_radio.pwm_on = true;
+}
+
+void pktDisableRadioPWM(const radio_unit_t radio) {
+  (void)radio;
+  sim_radio.pwm_on = false;
+  sim_cut();
+}
+
+/*
+ * Load frame with the time its end was on air.
+ */
+static void sim_fill_frame(pkt_data_object_t *pkt_buffer,
+                           const sim_pwm_object_t *obj) {
+  static const uint8_t hdr[SIM_RX_TIME_OFFSET] = {
+    'A' << 1, 'P' << 1, 'Z' << 1, 'S' << 1, 'I' << 1, 'M' << 1, 0x60,
+    'S' << 1, 'T' << 1, 'N' << 1, ' ' << 1, ' ' << 1, ' ' << 1, 0x61,
+    0x03, 0xF0
+  };
+  uint16_t i;
+  for(i = 0; i < obj->len; i++) {
+    uint8_t c;
+    if(i < SIM_RX_TIME_OFFSET)
+      c = hdr[i];
+    else if(i < SIM_RX_MIN_LEN)
+      c = (uint8_t)(obj->end >> ((i - SIM_RX_TIME_OFFSET) * 8));
+    else
+      c = 'x';
+    (void)pktStoreBufferData(pkt_buffer, c);
+  }
+  /* FCS, low byte first. */
+  uint16_t fcs = ~pkt_buffer->crc;
+  (void)pktStoreBufferData(pkt_buffer, fcs & 0xFF);
+  (void)pktStoreBufferData(pkt_buffer, fcs >> 8);
+}
+
+/*
+ * Decoder thread with the command handshake of rxafsk.c.
+ */
+static THD_FUNCTION(simDecoder, arg) {
+  AFSKDemodDriver *myDriver = arg;
+  packet_svc_t *myHandler = myDriver->packet_handler;
+  radio_unit_t radio = myHandler->radio;
+
+  myHandler->active_packet_object = NULL;
+
+  pktAddEventFlags(myDriver, DEC_OPEN_EXEC);
+  myDriver->decoder_state = DECODER_WAIT;
+  while(true) {
+    if(myDriver->decoder_state == DECODER_WAIT) {
+      eventmask_t evt = chEvtWaitAnyTimeout(DEC_COMMAND_START, TIME_MS2I(100));
+      if(evt) {
+        pktEnableRadioPWM(radio);
+        myDriver->decoder_state = DECODER_IDLE;
+        pktAddEventFlags(myDriver, DEC_START_EXEC);
+        continue;
+      }
+      evt = chEvtGetAndClearEvents(DEC_COMMAND_CLOSE);
+      if(evt) {
+        pktAddEventFlags(myDriver, DEC_CLOSE_EXEC);
+        pktDisableRadioPWM(radio);
+        chFactoryReleaseObjectsFIFO(sim_radio.pwm_factory);
+        sim_radio.pwm_factory = NULL;
+        myDriver->decoder_state = DECODER_TERMINATED;
+        chThdExit(MSG_OK);
+      }
+      continue;
+    }
+
+    if(chEvtGetAndClearEvents(DEC_COMMAND_STOP)) {
+      pktDisableRadioPWM(radio);
+      myDriver->decoder_state = DECODER_WAIT;
+      pktAddEventFlags(myDriver, DEC_STOP_EXEC);
+      continue;
+    }
+
+    /* Poll for a frame on air. */
+    sim_pwm_object_t *obj;
+    if(chFifoReceiveObjectTimeout(sim_radio.pwm_fifo, (void **)&obj,
+                                  TIME_MS2I(10)) != MSG_OK)
+      continue;
+
+    dyn_objects_fifo_t *pkt_fifo =
+        chFactoryFindObjectsFIFO(myHandler->pbuff_name);
+    chDbgAssert(pkt_fifo != NULL, "unable to find packet fifo");
+    objects_fifo_t *pkt_buffer_pool = chFactoryGetObjectsFIFO(pkt_fifo);
+
+    pkt_data_object_t *myPktBuffer = pktTakeDataBuffer(myHandler,
+                                                        pkt_buffer_pool,
+                                                        TIME_MS2I(100));
+    if(myPktBuffer == NULL) {
+      chFactoryReleaseObjectsFIFO(pkt_fifo);
+      sim_stats.rx_no_buffer++;
+      pktAddEventFlags(myHandler, EVT_PKT_NO_BUFFER);
+      chFifoReturnObject(sim_radio.pwm_fifo, obj);
+      continue;
+    }
+
+    /* Decode runs with the stream and ends a while after the frame. */
+    if((int32_t)(obj->end - chVTGetSystemTime()) > 0)
+      chThdSleepUntil(obj->end);
+    if(!obj->cut && sim_cfg.decode_ms != 0)
+      chThdSleep(TIME_MS2I(sim_cfg.decode_ms));
+
+    if(obj->cut) {
+      /* Reset. The buffer goes back unused. */
+#if USE_CCM_HEAP_RX_BUFFERS == TRUE
+      chHeapFree(myPktBuffer->buffer);
+#endif
+      chFifoReturnObject(pkt_buffer_pool, myPktBuffer);
+      chFactoryReleaseObjectsFIFO(pkt_fifo);
+    } else {
+      sim_fill_frame(myPktBuffer, obj);
+      myPktBuffer->status |= STA_AFSK_DECODE_DONE;
+      sim_stats.rx_dispatched++;
+      pktDispatchReceivedBuffer(myPktBuffer);
+    }
+    myHandler->active_packet_object = NULL;
+    chFifoReturnObject(sim_radio.pwm_fifo, obj);
+  }
+}
+
+AFSKDemodDriver *pktCreateAFSKDecoder(packet_svc_t *pktHandler) {
+
+  chDbgAssert(pktHandler != NULL, "no packet handler");
+
+  const radio_config_t *data = pktGetRadioData(pktHandler->radio);
+  if(data == NULL)
+    return NULL;
+
+  AFSKDemodDriver *myDriver = data->afsk;
+
+  chEvtObjectInit(pktGetEventSource(myDriver));
+
+  myDriver->packet_handler = pktHandler;
+
+  radio_unit_t rid = pktHandler->radio;
+
+  /* The PWM queue has the depth of the target. */
+  chsnprintf(myDriver->pwm_fifo_name, sizeof(myDriver->pwm_fifo_name),
+             "%s%02i", PKT_PWM_QUEUE_PREFIX, rid);
+  sim_radio.pwm_factory = chFactoryCreateObjectsFIFO(myDriver->pwm_fifo_name,
+                                        sizeof(sim_pwm_object_t),
+                                        NUMBER_PWM_FIFOS, sizeof(msg_t));
+  if(sim_radio.pwm_factory == NULL)
+    return NULL;
+  sim_radio.pwm_fifo = chFactoryGetObjectsFIFO(sim_radio.pwm_factory);
+
+  chsnprintf(myDriver->decoder_name, sizeof(myDriver->decoder_name),
+             "%s%02i", PKT_AFSK_THREAD_NAME_PREFIX, rid);
+
+  myDriver->decoder_thd = chThdCreateFromHeap(NULL,
+              THD_WORKING_AREA_SIZE(PKT_AFSK_DECODER_WA_SIZE),
+              myDriver->decoder_name,
+              NORMALPRIO - 10,
+              simDecoder,
+              myDriver);
+
+  if(myDriver->decoder_thd == NULL) {
+    chFactoryReleaseObjectsFIFO(sim_radio.pwm_factory);
+    return NULL;
+  }
+  return myDriver;
+}
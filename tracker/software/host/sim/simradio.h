@@ -0,0 +1,59 @@
+/*
+ * Simulated radio and AFSK decoder.
+ * The Si446x functions beneath pktLLDradio*() and the decoder of rxafsk.c
+ * are replaced. Sends take their air time and received frames come from a
+ * scripted load of other stations. The radio manager, TX worker and packet
+ * service above them are the firmware code.
+ */
+
+#ifndef SIM_SIMRADIO_H_
+#define SIM_SIMRADIO_H_
+
+#include "ch.h"
+#include "pktconf.h"
+
+/* The air is 1200 baud AFSK framed as by the Si446x feeder. */
+#define SIM_AFSK_BAUD           1200U
+
+typedef struct {
+  /* Mean time between the starts of received frames (0 no load). */
+  uint32_t                  rx_interval_ms;
+  /* Exponential intervals (random arrivals) instead of fixed. */
+  bool                      rx_random;
+  /* Frame length without the FCS. */
+  uint16_t                  rx_len;
+  /* Decoder work after the end of a frame before it is dispatched. */
+  uint32_t                  decode_ms;
+  uint32_t                  seed;
+  /* Called as each packet goes on air. */
+  void                      (*on_air)(packet_t pp);
+} sim_radio_config_t;
+
+typedef struct {
+  uint32_t                  rx_frames;      /* Put on air by the load */
+  uint32_t                  rx_missed;      /* Receiver off or in TX */
+  uint32_t                  rx_cut;         /* PWM stopped during the frame */
+  uint32_t                  rx_queue_full;  /* EVT_PWM_QUEUE_FULL */
+  uint32_t                  rx_no_buffer;   /* EVT_PKT_NO_BUFFER */
+  uint32_t                  rx_dispatched;
+  uint32_t                  tx_frames;
+  uint32_t                  tx_sessions;
+  sysinterval_t             tx_air;         /* Total time on air */
+} sim_radio_stats_t;
+
+/* Offset of the arrival time in the information field of a load frame. */
+#define SIM_RX_TIME_OFFSET      16U
+#define SIM_RX_MIN_LEN          (SIM_RX_TIME_OFFSET + 4U)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  void simRadioInit(const sim_radio_config_t *cfg);
+  const sim_radio_stats_t *simRadioGetStats(void);
+  sysinterval_t simRadioAirTime(uint16_t len, uint32_t speed);
+  systime_t simRadioArrival(const pkt_data_object_t *pkt_buffer);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIM_SIMRADIO_H_ */
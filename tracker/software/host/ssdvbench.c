@@ -0,0 +1,233 @@
+/**
+  * Offline benchmark of the SSDV encoder.
+  * Encodes JPEG images with the firmware encoder (ssdv.c, rs8.c) at each
+  * quality and reports the packets per image, the JPEG bytes encoded per
+  * second and the time per packet.
+  *
+  * The image is set whole as when it is sent after capture. With -f it is
+  * grown in segments as during a streamed capture.
+  *
+  * Times are nanoseconds of host CPU time. They compare encoder versions,
+  * they are not cycles of the STM32. The ssdv shell command measures the
+  * encoder on target.
+  */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ssdv.h"
+
+#define BENCH_QUALITIES		8
+
+typedef struct {
+	uint32_t	packets;
+	uint64_t	ns;			/* Fastest encode */
+} bench_encode_t;
+
+typedef struct {
+	uint32_t	images;
+	uint32_t	packets;
+	uint64_t	bytes;
+	uint64_t	ns;
+} bench_total_t;
+
+static bool dc_only;
+static size_t segment;
+static int repeat = 3;
+
+static uint64_t getNs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000U + ts.tv_nsec;
+}
+
+/*
+ * Name of the camera resolution of an image.
+ */
+static const char *getResolutionName(uint16_t width, uint16_t height)
+{
+	static const struct {
+		uint16_t	width;
+		uint16_t	height;
+		const char	*name;
+	} res[] = {
+		{160, 120, "QQVGA"},
+		{320, 240, "QVGA"},
+		{640, 480, "VGA"},
+		{1024, 768, "XGA"},
+		{1600, 1200, "UXGA"}
+	};
+	size_t i;
+	for(i = 0; i < sizeof(res) / sizeof(res[0]); i++) {
+		if(res[i].width == width && res[i].height == height)
+			return res[i].name;
+	}
+	return "-";
+}
+
+/*
+ * Encode an image the same as transmit_image_packets() does.
+ * Returns SSDV_EOI when the whole image is encoded.
+ */
+static char encode(ssdv_t *s, const uint8_t *image, size_t len,
+				   uint8_t quality, uint32_t *packets)
+{
+	uint8_t pkt[SSDV_PKT_SIZE];
+	size_t fed = segment == 0 || segment > len ? len : segment;
+	char c;
+
+	ssdv_enc_init(s, SSDV_TYPE_PADDING, "N0CALL", 0, quality);
+	ssdv_enc_set_buffer(s, pkt);
+	ssdv_enc_set_dc_only(s, dc_only);
+	ssdv_enc_set_image(s, image, fed);
+	*packets = 0;
+	while(true) {
+		c = ssdv_enc_get_packet(s);
+		if(c == SSDV_FEED_ME && fed < len) {
+			fed = fed + segment > len ? len : fed + segment;
+			ssdv_enc_grow(s, fed);
+			continue;
+		}
+		if(c != SSDV_OK)
+			return c;
+		(*packets)++;
+	}
+}
+
+static int benchImage(const char *name, const uint8_t *image, size_t len,
+					  int quality, bench_total_t *total)
+{
+	ssdv_t s;
+	int q;
+	for(q = 0; q < BENCH_QUALITIES; q++) {
+		if(quality >= 0 && q != quality)
+			continue;
+		bench_encode_t e = {0, UINT64_MAX};
+		int n;
+		for(n = 0; n < repeat; n++) {
+			uint64_t start = getNs();
+			char c = encode(&s, image, len, q, &e.packets);
+			uint64_t ns = getNs() - start;
+			if(c != SSDV_EOI) {
+				fprintf(stderr, "%s: encode failed at quality %d (%d)\n",
+						name, q, c);
+				return -1;
+			}
+			if(ns < e.ns)
+				e.ns = ns;
+		}
+		printf("%-24s %4ux%-4u %-5s %2d %8zu %8u %10.1f %10.0f %10.0f\n",
+			   name, s.width, s.height, getResolutionName(s.width, s.height),
+			   q, len, e.packets, e.ns / 1e3,
+			   e.packets ? (double)e.ns / e.packets : 0.0,
+			   e.ns ? len * 1e6 / e.ns : 0.0);
+		total[q].images++;
+		total[q].packets += e.packets;
+		total[q].bytes += len;
+		total[q].ns += e.ns;
+	}
+	return 0;
+}
+
+static void printTotals(const bench_total_t *total)
+{
+	printf("\n%-8s %8s %12s %10s %10s\n", "quality", "images",
+		   "packets/img", "ns/packet", "kB/s");
+	int q;
+	for(q = 0; q < BENCH_QUALITIES; q++) {
+		const bench_total_t *t = &total[q];
+		if(t->images == 0)
+			continue;
+		printf("%-8d %8u %12.1f %10.0f %10.0f\n", q, t->images,
+			   (double)t->packets / t->images,
+			   t->packets ? (double)t->ns / t->packets : 0.0,
+			   t->ns ? t->bytes * 1e6 / t->ns : 0.0);
+	}
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+			"usage: %s [-q quality] [-d] [-f bytes] [-r count] file...\n"
+			"  -q  encode at one quality (default: 0 to 7)\n"
+			"  -d  encode the DC only preview\n"
+			"  -f  grow the image in segments of bytes as during capture\n"
+			"  -r  encodes of each image, the fastest is reported (default 3)\n",
+			name);
+}
+
+static uint8_t *readFile(const char *path, size_t *len)
+{
+	FILE *f = fopen(path, "rb");
+	if(f == NULL) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return NULL;
+	}
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	uint8_t *data = size > 0 ? malloc(size) : NULL;
+	if(data != NULL && fread(data, size, 1, f) != 1) {
+		free(data);
+		data = NULL;
+	}
+	fclose(f);
+	if(data == NULL)
+		fprintf(stderr, "%s: unable to read\n", path);
+	*len = size;
+	return data;
+}
+
+int main(int argc, char *argv[])
+{
+	int quality = -1;
+	int opt;
+	while((opt = getopt(argc, argv, "q:df:r:")) != -1) {
+		switch(opt) {
+		case 'q':
+			quality = atoi(optarg);
+			break;
+		case 'd':
+			dc_only = true;
+			break;
+		case 'f':
+			segment = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			repeat = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	if(optind >= argc || quality >= BENCH_QUALITIES || repeat < 1) {
+		usage(argv[0]);
+		return 2;
+	}
+
+	printf("%-24s %9s %-5s %2s %8s %8s %10s %10s %10s\n", "image", "size",
+		   "res", "q", "bytes", "packets", "us/image", "ns/packet", "kB/s");
+	bench_total_t total[BENCH_QUALITIES] = {{0}};
+	int failed = 0;
+	int i;
+	for(i = optind; i < argc; i++) {
+		size_t len;
+		uint8_t *image = readFile(argv[i], &len);
+		if(image == NULL)
+			return 1;
+		const char *name = strrchr(argv[i], '/');
+		name = name != NULL ? name + 1 : argv[i];
+		if(benchImage(name, image, len, quality, total))
+			failed++;
+		free(image);
+	}
+	printTotals(total);
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,222 @@
+/**
+  * Incremental SSDV image decoder for the ground station.
+  *
+  * Packets are fed to the firmware decoder as they arrive. The decoder
+  * only moves forward so its state before each packet is kept. A packet
+  * older than the last one fed rewinds the decoder to the state before the
+  * next packet fed after it. Then it and the packets after it are fed
+  * again. Packets received in order (with or without gaps) cost one feed
+  * each.
+  *
+  * ssdv_dec_get_jpeg() fills the missing MCUs and ends the image, so it is
+  * run on a copy of the decoder. The copy writes after the end of the data
+  * in the shared output buffer which the next feed overwrites.
+  */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ssdv.h"
+#include "ssdvdec.h"
+
+#define SSDVDEC_BUFFER_START	(64 * 1024)
+/* Free space kept for the data of one packet and the end of image. */
+#define SSDVDEC_BUFFER_MARGIN	(4 * SSDV_PKT_SIZE)
+
+#define SSDVDEC_HAVE			1U	/* Packet received */
+#define SSDVDEC_FED				2U	/* Packet fed to the decoder */
+
+struct ssdvdec_image {
+	ssdv_t		s;
+	uint8_t		*buffer;	/* Output JPEG of the decoder */
+	size_t		size;
+	uint8_t		*packets;	/* Received packets by packet ID */
+	ssdv_t		*states;	/* Decoder state before each packet fed */
+	uint8_t		*flags;
+	uint32_t	slots;
+	uint16_t	count;		/* Packets received */
+	uint16_t	next;		/* Next packet ID the decoder takes */
+	uint8_t		image_id;
+	uint32_t	callsign;
+	bool		eoi;		/* The decoder has seen the last MCU */
+};
+
+/*
+ * Ensure space for the next packet and for padding all MCUs not decoded.
+ * A padded MCU part is a DC and an EOB code of at most 6 bits.
+ */
+static bool reserve(ssdvdec_image_t *img)
+{
+	ssdv_t *s = &img->s;
+	size_t used = s->outp - s->out;
+	size_t parts = (size_t)(s->mcu_count > s->mcu_id
+							? s->mcu_count - s->mcu_id : 0) * (s->ycparts + 2);
+	size_t need = used + parts + SSDVDEC_BUFFER_MARGIN;
+	if(need <= img->size)
+		return true;
+
+	size_t size = img->size * 2;
+	while(size < need)
+		size *= 2;
+	uint8_t *buffer = malloc(size);
+	if(buffer == NULL)
+		return false;
+	memcpy(buffer, img->buffer, used);
+	ssdv_dec_set_buffer(s, buffer, size);
+	free(img->buffer);
+	img->buffer = buffer;
+	img->size = size;
+	return true;
+}
+
+static bool store(ssdvdec_image_t *img, uint16_t id, const uint8_t *packet)
+{
+	if(id >= img->slots) {
+		uint32_t slots = img->slots ? img->slots : 64;
+		while(slots <= id)
+			slots *= 2;
+		uint8_t *packets = realloc(img->packets, (size_t)slots * SSDV_PKT_SIZE);
+		if(packets == NULL)
+			return false;
+		img->packets = packets;
+		ssdv_t *states = realloc(img->states, slots * sizeof(ssdv_t));
+		if(states == NULL)
+			return false;
+		img->states = states;
+		uint8_t *flags = realloc(img->flags, slots);
+		if(flags == NULL)
+			return false;
+		memset(&flags[img->slots], 0, slots - img->slots);
+		img->flags = flags;
+		img->slots = slots;
+	}
+	memcpy(&img->packets[(size_t)id * SSDV_PKT_SIZE], packet, SSDV_PKT_SIZE);
+	img->flags[id] = SSDVDEC_HAVE;
+	img->count++;
+	return true;
+}
+
+/*
+ * Rewind the decoder to the state before packet id was fed. The output
+ * buffer may have moved since the state was kept.
+ */
+static void rewind_to(ssdvdec_image_t *img, uint16_t id)
+{
+	uint32_t i;
+
+	img->s = img->states[id];
+	ssdv_dec_set_buffer(&img->s, img->buffer, img->size);
+	for(i = id; i < img->slots; i++)
+		img->flags[i] &= ~SSDVDEC_FED;
+	img->next = id;
+	img->eoi = false;
+}
+
+static bool decode(ssdvdec_image_t *img, uint16_t id)
+{
+	if(img->eoi)
+		return true;
+	if(!reserve(img))
+		return false;
+	img->states[id] = img->s;
+	img->flags[id] |= SSDVDEC_FED;
+	char c = ssdv_dec_feed(&img->s, &img->packets[(size_t)id * SSDV_PKT_SIZE]);
+	/* SSDV_OK is returned at the end of image. */
+	img->eoi = c == SSDV_OK;
+	img->next = id + 1;
+	return true;
+}
+
+ssdvdec_image_t *ssdvdec_open(void)
+{
+	ssdvdec_image_t *img = calloc(1, sizeof(ssdvdec_image_t));
+	if(img == NULL)
+		return NULL;
+	img->buffer = malloc(SSDVDEC_BUFFER_START);
+	if(img->buffer == NULL) {
+		free(img);
+		return NULL;
+	}
+	img->size = SSDVDEC_BUFFER_START;
+	ssdv_dec_init(&img->s);
+	ssdv_dec_set_buffer(&img->s, img->buffer, img->size);
+	return img;
+}
+
+void ssdvdec_close(ssdvdec_image_t *img)
+{
+	if(img == NULL)
+		return;
+	free(img->buffer);
+	free(img->packets);
+	free(img->states);
+	free(img->flags);
+	free(img);
+}
+
+/*
+ * Add a packet of SSDV_PKT_SIZE bytes (with sync byte) to the image.
+ * Packets of another image than the first one fed are rejected.
+ */
+int ssdvdec_feed(ssdvdec_image_t *img, const uint8_t *packet)
+{
+	uint8_t pkt[SSDV_PKT_SIZE];
+	ssdv_packet_info_t info;
+	int errors;
+	uint32_t i;
+
+	memcpy(pkt, packet, SSDV_PKT_SIZE);
+	if(ssdv_dec_is_packet(pkt, &errors) != 0)
+		return SSDVDEC_INVALID;
+	ssdv_dec_header(&info, pkt);
+
+	if(img->count == 0) {
+		img->image_id = info.image_id;
+		img->callsign = info.callsign;
+	} else if(info.image_id != img->image_id
+			  || info.callsign != img->callsign) {
+		return SSDVDEC_INVALID;
+	}
+
+	uint16_t id = info.packet_id;
+	if(id < img->slots && (img->flags[id] & SSDVDEC_HAVE))
+		return SSDVDEC_DUPLICATE;
+	if(!store(img, id, pkt))
+		return SSDVDEC_NO_MEMORY;
+
+	if(id >= img->next)
+		return decode(img, id) ? SSDVDEC_OK : SSDVDEC_NO_MEMORY;
+
+	/* Late packet. The last packet fed is after it. */
+	for(i = id + 1; !(img->flags[i] & SSDVDEC_FED); i++);
+	rewind_to(img, i);
+	for(i = id; i < img->slots; i++) {
+		if((img->flags[i] & SSDVDEC_HAVE) && !decode(img, i))
+			return SSDVDEC_NO_MEMORY;
+	}
+	return SSDVDEC_REBUILT;
+}
+
+/*
+ * Get the JPEG of the packets fed so far. Missing MCUs are padded.
+ * The data is valid until the next call for the image.
+ */
+int ssdvdec_get_jpeg(ssdvdec_image_t *img, const uint8_t **jpeg,
+					 size_t *length)
+{
+	if(img->count == 0)
+		return SSDVDEC_INVALID;
+	if(!reserve(img))
+		return SSDVDEC_NO_MEMORY;
+	ssdv_t end = img->s;
+	uint8_t *data;
+	ssdv_dec_get_jpeg(&end, &data, length);
+	*jpeg = data;
+	return SSDVDEC_OK;
+}
+
+uint16_t ssdvdec_packets(const ssdvdec_image_t *img)
+{
+	return img->count;
+}
@@ -0,0 +1,39 @@
+/**
+  * Incremental SSDV image decoder for the ground station.
+  * Built as a shared library from the firmware decoder (ssdv.c) and used
+  * by decoder/image.py. Each image keeps its decode state so a new packet
+  * is fed once and the JPEG is finished from a copy of that state.
+  *
+  * The functions are not thread safe. Calls for all images must be made
+  * under one lock as the host CRC unit (hal.c) is shared.
+  */
+
+#ifndef HOST_SSDVDEC_H_
+#define HOST_SSDVDEC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Results of ssdvdec_feed(). */
+#define SSDVDEC_OK		0	/* New packet fed, the image has changed */
+#define SSDVDEC_DUPLICATE	1	/* Packet already received */
+#define SSDVDEC_REBUILT		2	/* Late packet, decoded again from it */
+#define SSDVDEC_INVALID		(-1)	/* CRC or header error, other image */
+#define SSDVDEC_NO_MEMORY	(-2)
+
+typedef struct ssdvdec_image ssdvdec_image_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+	ssdvdec_image_t *ssdvdec_open(void);
+	void ssdvdec_close(ssdvdec_image_t *img);
+	int ssdvdec_feed(ssdvdec_image_t *img, const uint8_t *packet);
+	int ssdvdec_get_jpeg(ssdvdec_image_t *img, const uint8_t **jpeg,
+						 size_t *length);
+	uint16_t ssdvdec_packets(const ssdvdec_image_t *img);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HOST_SSDVDEC_H_ */
@@ -0,0 +1,351 @@
+/**
+  * Batch check and repair of recorded SSDV packets.
+  * Captures are scanned for packets with ssdv_dec_is_packet() of the
+  * firmware decoder. Packets with FEC are repaired by its Reed-Solomon
+  * decoder. The files are split in chunks which are scanned in parallel.
+  *
+  * The packets found are deduplicated by callsign, image ID and packet ID.
+  * Of the copies of a packet the one with the fewest corrected symbols is
+  * kept. Packets with a valid CRC are not run through the Reed-Solomon
+  * decoder so their parity is generated again for the packets kept. The
+  * packets are written in key order as a packet stream for ssdv or
+  * libssdvdec, and/or listed as text for decoder/ssdvimport.py.
+  */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ssdv.h"
+#include "rs8.h"
+
+#define FIX_CHUNK_SIZE		(1024 * 1024)
+#define FIX_MAX_THREADS		64
+#define FIX_SYNC			0x55
+
+typedef struct {
+	uint8_t		pkt[SSDV_PKT_SIZE];
+	uint32_t	callsign;
+	uint16_t	packet_id;
+	uint8_t		image_id;
+	uint8_t		errors;		/* Symbols corrected by FEC */
+	uint32_t	file;
+	uint64_t	offset;
+} fix_packet_t;
+
+typedef struct {
+	const uint8_t	*data;
+	size_t			len;
+} fix_file_t;
+
+typedef struct {
+	uint32_t	file;
+	size_t		start;
+	size_t		end;		/* Packets starting before end belong here */
+} fix_chunk_t;
+
+typedef struct {
+	fix_packet_t	*packets;
+	size_t			count;
+	size_t			size;
+	uint64_t		candidates;	/* Sync bytes tried */
+	uint64_t		corrected;	/* Packets repaired by FEC */
+	uint64_t		symbols;
+} fix_result_t;
+
+static fix_file_t *files;
+static fix_chunk_t *chunks;
+static size_t num_chunks;
+static size_t next_chunk;
+static pthread_mutex_t chunk_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t getNs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000U + ts.tv_nsec;
+}
+
+static bool addPacket(fix_result_t *r, const uint8_t *pkt, int errors,
+					  uint32_t file, uint64_t offset)
+{
+	if(r->count == r->size) {
+		size_t size = r->size ? r->size * 2 : 256;
+		fix_packet_t *p = realloc(r->packets, size * sizeof(fix_packet_t));
+		if(p == NULL)
+			return false;
+		r->packets = p;
+		r->size = size;
+	}
+	fix_packet_t *p = &r->packets[r->count++];
+	ssdv_packet_info_t info;
+	memcpy(p->pkt, pkt, SSDV_PKT_SIZE);
+	ssdv_dec_header(&info, p->pkt);
+	p->callsign = info.callsign;
+	p->image_id = info.image_id;
+	p->packet_id = info.packet_id;
+	p->errors = errors;
+	p->file = file;
+	p->offset = offset;
+	return true;
+}
+
+/*
+ * Scan a chunk. After a valid packet the scan continues after it,
+ * otherwise at the next sync byte.
+ */
+static bool scanChunk(const fix_chunk_t *c, fix_result_t *r)
+{
+	const fix_file_t *f = &files[c->file];
+	uint8_t pkt[SSDV_PKT_SIZE];
+	size_t i = c->start;
+
+	while(i < c->end && i + SSDV_PKT_SIZE <= f->len) {
+		const uint8_t *s = memchr(&f->data[i], FIX_SYNC, c->end - i);
+		if(s == NULL)
+			break;
+		i = s - f->data;
+		if(i + SSDV_PKT_SIZE > f->len)
+			break;
+		int errors;
+		r->candidates++;
+		memcpy(pkt, s, SSDV_PKT_SIZE);
+		if(ssdv_dec_is_packet(pkt, &errors) != 0) {
+			i++;
+			continue;
+		}
+		if(errors > 0) {
+			r->corrected++;
+			r->symbols += errors;
+		}
+		if(!addPacket(r, pkt, errors, c->file, i))
+			return false;
+		i += SSDV_PKT_SIZE;
+	}
+	return true;
+}
+
+static void *scanThread(void *arg)
+{
+	fix_result_t *r = arg;
+	while(true) {
+		pthread_mutex_lock(&chunk_mtx);
+		size_t n = next_chunk++;
+		pthread_mutex_unlock(&chunk_mtx);
+		if(n >= num_chunks)
+			break;
+		if(!scanChunk(&chunks[n], r)) {
+			fprintf(stderr, "out of memory\n");
+			exit(1);
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Key order, then the copy with the fewest errors, then the first seen.
+ */
+static int comparePackets(const void *a, const void *b)
+{
+	const fix_packet_t *x = a, *y = b;
+	if(x->callsign != y->callsign)
+		return x->callsign < y->callsign ? -1 : 1;
+	if(x->image_id != y->image_id)
+		return x->image_id < y->image_id ? -1 : 1;
+	if(x->packet_id != y->packet_id)
+		return x->packet_id < y->packet_id ? -1 : 1;
+	if(x->errors != y->errors)
+		return x->errors < y->errors ? -1 : 1;
+	if(x->file != y->file)
+		return x->file < y->file ? -1 : 1;
+	return x->offset < y->offset ? -1 : x->offset > y->offset;
+}
+
+static bool mapFile(const char *path, fix_file_t *f)
+{
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+	if(fd < 0 || fstat(fd, &st) != 0) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		if(fd >= 0)
+			close(fd);
+		return false;
+	}
+	f->len = st.st_size;
+	f->data = NULL;
+	if(f->len != 0) {
+		void *m = mmap(NULL, f->len, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(m == MAP_FAILED) {
+			fprintf(stderr, "%s: %s\n", path, strerror(errno));
+			close(fd);
+			return false;
+		}
+		f->data = m;
+	}
+	close(fd);
+	return true;
+}
+
+static void listPacket(const fix_packet_t *p)
+{
+	ssdv_packet_info_t info;
+	ssdv_dec_header(&info, (uint8_t *)p->pkt);
+	printf("%s %u %u %u ", info.callsign_s, p->image_id, p->packet_id,
+		   p->errors);
+	/* Without the sync byte as stored by decoder/image.py. */
+	int i;
+	for(i = 1; i < SSDV_PKT_SIZE; i++)
+		printf("%02x", p->pkt[i]);
+	printf("\n");
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+			"usage: %s [-j threads] [-o file] [-l] capture...\n"
+			"  -j  scan threads (default: number of cores)\n"
+			"  -o  write the repaired packets (256 byte each) to file\n"
+			"  -l  list the packets: callsign image packet errors hex\n",
+			name);
+}
+
+int main(int argc, char *argv[])
+{
+	long threads = sysconf(_SC_NPROCESSORS_ONLN);
+	const char *out = NULL;
+	bool list = false;
+	int opt;
+	while((opt = getopt(argc, argv, "j:o:l")) != -1) {
+		switch(opt) {
+		case 'j':
+			threads = strtol(optarg, NULL, 0);
+			break;
+		case 'o':
+			out = optarg;
+			break;
+		case 'l':
+			list = true;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if(optind >= argc || (out == NULL && !list)) {
+		usage(argv[0]);
+		return 1;
+	}
+	if(threads < 1)
+		threads = 1;
+	if(threads > FIX_MAX_THREADS)
+		threads = FIX_MAX_THREADS;
+
+	uint32_t num_files = argc - optind;
+	files = calloc(num_files, sizeof(fix_file_t));
+	uint64_t bytes = 0;
+	uint32_t i;
+	for(i = 0; i < num_files; i++) {
+		if(!mapFile(argv[optind + i], &files[i]))
+			return 1;
+		bytes += files[i].len;
+		num_chunks += (files[i].len + FIX_CHUNK_SIZE - 1) / FIX_CHUNK_SIZE;
+	}
+	chunks = calloc(num_chunks ? num_chunks : 1, sizeof(fix_chunk_t));
+	size_t n = 0;
+	for(i = 0; i < num_files; i++) {
+		size_t start;
+		for(start = 0; start < files[i].len; start += FIX_CHUNK_SIZE) {
+			chunks[n].file = i;
+			chunks[n].start = start;
+			chunks[n].end = start + FIX_CHUNK_SIZE < files[i].len
+							? start + FIX_CHUNK_SIZE : files[i].len;
+			n++;
+		}
+	}
+
+	uint64_t t0 = getNs();
+	pthread_t tid[FIX_MAX_THREADS];
+	fix_result_t result[FIX_MAX_THREADS];
+	memset(result, 0, sizeof(result));
+	long t;
+	for(t = 0; t < threads; t++)
+		pthread_create(&tid[t], NULL, scanThread, &result[t]);
+	for(t = 0; t < threads; t++)
+		pthread_join(tid[t], NULL);
+
+	/* Merge, sort and keep the best copy of each packet. */
+	fix_result_t all = {0};
+	for(t = 0; t < threads; t++) {
+		all.count += result[t].count;
+		all.candidates += result[t].candidates;
+		all.corrected += result[t].corrected;
+		all.symbols += result[t].symbols;
+	}
+	all.packets = malloc((all.count ? all.count : 1) * sizeof(fix_packet_t));
+	if(all.packets == NULL) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	n = 0;
+	for(t = 0; t < threads; t++) {
+		memcpy(&all.packets[n], result[t].packets,
+			   result[t].count * sizeof(fix_packet_t));
+		n += result[t].count;
+		free(result[t].packets);
+	}
+	qsort(all.packets, all.count, sizeof(fix_packet_t), comparePackets);
+	size_t unique = 0;
+	for(n = 0; n < all.count; n++) {
+		const fix_packet_t *p = &all.packets[n];
+		if(unique > 0) {
+			const fix_packet_t *q = &all.packets[unique - 1];
+			if(p->callsign == q->callsign && p->image_id == q->image_id
+			   && p->packet_id == q->packet_id)
+				continue;
+		}
+		all.packets[unique++] = *p;
+	}
+	/* The encoder tables of rs8.c are set up on first use, so not in
+	   the scan threads. */
+	for(n = 0; n < unique; n++) {
+		uint8_t *pkt = all.packets[n].pkt;
+		if(pkt[1] == 0x66 + SSDV_TYPE_NORMAL)
+			encode_rs_8(&pkt[1], &pkt[SSDV_PKT_SIZE - SSDV_PKT_SIZE_RSCODES], 0);
+	}
+	uint64_t ns = getNs() - t0;
+
+	if(out != NULL) {
+		FILE *f = fopen(out, "wb");
+		if(f == NULL) {
+			fprintf(stderr, "%s: %s\n", out, strerror(errno));
+			return 1;
+		}
+		for(n = 0; n < unique; n++)
+			fwrite(all.packets[n].pkt, SSDV_PKT_SIZE, 1, f);
+		fclose(f);
+	}
+	if(list) {
+		for(n = 0; n < unique; n++)
+			listPacket(&all.packets[n]);
+	}
+
+	fprintf(stderr,
+			"%u files, %llu bytes, %ld threads, %.3f s (%.1f MB/s)\n"
+			"%llu sync tried, %zu packets, %llu repaired (%llu symbols), "
+			"%zu duplicates, %zu unique\n",
+			num_files, (unsigned long long)bytes, threads, ns / 1e9,
+			ns ? bytes * 1e3 / ns : 0.0,
+			(unsigned long long)all.candidates, all.count,
+			(unsigned long long)all.corrected,
+			(unsigned long long)all.symbols,
+			all.count - unique, unique);
+	return 0;
+}
@@ -0,0 +1 @@
+/* Host build: txhdlc.h is not used by the DSP chain. */
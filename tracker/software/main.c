@@ -4,6 +4,8 @@
 
 #include "debug.h"
 #include "threads.h"
+#include "sleep.h"
+#include "memregion.h"
 
 /**
   * Main routine is starting up system, runs the software watchdog (module monitoring), controls LEDs
@@ -11,11 +13,12 @@
 int main(void) {
 	halInit();					// Startup HAL
 	chSysInit();				// Startup RTOS
+	mem_init();					// Heap regions of the subsystems
 
     /* Setup core IO peripherals. */
     pktConfigureCoreIO();
 
-    /* Setup the mutex for trace output. */
+    /* Setup trace output and the trace thread. */
     debug_init();
 
 #if ACTIVATE_CONSOLE
@@ -36,18 +39,10 @@ int main(void) {
     //pktSerialStart();
 
     /*
-     * Create a packet radio service.
-     * For now there is just one radio.
+     * Radio bring-up runs in its own thread while the other modules start.
+     * Users of the radio wait for BOOT_RADIO.
      */
-    while(!pktServiceCreate(PKT_RADIO_1)) {
-      TRACE_ERROR("MAIN > Unable to create packet radio %d services",
-                  PKT_RADIO_1);
-      chThdSleep(TIME_S2I(10));
-    }
-
-    pktEnableEventTrace(PKT_RADIO_1);
-    TRACE_INFO("MAIN > Started packet radio service for radio %d",
-               PKT_RADIO_1);
+    start_radio_services();
 
     TRACE_INFO("MAIN > Starting application and ancillary threads");
 
@@ -55,11 +50,14 @@ int main(void) {
 	start_essential_threads();	// Startup required modules (tracking manager, watchdog)
 	start_user_threads();		// Startup optional modules (eg. POSITION, LOG, ...)
 
+	/* Packet events are traced by their own thread once the radios are up. */
+	(void)boot_wait_ready(BOOT_RADIO, TIME_INFINITE);
+	const radio_config_t *list = pktGetRadioList();
+	for(uint8_t i = 0; list[i].unit != PKT_RADIO_NONE; i++)
+	  pktEnableEventTrace(list[i].unit);
+
 	TRACE_INFO("MAIN > Active");
-	while(true) {
-	  /* Trace events from packet decoder system. */
-      pktTraceEvents();
-      chThdSleep(TIME_MS2I(200));
-	}
+	while(true)
+	  chThdSleep(TIME_INFINITE);
 }
 
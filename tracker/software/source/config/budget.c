@@ -0,0 +1,235 @@
+#include "ch.h"
+#include "hal.h"
+#include "budget.h"
+#include "config.h"
+#include "padc.h"
+#include "pac1720.h"
+#include "si446x.h"
+#include "tseries.h"
+#include "debug.h"
+
+/* Share of the nominal airtime in % per user. */
+static const uint8_t budget_share[BUDGET_NUM] = {
+	[BUDGET_BEACON]	= 20,
+	[BUDGET_LOG]	= 20,
+	[BUDGET_IMAGE]	= 50,
+	[BUDGET_DIGI]	= 10
+};
+
+static const char *budget_name[BUDGET_NUM] = {
+	[BUDGET_BEACON]	= "beacon",
+	[BUDGET_LOG]	= "log",
+	[BUDGET_IMAGE]	= "image",
+	[BUDGET_DIGI]	= "digi"
+};
+
+static MUTEX_DECL(budget_mtx);
+static bool budget_started;
+static systime_t budget_refill;		// Time up to which the buckets are filled
+static systime_t budget_slot_start;
+static uint8_t budget_slot;
+static uint16_t budget_level;
+static int32_t budget_net[BUDGET_SLOTS];	// Net battery charge in mWh at slot start
+static int32_t budget_tokens[BUDGET_NUM];
+static uint32_t budget_used[BUDGET_NUM][BUDGET_SLOTS];
+static uint32_t budget_total[BUDGET_NUM];
+
+/*
+ * Net battery charge in mWh since the energy counters were reset.
+ * The counters stay at zero without the PAC1720.
+ */
+static int32_t getNetCharge(void)
+{
+	pac1720_energy_t energy;
+	pac1720_get_energy(&energy);
+	return (int32_t)(energy.bat_in - energy.bat_out);
+}
+
+/*
+ * Energy level from the battery voltage and the net charge over the
+ * rolling window. A battery at the GPS off voltage gives no airtime.
+ * The voltage is the mean of the data points over the last ten minutes
+ * so a sag while transmitting does not set the level.
+ */
+static uint16_t calcLevel(int32_t net)
+{
+	ts_stats_t stats;
+	uint16_t vbat = ts_get(TS_VBAT, TS_MINUTE, &stats)
+					? (uint16_t)stats.mean : stm32_get_vbat();
+	uint16_t low = conf_sram.gps_off_vbat;
+	uint16_t high = conf_sram.gps_onper_vbat;
+	if(vbat <= low)
+		return 0;
+
+	int32_t level = 100;
+	if(high > low && vbat < high)
+		level = (vbat - low) * 100 / (high - low);
+	level += net * 100 / BUDGET_SURPLUS_MWH;
+
+	if(level < 0)
+		return 0;
+	if(level > BUDGET_LEVEL_MAX)
+		return BUDGET_LEVEL_MAX;
+	return level;
+}
+
+/*
+ * Bucket size of a user at the current level.
+ * The bucket holds the airtime of one rolling window.
+ */
+static int32_t getBucketSize(budget_user_t user)
+{
+	return (int32_t)BUDGET_DUTY * budget_share[user] * budget_level
+		   * BUDGET_SLOTS * chTimeI2S(BUDGET_SLOT_TIME) / 1000;
+}
+
+/*
+ * Advance the rolling window and fill the buckets up to now.
+ * Called with the budget mutex locked.
+ */
+static void budgetUpdate(void)
+{
+	systime_t now = chVTGetSystemTime();
+
+	if(!budget_started) {
+		int32_t net = getNetCharge();
+		for(uint8_t i = 0; i < BUDGET_SLOTS; i++)
+			budget_net[i] = net;
+		budget_level = calcLevel(0);
+		for(uint8_t u = 0; u < BUDGET_NUM; u++)
+			budget_tokens[u] = getBucketSize(u);
+		budget_refill = now;
+		budget_slot_start = now;
+		budget_started = true;
+		return;
+	}
+
+	// New slots in the rolling window
+	if(chTimeDiffX(budget_slot_start, now) >= BUDGET_SLOT_TIME) {
+		uint8_t n = 0;
+		while(chTimeDiffX(budget_slot_start, now) >= BUDGET_SLOT_TIME
+			  && n++ < BUDGET_SLOTS) {
+			budget_slot_start = chTimeAddX(budget_slot_start, BUDGET_SLOT_TIME);
+			budget_slot = (budget_slot + 1) % BUDGET_SLOTS;
+			for(uint8_t u = 0; u < BUDGET_NUM; u++)
+				budget_used[u][budget_slot] = 0;
+		}
+		if(chTimeDiffX(budget_slot_start, now) >= BUDGET_SLOT_TIME)
+			budget_slot_start = now; // Window passed in Stop mode
+
+		int32_t net = getNetCharge();
+		budget_net[budget_slot] = net;
+		uint16_t level = calcLevel(net - budget_net[(budget_slot + 1) % BUDGET_SLOTS]);
+		if(level != budget_level)
+			TRACE_INFO("BUDG > Energy level %d%%", level);
+		budget_level = level;
+	}
+
+	// Fill the buckets in whole seconds
+	uint32_t secs = chTimeI2S(chTimeDiffX(budget_refill, now));
+	if(secs == 0)
+		return;
+	budget_refill = chTimeAddX(budget_refill, TIME_S2I(secs));
+	for(uint8_t u = 0; u < BUDGET_NUM; u++) {
+		int32_t size = getBucketSize(u);
+		if(budget_tokens[u] >= size)
+			continue;
+		budget_tokens[u] += (int32_t)BUDGET_DUTY * budget_share[u]
+							* budget_level * secs / 1000;
+		if(budget_tokens[u] > size)
+			budget_tokens[u] = size;
+	}
+}
+
+/*
+ * Estimated airtime of a packet chain in ms.
+ */
+uint32_t budget_airtime(packet_t pp, mod_t mod, link_speed_t speed)
+{
+	switch(mod) {
+	case MOD_AFSK:
+		speed = 1200;
+		break;
+	case MOD_2FSK:
+		if(speed == 0)
+			speed = SI446X_2FSK_SPEED_DEFAULT;
+		break;
+	default:
+		return 0;
+	}
+	uint32_t bytes = 0;
+	for(; pp != NULL; pp = pp->nextp)
+		bytes += pktStreamFrameSize(pp, NULL) + BUDGET_FRAME_OVERHEAD;
+	return BUDGET_TX_DELAY + bytes * 8 * 1000 / speed;
+}
+
+/*
+ * Charge the airtime of a packet chain to a user.
+ * Call before the chain is passed to the radio.
+ * Returns the airtime in ms.
+ */
+uint32_t budget_charge(budget_user_t user, packet_t pp, mod_t mod,
+					   link_speed_t speed)
+{
+	uint32_t ms = budget_airtime(pp, mod, speed);
+	chMtxLock(&budget_mtx);
+	budgetUpdate();
+	budget_tokens[user] -= (int32_t)ms;
+	budget_used[user][budget_slot] += ms;
+	budget_total[user] += ms;
+	chMtxUnlock(&budget_mtx);
+	return ms;
+}
+
+/*
+ * Airtime available to a user in ms. Negative if overdrawn.
+ */
+int32_t budget_available(budget_user_t user)
+{
+	chMtxLock(&budget_mtx);
+	budgetUpdate();
+	int32_t tokens = budget_tokens[user];
+	chMtxUnlock(&budget_mtx);
+	return tokens;
+}
+
+/*
+ * Scale a count by the energy level. The result is at least 1 and at
+ * most max.
+ */
+uint8_t budget_scale(uint8_t value, uint8_t max)
+{
+	uint32_t scaled = (uint32_t)value * budget_get_level() / 100;
+	if(scaled < 1)
+		return 1;
+	if(scaled > max)
+		return max;
+	return scaled;
+}
+
+uint16_t budget_get_level(void)
+{
+	chMtxLock(&budget_mtx);
+	budgetUpdate();
+	uint16_t level = budget_level;
+	chMtxUnlock(&budget_mtx);
+	return level;
+}
+
+void budget_get(budget_user_t user, budget_bucket_t *bucket)
+{
+	chMtxLock(&budget_mtx);
+	budgetUpdate();
+	bucket->tokens = budget_tokens[user];
+	bucket->size = getBucketSize(user);
+	bucket->used = 0;
+	for(uint8_t i = 0; i < BUDGET_SLOTS; i++)
+		bucket->used += budget_used[user][i];
+	bucket->total = budget_total[user];
+	chMtxUnlock(&budget_mtx);
+}
+
+const char *budget_get_name(budget_user_t user)
+{
+	return budget_name[user];
+}
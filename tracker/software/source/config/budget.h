@@ -0,0 +1,49 @@
+#ifndef __BUDGET_H__
+#define __BUDGET_H__
+
+#include "ch.h"
+#include "hal.h"
+#include "types.h"
+
+/*
+ * Airtime budget.
+ * Each radio user has a token bucket of airtime in ms. The buckets fill
+ * at a share of the nominal duty cycle scaled by the energy level.
+ * The level is 100 at a healthy battery without net charge. It drops to 0
+ * as the battery falls to the GPS off voltage and rises up to
+ * BUDGET_LEVEL_MAX when the battery is charged faster than it is used.
+ */
+#define BUDGET_DUTY				10				/* Nominal airtime in % */
+#define BUDGET_LEVEL_MAX		200				/* Energy level at full surplus */
+#define BUDGET_SURPLUS_MWH		100				/* Net charge per window for full surplus */
+#define BUDGET_SLOT_TIME		TIME_S2I(60)	/* Rolling window slot */
+#define BUDGET_SLOTS			10				/* Slots in the rolling window */
+#define BUDGET_TX_DELAY			50				/* ms of preamble per transmission */
+#define BUDGET_FRAME_OVERHEAD	6				/* Bytes of flags per frame */
+#define BUDGET_WAIT				TIME_S2I(10)	/* Poll time of a user waiting for airtime */
+
+typedef enum {
+	BUDGET_BEACON,
+	BUDGET_LOG,
+	BUDGET_IMAGE,
+	BUDGET_DIGI,
+	BUDGET_NUM
+} budget_user_t;
+
+typedef struct {
+	int32_t		tokens;		/* Airtime available in ms, negative if overdrawn */
+	int32_t		size;		/* Bucket size in ms at the current level */
+	uint32_t	used;		/* Airtime used in the rolling window in ms */
+	uint32_t	total;		/* Airtime used since startup in ms */
+} budget_bucket_t;
+
+uint32_t budget_airtime(packet_t pp, mod_t mod, link_speed_t speed);
+uint32_t budget_charge(budget_user_t user, packet_t pp, mod_t mod,
+					   link_speed_t speed);
+int32_t budget_available(budget_user_t user);
+uint8_t budget_scale(uint8_t value, uint8_t max);
+uint16_t budget_get_level(void);
+void budget_get(budget_user_t user, budget_bucket_t *bucket);
+const char *budget_get_name(budget_user_t user);
+
+#endif /* __BUDGET_H__ */
@@ -0,0 +1,30 @@
+#include "ch.h"
+#include "hal.h"
+#include "checkpoint.h"
+#include "pcrc.h"
+
+/*
+ * Update the CRC of a block after its data changed.
+ */
+void checkpoint_save(checkpoint_t *cp, uint32_t id, const void *data,
+					 size_t size)
+{
+	cp->magic = CHECKPOINT_MAGIC + id;
+	cp->size = size;
+	cp->crc = crc32_calc(data, size);
+}
+
+/*
+ * Check whether a block held its data over the reset.
+ */
+bool checkpoint_restore(const checkpoint_t *cp, uint32_t id,
+						const void *data, size_t size)
+{
+	return cp->magic == CHECKPOINT_MAGIC + id && cp->size == size
+		   && cp->crc == crc32_calc(data, size);
+}
+
+void checkpoint_invalidate(checkpoint_t *cp)
+{
+	cp->magic = 0;
+}
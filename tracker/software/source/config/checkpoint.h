@@ -0,0 +1,35 @@
+#ifndef __CHECKPOINT_H__
+#define __CHECKPOINT_H__
+
+#include "ch.h"
+#include "hal.h"
+
+/*
+ * State kept over a reset.
+ * The state is held in RAM which is not initialized at startup (.ram4).
+ * It survives a watchdog or brown-out reset but not a power loss. Each
+ * block has a CRC so saving after a change only covers that block. A block
+ * is restored at startup if its id, size and CRC match, otherwise the
+ * module starts from its defaults.
+ * The F413 has no battery backed SRAM and the RTC backup registers are too
+ * small for this state.
+ */
+#define CHECKPOINT_DATA			__attribute__((section(".ram4")))
+
+#define CHECKPOINT_MAGIC		0x43484B50		/* "CHKP" */
+#define CHECKPOINT_ID_IMAGE		1
+#define CHECKPOINT_ID_LOG		2
+
+typedef struct {
+	uint32_t	magic;		// CHECKPOINT_MAGIC + block id
+	uint32_t	size;		// Size of the block
+	uint32_t	crc;		// CRC-32 of the block
+} checkpoint_t;
+
+void checkpoint_save(checkpoint_t *cp, uint32_t id, const void *data,
+					 size_t size);
+bool checkpoint_restore(const checkpoint_t *cp, uint32_t id,
+						const void *data, size_t size);
+void checkpoint_invalidate(checkpoint_t *cp);
+
+#endif
@@ -16,7 +16,8 @@ const conf_t conf_flash_default = {
             .active = true,
             .cycle = TIME_S2I(30),
             .init_delay = TIME_S2I(5),
-            .fixed = false // Add lat, lon, alt fields when enabling fixed
+            .fixed = false, // Add lat, lon, alt fields when enabling fixed
+            .accuracy = 0 // Predicted position accuracy in m to skip GPS (0: disabled)
         },
         .radio_conf = {
             .pwr = 0x7F,
@@ -29,6 +30,9 @@ const conf_t conf_flash_default = {
         .path = "WIDE1-1",
         .symbol = SYM_BALLOON,
         .aprs_msg = true, // Enable APRS message reception on this app
+        .compact = false, // Set true to send compressed position and telemetry only
+        .fast_cycle = 0, // Set with slow_cycle for a motion adaptive cycle
+        .slow_cycle = 0,
     },
 
     // Secondary position app
@@ -53,6 +57,9 @@ const conf_t conf_flash_default = {
         .path = "WIDE1-1",
         .symbol = SYM_BALLOON,
         .aprs_msg = true, // Enable APRS message reception on this app
+        .compact = false, // Set true to send compressed position and telemetry only
+        .fast_cycle = 0, // Set with slow_cycle for a motion adaptive cycle
+        .slow_cycle = 0,
     },
 
     // Primary image app
@@ -78,7 +85,12 @@ const conf_t conf_flash_default = {
         .res = RES_VGA,
         .quality = 4,
         .buf_size = 50 * 1024,
-        .redundantTx = false
+        .redundantTx = false,
+        .progressive = false,
+        .max_packets = 0,
+        .delta = 0,
+        .ssdv_size = 0,
+        .binary = false
     },
 
     // Secondary image app
@@ -103,7 +115,12 @@ const conf_t conf_flash_default = {
         .res = RES_QVGA,
         .quality = 4,
         .buf_size = 15 * 1024,
-        .redundantTx = false
+        .redundantTx = false,
+        .progressive = false,
+        .max_packets = 0,
+        .delta = 0,
+        .ssdv_size = 0,
+        .binary = false
     },
 
     // Log app
@@ -122,7 +139,8 @@ const conf_t conf_flash_default = {
         // Node identity
         .call = "DL7AD-13",
         .path = "WIDE1-1",
-        .density = 10
+        .density = 10,
+        .burst = 0
     },
 
     // APRS app
@@ -147,6 +165,12 @@ const conf_t conf_flash_default = {
         },
         .aprs_msg = true, // Set true to enable messages to be accepted on RX call sign
         .digi = true,
+        // Hold digipeats and cancel them if another digipeater is heard first
+        .digi_hold = TIME_S2I(5),
+        // Fleet call signs (e.g. "DL7AD-12,DL4MDW*") to store and relay if
+        // no digipeater repeats their frames within the hold time
+        .relay = "",
+        .relay_hold = TIME_S2I(30),
         .tx = {
            // Transmit radio configuration
            .radio_conf = {
@@ -169,6 +193,7 @@ const conf_t conf_flash_default = {
 
     // Power control
     .keep_cam_switched_on = false,
+    .cam_standby = TIME_S2I(0),
     .gps_on_vbat = 3300, // mV
     .gps_off_vbat = 3000, // mV
     .gps_onper_vbat = 3500, // mV
@@ -182,6 +207,20 @@ const conf_t conf_flash_default = {
     // How often to send telemetry config (global for beacons)
     .tel_enc_cycle = TIME_S2I(3600),
 
+    // Transmit time slots shared by trackers on one frequency (0 slots: off)
+    .tdma_slots = 0,
+    .tdma_slot = 0,
+    .tdma_slot_time = TIME_S2I(10),
+
+    // Step the TX power down while digipeats and acks confirm transmissions
+    .tx_pwr_ctrl = false,
+
+    // Record the RF traffic to the SD card for analysis after the flight
+    .rf_capture = true,
+
+    // Keep the radio in receive while the MCU is in Stop mode
+    .rx_stop = false,
+
     // The default APRS frequency when geofence is not resolved
     .freq = FREQ_APRS_EUROPE,
 
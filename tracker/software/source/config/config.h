@@ -3,6 +3,7 @@
 
 #define TRACE_TIME					TRUE		/* Enables time tracing on debugging port */
 #define TRACE_FILE					TRUE		/* Enables file and line tracing on debugging port */
+#define TRACE_SERIAL				TRUE		/* Enables trace output on the serial debugging port */
 
 #include "types.h"
 
@@ -0,0 +1,211 @@
+/**
+  * Journalled configuration store.
+  * The config sector holds a conf_t image followed by records of the
+  * words changed since. Updates append a record for each changed word.
+  * The sector is erased and a new image is written only when the journal
+  * is full. A copy of the content of the store is kept in RAM to find
+  * the changed words.
+  */
+
+#include "ch.h"
+#include "hal.h"
+#include "config.h"
+#include "confstore.h"
+#include "flash.h"
+#include "pcrc.h"
+#include "debug.h"
+#include <stddef.h>
+#include <string.h>
+
+static conf_t conf_stored;		/* Content of the store */
+static bool conf_stored_valid;	/* The store holds a valid image */
+static uint32_t conf_wpos;		/* Next free journal record */
+static MUTEX_DECL(conf_mtx);
+static uint16_t conf_changes[CONF_CHG_NUM];	/* Change count of each CONF_CHG_* bit */
+
+static const conf_store_rec_t* conf_getRecord(uint32_t n)
+{
+	return (const conf_store_rec_t*)(CONF_FLASH_ADDR + CONF_STORE_JOURNAL
+									 + n * sizeof(conf_store_rec_t));
+}
+
+static uint16_t conf_getRecordCrc(uint16_t offset, uint32_t value)
+{
+	uint8_t buf[sizeof(offset) + sizeof(value)];
+	memcpy(buf, &offset, sizeof(offset));
+	memcpy(&buf[sizeof(offset)], &value, sizeof(value));
+	return crc16_x25(buf, sizeof(buf));
+}
+
+static bool conf_isImageValid(void)
+{
+	const conf_store_hdr_t* hdr = (const conf_store_hdr_t*)CONF_FLASH_ADDR;
+	const conf_t* image = (const conf_t*)(CONF_FLASH_ADDR + CONF_STORE_IMAGE);
+	return hdr->magic == CONF_STORE_MAGIC && hdr->size == sizeof(conf_t)
+		&& image->magic == CONFIG_MAGIC_UPDATED
+		&& image->crc == crc32_calc(image, offsetof(conf_t, crc));
+}
+
+/*
+ * Erase the sector and write conf_sram as the new image.
+ * Must be called with conf_mtx locked.
+ */
+static bool conf_compact(void)
+{
+	conf_stored_valid = false;
+	if(flashErase(CONF_FLASH_ADDR, CONF_FLASH_SIZE) != FLASH_RETURN_SUCCESS) {
+		TRACE_ERROR("CONF > Erase of config sector failed");
+		return false;
+	}
+
+	conf_sram.magic = CONFIG_MAGIC_UPDATED;
+	conf_sram.crc = crc32_calc(&conf_sram, offsetof(conf_t, crc));
+	conf_store_hdr_t hdr = {CONF_STORE_MAGIC, sizeof(conf_t)};
+	if(flashWrite(CONF_FLASH_ADDR + CONF_STORE_IMAGE, (char*)&conf_sram,
+				  sizeof(conf_t)) != FLASH_RETURN_SUCCESS
+	   || flashWrite(CONF_FLASH_ADDR, (char*)&hdr, sizeof(hdr))
+				  != FLASH_RETURN_SUCCESS
+	   || !conf_isImageValid()) {
+		TRACE_ERROR("CONF > Write of config image failed");
+		return false;
+	}
+
+	memcpy(&conf_stored, &conf_sram, sizeof(conf_t));
+	conf_stored_valid = true;
+	conf_wpos = 0;
+	TRACE_INFO("CONF > Config sector compacted");
+	return true;
+}
+
+/*
+ * Load the newest config into conf_sram.
+ * The default config is used if the store holds no valid image.
+ */
+void conf_store_load(void)
+{
+	chMtxLock(&conf_mtx);
+
+	memcpy(&conf_sram, &conf_flash_default, sizeof(conf_t));
+	conf_stored_valid = false;
+	conf_wpos = 0;
+	if(!conf_isImageValid()) {
+		TRACE_INFO("CONF > No stored config, using default");
+		chMtxUnlock(&conf_mtx);
+		return;
+	}
+
+	memcpy(&conf_sram, (const void*)(CONF_FLASH_ADDR + CONF_STORE_IMAGE),
+		   sizeof(conf_t));
+	uint32_t applied = 0;
+	for(uint32_t n = 0; n < CONF_STORE_RECORDS; n++) {
+		const conf_store_rec_t* rec = conf_getRecord(n);
+		if(rec->offset == 0xFFFF && rec->crc == 0xFFFF && rec->value == 0xFFFFFFFF)
+			continue; /* Erased */
+		conf_wpos = n + 1;
+		if(rec->crc != conf_getRecordCrc(rec->offset, rec->value)
+		   || rec->offset % sizeof(uint32_t) != 0
+		   || rec->offset / sizeof(uint32_t) >= CONF_STORE_WORDS)
+			continue;
+		memcpy((uint8_t*)&conf_sram + rec->offset, &rec->value, sizeof(rec->value));
+		applied++;
+	}
+	memcpy(&conf_stored, &conf_sram, sizeof(conf_t));
+	conf_stored_valid = true;
+	TRACE_INFO("CONF > Loaded stored config with %d updates", applied);
+
+	chMtxUnlock(&conf_mtx);
+}
+
+/*
+ * Store the words of conf_sram holding a field which was changed.
+ * Each changed word costs one journal record.
+ */
+bool conf_store_update(const void *field, size_t size)
+{
+	const uint8_t* base = (const uint8_t*)&conf_sram;
+	if((const uint8_t*)field < base
+	   || (const uint8_t*)field + size > base + sizeof(conf_t))
+		return false;
+
+	uint32_t first = ((const uint8_t*)field - base) / sizeof(uint32_t);
+	uint32_t end = ((const uint8_t*)field - base + size + sizeof(uint32_t) - 1)
+				   / sizeof(uint32_t);
+	if(end > CONF_STORE_WORDS)
+		end = CONF_STORE_WORDS;
+
+	chMtxLock(&conf_mtx);
+
+	if(!conf_stored_valid) {
+		bool ok = conf_compact();
+		chMtxUnlock(&conf_mtx);
+		return ok;
+	}
+
+	bool ok = true;
+	for(uint32_t w = first; w < end; w++) {
+		uint32_t value, stored;
+		memcpy(&value, base + w * sizeof(uint32_t), sizeof(value));
+		memcpy(&stored, (uint8_t*)&conf_stored + w * sizeof(uint32_t), sizeof(stored));
+		if(value == stored)
+			continue;
+
+		if(conf_wpos >= CONF_STORE_RECORDS) {
+			/* Journal full. The new image holds all changes. */
+			ok = conf_compact();
+			break;
+		}
+		conf_store_rec_t rec;
+		rec.offset = w * sizeof(uint32_t);
+		rec.value = value;
+		rec.crc = conf_getRecordCrc(rec.offset, rec.value);
+		flashaddr_t addr = (flashaddr_t)conf_getRecord(conf_wpos++);
+		if(flashWrite(addr, (char*)&rec, sizeof(rec)) != FLASH_RETURN_SUCCESS
+		   || !flashCompare(addr, (char*)&rec, sizeof(rec))) {
+			TRACE_ERROR("CONF > Write of config record failed");
+			ok = false;
+			break;
+		}
+		memcpy((uint8_t*)&conf_stored + w * sizeof(uint32_t), &value, sizeof(value));
+	}
+
+	chMtxUnlock(&conf_mtx);
+	return ok;
+}
+
+/*
+ * Store all changes of conf_sram.
+ */
+bool conf_store_save(void)
+{
+	return conf_store_update(&conf_sram, sizeof(conf_t));
+}
+
+/*
+ * Flag changed config fields to the subsystems using them.
+ */
+void conf_set_changed(uint32_t changes)
+{
+	chSysLock();
+	for(uint8_t i = 0; i < CONF_CHG_NUM; i++) {
+		if(changes & (1 << i))
+			conf_changes[i]++;
+	}
+	chSysUnlock();
+}
+
+/*
+ * Return the bits in mask which changed since the last check with watch.
+ */
+uint32_t conf_get_changed(conf_watch_t *watch, uint32_t mask)
+{
+	uint32_t changed = 0;
+	chSysLock();
+	for(uint8_t i = 0; i < CONF_CHG_NUM; i++) {
+		if((mask & (1 << i)) && watch->seen[i] != conf_changes[i]) {
+			watch->seen[i] = conf_changes[i];
+			changed |= 1 << i;
+		}
+	}
+	chSysUnlock();
+	return changed;
+}
@@ -0,0 +1,67 @@
+#ifndef __CONFSTORE_H__
+#define __CONFSTORE_H__
+
+#include "ch.h"
+#include "hal.h"
+#include "types.h"
+
+#define CONF_FLASH_ADDR			0x08060000	/* Config flash memory address (one sector) */
+#define CONF_FLASH_SIZE			0x20000		/* Config flash memory size */
+#define CONF_STORE_MAGIC		0x434F4E4A	/* Marks a sector in the journal format */
+
+/*
+ * The sector holds a header, a complete conf_t image and a journal of
+ * word updates. The header is written after the image so a compaction
+ * which was cut short leaves no valid image.
+ */
+typedef struct {
+	uint32_t	magic;
+	uint32_t	size;		/* sizeof(conf_t) of the image */
+} conf_store_hdr_t;
+
+/*
+ * A journal record replaces a word of the image. Records are applied in
+ * order. A record which fails its CRC was cut short and is skipped.
+ */
+typedef struct {
+	uint16_t	offset;		/* Byte offset of the word in conf_t */
+	uint16_t	crc;		/* CRC-16/X.25 of offset and value */
+	uint32_t	value;
+} conf_store_rec_t;
+
+#define CONF_STORE_IMAGE		sizeof(conf_store_hdr_t)
+#define CONF_STORE_JOURNAL		((CONF_STORE_IMAGE + sizeof(conf_t) + 7) & ~7)
+#define CONF_STORE_RECORDS		((CONF_FLASH_SIZE - CONF_STORE_JOURNAL) / sizeof(conf_store_rec_t))
+/* Words which are journalled. magic and crc only apply to the image. */
+#define CONF_STORE_WORDS		(offsetof(conf_t, magic) / sizeof(uint32_t))
+
+/*
+ * Change notification bits. A config command flags the bits of the field
+ * it changed. A subsystem checks its bits with its own conf_watch_t to
+ * find out what to refresh.
+ */
+#define CONF_CHG_POS_PRI		(1 << 0)
+#define CONF_CHG_POS_SEC		(1 << 1)
+#define CONF_CHG_IMG_PRI		(1 << 2)
+#define CONF_CHG_IMG_SEC		(1 << 3)
+#define CONF_CHG_LOG			(1 << 4)
+#define CONF_CHG_APRS_RX		(1 << 5)
+#define CONF_CHG_APRS_TX		(1 << 6)
+#define CONF_CHG_DIGI			(1 << 7)
+#define CONF_CHG_GPS			(1 << 8)
+#define CONF_CHG_CAM			(1 << 9)
+#define CONF_CHG_BASE			(1 << 10)
+#define CONF_CHG_GLOBAL			(1 << 11)
+#define CONF_CHG_NUM			12
+
+typedef struct {
+	uint16_t	seen[CONF_CHG_NUM];	/* Change counts already handled */
+} conf_watch_t;
+
+void conf_store_load(void);
+bool conf_store_update(const void *field, size_t size);
+bool conf_store_save(void);
+void conf_set_changed(uint32_t changes);
+uint32_t conf_get_changed(conf_watch_t *watch, uint32_t mask);
+
+#endif /* __CONFSTORE_H__ */
@@ -6,6 +6,14 @@
 #include "debug.h"
 #include "padc.h"
 #include "pac1720.h"
+#include "pktconf.h"
+#include "watchdog.h"
+#include "pclock.h"
+#include "config.h"
+
+/* Threads which accept a late wake-up after Stop mode. */
+static thread_t *late_threads[SLEEP_STOP_MAX_LATE];
+static uint8_t late_cnt;
 
 /**
   * Sleeping method. Returns true if sleeping condition are given.
@@ -70,3 +78,195 @@ void trigger_new_data_point(void)
 	} while(newtp->id == oldID);
 }
 
+
+static bool isLateThread(void *tp)
+{
+	for(uint8_t i=0; i<late_cnt; i++)
+		if(late_threads[i] == tp)
+			return true;
+	return false;
+}
+
+/**
+  * Lets Stop mode run past the timers of the calling thread. The thread
+  * wakes up late after Stop mode. It must not rely on exact intervals.
+  */
+void allowLateWakeup(void)
+{
+	chSysLock();
+	if(late_cnt < SLEEP_STOP_MAX_LATE && !isLateThread(chThdGetSelfX()))
+		late_threads[late_cnt++] = chThdGetSelfX();
+	chSysUnlock();
+}
+
+/**
+  * Removes the calling thread from the late wake-up threads. Called by
+  * threads which terminate.
+  */
+void cancelLateWakeup(void)
+{
+	chSysLock();
+	for(uint8_t i=0; i<late_cnt; i++) {
+		if(late_threads[i] == chThdGetSelfX()) {
+			late_threads[i] = late_threads[--late_cnt];
+			break;
+		}
+	}
+	chSysUnlock();
+}
+
+/*
+ * Time until the next timer which may not be delayed.
+ * Thread sleeps have the thread as timer parameter.
+ */
+static sysinterval_t getStopWindow(void)
+{
+	sysinterval_t due = 0;
+	virtual_timer_t *vtp = ch.vtlist.next;
+	while(vtp != (virtual_timer_t *)&ch.vtlist) {
+		due += vtp->delta;
+		if(!isLateThread(vtp->par))
+			return due;
+		vtp = vtp->next;
+	}
+	return TIME_INFINITE;
+}
+
+/*
+ * Stop mode cuts the clocks of the radio decoder and the USB console.
+ * With rx_stop a radio may stay in receive while no signal is heard.
+ * CCA from the radio then wakes the MCU before the PWM is opened.
+ */
+static bool isStopPermitted(void)
+{
+	const radio_config_t *list = pktGetRadioList();
+	for(uint8_t i=0; list[i].unit != PKT_RADIO_NONE; i++) {
+		if(!pktIsTransmitOpen(list[i].unit))
+			continue;
+		if(!conf_sram.rx_stop || !pktIsReceiveIdleI(list[i].unit))
+			return false;
+	}
+#if ACTIVATE_CONSOLE
+	if(USBD1.state == USB_ACTIVE)
+		return false;
+#endif
+	return true;
+}
+
+/*
+ * Advance the system time by the ticks lost in Stop mode.
+ * Timers due during Stop mode expire at the next tick.
+ */
+static void advanceSystemTime(sysinterval_t ticks)
+{
+	ch.vtlist.systime += ticks;
+
+	sysinterval_t due = 0, last = 0;
+	virtual_timer_t *vtp = ch.vtlist.next;
+	while(vtp != (virtual_timer_t *)&ch.vtlist) {
+		due += vtp->delta;
+		sysinterval_t next = due > ticks ? due - ticks : 1;
+		vtp->delta = next - last;
+		last = next;
+		if(due > ticks)
+			break; // Later deltas are unchanged
+		vtp = vtp->next;
+	}
+}
+
+/*
+ * Milliseconds of the day from the RTC. The shadow registers are not
+ * updated in Stop mode so they are synchronized again.
+ */
+static uint32_t getRTCTime(void)
+{
+	RTCDateTime time;
+	RTCD1.rtc->ISR &= ~RTC_ISR_RSF;
+	rtc_lld_get_time(&RTCD1, &time);
+	return time.millisecond;
+}
+
+/*
+ * Enter Stop mode until the RTC wakeup event or an enabled interrupt
+ * becomes pending. Interrupts are masked so they are taken after the
+ * clocks are restored. Returns the time spent in Stop mode.
+ * The RTC wakeup timer is clocked at 1Hz.
+ */
+static sysinterval_t enterStopMode(uint32_t secs)
+{
+	RTCWakeup wakeup = {
+		.wutr = (4 << 16) | (secs - 1)
+	};
+	rtcSTM32SetPeriodicWakeup(&RTCD1, &wakeup);
+
+	// RTC wakeup is EXTI line 22, used as event so no IRQ is taken
+	EXTI->RTSR |= EXTI_RTSR_TR22;
+	EXTI->EMR |= EXTI_EMR_MR22;
+	EXTI->PR = EXTI_PR_PR22;
+
+#ifndef DISABLE_HW_WATCHDOG
+	wdgResetI(&WDGD1);
+#endif
+
+	uint32_t start = getRTCTime();
+
+	// Stop mode with low power regulator, pending interrupts wake up
+	PWR->CR &= ~PWR_CR_PDDS;
+	PWR->CR |= PWR_CR_LPDS | PWR_CR_CWUF;
+	SCB->SCR |= SCB_SCR_SLEEPDEEP_Msk | SCB_SCR_SEVONPEND_Msk;
+	__SEV();
+	__WFE(); // Clear event flag
+	__WFE();
+	SCB->SCR &= ~(SCB_SCR_SLEEPDEEP_Msk | SCB_SCR_SEVONPEND_Msk);
+
+	// The MCU wakes up on HSI, restore PLL and bus clocks
+	stm32_clock_init();
+	pclkRestoreI();
+
+	rtcSTM32SetPeriodicWakeup(&RTCD1, NULL);
+	RTCD1.rtc->ISR &= ~RTC_ISR_WUTF;
+	EXTI->EMR &= ~EXTI_EMR_MR22;
+	EXTI->PR = EXTI_PR_PR22;
+
+	// Receive wakes up early, the RTC gives the time lost
+	uint32_t end = getRTCTime();
+	if(end < start)
+		end += 24 * 3600 * 1000; // Midnight passed
+	uint32_t ms = end - start;
+	if(ms > secs * 1000)
+		ms = secs * 1000;
+	return TIME_MS2I(ms);
+}
+
+/**
+  * Called by the idle thread. Enters Stop mode if every thread waits on a
+  * timer longer than SLEEP_STOP_THRESHOLD. Threads which called
+  * allowLateWakeup() do not keep the MCU running.
+  */
+void enterStopIfIdle(void)
+{
+	chSysLock();
+	// No thread ready and no termination pending for idle
+	if(firstprio(&ch.rlist.queue) > NOPRIO
+			|| chMsgIsPendingI(chThdGetSelfX())
+			|| !isStopPermitted()
+			|| wdg_recovering()) {
+		chSysUnlock();
+		return;
+	}
+
+	sysinterval_t window = getStopWindow();
+	if(window < SLEEP_STOP_THRESHOLD) {
+		chSysUnlock();
+		return;
+	}
+
+	// Wake up early enough to restore the clocks before the next timer
+	uint32_t secs = window == TIME_INFINITE ? SLEEP_STOP_MAX_TIME
+				  : TIME_I2S(window - SLEEP_STOP_MARGIN);
+	if(secs > SLEEP_STOP_MAX_TIME)
+		secs = SLEEP_STOP_MAX_TIME;
+
+	advanceSystemTime(enterStopMode(secs));
+	chSysUnlock();
+}
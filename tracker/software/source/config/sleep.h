@@ -8,10 +8,22 @@
 #define WAIT_FOR_DATA_POINT		trigger_new_data_point
 #define TX_CONTINUOSLY			trigger_immediately
 
+/*
+ * Stop mode is entered when the next timer is further away than the
+ * threshold. Each Stop is limited so the hardware watchdog is reset.
+ */
+#define SLEEP_STOP_THRESHOLD	TIME_S2I(5)
+#define SLEEP_STOP_MARGIN		TIME_S2I(1)
+#define SLEEP_STOP_MAX_TIME		20		/* s */
+#define SLEEP_STOP_MAX_LATE		8		/* Threads which may wake up late */
+
 bool p_sleep(const sleep_conf_t *config);
 sysinterval_t waitForTrigger(sysinterval_t prev, sysinterval_t timeout);
 void trigger_new_data_point(void);
 void trigger_immediately(void);
+void allowLateWakeup(void);
+void cancelLateWakeup(void);
+void enterStopIfIdle(void);
 
 #endif /* __SLEEP_H__ */
 
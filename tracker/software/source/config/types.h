@@ -8,18 +8,18 @@
 typedef enum {
 	FREQ_INVALID = 0,
 	FREQ_APRS_GEOFENCE,  /* Geofencing frequency (144.8 default). */
-	FREQ_SCAN,           /* Frequency last found in RX scan. - TBI */
+	FREQ_SCAN,           /* Frequency last found in RX scan. */
 	FREQ_RX_APRS,        /* Active RX frequency - fall back to DYNAMIC. */
-	FREQ_RX_CMDC,        /* Frequency used for command and control. TBI */
+	FREQ_RX_CMDC,        /* Frequency used for command and control. */
 	FREQ_DEFAULT,        /* Default frequency specified in configuration */
 	FREQ_CODES_END
 } freq_codes_t;
 
 #define FREQ_INVALID   0
 #define FREQ_GEOFENCE  1 /* Geofencing frequency (144.8 default). */
-#define FREQ_SCAN      2 /* Frequency based on band base + channel scan. */
+#define FREQ_SCAN      2 /* Frequency from the APRS receive scan. */
 #define FREQ_RX_APRS   3 /* Active RX frequency - fall back to DYNAMIC. */
-#define FREQ_RX_CMDC   4 /* Frequency used for command and control. TBI */
+#define FREQ_RX_CMDC   4 /* Frequency used for command and control. */
 #define FREQ_DEFAULT   5 /* Default frequency specified in configuration */
 #define FREQ_CODES_END 6
 
@@ -29,6 +29,7 @@ typedef enum {
 #define TYPE_INT			1
 #define TYPE_TIME			2
 #define TYPE_STR			3
+#define TYPE_INT_DEFAULT	4		// TYPE_INT which also takes 0 for the default
 
 typedef enum {
 	SLEEP_DISABLED = 0,
@@ -52,6 +53,11 @@ typedef enum { // Modulation type
 	MOD_2FSK
 } mod_t;
 
+typedef enum { // Link framing
+	LINK_AX25,
+	LINK_IL2P
+} link_type_t;
+
 typedef enum {
 	RES_NONE = 0,
 	RES_QQVGA,
@@ -80,6 +86,7 @@ typedef struct {
   mod_t             mod;
   link_speed_t      speed;
   radio_squelch_t   cca;
+  link_type_t       link;                   // Framing of image and log packets
 } radio_tx_conf_t; // Radio / Modulation
 
 typedef struct {
@@ -111,6 +118,8 @@ typedef struct {
   gps_coord_t       lat;
   gps_coord_t       lon;
   gps_alt_t         alt;
+  // Predicted position accuracy in m to skip GPS (0: GPS every cycle)
+  uint32_t          accuracy;
 } telem_svc_conf_t; // Thread
 
 typedef struct {
@@ -121,7 +130,11 @@ typedef struct {
   char              path[16];
   aprs_sym_t        symbol;
   bool              aprs_msg;
+  bool              compact;                // Position and telemetry only, no data point comment
   bool              run_once;
+  // Motion adaptive cycle from fast_cycle in ascent and descent to slow_cycle in float (0: fixed cycle)
+  sysinterval_t     fast_cycle;
+  sysinterval_t     slow_cycle;
 } bcn_app_conf_t;
 
 typedef struct {
@@ -134,6 +147,11 @@ typedef struct {
   resolution_t      res;					// Picture resolution
   uint8_t           quality;				// SSDV Quality ranging from 0-7
   bool              flip;                   // 180 image rotation
+  bool              progressive;            // DC only preview before the full image
+  uint16_t          max_packets;            // SSDV packet budget per image (0 = fixed quality)
+  uint8_t           delta;                  // MCU change sent in delta images (0 = full images)
+  uint8_t           ssdv_size;              // SSDV bytes per frame (0 = 174)
+  bool              binary;                 // Raw SSDV in non APRS UI frames (no base91)
   uint32_t          buf_size;		    	// SRAM buffer size for the picture
 } img_app_conf_t;
 
@@ -143,7 +161,8 @@ typedef struct {
   // Protocol
   char              call[AX25_MAX_ADDR_LEN];
   char              path[16];
-  uint8_t           density;				// Density of log points being sent out in 1/x (value 10 => 10%)
+  uint8_t           density;				// Newest log point is sent after each x new points, other cycles fill gaps
+  uint8_t           burst;					// Multi point log packets sent per cycle (0 = one point per packet)
 } log_app_conf_t;
 
 typedef struct {
@@ -176,6 +195,9 @@ typedef struct {
   thd_rx_conf_t     rx;
   bool              aprs_msg;
   bool              digi;
+  sysinterval_t     digi_hold;              // Viscous digipeat hold time (0 = repeat at once)
+  char              relay[32];              // Fleet call signs to store and forward (empty = off)
+  sysinterval_t     relay_hold;             // Time for the ground to hear a fleet frame before it is relayed
   bcn_app_conf_t    tx;
 } thd_aprs_conf_t;
 
@@ -190,6 +212,7 @@ typedef struct {
   thd_aprs_conf_t   aprs;
 
   bool			    keep_cam_switched_on;	// Keep camera switched on and initialized, this makes image capturing faster but takes a lot of power over long time
+  sysinterval_t     cam_standby;            // Keep camera in standby for this time after a capture (0 = switch off)
 
   volt_level_t      gps_on_vbat;			// Battery voltage threshold at which GPS is switched on
   volt_level_t      gps_off_vbat;			// Battery voltage threshold at which GPS is switched off
@@ -201,20 +224,30 @@ typedef struct {
 
   //APRS global
   sysinterval_t     tel_enc_cycle;          // Cycle for sending of telemetry config headers
+  // Transmit time slots for trackers sharing a frequency (tdma_slots 0: off)
+  uint8_t           tdma_slots;             // Slots in a frame
+  uint8_t           tdma_slot;              // Slot of this tracker, 0 to tdma_slots - 1
+  sysinterval_t     tdma_slot_time;         // Length of a slot
+  bool              tx_pwr_ctrl;            // Lower the TX power while transmissions are heard by digipeaters
+  bool              rf_capture;             // Record received and transmitted frames to the SD card
+  bool              rx_stop;                // Stop mode while receive waits for a signal
   radio_freq_t      freq;                   // Default APRS frequency if geolocation not available
   // Base station call sign for receipt of tracker initiated sends
   // These are sends by the tracker which are not in response to a query.
   thd_base_conf_t   base;
 
   uint32_t          magic;                  // Key that indicates if the flash is loaded or has been updated
-  uint16_t          crc;                    // CRC to verify content
+  uint32_t          crc;                    // CRC-32 of the content before this field
 } conf_t;
 
 typedef struct {
   uint8_t           type;
-  char              name[64];
+  const char        *name;
   size_t            size;
   void              *ptr;
+  int32_t           min;                    // Range of TYPE_INT and TYPE_TIME (ms) values
+  int32_t           max;
+  uint32_t          changes;                // CONF_CHG_* bits set when the field is written
 } conf_command_t;
 
 #endif /* __TYPES_H__ */
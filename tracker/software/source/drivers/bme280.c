@@ -40,6 +40,9 @@ bool BME280_isAvailable(uint8_t id)
 
 /**
   * Initializes BME280 and reads calibration data
+  * The calibration data is kept in the handle so this is needed only once.
+  * The BME280 is left in sleep mode. Conversions are made with
+  * BME280_startForced() and BME280_readData().
   * @handle Handle for the BME280 of type bme280_t
   * @id ID of the BME280, 0: internal, 1 and 2: external
   */
@@ -56,6 +59,7 @@ void BME280_Init(bme280_t *handle, uint8_t id)
 			handle->i2c_read16 = &I2C_read16;
 			handle->i2c_read16_LE = &I2C_read16_LE;
 			handle->i2c_write8 = &I2C_write8;
+			handle->i2c_readN = &I2C_readN;
 			handle->i2c_address = 0x77;
 			break;
 
@@ -66,6 +70,7 @@ void BME280_Init(bme280_t *handle, uint8_t id)
 			handle->i2c_read16 = &eI2C_read16;
 			handle->i2c_read16_LE = &eI2C_read16_LE;
 			handle->i2c_write8 = &eI2C_write8;
+			handle->i2c_readN = &eI2C_readN;
 			handle->i2c_address = id==BME280_E1 ? 0x77 : 0x76;
 			break;
 	}
@@ -98,28 +103,67 @@ void BME280_Init(bme280_t *handle, uint8_t id)
 
 	(*handle->i2c_read8)(handle->i2c_address, BME280_REGISTER_DIG_H6, (uint8_t*)&handle->calib.dig_H6);
 
-	(*handle->i2c_write8)(handle->i2c_address, BME280_REGISTER_CONTROLHUMID, 0x03); // Set before CONTROL (DS 5.4.3)
-	(*handle->i2c_write8)(handle->i2c_address, BME280_REGISTER_CONTROL, 0x3F);
-	chThdSleep(TIME_MS2I(50)); // Wait for BME280
+	handle->t_fine = 0;
+	handle->adc_T = 0;
+	handle->adc_P = 0;
+	handle->adc_H = 0;
+	handle->initialized = true;
+}
+
+/**
+  * Starts a forced mode conversion
+  * The conversion runs in the BME280 so several sensors can convert at the
+  * same time. The result is ready after BME280_MEASURE_TIME.
+  * @return true if the conversion was started
+  */
+bool BME280_startForced(bme280_t *handle)
+{
+	// Set before CONTROL (DS 5.4.3)
+	if(!(*handle->i2c_write8)(handle->i2c_address, BME280_REGISTER_CONTROLHUMID, BME280_OSRS_H))
+		return false;
+	return (*handle->i2c_write8)(handle->i2c_address, BME280_REGISTER_CONTROL, BME280_CTRL_MEAS_FORCED);
+}
+
+/**
+  * Reads the result of a forced mode conversion
+  * Waits up to BME280_MEASURE_TIMEOUT for the conversion to end.
+  * Pressure, temperature and humidity are read in one burst so the values
+  * are of the same conversion (DS 4).
+  * @return true if the values were read
+  */
+bool BME280_readData(bme280_t *handle)
+{
+	uint8_t status;
+	uint8_t wait = BME280_MEASURE_TIMEOUT;
+	do {
+		if(!(*handle->i2c_read8)(handle->i2c_address, BME280_REGISTER_STATUS, &status))
+			return false;
+		if(!(status & BME280_STATUS_MEASURING))
+			break;
+		chThdSleep(TIME_MS2I(1));
+	} while(--wait);
+	if(!wait)
+		return false;
+
+	uint8_t data[BME280_DATA_SIZE];
+	if(!(*handle->i2c_readN)(handle->i2c_address, BME280_REGISTER_PRESSUREDATA, data, sizeof(data)))
+		return false;
+	handle->adc_P = ((int32_t)data[0] << 12) | ((int32_t)data[1] << 4) | (data[2] >> 4);
+	handle->adc_T = ((int32_t)data[3] << 12) | ((int32_t)data[4] << 4) | (data[5] >> 4);
+	handle->adc_H = ((int32_t)data[6] << 8) | data[7];
 
 	BME280_getTemperature(handle); // Set t_fine
+	return true;
 }
 
 /**
-  * Reads the temperature
+  * Returns the temperature of the last conversion
   * @return Temperature in degC * 100
   */
 int16_t BME280_getTemperature(bme280_t *handle)
 {
-	int32_t var1, var2, adc_T;
-	uint16_t tmp;
-
-	(*handle->i2c_read16)(handle->i2c_address, BME280_REGISTER_TEMPDATA, &tmp);
-	adc_T = tmp;
-	(*handle->i2c_read8)(handle->i2c_address, BME280_REGISTER_TEMPDATA+2, (uint8_t*)&tmp);
-	adc_T <<= 8;
-	adc_T |= tmp & 0xFF;
-	adc_T >>= 4;
+	int32_t var1, var2;
+	int32_t adc_T = handle->adc_T;
 
 	var1 = ((((adc_T>>3) - ((int32_t)handle->calib.dig_T1 <<1))) * ((int32_t)handle->calib.dig_T2)) >> 11;
 	var2 = (((((adc_T>>4) - ((int32_t)handle->calib.dig_T1)) * ((adc_T>>4) - ((int32_t)handle->calib.dig_T1))) >> 12) * ((int32_t)handle->calib.dig_T3)) >> 14;
@@ -130,54 +174,40 @@ int16_t BME280_getTemperature(bme280_t *handle)
 }
 
 /**
-  * Reads the barometric pressure
-  * @param Values to be sampled
+  * Returns the barometric pressure of the last conversion
+  * The BME280 oversampling replaces averaging of readings.
   * @return Pressure in Pa * 10
   */
-uint32_t BME280_getPressure(bme280_t *handle, uint16_t means) {
+uint32_t BME280_getPressure(bme280_t *handle) {
 	int64_t var1, var2, p;
-	uint16_t tmp;
-
-	uint64_t sum = 0;
-	for(uint16_t i=0; i<means; i++) {
-		int32_t adc_P;
-		(*handle->i2c_read16)(handle->i2c_address, BME280_REGISTER_PRESSUREDATA, &tmp);
-		adc_P = tmp;
-		(*handle->i2c_read8)(handle->i2c_address, BME280_REGISTER_PRESSUREDATA+2, (uint8_t*)&tmp);
-		adc_P <<= 8;
-		adc_P |= tmp & 0xFF;
-		adc_P >>= 4;
-
-		var1 = ((int64_t)handle->t_fine) - 128000;
-		var2 = var1 * var1 * (int64_t)handle->calib.dig_P6;
-		var2 = var2 + ((var1*(int64_t)handle->calib.dig_P5)<<17);
-		var2 = var2 + (((int64_t)handle->calib.dig_P4)<<35);
-		var1 = ((var1 * var1 * (int64_t)handle->calib.dig_P3)>>8) + ((var1 * (int64_t)handle->calib.dig_P2)<<12);
-		var1 = (((((int64_t)1)<<47)+var1))*((int64_t)handle->calib.dig_P1)>>33;
-
-		if (var1 == 0)
-			return 0;  // avoid exception caused by division by zero
-
-		p = 1048576 - adc_P;
-		p = (((p<<31) - var2)*3125) / var1;
-		var1 = (((int64_t)handle->calib.dig_P9) * (p>>13) * (p>>13)) >> 25;
-		var2 = (((int64_t)handle->calib.dig_P8) * p) >> 19;
-
-		sum += ((p + var1 + var2) >> 8) + (((int64_t)handle->calib.dig_P7)<<4);
-	}
+	int32_t adc_P = handle->adc_P;
+
+	var1 = ((int64_t)handle->t_fine) - 128000;
+	var2 = var1 * var1 * (int64_t)handle->calib.dig_P6;
+	var2 = var2 + ((var1*(int64_t)handle->calib.dig_P5)<<17);
+	var2 = var2 + (((int64_t)handle->calib.dig_P4)<<35);
+	var1 = ((var1 * var1 * (int64_t)handle->calib.dig_P3)>>8) + ((var1 * (int64_t)handle->calib.dig_P2)<<12);
+	var1 = (((((int64_t)1)<<47)+var1))*((int64_t)handle->calib.dig_P1)>>33;
+
+	if (var1 == 0)
+		return 0;  // avoid exception caused by division by zero
+
+	p = 1048576 - adc_P;
+	p = (((p<<31) - var2)*3125) / var1;
+	var1 = (((int64_t)handle->calib.dig_P9) * (p>>13) * (p>>13)) >> 25;
+	var2 = (((int64_t)handle->calib.dig_P8) * p) >> 19;
+
+	p = ((p + var1 + var2) >> 8) + (((int64_t)handle->calib.dig_P7)<<4);
 
-	return sum/(means*26);
+	return p/26;
 }
 
 /**
-  * Reads the relative humidity
+  * Returns the relative humidity of the last conversion
   * @return rel. humidity in % * 10
   */
 uint8_t BME280_getHumidity(bme280_t *handle) {
-	int32_t adc_H;
-	uint16_t tmp;
-	(*handle->i2c_read16)(handle->i2c_address, BME280_REGISTER_HUMIDDATA, &tmp);
-	adc_H = tmp;
+	int32_t adc_H = handle->adc_H;
 
 	int32_t v_x1_u32r;
 
@@ -47,12 +47,25 @@
 #define BME280_REGISTER_CAL26			0xE1
 
 #define BME280_REGISTER_CONTROLHUMID	0xF2
+#define BME280_REGISTER_STATUS			0xF3
 #define BME280_REGISTER_CONTROL			0xF4
 #define BME280_REGISTER_CONFIG			0xF5
 #define BME280_REGISTER_PRESSUREDATA	0xF7
 #define BME280_REGISTER_TEMPDATA		0xFA
 #define BME280_REGISTER_HUMIDDATA		0xFD
 
+#define BME280_DATA_SIZE				8		// Burst of pressure, temperature and humidity
+#define BME280_STATUS_MEASURING			0x08
+
+/*
+ * Conversions are made in forced mode using the chip oversampling.
+ * Humidity x4, temperature x2, pressure x16.
+ * The maximum conversion time is given by DS 9.1.
+ */
+#define BME280_OSRS_H					0x03
+#define BME280_CTRL_MEAS_FORCED			((0x2 << 5) | (0x5 << 2) | 0x1)
+#define BME280_MEASURE_TIME				54		// Maximum conversion time in ms
+#define BME280_MEASURE_TIMEOUT			20		// Added wait for the conversion end in ms
 
 #define BME280_I1	0x0
 #define BME280_E1	0x1
@@ -88,19 +101,26 @@ typedef struct {
 	bool (*i2c_read16)(uint8_t,uint8_t,uint16_t*);
 	bool (*i2c_read16_LE)(uint8_t,uint8_t,uint16_t*);
 	bool (*i2c_write8)(uint8_t,uint8_t,uint8_t);
+	bool (*i2c_readN)(uint8_t,uint8_t,uint8_t*,uint32_t);
 
 	// I2C Address
 	uint8_t i2c_address;
 
 	// BME280 stuff
+	bool initialized;			// Calibration data has been read
 	int32_t t_fine;
+	int32_t adc_T;				// Raw values of the last conversion
+	int32_t adc_P;
+	int32_t adc_H;
 	bme280_calib_data_t calib;
 } bme280_t;
 
 bool BME280_isAvailable(uint8_t id);
 void BME280_Init(bme280_t *handle, uint8_t id);
+bool BME280_startForced(bme280_t *handle);
+bool BME280_readData(bme280_t *handle);
 int16_t BME280_getTemperature(bme280_t *handle);
-uint32_t BME280_getPressure(bme280_t *handle, uint16_t means);
+uint32_t BME280_getPressure(bme280_t *handle);
 uint8_t BME280_getHumidity(bme280_t *handle);
 int32_t BME280_getAltitude(uint32_t seaLevel, uint32_t atmospheric);
 
@@ -52,3 +52,80 @@ uint8_t Checksum_IHexRecord(const IHexRecord *ihexRecord) {
   return checksum;
 }
 
+/* Utility function to convert ASCII hex digits to an integer, -1 if not hex */
+static int Hex_IHexDigits(const char *s, int len) {
+  int value = 0;
+  int i;
+
+  for (i = 0; i < len; i++) {
+    char c = s[i];
+    value <<= 4;
+    if (c >= '0' && c <= '9')
+      value |= c - '0';
+    else if (c >= 'A' && c <= 'F')
+      value |= c - 'A' + 10;
+    else if (c >= 'a' && c <= 'f')
+      value |= c - 'a' + 10;
+    else
+      return -1;
+  }
+  return value;
+}
+
+/* Parses an Intel HEX8 record string into the IHexRecord structure that the parameter
+ * ihexRecord points to. The record checksum is verified. */
+int Parse_IHexRecord(const char *recordBuff, IHexRecord *ihexRecord) {
+  int dataCount, i, field;
+
+  /* Check our record pointer and string pointer */
+  if (recordBuff == NULL || ihexRecord == NULL)
+    return IHEX_ERROR_INVALID_ARGUMENTS;
+
+  /* Check if we hit a newline */
+  if (recordBuff[0] == '\0' || recordBuff[0] == '\r' || recordBuff[0] == '\n')
+    return IHEX_ERROR_NEWLINE;
+
+  /* Size check for start code, count, address, and type fields */
+  if (strlen(recordBuff) < (unsigned int) (1 + IHEX_COUNT_LEN + IHEX_ADDRESS_LEN + IHEX_TYPE_LEN))
+    return IHEX_ERROR_INVALID_RECORD;
+
+  /* Check the for colon start code */
+  if (recordBuff[IHEX_START_CODE_OFFSET] != IHEX_START_CODE)
+    return IHEX_ERROR_INVALID_RECORD;
+
+  /* Copy the ASCII hex encoding of the count, address and type fields */
+  dataCount = Hex_IHexDigits(recordBuff + IHEX_COUNT_OFFSET, IHEX_COUNT_LEN);
+  field = Hex_IHexDigits(recordBuff + IHEX_ADDRESS_OFFSET, IHEX_ADDRESS_LEN);
+  ihexRecord->type = Hex_IHexDigits(recordBuff + IHEX_TYPE_OFFSET, IHEX_TYPE_LEN);
+  if (dataCount < 0 || field < 0 || ihexRecord->type < 0)
+    return IHEX_ERROR_INVALID_RECORD;
+  ihexRecord->address = (uint16_t) field;
+
+  /* Size check for data and checksum fields */
+  if (strlen(recordBuff) < (unsigned int) (1 + IHEX_COUNT_LEN + IHEX_ADDRESS_LEN + IHEX_TYPE_LEN
+      + dataCount * IHEX_ASCII_HEX_BYTE_LEN + IHEX_CHECKSUM_LEN))
+    return IHEX_ERROR_INVALID_RECORD;
+
+  /* Loop through each ASCII hex byte of the data field and convert it */
+  for (i = 0; i < dataCount; i++) {
+    field = Hex_IHexDigits(recordBuff + IHEX_DATA_OFFSET + IHEX_ASCII_HEX_BYTE_LEN * i,
+                           IHEX_ASCII_HEX_BYTE_LEN);
+    if (field < 0)
+      return IHEX_ERROR_INVALID_RECORD;
+    ihexRecord->data[i] = (uint8_t) field;
+  }
+  ihexRecord->dataLen = dataCount;
+
+  /* Copy the ASCII hex encoding of the checksum field */
+  field = Hex_IHexDigits(recordBuff + IHEX_DATA_OFFSET + dataCount * IHEX_ASCII_HEX_BYTE_LEN,
+                         IHEX_CHECKSUM_LEN);
+  if (field < 0)
+    return IHEX_ERROR_INVALID_RECORD;
+  ihexRecord->checksum = (uint8_t) field;
+
+  if (ihexRecord->checksum != Checksum_IHexRecord(ihexRecord))
+    return IHEX_ERROR_INVALID_RECORD;
+
+  return IHEX_OK;
+}
+
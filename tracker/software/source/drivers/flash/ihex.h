@@ -96,4 +96,17 @@ int New_IHexRecord(int type, uint16_t address, const uint8_t *data, int dataLen,
 */
 uint8_t Checksum_IHexRecord(const IHexRecord *ihexRecord);
 
+/**
+ * Parses an Intel HEX8 record from a string into an IHexRecord structure.
+ * Characters after the checksum, such as a line ending, are ignored.
+ * \param recordBuff A pointer to the null terminated record string.
+ * \param ihexRecord A pointer to the Intel HEX8 record structure that will store the parsed record.
+ * \return IHEX_OK on success, otherwise one of the IHEX_ERROR_ error codes.
+ * \retval IHEX_OK on success.
+ * \retval IHEX_ERROR_NEWLINE if the string holds no record.
+ * \retval IHEX_ERROR_INVALID_RECORD if the record is malformed or its checksum does not match.
+ * \retval IHEX_ERROR_INVALID_ARGUMENTS if a pointer is NULL.
+*/
+int Parse_IHexRecord(const char *recordBuff, IHexRecord *ihexRecord);
+
 #endif
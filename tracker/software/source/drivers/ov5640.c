@@ -20,8 +20,6 @@
 static uint32_t lightIntensity;
 static uint8_t error;
 
-bool    decode_pause;
-
 struct regval_list {
 	uint16_t reg;
 	uint8_t val;
@@ -696,17 +694,46 @@ static const struct regval_list OV5640_QSXGA2XGA[]  =
 	{0xffff, 0xff},	
 };
 
+#if OV5640_KEEP_EXPOSURE == TRUE
+/* Exposure, gain and white balance of the last good capture. */
+typedef struct {
+	bool		valid;
+	systime_t	time;
+	/* Light level of the capture. */
+	uint32_t	light;
+	/* 0x3500 to 0x3502. */
+	uint8_t		exposure[3];
+	/* 0x350A and 0x350B. */
+	uint8_t		gain[2];
+	/* R, G and B gains high and low as 0x3400 to 0x3405. */
+	uint8_t		awb[6];
+} ov5640_exposure_t;
+
+static ov5640_exposure_t exposure_state;
+#endif
+
 static resolution_t last_res = RES_NONE;
+/* Register table of the current resolution. */
+static const struct regval_list *res_regs = NULL;
+/* Sensor is in software power down with registers kept. */
+static bool in_standby = false;
 
 typedef struct dmaControl {
   const stm32_dma_stream_t  *dmastp;
   TIM_TypeDef               *timer;
+  uint8_t                   *buffer;
   uint8_t                   *capture_buffer;
+  /* Bytes in completed DMA segments. */
+  volatile uint32_t         filled;
   uint16_t                  dbm_index;
   volatile bool             capture;
   uint32_t                  dma_flags;
   volatile bool             dma_error;
   uint16_t                  dma_count;
+  /* DBM target the DMA is expected to be writing. */
+  uint8_t                   target;
+  /* A segment switch was serviced too late and data was overwritten. */
+  bool                      overrun;
 } dma_capture_t;
 
 /**
@@ -714,13 +741,16 @@ typedef struct dmaControl {
   * @buffer Buffer in which the image can be sampled
   * @size Size of buffer
   * @res Resolution of the image
+  * @segment Callback for completed DMA segments (or NULL)
+  * @arg Argument passed to the callback
   * If resolution MAX_RES has been chosen, the maximum resolution will be
   * chosen for the available buffer. Due to the JPEG compression
   * that could lead to different resolutions on different method calls.
   * The method returns the size of the image.
   */
 uint32_t OV5640_Snapshot2RAM(uint8_t* buffer,
-                             uint32_t size, resolution_t res) {
+                             uint32_t size, resolution_t res,
+                             ov5640_segment_cb_t segment, void *arg) {
 	uint8_t cntr = 5;
 	//bool status;
 	uint32_t size_sampled;
@@ -732,15 +762,18 @@ uint32_t OV5640_Snapshot2RAM(uint8_t* buffer,
 		} else {
 			OV5640_SetResolution(res);
 		}
+		last_res = res;
 	}
 
 	// Capture image until we get a good image or reach max retries.
     TRACE_INFO("CAM  > Capture image into buffer @ 0x%08x size 0x%08x",
                buffer, size);
 	do {
-		size_sampled = OV5640_Capture(buffer, size);
+		size_sampled = OV5640_Capture(buffer, size, segment, arg);
 		if(size_sampled > 0) {
 		  TRACE_INFO("CAM  > Image size: %d bytes", size_sampled);
+		  /* Light level at this capture for telemetry and image policy. */
+		  OV5640_setLightIntensity();
 		  return size_sampled;
 		}
 		/* Allow time for other threads. */
@@ -843,13 +876,27 @@ static void dma_interrupt(void *p, uint32_t flags) {
      * This is done at HTIF so that CT is known to be valid.
      * Checking state of CT at TCIF may be too late because of IRQ latency.
      * i.e. the DMA controller may have already changed CT before IRQ is serviced.
+     *
+     * The capture is not exclusive of other interrupt users.
+     * If this IRQ was held off past the end of the segment the DMA has
+     * switched to a stale address and overwritten earlier data.
+     * Verify CT is still the expected target and abort if not.
      */
+    if(dmaStreamGetCurrentTarget(dmastp) != dma_control->target) {
+      dma_control->dma_count = dma_stop(dmastp);
+      dma_control->overrun = true;
+      dma_control->dma_error = true;
+      dmaStreamClearInterrupt(dmastp);
+      return;
+    }
+    dma_control->filled = dma_control->capture_buffer - dma_control->buffer;
     dma_control->capture_buffer += DMA_SEGMENT_SIZE;
-    if (dmaStreamGetCurrentTarget(dmastp) == 1) {
+    if (dma_control->target == 1) {
       dmaStreamSetMemory0(dmastp, dma_control->capture_buffer);
     } else {
       dmaStreamSetMemory1(dmastp, dma_control->capture_buffer);
     }
+    dma_control->target ^= 1;
     dmaStreamClearInterrupt(dmastp);
     return;
   }
@@ -989,24 +1036,15 @@ void vsync_cb(void *arg) {
 
 /*
  * Other drivers using resources that can cause DMA competition are locked.
+ *
+ * The radios are not locked. Receive and transmit continue during capture.
+ * The radio SPI is on DMA1 while the capture stream is on DMA2 at PL 3.
+ * The capture DMA IRQ is above the receive interrupts and a missed segment
+ * switch is detected in the DMA IRQ. The capture is then retried.
  */
 msg_t OV5640_LockResourcesForCapture(void) {
-  /* TODO: have to make this a loop which would handle multiple receivers. */
-
-  /* Acquire radio after any active TX completes. */
-  msg_t msg = pktLockRadioTransmit(PKT_RADIO_1, TIME_INFINITE);
-  if(msg != MSG_OK) {
-    return msg;
-  }
-  if(pktIsReceiveActive(PKT_RADIO_1)) {
-    pktLLDradioPauseDecoding(PKT_RADIO_1);
-    decode_pause = true;
-  } else
-    decode_pause = false;
   I2C_Lock();
 
-  //pktLLDradioPauseDecoding(PKT_RADIO_1);
-  //pktPauseDecoding(PKT_RADIO_1);
   /* Hold TRACE output on USB. */
 /*  if(isUSBactive())
     chMtxLock(&trace_mtx);*/
@@ -1021,19 +1059,15 @@ void OV5640_UnlockResourcesForCapture(void) {
 /*  if(isUSBactive())
     chMtxUnlock(&trace_mtx);*/
   I2C_Unlock();
-  /* TODO: have to make this a loop which would handle multiple receivers. */
-  if(pktIsReceivePaused(PKT_RADIO_1) && decode_pause) {
-    pktLLDradioResumeDecoding(PKT_RADIO_1);
-  }
-  //pktResumeDecoding(PKT_RADIO_1);
-  /* Enable TX tasks to run. */
-  pktUnlockRadioTransmit(PKT_RADIO_1);
 }
 
 /**
- *
+ * The segment callback (if not NULL) is called from this thread with the
+ * bytes written by completed DMA segments while the capture runs.
+ * It must not use TRACE while the capture holds its resources.
  */
-uint32_t OV5640_Capture(uint8_t* buffer, uint32_t size) {
+uint32_t OV5640_Capture(uint8_t* buffer, uint32_t size,
+                        ov5640_segment_cb_t segment, void *arg) {
 
 	/*
 	 * Note:
@@ -1050,6 +1084,9 @@ uint32_t OV5640_Capture(uint8_t* buffer, uint32_t size) {
 
 	dma_capture_t dma_control = {0};
 
+	if(segment != NULL)
+	  segment(arg, buffer, 0);
+
 	/* Setup DMA for transfer on timer CC tigger.
 	 * For TIM8 this is DMA2 stream 2, channel 7.
 	 * Use PL 3 as camera PCLK rate is high and we need priority service.
@@ -1071,13 +1108,14 @@ uint32_t OV5640_Capture(uint8_t* buffer, uint32_t size) {
 	STM32_DMA_CR_TCIE;
 
 	/* Set stream, IRQ priority, IRQ handler & parameter. */
-	dmaStreamAllocate(dma_control.dmastp, 7,
+	dmaStreamAllocate(dma_control.dmastp, OV5640_DMA_IRQ_PRIORITY,
 	                  (stm32_dmaisr_t)dma_interrupt, &dma_control);
 
 	dmaStreamSetPeripheral(dma_control.dmastp, &GPIOA->IDR); // We want to read the data from here
 
 #if OV5640_USE_DMA_DBM == TRUE
 	//dma_buffer = buffer;
+	dma_control.buffer = buffer;
 	dma_control.capture_buffer = buffer;
 
     /*
@@ -1105,7 +1143,9 @@ uint32_t OV5640_Capture(uint8_t* buffer, uint32_t size) {
 
     /*
      * Calculate the number of whole buffers.
-     * TODO: Make this include remainder memory as partial buffer?
+     * DBM uses the same transfer size for both memory targets.
+     * So a remainder of less than a segment can not be used.
+     * The caller should size the buffer in whole segments.
      */
     dma_control.dbm_index = (size / DMA_SEGMENT_SIZE);
     if(dma_control.dbm_index < 2) {
@@ -1157,8 +1197,18 @@ uint32_t OV5640_Capture(uint8_t* buffer, uint32_t size) {
 
 	// Wait for capture to be finished
 	uint8_t timout = 50; // 500ms max
+#if OV5640_USE_DMA_DBM == TRUE
+	uint32_t filled = 0;
+#endif
 	do {
 		chThdSleep(TIME_MS2I(10));
+#if OV5640_USE_DMA_DBM == TRUE
+		/* Hand completed segments to the consumer. */
+		if(segment != NULL && dma_control.filled > filled) {
+		  filled = dma_control.filled;
+		  segment(arg, buffer, filled);
+		}
+#endif
 	} while(!dma_control.capture && !dma_control.dma_error && --timout);
 
     palDisableLineEvent(LINE_CAM_VSYNC);
@@ -1173,6 +1223,11 @@ uint32_t OV5640_Capture(uint8_t* buffer, uint32_t size) {
     OV5640_UnlockResourcesForCapture();
 
 	if(dma_control.dma_error) {
+		if(dma_control.overrun) {
+			TRACE_ERROR("CAM  > DMA segment switch missed");
+			error = 0x6;
+			return 0;
+		}
 		if(dma_control.dma_flags & STM32_DMA_ISR_HTIF) {
 			TRACE_ERROR("CAM  > DMA abort - last buffer segment");
 			error = 0x2;
@@ -1232,6 +1287,9 @@ void OV5640_TransmitConfig(void)
 	I2C_write8_16bitreg(OV5640_I2C_ADR, 0x3103, 0x11);
 	I2C_write8_16bitreg(OV5640_I2C_ADR, 0x3008, 0x82);
 	chThdSleep(TIME_MS2I(100));
+	res_regs = NULL;
+	last_res = RES_NONE;
+	in_standby = false;
 
 	TRACE_INFO("CAM  > ... Initialization");
 	for(uint32_t i=0; (OV5640YUV_Sensor_Dvp_Init[i].reg != 0xffff) || (OV5640YUV_Sensor_Dvp_Init[i].val != 0xff); i++)
@@ -1289,44 +1347,71 @@ void OV5640_TransmitConfig(void)
 	I2C_write8_16bitreg(OV5640_I2C_ADR, 0x3212, 0xa3); // launch group 3
 }
 
-void OV5640_SetResolution(resolution_t res)
+/*
+ * Get the register table for a resolution.
+ */
+static const struct regval_list *OV5640_getResolutionRegs(resolution_t res)
 {
-	TRACE_INFO("CAM  > ... Configure Resolution");
 	switch(res) {
 		case RES_QQVGA:
-			for(uint32_t i=0; (OV5640_QSXGA2QQVGA[i].reg != 0xffff) || (OV5640_QSXGA2QQVGA[i].val != 0xff); i++)
-				I2C_write8_16bitreg(OV5640_I2C_ADR, OV5640_QSXGA2QQVGA[i].reg, OV5640_QSXGA2QQVGA[i].val);
-			break;
+			return OV5640_QSXGA2QQVGA;
 
 		case RES_QVGA:
-			for(uint32_t i=0; (OV5640_QSXGA2QVGA[i].reg != 0xffff) || (OV5640_QSXGA2QVGA[i].val != 0xff); i++)
-				I2C_write8_16bitreg(OV5640_I2C_ADR, OV5640_QSXGA2QVGA[i].reg, OV5640_QSXGA2QVGA[i].val);
-			break;
+			return OV5640_QSXGA2QVGA;
 
 		case RES_VGA:
-			for(uint32_t i=0; (OV5640_QSXGA2VGA[i].reg != 0xffff) || (OV5640_QSXGA2VGA[i].val != 0xff); i++)
-				I2C_write8_16bitreg(OV5640_I2C_ADR, OV5640_QSXGA2VGA[i].reg, OV5640_QSXGA2VGA[i].val);
-			break;
+			return OV5640_QSXGA2VGA;
 
 		case RES_XGA:
-			for(uint32_t i=0; (OV5640_QSXGA2XGA[i].reg != 0xffff) || (OV5640_QSXGA2XGA[i].val != 0xff); i++)
-				I2C_write8_16bitreg(OV5640_I2C_ADR, OV5640_QSXGA2XGA[i].reg, OV5640_QSXGA2XGA[i].val);
-			break;
+			return OV5640_QSXGA2XGA;
 
 		case RES_UXGA:
-			for(uint32_t i=0; (OV5640_QSXGA2UXGA[i].reg != 0xffff) || (OV5640_QSXGA2UXGA[i].val != 0xff); i++)
-				I2C_write8_16bitreg(OV5640_I2C_ADR, OV5640_QSXGA2UXGA[i].reg, OV5640_QSXGA2UXGA[i].val);
-			break;
+			return OV5640_QSXGA2UXGA;
 
 		case RES_NONE: // No configuration is made
-			break;
+			return NULL;
 
 		default: // Default QVGA
-			for(uint32_t i=0; (OV5640_QSXGA2QVGA[i].reg != 0xffff) || (OV5640_QSXGA2QVGA[i].val != 0xff); i++)
-				I2C_write8_16bitreg(OV5640_I2C_ADR, OV5640_QSXGA2QVGA[i].reg, OV5640_QSXGA2QVGA[i].val);
+			return OV5640_QSXGA2QVGA;
 	}
 }
 
+/*
+ * Check if a register is already set to a value by a register table.
+ */
+static bool OV5640_isRegSet(const struct regval_list *list,
+                            uint16_t reg, uint8_t val)
+{
+	if(list == NULL)
+		return false;
+	for(uint32_t i=0; (list[i].reg != 0xffff) || (list[i].val != 0xff); i++)
+		if(list[i].reg == reg)
+			return list[i].val == val;
+	return false;
+}
+
+/*
+ * The resolution tables all set the same registers over QSXGA.
+ * So only registers which differ from the current table are written.
+ */
+void OV5640_SetResolution(resolution_t res)
+{
+	const struct regval_list *list = OV5640_getResolutionRegs(res);
+	if(list == NULL)
+		return;
+
+	TRACE_INFO("CAM  > ... Configure Resolution");
+	uint32_t n = 0;
+	for(uint32_t i=0; (list[i].reg != 0xffff) || (list[i].val != 0xff); i++) {
+		if(OV5640_isRegSet(res_regs, list[i].reg, list[i].val))
+			continue;
+		I2C_write8_16bitreg(OV5640_I2C_ADR, list[i].reg, list[i].val);
+		n++;
+	}
+	res_regs = list;
+	TRACE_INFO("CAM  > ... %d resolution registers written", n);
+}
+
 void OV5640_powerup(void) {
   // Configure pins
     OV5640_InitGPIO();
@@ -1340,6 +1425,63 @@ void OV5640_powerup(void) {
 }
 
 
+#if OV5640_KEEP_EXPOSURE == TRUE
+/*
+ * Write the kept exposure and white balance as manual values then hand
+ * them back to AE/AWB which continue from there.
+ * Returns true if a state was written.
+ */
+static bool OV5640_restoreExposure(void)
+{
+	if(!exposure_state.valid
+			|| chVTTimeElapsedSinceX(exposure_state.time) > OV5640_AE_MAX_AGE)
+		return false;
+
+	TRACE_INFO("CAM  > ... Restore exposure of light level %d",
+			   exposure_state.light);
+	I2C_write8_16bitreg(OV5640_I2C_ADR, 0x3503, 0x03); // manual AEC/AGC
+	for(uint8_t i = 0; i < sizeof(exposure_state.exposure); i++)
+		I2C_write8_16bitreg(OV5640_I2C_ADR, 0x3500 + i,
+							exposure_state.exposure[i]);
+	for(uint8_t i = 0; i < sizeof(exposure_state.gain); i++)
+		I2C_write8_16bitreg(OV5640_I2C_ADR, 0x350A + i,
+							exposure_state.gain[i]);
+	I2C_write8_16bitreg(OV5640_I2C_ADR, 0x3406, 0x01); // manual AWB
+	for(uint8_t i = 0; i < sizeof(exposure_state.awb); i++)
+		I2C_write8_16bitreg(OV5640_I2C_ADR, 0x3400 + i,
+							exposure_state.awb[i]);
+	I2C_write8_16bitreg(OV5640_I2C_ADR, 0x3406, 0x00); // auto AWB
+	I2C_write8_16bitreg(OV5640_I2C_ADR, 0x3503, 0x00); // auto AEC/AGC
+	return true;
+}
+#endif
+
+/*
+ * Read the converged exposure, gain and white balance after a good
+ * capture to start from at the next power up.
+ */
+void OV5640_saveExposure(void)
+{
+#if OV5640_KEEP_EXPOSURE == TRUE
+	ov5640_exposure_t state;
+	bool ok = true;
+	for(uint8_t i = 0; i < sizeof(state.exposure); i++)
+		ok &= I2C_read8_16bitreg(OV5640_I2C_ADR, 0x3500 + i,
+								 &state.exposure[i]);
+	for(uint8_t i = 0; i < sizeof(state.gain); i++)
+		ok &= I2C_read8_16bitreg(OV5640_I2C_ADR, 0x350A + i, &state.gain[i]);
+	/* The AWB gains in use are read back from 0x519F to 0x51A4. */
+	for(uint8_t i = 0; i < sizeof(state.awb); i++)
+		ok &= I2C_read8_16bitreg(OV5640_I2C_ADR, 0x519F + i, &state.awb[i]);
+	if(!ok)
+		return;
+	state.valid = true;
+	state.time = chVTGetSystemTime();
+	state.light = lightIntensity;
+	exposure_state = state;
+#endif
+}
+
 void OV5640_init(void)
 {
 	TRACE_INFO("CAM  > Init pins");
@@ -1350,7 +1492,40 @@ void OV5640_init(void)
 	TRACE_INFO("CAM  > Transmit config to camera");
 	OV5640_TransmitConfig();
 
-	chThdSleep(TIME_MS2I(200));
+#if OV5640_KEEP_EXPOSURE == TRUE
+	if(OV5640_restoreExposure()) {
+		chThdSleep(TIME_MS2I(OV5640_RESTORE_DELAY));
+		return;
+	}
+#endif
+	chThdSleep(TIME_MS2I(OV5640_INIT_DELAY));
+}
+
+/*
+ * Put the sensor into software power down.
+ * Register settings are kept so a capture needs no register load.
+ */
+void OV5640_standby(void)
+{
+	if(in_standby)
+		return;
+	TRACE_INFO("CAM  > Standby");
+	I2C_write8_16bitreg(OV5640_I2C_ADR, 0x3008, 0x42);
+	in_standby = true;
+}
+
+/*
+ * Wake the sensor from software power down.
+ */
+void OV5640_wakeup(void)
+{
+	if(!in_standby)
+		return;
+	TRACE_INFO("CAM  > Wake up from standby");
+	I2C_write8_16bitreg(OV5640_I2C_ADR, 0x3008, 0x02);
+	in_standby = false;
+	/* Allow a few frames for exposure to settle. */
+	chThdSleep(TIME_MS2I(OV5640_WAKEUP_DELAY));
 }
 
 void OV5640_deinit(void)
@@ -1358,6 +1533,17 @@ void OV5640_deinit(void)
 	// Power off OV5640
 	TRACE_INFO("CAM  > Switch off");
 
+	chSysLock();
+	OV5640_switchOffI();
+	chSysUnlock();
+}
+
+/*
+ * Switch off the camera power and release the interface pins.
+ * Can be called from a timer callback.
+ */
+void OV5640_switchOffI(void)
+{
 	palSetLineMode(LINE_CAM_PCLK, PAL_MODE_INPUT);
 	palSetLineMode(LINE_CAM_VSYNC, PAL_MODE_INPUT);
 
@@ -1375,6 +1561,8 @@ void OV5640_deinit(void)
 	palSetLineMode(LINE_CAM_RESET, PAL_MODE_INPUT);
 
 	last_res = RES_NONE;
+	res_regs = NULL;
+	in_standby = false;
 }
 
 bool OV5640_isAvailable(void) {
@@ -28,17 +28,53 @@
 #define DMA_SEGMENT_SIZE        1024
 #define DMA_FIFO_BURST_ALIGN    16
 
+/*
+ * IRQ priority of the capture DMA stream.
+ * Above the ICU, GPT and EXTI handlers of packet receive (6 and 7) so the
+ * DBM segment switch is serviced in time while receive runs.
+ */
+#define OV5640_DMA_IRQ_PRIORITY 3
+
+/* Time in ms for exposure to settle after standby. */
+#define OV5640_WAKEUP_DELAY     100
+
+/*
+ * Keep the exposure, gain and white balance of the last good capture.
+ * They are the starting point of AE/AWB at the next power up so the
+ * settle time after the configuration is shortened.
+ * A state older than OV5640_AE_MAX_AGE is not used.
+ */
+#define OV5640_KEEP_EXPOSURE    TRUE
+#define OV5640_AE_MAX_AGE       TIME_S2I(3600)
+/* Time in ms for exposure to settle after power up. */
+#define OV5640_INIT_DELAY       200
+#define OV5640_RESTORE_DELAY    50
+
+/*
+ * Called from the capture thread as DMA segments complete.
+ * A fill of zero is made when a capture (or retry) starts.
+ */
+typedef void (*ov5640_segment_cb_t)(void *arg, const uint8_t *buffer,
+                                    uint32_t filled);
+
 #ifdef __cplusplus
 extern "C" {
 #endif
-uint32_t    OV5640_Snapshot2RAM(uint8_t* buffer, uint32_t size, resolution_t resolution);
-uint32_t    OV5640_Capture(uint8_t* buffer, uint32_t size);
+uint32_t    OV5640_Snapshot2RAM(uint8_t* buffer, uint32_t size,
+                                resolution_t resolution,
+                                ov5640_segment_cb_t segment, void *arg);
+uint32_t    OV5640_Capture(uint8_t* buffer, uint32_t size,
+                           ov5640_segment_cb_t segment, void *arg);
 void        OV5640_InitGPIO(void);
 void        OV5640_TransmitConfig(void);
 void        OV5640_SetResolution(resolution_t res);
 void        OV5640_init(void);
 void        OV5640_deinit(void);
+void        OV5640_switchOffI(void);
+void        OV5640_standby(void);
+void        OV5640_wakeup(void);
 bool        OV5640_isAvailable(void);
+void        OV5640_saveExposure(void);
 void        OV5640_setLightIntensity(void);
 uint32_t    OV5640_getLastLightIntensity(void);
 uint8_t     OV5640_hasError(void);
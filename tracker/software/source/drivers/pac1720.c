@@ -4,6 +4,8 @@
 #include "pi2c.h"
 #include "pac1720.h"
 #include "padc.h"
+#include "sleep.h"
+#include "eprof.h"
 #include <stdlib.h>
 
 /* 
@@ -24,6 +26,11 @@ static int32_t pac1720_vbat;
 static int32_t pac1720_vsol;
 static int32_t pac1720_counter;
 
+/* Energy not yet counted in the mWh counters in 0.1mWs. */
+static int32_t pac1720_esol;
+static int32_t pac1720_ebat;
+static bool pac1720_configured = false;
+
 static uint8_t error;
 
 static mutex_t mtx;
@@ -121,6 +128,98 @@ static void sendConfig(void)
 	I2C_write8(PAC1720_ADDRESS, PAC1720_V_SOURCE_SAMP_CONFIG,   0xFF);
 }
 
+/*
+ * Counters are kept in RTC backup registers so survive a reset.
+ * The register after the counters is a magic marking them valid.
+ */
+#define BKP_REG(n)	((&RTC->BKP0R)[PAC1720_BKP_REG + (n)])
+#define BKP_SOLAR	0
+#define BKP_BAT_IN	1
+#define BKP_BAT_OUT	2
+#define BKP_MAGIC	3
+
+static void initEnergy(void)
+{
+	if(BKP_REG(BKP_MAGIC) == PAC1720_BKP_MAGIC)
+		return;
+	BKP_REG(BKP_SOLAR) = 0;
+	BKP_REG(BKP_BAT_IN) = 0;
+	BKP_REG(BKP_BAT_OUT) = 0;
+	BKP_REG(BKP_MAGIC) = PAC1720_BKP_MAGIC;
+}
+
+/*
+ * Read all measurement registers in one burst.
+ * Power in 0.1mW and voltages in mV as the single getters.
+ */
+static bool readMeter(uint16_t* vbat, uint16_t* vsol, int16_t* pbat, int16_t* psol)
+{
+	uint8_t buf[PAC1720_METER_SIZE];
+	if(!I2C_readN(PAC1720_ADDRESS, PAC1720_METER_FIRST_REG, buf, sizeof(buf))) {
+		error |= 0x1;
+		return false; // PAC1720 not available (maybe Vcc too low)
+	}
+
+#define METER_REG(r) (((uint16_t)buf[(r) - PAC1720_METER_FIRST_REG] << 8) | buf[(r) + 1 - PAC1720_METER_FIRST_REG])
+	int32_t fsp = FSV * FSC;
+	int16_t val;
+
+	val = METER_REG(PAC1720_CH2_PWR_RAT_HIGH);
+	*pbat = (buf[PAC1720_CH2_VSENSE_HIGH - PAC1720_METER_FIRST_REG] >> 7 ? -1 : 1) * 10 * (val * fsp / 65535);
+	val = METER_REG(PAC1720_CH1_PWR_RAT_HIGH);
+	*psol = (buf[PAC1720_CH1_VSENSE_HIGH - PAC1720_METER_FIRST_REG] >> 7 ? -1 : 1) * 10 * (val * fsp / 65535);
+	*vbat = (METER_REG(PAC1720_CH2_VSOURCE_HIGH) >> 5) * 20000 / 0x400;
+	*vsol = (METER_REG(PAC1720_CH1_VSOURCE_HIGH) >> 5) * 20000 / 0x400;
+#undef METER_REG
+
+	if(*vbat < 1500)
+		error |= 0x2; // The chip is unreliable
+	return true;
+}
+
+/*
+ * Add the energy of an interval to the counters.
+ */
+static void countEnergy(int16_t pbat, int16_t psol, uint32_t ms)
+{
+	pac1720_esol += (int32_t)psol * (int32_t)ms / 1000;
+	pac1720_ebat += (int32_t)pbat * (int32_t)ms / 1000;
+
+	while(pac1720_esol >= PAC1720_MWH) {
+		BKP_REG(BKP_SOLAR)++;
+		pac1720_esol -= PAC1720_MWH;
+	}
+	if(pac1720_esol < 0)
+		pac1720_esol = 0; // Solar energy is not negative
+	while(pac1720_ebat >= PAC1720_MWH) {
+		BKP_REG(BKP_BAT_IN)++;
+		pac1720_ebat -= PAC1720_MWH;
+	}
+	while(pac1720_ebat <= -PAC1720_MWH) {
+		BKP_REG(BKP_BAT_OUT)++;
+		pac1720_ebat += PAC1720_MWH;
+	}
+}
+
+void pac1720_get_energy(pac1720_energy_t *energy)
+{
+	pac1720_lock();
+	energy->solar = BKP_REG(BKP_SOLAR);
+	energy->bat_in = BKP_REG(BKP_BAT_IN);
+	energy->bat_out = BKP_REG(BKP_BAT_OUT);
+	pac1720_unlock();
+}
+
+void pac1720_reset_energy(void)
+{
+	pac1720_lock();
+	BKP_REG(BKP_MAGIC) = 0;
+	initEnergy();
+	pac1720_esol = 0;
+	pac1720_ebat = 0;
+	pac1720_unlock();
+}
+
 void pac1720_get_avg(uint16_t* vbat, uint16_t* vsol, int16_t* pbat, int16_t* psol) {
 	// Return current value if time interval too short
 	if(!pac1720_counter) {
@@ -153,22 +252,43 @@ THD_FUNCTION(pac1720_thd, arg)
 {
 	(void)arg;
 
+	/*
+	 * Stop mode may delay the reads. The energy is counted over the time
+	 * since the last read.
+	 */
+	allowLateWakeup();
+
+	systime_t time = chVTGetSystemTime();
 	while(true)
 	{
-		// Send config
-		sendConfig();
-
-		// Measure battery power
+		/*
+		 * The PAC1720 averages over its longest sampling time so one read
+		 * per interval is enough. The config is sent again after the chip
+		 * was not available as it may have been without power.
+		 */
+		if(!pac1720_configured)
+			sendConfig();
+
+		uint16_t vbat, vsol;
+		int16_t pbat, psol;
 		pac1720_lock();
-		pac1720_vbat += pac1720_get_vbat();
-		pac1720_vsol += pac1720_get_vsol();
-		pac1720_pbat += pac1720_get_pbat();
-		pac1720_psol += pac1720_get_psol();
-
-		pac1720_counter++;
+		pac1720_configured = readMeter(&vbat, &vsol, &pbat, &psol);
+		if(pac1720_configured) {
+			pac1720_vbat += vbat;
+			pac1720_vsol += vsol;
+			pac1720_pbat += pbat;
+			pac1720_psol += psol;
+			pac1720_counter++;
+			uint32_t ms = TIME_I2MS(chVTTimeElapsedSinceX(time));
+			countEnergy(pbat, psol, ms);
+			eprof_sample((int32_t)psol - pbat, ms);
+		}
+		time = chVTGetSystemTime();
 		pac1720_unlock();
 
-		chThdSleep(TIME_MS2I(200));
+		/* Activities are short so they are sampled faster. */
+		chThdSleep(TIME_MS2I(eprof_busy() ? PAC1720_METER_FAST
+		                                  : PAC1720_METER_INTERVAL));
 	}
 }
 
@@ -178,7 +298,11 @@ void pac1720_init(void)
 
 	// Send config
 	sendConfig();
+	pac1720_configured = true;
+	initEnergy();
 
+	TRACE_INFO("PAC  > Energy solar %d mWh, battery in %d mWh, out %d mWh",
+	           BKP_REG(BKP_SOLAR), BKP_REG(BKP_BAT_IN), BKP_REG(BKP_BAT_OUT));
 	TRACE_INFO("PAC  > Init PAC1720 continuous measurement");
 	chThdCreateFromHeap(NULL, THD_WORKING_AREA_SIZE(512), "PAC1720", LOWPRIO, pac1720_thd, NULL);
 	chThdSleep(TIME_MS2I(10));
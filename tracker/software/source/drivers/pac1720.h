@@ -48,6 +48,25 @@
 #define PAC1720_MANUFACTURER_ID			0xFE
 #define PAC1720_REVISION				0xFF
 
+/*
+ * Energy metering.
+ * The measurement registers are read in one burst each interval and the
+ * power is integrated into mWh counters kept in RTC backup registers.
+ */
+#define PAC1720_METER_INTERVAL			1000	/* ms */
+#define PAC1720_METER_FAST				200		/* ms while an activity is profiled */
+#define PAC1720_METER_FIRST_REG			PAC1720_CH1_VSENSE_HIGH
+#define PAC1720_METER_SIZE				(PAC1720_CH2_PWR_RAT_LOW - PAC1720_CH1_VSENSE_HIGH + 1)
+#define PAC1720_BKP_REG					0		/* First of 4 RTC backup registers used */
+#define PAC1720_BKP_MAGIC				0x50414331
+#define PAC1720_MWH						36000	/* Energy of 1mWh in 0.1mWs */
+
+typedef struct {
+	uint32_t solar;		// Solar energy in mWh
+	uint32_t bat_in;	// Battery energy at positive power in mWh
+	uint32_t bat_out;	// Battery energy at negative power in mWh
+} pac1720_energy_t;
+
 
 int16_t pac1720_get_pbat(void);
 int16_t pac1720_get_psol(void);
@@ -57,6 +76,8 @@ bool pac1720_isAvailable(void);
 void pac1720_get_avg(uint16_t* vbat, uint16_t* vsol, int16_t* pbat, int16_t* psol);
 void pac1720_init(void);
 uint8_t pac1720_hasError(void);
+void pac1720_get_energy(pac1720_energy_t *energy);
+void pac1720_reset_energy(void);
 
 #endif
 
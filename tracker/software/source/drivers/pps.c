@@ -0,0 +1,158 @@
+/**
+  * GPS timepulse (PPS) service.
+  * The rising edge of the u-blox timepulse marks the start of each GPS
+  * second. Pulses are timestamped with the core cycle counter in the line
+  * interrupt. The period between pulses trims the rate of the core clock,
+  * which also drives the system tick, so its temperature drift is measured
+  * continuously. The residual of each period against the filtered rate is
+  * kept for reporting.
+  *
+  * The cycle counter runs at HCLK of the clock profile. Periods are scaled
+  * to SYSCLK so the rate is of SYSCLK in every profile. A period which
+  * spans a profile switch is not measured.
+  *
+  * A GPS fix labels the last pulse with its UNIX second and later pulses
+  * count on. Time is then the last pulse plus the time since it by the
+  * trimmed clock. Without pulses (GPS off) the time is held over from the
+  * system tick at the trimmed rate. A pulse after a gap is labelled from
+  * the held over time.
+  */
+
+#include "ch.h"
+#include "hal.h"
+#include "portab.h"
+#include "pps.h"
+#include "pclock.h"
+#include "debug.h"
+
+static rtcnt_t pps_count;				// Cycle counter at the last pulse
+static uint32_t pps_switches;			// Clock profile switches at the last pulse
+static systime_t pps_tick;				// System time at the last pulse
+static uint64_t pps_rate = (uint64_t)STM32_SYSCLK << PPS_RATE_SHIFT;
+static uint32_t pps_second;
+static bool pps_locked;
+static uint32_t pps_pulses;
+static uint32_t pps_rejected;
+static int32_t pps_residual;			// Cycles
+
+/*
+ * Milliseconds since the last pulse by the trimmed clock.
+ * Must be called with the system locked.
+ */
+static uint32_t pps_elapsed(void) {
+	sysinterval_t elapsed = chVTTimeElapsedSinceX(pps_tick);
+	if(elapsed < PPS_COUNTER_SPAN && pclkGetSwitches() == pps_switches) {
+		/* Same profile as at the pulse, scale the cycles to SYSCLK. */
+		uint64_t cycles = (uint64_t)(chSysGetRealtimeCounterX() - pps_count)
+				* (STM32_SYSCLK / pclkGetHCLK());
+		return (cycles * 1000 << PPS_RATE_SHIFT) / pps_rate;
+	}
+	/* The tick runs from the core clock so the rate trims it as well. */
+	return ((uint64_t)TIME_I2MS(elapsed) * STM32_SYSCLK << PPS_RATE_SHIFT)
+			/ pps_rate;
+}
+
+static void pps_pulse_cb(void *arg) {
+	(void)arg;
+	rtcnt_t now = chSysGetRealtimeCounterX();
+
+	chSysLockFromISR();
+	uint32_t hclk = pclkGetHCLK();
+	bool same_clock = pclkGetSwitches() == pps_switches;
+	rtcnt_t period = now - pps_count;
+	int32_t error = (int32_t)(period - hclk);
+	int32_t tolerance = (int32_t)((uint64_t)hclk * PPS_TOLERANCE_PPM / 1000000);
+	if(pps_pulses != 0 && same_clock
+			&& chVTTimeElapsedSinceX(pps_tick) < TIME_S2I(2)
+			&& error <= tolerance && error >= -tolerance) {
+		/* The next second, trim the clock rate with its period. */
+		uint64_t cycles = (uint64_t)period * (STM32_SYSCLK / hclk);
+		int64_t delta = ((int64_t)cycles << PPS_RATE_SHIFT) - (int64_t)pps_rate;
+		pps_residual = (int32_t)(delta >> PPS_RATE_SHIFT);
+		pps_rate += delta >> PPS_FILTER_SHIFT;
+		pps_second++;
+	} else if(pps_locked && chVTTimeElapsedSinceX(pps_tick) < PPS_HOLDOVER) {
+		/*
+		 * A pulse after a gap or a profile switch is labelled from the
+		 * held over time.
+		 */
+		pps_second += (pps_elapsed() + 500) / 1000;
+		if(same_clock)
+			pps_rejected++;
+	} else {
+		pps_locked = false;
+		if(pps_pulses != 0 && same_clock)
+			pps_rejected++;
+	}
+	pps_count = now;
+	pps_switches = pclkGetSwitches();
+	pps_tick = chVTGetSystemTimeX();
+	pps_pulses++;
+	chSysUnlockFromISR();
+}
+
+/**
+  * Start timestamping the timepulse.
+  */
+void pps_init(void) {
+	palSetLineCallback(LINE_GPS_TIMEPULSE, pps_pulse_cb, NULL);
+	palEnableLineEvent(LINE_GPS_TIMEPULSE, PAL_EVENT_MODE_RISING_EDGE);
+}
+
+/**
+  * Label the last pulse with the UNIX second of a GPS fix.
+  * The fix is the solution of the epoch started by the last pulse so it
+  * must be given within a second of that pulse.
+  */
+void pps_set_second(uint32_t second) {
+	chSysLock();
+	bool recent = pps_pulses != 0
+			&& chVTTimeElapsedSinceX(pps_tick) < TIME_S2I(1);
+	int32_t offset = (int32_t)(second - pps_second);
+	if(recent) {
+		pps_second = second;
+		pps_locked = true;
+	}
+	bool locked = pps_locked;
+	chSysUnlock();
+
+	if(!recent) {
+		TRACE_INFO("PPS  > No timepulse for the fix");
+	} else if(offset != 0 && locked) {
+		TRACE_INFO("PPS  > Pulse label corrected by %d s", offset);
+	}
+}
+
+/**
+  * Get the time in milliseconds since the UNIX epoch.
+  * @return false if no pulse has been labelled or the holdover has passed
+  */
+bool pps_get_time(uint64_t *ms) {
+	bool valid;
+	chSysLock();
+	valid = pps_locked && chVTTimeElapsedSinceX(pps_tick) < PPS_HOLDOVER;
+	if(valid)
+		*ms = (uint64_t)pps_second * 1000 + pps_elapsed();
+	chSysUnlock();
+	return valid;
+}
+
+/**
+  * Get the discipline state for reporting.
+  */
+void pps_get_status(pps_status_t *status) {
+	chSysLock();
+	status->locked = pps_locked;
+	status->pulses = pps_pulses;
+	status->rejected = pps_rejected;
+	status->second = pps_second;
+	status->age = chVTTimeElapsedSinceX(pps_tick);
+	uint64_t rate = pps_rate;
+	int32_t residual = pps_residual;
+	chSysUnlock();
+
+	int64_t drift = (int64_t)(rate >> PPS_RATE_SHIFT) - STM32_SYSCLK;
+	status->drift_ppb = (int32_t)(drift * 1000000000 / STM32_SYSCLK);
+	status->residual_ns = (int32_t)((int64_t)residual * 1000000000
+							/ STM32_SYSCLK);
+}
@@ -0,0 +1,28 @@
+#ifndef __PPS_H__
+#define __PPS_H__
+
+#include "ch.h"
+#include "hal.h"
+
+#define PPS_TOLERANCE_PPM		200				/* Pulse period accepted around the core clock */
+#define PPS_FILTER_SHIFT		3				/* A new period has weight 1/8 in the clock rate */
+#define PPS_RATE_SHIFT			8				/* Fraction bits of the clock rate */
+#define PPS_HOLDOVER			TIME_S2I(3600)	/* Time kept from the clock rate without pulses */
+#define PPS_COUNTER_SPAN		TIME_S2I(30)	/* Time measured with the cycle counter, it wraps after 42s */
+
+typedef struct {
+	bool			locked;			// Pulses are labelled with GPS time
+	uint32_t		pulses;			// Pulses accepted
+	uint32_t		rejected;		// Pulses outside the tolerance
+	uint32_t		second;			// UNIX time of the last pulse
+	sysinterval_t	age;			// Time since the last pulse
+	int32_t			drift_ppb;		// Core clock and system tick error against GPS
+	int32_t			residual_ns;	// Last pulse period against the clock rate
+} pps_status_t;
+
+void pps_init(void);
+void pps_set_second(uint32_t second);
+bool pps_get_time(uint64_t *ms);
+void pps_get_status(pps_status_t *status);
+
+#endif
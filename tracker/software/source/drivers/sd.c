@@ -3,11 +3,23 @@
 #include "ff.h"
 #include "debug.h"
 #include "portab.h"
+#include "sd.h"
+#include "pspi.h"
+#include <string.h>
 //#include "config.h"
 
 MMCDriver MMCD1;
 bool sdInitialized = false;
 
+/*
+ * One volume object is shared by all files.
+ * The volume stays mounted while the card stays connected.
+ * FatFS is not reentrant so each FatFS call is made holding the SPI bus.
+ */
+static FATFS fs;
+static bool sdMounted = false;
+static bool mmcStarted = false;
+
 bool initSD(void)
 {
 
@@ -18,8 +30,13 @@ bool initSD(void)
   if(palReadLine(LINE_SD_DET)) {
       TRACE_INFO("SD   > No SD card inserted");
       sdInitialized = false;
+      sdMounted = false;
       return false;
   }
+
+  /* The card stays connected at high speed until an error or removal. */
+  if(sdInitialized)
+      return true;
   TRACE_INFO("SD   > Access SD card");
 
     /* NOTE: SD_CS line is set in board.h and initialized to HIGH. */
@@ -42,12 +59,23 @@ bool initSD(void)
 	static MMCConfig mmccfg = {SPI_BUS1_DRIVER, &ls_spicfg, &hs_spicfg};
 
 	// Check SD card presence
-	spiAcquireBus(SPI_BUS1_DRIVER);
+	pspiAcquireBulk(SPI_BUS1_DRIVER);
+
+	/* Another thread may have connected while waiting for the bus. */
+	if(sdInitialized) {
+		pspiReleaseBulk(SPI_BUS1_DRIVER);
+		return true;
+	}
 
 	// Init MMC
-	mmcObjectInit(&MMCD1);
-	mmcStart(&MMCD1, &mmccfg);
+	if(!mmcStarted) {
+		mmcObjectInit(&MMCD1);
+		mmcStart(&MMCD1, &mmccfg);
+		mmcStarted = true;
+	}
 
+	/* A new connection has to be mounted again. */
+	sdMounted = false;
 	TRACE_DEBUG("SD   > Connect");
 	if(mmcConnect(&MMCD1)) {
 		TRACE_ERROR("SD   > SD card connection error");
@@ -55,79 +83,298 @@ bool initSD(void)
 		TRACE_INFO("SD   > SD card connection OK");
 		sdInitialized = true;
 	}
-	spiReleaseBus(SPI_BUS1_DRIVER);
+	pspiReleaseBulk(SPI_BUS1_DRIVER);
 
 	return sdInitialized;
 }
 
-bool writeBufferToFile(const char *filename, const uint8_t *buffer, uint32_t len)
+/*
+ * Mount the volume if not mounted.
+ * The SPI bus must be held by the caller.
+ */
+static bool mountSD(void)
 {
-	if(!sdInitialized)
+	if(sdMounted)
+		return true;
+
+	TRACE_INFO("SD   > Mount");
+	FRESULT res = f_mount(&fs, "/", 1);
+	if(res != FR_OK)
+	{
+		TRACE_ERROR("SD   > Mounting failed (err=%d)", res);
 		return false;
+	}
+	sdMounted = true;
+	return true;
+}
 
-	spiAcquireBus(SPI_BUS1_DRIVER);
+/*
+ * Drop the connection after an error.
+ * The card is connected and mounted again at next access.
+ */
+static void resetSD(void)
+{
+	sdMounted = false;
+	sdInitialized = false;
+}
 
-	static FATFS fs;
+/*
+ * Write a buffer to a file in chunks.
+ * Chunks are aligned in the file so whole sectors are written direct
+ * to the card by FatFS. The SPI bus is released between chunks so the
+ * radio does not wait for the whole file. No chunk is started while the
+ * radio is sending (see pspi.c).
+ */
+static bool writeChunkedToFile(const char *filename, const uint8_t *buffer,
+                               uint32_t len, bool append)
+{
 	static FIL fdst;
 	FRESULT res;
 	bool gres = true; // Optimist
 
-	// Mount SD card
-	TRACE_INFO("SD   > Mount");
-	res = f_mount(&fs, "/", 0);
+	if(!initSD())
+		return false;
+
+	pspiAcquireBulk(SPI_BUS1_DRIVER);
+	if(!mountSD())
+	{
+		pspiReleaseBulk(SPI_BUS1_DRIVER);
+		resetSD();
+		return false;
+	}
+
+	// Open file
+	TRACE_INFO("SD   > Open file %s", filename);
+	res = f_open(&fdst, (TCHAR*)filename, append
+	             ? (FA_OPEN_APPEND | FA_WRITE) : (FA_CREATE_ALWAYS | FA_WRITE));
+	pspiReleaseBulk(SPI_BUS1_DRIVER);
 	if(res != FR_OK)
 	{
+		TRACE_ERROR("SD   > Opening file failed (err=%d)", res);
+		resetSD();
+		return false;
+	}
 
-		TRACE_ERROR("SD   > Mounting failed (err=%d)", res);
+	// Write buffer into file
+	TRACE_INFO("SD   > Write buffer to file (len=%d)", len);
+	while(len > 0)
+	{
+		uint32_t n = SD_ARCHIVE_CHUNK - (f_tell(&fdst) % SD_ARCHIVE_CHUNK);
+		if(n > len)
+			n = len;
+		uint32_t len_written;
+		pspiAcquireBulk(SPI_BUS1_DRIVER);
+		res = f_write(&fdst, buffer, n, (UINT*)&len_written);
+		pspiReleaseBulk(SPI_BUS1_DRIVER);
+		if(res != FR_OK || len_written != n)
+		{
+			TRACE_ERROR("SD   > Writing failed (err=%d)", res);
+			gres = false;
+			break;
+		}
+		buffer += n;
+		len -= n;
+	}
+
+	// Close file
+	TRACE_INFO("SD   > Close file");
+	pspiAcquireBulk(SPI_BUS1_DRIVER);
+	res = f_close(&fdst);
+	pspiReleaseBulk(SPI_BUS1_DRIVER);
+	if(res != FR_OK)
+	{
+		TRACE_ERROR("SD   > Closing file failed (err=%d)", res);
 		gres = false;
+	}
 
-	} else {
+	if(!gres)
+		resetSD();
+	return gres;
+}
 
-		// Open file
-		TRACE_INFO("SD   > Open file %s", filename);
-		res = f_open(&fdst, (TCHAR*)filename, FA_CREATE_ALWAYS | FA_WRITE);
-		if(res != FR_OK)
-		{
+/*
+ * Asynchronous archive.
+ * Requests are queued to a writer thread so callers are not held for the
+ * duration of the write. The writer thread is the only writer of files.
+ */
+typedef struct {
+	char				filename[SD_ARCHIVE_NAME_LEN];
+	const uint8_t		*data;
+	uint32_t			len;
+	bool				append;
+	bool				copied;		// Data is a heap copy freed after the write
+	binary_semaphore_t	*done;
+} sd_archive_req_t;
+
+static objects_fifo_t archive_fifo;
+static sd_archive_req_t archive_reqs[SD_ARCHIVE_QUEUE_SIZE];
+static msg_t archive_msgs[SD_ARCHIVE_QUEUE_SIZE];
+static bool archiveStarted = false;
+
+static THD_FUNCTION(sdArchiveThread, arg)
+{
+	(void)arg;
 
-			TRACE_ERROR("SD   > Opening file failed (err=%d)", res);
-			gres = false;
+	while(true)
+	{
+		sd_archive_req_t *req;
+		chFifoReceiveObjectTimeout(&archive_fifo, (void **)&req, TIME_INFINITE);
 
-		} else {
+		if(!writeChunkedToFile(req->filename, req->data, req->len, req->append))
+			TRACE_WARN("SD   > Archive of %s failed", req->filename);
 
-			// Write buffer into file
-			TRACE_INFO("SD   > Write buffer to file (len=%d)", len);
-			uint32_t len_written;
-			f_write(&fdst, buffer, len, (UINT*)&len_written);
-			if(len_written != len)
-			{
-				TRACE_ERROR("SD   > Writing failed (err=%d)", res);
-				gres = false;
-			}
-
-			// Close file
-			TRACE_INFO("SD   > Close file");
-			res = f_close(&fdst);
-			if(res != FR_OK)
-			{
-				TRACE_ERROR("SD   > Closing file failed (err=%d)", res);
-				gres = false;
-			}
+		if(req->copied)
+			chHeapFree((void *)req->data);
+		if(req->done != NULL)
+			chBSemSignal(req->done);
+		chFifoReturnObject(&archive_fifo, req);
+	}
+}
 
-		}
+void sdArchiveStart(void)
+{
+	if(archiveStarted)
+		return;
+
+	chFifoObjectInit(&archive_fifo, sizeof(sd_archive_req_t),
+	                 SD_ARCHIVE_QUEUE_SIZE, sizeof(uint32_t),
+	                 archive_reqs, archive_msgs);
+	thread_t *th = chThdCreateFromHeap(NULL, THD_WORKING_AREA_SIZE(2*1024),
+	                                   "SDA", LOWPRIO, sdArchiveThread, NULL);
+	if(!th)
+	{
+		TRACE_ERROR("SD   > Could not start archive thread (not enough memory available)");
+		return;
+	}
+	archiveStarted = true;
+}
+
+/*
+ * Queue a request to the writer thread.
+ * Returns false if there is no card or the queue is full.
+ */
+static bool queueArchive(const char *filename, const uint8_t *data,
+                         uint32_t len, bool append, bool copied,
+                         binary_semaphore_t *done)
+{
+	if(!archiveStarted || palReadLine(LINE_SD_DET))
+		return false;
+
+	sd_archive_req_t *req = chFifoTakeObjectTimeout(&archive_fifo,
+	                                                TIME_IMMEDIATE);
+	if(req == NULL)
+	{
+		TRACE_WARN("SD   > Archive queue full, %s not saved", filename);
+		return false;
+	}
+	strncpy(req->filename, filename, sizeof(req->filename) - 1);
+	req->filename[sizeof(req->filename) - 1] = '\0';
+	req->data = data;
+	req->len = len;
+	req->append = append;
+	req->copied = copied;
+	req->done = done;
+	chFifoSendObject(&archive_fifo, req);
+	return true;
+}
+
+/*
+ * Archive a buffer to a new file.
+ * The buffer is written in place so must be kept until done is signalled.
+ * done is signalled only if the request was queued.
+ */
+bool sdArchiveFile(const char *filename, const uint8_t *buffer, uint32_t len,
+                   binary_semaphore_t *done)
+{
+	return queueArchive(filename, buffer, len, false, false, done);
+}
+
+/*
+ * Append a record to a file.
+ * The record is copied so the caller does not wait for the write.
+ */
+bool sdArchiveRecord(const char *filename, const void *record, uint32_t len)
+{
+	if(!archiveStarted || palReadLine(LINE_SD_DET))
+		return false;
+
+	uint8_t *copy = chHeapAlloc(NULL, len);
+	if(copy == NULL)
+		return false;
+	memcpy(copy, record, len);
+	if(!queueArchive(filename, copy, len, true, true, NULL))
+	{
+		chHeapFree(copy);
+		return false;
+	}
+	return true;
+}
 
-		// Unmount
-		TRACE_INFO("SD   > Unmount");
-		res = f_mount(0, "", 0);
+/*
+ * File opened for reading in parts.
+ * Only one read file may be open at a time.
+ * The file is read from the shared volume.
+ */
+static FIL rsrc;
+static bool readOpen = false;
+
+bool openFileForRead(const char *filename)
+{
+	if(!initSD() || readOpen)
+		return false;
+
+	pspiAcquireBulk(SPI_BUS1_DRIVER);
+
+	// Mount SD card
+	if(mountSD())
+	{
+		// Open file
+		TRACE_INFO("SD   > Open file %s for read", filename);
+		FRESULT res = f_open(&rsrc, (TCHAR*)filename, FA_OPEN_EXISTING | FA_READ);
 		if(res != FR_OK)
 		{
-			TRACE_ERROR("SD   > Unmounting failed (err=%d)", res);
-			gres = false;
+			TRACE_ERROR("SD   > Opening file failed (err=%d)", res);
+		} else {
+			readOpen = true;
 		}
 	}
 
-	spiReleaseBus(SPI_BUS1_DRIVER);
+	pspiReleaseBulk(SPI_BUS1_DRIVER);
 
-	return gres;
+	return readOpen;
+}
+
+/*
+ * Returns the number of bytes read (0 at end of file) or -1 on error.
+ * The SPI bus is only held for the read so the radio can share it.
+ */
+int32_t readFromFile(uint8_t *buffer, uint32_t len)
+{
+	if(!readOpen)
+		return -1;
+
+	pspiAcquireBulk(SPI_BUS1_DRIVER);
+	uint32_t len_read;
+	FRESULT res = f_read(&rsrc, buffer, len, (UINT*)&len_read);
+	pspiReleaseBulk(SPI_BUS1_DRIVER);
+
+	if(res != FR_OK)
+	{
+		TRACE_ERROR("SD   > Reading failed (err=%d)", res);
+		return -1;
+	}
+	return len_read;
+}
+
+void closeReadFile(void)
+{
+	if(!readOpen)
+		return;
+
+	pspiAcquireBulk(SPI_BUS1_DRIVER);
+	f_close(&rsrc);
+	pspiReleaseBulk(SPI_BUS1_DRIVER);
+	readOpen = false;
 }
 
 #if HAL_USE_SDC || defined(__DOXYGEN__)
@@ -4,10 +4,25 @@
 #include "ch.h"
 #include "hal.h"
 
+/* Archive requests which can be queued to the writer thread. */
+#define SD_ARCHIVE_QUEUE_SIZE	4
+/* File aligned write size. A multiple of the sector size. */
+#define SD_ARCHIVE_CHUNK		4096
+/* Enough for an 8.3 file name. */
+#define SD_ARCHIVE_NAME_LEN		16
+/* File which log records are appended to. */
+#define SD_ARCHIVE_LOG_FILE		"log.bin"
+
 extern MMCDriver MMCD1;
 
 bool initSD(void);
-bool writeBufferToFile(const char *filename, const uint8_t *buffer, uint32_t len);
+void sdArchiveStart(void);
+bool sdArchiveFile(const char *filename, const uint8_t *buffer, uint32_t len,
+                   binary_semaphore_t *done);
+bool sdArchiveRecord(const char *filename, const void *record, uint32_t len);
+bool openFileForRead(const char *filename);
+int32_t readFromFile(uint8_t *buffer, uint32_t len);
+void closeReadFile(void);
 
 #endif
 
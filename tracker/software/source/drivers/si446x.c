@@ -9,12 +9,35 @@
 #include "radio.h"
 #include "geofence.h"
 #include "si4463_patch.h"
+#include "stats.h"
+#include "txlatency.h"
+#include "pspi.h"
+#include "eprof.h"
+#include "rfcapture.h"
 
 
 /*===========================================================================*/
 /* Module local variables.                                                   */
 /*===========================================================================*/
 
+/*
+ * AFSK up-sampler symbol table.
+ * Sample pattern of one symbol for each tone and starting phase bucket.
+ */
+static uint16_t Si446x_afskSymbol[2][SI446X_AFSK_PHASE_BUCKETS];
+static bool Si446x_afskSymbolReady = false;
+
+/* Highest TX FIFO free level per frame. Near the FIFO size is an underrun. */
+static STATS_DECL(si_stats_afsk_fifo, "si afsk tx fifo free");
+static STATS_DECL(si_stats_2fsk_fifo, "si 2fsk tx fifo free");
+
+#if SI446X_USE_TX_TEST == TRUE
+/* TX test record and the frame being sent (NULL when not recorded). */
+static si446x_tx_test_t si_tx_test;
+static si446x_tx_test_frame_t *si_tx_frame;
+static rtcnt_t si_tx_last_end;
+#endif
+
 /*===========================================================================*/
 /* Module constants.                                                         */
 /*===========================================================================*/
@@ -40,6 +63,97 @@ static SPIConfig ls_spicfg = {
     .cr1    = SPI_CR1_MSTR
 };
 
+/*
+ * SPI transfers use DMA which cannot reach CCM.
+ * Buffers and the stack of the calling thread must be in SRAM.
+ */
+#define Si446x_assertDMA(p) chDbgAssert(!pktIsCCM(p), "SPI buffer in CCM")
+
+/*
+ * TX test recording.
+ * The feeders call these for every frame. They only record while a test
+ * is active and the record has room.
+ */
+#if SI446X_USE_TX_TEST == TRUE
+#define Si446x_txTestNow()  chSysGetRealtimeCounterX()
+
+/*
+ * Start the record of a frame before the FIFO is first loaded.
+ */
+static void Si446x_txTestBegin(uint16_t bytes, uint32_t air_us) {
+  si_tx_frame = NULL;
+  if(!si_tx_test.active || si_tx_test.count >= SI446X_TX_TEST_FRAMES)
+    return;
+  si446x_tx_test_frame_t *f = &si_tx_test.frame[si_tx_test.count];
+  memset(f, 0, sizeof(*f));
+  f->bytes = bytes;
+  f->air_us = air_us;
+  f->free_min = UINT8_MAX;
+  f->result = MSG_RESET;
+  si_tx_frame = f;
+  si_tx_test.count++;
+}
+
+/*
+ * TX has started. The gap is from the end of the previous test frame.
+ */
+static void Si446x_txTestStart(void) {
+  if(si_tx_frame == NULL)
+    return;
+  si_tx_frame->start = chSysGetRealtimeCounterX();
+  if(si_tx_test.count > 1)
+    si_tx_frame->gap = si_tx_frame->start - si_tx_last_end;
+}
+
+static void Si446x_txTestSPI(rtcnt_t start) {
+  if(si_tx_frame != NULL)
+    si_tx_frame->spi += chSysGetRealtimeCounterX() - start;
+}
+
+static void Si446x_txTestLevel(uint8_t free) {
+  if(si_tx_frame == NULL)
+    return;
+  if(free < si_tx_frame->free_min)
+    si_tx_frame->free_min = free;
+  if(free > si_tx_frame->free_max)
+    si_tx_frame->free_max = free;
+}
+
+/*
+ * A FIFO refill is done. The wake is when the feeder started the refill.
+ */
+static void Si446x_txTestRefill(rtcnt_t wake) {
+  if(si_tx_frame == NULL)
+    return;
+  uint32_t t = chSysGetRealtimeCounterX() - wake;
+  si_tx_frame->refills++;
+  si_tx_frame->refill_total += t;
+  if(t > si_tx_frame->refill_peak)
+    si_tx_frame->refill_peak = t;
+}
+
+/*
+ * The frame has left the radio or the send failed.
+ */
+static void Si446x_txTestEnd(msg_t result) {
+  if(si_tx_frame == NULL)
+    return;
+  si_tx_frame->end = chSysGetRealtimeCounterX();
+  si_tx_frame->result = result;
+  si_tx_last_end = si_tx_frame->end;
+  si_tx_frame = NULL;
+  si_tx_test.done++;
+}
+#else
+#define Si446x_txTestNow()              0
+#define Si446x_txTestBegin(bytes, air)  (void)(air)
+#define Si446x_txTestStart()
+#define Si446x_txTestSPI(start)         (void)(start)
+#define Si446x_txTestLevel(free)        (void)(free)
+#define Si446x_txTestRefill(wake)       (void)(wake)
+#define Si446x_txTestEnd(result)
+#endif
+
 /**
  * Get pointer to the radio specific configuration.
  */
@@ -68,6 +182,69 @@ static SPIDriver *Si446x_spiSetupBus(const radio_unit_t radio,
   return spip;
 }
 
+/*
+ * State of a CTS wait.
+ */
+typedef struct {
+  rtcnt_t   start;
+  uint8_t   sleeps;
+} si446x_cts_wait_t;
+
+static void Si446x_startCTSWait(si446x_cts_wait_t *wait) {
+  wait->start = chSysGetRealtimeCounterX();
+  wait->sleeps = 0;
+}
+
+static bool Si446x_isCTSSpin(const si446x_cts_wait_t *wait) {
+  return chSysIsCounterWithinX(chSysGetRealtimeCounterX(), wait->start,
+                               wait->start + US2RTC(STM32_HCLK,
+                                                    SI446X_CTS_SPIN_US));
+}
+
+/*
+ * Called after a CTS poll found the radio busy.
+ * Polls are repeated at once for SI446X_CTS_SPIN_US and then at 1 ms.
+ * Returns false when SI446X_CTS_TIMEOUT_MS has passed.
+ */
+static bool Si446x_continueCTSWait(si446x_cts_wait_t *wait) {
+  if(Si446x_isCTSSpin(wait))
+    return true;
+  if(wait->sleeps++ >= SI446X_CTS_TIMEOUT_MS)
+    return false;
+  chThdSleep(TIME_MS2I(1));
+  return true;
+}
+
+static void Si446x_ctsLineI(thread_t *tp) {
+  chSysLockFromISR();
+  chEvtSignalI(tp, SI446X_EVT_CTS);
+  chSysUnlockFromISR();
+}
+
+/*
+ * Wait for CTS on radio GPIO1 (start up only, GPIO1 is RX data after init).
+ * Fast commands are caught by the spin. Longer ones wake on the CTS edge.
+ */
+static bool Si446x_waitCTSLine(const radio_unit_t radio) {
+  ioline_t cts = Si446x_getConfig(radio)->gpio1;
+  si446x_cts_wait_t wait;
+  Si446x_startCTSWait(&wait);
+  do {
+    if(palReadLine(cts) == PAL_HIGH)
+      return true;
+  } while(Si446x_isCTSSpin(&wait));
+
+  (void)chEvtGetAndClearEvents(SI446X_EVT_CTS);
+  palSetLineCallback(cts, (palcallback_t)Si446x_ctsLineI, chThdGetSelfX());
+  palEnableLineEvent(cts, PAL_EVENT_MODE_RISING_EDGE);
+  /* The edge may have been before the event was enabled. */
+  if(palReadLine(cts) != PAL_HIGH)
+    (void)chEvtWaitAnyTimeout(SI446X_EVT_CTS,
+                              TIME_MS2I(SI446X_CTS_TIMEOUT_MS));
+  palDisableLineEvent(cts);
+  return palReadLine(cts) == PAL_HIGH;
+}
+
 /**
  * SPI write which uses CTS presented on radio GPIO1.
  * Used when starting the radio up from shutdown state.
@@ -76,20 +253,14 @@ static SPIDriver *Si446x_spiSetupBus(const radio_unit_t radio,
 static bool Si446x_writeBoot(const radio_unit_t radio,
                              const uint8_t* txData, uint32_t len) {
   /* Write data via SPI with CTS checked via GPIO1. */
+  Si446x_assertDMA(txData);
 
   /* Acquire bus and then start SPI. */
   SPIDriver *spip = Si446x_spiSetupBus(radio, &ls_spicfg);
   spiStart(spip, &ls_spicfg);
 
-  /* Poll for CTS with timeout of 100mS. */
-  ioline_t cts = Si446x_getConfig(radio)->gpio1;
-  uint8_t timeout = 100;
-  do {
-    if(timeout != 100)
-      chThdSleep(TIME_MS2I(1));
-  } while(palReadLine(cts) != PAL_HIGH && timeout--);
-
-  if(!timeout) {
+  /* Wait for CTS. */
+  if(!Si446x_waitCTSLine(radio)) {
     TRACE_ERROR("SI   > CTS not received");
     /* Stop SPI and relinquish bus. */
     spiStop(spip);
@@ -116,23 +287,25 @@ static bool Si446x_write(const radio_unit_t radio,
 		const uint8_t* txData, uint32_t len) {
     /* Transmit data by SPI with CTS polling by command. */
     uint8_t null_spi[len];
+    Si446x_assertDMA(txData);
+    Si446x_assertDMA(null_spi);
 
     /* Acquire bus, get SPI Driver object and then start SPI. */
     SPIDriver *spip = Si446x_spiSetupBus(radio, &ls_spicfg);
     spiStart(spip, &ls_spicfg);
 
-    /* Poll for CTS with timeout of 100mS. */
-    uint8_t timeout = 100;
+    /* Poll for CTS. */
+    si446x_cts_wait_t wait;
+    Si446x_startCTSWait(&wait);
     uint8_t rx_ready[] = {Si446x_READ_CMD_BUFF, 0x00};
     do {
       spiSelect(spip);
       spiExchange(spip, 1, rx_ready, &rx_ready[1]);
       spiUnselect(spip);
-      if(timeout != 100)
-        chThdSleep(TIME_MS2I(1));
-    } while(rx_ready[1] != Si446x_COMMAND_CTS && timeout--);
+    } while(rx_ready[1] != Si446x_COMMAND_CTS
+        && Si446x_continueCTSWait(&wait));
 
-    if(!timeout) {
+    if(rx_ready[1] != Si446x_COMMAND_CTS) {
       TRACE_ERROR("SI   > CTS not received");
       /* Stop SPI and relinquish bus. */
       spiStop(spip);
@@ -160,18 +333,14 @@ static bool Si446x_write(const radio_unit_t radio,
 static bool Si446x_readBoot(const radio_unit_t radio,
 						const uint8_t* txData, uint32_t txlen,
                         uint8_t* rxData, uint32_t rxlen) {
+    Si446x_assertDMA(txData);
+    Si446x_assertDMA(rxData);
 
     /* Acquire bus and get SPI Driver object. */
     SPIDriver *spip = Si446x_spiSetupBus(radio, &ls_spicfg);
 
-    /* Poll for CTS with timeout of 100mS. */
-    ioline_t cts = Si446x_getConfig(radio)->gpio1;
-    uint8_t timeout = 100;
-    while(palReadLine(cts) != PAL_HIGH && timeout--) {
-        chThdSleep(TIME_MS2I(1));
-    }
-
-    if(!timeout) {
+    /* Wait for CTS. */
+    if(!Si446x_waitCTSLine(radio)) {
       /* Relinquish bus. */
       spiReleaseBus(spip);
       TRACE_ERROR("SI   > CTS not received");
@@ -186,13 +355,8 @@ static bool Si446x_readBoot(const radio_unit_t radio,
     spiSend(spip, txlen, txData);
     spiUnselect(spip);
 
-    /* Poll for CTS from command. */
-    timeout = 100;
-    while(palReadLine(cts) != PAL_HIGH && timeout--) {
-        chThdSleep(TIME_MS2I(1));
-    }
-
-    if(!timeout) {
+    /* Wait for CTS from command. */
+    if(!Si446x_waitCTSLine(radio)) {
       /* Stop SPI and relinquish bus. */
       spiStop(spip);
       spiReleaseBus(spip);
@@ -219,6 +383,8 @@ static bool Si446x_readBoot(const radio_unit_t radio,
 static bool Si446x_read(const radio_unit_t radio,
 		                const uint8_t* txData, uint32_t txlen,
                         uint8_t* rxData, uint32_t rxlen) {
+    Si446x_assertDMA(txData);
+    Si446x_assertDMA(rxData);
 
     /* Acquire bus and then start SPI. */
     SPIDriver *spip = Si446x_spiSetupBus(radio, &ls_spicfg);
@@ -228,20 +394,18 @@ static bool Si446x_read(const radio_unit_t radio,
      * Poll command buffer waiting for CTS from the READ_CMD_BUFF command.
      * This command does not itself cause CTS to report busy.
      * Allocate a buffer to use for CTS check.
-     * Timeout after 100mS waiting for CTS.
      */
-    uint8_t timeout = 100;
+    si446x_cts_wait_t wait;
+    Si446x_startCTSWait(&wait);
     uint8_t rx_ready[] = {Si446x_READ_CMD_BUFF, 0x00};
     do {
-      if(timeout != 100)
-        chThdSleep(TIME_MS2I(1));
       spiSelect(spip);
       spiExchange(spip, 1, rx_ready, &rx_ready[1]);
       spiUnselect(spip);
+    } while(rx_ready[1] != Si446x_COMMAND_CTS
+        && Si446x_continueCTSWait(&wait));
 
-    } while(rx_ready[1] != Si446x_COMMAND_CTS && timeout--);
-
-    if(!timeout) {
+    if(rx_ready[1] != Si446x_COMMAND_CTS) {
       TRACE_ERROR("SI   > CTS not received");
       /* Stop SPI and relinquish bus. */
       spiStop(spip);
@@ -259,58 +423,89 @@ static bool Si446x_read(const radio_unit_t radio,
      * Poll waiting for CTS again using the READ_CMD_BUFF command.
      * Once CTS is received the response data is ready in the rx data buffer.
      * The buffer contains the command, CTS and 0 - 16 bytes of response.
-     * Timeout after 100mS waiting for CTS.
      */
-    timeout = 100;
+    Si446x_startCTSWait(&wait);
     do {
-      if(timeout != 100)
-        chThdSleep(TIME_MS2I(1));
       spiSelect(spip);
       spiExchange(spip, rxlen, rx_ready, rxData);
       spiUnselect(spip);
-    } while(rxData[1] != Si446x_COMMAND_CTS && timeout--);
+    } while(rxData[1] != Si446x_COMMAND_CTS
+        && Si446x_continueCTSWait(&wait));
 
     /* Stop SPI and relinquish bus. */
     spiStop(spip);
     spiReleaseBus(spip);
     
-   if(!timeout) {
+   if(rxData[1] != Si446x_COMMAND_CTS) {
       TRACE_ERROR("SI   > CTS not received");
       return false;
     }
     return true;
 }
 
-/* TODO: Make set property a single func with size parameter. */
+/**
+ * Set a run of consecutive properties within a group.
+ * The run is sent in SET_PROPERTY commands of up to 12 properties each.
+ */
+static void Si446x_setProperties(const radio_unit_t radio, uint16_t reg,
+                                 const uint8_t *val, uint8_t num) {
+    while(num > 0) {
+      uint8_t n = (num > Si446x_MAX_SET_PROPERTIES)
+          ? Si446x_MAX_SET_PROPERTIES : num;
+      uint8_t msg[4 + Si446x_MAX_SET_PROPERTIES];
+      msg[0] = Si446x_SET_PROPERTY;
+      msg[1] = (reg >> 8) & 0xFF;
+      msg[2] = n;
+      msg[3] = reg & 0xFF;
+      memcpy(&msg[4], val, n);
+      Si446x_write(radio, msg, 4 + n);
+      reg += n;
+      val += n;
+      num -= n;
+    }
+}
+
 static void Si446x_setProperty8(const radio_unit_t radio,
 		uint16_t reg, uint8_t val) {
-    uint8_t msg[] = {Si446x_SET_PROPERTY,
-                     (reg >> 8) & 0xFF, 0x01, reg & 0xFF, val};
-    Si446x_write(radio, msg, sizeof(msg));
+    Si446x_setProperties(radio, reg, &val, 1);
 }
 
 static void Si446x_setProperty16(const radio_unit_t radio,
 		uint16_t reg, uint8_t val1, uint8_t val2) {
-    uint8_t msg[] = {Si446x_SET_PROPERTY,
-                     (reg >> 8) & 0xFF, 0x02, reg & 0xFF, val1, val2};
-    Si446x_write(radio, msg, sizeof(msg));
+    const uint8_t val[] = {val1, val2};
+    Si446x_setProperties(radio, reg, val, sizeof(val));
 }
 
 static void Si446x_setProperty24(const radio_unit_t radio,
 		                         uint16_t reg, uint8_t val1,
                                  uint8_t val2, uint8_t val3) {
-    uint8_t msg[] = {Si446x_SET_PROPERTY,
-                     (reg >> 8) & 0xFF, 0x03, reg & 0xFF, val1, val2, val3};
-    Si446x_write(radio, msg, sizeof(msg));
+    const uint8_t val[] = {val1, val2, val3};
+    Si446x_setProperties(radio, reg, val, sizeof(val));
 }
 
 static void Si446x_setProperty32(const radio_unit_t radio,
 		                         uint16_t reg, uint8_t val1,
                                  uint8_t val2, uint8_t val3, uint8_t val4) {
-    uint8_t msg[] = {Si446x_SET_PROPERTY,
-                     (reg >> 8) & 0xFF, 0x04, reg & 0xFF,
-                     val1, val2, val3, val4};
-    Si446x_write(radio, msg, sizeof(msg));
+    const uint8_t val[] = {val1, val2, val3, val4};
+    Si446x_setProperties(radio, reg, val, sizeof(val));
+}
+
+/**
+ * Clear the shadow of radio configuration.
+ * Called when the radio is initialized so all settings are written again.
+ */
+static void Si446x_clearShadow(const radio_unit_t radio) {
+  si446x_data_t *dat = Si446x_getData(radio);
+  dat->band_freq = 0;
+  dat->band_step = 0;
+  dat->outdiv = 0;
+  dat->deviation = 0;
+  dat->tx_modem = SI446X_MODEM_NONE;
+  dat->tx_speed = 0;
+  dat->rx_modem = SI446X_MODEM_NONE;
+  dat->rx_speed = 0;
+  dat->mod_type = SI446X_MODEM_NONE;
+  dat->power_set = false;
 }
 
 /**
@@ -334,6 +529,9 @@ static bool Si446x_init(const radio_unit_t radio) {
 
   packet_svc_t *handler = pktGetServiceObject(radio);
 
+  /* Radio settings are reset so the shadow is no longer valid. */
+  Si446x_clearShadow(radio);
+
   /*
    * Set MCU GPIO for radio GPIO1 (CTS).
    * Execute radio startup sequence.
@@ -484,12 +682,14 @@ static bool Si446x_init(const radio_unit_t radio) {
   /* PA ramp timing and modulation delay. */
   Si446x_setProperty8(radio, Si446x_PA_TC, 0x3D);
 
-  /* Synthesizer PLL settings. */
-  Si446x_setProperty8(radio, Si446x_FREQ_CONTROL_INTE, 0x41);
-  Si446x_setProperty24(radio, Si446x_FREQ_CONTROL_FRAC, 0x0B, 0xB1, 0x3B);
-  Si446x_setProperty16(radio, Si446x_FREQ_CONTROL_CHANNEL_STEP_SIZE, 0x0B, 0xD1);
-  Si446x_setProperty8(radio, Si446x_FREQ_CONTROL_W_SIZE, 0x20);
-  Si446x_setProperty8(radio, Si446x_FREQ_CONTROL_VCOCNT_RX_ADJ, 0xFA);
+  /*
+   * Synthesizer PLL settings.
+   * INTE, FRAC (3), CHANNEL_STEP_SIZE (2), W_SIZE and VCOCNT_RX_ADJ.
+   */
+  const uint8_t freq_control[] = {0x41, 0x0B, 0xB1, 0x3B, 0x0B, 0xD1,
+                                  0x20, 0xFA};
+  Si446x_setProperties(radio, Si446x_FREQ_CONTROL_INTE, freq_control,
+                       sizeof(freq_control));
 
   /* Antenna settings. */
   Si446x_setProperty8(radio, Si446x_MODEM_ANT_DIV_MODE, 0x01);
@@ -529,8 +729,101 @@ bool Si446x_conditional_init(const radio_unit_t radio) {
   return true;
 }
 
+/**
+ * Set the TX deviation in Hz.
+ * The band must have been set so the output divider is known.
+ */
+static void Si446x_setDeviation(const radio_unit_t radio,
+                                const uint16_t deviation) {
+  si446x_data_t *dat = Si446x_getData(radio);
+  if(dat->deviation == deviation || dat->outdiv == 0)
+    return;
+  uint32_t x = ((((uint32_t)1 << 19) * dat->outdiv * (float)deviation)
+      / (2 * Si446x_CCLK)) * 2;
+  Si446x_setProperty24(radio, Si446x_MODEM_FREQ_DEV, (x >> 16) & 0xFF,
+                       (x >> 8) & 0xFF, x & 0xFF);
+  dat->deviation = deviation;
+}
+
+/*
+ * Get the oscillator correction in ppb for the last chip temperature.
+ * The drift table is interpolated and rounded to the plan cache resolution.
+ */
+static int32_t Si446x_getClockCorrection(const radio_unit_t radio) {
+  static const int16_t drift[] = Si446x_CLK_TEMP_PPB;
+  const int32_t size = sizeof(drift) / sizeof(drift[0]);
+  const int32_t span = Si446x_CLK_TEMP_STEP * 100;
+
+  /* Chip temperature is in 1/100 degree C. */
+  int32_t t = Si446x_getData(radio)->lastTemp - (Si446x_CLK_TEMP_BASE * 100);
+  int32_t ppb;
+  if(t <= 0) {
+    ppb = drift[0];
+  } else if(t >= (size - 1) * span) {
+    ppb = drift[size - 1];
+  } else {
+    int32_t i = t / span;
+    ppb = drift[i] + ((int32_t)(drift[i + 1] - drift[i]) * (t % span)) / span;
+  }
+  int32_t half = (ppb < 0) ? -(SI446X_FREQ_PLAN_PPB_STEP / 2)
+                           : (SI446X_FREQ_PLAN_PPB_STEP / 2);
+  return ((ppb + half) / SI446X_FREQ_PLAN_PPB_STEP) * SI446X_FREQ_PLAN_PPB_STEP;
+}
+
+/*
+ * Get the synthesizer settings for a frequency, step and correction.
+ * Plans are cached so channel changes do not recompute them.
+ */
+static const si446x_freq_plan_t *Si446x_getFrequencyPlan(
+                                              const radio_unit_t radio,
+                                              const radio_freq_t freq,
+                                              const channel_hz_t step,
+                                              const int32_t ppb) {
+  si446x_data_t *dat = Si446x_getData(radio);
+  si446x_freq_plan_t *plan;
+  uint8_t i;
+  for(i = 0; i < SI446X_FREQ_PLAN_CACHE_SIZE; i++) {
+    plan = &dat->plan[i];
+    if(plan->valid && plan->freq == freq && plan->step == step
+        && plan->ppb == ppb) {
+      dat->plan_hits++;
+      return plan;
+    }
+  }
+  dat->plan_misses++;
+  plan = &dat->plan[dat->plan_next];
+  dat->plan_next = (dat->plan_next + 1) % SI446X_FREQ_PLAN_CACHE_SIZE;
+
+  /* Set the output divider as recommended in Si446x data sheet. */
+  uint32_t outdiv = 0;
+  uint32_t band = 0;
+  if(freq < 705000000UL) {outdiv = 6;  band = 1;}
+  if(freq < 525000000UL) {outdiv = 8;  band = 2;}
+  if(freq < 353000000UL) {outdiv = 12; band = 3;}
+  if(freq < 239000000UL) {outdiv = 16; band = 4;}
+  if(freq < 177000000UL) {outdiv = 24; band = 5;}
+
+  /* Oscillator frequency corrected for temperature drift. */
+  uint64_t cclk = (uint64_t)((int64_t)Si446x_CCLK
+      + ((int64_t)Si446x_CLK * ppb) / 1000000000);
+
+  /* PLL ratio in 19 bit fixed point. FC_FRAC holds 1 + fraction. */
+  uint64_t ratio = (((uint64_t)freq * outdiv) << 19) / (2 * cclk);
+  plan->fc_inte = (uint8_t)((ratio >> 19) - 1);
+  plan->fc_frac = (uint32_t)(ratio - ((uint64_t)plan->fc_inte << 19));
+  plan->fc_step = (uint16_t)((((uint64_t)step * outdiv) << 19) / (2 * cclk));
+  plan->band = band;
+  plan->outdiv = outdiv;
+  plan->freq = freq;
+  plan->step = step;
+  plan->ppb = ppb;
+  plan->valid = true;
+  return plan;
+}
+
 /*
  * Set radio NCO registers for frequency.
+ * The oscillator is corrected for drift by the last chip temperature.
  * This function also collects the chip temperature data at the moment.
  * TODO: Move temperature reading to???
  */
@@ -542,55 +835,47 @@ bool Si446x_setBandParameters(const radio_unit_t radio,
   if(freq < 144000000UL || freq > 900000000UL)
     return false;
 
+  /* Skip writing the radio if band, step and correction are unchanged. */
+  si446x_data_t *dat = Si446x_getData(radio);
+  int32_t ppb = Si446x_getClockCorrection(radio);
+  if(dat->band_freq == freq && dat->band_step == step
+      && dat->band_ppb == ppb) {
+    /* Measure the chip temperature and update saved value. */
+    Si446x_getTemperature(radio);
+    return true;
+  }
 
-  /* Set the output divider as recommended in Si446x data sheet. */
-  uint32_t outdiv = 0;
-  uint32_t band = 0;
-  if(freq < 705000000UL) {outdiv = 6;  band = 1;}
-  if(freq < 525000000UL) {outdiv = 8;  band = 2;}
-  if(freq < 353000000UL) {outdiv = 12; band = 3;}
-  if(freq < 239000000UL) {outdiv = 16; band = 4;}
-  if(freq < 177000000UL) {outdiv = 24; band = 5;}
-
-  /*
-   * Initialize radio.
-   */
-  //Si446x_conditional_init(radio);
+  const si446x_freq_plan_t *plan = Si446x_getFrequencyPlan(radio, freq,
+                                                           step, ppb);
 
   /* Set the band parameter. */
   uint32_t sy_sel = 8;
   uint8_t set_band_property_command[] = {Si446x_SET_PROPERTY,
-                                         0x20, 0x01, 0x51, (band + sy_sel)};
+                                         0x20, 0x01, 0x51,
+                                         (plan->band + sy_sel)};
   Si446x_write(radio, set_band_property_command,
 		  sizeof(set_band_property_command));
 
   /* Set the PLL parameters. */
-  uint32_t f_pfd = 2 * Si446x_CCLK / outdiv;
-  uint32_t n = ((uint32_t)(freq / f_pfd)) - 1;
-  float ratio = (float)freq / (float)f_pfd;
-  float rest  = ratio - (float)n;
-
-  uint32_t m = (uint32_t)(rest * 524288UL);
-  uint32_t m2 = m >> 16;
-  uint32_t m1 = (m - m2 * 0x10000) >> 8;
-  uint32_t m0 = (m - m2 * 0x10000 - (m1 << 8));
-
-  uint32_t channel_increment = 524288 * outdiv * step / (2 * Si446x_CCLK);
-  uint8_t c1 = channel_increment / 0x100;
-  uint8_t c0 = channel_increment - (0x100 * c1);
-
   uint8_t set_frequency_property_command[] = {Si446x_SET_PROPERTY,
-                                              0x40, 0x04, 0x00, n,
-                                              m2, m1, m0, c1, c0};
+                                              0x40, 0x04, 0x00,
+                                              plan->fc_inte,
+                                              (plan->fc_frac >> 16) & 0xFF,
+                                              (plan->fc_frac >> 8) & 0xFF,
+                                              plan->fc_frac & 0xFF,
+                                              (plan->fc_step >> 8) & 0xFF,
+                                              plan->fc_step & 0xFF};
   Si446x_write(radio, set_frequency_property_command,
                sizeof(set_frequency_property_command));
 
-  uint32_t x = ((((uint32_t)1 << 19) * outdiv * 1300.0)/(2*Si446x_CCLK))*2;
-  uint8_t x2 = (x >> 16) & 0xFF;
-  uint8_t x1 = (x >>  8) & 0xFF;
-  uint8_t x0 = (x >>  0) & 0xFF;
-  uint8_t set_deviation[] = {Si446x_SET_PROPERTY, 0x20, 0x03, 0x0a, x2, x1, x0};
-  Si446x_write(radio, set_deviation, sizeof(set_deviation));
+  dat->band_freq = freq;
+  dat->band_step = step;
+  dat->band_ppb = ppb;
+
+  /* Deviation depends on the output divider so is written again. */
+  dat->outdiv = plan->outdiv;
+  dat->deviation = 0;
+  Si446x_setDeviation(radio, SI446X_AFSK_DEVIATION);
 
   /* Measure the chip temperature and update saved value. */
   Si446x_getTemperature(radio);
@@ -616,6 +901,12 @@ bool Si446x_setBandParameters(const radio_unit_t radio,
 
 static void Si446x_setPowerLevel(const radio_unit_t radio,
 								 const radio_pwr_t level) {
+    si446x_data_t *dat = Si446x_getData(radio);
+    if(dat->power_set && dat->power == level)
+      return;
+    dat->power = level;
+    dat->power_set = true;
+
     // Set the Power
     uint8_t set_pa_pwr_lvl_property_command[] = {Si446x_SET_PROPERTY,
                                                  0x22, 0x01, 0x01, level};
@@ -629,7 +920,81 @@ static void Si446x_setPowerLevel(const radio_unit_t radio,
  *  Radio modulation settings
  */
 
+/*
+ * Set the GPIO1 mode leaving other GPIO unchanged.
+ * GPIO1 is the RX data input to the ICU.
+ */
+static void Si446x_setRXDataMode(const radio_unit_t radio, uint8_t mode) {
+  const uint8_t gpio_pin_cfg[] = {
+      Si446x_GPIO_PIN_CFG,
+      0x00,                     // GPIO0      DONOTHING
+      mode,                     // GPIO1
+      0x00, 0x00, 0x00,         // GPIO2-3 and NIRQ DONOTHING
+      0x00,                     // SDO        DONOTHING
+      0x00                      // GEN_CONFIG
+  };
+  Si446x_write(radio, gpio_pin_cfg, sizeof(gpio_pin_cfg));
+}
+
+/*
+ * Set the modulation type and packet handler bit order for a modem.
+ * These are the only settings shared by the TX and RX modem configurations.
+ */
+static void Si446x_setModemType(const radio_unit_t radio,
+                                si446x_modem_t modem) {
+  si446x_data_t *dat = Si446x_getData(radio);
+  if(dat->mod_type == modem)
+    return;
+  switch(modem) {
+  case SI446X_MODEM_AFSK_TX:
+    // Use up-sampled AFSK from FIFO (PH)
+    Si446x_setProperty8(radio, Si446x_MODEM_MOD_TYPE, 0x02);
+    /* Set PH bit order for AFSK. */
+    Si446x_setProperty8(radio, Si446x_PKT_CONFIG1, 0x01);
+    break;
+
+  case SI446X_MODEM_2FSK_TX:
+    // Use 2GFSK from FIFO (PH)
+    Si446x_setProperty8(radio, Si446x_MODEM_MOD_TYPE, 0x03);
+    /* Set PH bit order for 2FSK. */
+    Si446x_setProperty8(radio, Si446x_PKT_CONFIG1, 0x01);
+    break;
+
+  case SI446X_MODEM_AFSK_RX:
+    /* Set DIRECT_MODE (asynchronous mode as 2FSK). */
+    Si446x_setProperty8(radio, Si446x_MODEM_MOD_TYPE, 0x0A);
+    /* Packet handler disabled in RX. */
+    Si446x_setProperty8(radio, Si446x_PKT_CONFIG1, 0x41);
+    /* The decoder takes the raw demodulator output. */
+    Si446x_setRXDataMode(radio, Si446x_GPIO_MODE_RAW_RX_DATA);
+    break;
+
+  case SI446X_MODEM_2FSK_RX:
+    /* Set DIRECT_MODE (synchronous mode as 2GFSK). */
+    Si446x_setProperty8(radio, Si446x_MODEM_MOD_TYPE, 0x0B);
+    /* Packet handler disabled in RX. */
+    Si446x_setProperty8(radio, Si446x_PKT_CONFIG1, 0x41);
+    /* The decoder takes the clock recovered data. */
+    Si446x_setRXDataMode(radio, Si446x_GPIO_MODE_RX_DATA);
+    break;
+
+  default:
+    return;
+  }
+  dat->mod_type = modem;
+}
+
 static void Si446x_setModemAFSK_TX(const radio_unit_t radio) {
+    /* A 2FSK send may have changed the deviation. */
+    Si446x_setDeviation(radio, SI446X_AFSK_DEVIATION);
+
+    /* The TX modem settings are kept by the radio while in RX. */
+    si446x_data_t *dat = Si446x_getData(radio);
+    if(dat->tx_modem == SI446X_MODEM_AFSK_TX) {
+      Si446x_setModemType(radio, SI446X_MODEM_AFSK_TX);
+      return;
+    }
+
     // Setup the NCO modulo and oversampling mode
     uint32_t s = Si446x_CCLK / 10;
     uint8_t f3 = (s >> 24) & 0xFF;
@@ -641,25 +1006,81 @@ static void Si446x_setModemAFSK_TX(const radio_unit_t radio) {
     // Setup the NCO data rate for APRS
     Si446x_setProperty24(radio, Si446x_MODEM_DATA_RATE, 0x00, 0x33, 0x90);
 
-    // Use up-sampled AFSK from FIFO (PH)
-    Si446x_setProperty8(radio, Si446x_MODEM_MOD_TYPE, 0x02);
+    Si446x_setModemType(radio, SI446X_MODEM_AFSK_TX);
 
-    /* Set PH bit order for AFSK. */
-    Si446x_setProperty8(radio, Si446x_PKT_CONFIG1, 0x01);
+    // Set AFSK filter (COEFF8 to COEFF0)
+    const uint8_t coeff[] = {0x76, 0x70, 0x5c, 0x3e, 0x18, 0xee, 0xc4, 0x9f, 0x81};
+    Si446x_setProperties(radio, Si446x_MODEM_TX_FILTER_COEFF_8, coeff,
+                         sizeof(coeff));
+    dat->tx_modem = SI446X_MODEM_AFSK_TX;
+}
 
-    // Set AFSK filter
-    const uint8_t coeff[] = {0x81, 0x9f, 0xc4, 0xee, 0x18, 0x3e, 0x5c, 0x70, 0x76};
-    uint8_t i;
-    for(i = 0; i < sizeof(coeff); i++) {
-        uint8_t msg[] = {0x11, 0x20, 0x01, 0x17-i, coeff[i]};
-        Si446x_write(radio, msg, 5);
-    }
+/*
+ * Set the receive front end (AFC, AGC, IF and channel filter).
+ * The settings are common to AFSK and 2FSK receive.
+ */
+static void Si446x_setRXFrontEnd(const radio_unit_t radio) {
+
+  packet_svc_t *handler = pktGetServiceObject(radio);
+
+  if(is_part_Si4463(handler->radio_part)) {
+    /* Run 4463 in 4464 compatibility mode (set SEARCH2 to zero). */
+    Si446x_setProperty8(radio, Si446x_MODEM_RAW_SEARCH2, 0x00);
+  }
+
+  /*
+   * RX AFC control.
+   * AFC_GEAR, AFC_WAIT, AFC_GAIN (2), AFC_LIMITER (2) and AFC_MISC.
+   */
+  const uint8_t afc[] = {0x54, 0x36, 0x80, 0xAB, 0x02, 0x50, 0xC0}; // MISC 0x80
+  Si446x_setProperties(radio, Si446x_MODEM_AFC_GEAR, afc, sizeof(afc));
+
+  /* RX AGC control. */
+  Si446x_setProperty8(radio, Si446x_MODEM_AGC_CONTROL, 0xE0); // 0xE2 (bit 1 not used in 4464. It is used in 4463.)
+  /* AGC_WINDOW_SIZE, AGC_RFPD_DECAY and AGC_IFPD_DECAY. */
+  const uint8_t agc[] = {0x11, 0x63, 0x63};
+  Si446x_setProperties(radio, Si446x_MODEM_AGC_WINDOW_SIZE, agc, sizeof(agc));
+
+  /* RX IF controls. */
+  Si446x_setProperty8(radio, Si446x_MODEM_IF_CONTROL, 0x08);
+  Si446x_setProperty24(radio, Si446x_MODEM_IF_FREQ, 0x02, 0x80, 0x00);
+
+  /* RSSI latching disabled. */
+  Si446x_setProperty8(radio, Si446x_MODEM_RSSI_CONTROL, 0x00);
+
+  /*
+   * RX IF filter coefficients.
+   * COE13 to COE0 then COEM0 to COEM3. The same filter is used for RX1 and RX2.
+   */
+  const uint8_t chflt[] = {0xFF, 0xC4, 0x30, 0x7F, 0x5F, 0xB5, 0xB8, 0xDE,
+                           0x05, 0x17, 0x16, 0x0C, 0x03, 0x00,
+                           0x15, 0xFF, 0x00, 0x00};
+  Si446x_setProperties(radio, Si446x_MODEM_CHFLT_RX1_CHFLT_COE13_7_0, chflt,
+                       sizeof(chflt));
+  Si446x_setProperties(radio, Si446x_MODEM_CHFLT_RX2_CHFLT_COE13_7_0, chflt,
+                       sizeof(chflt));
+
+  /* Unused Si4463 features for RX. */
+  if(is_part_Si4463(handler->radio_part)) {
+   /* DSA is not enabled. */
+   Si446x_setProperty16(radio, Si446x_MODEM_SPIKE_DET, 0x00, 0x00); // 0x03 0x07
+   Si446x_setProperty8(radio, Si446x_MODEM_RSSI_MUTE, 0x00);
+   /* DSA_CTRL1, DSA_CTRL2, DSA_QUAL, DSA_RSSI and DSA_MISC. */
+   const uint8_t dsa[] = {0x00, 0x00, 0x00, 0x00, 0x00}; // 0xA0 0x04 0x06 0x78 0x20
+   Si446x_setProperties(radio, Si446x_MODEM_DSA_CTRL1, dsa, sizeof(dsa));
+  }
 }
 
 static void Si446x_setModemAFSK_RX(const radio_unit_t radio) {
 
   packet_svc_t *handler = pktGetServiceObject(radio);
 
+  /* The RX modem settings are kept by the radio while in TX. */
+  si446x_data_t *dat = Si446x_getData(radio);
+  Si446x_setModemType(radio, SI446X_MODEM_AFSK_RX);
+  if(dat->rx_modem == SI446X_MODEM_AFSK_RX)
+    return;
+
 /*
 # BatchName Si4464
 # Crys_freq(Hz): 26000000    Crys_tol(ppm): 20    IF_mode: 2
@@ -676,116 +1097,51 @@ static void Si446x_setModemAFSK_RX(const radio_unit_t radio) {
 # Modulation index: 0.833
 */
 
-  /* Set DIRECT_MODE (asynchronous mode as 2FSK). */
-  Si446x_setProperty8(radio, Si446x_MODEM_MOD_TYPE, 0x0A);
-
-  /* Packet handler disabled in RX. */
-  Si446x_setProperty8(radio, Si446x_PKT_CONFIG1, 0x41);
-
-  if(is_part_Si4463(handler->radio_part)) {
-    /* Run 4463 in 4464 compatibility mode (set SEARCH2 to zero). */
-    Si446x_setProperty8(radio, Si446x_MODEM_RAW_SEARCH2, 0x00);
-  }
-  Si446x_setProperty8(radio, Si446x_MODEM_RAW_CONTROL, 0x8F);
-  Si446x_setProperty8(radio, Si446x_MODEM_RAW_SEARCH, 0xD6);
-  Si446x_setProperty16(radio, Si446x_MODEM_RAW_EYE, 0x00, 0x3B);
+  Si446x_setRXFrontEnd(radio);
 
   /*
    * OOK_MISC settings include parameters related to asynchronous mode.
    * Asynchronous mode is used for AFSK reception passed to DSP decode.
+   * OOK_CNT1, OOK_MISC, RAW_SEARCH, RAW_CONTROL and RAW_EYE (2).
    */
   Si446x_setProperty8(radio, Si446x_MODEM_OOK_PDTC, 0x2A);
-  Si446x_setProperty8(radio, Si446x_MODEM_OOK_CNT1, 0x85);
-  Si446x_setProperty8(radio, Si446x_MODEM_OOK_MISC, 0x23);
+  const uint8_t ook_raw[] = {0x85, 0x23, 0xD6, 0x8F, 0x00, 0x3B};
+  Si446x_setProperties(radio, Si446x_MODEM_OOK_CNT1, ook_raw,
+                       sizeof(ook_raw));
 
-  /* RX AFC control. */
-  Si446x_setProperty8(radio, Si446x_MODEM_AFC_GEAR, 0x54);
-  Si446x_setProperty8(radio, Si446x_MODEM_AFC_WAIT, 0x36);
-  Si446x_setProperty16(radio, Si446x_MODEM_AFC_GAIN, 0x80, 0xAB);
-  Si446x_setProperty16(radio, Si446x_MODEM_AFC_LIMITER, 0x02, 0x50);
-  Si446x_setProperty8(radio, Si446x_MODEM_AFC_MISC, 0xC0); // 0x80
-
-  /* RX AGC control. */
-  Si446x_setProperty8(radio, Si446x_MODEM_AGC_CONTROL, 0xE0); // 0xE2 (bit 1 not used in 4464. It is used in 4463.)
-  Si446x_setProperty8(radio, Si446x_MODEM_AGC_WINDOW_SIZE, 0x11);
-  Si446x_setProperty8(radio, Si446x_MODEM_AGC_RFPD_DECAY, 0x63);
-  Si446x_setProperty8(radio, Si446x_MODEM_AGC_IFPD_DECAY, 0x63);
-
-  /* RX Bit clock recovery control. */
+  /*
+   * RX Bit clock recovery control.
+   * BCR_OSR (2), BCR_NCO_OFFSET (3), BCR_GAIN (2), BCR_GEAR and BCR_MISC1.
+   */
   Si446x_setProperty8(radio, Si446x_MODEM_MDM_CTRL, 0x80);
-  Si446x_setProperty16(radio, Si446x_MODEM_BCR_OSR, 0x01, 0xC3);
-  Si446x_setProperty24(radio, Si446x_MODEM_BCR_NCO_OFFSET, 0x01, 0x22, 0x60);
-  Si446x_setProperty16(radio, Si446x_MODEM_BCR_GAIN, 0x00, 0x91);
-  Si446x_setProperty8(radio, Si446x_MODEM_BCR_GEAR, 0x00);
-  Si446x_setProperty8(radio, Si446x_MODEM_BCR_MISC1, 0xC2);
-
-  /* RX IF controls. */
-  Si446x_setProperty8(radio, Si446x_MODEM_IF_CONTROL, 0x08);
-  Si446x_setProperty24(radio, Si446x_MODEM_IF_FREQ, 0x02, 0x80, 0x00);
+  const uint8_t bcr[] = {0x01, 0xC3, 0x01, 0x22, 0x60, 0x00, 0x91, 0x00, 0xC2};
+  Si446x_setProperties(radio, Si446x_MODEM_BCR_OSR, bcr, sizeof(bcr));
 
-  /* RX IF filter decimation controls. */
-  Si446x_setProperty8(radio, Si446x_MODEM_DECIMATION_CFG1, 0x70);
-  Si446x_setProperty8(radio, Si446x_MODEM_DECIMATION_CFG0, 0x10);
+  /* RX IF filter decimation controls (CFG1 and CFG0). */
+  Si446x_setProperty16(radio, Si446x_MODEM_DECIMATION_CFG1, 0x70, 0x10);
   if(is_part_Si4463(handler->radio_part)) {
     Si446x_setProperty8(radio, Si446x_MODEM_DECIMATION_CFG2, 0x0C);
   }
 
-  /* RSSI latching disabled. */
-  Si446x_setProperty8(radio, Si446x_MODEM_RSSI_CONTROL, 0x00);
-
-  /* RX IF filter coefficients. */
-  Si446x_setProperty8(radio, Si446x_MODEM_CHFLT_RX1_CHFLT_COE13_7_0, 0xFF);
-  Si446x_setProperty8(radio, Si446x_MODEM_CHFLT_RX1_CHFLT_COE12_7_0, 0xC4);
-  Si446x_setProperty8(radio, Si446x_MODEM_CHFLT_RX1_CHFLT_COE11_7_0, 0x30);
-  Si446x_setProperty8(radio, Si446x_MODEM_CHFLT_RX1_CHFLT_COE10_7_0, 0x7F);
-  Si446x_setProperty8(radio, Si446x_MODEM_CHFLT_RX1_CHFLT_COE9_7_0, 0x5F);
-  Si446x_setProperty8(radio, Si446x_MODEM_CHFLT_RX1_CHFLT_COE8_7_0, 0xB5);
-  Si446x_setProperty8(radio, Si446x_MODEM_CHFLT_RX1_CHFLT_COE7_7_0, 0xB8);
-  Si446x_setProperty8(radio, Si446x_MODEM_CHFLT_RX1_CHFLT_COE6_7_0, 0xDE);
-  Si446x_setProperty8(radio, Si446x_MODEM_CHFLT_RX1_CHFLT_COE5_7_0, 0x05);
-  Si446x_setProperty8(radio, Si446x_MODEM_CHFLT_RX1_CHFLT_COE4_7_0, 0x17);
-  Si446x_setProperty8(radio, Si446x_MODEM_CHFLT_RX1_CHFLT_COE3_7_0, 0x16);
-  Si446x_setProperty8(radio, Si446x_MODEM_CHFLT_RX1_CHFLT_COE2_7_0, 0x0C);
-  Si446x_setProperty8(radio, Si446x_MODEM_CHFLT_RX1_CHFLT_COE1_7_0, 0x03);
-  Si446x_setProperty8(radio, Si446x_MODEM_CHFLT_RX1_CHFLT_COE0_7_0, 0x00);
-  Si446x_setProperty8(radio, Si446x_MODEM_CHFLT_RX1_CHFLT_COEM0, 0x15);
-  Si446x_setProperty8(radio, Si446x_MODEM_CHFLT_RX1_CHFLT_COEM1, 0xFF);
-  Si446x_setProperty8(radio, Si446x_MODEM_CHFLT_RX1_CHFLT_COEM2, 0x00);
-  Si446x_setProperty8(radio, Si446x_MODEM_CHFLT_RX1_CHFLT_COEM3, 0x00);
-
-  Si446x_setProperty8(radio, Si446x_MODEM_CHFLT_RX2_CHFLT_COE13_7_0, 0xFF);
-  Si446x_setProperty8(radio, Si446x_MODEM_CHFLT_RX2_CHFLT_COE12_7_0, 0xC4);
-  Si446x_setProperty8(radio, Si446x_MODEM_CHFLT_RX2_CHFLT_COE11_7_0, 0x30);
-  Si446x_setProperty8(radio, Si446x_MODEM_CHFLT_RX2_CHFLT_COE10_7_0, 0x7F);
-  Si446x_setProperty8(radio, Si446x_MODEM_CHFLT_RX2_CHFLT_COE9_7_0, 0x5F);
-  Si446x_setProperty8(radio, Si446x_MODEM_CHFLT_RX2_CHFLT_COE8_7_0, 0xB5);
-  Si446x_setProperty8(radio, Si446x_MODEM_CHFLT_RX2_CHFLT_COE7_7_0, 0xB8);
-  Si446x_setProperty8(radio, Si446x_MODEM_CHFLT_RX2_CHFLT_COE6_7_0, 0xDE);
-  Si446x_setProperty8(radio, Si446x_MODEM_CHFLT_RX2_CHFLT_COE5_7_0, 0x05);
-  Si446x_setProperty8(radio, Si446x_MODEM_CHFLT_RX2_CHFLT_COE4_7_0, 0x17);
-  Si446x_setProperty8(radio, Si446x_MODEM_CHFLT_RX2_CHFLT_COE3_7_0, 0x16);
-  Si446x_setProperty8(radio, Si446x_MODEM_CHFLT_RX2_CHFLT_COE2_7_0, 0x0C);
-  Si446x_setProperty8(radio, Si446x_MODEM_CHFLT_RX2_CHFLT_COE1_7_0, 0x03);
-  Si446x_setProperty8(radio, Si446x_MODEM_CHFLT_RX2_CHFLT_COE0_7_0, 0x00);
-  Si446x_setProperty8(radio, Si446x_MODEM_CHFLT_RX2_CHFLT_COEM0, 0x15);
-  Si446x_setProperty8(radio, Si446x_MODEM_CHFLT_RX2_CHFLT_COEM1, 0xFF);
-  Si446x_setProperty8(radio, Si446x_MODEM_CHFLT_RX2_CHFLT_COEM2, 0x00);
-  Si446x_setProperty8(radio, Si446x_MODEM_CHFLT_RX2_CHFLT_COEM3, 0x00);
-
   Si446x_setProperty8(radio, Si446x_PREAMBLE_CONFIG, 0x21);
+  dat->rx_modem = SI446X_MODEM_AFSK_RX;
+}
 
-  /* Unused Si4463 features for AFSK RX. */
-  if(is_part_Si4463(handler->radio_part)) {
-   /* DSA is not enabled. */
-   Si446x_setProperty8(radio, Si446x_MODEM_DSA_CTRL1, 0x00); // 0xA0
-   Si446x_setProperty8(radio, Si446x_MODEM_DSA_CTRL2, 0x00); // 0x04
-   Si446x_setProperty8(radio, Si446x_MODEM_SPIKE_DET, 0x00); // 0x03
-   Si446x_setProperty8(radio, Si446x_MODEM_ONE_SHOT_AFC, 0x00); // 0x07
-   Si446x_setProperty8(radio, Si446x_MODEM_DSA_QUAL, 0x00); // 0x06
-   Si446x_setProperty8(radio, Si446x_MODEM_DSA_RSSI, 0x00); // 0x78
-   Si446x_setProperty8(radio, Si446x_MODEM_RSSI_MUTE, 0x00);
-   Si446x_setProperty8(radio, Si446x_MODEM_DSA_MISC, 0x00); // 0x20
+/**
+ * Get the 2FSK modem profile for a rate.
+ * Returns NULL if the rate is not supported.
+ */
+static const si446x_2fsk_profile_t *Si446x_get2FSKProfile(const uint32_t speed) {
+  static const si446x_2fsk_profile_t profiles[] = {
+    {SI446X_2FSK_SPEED_4800, 1500, 0x70},
+    {SI446X_2FSK_SPEED_9600, 3000, 0x60}
+  };
+  uint8_t i;
+  for(i = 0; i < sizeof(profiles) / sizeof(profiles[0]); i++) {
+    if(profiles[i].speed == speed)
+      return &profiles[i];
   }
+  return NULL;
 }
 
 /**
@@ -793,6 +1149,17 @@ static void Si446x_setModemAFSK_RX(const radio_unit_t radio) {
  */
 static void Si446x_setModem2FSK_TX(const radio_unit_t radio,
 		const uint32_t speed) {
+    const si446x_2fsk_profile_t *profile = Si446x_get2FSKProfile(speed);
+    chDbgAssert(profile != NULL, "unsupported 2FSK speed");
+    Si446x_setDeviation(radio, profile->deviation);
+
+    /* The TX modem settings are kept by the radio while in RX. */
+    si446x_data_t *dat = Si446x_getData(radio);
+    if(dat->tx_modem == SI446X_MODEM_2FSK_TX && dat->tx_speed == speed) {
+      Si446x_setModemType(radio, SI446X_MODEM_2FSK_TX);
+      return;
+    }
+
     // Setup the NCO modulo and oversampling mode
     uint32_t s = Si446x_CCLK / 10;
     uint8_t f3 = (s >> 24) & 0xFF;
@@ -806,19 +1173,67 @@ static void Si446x_setModem2FSK_TX(const radio_unit_t radio,
                          (uint8_t)(speed >> 16),
                          (uint8_t)(speed >> 8), (uint8_t)speed);
 
-    // Use 2GFSK from FIFO (PH)
-    Si446x_setProperty8(radio, Si446x_MODEM_MOD_TYPE, 0x03);
+    Si446x_setModemType(radio, SI446X_MODEM_2FSK_TX);
 
-    /* Set PH bit order for 2FSK. */
-    Si446x_setProperty8(radio, Si446x_PKT_CONFIG1, 0x01);
+    // Set 2GFSK filter (default per Si) (COEFF8 to COEFF0).
+    const uint8_t coeff[] = {0x67, 0x60, 0x4d, 0x36, 0x21, 0x11, 0x08, 0x03, 0x01};
+    Si446x_setProperties(radio, Si446x_MODEM_TX_FILTER_COEFF_8, coeff,
+                         sizeof(coeff));
+    dat->tx_modem = SI446X_MODEM_2FSK_TX;
+    dat->tx_speed = speed;
+}
 
-    // Set 2GFSK filter (default per Si).
-    const uint8_t coeff[] = {0x01, 0x03, 0x08, 0x11, 0x21, 0x36, 0x4d, 0x60, 0x67};
-    uint8_t i;
-    for(i = 0; i < sizeof(coeff); i++) {
-        uint8_t msg[] = {0x11, 0x20, 0x01, 0x17-i, coeff[i]};
-        Si446x_write(radio, msg, sizeof(msg));
-    }
+/**
+ * Set the radio for 2FSK receive.
+ * The radio demodulates and recovers the bit clock.
+ * The RX data output is synchronous data for the PWM decoder.
+ */
+static void Si446x_setModem2FSK_RX(const radio_unit_t radio,
+                                   const uint32_t speed) {
+
+  packet_svc_t *handler = pktGetServiceObject(radio);
+
+  const si446x_2fsk_profile_t *profile = Si446x_get2FSKProfile(speed);
+  chDbgAssert(profile != NULL, "unsupported 2FSK speed");
+
+  /* The RX modem settings are kept by the radio while in TX. */
+  si446x_data_t *dat = Si446x_getData(radio);
+  Si446x_setModemType(radio, SI446X_MODEM_2FSK_RX);
+  if(dat->rx_modem == SI446X_MODEM_2FSK_RX && dat->rx_speed == speed)
+    return;
+
+  Si446x_setRXFrontEnd(radio);
+
+  /* Synchronous demodulator output. */
+  Si446x_setProperty8(radio, Si446x_MODEM_MDM_CTRL, 0x00);
+
+  /* RX IF filter decimation controls (CFG1 and CFG0). */
+  uint8_t cfg1 = profile->rx_decimation;
+  Si446x_setProperty16(radio, Si446x_MODEM_DECIMATION_CFG1, cfg1, 0x10);
+  if(is_part_Si4463(handler->radio_part)) {
+    Si446x_setProperty8(radio, Si446x_MODEM_DECIMATION_CFG2, 0x0C);
+  }
+
+  /*
+   * RX Bit clock recovery control.
+   * BCR_OSR (2), BCR_NCO_OFFSET (3), BCR_GAIN (2), BCR_GEAR and BCR_MISC1.
+   * The over sampling rate has 3 fractional bits.
+   * The NCO offset and gain follow from the over sampling rate.
+   */
+  uint32_t ndec = 1U << (((cfg1 >> 6) & 0x3) + ((cfg1 >> 4) & 0x3)
+      + ((cfg1 >> 1) & 0x7));
+  uint32_t osr = Si446x_CCLK / (3 * ndec * speed);
+  uint32_t nco = (uint32_t)(((uint64_t)1 << 25) / osr);
+  uint32_t gain = nco >> 9;
+  const uint8_t bcr[] = {(osr >> 8) & 0x0F, osr & 0xFF,
+                         (nco >> 16) & 0x3F, (nco >> 8) & 0xFF, nco & 0xFF,
+                         (gain >> 8) & 0x07, gain & 0xFF,
+                         0x00, 0xC2};
+  Si446x_setProperties(radio, Si446x_MODEM_BCR_OSR, bcr, sizeof(bcr));
+
+  Si446x_setProperty8(radio, Si446x_PREAMBLE_CONFIG, 0x21);
+  dat->rx_modem = SI446X_MODEM_2FSK_RX;
+  dat->rx_speed = speed;
 }
 
 
@@ -836,18 +1251,38 @@ static uint8_t __attribute__((unused)) Si446x_getChannel(const radio_unit_t radi
  * Radio FIFO
  */
 
+/**
+ * Write data to the TX FIFO.
+ * The command and data are sent as transmit only (DMA) in one SPI select.
+ * FIFO access does not wait for CTS and data is not copied.
+ */
 static void Si446x_writeFIFO(const radio_unit_t radio,
 		uint8_t *msg, uint8_t size) {
-  uint8_t write_fifo[size+1];
-  write_fifo[0] = Si446x_WRITE_TX_FIFO;
-  memcpy(&write_fifo[1], msg, size);
-  Si446x_write(radio, write_fifo, size+1);
+  const uint8_t write_fifo[] = {Si446x_WRITE_TX_FIFO};
+  Si446x_assertDMA(msg);
+  rtcnt_t start = Si446x_txTestNow();
+
+  /* Acquire bus and then start SPI. */
+  SPIDriver *spip = Si446x_spiSetupBus(radio, &ls_spicfg);
+  spiStart(spip, &ls_spicfg);
+
+  spiSelect(spip);
+  spiSend(spip, sizeof(write_fifo), write_fifo);
+  spiSend(spip, size, msg);
+  spiUnselect(spip);
+
+  /* Stop SPI and relinquish bus. */
+  spiStop(spip);
+  spiReleaseBus(spip);
+  Si446x_txTestSPI(start);
 }
 
 static uint8_t Si446x_getTXfreeFIFO(const radio_unit_t radio) {
   const uint8_t fifo_info[] = {Si446x_FIFO_INFO, 0x00};
   uint8_t rxData[4];
+  rtcnt_t start = Si446x_txTestNow();
   Si446x_read(radio, fifo_info, sizeof(fifo_info), rxData, sizeof(rxData));
+  Si446x_txTestSPI(start);
   return rxData[3];
 }
 
@@ -863,6 +1298,13 @@ radio_signal_t Si446x_getCurrentRSSI(const radio_unit_t radio) {
     return rxData[4];
 }
 
+/*
+ * Set the RSSI threshold of the receive in progress.
+ */
+void Si446x_setSquelch(const radio_unit_t radio, const radio_squelch_t rssi) {
+  Si446x_setProperty8(radio, Si446x_MODEM_RSSI_THRESH, rssi);
+}
+
 static uint8_t Si446x_getState(const radio_unit_t radio) {
   const uint8_t state_info[] = {Si446x_REQUEST_DEVICE_STATE};
   uint8_t rxData[4];
@@ -971,16 +1413,66 @@ static bool Si446x_checkCCAthreshold(const radio_unit_t radio, uint8_t ms) {
 }
 
 /**
- * Wait for a clear time slot and initiate packet transmission.
+ * Listen on the TX frequency for one CCA measurement interval.
+ * Returns true if the channel is clear.
+ */
+static bool Si446x_senseChannel(const radio_unit_t radio,
+                                const radio_task_object_t *rto,
+                                const radio_squelch_t rssi) {
+#define CCA_VALID_TIME_MS   50
+  /* Get an absolute operating frequency in Hz. */
+  radio_freq_t op_freq = pktComputeOperatingFrequency(radio,
+                                                      rto->base_frequency,
+                                                      rto->step_hz,
+                                                      rto->channel,
+                                                      RADIO_TX);
+
+  /* Let the transmit handle an invalid frequency. */
+  if(op_freq == FREQ_INVALID)
+    return true;
+
+  /* Switch to ready state if receive is active. */
+  if(Si446x_getState(radio) == Si446x_STATE_RX) {
+    Si446x_setReadyState(radio);
+    chThdSleep(TIME_MS2I(1));
+  }
+
+  /* Frequency is an absolute frequency in Hz. */
+  Si446x_setBandParameters(radio, op_freq, rto->step_hz);
+  Si446x_setProperty8(radio, Si446x_MODEM_RSSI_THRESH, rssi);
+
+  /* Listen on the TX frequency. */
+  Si446x_setRXState(radio, rto->channel);
+  /* Wait for RX state. */
+  while(Si446x_getState(radio) != Si446x_STATE_RX) {
+    chThdSleep(TIME_MS2I(1));
+  }
+  return !Si446x_checkCCAthreshold(radio, CCA_VALID_TIME_MS);
+}
+
+/**
+ * Get channel access for a send using p-persistent CSMA.
+ * The channel is sensed once and the send deferred if access is not granted.
+ * Returns true if the send can start.
+ */
+static bool Si446x_acquireChannel(const radio_unit_t radio,
+                                  radio_task_object_t *rto,
+                                  const radio_squelch_t rssi) {
+  bool clear = Si446x_senseChannel(radio, rto,
+                                   pktGetAdaptiveSquelch(radio, rssi));
+  return pktCheckRadioChannelAccess(rto, clear);
+}
+
+/**
+ * Initiate packet transmission.
+ * Channel access is acquired by the caller before loading the FIFO.
  */
 static bool Si446x_transmit(const radio_unit_t radio,
                             const radio_freq_t freq,
                             const channel_hz_t step,
                             const radio_ch_t chan,
                             const radio_pwr_t power,
-                            const uint16_t size,
-                            const radio_squelch_t rssi,
-                            sysinterval_t cca_timeout) {
+                            const uint16_t size) {
 
   /* Get an absolute operating frequency in Hz. */
   radio_freq_t op_freq = pktComputeOperatingFrequency(radio, freq,
@@ -1002,40 +1494,6 @@ static bool Si446x_transmit(const radio_unit_t radio,
   /* Frequency is an absolute frequency in Hz. */
   Si446x_setBandParameters(radio, op_freq, step);
 
-  /* Check for blind send request. */
-  if(rssi != PKT_SI446X_NO_CCA_RSSI) {
-    Si446x_setProperty8(radio, Si446x_MODEM_RSSI_THRESH, rssi);
-
-    /* Listen on the TX frequency. */
-    Si446x_setRXState(radio, chan);
-    /* Wait for RX state. */
-    while(Si446x_getState(radio) != Si446x_STATE_RX) {
-      chThdSleep(TIME_MS2I(1));
-    }
-    /* Minimum timeout for CCA is 1 second. */
-    if(cca_timeout < TIME_S2I(1)) {
-      TRACE_WARN("SI   > Minimum CCA wait time forced to 1 second,"
-          " %d ms was specified", chTimeI2MS(cca_timeout));
-      cca_timeout = TIME_S2I(1);
-    }
-
-    /* Try to get clear channel. */
-    TRACE_INFO( "SI   > Wait up to %.1f seconds for CCA on"
-        " %d.%03d MHz",
-        (float32_t)(TIME_I2MS(cca_timeout) / 1000),
-        op_freq/1000000, (op_freq%1000000)/1000);
-#define CCA_VALID_TIME_MS   50
-    sysinterval_t t0 = chVTGetSystemTime();
-    while((Si446x_getState(radio) != Si446x_STATE_RX
-        || Si446x_checkCCAthreshold(radio, CCA_VALID_TIME_MS))
-        && chVTIsSystemTimeWithinX(t0, t0 + cca_timeout)) {
-      chThdSleep(TIME_MS2I(1));
-    }
-    /* Clear channel timing. */
-    TRACE_INFO( "SI   > CCA attained in %d milliseconds",
-                chTimeI2MS(chVTTimeElapsedSinceX(t0)));
-  }
-
   // Transmit
   TRACE_INFO("SI   > Tune Si446x to %d.%03d MHz (TX)",
              op_freq/1000000, (op_freq%1000000)/1000);
@@ -1091,6 +1549,10 @@ bool Si446x_receiveNoLock(const radio_unit_t radio,
   /* Configure radio for modulation type. */
   if(mod == MOD_AFSK) {
       Si446x_setModemAFSK_RX(radio);
+#if PKT_RX_USE_2FSK == TRUE
+  } else if(mod == MOD_2FSK) {
+      Si446x_setModem2FSK_RX(radio, PKT_RX_2FSK_SPEED);
+#endif
   } else {
       TRACE_ERROR("SI   > Modulation type not supported in receive");
       TRACE_ERROR("SI   > abort reception");
@@ -1185,32 +1647,71 @@ void Si446x_waitTransmitEnd(const radio_unit_t radio) {
  */
 
 /*
- *
+ * Get the next NRZI byte from the encoder stream.
+ * The up-sampler buffer is refilled from the iterator as it empties.
  */
-static uint8_t Si446x_getUpsampledNRZIbits(up_sampler_t *upsampler,
-                                           uint8_t *buf) {
-  uint8_t b = 0;
-  for(uint8_t i = 0; i < 8; i++) {
-    if(upsampler->current_sample_in_baud == 0) {
-      if((upsampler->packet_pos & 7) == 0) { // Load up next byte
-        upsampler->current_byte = buf[upsampler->packet_pos >> 3];
-      } else { // Load up next bit
-        upsampler->current_byte >>= 1;
+static uint8_t Si446x_getNextNRZIbyte(up_sampler_t *upsampler) {
+  if(upsampler->nrzi_index >= upsampler->nrzi_count) {
+    upsampler->nrzi_count = pktStreamEncodingIterator(upsampler->iterator,
+                                                      upsampler->nrzi,
+                                                      sizeof(upsampler->nrzi));
+    upsampler->nrzi_index = 0;
+    /* Stream ended early. Repeat the last byte rather than read stale data. */
+    if(upsampler->nrzi_count == 0)
+      return upsampler->current_byte;
+  }
+  return upsampler->nrzi[upsampler->nrzi_index++];
+}
+
+/*
+ * Build the AFSK up-sampler symbol table.
+ * Each pattern is sampled from the centre phase of its bucket.
+ */
+static void Si446x_initAFSKSymbolTable(void) {
+  if(Si446x_afskSymbolReady)
+    return;
+  for(uint8_t bit = 0; bit < 2; bit++) {
+    uint32_t delta = bit ? PHASE_DELTA_1200 : PHASE_DELTA_2200;
+    for(uint16_t n = 0; n < SI446X_AFSK_PHASE_BUCKETS; n++) {
+      uint32_t phase = (n << SI446X_AFSK_BUCKET_SHIFT)
+          + (1U << (SI446X_AFSK_BUCKET_SHIFT - 1));
+      uint16_t pattern = 0;
+      for(uint8_t i = 0; i < SAMPLES_PER_BAUD; i++) {
+        phase += delta;
+        pattern |= ((phase >> 16) & 1) << i;
       }
+      Si446x_afskSymbol[bit][n] = pattern;
     }
+  }
+  Si446x_afskSymbolReady = true;
+}
 
-    // Toggle tone (1200 <> 2200)
-    upsampler->phase_delta = (upsampler->current_byte & 1)
-        ? PHASE_DELTA_1200 : PHASE_DELTA_2200;
-    /* Add delta-phase (position within SAMPLES_PER_BAUD). */
-    upsampler->phase += upsampler->phase_delta;
-    b |= ((upsampler->phase >> 16) & 1) << i;  // Set modulation bit
-
-    if(++upsampler->current_sample_in_baud == SAMPLES_PER_BAUD) {
-      upsampler->current_sample_in_baud = 0;
-      upsampler->packet_pos++;
+/*
+ * Get the next FIFO byte (8 samples) of up-sampled NRZI data.
+ * Whole symbols are looked up in the symbol table and queued as samples.
+ * The phase is carried exactly between symbols so there is no drift.
+ */
+static uint8_t Si446x_getUpsampledNRZIbits(up_sampler_t *upsampler) {
+  while(upsampler->sample_count < 8) {
+    if((upsampler->packet_pos & 7) == 0) { // Load up next byte
+      upsampler->current_byte = Si446x_getNextNRZIbyte(upsampler);
+    } else { // Load up next bit
+      upsampler->current_byte >>= 1;
     }
+    upsampler->packet_pos++;
+
+    /* Tone 1200 for NRZI 1 and 2200 for NRZI 0. */
+    uint8_t bit = upsampler->current_byte & 1;
+    upsampler->phase_delta = bit ? PHASE_DELTA_1200 : PHASE_DELTA_2200;
+    upsampler->samples |= (uint32_t)Si446x_afskSymbol[bit]
+        [(upsampler->phase & SI446X_AFSK_PHASE_MASK)
+         >> SI446X_AFSK_BUCKET_SHIFT] << upsampler->sample_count;
+    upsampler->sample_count += SAMPLES_PER_BAUD;
+    upsampler->phase += SAMPLES_PER_BAUD * upsampler->phase_delta;
   }
+  uint8_t b = upsampler->samples & 0xFF;
+  upsampler->samples >>= 8;
+  upsampler->sample_count -= 8;
   return b;
 }
 
@@ -1224,34 +1725,181 @@ static void Si446x_transmitTimeoutI(thread_t *tp) {
   chSysUnlockFromISR();
 }
 
+/**
+ * Called on NIRQ falling edge when the TX FIFO almost empty is pending.
+ */
+static void Si446x_transmitFIFOI(thread_t *tp) {
+  /* Tell the thread to refill the FIFO. */
+  chSysLockFromISR();
+  chEvtSignalI(tp, SI446X_EVT_TX_FIFO);
+  chSysUnlockFromISR();
+}
+
 /*
- * Simple AFSK send thread with minimized buffering and burst send capability.
- * Uses an iterator to size NRZI output and allocate suitable size buffer.
- *
+ * Set the NIRQ pin mode leaving other GPIO unchanged.
  */
-THD_FUNCTION(bloc_si_fifo_feeder_afsk, arg) {
-  radio_task_object_t *rto = arg;
+static void Si446x_setNIRQmode(const radio_unit_t radio, uint8_t mode) {
+  const uint8_t gpio_pin_cfg[] = {
+      Si446x_GPIO_PIN_CFG,
+      0x00, 0x00, 0x00, 0x00,   // GPIO0-3    DONOTHING
+      mode,                     // NIRQ
+      0x00,                     // SDO        DONOTHING
+      0x00                      // GEN_CONFIG
+  };
+  Si446x_write(radio, gpio_pin_cfg, sizeof(gpio_pin_cfg));
+}
 
-  radio_unit_t radio = rto->handler->radio;
+/*
+ * Clear a pending TX FIFO almost empty interrupt which releases NIRQ.
+ */
+static void Si446x_clearTXFIFOInterrupt(const radio_unit_t radio) {
+  const uint8_t clear_int[] = {Si446x_GET_INT_STATUS,
+                               (uint8_t)~Si446x_PH_TX_FIFO_ALMOST_EMPTY,
+                               0xFF, 0xFF};
+  Si446x_write(radio, clear_int, sizeof(clear_int));
+}
 
-  packet_t pp = rto->packet_out;
+/*
+ * Use NIRQ to wake the calling feeder thread when the TX FIFO needs refill.
+ * NIRQ is used for CCA so this is enabled only once TX has started.
+ */
+static void Si446x_enableTXFIFOInterrupt(const radio_unit_t radio) {
+  Si446x_setProperty8(radio, Si446x_PKT_TX_THRESHOLD,
+                      SI446X_TX_FIFO_THRESHOLD);
+  Si446x_setProperty8(radio, Si446x_INT_CTL_PH_ENABLE,
+                      Si446x_PH_TX_FIFO_ALMOST_EMPTY);
+  Si446x_setProperty8(radio, Si446x_INT_CTL_ENABLE, Si446x_INT_PH);
+  Si446x_clearTXFIFOInterrupt(radio);
+  (void)chEvtGetAndClearEvents(SI446X_EVT_TX_FIFO);
+
+  ioline_t nirq = Si446x_getConfig(radio)->nirq;
+  palSetLineCallback(nirq, (palcallback_t)Si446x_transmitFIFOI,
+                     chThdGetSelfX());
+  palEnableLineEvent(nirq, PAL_EVENT_MODE_FALLING_EDGE);
+  Si446x_setNIRQmode(radio, Si446x_NIRQ_MODE_NIRQ);
+}
 
-  chDbgAssert(pp != NULL, "no packet in radio task");
+/*
+ * Return NIRQ to CCA output.
+ * The decoder sets its CCA callback again when it is restarted.
+ */
+static void Si446x_disableTXFIFOInterrupt(const radio_unit_t radio) {
+  palDisableLineEvent(Si446x_getConfig(radio)->nirq);
+  Si446x_setProperty8(radio, Si446x_INT_CTL_ENABLE, 0x00);
+  Si446x_clearTXFIFOInterrupt(radio);
+  Si446x_setNIRQmode(radio, Si446x_NIRQ_MODE_CCA);
+  (void)chEvtGetAndClearEvents(SI446X_EVT_TX_FIFO);
+}
 
-  if(pktLockRadioTransmit(radio, TIME_INFINITE) == MSG_RESET) {
-    TRACE_ERROR("SI   > AFSK TX reset from radio acquisition");
-    /* Free packet object memory. */
-    pktReleaseBufferChain(pp);
+/*
+ * Start NRZI encoding of a burst of the frames chained from pp.
+ * Each NRZI byte is up-sampled to SAMPLES_PER_BAUD FIFO bytes.
+ * Returns the number of NRZI bytes the burst will stream.
+ */
+static uint16_t Si446x_initAFSKEncode(tx_iterator_t *iterator, packet_t pp) {
+  /*
+   * Set NRZI encoding format.
+   * Iterator object.
+   * Packet reference.
+   * Preamble length (HDLC flags)
+   * Gap length between frames (HDLC flags)
+   * Postamble length (HDLC flags)
+   * Tail length (HDLC zeros)
+   * Scramble off
+   * Burst size limit
+   */
+  pktStreamIteratorInitBurst(iterator, pp, SI446X_AFSK_PREAMBLE,
+                             SI446X_BURST_GAP, SI446X_AFSK_POSTAMBLE,
+                             SI446X_AFSK_TAIL, false,
+                             SI446X_TX_MAX_LEN / SAMPLES_PER_BAUD);
+
+  /* The radio needs the TX length so count (without writing) the stream. */
+  return pktStreamEncodingIterator(iterator, NULL, 0);
+}
+
+/*
+ * Get the packet following the frames of a burst.
+ */
+static packet_t Si446x_getBurstNext(packet_t pp, uint8_t frames) {
+  while(frames-- > 0 && pp != NULL)
+    pp = pp->nextp;
+  return pp;
+}
+
+/*
+ * Release the packets of a burst which was sent.
+ * The packets are captured with the time the burst went on air.
+ */
+static void Si446x_releaseBurst(radio_task_object_t *rto, packet_t pp,
+                                uint8_t frames, systime_t rf_start) {
+  uint8_t i;
+  for(i = 0; i < frames && pp != NULL; i++) {
+    cap_tx(rto, pp, i, rf_start);
+    packet_t np = pp->nextp;
+    pktReleaseBufferObject(pp);
+    pp = np;
+  }
+}
 
-    /* Schedule thread and task object memory release. */
-    pktLLDradioSendComplete(rto, chThdGetSelfX());
+/*
+ * Up-sample a frame as the AFSK feeder does but without a radio.
+ * The FIFO bytes are written to the buffer which is reused as it fills.
+ * Used by the bench command. Returns the number of FIFO bytes made.
+ */
+uint32_t Si446x_upsampleAFSK(packet_t pp, uint8_t *buffer, uint16_t size) {
+  Si446x_initAFSKSymbolTable();
+
+  tx_iterator_t iterator;
+  uint32_t all = Si446x_initAFSKEncode(&iterator, pp) * SAMPLES_PER_BAUD;
 
-    /* Exit thread. */
-    chThdExit(MSG_RESET);
-    /* We never arrive here. */
-    chSysHalt("TX AFSK exit");
+  up_sampler_t upsampler = {0};
+  upsampler.phase_delta = PHASE_DELTA_1200;
+  upsampler.iterator = &iterator;
+
+  uint16_t n = 0;
+  for(uint32_t i = 0; i < all; i++) {
+    buffer[n++] = Si446x_getUpsampledNRZIbits(&upsampler);
+    if(n == size)
+      n = 0;
   }
+  return all;
+}
 
+/*
+ * Start recording the feeder timing of the frames sent from now.
+ */
+void Si446x_startTXTest(void) {
+#if SI446X_USE_TX_TEST == TRUE
+  chSysLock();
+  si_tx_test.count = 0;
+  si_tx_test.done = 0;
+  si_tx_test.active = true;
+  chSysUnlock();
+#endif
+}
+
+/*
+ * Get the TX test record and optionally stop recording.
+ * A frame being sent when the test is stopped is still completed.
+ */
+void Si446x_getTXTest(si446x_tx_test_t *test, bool stop) {
+#if SI446X_USE_TX_TEST == TRUE
+  chSysLock();
+  if(stop)
+    si_tx_test.active = false;
+  *test = si_tx_test;
+  chSysUnlock();
+#else
+  (void)stop;
+  memset(test, 0, sizeof(*test));
+#endif
+}
+
+/*
+ * Set up the radio for AFSK transmit.
+ */
+static void Si446x_prepareAFSKTransmit(const radio_unit_t radio,
+                                       radio_task_object_t *rto) {
   /* Initialize radio before any commands as it may have been powered down. */
   Si446x_conditional_init(radio);
 
@@ -1264,13 +1912,48 @@ THD_FUNCTION(bloc_si_fifo_feeder_afsk, arg) {
 
   /* Set the radio for AFSK upsampled mode. */
   Si446x_setModemAFSK_TX(radio);
+}
+
+/*
+ * Simple AFSK feeder with minimized buffering and burst send capability.
+ * Runs in the radio TX worker thread.
+ * NRZI data is streamed from the encoder as the up-sampler needs it.
+ * Chained frames are sent as bursts which share one preamble and tail.
+ * The next burst is sized while the current burst is being sent.
+ * The next burst transmit starts as soon as the radio leaves TX state.
+ * If a higher priority send is queued the unsent packets are left in the
+ * task object to be resumed later.
+ */
+msg_t Si446x_feedAFSK(radio_task_object_t *rto) {
+  radio_unit_t radio = rto->handler->radio;
+
+  packet_t pp = rto->packet_out;
+
+  chDbgAssert(pp != NULL, "no packet in radio task");
+
+  txlat_mark(pp, TXLAT_FEED, true);
+
+  if(pktLockRadioTransmit(radio, TIME_INFINITE) == MSG_RESET) {
+    TRACE_ERROR("SI   > AFSK TX reset from radio acquisition");
+    /* Free packet object memory. */
+    pktReleaseBufferChain(pp);
+    rto->packet_out = NULL;
+    return MSG_RESET;
+  }
+
+  /* Hold off SD card transfers on the shared SPI bus while feeding. */
+  pspiOpenUrgent();
+  eprof_enter(EPROF_TX(rto->tx_priority));
+
+  Si446x_prepareAFSKTransmit(radio, rto);
 
   /* Initialize variables for AFSK encoder. */
   virtual_timer_t send_timer;
 
   chVTObjectInit(&send_timer);
-  msg_t exit_msg;
+  msg_t exit_msg = MSG_OK;
   tx_iterator_t iterator;
+  tx_iterator_t next_iterator;
 
   /*
    * Use the specified CCA RSSI level.
@@ -1278,50 +1961,40 @@ THD_FUNCTION(bloc_si_fifo_feeder_afsk, arg) {
    */
   radio_squelch_t rssi = rto->squelch;
 
-  do {
-
-    /*
-     * Set NRZI encoding format.
-     * Iterator object.
-     * Packet reference.
-     * Preamble length (HDLC flags)
-     * Postamble length (HDLC flags)
-     * Tail length (HDLC zeros)
-     * Scramble off
-     */
-    pktStreamIteratorInit(&iterator, pp, 30, 10, 10, false);
-
-    uint16_t all = pktStreamEncodingIterator(&iterator, NULL, 0);
+  /* Size the first burst. Following bursts are sized during send. */
+  uint16_t nrzi_size = Si446x_initAFSKEncode(&iterator, pp);
 
-    if(all == 0) {
-      /* Nothing encoded. Release packet send object. */
+  do {
+    /* Defer to the TX worker if channel access is not granted. */
+    if(rssi != PKT_SI446X_NO_CCA_RSSI
+        && !Si446x_acquireChannel(radio, rto, rssi))
+      break;
+    rssi = PKT_SI446X_NO_CCA_RSSI;
 
+    if(nrzi_size == 0) {
+      /* Nothing encoded. Release packet send objects. */
       TRACE_ERROR("SI   > AFSK TX no NRZI data encoded");
 
       /* Free packet object memory. */
       pktReleaseBufferChain(pp);
-
-      /* Schedule thread and task object memory release. */
-      pktLLDradioSendComplete(rto, chThdGetSelfX());
-
-      /* Unlock radio. */
-      pktUnlockRadioTransmit(radio);
-
-      /* Exit thread. */
-      chThdExit(MSG_ERROR);
-      /* We never arrive here. */
+      pp = NULL;
+      exit_msg = MSG_ERROR;
+      break;
     }
-    /* Allocate buffer and perform NRZI encoding. */
-    uint8_t layer0[all];
-    pktStreamEncodingIterator(&iterator, layer0, all);
 
-    all *= SAMPLES_PER_BAUD;
+    /* The packet after the burst (if any) is sized during send. */
+    packet_t np = Si446x_getBurstNext(pp, iterator.frames);
+    uint16_t next_size = 0;
+    bool next_done = (np == NULL);
+
+    uint16_t all = nrzi_size * SAMPLES_PER_BAUD;
     /* Reset TX FIFO in case some remnant unsent data is left there. */
     const uint8_t reset_fifo[] = {0x15, 0x01};
     Si446x_write(radio, reset_fifo, 2);
 
     up_sampler_t upsampler = {0};
     upsampler.phase_delta = PHASE_DELTA_1200;
+    upsampler.iterator = &iterator;
 
     /* Maximum amount of FIFO data when using combined TX+RX (safe size). */
     uint8_t localBuffer[Si446x_FIFO_COMBINED_SIZE];
@@ -1332,6 +2005,8 @@ THD_FUNCTION(bloc_si_fifo_feeder_afsk, arg) {
     /* Calculate initial FIFO fill. */
     uint16_t c = (all > free) ? free : all;
 
+    Si446x_txTestBegin(all, ((uint64_t)all * 8 * 1000000) / PLAYBACK_RATE);
+
     /*
      * Start transmission timeout timer.
      * If the 446x gets locked up we'll exit TX and release packet object.
@@ -1341,10 +2016,11 @@ THD_FUNCTION(bloc_si_fifo_feeder_afsk, arg) {
 
     /* The exit message if all goes well. */
     exit_msg = MSG_OK;
+    systime_t rf_start = 0;
 
     /* Initial FIFO load. */
     for(uint16_t i = 0;  i < c; i++)
-      localBuffer[i] = Si446x_getUpsampledNRZIbits(&upsampler, layer0);
+      localBuffer[i] = Si446x_getUpsampledNRZIbits(&upsampler);
     Si446x_writeFIFO(radio, localBuffer, c);
 
     uint8_t lower = 0;
@@ -1355,40 +2031,58 @@ THD_FUNCTION(bloc_si_fifo_feeder_afsk, arg) {
                        rto->step_hz,
                        rto->channel,
                        rto->tx_power,
-                       all,
-                       rssi,
-                       TIME_S2I(10))) {
+                       all)) {
+      Si446x_txTestStart();
+      txlat_mark(pp, TXLAT_RF, false);
+      rf_start = chVTGetSystemTime();
+
+      /* Refill the FIFO when woken by the FIFO almost empty interrupt. */
+      Si446x_enableTXFIFOInterrupt(radio);
 
       /* Feed the FIFO while data remains to be sent. */
       while((all - c) > 0) {
+        rtcnt_t wake = Si446x_txTestNow();
         /* Get TX FIFO free count. */
         uint8_t more = Si446x_getTXfreeFIFO(radio);
         /* Update the FIFO free low water mark. */
         lower = (more > lower) ? more : lower;
+        Si446x_txTestLevel(more);
 
         /* If there is more free than we need use remainder only. */
         more = (more > (all - c)) ? (all - c) : more;
 
         /* Load the FIFO. */
         for(uint16_t i = 0; i < more; i++)
-          localBuffer[i] = Si446x_getUpsampledNRZIbits(&upsampler, layer0);
+          localBuffer[i] = Si446x_getUpsampledNRZIbits(&upsampler);
         Si446x_writeFIFO(radio, localBuffer, more); // Write into FIFO
         c += more;
 
+        /* Release NIRQ now the FIFO is above threshold. */
+        Si446x_clearTXFIFOInterrupt(radio);
+        Si446x_txTestRefill(wake);
+
+        /* Use the FIFO refill slack to size the next burst. */
+        if(!next_done) {
+          next_size = Si446x_initAFSKEncode(&next_iterator, np);
+          next_done = true;
+        }
+
         /*
-         * Wait for a timeout event during up-sampled NRZI send.
-         * Time delay allows ~SAMPLES_PER_BAUD bytes to be consumed from FIFO.
-         * If no timeout event go back and load more data to FIFO.
+         * Wait for the FIFO almost empty or a timeout event.
+         * The wait time is a fallback for when the FIFO reaches threshold.
          */
-        eventmask_t evt = chEvtWaitAnyTimeout(SI446X_EVT_TX_TIMEOUT,
-                                              chTimeUS2I(833 * 8));
-        if(evt) {
+        eventmask_t evt = chEvtWaitAnyTimeout(SI446X_EVT_TX_TIMEOUT
+                                              | SI446X_EVT_TX_FIFO,
+            chTimeUS2I((Si446x_FIFO_COMBINED_SIZE - SI446X_TX_FIFO_THRESHOLD)
+                       * SI446X_AFSK_FIFO_BYTE_US));
+        if(evt & SI446X_EVT_TX_TIMEOUT) {
           /* Force 446x out of TX state. */
           Si446x_setReadyState(radio);
           exit_msg = MSG_TIMEOUT;
           break;
         }
       }
+      Si446x_disableTXFIFOInterrupt(radio);
     } else {
       /* Transmit start failed. */
       TRACE_ERROR("SI   > Transmit start failed");
@@ -1397,19 +2091,29 @@ THD_FUNCTION(bloc_si_fifo_feeder_afsk, arg) {
     chVTReset(&send_timer);
 
     /*
-     * If nothing went wrong wait for TX to finish.
-     * Else don't wait.
+     * If nothing went wrong size the next burst if not yet done.
+     * Then wait for TX to finish. Else don't wait.
      */
-    while(Si446x_getState(radio) == Si446x_STATE_TX && exit_msg == MSG_OK) {
-      /* TODO: Add an absolute timeout on this. */
-      /* Sleep for an AFSK byte time. */
-      chThdSleep(chTimeUS2I(833 * 8));
-      continue;
+    if(exit_msg == MSG_OK) {
+      if(!next_done)
+        next_size = Si446x_initAFSKEncode(&next_iterator, np);
+
+      /* Sleep for the time taken to send the data still in the FIFO. */
+      uint8_t left = Si446x_getTXfreeFIFO(radio);
+      left = (free > left) ? (free - left) : 0;
+      if(left > 0)
+        chThdSleep(chTimeUS2I(left * SI446X_AFSK_FIFO_BYTE_US));
+
+      /* Then poll at FIFO byte time so the next burst can start promptly. */
+      while(Si446x_getState(radio) == Si446x_STATE_TX) {
+        /* TODO: Add an absolute timeout on this. */
+        chThdSleep(chTimeUS2I(SI446X_AFSK_FIFO_BYTE_US));
+      }
     }
+    Si446x_txTestEnd(exit_msg);
 
-    /* No CCA on subsequent packet sends. */
-    rssi = PKT_SI446X_NO_CCA_RSSI;
-
+    /* Highest TX FIFO free level of the frame. */
+    stats_sample(&si_stats_afsk_fifo, lower);
     if(lower > (free / 2)) {
       /*
        *  Warn when free level is more than 50% of FIFO size.
@@ -1417,11 +2121,9 @@ THD_FUNCTION(bloc_si_fifo_feeder_afsk, arg) {
        */
       TRACE_WARN("SI   > AFSK TX FIFO dropped below safe threshold %i", lower);
     }
-    /* Get the next linked packet to send. */
-    packet_t np = pp->nextp;
     if(exit_msg == MSG_OK) {
-      /* Send was OK. Release the just completed packet. */
-      pktReleaseBufferObject(pp);
+      /* Send was OK. Release the packets of the burst. */
+      Si446x_releaseBurst(rto, pp, iterator.frames, rf_start);
     } else {
       /* Send failed so release any queue and terminate. */
       pktReleaseBufferChain(pp);
@@ -1430,42 +2132,46 @@ THD_FUNCTION(bloc_si_fifo_feeder_afsk, arg) {
 
     /* Process next packet. */
     pp = np;
-  } while(pp != NULL);
 
-  /* Save status in case a callback requires it. */
-  rto->result = exit_msg;
+    /* The next burst encoder becomes the current one. */
+    iterator = next_iterator;
+    nrzi_size = next_size;
 
-  /* Finished send so schedule thread memory and task object release. */
-  pktLLDradioSendComplete(rto, chThdGetSelfX());
+    /* A queued higher priority send takes the radio between packets. */
+    if(pp != NULL && pktIsRadioTransmitPreempted(rto))
+      break;
+
+    /* Let a waiting higher priority radio user in between packets. */
+    if(pp != NULL && pktYieldRadioTransmit(radio)) {
+      /* The radio may have been set up by the other user. */
+      Si446x_prepareAFSKTransmit(radio, rto);
+      rssi = rto->squelch;
+    }
+  } while(pp != NULL);
+
+  /* Packets not sent (if any) are resumed by the TX worker. */
+  rto->packet_out = pp;
 
   /* Unlock radio. */
+  eprof_leave(EPROF_TX(rto->tx_priority));
+  pspiCloseUrgent();
   pktUnlockRadioTransmit(radio);
 
-  /* Exit thread. */
-  chThdExit(exit_msg);
+  return exit_msg;
 }
 
 /*
- *
+ * Return true on send successfully queued to the radio TX worker.
+ * Task object will be returned through a TX done task.
+ * Return false on failure.
  */
 bool Si446x_blocSendAFSK(radio_task_object_t *rt) {
 
-    thread_t *afsk_feeder_thd = NULL;
-
-    /* Create a send thread name which includes the sequence number. */
-    char tx_thd_name[16];
-    chsnprintf(tx_thd_name, sizeof(tx_thd_name),
-               "tx_afsk_%03i", rt->tx_seq_num);
-
-    afsk_feeder_thd = chThdCreateFromHeap(NULL,
-                THD_WORKING_AREA_SIZE(SI_AFSK_FIFO_MIN_FEEDER_WA_SIZE),
-                tx_thd_name,
-                NORMALPRIO - 10,
-                bloc_si_fifo_feeder_afsk,
-                rt);
+    /* Set up the up-sampler symbol table on first use. */
+    Si446x_initAFSKSymbolTable();
 
-    if(afsk_feeder_thd == NULL) {
-      TRACE_ERROR("SI   > Unable to create AFSK transmit thread");
+    if(!pktQueueRadioTransmit(rt)) {
+      TRACE_ERROR("SI   > No transmit worker for AFSK send");
       return false;
     }
     return true;
@@ -1484,42 +2190,52 @@ void Si446x_stopDecoder(void) {
  */
 
 /*
- * New 2FSK send thread using minimized buffer space and burst send.
+ * Set up the radio for 2FSK transmit.
  */
-THD_FUNCTION(bloc_si_fifo_feeder_fsk, arg) {
-  radio_task_object_t *rto = arg;
+static void Si446x_prepare2FSKTransmit(const radio_unit_t radio,
+                                       radio_task_object_t *rto) {
+  /* Initialize radio before any commands as it may have been powered down. */
+  Si446x_conditional_init(radio);
+
+  /* Set 446x back to READY from RX (if active). */
+  Si446x_terminateReceive(radio);
+
+  /* Base frequency must be an absolute frequency in Hz. */
+  Si446x_setBandParameters(radio, rto->base_frequency, rto->step_hz);
+
+  /* Set parameters for 2FSK transmission. */
+  Si446x_setModem2FSK_TX(radio, rto->tx_speed);
+}
 
+/*
+ * 2FSK feeder using minimized buffer space and burst send.
+ * Runs in the radio TX worker thread.
+ * If a higher priority send is queued the unsent packets are left in the
+ * task object to be resumed later.
+ */
+msg_t Si446x_feed2FSK(radio_task_object_t *rto) {
   radio_unit_t radio = rto->handler->radio;
 
   packet_t pp = rto->packet_out;
 
   chDbgAssert(pp != NULL, "no packet in radio task");
 
+  txlat_mark(pp, TXLAT_FEED, true);
+
   /* Check for MSG_RESET which means system has forced radio release. */
   if(pktLockRadioTransmit(radio, TIME_INFINITE) == MSG_RESET) {
     TRACE_ERROR("SI   > 2FSK TX reset from radio acquisition");
     /* Free packet object memory. */
     pktReleaseBufferChain(pp);
-
-    /* Schedule thread and task object memory release. */
-    pktLLDradioSendComplete(rto, chThdGetSelfX());
-
-    /* Exit thread. */
-    chThdExit(MSG_RESET);
-    /* We never arrive here. */
+    rto->packet_out = NULL;
+    return MSG_RESET;
   }
 
-  /* Initialize radio before any commands as it may have been powered down. */
-  Si446x_conditional_init(radio);
+  /* Hold off SD card transfers on the shared SPI bus while feeding. */
+  pspiOpenUrgent();
+  eprof_enter(EPROF_TX(rto->tx_priority));
 
-  /* Set 446x back to READY from RX (if active). */
-  Si446x_terminateReceive(radio);
-
-  /* Base frequency must be an absolute frequency in Hz. */
-  Si446x_setBandParameters(radio, rto->base_frequency, rto->step_hz);
-
-  /* Set parameters for 2FSK transmission. */
-  Si446x_setModem2FSK_TX(radio, rto->tx_speed);
+  Si446x_prepare2FSKTransmit(radio, rto);
 
   /* Initialize variables for 2FSK encoder. */
 
@@ -1530,7 +2246,7 @@ THD_FUNCTION(bloc_si_fifo_feeder_fsk, arg) {
   tx_iterator_t iterator;
 
   /* The exit message. */
-  msg_t exit_msg;
+  msg_t exit_msg = MSG_OK;
 
   /*
    * Use the specified CCA RSSI level.
@@ -1539,16 +2255,26 @@ THD_FUNCTION(bloc_si_fifo_feeder_fsk, arg) {
   radio_squelch_t rssi = rto->squelch;
 
   do {
+    /* Defer to the TX worker if channel access is not granted. */
+    if(rssi != PKT_SI446X_NO_CCA_RSSI
+        && !Si446x_acquireChannel(radio, rto, rssi))
+      break;
+    rssi = PKT_SI446X_NO_CCA_RSSI;
+
     /*
-     * Set NRZI encoding format.
+     * Set NRZI encoding format for a burst of the frames chained from pp.
      * Iterator object.
      * Packet reference.
      * Preamble length (HDLC flags)
+     * Gap length between frames (HDLC flags)
      * Postamble length (HDLC flags)
      * Tail length (HDLC zeros)
      * Scramble on
+     * Burst size limit
      */
-    pktStreamIteratorInit(&iterator, pp, 30, 10, 10, true);
+    pktStreamIteratorInitBurst(&iterator, pp, SI446X_2FSK_PREAMBLE,
+                               SI446X_BURST_GAP, SI446X_2FSK_POSTAMBLE,
+                               SI446X_2FSK_TAIL, true, SI446X_TX_MAX_LEN);
 
     /* Compute size of NRZI stream. */
     uint16_t all = pktStreamEncodingIterator(&iterator, NULL, 0);
@@ -1559,23 +2285,16 @@ THD_FUNCTION(bloc_si_fifo_feeder_fsk, arg) {
 
       /* Free packet object memory. */
       pktReleaseBufferChain(pp);
-
-      rto->result = MSG_ERROR;
-
-      /* Schedule thread and task object memory release. */
-      pktLLDradioSendComplete(rto, chThdGetSelfX());
+      rto->packet_out = NULL;
 
       /* Unlock radio. */
+      eprof_leave(EPROF_TX(rto->tx_priority));
+      pspiCloseUrgent();
       pktUnlockRadioTransmit(radio);
-
-      /* Exit thread. */
-      chThdExit(MSG_ERROR);
-      /* We never arrive here. */
+      return MSG_ERROR;
     }
-    /* Allocate buffer and perform NRZI encoding. */
-    uint8_t layer0[all];
-
-    pktStreamEncodingIterator(&iterator, layer0, all);
+    /* NRZI data is encoded into the FIFO as the send proceeds. */
+    uint8_t localBuffer[Si446x_FIFO_COMBINED_SIZE];
 
     /* Reset TX FIFO in case some remnant unsent data is left there. */
     const uint8_t reset_fifo[] = {0x15, 0x01};
@@ -1587,21 +2306,24 @@ THD_FUNCTION(bloc_si_fifo_feeder_fsk, arg) {
     /* Calculate initial FIFO fill. */
     uint16_t c = (all > free) ? free : all;
 
+    Si446x_txTestBegin(all, ((uint64_t)all * 8 * 1000000) / rto->tx_speed);
+
     /*
-     * Start/re-start transmission timeout timer for this packet.
+     * Start/re-start transmission timeout timer for this burst.
+     * A long burst at low rate can take more than the base time on air.
      * If the 446x gets locked up we'll exit TX and release packet object(s).
      */
-    chVTSet(&send_timer, TIME_S2I(10),
+    chVTSet(&send_timer, TIME_S2I(10)
+            + TIME_MS2I(((uint32_t)all * 8 * 1000) / rto->tx_speed),
             (vtfunc_t)Si446x_transmitTimeoutI, chThdGetSelfX());
 
     /* The exit message if all goes well. */
     exit_msg = MSG_OK;
-
-    uint8_t *bufp = layer0;
+    systime_t rf_start = 0;
 
     /* Initial FIFO load. */
-    Si446x_writeFIFO(radio, bufp, c);
-    bufp += c;
+    pktStreamEncodingIterator(&iterator, localBuffer, c);
+    Si446x_writeFIFO(radio, localBuffer, c);
     uint8_t lower = 0;
 
     /* Request start of transmission. */
@@ -1610,38 +2332,53 @@ THD_FUNCTION(bloc_si_fifo_feeder_fsk, arg) {
                        rto->step_hz,
                        rto->channel,
                        rto->tx_power,
-                       all,
-                       rssi,
-                       TIME_S2I(10))) {
+                       all)) {
+      Si446x_txTestStart();
+      txlat_mark(pp, TXLAT_RF, false);
+      rf_start = chVTGetSystemTime();
+
+      /* Refill the FIFO when woken by the FIFO almost empty interrupt. */
+      Si446x_enableTXFIFOInterrupt(radio);
+
       /* Feed the FIFO while data remains to be sent. */
       while((all - c) > 0) {
+        rtcnt_t wake = Si446x_txTestNow();
         /* Get TX FIFO free count. */
         uint8_t more = Si446x_getTXfreeFIFO(radio);
         /* Update the FIFO free low water mark. */
         lower = (more > lower) ? more : lower;
+        Si446x_txTestLevel(more);
 
         /* If there is more free than we need for send use remainder only. */
         more = (more > (all - c)) ? (all - c) : more;
 
-        /* Load the FIFO. */
-        Si446x_writeFIFO(radio, bufp, more); // Write into FIFO
-        bufp += more;
-        c += more;
+        /* Load the FIFO. A zero quantity would only count the stream. */
+        if(more > 0) {
+          pktStreamEncodingIterator(&iterator, localBuffer, more);
+          Si446x_writeFIFO(radio, localBuffer, more); // Write into FIFO
+          c += more;
+        }
+
+        /* Release NIRQ now the FIFO is above threshold. */
+        Si446x_clearTXFIFOInterrupt(radio);
+        Si446x_txTestRefill(wake);
 
         /*
-         * Wait for a timeout event during up-sampled NRZI send.
-         * Time delay allows ~10 bytes to be consumed from FIFO.
-         * If no timeout event go back and load more data to FIFO.
+         * Wait for the FIFO almost empty or a timeout event.
+         * The wait time is a fallback for when the FIFO reaches threshold.
          */
-        eventmask_t evt = chEvtWaitAnyTimeout(SI446X_EVT_TX_TIMEOUT,
-                                              chTimeUS2I(104 * 8 * 10));
-        if(evt) {
+        eventmask_t evt = chEvtWaitAnyTimeout(SI446X_EVT_TX_TIMEOUT
+                                              | SI446X_EVT_TX_FIFO,
+            chTimeUS2I(((Si446x_FIFO_COMBINED_SIZE - SI446X_TX_FIFO_THRESHOLD)
+                        * 8 * 1000000) / rto->tx_speed));
+        if(evt & SI446X_EVT_TX_TIMEOUT) {
           /* Force 446x out of TX state. */
           Si446x_setReadyState(radio);
           exit_msg = MSG_TIMEOUT;
           break;
         }
       }
+      Si446x_disableTXFIFOInterrupt(radio);
     } else {
       /* Transmit start failed. */
       TRACE_ERROR("SI   > 2FSK transmit start failed");
@@ -1655,24 +2392,24 @@ THD_FUNCTION(bloc_si_fifo_feeder_fsk, arg) {
      */
     while(Si446x_getState(radio) == Si446x_STATE_TX && exit_msg == MSG_OK) {
       /* TODO: Add an absolute timeout on this. */
-      /* Sleep for a 2FSK byte time. */
-      chThdSleep(chTimeUS2I(104 * 8 * 10));
+      /* Sleep for 10 2FSK byte times. */
+      chThdSleep(chTimeUS2I((10 * 8 * 1000000) / rto->tx_speed));
       continue;
     }
+    Si446x_txTestEnd(exit_msg);
 
-    /* No CCA on subsequent packet sends. */
-    rssi = PKT_SI446X_NO_CCA_RSSI;
-
+    /* Highest TX FIFO free level of the frame. */
+    stats_sample(&si_stats_2fsk_fifo, lower);
     if(lower > (free / 2)) {
       /* Warn when free level is > 50% of FIFO size. */
       TRACE_WARN("SI   > AFSK TX FIFO dropped below safe threshold %i", lower);
     }
-    /* Get the next linked packet to send. */
-    packet_t np = pp->nextp;
+    /* Get the packet following the burst. */
+    packet_t np = Si446x_getBurstNext(pp, iterator.frames);
     if(exit_msg == MSG_OK) {
 
-      /* Send was OK. Release the just completed packet. */
-      pktReleaseBufferObject(pp);
+      /* Send was OK. Release the packets of the burst. */
+      Si446x_releaseBurst(rto, pp, iterator.frames, rf_start);
     } else {
       /* Send failed so release any queue and terminate. */
       pktReleaseBufferChain(pp);
@@ -1681,44 +2418,44 @@ THD_FUNCTION(bloc_si_fifo_feeder_fsk, arg) {
 
     /* Process next packet. */
     pp = np;
-  } while(pp != NULL);
 
-  /* Save status in case a callback requires it. */
-  rto->result = exit_msg;
+    /* A queued higher priority send takes the radio between packets. */
+    if(pp != NULL && pktIsRadioTransmitPreempted(rto))
+      break;
 
-  /* Finished send so schedule thread memory and task object release. */
-  pktLLDradioSendComplete(rto, chThdGetSelfX());
+    /* Let a waiting higher priority radio user in between packets. */
+    if(pp != NULL && pktYieldRadioTransmit(radio)) {
+      /* The radio may have been set up by the other user. */
+      Si446x_prepare2FSKTransmit(radio, rto);
+      rssi = rto->squelch;
+    }
+  } while(pp != NULL);
+
+  /* Packets not sent (if any) are resumed by the TX worker. */
+  rto->packet_out = pp;
 
   /* Unlock radio. */
+  eprof_leave(EPROF_TX(rto->tx_priority));
+  pspiCloseUrgent();
   pktUnlockRadioTransmit(radio);
 
-  /* Exit thread. */
-  chThdExit(exit_msg);
+  return exit_msg;
 }
 
 /*
- * Return true on send successfully enqueued.
- * Task object will be returned
- * Return false on failure
+ * Return true on send successfully queued to the radio TX worker.
+ * Task object will be returned through a TX done task.
+ * Return false on failure.
  */
 bool Si446x_blocSend2FSK(radio_task_object_t *rt) {
 
-  thread_t *fsk_feeder_thd = NULL;
-
-  /* Create a send thread name which includes the sequence number. */
-  char tx_thd_name[16];
-  chsnprintf(tx_thd_name, sizeof(tx_thd_name),
-             "tx_2fsk_%03i", rt->tx_seq_num);
-
-  fsk_feeder_thd = chThdCreateFromHeap(NULL,
-              THD_WORKING_AREA_SIZE(SI_FSK_FIFO_FEEDER_WA_SIZE),
-              tx_thd_name,
-              NORMALPRIO - 10,
-              bloc_si_fifo_feeder_fsk,
-              rt);
+  if(Si446x_get2FSKProfile(rt->tx_speed) == NULL) {
+    TRACE_ERROR("SI   > 2FSK speed %d is not supported", rt->tx_speed);
+    return false;
+  }
 
-  if(fsk_feeder_thd == NULL) {
-    TRACE_ERROR("SI   > Unable to create FSK transmit thread");
+  if(!pktQueueRadioTransmit(rt)) {
+    TRACE_ERROR("SI   > No transmit worker for 2FSK send");
     return false;
   }
   return true;
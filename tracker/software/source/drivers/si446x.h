@@ -11,11 +11,15 @@
 #ifndef __si446x__H__
 #define __si446x__H__
 
+#include "pktconf.h"
+
 /*===========================================================================*/
 /* Module constants.                                                         */
 /*===========================================================================*/
 
 #define SI446X_EVT_TX_TIMEOUT                   EVENT_MASK(0)
+#define SI446X_EVT_TX_FIFO                      EVENT_MASK(1)
+#define SI446X_EVT_CTS                          EVENT_MASK(2)
 
 #define Si446x_LOCK_BY_SEMAPHORE                TRUE
 
@@ -59,6 +63,19 @@
 /* Defined response values. */
 #define Si446x_COMMAND_CTS                      0xFF
 
+/* Maximum number of properties in one SET_PROPERTY command. */
+#define Si446x_MAX_SET_PROPERTIES               12
+
+/* NIRQ pin modes. */
+#define Si446x_NIRQ_MODE_CCA                    0x1B
+#define Si446x_GPIO_MODE_RX_DATA                0x14
+#define Si446x_GPIO_MODE_RAW_RX_DATA            0x15
+#define Si446x_NIRQ_MODE_NIRQ                   0x27
+
+/* Interrupt enable and pending bits. */
+#define Si446x_INT_PH                           0x01
+#define Si446x_PH_TX_FIFO_ALMOST_EMPTY          0x02
+
 /*
  * Property group commands.
  * Format is 0xGGNN (GG = group, NN = number).
@@ -68,6 +85,7 @@
 #define Si446x_GLOBAL_CONFIG                    0x0003
 
 #define Si446x_INT_CTL_ENABLE                   0x0100
+#define Si446x_INT_CTL_PH_ENABLE                0x0101
 #define Si446x_INT_CTL_MODEM_ENABLE             0x0102
 
 #define Si446x_FRR_CTL_A_MODE                   0x0200
@@ -88,6 +106,7 @@
 #define Si446x_PKT_CONFIG1                      0x1206
 #define Si446x_PKT_LEN                          0x1208
 #define Si446x_PKT_LEN_FIELD_SOURCE             0x1209
+#define Si446x_PKT_TX_THRESHOLD                 0x120B
 
 #define Si446x_MODEM_MOD_TYPE                   0x2000
 #define Si446x_MODEM_MAP_CONTROL                0x2001
@@ -95,6 +114,7 @@
 #define Si446x_MODEM_DATA_RATE                  0x2003
 #define Si446x_MODEM_TX_NCO_MODE                0x2006
 #define Si446x_MODEM_FREQ_DEV                   0x200A
+#define Si446x_MODEM_TX_FILTER_COEFF_8          0x200F
 #define Si446x_MODEM_TX_RAMP_DELAY              0x2018
 #define Si446x_MODEM_MDM_CTRL                   0x2019
 #define Si446x_MODEM_IF_CONTROL                 0x201A
@@ -204,12 +224,41 @@
 
 #define PKT_SI446X_NO_CCA_RSSI                  0xFF
 
+/* Number of cached synthesizer frequency plans per radio. */
+#define SI446X_FREQ_PLAN_CACHE_SIZE             8
+/* Resolution of the oscillator correction in the plan cache (ppb). */
+#define SI446X_FREQ_PLAN_PPB_STEP               50
+
 #define Si446x_FIFO_SEPARATE_SIZE                64
 #define Si446x_FIFO_COMBINED_SIZE               129
 
-#define SI_AFSK_FIFO_MIN_FEEDER_WA_SIZE         1024
+#define SI_AFSK_FIFO_MIN_FEEDER_WA_SIZE         768
+
+/*
+ * TX FIFO almost empty interrupt threshold (free bytes).
+ * The feeder is woken at this level to refill the FIFO.
+ */
+#define SI446X_TX_FIFO_THRESHOLD                (Si446x_FIFO_COMBINED_SIZE / 2)
+
+/*
+ * CTS wait. Most commands complete in tens of microseconds so CTS is
+ * polled without delay for the spin time. Long commands (POWER_UP, patch,
+ * calibration) are then waited for in ticks up to the timeout.
+ */
+#define SI446X_CTS_SPIN_US                      250
+#define SI446X_CTS_TIMEOUT_MS                   100
+
+/*
+ * Record feeder timing of the frames sent after Si446x_startTXTest().
+ * Used by the txtest command to measure FIFO margin and frame gaps.
+ */
+#define SI446X_USE_TX_TEST                      TRUE
+#define SI446X_TX_TEST_FRAMES                   32
 #define SI_FSK_FIFO_FEEDER_WA_SIZE              1024
 
+/* The radio TX worker runs both feeders so use the larger. */
+#define SI_TX_WORKER_WA_SIZE                    SI_FSK_FIFO_FEEDER_WA_SIZE
+
 /* AFSK NRZI up-sampler definitions. */
 #define PLAYBACK_RATE       13200
 #define BAUD_RATE           1200                                    /* APRS AFSK baudrate */
@@ -217,6 +266,56 @@
 #define PHASE_DELTA_1200    (((2 * 1200) << 16) / PLAYBACK_RATE)    /* Delta-phase per sample for 1200Hz tone */
 #define PHASE_DELTA_2200    (((2 * 2200) << 16) / PLAYBACK_RATE)    /* Delta-phase per sample for 2200Hz tone */
 
+/* AFSK transmit deviation in Hz. */
+#define SI446X_AFSK_DEVIATION       1300
+
+/*
+ * 2FSK (G3RUH compatible) transmit rates.
+ * Each rate has a modem profile in the driver.
+ */
+#define SI446X_2FSK_SPEED_4800      4800
+#define SI446X_2FSK_SPEED_9600      9600
+#define SI446X_2FSK_SPEED_DEFAULT   SI446X_2FSK_SPEED_9600
+
+/* AFSK HDLC framing in flags (preamble, postamble) and zeros (tail). */
+#define SI446X_AFSK_PREAMBLE        30
+#define SI446X_AFSK_POSTAMBLE       10
+#define SI446X_AFSK_TAIL            10
+
+/* 2FSK HDLC framing in flags (preamble, postamble) and zeros (tail). */
+#define SI446X_2FSK_PREAMBLE        30
+#define SI446X_2FSK_POSTAMBLE       10
+#define SI446X_2FSK_TAIL            10
+
+/*
+ * Chained frames are sent as a burst in one transmission with flags
+ * between the frames. A burst is limited by the 13 bit TX length of
+ * START_TX which counts FIFO bytes.
+ */
+#define SI446X_BURST_GAP            3
+#define SI446X_TX_MAX_LEN           0x1FFF
+
+/* NRZI bytes pulled from the encoder per up-sampler refill (one FIFO fill). */
+#define SI446X_AFSK_NRZI_CHUNK      ((Si446x_FIFO_COMBINED_SIZE              \
+                                      / SAMPLES_PER_BAUD) + 1)
+
+/*
+ * AFSK up-sampler symbol table phase buckets.
+ * One tone cycle covers 17 bits of phase.
+ */
+#define SI446X_AFSK_PHASE_BITS      17
+#define SI446X_AFSK_BUCKET_SHIFT    9
+#define SI446X_AFSK_PHASE_BUCKETS   (1U << (SI446X_AFSK_PHASE_BITS           \
+                                            - SI446X_AFSK_BUCKET_SHIFT))
+#define SI446X_AFSK_PHASE_MASK      ((1U << SI446X_AFSK_PHASE_BITS) - 1)
+
+#if SAMPLES_PER_BAUD > 16
+#error "AFSK up-sampler symbol table requires SAMPLES_PER_BAUD <= 16"
+#endif
+
+/* Time to send one up-sampled FIFO byte (8 samples). */
+#define SI446X_AFSK_FIFO_BYTE_US    ((8 * 1000000) / PLAYBACK_RATE)
+
 /*===========================================================================*/
 /* Module macros.                                                            */
 /*===========================================================================*/
@@ -242,10 +341,41 @@ typedef struct {
   uint32_t  phase_delta;            // 1200/2200 for standard AX.25
   uint32_t  phase;                  // Fixed point 9.7 (2PI = TABLE_SIZE)
   uint32_t  packet_pos;             // Index of next bit to be sent out
-  uint32_t  current_sample_in_baud; // 1 bit = SAMPLES_PER_BAUD samples
+  uint32_t  samples;                // Queued samples (LSB first)
+  uint8_t   sample_count;           // Number of queued samples
   uint8_t   current_byte;
+  tx_iterator_t *iterator;          // NRZI stream source
+  uint8_t   nrzi[SI446X_AFSK_NRZI_CHUNK];
+  uint8_t   nrzi_index;
+  uint8_t   nrzi_count;
 } up_sampler_t;
 
+/*
+ * Feeder timing of one test frame.
+ * Times are in realtime counter cycles except the air time.
+ */
+typedef struct {
+  uint16_t  bytes;                  // FIFO bytes of the frame
+  uint32_t  air_us;                 // Time on air of the FIFO bytes
+  uint8_t   free_min;               // Lowest TX FIFO free count at a refill
+  uint8_t   free_max;               // Highest, near FIFO size is an underrun
+  uint16_t  refills;
+  uint32_t  refill_peak;            // Wake of the feeder to FIFO refilled
+  uint32_t  refill_total;
+  uint32_t  spi;                    // FIFO SPI transfers of the frame
+  uint32_t  gap;                    // End of the previous frame to TX start
+  rtcnt_t   start;                  // TX start
+  rtcnt_t   end;                    // TX end seen by the feeder
+  msg_t     result;
+} si446x_tx_test_frame_t;
+
+typedef struct {
+  bool      active;
+  uint8_t   count;                  // Frames started
+  uint8_t   done;                   // Frames ended
+  si446x_tx_test_frame_t frame[SI446X_TX_TEST_FRAMES];
+} si446x_tx_test_t;
+
 /* MCU IO configuration for a specific radio. */
 typedef struct Si446x_MCUCFG {
 	const ioline_t	    gpio0;
@@ -284,9 +414,66 @@ typedef struct {
   uint8_t   info[10];
 } si446x_func_t;
 
+/* Modem configurations which can be loaded in the radio. */
+typedef enum {
+  SI446X_MODEM_NONE = 0,
+  SI446X_MODEM_AFSK_TX,
+  SI446X_MODEM_AFSK_RX,
+  SI446X_MODEM_2FSK_TX,
+  SI446X_MODEM_2FSK_RX
+} si446x_modem_t;
+
+/*
+ * 2FSK modem profile.
+ * The deviation keeps the modulation index the same at each rate.
+ * The RX decimation keeps the clock recovery over sampling near 14.
+ */
+typedef struct {
+  uint32_t          speed;
+  uint16_t          deviation;
+  uint8_t           rx_decimation;
+} si446x_2fsk_profile_t;
+
+/*
+ * Synthesizer settings for a frequency, step and oscillator correction.
+ */
+typedef struct {
+  radio_freq_t      freq;
+  channel_hz_t      step;
+  int32_t           ppb;
+  uint8_t           band;
+  uint8_t           fc_inte;
+  uint32_t          fc_frac;
+  uint16_t          fc_step;
+  uint8_t           outdiv;
+  bool              valid;
+} si446x_freq_plan_t;
+
 /* Data associated with a specific radio. */
 typedef struct Si446x_DAT {
   si446x_temp_t lastTemp;
+  /* Cache of computed frequency plans. Replaced in rotation. */
+  si446x_freq_plan_t plan[SI446X_FREQ_PLAN_CACHE_SIZE];
+  uint8_t           plan_next;
+  uint32_t          plan_hits;
+  uint32_t          plan_misses;
+  /*
+   * Shadow of the radio configuration.
+   * Only changed settings are written to the radio.
+   * The shadow is cleared when the radio is initialized.
+   */
+  radio_freq_t      band_freq;
+  channel_hz_t      band_step;
+  int32_t           band_ppb;
+  uint32_t          outdiv;
+  uint16_t          deviation;
+  si446x_modem_t    tx_modem;
+  uint32_t          tx_speed;
+  si446x_modem_t    rx_modem;
+  uint32_t          rx_speed;
+  si446x_modem_t    mod_type;
+  radio_pwr_t       power;
+  bool              power_set;
 } si446x_data_t;
 
 /* External. */
@@ -307,8 +494,13 @@ extern "C" {
   void Si446x_radioStandby(const radio_unit_t radio);
   void Si446x_sendAFSK(packet_t pp);
   bool Si446x_blocSendAFSK(radio_task_object_t *rto);
+  msg_t Si446x_feedAFSK(radio_task_object_t *rto);
+  uint32_t Si446x_upsampleAFSK(packet_t pp, uint8_t *buffer, uint16_t size);
+  void Si446x_startTXTest(void);
+  void Si446x_getTXTest(si446x_tx_test_t *test, bool stop);
   void Si446x_send2FSK(packet_t pp);
   bool Si446x_blocSend2FSK(radio_task_object_t *rto);
+  msg_t Si446x_feed2FSK(radio_task_object_t *rto);
   void Si446x_disableReceive(radio_unit_t radio);
   void Si446x_stopDecoder(void);
   bool Si4464_enableReceive(const radio_unit_t radio,
@@ -332,6 +524,7 @@ extern "C" {
                                 radio_freq_t freq,
                                 channel_hz_t step);
   radio_signal_t Si446x_getCurrentRSSI(const radio_unit_t radio);
+  void Si446x_setSquelch(const radio_unit_t radio, const radio_squelch_t rssi);
   ICUDriver *Si446x_attachPWM(const radio_unit_t radio);
   bool Si446x_detachPWM(const radio_unit_t radio);
   const ICUConfig *Si446x_enablePWMevents(const radio_unit_t radio, palcallback_t cb);
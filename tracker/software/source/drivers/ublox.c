@@ -9,11 +9,15 @@
 #include "pi2c.h"
 #include "debug.h"
 #include "config.h"
+#include "eprof.h"
 #include "collector.h"
 #include "portab.h"
+#include "pclock.h"
 
 bool gps_enabled = false;
 uint8_t gps_model = GPS_MODEL_PORTABLE;
+static bool gps_powered = false;
+static systime_t gps_power_time;
 
 #if defined(UBLOX_UART_CONNECTED)
 // Serial driver configuration for GPS
@@ -52,18 +56,41 @@ void gps_transmit_string(uint8_t *cmd, uint8_t length) {
 #endif
 }
 
+#if UBLOX_USE_I2C == TRUE
+/**
+  * DDC stream buffer.
+  * The available count is read once and then up to that many bytes are
+  * read in one transfer. Bytes are then taken from the buffer.
+  */
+static uint8_t gps_ddc_buf[UBLOX_DDC_BUFFER_SIZE];
+static uint16_t gps_ddc_pos = 0;
+static uint16_t gps_ddc_len = 0;
+
+static bool gps_fill_ddc_buffer(void) {
+	uint16_t avail;
+	if(!I2C_read16(UBLOX_MAX_ADDRESS, 0xFD, &avail) || avail == 0
+	   || avail == 0xFFFF)
+		return false;
+	if(avail > sizeof(gps_ddc_buf))
+		avail = sizeof(gps_ddc_buf);
+	if(!I2C_readN(UBLOX_MAX_ADDRESS, 0xFF, gps_ddc_buf, avail))
+		return false;
+	gps_ddc_pos = 0;
+	gps_ddc_len = avail;
+	return true;
+}
+#endif
+
 /**
   * Receives a single byte from the GPS and assigns to supplied pointer.
   * Returns false is there is no byte available else true
   */
 bool gps_receive_byte(uint8_t *data) {
 #if UBLOX_USE_I2C == TRUE
-	uint16_t len;
-	I2C_read16(UBLOX_MAX_ADDRESS, 0xFD, &len);
-	if(len) {
-		I2C_read8(UBLOX_MAX_ADDRESS, 0xFF, data);
-		return true;
-	}
+	if(gps_ddc_pos >= gps_ddc_len && !gps_fill_ddc_buffer())
+		return false;
+	*data = gps_ddc_buf[gps_ddc_pos++];
+	return true;
 #elif defined(UBLOX_UART_CONNECTED)
 	return sdReadTimeout(&SD5, data, 1, TIME_IMMEDIATE);
 #else
@@ -72,6 +99,36 @@ bool gps_receive_byte(uint8_t *data) {
     return false;
 }
 
+/**
+  * Waits up to the timeout for a byte from the GPS.
+  * The UART read sleeps until a byte arrives and returns at once.
+  * I2C has no data ready line so the DDC count is checked every 10ms.
+  * Returns false if no byte was received.
+  */
+static bool gps_wait_byte(uint8_t *data, sysinterval_t timeout) {
+#if UBLOX_USE_I2C == TRUE
+	if(gps_receive_byte(data))
+		return true;
+	chThdSleep(timeout < TIME_MS2I(10) ? timeout : TIME_MS2I(10));
+	return false;
+#elif defined(UBLOX_UART_CONNECTED)
+	return sdReadTimeout(&SD5, data, 1, timeout) == 1;
+#else
+	(void)data;
+	chThdSleep(timeout);
+	return false;
+#endif
+}
+
+/**
+  * Discards bytes received from the GPS but not read.
+  * Streamed messages queued earlier are then not taken as a response.
+  */
+static void gps_flush_input(void) {
+	uint8_t rx_byte;
+	while(gps_receive_byte(&rx_byte));
+}
+
 /**
   * gps_receive_ack
   *
@@ -96,10 +153,8 @@ uint8_t gps_receive_ack(uint8_t class_id, uint8_t msg_id, uint16_t timeout) {
 	while(sTimeout >= chVTGetSystemTimeX()) {
 
 		// Receive one byte
-		if(!gps_receive_byte(&rx_byte)) {
-			chThdSleep(TIME_MS2I(10));
+		if(!gps_wait_byte(&rx_byte, TIME_MS2I(10)))
 			continue;
-		}
 
 		// Process one byte
 		if (rx_byte == ack[match_count] || rx_byte == nak[match_count]) {
@@ -145,10 +200,8 @@ uint16_t gps_receive_payload(uint8_t class_id, uint8_t msg_id,
 	while(chVTIsSystemTimeWithin(sNow, sNow + TIME_MS2I(timeout))) {
 
 		// Receive one byte
-      if(!gps_receive_byte(&rx_byte)) {
-			chThdSleep(TIME_MS2I(1));
+		if(!gps_wait_byte(&rx_byte, TIME_MS2I(10)))
 			continue;
-		}
 
 		// Process one byte
 		switch (state) {
@@ -211,37 +264,15 @@ bool gps_get_sv_info(gps_svinfo_t *svinfo, size_t size) {
   return true;
 }
 
+static uint8_t navpvt[128];
+
 /**
-  * gps_get_fix
-  *
-  * retrieves a GPS fix from the module.
-  * if validity flag is not set, date/time and position/altitude are
-  * assumed not to be reliable!
-  *
+  * Extracts a fix from the NAV-PVT payload.
+  * The gnssFixOK flag of NAV-PVT is the fixOK flag of NAV-STATUS.
   */
-bool gps_get_fix(gpsFix_t *fix) {
-	static uint8_t navpvt[128];
-	static uint8_t navstatus[32];
-
-	// Transmit request
-	uint8_t navpvt_req[] = {0xB5, 0x62, 0x01, 0x07, 0x00, 0x00, 0x00, 0x00};
-	gps_transmit_string(navpvt_req, sizeof(navpvt_req));
-
-	if(!gps_receive_payload(0x01, 0x07, navpvt, sizeof(navpvt), 3000)) { // Receive request
-		TRACE_ERROR("GPS  > NAV-PVT Polling FAILED");
-		return false;
-	}
-
-	uint8_t navstatus_req[] = {0xB5, 0x62, 0x01, 0x03, 0x00, 0x00, 0x00, 0x00};
-	gps_transmit_string(navstatus_req, sizeof(navstatus_req));
-
-	if(!gps_receive_payload(0x01, 0x03, navstatus, sizeof(navstatus), 3000)) { // Receive request
-		TRACE_ERROR("GPS  > NAV-STATUS Polling FAILED");
-		return false;
-	}
-
+static void gps_parse_navpvt(gpsFix_t *fix) {
       // Extract data from message
-      fix->fixOK = navstatus[5] & 0x1;
+      fix->fixOK = navpvt[21] & 0x1;
       fix->pdop = navpvt[76] + (navpvt[77] << 8);
 
       fix->num_svs = navpvt[23];
@@ -280,6 +311,28 @@ bool gps_get_fix(gpsFix_t *fix) {
           fix->alt = (uint16_t)alt_tmp;
       }
       fix->model = gps_model;
+}
+
+/**
+  * gps_get_fix
+  *
+  * retrieves a GPS fix from the module.
+  * if validity flag is not set, date/time and position/altitude are
+  * assumed not to be reliable!
+  *
+  */
+bool gps_get_fix(gpsFix_t *fix) {
+	// Transmit request
+	uint8_t navpvt_req[] = {0xB5, 0x62, 0x01, 0x07, 0x00, 0x00, 0x00, 0x00};
+	gps_flush_input();
+	gps_transmit_string(navpvt_req, sizeof(navpvt_req));
+
+	if(!gps_receive_payload(0x01, 0x07, navpvt, sizeof(navpvt), 3000)) { // Receive request
+		TRACE_ERROR("GPS  > NAV-PVT Polling FAILED");
+		return false;
+	}
+
+	gps_parse_navpvt(fix);
 	TRACE_INFO("GPS  > Polling OK time=%04d-%02d-%02d %02d:%02d:%02d lat=%d.%05d lon=%d.%05d alt=%dm sats=%d fixOK=%d pDOP=%02d.%02d model=%s",
 		fix->time.year, fix->time.month, fix->time.day, fix->time.hour, fix->time.minute, fix->time.second,
 		fix->lat/10000000, (fix->lat > 0 ? 1:-1)*(fix->lat/100)%100000, fix->lon/10000000, (fix->lon > 0 ? 1:-1)*(fix->lon/100)%100000,
@@ -289,6 +342,104 @@ bool gps_get_fix(gpsFix_t *fix) {
 	return true;
 }
 
+/**
+  * gps_wait_fix
+  *
+  * waits for the next NAV-PVT solution output by the GPS.
+  * output must first be enabled with gps_set_navpvt_rate().
+  * the wait sleeps until the solution arrives so nothing is polled.
+  *
+  */
+bool gps_wait_fix(gpsFix_t *fix, uint16_t timeout) {
+	// Take the next solution rather than one queued earlier
+	gps_flush_input();
+	if(!gps_receive_payload(0x01, 0x07, navpvt, sizeof(navpvt), timeout)) {
+		TRACE_WARN("GPS  > NAV-PVT not received");
+		return false;
+	}
+
+	gps_parse_navpvt(fix);
+	TRACE_INFO("GPS  > Solution time=%04d-%02d-%02d %02d:%02d:%02d sats=%d fixOK=%d",
+		fix->time.year, fix->time.month, fix->time.day, fix->time.hour,
+		fix->time.minute, fix->time.second, fix->num_svs, fix->fixOK);
+	return true;
+}
+
+/**
+  * gps_set_navpvt_rate
+  *
+  * sets NAV-PVT output every rate solutions on the port in use.
+  * a rate of 0 stops the output.
+  *
+  * returns ACK/NAK result
+  *
+  */
+uint8_t gps_set_navpvt_rate(uint8_t rate) {
+	uint8_t msg[] = {
+		0xB5, 0x62, 0x06, 0x01, 3, 0x00,	// UBX-CFG-MSG
+		0x01, 0x07, rate,					// NAV-PVT, rate on current port
+		0x00, 0x00							// CRC place holders
+	};
+
+	gps_transmit_string(msg, sizeof(msg));
+	return gps_receive_ack(0x06, 0x01, 1000);
+}
+
+/**
+  * gps_send_position_aiding
+  *
+  * sends an approximate position as UBX-MGA-INI-POS_LLH.
+  * lat/lon are in 1e-7 degree, alt and acc are in m.
+  * MGA messages are not acknowledged unless enabled so no ACK is awaited.
+  *
+  */
+void gps_send_position_aiding(int32_t lat, int32_t lon, int32_t alt,
+                              uint32_t acc) {
+	uint8_t msg[] = {
+		0xB5, 0x62, 0x13, 0x40, 20, 0x00,	// UBX-MGA-INI
+		0x01, 0x00, 0x00, 0x00,				// POS_LLH, version, reserved
+		0x00, 0x00, 0x00, 0x00,				// lat
+		0x00, 0x00, 0x00, 0x00,				// lon
+		0x00, 0x00, 0x00, 0x00,				// alt (cm)
+		0x00, 0x00, 0x00, 0x00,				// posAcc (cm)
+		0x00, 0x00							// CRC place holders
+	};
+	int32_t v[] = {lat, lon, alt * 100, (int32_t)(acc * 100)};
+	for(uint8_t i = 0; i < 4; i++) {
+		msg[10 + 4*i] = v[i];
+		msg[11 + 4*i] = v[i] >> 8;
+		msg[12 + 4*i] = v[i] >> 16;
+		msg[13 + 4*i] = v[i] >> 24;
+	}
+
+	gps_transmit_string(msg, sizeof(msg));
+}
+
+/**
+  * gps_send_time_aiding
+  *
+  * sends the UTC time as UBX-MGA-INI-TIME_UTC.
+  * the time is taken as valid on receipt. acc is in s.
+  *
+  */
+void gps_send_time_aiding(ptime_t *time, uint16_t acc) {
+	uint8_t msg[] = {
+		0xB5, 0x62, 0x13, 0x40, 24, 0x00,	// UBX-MGA-INI
+		0x10, 0x00, 0x00, 0x80,				// TIME_UTC, version, ref none, leap seconds unknown
+		time->year & 0xFF, time->year >> 8,
+		time->month, time->day,
+		time->hour, time->minute,
+		time->second, 0x00,					// second, reserved
+		0x00, 0x00, 0x00, 0x00,				// ns
+		acc & 0xFF, acc >> 8,				// tAccS
+		0x00, 0x00,							// reserved
+		0x00, 0x00, 0x00, 0x00,				// tAccNs
+		0x00, 0x00							// CRC place holders
+	};
+
+	gps_transmit_string(msg, sizeof(msg));
+}
+
 /**
   * gps_disable_nmea_output
   *
@@ -588,15 +739,30 @@ bool gps_set_model(bool dynamic) {
 }
 
 /*
- *
+ * Switch on the GPS without waiting for its startup.
+ * Used at boot so the GPS starts while other modules are initialized.
  */
-bool GPS_Init() {
+void GPS_PowerUp(void) {
+	if(gps_powered)
+		return;
 	// Initialize pins
 	TRACE_INFO("GPS  > Init GPS pins");
 	palSetLineMode(LINE_GPS_RESET, PAL_MODE_OUTPUT_PUSHPULL);	// GPS reset
 	palSetLineMode(LINE_GPS_EN, PAL_MODE_OUTPUT_PUSHPULL);		// GPS off
 
+	// Switch MOSFET
+	TRACE_INFO("GPS  > Power up GPS");
+	palSetLine(LINE_GPS_RESET);	// Pull up GPS reset
+	palSetLine(LINE_GPS_EN);	// Switch on GPS
+	gps_power_time = chVTGetSystemTime();
+	gps_powered = true;
+	eprof_enter(EPROF_GPS);
+}
 
+/*
+ *
+ */
+bool GPS_Init() {
 #if defined(UBLOX_UART_CONNECTED) && UBLOX_USE_I2C == FALSE
     // Init and start UART
     TRACE_INFO("GPS  > Init GPS UART");
@@ -604,15 +770,15 @@ bool GPS_Init() {
     palSetLineMode(LINE_GPS_RXD, PAL_MODE_ALTERNATE(11));       // UART RXD
     palSetLineMode(LINE_GPS_TXD, PAL_MODE_ALTERNATE(11));       // UART TXD
 	sdStart(&SD5, &gps_config);
+	pclkRetimeSerial(&SD5);
 #endif
 
-	// Switch MOSFET
-	TRACE_INFO("GPS  > Power up GPS");
-	palSetLine(LINE_GPS_RESET);	// Pull up GPS reset
-	palSetLine(LINE_GPS_EN);	// Switch on GPS
-	
+	GPS_PowerUp();
+
 	// Wait for GPS startup
-	chThdSleep(TIME_S2I(1));
+	sysinterval_t up = chTimeDiffX(gps_power_time, chVTGetSystemTime());
+	if(up < TIME_S2I(1))
+		chThdSleep(TIME_S2I(1) - up);
 
 	gps_model = GPS_MODEL_PORTABLE;
 	// Configure GPS
@@ -639,6 +805,9 @@ void GPS_Deinit(void)
 	// Switch MOSFET
 	TRACE_INFO("GPS  > Power down GPS");
 	palClearLine(LINE_GPS_EN);
+	if(gps_powered)
+		eprof_leave(EPROF_GPS);
+	gps_powered = false;
 
 #if defined(UBLOX_UART_CONNECTED) && UBLOX_USE_I2C == FALSE
     // Stop and deinit UART
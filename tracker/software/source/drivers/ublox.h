@@ -57,6 +57,16 @@ typedef enum {
 #define UBLOX_USE_I2C           FALSE
 #define UBLOX_UART_CONNECTED
 
+// Accuracy given with aiding data
+#define UBLOX_AID_POS_ACC       100000  // Position from a prior fix (m)
+#define UBLOX_AID_TIME_ACC      2       // RTC time (s)
+
+// Wait for a streamed NAV-PVT solution (ms)
+#define UBLOX_SOLUTION_TIMEOUT  1500
+
+// DDC stream bytes read from the GPS by one I2C transfer
+#define UBLOX_DDC_BUFFER_SIZE   128
+
 #if     UBLOX_USE_I2C == FALSE && !defined(UBLOX_UART_CONNECTED)
 #warning "UBLOX has no I2C or UART communications enabled"
 #endif
@@ -104,7 +114,13 @@ uint8_t gps_set_power_save(void);
 uint8_t gps_power_save(int on);
 //uint8_t gps_save_settings(void);
 bool gps_get_fix(gpsFix_t *fix);
+bool gps_wait_fix(gpsFix_t *fix, uint16_t timeout);
+uint8_t gps_set_navpvt_rate(uint8_t rate);
+void gps_send_position_aiding(int32_t lat, int32_t lon, int32_t alt,
+                              uint32_t acc);
+void gps_send_time_aiding(ptime_t *time, uint16_t acc);
 bool gps_get_sv_info(gps_svinfo_t *svinfo, size_t size);
+void GPS_PowerUp(void);
 bool GPS_Init(void);
 void GPS_Deinit(void);
 uint32_t GPS_get_mcu_frequency(void);
@@ -6,10 +6,29 @@
 #include "ctype.h"
 #include "image.h"
 #include "aprs.h"
+#include "aprsmsg.h"
+#include "kiss.h"
 #include "radio.h"
 #include "commands.h"
 #include "pflash.h"
 #include "ublox.h"
+#include "pps.h"
+#include "sd.h"
+#include "pcrc.h"
+#include "stats.h"
+#include "threadprof.h"
+#include "watchdog.h"
+#include "budget.h"
+#include "memregion.h"
+#include "pclock.h"
+#include "ssdv.h"
+#include "bench.h"
+#include "txlatency.h"
+#include "fwupdate.h"
+#include "eprof.h"
+#include "tseries.h"
+#include "rfcapture.h"
+#include "loopback.h"
 #include <string.h>
 #include <time.h>
 
@@ -18,19 +37,39 @@ static uint8_t usb_buffer[16*1024] __attribute__((aligned(32))); // USB image bu
 const ShellCommand commands[] = {
     {"trace", usb_cmd_set_trace_level},
 	{"picture", usb_cmd_printPicture},
+	{"picture_bin", usb_cmd_printPictureBin},
 	{"print_log", usb_cmd_printLog},
+	{"log_bin", usb_cmd_printLogBin},
 	{"config", usb_cmd_printConfig},
 	{"msg", usb_cmd_send_aprs_message},
+	{"kiss", usb_cmd_kiss},
 
 #if SHELL_CMD_MEM_ENABLED == TRUE
     {"heap", usb_cmd_ccm_heap},
 #else
     {"mem", usb_cmd_ccm_heap},
 #endif
+    {"stats", usb_cmd_stats},
+    {"prof", usb_cmd_thread_prof},
+    {"wdg", usb_cmd_watchdog},
+    {"budget", usb_cmd_budget},
     {"sats", usb_cmd_get_gps_sat_info},
     {"error_list", usb_cmd_get_error_list},
     {"time", usb_cmd_time},
     {"radio", usb_cmd_radio},
+    {"afsk", usb_cmd_afsk_stats},
+    {"pwm", usb_cmd_pwm_pool},
+    {"events", usb_cmd_pkt_events},
+    {"replay", usb_cmd_pwm_replay},
+    {"ssdv", usb_cmd_ssdv_bench},
+    {"bench", usb_cmd_bench},
+    {"txtest", usb_cmd_tx_test},
+    {"loopback", usb_cmd_loopback},
+    {"latency", usb_cmd_tx_latency},
+    {"fwupdate", usb_cmd_fw_update},
+    {"energy", usb_cmd_energy},
+    {"series", usb_cmd_tseries},
+    {"capture", usb_cmd_rf_capture},
 	{NULL, NULL}
 };
 
@@ -86,21 +125,155 @@ void usb_cmd_ccm_heap(BaseSequentialStream *chp, int argc, char *argv[]) {
   chprintf(chp, "heap free total  : %u bytes"SHELL_NEWLINE_STR, total);
   chprintf(chp, "heap free largest: %u bytes"SHELL_NEWLINE_STR, largest);
 
-  extern memory_heap_t *ccm_heap;
-  if(ccm_heap == NULL) {
-    chprintf(chp, SHELL_NEWLINE_STR"CCM Heap not enabled"SHELL_NEWLINE_STR);
+  ax25_pkt_class_t sc;
+  for(sc = AX25_PKT_SMALL; sc < AX25_PKT_CLASSES; sc++) {
+    ax25_pool_stats_t pool;
+    ax25_get_pool_stats(sc, &pool);
+    chprintf(chp, SHELL_NEWLINE_STR"Packet objects of %u bytes"SHELL_NEWLINE_STR,
+             pool.frame_size);
+    chprintf(chp, "pool size        : %u"SHELL_NEWLINE_STR, pool.size);
+    chprintf(chp, "in use           : %u"SHELL_NEWLINE_STR, pool.in_use);
+    chprintf(chp, "peak in use      : %u"SHELL_NEWLINE_STR, pool.peak);
+    chprintf(chp, "allocations      : %u"SHELL_NEWLINE_STR, pool.allocs);
+    chprintf(chp, "failures         : %u"SHELL_NEWLINE_STR, pool.fails);
+  }
+
+  /* Regions fall back to the core heap when full. */
+  mem_region_t r;
+  for(r = 0; r < MEM_REGION_NUM; r++) {
+    mem_region_stats_t region;
+    mem_get_stats(r, &region);
+    chprintf(chp, SHELL_NEWLINE_STR"Region %s"SHELL_NEWLINE_STR, region.name);
+    if(region.size == 0) {
+      chprintf(chp, "not enabled"SHELL_NEWLINE_STR);
+      continue;
+    }
+    chprintf(chp, "size             : %u bytes"SHELL_NEWLINE_STR, region.size);
+    chprintf(chp, "heap fragments   : %u"SHELL_NEWLINE_STR, region.fragments);
+    chprintf(chp, "heap free total  : %u bytes"SHELL_NEWLINE_STR, region.free);
+    chprintf(chp, "heap free largest: %u bytes"SHELL_NEWLINE_STR, region.largest);
+    chprintf(chp, "lowest largest   : %u bytes"SHELL_NEWLINE_STR,
+             region.largest_min);
+    chprintf(chp, "allocations      : %u"SHELL_NEWLINE_STR, region.allocs);
+    chprintf(chp, "core heap used   : %u"SHELL_NEWLINE_STR, region.fallbacks);
+    chprintf(chp, "failures         : %u"SHELL_NEWLINE_STR, region.fails);
+  }
+}
+
+/*
+ * Show the registered performance counters and sampled values.
+ */
+void usb_cmd_stats(BaseSequentialStream *chp, int argc, char *argv[]) {
+  if(argc > 1 || (argc == 1 && strcmp(argv[0], "clear") != 0)) {
+    shellUsage(chp, "stats [clear]");
     return;
   }
-  extern uint8_t __ram4_free__[];
-  extern uint8_t __ram4_end__[];
+  if(argc == 1) {
+    stats_reset();
+    return;
+  }
+  stats_t *s;
+  for(s = stats_first(); s != NULL; s = s->next) {
+    stats_t c;
+    stats_get(s, &c);
+    uint32_t samples = 0;
+    uint8_t k;
+    for(k = 0; k < STATS_HIST_BINS; k++)
+      samples += c.hist[k];
+    if(samples == 0) {
+      /* Counter or a value without samples yet. */
+      chprintf(chp, "%-24s %u"SHELL_NEWLINE_STR, c.name, c.count);
+      continue;
+    }
+    chprintf(chp, "%-24s count %u, last %d, min %d, max %d, avg %d"
+             SHELL_NEWLINE_STR, c.name, c.count, c.value, c.min, c.max,
+             (int32_t)(c.total / c.count));
+    /* Histogram bin k holds values from 2^k to 2^(k+1) - 1. */
+    for(k = 0; k < STATS_HIST_BINS; k++) {
+      if(c.hist[k] != 0)
+        chprintf(chp, "  >=%-6u %u"SHELL_NEWLINE_STR,
+                 k == 0 ? 0 : 1U << k, c.hist[k]);
+    }
+  }
+}
 
-  chprintf(chp, SHELL_NEWLINE_STR"CCM heap : size %x starts at : %x"SHELL_NEWLINE_STR,
-           (__ram4_end__ - __ram4_free__), __ram4_free__);
-  n = chHeapStatus(ccm_heap, &total, &largest);
-  chprintf(chp, SHELL_NEWLINE_STR"CCM Heap"SHELL_NEWLINE_STR);
-  chprintf(chp, "heap fragments   : %u"SHELL_NEWLINE_STR, n);
-  chprintf(chp, "heap free total  : %u bytes"SHELL_NEWLINE_STR, total);
-  chprintf(chp, "heap free largest: %u bytes"SHELL_NEWLINE_STR, largest);
+/*
+ * Show CPU time and stack high-water mark of each thread.
+ * CPU time is since boot or the last clear.
+ */
+void usb_cmd_thread_prof(BaseSequentialStream *chp, int argc, char *argv[]) {
+  if(argc > 1 || (argc == 1 && strcmp(argv[0], "clear") != 0)) {
+    shellUsage(chp, "prof [clear]");
+    return;
+  }
+  if(argc == 1) {
+    threadprof_reset();
+    return;
+  }
+  /* Every cycle is charged to a thread so the sum is the elapsed time. */
+  uint64_t total = 0;
+  thread_t *tp;
+  for(tp = chRegFirstThread(); tp != NULL; tp = chRegNextThread(tp)) {
+    threadprof_t p;
+    threadprof_get(tp, &p);
+    total += p.cycles;
+  }
+  if(total == 0)
+    total = 1;
+
+  chprintf(chp, "name                 prio  stack   used   free    cpu"
+           SHELL_NEWLINE_STR);
+  for(tp = chRegFirstThread(); tp != NULL; tp = chRegNextThread(tp)) {
+    threadprof_t p;
+    threadprof_get(tp, &p);
+    uint32_t cpu = p.cycles * 1000 / total;
+    chprintf(chp, "%-20s %4u %6u %6u %6u %3u.%u%%"SHELL_NEWLINE_STR,
+             p.name == NULL ? "" : p.name, p.prio, p.stack_size,
+             p.stack_used, p.stack_size - p.stack_used, cpu / 10, cpu % 10);
+  }
+  chprintf(chp, "%u ms measured"SHELL_NEWLINE_STR,
+           (uint32_t)(total / (STM32_SYSCLK / 1000)));
+}
+
+/*
+ * Show the heartbeats of the threads and their deadline statistics.
+ */
+void usb_cmd_watchdog(BaseSequentialStream *chp, int argc, char *argv[]) {
+  (void)argv;
+  if(argc > 0) {
+    shellUsage(chp, "wdg");
+    return;
+  }
+  chprintf(chp, "name             cycle s   last s    beats     late  late max ms"
+           "   misses"SHELL_NEWLINE_STR);
+  systime_t now = chVTGetSystemTime();
+  wdg_beat_t *b;
+  for(b = wdg_first(); b != NULL; b = b->next) {
+    wdg_beat_t c;
+    wdg_get(b, &c);
+    chprintf(chp, "%-16s %7u %8u %8u %8u %12u %8u"SHELL_NEWLINE_STR,
+             c.name == NULL ? "" : c.name, chTimeI2S(c.cycle),
+             chTimeI2S(chTimeDiffX(c.last, now)), c.beats, c.late,
+             chTimeI2MS(c.late_max), c.misses);
+  }
+}
+
+void usb_cmd_budget(BaseSequentialStream *chp, int argc, char *argv[]) {
+  (void)argv;
+  if(argc > 0) {
+    shellUsage(chp, "budget");
+    return;
+  }
+  chprintf(chp, "Energy level %d%%, nominal airtime %d%%"SHELL_NEWLINE_STR,
+           budget_get_level(), BUDGET_DUTY);
+  chprintf(chp, "user       available ms    size ms  window ms   total ms"
+           SHELL_NEWLINE_STR);
+  for(uint8_t u = 0; u < BUDGET_NUM; u++) {
+    budget_bucket_t b;
+    budget_get(u, &b);
+    chprintf(chp, "%-10s %12d %10d %10u %10u"SHELL_NEWLINE_STR,
+             budget_get_name(u), b.tokens, b.size, b.used, b.total);
+  }
 }
 
 void usb_cmd_set_trace_level(BaseSequentialStream *chp, int argc, char *argv[])
@@ -128,7 +301,8 @@ void usb_cmd_printPicture(BaseSequentialStream *chp, int argc, char *argv[])
 	(void)argv;
 
 	// Take picture
-	uint32_t size_sampled = takePicture(usb_buffer, sizeof(usb_buffer), RES_QVGA, false);
+	uint32_t size_sampled = takePicture(usb_buffer, sizeof(usb_buffer), RES_QVGA, false,
+	                                    NULL, NULL);
 
 	// Transmit image via USB
 	if(size_sampled)
@@ -160,6 +334,180 @@ void usb_cmd_printPicture(BaseSequentialStream *chp, int argc, char *argv[])
 	}
 }
 
+/*
+ * Binary transfers send a header line "BIN <type>,<length>\r\n" followed
+ * by <length> raw bytes and the CRC-16/X.25 of the data, low byte first
+ * as an AX.25 FCS.
+ */
+#define USB_BIN_CHUNK	512
+#define USB_BIN_TIMEOUT	TIME_S2I(1)
+
+/*
+ * Write data to the host in chunks.
+ * Returns false if the host stopped reading.
+ */
+static bool usb_write_bin(BaseSequentialStream *chp, const uint8_t *data,
+						  size_t len, uint16_t *crc)
+{
+	*crc = crc16_x25_update(*crc, data, len);
+	while(len > 0) {
+		size_t n = len > USB_BIN_CHUNK ? USB_BIN_CHUNK : len;
+		if(chnWriteTimeout((BaseChannel*)chp, data, n, USB_BIN_TIMEOUT) != n)
+			return false;
+		data += n;
+		len -= n;
+	}
+	return true;
+}
+
+static bool usb_write_bin_crc(BaseSequentialStream *chp, uint16_t crc)
+{
+	crc = ~crc;
+	uint8_t fcs[2] = {crc & 0xFF, crc >> 8};
+	return chnWriteTimeout((BaseChannel*)chp, fcs, sizeof(fcs),
+						   USB_BIN_TIMEOUT) == sizeof(fcs);
+}
+
+void usb_cmd_printPictureBin(BaseSequentialStream *chp, int argc, char *argv[])
+{
+	(void)argv;
+
+	if(argc > 0) {
+		shellUsage(chp, "picture_bin");
+		return;
+	}
+
+	uint32_t size_sampled = takePicture(usb_buffer, sizeof(usb_buffer), RES_QVGA, false,
+	                                    NULL, NULL);
+
+	// Look for APP0 as SOI is lost sometimes
+	uint32_t start = 0;
+	while(start + 1 < size_sampled
+			&& !(usb_buffer[start] == 0xFF && usb_buffer[start+1] == 0xE0))
+		start++;
+	if(start + 1 >= size_sampled) {
+		chprintf(chp, "BIN image/jpeg,0\r\n");
+		usb_write_bin_crc(chp, CRC16_X25_INIT);
+		return;
+	}
+
+	static const uint8_t soi[] = {0xFF, 0xD8};
+	uint32_t len = size_sampled - start;
+	uint16_t crc = CRC16_X25_INIT;
+	chprintf(chp, "BIN image/jpeg,%d\r\n", sizeof(soi) + len);
+	if(!usb_write_bin(chp, soi, sizeof(soi), &crc)
+			|| !usb_write_bin(chp, &usb_buffer[start], len, &crc)
+			|| !usb_write_bin_crc(chp, crc))
+		TRACE_WARN("USB  > Binary image transfer aborted");
+}
+
+/*
+ * Binary log export.
+ * The data is a log_export_hdr_t followed by the points either raw or as
+ * keyframe and delta records in the format of the flash log.
+ */
+#define LOG_EXPORT_MAGIC	0x47584C50	/* "PLXG" */
+#define LOG_EXPORT_RAW		0
+#define LOG_EXPORT_DELTA	1
+
+typedef struct __attribute__((packed)) {
+	uint32_t	magic;
+	uint8_t		version;	// DATAPOINT_VERSION
+	uint8_t		encoding;	// LOG_EXPORT_RAW or LOG_EXPORT_DELTA
+	uint16_t	size;		// sizeof(dataPoint_t)
+	uint32_t	first;		// Number of the first point sent
+	uint32_t	count;		// Points sent
+	uint32_t	end;		// Number after the newest point held
+} log_export_hdr_t;
+
+/*
+ * Encode points of the log into the USB buffer and send them in large
+ * writes. Without a stream only the length is determined.
+ * Returns the number of points encoded.
+ */
+static uint32_t log_export(BaseSequentialStream *chp, uint32_t first,
+						   uint32_t count, bool delta, uint32_t *len,
+						   uint16_t *crc)
+{
+	log_iter_t it;
+	dataPoint_t prev;
+	size_t fill = 0;
+	uint32_t n = 0;
+	*len = 0;
+	dataPoint_t *dp = count > 0 ? flash_seekLogEntry(&it, first) : NULL;
+	while(dp != NULL) {
+		uint8_t *p = &usb_buffer[fill];
+		uint8_t *e;
+		if(delta) {
+			e = flash_encodeLogRecord(p, dp, &prev, n % LOG_KEYFRAME_INTERVAL == 0);
+			prev = *dp;
+		} else {
+			memcpy(p, dp, sizeof(dataPoint_t));
+			e = p + sizeof(dataPoint_t);
+		}
+		*len += e - p;
+		if(chp != NULL)
+			fill += e - p;
+		if(++n == count)
+			break;
+		if(fill + LOG_REC_MAX_SIZE > sizeof(usb_buffer)) {
+			if(!usb_write_bin(chp, usb_buffer, fill, crc))
+				return 0;
+			fill = 0;
+		}
+		dp = flash_getNextLogEntry(&it);
+	}
+	if(fill > 0 && !usb_write_bin(chp, usb_buffer, fill, crc))
+		return 0;
+	return n;
+}
+
+/*
+ * Send points of the log as binary.
+ * A range allows a host to fetch only the points it does not have yet.
+ */
+void usb_cmd_printLogBin(BaseSequentialStream *chp, int argc, char *argv[])
+{
+	if(argc > 3 || (argc > 0 && strcmp(argv[0], "raw")
+			&& strcmp(argv[0], "delta"))) {
+		shellUsage(chp, "log_bin [raw|delta] [first [count]]");
+		return;
+	}
+
+	bool delta = argc > 0 && !strcmp(argv[0], "delta");
+	uint32_t first, end;
+	flash_getLogRange(&first, &end);
+	if(argc > 1 && strtoul(argv[1], NULL, 0) > first)
+		first = strtoul(argv[1], NULL, 0);
+	if(first > end)
+		first = end;
+	uint32_t count = end - first;
+	if(argc > 2 && strtoul(argv[2], NULL, 0) < count)
+		count = strtoul(argv[2], NULL, 0);
+
+	uint32_t len;
+	uint16_t crc = CRC16_X25_INIT;
+	count = log_export(NULL, first, count, delta, &len, &crc);
+
+	log_export_hdr_t hdr = {
+		.magic = LOG_EXPORT_MAGIC,
+		.version = DATAPOINT_VERSION,
+		.encoding = delta ? LOG_EXPORT_DELTA : LOG_EXPORT_RAW,
+		.size = sizeof(dataPoint_t),
+		.first = first,
+		.count = count,
+		.end = end
+	};
+	chprintf(chp, "BIN log/datapoint,%d\r\n", sizeof(hdr) + len);
+
+	crc = CRC16_X25_INIT;
+	uint32_t sent_len;
+	if(!usb_write_bin(chp, (uint8_t*)&hdr, sizeof(hdr), &crc)
+			|| log_export(chp, first, count, delta, &sent_len, &crc) != count
+			|| sent_len != len || !usb_write_bin_crc(chp, crc))
+		TRACE_WARN("USB  > Binary log transfer aborted");
+}
+
 void usb_cmd_printLog(BaseSequentialStream *chp, int argc, char *argv[])
 {
 	(void)argc;
@@ -178,8 +526,9 @@ void usb_cmd_printLog(BaseSequentialStream *chp, int argc, char *argv[])
 		"light,sys_error\r\n");
 
 	dataPoint_t *dp;
-	for(uint16_t i=0; (dp = flash_getLogBuffer(i)) != NULL; i++)
-		if(dp->id != 0xFFFFFFFF)
+	log_iter_t it;
+	flash_initLogIterator(&it);
+	while((dp = flash_getNextLogEntry(&it)) != NULL)
 		{
 			chprintf(	chp,
 						"%d,%d,%d,%d,%d,%d,"
@@ -277,25 +626,41 @@ void usb_cmd_send_aprs_message(BaseSequentialStream *chp, int argc, char *argv[]
 
 	chprintf(chp, "Message: %s\r\n", m);
 
-	/* Send with ack request (last arg true). */
-	packet_t packet = aprs_format_transmit_message(conf_sram.aprs.tx.call,
-	                                      conf_sram.aprs.tx.path,
-	                                      argv[0], m, true);
-    if(packet == NULL) {
-      TRACE_WARN("CMD  > No free packet objects");
-      return;
-    }
-	transmitOnRadio(packet,
-	                conf_sram.aprs.tx.radio_conf.freq,
-                    0,
-                    0,
-                    conf_sram.aprs.tx.radio_conf.pwr,
-                    conf_sram.aprs.tx.radio_conf.mod,
-                    conf_sram.aprs.tx.radio_conf.cca);
+	/* Send with ack request. It is retried until acked. */
+	aprs_identity_t id = {0};
+	strlcpy(id.src, argv[0], sizeof(id.src));
+	strlcpy(id.call, conf_sram.aprs.tx.call, sizeof(id.call));
+	strlcpy(id.path, conf_sram.aprs.tx.path, sizeof(id.path));
+	id.freq = conf_sram.aprs.tx.radio_conf.freq;
+	id.pwr = conf_sram.aprs.tx.radio_conf.pwr;
+	id.mod = conf_sram.aprs.tx.radio_conf.mod;
+	id.cca = conf_sram.aprs.tx.radio_conf.cca;
+	if(aprs_msg_send(&id, m, true) != MSG_OK) {
+	  chprintf(chp, "Message not sent!\r\n");
+	  return;
+	}
 
 	chprintf(chp, "Message sent!\r\n");
 }
 
+/*
+ * Switch the console to a KISS TNC.
+ * Received frames are sent to the host and frames from the host are
+ * transmitted. The host leaves KISS mode with C0 FF C0.
+ */
+void usb_cmd_kiss(BaseSequentialStream *chp, int argc, char *argv[])
+{
+	(void)argv;
+
+	if(argc > 0) {
+		shellUsage(chp, "kiss");
+		return;
+	}
+	chprintf(chp, "KISS mode, send C0 FF C0 to exit\r\n");
+	kiss_run((BaseChannel *)chp);
+	chprintf(chp, "\r\nKISS mode ended\r\n");
+}
+
 void usb_cmd_get_error_list(BaseSequentialStream *chp, int argc, char *argv[])
 {
 	(void)argc;
@@ -333,6 +698,13 @@ void usb_cmd_time(BaseSequentialStream *chp, int argc, char *argv[]) {
     chprintf(chp, "RTC time %04d-%02d-%02d %02d:%02d:%02d\r\n",
                             time.year, time.month, time.day,
                             time.hour, time.minute, time.day);
+    pps_status_t pps;
+    pps_get_status(&pps);
+    chprintf(chp, "PPS %s, pulses %d, rejected %d, last %d ms ago\r\n",
+             pps.locked ? "locked" : "not locked", pps.pulses, pps.rejected,
+             chTimeI2MS(pps.age));
+    chprintf(chp, "Clock drift %d ppb, residual %d ns\r\n",
+             pps.drift_ppb, pps.residual_ns);
     chprintf(chp, "\r\nTo set time: time [YYYY-MM-DD HH:MM:SS]\r\n");
     return;
   }
@@ -392,4 +764,736 @@ void usb_cmd_radio(BaseSequentialStream *chp, int argc, char *argv[]) {
                    "patch ID %04x\r\n",
                    radio, handler->radio_part,
                    handler->radio_rom_rev, handler->radio_patch);
+#if PKT_RX_FAST_TURNAROUND == TRUE
+  chSysLock();
+  radio_turnaround_t ta = handler->rx_turnaround;
+  chSysUnlock();
+  uint32_t mean = (ta.count == 0) ? 0 : (uint32_t)(ta.total_us / ta.count);
+  chprintf(chp, "Receive turnaround: count %u, last %uus, mean %uus, "
+                   "peak %uus\r\n",
+                   ta.count, ta.last_us, mean, ta.peak_us);
+#endif
+  chSysLock();
+  radio_csma_t csma = handler->tx_csma;
+  chSysUnlock();
+  chprintf(chp, "Channel access: persist %u, slot %ums, granted %u, "
+                   "busy %u, persisted %u, forced %u\r\n",
+                   csma.persist, chTimeI2MS(csma.slot), csma.granted,
+                   csma.busy, csma.persisted, csma.forced);
+#if PKT_RX_USE_SCAN == TRUE
+  chSysLock();
+  radio_rx_scan_t scan = handler->rx_scan;
+  chSysUnlock();
+  chprintf(chp, "Receive scan: %s, listen %d.%03d MHz, found %d.%03d MHz, "
+                   "hops %u, finds %u\r\n",
+                   scan.active ? "active" : "idle",
+                   scan.current/1000000, (scan.current%1000000)/1000,
+                   scan.found/1000000, (scan.found%1000000)/1000,
+                   scan.hops, scan.finds);
+#endif
+#if PKT_RX_USE_NOISE_FLOOR == TRUE
+  chSysLock();
+  radio_noise_t noise = handler->rx_noise;
+  chSysUnlock();
+  chprintf(chp, "Noise floor: rssi %u, squelch %u, samples %u, "
+                   "changes %u\r\n",
+                   noise.floor >> 4, noise.squelch,
+                   noise.samples, noise.changes);
+#endif
+}
+
+/**
+ * Show AFSK decoder cycle, queue and latency statistics for radio.
+ */
+void usb_cmd_afsk_stats(BaseSequentialStream *chp, int argc, char *argv[]) {
+#if USE_AFSK_DECODER_STATS == TRUE
+  bool clear = (argc > 0 && strcmp(argv[argc - 1], "clear") == 0);
+  if(argc > (clear ? 2 : 1)) {
+    shellUsage(chp, "afsk [number] [clear]");
+    return;
+  }
+  radio_unit_t radio;
+  if(argc == (clear ? 1 : 0))
+    radio = PKT_RADIO_1;
+  else
+    radio = atoi(argv[0]);
+
+  int8_t num = pktGetNumRadios();
+  if(radio == 0 || radio > num) {
+    chprintf(chp, "Invalid radio number %d\r\n", radio);
+    return;
+  }
+  if(clear) {
+    if(!pktResetAFSKStats(radio))
+      chprintf(chp, "No AFSK decoder on radio %d\r\n", radio);
+    return;
+  }
+  afsk_decoder_stats_t stats;
+  if(!pktGetAFSKStats(radio, &stats)) {
+    chprintf(chp, "No AFSK decoder on radio %d\r\n", radio);
+    return;
+  }
+  uint32_t per_sample = stats.samples == 0 ? 0
+      : (uint32_t)(stats.process_cycles / stats.samples);
+  uint32_t per_symbol = stats.symbols == 0 ? 0
+      : (uint32_t)(stats.process_cycles / stats.symbols);
+  uint32_t per_frame = stats.frames == 0 ? 0
+      : (uint32_t)(stats.process_cycles / stats.frames);
+  chprintf(chp, "AFSK radio %d: samples %u, symbols %u, frames %u\r\n",
+           radio, stats.samples, stats.symbols, stats.frames);
+  chprintf(chp, "Cycles per sample %u, per symbol %u, per frame %u\r\n",
+           per_sample, per_symbol, per_frame);
+  chprintf(chp, "Peak PWM queue %u entries\r\n", stats.peak_pwm_queue);
+  uint32_t latency = stats.latency_count == 0 ? 0
+      : (uint32_t)(stats.latency_total / stats.latency_count);
+  chprintf(chp, "CCA close to dispatch: count %u, last %uus, avg %uus, "
+                "peak %uus, early dispatch %u\r\n",
+           stats.latency_count,
+           RTC2US(STM32_SYSCLK, stats.latency_last),
+           RTC2US(STM32_SYSCLK, latency),
+           RTC2US(STM32_SYSCLK, stats.latency_peak),
+           stats.early_dispatch);
+  chprintf(chp, "CCA breaks qualified %u, rejected %u\r\n",
+           stats.qualify_accept, stats.qualify_reject);
+  chprintf(chp, "Sessions ended by carrier detect %u\r\n", stats.dcd_drops);
+  chprintf(chp, "Sessions handed to the correlator %u\r\n",
+           stats.period_fallbacks);
+  chprintf(chp, "Decoder priority boosts %u\r\n", stats.priority_boosts);
+  afsk_stage_t s;
+  for(s = 0; s < AFSK_STAGE_COUNT; s++) {
+    afsk_stage_stats_t *stage = &stats.stage[s];
+    uint32_t avg = stage->count == 0 ? 0
+        : (uint32_t)(stage->total / stage->count);
+    chprintf(chp, "%-10s count %u, avg %u, peak %u cycles\r\n",
+             pktGetAFSKStageName(s), stage->count, avg, stage->peak);
+    /* Histogram bin k holds counts from 2^k to 2^(k+1) - 1 cycles. */
+    uint8_t k;
+    for(k = 0; k < AFSK_STATS_HIST_BINS; k++) {
+      if(stage->hist[k] != 0)
+        chprintf(chp, "  >=%-6u %u\r\n", 1U << k, stage->hist[k]);
+    }
+  }
+#else
+  (void)argc;
+  (void)argv;
+  chprintf(chp, "AFSK decoder statistics are not enabled\r\n");
+#endif
+}
+
+/**
+ * Show PWM buffer pool size, peak usage and overflow counts for radio.
+ */
+void usb_cmd_pwm_pool(BaseSequentialStream *chp, int argc, char *argv[]) {
+#if USE_HEAP_PWM_BUFFER == TRUE
+  if(argc > 1) {
+    shellUsage(chp, "pwm [number]");
+    return;
+  }
+  radio_unit_t radio;
+  if(argc == 0)
+    radio = PKT_RADIO_1;
+  else
+    radio = atoi(argv[0]);
+
+  int8_t num = pktGetNumRadios();
+  if(radio == 0 || radio > num) {
+    chprintf(chp, "Invalid radio number %d\r\n", radio);
+    return;
+  }
+  radio_pwm_pool_stats_t stats;
+  if(!pktGetPWMPoolStats(radio, &stats)) {
+    chprintf(chp, "No AFSK decoder on radio %d\r\n", radio);
+    return;
+  }
+  chprintf(chp, "PWM pool radio %d: size %u (min %u, max %u), "
+                "in use %u\r\n",
+           radio, stats.size, PWM_DATA_BUFFERS_MIN, PWM_DATA_BUFFERS,
+           stats.out);
+  chprintf(chp, "Peak use %u, recent peak %u, overflows %u\r\n",
+           stats.peak, stats.recent, stats.overflows);
+  chprintf(chp, "Pool grown %u times, shrunk %u times\r\n",
+           stats.grows, stats.shrinks);
+#else
+  (void)argc;
+  (void)argv;
+  chprintf(chp, "PWM buffer pool is not enabled\r\n");
+#endif
+}
+
+/*
+ * Energy spent by each activity of the tracker.
+ */
+void usb_cmd_energy(BaseSequentialStream *chp, int argc, char *argv[]) {
+  bool clear = (argc == 1 && strcmp(argv[0], "clear") == 0);
+  if(argc > 1 || (argc == 1 && !clear)) {
+    shellUsage(chp, "energy [clear]");
+    return;
+  }
+  if(clear) {
+    eprof_reset();
+    return;
+  }
+  chprintf(chp, "state      time s   energy J   avg mW\r\n");
+  eprof_state_t s;
+  for(s = EPROF_IDLE; s < EPROF_STATES; s++) {
+    eprof_total_t t;
+    eprof_get(s, &t);
+    uint32_t mw = t.time == 0 ? 0 : (uint32_t)(t.energy * 100 / t.time);
+    chprintf(chp, "%-8s %8u %6u.%03u %8u\r\n", eprof_state_name(s),
+             (uint32_t)(t.time / 1000), (uint32_t)(t.energy / 10000),
+             (uint32_t)(t.energy / 10 % 1000), mw);
+  }
+}
+
+/*
+ * Telemetry time series at each resolution as min, mean and max.
+ */
+void usb_cmd_tseries(BaseSequentialStream *chp, int argc, char *argv[]) {
+  bool clear = (argc == 1 && strcmp(argv[0], "clear") == 0);
+  if(argc > 1 || (argc == 1 && !clear)) {
+    shellUsage(chp, "series [clear]");
+    return;
+  }
+  if(clear) {
+    ts_reset();
+    return;
+  }
+  chprintf(chp, "field  res   count        min       mean        max\r\n");
+  ts_field_t f;
+  for(f = TS_VBAT; f < TS_FIELDS; f++) {
+    ts_res_t r;
+    for(r = TS_MINUTE; r < TS_RESOLUTIONS; r++) {
+      ts_stats_t s;
+      if(!ts_get(f, r, &s)) {
+        chprintf(chp, "%-6s %-4s %6u\r\n", ts_field_name(f), ts_res_name(r),
+                 0);
+        continue;
+      }
+      chprintf(chp, "%-6s %-4s %6u %10d %10d %10d\r\n", ts_field_name(f),
+               ts_res_name(r), s.count, s.min, s.mean, s.max);
+    }
+  }
+}
+
+/*
+ * RF capture counts. The records gathered are written with flush.
+ */
+void usb_cmd_rf_capture(BaseSequentialStream *chp, int argc, char *argv[]) {
+  bool flush = (argc == 1 && strcmp(argv[0], "flush") == 0);
+  if(argc > 1 || (argc == 1 && !flush)) {
+    shellUsage(chp, "capture [flush]");
+    return;
+  }
+  if(flush)
+    cap_flush();
+  cap_stats_t s;
+  cap_get_stats(&s);
+  chprintf(chp, "Capture %s to %s\r\n",
+           conf_sram.rf_capture ? "enabled" : "disabled", CAP_FILE);
+  chprintf(chp, "RX frames: %u\r\n", s.rx);
+  chprintf(chp, "TX frames: %u\r\n", s.tx);
+  chprintf(chp, "Writes:    %u\r\n", s.writes);
+  chprintf(chp, "Lost:      %u\r\n", s.lost);
+}
+
+/*
+ * Counts of the packet service events since startup.
+ */
+void usb_cmd_pkt_events(BaseSequentialStream *chp, int argc, char *argv[]) {
+  (void)argv;
+
+  if(argc > 0) {
+    shellUsage(chp, "events");
+    return;
+  }
+  uint8_t bit;
+  for(bit = 0; bit < PKT_EVT_FLAGS; bit++) {
+    uint32_t count = pktGetEventCount(bit);
+    if(count != 0)
+      chprintf(chp, "Event 0x%08x: %u\r\n", EVENT_MASK(bit), count);
+  }
+  chprintf(chp, "Not traced (ring full): %u\r\n", pktGetEventsLost());
+}
+
+#if USE_PWM_REPLAY == TRUE
+/*
+ * Replay source reading a recording from SD card.
+ */
+static size_t usb_replay_read_sd(void *arg, uint8_t *buffer, size_t size) {
+  (void)arg;
+  int32_t n = readFromFile(buffer, size);
+  return n < 0 ? 0 : (size_t)n;
+}
+
+/*
+ * Replay source reading a recording sent over USB.
+ * The recording ends when the sender pauses.
+ */
+typedef struct {
+  BaseChannel *chn;
+  bool started;
+} usb_replay_source_t;
+
+static size_t usb_replay_read_usb(void *arg, uint8_t *buffer, size_t size) {
+  usb_replay_source_t *source = arg;
+  size_t n = chnReadTimeout(source->chn, buffer, size,
+                            source->started ? TIME_MS2I(500) : TIME_S2I(30));
+  if(n > 0)
+    source->started = true;
+  return n;
+}
+#endif
+
+/*
+ *
+ */
+void usb_cmd_pwm_replay(BaseSequentialStream *chp, int argc, char *argv[]) {
+#if USE_PWM_REPLAY == TRUE
+  if(argc < 1 || argc > 2) {
+    shellUsage(chp, "replay file|usb [number]");
+    return;
+  }
+  radio_unit_t radio;
+  if(argc == 1)
+    radio = PKT_RADIO_1;
+  else
+    radio = atoi(argv[1]);
+
+  int8_t num = pktGetNumRadios();
+  if(radio == 0 || radio > num) {
+    chprintf(chp, "Invalid radio number %d\r\n", radio);
+    return;
+  }
+  if(!pktIsReceiveActive(radio)) {
+    chprintf(chp, "Receive is not active on radio %d\r\n", radio);
+    return;
+  }
+
+  pwm_replay_result_t result;
+  msg_t msg;
+  if(strcmp(argv[0], "usb") == 0) {
+    usb_replay_source_t source = {(BaseChannel *)chp, false};
+    chprintf(chp, "Send PWM recording now\r\n");
+    msg = pktReplayPWM(radio, usb_replay_read_usb, &source, &result);
+  } else {
+    if(!openFileForRead(argv[0])) {
+      chprintf(chp, "Unable to open %s\r\n", argv[0]);
+      return;
+    }
+    msg = pktReplayPWM(radio, usb_replay_read_sd, NULL, &result);
+    closeReadFile();
+  }
+
+  if(msg == MSG_TIMEOUT) {
+    chprintf(chp, "PWM stream on radio %d is busy\r\n", radio);
+  } else if(msg == MSG_RESET) {
+    chprintf(chp, "Receive stopped on radio %d during replay\r\n", radio);
+  }
+  uint32_t elapsed = TIME_I2MS(result.elapsed);
+  uint32_t signal = (uint32_t)(result.signal_us / 1000U);
+  chprintf(chp, "Replayed %u PWM entries in %u sessions, %u dropped\r\n",
+           result.entries, result.sessions, result.dropped);
+  chprintf(chp, "Signal %ums replayed in %ums (x%u)\r\n",
+           signal, elapsed, elapsed == 0 ? 0 : signal / elapsed);
+#if USE_AFSK_DECODER_STATS == TRUE
+  uint32_t per_entry = result.entries == 0 ? 0
+      : (uint32_t)(result.cycles / result.entries);
+  uint32_t per_frame = result.frames == 0 ? 0
+      : (uint32_t)(result.cycles / result.frames);
+  chprintf(chp, "Frames %u, cycles per entry %u, per frame %u\r\n",
+           result.frames, per_entry, per_frame);
+#endif
+#else
+  (void)argc;
+  (void)argv;
+  chprintf(chp, "PWM replay is not enabled\r\n");
+#endif
+}
+
+/*
+ * SSDV encoder benchmark.
+ * An image is taken at each camera resolution and encoded at each quality
+ * the same as for transmission. Times are cycles of the realtime counter.
+ */
+#define USB_SSDV_BENCH_SIZE     (50 * 1024)
+#define USB_SSDV_BENCH_QUALITY  8
+
+typedef struct {
+  ssdv_t  ssdv;
+  uint8_t pkt[SSDV_PKT_SIZE];
+} usb_ssdv_bench_t;
+
+/*
+ * Encode an image. Returns SSDV_EOI if the whole image is encoded.
+ */
+static char usb_ssdv_encode(usb_ssdv_bench_t *b, const uint8_t *image,
+                            uint32_t len, uint8_t quality,
+                            uint32_t *packets, rtcnt_t *cycles) {
+  rtcnt_t start = chSysGetRealtimeCounterX();
+  ssdv_enc_init(&b->ssdv, SSDV_TYPE_PADDING, "N0CALL", 0, quality);
+  ssdv_enc_set_buffer(&b->ssdv, b->pkt);
+  ssdv_enc_set_image(&b->ssdv, image, len);
+  char c;
+  *packets = 0;
+  while((c = ssdv_enc_get_packet(&b->ssdv)) == SSDV_OK)
+    (*packets)++;
+  *cycles = chSysGetRealtimeCounterX() - start;
+  return c;
+}
+
+void usb_cmd_ssdv_bench(BaseSequentialStream *chp, int argc, char *argv[]) {
+  if(argc > 1) {
+    shellUsage(chp, "ssdv [quality]");
+    return;
+  }
+  int quality = argc == 0 ? -1 : atoi(argv[0]);
+  if(quality >= USB_SSDV_BENCH_QUALITY) {
+    chprintf(chp, "Quality is 0 to %d\r\n", USB_SSDV_BENCH_QUALITY - 1);
+    return;
+  }
+  uint8_t *buffer = mem_alloc(MEM_REGION_IMAGE, USB_SSDV_BENCH_SIZE,
+                              DMA_FIFO_BURST_ALIGN);
+  usb_ssdv_bench_t *b = mem_alloc(MEM_REGION_IMAGE, sizeof(*b), 0);
+  if(buffer == NULL || b == NULL) {
+    chprintf(chp, "Unable to get image buffer\r\n");
+    if(buffer != NULL)
+      chHeapFree(buffer);
+    if(b != NULL)
+      chHeapFree(b);
+    return;
+  }
+
+  chprintf(chp, "res  size       q    bytes  packets  us/image  "
+                "cycles/packet  kB/s\r\n");
+  resolution_t res;
+  for(res = RES_QQVGA; res < RES_MAX; res++) {
+    uint32_t len = takePicture(buffer, USB_SSDV_BENCH_SIZE, res, true,
+                               NULL, NULL);
+    if(len == 0) {
+      chprintf(chp, "%-4d no image\r\n", res);
+      continue;
+    }
+    /* The encode runs at full clock as after capture. */
+    pclkAcquire();
+    int q;
+    for(q = 0; q < USB_SSDV_BENCH_QUALITY; q++) {
+      if(quality >= 0 && q != quality)
+        continue;
+      uint32_t packets;
+      rtcnt_t cycles;
+      char c = usb_ssdv_encode(b, buffer, len, q, &packets, &cycles);
+      if(c != SSDV_EOI) {
+        chprintf(chp, "%-4d encode failed at quality %d (%d)\r\n", res, q, c);
+        break;
+      }
+      uint32_t us = RTC2US(STM32_SYSCLK, cycles);
+      chprintf(chp, "%-4d %4ux%-4u  %d %8u %8u %9u %14u %5u\r\n",
+               res, b->ssdv.width, b->ssdv.height, q, len, packets, us,
+               packets == 0 ? 0 : cycles / packets,
+               us == 0 ? 0 : (uint32_t)((uint64_t)len * 1000U / us));
+    }
+    pclkRelease();
+  }
+  chHeapFree(b);
+  chHeapFree(buffer);
+}
+
+/*
+ * Kernel micro-benchmarks.
+ * Cycles are from the realtime counter at the clock the shell runs at.
+ */
+#define USB_BENCH_CALLS     100
+#define USB_BENCH_CALLS_MAX 10000
+
+void usb_cmd_bench(BaseSequentialStream *chp, int argc, char *argv[]) {
+  if(argc > 1) {
+    shellUsage(chp, "bench [calls]");
+    return;
+  }
+  uint32_t calls = argc == 0 ? USB_BENCH_CALLS : (uint32_t)atoi(argv[0]);
+  if(calls == 0 || calls > USB_BENCH_CALLS_MAX) {
+    chprintf(chp, "Calls is 1 to %d\r\n", USB_BENCH_CALLS_MAX);
+    return;
+  }
+  chprintf(chp, "SYSCLK %uHz\r\n", STM32_SYSCLK);
+  chprintf(chp, "kernel    size unit       min cycles  avg cycles  "
+                "max cycles  min/unit\r\n");
+  uint8_t n;
+  for(n = 0; n < bench_count(); n++) {
+    bench_result_t r;
+    if(!bench_run(n, calls, &r)) {
+      chprintf(chp, "%-9s unable to set up\r\n", r.name);
+      continue;
+    }
+    chprintf(chp, "%-9s %4u %-8s %11u %11u %11u %9u\r\n",
+             r.name, r.size, r.unit, r.min,
+             (uint32_t)(r.total / r.calls), r.max, r.min / r.size);
+  }
+}
+
+/*
+ * TX loopback test.
+ * A burst of SSDV size frames is sent and the feeder timing of each frame
+ * is shown. Power 0 leaves the PA at its lowest level for a dummy load.
+ */
+#define USB_TXTEST_FRAMES       8
+#define USB_TXTEST_DATA_SIZE    174     /* SSDV payload of an image packet */
+#define USB_TXTEST_TIMEOUT      TIME_S2I(120)
+
+static si446x_tx_test_t usb_txtest;
+
+void usb_cmd_tx_test(BaseSequentialStream *chp, int argc, char *argv[]) {
+  if(argc > 3) {
+    shellUsage(chp, "txtest [frames] [afsk|2fsk] [power]");
+    return;
+  }
+  int count = argc > 0 ? atoi(argv[0]) : USB_TXTEST_FRAMES;
+  mod_t mod = (argc > 1 && strcmp(argv[1], "2fsk") == 0) ? MOD_2FSK : MOD_AFSK;
+  radio_pwr_t pwr = argc > 2 ? atoi(argv[2]) : 0;
+  if(count < 1 || count > SI446X_TX_TEST_FRAMES) {
+    chprintf(chp, "Frames is 1 to %d\r\n", SI446X_TX_TEST_FRAMES);
+    return;
+  }
+  uint8_t frames = count;
+
+  /* Payloads which do not compress or repeat, as SSDV data. */
+  uint8_t data[USB_TXTEST_DATA_SIZE];
+  uint32_t seed = 1;
+  packet_t head = NULL;
+  packet_t previous = NULL;
+  uint8_t n;
+  for(n = 0; n < frames; n++) {
+    uint16_t i;
+    for(i = 0; i < sizeof(data); i++) {
+      seed = seed * 1103515245 + 12345;
+      data[i] = seed >> 24;
+    }
+    packet_t pp = aprs_encode_base91_packet(conf_sram.aprs.tx.call,
+                                            conf_sram.aprs.tx.path, 'I',
+                                            data, sizeof(data));
+    if(pp == NULL) {
+      chprintf(chp, "No free packet objects\r\n");
+      if(head != NULL)
+        pktReleaseBufferChain(head);
+      return;
+    }
+    if(previous != NULL)
+      previous->nextp = pp;
+    else
+      head = pp;
+    previous = pp;
+  }
+
+  Si446x_startTXTest();
+  if(!transmitOnRadio(head, conf_sram.aprs.tx.radio_conf.freq, 0, 0, pwr,
+                      mod, PKT_SI446X_NO_CCA_RSSI, TX_PRIO_COMMAND)) {
+    Si446x_getTXTest(&usb_txtest, true);
+    chprintf(chp, "Transmit failed\r\n");
+    return;
+  }
+  systime_t start = chVTGetSystemTime();
+  do {
+    chThdSleep(TIME_MS2I(100));
+    Si446x_getTXTest(&usb_txtest, false);
+  } while(usb_txtest.done < frames
+      && chVTTimeElapsedSinceX(start) < USB_TXTEST_TIMEOUT);
+  Si446x_getTXTest(&usb_txtest, true);
+
+  chprintf(chp, "%s burst of %d frames at power %d\r\n",
+           getModulation(mod), frames, pwr);
+  chprintf(chp, "frame bytes  air ms  free min  free max  refills  "
+                "refill avg us  peak us  spi us  gap us  result\r\n");
+  uint32_t air = 0;
+  for(n = 0; n < usb_txtest.done; n++) {
+    si446x_tx_test_frame_t *f = &usb_txtest.frame[n];
+    air += f->air_us;
+    uint32_t avg = f->refills == 0 ? 0 : f->refill_total / f->refills;
+    chprintf(chp, "%5d %5u %7u %9u %9u %8u %14u %8u %7u %7u  %d\r\n",
+             n, f->bytes, f->air_us / 1000,
+             f->free_min == UINT8_MAX ? 0 : f->free_min, f->free_max,
+             f->refills, RTC2US(STM32_SYSCLK, avg),
+             RTC2US(STM32_SYSCLK, f->refill_peak),
+             RTC2US(STM32_SYSCLK, f->spi), RTC2US(STM32_SYSCLK, f->gap),
+             f->result);
+  }
+  if(usb_txtest.done < frames)
+    chprintf(chp, "Only %d of %d frames were sent\r\n", usb_txtest.done,
+             frames);
+  if(usb_txtest.done == 0)
+    return;
+
+  /* Air time of the frames against the time from first start to last end. */
+  uint32_t burst = RTC2US(STM32_SYSCLK,
+                          usb_txtest.frame[usb_txtest.done - 1].end
+                          - usb_txtest.frame[0].start);
+  chprintf(chp, "Burst %ums, air time %ums, efficiency %u%%\r\n",
+           burst / 1000, air / 1000,
+           burst == 0 ? 0 : (uint32_t)((uint64_t)air * 100 / burst));
+}
+
+/*
+ * RF loopback between the radios of the board.
+ * Frames of each length are sent at each power level from one radio to
+ * the other. Latency is from the end of a frame on air to its receipt.
+ */
+static loop_result_t usb_loop;
+
+void usb_cmd_loopback(BaseSequentialStream *chp, int argc, char *argv[]) {
+  if(argc > 3) {
+    shellUsage(chp, "loopback [frames] [afsk|2fsk] [tx radio]");
+    return;
+  }
+  int frames = argc > 0 ? atoi(argv[0]) : LOOP_FRAMES;
+  mod_t mod = (argc > 1 && strcmp(argv[1], "2fsk") == 0) ? MOD_2FSK : MOD_AFSK;
+  radio_unit_t tx = argc > 2 ? atoi(argv[2]) : PKT_RADIO_1;
+  if(frames < 1 || frames > LOOP_FRAMES_MAX) {
+    chprintf(chp, "Frames is 1 to %d\r\n", LOOP_FRAMES_MAX);
+    return;
+  }
+  if(tx == 0 || tx > pktGetNumRadios()) {
+    chprintf(chp, "Invalid radio number %d\r\n", tx);
+    return;
+  }
+
+  loop_status_t status = loop_run(tx, mod, frames, &usb_loop);
+  if(status != LOOP_OK && usb_loop.time_ms == 0) {
+    chprintf(chp, "Loopback failed: %s\r\n", loop_status_name(status));
+    return;
+  }
+  chprintf(chp, "%s radio %d to radio %d on %d.%03d MHz\r\n",
+           getModulation(mod), usb_loop.tx, usb_loop.rx,
+           usb_loop.freq/1000000, (usb_loop.freq%1000000)/1000);
+  chprintf(chp, "power bytes  sent  recv fixed  success  air ms  "
+                "latency avg us  max us\r\n");
+  uint32_t sent = 0, received = 0, air = 0;
+  uint8_t n;
+  for(n = 0; n < LOOP_NUM_POWERS * LOOP_NUM_LENGTHS; n++) {
+    loop_step_t *s = &usb_loop.step[n];
+    if(s->sent == 0)
+      continue;
+    sent += s->sent;
+    received += s->received;
+    air += s->air_total / 1000;
+    chprintf(chp, "%5d %5u %5u %5u %5u %7u%% %7u %15u %7u\r\n",
+             s->pwr, s->len, s->sent, s->received, s->fixed,
+             s->received * 100 / s->sent,
+             s->received == 0 ? 0 : s->air_total / s->received / 1000,
+             s->received == 0 ? 0 : s->lat_total / s->received, s->lat_max);
+  }
+  chprintf(chp, "Frames %u of %u, bad CRC %u, strays %u\r\n",
+           received, sent, usb_loop.bad, usb_loop.strays);
+  chprintf(chp, "Test %ums, air time %ums, CPU %u.%u%%, decoder %u.%u%%\r\n",
+           usb_loop.time_ms, air, usb_loop.cpu / 10, usb_loop.cpu % 10,
+           usb_loop.decoder / 10, usb_loop.decoder % 10);
+  if(status != LOOP_OK)
+    chprintf(chp, "Stopped: %s\r\n", loop_status_name(status));
+}
+
+/*
+ * Show the latency of the recent positions from the sensors to the air.
+ * Each stage is the delay from the stage before it. The ages are the
+ * delays to the air from the sample, the GPS fix and the encode.
+ */
+void usb_cmd_tx_latency(BaseSequentialStream *chp, int argc, char *argv[]) {
+  if(argc > 1 || (argc == 1 && strcmp(argv[0], "clear") != 0)) {
+    shellUsage(chp, "latency [clear]");
+    return;
+  }
+  if(argc == 1) {
+    txlat_reset();
+    return;
+  }
+  chprintf(chp, "stage        count   p50 ms   p90 ms   max ms\r\n");
+  txlat_stage_t st;
+  for(st = TXLAT_ENCODE; st < TXLAT_STAGES; st++) {
+    txlat_summary_t s;
+    if(!txlat_summary(st, &s)) {
+      chprintf(chp, "%-10s %7u\r\n", txlat_stage_name(st), 0);
+      continue;
+    }
+    chprintf(chp, "%-10s %7u %8u %8u %8u\r\n", txlat_stage_name(st),
+             s.count, s.p50, s.p90, s.max);
+  }
+  /* Age of the data when it went on air. */
+  txlat_stage_t from[] = {TXLAT_SAMPLE, TXLAT_FIX, TXLAT_ENCODE};
+  uint8_t i;
+  for(i = 0; i < sizeof(from) / sizeof(from[0]); i++) {
+    txlat_summary_t s;
+    char name[16];
+    chsnprintf(name, sizeof(name), "%s>rf", txlat_stage_name(from[i]));
+    if(!txlat_age(from[i], &s)) {
+      chprintf(chp, "%-10s %7u\r\n", name, 0);
+      continue;
+    }
+    chprintf(chp, "%-10s %7u %8u %8u %8u\r\n", name,
+             s.count, s.p50, s.p90, s.max);
+  }
+  chprintf(chp, "%u positions dropped before air\r\n", txlat_dropped());
+}
+
+/*
+ * Stream an Intel HEX image into the log memory and install it.
+ * The CRC-32 is of the binary image with gaps filled with 0xFF.
+ * Without "install" the image is only staged and verified.
+ */
+void usb_cmd_fw_update(BaseSequentialStream *chp, int argc, char *argv[]) {
+  bool install = (argc == 2 && strcmp(argv[1], "install") == 0);
+  if(argc < 1 || argc > 2 || (argc == 2 && !install)) {
+    shellUsage(chp, "fwupdate <crc32 hex> [install]");
+    return;
+  }
+  uint32_t crc = strtoul(argv[0], NULL, 16);
+
+  chprintf(chp, "Logging suspended until reset. Send the Intel HEX image\r\n");
+  fw_update_begin();
+
+  static char line[FW_RECORD_LINE_MAX + 1];
+  size_t len = 0;
+  uint32_t records = 0;
+  fw_record_t result = FW_RECORD_OK;
+  while(result == FW_RECORD_OK) {
+    msg_t c = chnGetTimeout((BaseChannel *)chp, FW_RECORD_TIMEOUT);
+    if(c == STM_TIMEOUT) {
+      chprintf(chp, "Update timed out after %u records\r\n", records);
+      return;
+    }
+    if(c != '\r' && c != '\n') {
+      if(len >= FW_RECORD_LINE_MAX) {
+        result = FW_RECORD_BAD;
+        break;
+      }
+      line[len++] = (char)c;
+      continue;
+    }
+    if(len == 0)
+      continue;
+    line[len] = '\0';
+    len = 0;
+    records++;
+    result = fw_update_record(line);
+  }
+  if(result != FW_RECORD_END) {
+    static const char *const errors[] = {
+      [FW_RECORD_BAD] = "malformed record",
+      [FW_RECORD_RANGE] = "address outside program memory or descending",
+      [FW_RECORD_FLASH] = "flash write failed"
+    };
+    chprintf(chp, "Update failed at record %u: %s\r\n", records,
+             errors[result]);
+    return;
+  }
+
+  uint32_t size, calc;
+  if(!fw_update_finish(crc, &size, &calc)) {
+    chprintf(chp, "Image of %u bytes failed verification (CRC %08x)\r\n",
+             size, calc);
+    return;
+  }
+  chprintf(chp, "Image of %u bytes in %u records verified (CRC %08x)\r\n",
+           size, records, calc);
+  if(!install)
+    return;
+  chprintf(chp, "Installing, the tracker restarts when done\r\n");
+  chThdSleep(TIME_MS2I(100));
+  (void)fw_update_install();
 }
@@ -7,15 +7,35 @@
 void usb_cmd_set_trace_level(BaseSequentialStream *chp, int argc, char *argv[]);
 void usb_cmd_printConfig(BaseSequentialStream *chp, int argc, char *argv[]);
 void usb_cmd_printPicture(BaseSequentialStream *chp, int argc, char *argv[]);
+void usb_cmd_printPictureBin(BaseSequentialStream *chp, int argc, char *argv[]);
 void usb_cmd_printLog(BaseSequentialStream *chp, int argc, char *argv[]);
+void usb_cmd_printLogBin(BaseSequentialStream *chp, int argc, char *argv[]);
 void usb_cmd_command2Camera(BaseSequentialStream *chp, int argc, char *argv[]);
 void usb_cmd_send_aprs_message(BaseSequentialStream *chp, int argc, char *argv[]);
+void usb_cmd_kiss(BaseSequentialStream *chp, int argc, char *argv[]);
 void usb_cmd_set_test_gps(BaseSequentialStream *chp, int argc, char *argv[]);
 void usb_cmd_ccm_heap(BaseSequentialStream *chp, int argc, char *argv[]);
+void usb_cmd_stats(BaseSequentialStream *chp, int argc, char *argv[]);
+void usb_cmd_thread_prof(BaseSequentialStream *chp, int argc, char *argv[]);
+void usb_cmd_watchdog(BaseSequentialStream *chp, int argc, char *argv[]);
+void usb_cmd_budget(BaseSequentialStream *chp, int argc, char *argv[]);
 void usb_cmd_get_gps_sat_info(BaseSequentialStream *chp, int argc, char *argv[]);
 void usb_cmd_get_error_list(BaseSequentialStream *chp, int argc, char *argv[]);
 void usb_cmd_time(BaseSequentialStream *chp, int argc, char *argv[]);
 void usb_cmd_radio(BaseSequentialStream *chp, int argc, char *argv[]);
+void usb_cmd_afsk_stats(BaseSequentialStream *chp, int argc, char *argv[]);
+void usb_cmd_pwm_pool(BaseSequentialStream *chp, int argc, char *argv[]);
+void usb_cmd_pkt_events(BaseSequentialStream *chp, int argc, char *argv[]);
+void usb_cmd_pwm_replay(BaseSequentialStream *chp, int argc, char *argv[]);
+void usb_cmd_ssdv_bench(BaseSequentialStream *chp, int argc, char *argv[]);
+void usb_cmd_bench(BaseSequentialStream *chp, int argc, char *argv[]);
+void usb_cmd_tx_test(BaseSequentialStream *chp, int argc, char *argv[]);
+void usb_cmd_loopback(BaseSequentialStream *chp, int argc, char *argv[]);
+void usb_cmd_tx_latency(BaseSequentialStream *chp, int argc, char *argv[]);
+void usb_cmd_fw_update(BaseSequentialStream *chp, int argc, char *argv[]);
+void usb_cmd_energy(BaseSequentialStream *chp, int argc, char *argv[]);
+void usb_cmd_tseries(BaseSequentialStream *chp, int argc, char *argv[]);
+void usb_cmd_rf_capture(BaseSequentialStream *chp, int argc, char *argv[]);
 
 extern const ShellCommand commands[];
 
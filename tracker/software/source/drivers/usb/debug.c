@@ -2,6 +2,8 @@
 #include "hal.h"
 #include "debug.h"
 #include "portab.h"
+#include "memstreams.h"
+#include "pclock.h"
 
 mutex_t mtx; // Used internal to synchronize multiple chprintf in debug.h
 
@@ -21,47 +23,346 @@ uint8_t usb_trace_level = USB_TRACE_LEVEL; // Set in makefile UDEFS
 uint8_t usb_trace_level = 2; // Level: Errors + Warnings
 #endif
 
+/*
+ * Messages are stored in a ring with their format string and arguments
+ * and formatted by the trace thread. A caller only reserves an entry and
+ * copies the arguments so it never waits for USB or the serial port.
+ */
+typedef struct {
+	uint32_t	seq;	// Ring index + 1 once the entry is complete
+	systime_t	time;
+	const char	*type;
+	const char	*file;
+	const char	*format;
+	uint32_t	line;
+	uint16_t	len;	// Bytes used in args
+	uint8_t		args[TRACE_ARGS_SIZE];
+} trace_entry_t;
 
-void debug_init(void) {
-	chMtxObjectInit(&mtx);
+static struct {
+	uint32_t		head;		// Next entry to reserve
+	uint32_t		tail;		// Next entry to output
+	uint32_t		dropped;	// Messages lost while the ring was full
+	trace_entry_t	entry[TRACE_RING_SIZE];
+} trace_ring;
 
-	sdStart(&SD3, &debug_config);
-	palSetLineMode(LINE_IO_TXD, PAL_MODE_ALTERNATE(7));
-	palSetLineMode(LINE_IO_RXD, PAL_MODE_ALTERNATE(7));
+static thread_t *trace_thd;
+static BSEMAPHORE_DECL(trace_sem, true);	// Signalled when an entry is complete
+
+typedef enum {
+	TRACE_ARG_NONE,
+	TRACE_ARG_INT,
+	TRACE_ARG_STR,
+	TRACE_ARG_FLOAT
+} trace_arg_t;
+
+/*
+ * Parses a conversion the way chvprintf() does.
+ * fmt points after the '%'. Returns the position after the conversion.
+ */
+static const char *trace_parse(const char *fmt, uint8_t *stars, trace_arg_t *arg) {
+	char c;
+	*stars = 0;
+	if(*fmt == '-')
+		fmt++;
+	if(*fmt == '0')
+		fmt++;
+	do {
+		c = *fmt++;
+		if(c == '*')
+			(*stars)++;
+	} while((c >= '0' && c <= '9') || c == '*');
+	if(c == '.') {
+		do {
+			c = *fmt++;
+			if(c == '*')
+				(*stars)++;
+		} while((c >= '0' && c <= '9') || c == '*');
+	}
+	if((c == 'l' || c == 'L') && *fmt)
+		c = *fmt++;
+	if(c == 0)
+		fmt--;
+
+	switch(c) {
+	case 'c':
+	case 'D':
+	case 'd':
+	case 'I':
+	case 'i':
+	case 'X':
+	case 'x':
+	case 'U':
+	case 'u':
+	case 'O':
+	case 'o':
+		*arg = TRACE_ARG_INT;
+		break;
+	case 's':
+		*arg = TRACE_ARG_STR;
+		break;
+#if CHPRINTF_USE_FLOAT
+	case 'f':
+		*arg = TRACE_ARG_FLOAT;
+		break;
+#endif
+	default:
+		*arg = TRACE_ARG_NONE;
+		break;
+	}
+	return fmt;
 }
 
-void debug_print(char *type, char* filename, uint32_t line, char* format, ...)
-{
-	chMtxLock(&mtx);
+static bool trace_put(trace_entry_t *e, const void *data, size_t size) {
+	if(e->len + size > sizeof(e->args))
+		return false;
+	memcpy(&e->args[e->len], data, size);
+	e->len += size;
+	return true;
+}
 
-	uint8_t str[256];
+/*
+ * Strings are copied as the caller may pass a buffer on its stack.
+ */
+static bool trace_put_str(trace_entry_t *e, const char *s) {
+	if(s == NULL)
+		s = "(null)";
+	size_t size = strlen(s);
+	if(e->len >= sizeof(e->args))
+		return false;
+	if(size > sizeof(e->args) - e->len - 1)
+		size = sizeof(e->args) - e->len - 1;
+	memcpy(&e->args[e->len], s, size);
+	e->args[e->len + size] = 0;
+	e->len += size + 1;
+	return true;
+}
 
-	va_list args;
-	va_start(args, format);
-	chsnprintf((char*)str, sizeof(str), format, args);
-	va_end(args);
+/*
+ * Stores the arguments of a message. Arguments which do not fit are
+ * dropped and the message is cut there when it is formatted.
+ */
+static void trace_store(trace_entry_t *e, const char *fmt, va_list ap) {
+	e->len = 0;
+	while((fmt = strchr(fmt, '%')) != NULL) {
+		uint8_t stars;
+		trace_arg_t arg;
+		fmt = trace_parse(fmt + 1, &stars, &arg);
+		for(uint8_t i = 0; i < stars; i++) {
+			int v = va_arg(ap, int);
+			if(!trace_put(e, &v, sizeof(v)))
+				return;
+		}
+		switch(arg) {
+		case TRACE_ARG_INT: {
+			int v = va_arg(ap, int);
+			if(!trace_put(e, &v, sizeof(v)))
+				return;
+			break;
+		}
+		case TRACE_ARG_STR:
+			if(!trace_put_str(e, va_arg(ap, const char*)))
+				return;
+			break;
+		case TRACE_ARG_FLOAT: {
+			double v = va_arg(ap, double);
+			if(!trace_put(e, &v, sizeof(v)))
+				return;
+			break;
+		}
+		case TRACE_ARG_NONE:
+			break;
+		}
+	}
+}
+
+static bool trace_get(const trace_entry_t *e, size_t *pos, void *data, size_t size) {
+	if(*pos + size > e->len)
+		return false;
+	memcpy(data, &e->args[*pos], size);
+	*pos += size;
+	return true;
+}
 
+/*
+ * Formats a stored message. Each conversion is printed on its own with
+ * its argument. A '*' width or precision is replaced by its value.
+ */
+static void trace_format(BaseSequentialStream *chp, const trace_entry_t *e) {
+	const char *fmt = e->format;
+	size_t pos = 0;
+	const char *spec;
+	while((spec = strchr(fmt, '%')) != NULL) {
+		streamWrite(chp, (const uint8_t*)fmt, spec - fmt);
+		uint8_t stars;
+		trace_arg_t arg;
+		fmt = trace_parse(spec + 1, &stars, &arg);
 
-	if(isConsoleOutputAvailable()) {
-		if(TRACE_TIME) {
-			chprintf((BaseSequentialStream*)&SDU1, "[%8d.%03d]", chVTGetSystemTime()/CH_CFG_ST_FREQUENCY, (chVTGetSystemTime()*1000/CH_CFG_ST_FREQUENCY)%1000);
+		char conv[24];
+		size_t n = 0;
+		for(; spec < fmt && n < sizeof(conv) - 1; spec++) {
+			if(*spec != '*') {
+				conv[n++] = *spec;
+				continue;
+			}
+			int v;
+			if(!trace_get(e, &pos, &v, sizeof(v))) {
+				chprintf(chp, "...");
+				return;
+			}
+			chsnprintf(&conv[n], sizeof(conv) - n, "%d", v < 0 ? 0 : v);
+			n += strlen(&conv[n]);
+		}
+		conv[n] = 0;
+
+		switch(arg) {
+		case TRACE_ARG_INT: {
+			int v;
+			if(!trace_get(e, &pos, &v, sizeof(v))) {
+				chprintf(chp, "...");
+				return;
+			}
+			chprintf(chp, conv, v);
+			break;
 		}
-		chprintf((BaseSequentialStream*)&SDU1, "[%s]", type);
-		if(TRACE_FILE) {
-			chprintf((BaseSequentialStream*)&SDU1, "[%12s %04d]", filename, line);
+		case TRACE_ARG_STR:
+			if(pos >= e->len) {
+				chprintf(chp, "...");
+				return;
+			}
+			chprintf(chp, conv, (const char*)&e->args[pos]);
+			pos += strlen((const char*)&e->args[pos]) + 1;
+			break;
+		case TRACE_ARG_FLOAT: {
+			double v;
+			if(!trace_get(e, &pos, &v, sizeof(v))) {
+				chprintf(chp, "...");
+				return;
+			}
+			chprintf(chp, conv, v);
+			break;
+		}
+		case TRACE_ARG_NONE:
+			chprintf(chp, conv);
+			break;
 		}
-		chprintf((BaseSequentialStream*)&SDU1, " %s\r\n", str);
 	}
+	chprintf(chp, "%s", fmt);
+}
 
+/*
+ * Writes a formatted message to the console and the serial port.
+ */
+static void trace_output(systime_t time, const char *type, const char *file,
+						 uint32_t line, const char *str) {
+	char head[48];
+	MemoryStream ms;
+	msObjectInit(&ms, (uint8_t*)head, sizeof(head) - 1, 0);
+	BaseSequentialStream *chp = (BaseSequentialStream*)&ms;
 	if(TRACE_TIME) {
-		chprintf((BaseSequentialStream*)&SD3, "[%8d.%03d]", chVTGetSystemTime()/CH_CFG_ST_FREQUENCY, (chVTGetSystemTime()*1000/CH_CFG_ST_FREQUENCY)%1000);
+		chprintf(chp, "[%8d.%03d]", time/CH_CFG_ST_FREQUENCY, (time*1000/CH_CFG_ST_FREQUENCY)%1000);
 	}
-	chprintf((BaseSequentialStream*)&SD3, "[%s]", type);
+	chprintf(chp, "[%s]", type);
 	if(TRACE_FILE) {
-		chprintf((BaseSequentialStream*)&SD3, "[%12s %04d]", filename, line);
+		chprintf(chp, "[%12s %04d]", file, line);
+	}
+	chprintf(chp, " ");
+	head[ms.eos] = 0;
+
+	if(isConsoleOutputAvailable()) {
+		chprintf((BaseSequentialStream*)&SDU1, "%s%s\r\n", head, str);
+	}
+	if(TRACE_SERIAL) {
+		chprintf((BaseSequentialStream*)&SD3, "%s%s\r\n", head, str);
 	}
-	chprintf((BaseSequentialStream*)&SD3, " %s\r\n", str);
+}
 
-	chMtxUnlock(&mtx);
+static THD_FUNCTION(traceThread, arg) {
+	(void)arg;
+
+	char str[TRACE_LINE_SIZE];
+	while(true) {
+		trace_entry_t *e = &trace_ring.entry[trace_ring.tail % TRACE_RING_SIZE];
+		if(__atomic_load_n(&e->seq, __ATOMIC_ACQUIRE) != trace_ring.tail + 1) {
+			/* Empty or the next message is still being stored. */
+			(void)chBSemWait(&trace_sem);
+			continue;
+		}
+
+		MemoryStream ms;
+		msObjectInit(&ms, (uint8_t*)str, sizeof(str) - 1, 0);
+		trace_format((BaseSequentialStream*)&ms, e);
+		str[ms.eos] = 0;
+		systime_t time = e->time;
+		const char *type = e->type;
+		const char *file = e->file;
+		uint32_t line = e->line;
+
+		/* Release the entry before the slow output. */
+		__atomic_store_n(&trace_ring.tail, trace_ring.tail + 1, __ATOMIC_RELEASE);
+		trace_output(time, type, file, line, str);
+
+		uint32_t dropped = __atomic_exchange_n(&trace_ring.dropped, 0, __ATOMIC_RELAXED);
+		if(dropped) {
+			chsnprintf(str, sizeof(str), "TRACE> %d messages dropped", dropped);
+			trace_output(chVTGetSystemTime(), "WARN ", __FILENAME__, __LINE__, str);
+		}
+	}
 }
 
+void debug_init(void) {
+	chMtxObjectInit(&mtx);
+
+	sdStart(&SD3, &debug_config);
+	pclkRetimeSerial(&SD3);
+	palSetLineMode(LINE_IO_TXD, PAL_MODE_ALTERNATE(7));
+	palSetLineMode(LINE_IO_RXD, PAL_MODE_ALTERNATE(7));
+
+	trace_thd = chThdCreateFromHeap(NULL, THD_WORKING_AREA_SIZE(2*1024), "TRACE", LOWPRIO, traceThread, NULL);
+}
+
+void debug_print(char *type, char* filename, uint32_t line, char* format, ...)
+{
+	va_list args;
+	va_start(args, format);
+
+	if(trace_thd == NULL) {
+		// No trace thread, print directly
+		chMtxLock(&mtx);
+
+		char str[TRACE_LINE_SIZE];
+		MemoryStream ms;
+		msObjectInit(&ms, (uint8_t*)str, sizeof(str) - 1, 0);
+		chvprintf((BaseSequentialStream*)&ms, format, args);
+		str[ms.eos] = 0;
+		trace_output(chVTGetSystemTime(), type, filename, line, str);
+
+		chMtxUnlock(&mtx);
+		va_end(args);
+		return;
+	}
+
+	// Reserve an entry
+	uint32_t head = __atomic_load_n(&trace_ring.head, __ATOMIC_RELAXED);
+	do {
+		if(head - __atomic_load_n(&trace_ring.tail, __ATOMIC_ACQUIRE) >= TRACE_RING_SIZE) {
+			__atomic_fetch_add(&trace_ring.dropped, 1, __ATOMIC_RELAXED);
+			va_end(args);
+			return;
+		}
+	} while(!__atomic_compare_exchange_n(&trace_ring.head, &head, head + 1,
+										 true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+
+	trace_entry_t *e = &trace_ring.entry[head % TRACE_RING_SIZE];
+	e->time = chVTGetSystemTime();
+	e->type = type;
+	e->file = filename;
+	e->line = line;
+	e->format = format;
+	trace_store(e, format, args);
+	va_end(args);
+
+	// Hand the entry to the trace thread
+	__atomic_store_n(&e->seq, head + 1, __ATOMIC_RELEASE);
+	chBSemSignal(&trace_sem);
+}
@@ -13,18 +13,44 @@
 #define ERROR_LIST_LENGTH	64
 #define ERROR_LIST_SIZE		32
 
+#define TRACE_RING_SIZE		32	// Messages waiting for output, power of 2
+#define TRACE_ARGS_SIZE		96	// Bytes for the arguments of a message
+#define TRACE_LINE_SIZE		256	// Length of a formatted message
+
 #define __FILENAME__ (strrchr(__FILE__, '/') ? strrchr(__FILE__, '/') + 1 : __FILE__)
 
 extern char error_list[ERROR_LIST_SIZE][ERROR_LIST_LENGTH];
 extern uint8_t error_counter;
 extern uint8_t usb_trace_level;
 
-#define TRACE_DEBUG(format, args...) if(usb_trace_level > 4) { debug_print("DEBUG", __FILENAME__, __LINE__, format, ##args); }
-#define TRACE_INFO(format, args...)  if(usb_trace_level > 3) { debug_print("     ", __FILENAME__, __LINE__, format, ##args); }
-#define TRACE_MON(format, args...)  if(usb_trace_level > 2) { debug_print("     ", __FILENAME__, __LINE__, format, ##args); }
-#define TRACE_WARN(format, args...)  if(usb_trace_level > 1) { debug_print("WARN ", __FILENAME__, __LINE__, format, ##args); }
+#define TRACE_LEVEL_ERROR	1
+#define TRACE_LEVEL_WARN	2
+#define TRACE_LEVEL_MON		3
+#define TRACE_LEVEL_INFO	4
+#define TRACE_LEVEL_DEBUG	5
+
+/*
+ * Highest trace level compiled in. Set it in UDEFS for a build or redefine
+ * it after the includes of a module. Traces above it are removed with
+ * their arguments.
+ */
+#ifndef TRACE_LEVEL
+#define TRACE_LEVEL			TRACE_LEVEL_DEBUG
+#endif
+
+/*
+ * True if a trace of the level is output somewhere. Guard formatting work
+ * done before a trace with it.
+ */
+#define TRACE_ACTIVE(level) (TRACE_LEVEL >= (level) && usb_trace_level >= (level) \
+	&& (TRACE_SERIAL || isConsoleOutputAvailable()))
+
+#define TRACE_DEBUG(format, args...) if(TRACE_ACTIVE(TRACE_LEVEL_DEBUG)) { debug_print("DEBUG", __FILENAME__, __LINE__, format, ##args); }
+#define TRACE_INFO(format, args...)  if(TRACE_ACTIVE(TRACE_LEVEL_INFO)) { debug_print("     ", __FILENAME__, __LINE__, format, ##args); }
+#define TRACE_MON(format, args...)  if(TRACE_ACTIVE(TRACE_LEVEL_MON)) { debug_print("     ", __FILENAME__, __LINE__, format, ##args); }
+#define TRACE_WARN(format, args...)  if(TRACE_ACTIVE(TRACE_LEVEL_WARN)) { debug_print("WARN ", __FILENAME__, __LINE__, format, ##args); }
 #define TRACE_ERROR(format, args...) { \
-	if(usb_trace_level > 0) { \
+	if(TRACE_ACTIVE(TRACE_LEVEL_ERROR)) { \
 		debug_print("ERROR", __FILENAME__, __LINE__, format, ##args); \
 	} \
 	\
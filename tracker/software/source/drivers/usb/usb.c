@@ -4,6 +4,7 @@
 #include "shell.h"
 #include "commands.h"
 #include "pktconf.h"
+#include "memregion.h"
 
 
 static const ShellConfig shell_cfg = {
@@ -88,7 +89,7 @@ THD_FUNCTION(pktConsole, arg) {
         chprintf(chp, "\r\n*** Trace suspended - type ^D or use the "
             "'exit' command to resume trace ***\r\n");
         shellInit();
-        shelltp = chThdCreateFromHeap(NULL,
+        shelltp = mem_thread_create(MEM_REGION_THREADS,
                                       THD_WORKING_AREA_SIZE(4*1024),
                                       "shell", NORMALPRIO + 1,
                                       shellThread,
@@ -16,6 +16,7 @@
 
 #include "hal.h"
 #include "config.h"
+#include "pclock.h"
 
 /* Attempt to get FTDI emulation working... not a success thus far. */
 #define USB_VCP_FTDI_230X       FALSE
@@ -451,6 +452,9 @@ static void usb_event(USBDriver *usbp, usbevent_t event) {
     /* Disconnection event on suspend.*/
     sduSuspendHookI(&SDU1);
 
+    /* Clock profile follows the bus state.*/
+    pclkUpdateI();
+
     chSysUnlockFromISR();
     return;
   case USB_EVENT_WAKEUP:
@@ -459,6 +463,9 @@ static void usb_event(USBDriver *usbp, usbevent_t event) {
     /* Wake up event.*/
     sduWakeupHookI(&SDU1);
 
+    /* Clock profile follows the bus state.*/
+    pclkUpdateI();
+
     chSysUnlockFromISR();
     return;
   case USB_EVENT_STALLED:
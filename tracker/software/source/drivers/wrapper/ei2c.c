@@ -14,7 +14,74 @@
 #include "hal.h"
 #include "debug.h"
 #include "portab.h"
+#include "ei2c.h"
 
+#if EI2C_USE_HARDWARE == TRUE
+/*
+ * Hardware I2C on boards with the external pins on an I2C peripheral.
+ * Transfers are made by DMA so the CPU is free while the transfer runs.
+ */
+static const I2CConfig ei2c_cfg = {
+	OPMODE_I2C,
+	EI2C_SPEED,
+	EI2C_SPEED > 100000 ? FAST_DUTY_CYCLE_2 : STD_DUTY_CYCLE,
+};
+
+static bool pins_set = false;
+
+static bool eI2C_transmit(uint8_t addr, uint8_t *txbuf, uint32_t txbytes, uint8_t *rxbuf, uint32_t rxbytes) {
+	i2cAcquireBus(EI2C_DRIVER);
+	if(!pins_set) {
+		palSetLineMode(EI2C_SCL, PAL_MODE_ALTERNATE(EI2C_AF) | PAL_STM32_OTYPE_OPENDRAIN | PAL_STM32_OSPEED_HIGHEST);
+		palSetLineMode(EI2C_SDA, PAL_MODE_ALTERNATE(EI2C_AF) | PAL_STM32_OTYPE_OPENDRAIN | PAL_STM32_OSPEED_HIGHEST);
+		pins_set = true;
+	}
+	i2cStart(EI2C_DRIVER, &ei2c_cfg);
+	msg_t i2c_status = i2cMasterTransmitTimeout(EI2C_DRIVER, addr, txbuf, txbytes, rxbuf, rxbytes, TIME_MS2I(100));
+	i2cStop(EI2C_DRIVER);
+	i2cReleaseBus(EI2C_DRIVER);
+
+	if(i2c_status == MSG_TIMEOUT)
+		TRACE_ERROR("EI2C > TIMEOUT (ADDR 0x%02x)", addr);
+	return i2c_status == MSG_OK;
+}
+
+bool eI2C_write8(uint8_t address, uint8_t reg, uint8_t value) {
+	uint8_t txbuf[] = {reg, value};
+	return eI2C_transmit(address, txbuf, 2, NULL, 0);
+}
+
+/* The driver receives at least two bytes. The second is not used. */
+bool eI2C_read8(uint8_t address, uint8_t reg, uint8_t *val) {
+	uint8_t txbuf[] = {reg};
+	uint8_t rxbuf[2];
+	bool ret = eI2C_transmit(address, txbuf, 1, rxbuf, 2);
+	*val = rxbuf[0];
+	return ret;
+}
+
+bool eI2C_read16(uint8_t address, uint8_t reg, uint16_t *val) {
+	uint8_t txbuf[] = {reg};
+	uint8_t rxbuf[2];
+	bool ret = eI2C_transmit(address, txbuf, 1, rxbuf, 2);
+	*val = (rxbuf[0] << 8) | rxbuf[1];
+	return ret;
+}
+
+bool eI2C_read16_LE(uint8_t address, uint8_t reg, uint16_t *val) {
+	uint8_t txbuf[] = {reg};
+	uint8_t rxbuf[2];
+	bool ret = eI2C_transmit(address, txbuf, 1, rxbuf, 2);
+	*val = rxbuf[0] | (rxbuf[1] << 8);
+	return ret;
+}
+
+bool eI2C_readN(uint8_t address, uint8_t reg, uint8_t *rxbuf, uint32_t length) {
+	uint8_t txbuf[] = {reg};
+	return eI2C_transmit(address, txbuf, 1, rxbuf, length);
+}
+
+#else /* EI2C_USE_HARDWARE != TRUE */
 static bool started = false;
 
 static inline bool read_SCL(void) { // Return current level of SCL line, 0 or 1
@@ -194,3 +261,14 @@ bool eI2C_read16_LE(uint8_t address, uint8_t reg, uint16_t *val) {
 	return true;
 }
 
+bool eI2C_readN(uint8_t address, uint8_t reg, uint8_t *rxbuf, uint32_t length) {
+	i2c_write_byte(true, false, address << 1);
+	i2c_write_byte(false, false, reg);
+
+	i2c_write_byte(true, false,(address << 1) | 0x1);
+	for(uint32_t i = 0; i < length; i++)
+		rxbuf[i] = i2c_read_byte(i == length-1, i == length-1);
+	return true;
+}
+#endif /* EI2C_USE_HARDWARE == TRUE */
+
@@ -0,0 +1,241 @@
+/**
+  * Firmware update over the USB console.
+  * Intel HEX records are programmed as they arrive into the log memory,
+  * which holds the staged image. Each staging sector is erased when the
+  * image reaches it, unless it is already blank, and each write is read
+  * back. The log is suspended for the update.
+  *
+  * The finished stage is checked against the CRC-32 of the image given by
+  * the sender and its vector table is checked. Installing copies the stage
+  * to the program memory from a routine in RAM, as nothing in the program
+  * memory may run while it is erased, and resets the MCU.
+  *
+  * The F413 has a single flash bank. Code fetches stall while a sector is
+  * erased, so erase and programming can not overlap.
+  */
+
+#include "ch.h"
+#include "hal.h"
+#include "fwupdate.h"
+#include "flash.h"
+#include "ihex.h"
+#include "pcrc.h"
+#include "debug.h"
+#include <string.h>
+
+typedef struct {
+	uint32_t	upper;		// Extended address of the records
+	uint32_t	next;		// Image offset following the last data
+	uint32_t	end;		// Image offset following the data written
+	uint8_t		erased;		// Staging sectors erased
+	bool		verified;
+	uint16_t	buffered;
+	uint32_t	start;		// Image offset of the buffer
+	uint8_t		buffer[FW_WRITE_SIZE] __attribute__((aligned(4)));
+} fw_update_t;
+
+static fw_update_t fw;
+static IHexRecord fw_record;
+
+/*
+ * Erase the staging sectors up to the given image offset.
+ * Sectors skipped by the image are erased as well so they read blank.
+ */
+static bool fw_prepare_stage(uint32_t end)
+{
+	while((uint32_t)fw.erased * FW_STAGE_SECTOR_SIZE < end) {
+		flashaddr_t addr = FW_STAGE_ADDR + fw.erased * FW_STAGE_SECTOR_SIZE;
+		if(!flashIsErased(addr, FW_STAGE_SECTOR_SIZE)
+				&& flashErase(addr, FW_STAGE_SECTOR_SIZE) != FLASH_RETURN_SUCCESS)
+			return false;
+		fw.erased++;
+	}
+	return true;
+}
+
+/*
+ * Program the buffered data to the stage and read it back.
+ */
+static bool fw_flush(void)
+{
+	if(fw.buffered == 0)
+		return true;
+	uint32_t end = fw.start + fw.buffered;
+	flashaddr_t addr = FW_STAGE_ADDR + fw.start;
+	fw.buffered = 0;
+	if(!fw_prepare_stage(end))
+		return false;
+	if(flashWrite(addr, (char*)fw.buffer, end - fw.start) != FLASH_RETURN_SUCCESS
+			|| !flashCompare(addr, (char*)fw.buffer, end - fw.start))
+		return false;
+	if(end > fw.end)
+		fw.end = end;
+	return true;
+}
+
+/*
+ * Add the data of a record to the write buffer.
+ * Data must be ascending. A gap or a full buffer flushes the buffer.
+ */
+static fw_record_t fw_stage_data(uint32_t addr, const uint8_t *data, uint16_t len)
+{
+	if(addr < FW_IMAGE_ADDR || addr - FW_IMAGE_ADDR + len > FW_IMAGE_SIZE)
+		return FW_RECORD_RANGE;
+	uint32_t offset = addr - FW_IMAGE_ADDR;
+	if(offset < fw.next)
+		return FW_RECORD_RANGE;
+	fw.next = offset + len;
+
+	if(fw.buffered != 0 && offset != fw.start + fw.buffered && !fw_flush())
+		return FW_RECORD_FLASH;
+	while(len > 0) {
+		if(fw.buffered == 0)
+			fw.start = offset;
+		uint16_t n = FW_WRITE_SIZE - fw.buffered;
+		if(n > len)
+			n = len;
+		memcpy(&fw.buffer[fw.buffered], data, n);
+		fw.buffered += n;
+		offset += n;
+		data += n;
+		len -= n;
+		if(fw.buffered == FW_WRITE_SIZE && !fw_flush())
+			return FW_RECORD_FLASH;
+	}
+	return FW_RECORD_OK;
+}
+
+/*
+ * Copy the stage to the program memory and reset.
+ * This runs from RAM with the system disabled and may not call anything
+ * in the program memory.
+ */
+static void __attribute__((section(".ramtext"), noinline, noreturn, long_call))
+fw_install_ram(uint32_t size)
+{
+	FLASH->KEYR = 0x45670123;
+	FLASH->KEYR = 0xCDEF89AB;
+	while(FLASH->SR & FLASH_SR_BSY);
+	FLASH->SR = FLASH_SR_WRPERR | FLASH_SR_PGAERR | FLASH_SR_PGPERR
+			| FLASH_SR_PGSERR;
+
+	uint32_t addr = FW_IMAGE_ADDR;
+	uint32_t sector = 0;
+	while(addr < FW_IMAGE_ADDR + size) {
+		IWDG->KR = 0xAAAA;
+		FLASH->CR = FLASH_CR_PSIZE_VALUE | FLASH_CR_SER
+				| (sector << FLASH_CR_SNB_Pos);
+		FLASH->CR |= FLASH_CR_STRT;
+		while(FLASH->SR & FLASH_SR_BSY);
+		addr += sector < 4 ? 0x4000 : sector == 4 ? 0x10000 : 0x20000;
+		sector++;
+	}
+
+	FLASH->CR = FLASH_CR_PSIZE_VALUE | FLASH_CR_PG;
+	volatile flashdata_t *dst = (volatile flashdata_t*)FW_IMAGE_ADDR;
+	const volatile flashdata_t *src = (const volatile flashdata_t*)FW_STAGE_ADDR;
+	uint32_t words = (size + sizeof(flashdata_t) - 1) / sizeof(flashdata_t);
+	for(uint32_t i = 0; i < words; i++) {
+		dst[i] = src[i];
+		while(FLASH->SR & FLASH_SR_BSY);
+		if((i & 0x3FF) == 0)
+			IWDG->KR = 0xAAAA;
+	}
+	FLASH->CR = FLASH_CR_LOCK;
+
+	SCB->AIRCR = (0x5FAUL << SCB_AIRCR_VECTKEY_Pos) | SCB_AIRCR_SYSRESETREQ_Msk;
+	__DSB();
+	while(true);
+}
+
+/*
+ * Start an update. The log is suspended as its memory holds the stage.
+ */
+void fw_update_begin(void)
+{
+	flash_suspendLog();
+	memset(&fw, 0, sizeof(fw));
+	TRACE_INFO("FWUP > Update started, stage at %08x", FW_STAGE_ADDR);
+}
+
+/*
+ * Process a record line of the image.
+ */
+fw_record_t fw_update_record(const char *line)
+{
+	if(Parse_IHexRecord(line, &fw_record) != IHEX_OK)
+		return FW_RECORD_BAD;
+
+	const uint8_t *d = fw_record.data;
+	switch(fw_record.type) {
+		case IHEX_TYPE_00:
+			return fw_stage_data(fw.upper + fw_record.address, d,
+			                     fw_record.dataLen);
+
+		case IHEX_TYPE_01:
+			return fw_flush() ? FW_RECORD_END : FW_RECORD_FLASH;
+
+		case IHEX_TYPE_02:
+			if(fw_record.dataLen != 2)
+				return FW_RECORD_BAD;
+			fw.upper = (uint32_t)((d[0] << 8) | d[1]) << 4;
+			return FW_RECORD_OK;
+
+		case IHEX_TYPE_04:
+			if(fw_record.dataLen != 2)
+				return FW_RECORD_BAD;
+			fw.upper = (uint32_t)((d[0] << 8) | d[1]) << 16;
+			return FW_RECORD_OK;
+
+		case IHEX_TYPE_03:
+		case IHEX_TYPE_05:
+			/* The image starts from its vector table. */
+			return FW_RECORD_OK;
+
+		default:
+			return FW_RECORD_BAD;
+	}
+}
+
+/*
+ * Check the stage after the end record.
+ * The CRC-32 is over the image from the program memory start to the last
+ * byte written with gaps read as 0xFF (objcopy --gap-fill 0xff).
+ */
+bool fw_update_finish(uint32_t crc, uint32_t *size, uint32_t *calc)
+{
+	fw.verified = false;
+	*size = fw.end;
+	*calc = 0;
+	if(!fw_flush() || fw.end < 8)
+		return false;
+	*size = fw.end;
+	*calc = crc32_calc((const void*)FW_STAGE_ADDR, fw.end);
+	if(*calc != crc)
+		return false;
+
+	/* Stack pointer in RAM and reset handler in the image. */
+	const uint32_t *vectors = (const uint32_t*)FW_STAGE_ADDR;
+	if((vectors[0] & 0xFFF00000) != 0x20000000
+			|| vectors[1] < FW_IMAGE_ADDR
+			|| vectors[1] >= FW_IMAGE_ADDR + fw.end)
+		return false;
+
+	fw.verified = true;
+	TRACE_INFO("FWUP > Image of %d bytes verified, CRC %08x", fw.end, *calc);
+	return true;
+}
+
+/*
+ * Install the verified image and reset.
+ * Returns only if no image has been verified.
+ */
+bool fw_update_install(void)
+{
+	if(!fw.verified)
+		return false;
+	TRACE_WARN("FWUP > Installing image, the MCU resets when done");
+	chThdSleep(TIME_MS2I(100));		// Let the trace out
+	chSysDisable();
+	fw_install_ram(fw.end);
+}
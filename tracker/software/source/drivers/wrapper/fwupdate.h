@@ -0,0 +1,29 @@
+#ifndef __FWUPDATE_H__
+#define __FWUPDATE_H__
+
+#include "ch.h"
+#include "hal.h"
+#include "pflash.h"
+
+#define FW_IMAGE_ADDR			0x08000000		/* Program memory address */
+#define FW_IMAGE_SIZE			0x60000			/* Program memory size */
+#define FW_STAGE_ADDR			LOG_FLASH_ADDR	/* Image staged in the log memory */
+#define FW_STAGE_SECTOR_SIZE	LOG_SECTOR_SIZE
+#define FW_WRITE_SIZE			256				/* Bytes programmed per flash write */
+#define FW_RECORD_TIMEOUT		TIME_S2I(10)	/* Pause ending an update not completed */
+#define FW_RECORD_LINE_MAX		(1 + 2 * (4 + 255 + 1) + 2)
+
+typedef enum {
+	FW_RECORD_OK,			// Record accepted
+	FW_RECORD_END,			// End of file record
+	FW_RECORD_BAD,			// Malformed record or checksum error
+	FW_RECORD_RANGE,		// Address outside program memory or not ascending
+	FW_RECORD_FLASH			// Erase, program or verify of the stage failed
+} fw_record_t;
+
+void fw_update_begin(void);
+fw_record_t fw_update_record(const char *line);
+bool fw_update_finish(uint32_t crc, uint32_t *size, uint32_t *calc);
+bool fw_update_install(void);
+
+#endif
@@ -6,6 +6,8 @@
 #include "pi2c.h"
 #include <stdlib.h>
 #include "portab.h"
+#include "padc.h"
+#include "pclock.h"
 
 #define ADC_NUM_CHANNELS	4		/* Amount of channels (solar, battery, temperature) */
 #define VCC_REF				3100	/* mV */
@@ -14,30 +16,103 @@
 #define DIVIDER_VBAT		205/64	/* VBat -- 22KOhm -- ADC -- 10kOhm -- GND */
 #define DIVIDER_VUSB		205/64	/* VUSB -- 22KOhm -- ADC -- 10kOhm -- GND */
 
-static adcsample_t samples[ADC_NUM_CHANNELS]; // ADC sample buffer
+/* Sample index of each channel in a conversion sequence. */
+#define ADC_INDEX_VSOL		0
+#define ADC_INDEX_VUSB		1
+#define ADC_INDEX_VBAT		2
+#define ADC_INDEX_TEMP		3
 
-void adccb(ADCDriver *adcp, adcsample_t *buffer, size_t n) {
+/*
+ * The sequence is converted continuously into a circular buffer.
+ * Each half buffer is a block. The last ADC_WINDOW_BLOCKS blocks make the
+ * averaging window.
+ */
+#define ADC_BLOCK_SIZE		(ADC_BUFFER_DEPTH / 2)
+#define ADC_TIMER_CLOCK		10000	/* Hz */
+
+static adcsample_t samples[ADC_BUFFER_DEPTH * ADC_NUM_CHANNELS]; // ADC sample buffer
+
+/* Block results of each channel in the window. */
+typedef struct {
+	uint32_t	sum[ADC_WINDOW_BLOCKS];
+	adcsample_t	min[ADC_WINDOW_BLOCKS];
+	adcsample_t	max[ADC_WINDOW_BLOCKS];
+} adc_window_t;
+
+static adc_window_t window[ADC_NUM_CHANNELS];
+static uint8_t block;		// Window slot of the next block
+static uint8_t blocks;		// Blocks in the window
+
+/* Window results read by the getters. */
+static volatile adcsample_t adc_mean[ADC_NUM_CHANNELS];
+static volatile adcsample_t adc_min[ADC_NUM_CHANNELS];
+static volatile adcsample_t adc_max[ADC_NUM_CHANNELS];
+static volatile bool adcValid = false;
+static bool adcStarted = false;
+
+static void adcerrcb(ADCDriver *adcp, adcerror_t err);
+
+/*
+ * Called at each half buffer.
+ * The block is reduced to sum, min and max per channel and the window
+ * results are updated so the getters do not wait for a conversion.
+ */
+static void adccb(ADCDriver *adcp, adcsample_t *buffer, size_t n) {
 	(void)adcp;
-	(void)buffer;
-	(void)n;
+
+	if(blocks < ADC_WINDOW_BLOCKS)
+		blocks++;
+	for(uint8_t ch = 0; ch < ADC_NUM_CHANNELS; ch++) {
+		adc_window_t *w = &window[ch];
+		uint32_t sum = 0;
+		adcsample_t min = 0xFFFF;
+		adcsample_t max = 0;
+		for(size_t i = 0; i < n; i++) {
+			adcsample_t s = buffer[i * ADC_NUM_CHANNELS + ch];
+			sum += s;
+			if(s < min)
+				min = s;
+			if(s > max)
+				max = s;
+		}
+		w->sum[block] = sum;
+		w->min[block] = min;
+		w->max[block] = max;
+
+		sum = 0;
+		for(uint8_t b = 0; b < blocks; b++) {
+			sum += w->sum[b];
+			if(w->min[b] < min)
+				min = w->min[b];
+			if(w->max[b] > max)
+				max = w->max[b];
+		}
+		adc_mean[ch] = sum / (blocks * n);
+		adc_min[ch] = min;
+		adc_max[ch] = max;
+	}
+	if(++block >= ADC_WINDOW_BLOCKS)
+		block = 0;
+	adcValid = true;
 }
 
 /*
  * ADC conversion group.
- * Mode:        Linear buffer, 4 samples of 4 channels, SW triggered.
+ * Mode:        Circular buffer, ADC_BUFFER_DEPTH samples of 4 channels,
+ *              TIM3 triggered at ADC_SAMPLE_RATE.
  * Channels:    Solar voltage divider    ADC1_IN12
  *              USB voltage divider      ADC1_IN14
  *              Battery voltage divider  ADC1_IN9
  *              Temperature sensor       ADC1_IN16
  */
 static const ADCConversionGroup adcgrpcfg = {
-	FALSE,
+	TRUE,
 	ADC_NUM_CHANNELS,
 	adccb,
-	NULL,
+	adcerrcb,
 	/* HW dependent part.*/
 	0,
-	ADC_CR2_SWSTART,
+	ADC_CR2_EXTEN_RISING | ADC_CR2_EXTSEL_SRC(8), // TIM3_TRGO
 	ADC_SMPR1_SMP_AN14(ADC_SAMPLE_144) | ADC_SMPR1_SMP_AN12(ADC_SAMPLE_144) | ADC_SMPR1_SMP_SENSOR(ADC_SAMPLE_144),
 	ADC_SMPR2_SMP_AN9(ADC_SAMPLE_144),
 	ADC_SQR1_NUM_CH(ADC_NUM_CHANNELS),
@@ -45,49 +120,120 @@ static const ADCConversionGroup adcgrpcfg = {
 	ADC_SQR3_SQ1_N(ADC_CHANNEL_IN12) | ADC_SQR3_SQ2_N(ADC_CHANNEL_IN14)  | ADC_SQR3_SQ3_N(ADC_CHANNEL_IN9) | ADC_SQR3_SQ4_N(ADC_CHANNEL_SENSOR)
 };
 
+/*
+ * The driver stops the conversion on an error.
+ * It is started again by the next getter.
+ */
+static void adcerrcb(ADCDriver *adcp, adcerror_t err) {
+	(void)adcp;
+	(void)err;
+}
+
+/*
+ * Start sampling again after an error.
+ */
+static void checkADC(void)
+{
+	chSysLock();
+	if(adcStarted && ADCD1.state == ADC_READY)
+		adcStartConversionI(&ADCD1, &adcgrpcfg, samples, ADC_BUFFER_DEPTH);
+	chSysUnlock();
+}
+
+/*
+ * Wait for the first block after start.
+ */
+static void waitADC(void)
+{
+	if(!adcStarted)
+		initADC();
+	checkADC();
+	while(!adcValid)
+		chThdSleep(TIME_MS2I(10));
+}
+
+/*
+ * Start continuous sampling.
+ * TIM3 update event triggers each conversion sequence.
+ */
 void initADC(void)
 {
+	if(adcStarted)
+		return;
+
 	adcStart(&ADCD1, NULL);
 	adcSTM32EnableTSVREFE();
 	palSetLineMode(LINE_ADC_VSOL, PAL_MODE_INPUT_ANALOG); // Solar panels
 	palSetLineMode(LINE_ADC_VBAT, PAL_MODE_INPUT_ANALOG); // Battery
 	palSetLineMode(LINE_ADC_VUSB, PAL_MODE_INPUT_ANALOG); // USB
+
+	block = 0;
+	blocks = 0;
+	adcValid = false;
+	adcStarted = true;
+	adcStartConversion(&ADCD1, &adcgrpcfg, samples, ADC_BUFFER_DEPTH);
+
+	rccEnableTIM3(FALSE);
+	rccResetTIM3();
+	TIM3->PSC = (STM32_TIMCLK1 / ADC_TIMER_CLOCK) - 1;
+	pclkRetimeTimer(STM32_TIM3);
+	TIM3->ARR = (ADC_TIMER_CLOCK / ADC_SAMPLE_RATE) - 1;
+	TIM3->CR2 = TIM_CR2_MMS_1; // Update event is TRGO
+	TIM3->EGR = TIM_EGR_UG;
+	TIM3->CR1 = TIM_CR1_CEN;
 }
 
 void deinitADC(void)
 {
-	adcStop(&ADCD1);
-}
+	if(!adcStarted)
+		return;
 
-void doConversion(void)
-{
-	initADC();
-	adcStartConversion(&ADCD1, &adcgrpcfg, samples, 1);
-	chThdSleep(TIME_MS2I(50)); // Wait until conversion is finished
-	deinitADC();
+	TIM3->CR1 = 0;
+	rccDisableTIM3();
+	adcStopConversion(&ADCD1);
+	adcStop(&ADCD1);
+	adcStarted = false;
+	adcValid = false;
 }
 
 uint16_t stm32_get_vbat(void)
 {
-	doConversion();
-	return samples[2] * VCC_REF * DIVIDER_VBAT / 4096;
+	waitADC();
+	return adc_mean[ADC_INDEX_VBAT] * VCC_REF * DIVIDER_VBAT / 4096;
 }
 
 uint16_t stm32_get_vsol(void)
 {
-	doConversion();
-	return samples[0] * VCC_REF * DIVIDER_VSOL / 4096;
+	waitADC();
+	return adc_mean[ADC_INDEX_VSOL] * VCC_REF * DIVIDER_VSOL / 4096;
 }
 
 uint16_t stm32_get_vusb(void)
 {
-	doConversion();
-	return samples[1] * VCC_REF * DIVIDER_VUSB / 4096;
+	waitADC();
+	return adc_mean[ADC_INDEX_VUSB] * VCC_REF * DIVIDER_VUSB / 4096;
 }
 
 uint16_t stm32_get_temp(void)
 {
-	doConversion();
-	return (((int32_t)samples[3]*40 * VCC_REF / 4096)-30400) + 2500 + 850/*Calibration*/;
+	waitADC();
+	return (((int32_t)adc_mean[ADC_INDEX_TEMP]*40 * VCC_REF / 4096)-30400) + 2500 + 850/*Calibration*/;
+}
+
+/*
+ * Battery and solar voltage extremes in the averaging window.
+ */
+void stm32_get_vbat_range(uint16_t *min, uint16_t *max)
+{
+	waitADC();
+	*min = adc_min[ADC_INDEX_VBAT] * VCC_REF * DIVIDER_VBAT / 4096;
+	*max = adc_max[ADC_INDEX_VBAT] * VCC_REF * DIVIDER_VBAT / 4096;
+}
+
+void stm32_get_vsol_range(uint16_t *min, uint16_t *max)
+{
+	waitADC();
+	*min = adc_min[ADC_INDEX_VSOL] * VCC_REF * DIVIDER_VSOL / 4096;
+	*max = adc_max[ADC_INDEX_VSOL] * VCC_REF * DIVIDER_VSOL / 4096;
 }
 
@@ -6,12 +6,23 @@
 
 #define isUsbConnected()	(getUSBVoltageMV() > 300)
 
+/*
+ * Continuous sampling.
+ * Values are averaged over ADC_WINDOW_BLOCKS * ADC_BUFFER_DEPTH / 2
+ * sequences (one second).
+ */
+#define ADC_SAMPLE_RATE		64		/* Conversion sequences per second */
+#define ADC_BUFFER_DEPTH	16		/* Sequences in the circular buffer */
+#define ADC_WINDOW_BLOCKS	8		/* Half buffers in the averaging window */
+
 void initADC(void);
 void deinitADC(void);
 uint16_t stm32_get_vbat(void);
 uint16_t stm32_get_vsol(void);
 uint16_t stm32_get_vusb(void);
 uint16_t stm32_get_temp(void);
+void stm32_get_vbat_range(uint16_t *min, uint16_t *max);
+void stm32_get_vsol_range(uint16_t *min, uint16_t *max);
 
 #endif
 
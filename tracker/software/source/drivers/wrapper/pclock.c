@@ -0,0 +1,166 @@
+/**
+  * Clock profiles.
+  * The MCU runs at the CLOCK_IDLE profile while only waiting, e.g. for a
+  * carrier or the next beacon. Bursts like AFSK decoding, transmission and
+  * image processing acquire the CLOCK_RUN profile and release it when done.
+  * USB keeps the CLOCK_RUN profile while it is in use since the OTG core
+  * is configured for the full HCLK.
+  *
+  * The HAL computes the timer prescalers and baud rates from the clock
+  * constants of mcuconf.h. On a profile change the running peripherals
+  * which keep time are re-timed: SysTick, TIM3 (ADC trigger), TIM4 (ICU),
+  * USART3 and UART5. SPI, I2C and the ADC just run slower.
+  */
+
+#include "ch.h"
+#include "hal.h"
+#include "pclock.h"
+#include "stats.h"
+
+static uint32_t clk_votes;
+static clock_profile_t clk_profile = CLOCK_RUN;
+static uint32_t clk_switches;
+static STATS_DECL(clk_stats_run, "clk run switches");
+static STATS_DECL(clk_stats_idle, "clk idle switches");
+
+static uint32_t getDivider(clock_profile_t profile)
+{
+	return profile == CLOCK_IDLE ? CLOCK_IDLE_DIV : 1;
+}
+
+static uint32_t getHPRE(clock_profile_t profile)
+{
+	return profile == CLOCK_IDLE ? CLOCK_IDLE_HPRE : STM32_HPRE;
+}
+
+/*
+ * Scale a timer prescaler. The new value is loaded at the next update
+ * event, the ICU generates one on every edge.
+ * Only for timers with the clock enabled.
+ */
+static void scaleTimer(stm32_tim_t *tim, uint32_t from, uint32_t to)
+{
+	tim->PSC = (tim->PSC + 1) * from / to - 1;
+}
+
+static void scaleUSART(USART_TypeDef *u, uint32_t from, uint32_t to)
+{
+	if(!(u->CR1 & USART_CR1_UE))
+		return;
+	u->BRR = u->BRR * from / to;
+}
+
+static clock_profile_t getTarget(void)
+{
+#ifdef DISABLE_CLOCK_SCALING
+	return CLOCK_RUN;
+#else
+	if(clk_votes)
+		return CLOCK_RUN;
+	if(USBD1.state != USB_STOP && USBD1.state != USB_SUSPENDED)
+		return CLOCK_RUN;
+	return CLOCK_IDLE;
+#endif
+}
+
+static void setProfile(clock_profile_t profile)
+{
+	uint32_t from = getDivider(clk_profile);
+	uint32_t to = getDivider(profile);
+
+	RCC->CFGR = (RCC->CFGR & ~RCC_CFGR_HPRE) | getHPRE(profile);
+
+	SysTick->LOAD = STM32_HCLK / to / CH_CFG_ST_FREQUENCY - 1;
+	SysTick->VAL = 0;
+	if(RCC->APB1ENR & RCC_APB1ENR_TIM3EN)
+		scaleTimer(STM32_TIM3, from, to);
+	if(RCC->APB1ENR & RCC_APB1ENR_TIM4EN)
+		scaleTimer(STM32_TIM4, from, to);
+	scaleUSART(USART3, from, to);
+	scaleUSART(UART5, from, to);
+
+	clk_profile = profile;
+	clk_switches++;
+	stats_count(profile == CLOCK_RUN ? &clk_stats_run : &clk_stats_idle, 1);
+}
+
+/**
+  * Select the profile for the current votes and USB state.
+  * Must be called with the system locked, also used by the USB events.
+  */
+void pclkUpdateI(void)
+{
+	clock_profile_t profile = getTarget();
+	if(profile != clk_profile)
+		setProfile(profile);
+}
+
+/**
+  * Request the CLOCK_RUN profile for a burst of work.
+  * Each call must be matched by pclkRelease().
+  */
+void pclkAcquire(void)
+{
+	chSysLock();
+	clk_votes++;
+	pclkUpdateI();
+	chSysUnlock();
+}
+
+void pclkRelease(void)
+{
+	chSysLock();
+	chDbgAssert(clk_votes > 0, "clock not acquired");
+	clk_votes--;
+	pclkUpdateI();
+	chSysUnlock();
+}
+
+/**
+  * Set the AHB prescaler of the current profile again after
+  * stm32_clock_init() restored the mcuconf.h clocks.
+  */
+void pclkRestoreI(void)
+{
+	RCC->CFGR = (RCC->CFGR & ~RCC_CFGR_HPRE) | getHPRE(clk_profile);
+}
+
+/**
+  * Adapt a serial driver started with the mcuconf.h clocks to the profile.
+  * Call after sdStart().
+  */
+void pclkRetimeSerial(SerialDriver *sdp)
+{
+	chSysLock();
+	scaleUSART(sdp->usart, 1, getDivider(clk_profile));
+	chSysUnlock();
+}
+
+/**
+  * Adapt a timer started with the mcuconf.h clocks to the profile.
+  * Call after the driver start, e.g. icuStart().
+  */
+void pclkRetimeTimer(stm32_tim_t *tim)
+{
+	chSysLock();
+	scaleTimer(tim, 1, getDivider(clk_profile));
+	chSysUnlock();
+}
+
+clock_profile_t pclkGetProfile(void)
+{
+	return clk_profile;
+}
+
+uint32_t pclkGetHCLK(void)
+{
+	return STM32_HCLK / getDivider(clk_profile);
+}
+
+/**
+  * Number of profile changes, to tell if HCLK changed over an interval.
+  */
+uint32_t pclkGetSwitches(void)
+{
+	return clk_switches;
+}
@@ -0,0 +1,32 @@
+#ifndef __PCLOCK_H__
+#define __PCLOCK_H__
+
+#include "ch.h"
+#include "hal.h"
+
+/*
+ * Clock profiles.
+ * SYSCLK stays at the PLL output since the PLL also clocks USB. A profile
+ * only selects the AHB prescaler. APB1 and APB2 run at HCLK so the
+ * peripherals on both buses follow the profile.
+ */
+typedef enum {
+	CLOCK_RUN,		/* HCLK = SYSCLK */
+	CLOCK_IDLE		/* HCLK = SYSCLK / CLOCK_IDLE_DIV */
+} clock_profile_t;
+
+#define CLOCK_IDLE_DIV		2
+#define CLOCK_IDLE_HPRE		STM32_HPRE_DIV2
+
+void pclkAcquire(void);
+void pclkRelease(void);
+void pclkUpdateI(void);
+void pclkRestoreI(void);
+void pclkRetimeSerial(SerialDriver *sdp);
+void pclkRetimeTimer(stm32_tim_t *tim);
+clock_profile_t pclkGetProfile(void);
+uint32_t pclkGetHCLK(void);
+uint32_t pclkGetSwitches(void);
+
+#endif
+
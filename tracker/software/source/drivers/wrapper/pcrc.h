@@ -0,0 +1,31 @@
+/**
+  * CRC service shared by AX.25, SSDV and the flash configuration.
+  * CRC-16/X.25 (AX.25 FCS) uses a slice-by-4 table.
+  * CRC-32 (SSDV, config) uses the STM32 CRC unit.
+  */
+
+#ifndef __PCRC_H__
+#define __PCRC_H__
+
+#include "ch.h"
+#include "hal.h"
+
+#define CRC16_X25_INIT		0xFFFF
+#define CRC32_INIT			0xFFFFFFFF
+
+extern const uint16_t crc16_x25_table[4][256];
+
+uint16_t crc16_x25_update(uint16_t crc, const uint8_t *data, size_t length);
+uint16_t crc16_x25(const uint8_t *data, size_t length);
+uint32_t crc32_calc(const void *data, size_t length);
+
+/**
+  * Adds a single byte to a running CRC-16/X.25.
+  * The final CRC is the complement of the running value.
+  */
+static inline uint16_t crc16_x25_byte(uint16_t crc, uint8_t data) {
+	return (uint16_t)((crc >> 8) ^ crc16_x25_table[0][(crc ^ data) & 0xFF]);
+}
+
+#endif
+
@@ -1,122 +1,771 @@
+#include "ch.h"
 #include "flash.h"
 #include "pflash.h"
 #include "debug.h"
+#include "checkpoint.h"
+#include <stddef.h>
+#include <string.h>
 
-dataPoint_t* flash_getLogBuffer(uint16_t id)
+/*
+ * RAM cursor of the log ring.
+ * The cursor is set up from the sector headers and the head sector at
+ * first use. Writes then keep it current.
+ */
+typedef struct {
+	bool		valid;
+	bool		empty;		/* No sector is in use */
+	bool		has_last;	/* A committed point exists */
+	uint8_t		head;		/* Sector being written */
+	uint8_t		tail;		/* Sector holding the oldest points */
+	uint16_t	since_key;	/* Records since the last keyframe */
+	uint32_t	seq;		/* Sequence number of the head sector */
+	uint32_t	wpos;		/* Offset of the next batch in the head sector */
+	uint16_t	count[LOG_SECTORS];	/* Points committed in each sector */
+	uint32_t	dropped;	/* Points dropped from the tail since startup */
+	dataPoint_t	last;		/* Newest committed point (delta base) */
+} log_cursor_t;
+
+static log_cursor_t log_cursor;
+
+/*
+ * Points are staged in RAM and committed to flash in batches.
+ * Staged points are lost at a power failure.
+ */
+static dataPoint_t log_stage[LOG_STAGE_POINTS];
+static uint8_t log_staged = 0;
+
+/*
+ * Cursor and staged points kept over a reset.
+ * The cursor is taken at startup if the flash was not written after the
+ * state was saved. This avoids decoding the log.
+ */
+typedef struct {
+	log_cursor_t	cursor;
+	dataPoint_t		stage[LOG_STAGE_POINTS];
+	uint8_t			staged;
+} log_state_t;
+
+static CHECKPOINT_DATA log_state_t log_saved;
+static CHECKPOINT_DATA checkpoint_t log_checkpoint;
+
+/* Encoded batch. Padding is left erased. */
+static uint8_t log_batch[LOG_STAGE_POINTS * LOG_REC_MAX_SIZE + 3];
+static uint16_t log_batch_since;
+
+/* Copies returned by the newest and oldest lookups. */
+static dataPoint_t log_newest;
+static dataPoint_t log_oldest;
+
+/* Sector erased ahead of need (-1 if none). */
+static int8_t log_erased = -1;
+/* Logging stopped until reset as the log flash is used for other data. */
+static bool log_suspended = false;
+static thread_t* log_erase_thd = NULL;
+static BSEMAPHORE_DECL(log_erase_sem, true);
+static MUTEX_DECL(log_mtx);
+
+static const log_sector_hdr_t* flash_getLogSectorHeader(uint8_t sector)
 {
-	uint32_t addr = LOG_FLASH_ADDR + LOG_SECTOR_ID(id) * LOG_SECTOR_SIZE + LOG_POS_IN_SECTOR(id) * sizeof(dataPoint_t);
-	if(addr >= LOG_FLASH_ADDR && addr <= LOG_FLASH_ADDR+LOG_FLASH_SIZE-sizeof(dataPoint_t))
-		return (dataPoint_t*)addr;
-	else
-		return NULL; // Outside of memory address allocation
+	return (const log_sector_hdr_t*)(LOG_FLASH_ADDR + sector * LOG_SECTOR_SIZE);
 }
 
-/**
-  * Returns next free log entry address in memory.
-  * Returns NULL if all entries are used.
-  */
-static dataPoint_t* flash_getNextFreeLogAddress(void) {
-  dataPoint_t* tp;
-  for(uint32_t i=0; (tp = flash_getLogBuffer(i)) != NULL; i++) {
-    if(LOG_IS_EMPTY(tp))
-      return tp;
-  }
-  return NULL;
+static bool flash_isLogSector(uint8_t sector)
+{
+	const log_sector_hdr_t* hdr = flash_getLogSectorHeader(sector);
+	return hdr->magic == LOG_SECTOR_MAGIC && hdr->seq != 0xFFFFFFFF;
+}
+
+static uint64_t flash_getLogSectorKey(uint8_t sector)
+{
+	return LOG_SECTOR_KEY(flash_getLogSectorHeader(sector));
 }
 
 /*
- *
+ * Varint with 7 bits per byte, lowest first.
  */
-dataPoint_t* flash_getNewestLogEntry(void) {
-  dataPoint_t* last_tp = NULL;
-  uint64_t last_id = 0x0;
-  dataPoint_t* tp;
-  for(uint32_t i=0; (tp = flash_getLogBuffer(i)) != NULL; i++) {
-    if(!LOG_IS_EMPTY(tp) && last_id <= LOG_RSTandID(tp)) {
-      last_id = LOG_RSTandID(tp);
-      last_tp = tp;
-    } else {
-      break;
-    }
-  }
-  return last_tp;
+static uint8_t* flash_putVarint(uint8_t* p, uint32_t v)
+{
+	while(v >= 0x80) {
+		*p++ = (v & 0x7F) | 0x80;
+		v >>= 7;
+	}
+	*p++ = v;
+	return p;
+}
+
+static const uint8_t* flash_getVarint(const uint8_t* p, const uint8_t* end,
+                                      uint32_t* v)
+{
+	uint32_t r = 0;
+	uint8_t shift = 0;
+	while(p < end && shift < 32) {
+		uint8_t b = *p++;
+		r |= (uint32_t)(b & 0x7F) << shift;
+		if(!(b & 0x80)) {
+			*v = r;
+			return p;
+		}
+		shift += 7;
+	}
+	return NULL;
+}
+
+/*
+ * Encode a point as a keyframe or as a delta from the base point.
+ * A keyframe is used if the delta would not be smaller.
+ * Returns the end of the record.
+ */
+uint8_t* flash_encodeLogRecord(uint8_t* p, const dataPoint_t* tp,
+                               const dataPoint_t* base, bool key)
+{
+	if(!key) {
+		uint16_t cur[LOG_HALFWORDS], prev[LOG_HALFWORDS];
+		uint8_t rec[1 + LOG_DELTA_MAP_SIZE + LOG_HALFWORDS * 3];
+		memcpy(cur, tp, sizeof(cur));
+		memcpy(prev, base, sizeof(prev));
+		memset(rec, 0, 1 + LOG_DELTA_MAP_SIZE);
+		rec[0] = LOG_REC_DELTA;
+		uint8_t* q = &rec[1 + LOG_DELTA_MAP_SIZE];
+		for(uint16_t i = 0; i < LOG_HALFWORDS; i++) {
+			int16_t d = (int16_t)(cur[i] - prev[i]);
+			if(d == 0)
+				continue;
+			rec[1 + i / 8] |= 1 << (i % 8);
+			q = flash_putVarint(q, (uint16_t)(((uint16_t)d << 1) ^ (uint16_t)(d >> 15)));
+		}
+		if((size_t)(q - rec) < LOG_REC_MAX_SIZE) {
+			memcpy(p, rec, q - rec);
+			return p + (q - rec);
+		}
+	}
+	*p++ = LOG_REC_KEY;
+	memcpy(p, tp, sizeof(dataPoint_t));
+	return p + sizeof(dataPoint_t);
+}
+
+/*
+ * Decode a record onto the prior point.
+ * Returns the end of the record or NULL if the record is corrupt.
+ */
+static const uint8_t* flash_decodeLogRecord(const uint8_t* p,
+                                            const uint8_t* end,
+                                            dataPoint_t* tp, bool* key)
+{
+	if(p >= end)
+		return NULL;
+	uint8_t type = *p++;
+	if(type == LOG_REC_KEY) {
+		if(end - p < (ptrdiff_t)sizeof(dataPoint_t))
+			return NULL;
+		memcpy(tp, p, sizeof(dataPoint_t));
+		*key = true;
+		return p + sizeof(dataPoint_t);
+	}
+	if(type != LOG_REC_DELTA || end - p < (ptrdiff_t)LOG_DELTA_MAP_SIZE)
+		return NULL;
+	const uint8_t* map = p;
+	p += LOG_DELTA_MAP_SIZE;
+	uint16_t cur[LOG_HALFWORDS];
+	memcpy(cur, tp, sizeof(cur));
+	for(uint16_t i = 0; i < LOG_HALFWORDS; i++) {
+		if(!(map[i / 8] & (1 << (i % 8))))
+			continue;
+		uint32_t z;
+		if((p = flash_getVarint(p, end, &z)) == NULL)
+			return NULL;
+		cur[i] += (uint16_t)((z >> 1) ^ -(z & 1));
+	}
+	memcpy(tp, cur, sizeof(cur));
+	*key = false;
+	return p;
+}
+
+static void flash_startLogIterator(log_iter_t* it, uint8_t sector)
+{
+	it->started = true;
+	it->sector = sector;
+	it->seq = flash_getLogSectorHeader(sector)->seq;
+	it->pos = sizeof(log_sector_hdr_t);
+	it->left = 0;
+	it->since_key = 0;
+	memset(&it->point, 0, sizeof(dataPoint_t));
+}
+
+/*
+ * Step to the next batch in the sector being iterated.
+ * Records left is the point count of a committed batch or 0 for a partial.
+ * Returns false at the end of the sector.
+ */
+static bool flash_nextLogBatch(log_iter_t* it)
+{
+	const uint8_t* base = (const uint8_t*)flash_getLogSectorHeader(it->sector);
+	if(it->pos + LOG_BATCH_SIZE(0) > LOG_SECTOR_SIZE)
+		return false;
+	uint32_t tag = *(const uint32_t*)(base + it->pos);
+	if(tag == 0xFFFFFFFF)
+		return false;
+	uint32_t size = LOG_BATCH_SIZE(LOG_BATCH_LEN(tag));
+	if((tag & LOG_BATCH_MAGIC_MASK) != LOG_BATCH_MAGIC
+	    || it->pos + size > LOG_SECTOR_SIZE) {
+		/* Nothing more can be written to the sector. */
+		it->pos = LOG_SECTOR_SIZE;
+		return false;
+	}
+	uint32_t commit = *(const uint32_t*)(base + it->pos + size - sizeof(uint32_t));
+	it->rec = it->pos + sizeof(uint32_t);
+	it->rec_end = it->rec + LOG_BATCH_LEN(tag);
+	it->pos += size;
+	it->left = commit == LOG_BATCH_COMMIT ? LOG_BATCH_COUNT(tag) : 0;
+	return true;
+}
+
+/*
+ * Decode the next committed point in the sector being iterated.
+ * Partial batches are skipped. A corrupt batch ends the sector.
+ * Returns false at the end of the sector.
+ */
+static bool flash_nextLogRecord(log_iter_t* it)
+{
+	const uint8_t* base = (const uint8_t*)flash_getLogSectorHeader(it->sector);
+	while(it->left == 0) {
+		if(!flash_nextLogBatch(it))
+			return false;
+	}
+
+	bool key;
+	const uint8_t* p = flash_decodeLogRecord(base + it->rec, base + it->rec_end,
+	                                         &it->point, &key);
+	if(p == NULL) {
+		it->left = 0;
+		it->pos = LOG_SECTOR_SIZE;
+		return false;
+	}
+	it->rec = p - base;
+	it->left--;
+	it->since_key = key ? 0 : it->since_key + 1;
+	return true;
+}
+
+/*
+ * Count the committed points of a sector from the batch tags.
+ */
+static uint16_t flash_countLogPoints(uint8_t sector)
+{
+	log_iter_t it;
+	uint16_t n = 0;
+	flash_startLogIterator(&it, sector);
+	while(flash_nextLogBatch(&it))
+		n += it.left;
+	return n;
+}
+
+/*
+ * Set up the cursor with one header read per sector.
+ * Sectors without a valid header are free and are erased before use.
+ */
+static void flash_scanLogCursor(void)
+{
+	log_cursor.empty = true;
+	for(uint8_t i = 0; i < LOG_SECTORS; i++) {
+		if(!flash_isLogSector(i))
+			continue;
+		uint64_t key = flash_getLogSectorKey(i);
+		if(log_cursor.empty || key > flash_getLogSectorKey(log_cursor.head))
+			log_cursor.head = i;
+		if(log_cursor.empty || key < flash_getLogSectorKey(log_cursor.tail))
+			log_cursor.tail = i;
+		log_cursor.empty = false;
+	}
+}
+
+/*
+ * Returns the oldest sector following the given sector in the ring.
+ */
+static uint8_t flash_getNextLogSector(uint8_t sector)
+{
+	for(uint8_t i = 1; i < LOG_SECTORS; i++) {
+		uint8_t s = (sector + i) % LOG_SECTORS;
+		if(flash_isLogSector(s))
+			return s;
+	}
+	return log_cursor.head;
+}
+
+/*
+ * Save the cursor and the staged points after a change.
+ */
+static void flash_saveLogState(void)
+{
+	if(!log_cursor.valid) {
+		checkpoint_invalidate(&log_checkpoint);
+		return;
+	}
+	log_saved.cursor = log_cursor;
+	memcpy(log_saved.stage, log_stage, sizeof(log_stage));
+	log_saved.staged = log_staged;
+	checkpoint_save(&log_checkpoint, CHECKPOINT_ID_LOG, &log_saved,
+	                sizeof(log_saved));
+}
+
+/*
+ * Take the cursor saved before a reset.
+ * The log must be as it was saved: the head sector not written beyond the
+ * cursor and no sector opened or dropped since.
+ */
+static bool flash_restoreLogState(void)
+{
+	if(!checkpoint_restore(&log_checkpoint, CHECKPOINT_ID_LOG, &log_saved,
+	                       sizeof(log_saved)))
+		return false;
+	const log_cursor_t* c = &log_saved.cursor;
+	if(!c->valid || log_saved.staged > LOG_STAGE_POINTS)
+		return false;
+	for(uint8_t i = 0; i < LOG_SECTORS; i++) {
+		if(!flash_isLogSector(i))
+			continue;
+		if(c->empty || flash_getLogSectorHeader(i)->seq > c->seq)
+			return false;
+	}
+	if(!c->empty) {
+		const uint8_t* base = (const uint8_t*)flash_getLogSectorHeader(c->head);
+		if(!flash_isLogSector(c->head) || !flash_isLogSector(c->tail)
+		    || flash_getLogSectorHeader(c->head)->seq != c->seq)
+			return false;
+		if(c->wpos + sizeof(uint32_t) <= LOG_SECTOR_SIZE
+		    && *(const uint32_t*)(base + c->wpos) != 0xFFFFFFFF)
+			return false;
+	}
+	log_cursor = *c;
+	memcpy(log_stage, log_saved.stage, sizeof(log_stage));
+	log_staged = log_saved.staged;
+	log_erased = -1;
+	TRACE_INFO("LOG  > Log cursor resumed, %d points staged", log_staged);
+	return true;
 }
 
 /*
- * Alternative version of flash_getNewestLogEntry(...)
- * All that really needs to be found is the next EMPTY entry?
+ * Set up the cursor by binary search of the sector keys.
+ * The ring is filled from sector 0 so sectors holding a key not below
+ * that of sector 0 form a prefix which ends at the head. After the head
+ * are either free sectors or the older sectors of a wrapped ring.
+ * Free sectors elsewhere (e.g. after an erase failure) fall back to a scan.
+ * The head sector is then decoded to find the write position and the
+ * newest point.
  */
+static void flash_initLogCursor(void)
+{
+	if(flash_restoreLogState())
+		return;
+
+	if(!flash_isLogSector(0)) {
+		flash_scanLogCursor();
+	} else {
+		uint64_t first = flash_getLogSectorKey(0);
+		uint8_t lo = 0, hi = LOG_SECTORS - 1;
+		while(lo < hi) {
+			uint8_t mid = (lo + hi + 1) / 2;
+			if(flash_isLogSector(mid) && flash_getLogSectorKey(mid) >= first)
+				lo = mid;
+			else
+				hi = mid - 1;
+		}
+		log_cursor.head = lo;
+		log_cursor.empty = false;
+		/* The sector after the head may have been erased ahead. */
+		log_cursor.tail = flash_getNextLogSector(lo);
+
+		/* Check the ring is ordered as the search expects. */
+		if(log_cursor.tail != 0 && log_cursor.tail != lo
+		    && flash_getLogSectorKey(log_cursor.tail) > first)
+			flash_scanLogCursor();
+	}
+
+	log_cursor.has_last = false;
+	log_cursor.since_key = 0;
+	for(uint8_t i = 0; i < LOG_SECTORS; i++)
+		log_cursor.count[i] = 0;
+	if(!log_cursor.empty) {
+		static log_iter_t it;
+		for(uint8_t i = 0; i < LOG_SECTORS; i++) {
+			if(i != log_cursor.head && flash_isLogSector(i))
+				log_cursor.count[i] = flash_countLogPoints(i);
+		}
+		log_cursor.seq = flash_getLogSectorHeader(log_cursor.head)->seq;
+		flash_startLogIterator(&it, log_cursor.head);
+		while(flash_nextLogRecord(&it))
+			log_cursor.count[log_cursor.head]++;
+		log_cursor.wpos = it.pos;
+		log_cursor.since_key = it.since_key;
+		if(log_cursor.count[log_cursor.head] > 0) {
+			log_cursor.last = it.point;
+			log_cursor.has_last = true;
+		} else {
+			/* Head sector opened but not written so take the sector before. */
+			uint8_t prev = (log_cursor.head + LOG_SECTORS - 1) % LOG_SECTORS;
+			if(prev != log_cursor.head && flash_isLogSector(prev)
+			    && flash_getLogSectorHeader(prev)->seq == log_cursor.seq - 1) {
+				flash_startLogIterator(&it, prev);
+				while(flash_nextLogRecord(&it))
+					log_cursor.has_last = true;
+				log_cursor.last = it.point;
+			}
+		}
+	}
+	log_erased = -1;
+	log_cursor.valid = true;
+}
+
+/*
+ * Drop the tail sector from the ring before it is reused.
+ */
+static void flash_dropLogSector(uint8_t sector)
+{
+	log_cursor.dropped += log_cursor.count[sector];
+	log_cursor.count[sector] = 0;
+	log_cursor.tail = flash_getNextLogSector(sector);
+}
+
 /*
+ * Returns a copy of the newest committed point.
+ * The copy is valid until the next call.
+ */
 dataPoint_t* flash_getNewestLogEntry(void) {
-  dataPoint_t* tp;
-  uint32_t i = 0;
-  while((tp = flash_getLogBuffer(i++)) != NULL) {
-    if(LOG_IS_EMPTY(tp))
-      break;
+  chMtxLock(&log_mtx);
+  if(!log_cursor.valid)
+    flash_initLogCursor();
+  dataPoint_t* tp = NULL;
+  if(log_cursor.has_last) {
+    log_newest = log_cursor.last;
+    tp = &log_newest;
   }
-  return (i > 1 && tp != NULL ? flash_getLogBuffer(i - 1) : NULL);
+  chMtxUnlock(&log_mtx);
+  return tp;
 }
-*/
 
 /*
- *
+ * Returns a copy of the oldest committed point.
+ * The copy is valid until the next call.
  */
 dataPoint_t* flash_getOldestLogEntry(void) {
-  dataPoint_t* first_tp = NULL;
-  uint64_t first_id = 0xFFFFFFFFFFFFFFFF;
-  dataPoint_t* tp;
-  for(uint32_t i=0; (tp = flash_getLogBuffer(i)) != NULL; i++) {
-    if(!LOG_IS_EMPTY(tp) && first_id >= LOG_RSTandID(tp)) {
-      first_id = LOG_RSTandID(tp);
-      first_tp = tp;
-    } else {
-      break;
-    }
-  }
-  return first_tp;
+  log_iter_t it;
+  flash_initLogIterator(&it);
+  dataPoint_t* tp = flash_getNextLogEntry(&it);
+  if(tp == NULL)
+    return NULL;
+  log_oldest = *tp;
+  return &log_oldest;
+}
+
+void flash_initLogIterator(log_iter_t* it)
+{
+	it->started = false;
 }
 
-/**
-  * Erases oldest data
-  */
+/*
+ * Returns the next point from the oldest or NULL at the newest.
+ * Further points are returned as they are committed.
+ * If the sector being read is reused the iterator starts again at the
+ * oldest point.
+ */
+dataPoint_t* flash_getNextLogEntry(log_iter_t* it)
+{
+	chMtxLock(&log_mtx);
+	if(!log_cursor.valid)
+		flash_initLogCursor();
+	dataPoint_t* tp = NULL;
+	if(!log_cursor.empty) {
+		if(!it->started || !flash_isLogSector(it->sector)
+		    || flash_getLogSectorHeader(it->sector)->seq != it->seq)
+			flash_startLogIterator(it, log_cursor.tail);
+		while(true) {
+			if(flash_nextLogRecord(it)) {
+				tp = &it->point;
+				break;
+			}
+			/* Continue in the next sector of the ring. */
+			uint8_t next = (it->sector + 1) % LOG_SECTORS;
+			if(it->sector == log_cursor.head || !flash_isLogSector(next)
+			    || flash_getLogSectorHeader(next)->seq != it->seq + 1)
+				break;
+			flash_startLogIterator(it, next);
+		}
+	}
+	chMtxUnlock(&log_mtx);
+	return tp;
+}
 
-static void flash_eraseOldestLogData(void)
+/*
+ * Get the range of point numbers held in the log.
+ * Points are numbered from the oldest point held at a cold start so a
+ * number stays with its point until the point is dropped from the ring.
+ * The numbering continues over a reset which kept the cursor.
+ */
+void flash_getLogRange(uint32_t* first, uint32_t* end)
 {
-	uint32_t last_tp = (uint32_t)flash_getOldestLogEntry();
-	if(last_tp) {
-		last_tp = (last_tp / LOG_SECTOR_SIZE) * LOG_SECTOR_SIZE; // Get start address of sector
+	chMtxLock(&log_mtx);
+	if(!log_cursor.valid)
+		flash_initLogCursor();
+	uint32_t n = 0;
+	for(uint8_t i = 0; i < LOG_SECTORS; i++)
+		n += log_cursor.count[i];
+	*first = log_cursor.dropped;
+	*end = log_cursor.dropped + n;
+	chMtxUnlock(&log_mtx);
+}
 
-		TRACE_INFO("LOG  > Erase flash %08x", last_tp);
-		flashErase(last_tp, LOG_SECTOR_SIZE);
+/*
+ * Returns the point of the given number or NULL if it is not held.
+ * The iterator is left at the point so the points after it follow.
+ * Decoding starts at the last keyframe batch before the point.
+ */
+dataPoint_t* flash_seekLogEntry(log_iter_t* it, uint32_t number)
+{
+	chMtxLock(&log_mtx);
+	if(!log_cursor.valid)
+		flash_initLogCursor();
+	dataPoint_t* tp = NULL;
+	if(!log_cursor.empty && number >= log_cursor.dropped) {
+		uint32_t idx = number - log_cursor.dropped;
+		uint8_t s = log_cursor.tail;
+		while(idx >= log_cursor.count[s] && s != log_cursor.head) {
+			idx -= log_cursor.count[s];
+			s = (s + 1) % LOG_SECTORS;
+		}
+		if(idx < log_cursor.count[s]) {
+			const uint8_t* base = (const uint8_t*)flash_getLogSectorHeader(s);
+			uint32_t key_pos = sizeof(log_sector_hdr_t), key_idx = 0, n = 0;
+			flash_startLogIterator(it, s);
+			while(true) {
+				uint32_t pos = it->pos;
+				if(!flash_nextLogBatch(it))
+					break;
+				if(it->left > 0 && base[it->rec] == LOG_REC_KEY) {
+					key_pos = pos;
+					key_idx = n;
+				}
+				if(n + it->left > idx)
+					break;
+				n += it->left;
+			}
+			it->pos = key_pos;
+			it->left = 0;
+			for(n = key_idx; n <= idx; n++) {
+				if(!flash_nextLogRecord(it))
+					break;
+			}
+			if(n > idx)
+				tp = &it->point;
+		}
 	}
+	chMtxUnlock(&log_mtx);
+	return tp;
 }
 
-void flash_writeLogDataPoint(dataPoint_t* tp)
+/*
+ * Erase a sector for use by the log.
+ */
+static bool flash_prepareLogSector(uint8_t sector)
+{
+	flashaddr_t addr = (flashaddr_t)flash_getLogSectorHeader(sector);
+	/* Free sectors may hold data of an earlier log format. */
+	if(!flashIsErased(addr, LOG_SECTOR_SIZE)) {
+		TRACE_INFO("LOG  > Erase flash %08x", addr);
+		if(flashErase(addr, LOG_SECTOR_SIZE) != FLASH_RETURN_SUCCESS)
+			return false;
+	}
+	log_erased = sector;
+	return true;
+}
+
+/*
+ * Erase the next sector of the ring ahead of need.
+ * The erase is done here so the collector does not wait for it.
+ * The oldest sector is dropped at the erase if the ring is full.
+ */
+static THD_FUNCTION(flashLogEraseThread, arg)
+{
+	(void)arg;
+	while(true) {
+		chBSemWait(&log_erase_sem);
+		chMtxLock(&log_mtx);
+		uint8_t next = (log_cursor.head + 1) % LOG_SECTORS;
+		if(log_cursor.valid && !log_suspended && !log_cursor.empty
+		    && log_erased != next) {
+			if(next == log_cursor.tail)
+				flash_dropLogSector(next);
+			if(!flash_prepareLogSector(next))
+				TRACE_ERROR("LOG  > Erasing flash failed");
+			flash_saveLogState();
+		}
+		chMtxUnlock(&log_mtx);
+	}
+}
+
+/*
+ * Open the next sector of the ring for writing.
+ * The oldest sector is reclaimed when the ring is full.
+ * The magic is programmed last and marks the header committed.
+ */
+static bool flash_openLogSector(dataPoint_t* tp)
 {
+	uint8_t next = log_cursor.empty ? 0 : (log_cursor.head + 1) % LOG_SECTORS;
+	if(!log_cursor.empty && next == log_cursor.tail)
+		flash_dropLogSector(next);
+
+	/* Erase now if the sector was not erased ahead. */
+	if(log_erased != next && !flash_prepareLogSector(next))
+		return false;
+	log_erased = -1;
+
+	flashaddr_t addr = (flashaddr_t)flash_getLogSectorHeader(next);
+	log_sector_hdr_t hdr = {
+		.magic = LOG_SECTOR_MAGIC,
+		.seq = log_cursor.empty ? 0 : log_cursor.seq + 1,
+		.first_id = tp->id,
+		.first_reset = tp->reset,
+		.reserved = 0xFFFF
+	};
+	flashWrite(addr + sizeof(hdr.magic), (char*)&hdr + sizeof(hdr.magic),
+	           sizeof(hdr) - sizeof(hdr.magic));
+	flashWrite(addr, (char*)&hdr.magic, sizeof(hdr.magic));
+	if(!flashCompare(addr, (char*)&hdr, sizeof(hdr)))
+		return false;
+
+	if(log_cursor.empty)
+		log_cursor.tail = next;
+	log_cursor.head = next;
+	log_cursor.seq = hdr.seq;
+	log_cursor.wpos = sizeof(log_sector_hdr_t);
+	log_cursor.count[next] = 0;
+	log_cursor.empty = false;
+	return true;
+}
+
+/*
+ * Encode the staged points into the batch buffer.
+ * The first point of a sector is a keyframe.
+ * Returns the length of the records.
+ */
+static uint16_t flash_encodeLogBatch(void)
+{
+	const dataPoint_t* base = &log_cursor.last;
+	uint16_t since = log_cursor.since_key;
+	uint8_t* p = log_batch;
+	for(uint8_t i = 0; i < log_staged; i++) {
+		bool key = (i == 0 && log_cursor.count[log_cursor.head] == 0)
+		    || !log_cursor.has_last || since >= LOG_KEYFRAME_INTERVAL;
+		uint8_t* rec = p;
+		p = flash_encodeLogRecord(p, &log_stage[i], base, key);
+		since = (*rec == LOG_REC_KEY) ? 0 : since + 1;
+		base = &log_stage[i];
+	}
+	log_batch_since = since;
+	/* Leave the padding erased. */
+	memset(p, 0xFF, 3);
+	return p - log_batch;
+}
+
+/*
+ * Commit the staged points to flash as one batch.
+ * The tag and records are programmed then the commit word.
+ * The cursor mutex must be held by the caller.
+ */
+static void flash_commitLogData(void)
+{
+	if(log_staged == 0)
+		return;
+
 	// Get address to write on
-	dataPoint_t* address = flash_getNextFreeLogAddress();
-	if(address == NULL) // Memory completly used, erase oldest data
-	{
-		flash_eraseOldestLogData();
-		address = flash_getNextFreeLogAddress();
-	}
-	if(address == NULL) // Something went wrong at erasing the memory
-	{
+	if(log_cursor.empty && !flash_openLogSector(&log_stage[0])) {
 		TRACE_ERROR("LOG  > Erasing flash failed");
+		log_staged = 0;
 		return;
 	}
+	uint16_t len = flash_encodeLogBatch();
+	if(log_cursor.wpos + LOG_BATCH_SIZE(len) > LOG_SECTOR_SIZE) {
+		if(!flash_openLogSector(&log_stage[0])) { // Something went wrong at erasing the memory
+			TRACE_ERROR("LOG  > Erasing flash failed");
+			/* Set up again from flash at next write. */
+			log_cursor.valid = false;
+			log_staged = 0;
+			return;
+		}
+		len = flash_encodeLogBatch();
+	}
 
-	// Write data into flash
-	TRACE_INFO("LOG  > Flash write (ADDR=%08x)", address);
-	flashSectorBegin(flashSectorAt((uint32_t)address));
-	flashWrite((uint32_t)address, (char*)tp, sizeof(dataPoint_t));
-	flashSectorEnd(flashSectorAt((uint32_t)address));
+	flashaddr_t addr = (flashaddr_t)flash_getLogSectorHeader(log_cursor.head)
+	    + log_cursor.wpos;
+	uint32_t tag = LOG_BATCH_TAG(log_staged, len);
+	uint32_t commit = LOG_BATCH_COMMIT;
+	uint32_t size = LOG_BATCH_SIZE(len);
+	flashWrite(addr, (char*)&tag, sizeof(tag));
+	flashWrite(addr + sizeof(tag), (char*)log_batch, size - 2 * sizeof(uint32_t));
+	flashWrite(addr + size - sizeof(commit), (char*)&commit, sizeof(commit));
 
 	// Verify
-	if(flashCompare((uint32_t)address, (char*)tp, sizeof(dataPoint_t))) {
-		TRACE_INFO("LOG  > Flash write OK");
+	if(flashCompare(addr, (char*)&tag, sizeof(tag))
+	    && flashCompare(addr + sizeof(tag), (char*)log_batch, len)
+	    && flashCompare(addr + size - sizeof(commit), (char*)&commit, sizeof(commit))) {
+		TRACE_INFO("LOG  > Flash write OK (ADDR=%08x, %d points in %d bytes)",
+		           addr, log_staged, size);
+		log_cursor.wpos += size;
+		log_cursor.count[log_cursor.head] += log_staged;
+		log_cursor.since_key = log_batch_since;
+		log_cursor.last = log_stage[log_staged - 1];
+		log_cursor.has_last = true;
 	} else {
-		TRACE_ERROR("LOG  > Flash write failed");
+		TRACE_ERROR("LOG  > Flash write failed (ADDR=%08x)", addr);
+		/* Set up again from flash at next write. */
+		log_cursor.valid = false;
+	}
+	log_staged = 0;
+
+	/* Have the next sector erased before it is needed. */
+	if(log_cursor.valid && log_cursor.wpos >= LOG_ERASE_AHEAD_POS
+	    && log_erased != (log_cursor.head + 1) % LOG_SECTORS)
+		chBSemSignal(&log_erase_sem);
+}
+
+void flash_writeLogDataPoint(dataPoint_t* tp)
+{
+	chMtxLock(&log_mtx);
+	if(log_suspended) {
+		chMtxUnlock(&log_mtx);
+		return;
+	}
+	if(log_erase_thd == NULL) {
+		log_erase_thd = chThdCreateFromHeap(NULL, THD_WORKING_AREA_SIZE(1024),
+		                                    "LGE", LOWPRIO,
+		                                    flashLogEraseThread, NULL);
+		if(log_erase_thd == NULL)
+			TRACE_ERROR("LOG  > Could not start erase thread (not enough memory available)");
 	}
+	if(!log_cursor.valid)
+		flash_initLogCursor();
+
+	/* Stage the point and commit when the batch is complete. */
+	log_stage[log_staged++] = *tp;
+	TRACE_INFO("LOG  > Flash stage (%d of %d)", log_staged, LOG_STAGE_POINTS);
+	if(log_staged >= LOG_STAGE_POINTS)
+		flash_commitLogData();
+	flash_saveLogState();
+	chMtxUnlock(&log_mtx);
 }
 
+/*
+ * Stop logging until reset and drop the log.
+ * The log flash is then free for other data, such as a firmware image
+ * being staged. Sectors holding other data are erased when the log is
+ * started again after reset.
+ */
+void flash_suspendLog(void)
+{
+	chMtxLock(&log_mtx);
+	log_suspended = true;
+	log_staged = 0;
+	log_erased = -1;
+	log_cursor.valid = false;
+	flash_saveLogState();
+	chMtxUnlock(&log_mtx);
+	TRACE_INFO("LOG  > Log suspended until reset");
+}
@@ -7,17 +7,84 @@
 #define LOG_FLASH_SIZE			0x100000	/* Log flash memory size */
 #define LOG_SECTOR_SIZE			0x20000		/* Single sector size */
 
-#define LOG_POINTS_IN_SECTOR	(LOG_SECTOR_SIZE / sizeof(dataPoint_t))
-#define LOG_POS_IN_SECTOR(id)	((id) % LOG_POINTS_IN_SECTOR)
-#define LOG_SECTOR_ID(id)		((id) / LOG_POINTS_IN_SECTOR)
-#define LOG_RSTandID(tp)		(((uint64_t)(tp)->reset << 32) & (tp)->id)
-#define LOG_IS_EMPTY(tp)		((tp)->id == 0xFFFFFFFF && (tp)->reset == 0xFFFF)
+#define LOG_SECTORS				(LOG_FLASH_SIZE / LOG_SECTOR_SIZE)
+#define LOG_SECTOR_MAGIC		0x4C4F4732	/* Marks a sector in the log format */
 
+/*
+ * Header at the start of each log sector.
+ * The sector sequence number orders the sectors of the log ring.
+ * The header is written with the first point of the sector.
+ */
+typedef struct {
+	uint32_t	magic;
+	uint32_t	seq;
+	uint32_t	first_id;
+	uint16_t	first_reset;
+	uint16_t	reserved;
+} log_sector_hdr_t;
+
+/*
+ * Points are stored in batches following the sector header.
+ * A batch is a tag word, the records and a commit word programmed after
+ * the records. A batch without the commit word is a partial write.
+ */
+#define LOG_BATCH_MAGIC			0xA5000000
+#define LOG_BATCH_MAGIC_MASK	0xFF000000
+#define LOG_BATCH_COMMIT		0x5AC3A55A
+#define LOG_BATCH_TAG(n, len)	(LOG_BATCH_MAGIC | ((uint32_t)(n) << 16) | (len))
+#define LOG_BATCH_COUNT(tag)	(((tag) >> 16) & 0xFF)
+#define LOG_BATCH_LEN(tag)		((tag) & 0xFFFF)
+#define LOG_BATCH_SIZE(len)		(2 * sizeof(uint32_t) + (((len) + 3) & ~3))
+
+/*
+ * Records are a keyframe holding the complete point or a delta.
+ * A delta is a bitmap of the half words changed from the prior point
+ * followed by the zigzag varint delta of each changed half word.
+ * The first point of each sector is a keyframe so sectors decode alone.
+ */
+#define LOG_REC_KEY				0x00
+#define LOG_REC_DELTA			0x01
+#define LOG_HALFWORDS			(sizeof(dataPoint_t) / sizeof(uint16_t))
+#define LOG_DELTA_MAP_SIZE		((LOG_HALFWORDS + 7) / 8)
+#define LOG_REC_MAX_SIZE		(1 + sizeof(dataPoint_t))
+#define LOG_KEYFRAME_INTERVAL	32			/* Records between keyframes */
+
+/* Points committed to flash per program operation. */
+#define LOG_STAGE_POINTS		4
+/* Head sector fill at which the next sector is erased ahead of need. */
+#define LOG_ERASE_AHEAD_POS		(LOG_SECTOR_SIZE * 3 / 4)
+
+/* Monotonic sequence key of a log point. The reset count is the upper part. */
+#define LOG_SEQ_KEY(rst, id)	(((uint64_t)(rst) << 32) | (uint32_t)(id))
+#define LOG_POINT_KEY(tp)		LOG_SEQ_KEY((tp)->reset, (tp)->id)
+#define LOG_SECTOR_KEY(hdr)		LOG_SEQ_KEY((hdr)->first_reset, (hdr)->first_id)
+
+/*
+ * Iterator over the log from the oldest point.
+ * Points are decoded into the iterator.
+ */
+typedef struct {
+	bool		started;
+	uint8_t		sector;
+	uint8_t		left;		/* Records left in the current batch */
+	uint16_t	since_key;	/* Records since the last keyframe */
+	uint32_t	seq;		/* Sequence number of the sector */
+	uint32_t	pos;		/* Offset of the next batch in the sector */
+	uint32_t	rec;		/* Offset of the next record in the batch */
+	uint32_t	rec_end;	/* Offset of the end of the batch records */
+	dataPoint_t	point;		/* Last point decoded */
+} log_iter_t;
 
-dataPoint_t* flash_getLogBuffer(uint16_t id);
 dataPoint_t* flash_getNewestLogEntry(void);
 dataPoint_t* flash_getOldestLogEntry(void);
 void flash_writeLogDataPoint(dataPoint_t* tp);
+void flash_initLogIterator(log_iter_t* it);
+dataPoint_t* flash_getNextLogEntry(log_iter_t* it);
+void flash_getLogRange(uint32_t* first, uint32_t* end);
+uint8_t* flash_encodeLogRecord(uint8_t* p, const dataPoint_t* tp,
+                               const dataPoint_t* base, bool key);
+dataPoint_t* flash_seekLogEntry(log_iter_t* it, uint32_t number);
+void flash_suspendLog(void);
 
 #endif
 
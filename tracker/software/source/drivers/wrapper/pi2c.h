@@ -17,6 +17,7 @@ bool I2C_write8(uint8_t address, uint8_t reg, uint8_t value);
 bool I2C_writeN(uint8_t address, uint8_t *txbuf, uint32_t length);
 bool I2C_read8(uint8_t address, uint8_t reg, uint8_t *val);
 bool I2C_read16(uint8_t address, uint8_t reg, uint16_t *val);
+bool I2C_readN(uint8_t address, uint8_t reg, uint8_t *rxbuf, uint32_t length);
 
 bool I2C_write8_16bitreg(uint8_t address, uint16_t reg, uint8_t value); // 16bit register (for OV5640)
 bool I2C_read8_16bitreg(uint8_t address, uint16_t reg, uint8_t *val); // 16bit register (for OV5640)
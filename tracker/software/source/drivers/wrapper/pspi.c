@@ -0,0 +1,56 @@
+/**
+  * Arbitration of the SPI bus shared by the radio and the SD card.
+  *
+  * The radio TX FIFO has to be refilled within a few ms of the almost empty
+  * interrupt. The SD card holds the bus for whole card operations, which
+  * include the busy wait of each block written. SPI transfers of both use
+  * DMA, the bus itself is the contended resource.
+  *
+  * A radio send is an urgent session. Bulk users (the SD card) wait until
+  * no urgent session is open before they take the bus, so no card operation
+  * starts while the FIFO is fed. An operation already running when a
+  * session opens only delays the first FIFO load, which is done before TX
+  * starts. Bulk operations are kept to one archive chunk to bound it.
+  */
+
+#include "ch.h"
+#include "hal.h"
+#include "pspi.h"
+
+static uint32_t urgent_sessions;
+static threads_queue_t bulk_waiters = _THREADS_QUEUE_DATA(bulk_waiters);
+
+void pspiOpenUrgent(void)
+{
+	chSysLock();
+	urgent_sessions++;
+	chSysUnlock();
+}
+
+void pspiCloseUrgent(void)
+{
+	chSysLock();
+	chDbgAssert(urgent_sessions > 0, "no urgent session open");
+	if(--urgent_sessions == 0) {
+		chThdDequeueAllI(&bulk_waiters, MSG_OK);
+		chSchRescheduleS();
+	}
+	chSysUnlock();
+}
+
+/*
+ * Take the bus for a bulk transfer once no urgent session is open.
+ */
+void pspiAcquireBulk(SPIDriver *spip)
+{
+	chSysLock();
+	while(urgent_sessions > 0)
+		(void)chThdEnqueueTimeoutS(&bulk_waiters, TIME_INFINITE);
+	chSysUnlock();
+	spiAcquireBus(spip);
+}
+
+void pspiReleaseBulk(SPIDriver *spip)
+{
+	spiReleaseBus(spip);
+}
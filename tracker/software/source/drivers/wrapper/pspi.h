@@ -0,0 +1,17 @@
+#ifndef __PSPI_H__
+#define __PSPI_H__
+
+#include "ch.h"
+#include "hal.h"
+
+/*
+ * Arbitration of the SPI bus shared by the radio and the SD card.
+ * A radio send is an urgent session. Bulk users do not start a transfer
+ * while a session is open.
+ */
+void pspiOpenUrgent(void);
+void pspiCloseUrgent(void);
+void pspiAcquireBulk(SPIDriver *spip);
+void pspiReleaseBulk(SPIDriver *spip);
+
+#endif
@@ -1,5 +1,6 @@
 #include "ptime.h"
 #include "debug.h"
+#include "pps.h"
 
 const uint16_t nonLeapYear[] = {0,31,59,90,120,151,181,212,243,273,304,334,365};
 const uint16_t leapYear[] = {0,31,60,91,121,152,182,213,244,274,305,335,366};
@@ -93,3 +94,43 @@ void setTime(ptime_t *date) {
 	rtcSetTime(&RTCD1, &timespec);
 }
 
+/**
+  * Time until a slot of a frame opens in GPS time.
+  * Frames of slots of slot_time are counted from the UNIX epoch. A slot is
+  * open until the guard time (at most half a slot) before its end.
+  * The time is taken from the timepulse when it is locked, else from the RTC.
+  * @param slot Slot index, taken modulo slots
+  * @return 0 if the slot is open or the RTC has not been set
+  */
+sysinterval_t getSlotWait(uint8_t slot, uint8_t slots,
+						  sysinterval_t slot_time, sysinterval_t guard) {
+	if(slots == 0 || slot_time == 0)
+		return 0;
+	uint64_t now;
+	if(!pps_get_time(&now)) {
+		RTCDateTime timespec;
+		rtcGetTime(&RTCD1, &timespec);
+		if(timespec.year == 0)
+			return 0; // Not set from GPS yet
+
+		ptime_t date = {
+			.year = timespec.year + RTC_BASE_YEAR,
+			.month = timespec.month,
+			.day = timespec.day
+		};
+		now = (uint64_t)date2UnixTimestamp(&date) * 1000
+				+ timespec.millisecond;
+	}
+	uint32_t length = chTimeI2MS(slot_time);
+	uint32_t open = length - ((guard < slot_time / 2)
+					? chTimeI2MS(guard) : length / 2);
+	uint64_t frame = (uint64_t)length * slots;
+	uint64_t start = (uint64_t)length * (slot % slots);
+
+	// Time since the slot opened in this frame
+	uint64_t into = (now + frame - start) % frame;
+	if(into < open)
+		return 0;
+	return TIME_MS2I((uint32_t)(frame - into));
+}
+
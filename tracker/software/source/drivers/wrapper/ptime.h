@@ -16,6 +16,8 @@ uint32_t date2UnixTimestamp(ptime_t *date);
 void unixTimestamp2Date(ptime_t *date, uint32_t time);
 void getTime(ptime_t *date);
 void setTime(ptime_t *date);
+sysinterval_t getSlotWait(uint8_t slot, uint8_t slots,
+						  sysinterval_t slot_time, sysinterval_t guard);
 
 #endif
 
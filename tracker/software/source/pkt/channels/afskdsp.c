@@ -0,0 +1,824 @@
+/*
+    Aerospace Decoder - Copyright (C) 2018 Bob Anderson (VK2GJ)
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+/**
+ * @file        afskdsp.c
+ * @brief       AFSK demodulation from PWM to HDLC.
+ * @notes       The DSP chain only uses the driver and packet buffer objects.
+ * @notes       It does not block or use the radio so it also runs off target.
+ *
+ * @addtogroup  channels
+ * @{
+ */
+
+#include "pktconf.h"
+
+/*===========================================================================*/
+/* Driver exported variables.                                                */
+/*===========================================================================*/
+
+/* TODO: Remove or recalculate Matlab/Octave filter coefficients. */
+
+#if MAG_FILTER_GEN_COEFF == TRUE
+
+float32_t mag_filter_coeff_f32[MAG_FILTER_NUM_TAPS] useCCM;
+
+#else
+/*
+ * Magnitude (LPF) coefficients.
+ * Fs=28800, f1 = 1400, number of taps = 29
+ * Matlab/Octave parameters:
+ * hc = fir1(28, 1400/(Fs/2), 'low');
+ */
+
+float32_t mag_filter_coeff_f32[MAG_FILTER_NUM_TAPS] = {
+   -0.0016890122f, -0.0016647590f, -0.0016305187f, -0.0010016907f,
+   0.0009925971f, 0.0051420766f, 0.0120550411f, 0.0219694930f,
+   0.0346207799f, 0.0492010182f, 0.0644272330f, 0.0787120655f,
+   0.0904082200f, 0.0980807163f, 0.1007534795f, 0.0980807163f,
+   0.0904082200f, 0.0787120655f, 0.0644272330f, 0.0492010182f,
+   0.0346207799f, 0.0219694930f, 0.0120550411f, 0.0051420766f,
+   0.0009925971f, -0.0010016907f, -0.0016305187f, -0.0016647590f,
+   -0.0016890122f
+};
+#endif /* PREQ_FILTER_GEN_COEFF == TRUE */
+
+
+#if PRE_FILTER_GEN_COEFF == TRUE
+
+float32_t pre_filter_coeff_f32[PRE_FILTER_NUM_TAPS] useCCM;
+
+#else
+/*
+ * Pre-filter (BPF) coefficients.
+ * Fs=28800, f1 = 925, f2 = 2475, number of taps = 311
+ * Matlab/Octave parameters:
+ * hc = fir1(310, [925, 2475]/(Fs/2), 'pass');
+ */
+
+float32_t pre_filter_coeff_f32[PRE_FILTER_NUM_TAPS] = {
+  0.0002630141f, 0.0002628323f, 0.0002174784f, 0.0001439800f,
+  0.0000662689f, 0.0000087403f, -0.0000104737f, 0.0000152369f,
+  0.0000786174f, 0.0001598901f, 0.0002316217f, 0.0002660169f,
+  0.0002428125f, 0.0001556541f, 0.0000150847f, -0.0001529389f,
+  -0.0003129410f, -0.0004289345f, -0.0004742560f, -0.0004395107f,
+  -0.0003362076f, -0.0001946865f, -0.0000564585f, 0.0000372882f,
+  0.0000579911f, -0.0000007155f, -0.0001192216f, -0.0002555907f,
+  -0.0003562318f, -0.0003710739f, -0.0002691589f, -0.0000500718f,
+  0.0002525572f, 0.0005772283f, 0.0008494657f, 0.0010017974f,
+  0.0009933667f, 0.0008233662f, 0.0005338281f, 0.0002000953f,
+  -0.0000891793f, -0.0002573906f, -0.0002635755f, -0.0001170745f,
+  0.0001218157f, 0.0003565040f, 0.0004809200f, 0.0004114493f,
+  0.0001148717f, -0.0003763382f, -0.0009669091f, -0.0015204528f,
+  -0.0018949887f, -0.0019829034f, -0.0017439270f, -0.0012209388f,
+  -0.0005327554f, 0.0001555675f, 0.0006777111f, 0.0009141328f,
+  0.0008292156f, 0.0004858414f, 0.0000315873f, -0.0003412629f,
+  -0.0004518110f, -0.0001872172f, 0.0004567840f, 0.0013646274f,
+  0.0023242755f, 0.0030807181f, 0.0034059854f, 0.0031663042f,
+  0.0023666159f, 0.0011580344f, -0.0001962396f, -0.0013891652f,
+  -0.0021544494f, -0.0023437972f, -0.0019738661f, -0.0012274564f,
+  -0.0004059321f, 0.0001560330f, 0.0001905957f, -0.0004167487f,
+  -0.0015805414f, -0.0030247966f, -0.0043492747f, -0.0051368262f,
+  -0.0050731091f, -0.0040446519f, -0.0021854927f, 0.0001442042f,
+  0.0024453937f, 0.0042118692f, 0.0050709497f, 0.0048929927f,
+  0.0038363447f, 0.0023111613f, 0.0008681171f, 0.0000401684f,
+  0.0001807741f, 0.0013455353f, 0.0032543614f, 0.0053501112f,
+  0.0069426437f, 0.0074018164f, 0.0063466090f, 0.0037754712f,
+  0.0000966124f, -0.0039567264f, -0.0075087956f, -0.0097752826f,
+  -0.0102847504f, -0.0090233718f, -0.0064569060f, -0.0034162907f,
+  -0.0008715304f, 0.0003478556f, -0.0001914293f, -0.0023698932f,
+  -0.0055096823f, -0.0085320077f, -0.0102437760f, -0.0096804313f,
+  -0.0064109478f, -0.0007150685f, 0.0064272605f, 0.0135454918f,
+  0.0190429897f, 0.0216254883f, 0.0206778373f, 0.0164791731f,
+  0.0101834165f, 0.0035516810f, -0.0015090359f, -0.0034886155f,
+  -0.0017541991f, 0.0031705084f, 0.0096227405f, 0.0151387937f,
+  0.0170529057f, 0.0132228528f, 0.0027036543f, -0.0138107229f,
+  -0.0339131039f, -0.0538295639f, -0.0691388898f, -0.0757219326f,
+  -0.0707320414f, -0.0533595170f, -0.0251988255f, 0.0098893389f,
+  0.0464165977f, 0.0782860621f, 0.0999812724f, 0.1076699117f,
+  0.0999812724f, 0.0782860621f, 0.0464165977f, 0.0098893389f,
+  -0.0251988255f, -0.0533595170f, -0.0707320414f, -0.0757219326f,
+  -0.0691388898f, -0.0538295639f, -0.0339131039f, -0.0138107229f,
+  0.0027036543f, 0.0132228528f, 0.0170529057f, 0.0151387937f,
+  0.0096227405f, 0.0031705084f, -0.0017541991f, -0.0034886155f,
+  -0.0015090359f, 0.0035516810f, 0.0101834165f, 0.0164791731f,
+  0.0206778373f, 0.0216254883f, 0.0190429897f, 0.0135454918f,
+  0.0064272605f, -0.0007150685f, -0.0064109478f, -0.0096804313f,
+  -0.0102437760f, -0.0085320077f, -0.0055096823f, -0.0023698932f,
+  -0.0001914293f, 0.0003478556f, -0.0008715304f, -0.0034162907f,
+  -0.0064569060f, -0.0090233718f, -0.0102847504f, -0.0097752826f,
+  -0.0075087956f, -0.0039567264f, 0.0000966124f, 0.0037754712f,
+  0.0063466090f, 0.0074018164f, 0.0069426437f, 0.0053501112f,
+  0.0032543614f, 0.0013455353f, 0.0001807741f, 0.0000401684f,
+  0.0008681171f, 0.0023111613f, 0.0038363447f, 0.0048929927f,
+  0.0050709497f, 0.0042118692f, 0.0024453937f, 0.0001442042f,
+  -0.0021854927f, -0.0040446519f, -0.0050731091f, -0.0051368262f,
+  -0.0043492747f, -0.0030247966f, -0.0015805414f, -0.0004167487f,
+  0.0001905957f, 0.0001560330f, -0.0004059321f, -0.0012274564f,
+  -0.0019738661f, -0.0023437972f, -0.0021544494f, -0.0013891652f,
+  -0.0001962396f, 0.0011580344f, 0.0023666159f, 0.0031663042f,
+  0.0034059854f, 0.0030807181f, 0.0023242755f, 0.0013646274f,
+  0.0004567840f, -0.0001872172f, -0.0004518110f, -0.0003412629f,
+  0.0000315873f, 0.0004858414f, 0.0008292156f, 0.0009141328f,
+  0.0006777111f, 0.0001555675f, -0.0005327554f, -0.0012209388f,
+  -0.0017439270f, -0.0019829034f, -0.0018949887f, -0.0015204528f,
+  -0.0009669091f, -0.0003763382f, 0.0001148717f, 0.0004114493f,
+  0.0004809200f, 0.0003565040f, 0.0001218157f, -0.0001170745f,
+  -0.0002635755f, -0.0002573906f, -0.0000891793f, 0.0002000953f,
+  0.0005338281f, 0.0008233662f, 0.0009933667f, 0.0010017974f,
+  0.0008494657f, 0.0005772283f, 0.0002525572f, -0.0000500718f,
+  -0.0002691589f, -0.0003710739f, -0.0003562318f, -0.0002555907f,
+  -0.0001192216f, -0.0000007155f, 0.0000579911f, 0.0000372882f,
+  -0.0000564585f, -0.0001946865f, -0.0003362076f, -0.0004395107f,
+  -0.0004742560f, -0.0004289345f, -0.0003129410f, -0.0001529389f,
+  0.0000150847f, 0.0001556541f, 0.0002428125f, 0.0002660169f,
+  0.0002316217f, 0.0001598901f, 0.0000786174f, 0.0000152369f,
+  -0.0000104737f, 0.0000087403f, 0.0000662689f, 0.0001439800f,
+  0.0002174784f, 0.0002628323f, 0.0002630141f
+};
+#endif
+
+
+/*===========================================================================*/
+/* Decoder local variables and types.                                        */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Decoder local functions.                                                  */
+/*===========================================================================*/
+
+/**
+ * @brief   Check the symbol timing.
+ *
+ * @param[in]   myDriver   pointer to a @p AFSKDemodDriver structure
+ *
+ * @return  status  indicating if symbol decoding should take place.
+ * @retval  true    decoding should run before getting next PWM entry.
+ * @retval  false   continue immediately with next PWM data entry.
+ *
+ * @api
+ */
+static bool pktCheckAFSKSymbolTime(AFSKDemodDriver *myDriver) {
+  /*
+   * Each decoder filter is setup at init with a sample source.
+   * This is set in the filter control structure.
+   */
+
+  switch(AFSK_DECODE_TYPE) {
+    case AFSK_DSP_QCORR_DECODE: {
+
+      /*
+       * Check if symbol decode should be run now.
+       */
+      return (get_qcorr_symbol_timing(myDriver));
+    }
+
+    case AFSK_DSP_FCORR_DECODE: {
+      return (get_fcorr_symbol_timing(myDriver));
+    }
+
+    case AFSK_DSP_SDFT_DECODE: {
+      return (get_sdft_symbol_timing(myDriver));
+    }
+
+    default: {
+      break;
+    }
+  } /* end switch. */
+  return false;
+}
+
+/**
+ * @brief   Update the symbol timing PLL.
+ *
+ * @param[in]   myDriver   pointer to a @p AFSKDemodDriver structure
+ *
+ * @api
+ */
+static void pktUpdateAFSKSymbolPLL(AFSKDemodDriver *myDriver) {
+  /*
+   * Increment PLL timing.
+   */
+
+  switch(AFSK_DECODE_TYPE) {
+    case AFSK_DSP_QCORR_DECODE: {
+
+      /*
+       *
+       */
+
+      update_qcorr_pll(myDriver);
+      break;
+    }
+
+    case AFSK_DSP_FCORR_DECODE: {
+      update_fcorr_pll(myDriver);
+      break;
+    }
+
+    case AFSK_DSP_SDFT_DECODE: {
+      update_sdft_pll(myDriver);
+      break;
+    }
+
+    default: {
+      break;
+    }
+  } /* end switch. */
+  return;
+}
+
+/**
+ * @brief   Add a sample to the decoder filter input.
+ * @notes   The decimated entries are filtered through a BPF.
+ * @notes   Samples are collected and filtered in blocks.
+ *
+ * @param[in]   myDriver   pointer to an @p AFSKDemodDriver structure.
+ * @param[in]   binary     binary data from the PWM.
+ *
+ * @return  block status
+ * @retval  true    a block of filtered samples is ready for processing.
+ * @retval  false   the input block is not yet full.
+ *
+ * @api
+ */
+static bool pktAddAFSKFilterSample(AFSKDemodDriver *myDriver, bit_t binary) {
+  switch(AFSK_DECODE_TYPE) {
+    case AFSK_DSP_QCORR_DECODE: {
+      return push_qcorr_sample(myDriver, binary);
+    }
+
+    case AFSK_DSP_FCORR_DECODE: {
+      return push_fcorr_sample(myDriver, binary);
+    }
+
+    case AFSK_DSP_SDFT_DECODE: {
+      return push_sdft_sample(myDriver, binary);
+    }
+
+    default: {
+      break;
+    }
+  } /* End switch. */
+  return false;
+}
+
+/**
+ * @brief   Process a filtered sample block through the IQ correlation.
+ * @notes   There are 4 filters that are run (I & Q for Mark and Space)
+ * @notes   The tone magnitudes for the full block are computed.
+ *
+ * @param[in]   myDriver   pointer to an @p AFSKDemodDriver structure.
+ *
+ * @api
+ */
+static void pktProcessAFSKFilteredBlock(AFSKDemodDriver *myDriver) {
+  switch(AFSK_DECODE_TYPE) {
+    case AFSK_DSP_QCORR_DECODE: {
+
+      /*
+       * Next perform the fixed point correlator update.
+       * Result is updated MARK and SPACE bins for the block.
+       *
+       */
+      process_qcorr_block(myDriver);
+      break;
+    }
+
+    case AFSK_DSP_FCORR_DECODE: {
+      /* Float correlator update for MARK and SPACE bins. */
+      process_fcorr_block(myDriver);
+      break;
+    }
+
+    case AFSK_DSP_SDFT_DECODE: {
+      /* Update the recursive DFT bins over the block. */
+      process_sdft_block(myDriver);
+      break;
+    }
+
+    default: {
+      break;
+    }
+  } /* end switch. */
+}
+
+/**
+ * @brief   Evaluate the tone for a sample in the processed block.
+ *
+ * @param[in]   myDriver   pointer to an @p AFSKDemodDriver structure.
+ * @param[in]   n          index of the sample within the block.
+ *
+ * @return  filter  status
+ * @retval  true    the filter output is valid.
+ * @retval  false   the filter output in not yet valid.
+ *
+ * @api
+ */
+static bool pktProcessAFSKFilteredSample(AFSKDemodDriver *myDriver,
+                                         uint16_t n) {
+  /*
+   * Each decoder filter is setup at init with a sample source.
+   * This is set in the filter control structure.
+   */
+
+  switch(AFSK_DECODE_TYPE) {
+    case AFSK_DSP_QCORR_DECODE: {
+
+      /*
+       * Compare MARK and SPACE bins at this sample.
+       */
+      return process_qcorr_output(myDriver, n);
+    }
+
+    case AFSK_DSP_FCORR_DECODE: {
+      return process_fcorr_output(myDriver, n);
+    }
+
+    case AFSK_DSP_SDFT_DECODE: {
+      return process_sdft_output(myDriver, n);
+    }
+
+    default: {
+      break;
+    }
+  } /* end switch. */
+  return false;
+}
+
+#if AFSK_NUM_SLICERS > 1
+/**
+ * @brief   Run the additional slicers and collect a good frame.
+ * @notes   All slicers share symbol timing so frames close on the same symbol.
+ * @notes   The primary frame is used if it has a good CRC.
+ * @notes   Otherwise the first additional slicer frame with good CRC is used.
+ * @notes   A failed primary frame is dropped while another slicer is in frame.
+ * @notes   Only one frame is dispatched per decode session.
+ * @post    A selected slicer frame is copied to the active packet buffer.
+ *
+ * @param[in]   myDriver   pointer to an @p AFSKDemodDriver structure.
+ *
+ * @api
+ */
+static void pktProcessAFSKSlicers(AFSKDemodDriver *myDriver) {
+  packet_svc_t *myHandler = myDriver->packet_handler;
+  pkt_data_object_t *myPacket = myHandler->active_packet_object;
+
+  /* Check if the primary already has a good frame. */
+  bool collected = (myDriver->frame_state == FRAME_CLOSE)
+      && pktIsBufferGoodCRC(myPacket);
+
+  uint8_t i;
+  for(i = 0; i < AFSK_NUM_SLICERS - 1; i++) {
+    afsk_slicer_t *mySlicer = &myDriver->slicers[i];
+    pktExtractHDLCfromSlicer(mySlicer);
+    if(mySlicer->frame_state != FRAME_CLOSE)
+      continue;
+
+    /* Slicer frame is closed so it is taken or discarded now. */
+    if(!collected
+        && mySlicer->crc == (uint16_t)~CRC_INCLUSIVE_CONSTANT) {
+      /* Replace primary frame (which may be open, reset or bad CRC). */
+      memcpy(myPacket->buffer, mySlicer->buffer, mySlicer->packet_size);
+      myPacket->packet_size = mySlicer->packet_size;
+      myPacket->crc = mySlicer->crc;
+      myDriver->frame_state = FRAME_CLOSE;
+      collected = true;
+    }
+    mySlicer->packet_size = 0;
+    mySlicer->frame_state = FRAME_SEARCH;
+  }
+  if(collected)
+    return;
+
+  /*
+   * The primary has no good frame but may have ended its frame.
+   * If another slicer is still inside a frame keep the session going.
+   */
+  if(myDriver->frame_state == FRAME_RESET
+      || myDriver->frame_state == FRAME_CLOSE) {
+    for(i = 0; i < AFSK_NUM_SLICERS - 1; i++) {
+      if(myDriver->slicers[i].frame_state == FRAME_OPEN
+          && myDriver->slicers[i].packet_size > 0) {
+        pktResetDataCount(myPacket);
+        myDriver->frame_state = FRAME_SEARCH;
+        return;
+      }
+    }
+  }
+}
+
+/**
+ * @brief   Reset the additional slicers.
+ *
+ * @param[in]   myDriver   pointer to an @p AFSKDemodDriver structure.
+ *
+ * @api
+ */
+static void pktResetAFSKSlicers(AFSKDemodDriver *myDriver) {
+  uint8_t i;
+  for(i = 0; i < AFSK_NUM_SLICERS - 1; i++) {
+    afsk_slicer_t *mySlicer = &myDriver->slicers[i];
+    mySlicer->frame_state = FRAME_SEARCH;
+    mySlicer->tone_freq = TONE_NONE;
+    mySlicer->prior_freq = TONE_NONE;
+    mySlicer->bit_index = 0;
+    mySlicer->packet_size = 0;
+    mySlicer->crc = CRC16_INIT_VALUE;
+    mySlicer->hdlc_bits = (int32_t)-1;
+  }
+}
+#endif /* AFSK_NUM_SLICERS > 1 */
+
+/**
+ * @brief   Sets the signal quality of a frame from the decode session.
+ * @notes   The RSSI is set when the session starts.
+ *
+ * @param[in]   myDriver   pointer to an @p AFSKDemodDriver structure.
+ * @param[in]   myPacket   pointer to the @p pkt_data_object_t to update.
+ *
+ * @api
+ */
+void pktSetAFSKFrameQuality(AFSKDemodDriver *myDriver,
+                            pkt_data_object_t *myPacket) {
+  afsk_quality_t *quality = &myDriver->quality;
+  if(quality->level_count != 0)
+    myPacket->quality.tone_level =
+        (uint32_t)(quality->level_total / quality->level_count);
+  if(quality->pll_edges != 0)
+    myPacket->quality.pll_lock =
+        (uint8_t)((quality->pll_locked * 100U) / quality->pll_edges);
+}
+
+#if PKT_RX_USE_SOFT_DCD == TRUE
+/**
+ * @brief   Update the software carrier detect at a symbol.
+ * @notes   A window has carrier if it holds enough HDLC flags or enough of
+ *          its tone transitions are at the symbol clock or at the phase of
+ *          the transition before.
+ * @notes   An FEC block being collected holds the carrier.
+ * @notes   An open HDLC frame does not as noise opens frames on false flags.
+ * @post    The count of windows without carrier is updated.
+ *
+ * @param[in]   myDriver   pointer to an @p AFSKDemodDriver structure.
+ *
+ * @api
+ */
+static void pktUpdateAFSKCarrier(AFSKDemodDriver *myDriver) {
+  afsk_dcd_t *dcd = &myDriver->dcd;
+
+  if((myDriver->hdlc_bits & HDLC_CODE_MASK) == HDLC_FLAG)
+    dcd->flags++;
+
+  bool busy = false;
+#if PKT_RX_USE_FX25 == TRUE
+  busy |= myDriver->fx25.mode != NULL;
+#endif
+#if PKT_RX_USE_IL2P == TRUE
+  busy |= myDriver->il2p.state != IL2P_RX_SEARCH;
+#endif
+  if(busy)
+    dcd->idle = 0;
+  if(++dcd->symbols < PKT_RX_DCD_WINDOW)
+    return;
+
+  uint16_t timed = dcd->locked > dcd->regular ? dcd->locked : dcd->regular;
+  bool carrier = dcd->flags >= PKT_RX_DCD_FLAGS
+      || (dcd->edges >= PKT_RX_DCD_WINDOW / 4U
+          && timed * 100U >= dcd->edges * PKT_RX_DCD_LOCK);
+  if(carrier || busy)
+    dcd->idle = 0;
+  else if(dcd->idle < UINT8_MAX)
+    dcd->idle++;
+  dcd->symbols = 0;
+  dcd->flags = 0;
+  dcd->edges = 0;
+  dcd->locked = 0;
+  dcd->regular = 0;
+}
+#endif /* PKT_RX_USE_SOFT_DCD == TRUE */
+
+/**
+ * @brief   Decode AFSK symbol into an HDLC bit.
+ * @notes   Called at symbol ready time as determined by decoders.
+ *
+ * @param[in]   myDriver   pointer to an @p AFSKDemodDriver structure.
+ *
+ * @return  status of operation
+ * @retval  true - success
+ * @retval  false - an error occurred in processing (buffer full)
+ *
+ * @api
+ */
+static bool pktDecodeAFSKSymbol(AFSKDemodDriver *myDriver) {
+  /*
+   * Called when a symbol timeline is ready.
+   * Called from normal thread level.
+   */
+
+  switch(AFSK_DECODE_TYPE) {
+
+    case AFSK_DSP_QCORR_DECODE: {
+      /* Tone analysis is done per sample in QCORR. */
+      qcorr_decoder_t *decoder = myDriver->tone_decoder;
+      myDriver->tone_freq = decoder->current_demod;
+#if AFSK_NUM_SLICERS > 1
+      uint8_t i;
+      for(i = 0; i < AFSK_NUM_SLICERS - 1; i++)
+        myDriver->slicers[i].tone_freq = decoder->slicer_demod[i];
+#endif
+      break;
+    } /* End case AFSK_DSP_QCORR_DECODE. */
+
+    case AFSK_DSP_FCORR_DECODE: {
+      /* Tone analysis is done per sample in FCORR. */
+      fcorr_decoder_t *decoder = myDriver->tone_decoder;
+      myDriver->tone_freq = decoder->current_demod;
+#if AFSK_NUM_SLICERS > 1
+      uint8_t i;
+      for(i = 0; i < AFSK_NUM_SLICERS - 1; i++)
+        myDriver->slicers[i].tone_freq = decoder->slicer_demod[i];
+#endif
+      break;
+    } /* End case AFSK_DSP_FCORR_DECODE. */
+
+    case AFSK_DSP_SDFT_DECODE: {
+      /* Tone analysis is done per sample in SDFT. */
+      sdft_decoder_t *decoder = myDriver->tone_decoder;
+      myDriver->tone_freq = decoder->current_demod;
+#if AFSK_NUM_SLICERS > 1
+      uint8_t i;
+      for(i = 0; i < AFSK_NUM_SLICERS - 1; i++)
+        myDriver->slicers[i].tone_freq = decoder->slicer_demod[i];
+#endif
+      break;
+    } /* End case AFSK_DSP_SDFT_DECODE. */
+
+    case AFSK_NULL_DECODE: {
+      /*
+       * Do nothing (used when in debug capture mode).
+       */
+      return true;
+    } /* End case AFSK_NULL_DECODE. */
+  } /* End switch. */
+
+  /* After tone detection generate an HDLC bit. */
+  if(!pktExtractHDLCfromAFSK(myDriver))
+    return false;
+
+#if AFSK_NUM_SLICERS > 1
+  /* Run the additional slicers on the same symbol. */
+  pktProcessAFSKSlicers(myDriver);
+#endif
+#if PKT_RX_USE_FX25 == TRUE
+  pktExtractFX25fromHDLC(myDriver);
+#endif
+#if PKT_RX_USE_IL2P == TRUE
+  pktExtractIL2PfromHDLC(myDriver);
+#endif
+#if PKT_RX_USE_SOFT_DCD == TRUE
+  pktUpdateAFSKCarrier(myDriver);
+#endif
+  return true;
+} /* End function. */
+
+/**
+ * @brief   Run the symbol PLL and HDLC for a decode rate sample.
+ * @notes   The tone of the sample has been set by the tone decoder.
+ *
+ * @param[in]   myDriver   pointer to an @p AFSKDemodDriver structure.
+ *
+ * @return  status of operation
+ * @retval  true - success
+ * @retval  false - an error occurred in processing (buffer full)
+ *
+ * @api
+ */
+static bool pktProcessAFSKDecodeSample(AFSKDemodDriver *myDriver) {
+  AFSK_STATS_STAMP(pll_start);
+  if(pktCheckAFSKSymbolTime(myDriver)) {
+    /* A symbol is ready to decode. */
+    AFSK_STATS_STAMP(hdlc_start);
+    bool stored = pktDecodeAFSKSymbol(myDriver);
+#if USE_AFSK_DECODER_STATS == TRUE
+    rtcnt_t hdlc_cycles = chSysGetRealtimeCounterX() - hdlc_start;
+    pktAddAFSKStageCycles(&myDriver->stats, AFSK_STAGE_HDLC,
+                          hdlc_cycles);
+    myDriver->stats.symbols++;
+    /* Exclude HDLC from the PLL stage time. */
+    pll_start += hdlc_cycles;
+#endif
+    if(!stored)
+      /* Unable to store character - buffer full. */
+      return false;
+  }
+  pktUpdateAFSKSymbolPLL(myDriver);
+  AFSK_STATS_STAGE(myDriver, AFSK_STAGE_PLL, pll_start);
+  return true;
+}
+
+/**
+ * @brief   Processes PWM into a decimated time line for AFSK decoding.
+ * @notes   The decimated entries are filtered through a BPF.
+ *
+ * @param[in]   myDriver   pointer to a @p AFSKDemodDriver structure
+ *
+ * @return  status of operations.
+ * @retval  true    no error occurred so decimation can continue at next data.
+ * @retval  false   an error occurred and decimation should be aborted.
+ *
+ * @api
+ */
+bool pktProcessAFSK(AFSKDemodDriver *myDriver, min_pwmcnt_t current_tone[]) {
+  AFSK_STATS_STAMP(process_start);
+  /* Start working on new input data now. */
+  uint8_t i = 0;
+  for(i = 0; i < (sizeof(min_pwm_counts_t) / sizeof(min_pwmcnt_t)); i++) {
+#if PKT_RX_USE_PERIOD_DISC == TRUE
+    /* Selects the discriminator or the correlator by the half cycles. */
+    push_period_cycle(myDriver, current_tone[i]);
+#endif
+    myDriver->decimation_accumulator += current_tone[i];
+    while(myDriver->decimation_accumulator >= 0) {
+#if USE_AFSK_DECODER_STATS == TRUE
+      myDriver->stats.samples++;
+#endif
+#if PKT_RX_USE_PERIOD_DISC == TRUE
+      if(myDriver->period.active) {
+        /* The tone is known from the half cycle so no filtering is done. */
+        if(push_period_sample(myDriver, myDriver->decimation_accumulator)
+            && !pktProcessAFSKDecodeSample(myDriver))
+          return false;
+        myDriver->decimation_accumulator -= myDriver->decimation_size;
+        continue;
+      }
+#endif
+      /*
+       *  The decoder will process a converted binary sample.
+       *  The PWM binary is converted to a q31 +/- sample value.
+       *  The sample is added to the pre-filter (i.e. BPF) input block.
+       */
+      AFSK_STATS_STAMP(filter_start);
+      if(pktAddAFSKFilterSample(myDriver, !(i & 1))) {
+        AFSK_STATS_STAGE(myDriver, AFSK_STAGE_PREFILTER, filter_start);
+
+        /* A full block has been pre-filtered so run the correlators. */
+        pktProcessAFSKFilteredBlock(myDriver);
+
+        /*
+         * Process each sample at the output side of the filters.
+         * The decoder returns true if its output is now valid.
+         */
+        uint16_t n;
+        for(n = 0; n < AFSK_DECODE_BLOCK_SIZE; n++) {
+          /* Decoding commences once the filters are ready. */
+          if(pktProcessAFSKFilteredSample(myDriver, n)
+              && !pktProcessAFSKDecodeSample(myDriver))
+            return false;
+        }
+      }
+      myDriver->decimation_accumulator -= myDriver->decimation_size;
+    } /* End while. Accumulator has underflowed. */
+  } /* End for. */
+#if USE_AFSK_DECODER_STATS == TRUE
+  myDriver->stats.process_cycles += chSysGetRealtimeCounterX() - process_start;
+#endif
+  return true;
+}
+
+/**
+ * @brief   Reset the AFSK decoder and filter.
+ * @notes   Called at completion of packet reception.
+ * @post    Selected tone decoder and common AFSK data is initialized.
+ *
+ * @param[in]   myDriver   pointer to an @p AFSKDemodDriver structure.
+ *
+ * @api
+ */
+void pktResetAFSKDecoder(AFSKDemodDriver *myDriver) {
+  /*
+   * Called when a decode stream has completed.
+   * Called from normal thread level.
+   */
+
+  /* Reset the decoder data.*/
+  myDriver->frame_state = FRAME_SEARCH;
+  myDriver->prior_freq = TONE_NONE;
+  myDriver->bit_index = 0;
+  myDriver->decimation_accumulator = 0;
+
+  /* Set the hdlc bits to all ones. */
+  myDriver->hdlc_bits = (int32_t)-1;
+
+#if AFSK_NUM_SLICERS > 1
+  pktResetAFSKSlicers(myDriver);
+#endif
+
+#if PKT_RX_USE_FX25 == TRUE
+  pktFX25ResetReceive(&myDriver->fx25);
+#endif
+
+#if PKT_RX_USE_IL2P == TRUE
+  pktIL2PResetReceive(&myDriver->il2p);
+#endif
+
+#if PKT_RX_USE_SOFT_DCD == TRUE
+  memset(&myDriver->dcd, 0, sizeof(afsk_dcd_t));
+#endif
+
+#if PKT_RX_USE_PERIOD_DISC == TRUE
+  reset_period_disc(myDriver);
+#endif
+
+#if PKT_RX_USE_2FSK == TRUE
+  pktReset2FSKDecoder(myDriver);
+#endif
+
+  switch(AFSK_DECODE_TYPE) {
+
+    case AFSK_DSP_QCORR_DECODE: {
+      /* Reset QCORR. */
+      (void)reset_qcorr_all(myDriver);
+      break;
+    }
+
+    case AFSK_DSP_FCORR_DECODE: {
+      /* Reset FCORR. */
+      (void)reset_fcorr_all(myDriver);
+      break;
+    }
+
+    case AFSK_DSP_SDFT_DECODE: {
+      /* Reset SDFT. */
+      (void)reset_sdft_all(myDriver);
+      break;
+    }
+
+    case AFSK_NULL_DECODE: {
+      /*
+       * Do nothing (used when in debug capture mode).
+       */
+      break;
+    } /* End case AFSK_NULL_DECODE. */
+  } /* End switch. */
+}
+
+/*===========================================================================*/
+/* Decoder exported functions.                                               */
+/*===========================================================================*/
+
+/**
+ * @brief   Initialize the DSP of an AFSK decoder.
+ * @notes   Called by the decoder thread before the first session.
+ * @post    The decimation, filter coefficients and tone decoder are set.
+ *
+ * @param[in]   myDriver   pointer to an @p AFSKDemodDriver structure.
+ *
+ * @api
+ */
+void pktInitAFSKDSP(AFSKDemodDriver *myDriver) {
+  /* Set DSP parameters. */
+  myDriver->decimation_size = ((pwm_accum_t)ICU_COUNT_FREQUENCY
+                                / (pwm_accum_t)AFSK_BAUD_RATE)
+                                / (pwm_accum_t)SYMBOL_DECIMATION;
+
+  /*
+   * Generate the BPF and LPF filter coordinates.
+   * QCORR with flash coefficient tables does not use the float coefficients.
+   */
+#if PRE_FILTER_GEN_COEFF == TRUE                                             \
+  && !(AFSK_DECODE_TYPE == AFSK_DSP_QCORR_DECODE                             \
+       && QCORR_USE_FLASH_COEFFS == TRUE)
+
+  gen_fir_bpf((float32_t)PRE_FILTER_LOW / (float32_t)FILTER_SAMPLE_RATE,
+              (float32_t)PRE_FILTER_HIGH / (float32_t)FILTER_SAMPLE_RATE,
+              pre_filter_coeff_f32,
+              PRE_FILTER_NUM_TAPS,
+              TD_WINDOW_NONE);
+#endif
+
+#if MAG_FILTER_GEN_COEFF == TRUE                                             \
+  && !(AFSK_DECODE_TYPE == AFSK_DSP_QCORR_DECODE                             \
+       && QCORR_USE_FLASH_COEFFS == TRUE)
+
+  gen_fir_lpf((float32_t)MAG_FILTER_HIGH / (float32_t)DECODE_SAMPLE_RATE,
+              mag_filter_coeff_f32,
+              MAG_FILTER_NUM_TAPS,
+              TD_WINDOW_NONE);
+#endif
+
+#if AFSK_DECODE_TYPE == AFSK_DSP_QCORR_DECODE
+  init_qcorr_decoder(myDriver);
+#elif AFSK_DECODE_TYPE == AFSK_DSP_FCORR_DECODE
+  init_fcorr_decoder(myDriver);
+#elif AFSK_DECODE_TYPE == AFSK_DSP_SDFT_DECODE
+  init_sdft_decoder(myDriver);
+#endif
+}
+
+/** @} */
@@ -0,0 +1,110 @@
+/*
+    Aerospace Decoder - Copyright (C) 2018 Bob Anderson (VK2GJ)
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+/**
+ * @file    rx2fsk.c
+ * @brief   2FSK (G3RUH) receive channel.
+ * @details The radio output is clock recovered data so no DSP is needed.
+ *          Bits are descrambled (1 + x^12 + x^17).
+ *          The descrambled bits are NRZI so the AFSK HDLC decoder is used.
+ *
+ * @addtogroup channels
+ * @{
+ */
+
+#include "pktconf.h"
+
+#if PKT_RX_USE_2FSK == TRUE
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+/**
+ * @brief   Descrambles a received bit and passes it to HDLC.
+ *
+ * @param[in]   myDriver   pointer to an @p AFSKDemodDriver structure.
+ * @param[in]   level      received bit.
+ *
+ * @return  status of operation
+ * @retval  true - success
+ * @retval  false - an error occurred in processing (buffer full)
+ */
+static bool pktDecode2FSKBit(AFSKDemodDriver *myDriver, uint8_t level) {
+  uint32_t lfsr = (myDriver->descrambler << 1) | level;
+  myDriver->descrambler = lfsr;
+  uint8_t bit = (lfsr ^ (lfsr >> 12) ^ (lfsr >> 17)) & 0x1;
+
+  /* The HDLC decoder takes NRZI as tones. */
+  myDriver->tone_freq = bit ? TONE_MARK : TONE_SPACE;
+#if USE_AFSK_DECODER_STATS == TRUE
+  myDriver->stats.symbols++;
+#endif
+  if(!pktExtractHDLCfromAFSK(myDriver))
+    return false;
+#if PKT_RX_USE_FX25 == TRUE
+  pktExtractFX25fromHDLC(myDriver);
+#endif
+#if PKT_RX_USE_IL2P == TRUE
+  pktExtractIL2PfromHDLC(myDriver);
+#endif
+  return true;
+}
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Resets the 2FSK decoder.
+ *
+ * @param[in]   myDriver   pointer to an @p AFSKDemodDriver structure.
+ *
+ * @api
+ */
+void pktReset2FSKDecoder(AFSKDemodDriver *myDriver) {
+  myDriver->descrambler = 0;
+}
+
+/**
+ * @brief   Processes a PWM entry of 2FSK data into HDLC.
+ * @notes   The impulse is the high level and the valley the low level.
+ * @notes   Each level is rounded to a number of bit times.
+ *
+ * @param[in]   myDriver        pointer to an @p AFSKDemodDriver structure.
+ * @param[in]   current_tone    impulse and valley PWM counts.
+ *
+ * @return  status of operations.
+ * @retval  true    no error occurred so decoding can continue at next data.
+ * @retval  false   an error occurred and decoding should be aborted.
+ *
+ * @api
+ */
+bool pktProcess2FSK(AFSKDemodDriver *myDriver, min_pwmcnt_t current_tone[]) {
+  AFSK_STATS_STAMP(process_start);
+  uint8_t i;
+  for(i = 0; i < (sizeof(min_pwm_counts_t) / sizeof(min_pwmcnt_t)); i++) {
+    uint32_t bits = (current_tone[i] + (PKT_2FSK_BIT_COUNT / 2))
+        / PKT_2FSK_BIT_COUNT;
+#if USE_AFSK_DECODER_STATS == TRUE
+    myDriver->stats.samples += bits;
+#endif
+    while(bits-- > 0) {
+      if(!pktDecode2FSKBit(myDriver, !(i & 1)))
+        return false;
+    }
+  }
+#if USE_AFSK_DECODER_STATS == TRUE
+  myDriver->stats.process_cycles += chSysGetRealtimeCounterX() - process_start;
+#endif
+  return true;
+}
+
+#endif /* PKT_RX_USE_2FSK == TRUE */
+
+/** @} */
@@ -0,0 +1,59 @@
+/*
+    Aerospace Decoder - Copyright (C) 2018 Bob Anderson (VK2GJ)
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+/**
+ * @file        rx2fsk.h
+ * @brief       2FSK (G3RUH) decoding definitions.
+ * @details     The radio demodulates 2FSK and recovers the bit clock.
+ *              Its RX data is captured by the PWM front end of the AFSK
+ *              decoder. Each PWM level is converted to a run of bits.
+ *
+ * @addtogroup decoders
+ * @{
+ */
+
+#ifndef CHANNELS_RX2FSK_H_
+#define CHANNELS_RX2FSK_H_
+
+#if PKT_RX_USE_2FSK == TRUE
+
+/*===========================================================================*/
+/* Module constants.                                                         */
+/*===========================================================================*/
+
+/* ICU counts per 2FSK bit. */
+#define PKT_2FSK_BIT_COUNT      (ICU_COUNT_FREQUENCY / PKT_RX_2FSK_SPEED)
+
+/*
+ * Longest run of equal bits that must fit in a PWM count.
+ * Scrambled data has runs of more than 17 bits only rarely.
+ */
+#define PKT_2FSK_MAX_RUN        24U
+
+#if (PKT_2FSK_MAX_RUN * PKT_2FSK_BIT_COUNT) > PWM_MAX_COUNT
+#error "PWM count range too short for 2FSK receive (disable 12 bit PWM)"
+#endif
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  void pktReset2FSKDecoder(AFSKDemodDriver *myDriver);
+  bool pktProcess2FSK(AFSKDemodDriver *myDriver, min_pwmcnt_t current_tone[]);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PKT_RX_USE_2FSK == TRUE */
+
+#endif /* CHANNELS_RX2FSK_H_ */
+
+/** @} */
@@ -16,425 +16,28 @@
 
 #include "pktconf.h"
 #include "portab.h"
+#include "watchdog.h"
+#include "pclock.h"
+#include "memregion.h"
+#include "eprof.h"
+#include "sleep.h"
 
 /*===========================================================================*/
 /* Driver exported variables.                                                */
 /*===========================================================================*/
 
-/* TODO: Remove or recalculate Matlab/Octave filter coefficients. */
-
-#if MAG_FILTER_GEN_COEFF == TRUE
-
-float32_t mag_filter_coeff_f32[MAG_FILTER_NUM_TAPS] useCCM;
-
-#else
-/*
- * Magnitude (LPF) coefficients.
- * Fs=28800, f1 = 1400, number of taps = 29
- * Matlab/Octave parameters:
- * hc = fir1(28, 1400/(Fs/2), 'low');
- */
-
-float32_t mag_filter_coeff_f32[MAG_FILTER_NUM_TAPS] = {
-   -0.0016890122f, -0.0016647590f, -0.0016305187f, -0.0010016907f,
-   0.0009925971f, 0.0051420766f, 0.0120550411f, 0.0219694930f,
-   0.0346207799f, 0.0492010182f, 0.0644272330f, 0.0787120655f,
-   0.0904082200f, 0.0980807163f, 0.1007534795f, 0.0980807163f,
-   0.0904082200f, 0.0787120655f, 0.0644272330f, 0.0492010182f,
-   0.0346207799f, 0.0219694930f, 0.0120550411f, 0.0051420766f,
-   0.0009925971f, -0.0010016907f, -0.0016305187f, -0.0016647590f,
-   -0.0016890122f
-};
-#endif /* PREQ_FILTER_GEN_COEFF == TRUE */
-
-
-#if PRE_FILTER_GEN_COEFF == TRUE
-
-float32_t pre_filter_coeff_f32[PRE_FILTER_NUM_TAPS] useCCM;
-
-#else
-/*
- * Pre-filter (BPF) coefficients.
- * Fs=28800, f1 = 925, f2 = 2475, number of taps = 311
- * Matlab/Octave parameters:
- * hc = fir1(310, [925, 2475]/(Fs/2), 'pass');
- */
-
-float32_t pre_filter_coeff_f32[PRE_FILTER_NUM_TAPS] = {
-  0.0002630141f, 0.0002628323f, 0.0002174784f, 0.0001439800f,
-  0.0000662689f, 0.0000087403f, -0.0000104737f, 0.0000152369f,
-  0.0000786174f, 0.0001598901f, 0.0002316217f, 0.0002660169f,
-  0.0002428125f, 0.0001556541f, 0.0000150847f, -0.0001529389f,
-  -0.0003129410f, -0.0004289345f, -0.0004742560f, -0.0004395107f,
-  -0.0003362076f, -0.0001946865f, -0.0000564585f, 0.0000372882f,
-  0.0000579911f, -0.0000007155f, -0.0001192216f, -0.0002555907f,
-  -0.0003562318f, -0.0003710739f, -0.0002691589f, -0.0000500718f,
-  0.0002525572f, 0.0005772283f, 0.0008494657f, 0.0010017974f,
-  0.0009933667f, 0.0008233662f, 0.0005338281f, 0.0002000953f,
-  -0.0000891793f, -0.0002573906f, -0.0002635755f, -0.0001170745f,
-  0.0001218157f, 0.0003565040f, 0.0004809200f, 0.0004114493f,
-  0.0001148717f, -0.0003763382f, -0.0009669091f, -0.0015204528f,
-  -0.0018949887f, -0.0019829034f, -0.0017439270f, -0.0012209388f,
-  -0.0005327554f, 0.0001555675f, 0.0006777111f, 0.0009141328f,
-  0.0008292156f, 0.0004858414f, 0.0000315873f, -0.0003412629f,
-  -0.0004518110f, -0.0001872172f, 0.0004567840f, 0.0013646274f,
-  0.0023242755f, 0.0030807181f, 0.0034059854f, 0.0031663042f,
-  0.0023666159f, 0.0011580344f, -0.0001962396f, -0.0013891652f,
-  -0.0021544494f, -0.0023437972f, -0.0019738661f, -0.0012274564f,
-  -0.0004059321f, 0.0001560330f, 0.0001905957f, -0.0004167487f,
-  -0.0015805414f, -0.0030247966f, -0.0043492747f, -0.0051368262f,
-  -0.0050731091f, -0.0040446519f, -0.0021854927f, 0.0001442042f,
-  0.0024453937f, 0.0042118692f, 0.0050709497f, 0.0048929927f,
-  0.0038363447f, 0.0023111613f, 0.0008681171f, 0.0000401684f,
-  0.0001807741f, 0.0013455353f, 0.0032543614f, 0.0053501112f,
-  0.0069426437f, 0.0074018164f, 0.0063466090f, 0.0037754712f,
-  0.0000966124f, -0.0039567264f, -0.0075087956f, -0.0097752826f,
-  -0.0102847504f, -0.0090233718f, -0.0064569060f, -0.0034162907f,
-  -0.0008715304f, 0.0003478556f, -0.0001914293f, -0.0023698932f,
-  -0.0055096823f, -0.0085320077f, -0.0102437760f, -0.0096804313f,
-  -0.0064109478f, -0.0007150685f, 0.0064272605f, 0.0135454918f,
-  0.0190429897f, 0.0216254883f, 0.0206778373f, 0.0164791731f,
-  0.0101834165f, 0.0035516810f, -0.0015090359f, -0.0034886155f,
-  -0.0017541991f, 0.0031705084f, 0.0096227405f, 0.0151387937f,
-  0.0170529057f, 0.0132228528f, 0.0027036543f, -0.0138107229f,
-  -0.0339131039f, -0.0538295639f, -0.0691388898f, -0.0757219326f,
-  -0.0707320414f, -0.0533595170f, -0.0251988255f, 0.0098893389f,
-  0.0464165977f, 0.0782860621f, 0.0999812724f, 0.1076699117f,
-  0.0999812724f, 0.0782860621f, 0.0464165977f, 0.0098893389f,
-  -0.0251988255f, -0.0533595170f, -0.0707320414f, -0.0757219326f,
-  -0.0691388898f, -0.0538295639f, -0.0339131039f, -0.0138107229f,
-  0.0027036543f, 0.0132228528f, 0.0170529057f, 0.0151387937f,
-  0.0096227405f, 0.0031705084f, -0.0017541991f, -0.0034886155f,
-  -0.0015090359f, 0.0035516810f, 0.0101834165f, 0.0164791731f,
-  0.0206778373f, 0.0216254883f, 0.0190429897f, 0.0135454918f,
-  0.0064272605f, -0.0007150685f, -0.0064109478f, -0.0096804313f,
-  -0.0102437760f, -0.0085320077f, -0.0055096823f, -0.0023698932f,
-  -0.0001914293f, 0.0003478556f, -0.0008715304f, -0.0034162907f,
-  -0.0064569060f, -0.0090233718f, -0.0102847504f, -0.0097752826f,
-  -0.0075087956f, -0.0039567264f, 0.0000966124f, 0.0037754712f,
-  0.0063466090f, 0.0074018164f, 0.0069426437f, 0.0053501112f,
-  0.0032543614f, 0.0013455353f, 0.0001807741f, 0.0000401684f,
-  0.0008681171f, 0.0023111613f, 0.0038363447f, 0.0048929927f,
-  0.0050709497f, 0.0042118692f, 0.0024453937f, 0.0001442042f,
-  -0.0021854927f, -0.0040446519f, -0.0050731091f, -0.0051368262f,
-  -0.0043492747f, -0.0030247966f, -0.0015805414f, -0.0004167487f,
-  0.0001905957f, 0.0001560330f, -0.0004059321f, -0.0012274564f,
-  -0.0019738661f, -0.0023437972f, -0.0021544494f, -0.0013891652f,
-  -0.0001962396f, 0.0011580344f, 0.0023666159f, 0.0031663042f,
-  0.0034059854f, 0.0030807181f, 0.0023242755f, 0.0013646274f,
-  0.0004567840f, -0.0001872172f, -0.0004518110f, -0.0003412629f,
-  0.0000315873f, 0.0004858414f, 0.0008292156f, 0.0009141328f,
-  0.0006777111f, 0.0001555675f, -0.0005327554f, -0.0012209388f,
-  -0.0017439270f, -0.0019829034f, -0.0018949887f, -0.0015204528f,
-  -0.0009669091f, -0.0003763382f, 0.0001148717f, 0.0004114493f,
-  0.0004809200f, 0.0003565040f, 0.0001218157f, -0.0001170745f,
-  -0.0002635755f, -0.0002573906f, -0.0000891793f, 0.0002000953f,
-  0.0005338281f, 0.0008233662f, 0.0009933667f, 0.0010017974f,
-  0.0008494657f, 0.0005772283f, 0.0002525572f, -0.0000500718f,
-  -0.0002691589f, -0.0003710739f, -0.0003562318f, -0.0002555907f,
-  -0.0001192216f, -0.0000007155f, 0.0000579911f, 0.0000372882f,
-  -0.0000564585f, -0.0001946865f, -0.0003362076f, -0.0004395107f,
-  -0.0004742560f, -0.0004289345f, -0.0003129410f, -0.0001529389f,
-  0.0000150847f, 0.0001556541f, 0.0002428125f, 0.0002660169f,
-  0.0002316217f, 0.0001598901f, 0.0000786174f, 0.0000152369f,
-  -0.0000104737f, 0.0000087403f, 0.0000662689f, 0.0001439800f,
-  0.0002174784f, 0.0002628323f, 0.0002630141f
-};
-#endif
-
 /*
  * Data structure for AFSK decoding.
+ * Used on each PWM sample so placed in CCM.
  */
 #if PKT_SVC_USE_RADIO1 || defined(__DOXYGEN__)
-AFSKDemodDriver AFSKD1;
+AFSKDemodDriver AFSKD1 useCCMClear;
 #endif
 
 #if PKT_SVC_USE_RADIO2 || defined(__DOXYGEN__)
-AFSKDemodDriver AFSKD2;
+AFSKDemodDriver AFSKD2 useCCMClear;
 #endif
 
-/*===========================================================================*/
-/* Decoder local variables and types.                                        */
-/*===========================================================================*/
-
-/*===========================================================================*/
-/* Decoder local functions.                                                  */
-/*===========================================================================*/
-
-/**
- * @brief   Check the symbol timing.
- *
- * @param[in]   myDriver   pointer to a @p AFSKDemodDriver structure
- *
- * @return  status  indicating if symbol decoding should take place.
- * @retval  true    decoding should run before getting next PWM entry.
- * @retval  false   continue immediately with next PWM data entry.
- *
- * @api
- */
-static bool pktCheckAFSKSymbolTime(AFSKDemodDriver *myDriver) {
-  /*
-   * Each decoder filter is setup at init with a sample source.
-   * This is set in the filter control structure.
-   */
-
-  switch(AFSK_DECODE_TYPE) {
-    case AFSK_DSP_QCORR_DECODE: {
-
-      /*
-       * Check if symbol decode should be run now.
-       */
-      return (get_qcorr_symbol_timing(myDriver));
-    }
-
-    case AFSK_DSP_FCORR_DECODE: {
-      break;
-    }
-
-    default: {
-      break;
-    }
-  } /* end switch. */
-  return false;
-}
-
-/**
- * @brief   Update the symbol timing PLL.
- *
- * @param[in]   myDriver   pointer to a @p AFSKDemodDriver structure
- *
- * @api
- */
-static void pktUpdateAFSKSymbolPLL(AFSKDemodDriver *myDriver) {
-  /*
-   * Increment PLL timing.
-   */
-
-  switch(AFSK_DECODE_TYPE) {
-    case AFSK_DSP_QCORR_DECODE: {
-
-      /*
-       *
-       */
-
-      update_qcorr_pll(myDriver);
-      break;
-    }
-
-    case AFSK_DSP_FCORR_DECODE: {
-
-    }
-
-    default: {
-      break;
-    }
-  } /* end switch. */
-  return;
-}
-
-/**
- * @brief   Add a sample to the decoder filter input.
- * @notes   The decimated entries are filtered through a BPF.
- *
- * @param[in]   myDriver   pointer to an @p AFSKDemodDriver structure.
- * @param[in]   binary     binary data from the PWM.
- *
- * @api
- */
-static void pktAddAFSKFilterSample(AFSKDemodDriver *myDriver, bit_t binary) {
-  switch(AFSK_DECODE_TYPE) {
-    case AFSK_DSP_QCORR_DECODE: {
-      (void)push_qcorr_sample(myDriver, binary);
-      break;
-    }
-
-    case AFSK_DSP_FCORR_DECODE: {
-      //(void)push_fcorr_sample(myDriver, binary);
-      break;
-    }
-
-    default: {
-      break;
-    }
-  } /* End switch. */
-}
-
-/**
- * @brief   Process the input sample through the IQ correlation.
- * @notes   There are 4 filters that are run (I & Q for Mark and Space)
- *
- * @param[in]   myDriver   pointer to an @p AFSKDemodDriver structure.
- *
- * @return  filter  status
- * @retval  true    the filter output is valid.
- * @retval  false   the filter output in not yet valid.
- *
- * @api
- */
-static bool pktProcessAFSKFilteredSample(AFSKDemodDriver *myDriver) {
-  /*
-   * Each decoder filter is setup at init with a sample source.
-   * This is set in the filter control structure.
-   */
-
-  switch(AFSK_DECODE_TYPE) {
-    case AFSK_DSP_QCORR_DECODE: {
-
-      /*
-       * Next perform the fixed point correlator update.
-       * Result is updated MARK and SPACE bins.
-       *
-       */
-      return process_qcorr_output(myDriver);
-    }
-
-    case AFSK_DSP_FCORR_DECODE: {
-
-    }
-
-    default: {
-      break;
-    }
-  } /* end switch. */
-  return false;
-}
-
-/**
- * @brief   Decode AFSK symbol into an HDLC bit.
- * @notes   Called at symbol ready time as determined by decoders.
- *
- * @param[in]   myDriver   pointer to an @p AFSKDemodDriver structure.
- *
- * @return  status of operation
- * @retval  true - success
- * @retval  false - an error occurred in processing (buffer full)
- *
- * @api
- */
-static bool pktDecodeAFSKSymbol(AFSKDemodDriver *myDriver) {
-  /*
-   * Called when a symbol timeline is ready.
-   * Called from normal thread level.
-   */
-
-  switch(AFSK_DECODE_TYPE) {
-
-    case AFSK_DSP_QCORR_DECODE: {
-      /* Tone analysis is done per sample in QCORR. */
-      qcorr_decoder_t *decoder = myDriver->tone_decoder;
-      myDriver->tone_freq = decoder->current_demod;
-      break;
-    } /* End case AFSK_DSP_QCORR_DECODE. */
-
-    case AFSK_DSP_FCORR_DECODE: {
-      /* Tone analysis is done per sample in FCORR. */
-      break;
-    } /* End case AFSK_DSP_FCORR_DECODE. */
-
-    case AFSK_NULL_DECODE: {
-      /*
-       * Do nothing (used when in debug capture mode).
-       */
-      return true;
-    } /* End case AFSK_NULL_DECODE. */
-  } /* End switch. */
-
-  /* After tone detection generate an HDLC bit. */
-  return pktExtractHDLCfromAFSK(myDriver);
-} /* End function. */
-
-/**
- * @brief   Processes PWM into a decimated time line for AFSK decoding.
- * @notes   The decimated entries are filtered through a BPF.
- *
- * @param[in]   myDriver   pointer to a @p AFSKDemodDriver structure
- *
- * @return  status of operations.
- * @retval  true    no error occurred so decimation can continue at next data.
- * @retval  false   an error occurred and decimation should be aborted.
- *
- * @api
- */
-static bool pktProcessAFSK(AFSKDemodDriver *myDriver, min_pwmcnt_t current_tone[]) {
-  /* Start working on new input data now. */
-  uint8_t i = 0;
-  for(i = 0; i < (sizeof(min_pwm_counts_t) / sizeof(min_pwmcnt_t)); i++) {
-    myDriver->decimation_accumulator += current_tone[i];
-    while(myDriver->decimation_accumulator >= 0) {
-
-      /*
-       *  The decoder will process a converted binary sample.
-       *  The PWM binary is converted to a q31 +/- sample value.
-       *  The sample is passed to pre-filtering (i.e. BPF) as its next input.
-       */
-      (void)pktAddAFSKFilterSample(myDriver, !(i & 1));
-
-      /*
-       * Process the sample at the output side of the pre-filter.
-       * The filter returns true if its output is now valid.
-       */
-      if(pktProcessAFSKFilteredSample(myDriver)) {
-        /* Filters are ready so decoding can commence. */
-        if(pktCheckAFSKSymbolTime(myDriver)) {
-          /* A symbol is ready to decode. */
-          if(!pktDecodeAFSKSymbol(myDriver))
-            /* Unable to store character - buffer full. */
-            return false;
-        }
-        pktUpdateAFSKSymbolPLL(myDriver);
-      }
-      myDriver->decimation_accumulator -= myDriver->decimation_size;
-    } /* End while. Accumulator has underflowed. */
-  } /* End for. */
-  return true;
-}
-
-/**
- * @brief   Reset the AFSK decoder and filter.
- * @notes   Called at completion of packet reception.
- * @post    Selected tone decoder and common AFSK data is initialized.
- *
- * @param[in]   myDriver   pointer to an @p AFSKDemodDriver structure.
- *
- * @api
- */
-static void pktResetAFSKDecoder(AFSKDemodDriver *myDriver) {
-  /*
-   * Called when a decode stream has completed.
-   * Called from normal thread level.
-   */
-
-  /* Reset the decoder data.*/
-  myDriver->frame_state = FRAME_SEARCH;
-  myDriver->prior_freq = TONE_NONE;
-  myDriver->bit_index = 0;
-  myDriver->decimation_accumulator = 0;
-
-  /* Set the hdlc bits to all ones. */
-  myDriver->hdlc_bits = (int32_t)-1;
-
-  switch(AFSK_DECODE_TYPE) {
-
-    case AFSK_DSP_QCORR_DECODE: {
-      /* Reset QCORR. */
-      (void)reset_qcorr_all(myDriver);
-      break;
-    }
-
-    case AFSK_DSP_FCORR_DECODE: {
-      /* TODO: Reset FCORR. */
-      break;
-    }
-
-    case AFSK_NULL_DECODE: {
-      /*
-       * Do nothing (used when in debug capture mode).
-       */
-      break;
-    } /* End case AFSK_NULL_DECODE. */
-  } /* End switch. */
-}
-
 /**
  * @brief   Creates an AFSK channel which decodes PWM data from the radio.
  * @note    The si radio has no AFSK decoding capability.
@@ -474,6 +77,10 @@ AFSKDemodDriver *pktCreateAFSKDecoder(packet_svc_t *pktHandler) {
   /* Set the link from demod driver to the packet driver. */
   myDriver->packet_handler = pktHandler;
 
+#if USE_AFSK_DECODER_STATS == TRUE
+  pktClearAFSKStats(&myDriver->stats);
+#endif
+
   /* The radio associated with this AFSK driver. */
   radio_unit_t rid = myDriver->packet_handler->radio;
 
@@ -495,34 +102,22 @@ AFSKDemodDriver *pktCreateAFSKDecoder(packet_svc_t *pktHandler) {
 #if USE_HEAP_PWM_BUFFER == TRUE
   /*
    * Create a memory pool of PWM queue objects in heap.
-   * 1. Allocate heap memory
-   * 2. Initialise pool manager
-   * 3. Load heap with pool objects
-   */
-
-  /*
-   * Get heap to accommodate buffer objects.
-   * The size of the allocation is:
-   *  Number of slots for individual PWM entries in each buffer
-   *  Multiplied by the number of chainable buffers to be allocated
+   * The pool starts with the minimum number of objects.
+   * It is then sized at run time from measured peak usage.
+   * Each object holds a ring and a buffer of PWM_DATA_SLOTS entries.
    */
 #if USE_CCM_BASED_HEAP == TRUE
   extern memory_heap_t *ccm_heap;
-  myDriver->pwm_queue_heap = chHeapAlloc(ccm_heap,
-        sizeof(radio_pwm_object_t) * PWM_DATA_BUFFERS);
+  bool pool = pktInitPWMPool(&myDriver->pwm_pool, ccm_heap);
 #else
-  myDriver->pwm_queue_heap = chHeapAlloc(NULL,
-        sizeof(radio_pwm_object_t) * PWM_DATA_BUFFERS);
+  bool pool = pktInitPWMPool(&myDriver->pwm_pool, NULL);
 #endif
-  chDbgAssert(myDriver->pwm_queue_heap != NULL, "failed to create PWM heap");
-  /* Initialize the memory pool to manage buffer objects. */
-  chPoolObjectInitAligned(&myDriver->pwm_buffer_pool,
-                          sizeof(radio_pwm_object_t),
-                          sizeof(msg_t), NULL);
-  /* Load the memory pool with buffer objects. */
-  chPoolLoadArray(&myDriver->pwm_buffer_pool,
-                  myDriver->pwm_queue_heap,
-                  PWM_DATA_BUFFERS);
+  chDbgAssert(pool, "failed to create PWM pool");
+  if(!pool) {
+    chFactoryReleaseObjectsFIFO(myDriver->the_pwm_fifo);
+    myDriver->the_pwm_fifo = NULL;
+    return NULL;
+  }
 #endif
 
   /* Get the objects FIFO . */
@@ -543,9 +138,11 @@ AFSKDemodDriver *pktCreateAFSKDecoder(packet_svc_t *pktHandler) {
   chsnprintf(myDriver->decoder_name, sizeof(myDriver->decoder_name),
              "%s%02i", PKT_AFSK_THREAD_NAME_PREFIX, rid);
 
-  /* Create the AFSK decoder thread. */
-  extern memory_heap_t *ccm_heap;
-  myDriver->decoder_thd = chThdCreateFromHeap(NULL,
+  /*
+   * Create the AFSK decoder thread.
+   * The stack is in SRAM as RSSI is read over SPI (DMA) from the stack.
+   */
+  myDriver->decoder_thd = mem_thread_create(MEM_REGION_THREADS,
               THD_WORKING_AREA_SIZE(PKT_AFSK_DECODER_WA_SIZE),
               myDriver->decoder_name,
               NORMALPRIO - 10,
@@ -560,29 +157,6 @@ AFSKDemodDriver *pktCreateAFSKDecoder(packet_svc_t *pktHandler) {
     return NULL;
   }
 
-  /* Set DSP parameters. */
-  myDriver->decimation_size = ((pwm_accum_t)ICU_COUNT_FREQUENCY
-                                / (pwm_accum_t)AFSK_BAUD_RATE)
-                                / (pwm_accum_t)SYMBOL_DECIMATION;
-
-  /* Generate the BPF and LPF filter coordinates. */
-#if PRE_FILTER_GEN_COEFF == TRUE
-
-  gen_fir_bpf((float32_t)PRE_FILTER_LOW / (float32_t)FILTER_SAMPLE_RATE,
-              (float32_t)PRE_FILTER_HIGH / (float32_t)FILTER_SAMPLE_RATE,
-              pre_filter_coeff_f32,
-              PRE_FILTER_NUM_TAPS,
-              TD_WINDOW_NONE);
-#endif
-
-#if MAG_FILTER_GEN_COEFF == TRUE
-
-  gen_fir_lpf((float32_t)MAG_FILTER_HIGH / (float32_t)FILTER_SAMPLE_RATE,
-              mag_filter_coeff_f32,
-              MAG_FILTER_NUM_TAPS,
-              TD_WINDOW_NONE);
-#endif
-
   return myDriver;
 }
 
@@ -618,10 +192,9 @@ void pktReleaseAFSKDecoder(AFSKDemodDriver *myDriver) {
 #if USE_HEAP_PWM_BUFFER == TRUE
   /*
    *  No memory pool objects should be in use.
-   *  So just release the PWM pool heap.
+   *  So just release the PWM pool objects to heap.
    */
-  chHeapFree(myDriver->pwm_queue_heap);
-  myDriver->pwm_queue_heap = NULL;
+  pktDeinitPWMPool(&myDriver->pwm_pool);
 #endif
 }
 
@@ -643,8 +216,8 @@ uint8_t pktReleasePWMbuffers(AFSKDemodDriver *myDriver) {
     return 0;
   radio_pwm_object_t *next;
   do {
-    next = qGetLink(&object->queue);
-    chPoolFree(&myDriver->pwm_buffer_pool, object);
+    next = object->queue.link;
+    pktFreePWMObject(&myDriver->pwm_pool, object);
     myDriver->active_demod_object->rlsd++;
   } while((object = next) != NULL);
   myFIFO->decode_pwm_queue = NULL;
@@ -677,20 +250,41 @@ THD_FUNCTION(pktAFSKDecoder, arg) {
 #define DECODER_LED_POLL_CYCLE      (30000/DECODER_POLL_TIME)    /* 30S. */
 
   /* Set thread priority to different level when decoding./ */
+#if PKT_RX_USE_DECODER_BOOST == TRUE
+#define DECODER_RUN_PRIORITY        NORMALPRIO-5
+#define DECODER_BOOST_PRIORITY      NORMALPRIO+10
+#else
 #define DECODER_RUN_PRIORITY        NORMALPRIO+10
-
-#if AFSK_DECODE_TYPE == AFSK_DSP_QCORR_DECODE
-  init_qcorr_decoder(myDriver);
 #endif
 
+  /* Setup the filters and tone decoder. */
+  pktInitAFSKDSP(myDriver);
+
   /* Save the priority that calling thread gave us. */
   tprio_t decoder_idle_priority = chThdGetPriorityX();
 
+  /* Clock raised while a packet is decoded. */
+  bool clock_run = false;
+
+#if PKT_RX_USE_DECODER_BOOST == TRUE
+  /* Priority raised while the PWM backlog is high. */
+  bool boosted = false;
+#endif
+
   /* Setup LED for decoder blinker. */
   pktSetGPIOlineMode(LINE_DECODER_LED, PAL_MODE_OUTPUT_PUSHPULL);
 
   pktWriteGPIOline(LINE_DECODER_LED, PAL_HIGH);
 
+  /*
+   * Heartbeat in the wait, poll and reset states.
+   * A session in the active state ends with the packet.
+   */
+  wdg_beat_t beat;
+  wdg_register(&beat, chRegGetThreadNameX(chThdGetSelfX()), TIME_S2I(1));
+  /* The polls are only to beat, PWM open wakes the decoder after Stop. */
+  allowLateWakeup();
+
    /* Acknowledge open then wait for start or close of decoder. */
   pktAddEventFlags(myDriver, DEC_OPEN_EXEC);
   myDriver->decoder_state = DECODER_WAIT;
@@ -698,6 +292,7 @@ THD_FUNCTION(pktAFSKDecoder, arg) {
     switch(myDriver->decoder_state) {
 
       case DECODER_WAIT: {
+        wdg_beat(&beat);
         /*
          *  Wait for start or close event.
          */
@@ -715,6 +310,8 @@ THD_FUNCTION(pktAFSKDecoder, arg) {
           pktReleaseAFSKDecoder(myDriver);
           myDriver->decoder_state = DECODER_TERMINATED;
           pktWriteGPIOline(LINE_DECODER_LED, PAL_LOW);
+          wdg_unregister(&beat);
+          cancelLateWakeup();
           chThdExit(MSG_OK);
           /* Something went wrong if we arrive here. */
           chSysHalt("ThdExit");
@@ -745,6 +342,7 @@ THD_FUNCTION(pktAFSKDecoder, arg) {
       }  /* End case DECODER_IDLE. */
 
       case DECODER_POLL: {
+        wdg_beat(&beat);
         radio_pwm_fifo_t *myRadioFIFO;
         msg_t fifo_msg = chFifoReceiveObjectTimeout(myDriver->pwm_fifo_pool,
                              (void *)&myRadioFIFO,
@@ -803,9 +401,25 @@ THD_FUNCTION(pktAFSKDecoder, arg) {
           break;
         }
 
+        /* Start signal quality for the session. */
+        memset(&myDriver->quality, 0, sizeof(afsk_quality_t));
+#if USE_PWM_REPLAY == TRUE
+        if(myDriver->icustate != PKT_PWM_REPLAY)
+#endif
+        {
+          /*
+           * The radio cannot be read from the CCA ISR.
+           * CCA is still open when the stream is picked up so read it here.
+           */
+          pktLLDradioCaptureRSSI(myHandler->radio);
+          myPktBuffer->quality.rssi = myHandler->rx_strength;
+        }
 
         /* Increase thread priority. */
         (void)chThdSetPriority(DECODER_RUN_PRIORITY);
+        pclkAcquire();
+        clock_run = true;
+        eprof_enter(EPROF_RX);
         /* Turn on the decoder LED. */
         pktWriteGPIOline(LINE_DECODER_LED, PAL_HIGH);
         /* Enable processing of incoming PWM stream. */
@@ -821,22 +435,47 @@ THD_FUNCTION(pktAFSKDecoder, arg) {
         radio_pwm_fifo_t *myFIFO = myDriver->active_demod_object;
 
 #if USE_HEAP_PWM_BUFFER == TRUE
-        /* Get current PWM queue object address. */
-        input_queue_t *myQueue = &myFIFO->decode_pwm_queue->queue;
+        /* Get current PWM ring object address. */
+        radio_pwm_ring_t *myQueue = &myFIFO->decode_pwm_queue->queue;
 #else
-        /* Use the common PWM -> decoder queue. */
-        input_queue_t *myQueue = &myFIFO->radio_pwm_queue;
+        /* Use the common PWM -> decoder ring. */
+        radio_pwm_ring_t *myQueue = &myFIFO->radio_pwm_queue;
 #endif
         chDbgAssert(myQueue != NULL, "no queue assigned");
 
+#if USE_AFSK_DECODER_STATS == TRUE || PKT_RX_USE_DECODER_BOOST == TRUE
+        /* Track PWM entries waiting to be decoded. */
+        uint32_t depth = pktGetPWMRingFullX(myQueue);
+#if USE_HEAP_PWM_BUFFER == TRUE
+        /* Add linked buffers not yet reached by the decoder. */
+        depth += (uint32_t)(myFIFO->in_use - myFIFO->rlsd - 1)
+                  * PWM_DATA_SLOTS;
+#endif
+#endif
+#if USE_AFSK_DECODER_STATS == TRUE
+        pktAddAFSKQueueDepth(&myDriver->stats, depth);
+#endif
+#if PKT_RX_USE_DECODER_BOOST == TRUE
+        /* Catch up on a backlog ahead of the other threads. */
+        if(!boosted && depth >= PKT_RX_BOOST_DEPTH) {
+          (void)chThdSetPriority(DECODER_BOOST_PRIORITY);
+          boosted = true;
+#if USE_AFSK_DECODER_STATS == TRUE
+          myDriver->stats.priority_boosts++;
+#endif
+        } else if(boosted && depth <= PKT_RX_BOOST_RELEASE) {
+          (void)chThdSetPriority(DECODER_RUN_PRIORITY);
+          boosted = false;
+        }
+#endif
+
         byte_packed_pwm_t data;
-        size_t n = iqReadTimeout(myQueue, data.bytes,
-                                 sizeof(packed_pwm_counts_t),
+        msg_t msg = pktReadPWMQueueTimeout(myQueue, &data,
                                  chTimeUS2I(833 * 8 * 20)
                                  /*TIME_MS2I(DECODER_ACTIVE_TIMEOUT)*/);
         /* Timeout calculated as SYMBOL time x 8 x 20. */
 
-        if(n != sizeof(packed_pwm_counts_t)) {
+        if(msg != MSG_OK) {
           /* PWM stream wait timeout. */
           pktAddEventFlags(myHandler, EVT_PWM_STREAM_TIMEOUT);
           myDriver->active_demod_object->status |= STA_PWM_STREAM_TIMEOUT;
@@ -851,6 +490,9 @@ THD_FUNCTION(pktAFSKDecoder, arg) {
         int out = chsnprintf(buf, sizeof(buf), "%i, %i\r\n",
                   stream.pwm.impulse, stream.pwm.valley);
         pktWrite( (uint8_t *)buf, out);
+#elif AFSK_DEBUG_TYPE == AFSK_PWM_REPLAY_CAPTURE_DEBUG
+        /* Packed entries including in-band are the replay format. */
+        pktWrite(data.bytes, sizeof(data));
 #endif
 
         /* Look for "in band" message in radio data. */
@@ -916,6 +558,11 @@ THD_FUNCTION(pktAFSKDecoder, arg) {
              */
           case PWM_TERM_QUEUE_ERR:
 
+            /* If the PWM capture DMA reported an error.
+             * The PWM side has already posted a PWM_QUEUE_OVERRUN event.
+             */
+          case PWM_TERM_DMA_ERROR:
+
             /* If there is no more PWM buffer space available.
              * The PWM side has already posted a PWM_QUEUE_FULL event.
              */
@@ -929,15 +576,17 @@ THD_FUNCTION(pktAFSKDecoder, arg) {
           case PWM_INFO_QUEUE_SWAP: {
             /* Radio made a queue swap (filled the buffer). */
             /* Get reference to next queue/buffer object. */
-            radio_pwm_object_t *nextObject = qGetLink(&myFIFO->decode_pwm_queue->queue);
+            radio_pwm_object_t *nextObject = myFIFO->decode_pwm_queue->queue.link;
             if(nextObject != NULL) {
               /*
                *  Release the now empty prior buffer object back to the pool.
                *  Switch to the next queue/buffer object for decoding.
                */
-              chPoolFree(&myDriver->pwm_buffer_pool, myFIFO->decode_pwm_queue);
+              pktFreePWMObject(&myDriver->pwm_pool, myFIFO->decode_pwm_queue);
               myFIFO->rlsd++;
               myFIFO->decode_pwm_queue = nextObject;
+              /* Top up the pool if the radio is running ahead. */
+              pktAdjustPWMPool(&myDriver->pwm_pool, false);
               //myQueue = &nextObject->queue;
             } else {
               /*
@@ -969,8 +618,16 @@ THD_FUNCTION(pktAFSKDecoder, arg) {
 
         /*
          * If not in-band process the AFSK into an HDLC bit and AX25 data.
+         * 2FSK is bit data from the radio so only needs descrambling.
          */
-        if(!pktProcessAFSK(myDriver, stream.array)) {
+#if PKT_RX_USE_2FSK == TRUE
+        bool processed = (myHandler->radio_rx_config.type == MOD_2FSK) ?
+            pktProcess2FSK(myDriver, stream.array) :
+            pktProcessAFSK(myDriver, stream.array);
+#else
+        bool processed = pktProcessAFSK(myDriver, stream.array);
+#endif
+        if(!processed) {
           /* AX25 character decoded but buffer is full.
            * Event sent by HDLC processor (common code for AFSK & 2FSK).
            * Set error state and don't dispatch the AX25 buffer.
@@ -980,6 +637,22 @@ THD_FUNCTION(pktAFSKDecoder, arg) {
           break; /* From this case. */
         }
 
+#if PKT_RX_USE_SOFT_DCD == TRUE
+        if(pktIsAFSKCarrierLost(myDriver)) {
+          /*
+           * No flags or locked tones and no frame open.
+           * The PWM side closes the stream and qualifies CCA again.
+           */
+          myDriver->active_demod_object->status |= STA_AFSK_DCD_DROP;
+#if USE_AFSK_DECODER_STATS == TRUE
+          myDriver->stats.dcd_drops++;
+#endif
+          pktAddEventFlags(myHandler, EVT_AFSK_DCD_DROP);
+          myDriver->decoder_state = DECODER_RESET;
+          continue;
+        }
+#endif
+
         /* Check for change of frame state. */
         switch(myDriver->frame_state) {
         case FRAME_SEARCH:
@@ -1079,7 +752,7 @@ THD_FUNCTION(pktAFSKDecoder, arg) {
 #if TRACE_PWM_BUFFER_STATS == TRUE
           TRACE_DEBUG("AFSK > PWM buffer use:"
               " allocated %d, consumed %d, released %d, peak lag %d",
-              PWM_DATA_BUFFERS, u, n, myFIFO->peak);
+              myDriver->pwm_pool.stats.size, u, n, myFIFO->peak);
 #else
           (void)u;
           (void)n;
@@ -1090,6 +763,11 @@ THD_FUNCTION(pktAFSKDecoder, arg) {
 
           /* Forget the demod side reference to the object. */
           myDriver->active_demod_object = NULL;
+
+#if USE_HEAP_PWM_BUFFER == TRUE
+          /* Resize the PWM buffer pool from recent session usage. */
+          pktAdjustPWMPool(&myDriver->pwm_pool, true);
+#endif
         }
 
         /* Reset the correlation decoder and its filters. */
@@ -1100,9 +778,18 @@ THD_FUNCTION(pktAFSKDecoder, arg) {
         led_count = 0;
 
         (void)chThdSetPriority(decoder_idle_priority);
+#if PKT_RX_USE_DECODER_BOOST == TRUE
+        boosted = false;
+#endif
+        if(clock_run) {
+          pclkRelease();
+          clock_run = false;
+          eprof_leave(EPROF_RX);
+        }
 
         /* Set decoder back to idle. */
         myDriver->decoder_state = DECODER_IDLE;
+        wdg_beat(&beat);
         break;
       } /* End case DECODER_RESET. */
 
@@ -1118,7 +805,7 @@ THD_FUNCTION(pktAFSKDecoder, arg) {
 #if TRACE_PWM_BUFFER_STATS == TRUE
           TRACE_DEBUG("AFSK > PWM buffer use:"
             " allocated %d, consumed %d, released %d, peak lag %d",
-            PWM_DATA_BUFFERS, u, n, myFIFO->peak);
+            myDriver->pwm_pool.stats.size, u, n, myFIFO->peak);
 #else
           (void)u;
           (void)n;
@@ -1134,6 +821,12 @@ THD_FUNCTION(pktAFSKDecoder, arg) {
           myHandler->active_packet_object->status =
               myDriver->active_demod_object->status;
 
+#if USE_AFSK_DECODER_STATS == TRUE
+          pktAddAFSKDispatchLatency(&myDriver->stats);
+#endif
+          /* Copy session signal quality into packet buffer object. */
+          pktSetAFSKFrameQuality(myDriver, myHandler->active_packet_object);
+
           /* Set AX25 status and dispatch the packet buffer object. */
           pktDispatchReceivedBuffer(myHandler->active_packet_object);
 
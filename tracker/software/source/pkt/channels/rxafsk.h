@@ -32,16 +32,33 @@
 #define AFSK_SPACE_INDEX            1U
 #define AFSK_SPACE_FREQUENCY        2200U
 
-/* Thread working area size. */
+/* A half cycle of the lowest tone must fit in a packed PWM count. */
+#if (ICU_COUNT_FREQUENCY / (2U * AFSK_MARK_FREQUENCY)) > PWM_MAX_COUNT
+#error "ICU count frequency too high for packed PWM format"
+#endif
+
+/* Thread working area size. FX.25 and IL2P block decoding need more stack. */
+#if PKT_RX_USE_FX25 == TRUE || PKT_RX_USE_IL2P == TRUE
+#define PKT_AFSK_DECODER_WA_SIZE    1536
+#else
 #define PKT_AFSK_DECODER_WA_SIZE    1024
+#endif
 
 /* AFSK decoder type selection. */
 #define AFSK_NULL_DECODE            0
 #define AFSK_DSP_QCORR_DECODE       1
-#define AFSK_DSP_FCORR_DECODE       2 /* Currently unimplemented. */
+#define AFSK_DSP_FCORR_DECODE       2
+#define AFSK_DSP_SDFT_DECODE        3
 
 #define AFSK_DECODE_TYPE            AFSK_DSP_QCORR_DECODE
 
+/* Each radio has its own decoder state so radios can receive concurrently. */
+#if PKT_SVC_USE_RADIO2 == TRUE
+#define AFSK_NUM_DECODERS           2U
+#else
+#define AFSK_NUM_DECODERS           1U
+#endif
+
 /* Debug output type selection. */
 #define AFSK_NO_DEBUG               0
 #define AFSK_QCORR_FIR_DEBUG        1
@@ -53,6 +70,8 @@
 #define AFSK_PWM_DATA_CAPTURE_DEBUG 7
 #define AFSK_AX25_RAW_PACKET_DUMP   8
 #define AFSK_PACKET_RESET_STATUS    9
+/* Raw PWM stream output for replay (see pwmreplay.h). */
+#define AFSK_PWM_REPLAY_CAPTURE_DEBUG 10
 
 #define AFSK_DEBUG_TYPE             AFSK_NO_DEBUG
 
@@ -69,18 +88,38 @@
 #define MAG_FILTER_GEN_COEFF        TRUE
 #define MAG_FILTER_HIGH             1400
 
+/*
+ * Number of decimated samples collected before the filter chain is run.
+ * The BPF, IQ correlators and magnitude LPF each process a full block.
+ * Set to 1 to run the filter chain on every sample.
+ */
+#define AFSK_FILTER_BLOCK_SIZE      8U
+#if AFSK_FILTER_BLOCK_SIZE < 1 || AFSK_FILTER_BLOCK_SIZE > 32
+#error "Filter block size must be in the range 1 to 32"
+#endif
+
+/* Can be overridden for the host benchmark suite (make bench-suite). */
+#if !defined(PRE_FILTER_NUM_TAPS)
 #define PRE_FILTER_NUM_TAPS         55U
-#define PRE_FILTER_BLOCK_SIZE       1U
-#if PRE_FILTER_BLOCK_SIZE != 1
-#error "Filter block size must be 1"
 #endif
+#define PRE_FILTER_BLOCK_SIZE       AFSK_FILTER_BLOCK_SIZE
 
 #define USE_QCORR_MAG_LPF           TRUE
 
 #define MAG_FILTER_NUM_TAPS         15U
-#define MAG_FILTER_BLOCK_SIZE       1U
-#if MAG_FILTER_BLOCK_SIZE != 1
-#error "Filter block size must be 1"
+#define MAG_FILTER_BLOCK_SIZE       AFSK_DECODE_BLOCK_SIZE
+
+/*
+ * Number of tone slicers run on the shared decoder output.
+ * The first slicer compares mark and space with unity gain.
+ * Each additional slicer applies a gain to space before comparison.
+ * An additional slicer frame is used only if it passes CRC.
+ * Set to 1 to run a single slicer.
+ */
+#define AFSK_NUM_SLICERS            3U
+#define AFSK_SLICER_SPACE_GAINS     {2.0f, 0.5f}
+#if AFSK_NUM_SLICERS < 1
+#error "At least one slicer is required"
 #endif
 
 
@@ -94,21 +133,52 @@
 #define SYMBOL_DECIMATION           (12U)
 /* Sample rate in Hz. */
 #define FILTER_SAMPLE_RATE          (SYMBOL_DECIMATION * AFSK_BAUD_RATE)
-#define DECODE_FILTER_LENGTH        (2U * SYMBOL_DECIMATION)
-#elif
+/*
+ * The pre-filter is a polyphase decimator.
+ * The IQ correlators and magnitude filter run at the reduced rate.
+ */
+#define AFSK_DECODE_DECIMATION      (2U)
+#define DECODE_FILTER_LENGTH        (2U * DECODE_SYMBOL_SAMPLES)
+#elif AFSK_DECODE_TYPE == AFSK_DSP_FCORR_DECODE
 /* BPF followed by floating point IQ correlation decoder. */
-#define SYMBOL_DECIMATION           (24U)
+#define SYMBOL_DECIMATION           (12U)
 /* Sample rate in Hz. */
 #define FILTER_SAMPLE_RATE          (SYMBOL_DECIMATION * AFSK_BAUD_RATE)
+#define AFSK_DECODE_DECIMATION      (1U)
 #define DECODE_FILTER_LENGTH        (2U * SYMBOL_DECIMATION)
+#elif AFSK_DECODE_TYPE == AFSK_DSP_SDFT_DECODE
+/* Sliding DFT tone detector with a one symbol window. */
+#define SYMBOL_DECIMATION           (12U)
+/* Sample rate in Hz. */
+#define FILTER_SAMPLE_RATE          (SYMBOL_DECIMATION * AFSK_BAUD_RATE)
+#define AFSK_DECODE_DECIMATION      (1U)
+#define DECODE_FILTER_LENGTH        (SYMBOL_DECIMATION)
 #else
 /* Any other decoder. */
 #define SYMBOL_DECIMATION           (24U)
 /* Sample rate in Hz. */
 #define FILTER_SAMPLE_RATE          (SYMBOL_DECIMATION * AFSK_BAUD_RATE)
+#define AFSK_DECODE_DECIMATION      (1U)
 #define DECODE_FILTER_LENGTH        (2U * SYMBOL_DECIMATION)
 #endif
 
+/* Samples per symbol, sample rate and block size after the pre-filter. */
+#define DECODE_SYMBOL_SAMPLES       (SYMBOL_DECIMATION / AFSK_DECODE_DECIMATION)
+#define DECODE_SAMPLE_RATE          (DECODE_SYMBOL_SAMPLES * AFSK_BAUD_RATE)
+#define AFSK_DECODE_BLOCK_SIZE      (AFSK_FILTER_BLOCK_SIZE                   \
+                                     / AFSK_DECODE_DECIMATION)
+
+#if (SYMBOL_DECIMATION % AFSK_DECODE_DECIMATION) != 0                        \
+  || (AFSK_FILTER_BLOCK_SIZE % AFSK_DECODE_DECIMATION) != 0
+#error "Decode decimation must divide symbol decimation and filter block size"
+#endif
+
+
+/*
+ * Tone transitions within this PLL offset of the symbol centre are locked.
+ * The PLL counter spans one symbol so the window is +/- 1/8 symbol.
+ */
+#define AFSK_PLL_LOCK_WINDOW        (INT32_MAX / 4)
 
 #define PKT_PWM_QUEUE_PREFIX        "pwmx_"
 #define PKT_PWM_MBOX_PREFIX         "pwmd_"
@@ -153,6 +223,76 @@ typedef int16_t     dsp_phase_t;
 
 #include "rxpwm.h"
 #include "pktservice.h"
+
+/**
+ * @brief   Signal quality accumulated over a decode session.
+ */
+typedef struct AFSK_quality {
+  /* Dominant tone magnitude total and sample count. */
+  uint64_t                  level_total;
+  uint32_t                  level_count;
+  /* Tone transitions seen and those inside the PLL lock window. */
+  uint32_t                  pll_edges;
+  uint32_t                  pll_locked;
+} afsk_quality_t;
+
+#if PKT_RX_USE_SOFT_DCD == TRUE
+/**
+ * @brief   Software carrier detect over a window of symbols.
+ */
+typedef struct AFSK_dcd {
+  /* Symbols, HDLC flags and tone transitions in the current window. */
+  uint16_t                  symbols;
+  uint16_t                  flags;
+  uint16_t                  edges;
+  /* Transitions at the symbol clock and at the phase of the last one. */
+  uint16_t                  locked;
+  uint16_t                  regular;
+  int32_t                   last_pll;
+  /* Windows in a row without carrier. */
+  uint8_t                   idle;
+} afsk_dcd_t;
+#endif
+
+#if PKT_RX_USE_PERIOD_DISC == TRUE
+/**
+ * @brief   PWM period discriminator state of a decode session.
+ */
+typedef struct AFSK_period {
+  /* The discriminator is decoding. Otherwise the correlator is. */
+  bool                      active;
+  /* Tone at the start and end of the current half cycle. */
+  tone_t                    first;
+  tone_t                    second;
+  /* Counts at the end of the current half cycle in the second tone. */
+  min_pwmcnt_t              split;
+  /* Filter rate samples since the last decode rate sample. */
+  uint8_t                   decimation;
+  /* Mark votes of the last decode rate samples, newest in bit 0. */
+  uint16_t                  votes;
+  /* Half cycles and those outside the tone lengths in the window. */
+  uint16_t                  cycles;
+  uint16_t                  outliers;
+} afsk_period_t;
+#endif
+
+#if AFSK_NUM_SLICERS > 1
+/**
+ * @brief   Additional slicer HDLC state and frame store.
+ */
+typedef struct AFSK_slicer {
+  tone_t                    tone_freq;
+  tone_t                    prior_freq;
+  uint32_t                  hdlc_bits;
+  ax25char_t                current_byte;
+  uint8_t                   bit_index;
+  frame_state_t             frame_state;
+  size_t                    packet_size;
+  uint16_t                  crc;
+  ax25char_t                buffer[PKT_RX_BUFFER_SIZE];
+} afsk_slicer_t;
+#endif
+
 /**
  * @brief   Structure representing an AFSK demod driver.
  */
@@ -210,15 +350,19 @@ typedef struct AFSK_data {
    */
   rx_icu_state_t            icustate;
 
+#if USE_PWM_PREQUALIFY == TRUE
   /**
-   * @brief PWM queue heap memory.
+   * @brief PWM captured while qualifying a CCA break.
    */
-  void                      *pwm_queue_heap;
+  radio_pwm_qualify_t       qualify;
+#endif
 
+#if USE_HEAP_PWM_BUFFER == TRUE
   /**
    * @brief PWM buffer object pool manager.
    */
-  memory_pool_t             pwm_buffer_pool;
+  radio_pwm_pool_t          pwm_pool;
+#endif
 
   /**
    * @brief PWM FIFO manager name.
@@ -271,6 +415,60 @@ typedef struct AFSK_data {
    * @brief Opening HDLC flag sequence found.
    */
   frame_state_t             frame_state;
+
+#if PKT_RX_USE_2FSK == TRUE
+  /**
+   * @brief 2FSK descrambler shift register.
+   */
+  uint32_t                  descrambler;
+#endif
+
+#if AFSK_NUM_SLICERS > 1
+  /**
+   * @brief Additional slicers fed from the same tone decoder output.
+   */
+  afsk_slicer_t             slicers[AFSK_NUM_SLICERS - 1];
+#endif
+
+#if PKT_RX_USE_FX25 == TRUE
+  /**
+   * @brief FX.25 block receive fed from the HDLC bit stream.
+   */
+  fx25_rx_t                 fx25;
+#endif
+
+#if PKT_RX_USE_IL2P == TRUE
+  /**
+   * @brief IL2P frame receive fed from the HDLC bit stream.
+   */
+  il2p_rx_t                 il2p;
+#endif
+
+  /**
+   * @brief Signal quality of the current decode session.
+   */
+  afsk_quality_t            quality;
+
+#if PKT_RX_USE_SOFT_DCD == TRUE
+  /**
+   * @brief Software carrier detect of the current decode session.
+   */
+  afsk_dcd_t                dcd;
+#endif
+
+#if PKT_RX_USE_PERIOD_DISC == TRUE
+  /**
+   * @brief PWM period discriminator of the current decode session.
+   */
+  afsk_period_t             period;
+#endif
+
+#if USE_AFSK_DECODER_STATS == TRUE
+  /**
+   * @brief Decoder CPU load and latency statistics.
+   */
+  afsk_decoder_stats_t      stats;
+#endif
 } AFSKDemodDriver;
 
 /*===========================================================================*/
@@ -284,9 +482,81 @@ typedef struct AFSK_data {
 static inline void pktResyncAFSKDecoder(AFSKDemodDriver *myDriver) {
   packet_svc_t *myHandler = myDriver->packet_handler;
   myDriver->frame_state = FRAME_OPEN;
-  myHandler->active_packet_object->packet_size = 0;
+  pktResetDataCount(myHandler->active_packet_object);
 }
 
+/**
+ * @brief   Gets the decoder state index for the radio of an AFSK driver.
+ *
+ * @param[in] myDriver  pointer to a @p AFSKDemodDriver structure.
+ *
+ * @return  index of the decoder state for this radio.
+ *
+ * @api
+ */
+static inline uint8_t pktGetAFSKDecoderIndex(AFSKDemodDriver *myDriver) {
+  uint8_t inst = myDriver->packet_handler->radio - PKT_RADIO_1;
+  chDbgAssert(inst < AFSK_NUM_DECODERS, "no decoder state for radio");
+  return inst;
+}
+
+/**
+ * @brief   Adds a dominant tone magnitude to the session quality.
+ *
+ * @param[in] myDriver  pointer to a @p AFSKDemodDriver structure.
+ * @param[in] level     magnitude in decoder units.
+ *
+ * @api
+ */
+static inline void pktAddAFSKToneLevel(AFSKDemodDriver *myDriver,
+                                       uint32_t level) {
+  myDriver->quality.level_total += level;
+  myDriver->quality.level_count++;
+}
+
+/**
+ * @brief   Adds a tone transition to the session PLL lock quality.
+ * @notes   Called at the transition before the PLL is corrected.
+ *
+ * @param[in] myDriver  pointer to a @p AFSKDemodDriver structure.
+ * @param[in] pll       symbol PLL counter at the transition.
+ *
+ * @api
+ */
+static inline void pktAddAFSKPLLEdge(AFSKDemodDriver *myDriver, int32_t pll) {
+  bool locked = pll > -AFSK_PLL_LOCK_WINDOW && pll < AFSK_PLL_LOCK_WINDOW;
+  myDriver->quality.pll_edges++;
+  if(locked)
+    myDriver->quality.pll_locked++;
+#if PKT_RX_USE_SOFT_DCD == TRUE
+  myDriver->dcd.edges++;
+  if(locked)
+    myDriver->dcd.locked++;
+  /* A clock offset moves transitions off the PLL but keeps them regular. */
+  int32_t drift = (int32_t)((uint32_t)pll - (uint32_t)myDriver->dcd.last_pll);
+  if(drift > -AFSK_PLL_LOCK_WINDOW && drift < AFSK_PLL_LOCK_WINDOW)
+    myDriver->dcd.regular++;
+  myDriver->dcd.last_pll = pll;
+#endif
+}
+
+#if PKT_RX_USE_SOFT_DCD == TRUE
+/**
+ * @brief   Checks if the software carrier detect has dropped.
+ *
+ * @param[in] myDriver  pointer to a @p AFSKDemodDriver structure.
+ *
+ * @return  carrier status.
+ * @retval  true    no carrier for the hold time so the session can end.
+ * @retval  false   carrier present or within the hold time.
+ *
+ * @api
+ */
+static inline bool pktIsAFSKCarrierLost(AFSKDemodDriver *myDriver) {
+  return myDriver->dcd.idle >= PKT_RX_DCD_HOLD;
+}
+#endif
+
 /*===========================================================================*/
 /* External declarations.                                                    */
 /*===========================================================================*/
@@ -294,6 +564,9 @@ static inline void pktResyncAFSKDecoder(AFSKDemodDriver *myDriver) {
 extern float32_t pre_filter_coeff_f32[];
 extern float32_t mag_filter_coeff_f32[];
 extern AFSKDemodDriver AFSKD1;
+#if PKT_SVC_USE_RADIO2 == TRUE
+extern AFSKDemodDriver AFSKD2;
+#endif
 
 #ifdef __cplusplus
 extern "C" {
@@ -301,6 +574,11 @@ extern "C" {
   AFSKDemodDriver *pktCreateAFSKDecoder(packet_svc_t *pktDriver);
   void pktReleaseAFSKDecoder(AFSKDemodDriver *myDriver);
   void pktAFSKDecoder(void *arg);
+  void pktInitAFSKDSP(AFSKDemodDriver *myDriver);
+  bool pktProcessAFSK(AFSKDemodDriver *myDriver, min_pwmcnt_t current_tone[]);
+  void pktResetAFSKDecoder(AFSKDemodDriver *myDriver);
+  void pktSetAFSKFrameQuality(AFSKDemodDriver *myDriver,
+                              pkt_data_object_t *myPacket);
 #ifdef __cplusplus
 }
 #endif
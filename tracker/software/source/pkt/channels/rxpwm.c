@@ -29,6 +29,7 @@
  */
 
 #include "pktconf.h"
+#include "pclock.h"
 
 /*===========================================================================*/
 /* Module local definitions.                                                 */
@@ -46,10 +47,399 @@
 /* Module local variables.                                                   */
 /*===========================================================================*/
 
+#if USE_PWM_DMA_CAPTURE == TRUE
+#if STM32_I2C_USE_I2C1 &&                                                    \
+    (STM32_I2C_I2C1_RX_DMA_STREAM == PKT_RADIO1_PWM_DMA_STREAM)
+#error "PWM DMA stream is shared with I2C1 RX"
+#endif
+/* DMA capture buffer for radio 1 (in SRAM so it is accessible by DMA). */
+static radio_pwm_dma_t radio1_pwm_dma;
+#endif
+
+#if USE_CCA_GPT_DEBOUNCE == TRUE
+static void pktRadioCCATimerExpired(GPTDriver *gptp);
+
+/* CCA de-glitch timer for radio 1. */
+static const GPTConfig radio1_cca_gpt_cfg = {
+  CCA_GPT_FREQUENCY,
+  pktRadioCCATimerExpired,
+  0,
+  0
+};
+#endif
+
 /*===========================================================================*/
 /* Module local functions.                                                   */
 /*===========================================================================*/
 
+#if USE_CCA_GPT_DEBOUNCE == TRUE
+/**
+ * @brief   CCA de-glitch timer expiry.
+ * @notes   Dispatches to the lead or trail handler the timer was started for.
+ *
+ * @param[in] gptp      pointer to a @p GPTDriver structure
+ *
+ * @isr
+ */
+static void pktRadioCCATimerExpired(GPTDriver *gptp) {
+  gptp->cca_cb(gptp->link);
+}
+#endif
+
+/**
+ * @brief   Starts the CCA de-glitch timer.
+ *
+ * @param[in] myICU     pointer to a @p ICUDriver structure
+ * @param[in] us        de-glitch time in microseconds.
+ * @param[in] cb        handler called when the time expires.
+ *
+ * @iclass
+ */
+static void pktStartCCATimerI(ICUDriver *myICU, uint32_t us, vtfunc_t cb) {
+#if USE_CCA_GPT_DEBOUNCE == TRUE
+  GPTDriver *gptp = myICU->gpt;
+  if(gptp->state == GPT_ONESHOT)
+    gptStopTimerI(gptp);
+  gptp->cca_cb = cb;
+  gptStartOneShotI(gptp, (gptcnt_t)(((uint64_t)us * CCA_GPT_FREQUENCY)
+                                     / 1000000U));
+#else
+  chVTSetI(&myICU->cca_timer, TIME_US2I(us), cb, myICU);
+#endif
+}
+
+/**
+ * @brief   Stops the CCA de-glitch timer.
+ *
+ * @param[in] myICU     pointer to a @p ICUDriver structure
+ *
+ * @iclass
+ */
+static void pktStopCCATimerI(ICUDriver *myICU) {
+#if USE_CCA_GPT_DEBOUNCE == TRUE
+  GPTDriver *gptp = myICU->gpt;
+  if(gptp->state == GPT_ONESHOT)
+    gptStopTimerI(gptp);
+#else
+  chVTResetI(&myICU->cca_timer);
+#endif
+}
+
+/**
+ * @brief   Tests if the CCA de-glitch timer is running.
+ *
+ * @param[in] myICU     pointer to a @p ICUDriver structure
+ *
+ * @return  true if the timer is running.
+ *
+ * @iclass
+ */
+static bool pktIsCCATimerArmedI(ICUDriver *myICU) {
+#if USE_CCA_GPT_DEBOUNCE == TRUE
+  return ((GPTDriver *)myICU->gpt)->state == GPT_ONESHOT;
+#else
+  return chVTIsArmedI(&myICU->cca_timer);
+#endif
+}
+
+#if PKT_RX_USE_SOFT_DCD == TRUE
+/**
+ * @brief   Qualifies CCA again after the session was ended by carrier detect.
+ * @notes   With a low squelch CCA may stay asserted between packets so
+ *          there is no leading edge to open the next session.
+ *
+ * @param[in] myICU     pointer to a @p ICUDriver structure
+ *
+ * @iclass
+ */
+static void pktRestartCCAI(ICUDriver *myICU) {
+  AFSKDemodDriver *myDemod = myICU->link;
+  if(pktLLDradioReadCCA(myDemod->packet_handler->radio) == PAL_HIGH)
+    pktStartCCATimerI(myICU, CCA_LEAD_DEGLITCH_US,
+                      (vtfunc_t)pktRadioCCALeadTimer);
+}
+#endif
+
+/**
+ * @brief   Adds a PWM entry to the open PWM stream.
+ * @notes   The decoder state is checked before the PWM is queued.
+ * @notes   A new queue/buffer object is linked when the current one is full.
+ * @post    The channel is closed if the entry can not be added.
+ *
+ * @param[in] myICU     pointer to a @p ICUDriver structure
+ * @param[in] pack      PWM packed data object.
+ * @param[in] width     the impulse count (zero is invalid).
+ *
+ * @return  status of the PWM channel.
+ * @retval  true    the entry was added and the channel remains open.
+ * @retval  false   the channel has been closed.
+ *
+ * @iclass
+ */
+static bool pktAddPWMEntryI(ICUDriver *myICU, byte_packed_pwm_t pack,
+                            icucnt_t width) {
+  AFSKDemodDriver *myDemod = myICU->link;
+
+  /*
+   * Check if decoding has already finished while ICU is still active.
+   * The decoder terminates a frame on the first trailing HDLC flag.
+   * If CPU is fast (FPU enabled) it might finish decode before PWM stops.
+   * A long sequence of trailing HDLC flags or junk after a frame close
+   *  flag may cause trailing PWM activity.
+   *
+   */
+  if((myDemod->active_radio_object->status & STA_AFSK_DECODE_DONE) != 0) {
+    pktClosePWMchannelI(myICU, EVT_NONE, PWM_ACK_DECODE_END);
+    return false;
+  }
+
+  /*
+   * Check if the the decoder encountered an error condition.
+   * This will happen when no AX25 buffer is available or overflows.
+   * Close the PWM stream and wait for next radio CCA.
+   */
+  if((myDemod->active_radio_object->status & STA_AFSK_DECODE_RESET) != 0) {
+#if PKT_RX_USE_SOFT_DCD == TRUE
+    bool dropped =
+        (myDemod->active_radio_object->status & STA_AFSK_DCD_DROP) != 0;
+    pktClosePWMchannelI(myICU, EVT_NONE, PWM_ACK_DECODE_ERROR);
+    if(dropped)
+      pktRestartCCAI(myICU);
+#else
+    pktClosePWMchannelI(myICU, EVT_NONE, PWM_ACK_DECODE_ERROR);
+#endif
+    return false;
+  }
+
+  /*
+   * Check if impulse ICU value is zero and thus invalid.
+   */
+  if(width == 0) {
+    pktClosePWMchannelI(myICU, EVT_NONE, PWM_TERM_ICU_ZERO);
+    return false;
+  }
+
+  /* Write ICU data to PWM queue. */
+#if USE_HEAP_PWM_BUFFER == TRUE
+  radio_pwm_ring_t *myQueue =
+      &myDemod->active_radio_object->radio_pwm_queue->queue;
+#else
+  radio_pwm_ring_t *myQueue = &myDemod->active_radio_object->radio_pwm_queue;
+#endif
+  msg_t qs = pktWritePWMQueueI(myQueue, pack);
+
+  if(qs == MSG_RESET) {
+    /* Data not written. Space for one in-band entry available. */
+#if USE_HEAP_PWM_BUFFER == TRUE
+    /* Get another queue/buffer object. */
+    radio_pwm_object_t *pwm_object = pktAllocPWMObjectI(&myDemod->pwm_pool);
+    if(pwm_object != NULL) {
+      /* Initialize the new queue/buffer object. */
+      pktInitPWMRing(&pwm_object->queue,
+                     (*pwm_object).buffer.pwm_buffer,
+                     PWM_DATA_SLOTS);
+
+      /*
+       * Link the new object in read sequence after the prior object.
+       * The next link is set to NULL.
+       */
+      radio_pwm_object_t *myObject =
+          myDemod->active_radio_object->radio_pwm_queue;
+      myObject->queue.link = pwm_object;
+      myDemod->active_radio_object->in_use++;
+      uint8_t out = (myDemod->active_radio_object->in_use
+          - myDemod->active_radio_object->rlsd);
+      if(out > myDemod->active_radio_object->peak)
+        myDemod->active_radio_object->peak = out;
+
+      /* Write the in-band queue swap message to the current object. */
+  #if USE_12_BIT_PWM == TRUE
+      byte_packed_pwm_t swap = {{PWM_IN_BAND_PREFIX, PWM_INFO_QUEUE_SWAP, 0}};
+  #else
+      byte_packed_pwm_t swap = {{PWM_IN_BAND_PREFIX, PWM_INFO_QUEUE_SWAP}};
+  #endif
+      (void)pktWritePWMQueueI(&myObject->queue, swap);
+
+      /* Set the new object as the active PWM queue/buffer. */
+      myDemod->active_radio_object->radio_pwm_queue = pwm_object;
+
+      /* Write the PWM data to the new buffer. */
+      qs = pktWritePWMQueueI(&pwm_object->queue, pack);
+      if(qs == MSG_OK)
+        return true;
+    }
+#endif
+
+    /*
+     * Queue has space for one entry only.
+     * Close channel and write in-band message indicating queue full.
+     */
+    pktWriteGPIOline(LINE_OVERFLOW_LED, PAL_HIGH);
+    pktClosePWMchannelI(myICU, EVT_PWM_QUEUE_FULL, PWM_TERM_QUEUE_FULL);
+    return false;
+  }
+  return true;
+}
+
+#if USE_PWM_PREQUALIFY == TRUE
+/**
+ * @brief   Starts qualification of PWM after a CCA break.
+ * @notes   PWM is captured but no stream or buffer object is taken.
+ * @post    The ICU state is set to qualify.
+ *
+ * @param[in] myICU     pointer to a @p ICUDriver structure
+ *
+ * @iclass
+ */
+static void pktStartPWMQualifyI(ICUDriver *myICU) {
+  AFSKDemodDriver *myDemod = myICU->link;
+
+  if(myDemod->active_radio_object != NULL) {
+    /* Let open handle the remnant channel. */
+    pktOpenPWMChannelI(myICU, EVT_PWM_STREAM_OPEN);
+    return;
+  }
+  myDemod->qualify.count = 0;
+  myDemod->qualify.pass = 0;
+
+  /* This catches the condition where CCA raises but no RX data appears. */
+  chVTSetI(&myICU->pwm_timer, TIME_MS2I(50),
+           (vtfunc_t)pktPWMInactivityTimeout, myICU);
+  icuStartCaptureI(myICU);
+  icuEnableNotificationsI(myICU);
+  myDemod->icustate = PKT_PWM_QUALIFY;
+}
+
+/**
+ * @brief   Rejects the CCA break being qualified.
+ * @post    The ICU notification (callback) is stopped.
+ * @post    The ICU state is returned to ready.
+ *
+ * @param[in] myICU     pointer to a @p ICUDriver structure
+ *
+ * @iclass
+ */
+static void pktRejectPWMQualifyI(ICUDriver *myICU) {
+  AFSKDemodDriver *myDemod = myICU->link;
+
+  chVTResetI(&myICU->pwm_timer);
+  icuDisableNotificationsI(myICU);
+  myDemod->icustate = PKT_PWM_READY;
+#if USE_AFSK_DECODER_STATS == TRUE
+  pktAddAFSKQualifyI(&myDemod->stats, false);
+#endif
+  pktAddEventFlagsI(myDemod->packet_handler, EVT_RADIO_CCA_SPIKE);
+#if PKT_RX_USE_SOFT_DCD == TRUE
+  /* Keep checking while CCA stays asserted. */
+  pktRestartCCAI(myICU);
+#endif
+}
+
+/**
+ * @brief   Checks a PWM edge captured during qualification.
+ * @notes   An edge is plausible if impulse and valley are within the
+ *          bounds of an AFSK half cycle.
+ * @post    After PWM_QUALIFY_EDGES the PWM stream is opened and the
+ *          captured PWM replayed or the CCA break is rejected.
+ *
+ * @param[in] myICU     pointer to a @p ICUDriver structure
+ * @param[in] width     the impulse count.
+ * @param[in] period    the period count.
+ *
+ * @iclass
+ */
+static void pktQualifyPWMEntryI(ICUDriver *myICU, icucnt_t width,
+                                icucnt_t period) {
+  AFSKDemodDriver *myDemod = myICU->link;
+  radio_pwm_qualify_t *myQualify = &myDemod->qualify;
+
+  myQualify->impulse[myQualify->count] = width;
+  myQualify->period[myQualify->count] = period;
+  icucnt_t valley = period - width;
+  if(width >= PWM_QUALIFY_MIN_COUNT && width <= PWM_QUALIFY_MAX_COUNT
+      && valley >= PWM_QUALIFY_MIN_COUNT && valley <= PWM_QUALIFY_MAX_COUNT)
+    myQualify->pass++;
+  if(++myQualify->count < PWM_QUALIFY_EDGES)
+    return;
+
+  if(myQualify->pass < PWM_QUALIFY_PASS) {
+    pktRejectPWMQualifyI(myICU);
+    return;
+  }
+#if USE_AFSK_DECODER_STATS == TRUE
+  pktAddAFSKQualifyI(&myDemod->stats, true);
+#endif
+  pktOpenPWMChannelI(myICU, EVT_PWM_STREAM_OPEN);
+  if(myDemod->active_radio_object == NULL) {
+    /* No stream or buffer object available. Notifications are stopped. */
+    myDemod->icustate = PKT_PWM_READY;
+    return;
+  }
+
+  /* Replay the qualified PWM into the new stream. */
+  uint8_t i;
+  for(i = 0; i < PWM_QUALIFY_EDGES; i++) {
+    byte_packed_pwm_t pack;
+    pktConvertCaptureToPWM(myQualify->impulse[i], myQualify->period[i], &pack);
+    if(!pktAddPWMEntryI(myICU, pack, myQualify->impulse[i]))
+      break;
+  }
+}
+#endif /* USE_PWM_PREQUALIFY == TRUE */
+
+#if USE_PWM_DMA_CAPTURE == TRUE
+/**
+ * @brief   Starts DMA capture of PWM into the circular buffer.
+ * @notes   The timer DMA burst transfers CCR1 (period) and CCR2 (width).
+ *
+ * @param[in] myICU     pointer to a @p ICUDriver structure
+ *
+ * @iclass
+ */
+static void pktStartPWMDMAI(ICUDriver *myICU) {
+  radio_pwm_dma_t *myDMA = myICU->dma;
+
+  chDbgAssert(myICU->config->channel == ICU_CHANNEL_1,
+              "PWM DMA requires ICU channel 1");
+  myDMA->read_index = 0;
+  dmaStreamSetPeripheral(myDMA->dmastp, &myICU->tim->DMAR);
+  dmaStreamSetMemory0(myDMA->dmastp, myDMA->capture);
+  /* Transfers are half words. */
+  dmaStreamSetTransactionSize(myDMA->dmastp, PWM_DMA_SLOTS
+                              * (sizeof(pwm_dma_capture_t) / sizeof(uint16_t)));
+  dmaStreamSetMode(myDMA->dmastp,
+                   STM32_DMA_CR_CHSEL(PKT_RADIO1_PWM_DMA_CHANNEL)
+                   | STM32_DMA_CR_PL(PKT_RADIO1_PWM_DMA_PRIORITY)
+                   | STM32_DMA_CR_DIR_P2M | STM32_DMA_CR_PSIZE_HWORD
+                   | STM32_DMA_CR_MSIZE_HWORD | STM32_DMA_CR_MINC
+                   | STM32_DMA_CR_CIRC | STM32_DMA_CR_HTIE
+                   | STM32_DMA_CR_TCIE | STM32_DMA_CR_DMEIE
+                   | STM32_DMA_CR_TEIE);
+  dmaStreamClearInterrupt(myDMA->dmastp);
+  dmaStreamEnable(myDMA->dmastp);
+
+  /* Burst of two registers from CCR1 on each CC1 (period) capture. */
+  myICU->tim->DCR = STM32_TIM_DCR_DBL(1)
+      | STM32_TIM_DCR_DBA(offsetof(stm32_tim_t, CCR[0]) / sizeof(uint32_t));
+  /* Only overflow remains as an ICU interrupt. */
+  myICU->tim->DIER = (myICU->tim->DIER & ~STM32_TIM_DIER_IRQ_MASK)
+      | STM32_TIM_DIER_CC1DE | STM32_TIM_DIER_UIE;
+}
+
+/**
+ * @brief   Stops DMA capture of PWM.
+ *
+ * @param[in] myICU     pointer to a @p ICUDriver structure
+ *
+ * @iclass
+ */
+static void pktStopPWMDMAI(ICUDriver *myICU) {
+  radio_pwm_dma_t *myDMA = myICU->dma;
+  myICU->tim->DIER &= ~STM32_TIM_DIER_CC1DE;
+  dmaStreamDisable(myDMA->dmastp);
+}
+#endif /* USE_PWM_DMA_CAPTURE == TRUE */
+
 /*===========================================================================*/
 /* Module exported functions.                                                */
 /*===========================================================================*/
@@ -80,6 +470,14 @@ ICUDriver *pktAttachRadio(const radio_unit_t radio) {
   chVTObjectInit(&myICU->icu_timer);
   chVTObjectInit(&myICU->pwm_timer);
 
+#if USE_CCA_GPT_DEBOUNCE == TRUE
+  /* TODO: Select the CCA timer by radio when a second is added. */
+  GPTDriver *gptp = PKT_RADIO1_CCA_GPT;
+  gptp->link = myICU;
+  myICU->gpt = gptp;
+  gptStart(gptp, &radio1_cca_gpt_cfg);
+#endif
+
   /* TODO: Implement LLD call to setup indicator LEDs specific to radio. */
   /* Setup the squelch LED. */
   pktSetGPIOlineMode(LINE_SQUELCH_LED, PAL_MODE_OUTPUT_PUSHPULL);
@@ -96,6 +494,18 @@ ICUDriver *pktAttachRadio(const radio_unit_t radio) {
   /* If using PWM mirror to output to a diagnostic port. */
   pktSetGPIOlineMode(LINE_PWM_MIRROR, PAL_MODE_OUTPUT_PUSHPULL);
 
+#if USE_PWM_DMA_CAPTURE == TRUE
+  /* TODO: Select DMA stream and buffer by radio when a second is added. */
+  myICU->dma = &radio1_pwm_dma;
+  radio1_pwm_dma.dmastp = STM32_DMA_STREAM(PKT_RADIO1_PWM_DMA_STREAM);
+  bool b = dmaStreamAllocate(radio1_pwm_dma.dmastp,
+                             PKT_RADIO1_PWM_DMA_IRQ_PRIORITY,
+                             (stm32_dmaisr_t)pktRadioPWMDMAInterrupt,
+                             myICU);
+  chDbgAssert(!b, "PWM DMA stream already allocated");
+  (void)b;
+#endif
+
   return myICU;
 }
 
@@ -121,6 +531,18 @@ void pktDetachRadio(const radio_unit_t radio) {
    */
   icuStop(myDemod->icudriver);
 
+#if USE_CCA_GPT_DEBOUNCE == TRUE
+  /* Stop the CCA de-glitch timer. */
+  gptStop((GPTDriver *)myDemod->icudriver->gpt);
+  myDemod->icudriver->gpt = NULL;
+#endif
+
+#if USE_PWM_DMA_CAPTURE == TRUE
+  /* Release the PWM capture DMA stream. */
+  dmaStreamRelease(((radio_pwm_dma_t *)myDemod->icudriver->dma)->dmastp);
+  myDemod->icudriver->dma = NULL;
+#endif
+
   /*
    * Detach the radio from the PWM handlers.
    */
@@ -166,6 +588,7 @@ void pktEnableRadioPWM(const radio_unit_t radio) {
 
   //pktICUStart(myDemod->icudriver);
   icuStart(myDemod->icudriver, icucfg);
+  pclkRetimeTimer(myDemod->icudriver->tim);
   myDemod->icustate = PKT_PWM_READY;
 }
 
@@ -249,14 +672,18 @@ void pktClosePWMchannelI(ICUDriver *myICU, eventflags_t evt, pwm_code_t reason)
 
   /* Stop the ICU notification (callback). */
   icuDisableNotificationsI(myICU);
+#if USE_PWM_DMA_CAPTURE == TRUE
+  /* Any captures not yet moved to the stream are discarded. */
+  pktStopPWMDMAI(myICU);
+#endif
   if(myDemod->active_radio_object != NULL) {
     myDemod->active_radio_object->status |= (STA_PWM_STREAM_CLOSED | evt);
-    pktAddEventFlagsI(myHandler, evt);
+    pktAddEventArgI(myHandler, evt, reason);
 #if USE_HEAP_PWM_BUFFER == TRUE
-    input_queue_t *myQueue =
+    radio_pwm_ring_t *myQueue =
         &myDemod->active_radio_object->radio_pwm_queue->queue;
 #else
-    input_queue_t *myQueue = &myDemod->active_radio_object->radio_pwm_queue;
+    radio_pwm_ring_t *myQueue = &myDemod->active_radio_object->radio_pwm_queue;
 #endif
     /* End of data flag. */
 #if USE_12_BIT_PWM == TRUE
@@ -285,10 +712,11 @@ void pktClosePWMchannelI(ICUDriver *myICU, eventflags_t evt, pwm_code_t reason)
     /* Remove object reference. */
     myDemod->active_radio_object = NULL;
   } else {
-    pktAddEventFlagsI(myHandler, evt);
+    pktAddEventArgI(myHandler, evt, reason);
   }
-  /* Return to ready state (inactive). */
-  myDemod->icustate = PKT_PWM_READY;
+  /* Return to ready state (inactive). A replay keeps the ICU until done. */
+  if(myDemod->icustate != PKT_PWM_REPLAY)
+    myDemod->icustate = PKT_PWM_READY;
 }
 
 /**
@@ -338,6 +766,10 @@ void pktOpenPWMChannelI(ICUDriver *myICU, eventflags_t evt) {
 
   /* Save the FIFO used for this PWM -> decoder session. */
   myDemod->active_radio_object = myFIFO;
+#if USE_AFSK_DECODER_STATS == TRUE
+  /* New PWM session so CCA close has not happened yet. */
+  pktClearAFSKCCACloseI(&myDemod->stats);
+#endif
 
 #if USE_HEAP_PWM_BUFFER == TRUE
   /*
@@ -362,7 +794,7 @@ void pktOpenPWMChannelI(ICUDriver *myICU, eventflags_t evt) {
    *
    */
 
-  radio_pwm_object_t *pwm_object = chPoolAllocI(&myDemod->pwm_buffer_pool);
+  radio_pwm_object_t *pwm_object = pktAllocPWMObjectI(&myDemod->pwm_pool);
   if(pwm_object == NULL) {
     /*
      * Failed to get a PWM buffer object.
@@ -385,21 +817,18 @@ void pktOpenPWMChannelI(ICUDriver *myICU, eventflags_t evt) {
   myFIFO->rlsd = 0;
   myFIFO->decode_pwm_queue = pwm_object;
   /*
-   * Initialize the queue object.
-   * Set the user defined link to NULL.
-   * Using the embedded link allows removal of the buffer object link field.
+   * Initialize the ring object.
+   * The link to the next ring is set to NULL.
    */
-  iqObjectInit(&pwm_object->queue,
-                     (*pwm_object).buffer.pwm_bytes,
-                     sizeof(radio_pwm_buffer_t),
-                     NULL, NULL);
+  pktInitPWMRing(&pwm_object->queue,
+                 (*pwm_object).buffer.pwm_buffer,
+                 PWM_DATA_SLOTS);
 
 #else /* USE_HEAP_PWM_BUFFER != TRUE */
-  /* Non linked FIFOs have an embedded input queue with data buffer. */
-  iqObjectInit(&myFIFO->radio_pwm_queue,
-                     myFIFO->packed_buffer.pwm_bytes,
-                     sizeof(radio_pwm_buffer_t),
-                     NULL, NULL);
+  /* Non linked FIFOs have an embedded PWM ring with data buffer. */
+  pktInitPWMRing(&myFIFO->radio_pwm_queue,
+                 myFIFO->packed_buffer.pwm_buffer,
+                 PWM_DATA_SLOTS);
 #endif /* USE_HEAP_PWM_BUFFER == TRUE */
 
   /*
@@ -429,14 +858,25 @@ void pktOpenPWMChannelI(ICUDriver *myICU, eventflags_t evt) {
   chVTSetI(&myICU->pwm_timer, TIME_MS2I(50),
            (vtfunc_t)pktPWMInactivityTimeout, myICU);
 
-  icuStartCaptureI(myICU);
-  icuEnableNotificationsI(myICU);
+  /* Capture is already running if the PWM was qualified. */
+  if(myDemod->icustate == PKT_PWM_READY) {
+#if USE_PWM_DMA_CAPTURE == TRUE
+    /* PWM is moved to the stream on DMA half and full transfer. */
+    pktStartPWMDMAI(myICU);
+    icuStartCaptureI(myICU);
+#else
+    icuStartCaptureI(myICU);
+    icuEnableNotificationsI(myICU);
+#endif
+  }
   pktAddEventFlagsI(myHandler, evt);
 
   /* Clear status bits. */
   myFIFO->status = 0;
 
-  myDemod->icustate = PKT_PWM_ACTIVE;
+  /* A replay writes the PWM so the ICU stays in replay state. */
+  if(myDemod->icustate != PKT_PWM_REPLAY)
+    myDemod->icustate = PKT_PWM_ACTIVE;
 }
 
 /**
@@ -491,7 +931,7 @@ void pktICUInactivityTimeout(ICUDriver *myICU) {
  */
 void pktStopAllICUtimersI(ICUDriver *myICU) {
   chVTResetI(&myICU->icu_timer);
-  chVTResetI(&myICU->cca_timer);
+  pktStopCCATimerI(myICU);
   chVTResetI(&myICU->pwm_timer);
 }
 
@@ -507,6 +947,13 @@ void pktPWMInactivityTimeout(ICUDriver *myICU) {
   /* Timeout waiting for PWM data from the radio. */
   chSysLockFromISR();
   AFSKDemodDriver *myDemod = myICU->link;
+#if USE_PWM_PREQUALIFY == TRUE
+  if(myDemod->icustate == PKT_PWM_QUALIFY) {
+    pktRejectPWMQualifyI(myICU);
+    chSysUnlockFromISR();
+    return;
+  }
+#endif
   if(myDemod->active_radio_object != NULL) {
     pktClosePWMchannelI(myICU, EVT_PWM_NO_DATA, PWM_TERM_NO_DATA);
   }
@@ -538,7 +985,19 @@ void pktRadioCCALeadTimer(ICUDriver *myICU) {
 
     /* CCA still high so open PWM channel now it is validated. */
     case PAL_HIGH: {
+#if USE_PWM_PREQUALIFY == TRUE
+#if PKT_RX_USE_2FSK == TRUE
+      /* Qualification checks AFSK timing so does not apply to 2FSK. */
+      if(myHandler->radio_rx_config.type == MOD_2FSK) {
+        pktOpenPWMChannelI(myICU, EVT_PWM_STREAM_OPEN);
+        break;
+      }
+#endif
+      /* Check the PWM is plausible AFSK before opening the channel. */
+      pktStartPWMQualifyI(myICU);
+#else
       pktOpenPWMChannelI(myICU, EVT_PWM_STREAM_OPEN);
+#endif
       break;
     }
   }
@@ -571,6 +1030,16 @@ void pktRadioCCATrailTimer(ICUDriver *myICU) {
        * This caters for the case where the decoder terminates stream processing first.
        * This may happen if noise produces a long string of data.
        */
+#if USE_AFSK_DECODER_STATS == TRUE
+      /* Decode latency is measured from CCA close. */
+      pktSetAFSKCCACloseI(&myDemod->stats);
+#endif
+#if USE_PWM_DMA_CAPTURE == TRUE
+      /* Move PWM captured since the last DMA interrupt. */
+      pktDrainPWMDMAI(myICU);
+      if(myDemod->active_radio_object == NULL)
+        break;
+#endif
       pktClosePWMchannelI(myICU, EVT_NONE, PWM_TERM_CCA_CLOSE);
       break;
       }
@@ -598,7 +1067,9 @@ void pktRadioCCAInput(ICUDriver *myICU) {
   chSysLockFromISR();
   AFSKDemodDriver *myDemod = myICU->link;
 
-  if(myDemod->icustate == PKT_PWM_STOP) {
+  /* Radio CCA is ignored while a replay is writing the PWM stream. */
+  if(myDemod->icustate == PKT_PWM_STOP
+      || myDemod->icustate == PKT_PWM_REPLAY) {
     chSysUnlockFromISR();
     return;
   }
@@ -607,30 +1078,36 @@ void pktRadioCCAInput(ICUDriver *myICU) {
   /* CCA changed. */
   switch(cca) {
     case PAL_LOW: {
+#if USE_PWM_PREQUALIFY == TRUE
+      if(myDemod->icustate == PKT_PWM_QUALIFY) {
+        /* CCA dropped before the PWM was qualified. */
+        pktRejectPWMQualifyI(myICU);
+        break;
+      }
+#endif
       if(myDemod->icustate == PKT_PWM_ACTIVE) {
         /* CCA trailing edge glitch handling.
          * Start timer and check if CCA remains low before closing PWM.
          *
          * De-glitch for 8 AFSK bit times.
          */
-        chVTSetI(&myICU->cca_timer, TIME_US2I(833 * 8),
-                 (vtfunc_t)pktRadioCCATrailTimer, myICU);
+        pktStartCCATimerI(myICU, CCA_TRAIL_DEGLITCH_US,
+                          (vtfunc_t)pktRadioCCATrailTimer);
       }
       /* Idle state. */
       break;
     } /* End case PAL_LOW. */
 
     case PAL_HIGH: {
-      if(chVTIsArmedI(&myICU->cca_timer)) {
+      if(pktIsCCATimerArmedI(myICU)) {
         /* CAA has been re-asserted during trailing edge timer. */
-        chVTResetI(&myICU->cca_timer);
+        pktStopCCATimerI(myICU);
         break;
       }
       /* Else this is a leading edge of CCA for a new packet. */
       /* De-glitch for 16 AFSK bit times. */
-      chVTSetI(&myICU->cca_timer,
-               TIME_US2I(833 * 16),
-               (vtfunc_t)pktRadioCCALeadTimer, myICU);
+      pktStartCCATimerI(myICU, CCA_LEAD_DEGLITCH_US,
+                        (vtfunc_t)pktRadioCCALeadTimer);
       break;
     }
   } /* End switch. */
@@ -679,6 +1156,15 @@ void pktRadioICUPeriod(ICUDriver *myICU) {
    */
   chVTResetI(&myICU->pwm_timer);
 
+#if USE_PWM_PREQUALIFY == TRUE
+  if(myDemod->icustate == PKT_PWM_QUALIFY) {
+    /* No stream is open until the PWM is qualified. */
+    pktQualifyPWMEntryI(myICU, icuGetWidthX(myICU), icuGetPeriodX(myICU));
+    chSysUnlockFromISR();
+    return;
+  }
+#endif
+
   if(myDemod->active_radio_object == NULL) {
     /*
      * Arrive here when we are running but not buffering.
@@ -687,98 +1173,80 @@ void pktRadioICUPeriod(ICUDriver *myICU) {
     chSysUnlockFromISR();
     return;
   }
-  /*
-   * Check if decoding has already finished while ICU is still active.
-   * The decoder terminates a frame on the first trailing HDLC flag.
-   * If CPU is fast (FPU enabled) it might finish decode before PWM stops.
-   * A long sequence of trailing HDLC flags or junk after a frame close
-   *  flag may cause trailing PWM activity.
-   *
-   */
-  if((myDemod->active_radio_object->status & STA_AFSK_DECODE_DONE) != 0) {
-    pktClosePWMchannelI(myICU, EVT_NONE, PWM_ACK_DECODE_END);
-    chSysUnlockFromISR();
-    return;
-  }
 
-  /*
-   * Check if the the decoder encountered an error condition.
-   * This will happen when no AX25 buffer is available or overflows.
-   * Close the PWM stream and wait for next radio CCA.
-   */
-  if((myDemod->active_radio_object->status & STA_AFSK_DECODE_RESET) != 0) {
-    pktClosePWMchannelI(myICU, EVT_NONE, PWM_ACK_DECODE_ERROR);
-    chSysUnlockFromISR();
-    return;
-  }
-
-  /*
-   * Check if impulse ICU value is zero and thus invalid.
-   */
-  if(icuGetWidthX(myICU) == 0) {
-    pktClosePWMchannelI(myICU, EVT_NONE, PWM_TERM_ICU_ZERO);
-    chSysUnlockFromISR();
-    return;
-  }
+  /* Check decoder state and write ICU data to PWM queue. */
+  byte_packed_pwm_t pack;
+  pktConvertICUtoPWM(myICU, &pack);
+  (void)pktAddPWMEntryI(myICU, pack, icuGetWidthX(myICU));
+  chSysUnlockFromISR();
+  return;
+}
 
-  /* Write ICU data to PWM queue. */
-  msg_t qs = pktQueuePWMDataI(myICU);
+#if USE_PWM_DMA_CAPTURE == TRUE
+/**
+ * @brief   Moves PWM captured by DMA into the PWM stream.
+ * @notes   Entries from the read index to the DMA write position are moved.
+ * @notes   Called on DMA half and full transfer and at CCA close.
+ * @post    The PWM activity timer is reset if there was new PWM.
+ *
+ * @param[in] myICU     pointer to a @p ICUDriver structure
+ *
+ * @iclass
+ */
+void pktDrainPWMDMAI(ICUDriver *myICU) {
+  AFSKDemodDriver *myDemod = myICU->link;
+  radio_pwm_dma_t *myDMA = myICU->dma;
 
-  if(qs == MSG_RESET) {
-    /* Data not written. Space for one in-band entry available. */
-#if USE_HEAP_PWM_BUFFER == TRUE
-    /* Get another queue/buffer object. */
-    radio_pwm_object_t *pwm_object = chPoolAllocI(&myDemod->pwm_buffer_pool);
-    if(pwm_object != NULL) {
-      /* Initialize the new queue/buffer object. */
-      iqObjectInit(&pwm_object->queue,
-                         (*pwm_object).buffer.pwm_bytes,
-                         sizeof(radio_pwm_buffer_t),
-                         NULL, NULL);
+  if(myDemod->active_radio_object == NULL)
+    return;
 
-      /*
-       * Link the new object in read sequence after the prior object.
-       * The next link is set to NULL.
-       */
-      radio_pwm_object_t *myObject =
-          myDemod->active_radio_object->radio_pwm_queue;
-      qSetLink(&myObject->queue, pwm_object);
-      myDemod->active_radio_object->in_use++;
-      uint8_t out = (myDemod->active_radio_object->in_use
-          - myDemod->active_radio_object->rlsd);
-      if(out > myDemod->active_radio_object->peak)
-        myDemod->active_radio_object->peak = out;
+  /* DMA count is in half words. Only complete captures are taken. */
+  uint16_t remain = dmaStreamGetTransactionSize(myDMA->dmastp);
+  uint16_t write_index = (PWM_DMA_SLOTS - ((remain + 1U) / 2U))
+      % PWM_DMA_SLOTS;
+  if(write_index == myDMA->read_index)
+    return;
 
-      /* Write the in-band queue swap message to the current object. */
-  #if USE_12_BIT_PWM == TRUE
-      byte_packed_pwm_t pack = {{PWM_IN_BAND_PREFIX, PWM_INFO_QUEUE_SWAP, 0}};
-  #else
-      byte_packed_pwm_t pack = {{PWM_IN_BAND_PREFIX, PWM_INFO_QUEUE_SWAP}};
-  #endif
-      msg_t qs = pktWritePWMQueueI(&myObject->queue, pack);
+  /* Radio data has appeared so the "no data" timeout is invalidated. */
+  chVTResetI(&myICU->pwm_timer);
 
-      /* Set the new object as the active PWM queue/buffer. */
-      myDemod->active_radio_object->radio_pwm_queue = pwm_object;
+  while(myDMA->read_index != write_index) {
+    pwm_dma_capture_t *capture = &myDMA->capture[myDMA->read_index];
+    if(++myDMA->read_index == PWM_DMA_SLOTS)
+      myDMA->read_index = 0;
+    /* Capture registers hold count - 1 (see icuGetWidthX). */
+    icucnt_t period = (icucnt_t)capture->ccr1 + 1U;
+    icucnt_t width = (icucnt_t)capture->ccr2 + 1U;
+    byte_packed_pwm_t pack;
+    pktConvertCaptureToPWM(width, period, &pack);
+    if(!pktAddPWMEntryI(myICU, pack, width))
+      return;
+  }
+}
 
-      /* Write the PWM data to the new buffer. */
-      qs = pktQueuePWMDataI(myICU);
-      if(qs == MSG_OK) {
-        chSysUnlockFromISR();
-        return;
-      }
+/**
+ * @brief   DMA interrupt for PWM capture.
+ * @notes   Called at ISR level on half transfer, full transfer or error.
+ *
+ * @param[in] myICU     pointer to a @p ICUDriver structure
+ * @param[in] flags     DMA interrupt flags.
+ *
+ * @isr
+ */
+void pktRadioPWMDMAInterrupt(ICUDriver *myICU, uint32_t flags) {
+  chSysLockFromISR();
+  AFSKDemodDriver *myDemod = myICU->link;
+  if(myDemod->active_radio_object != NULL) {
+    if((flags & (STM32_DMA_ISR_TEIF | STM32_DMA_ISR_DMEIF)) != 0) {
+      /* DMA error so the captured PWM is not reliable. */
+      pktClosePWMchannelI(myICU, EVT_PWM_QUEUE_OVERRUN, PWM_TERM_DMA_ERROR);
+    } else {
+      pktDrainPWMDMAI(myICU);
     }
-#endif
-
-    /*
-     * Queue has space for one entry only.
-     * Close channel and write in-band message indicating queue full.
-     */
-    pktWriteGPIOline(LINE_OVERFLOW_LED, PAL_HIGH);
-    pktClosePWMchannelI(myICU, EVT_PWM_QUEUE_FULL, PWM_TERM_QUEUE_FULL);
   }
   chSysUnlockFromISR();
-  return;
 }
+#endif /* USE_PWM_DMA_CAPTURE == TRUE */
 
 /**
  * @brief   Overflow callback from ICU driver.
@@ -794,6 +1262,16 @@ void pktRadioICUOverflow(ICUDriver *myICU) {
   AFSKDemodDriver *myDemod = myICU->link;
 /*  packet_svc_t *myHandler = myDemod->packet_handler;
   pktAddEventFlagsI(myHandler, EVT_ICU_OVERFLOW);*/
+#if USE_PWM_DMA_CAPTURE == TRUE
+  /* Move PWM captured before the overflow. */
+  pktDrainPWMDMAI(myICU);
+#endif
+#if USE_PWM_PREQUALIFY == TRUE
+  if(myDemod->icustate == PKT_PWM_QUALIFY) {
+    /* A period beyond the timer range is not AFSK. */
+    pktRejectPWMQualifyI(myICU);
+  } else
+#endif
   if(myDemod->active_radio_object != NULL) {
     /* Close the channel and stop ICU notifications. */
     pktClosePWMchannelI(myICU, EVT_NONE, PWM_TERM_ICU_OVERFLOW);
@@ -807,7 +1285,7 @@ void pktRadioICUOverflow(ICUDriver *myICU) {
 /**
  * @brief   Converts ICU data and posts to the PWM queue.
  * @pre     The ICU driver is linked to a demod driver (pointer to driver).
- * @details Byte values of packed PWM data are written into an input queue.
+ * @details Packed PWM data is written into the PWM ring.
  *
  * @param[in] myICU      pointer to the ICU driver structure
  *
@@ -826,10 +1304,10 @@ msg_t pktQueuePWMDataI(ICUDriver *myICU) {
   chDbgAssert(myDemod != NULL, "no linked demod driver");
 
 #if USE_HEAP_PWM_BUFFER == TRUE
-  input_queue_t *myQueue =
+  radio_pwm_ring_t *myQueue =
       &myDemod->active_radio_object->radio_pwm_queue->queue;
 #else
-  input_queue_t *myQueue = &myDemod->active_radio_object->radio_pwm_queue;
+  radio_pwm_ring_t *myQueue = &myDemod->active_radio_object->radio_pwm_queue;
 #endif
   chDbgAssert(myQueue != NULL, "no queue assigned");
 
@@ -838,4 +1316,270 @@ msg_t pktQueuePWMDataI(ICUDriver *myICU) {
   return pktWritePWMQueueI(myQueue, pack);
 }
 
+#if USE_PWM_REPLAY == TRUE
+/**
+ * @brief   Takes the PWM stream from the ICU for a replay.
+ * @notes   Radio CCA and ICU capture are ignored until the replay stops.
+ * @post    The ICU state is set to replay.
+ *
+ * @param[in] myICU     pointer to a @p ICUDriver structure
+ *
+ * @return  status of the request.
+ * @retval  true    the PWM stream is available for replay.
+ * @retval  false   the ICU is not idle.
+ *
+ * @iclass
+ */
+bool pktStartPWMReplayI(ICUDriver *myICU) {
+  AFSKDemodDriver *myDemod = myICU->link;
+
+  if(myDemod->icustate != PKT_PWM_READY
+      || myDemod->active_radio_object != NULL)
+    return false;
+
+  /* Cancel any CCA de-glitch in progress and stop radio capture. */
+  pktStopCCATimerI(myICU);
+  icuDisableNotificationsI(myICU);
+  pktSleepICUI(myICU);
+  myDemod->icustate = PKT_PWM_REPLAY;
+  return true;
+}
+
+/**
+ * @brief   Returns the PWM stream to the ICU after a replay.
+ * @notes   The next radio CCA will restart ICU capture.
+ * @post    Any open replay stream is closed.
+ * @post    The ICU state is set to ready.
+ *
+ * @param[in] myICU     pointer to a @p ICUDriver structure
+ *
+ * @iclass
+ */
+void pktStopPWMReplayI(ICUDriver *myICU) {
+  AFSKDemodDriver *myDemod = myICU->link;
+
+  if(myDemod->icustate != PKT_PWM_REPLAY)
+    return;
+  if(myDemod->active_radio_object != NULL)
+    pktClosePWMchannelI(myICU, EVT_NONE, PWM_TERM_CCA_CLOSE);
+  myDemod->icustate = PKT_PWM_READY;
+}
+
+/**
+ * @brief   Writes a replayed PWM entry to the open PWM stream.
+ * @notes   The entry is handled as if it were captured by the ICU.
+ * @notes   The write is refused while the decoder is behind.
+ *          That limits the replay to PWM_REPLAY_BUFFERS linked objects.
+ *
+ * @param[in] myICU     pointer to a @p ICUDriver structure
+ * @param[in] pack      PWM packed data object.
+ *
+ * @return              The operation status.
+ * @retval MSG_OK       The PWM entry has been queued.
+ * @retval MSG_TIMEOUT  The decoder is behind so try again later.
+ * @retval MSG_RESET    The stream is closed or the replay was stopped.
+ *
+ * @iclass
+ */
+msg_t pktWritePWMReplayI(ICUDriver *myICU, byte_packed_pwm_t pack) {
+  AFSKDemodDriver *myDemod = myICU->link;
+
+  if(myDemod->icustate != PKT_PWM_REPLAY
+      || myDemod->active_radio_object == NULL)
+    return MSG_RESET;
+
+#if USE_HEAP_PWM_BUFFER == TRUE
+  radio_pwm_fifo_t *myFIFO = myDemod->active_radio_object;
+  radio_pwm_ring_t *myQueue = &myFIFO->radio_pwm_queue->queue;
+  /* A full ring is swapped for a new object unless enough are out. */
+  if(pktGetPWMRingFullX(myQueue) >= myQueue->size - 2U
+      && (uint8_t)(myFIFO->in_use - myFIFO->rlsd) >= PWM_REPLAY_BUFFERS)
+    return MSG_TIMEOUT;
+#else
+  radio_pwm_ring_t *myQueue = &myDemod->active_radio_object->radio_pwm_queue;
+  /* Keep the last slot for the in-band close. */
+  if(pktGetPWMRingFullX(myQueue) >= myQueue->size - 2U)
+    return MSG_TIMEOUT;
+#endif
+
+  /* Replayed data counts as PWM activity. */
+  chVTResetI(&myICU->pwm_timer);
+  array_min_pwm_counts_t counts;
+  pktUnpackPWMData(pack, &counts);
+  return pktAddPWMEntryI(myICU, pack, counts.pwm.impulse) ? MSG_OK : MSG_RESET;
+}
+#endif /* USE_PWM_REPLAY == TRUE */
+
+#if USE_HEAP_PWM_BUFFER == TRUE
+/**
+ * @brief   Add PWM buffer objects from heap to the pool.
+ *
+ * @param[in] pwm_pool  pointer to a @p radio_pwm_pool_t structure.
+ * @param[in] number    number of objects to add.
+ *
+ * @return  number of objects added.
+ *
+ * @api
+ */
+static uint16_t pktGrowPWMPool(radio_pwm_pool_t *pwm_pool, uint16_t number) {
+  uint16_t n;
+  for(n = 0; n < number; n++) {
+    if(pwm_pool->stats.size >= PWM_DATA_BUFFERS)
+      break;
+    radio_pwm_object_t *object = chHeapAlloc(pwm_pool->heap,
+                                             sizeof(radio_pwm_object_t));
+    if(object == NULL)
+      break;
+    chSysLock();
+    chPoolFreeI(&pwm_pool->pool, object);
+    pwm_pool->stats.size++;
+    chSysUnlock();
+  }
+  return n;
+}
+
+/**
+ * @brief   Release free PWM buffer objects from the pool back to heap.
+ * @notes   Objects in use by a PWM session are not touched.
+ *
+ * @param[in] pwm_pool  pointer to a @p radio_pwm_pool_t structure.
+ * @param[in] number    number of objects to release.
+ *
+ * @return  number of objects released.
+ *
+ * @api
+ */
+static uint16_t pktShrinkPWMPool(radio_pwm_pool_t *pwm_pool, uint16_t number) {
+  uint16_t n;
+  for(n = 0; n < number; n++) {
+    chSysLock();
+    void *object = chPoolAllocI(&pwm_pool->pool);
+    if(object != NULL)
+      pwm_pool->stats.size--;
+    chSysUnlock();
+    if(object == NULL)
+      break;
+    chHeapFree(object);
+  }
+  return n;
+}
+
+/**
+ * @brief   Create the PWM buffer object pool.
+ * @post    The pool is loaded with the minimum number of objects.
+ *
+ * @param[in] pwm_pool  pointer to a @p radio_pwm_pool_t structure.
+ * @param[in] heap      heap to allocate objects from or NULL for default.
+ *
+ * @return  status of the operation.
+ * @retval  true    the pool was created.
+ * @retval  false   the minimum number of objects could not be allocated.
+ *
+ * @api
+ */
+bool pktInitPWMPool(radio_pwm_pool_t *pwm_pool, memory_heap_t *heap) {
+  memset(&pwm_pool->stats, 0, sizeof(radio_pwm_pool_stats_t));
+  pwm_pool->heap = heap;
+  chPoolObjectInitAligned(&pwm_pool->pool,
+                          sizeof(radio_pwm_object_t),
+                          sizeof(msg_t), NULL);
+  pwm_pool->stats.recent = PWM_DATA_BUFFERS_MIN;
+  if(pktGrowPWMPool(pwm_pool, PWM_DATA_BUFFERS_MIN) < PWM_DATA_BUFFERS_MIN) {
+    pktDeinitPWMPool(pwm_pool);
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief   Release the PWM buffer object pool.
+ * @pre     No PWM buffer objects should be in use.
+ * @post    All pool objects are returned to heap.
+ *
+ * @param[in] pwm_pool  pointer to a @p radio_pwm_pool_t structure.
+ *
+ * @api
+ */
+void pktDeinitPWMPool(radio_pwm_pool_t *pwm_pool) {
+  chDbgAssert(pwm_pool->stats.out == 0, "PWM objects still in use");
+  (void)pktShrinkPWMPool(pwm_pool, pwm_pool->stats.size);
+}
+
+/**
+ * @brief   Adjust the PWM buffer object pool size from measured usage.
+ * @details While a session is active the pool is grown when free objects
+ *          fall below the adjust step.
+ *          When idle the pool is sized to the decaying peak of recent
+ *          sessions plus one adjust step of headroom.
+ *          The pool stays within the minimum and maximum object counts.
+ *
+ * @param[in] pwm_pool  pointer to a @p radio_pwm_pool_t structure.
+ * @param[in] idle      true if called between PWM sessions.
+ *
+ * @api
+ */
+void pktAdjustPWMPool(radio_pwm_pool_t *pwm_pool, bool idle) {
+  radio_pwm_pool_stats_t *stats = &pwm_pool->stats;
+  if(!idle) {
+    if(stats->size - stats->out < PWM_POOL_ADJUST_STEP
+        && pktGrowPWMPool(pwm_pool, PWM_POOL_ADJUST_STEP) != 0)
+      stats->grows++;
+    return;
+  }
+
+  /* Take the window peak and restart the window. */
+  chSysLock();
+  uint16_t window = stats->window;
+  stats->window = stats->out;
+  chSysUnlock();
+
+  /* Follow a higher peak at once and decay slowly from it. */
+  if(window >= stats->recent)
+    stats->recent = window;
+  else
+    stats->recent--;
+
+  uint16_t target = stats->recent + PWM_POOL_ADJUST_STEP;
+  if(target < PWM_DATA_BUFFERS_MIN)
+    target = PWM_DATA_BUFFERS_MIN;
+  if(target > PWM_DATA_BUFFERS)
+    target = PWM_DATA_BUFFERS;
+
+  if(stats->size < target) {
+    if(pktGrowPWMPool(pwm_pool, target - stats->size) != 0)
+      stats->grows++;
+  } else if(stats->size > target) {
+    /* Release gradually to avoid heap churn between sessions. */
+    uint16_t n = stats->size - target;
+    if(n > PWM_POOL_ADJUST_STEP)
+      n = PWM_POOL_ADJUST_STEP;
+    if(pktShrinkPWMPool(pwm_pool, n) != 0)
+      stats->shrinks++;
+  }
+}
+
+/**
+ * @brief   Gets a copy of the PWM buffer pool statistics for a radio.
+ *
+ * @param[in] radio     radio unit ID.
+ * @param[in] copy      pointer to a @p radio_pwm_pool_stats_t for the result.
+ *
+ * @return  status of the request.
+ * @retval  true    the statistics were copied.
+ * @retval  false   the radio has no AFSK decoder.
+ *
+ * @api
+ */
+bool pktGetPWMPoolStats(radio_unit_t radio, radio_pwm_pool_stats_t *copy) {
+  packet_svc_t *handler = pktGetServiceObject(radio);
+  if(handler == NULL || handler->link_controller == NULL)
+    return false;
+  AFSKDemodDriver *myDemod = (AFSKDemodDriver *)handler->link_controller;
+  chSysLock();
+  *copy = myDemod->pwm_pool.stats;
+  chSysUnlock();
+  return true;
+}
+#endif /* USE_HEAP_PWM_BUFFER == TRUE */
+
 /** @} */
@@ -48,10 +48,41 @@
 #define PWM_TERM_ICU_ZERO       7
 #define PWM_INFO_QUEUE_SWAP     8
 #define PWM_ACK_DECODE_ERROR    9
+#define PWM_TERM_DMA_ERROR      10
 
 /* ICU will be stopped if no activity for this number of seconds. */
 #define ICU_INACTIVITY_TIMEOUT  60
 
+/*
+ * Bounds for a plausible AFSK half cycle during pre-qualification.
+ * From half of a space half cycle to one and a half mark half cycles.
+ * Pulses at tone and symbol changes may be short so not all need pass.
+ */
+#define PWM_QUALIFY_MIN_COUNT   (ICU_COUNT_FREQUENCY                         \
+                                 / (4U * AFSK_SPACE_FREQUENCY))
+#define PWM_QUALIFY_MAX_COUNT   ((3U * ICU_COUNT_FREQUENCY)                  \
+                                 / (4U * AFSK_MARK_FREQUENCY))
+
+#if USE_PWM_PREQUALIFY == TRUE && USE_PWM_DMA_CAPTURE == TRUE
+#error "PWM pre-qualification requires ICU interrupt capture"
+#endif
+
+#if USE_PWM_DMA_CAPTURE == TRUE && PKT_SVC_USE_RADIO2 == TRUE
+#error "DMA PWM capture is only configured for radio 1"
+#endif
+
+#if USE_CCA_GPT_DEBOUNCE == TRUE && HAL_USE_GPT != TRUE
+#error "CCA timer de-glitch requires HAL_USE_GPT"
+#endif
+
+#if USE_CCA_GPT_DEBOUNCE == TRUE && PKT_SVC_USE_RADIO2 == TRUE
+#error "CCA timer de-glitch is only configured for radio 1"
+#endif
+
+/* CCA de-glitch times for the leading and trailing edge. */
+#define CCA_LEAD_DEGLITCH_US    (833U * 16U)
+#define CCA_TRAIL_DEGLITCH_US   (833U * 8U)
+
 /*===========================================================================*/
 /* Module data structures and types.                                         */
 /*===========================================================================*/
@@ -61,7 +92,9 @@ typedef uint8_t pwm_code_t;
 typedef enum ICUStates {
   PKT_PWM_INIT = 0,
   PKT_PWM_READY,
+  PKT_PWM_QUALIFY,
   PKT_PWM_ACTIVE,
+  PKT_PWM_REPLAY,
   PKT_PWM_STOP
 } rx_icu_state_t;
 
@@ -117,18 +150,98 @@ typedef union {
                                  * PWM_DATA_SLOTS];
 } radio_pwm_buffer_t;
 
+#if USE_PWM_DMA_CAPTURE == TRUE
+/* Timer capture registers transferred by DMA burst on each period. */
+typedef struct {
+  uint16_t                  ccr1;
+  uint16_t                  ccr2;
+} pwm_dma_capture_t;
+
+/*
+ * DMA circular capture buffer.
+ * The DMA is the producer and the read index is the consumer.
+ * Must be in DMA accessible memory (not CCM).
+ */
+typedef struct {
+  const stm32_dma_stream_t  *dmastp;
+  uint16_t                  read_index;
+  pwm_dma_capture_t         capture[PWM_DMA_SLOTS];
+} radio_pwm_dma_t;
+#endif
+
+#if USE_PWM_PREQUALIFY == TRUE
+/*
+ * PWM captured while a CCA break is being qualified.
+ * No stream or buffer object is committed until the PWM is plausible.
+ * The captured PWM is then replayed into the opened stream.
+ */
+typedef struct {
+  uint8_t                   count;
+  uint8_t                   pass;
+  icucnt_t                  impulse[PWM_QUALIFY_EDGES];
+  icucnt_t                  period[PWM_QUALIFY_EDGES];
+} radio_pwm_qualify_t;
+#endif
+
+/*
+ * Single producer/single consumer ring of PWM entries.
+ * The radio (ISR) side only writes the put index.
+ * The decoder (thread) side only writes the get index.
+ * Hence neither side needs a kernel lock to move PWM data.
+ * The decoder only locks to suspend when the ring is empty.
+ * One slot is kept empty so that a full ring can be distinguished.
+ */
+typedef struct PWMring {
+  byte_packed_pwm_t         *buffer;
+  uint16_t                  size;
+  volatile uint16_t         put_index;
+  volatile uint16_t         get_index;
+  /* Decoder thread waiting for PWM data. */
+  thread_reference_t        waiter;
+  /* In linked mode the reference to the next PWM ring is saved here.
+   * The decoder will continue to process linked PWM rings until completion.
+   */
+  void                      *link;
+} radio_pwm_ring_t;
+
 #if USE_HEAP_PWM_BUFFER == TRUE
 /* Forward declare struct. */
 typedef struct PWMobject radio_pwm_object_t;
 
 typedef struct PWMobject {
   radio_pwm_buffer_t        buffer;
-
-  /* In linked mode the reference to the next PWM queue is saved here.
-   * The decoder will continue to process linked PWM queues until completion.
-   */
-  input_queue_t             queue;
+  radio_pwm_ring_t          queue;
 } radio_pwm_object_t;
+
+/* Usage statistics of the PWM buffer object pool. */
+typedef struct {
+  /* Objects currently allocated from heap into the pool. */
+  uint16_t                  size;
+  /* Objects currently taken from the pool by PWM sessions. */
+  uint16_t                  out;
+  /* Highest number of objects taken since the pool was created. */
+  uint16_t                  peak;
+  /* Decaying peak of recent sessions used to size the pool. */
+  uint16_t                  recent;
+  /* Highest number of objects taken since the last adjustment. */
+  uint16_t                  window;
+  /* Number of times an object was not available. */
+  uint32_t                  overflows;
+  uint32_t                  grows;
+  uint32_t                  shrinks;
+} radio_pwm_pool_stats_t;
+
+/*
+ * PWM buffer object pool.
+ * Objects are allocated from heap and loaded into the pool as needed.
+ * The pool is grown and shrunk by the decoder thread.
+ * The radio (ISR) side only takes objects from the pool.
+ */
+typedef struct {
+  memory_pool_t             pool;
+  memory_heap_t             *heap;
+  radio_pwm_pool_stats_t    stats;
+} radio_pwm_pool_t;
 #endif
 
 /*
@@ -157,13 +270,13 @@ typedef struct {
    * In single queue mode PWM is written to a single queue only.
    * The queue has a single large buffer and used for the entire PWM session.
    *
-   * In linked buffer mode PWM can chain multiple smaller input buffers.
-   * After getting a new PWM buffer object the queue is re-initialized.
+   * In linked buffer mode PWM can chain multiple smaller ring buffers.
+   * After getting a new PWM buffer object the ring is re-initialized.
    * The queue fill with further PWM then continues.
    * As PWM buffers are consumed by the decoder they are recycled back to the pool.
    * The radio PWM can then re-use those buffers which in theory reduces memory utilisation.
    */
-  input_queue_t             radio_pwm_queue;
+  radio_pwm_ring_t          radio_pwm_queue;
 #endif
   /*
    * The semaphore controls the release of the PWM buffer and FIFO resources.
@@ -181,19 +294,25 @@ typedef struct {
 /*===========================================================================*/
 
 /**
- * @brief   Convert ICU data to PWM data and pack into minimized buffer.
+ * @brief   Convert width and period to PWM data and pack into minimized buffer.
  * @note    This function deals with ICU data packed into 12 bits or 16 bits.
+ * @note    Counts above the packed range are saturated to PWM_MAX_COUNT.
+ *          Otherwise a long pulse could pack to zero and read as in-band.
  *
- * @param[in] icup      pointer to ICU driver.
+ * @param[in] impulse   the impulse (width) count.
+ * @param[in] period    the period count.
  * @param[in] dest      pointer to the object for PWM data.
  *
  * @api
  */
-static inline void pktConvertICUtoPWM(ICUDriver *icup,
-                                      byte_packed_pwm_t *dest) {
-  icucnt_t impulse = icuGetWidthX(icup);
-  icucnt_t valley = icuGetPeriodX(icup) - impulse;
+static inline void pktConvertCaptureToPWM(icucnt_t impulse, icucnt_t period,
+                                          byte_packed_pwm_t *dest) {
+  icucnt_t valley = period - impulse;
 #if USE_12_BIT_PWM == TRUE
+  if(impulse > PWM_MAX_COUNT)
+    impulse = PWM_MAX_COUNT;
+  if(valley > PWM_MAX_COUNT)
+    valley = PWM_MAX_COUNT;
   dest->pwm.impulse = (packed_pwmcnt_t)impulse & 0xFFU;
   dest->pwm.valley = (packed_pwmcnt_t)valley & 0xFFU;
   /*
@@ -210,6 +329,19 @@ static inline void pktConvertICUtoPWM(ICUDriver *icup,
 #endif
 }
 
+/**
+ * @brief   Convert ICU data to PWM data and pack into minimized buffer.
+ *
+ * @param[in] icup      pointer to ICU driver.
+ * @param[in] dest      pointer to the object for PWM data.
+ *
+ * @api
+ */
+static inline void pktConvertICUtoPWM(ICUDriver *icup,
+                                      byte_packed_pwm_t *dest) {
+  pktConvertCaptureToPWM(icuGetWidthX(icup), icuGetPeriodX(icup), dest);
+}
+
 /**
  * @brief   Unpack PWM data into PWM structure.
  * @note    This function deals with ICU data up to 12 bits.
@@ -235,10 +367,45 @@ static inline void pktUnpackPWMData(byte_packed_pwm_t src,
 }
 
 /**
- * @brief   Write PWM data into input queue.
- * @note    This function deals with PWM data packed in sequential bytes.
+ * @brief   Initialise a PWM ring.
+ *
+ * @param[in] ring      pointer to a @p radio_pwm_ring_t object.
+ * @param[in] buffer    pointer to the PWM entry buffer.
+ * @param[in] size      number of PWM entries in the buffer.
  *
- * @param[in] queue     pointer to an input queue object.
+ * @api
+ */
+static inline void pktInitPWMRing(radio_pwm_ring_t *ring,
+                                  byte_packed_pwm_t *buffer, uint16_t size) {
+  ring->buffer = buffer;
+  ring->size = size;
+  ring->put_index = 0;
+  ring->get_index = 0;
+  ring->waiter = NULL;
+  ring->link = NULL;
+}
+
+/**
+ * @brief   Get the number of PWM entries waiting in a ring.
+ *
+ * @param[in] ring      pointer to a @p radio_pwm_ring_t object.
+ *
+ * @return  number of entries.
+ *
+ * @api
+ */
+static inline uint16_t pktGetPWMRingFullX(radio_pwm_ring_t *ring) {
+  uint16_t put = ring->put_index;
+  uint16_t get = ring->get_index;
+  return (put >= get) ? (put - get) : (ring->size - get + put);
+}
+
+/**
+ * @brief   Write PWM data into a PWM ring.
+ * @note    Called from the radio (producer) side only.
+ * @post    A decoder thread waiting on the ring is resumed.
+ *
+ * @param[in] queue     pointer to a @p radio_pwm_ring_t object.
  * @param[in] pack      PWM packed data object.
  *
  * @return              The operation status.
@@ -246,28 +413,111 @@ static inline void pktUnpackPWMData(byte_packed_pwm_t src,
  * @retval MSG_RESET    One slot remains which is reserved for an in-band signal.
  * @retval MSG_TIMEOUT  The queue is full for normal PWM data writes.
  *
- *
- * @api
+ * @iclass
  */
-static inline msg_t pktWritePWMQueueI(input_queue_t *queue,
+static inline msg_t pktWritePWMQueueI(radio_pwm_ring_t *queue,
                                      byte_packed_pwm_t pack) {
+  uint16_t put = queue->put_index;
+  uint16_t next = (put + 1U == queue->size) ? 0 : put + 1U;
+
+  /* Full. */
+  if(next == queue->get_index)
+    return MSG_TIMEOUT;
 
   /* Check if there is only one slot left. */
-  if(iqGetEmptyI(queue) == sizeof(byte_packed_pwm_t)) {
+  uint16_t after = (next + 1U == queue->size) ? 0 : next + 1U;
+  if(after == queue->get_index) {
     array_min_pwm_counts_t data;
     pktUnpackPWMData(pack, &data);
     if(data.pwm.impulse != PWM_IN_BAND_PREFIX)
       return MSG_RESET;
   }
 
-  /* Data is normal PWM or an in-band. */
-  for(uint8_t b = 0; b < sizeof(pack.bytes); b++) {
-    if(MSG_TIMEOUT == iqPutI(queue, pack.bytes[b]))
-      return MSG_TIMEOUT;
+  /* Data is normal PWM or an in-band. Publish after the entry is written. */
+  queue->buffer[put] = pack;
+  __DMB();
+  queue->put_index = next;
+  chThdResumeI(&queue->waiter, MSG_OK);
+  return MSG_OK;
+}
+
+/**
+ * @brief   Read PWM data from a PWM ring.
+ * @note    Called from the decoder (consumer) side only.
+ * @note    The kernel is locked only if the ring is empty.
+ *
+ * @param[in] queue     pointer to a @p radio_pwm_ring_t object.
+ * @param[out] pack     pointer to the PWM packed data object.
+ * @param[in] timeout   the number of ticks before the operation times out.
+ *
+ * @return              The operation status.
+ * @retval MSG_OK       A PWM entry has been read.
+ * @retval MSG_TIMEOUT  No PWM entry arrived within the timeout.
+ *
+ * @api
+ */
+static inline msg_t pktReadPWMQueueTimeout(radio_pwm_ring_t *queue,
+                                           byte_packed_pwm_t *pack,
+                                           sysinterval_t timeout) {
+  uint16_t get = queue->get_index;
+  if(get == queue->put_index) {
+    msg_t msg = MSG_OK;
+    chSysLock();
+    if(get == queue->put_index)
+      msg = chThdSuspendTimeoutS(&queue->waiter, timeout);
+    chSysUnlock();
+    if(msg != MSG_OK)
+      return msg;
   }
+  *pack = queue->buffer[get];
+  __DMB();
+  queue->get_index = (get + 1U == queue->size) ? 0 : get + 1U;
   return MSG_OK;
 }
 
+#if USE_HEAP_PWM_BUFFER == TRUE
+/**
+ * @brief   Take a PWM buffer object from the pool.
+ * @notes   Usage and overflow statistics are updated.
+ *
+ * @param[in] pwm_pool  pointer to a @p radio_pwm_pool_t structure.
+ *
+ * @return  pointer to the object.
+ * @retval  NULL if the pool has no free object.
+ *
+ * @iclass
+ */
+static inline radio_pwm_object_t *pktAllocPWMObjectI(radio_pwm_pool_t *pwm_pool) {
+  radio_pwm_pool_stats_t *stats = &pwm_pool->stats;
+  radio_pwm_object_t *object = chPoolAllocI(&pwm_pool->pool);
+  if(object == NULL) {
+    stats->overflows++;
+    return NULL;
+  }
+  if(++stats->out > stats->window)
+    stats->window = stats->out;
+  if(stats->out > stats->peak)
+    stats->peak = stats->out;
+  return object;
+}
+
+/**
+ * @brief   Return a PWM buffer object to the pool.
+ *
+ * @param[in] pwm_pool  pointer to a @p radio_pwm_pool_t structure.
+ * @param[in] object    pointer to the object.
+ *
+ * @api
+ */
+static inline void pktFreePWMObject(radio_pwm_pool_t *pwm_pool,
+                                    radio_pwm_object_t *object) {
+  chSysLock();
+  chPoolFreeI(&pwm_pool->pool, object);
+  pwm_pool->stats.out--;
+  chSysUnlock();
+}
+#endif
+
 /*===========================================================================*/
 /* External declarations.                                                    */
 /*===========================================================================*/
@@ -286,10 +536,28 @@ extern "C" {
   void pktStopAllICUtimersI(ICUDriver *myICU);
   void pktSleepICUI(ICUDriver *myICU);
   msg_t pktQueuePWMDataI(ICUDriver *myICU);
+  void pktOpenPWMChannelI(ICUDriver *myICU, eventflags_t evt);
   void pktClosePWMchannelI(ICUDriver *myICU, eventflags_t evt,
                            pwm_code_t reason);
   void pktICUInactivityTimeout(ICUDriver *myICU);
   void pktPWMInactivityTimeout(ICUDriver *myICU);
+  void pktRadioCCALeadTimer(ICUDriver *myICU);
+  void pktRadioCCATrailTimer(ICUDriver *myICU);
+#if USE_PWM_DMA_CAPTURE == TRUE
+  void pktRadioPWMDMAInterrupt(ICUDriver *myICU, uint32_t flags);
+  void pktDrainPWMDMAI(ICUDriver *myICU);
+#endif
+#if USE_HEAP_PWM_BUFFER == TRUE
+  bool pktInitPWMPool(radio_pwm_pool_t *pwm_pool, memory_heap_t *heap);
+  void pktDeinitPWMPool(radio_pwm_pool_t *pwm_pool);
+  void pktAdjustPWMPool(radio_pwm_pool_t *pwm_pool, bool idle);
+  bool pktGetPWMPoolStats(radio_unit_t radio, radio_pwm_pool_stats_t *copy);
+#endif
+#if USE_PWM_REPLAY == TRUE
+  bool pktStartPWMReplayI(ICUDriver *myICU);
+  void pktStopPWMReplayI(ICUDriver *myICU);
+  msg_t pktWritePWMReplayI(ICUDriver *myICU, byte_packed_pwm_t pack);
+#endif
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,503 @@
+/*
+    Aerospace Decoder - Copyright (C) 2018 Bob Anderson (VK2GJ)
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+/**
+ * @file    corr_f32.c
+ * @brief   CORR_F32 decoder implementation.
+ * @details The same BPF, IQ correlator and magnitude LPF chain as QCORR.
+ *          Filters run in float32 on the FPU so no rescaling is needed.
+ *
+ * @addtogroup DSP
+ * @{
+ */
+
+
+#include "pktconf.h"
+
+
+#if AFSK_DECODE_TYPE == AFSK_DSP_FCORR_DECODE
+
+/*===========================================================================*/
+/* Module local definitions.                                                 */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module exported variables.                                                */
+/*===========================================================================*/
+
+/* Allocate the decoder main structure and the tone bins. */
+fcorr_decoder_t FCORR[AFSK_NUM_DECODERS] useCCM;
+fcorr_tone_t fcorr_bins[AFSK_NUM_DECODERS][FCORR_FILTER_BINS] useCCM;
+
+/* Pre-filter FIR record. */
+ffir_filter_t AFSK_PWM_FFILTER[AFSK_NUM_DECODERS] useCCM;
+
+/*
+ * Allocate data for prefilter FIR.
+ */
+arm_fir_instance_f32 pre_filter_instance_f32[AFSK_NUM_DECODERS] useCCM;
+float32_t pre_filter_state_f32[AFSK_NUM_DECODERS][PRE_FILTER_BLOCK_SIZE
+                                  + PRE_FILTER_NUM_TAPS - 1] useCCM;
+float32_t pre_filter_coeff_rev_f32[PRE_FILTER_NUM_TAPS] useCCM;
+
+#if USE_FCORR_MAG_LPF == TRUE
+
+/* Allocate the FIR filter structures. */
+ffir_filter_t FFILT_M_MAG[AFSK_NUM_DECODERS] useCCM;
+ffir_filter_t FFILT_S_MAG[AFSK_NUM_DECODERS] useCCM;
+
+/*
+* Allocate data for mag FIR filter.
+*/
+float32_t mag_filter_coeff_rev_f32[MAG_FILTER_NUM_TAPS] useCCM;
+
+arm_fir_instance_f32 m_mag_filter_instance_f32[AFSK_NUM_DECODERS] useCCM;
+float32_t m_mag_filter_state_f32[AFSK_NUM_DECODERS][MAG_FILTER_BLOCK_SIZE
+                                + MAG_FILTER_NUM_TAPS - 1] useCCM;
+
+arm_fir_instance_f32 s_mag_filter_instance_f32[AFSK_NUM_DECODERS] useCCM;
+float32_t s_mag_filter_state_f32[AFSK_NUM_DECODERS][MAG_FILTER_BLOCK_SIZE
+                                + MAG_FILTER_NUM_TAPS - 1] useCCM;
+
+#endif /* USE_FCORR_MAG_LPF == TRUE */
+
+/* Mark and Space correlation filter instances. */
+ffir_filter_t FFILT_M_COS[AFSK_NUM_DECODERS] useCCM;
+ffir_filter_t FFILT_M_SIN[AFSK_NUM_DECODERS] useCCM;
+
+ffir_filter_t FFILT_S_COS[AFSK_NUM_DECODERS] useCCM;
+ffir_filter_t FFILT_S_SIN[AFSK_NUM_DECODERS] useCCM;
+
+/* f32 filter coefficient arrays. */
+float32_t m_cos_filter_coeff_f32[DECODE_FILTER_LENGTH] useCCM;
+float32_t m_sin_filter_coeff_f32[DECODE_FILTER_LENGTH] useCCM;
+float32_t s_cos_filter_coeff_f32[DECODE_FILTER_LENGTH] useCCM;
+float32_t s_sin_filter_coeff_f32[DECODE_FILTER_LENGTH] useCCM;
+
+/* f32 fir instance records. */
+arm_fir_instance_f32 m_cos_filter_instance_f32[AFSK_NUM_DECODERS] useCCM;
+arm_fir_instance_f32 m_sin_filter_instance_f32[AFSK_NUM_DECODERS] useCCM;
+arm_fir_instance_f32 s_cos_filter_instance_f32[AFSK_NUM_DECODERS] useCCM;
+arm_fir_instance_f32 s_sin_filter_instance_f32[AFSK_NUM_DECODERS] useCCM;
+
+/* f32 filter state arrays. */
+float32_t m_cos_filter_state_f32[AFSK_NUM_DECODERS][FCORR_FILTER_BLOCK_SIZE
+                                + DECODE_FILTER_LENGTH - 1] useCCM;
+float32_t m_sin_filter_state_f32[AFSK_NUM_DECODERS][FCORR_FILTER_BLOCK_SIZE
+                                + DECODE_FILTER_LENGTH - 1] useCCM;
+float32_t s_cos_filter_state_f32[AFSK_NUM_DECODERS][FCORR_FILTER_BLOCK_SIZE
+                                + DECODE_FILTER_LENGTH - 1] useCCM;
+float32_t s_sin_filter_state_f32[AFSK_NUM_DECODERS][FCORR_FILTER_BLOCK_SIZE
+                                + DECODE_FILTER_LENGTH - 1] useCCM;
+
+/*===========================================================================*/
+/* Module local types.                                                       */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module local variables.                                                   */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+/**
+ * @brief Calculate magnitudes.
+ * @notes The magnitudes are computed for the full sample block.
+ *
+ * @param[in] decoder   pointer to a @p fcorr_decoder_t structure.
+ */
+static void calc_fcorr_magnitude(fcorr_decoder_t *decoder) {
+  uint8_t i;
+  for(i = 0; i < decoder->number_bins; i++) {
+    fcorr_tone_t *myBin = &decoder->filter_bins[i];
+    float32_t cos[FCORR_FILTER_BLOCK_SIZE], sin[FCORR_FILTER_BLOCK_SIZE];
+    (void)arm_mult_f32(myBin->cos_out, myBin->cos_out, cos,
+                       FCORR_FILTER_BLOCK_SIZE);
+    (void)arm_mult_f32(myBin->sin_out, myBin->sin_out, sin,
+                       FCORR_FILTER_BLOCK_SIZE);
+    (void)arm_add_f32(cos, sin, myBin->raw_mag, FCORR_FILTER_BLOCK_SIZE);
+    uint16_t n;
+    for(n = 0; n < FCORR_FILTER_BLOCK_SIZE; n++)
+      myBin->raw_mag[n] = sqrtf(myBin->raw_mag[n]);
+  }
+}
+
+/**
+ * @brief Called to evaluate the tone strengths in the filters.
+ * @notes Hysteresis is applied such that an unclear result is no change.
+ * @post  The tone memory will be set to the current strongest at this sample.
+ *
+ * @param[in]   decoder    pointer to a @p fcorr_decoder_t structure.
+ * @param[in]   n          index of the sample within the processed block.
+ */
+static void evaluate_fcorr_tone(fcorr_decoder_t *decoder, uint16_t n) {
+  float32_t mark, space;
+#if USE_FCORR_MAG_LPF == TRUE
+  mark = decoder->filter_bins[AFSK_MARK_INDEX].filtered_mag[n];
+  space = decoder->filter_bins[AFSK_SPACE_INDEX].filtered_mag[n];
+#else
+  mark = decoder->filter_bins[AFSK_MARK_INDEX].raw_mag[n];
+  space = decoder->filter_bins[AFSK_SPACE_INDEX].raw_mag[n];
+#endif
+  float32_t delta = mark - space;
+  if(delta > decoder->hysteresis) {
+    /* Mark symbol dominant. */
+    decoder->current_demod = TONE_MARK;
+  } else if (delta < -decoder->hysteresis) {
+    /* Space symbol dominant. */
+    decoder->current_demod = TONE_SPACE;
+  }
+  /* Else don't change current_demod so it remains as prior. */
+
+#if AFSK_NUM_SLICERS > 1
+  /* Additional slicers compare with the space/mark gain applied. */
+  uint8_t i;
+  for(i = 0; i < AFSK_NUM_SLICERS - 1; i++) {
+    float32_t gain_space = space * decoder->slicer_space_gain[i];
+    delta = mark - gain_space;
+    if(delta > decoder->hysteresis) {
+      decoder->slicer_demod[i] = TONE_MARK;
+    } else if (delta < -decoder->hysteresis) {
+      decoder->slicer_demod[i] = TONE_SPACE;
+    }
+  }
+#endif
+}
+
+/**
+ * @brief Setup the correlation IQ filters.
+ *
+ * @param[in]   decoder   pointer to a @p fcorr_decoder_t structure.
+ */
+static void setup_fcorr_IQfilters(fcorr_decoder_t *decoder) {
+  /* Index of the filter instances for this decoder. */
+  uint8_t inst = decoder - FCORR;
+
+  /* Set tone frequencies. */
+  decoder->filter_bins[AFSK_MARK_INDEX].freq = AFSK_MARK_FREQUENCY;
+  decoder->filter_bins[AFSK_SPACE_INDEX].freq = AFSK_SPACE_FREQUENCY;
+
+  /* Set COS and SIN filters for Mark and Space. */
+  decoder->filter_bins[AFSK_MARK_INDEX].tone_filter[FCORR_COS_INDEX]
+                                                    = &FFILT_M_COS[inst];
+  decoder->filter_bins[AFSK_MARK_INDEX].tone_filter[FCORR_SIN_INDEX]
+                                                    = &FFILT_M_SIN[inst];
+  decoder->filter_bins[AFSK_SPACE_INDEX].tone_filter[FCORR_COS_INDEX]
+                                                     = &FFILT_S_COS[inst];
+  decoder->filter_bins[AFSK_SPACE_INDEX].tone_filter[FCORR_SIN_INDEX]
+                                                     = &FFILT_S_SIN[inst];
+
+  /* Temporary float coeff arrays. */
+  float32_t cos_table[decoder->decode_length];
+  float32_t sin_table[decoder->decode_length];
+
+  /* Calculate the IQ filter coefficients for Mark. */
+  float32_t norm_freq = (float32_t)AFSK_MARK_FREQUENCY
+      / (float32_t)decoder->sample_rate;
+  gen_fir_iqf(cos_table, sin_table, decoder->decode_length,
+              norm_freq, FCORR_IQ_WINDOW);
+
+  create_ffir_filter(&FFILT_M_COS[inst],
+    &m_cos_filter_instance_f32[inst],
+    DECODE_FILTER_LENGTH,
+    m_cos_filter_coeff_f32,
+    m_cos_filter_state_f32[inst],
+    FCORR_FILTER_BLOCK_SIZE,
+    cos_table);
+
+  create_ffir_filter(&FFILT_M_SIN[inst],
+    &m_sin_filter_instance_f32[inst],
+    DECODE_FILTER_LENGTH,
+    m_sin_filter_coeff_f32,
+    m_sin_filter_state_f32[inst],
+    FCORR_FILTER_BLOCK_SIZE,
+    sin_table);
+
+  /* Calculate the IQ filter coefficients for Space. */
+  norm_freq = (float32_t)AFSK_SPACE_FREQUENCY
+      / (float32_t)decoder->sample_rate;
+  gen_fir_iqf(cos_table, sin_table, decoder->decode_length,
+              norm_freq, FCORR_IQ_WINDOW);
+
+  create_ffir_filter(&FFILT_S_COS[inst],
+     &s_cos_filter_instance_f32[inst],
+     DECODE_FILTER_LENGTH,
+     s_cos_filter_coeff_f32,
+     s_cos_filter_state_f32[inst],
+     FCORR_FILTER_BLOCK_SIZE,
+     cos_table);
+
+  create_ffir_filter(&FFILT_S_SIN[inst],
+     &s_sin_filter_instance_f32[inst],
+     DECODE_FILTER_LENGTH,
+     s_sin_filter_coeff_f32,
+     s_sin_filter_state_f32[inst],
+     FCORR_FILTER_BLOCK_SIZE,
+     sin_table);
+}
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Resets the correlator state.
+ * @post    Filter state is reset.
+ * @post    Filter variables are reset.
+ *
+ * @param[in]   myDriver   pointer to a @p AFSKDemodDriver structure.
+ *
+ * @api
+ */
+void reset_fcorr_all(AFSKDemodDriver *myDriver) {
+  fcorr_decoder_t *decoder = myDriver->tone_decoder;
+  if(decoder->input_filter != NULL)
+    reset_ffir_filter(decoder->input_filter);
+  memset(decoder->preFilterOut, 0, sizeof(decoder->preFilterOut));
+
+  uint8_t i;
+  for(i = 0; i < decoder->number_bins; i++) {
+    fcorr_tone_t *myBin = &decoder->filter_bins[i];
+    if(myBin->mag_filter != NULL)
+      reset_ffir_filter(myBin->mag_filter);
+    if(myBin->tone_filter[FCORR_COS_INDEX] != NULL)
+      reset_ffir_filter(myBin->tone_filter[FCORR_COS_INDEX]);
+    if(myBin->tone_filter[FCORR_SIN_INDEX] != NULL)
+      reset_ffir_filter(myBin->tone_filter[FCORR_SIN_INDEX]);
+    memset(myBin->raw_mag, 0, sizeof(myBin->raw_mag));
+  }
+  decoder->block_fill = 0;
+  decoder->filter_valid = 0;
+
+  decoder->prior_demod = TONE_NONE;
+  decoder->current_demod = TONE_NONE;
+#if AFSK_NUM_SLICERS > 1
+  for(i = 0; i < AFSK_NUM_SLICERS - 1; i++)
+    decoder->slicer_demod[i] = TONE_NONE;
+#endif
+
+  decoder->symbol_pll = 0;
+}
+
+/**
+ * @brief   Called at each new sample to pre-process sample.
+ * @post    New sample is added to the pre-filter input block.
+ * @post    When the block is full the pre-filter is run over the block.
+ *
+ * @param[in] myDriver  pointer to driver structure.
+ * @param[in] sample    input binary value.
+ *
+ * @return  Status of the input block.
+ * @retval  true if the block was filled and the pre-filter output is ready.
+ * @retval  false if the block is still being filled.
+ *
+ * @api
+ */
+bool push_fcorr_sample(AFSKDemodDriver *myDriver, bit_t sample) {
+  fcorr_decoder_t *decoder = myDriver->tone_decoder;
+
+  decoder->input_block[decoder->block_fill] = decoder->sample_level[sample];
+  if(++decoder->block_fill < FCORR_FILTER_BLOCK_SIZE)
+    return false;
+  decoder->block_fill = 0;
+
+  apply_ffir_filter(decoder->input_filter, decoder->input_block,
+                    decoder->preFilterOut);
+  return true;
+}
+
+/**
+ * @brief   Called at each new pre-filter block to process correlation.
+ * @notes   The correlation filters are run for each tone and IQ phase.
+ * @notes   The magnitude of each tone is calculated and filtered.
+ *
+ * @param[in]   myDriver   pointer to a @p AFSKDemodDriver structure.
+ *
+ * @api
+ */
+void process_fcorr_block(AFSKDemodDriver *myDriver) {
+  fcorr_decoder_t *decoder = myDriver->tone_decoder;
+
+  AFSK_STATS_STAMP(corr_start);
+  uint8_t i;
+  for(i = 0; i < decoder->number_bins; i++) {
+    fcorr_tone_t *myBin = &decoder->filter_bins[i];
+    apply_ffir_filter(myBin->tone_filter[FCORR_COS_INDEX],
+                      decoder->preFilterOut, myBin->cos_out);
+    apply_ffir_filter(myBin->tone_filter[FCORR_SIN_INDEX],
+                      decoder->preFilterOut, myBin->sin_out);
+  }
+  AFSK_STATS_STAGE(myDriver, AFSK_STAGE_CORRELATE, corr_start);
+
+  /* Compute magnitude of bins. */
+  AFSK_STATS_STAMP(mag_start);
+  calc_fcorr_magnitude(decoder);
+
+#if USE_FCORR_MAG_LPF == TRUE
+  /* Filter magnitude. */
+  for(i = 0; i < decoder->number_bins; i++) {
+    apply_ffir_filter(decoder->filter_bins[i].mag_filter,
+                      decoder->filter_bins[i].raw_mag,
+                      decoder->filter_bins[i].filtered_mag);
+  }
+#endif
+  AFSK_STATS_STAGE(myDriver, AFSK_STAGE_MAGNITUDE, mag_start);
+}
+
+/**
+ * @brief   Called for each sample in a processed block.
+ * @notes   The comparative strength of symbol tones is evaluated and updated.
+ *
+ * @param[in]   myDriver   pointer to a @p AFSKDemodDriver structure.
+ * @param[in]   n          index of the sample within the processed block.
+ *
+ * @return      Status for sample
+ * @retval      false if the decoder output is not valid.
+ * @retval      true if the decoder output is valid.
+ *
+ * @api
+ */
+bool process_fcorr_output(AFSKDemodDriver *myDriver, uint16_t n) {
+  fcorr_decoder_t *decoder = myDriver->tone_decoder;
+
+  /* Wait for initial data to be valid from the filter chain. */
+#if USE_FCORR_MAG_LPF == TRUE
+  if(decoder->filter_valid < (PRE_FILTER_NUM_TAPS + DECODE_FILTER_LENGTH
+                              + MAG_FILTER_NUM_TAPS)) {
+#else
+  if(decoder->filter_valid < (PRE_FILTER_NUM_TAPS + DECODE_FILTER_LENGTH)) {
+#endif
+    ++decoder->filter_valid;
+    return false;
+  }
+
+  evaluate_fcorr_tone(decoder, n);
+  return true;
+}
+
+/**
+ * @brief       Checks the symbol timing.
+ *
+ * @param[in]   myDriver    pointer to AFSKDemodDriver structure.
+ *
+ * @return      Status for symbol timing.
+ * @retval      false if the symbol is not complete.
+ * @retval      true if the symbol is ready for HDLC detection.
+ *
+ * @api
+ */
+bool get_fcorr_symbol_timing(AFSKDemodDriver *myDriver) {
+  fcorr_decoder_t *decoder = myDriver->tone_decoder;
+
+  decoder->prior_pll = decoder->symbol_pll;
+  /* PLL increment is size of uint32_t / decimation rate. */
+  decoder->symbol_pll = (int32_t)((uint32_t)(decoder->symbol_pll)
+      + (UINT_MAX / SYMBOL_DECIMATION));
+  /*
+   * The symbol period is reached when the PLL counter wraps around.
+   */
+  return ((decoder->symbol_pll < 0) && (decoder->prior_pll > 0));
+}
+
+/**
+ * @brief Advances the symbol PLL timing.
+ * @notes If a frame start has not been detected a faster search rate is used.
+ *
+ * @param[in] myDriver    pointer to AFSKDemodDriver structure.
+ *
+ * @api
+ */
+void update_fcorr_pll(AFSKDemodDriver *myDriver) {
+  fcorr_decoder_t *decoder = myDriver->tone_decoder;
+
+  if(decoder->current_demod != decoder->prior_demod) {
+    decoder->prior_demod = decoder->current_demod;
+    pktAddAFSKPLLEdge(myDriver, decoder->symbol_pll);
+    if(myDriver->frame_state == FRAME_SEARCH) {
+      decoder->symbol_pll = (int32_t)((float32_t)decoder->symbol_pll
+          * FCORR_PLL_SEARCH_RATE);
+    } else {
+      decoder->symbol_pll = (int32_t)((float32_t)decoder->symbol_pll
+          * FCORR_PLL_LOCKED_RATE);
+    }
+  }
+}
+
+/**
+ * @brief   Called once to initialise the FCORR parameters.
+ *
+ * @param[in] myDriver  pointer to AFSKDemodDriver data structure.
+ *
+ *@api
+ */
+void init_fcorr_decoder(AFSKDemodDriver *myDriver) {
+  /* Assign the decoder record for this radio. */
+  uint8_t inst = pktGetAFSKDecoderIndex(myDriver);
+  fcorr_decoder_t *decoder = &FCORR[inst];
+
+  decoder->sample_rate = FILTER_SAMPLE_RATE;
+  decoder->decode_length = DECODE_FILTER_LENGTH;
+  decoder->number_bins = FCORR_FILTER_BINS;
+  decoder->filter_bins = fcorr_bins[inst];
+  decoder->hysteresis = FCORR_HYSTERESIS;
+  myDriver->tone_decoder = decoder;
+
+#if AFSK_NUM_SLICERS > 1
+  const float32_t gains[AFSK_NUM_SLICERS - 1] = AFSK_SLICER_SPACE_GAINS;
+  memcpy(decoder->slicer_space_gain, gains, sizeof(gains));
+#endif
+
+  /* Binary PWM maps to -h and +h filter input. */
+  decoder->sample_level[1] = FCORR_SAMPLE_LEVEL;
+  decoder->sample_level[0] = -FCORR_SAMPLE_LEVEL;
+
+  /* Create and attach the pre-filter. */
+  decoder->input_filter = &AFSK_PWM_FFILTER[inst];
+  create_ffir_filter(decoder->input_filter,
+    &pre_filter_instance_f32[inst],
+    PRE_FILTER_NUM_TAPS,
+    pre_filter_coeff_rev_f32,
+    pre_filter_state_f32[inst],
+    PRE_FILTER_BLOCK_SIZE,
+    pre_filter_coeff_f32);
+
+  /* Setup the decoder tone IQ filters. */
+  setup_fcorr_IQfilters(decoder);
+
+#if USE_FCORR_MAG_LPF == TRUE
+  /* Setup the IQ magnitude LPFs. */
+  decoder->filter_bins[AFSK_MARK_INDEX].mag_filter = &FFILT_M_MAG[inst];
+  decoder->filter_bins[AFSK_SPACE_INDEX].mag_filter = &FFILT_S_MAG[inst];
+  create_ffir_filter(&FFILT_M_MAG[inst],
+    &m_mag_filter_instance_f32[inst],
+    MAG_FILTER_NUM_TAPS,
+    mag_filter_coeff_rev_f32,
+    m_mag_filter_state_f32[inst],
+    MAG_FILTER_BLOCK_SIZE,
+    mag_filter_coeff_f32);
+
+  /* The reversed coefficients are shared by both magnitude filters. */
+  create_ffir_filter(&FFILT_S_MAG[inst],
+    &s_mag_filter_instance_f32[inst],
+    MAG_FILTER_NUM_TAPS,
+    mag_filter_coeff_rev_f32,
+    s_mag_filter_state_f32[inst],
+    MAG_FILTER_BLOCK_SIZE,
+    NULL);
+#else
+  decoder->filter_bins[AFSK_MARK_INDEX].mag_filter = NULL;
+  decoder->filter_bins[AFSK_SPACE_INDEX].mag_filter = NULL;
+#endif
+  reset_fcorr_all(myDriver);
+}
+
+#endif /* AFSK_DSP_FCORR_DECODE */
+
+/** @} */
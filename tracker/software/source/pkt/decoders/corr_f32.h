@@ -0,0 +1,119 @@
+/*
+    Aerospace Decoder - Copyright (C) 2018 Bob Anderson (VK2GJ)
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+/**
+ * @file    corr_f32.h
+ * @brief   Correlator using floating point.
+ *
+ * @addtogroup DSP
+ * @{
+ */
+
+#ifndef IO_DECODERS_FCORR_H_
+#define IO_DECODERS_FCORR_H_
+
+/*===========================================================================*/
+/* Module constants.                                                         */
+/*===========================================================================*/
+
+#define FCORR_FILTER_BINS           AFSK_NUM_TONES /* Set by AFSK header. */
+#define FCORR_FILTER_BLOCK_SIZE     AFSK_FILTER_BLOCK_SIZE
+
+#define FCORR_SAMPLE_LEVEL          1.0f
+#define FCORR_HYSTERESIS            0.01f
+
+#define FCORR_PLL_SEARCH_RATE       0.5f
+#define FCORR_PLL_LOCKED_RATE       0.75f
+
+#define FCORR_IQ_WINDOW             TD_WINDOW_CHEBYSCHEV
+
+/* Used for indexing of IQ filter sections. */
+#define FCORR_COS_INDEX             0U
+#define FCORR_SIN_INDEX             1U
+
+#define USE_FCORR_MAG_LPF           USE_QCORR_MAG_LPF
+
+/*===========================================================================*/
+/* Module pre-compile time settings.                                         */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Derived constants and error checks.                                       */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Correlation decoder bin (tone) structure.
+ *
+ * @note    Each bin is defined and maintains its specific parameters.
+ */
+typedef struct fTone {
+  uint16_t          freq;
+  ffir_filter_t     *tone_filter[AFSK_NUM_TONES];
+  ffir_filter_t     *mag_filter;
+  float32_t         raw_mag[FCORR_FILTER_BLOCK_SIZE];
+  float32_t         filtered_mag[FCORR_FILTER_BLOCK_SIZE];
+  float32_t         cos_out[FCORR_FILTER_BLOCK_SIZE];
+  float32_t         sin_out[FCORR_FILTER_BLOCK_SIZE];
+} fcorr_tone_t;
+
+/**
+ * @brief   Correlation decoder control structure.
+ *
+ */
+typedef struct fCorrFilter {
+  ffir_filter_t     *input_filter;
+  uint16_t          decode_length;
+  uint32_t          sample_rate;
+  float32_t         input_block[FCORR_FILTER_BLOCK_SIZE];
+  uint16_t          block_fill;
+  float32_t         preFilterOut[FCORR_FILTER_BLOCK_SIZE];
+  uint32_t          filter_valid;
+  uint8_t           number_bins;
+  fcorr_tone_t      *filter_bins;
+  float32_t         sample_level[2];
+  float32_t         hysteresis;
+  tone_t            prior_demod;
+  tone_t            current_demod;
+#if AFSK_NUM_SLICERS > 1
+  float32_t         slicer_space_gain[AFSK_NUM_SLICERS - 1];
+  tone_t            slicer_demod[AFSK_NUM_SLICERS - 1];
+#endif
+  int32_t           symbol_pll;
+  int32_t           prior_pll;
+} fcorr_decoder_t;
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  bool push_fcorr_sample(AFSKDemodDriver *myDriver, bit_t sample);
+  void process_fcorr_block(AFSKDemodDriver *myDriver);
+  bool process_fcorr_output(AFSKDemodDriver *myDriver, uint16_t n);
+  void reset_fcorr_all(AFSKDemodDriver *myDriver);
+  bool get_fcorr_symbol_timing(AFSKDemodDriver *myDriver);
+  void update_fcorr_pll(AFSKDemodDriver *myDriver);
+  void init_fcorr_decoder(AFSKDemodDriver *myDriver);
+#ifdef __cplusplus
+}
+#endif
+
+/*===========================================================================*/
+/* Module inline functions.                                                  */
+/*===========================================================================*/
+
+
+#endif /* IO_DECODERS_FCORR_H_ */
+
+/** @} */
@@ -24,87 +24,77 @@
 /* Module local definitions.                                                 */
 /*===========================================================================*/
 
+#if QCORR_USE_FLASH_COEFFS == TRUE
+#include "corr_q31_coeffs.h"
+
+#if QCORR_COEFF_DECIMATION != SYMBOL_DECIMATION                              \
+  || QCORR_COEFF_DECODE_DECIMATION != AFSK_DECODE_DECIMATION                 \
+  || QCORR_COEFF_PRE_TAPS != PRE_FILTER_NUM_TAPS                             \
+  || QCORR_COEFF_PRE_LOW != PRE_FILTER_LOW                                   \
+  || QCORR_COEFF_PRE_HIGH != PRE_FILTER_HIGH                                 \
+  || QCORR_COEFF_MARK != AFSK_MARK_FREQUENCY                                 \
+  || QCORR_COEFF_SPACE != AFSK_SPACE_FREQUENCY
+#error "QCORR coefficient tables do not match filter settings (make coeffs)"
+#endif
+
+#if USE_QCORR_MAG_LPF == TRUE && (QCORR_COEFF_MAG_TAPS != MAG_FILTER_NUM_TAPS \
+  || QCORR_COEFF_MAG_HIGH != MAG_FILTER_HIGH)
+#error "QCORR magnitude table does not match filter settings (make coeffs)"
+#endif
+
+#if REPORT_QCORR_COEFFS == TRUE
+#error "REPORT_QCORR_COEFFS requires QCORR_USE_FLASH_COEFFS set to FALSE"
+#endif
+#endif /* QCORR_USE_FLASH_COEFFS == TRUE */
+
 /*===========================================================================*/
 /* Module exported variables.                                                */
 /*===========================================================================*/
 
-/* Allocate the decoder main structure and the tone bins. */
-qcorr_decoder_t QCORR1 useCCM;
-qcorr_tone_t qcorr_bins[QCORR_FILTER_BINS] useCCM;
+/* Allocate the decoder main structure and the correlator block. */
+qcorr_decoder_t QCORR[AFSK_NUM_DECODERS] useCCM;
+qcorr_block_t QCORR_BLOCK[AFSK_NUM_DECODERS] useCCM;
 
 /**
  * @brief   AFSK_PWM_QFILTER pre-filter identifier.
  * @note    Allocate a pre-filter FIR record.
  */
 
-qfir_filter_t AFSK_PWM_QFILTER useCCM;
+qfir_filter_t AFSK_PWM_QFILTER[AFSK_NUM_DECODERS] useCCM;
 
 /*
  * Allocate data for prefilter FIR.
  */
-arm_fir_instance_q31 pre_filter_instance_q31 useCCM;
-q31_t pre_filter_state_q31[PRE_FILTER_BLOCK_SIZE
+arm_fir_instance_q31 pre_filter_instance_q31[AFSK_NUM_DECODERS] useCCM;
+q31_t pre_filter_state_q31[AFSK_NUM_DECODERS][PRE_FILTER_BLOCK_SIZE
                                   + PRE_FILTER_NUM_TAPS - 1] useCCM;
+#if QCORR_USE_FLASH_COEFFS != TRUE
 q31_t pre_filter_coeff_q31[PRE_FILTER_NUM_TAPS] useCCM;
+#endif
 
 #if USE_QCORR_MAG_LPF == TRUE
 
 /* Allocate the FIR filter structures. */
-qfir_filter_t QFILT_M_MAG useCCM;
-qfir_filter_t QFILT_S_MAG useCCM;
+qfir_filter_t QFILT_M_MAG[AFSK_NUM_DECODERS] useCCM;
+qfir_filter_t QFILT_S_MAG[AFSK_NUM_DECODERS] useCCM;
 
 /*
 * Allocate data for mag FIR filter.
 */
+#if QCORR_USE_FLASH_COEFFS != TRUE
 q31_t mag_filter_coeff_q31[MAG_FILTER_NUM_TAPS] useCCM;
+#endif
 
-arm_fir_instance_q31 m_mag_filter_instance_q31 useCCM;
-q31_t m_mag_filter_state_q31[MAG_FILTER_BLOCK_SIZE
+arm_fir_instance_q31 m_mag_filter_instance_q31[AFSK_NUM_DECODERS] useCCM;
+q31_t m_mag_filter_state_q31[AFSK_NUM_DECODERS][MAG_FILTER_BLOCK_SIZE
                                 + MAG_FILTER_NUM_TAPS - 1] useCCM;
 
-arm_fir_instance_q31 s_mag_filter_instance_q31 useCCM;
-q31_t s_mag_filter_state_q31[MAG_FILTER_BLOCK_SIZE
+arm_fir_instance_q31 s_mag_filter_instance_q31[AFSK_NUM_DECODERS] useCCM;
+q31_t s_mag_filter_state_q31[AFSK_NUM_DECODERS][MAG_FILTER_BLOCK_SIZE
                                 + MAG_FILTER_NUM_TAPS - 1] useCCM;
 
 #endif /* USE_QCORR_MAG_LPF == TRUE */
 
-/* Mark and Space correlation filter instances. */
-qfir_filter_t QFILT_M_COS useCCM;
-qfir_filter_t QFILT_M_SIN useCCM;
-
-qfir_filter_t QFILT_S_COS useCCM;
-qfir_filter_t QFILT_S_SIN useCCM;
-
-/*
-* Allocate data for Mark and Space correlation filters.
-*/
-
-/* q31 filter coefficient arrays. */
-q31_t m_cos_filter_coeff_q31[DECODE_FILTER_LENGTH] useCCM;
-q31_t m_sin_filter_coeff_q31[DECODE_FILTER_LENGTH] useCCM;
-q31_t s_cos_filter_coeff_q31[DECODE_FILTER_LENGTH] useCCM;
-q31_t s_sin_filter_coeff_q31[DECODE_FILTER_LENGTH] useCCM;
-
-/* q31 fir instance records. */
-arm_fir_instance_q31 m_cos_filter_instance_q31 useCCM;
-arm_fir_instance_q31 m_sin_filter_instance_q31 useCCM;
-arm_fir_instance_q31 s_cos_filter_instance_q31 useCCM;
-arm_fir_instance_q31 s_sin_filter_instance_q31 useCCM;
-
-#define QCORR_FILTER_BLOCK_SIZE 1U
-
-/* q31 filter state arrays. */
-q31_t m_cos_filter_state_q31[QCORR_FILTER_BLOCK_SIZE
-                                + DECODE_FILTER_LENGTH - 1] useCCM;
-q31_t m_sin_filter_state_q31[QCORR_FILTER_BLOCK_SIZE
-                                + DECODE_FILTER_LENGTH - 1] useCCM;
-q31_t s_cos_filter_state_q31[QCORR_FILTER_BLOCK_SIZE
-                                + DECODE_FILTER_LENGTH - 1] useCCM;
-q31_t s_sin_filter_state_q31[QCORR_FILTER_BLOCK_SIZE
-                                + DECODE_FILTER_LENGTH - 1] useCCM;
-
-
-
 /*===========================================================================*/
 /* Module local types.                                                       */
 /*===========================================================================*/
@@ -114,11 +104,70 @@ q31_t s_sin_filter_state_q31[QCORR_FILTER_BLOCK_SIZE
 /*===========================================================================*/
 
 /*===========================================================================*/
-/* Module exported functions.                                                */
+/* Module local functions.                                                   */
 /*===========================================================================*/
 
+/* The correlator kernel runs mark and space together. */
+#if QCORR_FILTER_BINS != 2
+#error "QCORR correlator kernel requires two tones"
+#endif
+
+/**
+ * @brief   Dual tone IQ correlator kernel.
+ * @note    The new samples are scaled down into the shared history.
+ * @note    Each history sample is loaded once per output and multiplied by
+ *          the cos and sin coefficients of mark and space.
+ * @note    Accumulation and output scaling are those of the fused FIR
+ *          kernel so the outputs are the same as four separate filters.
+ *
+ * @param[in] corr      pointer to a @p qcorr_block_t structure.
+ * @param[in] input     pointer to the pre-filter output block.
+ *
+ * @notapi
+ */
+static void qcorr_dual_kernel(qcorr_block_t *corr, const q31_t *input) {
+  q31_t *history = corr->history;
+  uint8_t scale = corr->scale;
+
+  /* Scaled new samples go at the end of the history. */
+  q31_t *pIn = &history[DECODE_FILTER_LENGTH - 1U];
+  uint16_t n;
+  for(n = 0; n < QCORR_DECODE_BLOCK_SIZE; n++) {
+    pIn[n] = input[n] >> scale;
+  }
+
+  for(n = 0; n < QCORR_DECODE_BLOCK_SIZE; n++) {
+    const q31_t *px = &history[n];
+    const q31_t (*pb)[2] = corr->coeffs[0];
+    q63_t mark_cos = 0, mark_sin = 0, space_cos = 0, space_sin = 0;
+    uint16_t k;
+    for(k = 0; k < DECODE_FILTER_LENGTH; k++) {
+      q63_t x = *px++;
+      mark_cos += x * pb[AFSK_MARK_INDEX][QCORR_COS_INDEX];
+      mark_sin += x * pb[AFSK_MARK_INDEX][QCORR_SIN_INDEX];
+      space_cos += x * pb[AFSK_SPACE_INDEX][QCORR_COS_INDEX];
+      space_sin += x * pb[AFSK_SPACE_INDEX][QCORR_SIN_INDEX];
+      pb += QCORR_FILTER_BINS;
+    }
+
+    /* Combine the 1.31 result shift with the scale up and saturate. */
+    corr->iq_out[AFSK_MARK_INDEX][QCORR_COS_INDEX][n] =
+        clip_q63_to_q31(mark_cos >> (31U - scale));
+    corr->iq_out[AFSK_MARK_INDEX][QCORR_SIN_INDEX][n] =
+        clip_q63_to_q31(mark_sin >> (31U - scale));
+    corr->iq_out[AFSK_SPACE_INDEX][QCORR_COS_INDEX][n] =
+        clip_q63_to_q31(space_cos >> (31U - scale));
+    corr->iq_out[AFSK_SPACE_INDEX][QCORR_SIN_INDEX][n] =
+        clip_q63_to_q31(space_sin >> (31U - scale));
+  }
+
+  /* Shift the history down ready for the next block. */
+  memmove(history, &history[QCORR_DECODE_BLOCK_SIZE],
+          (DECODE_FILTER_LENGTH - 1U) * sizeof(q31_t));
+}
+
 /*===========================================================================*/
-/* Module local functions.                                                   */
+/* Module exported functions.                                                */
 /*===========================================================================*/
 
 
@@ -136,7 +185,7 @@ void reset_qcorr_all(AFSKDemodDriver *driver) {
   qfir_filter_t *input_filter = decoder->input_filter;
   if(input_filter != NULL)
     (void)reset_qfir_filter(input_filter);
-  decoder->preFilterOut = 0;
+  memset(decoder->preFilterOut, 0, sizeof(decoder->preFilterOut));
 
   uint8_t i;
   for(i = 0; i < decoder->number_bins; i++) {
@@ -146,26 +195,39 @@ void reset_qcorr_all(AFSKDemodDriver *driver) {
     if(mag_filter != NULL)
     (void)reset_qfir_filter(mag_filter);
 
-    /* Reset the correlation filters. */
-    qcorr_tone_t *myBin = &decoder->filter_bins[i];
-    qfir_filter_t *myCosFilter = myBin->tone_filter[QCORR_COS_INDEX];
-    qfir_filter_t *mySinFilter = myBin->tone_filter[QCORR_SIN_INDEX];
-    if(myCosFilter != NULL)
-     (void)reset_qfir_filter(myCosFilter);
-    if(mySinFilter != NULL)
-     (void)reset_qfir_filter(mySinFilter);
-
-    decoder->filter_bins[i].raw_mag = 0;
+    memset(decoder->filter_bins[i].raw_mag, 0,
+           sizeof(decoder->filter_bins[i].raw_mag));
     decoder->filter_bins[i].mag = 0;
   } /* End for (number_bins). */
+
+  /* Reset the correlator history. */
+  memset(decoder->corr->history, 0, sizeof(decoder->corr->history));
+  decoder->block_fill = 0;
   decoder->current_n = 0;
   decoder->filter_valid = 0;
 
   decoder->prior_demod = TONE_NONE;
   decoder->current_demod = TONE_NONE;
+#if QCORR_USE_TONE_EQ == TRUE
+  decoder->eq_mark_level = 0;
+  decoder->eq_space_level = 0;
+  decoder->eq_mark_scale = INT32_MAX;
+  decoder->eq_space_scale = INT32_MAX;
+  decoder->eq_hold = false;
+#endif
+#if AFSK_NUM_SLICERS > 1
+  for(i = 0; i < AFSK_NUM_SLICERS - 1; i++)
+    decoder->slicer_demod[i] = TONE_NONE;
+#endif
 
 #if  USE_QCORR_FRACTIONAL_PLL == TRUE
   decoder->symbol_pll = 0/*(int32_t)-1*/;
+#if QCORR_USE_WEIGHTED_PLL == TRUE
+  decoder->pll_freq = 0;
+  decoder->prior_delta = 0;
+  decoder->delta_level = 0;
+  decoder->edge_weight = 1.0f;
+#endif
 #else
   decoder->search_rate = 0;
   decoder->phase_correction = 0;
@@ -186,112 +248,128 @@ void reset_qcorr_all(AFSKDemodDriver *driver) {
 
 /**
  * @brief   Called at each new sample to pre-process sample.
- * @post    New sample applied to pre-filter input.
- * @post    Latest output from pre-filter computed.
- * @note    Latest output value is saved in filter object.
+ * @post    New sample is added to the pre-filter input block.
+ * @post    When the block is full the pre-filter is run over the block.
+ * @note    Latest output block is saved in decoder object.
  *
  * @param[in] myDriver  pointer to driver structure.
  * @param[in] sample    input binary value.
  *
- * @retrun  Latest sample output from filter.
- * @retval  Re-scaled q31 value from filter.
+ * @return  Status of the input block.
+ * @retval  true if the block was filled and the pre-filter output is ready.
+ * @retval  false if the block is still being filled.
  *
  * @api
  */
-q31_t push_qcorr_sample(AFSKDemodDriver *myDriver, bit_t sample) {
+bool push_qcorr_sample(AFSKDemodDriver *myDriver, bit_t sample) {
   qcorr_decoder_t *decoder = myDriver->tone_decoder;
   qfir_filter_t *myFilter = decoder->input_filter;
 
-  apply_qfir_filter(myFilter, &decoder->sample_level[sample],
-                    &decoder->preFilterOut);
+  decoder->input_block[decoder->block_fill] = decoder->sample_level[sample];
+  if(++decoder->block_fill < QCORR_FILTER_BLOCK_SIZE)
+    return false;
+  decoder->block_fill = 0;
+
+  apply_qfir_filter(myFilter, decoder->input_block, decoder->preFilterOut);
 #if AFSK_DEBUG_TYPE == AFSK_QCORR_FIR_DEBUG
-    char buf[80];
-    int out = chsnprintf(buf, sizeof(buf), "%X\r\n", scaledOut);
+  char buf[80];
+  uint16_t n;
+  for(n = 0; n < QCORR_DECODE_BLOCK_SIZE; n++) {
+    int out = chsnprintf(buf, sizeof(buf), "%X\r\n", decoder->preFilterOut[n]);
     pktWrite( (uint8_t *)buf, out);
+  }
 #endif
-
-  /*
-   * Return most recent filter output.
-   */
-  return decoder->preFilterOut;
+  return true;
 }
 
 /**
- * @brief   Called at each new sample to process correlation.
- * @notes   The correlation filters are run for each tone and IQ phase.
- * @notes   The magnitude of each tone is calculated.
- * @notes   The comparative strength of symbol tones is evaluated and updated.
- * @notes   If the symbol is complete then HDLC decoding is enabled.
+ * @brief   Called at each new pre-filter block to process correlation.
+ * @notes   The IQ correlation of both tones is run in a single pass.
+ * @notes   The magnitude of each tone is calculated and filtered.
+ * @notes   Tone evaluation is done per sample in process_qcorr_output().
  *
  * @param[in]   myDriver   pointer to a @p AFSKDemodDriver structure.
  *
- * @return      Status for symbol
- * @retval      false if the decoder output is not valid.
- * @retval      true if the decoder output is valid.
- *
+ * @api
  */
-bool process_qcorr_output(AFSKDemodDriver *myDriver) {
+void process_qcorr_block(AFSKDemodDriver *myDriver) {
   qcorr_decoder_t *decoder = myDriver->tone_decoder;
 
   /*
-   * The decoder structure contains the filtered and scaled sample.
+   * The decoder structure contains the filtered and scaled sample block.
   */
 
-  uint8_t i;
+  AFSK_STATS_STAMP(corr_start);
+  qcorr_dual_kernel(decoder->corr, decoder->preFilterOut);
 
+#if AFSK_DEBUG_TYPE == AFSK_QCORR_DEC_CS_DEBUG
+  uint8_t i;
   for(i = 0; i < decoder->number_bins; i++) {
-    qcorr_tone_t *myBin = &decoder->filter_bins[i];
-    qfir_filter_t *myCosFilter = myBin->tone_filter[QCORR_COS_INDEX];
-    qfir_filter_t *mySinFilter = myBin->tone_filter[QCORR_SIN_INDEX];
-
-    /*
-     * Run correlation for bin.
-     */
-    apply_qfir_filter(myCosFilter, &decoder->preFilterOut, &myBin->cos_out);
+    q31_t *cos_out = decoder->corr->iq_out[i][QCORR_COS_INDEX];
+    q31_t *sin_out = decoder->corr->iq_out[i][QCORR_SIN_INDEX];
+    char buf[200];
+    uint16_t n;
+    for(n = 0; n < QCORR_DECODE_BLOCK_SIZE; n++) {
+      int out = chsnprintf(buf, sizeof(buf), "%i, %i, %i\r\n", i,
+                           cos_out[n], sin_out[n]);
+      pktWrite( (uint8_t *)buf, out);
+    }
+  }
+#endif
 
-    apply_qfir_filter(mySinFilter, &decoder->preFilterOut, &myBin->sin_out);
+  AFSK_STATS_STAGE(myDriver, AFSK_STAGE_CORRELATE, corr_start);
 
+  /* Compute magnitude of bins. */
+  AFSK_STATS_STAMP(mag_start);
+  calc_qcorr_magnitude(myDriver);
 
-#if AFSK_DEBUG_TYPE == AFSK_QCORR_DEC_CS_DEBUG
-    char buf[200];
-    if(i == 0) {
-    int out =chsnprintf(buf, sizeof(buf), "%i, %i, ",
-      myBin->cos_out, myBin->sin_out);
-    } else {
-      int out = chsnprintf(buf, sizeof(buf), "%i, %i\r\n",
-        myBin->cos_out, myBin->sin_out);
-    }
-    pktWrite( (uint8_t *)buf, out);
+  /* Filter magnitude. */
+#if USE_QCORR_MAG_LPF == TRUE
+  filter_qcorr_magnitude(myDriver);
 #endif
-  }
+  AFSK_STATS_STAGE(myDriver, AFSK_STAGE_MAGNITUDE, mag_start);
+}
+
+/**
+ * @brief   Called for each sample in a processed block.
+ * @notes   The comparative strength of symbol tones is evaluated and updated.
+ * @notes   If the output is valid then symbol timing and HDLC can proceed.
+ *
+ * @param[in]   myDriver   pointer to a @p AFSKDemodDriver structure.
+ * @param[in]   n          index of the sample within the processed block.
+ *
+ * @return      Status for sample
+ * @retval      false if the decoder output is not valid.
+ * @retval      true if the decoder output is valid.
+ *
+ * @api
+ */
+bool process_qcorr_output(AFSKDemodDriver *myDriver, uint16_t n) {
+  qcorr_decoder_t *decoder = myDriver->tone_decoder;
 
   /*
    * Wait for initial data to be valid from pre-filter.
    * TODO: Review validity of this since and the next delay.
    */
   if(++decoder->filter_valid <
-      PRE_FILTER_NUM_TAPS + DECODE_FILTER_LENGTH)
+      (PRE_FILTER_NUM_TAPS / AFSK_DECODE_DECIMATION) + DECODE_FILTER_LENGTH)
     return false;
 
-  /* Compute magnitude of bins. */
-  calc_qcorr_magnitude(myDriver);
-
-  /* Filter magnitude. */
 #if USE_QCORR_MAG_LPF == TRUE
-  filter_qcorr_magnitude(myDriver);
   /* Further delay result by mag filter size. */
   if(decoder->filter_valid <
       (decoder->input_filter->filter_instance->numTaps
-          + MAG_FILTER_NUM_TAPS))
+          / AFSK_DECODE_DECIMATION + MAG_FILTER_NUM_TAPS))
           return false;
 #endif
 
 #if AFSK_DEBUG_TYPE == AFSK_QCORR_DATA_DEBUG
   char buf[200];
+  uint8_t i;
   for(i = 0; i < decoder->number_bins; i++) {
     int out = chsnprintf(buf, sizeof(buf),
       "BIN %i mag %i N %i N%% %i\r\n",
-      i, decoder->filter_bins[i].mag,
+      i, decoder->filter_bins[i].filtered_mag[n],
       decoder->current_n,
       decoder->current_n % decoder->decode_length);
     pktWrite( (uint8_t *)buf, out);
@@ -299,7 +377,7 @@ bool process_qcorr_output(AFSKDemodDriver *myDriver) {
 #endif
 
   /* Do magnitude comparison on tone bins and save results. */
-  evaluate_qcorr_tone(myDriver);
+  evaluate_qcorr_tone(myDriver, n);
 
   return true;
 }
@@ -320,9 +398,14 @@ bool get_qcorr_symbol_timing(AFSKDemodDriver *myDriver) {
 
 #if USE_QCORR_FRACTIONAL_PLL == TRUE
   decoder->prior_pll = decoder->symbol_pll;
-  /* PLL increment is size of uint32_t / decimation rate. */
-#define PLL_INCREMENT (UINT_MAX / SYMBOL_DECIMATION)
+  /* PLL increment is size of uint32_t / samples per symbol at decode rate. */
+#define PLL_INCREMENT (UINT_MAX / DECODE_SYMBOL_SAMPLES)
+#if QCORR_USE_WEIGHTED_PLL == TRUE
+  decoder->symbol_pll = (int32_t)((uint32_t)(decoder->symbol_pll)
+      + PLL_INCREMENT + decoder->pll_freq);
+#else
   decoder->symbol_pll = (int32_t)((uint32_t)(decoder->symbol_pll) + PLL_INCREMENT);
+#endif
   /*
    * Check if the symbol period was reached and return status.
    * The symbol period is reached when the PLL counter wraps around.
@@ -333,7 +416,7 @@ bool get_qcorr_symbol_timing(AFSKDemodDriver *myDriver) {
    * Calculate current phase point in symbol.
    */
   uint8_t symbol_phase = (decoder->current_n + decoder->phase_correction)
-      % SYMBOL_DECIMATION/*myDriver->decimation_slices*/;
+      % DECODE_SYMBOL_SAMPLES/*myDriver->decimation_slices*/;
 
   return (symbol_phase == 0);
 #endif
@@ -345,6 +428,8 @@ bool get_qcorr_symbol_timing(AFSKDemodDriver *myDriver) {
  * @notes If a frame start has not been detected a faster search rate is used.
  * @notes This aids in finding the HDLC sync point as soon as possible.
  * @notea After HDLC frame start has been found the PLL search rate is reduced.
+ * @notes With QCORR_USE_WEIGHTED_PLL the correction is scaled by the
+ *        transition confidence and the PLL rate follows the sender.
  *
  * @param[in] myDriver    pointer to AFSKDemodDriver structure.
  *
@@ -360,6 +445,28 @@ void update_qcorr_pll(AFSKDemodDriver *myDriver) {
     /* Update tone state. */
     decoder->prior_demod = decoder->current_demod;
 #if USE_QCORR_FRACTIONAL_PLL == TRUE
+    pktAddAFSKPLLEdge(myDriver, decoder->symbol_pll);
+#if QCORR_USE_WEIGHTED_PLL == TRUE
+    float32_t weight = decoder->edge_weight;
+    float32_t error = (float32_t)decoder->symbol_pll;
+    if(myDriver->frame_state == FRAME_SEARCH) {
+      /* The rate offset is learnt from the flags of each frame. */
+      decoder->pll_freq = 0;
+      decoder->symbol_pll = (int32_t)(error
+          * (1.0f - (1.0f - QCORR_PLL_SEARCH_RATE) * weight));
+    } else {
+      /* A late transition (positive phase) means the sender is slower. */
+      float32_t freq = (float32_t)decoder->pll_freq
+          - error * QCORR_PLL_FREQ_GAIN * weight;
+      if(freq > QCORR_PLL_FREQ_LIMIT * PLL_INCREMENT)
+        freq = QCORR_PLL_FREQ_LIMIT * PLL_INCREMENT;
+      else if(freq < -QCORR_PLL_FREQ_LIMIT * PLL_INCREMENT)
+        freq = -QCORR_PLL_FREQ_LIMIT * PLL_INCREMENT;
+      decoder->pll_freq = (int32_t)freq;
+      decoder->symbol_pll = (int32_t)(error
+          * (1.0f - (1.0f - QCORR_PLL_LOCKED_RATE) * weight));
+    }
+#else
     if(myDriver->frame_state == FRAME_SEARCH) {
       decoder->symbol_pll = (int32_t)((float32_t)decoder->symbol_pll
           * QCORR_PLL_SEARCH_RATE);
@@ -367,6 +474,7 @@ void update_qcorr_pll(AFSKDemodDriver *myDriver) {
       decoder->symbol_pll = (int32_t)((float32_t)decoder->symbol_pll
           * QCORR_PLL_LOCKED_RATE);
     }
+#endif
   }
 #else
 
@@ -380,7 +488,7 @@ void update_qcorr_pll(AFSKDemodDriver *myDriver) {
      * After CIC filtering the delta is applied to phase correction at symbol end.
      */
       decoder->phase_delta = (decoder->current_n % decoder->decode_length)
-          - SYMBOL_DECIMATION;
+          - DECODE_SYMBOL_SAMPLES;
 
   }
   /* Filter current sample count has already been updated. */
@@ -399,7 +507,7 @@ void placeholder_qcorr_pll(AFSKDemodDriver *myDriver) {
    * Calculate current phase point in symbol.
    */
   uint8_t symbol_phase = (decoder->current_n + decoder->phase_correction)
-      % SYMBOL_DECIMATION/*myDriver->decimation_slices*/;
+      % DECODE_SYMBOL_SAMPLES/*myDriver->decimation_slices*/;
   /*
    * If a symbol end has been reached then process.
    */
@@ -453,13 +561,13 @@ void placeholder_qcorr_pll(AFSKDemodDriver *myDriver) {
       if((decoder->search_rate > 32) && (decoder->search_rate % 8 == 0)) {
           decoder->phase_correction =
           (decoder->phase_correction + QCORR_PHASE_SEARCH)
-          % SYMBOL_DECIMATION;
+          % DECODE_SYMBOL_SAMPLES;
       }*/
     }
     //return true;
     return;
   }
-  if(symbol_phase == (SYMBOL_DECIMATION / 2)) {
+  if(symbol_phase == (DECODE_SYMBOL_SAMPLES / 2)) {
     /*
      * Update the phase correction at the center of the symbol time.
      * This ensures that a symbol end is not re-detected or missed.
@@ -475,8 +583,16 @@ void placeholder_qcorr_pll(AFSKDemodDriver *myDriver) {
 }
 #endif /* #if USE_QCORR_FRACTIONAL_PLL == TRUE */
 
+#if QCORR_MAG_TYPE == QCORR_MAG_AMBM
+/* Alpha max plus beta min coefficients for least peak error. */
+#define QCORR_AMBM_ALPHA    ((q63_t)(0.96043387f * 2147483648.0f))
+#define QCORR_AMBM_BETA     ((q63_t)(0.39782473f * 2147483648.0f))
+#endif
+
 /**
  * @brief Calculate magnitudes.
+ * @notes The magnitudes are computed for the full sample block.
+ * @notes With QCORR_MAG_POWER the squared magnitudes are output.
  *
  * @param[in] myDriver    pointer to AFSKDemodDriver structure.
  *
@@ -490,57 +606,69 @@ void calc_qcorr_magnitude(AFSKDemodDriver *myDriver) {
   /* Compute magnitude of each bin. */
   for(i = 0; i < decoder->number_bins; i++) {
     qcorr_tone_t *myBin = &decoder->filter_bins[i];
+    q31_t *cos_out = decoder->corr->iq_out[i][QCORR_COS_INDEX];
+    q31_t *sin_out = decoder->corr->iq_out[i][QCORR_SIN_INDEX];
+    uint16_t n;
+#if QCORR_MAG_TYPE == QCORR_MAG_AMBM
+    for(n = 0; n < QCORR_DECODE_BLOCK_SIZE; n++) {
+      q63_t c = cos_out[n];
+      q63_t s = sin_out[n];
+      c = (c < 0) ? -c : c;
+      s = (s < 0) ? -s : s;
+      q63_t mag = (c > s) ? (c * QCORR_AMBM_ALPHA + s * QCORR_AMBM_BETA)
+                          : (s * QCORR_AMBM_ALPHA + c * QCORR_AMBM_BETA);
+      mag >>= 31;
+      myBin->raw_mag[n] = (mag > INT32_MAX) ? INT32_MAX : (q31_t)mag;
+    }
+#else
 #ifdef QCORR_MAG_USE_FLOAT
-    float32_t cos, sin, mag2;
-    q31_t mag;
-    (void)arm_q31_to_float(&myBin->cos_out, &cos, 1);
-    (void)arm_q31_to_float(&myBin->sin_out, &sin, 1);
-    mag2 = (cos * cos + sin * sin);
-    //mag2 = cos2 + sin2;
-    (void)arm_float_to_q31(&mag2, &mag, 1);
-    arm_status status = arm_sqrt_q31(mag, &mag);
-    if(status == ARM_MATH_SUCCESS) {
-      /* Update raw bin magnitude. */
-      decoder->filter_bins[i].raw_mag = mag;
-    } else { /* arm_sqrt_q31 failed. */
-#if AFSK_ERROR_TYPE == AFSK_SQRT_ERROR
-      char buf[200];
-      int out = chsnprintf(buf, sizeof(buf),                                 \
-        "MAG SQRT failed bin %i, cosQ %X, sinQ %X, cos %f, sin %f, mag2 %f, mag %X, index %i\r\n",                                              \
-        i, myBin->cos_out, myBin->sin_out, cos, sin, mag2, raw_mag, decoder->current_n);
-      pktWrite( (uint8_t *)buf, out);
-#endif /* AFSK_ERROR_TYPE == AFSK_SQRT_ERROR */
-
+    float32_t cos[QCORR_DECODE_BLOCK_SIZE], sin[QCORR_DECODE_BLOCK_SIZE];
+    float32_t mag2[QCORR_DECODE_BLOCK_SIZE];
+    q31_t mag[QCORR_DECODE_BLOCK_SIZE];
+    (void)arm_q31_to_float(cos_out, cos, QCORR_DECODE_BLOCK_SIZE);
+    (void)arm_q31_to_float(sin_out, sin, QCORR_DECODE_BLOCK_SIZE);
+    for(n = 0; n < QCORR_DECODE_BLOCK_SIZE; n++)
+      mag2[n] = (cos[n] * cos[n] + sin[n] * sin[n]);
+    (void)arm_float_to_q31(mag2, mag, QCORR_DECODE_BLOCK_SIZE);
+#else
+    q31_t mag[QCORR_DECODE_BLOCK_SIZE];
+    q31_t cos[QCORR_DECODE_BLOCK_SIZE], sin[QCORR_DECODE_BLOCK_SIZE];
+    (void)arm_mult_q31(cos_out, cos_out, cos,
+                       QCORR_DECODE_BLOCK_SIZE);
+    (void)arm_mult_q31(sin_out, sin_out, sin,
+                       QCORR_DECODE_BLOCK_SIZE);
+    (void)arm_add_q31(cos, sin, mag, QCORR_DECODE_BLOCK_SIZE);
+#endif /* QCORR_MAG_USE_FLOAT */
+#if QCORR_MAG_TYPE == QCORR_MAG_POWER
+    for(n = 0; n < QCORR_DECODE_BLOCK_SIZE; n++)
+      myBin->raw_mag[n] = mag[n];
 #else
-      q31_t mag2, mag, cos, sin;
-      (void)arm_mult_q31(&myBin->cos_out, &myBin->cos_out, &cos, 1);
-      (void)arm_mult_q31(&myBin->sin_out, &myBin->sin_out, &sin, 1);
-      (void)arm_add_q31(&cos, &sin, &mag2, 1);
-      arm_status status = arm_sqrt_q31(mag2, &mag);
+    for(n = 0; n < QCORR_DECODE_BLOCK_SIZE; n++) {
+      arm_status status = arm_sqrt_q31(mag[n], &mag[n]);
       if(status == ARM_MATH_SUCCESS) {
         /* Update raw bin magnitude. */
-        decoder->filter_bins[i].raw_mag = mag;
+        myBin->raw_mag[n] = mag[n];
       } else { /* arm_sqrt_q31 failed. */
-  #if AFSK_ERROR_TYPE == AFSK_QSQRT_ERROR
+#if AFSK_ERROR_TYPE == AFSK_QSQRT_ERROR
         char buf[200];
         int out = chsnprintf(buf, sizeof(buf),
-          "MAG SQRT failed bin %i, cosQ %X, sinQ %X, cos %X, sin %X,"
-          "mag2 %X, mag %X, index %i\r\n",
-          i, myBin->cos_out, myBin->sin_out, cos, sin, mag2,
-          decoder->filter_bins[i].raw_mag, decoder->current_n);
+          "MAG SQRT failed bin %i, cosQ %X, sinQ %X, mag2 %X,"
+          " mag %X, index %i\r\n",
+          i, cos_out[n], sin_out[n], mag[n],
+          myBin->raw_mag[n], decoder->current_n);
         pktWrite( (uint8_t *)buf, out);
-  #endif /* AFSK_ERROR_TYPE == AFSK_SQRT_ERROR */
-#endif /* QCORR_MAG_USE_FLOAT */
+#endif /* AFSK_ERROR_TYPE == AFSK_QSQRT_ERROR */
+      }
     }
+#endif /* QCORR_MAG_TYPE == QCORR_MAG_POWER */
+#endif /* QCORR_MAG_TYPE == QCORR_MAG_AMBM */
 #if AFSK_DEBUG_TYPE == AFSK_QCORR_DEC_MAG_DEBUG
-    char buf[200];
-    int out;
-    if(i == 0) {
-      out = chsnprintf(buf, sizeof(buf), "%i, ", raw_mag);
-    } else {
-      out = chsnprintf(buf, sizeof(buf), "%i\r\n", raw_mag);
+    for(n = 0; n < QCORR_DECODE_BLOCK_SIZE; n++) {
+      char buf[200];
+      int out;
+      out = chsnprintf(buf, sizeof(buf), "%i, %i\r\n", i, myBin->raw_mag[n]);
+      pktWrite( (uint8_t *)buf, out);
     }
-    pktWrite( (uint8_t *)buf, out);
 #endif
   }
 }
@@ -557,30 +685,82 @@ void filter_qcorr_magnitude(AFSKDemodDriver *myDriver) {
   uint8_t i;
   for(i = 0; i < decoder->number_bins; i++) {
     /*
-     * Filter the magnitude and compute next output sample.
+     * Filter the magnitude block and compute next output block.
      */
 
     apply_qfir_filter(decoder->filter_bins[i].mag_filter,
-                      &decoder->filter_bins[i].raw_mag,
-                      &decoder->filter_bins[i].filtered_mag);
+                      decoder->filter_bins[i].raw_mag,
+                      decoder->filter_bins[i].filtered_mag);
 
 #if AFSK_DEBUG_TYPE == AFSK_QCORR_DEC_MFIL_DEBUG
     char buf[200];
-    int out;
-    if(i == 0) {
-      out = chsnprintf(buf, sizeof(buf), "%i, %i, ",
-                       decoder->filter_bins[i].raw_mag,
-                       decoder->filter_bins[i].filtered_mag);
-    } else {
-      out = chsnprintf(buf, sizeof(buf), "%i, %i\r\n",
-                       decoder->filter_bins[i].raw_mag,
-                       decoder->filter_bins[i].filtered_mag);
+    uint16_t n;
+    for(n = 0; n < QCORR_DECODE_BLOCK_SIZE; n++) {
+      int out = chsnprintf(buf, sizeof(buf), "%i, %i, %i\r\n", i,
+                           decoder->filter_bins[i].raw_mag[n],
+                           decoder->filter_bins[i].filtered_mag[n]);
+      pktWrite( (uint8_t *)buf, out);
     }
-    pktWrite( (uint8_t *)buf, out);
 #endif
   }
 }
 
+#if QCORR_USE_TONE_EQ == TRUE
+/**
+ * @brief Track the tone levels for the equaliser.
+ * @notes The dominant tone of the sample updates its level.
+ * @notes The scales are unity while tracking.
+ *
+ * @param[in]   decoder   pointer to a @p qcorr_decoder_t structure.
+ * @param[in]   mark      mark tone magnitude.
+ * @param[in]   space     space tone magnitude.
+ *
+ */
+static void track_qcorr_eq(qcorr_decoder_t *decoder, q31_t mark,
+                           q31_t space) {
+  if(mark > space)
+    decoder->eq_mark_level += (mark - decoder->eq_mark_level)
+        >> QCORR_EQ_SHIFT;
+  else
+    decoder->eq_space_level += (space - decoder->eq_space_level)
+        >> QCORR_EQ_SHIFT;
+  decoder->eq_hold = false;
+  decoder->eq_mark_scale = INT32_MAX;
+  decoder->eq_space_scale = INT32_MAX;
+}
+
+/**
+ * @brief Hold the tone equaliser for a frame.
+ * @post  The stronger tone is scaled towards the level of the weaker.
+ *
+ * @param[in]   decoder   pointer to a @p qcorr_decoder_t structure.
+ *
+ */
+static void hold_qcorr_eq(qcorr_decoder_t *decoder) {
+  decoder->eq_hold = true;
+  if(decoder->eq_mark_level <= 0 || decoder->eq_space_level <= 0)
+    return;
+  float32_t ratio = (float32_t)decoder->eq_space_level
+      / (float32_t)decoder->eq_mark_level;
+#if QCORR_MAG_TYPE == QCORR_MAG_POWER
+  /* Levels are power so the amplitude limit is squared. */
+  const float32_t min_scale = QCORR_EQ_MIN_SCALE * QCORR_EQ_MIN_SCALE;
+#else
+  const float32_t min_scale = QCORR_EQ_MIN_SCALE;
+#endif
+  if(ratio < 1.0f) {
+    if(ratio < min_scale)
+      ratio = min_scale;
+    decoder->eq_mark_scale = (q31_t)(ratio * 2147483648.0f);
+  } else {
+    ratio = 1.0f / ratio;
+    if(ratio < min_scale)
+      ratio = min_scale;
+    decoder->eq_space_scale = (q31_t)(ratio * 2147483648.0f);
+  }
+}
+#endif
+
 /**
  * @brief Called to evaluate the tone strengths in the filters.
  * @notes Hysteresis is applied such that an unclear result is no change.
@@ -588,9 +768,10 @@ void filter_qcorr_magnitude(AFSKDemodDriver *myDriver) {
  * @post  The tone memory will be set to the current strongest at this sample.
  *
  * @param[in]   myDriver   pointer to a @p AFSKDemodDriver structure.
+ * @param[in]   n          index of the sample within the processed block.
  *
  */
-void evaluate_qcorr_tone(AFSKDemodDriver *myDriver) {
+void evaluate_qcorr_tone(AFSKDemodDriver *myDriver, uint16_t n) {
   qcorr_decoder_t *myDecoder = (qcorr_decoder_t *)myDriver->tone_decoder;
   q31_t mark, space;
   q31_t delta;
@@ -600,13 +781,29 @@ void evaluate_qcorr_tone(AFSKDemodDriver *myDriver) {
    */
 
 #if USE_QCORR_MAG_LPF == TRUE
-  mark = myDecoder->filter_bins[AFSK_MARK_INDEX].filtered_mag;
-  space = myDecoder->filter_bins[AFSK_SPACE_INDEX].filtered_mag;
+  mark = myDecoder->filter_bins[AFSK_MARK_INDEX].filtered_mag[n];
+  space = myDecoder->filter_bins[AFSK_SPACE_INDEX].filtered_mag[n];
+#else
+  mark = myDecoder->filter_bins[AFSK_MARK_INDEX].raw_mag[n];
+  space = myDecoder->filter_bins[AFSK_SPACE_INDEX].raw_mag[n];
+#endif
+#if QCORR_USE_TONE_EQ == TRUE
+  /* Track the tone levels until the first byte of a frame. */
+  if(myDriver->frame_state == FRAME_SEARCH
+      || (myDriver->frame_state == FRAME_OPEN
+      && myDriver->packet_handler->active_packet_object->packet_size == 0))
+    track_qcorr_eq(myDecoder, mark, space);
+  else if(!myDecoder->eq_hold)
+    hold_qcorr_eq(myDecoder);
+  /* Filter undershoot can take a level negative so the difference is clipped. */
+  delta = clip_q63_to_q31((((q63_t)mark * myDecoder->eq_mark_scale) >> 31)
+      - (((q63_t)space * myDecoder->eq_space_scale) >> 31));
 #else
-  mark = myDecoder->filter_bins[AFSK_MARK_INDEX].raw_mag;
-  space = myDecoder->filter_bins[AFSK_SPACE_INDEX].raw_mag;
+  delta = clip_q63_to_q31((q63_t)mark - space);
+#endif
+#if USE_QCORR_FRACTIONAL_PLL == TRUE && QCORR_USE_WEIGHTED_PLL == TRUE
+  tone_t prior = myDecoder->current_demod;
 #endif
-  delta = mark - space;
   if(delta > myDecoder->hysteresis) {
     /* Mark symbol dominant. */
     myDecoder->current_demod = TONE_MARK;
@@ -615,6 +812,37 @@ void evaluate_qcorr_tone(AFSKDemodDriver *myDriver) {
     myDecoder->current_demod = TONE_SPACE;
   }
   /* Else don't change current_demod so it remains as prior. */
+
+#if USE_QCORR_FRACTIONAL_PLL == TRUE && QCORR_USE_WEIGHTED_PLL == TRUE
+  /* A sharp transition relative to the signal level places the edge well. */
+  q31_t level = myDecoder->delta_level;
+  if(myDecoder->current_demod != prior) {
+    q31_t slope = clip_q63_to_q31((q63_t)delta - myDecoder->prior_delta);
+    float32_t weight = (level > 0) ? QCORR_PLL_EDGE_SCALE
+        * (float32_t)(slope < 0 ? -(q63_t)slope : slope) / level : 1.0f;
+    myDecoder->edge_weight = (weight > 1.0f) ? 1.0f : weight;
+  }
+  myDecoder->prior_delta = delta;
+  myDecoder->delta_level = level + (((delta < 0 ? -(q63_t)delta : delta)
+      - level) >> QCORR_PLL_LEVEL_SHIFT);
+#endif
+
+  /* Magnitudes are positive so the dominant tone level is the larger. */
+  pktAddAFSKToneLevel(myDriver, (uint32_t)(delta > 0 ? mark : space));
+
+#if AFSK_NUM_SLICERS > 1
+  /* Additional slicers compare with the space/mark gain applied. */
+  uint8_t i;
+  for(i = 0; i < AFSK_NUM_SLICERS - 1; i++) {
+    delta = clip_q63_to_q31((((q63_t)mark * myDecoder->slicer_mark_scale[i]) >> 31)
+        - (((q63_t)space * myDecoder->slicer_space_scale[i]) >> 31));
+    if(delta > myDecoder->hysteresis) {
+      myDecoder->slicer_demod[i] = TONE_MARK;
+    } else if (delta < -myDecoder->hysteresis) {
+      myDecoder->slicer_demod[i] = TONE_SPACE;
+    }
+  }
+#endif
 #if AFSK_DEBUG_TYPE == AFSK_QCORR_DEC_MS_DEBUG
     char buf[200];
     int out = chsnprintf(buf, sizeof(buf), "%i, %i\r\n",
@@ -631,18 +859,34 @@ void evaluate_qcorr_tone(AFSKDemodDriver *myDriver) {
  *@api
  */
 static void setup_qcorr_prefilter(qcorr_decoder_t *decoder) {
+  /* Index of the filter instances for this decoder. */
+  uint8_t inst = decoder - QCORR;
 
-  decoder->input_filter = &AFSK_PWM_QFILTER;
+  decoder->input_filter = &AFSK_PWM_QFILTER[inst];
   /*
    * Initialise the pre-filter.
+   * The BPF is also the anti-alias filter for decimation to decode rate.
    */
-  create_qfir_filter(decoder->input_filter,
-    &pre_filter_instance_q31,
+#if QCORR_USE_FLASH_COEFFS == TRUE
+  /* The filter only reads coefficients so the const table is used as is. */
+  create_qfir_decimator(decoder->input_filter,
+    &pre_filter_instance_q31[inst],
+    PRE_FILTER_NUM_TAPS,
+    (q31_t *)qcorr_pre_filter_coeff_q31,
+    pre_filter_state_q31[inst],
+    PRE_FILTER_BLOCK_SIZE,
+    AFSK_DECODE_DECIMATION,
+    NULL);
+#else
+  create_qfir_decimator(decoder->input_filter,
+    &pre_filter_instance_q31[inst],
     PRE_FILTER_NUM_TAPS,
     pre_filter_coeff_q31,
-    pre_filter_state_q31,
+    pre_filter_state_q31[inst],
     PRE_FILTER_BLOCK_SIZE,
+    AFSK_DECODE_DECIMATION,
     pre_filter_coeff_f32);
+#endif
 
 #if REPORT_QCORR_COEFFS == TRUE
   /*
@@ -664,6 +908,29 @@ static void setup_qcorr_prefilter(qcorr_decoder_t *decoder) {
 #endif
 }
 
+/**
+ * @brief Set the IQ coefficients of a tone in the correlator block.
+ *
+ * @param[in]   corr      pointer to a @p qcorr_block_t structure.
+ * @param[in]   bin       index of the tone.
+ * @param[in]   cos_q31   cos coefficients.
+ * @param[in]   sin_q31   sin coefficients.
+ * @param[in]   reverse   true if the coefficients are in time order.
+ *
+ *@notapi
+ */
+static void set_qcorr_coeffs(qcorr_block_t *corr, uint8_t bin,
+                             const q31_t *cos_q31, const q31_t *sin_q31,
+                             bool reverse) {
+  uint16_t k;
+  for(k = 0; k < DECODE_FILTER_LENGTH; k++) {
+    /* CMSIS order is time reversed. */
+    uint16_t tap = reverse ? (DECODE_FILTER_LENGTH - 1U - k) : k;
+    corr->coeffs[k][bin][QCORR_COS_INDEX] = cos_q31[tap];
+    corr->coeffs[k][bin][QCORR_SIN_INDEX] = sin_q31[tap];
+  }
+}
+
 /**
  * @brief Setup the correlation IQ filters.
  *
@@ -672,77 +939,43 @@ static void setup_qcorr_prefilter(qcorr_decoder_t *decoder) {
  *@api
  */
 void setup_qcorr_IQfilters(qcorr_decoder_t *decoder) {
+  qcorr_block_t *corr = decoder->corr;
+
   /* Set tone frequencies. */
   decoder->filter_bins[AFSK_MARK_INDEX].freq = AFSK_MARK_FREQUENCY;
   decoder->filter_bins[AFSK_SPACE_INDEX].freq = AFSK_SPACE_FREQUENCY;
 
-  /* Set COS and SIN filters for Mark and Space. */
-
-  decoder->filter_bins[AFSK_MARK_INDEX].tone_filter[QCORR_COS_INDEX]
-                                                    = &QFILT_M_COS;
-  decoder->filter_bins[AFSK_MARK_INDEX].tone_filter[QCORR_SIN_INDEX]
-                                                    = &QFILT_M_SIN;
-
+  /* Scaling as a Q31 FIR to avoid wrap in intermediate calcs. */
+  corr->scale = log2(DECODE_FILTER_LENGTH);
 
-  decoder->filter_bins[AFSK_SPACE_INDEX].tone_filter[QCORR_COS_INDEX]
-                                                     = &QFILT_S_COS;
-  decoder->filter_bins[AFSK_SPACE_INDEX].tone_filter[QCORR_SIN_INDEX]
-                                                     = &QFILT_S_SIN;
-
-  /* Temporary float coeff arrays. */
+#if QCORR_USE_FLASH_COEFFS == TRUE
+  /* Interleave the Mark and Space coefficients from flash tables. */
+  set_qcorr_coeffs(corr, AFSK_MARK_INDEX, qcorr_m_cos_filter_coeff_q31,
+                   qcorr_m_sin_filter_coeff_q31, false);
+  set_qcorr_coeffs(corr, AFSK_SPACE_INDEX, qcorr_s_cos_filter_coeff_q31,
+                   qcorr_s_sin_filter_coeff_q31, false);
+#else
+  /* Temporary coeff arrays. */
   float32_t cos_table[decoder->decode_length];
   float32_t sin_table[decoder->decode_length];
+  q31_t cos_q31[DECODE_FILTER_LENGTH];
+  q31_t sin_q31[DECODE_FILTER_LENGTH];
 
-  /* Calculate the IQ filter coefficients for Mark. */
-  float32_t norm_freq = (float32_t)AFSK_MARK_FREQUENCY
-      / (float32_t)decoder->sample_rate;
-
-  gen_fir_iqf(cos_table, sin_table, decoder->decode_length,
-              norm_freq, QCORR_IQ_WINDOW);
-  /*
-   * Create the Mark correlation filters.
-   */
-  create_qfir_filter(&QFILT_M_COS,
-    &m_cos_filter_instance_q31,
-    DECODE_FILTER_LENGTH,
-    m_cos_filter_coeff_q31,
-    m_cos_filter_state_q31,
-    QCORR_FILTER_BLOCK_SIZE,
-    cos_table);
-
-  create_qfir_filter(&QFILT_M_SIN,
-    &m_sin_filter_instance_q31,
-    DECODE_FILTER_LENGTH,
-    m_sin_filter_coeff_q31,
-    m_sin_filter_state_q31,
-    QCORR_FILTER_BLOCK_SIZE,
-    sin_table);
-
-  /* Calculate the IQ filter coefficients for Space. */
-  norm_freq = (float32_t)AFSK_SPACE_FREQUENCY
-      / (float32_t)decoder->sample_rate;
-
-  gen_fir_iqf(cos_table, sin_table, decoder->decode_length,
-              norm_freq, QCORR_IQ_WINDOW);
+  /* Calculate the IQ filter coefficients for each tone. */
+  uint8_t i;
+  for(i = 0; i < decoder->number_bins; i++) {
+    float32_t norm_freq = (float32_t)decoder->filter_bins[i].freq
+        / (float32_t)decoder->sample_rate;
+
+    gen_fir_iqf(cos_table, sin_table, decoder->decode_length,
+                norm_freq, QCORR_IQ_WINDOW);
+    arm_float_to_q31(cos_table, cos_q31, DECODE_FILTER_LENGTH);
+    arm_float_to_q31(sin_table, sin_q31, DECODE_FILTER_LENGTH);
+    set_qcorr_coeffs(corr, i, cos_q31, sin_q31, true);
+  }
+#endif /* QCORR_USE_FLASH_COEFFS == TRUE */
 
-  /*
-   * Create the Space correlation filters.
-   */
-  create_qfir_filter(&QFILT_S_COS,
-     &s_cos_filter_instance_q31,
-     DECODE_FILTER_LENGTH,
-     s_cos_filter_coeff_q31,
-     s_cos_filter_state_q31,
-     QCORR_FILTER_BLOCK_SIZE,
-     cos_table);
-
-  create_qfir_filter(&QFILT_S_SIN,
-     &s_sin_filter_instance_q31,
-     DECODE_FILTER_LENGTH,
-     s_sin_filter_coeff_q31,
-     s_sin_filter_state_q31,
-     QCORR_FILTER_BLOCK_SIZE,
-     sin_table);
+  memset(corr->history, 0, sizeof(corr->history));
 }
 
 #if USE_QCORR_MAG_LPF == TRUE
@@ -754,26 +987,45 @@ void setup_qcorr_IQfilters(qcorr_decoder_t *decoder) {
  *@api
  */
 static void setup_qcorr_magfilter(qcorr_decoder_t *decoder) {
-  (void)decoder;
+  /* Index of the filter instances for this decoder. */
+  uint8_t inst = decoder - QCORR;
 
    /*
     * Initialise the magnitude filters.
     */
-  create_qfir_filter(&QFILT_M_MAG,
-    &m_mag_filter_instance_q31,
+#if QCORR_USE_FLASH_COEFFS == TRUE
+  create_qfir_filter(&QFILT_M_MAG[inst],
+    &m_mag_filter_instance_q31[inst],
+    MAG_FILTER_NUM_TAPS,
+    (q31_t *)qcorr_mag_filter_coeff_q31,
+    m_mag_filter_state_q31[inst],
+    MAG_FILTER_BLOCK_SIZE,
+    NULL);
+
+  create_qfir_filter(&QFILT_S_MAG[inst],
+    &s_mag_filter_instance_q31[inst],
+    MAG_FILTER_NUM_TAPS,
+    (q31_t *)qcorr_mag_filter_coeff_q31,
+    s_mag_filter_state_q31[inst],
+    MAG_FILTER_BLOCK_SIZE,
+    NULL);
+#else
+  create_qfir_filter(&QFILT_M_MAG[inst],
+    &m_mag_filter_instance_q31[inst],
     MAG_FILTER_NUM_TAPS,
     mag_filter_coeff_q31,
-    m_mag_filter_state_q31,
+    m_mag_filter_state_q31[inst],
     MAG_FILTER_BLOCK_SIZE,
     mag_filter_coeff_f32);
 
-  create_qfir_filter(&QFILT_S_MAG,
-    &s_mag_filter_instance_q31,
+  create_qfir_filter(&QFILT_S_MAG[inst],
+    &s_mag_filter_instance_q31[inst],
     MAG_FILTER_NUM_TAPS,
     mag_filter_coeff_q31,
-    s_mag_filter_state_q31,
+    s_mag_filter_state_q31[inst],
     MAG_FILTER_BLOCK_SIZE,
     mag_filter_coeff_f32);
+#endif
 
 #if REPORT_QCORR_COEFFS == TRUE
   /*
@@ -804,23 +1056,50 @@ static void setup_qcorr_magfilter(qcorr_decoder_t *decoder) {
  *@api
  */
 void init_qcorr_decoder(AFSKDemodDriver *myDriver) {
-  /* Assign the correlator control record. */
-  qcorr_decoder_t *decoder = &QCORR1;
+  /* Assign the correlator control record for this radio. */
+  uint8_t inst = pktGetAFSKDecoderIndex(myDriver);
+  qcorr_decoder_t *decoder = &QCORR[inst];
 
-  /* Calculate the sample rate for the system.
+  /* Calculate the sample rate for the correlators.
    * TODO: Centralize sample rate definition/calculation. */
-  decoder->sample_rate = FILTER_SAMPLE_RATE;
+  decoder->sample_rate = DECODE_SAMPLE_RATE;
 
   /* low level initialization. */
   decoder->decode_length = DECODE_FILTER_LENGTH;
   decoder->number_bins = QCORR_FILTER_BINS;
-  decoder->filter_bins = qcorr_bins;
+  decoder->corr = &QCORR_BLOCK[inst];
+  decoder->filter_bins = decoder->corr->bins;
   myDriver->tone_decoder = decoder;
 
   /* Calculate hysteresis value. */
+#if QCORR_MAG_TYPE == QCORR_MAG_POWER
+  float32_t hysteresis = QCORR_POWER_HYSTERESIS;
+#else
   float32_t hysteresis = QCORR_HYSTERESIS;
+#endif
   arm_float_to_q31(&hysteresis, &decoder->hysteresis, 1);
 
+#if AFSK_NUM_SLICERS > 1
+  /*
+   * Set the slicer scales from the space/mark gains.
+   * Q31 cannot hold a gain above 1 so the other tone is reduced instead.
+   */
+  const float32_t gains[AFSK_NUM_SLICERS - 1] = AFSK_SLICER_SPACE_GAINS;
+  uint8_t i;
+  for(i = 0; i < AFSK_NUM_SLICERS - 1; i++) {
+#if QCORR_MAG_TYPE == QCORR_MAG_POWER
+    /* Tones are compared by power so the gain is squared. */
+    float32_t gain = gains[i] * gains[i];
+#else
+    float32_t gain = gains[i];
+#endif
+    float32_t mark_scale = (gain > 1.0f) ? (1.0f / gain) : 1.0f;
+    float32_t space_scale = (gain > 1.0f) ? 1.0f : gain;
+    arm_float_to_q31(&mark_scale, &decoder->slicer_mark_scale[i], 1);
+    arm_float_to_q31(&space_scale, &decoder->slicer_space_scale[i], 1);
+  }
+#endif
+
   /* Create and attach the fixed point pre-filter. */
   setup_qcorr_prefilter(decoder);
 
@@ -846,8 +1125,8 @@ void init_qcorr_decoder(AFSKDemodDriver *myDriver) {
 
 #if USE_QCORR_MAG_LPF == TRUE
   /* Setup the IQ magnitude LPFs. */
-  decoder->filter_bins[AFSK_MARK_INDEX].mag_filter = &QFILT_M_MAG;
-  decoder->filter_bins[AFSK_SPACE_INDEX].mag_filter = &QFILT_S_MAG;
+  decoder->filter_bins[AFSK_MARK_INDEX].mag_filter = &QFILT_M_MAG[inst];
+  decoder->filter_bins[AFSK_SPACE_INDEX].mag_filter = &QFILT_S_MAG[inst];
   setup_qcorr_magfilter(decoder);
 #endif
 }
@@ -22,9 +22,57 @@
 /*===========================================================================*/
 
 #define QCORR_FILTER_BINS           AFSK_NUM_TONES /* Set by AFSK header. */
+#define QCORR_FILTER_BLOCK_SIZE     AFSK_FILTER_BLOCK_SIZE
+/* Block size after the decimating pre-filter. */
+#define QCORR_DECODE_BLOCK_SIZE     AFSK_DECODE_BLOCK_SIZE
 
 #define QCORR_SAMPLE_LEVEL          0.9f
+
+/*
+ * The tuning settings below can be overridden on the compiler command line.
+ * The host benchmark suite uses this to compare settings (make bench-suite).
+ */
+#if !defined(QCORR_HYSTERESIS)
 #define QCORR_HYSTERESIS            0.01f
+#endif
+
+/*
+ * Bin magnitude calculation.
+ * QCORR_MAG_SQRT takes the square root of cos^2 + sin^2.
+ * QCORR_MAG_POWER compares cos^2 + sin^2 without the square root. The
+ * hysteresis is QCORR_POWER_HYSTERESIS and the equaliser limit and slicer
+ * gains are squared to match.
+ * QCORR_MAG_AMBM estimates the magnitude as alpha * max + beta * min of
+ * |cos| and |sin| (peak error 4%) and is used as the square root result.
+ */
+#define QCORR_MAG_SQRT              0
+#define QCORR_MAG_POWER             1
+#define QCORR_MAG_AMBM              2
+
+#if !defined(QCORR_MAG_TYPE)
+#define QCORR_MAG_TYPE              QCORR_MAG_AMBM
+#endif
+#if !defined(QCORR_POWER_HYSTERESIS)
+#define QCORR_POWER_HYSTERESIS      0.005f
+#endif
+
+/*
+ * Tone equaliser.
+ * The mark and space levels are averaged while searching and over the
+ * flags before a frame. From the first byte of the frame the stronger
+ * tone is scaled to the level of the weaker to take out signal twist.
+ * The level average is over 2^QCORR_EQ_SHIFT samples of a tone.
+ * The scale is limited to QCORR_EQ_MIN_SCALE (12 dB).
+ */
+#if !defined(QCORR_USE_TONE_EQ)
+#define QCORR_USE_TONE_EQ           TRUE
+#endif
+#if !defined(QCORR_EQ_SHIFT)
+#define QCORR_EQ_SHIFT              5
+#endif
+#if !defined(QCORR_EQ_MIN_SCALE)
+#define QCORR_EQ_MIN_SCALE          0.25f
+#endif
 
 #define QCORR_PHASE_SEARCH          1
 #define QCORR_PLL_COMB_SIZE         64
@@ -34,17 +82,60 @@
 #endif
 
 #define USE_QCORR_FRACTIONAL_PLL    TRUE
+#if !defined(QCORR_PLL_SEARCH_RATE)
 #define QCORR_PLL_SEARCH_RATE       0.5f
+#endif
+#if !defined(QCORR_PLL_LOCKED_RATE)
 #define QCORR_PLL_LOCKED_RATE       0.75f
+#endif
+
+/*
+ * Transition weighted symbol timing.
+ * Each PLL correction is scaled by the confidence of the transition. This
+ * is the change of the mark/space difference over the transition sample
+ * relative to the average difference, times QCORR_PLL_EDGE_SCALE, to a
+ * maximum of 1. Weak transitions from noise then move the PLL little.
+ * After a frame start the weighted phase errors are also integrated into
+ * a PLL rate offset (QCORR_PLL_FREQ_GAIN) to track the sender baud rate.
+ * The offset is limited to QCORR_PLL_FREQ_LIMIT of the symbol rate.
+ */
+#if !defined(QCORR_USE_WEIGHTED_PLL)
+#define QCORR_USE_WEIGHTED_PLL      TRUE
+#endif
+#if !defined(QCORR_PLL_EDGE_SCALE)
+#define QCORR_PLL_EDGE_SCALE        6.0f
+#endif
+#if !defined(QCORR_PLL_LEVEL_SHIFT)
+#define QCORR_PLL_LEVEL_SHIFT       5
+#endif
+#if !defined(QCORR_PLL_FREQ_GAIN)
+#define QCORR_PLL_FREQ_GAIN         0.001f
+#endif
+#if !defined(QCORR_PLL_FREQ_LIMIT)
+#define QCORR_PLL_FREQ_LIMIT        0.03f
+#endif
 
+/* The flash tables are generated with the Chebyshev window. */
+#if !defined(QCORR_IQ_WINDOW)
 #define QCORR_IQ_WINDOW             TD_WINDOW_CHEBYSCHEV
+#endif
 
-/* Used for indexing of IQ filter sections. */
+/* Used for indexing of IQ correlator sections. */
 #define QCORR_COS_INDEX             0U
 #define QCORR_SIN_INDEX             1U
 
 #define REPORT_QCORR_COEFFS         FALSE
 
+/*
+ * Use the pre-computed Q31 coefficient tables in corr_q31_coeffs.h.
+ * The tables are in flash and no coefficients are calculated at start up.
+ * Regenerate the tables (make coeffs) if filter parameters are changed.
+ * When FALSE coefficients are calculated at run-time into RAM.
+ */
+#if !defined(QCORR_USE_FLASH_COEFFS)
+#define QCORR_USE_FLASH_COEFFS      TRUE
+#endif
+
 /*===========================================================================*/
 /* Module pre-compile time settings.                                         */
 /*===========================================================================*/
@@ -64,15 +155,30 @@
  */
 typedef struct qTone {
   uint16_t          freq;
-  qfir_filter_t     *tone_filter[AFSK_NUM_TONES];
   qfir_filter_t     *mag_filter;
-  q31_t             raw_mag;
-  q31_t             filtered_mag;
+  q31_t             raw_mag[QCORR_DECODE_BLOCK_SIZE];
+  q31_t             filtered_mag[QCORR_DECODE_BLOCK_SIZE];
   q31_t             mag;
-  q31_t             cos_out;
-  q31_t             sin_out;
 } qcorr_tone_t;
 
+/**
+ * @brief   Correlator state of a decoder.
+ *
+ * @note    The IQ correlators of all tones run in one pass over a single
+ *          history of the scaled pre-filter output.
+ * @note    Coefficients are in CMSIS order and interleaved per tap in the
+ *          order the kernel reads them.
+ * @note    The members are one contiguous block in the order of use.
+ */
+typedef struct qCorrBlock {
+  q31_t             history[QCORR_DECODE_BLOCK_SIZE
+                            + DECODE_FILTER_LENGTH - 1];
+  q31_t             coeffs[DECODE_FILTER_LENGTH][QCORR_FILTER_BINS][2];
+  q31_t             iq_out[QCORR_FILTER_BINS][2][QCORR_DECODE_BLOCK_SIZE];
+  qcorr_tone_t      bins[QCORR_FILTER_BINS];
+  uint8_t           scale;
+} qcorr_block_t;
+
 /**
  * @brief   Correlation decoder control structure.
  *
@@ -83,17 +189,41 @@ typedef struct qCorrFilter {
   uint16_t          decode_length;
   uint32_t          current_n;
   uint32_t          sample_rate;
-  q31_t             preFilterOut;
+  q31_t             input_block[QCORR_FILTER_BLOCK_SIZE];
+  uint16_t          block_fill;
+  q31_t             preFilterOut[QCORR_DECODE_BLOCK_SIZE];
   uint32_t          filter_valid;
   uint8_t           number_bins;
   qcorr_tone_t      *filter_bins;
+  qcorr_block_t     *corr;
   q31_t             sample_level[2];
   q31_t             hysteresis;
   tone_t            prior_demod;
   tone_t            current_demod;
+#if QCORR_USE_TONE_EQ == TRUE
+  q31_t             eq_mark_level;
+  q31_t             eq_space_level;
+  q31_t             eq_mark_scale;
+  q31_t             eq_space_scale;
+  bool              eq_hold;
+#endif
+#if AFSK_NUM_SLICERS > 1
+  q31_t             slicer_mark_scale[AFSK_NUM_SLICERS - 1];
+  q31_t             slicer_space_scale[AFSK_NUM_SLICERS - 1];
+  tone_t            slicer_demod[AFSK_NUM_SLICERS - 1];
+#endif
 #if  USE_QCORR_FRACTIONAL_PLL == TRUE
   int32_t           symbol_pll;
   int32_t           prior_pll;
+#if QCORR_USE_WEIGHTED_PLL == TRUE
+  /* PLL rate offset tracking the sender symbol rate. */
+  int32_t           pll_freq;
+  /* Mark/space difference of the prior sample and its average level. */
+  q31_t             prior_delta;
+  q31_t             delta_level;
+  /* Confidence of the latest transition from 0 to 1. */
+  float32_t         edge_weight;
+#endif
 #else
   dsp_phase_t       phase_delta;
   dsp_phase_t       phase_correction;
@@ -111,12 +241,13 @@ typedef struct qCorrFilter {
 #ifdef __cplusplus
 extern "C" {
 #endif
-  q31_t push_qcorr_sample(AFSKDemodDriver *myDriver, bit_t sample);
-  bool process_qcorr_output(AFSKDemodDriver *myDriver);
+  bool push_qcorr_sample(AFSKDemodDriver *myDriver, bit_t sample);
+  void process_qcorr_block(AFSKDemodDriver *myDriver);
+  bool process_qcorr_output(AFSKDemodDriver *myDriver, uint16_t n);
   void calc_qcorr_magnitude(AFSKDemodDriver *myDriver);
   void filter_qcorr_magnitude(AFSKDemodDriver *myDriver);
   void reset_qcorr_all(AFSKDemodDriver *myDriver);
-  void evaluate_qcorr_tone(AFSKDemodDriver *myDriver);
+  void evaluate_qcorr_tone(AFSKDemodDriver *myDriver, uint16_t n);
   bool get_qcorr_symbol_timing(AFSKDemodDriver *myDriver);
   void update_qcorr_pll(AFSKDemodDriver *myDriver);
   void init_qcorr_decoder(AFSKDemodDriver *myDriver);
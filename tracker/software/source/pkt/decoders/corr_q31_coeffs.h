@@ -0,0 +1,87 @@
+/*
+    Aerospace Decoder - Copyright (C) 2018 Bob Anderson (VK2GJ)
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+/**
+ * @file    corr_q31_coeffs.h
+ * @brief   Pre-computed Q31 coefficients for the QCORR decoder.
+ * @note    Generated by gen_qcorr_coeffs.py. Do not edit.
+ * @note    Tables are in CMSIS (time reversed) order.
+ *
+ * @addtogroup DSP
+ * @{
+ */
+
+#ifndef IO_DECODERS_QCORR_COEFFS_H_
+#define IO_DECODERS_QCORR_COEFFS_H_
+
+/* Parameters used to generate the tables. */
+#define QCORR_COEFF_DECIMATION         12U
+#define QCORR_COEFF_DECODE_DECIMATION  2U
+#define QCORR_COEFF_PRE_TAPS           55U
+#define QCORR_COEFF_PRE_LOW            925U
+#define QCORR_COEFF_PRE_HIGH           2475U
+#define QCORR_COEFF_MAG_TAPS           15U
+#define QCORR_COEFF_MAG_HIGH           1400U
+#define QCORR_COEFF_MARK               1200U
+#define QCORR_COEFF_SPACE              2200U
+
+/* Pre-filter BPF (no window). */
+static const q31_t qcorr_pre_filter_coeff_q31[55] = {
+  -9718602, -48687908, -74374944, -47534220,
+  22163852, 80503448, 81394488, 35054748,
+  -766431, 18103064, 70715520, 86634680,
+  19237228, -96752824, -168592880, -135244560,
+  -35287200, 23727686, -23767238, -117259456,
+  -108969984, 91385976, 395575104, 567775616,
+  407043424, -64430428, -577756672, -798772032,
+  -577756672, -64430428, 407043424, 567775616,
+  395575104, 91385976, -108969984, -117259456,
+  -23767238, 23727686, -35287200, -135244560,
+  -168592880, -96752824, 19237228, 86634680,
+  70715520, 18103064, -766431, 35054748,
+  81394488, 80503448, 22163852, -47534220,
+  -74374944, -48687908, -9718602
+};
+
+/* Magnitude LPF (no window). */
+static const q31_t qcorr_mag_filter_coeff_q31[15] = {
+  70021472, 92353808, -22221600, -157531280,
+  -106640992, 205642480, 601258432, 781719232,
+  601258432, 205642480, -106640992, -157531280,
+  -22221600, 92353808, 70021472
+};
+
+/* Mark IQ correlators (Chebyshev window). */
+static const q31_t qcorr_m_cos_filter_coeff_q31[12] = {
+  18742440, 1, -229952496, -457843680,
+  -34, 775785856, 681192576, -23,
+  -229952576, -82071024, 0, 4160062
+};
+
+static const q31_t qcorr_m_sin_filter_coeff_q31[12] = {
+  -10820949, -94767512, -132763320, 264336144,
+  786573760, 447900320, -393286880, -528672480,
+  -132763168, 47383792, 21641908, 2401812
+};
+
+/* Space IQ correlators (Chebyshev window). */
+static const q31_t qcorr_s_cos_filter_coeff_q31[12] = {
+  -9154588, -67071816, 240867792, 46118796,
+  -760463808, 514278016, 451571008, -511123392,
+  23163226, 85966744, -15317086, -2031947
+};
+
+static const q31_t qcorr_s_sin_filter_coeff_q31[12] = {
+  -19596390, 66949752, 112114264, -526181664,
+  203395152, 733129472, -643737408, -136706080,
+  264275408, -40014056, -15289209, 4349604
+};
+
+#endif /* IO_DECODERS_QCORR_COEFFS_H_ */
+
+/** @} */
@@ -0,0 +1,174 @@
+# Generates corr_q31_coeffs.h which holds the Q31 coefficient tables used by
+# the QCORR decoder (pre-filter BPF, IQ correlators and magnitude LPF).
+#
+# The calculations follow gen_fir_bpf(), gen_fir_lpf(), gen_fir_iqf() and the
+# Chebyshev window in dsp.c. Tables are written in CMSIS (time reversed) order.
+#
+# Filter parameters are read from ../channels/rxafsk.h.
+# Run again (make coeffs) whenever those parameters are changed.
+
+import math
+import re
+import struct
+import sys
+
+HEADER = '../channels/rxafsk.h'
+OUTPUT = 'corr_q31_coeffs.h'
+
+def f32(x):
+	# Round to float32 as the target does on each store.
+	return struct.unpack('f', struct.pack('f', x))[0]
+
+def to_q31(x):
+	# Matches arm_float_to_q31() (truncation with saturation).
+	v = int(f32(x * 2147483648.0))
+	return max(-2147483648, min(2147483647, v))
+
+def chebyshev(size, j):
+	a = 6.0
+	M = size // 2
+	N = M * 2
+	b = f32(math.cosh(math.acosh(math.pow(10, a)) / (N - 1)))
+	def T(n, x):
+		if abs(x) <= 1:
+			return math.cos(n * math.acos(x))
+		return math.cosh(n * math.acosh(x))
+	s = 0.0
+	for k in range(M):
+		s += (-1 if k & 1 else 1) * T(N, b * math.cos(math.pi * k / N)) \
+			* math.cos(2 * j * k * math.pi / N)
+	s /= T(N, b)
+	return f32(s - 0.5)
+
+def gen_bpf(f1, f2, taps):
+	center = 0.5 * (taps - 1)
+	coeff = []
+	for j in range(taps):
+		if j - center == 0:
+			sinc = 2 * (f2 - f1)
+		else:
+			sinc = math.sin(2 * math.pi * f2 * (j - center)) / (math.pi * (j - center)) \
+				- math.sin(2 * math.pi * f1 * (j - center)) / (math.pi * (j - center))
+		coeff.append(f32(sinc))
+	omega = f32(2 * math.pi * (f32(f1 + f2) / 2))
+	gain = 0.0
+	for j in range(taps):
+		angle = f32(j * omega)
+		gain = f32(gain + coeff[j] * (math.cos(angle) - math.sin(angle)))
+	return [f32(c / gain) for c in coeff]
+
+def gen_lpf(fc, taps):
+	center = 0.5 * (taps - 1)
+	coeff = []
+	for j in range(taps):
+		if j - center == 0:
+			sinc = 2 * fc
+		else:
+			sinc = math.sin(2 * math.pi * fc * (j - center)) / (math.pi * (j - center))
+		coeff.append(f32(sinc))
+	gain = 0.0
+	for c in coeff:
+		gain = f32(gain + c)
+	return [f32(c / gain) for c in coeff]
+
+def gen_iqf(length, norm_freq):
+	center = 0.5 * (length - 1)
+	pcos, psin = [], []
+	gain_c = gain_s = 0.0
+	for n in range(length):
+		angle = f32(f32(f32(n - center) * norm_freq) * 2.0)
+		angle = f32(angle * f32(math.pi))
+		w = chebyshev(length, n)
+		c = f32(math.cos(angle))
+		s = f32(math.sin(angle))
+		pcos.append(f32(c * w))
+		psin.append(f32(s * w))
+		gain_c = f32(gain_c + f32(pcos[n] * c))
+		gain_s = f32(gain_s + f32(psin[n] * s))
+	return [f32(c / gain_c) for c in pcos], [f32(s / gain_s) for s in psin]
+
+def read_defines(path):
+	# Take the first definition, or the QCORR one for per decoder settings.
+	defs = {}
+	qcorr = False
+	with open(path, 'r') as f:
+		for line in f:
+			if re.match(r'^#if AFSK_DECODE_TYPE == AFSK_DSP_QCORR_DECODE', line):
+				qcorr = True
+			elif re.match(r'^#(elif|else|endif)', line):
+				qcorr = False
+			m = re.match(r'^#define\s+(\w+)\s+\(?(\d+)U?\)?', line)
+			if m and (m.group(1) not in defs or qcorr):
+				defs[m.group(1)] = int(m.group(2))
+	return defs
+
+def table(name, values):
+	# Write the table in CMSIS (time reversed) order.
+	values = [to_q31(v) for v in reversed(values)]
+	out = 'static const q31_t %s[%d] = {\n' % (name, len(values))
+	for i in range(0, len(values), 4):
+		out += '  ' + ', '.join('%d' % v if v != -2147483648 else '(-2147483647 - 1)'
+			for v in values[i:i + 4])
+		out += ',\n' if i + 4 < len(values) else '\n'
+	return out + '};\n\n'
+
+d = read_defines(HEADER)
+decimation = int(sys.argv[1]) if len(sys.argv) > 1 else d['SYMBOL_DECIMATION']
+decode_decimation = int(sys.argv[2]) if len(sys.argv) > 2 \
+	else d['AFSK_DECODE_DECIMATION']
+# The BPF runs at the input rate. The correlators and LPF run at decode rate.
+rate = decimation * d['AFSK_BAUD_RATE']
+decode_rate = rate // decode_decimation
+decode_length = 2 * (decimation // decode_decimation)
+
+pre = gen_bpf(f32(d['PRE_FILTER_LOW'] / rate), f32(d['PRE_FILTER_HIGH'] / rate),
+	d['PRE_FILTER_NUM_TAPS'])
+mag = gen_lpf(f32(d['MAG_FILTER_HIGH'] / decode_rate), d['MAG_FILTER_NUM_TAPS'])
+m_cos, m_sin = gen_iqf(decode_length, f32(d['AFSK_MARK_FREQUENCY'] / decode_rate))
+s_cos, s_sin = gen_iqf(decode_length, f32(d['AFSK_SPACE_FREQUENCY'] / decode_rate))
+
+print('Writing %s for decimation %d (%d Hz) decode decimation %d (%d Hz)'
+	% (OUTPUT, decimation, rate, decode_decimation, decode_rate))
+with open(OUTPUT, 'w') as f:
+	f.write('/*\n'
+		'    Aerospace Decoder - Copyright (C) 2018 Bob Anderson (VK2GJ)\n\n'
+		'    Unless required by applicable law or agreed to in writing, software\n'
+		'    distributed under the License is distributed on an "AS IS" BASIS,\n'
+		'    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.\n'
+		'*/\n\n'
+		'/**\n'
+		' * @file    corr_q31_coeffs.h\n'
+		' * @brief   Pre-computed Q31 coefficients for the QCORR decoder.\n'
+		' * @note    Generated by gen_qcorr_coeffs.py. Do not edit.\n'
+		' * @note    Tables are in CMSIS (time reversed) order.\n'
+		' *\n'
+		' * @addtogroup DSP\n'
+		' * @{\n'
+		' */\n\n'
+		'#ifndef IO_DECODERS_QCORR_COEFFS_H_\n'
+		'#define IO_DECODERS_QCORR_COEFFS_H_\n\n'
+		'/* Parameters used to generate the tables. */\n')
+	params = [
+		('QCORR_COEFF_DECIMATION', decimation),
+		('QCORR_COEFF_DECODE_DECIMATION', decode_decimation),
+		('QCORR_COEFF_PRE_TAPS', d['PRE_FILTER_NUM_TAPS']),
+		('QCORR_COEFF_PRE_LOW', d['PRE_FILTER_LOW']),
+		('QCORR_COEFF_PRE_HIGH', d['PRE_FILTER_HIGH']),
+		('QCORR_COEFF_MAG_TAPS', d['MAG_FILTER_NUM_TAPS']),
+		('QCORR_COEFF_MAG_HIGH', d['MAG_FILTER_HIGH']),
+		('QCORR_COEFF_MARK', d['AFSK_MARK_FREQUENCY']),
+		('QCORR_COEFF_SPACE', d['AFSK_SPACE_FREQUENCY'])]
+	for name, value in params:
+		f.write('#define %-30s %dU\n' % (name, value))
+	f.write('\n')
+	f.write('/* Pre-filter BPF (no window). */\n')
+	f.write(table('qcorr_pre_filter_coeff_q31', pre))
+	f.write('/* Magnitude LPF (no window). */\n')
+	f.write(table('qcorr_mag_filter_coeff_q31', mag))
+	f.write('/* Mark IQ correlators (Chebyshev window). */\n')
+	f.write(table('qcorr_m_cos_filter_coeff_q31', m_cos))
+	f.write(table('qcorr_m_sin_filter_coeff_q31', m_sin))
+	f.write('/* Space IQ correlators (Chebyshev window). */\n')
+	f.write(table('qcorr_s_cos_filter_coeff_q31', s_cos))
+	f.write(table('qcorr_s_sin_filter_coeff_q31', s_sin))
+	f.write('#endif /* IO_DECODERS_QCORR_COEFFS_H_ */\n\n/** @} */\n')
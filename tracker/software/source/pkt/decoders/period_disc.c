@@ -0,0 +1,186 @@
+/*
+    Aerospace Decoder - Copyright (C) 2018 Bob Anderson (VK2GJ)
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+/**
+ * @file    period_disc.c
+ * @brief   PWM period tone discriminator implementation.
+ * @details With phase continuous AFSK a half cycle holding a tone change
+ *          has a part a of mark and a part b of space where
+ *          a / Tm + b / Ts = 1 for the mark and space half cycle lengths.
+ *          The tone before the half cycle gives the order of the parts.
+ *
+ * @addtogroup DSP
+ * @{
+ */
+
+
+#include "pktconf.h"
+
+
+#if PKT_RX_USE_PERIOD_DISC == TRUE
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+/**
+ * @brief   Select the discriminator or correlator at the end of a window.
+ * @notes   While searching for a frame a window with too many half cycles
+ *          outside the tone lengths hands decoding to the correlator and a
+ *          clean window returns it to the discriminator.
+ * @notes   A frame keeps its decoder as switching loses bits while the
+ *          correlator filters refill.
+ * @post    The correlator output is held until its filters have refilled.
+ *
+ * @param[in]   myDriver   pointer to a @p AFSKDemodDriver structure.
+ *
+ * @notapi
+ */
+static void select_period_disc(AFSKDemodDriver *myDriver) {
+  afsk_period_t *period = &myDriver->period;
+  bool clean = period->outliers * 100U
+      <= PKT_RX_PERIOD_WINDOW * PKT_RX_PERIOD_OUTLIERS;
+  period->cycles = 0;
+  period->outliers = 0;
+
+  if(myDriver->frame_state != FRAME_SEARCH)
+    return;
+  if(period->active) {
+    if(clean)
+      return;
+    period->active = false;
+    /* The correlator filters hold samples from before the discriminator. */
+    qcorr_decoder_t *decoder = myDriver->tone_decoder;
+    decoder->filter_valid = 0;
+#if USE_AFSK_DECODER_STATS == TRUE
+    myDriver->stats.period_fallbacks++;
+#endif
+    return;
+  }
+  if(clean)
+    period->active = true;
+}
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Reset the period discriminator for a decode session.
+ * @post    The discriminator is active for the session.
+ *
+ * @param[in]   myDriver   pointer to a @p AFSKDemodDriver structure.
+ *
+ * @api
+ */
+void reset_period_disc(AFSKDemodDriver *myDriver) {
+  afsk_period_t *period = &myDriver->period;
+  period->active = true;
+  period->first = TONE_NONE;
+  period->second = TONE_NONE;
+  period->split = 0;
+  period->decimation = 0;
+  period->votes = 0;
+  period->cycles = 0;
+  period->outliers = 0;
+}
+
+/**
+ * @brief   Add a PWM half cycle to the discriminator.
+ * @notes   Half cycles are checked against the tone lengths over windows
+ *          while either the discriminator or the correlator is decoding.
+ * @post    The tones of the half cycle and the position of a tone change
+ *          are set for push_period_sample().
+ *
+ * @param[in]   myDriver   pointer to a @p AFSKDemodDriver structure.
+ * @param[in]   count      length of the half cycle in ICU counts.
+ *
+ * @api
+ */
+void push_period_cycle(AFSKDemodDriver *myDriver, min_pwmcnt_t count) {
+  afsk_period_t *period = &myDriver->period;
+
+  if(count < PERIOD_CYCLE_MIN || count > PERIOD_CYCLE_MAX)
+    period->outliers++;
+  if(++period->cycles >= PKT_RX_PERIOD_WINDOW)
+    select_period_disc(myDriver);
+
+  tone_t prior = period->second;
+  period->split = 0;
+  if(count >= PERIOD_MARK_MIN) {
+    period->first = TONE_MARK;
+    period->second = TONE_MARK;
+  } else if(count <= PERIOD_SPACE_MAX) {
+    period->first = TONE_SPACE;
+    period->second = TONE_SPACE;
+  } else if(prior == TONE_MARK) {
+    /* Mark changing to space. */
+    uint32_t mark = (PERIOD_MARK_COUNT * (count - PERIOD_SPACE_COUNT))
+        / (PERIOD_MARK_COUNT - PERIOD_SPACE_COUNT);
+    period->first = TONE_MARK;
+    period->second = TONE_SPACE;
+    period->split = count - mark;
+  } else if(prior == TONE_SPACE) {
+    /* Space changing to mark. */
+    uint32_t space = (PERIOD_SPACE_COUNT * (PERIOD_MARK_COUNT - count))
+        / (PERIOD_MARK_COUNT - PERIOD_SPACE_COUNT);
+    period->first = TONE_SPACE;
+    period->second = TONE_MARK;
+    period->split = count - space;
+  } else {
+    /* No tone yet so the nearer length is used. */
+    tone_t tone = (count > (PERIOD_MARK_COUNT + PERIOD_SPACE_COUNT) / 2U)
+        ? TONE_MARK : TONE_SPACE;
+    period->first = tone;
+    period->second = tone;
+  }
+}
+
+/**
+ * @brief   Set the tone of a sample in the current half cycle.
+ * @notes   Samples are at the filter rate and every decimation'th is used
+ *          as the correlator does.
+ * @post    The QCORR tone and slicer tones are set for the symbol PLL.
+ *
+ * @param[in]   myDriver   pointer to a @p AFSKDemodDriver structure.
+ * @param[in]   remain     ICU counts from the sample to the end of the half
+ *                         cycle.
+ *
+ * @return  status of the sample.
+ * @retval  true    a decode rate sample is ready for the symbol PLL.
+ * @retval  false   the sample is dropped by decimation.
+ *
+ * @api
+ */
+bool push_period_sample(AFSKDemodDriver *myDriver, pwm_accum_t remain) {
+  afsk_period_t *period = &myDriver->period;
+
+  if(++period->decimation < AFSK_DECODE_DECIMATION)
+    return false;
+  period->decimation = 0;
+
+  /* A majority of the last samples gives the tone to ride out jitter. */
+  tone_t vote = (remain < (pwm_accum_t)period->split)
+      ? period->second : period->first;
+  period->votes = (period->votes << 1) | (vote == TONE_MARK);
+  tone_t tone = (__builtin_popcount(period->votes & PERIOD_VOTE_MASK)
+      > PKT_RX_PERIOD_VOTES / 2U) ? TONE_MARK : TONE_SPACE;
+  qcorr_decoder_t *decoder = myDriver->tone_decoder;
+  decoder->current_demod = tone;
+#if AFSK_NUM_SLICERS > 1
+  /* There is no level to slice so the slicers follow the tone. */
+  uint8_t i;
+  for(i = 0; i < AFSK_NUM_SLICERS - 1; i++)
+    decoder->slicer_demod[i] = tone;
+#endif
+  return true;
+}
+
+#endif /* PKT_RX_USE_PERIOD_DISC == TRUE */
+
+/** @} */
@@ -0,0 +1,89 @@
+/*
+    Aerospace Decoder - Copyright (C) 2018 Bob Anderson (VK2GJ)
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+/**
+ * @file    period_disc.h
+ * @brief   PWM period tone discriminator.
+ * @details The tone is taken from the length of each PWM half cycle with no
+ *          filtering. A half cycle between the space and mark lengths holds
+ *          a tone change which is placed by the phase of each tone.
+ *          The tone of a decode sample is the majority of the last
+ *          samples which rides out zero crossing jitter. The discriminator
+ *          feeds the QCORR symbol PLL. While searching for a frame it is
+ *          used when the half cycles are within the tone lengths and the
+ *          correlator is used otherwise. A frame keeps its decoder as
+ *          switching loses bits while the correlator filters refill.
+ *
+ * @addtogroup DSP
+ * @{
+ */
+
+#ifndef IO_DECODERS_PERIOD_DISC_H_
+#define IO_DECODERS_PERIOD_DISC_H_
+
+/*===========================================================================*/
+/* Module constants.                                                         */
+/*===========================================================================*/
+
+/* Half cycle lengths of the tones in ICU counts. */
+#define PERIOD_MARK_COUNT       (ICU_COUNT_FREQUENCY                         \
+                                 / (2U * AFSK_MARK_FREQUENCY))
+#define PERIOD_SPACE_COUNT      (ICU_COUNT_FREQUENCY                         \
+                                 / (2U * AFSK_SPACE_FREQUENCY))
+
+/* Half cycles within the tolerance of a tone length are that tone only. */
+#define PERIOD_MARK_MIN         ((PERIOD_MARK_COUNT                          \
+                                 * (100U - PKT_RX_PERIOD_TOLERANCE)) / 100U)
+#define PERIOD_SPACE_MAX        ((PERIOD_SPACE_COUNT                         \
+                                 * (100U + PKT_RX_PERIOD_TOLERANCE)) / 100U)
+
+/* Half cycles outside these bounds are not from a clean signal. */
+#define PERIOD_CYCLE_MIN        ((PERIOD_SPACE_COUNT                         \
+                                 * (100U - PKT_RX_PERIOD_TOLERANCE)) / 100U)
+#define PERIOD_CYCLE_MAX        ((PERIOD_MARK_COUNT                          \
+                                 * (100U + PKT_RX_PERIOD_TOLERANCE)) / 100U)
+
+/* Decode rate samples voting on the tone. */
+#define PERIOD_VOTE_MASK        ((1U << PKT_RX_PERIOD_VOTES) - 1U)
+
+/*===========================================================================*/
+/* Derived constants and error checks.                                       */
+/*===========================================================================*/
+
+#if PKT_RX_USE_PERIOD_DISC == TRUE                                           \
+  && AFSK_DECODE_TYPE != AFSK_DSP_QCORR_DECODE
+#error "The period discriminator uses the QCORR symbol PLL"
+#endif
+
+#if PKT_RX_USE_PERIOD_DISC == TRUE                                           \
+  && (PKT_RX_PERIOD_VOTES < 1 || PKT_RX_PERIOD_VOTES > 15                    \
+  || (PKT_RX_PERIOD_VOTES & 1) == 0)
+#error "PKT_RX_PERIOD_VOTES must be an odd count up to 15"
+#endif
+
+#if PKT_RX_USE_PERIOD_DISC == TRUE && PERIOD_SPACE_MAX >= PERIOD_MARK_MIN
+#error "PKT_RX_PERIOD_TOLERANCE overlaps the tone half cycle lengths"
+#endif
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  void reset_period_disc(AFSKDemodDriver *myDriver);
+  void push_period_cycle(AFSKDemodDriver *myDriver, min_pwmcnt_t count);
+  bool push_period_sample(AFSKDemodDriver *myDriver, pwm_accum_t remain);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IO_DECODERS_PERIOD_DISC_H_ */
+
+/** @} */
@@ -0,0 +1,318 @@
+/*
+    Aerospace Decoder - Copyright (C) 2018 Bob Anderson (VK2GJ)
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+/**
+ * @file    sdft_f32.c
+ * @brief   Sliding DFT decoder implementation.
+ * @details Each tone bin is updated recursively per sample.
+ *          S(n) = r.e^jw.S(n-1) + x(n) - r^N.e^jwN.x(n-N)
+ *          The cost per tone is one complex multiply regardless of N.
+ *
+ * @addtogroup DSP
+ * @{
+ */
+
+
+#include "pktconf.h"
+
+
+#if AFSK_DECODE_TYPE == AFSK_DSP_SDFT_DECODE
+
+/*===========================================================================*/
+/* Module local definitions.                                                 */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module exported variables.                                                */
+/*===========================================================================*/
+
+/* Allocate the decoder main structure and the tone bins. */
+sdft_decoder_t SDFT[AFSK_NUM_DECODERS] useCCM;
+sdft_tone_t sdft_bins[AFSK_NUM_DECODERS][SDFT_FILTER_BINS] useCCM;
+
+/*===========================================================================*/
+/* Module local types.                                                       */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module local variables.                                                   */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+/**
+ * @brief Called to evaluate the tone strengths in the bins.
+ * @notes Hysteresis is applied such that an unclear result is no change.
+ * @post  The tone memory will be set to the current strongest at this sample.
+ *
+ * @param[in]   decoder    pointer to a @p sdft_decoder_t structure.
+ * @param[in]   n          index of the sample within the processed block.
+ *
+ */
+static void evaluate_sdft_tone(sdft_decoder_t *decoder, uint16_t n) {
+  float32_t mark = decoder->filter_bins[AFSK_MARK_INDEX].mag[n];
+  float32_t space = decoder->filter_bins[AFSK_SPACE_INDEX].mag[n];
+  float32_t delta = mark - space;
+
+  /* Hysteresis is relative to the combined tone level. */
+  float32_t threshold = decoder->hysteresis * (mark + space);
+  if(delta > threshold) {
+    /* Mark symbol dominant. */
+    decoder->current_demod = TONE_MARK;
+  } else if (delta < -threshold) {
+    /* Space symbol dominant. */
+    decoder->current_demod = TONE_SPACE;
+  }
+  /* Else don't change current_demod so it remains as prior. */
+
+#if AFSK_NUM_SLICERS > 1
+  /* Additional slicers compare with the space/mark gain applied. */
+  uint8_t i;
+  for(i = 0; i < AFSK_NUM_SLICERS - 1; i++) {
+    float32_t gain_space = space * decoder->slicer_space_gain[i];
+    delta = mark - gain_space;
+    threshold = decoder->hysteresis * (mark + gain_space);
+    if(delta > threshold) {
+      decoder->slicer_demod[i] = TONE_MARK;
+    } else if (delta < -threshold) {
+      decoder->slicer_demod[i] = TONE_SPACE;
+    }
+  }
+#endif
+}
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Resets the sliding DFT state.
+ * @post    Window and bin accumulators are cleared.
+ * @post    Decoder variables are reset.
+ *
+ * @param[in]   myDriver   pointer to a @p AFSKDemodDriver structure.
+ *
+ * @api
+ */
+void reset_sdft_all(AFSKDemodDriver *myDriver) {
+  sdft_decoder_t *decoder = myDriver->tone_decoder;
+
+  memset(decoder->window, 0, sizeof(decoder->window));
+  decoder->window_index = 0;
+  decoder->block_fill = 0;
+
+  uint8_t i;
+  for(i = 0; i < decoder->number_bins; i++) {
+    sdft_tone_t *myBin = &decoder->filter_bins[i];
+    myBin->acc_re = 0;
+    myBin->acc_im = 0;
+    memset(myBin->mag, 0, sizeof(myBin->mag));
+  }
+  decoder->filter_valid = 0;
+
+  decoder->prior_demod = TONE_NONE;
+  decoder->current_demod = TONE_NONE;
+#if AFSK_NUM_SLICERS > 1
+  for(i = 0; i < AFSK_NUM_SLICERS - 1; i++)
+    decoder->slicer_demod[i] = TONE_NONE;
+#endif
+
+  decoder->symbol_pll = 0;
+}
+
+/**
+ * @brief   Called at each new sample to add it to the input block.
+ *
+ * @param[in] myDriver  pointer to driver structure.
+ * @param[in] sample    input binary value.
+ *
+ * @return  Status of the input block.
+ * @retval  true if the block was filled and is ready for processing.
+ * @retval  false if the block is still being filled.
+ *
+ * @api
+ */
+bool push_sdft_sample(AFSKDemodDriver *myDriver, bit_t sample) {
+  sdft_decoder_t *decoder = myDriver->tone_decoder;
+
+  decoder->input_block[decoder->block_fill] = decoder->sample_level[sample];
+  if(++decoder->block_fill < SDFT_FILTER_BLOCK_SIZE)
+    return false;
+  decoder->block_fill = 0;
+  return true;
+}
+
+/**
+ * @brief   Runs the sliding DFT over the input block.
+ * @notes   The magnitude of each tone bin is saved for each sample.
+ *
+ * @param[in]   myDriver   pointer to a @p AFSKDemodDriver structure.
+ *
+ * @api
+ */
+void process_sdft_block(AFSKDemodDriver *myDriver) {
+  sdft_decoder_t *decoder = myDriver->tone_decoder;
+
+  /* Bin update and magnitude are interleaved so are timed together. */
+  AFSK_STATS_STAMP(corr_start);
+  uint16_t n;
+  for(n = 0; n < SDFT_FILTER_BLOCK_SIZE; n++) {
+    /* Swap the new sample into the window and get the one leaving. */
+    float32_t x_new = decoder->input_block[n];
+    float32_t x_old = decoder->window[decoder->window_index];
+    decoder->window[decoder->window_index] = x_new;
+    if(++decoder->window_index >= decoder->window_length)
+      decoder->window_index = 0;
+
+    uint8_t i;
+    for(i = 0; i < decoder->number_bins; i++) {
+      sdft_tone_t *myBin = &decoder->filter_bins[i];
+      float32_t re = myBin->acc_re;
+      float32_t im = myBin->acc_im;
+
+      /* Rotate the prior value and apply the window difference. */
+      myBin->acc_re = (myBin->coeff_re * re) - (myBin->coeff_im * im)
+          + x_new - (myBin->comb_re * x_old);
+      myBin->acc_im = (myBin->coeff_re * im) + (myBin->coeff_im * re)
+          - (myBin->comb_im * x_old);
+
+      myBin->mag[n] = sqrtf((myBin->acc_re * myBin->acc_re)
+                            + (myBin->acc_im * myBin->acc_im));
+    }
+  }
+  AFSK_STATS_STAGE(myDriver, AFSK_STAGE_CORRELATE, corr_start);
+}
+
+/**
+ * @brief   Called for each sample in a processed block.
+ * @notes   The comparative strength of symbol tones is evaluated and updated.
+ * @notes   If the output is valid then symbol timing and HDLC can proceed.
+ *
+ * @param[in]   myDriver   pointer to a @p AFSKDemodDriver structure.
+ * @param[in]   n          index of the sample within the processed block.
+ *
+ * @return      Status for sample
+ * @retval      false if the decoder output is not valid.
+ * @retval      true if the decoder output is valid.
+ *
+ * @api
+ */
+bool process_sdft_output(AFSKDemodDriver *myDriver, uint16_t n) {
+  sdft_decoder_t *decoder = myDriver->tone_decoder;
+
+  /* Wait for the DFT window to fill. */
+  if(decoder->filter_valid < decoder->window_length) {
+    ++decoder->filter_valid;
+    return false;
+  }
+
+  evaluate_sdft_tone(decoder, n);
+  return true;
+}
+
+/**
+ * @brief       Checks the symbol timing.
+ *
+ * @param[in]   myDriver    pointer to AFSKDemodDriver structure.
+ *
+ * @return      Status for symbol timing.
+ * @retval      false if the symbol is not complete.
+ * @retval      true if the symbol is ready for HDLC detection.
+ *
+ * @api
+ */
+bool get_sdft_symbol_timing(AFSKDemodDriver *myDriver) {
+  sdft_decoder_t *decoder = myDriver->tone_decoder;
+
+  decoder->prior_pll = decoder->symbol_pll;
+  /* PLL increment is size of uint32_t / decimation rate. */
+  decoder->symbol_pll = (int32_t)((uint32_t)(decoder->symbol_pll)
+      + (UINT_MAX / SYMBOL_DECIMATION));
+  /*
+   * The symbol period is reached when the PLL counter wraps around.
+   */
+  return ((decoder->symbol_pll < 0) && (decoder->prior_pll > 0));
+}
+
+/**
+ * @brief Advances the symbol PLL timing.
+ * @notes The PLL is pulled toward each tone transition.
+ * @notes A faster rate is used while searching for HDLC frame start.
+ *
+ * @param[in] myDriver    pointer to AFSKDemodDriver structure.
+ *
+ * @api
+ */
+void update_sdft_pll(AFSKDemodDriver *myDriver) {
+  sdft_decoder_t *decoder = myDriver->tone_decoder;
+
+  if(decoder->current_demod != decoder->prior_demod) {
+    decoder->prior_demod = decoder->current_demod;
+    pktAddAFSKPLLEdge(myDriver, decoder->symbol_pll);
+    if(myDriver->frame_state == FRAME_SEARCH) {
+      decoder->symbol_pll = (int32_t)((float32_t)decoder->symbol_pll
+          * SDFT_PLL_SEARCH_RATE);
+    } else {
+      decoder->symbol_pll = (int32_t)((float32_t)decoder->symbol_pll
+          * SDFT_PLL_LOCKED_RATE);
+    }
+  }
+}
+
+/**
+ * @brief   Called once to initialise the sliding DFT parameters.
+ *
+ * @param[in] myDriver  pointer to AFSKDemodDriver data structure.
+ *
+ *@api
+ */
+void init_sdft_decoder(AFSKDemodDriver *myDriver) {
+  /* Assign the decoder record for this radio. */
+  uint8_t inst = pktGetAFSKDecoderIndex(myDriver);
+  sdft_decoder_t *decoder = &SDFT[inst];
+
+  decoder->sample_rate = FILTER_SAMPLE_RATE;
+  decoder->window_length = SDFT_WINDOW_LENGTH;
+  decoder->number_bins = SDFT_FILTER_BINS;
+  decoder->filter_bins = sdft_bins[inst];
+  decoder->hysteresis = SDFT_HYSTERESIS;
+  myDriver->tone_decoder = decoder;
+
+#if AFSK_NUM_SLICERS > 1
+  const float32_t gains[AFSK_NUM_SLICERS - 1] = AFSK_SLICER_SPACE_GAINS;
+  memcpy(decoder->slicer_space_gain, gains, sizeof(gains));
+#endif
+
+  /* Binary PWM maps to -h and +h DFT input. */
+  decoder->sample_level[1] = SDFT_SAMPLE_LEVEL;
+  decoder->sample_level[0] = -SDFT_SAMPLE_LEVEL;
+
+  decoder->filter_bins[AFSK_MARK_INDEX].freq = AFSK_MARK_FREQUENCY;
+  decoder->filter_bins[AFSK_SPACE_INDEX].freq = AFSK_SPACE_FREQUENCY;
+
+  /* Damping of the sample leaving the window is r^N. */
+  float32_t r_n = powf(SDFT_DAMPING, (float32_t)decoder->window_length);
+
+  uint8_t i;
+  for(i = 0; i < decoder->number_bins; i++) {
+    sdft_tone_t *myBin = &decoder->filter_bins[i];
+    float32_t w = 2.0f * PI * (float32_t)myBin->freq
+        / (float32_t)decoder->sample_rate;
+    myBin->coeff_re = SDFT_DAMPING * arm_cos_f32(w);
+    myBin->coeff_im = SDFT_DAMPING * arm_sin_f32(w);
+    myBin->comb_re = r_n * arm_cos_f32(w * decoder->window_length);
+    myBin->comb_im = r_n * arm_sin_f32(w * decoder->window_length);
+  }
+  reset_sdft_all(myDriver);
+}
+
+#endif /* AFSK_DSP_SDFT_DECODE */
+
+/** @} */
@@ -0,0 +1,124 @@
+/*
+    Aerospace Decoder - Copyright (C) 2018 Bob Anderson (VK2GJ)
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+/**
+ * @file    sdft_f32.h
+ * @brief   Sliding DFT (recursive Goertzel) tone detector using float32.
+ *
+ * @addtogroup DSP
+ * @{
+ */
+
+#ifndef IO_DECODERS_SDFT_H_
+#define IO_DECODERS_SDFT_H_
+
+/*===========================================================================*/
+/* Module constants.                                                         */
+/*===========================================================================*/
+
+#define SDFT_FILTER_BINS            AFSK_NUM_TONES /* Set by AFSK header. */
+#define SDFT_FILTER_BLOCK_SIZE      AFSK_FILTER_BLOCK_SIZE
+
+/* DFT window length in samples (one symbol). */
+#define SDFT_WINDOW_LENGTH          SYMBOL_DECIMATION
+
+#define SDFT_SAMPLE_LEVEL           1.0f
+#define SDFT_HYSTERESIS             0.05f
+
+/*
+ * Damping applied to the recursion to keep float rounding errors bounded.
+ * The sample leaving the window is weighted by SDFT_DAMPING^N.
+ */
+#define SDFT_DAMPING                0.9999f
+
+#define SDFT_PLL_SEARCH_RATE        0.5f
+#define SDFT_PLL_LOCKED_RATE        0.75f
+
+/*===========================================================================*/
+/* Module pre-compile time settings.                                         */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Derived constants and error checks.                                       */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Sliding DFT decoder bin (tone) structure.
+ *
+ * @note    Each bin holds its twiddle factors and running DFT value.
+ */
+typedef struct sdftTone {
+  uint16_t          freq;
+  /* Per sample rotation r.e^jw. */
+  float32_t         coeff_re;
+  float32_t         coeff_im;
+  /* Rotation applied to the sample leaving the window r^N.e^jwN. */
+  float32_t         comb_re;
+  float32_t         comb_im;
+  /* Running DFT bin value. */
+  float32_t         acc_re;
+  float32_t         acc_im;
+  float32_t         mag[SDFT_FILTER_BLOCK_SIZE];
+} sdft_tone_t;
+
+/**
+ * @brief   Sliding DFT decoder control structure.
+ *
+ */
+typedef struct sdftFilter {
+  uint16_t          window_length;
+  uint32_t          sample_rate;
+  float32_t         input_block[SDFT_FILTER_BLOCK_SIZE];
+  uint16_t          block_fill;
+  float32_t         window[SDFT_WINDOW_LENGTH];
+  uint16_t          window_index;
+  uint32_t          filter_valid;
+  uint8_t           number_bins;
+  sdft_tone_t       *filter_bins;
+  float32_t         sample_level[2];
+  float32_t         hysteresis;
+  tone_t            prior_demod;
+  tone_t            current_demod;
+#if AFSK_NUM_SLICERS > 1
+  float32_t         slicer_space_gain[AFSK_NUM_SLICERS - 1];
+  tone_t            slicer_demod[AFSK_NUM_SLICERS - 1];
+#endif
+  int32_t           symbol_pll;
+  int32_t           prior_pll;
+} sdft_decoder_t;
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  bool push_sdft_sample(AFSKDemodDriver *myDriver, bit_t sample);
+  void process_sdft_block(AFSKDemodDriver *myDriver);
+  bool process_sdft_output(AFSKDemodDriver *myDriver, uint16_t n);
+  void reset_sdft_all(AFSKDemodDriver *myDriver);
+  bool get_sdft_symbol_timing(AFSKDemodDriver *myDriver);
+  void update_sdft_pll(AFSKDemodDriver *myDriver);
+  void init_sdft_decoder(AFSKDemodDriver *myDriver);
+#ifdef __cplusplus
+}
+#endif
+
+/*===========================================================================*/
+/* Module inline functions.                                                  */
+/*===========================================================================*/
+
+
+#endif /* IO_DECODERS_SDFT_H_ */
+
+/** @} */
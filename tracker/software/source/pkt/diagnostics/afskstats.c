@@ -0,0 +1,166 @@
+/*
+    Aerospace Decoder - Copyright (C) 2018 Bob Anderson (VK2GJ)
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+/**
+ * @file    afskstats.c
+ * @brief   AFSK decoder CPU load and latency statistics.
+ *
+ * @addtogroup pktdiag
+ * @{
+ */
+
+#include "pktconf.h"
+
+#if USE_AFSK_DECODER_STATS == TRUE
+
+/*===========================================================================*/
+/* Module local variables.                                                   */
+/*===========================================================================*/
+
+static const char *stage_names[AFSK_STAGE_COUNT] = {
+  "pre-filter",
+  "correlate",
+  "magnitude",
+  "pll",
+  "hdlc"
+};
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Adds a cycle count to a stage.
+ * @notes   The histogram bin is the integer log2 of the cycle count.
+ *
+ * @param[in] stats     pointer to a @p afsk_decoder_stats_t structure.
+ * @param[in] stage     the decoder stage.
+ * @param[in] cycles    number of cycles taken by the stage.
+ *
+ * @api
+ */
+void pktAddAFSKStageCycles(afsk_decoder_stats_t *stats,
+                           afsk_stage_t stage, rtcnt_t cycles) {
+  afsk_stage_stats_t *myStage = &stats->stage[stage];
+  myStage->count++;
+  myStage->total += cycles;
+  if(cycles > myStage->peak)
+    myStage->peak = cycles;
+  uint8_t bin = (cycles == 0) ? 0 : (31U - __builtin_clz(cycles));
+  if(bin >= AFSK_STATS_HIST_BINS)
+    bin = AFSK_STATS_HIST_BINS - 1;
+  myStage->hist[bin]++;
+}
+
+/**
+ * @brief   Updates the peak PWM queue depth.
+ *
+ * @param[in] stats     pointer to a @p afsk_decoder_stats_t structure.
+ * @param[in] depth     number of PWM entries waiting.
+ *
+ * @api
+ */
+void pktAddAFSKQueueDepth(afsk_decoder_stats_t *stats, uint32_t depth) {
+  if(depth > stats->peak_pwm_queue)
+    stats->peak_pwm_queue = depth;
+}
+
+/**
+ * @brief   Records a frame dispatch and the latency from CCA close.
+ * @notes   The decoder may dispatch before CCA closes.
+ * @notes   That case is counted as an early dispatch with no latency.
+ *
+ * @param[in] stats     pointer to a @p afsk_decoder_stats_t structure.
+ *
+ * @api
+ */
+void pktAddAFSKDispatchLatency(afsk_decoder_stats_t *stats) {
+  stats->frames++;
+  if(!stats->cca_closed) {
+    stats->early_dispatch++;
+    return;
+  }
+  uint32_t latency = chSysGetRealtimeCounterX() - stats->cca_close;
+  stats->latency_count++;
+  stats->latency_total += latency;
+  stats->latency_last = latency;
+  if(latency > stats->latency_peak)
+    stats->latency_peak = latency;
+}
+
+/**
+ * @brief   Clears all statistics.
+ *
+ * @param[in] stats     pointer to a @p afsk_decoder_stats_t structure.
+ *
+ * @api
+ */
+void pktClearAFSKStats(afsk_decoder_stats_t *stats) {
+  chSysLock();
+  memset(stats, 0, sizeof(afsk_decoder_stats_t));
+  chSysUnlock();
+}
+
+/**
+ * @brief   Gets a copy of the AFSK decoder statistics for a radio.
+ *
+ * @param[in] radio     radio unit ID.
+ * @param[in] copy      pointer to a @p afsk_decoder_stats_t for the result.
+ *
+ * @return  status of the request.
+ * @retval  true    the statistics were copied.
+ * @retval  false   the radio has no AFSK decoder.
+ *
+ * @api
+ */
+bool pktGetAFSKStats(radio_unit_t radio, afsk_decoder_stats_t *copy) {
+  packet_svc_t *handler = pktGetServiceObject(radio);
+  if(handler == NULL || handler->link_controller == NULL)
+    return false;
+  AFSKDemodDriver *myDriver = (AFSKDemodDriver *)handler->link_controller;
+  chSysLock();
+  *copy = myDriver->stats;
+  chSysUnlock();
+  return true;
+}
+
+/**
+ * @brief   Resets the AFSK decoder statistics for a radio.
+ *
+ * @param[in] radio     radio unit ID.
+ *
+ * @return  status of the request.
+ * @retval  true    the statistics were reset.
+ * @retval  false   the radio has no AFSK decoder.
+ *
+ * @api
+ */
+bool pktResetAFSKStats(radio_unit_t radio) {
+  packet_svc_t *handler = pktGetServiceObject(radio);
+  if(handler == NULL || handler->link_controller == NULL)
+    return false;
+  pktClearAFSKStats(&((AFSKDemodDriver *)handler->link_controller)->stats);
+  return true;
+}
+
+/**
+ * @brief   Gets the display name of a decoder stage.
+ *
+ * @param[in] stage     the decoder stage.
+ *
+ * @return  pointer to the name string.
+ *
+ * @api
+ */
+const char *pktGetAFSKStageName(afsk_stage_t stage) {
+  return (stage < AFSK_STAGE_COUNT) ? stage_names[stage] : "unknown";
+}
+
+#endif /* USE_AFSK_DECODER_STATS == TRUE */
+
+/** @} */
@@ -0,0 +1,178 @@
+/*
+    Aerospace Decoder - Copyright (C) 2018 Bob Anderson (VK2GJ)
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+/**
+ * @file    afskstats.h
+ * @brief   AFSK decoder CPU load and latency statistics.
+ * @details Stage timing uses the DWT cycle counter (realtime counter).
+ *
+ * @addtogroup pktdiag
+ * @{
+ */
+
+#ifndef PKT_DIAGNOSTICS_AFSKSTATS_H_
+#define PKT_DIAGNOSTICS_AFSKSTATS_H_
+
+/*===========================================================================*/
+/* Module constants.                                                         */
+/*===========================================================================*/
+
+/* Histogram bins are powers of two. The last bin holds all larger values. */
+#define AFSK_STATS_HIST_BINS        16U
+
+/*===========================================================================*/
+/* Module pre-compile time settings.                                         */
+/*===========================================================================*/
+
+/*
+ * Collect per stage cycle counts in the AFSK decoder.
+ * Each timed stage costs two counter reads and a histogram update.
+ */
+#define USE_AFSK_DECODER_STATS      TRUE
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Timed stages of the AFSK decoder.
+ */
+typedef enum afskStage {
+  AFSK_STAGE_PREFILTER = 0,
+  AFSK_STAGE_CORRELATE,
+  AFSK_STAGE_MAGNITUDE,
+  AFSK_STAGE_PLL,
+  AFSK_STAGE_HDLC,
+  AFSK_STAGE_COUNT
+} afsk_stage_t;
+
+/**
+ * @brief   Cycle statistics for a decoder stage.
+ */
+typedef struct afskStageStats {
+  uint32_t          count;
+  uint64_t          total;
+  uint32_t          peak;
+  uint32_t          hist[AFSK_STATS_HIST_BINS];
+} afsk_stage_stats_t;
+
+/**
+ * @brief   AFSK decoder statistics.
+ * @note    The CCA close stamp is written at ISR level by the PWM handler.
+ */
+typedef struct afskDecoderStats {
+  afsk_stage_stats_t    stage[AFSK_STAGE_COUNT];
+  /* Decimated samples, symbols and frames dispatched. */
+  uint32_t              samples;
+  uint32_t              symbols;
+  uint32_t              frames;
+  /* Total cycles in the AFSK processing path. */
+  uint64_t              process_cycles;
+  /* Peak PWM entries waiting to be decoded. */
+  uint32_t              peak_pwm_queue;
+  /* Latency from CCA close to frame dispatch. */
+  volatile rtcnt_t      cca_close;
+  volatile bool         cca_closed;
+  uint32_t              latency_count;
+  uint64_t              latency_total;
+  uint32_t              latency_peak;
+  uint32_t              latency_last;
+  /* Frames dispatched before CCA closed. */
+  uint32_t              early_dispatch;
+  /* CCA breaks accepted and rejected by PWM pre-qualification. */
+  uint32_t              qualify_accept;
+  uint32_t              qualify_reject;
+  /* Sessions ended by the software carrier detect. */
+  uint32_t              dcd_drops;
+  /* Sessions handed from the period discriminator to the correlator. */
+  uint32_t              period_fallbacks;
+  /* Times the decoder priority was raised by the PWM backlog. */
+  uint32_t              priority_boosts;
+} afsk_decoder_stats_t;
+
+/*===========================================================================*/
+/* Module macros.                                                            */
+/*===========================================================================*/
+
+#if USE_AFSK_DECODER_STATS == TRUE
+/* Take a cycle counter stamp for a stage. */
+#define AFSK_STATS_STAMP(t)         rtcnt_t t = chSysGetRealtimeCounterX()
+
+/* Record cycles for a stage since the stamp. */
+#define AFSK_STATS_STAGE(drv, s, t)                                          \
+  pktAddAFSKStageCycles(&(drv)->stats, s, chSysGetRealtimeCounterX() - (t))
+#else
+#define AFSK_STATS_STAMP(t)
+#define AFSK_STATS_STAGE(drv, s, t)
+#endif
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  void pktAddAFSKStageCycles(afsk_decoder_stats_t *stats,
+                             afsk_stage_t stage, rtcnt_t cycles);
+  void pktAddAFSKQueueDepth(afsk_decoder_stats_t *stats, uint32_t depth);
+  void pktAddAFSKDispatchLatency(afsk_decoder_stats_t *stats);
+  void pktClearAFSKStats(afsk_decoder_stats_t *stats);
+  bool pktGetAFSKStats(radio_unit_t radio, afsk_decoder_stats_t *copy);
+  bool pktResetAFSKStats(radio_unit_t radio);
+  const char *pktGetAFSKStageName(afsk_stage_t stage);
+#ifdef __cplusplus
+}
+#endif
+
+/*===========================================================================*/
+/* Module inline functions.                                                  */
+/*===========================================================================*/
+
+/**
+ * @brief   Records the result of PWM pre-qualification of a CCA break.
+ *
+ * @param[in] stats     pointer to a @p afsk_decoder_stats_t structure.
+ * @param[in] accept    true if the PWM stream was opened.
+ *
+ * @iclass
+ */
+static inline void pktAddAFSKQualifyI(afsk_decoder_stats_t *stats,
+                                      bool accept) {
+  if(accept)
+    stats->qualify_accept++;
+  else
+    stats->qualify_reject++;
+}
+
+/**
+ * @brief   Records the CCA close time for latency measurement.
+ *
+ * @param[in] stats     pointer to a @p afsk_decoder_stats_t structure.
+ *
+ * @iclass
+ */
+static inline void pktSetAFSKCCACloseI(afsk_decoder_stats_t *stats) {
+  stats->cca_close = chSysGetRealtimeCounterX();
+  stats->cca_closed = true;
+}
+
+/**
+ * @brief   Clears the CCA close state at start of a PWM session.
+ *
+ * @param[in] stats     pointer to a @p afsk_decoder_stats_t structure.
+ *
+ * @iclass
+ */
+static inline void pktClearAFSKCCACloseI(afsk_decoder_stats_t *stats) {
+  stats->cca_closed = false;
+}
+
+#endif /* PKT_DIAGNOSTICS_AFSKSTATS_H_ */
+
+/** @} */
@@ -16,7 +16,10 @@
 
 #include "pktconf.h"
 
-/* Buffer and size params for serial terminal output. */
+/*
+ * Buffer and size params for serial terminal output.
+ * Shared by the dump functions rather than kept on the caller stack.
+ */
 char serial_buf[1024];
 int serial_out;
 
@@ -97,9 +100,6 @@ void pktDumpAX25Frame(ax25char_t *frame_buffer,
 void pktDiagnosticOutput(packet_svc_t *packetHandler,
                          pkt_data_object_t *myPktFIFO) {
   chBSemWait(&debug_out_sem);
-  /* Buffer and size params for serial terminal output. */
-    char serial_buf[1024];
-    int serial_out;
 
   /* Packet buffer. */
   ax25char_t *frame_buffer = myPktFIFO->buffer;
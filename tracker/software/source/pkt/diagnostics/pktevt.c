@@ -7,78 +7,238 @@
 */
 
 #include "pktconf.h"
+#include "memregion.h"
 
-event_listener_t pkt_el;
-static bool trace_enabled = false;
+/**
+ * @brief   Trace text of an event flag.
+ */
+typedef struct {
+  eventflags_t              flag;
+  uint8_t                   level;
+  const char                *text;
+} pkt_evt_text_t;
+
+static const pkt_evt_text_t evt_text[] = {
+  {EVT_PWM_QUEUE_FULL,      TRACE_LEVEL_WARN,  "PWM queue full"},
+  {EVT_PWM_FIFO_EMPTY,      TRACE_LEVEL_WARN,  "PWM FIFO exhausted"},
+  {EVT_PKT_NO_BUFFER,       TRACE_LEVEL_WARN,  "AX25 FIFO exhausted"},
+  {EVT_ICU_SLEEP_TIMEOUT,   TRACE_LEVEL_INFO,  "PWM ICU has entered sleep"},
+  {EVT_PKT_BUFFER_FULL,     TRACE_LEVEL_WARN,  "AX25 receive buffer full"},
+  {EVT_PWM_QUEUE_OVERRUN,   TRACE_LEVEL_ERROR, "PWM queue overrun"},
+  {EVT_PWM_INVALID_INBAND,  TRACE_LEVEL_ERROR, "Invalid PWM in-band message"},
+  {EVT_PWM_NO_DATA,         TRACE_LEVEL_ERROR, "No PWM data from radio"},
+  {EVT_PKT_FAILED_CB_THD,   TRACE_LEVEL_ERROR,
+                            "Failed to create RX callback thread"},
+  {EVT_PWM_INVALID_SWAP,    TRACE_LEVEL_DEBUG, "Invalid in-band buffer swap"},
+  {EVT_PWM_STREAM_TIMEOUT,  TRACE_LEVEL_WARN,  "PWM stream timeout"},
+  {EVT_AFSK_START_FAIL,     TRACE_LEVEL_ERROR, "AFSK decoder failed to start"},
+  {EVT_PKT_BUFFER_MGR_FAIL, TRACE_LEVEL_ERROR,
+                            "Unable to start packet RX buffer"},
+  {EVT_PKT_CBK_MGR_FAIL,    TRACE_LEVEL_ERROR,
+                            "Unable to start packet RX callback manager"}
+};
+
+#define PKT_EVT_NUM_TEXT  (sizeof(evt_text) / sizeof(evt_text[0]))
+
+/* Event sources of the radios being traced. */
+static event_source_t *evt_source[PKT_EVT_SOURCES];
+
+static pkt_evt_entry_t evt_ring[PKT_EVT_RING_SIZE];
+static uint8_t evt_head;
+static uint8_t evt_used;
+static uint32_t evt_lost;
+static uint32_t evt_count[PKT_EVT_FLAGS];
+
+static binary_semaphore_t evt_sem;
+static thread_t *evt_thd;
+
+/**
+ * @brief   Trace an event taken from the ring.
+ * @notes   Events without trace text are only counted.
+ *
+ * @param[in]   entry   pointer to a @p pkt_evt_entry_t structure.
+ *
+ * @notapi
+ */
+static void pktTraceEvent(const pkt_evt_entry_t *entry) {
+  uint8_t i;
+  for(i = 0; i < PKT_EVT_NUM_TEXT; i++) {
+    if((entry->flags & evt_text[i].flag) == 0)
+      continue;
+    uint32_t count = pktGetEventCount(__builtin_ctz(evt_text[i].flag));
+    uint32_t ms = chTimeI2MS(entry->time);
+    switch(evt_text[i].level) {
+    case TRACE_LEVEL_ERROR:
+      TRACE_ERROR("PKT  > %s on radio %d at %d ms arg %d (total %d)",
+                  evt_text[i].text, entry->radio, ms, entry->arg, count);
+      break;
+
+    case TRACE_LEVEL_WARN:
+      TRACE_WARN("PKT  > %s on radio %d at %d ms arg %d (total %d)",
+                 evt_text[i].text, entry->radio, ms, entry->arg, count);
+      break;
+
+    case TRACE_LEVEL_INFO:
+      TRACE_INFO("PKT  > %s on radio %d at %d ms arg %d (total %d)",
+                 evt_text[i].text, entry->radio, ms, entry->arg, count);
+      break;
+
+    default:
+      TRACE_DEBUG("PKT  > %s on radio %d at %d ms arg %d (total %d)",
+                  evt_text[i].text, entry->radio, ms, entry->arg, count);
+      break;
+    }
+  }
+}
 
+/**
+ * @brief   Drains the event ring to the trace.
+ * @details Entries are copied out of the ring under lock and traced
+ *          unlocked. Entries lost to a full ring are reported once drained.
+ *
+ * @param[in]   arg     not used.
+ *
+ * @notapi
+ */
+THD_FUNCTION(pktEventTrace, arg) {
+  (void)arg;
+  uint32_t reported = 0;
+  while(true) {
+    chBSemWait(&evt_sem);
+    while(true) {
+      chSysLock();
+      if(evt_used == 0) {
+        uint32_t lost = evt_lost;
+        chSysUnlock();
+        if(lost != reported) {
+          TRACE_WARN("PKT  > %d events not traced (ring full)",
+                     lost - reported);
+          reported = lost;
+        }
+        break;
+      }
+      uint8_t tail = (evt_head + PKT_EVT_RING_SIZE - evt_used)
+          % PKT_EVT_RING_SIZE;
+      pkt_evt_entry_t entry = evt_ring[tail];
+      evt_used--;
+      chSysUnlock();
+      pktTraceEvent(&entry);
+    }
+  }
+}
+
+/**
+ * @brief   Writes an event to the ring and counts its flags.
+ * @notes   Events of sources other than a traced packet service are
+ *          ignored. Decoder drivers use the same flag macros.
+ * @notes   A full ring drops the entry but its flags are still counted.
+ *
+ * @param[in]   esp     pointer to the event source of the event.
+ * @param[in]   flags   event flags.
+ * @param[in]   arg     argument of the event.
+ *
+ * @iclass
+ */
+void pktLogEventI(event_source_t *esp, eventflags_t flags, uint32_t arg) {
+  chDbgCheckClassI();
+
+  uint8_t i;
+  for(i = 0; i < PKT_EVT_SOURCES; i++) {
+    if(evt_source[i] == esp)
+      break;
+  }
+  if(i == PKT_EVT_SOURCES)
+    return;
+
+  eventflags_t f = flags;
+  while(f != 0) {
+    evt_count[__builtin_ctz(f)]++;
+    f &= f - 1;
+  }
+  if(evt_used == PKT_EVT_RING_SIZE) {
+    evt_lost++;
+    return;
+  }
+  pkt_evt_entry_t *entry = &evt_ring[evt_head];
+  entry->flags = flags;
+  entry->radio = (radio_unit_t)(PKT_RADIO_1 + i);
+  entry->time = chVTGetSystemTimeX();
+  entry->arg = arg;
+  evt_head = (evt_head + 1) % PKT_EVT_RING_SIZE;
+  evt_used++;
+  chBSemSignalI(&evt_sem);
+}
 
+/**
+ * @brief   Starts tracing the packet service events of a radio.
+ * @notes   The trace thread is started on first use.
+ *
+ * @param[in]   radio   radio unit ID.
+ *
+ * @api
+ */
 void pktEnableEventTrace(radio_unit_t radio) {
+  uint8_t i = radio - PKT_RADIO_1;
+  chDbgCheck(i < PKT_EVT_SOURCES);
+  if(i >= PKT_EVT_SOURCES)
+    return;
+  if(evt_thd == NULL) {
+    chBSemObjectInit(&evt_sem, true);
+    evt_thd = mem_thread_create(MEM_REGION_THREADS,
+                                THD_WORKING_AREA_SIZE(PKT_EVT_WA_SIZE),
+                                PKT_EVT_THREAD_NAME, LOWPRIO,
+                                pktEventTrace, NULL);
+    chDbgAssert(evt_thd != NULL, "failed to create event trace thread");
+    if(evt_thd == NULL)
+      return;
+  }
   packet_svc_t *handler = pktGetServiceObject(radio);
-  chEvtRegister(pktGetEventSource(handler), &pkt_el, 1);
-  trace_enabled = true;
+  chSysLock();
+  evt_source[i] = pktGetEventSource(handler);
+  chSysUnlock();
 }
 
+/**
+ * @brief   Stops tracing the packet service events of a radio.
+ *
+ * @param[in]   radio   radio unit ID.
+ *
+ * @api
+ */
 void pktDisableEventTrace(radio_unit_t radio) {
-  packet_svc_t *handler = pktGetServiceObject(radio);
-  trace_enabled = false;
-  chEvtUnregister(pktGetEventSource(handler), &pkt_el);
+  uint8_t i = radio - PKT_RADIO_1;
+  chDbgCheck(i < PKT_EVT_SOURCES);
+  if(i >= PKT_EVT_SOURCES)
+    return;
+  chSysLock();
+  evt_source[i] = NULL;
+  chSysUnlock();
 }
 
-/*
- * TODO:
- * - Refactor and add severity categories filtering
- * - Add packet service listener object per radio.
+/**
+ * @brief   Gets the count of an event flag over the traced radios.
+ *
+ * @param[in]   bit     bit number of the event flag.
+ *
+ * @return  number of times the flag was raised.
+ *
+ * @api
  */
-void pktTraceEvents() {
-  if(!trace_enabled)
-    return;
-eventmask_t evt = chEvtGetAndClearEvents(EVENT_MASK(1));
-  if(evt) {
-    eventflags_t flags = chEvtGetAndClearFlags(&pkt_el);
-    if(flags & EVT_PWM_QUEUE_FULL) {
-      TRACE_WARN("PKT  > PWM queue full");
-    }
-    if(flags & EVT_PWM_FIFO_EMPTY) {
-      TRACE_WARN("PKT  > PWM FIFO exhausted");
-    }
-    if(flags & EVT_PKT_NO_BUFFER) {
-      TRACE_WARN("PKT  > AX25 FIFO exhausted");
-    }
-    if(flags & EVT_ICU_SLEEP_TIMEOUT) {
-      TRACE_INFO("PKT  > PWM ICU has entered sleep");
-    }
-    if(flags & EVT_PKT_BUFFER_FULL) {
-      TRACE_WARN("PKT  > AX25 receive buffer full");
-    }
-    if(flags & EVT_PWM_QUEUE_OVERRUN) {
-      TRACE_ERROR("PKT  > PWM queue overrun");
-    }
-    if(flags & EVT_PWM_INVALID_INBAND) {
-      TRACE_ERROR("PKT  > Invalid PWM in-band message");
-    }
-    if(flags & EVT_PWM_NO_DATA) {
-      TRACE_ERROR("PKT  > No PWM data from radio");
-    }
-    if(flags & EVT_PKT_FAILED_CB_THD) {
-      TRACE_ERROR("PKT  > Failed to create RX callback thread");
-    }
-    if(flags & EVT_PWM_INVALID_SWAP) {
-      TRACE_DEBUG("PKT  > Invalid in-band buffer swap");
-    }
-    if(flags & EVT_PWM_STREAM_TIMEOUT) {
-      TRACE_WARN("PKT  > PWM stream timeout");
-    }
-    if(flags & EVT_PWM_NO_DATA) {
-      TRACE_WARN("PKT  > No PWM data from radio");
-    }
-    if(flags & EVT_AFSK_START_FAIL) {
-      TRACE_ERROR("PKT  > AFSK decoder failed to start");
-    }
-    if(flags & EVT_PKT_BUFFER_MGR_FAIL) {
-      TRACE_ERROR("PKT  > Unable to start packet RX buffer");
-    }
-    if(flags & EVT_PKT_CBK_MGR_FAIL) {
-      TRACE_ERROR("PKT  > Unable to start packet RX callback manager");
-    }
-  }
+uint32_t pktGetEventCount(uint8_t bit) {
+  if(bit >= PKT_EVT_FLAGS)
+    return 0;
+  return evt_count[bit];
 }
+
+/**
+ * @brief   Gets the number of events dropped by a full ring.
+ *
+ * @return  number of events not traced.
+ *
+ * @api
+ */
+uint32_t pktGetEventsLost(void) {
+  return evt_lost;
+}
+
+/** @} */
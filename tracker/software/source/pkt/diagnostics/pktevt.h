@@ -9,6 +9,10 @@
 /**
  * @file    pktevt.h
  * @brief   Packet event tracing.
+ * @details Events of the packet service of a radio are written to a ring
+ *          where they are added and counted per event flag. A low priority
+ *          thread drains the ring to the trace so bursts of the same event
+ *          are neither merged nor lost from the counts.
  *
  * @addtogroup pktdiag
  * @{
@@ -17,6 +21,30 @@
 #ifndef PKT_DIAGNOSTICS_PKTEVT_H_
 #define PKT_DIAGNOSTICS_PKTEVT_H_
 
+/*===========================================================================*/
+/* Module constants.                                                         */
+/*===========================================================================*/
+
+#define PKT_EVT_RING_SIZE       32U
+#define PKT_EVT_SOURCES         2U
+#define PKT_EVT_FLAGS           32U
+#define PKT_EVT_WA_SIZE         1024
+#define PKT_EVT_THREAD_NAME     "PKTEVT"
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Packet event ring entry.
+ */
+typedef struct {
+  eventflags_t              flags;
+  radio_unit_t              radio;
+  systime_t                 time;
+  uint32_t                  arg;
+} pkt_evt_entry_t;
+
 /*===========================================================================*/
 /* External declarations.                                                    */
 /*===========================================================================*/
@@ -24,9 +52,11 @@
 #ifdef __cplusplus
 extern "C" {
 #endif
-void pktTraceEvents(void);
+void pktLogEventI(event_source_t *esp, eventflags_t flags, uint32_t arg);
 void pktEnableEventTrace(radio_unit_t radio);
 void pktDisableEventTrace(radio_unit_t radio);
+uint32_t pktGetEventCount(uint8_t bit);
+uint32_t pktGetEventsLost(void);
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,246 @@
+/*
+    Aerospace Decoder - Copyright (C) 2018 Bob Anderson (VK2GJ)
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+/**
+ * @file    pwmreplay.c
+ * @brief   Replay of recorded PWM into the AFSK decoder.
+ * @details The replay writes the PWM stream in place of the ICU.
+ *          Entries are written as fast as the decoder accepts them.
+ *
+ * @addtogroup pktdiag
+ * @{
+ */
+
+#include "pktconf.h"
+
+#if USE_PWM_REPLAY == TRUE
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+/**
+ * @brief   Gets the number of free PWM stream objects.
+ *
+ * @param[in] myDemod   pointer to a @p AFSKDemodDriver structure.
+ *
+ * @return  number of free objects.
+ */
+static cnt_t pktGetReplayFreeStreams(AFSKDemodDriver *myDemod) {
+  chSysLock();
+  cnt_t n = chSemGetCounterI(&myDemod->pwm_fifo_pool->free.sem);
+  chSysUnlock();
+  return n;
+}
+
+/**
+ * @brief   Opens a PWM stream for the next replayed session.
+ * @notes   Waits while the decoder holds all stream objects.
+ *
+ * @param[in] myDemod   pointer to a @p AFSKDemodDriver structure.
+ *
+ * @return              The operation status.
+ * @retval MSG_OK       The stream is open.
+ * @retval MSG_TIMEOUT  No stream object became available.
+ * @retval MSG_RESET    The replay was stopped.
+ */
+static msg_t pktOpenReplayStream(AFSKDemodDriver *myDemod) {
+  systime_t start = chVTGetSystemTime();
+  while(pktGetReplayFreeStreams(myDemod) <= 0) {
+    if(chVTTimeElapsedSinceX(start) > PWM_REPLAY_OPEN_TIMEOUT)
+      return MSG_TIMEOUT;
+    chThdSleep(TIME_MS2I(1));
+  }
+  chSysLock();
+  if(myDemod->icustate != PKT_PWM_REPLAY) {
+    chSysUnlock();
+    return MSG_RESET;
+  }
+  pktOpenPWMChannelI(myDemod->icudriver, EVT_PWM_STREAM_OPEN);
+  msg_t msg = (myDemod->active_radio_object != NULL) ? MSG_OK : MSG_TIMEOUT;
+  chSchRescheduleS();
+  chSysUnlock();
+  return msg;
+}
+
+/**
+ * @brief   Closes the replayed PWM stream if open.
+ *
+ * @param[in] myDemod   pointer to a @p AFSKDemodDriver structure.
+ */
+static void pktCloseReplayStream(AFSKDemodDriver *myDemod) {
+  chSysLock();
+  if(myDemod->icustate == PKT_PWM_REPLAY
+      && myDemod->active_radio_object != NULL)
+    pktClosePWMchannelI(myDemod->icudriver, EVT_NONE, PWM_TERM_CCA_CLOSE);
+  chSchRescheduleS();
+  chSysUnlock();
+}
+
+/**
+ * @brief   Replays one recorded PWM entry.
+ * @notes   An in-band entry other than a buffer swap ends the session.
+ * @notes   If the decoder closes the stream the rest of the session is dropped.
+ *
+ * @param[in] myDemod   pointer to a @p AFSKDemodDriver structure.
+ * @param[in] pack      recorded PWM entry.
+ * @param[in] skip      pointer to the session drop state.
+ * @param[in] counts    pointer to the total of replayed ICU counts.
+ * @param[in] result    pointer to the replay result.
+ *
+ * @return              The operation status.
+ * @retval MSG_OK       The entry was handled.
+ * @retval MSG_TIMEOUT  No stream object became available.
+ * @retval MSG_RESET    The replay was stopped.
+ */
+static msg_t pktReplayPWMEntry(AFSKDemodDriver *myDemod,
+                               byte_packed_pwm_t pack, bool *skip,
+                               uint64_t *counts, pwm_replay_result_t *result) {
+  array_min_pwm_counts_t pwm;
+  pktUnpackPWMData(pack, &pwm);
+
+  if(pwm.pwm.impulse == PWM_IN_BAND_PREFIX) {
+    /* Buffer swaps belong to the stream that was recorded. */
+    if(pwm.pwm.valley == PWM_INFO_QUEUE_SWAP)
+      return MSG_OK;
+    *skip = false;
+    pktCloseReplayStream(myDemod);
+    return MSG_OK;
+  }
+
+  if(*skip) {
+    result->dropped++;
+    return MSG_OK;
+  }
+
+  if(myDemod->active_radio_object == NULL) {
+    msg_t msg = pktOpenReplayStream(myDemod);
+    if(msg != MSG_OK)
+      return msg;
+    result->sessions++;
+  }
+
+  while(true) {
+    chSysLock();
+    msg_t msg = pktWritePWMReplayI(myDemod->icudriver, pack);
+    chSchRescheduleS();
+    chSysUnlock();
+    switch(msg) {
+    case MSG_OK:
+      result->entries++;
+      *counts += pwm.pwm.impulse + pwm.pwm.valley;
+      return MSG_OK;
+
+    case MSG_RESET:
+      if(myDemod->icustate != PKT_PWM_REPLAY)
+        return MSG_RESET;
+      /* The decoder has closed the stream. */
+      *skip = true;
+      result->dropped++;
+      return MSG_OK;
+
+    default:
+      /* The decoder is behind. */
+      chThdSleep(TIME_MS2I(1));
+      break;
+    }
+  }
+}
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Replays a PWM recording into the AFSK decoder of a radio.
+ * @notes   Radio PWM is ignored for the duration of the replay.
+ * @notes   Decoded frames are dispatched as for received frames.
+ * @pre     Receive must be active on the radio.
+ *
+ * @param[in] radio     radio unit ID.
+ * @param[in] read      function to read the recording.
+ * @param[in] arg       argument passed to the read function.
+ * @param[out] result   pointer to the replay result.
+ *
+ * @return              The operation status.
+ * @retval MSG_OK       The recording was replayed.
+ * @retval MSG_TIMEOUT  The PWM stream was busy or no stream object was free.
+ * @retval MSG_RESET    Receive is not active or was stopped.
+ *
+ * @api
+ */
+msg_t pktReplayPWM(radio_unit_t radio, pwm_replay_read_t read, void *arg,
+                   pwm_replay_result_t *result) {
+  memset(result, 0, sizeof(pwm_replay_result_t));
+
+  if(!pktIsReceiveActive(radio))
+    return MSG_RESET;
+  packet_svc_t *handler = pktGetServiceObject(radio);
+  AFSKDemodDriver *myDemod = (AFSKDemodDriver *)handler->link_controller;
+  if(myDemod == NULL)
+    return MSG_RESET;
+
+  chSysLock();
+  bool started = pktStartPWMReplayI(myDemod->icudriver);
+  chSysUnlock();
+  if(!started)
+    return MSG_TIMEOUT;
+
+#if USE_AFSK_DECODER_STATS == TRUE
+  chSysLock();
+  uint32_t frames = myDemod->stats.frames;
+  uint64_t cycles = myDemod->stats.process_cycles;
+  chSysUnlock();
+#endif
+
+  systime_t start = chVTGetSystemTime();
+  uint8_t buffer[PWM_REPLAY_CHUNK * sizeof(byte_packed_pwm_t)];
+  byte_packed_pwm_t pack;
+  uint8_t fill = 0;
+  bool skip = false;
+  uint64_t counts = 0;
+  msg_t msg = MSG_OK;
+  size_t n;
+  while(msg == MSG_OK && (n = read(arg, buffer, sizeof(buffer))) > 0) {
+    size_t i;
+    for(i = 0; i < n && msg == MSG_OK; i++) {
+      /* Sources can return part entries so assemble byte by byte. */
+      pack.bytes[fill++] = buffer[i];
+      if(fill < sizeof(byte_packed_pwm_t))
+        continue;
+      fill = 0;
+      msg = pktReplayPWMEntry(myDemod, pack, &skip, &counts, result);
+    }
+  }
+  pktCloseReplayStream(myDemod);
+
+  /* Wait for the decoder to release the replayed streams. */
+  systime_t drain = chVTGetSystemTime();
+  while(msg == MSG_OK
+      && pktGetReplayFreeStreams(myDemod) < (cnt_t)NUMBER_PWM_FIFOS
+      && chVTTimeElapsedSinceX(drain) < PWM_REPLAY_DRAIN_TIMEOUT)
+    chThdSleep(TIME_MS2I(1));
+  result->elapsed = chVTTimeElapsedSinceX(start);
+  result->signal_us = (counts * 1000000U) / ICU_COUNT_FREQUENCY;
+
+#if USE_AFSK_DECODER_STATS == TRUE
+  chSysLock();
+  result->frames = myDemod->stats.frames - frames;
+  result->cycles = myDemod->stats.process_cycles - cycles;
+  chSysUnlock();
+#endif
+
+  chSysLock();
+  pktStopPWMReplayI(myDemod->icudriver);
+  chSysUnlock();
+  return msg;
+}
+
+#endif /* USE_PWM_REPLAY == TRUE */
+
+/** @} */
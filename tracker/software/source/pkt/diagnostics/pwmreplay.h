@@ -0,0 +1,84 @@
+/*
+    Aerospace Decoder - Copyright (C) 2018 Bob Anderson (VK2GJ)
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+/**
+ * @file    pwmreplay.h
+ * @brief   Replay of recorded PWM into the AFSK decoder.
+ * @details Recordings are byte packed PWM entries as read by the decoder.
+ *          A recording can be made with AFSK_PWM_REPLAY_CAPTURE_DEBUG.
+ *          In-band entries in the recording delimit the PWM sessions.
+ *
+ * @addtogroup pktdiag
+ * @{
+ */
+
+#ifndef PKT_DIAGNOSTICS_PWMREPLAY_H_
+#define PKT_DIAGNOSTICS_PWMREPLAY_H_
+
+/*===========================================================================*/
+/* Module constants.                                                         */
+/*===========================================================================*/
+
+/* Time allowed for the decoder to finish after the recording ends. */
+#define PWM_REPLAY_DRAIN_TIMEOUT    TIME_S2I(2)
+
+/* Time allowed for a PWM stream object to be available. */
+#define PWM_REPLAY_OPEN_TIMEOUT     TIME_S2I(1)
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Reads the next part of a recording.
+ *
+ * @param[in] arg       source specific argument.
+ * @param[in] buffer    pointer to the buffer for the data.
+ * @param[in] size      size of the buffer in bytes.
+ *
+ * @return  number of bytes read. Zero at the end of the recording.
+ */
+typedef size_t (*pwm_replay_read_t)(void *arg, uint8_t *buffer, size_t size);
+
+/**
+ * @brief   Result of a PWM replay.
+ * @note    Frames and cycles need USE_AFSK_DECODER_STATS.
+ */
+typedef struct {
+  /* PWM entries written to the decoder. */
+  uint32_t          entries;
+  /* Entries discarded after the decoder closed a stream. */
+  uint32_t          dropped;
+  /* PWM sessions opened. */
+  uint32_t          sessions;
+  /* Frames dispatched by the decoder. */
+  uint32_t          frames;
+  /* Cycles in the AFSK processing path. */
+  uint64_t          cycles;
+  /* Duration of the recorded signal. */
+  uint64_t          signal_us;
+  /* Time taken by the replay. */
+  sysinterval_t     elapsed;
+} pwm_replay_result_t;
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  msg_t pktReplayPWM(radio_unit_t radio, pwm_replay_read_t read, void *arg,
+                     pwm_replay_result_t *result);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PKT_DIAGNOSTICS_PWMREPLAY_H_ */
+
+/** @} */
@@ -0,0 +1,134 @@
+/*
+    Aerospace Decoder - Copyright (C) 2018 Bob Anderson (VK2GJ)
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+
+/**
+ * @file    firfilter_f32.c
+ * @brief   Float32 FIR filter implementation.
+ *
+ * @addtogroup DSP
+ * @{
+ */
+
+
+#include "pktconf.h"
+
+/*===========================================================================*/
+/* Filter exported variables.                                                */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Filter local variables and types.                                         */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Filter exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Creates a float32 FIR filter.
+ *
+ * @param[in] filter        pointer to a @p ffir_filter_t structure
+ * @param[in] instance      pointer to a @p arm_fir_instance_f32 structure
+ * @param[in] numTaps       the number of taps in the filter
+ * @param[in] pCoeffs       pointer to array of filter coefficients
+ * @param[in] pState        pointer to state values used by filter
+ * @param[in] blockSize     the number of samples processed at a
+ *                          time in the filter
+ * @param[in] pf32Coeffs    pointer to array of source filter coefficients
+ *                          If NULL coefficients to be otherwise filled
+ *
+ * @api
+ */
+void create_ffir_filter(
+  ffir_filter_t *filter,
+  arm_fir_instance_f32 *instance,
+  uint16_t numTaps,
+  float32_t *pCoeffs,
+  float32_t *pState,
+  uint32_t blockSize,
+  float32_t *pf32Coeffs) {
+
+  /* Save instance. */
+  filter->filter_instance = instance;
+
+  /* Assign filter taps */
+  instance->numTaps = numTaps;
+
+  /* Assign coefficient pointer */
+  instance->pCoeffs = pCoeffs;
+
+  /* Assign state pointer */
+  instance->pState = pState;
+
+  /* Save blocksize. */
+  filter->block_size = blockSize;
+
+  /* Copy source coefficients if supplied. */
+  if(pf32Coeffs != NULL) {
+    memcpy(pCoeffs, pf32Coeffs, numTaps * sizeof(float32_t));
+    transpose_ffir_coefficients(instance);
+  }
+
+  /* Clear state buffer and state array size is (blockSize + numTaps - 1) */
+  reset_ffir_filter(filter);
+}
+
+/**
+ * @brief   Resets the filter internal state data.
+ *
+ * @param[in] filter        pointer to filter data structure.
+ */
+void reset_ffir_filter(ffir_filter_t *filter) {
+  uint16_t pState_size = filter->filter_instance->numTaps
+      + filter->block_size - 1;
+  memset(filter->filter_instance->pState, 0, pState_size * sizeof(float32_t));
+}
+
+/**
+ * @brief   Pushes new input sample(s) through the filter and fetches output(s).
+ * @note    No scaling is required for float data.
+ *
+ * @param[in] filter    pointer to a @p ffir_filter_t structure
+ * @param[in] input     pointer to input sample(s) buffer
+ * @param[in] output    pointer to output sample(s) buffer
+ *
+ * @api
+ */
+void apply_ffir_filter(ffir_filter_t *filter, float32_t *input,
+                       float32_t *output) {
+  arm_fir_f32(filter->filter_instance, input, output, filter->block_size);
+}
+
+/**
+ * @brief   Reverse order of coefficients for float32 FIR.
+ * @note    CMSIS DSP filters use coefficients in reverse order.
+ *
+ * @param[in] instance  pointer to a @p arm_fir_instance_f32 structure.
+ *
+ * @api
+ */
+void transpose_ffir_coefficients(arm_fir_instance_f32 *instance) {
+
+  chDbgAssert(instance != NULL, "invalid filter instance pointer");
+
+  chDbgCheck(instance->numTaps > 2U);
+
+  float32_t *coeff = instance->pCoeffs;
+  uint16_t tapIndex = instance->numTaps - 1;
+
+  uint16_t n;
+  for(n = 0; n < ((tapIndex + 1) / 2); n++) {
+    /* Swap coefficient orders. */
+    float32_t coeff_f32 = coeff[n];
+    coeff[n] = coeff[tapIndex - n];
+    coeff[tapIndex - n] = coeff_f32;
+  }
+}
+
+/** @} */
@@ -0,0 +1,57 @@
+/*
+    Aerospace Decoder - Copyright (C) 2018 Bob Anderson (VK2GJ)
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+/**
+ * @file    firfilter_f32.h
+ * @brief   Floating point FIR filter structures and macros.
+ * @details This module implements generic FIR filter control.
+ *
+ * @addtogroup DSP
+ * @{
+ */
+
+#ifndef IO_FILTERS_FIR_F32_H_
+#define IO_FILTERS_FIR_F32_H_
+
+/**
+ * @brief   FIR filter control structure.
+ *
+ * @note    This is a generic FIR filter.
+ * @note    The type is determined by coefficients set by decoder.
+ */
+typedef struct FFIRFilter {
+  arm_fir_instance_f32  *filter_instance;
+  uint16_t              block_size;
+} ffir_filter_t;
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+  #ifdef __cplusplus
+  extern "C" {
+  #endif
+    void create_ffir_filter(
+      ffir_filter_t *filter,
+      arm_fir_instance_f32 *instance,
+      uint16_t numTaps,
+      float32_t * pCoeffs,
+      float32_t * pState,
+      uint32_t blockSize,
+      float32_t * pf32Coeffs);
+    void reset_ffir_filter(ffir_filter_t *filter);
+    void apply_ffir_filter(ffir_filter_t *filter, float32_t *input,
+                           float32_t *output);
+    void transpose_ffir_coefficients(arm_fir_instance_f32 *instance);
+  #ifdef __cplusplus
+  }
+  #endif
+
+#endif /* IO_FILTERS_FIR_F32_H_ */
+
+/** @} */
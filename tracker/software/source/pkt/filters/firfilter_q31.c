@@ -26,6 +26,30 @@
 /* Filter local variables and types.                                         */
 /*===========================================================================*/
 
+/*===========================================================================*/
+/* Filter local functions.                                                   */
+/*===========================================================================*/
+
+/**
+ * @brief   Check if the filter coefficients are symmetric.
+ *
+ * @param[in] instance      pointer to a @p arm_fir_instance_q31 structure
+ *
+ * @return  true if each coefficient equals its mirror.
+ *
+ * @notapi
+ */
+static bool qfir_coefficients_symmetric(arm_fir_instance_q31 *instance) {
+  const q31_t *coeff = instance->pCoeffs;
+  uint16_t last = instance->numTaps - 1U;
+  uint16_t n;
+  for(n = 0; n < instance->numTaps / 2U; n++) {
+    if(coeff[n] != coeff[last - n])
+      return false;
+  }
+  return true;
+}
+
 /*===========================================================================*/
 /* Filter exported functions.                                                */
 /*===========================================================================*/
@@ -73,6 +97,9 @@ void create_qfir_filter(
   /* Save blocksize. */
   filter->block_size = blockSize;
 
+  /* Output every input sample unless set as a decimator. */
+  filter->decimation = 1;
+
   /* Convert float32 coefficients if supplied. */
   if(pf32Coeffs != NULL) {
     /*
@@ -82,10 +109,49 @@ void create_qfir_filter(
     transpose_qfir_coefficients(instance);
   }
 
+  /* Linear phase filters can use the folded kernel. */
+  filter->symmetric = qfir_coefficients_symmetric(instance);
+
   /* Clear state buffer and state array size is (blockSize + numTaps - 1) */
   reset_qfir_filter(filter);
 }
 
+/**
+ * @brief   Creates a Q31 fixed point decimating FIR filter.
+ * @note    Only every decimation'th output is computed (polyphase form).
+ * @note    The output block size is blockSize / decimation.
+ * @note    The filter coefficients must also serve as the anti-alias filter.
+ *
+ * @param[in] filter        pointer to a @p qfir_filter_t structure
+ * @param[in] instance      pointer to a @p arm_fir_instance_q31 structure
+ * @param[in] numTaps       the number of taps in the filter
+ * @param[in] pCoeffs       pointer to array of q31 filter coefficients
+ * @param[in] pState        pointer to q31 state values used by filter
+ * @param[in] blockSize     the number of input samples processed at a
+ *                          time in the filter
+ * @param[in] decimation    the decimation factor
+ * @param[in] pf32Coeffs    pointer to array of float32 filter coefficients
+ *                          If NULL q31 coefficients to be otherwise filled
+ *
+ * @api
+ */
+void create_qfir_decimator(
+  qfir_filter_t *filter,
+  arm_fir_instance_q31 *instance,
+  uint16_t numTaps,
+  q31_t *pCoeffs,
+  q31_t *pState,
+  uint32_t blockSize,
+  uint8_t decimation,
+  float32_t *pf32Coeffs) {
+
+  chDbgCheck(decimation > 0U && (blockSize % decimation) == 0U);
+
+  create_qfir_filter(filter, instance, numTaps, pCoeffs, pState,
+                     blockSize, pf32Coeffs);
+  filter->decimation = decimation;
+}
+
 /**
  * @brief   Resets the filter internal state data.
  *
@@ -97,11 +163,138 @@ void reset_qfir_filter(qfir_filter_t *filter) {
   memset(filter->filter_instance->pState, 0, pState_size * sizeof(q31_t));
 }
 
+#if USE_QFIR_FUSED_KERNEL == TRUE
+/**
+ * @brief   Fused scale and MAC Q31 FIR kernel.
+ * @note    Input samples are scaled down as they are written to the state.
+ * @note    Accumulation is in 64 bits (SMLAL) using CMSIS coefficient order.
+ * @note    The accumulator is scaled back up and saturated to Q31 on output.
+ * @note    A decimating filter only computes the last output of each group.
+ *
+ * @param[in] filter    pointer to a @p qfir_filter_t structure
+ * @param[in] input     pointer to input sample(s) buffer
+ * @param[in] output    pointer to output sample(s) buffer
+ *
+ * @notapi
+ */
+static void qfir_fused_kernel(qfir_filter_t *filter, q31_t *input,
+                              q31_t *output) {
+  arm_fir_instance_q31 *instance = filter->filter_instance;
+  uint16_t numTaps = instance->numTaps;
+  uint16_t blockSize = filter->block_size;
+  q31_t *pState = instance->pState;
+  const q31_t *pCoeffs = instance->pCoeffs;
+  uint8_t scale = filter->scale;
+  uint8_t decimation = filter->decimation;
+
+  /* Scaled new samples go at the end of the state history. */
+  q31_t *pStateIn = &pState[numTaps - 1U];
+  uint16_t i;
+  for(i = 0; i < blockSize; i++) {
+    pStateIn[i] = input[i] >> scale;
+  }
+
+  uint16_t out = 0;
+  for(i = decimation - 1U; i < blockSize; i += decimation) {
+    const q31_t *px = &pState[i];
+    const q31_t *pb = pCoeffs;
+    q63_t acc = 0;
+    uint16_t k = numTaps >> 2U;
+
+    /* Four taps per pass. */
+    while(k > 0U) {
+      acc += (q63_t)*px++ * *pb++;
+      acc += (q63_t)*px++ * *pb++;
+      acc += (q63_t)*px++ * *pb++;
+      acc += (q63_t)*px++ * *pb++;
+      k--;
+    }
+
+    /* Remaining taps. */
+    k = numTaps & 3U;
+    while(k > 0U) {
+      acc += (q63_t)*px++ * *pb++;
+      k--;
+    }
+
+    /* Combine the 1.31 result shift with the scale up and saturate. */
+    output[out++] = clip_q63_to_q31(acc >> (31U - scale));
+  }
+
+  /* Shift the state history down ready for the next block. */
+  memmove(pState, &pState[blockSize], (numTaps - 1U) * sizeof(q31_t));
+}
+
+#if USE_QFIR_SYMMETRIC_KERNEL == TRUE
+/**
+ * @brief   Folded Q31 FIR kernel for symmetric coefficients.
+ * @note    Mirrored state samples are added then multiplied by their shared
+ *          coefficient. The output is the same as the fused kernel.
+ * @note    The scaled down samples leave headroom for the addition.
+ *
+ * @param[in] filter    pointer to a @p qfir_filter_t structure
+ * @param[in] input     pointer to input sample(s) buffer
+ * @param[in] output    pointer to output sample(s) buffer
+ *
+ * @notapi
+ */
+static void qfir_symmetric_kernel(qfir_filter_t *filter, q31_t *input,
+                                  q31_t *output) {
+  arm_fir_instance_q31 *instance = filter->filter_instance;
+  uint16_t numTaps = instance->numTaps;
+  uint16_t blockSize = filter->block_size;
+  q31_t *pState = instance->pState;
+  const q31_t *pCoeffs = instance->pCoeffs;
+  uint8_t scale = filter->scale;
+  uint8_t decimation = filter->decimation;
+
+  /* Scaled new samples go at the end of the state history. */
+  q31_t *pStateIn = &pState[numTaps - 1U];
+  uint16_t i;
+  for(i = 0; i < blockSize; i++) {
+    pStateIn[i] = input[i] >> scale;
+  }
+
+  uint16_t out = 0;
+  for(i = decimation - 1U; i < blockSize; i += decimation) {
+    const q31_t *px = &pState[i];
+    const q31_t *py = &pState[i + numTaps - 1U];
+    const q31_t *pb = pCoeffs;
+    q63_t acc = 0;
+    uint16_t k = numTaps >> 2U;
+
+    /* Two tap pairs per pass. */
+    while(k > 0U) {
+      acc += (q63_t)(*px++ + *py--) * *pb++;
+      acc += (q63_t)(*px++ + *py--) * *pb++;
+      k--;
+    }
+
+    /* Remaining pair. */
+    if((numTaps & 2U) != 0U)
+      acc += (q63_t)(*px++ + *py--) * *pb++;
+
+    /* Centre tap of an odd length filter. */
+    if((numTaps & 1U) != 0U)
+      acc += (q63_t)*px * *pb;
+
+    /* Combine the 1.31 result shift with the scale up and saturate. */
+    output[out++] = clip_q63_to_q31(acc >> (31U - scale));
+  }
+
+  /* Shift the state history down ready for the next block. */
+  memmove(pState, &pState[blockSize], (numTaps - 1U) * sizeof(q31_t));
+}
+#endif /* USE_QFIR_SYMMETRIC_KERNEL == TRUE */
+#endif /* USE_QFIR_FUSED_KERNEL == TRUE */
+
 /**
  * @brief   Pushes new input sample(s) through the filter and fetches output(s).
- * @note    The new sample(s) are copied and scaled down before being pushed.
+ * @note    The new sample(s) are scaled down before being pushed.
  * @note    Scaling prevents fixed point wrap around in filter calculations.
  * @note    Data exiting the filter is scaled back up.
+ * @note    The input buffer is not modified.
+ * @note    A decimating filter outputs block_size / decimation samples.
  *
  * @param[in] filter    pointer to a @p qfir_filter_t structure
  * @param[in] input     pointer to input sample(s) buffer
@@ -110,6 +303,15 @@ void reset_qfir_filter(qfir_filter_t *filter) {
  * @api
  */
 void apply_qfir_filter(qfir_filter_t *filter, q31_t *input, q31_t *output) {
+#if USE_QFIR_FUSED_KERNEL == TRUE
+#if USE_QFIR_SYMMETRIC_KERNEL == TRUE
+  if(filter->symmetric) {
+    qfir_symmetric_kernel(filter, input, output);
+    return;
+  }
+#endif
+  qfir_fused_kernel(filter, input, output);
+#else
   /* For temporary copy of input data. */
   q31_t input_copy[filter->block_size];
 
@@ -117,14 +319,29 @@ void apply_qfir_filter(qfir_filter_t *filter, q31_t *input, q31_t *output) {
   arm_scale_q31(input, Q31_MAX, -filter->scale, input_copy,
                 filter->block_size);
 
-  /*
-   * Apply the scaled input(s) to the filter and compute the output result(s).
-   */
-  arm_fir_q31(filter->filter_instance, input_copy,
-              output, filter->block_size);
+  if(filter->decimation == 1U) {
+    /*
+     * Apply the scaled input(s) to the filter and compute the output result(s).
+     */
+    arm_fir_q31(filter->filter_instance, input_copy,
+                output, filter->block_size);
+
+    /* Scale the output(s) up. */
+    arm_scale_q31(output, Q31_MAX, filter->scale, output, filter->block_size);
+    return;
+  }
 
-  /* Scale the output(s) up. */
-  arm_scale_q31(output, Q31_MAX, filter->scale, output, filter->block_size);
+  /* Decimator runs the full block then keeps every decimation'th output. */
+  q31_t full_output[filter->block_size];
+  arm_fir_q31(filter->filter_instance, input_copy,
+              full_output, filter->block_size);
+  uint16_t i, out = 0;
+  for(i = filter->decimation - 1U; i < filter->block_size;
+      i += filter->decimation) {
+    output[out++] = full_output[i];
+  }
+  arm_scale_q31(output, Q31_MAX, filter->scale, output, out);
+#endif
 }
 
 /**
@@ -145,7 +362,7 @@ void transpose_qfir_coefficients(arm_fir_instance_q31 *instance) {
   uint16_t tapIndex = instance->numTaps - 1;
 
   uint16_t n;
-  for(n = 0; n < (tapIndex / 2); n++) {
+  for(n = 0; n < ((tapIndex + 1U) / 2U); n++) {
     /* Swap coefficient orders. */
     q31_t coeff_q31 = coeff[n];
     coeff[n] = coeff[tapIndex - n];
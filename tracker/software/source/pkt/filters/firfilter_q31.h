@@ -18,6 +18,23 @@
 #ifndef IO_FILTERS_FIR_Q31_H_
 #define IO_FILTERS_FIR_Q31_H_
 
+/*===========================================================================*/
+/* Module pre-compile time settings.                                         */
+/*===========================================================================*/
+
+/*
+ * Use the fused scale and MAC kernel in apply_qfir_filter().
+ * When FALSE the CMSIS scale/FIR/scale sequence is used.
+ */
+#define USE_QFIR_FUSED_KERNEL       TRUE
+
+/*
+ * Use the folded kernel for filters with symmetric coefficients.
+ * Mirrored samples are added before the multiply which halves the MACs.
+ * Only used with the fused kernel.
+ */
+#define USE_QFIR_SYMMETRIC_KERNEL   TRUE
+
 /**
  * @brief   FIR filter control structure.
  *
@@ -28,6 +45,9 @@ typedef struct QFIRFilter {
   arm_fir_instance_q31  *filter_instance;
   uint16_t              block_size;
   uint8_t               scale;
+  uint8_t               decimation;
+  /* Coefficients are symmetric (linear phase). */
+  bool                  symmetric;
 } qfir_filter_t;
 
 /*===========================================================================*/
@@ -45,6 +65,15 @@ typedef struct QFIRFilter {
       q31_t * pState,
       uint32_t blockSize,
       float32_t * pf32Coeffs);
+    void create_qfir_decimator(
+      qfir_filter_t *filter,
+      arm_fir_instance_q31 *instance,
+      uint16_t numTaps,
+      q31_t * pCoeffs,
+      q31_t * pState,
+      uint32_t blockSize,
+      uint8_t decimation,
+      float32_t * pf32Coeffs);
     void reset_qfir_filter(qfir_filter_t *filter);
     void apply_qfir_filter(qfir_filter_t *filter, q31_t *input, q31_t *output);
     void compute_qfir_coefficents(qfir_filter_t *filter);
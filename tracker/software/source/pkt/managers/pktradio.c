@@ -20,6 +20,13 @@
 #include "si446x.h"
 #include "debug.h"
 #include "geofence.h"
+#include "watchdog.h"
+#include "pclock.h"
+#include "memregion.h"
+#include "txlatency.h"
+#include "padc.h"
+#include "ptime.h"
+#include "sleep.h"
 
 /*===========================================================================*/
 /* Module local definitions.                                                 */
@@ -39,6 +46,689 @@ const radio_band_t band_70cm = {
   //.def_aprs = BAND_DEF_70CM_APRS
 };
 
+#if PKT_RX_USE_SCAN == TRUE
+/*
+ * Candidate frequencies for the receive scan.
+ * South East Asia shares the America frequency.
+ */
+static const radio_freq_t scan_list[] = {
+  APRS_FREQ_OTHER,
+  APRS_FREQ_AMERICA,
+  APRS_FREQ_CHINA,
+  APRS_FREQ_JAPAN,
+  APRS_FREQ_SOUTHKOREA,
+  APRS_FREQ_AUSTRALIA,
+  APRS_FREQ_NEWZEALAND,
+  APRS_FREQ_ARGENTINA,
+  APRS_FREQ_BRAZIL
+};
+
+#define PKT_RX_SCAN_CHANNELS    (sizeof(scan_list) / sizeof(scan_list[0]))
+#endif
+
+#if PKT_RADIO_LOW_VBAT_SHUTDOWN == TRUE
+/**
+ * @brief   Tests if the radio should be shut down rather than kept in standby.
+ * @notes   Standby keeps registers so wake up for the next send is quick.
+ *          Shutdown is kept for a battery below the GPS off voltage.
+ *
+ * @return  true if the radio should be shut down.
+ *
+ * @notapi
+ */
+static bool pktIsRadioShutdownDue(void) {
+  return conf_sram.gps_off_vbat != 0
+      && stm32_get_vbat() < conf_sram.gps_off_vbat;
+}
+#endif
+
+/**
+ * @brief   Tests if the receive chain is handling a packet.
+ * @notes   Receive is not put in standby while a packet is being received.
+ *
+ * @param[in] handler   pointer to a @p packet_svc_t structure.
+ *
+ * @return  busy status.
+ *
+ * @notapi
+ */
+static bool pktIsReceiveBusy(packet_svc_t *handler) {
+  switch(handler->radio_rx_config.type) {
+#if PKT_RX_USE_2FSK == TRUE
+  /* 2FSK is received through the PWM decoder. */
+  case MOD_2FSK:
+#endif
+  case MOD_AFSK: {
+    AFSKDemodDriver *myDemod = (AFSKDemodDriver *)handler->link_controller;
+    if(myDemod == NULL)
+      return false;
+    return (myDemod->icustate != PKT_PWM_READY
+        || myDemod->active_radio_object != NULL
+        || myDemod->active_demod_object != NULL);
+    }
+
+  default:
+    return false;
+  }
+}
+
+#if PKT_RX_USE_DUTY_CYCLE == TRUE
+/**
+ * @brief   Applies the receive duty cycle and scheduled windows.
+ * @notes   Called by the radio manager between radio tasks.
+ * @notes   Only a standby made by the duty cycle is resumed here.
+ * @notes   Transmit keeps control of receive while sends are outstanding.
+ *
+ * @param[in] handler   pointer to a @p packet_svc_t structure.
+ *
+ * @return  time until the next duty cycle transition.
+ * @retval  TIME_INFINITE if there is no cycle or window scheduled.
+ *
+ * @notapi
+ */
+static sysinterval_t pktUpdateReceiveDutyCycle(packet_svc_t *handler) {
+  radio_rx_duty_t *duty = &handler->rx_duty;
+  const radio_unit_t radio = handler->radio;
+  sysinterval_t next = TIME_INFINITE;
+  bool on;
+
+  chSysLock();
+  systime_t now = chVTGetSystemTimeX();
+  if(duty->on == 0 || duty->off == 0) {
+    /* No periodic cycle so receive is on unless windows say otherwise. */
+    on = true;
+  } else {
+    sysinterval_t period = duty->on + duty->off;
+    sysinterval_t phase = chTimeDiffX(duty->epoch, now) % period;
+    on = phase < duty->on;
+    next = on ? duty->on - phase : period - phase;
+  }
+  uint8_t i;
+  for(i = 0; i < PKT_RX_DUTY_WINDOWS; i++) {
+    radio_rx_window_t *window = &duty->window[i];
+    if(!window->used)
+      continue;
+    sysinterval_t elapsed = chTimeDiffX(window->created, now);
+    sysinterval_t wait;
+    if(elapsed < window->delay) {
+      /* Window not yet started. */
+      wait = window->delay - elapsed;
+    } else if(elapsed - window->delay < window->duration) {
+      /* In the window. Hold receive on until it ends. */
+      on = true;
+      wait = window->duration - (elapsed - window->delay);
+    } else {
+      /* The window has ended. */
+      window->used = false;
+      continue;
+    }
+    if(next == TIME_INFINITE || wait < next)
+      next = wait;
+  }
+  chSysUnlock();
+
+  /* A transmit completion may have resumed receive. */
+  if(duty->asleep && pktIsReceiveActive(radio))
+    duty->asleep = false;
+
+  if(handler->tx_count != 0)
+    return next;
+
+  if(on && duty->asleep && pktIsReceivePaused(radio)) {
+    pktLockRadioTransmit(radio, TIME_INFINITE);
+    if(!pktLLDradioResumeReceive(radio)) {
+      TRACE_ERROR("RAD  > Receive on radio %d failed to "
+          "resume after standby", radio);
+      pktUnlockRadioTransmit(radio);
+      return next;
+    }
+    pktLLDradioResumeDecoding(radio);
+    pktUnlockRadioTransmit(radio);
+    duty->asleep = false;
+    duty->wakes++;
+    return next;
+  }
+
+  if(!on && !duty->asleep && pktIsReceiveActive(radio)) {
+    if(pktIsReceiveBusy(handler)) {
+      /* Let the packet complete and check again. */
+      duty->deferred++;
+      sysinterval_t busy = TIME_MS2I(PKT_RX_DUTY_BUSY_MS);
+      return (next == TIME_INFINITE || busy < next) ? busy : next;
+    }
+    pktLockRadioTransmit(radio, TIME_INFINITE);
+    pktLLDradioPauseDecoding(radio);
+    pktLLDradioStandby(radio);
+    pktUnlockRadioTransmit(radio);
+    duty->asleep = true;
+    duty->sleeps++;
+  }
+  return next;
+}
+#endif /* PKT_RX_USE_DUTY_CYCLE == TRUE */
+
+#if PKT_RX_USE_SCAN == TRUE
+/**
+ * @brief   Gets the next scan candidate allowed on the radio.
+ *
+ * @param[in] radio     radio unit ID.
+ * @param[in] index     index of the current candidate.
+ *
+ * @return  index of the next candidate.
+ * @retval  the current index if no other candidate is allowed.
+ *
+ * @notapi
+ */
+static uint8_t pktGetNextScanIndex(const radio_unit_t radio, uint8_t index) {
+  uint8_t i;
+  for(i = 1; i < PKT_RX_SCAN_CHANNELS; i++) {
+    uint8_t next = (index + i) % PKT_RX_SCAN_CHANNELS;
+    if(pktCheckAllowedFrequency(radio, scan_list[next]) != NULL)
+      return next;
+  }
+  return index;
+}
+
+/**
+ * @brief   Gets the frequency for the receive scan code.
+ * @notes   Receive uses the candidate being listened to.
+ * @notes   The scan starts on the last find or else the geofence frequency.
+ * @notes   Transmit uses the last candidate on which frames were decoded.
+ * @notes   The find of another radio is used by an offload transmit radio.
+ *
+ * @param[in] radio     radio unit ID.
+ * @param[in] mode      radio mode.
+ *
+ * @return  frequency in Hz.
+ * @retval  FREQ_GEOFENCE for transmit if nothing has been found.
+ *
+ * @notapi
+ */
+static radio_freq_t pktGetScanFrequency(const radio_unit_t radio,
+                                        const radio_mode_t mode) {
+  radio_rx_scan_t *scan = &pktGetServiceObject(radio)->rx_scan;
+  if(mode != RADIO_RX) {
+    if(scan->found != FREQ_INVALID)
+      return scan->found;
+    const radio_config_t *list = pktGetRadioList();
+    for(; list->unit != PKT_RADIO_NONE; list++) {
+      radio_freq_t found = pktGetServiceObject(list->unit)->rx_scan.found;
+      if(found != FREQ_INVALID
+          && pktCheckAllowedFrequency(radio, found) != NULL)
+        return found;
+    }
+    return FREQ_GEOFENCE;
+  }
+  if(scan->current == FREQ_INVALID) {
+    radio_freq_t start = (scan->found != FREQ_INVALID)
+        ? scan->found : getAPRSRegionFrequency();
+    scan->index = 0;
+    uint8_t i;
+    for(i = 0; i < PKT_RX_SCAN_CHANNELS; i++) {
+      if(scan_list[i] == start) {
+        scan->index = i;
+        break;
+      }
+    }
+    if(pktCheckAllowedFrequency(radio, scan_list[scan->index]) == NULL)
+      scan->index = pktGetNextScanIndex(radio, scan->index);
+    scan->current = scan_list[scan->index];
+  }
+  return scan->current;
+}
+
+/**
+ * @brief   Runs the receive frequency scan.
+ * @notes   Called by the radio manager between radio tasks.
+ * @notes   The scan runs while receive is active on FREQ_SCAN.
+ * @notes   Signal above the squelch level extends the listen on a candidate.
+ * @notes   Decoded frames hold the candidate and make it the find.
+ * @notes   A frame being received is never cut off by a hop.
+ *
+ * @param[in] handler   pointer to a @p packet_svc_t structure.
+ *
+ * @return  time until the scan should be updated.
+ * @retval  TIME_INFINITE if the scan is not running.
+ *
+ * @notapi
+ */
+static sysinterval_t pktUpdateReceiveScan(packet_svc_t *handler) {
+  radio_rx_scan_t *scan = &handler->rx_scan;
+  const radio_unit_t radio = handler->radio;
+
+  if(handler->radio_rx_config.base_frequency != FREQ_SCAN
+      || handler->tx_count != 0 || !pktIsReceiveActive(radio)) {
+    /* Listen restarts when receive resumes. */
+    scan->active = false;
+    return TIME_INFINITE;
+  }
+
+  const sysinterval_t sample = TIME_MS2I(PKT_RX_SCAN_SAMPLE_MS);
+  if(!scan->active) {
+    scan->active = true;
+    scan->tuned = chVTGetSystemTime();
+    scan->dwell = TIME_MS2I(PKT_RX_SCAN_LISTEN_MS);
+    scan->good_count = handler->good_count;
+    return sample;
+  }
+
+  sysinterval_t elapsed = chVTTimeElapsedSinceX(scan->tuned);
+  bool busy = pktIsReceiveBusy(handler);
+  if(handler->good_count != scan->good_count) {
+    /* Frames decoded on this candidate. */
+    scan->good_count = handler->good_count;
+    if(scan->found != scan->current) {
+      scan->found = scan->current;
+      scan->finds++;
+      TRACE_INFO("RAD  > Scan on radio %d found activity on %d.%03d MHz",
+                 radio, scan->found/1000000, (scan->found%1000000)/1000);
+    }
+    scan->dwell = elapsed + TIME_MS2I(PKT_RX_SCAN_HOLD_MS);
+  } else if(!busy) {
+    radio_squelch_t level = handler->radio_rx_config.squelch;
+    if(level == 0)
+      level = PKT_RX_SCAN_RSSI;
+    pktLockRadioTransmit(radio, TIME_INFINITE);
+    radio_signal_t rssi = pktLLDradioGetRSSI(radio);
+    pktUnlockRadioTransmit(radio);
+    sysinterval_t active = elapsed + TIME_MS2I(PKT_RX_SCAN_ACTIVE_MS);
+    if(rssi >= level && scan->dwell < active)
+      scan->dwell = active;
+  }
+  if(busy || elapsed < scan->dwell)
+    return sample;
+
+  uint8_t index = pktGetNextScanIndex(radio, scan->index);
+  if(index == scan->index) {
+    /* Nowhere else to listen. */
+    scan->tuned = chVTGetSystemTime();
+    scan->dwell = TIME_MS2I(PKT_RX_SCAN_LISTEN_MS);
+    return sample;
+  }
+  scan->index = index;
+  scan->current = scan_list[index];
+
+  pktLockRadioTransmit(radio, TIME_INFINITE);
+#if PKT_RX_FAST_TURNAROUND == TRUE
+  pktLLDradioHoldDecoding(radio);
+#else
+  pktLLDradioPauseDecoding(radio);
+#endif
+  if(!pktLLDradioResumeReceive(radio)) {
+    TRACE_ERROR("RAD  > Receive on radio %d failed to "
+        "resume on scan hop", radio);
+    pktUnlockRadioTransmit(radio);
+    scan->active = false;
+    return sample;
+  }
+  pktLLDradioResumeDecoding(radio);
+  pktUnlockRadioTransmit(radio);
+  scan->hops++;
+  scan->tuned = chVTGetSystemTime();
+  scan->dwell = TIME_MS2I(PKT_RX_SCAN_LISTEN_MS);
+  return sample;
+}
+#endif /* PKT_RX_USE_SCAN == TRUE */
+
+#if PKT_RX_USE_NOISE_FLOOR == TRUE
+/**
+ * @brief   Tracks the receive noise floor and sets the adaptive squelch.
+ * @notes   Called by the radio manager between radio tasks.
+ * @notes   RSSI is only sampled while no frame is being received.
+ * @notes   A sample is skipped if the radio is in use by another thread.
+ *
+ * @param[in] handler   pointer to a @p packet_svc_t structure.
+ *
+ * @return  time until the next sample.
+ * @retval  TIME_INFINITE if receive is not active.
+ *
+ * @notapi
+ */
+static sysinterval_t pktUpdateNoiseFloor(packet_svc_t *handler) {
+  radio_noise_t *noise = &handler->rx_noise;
+  const radio_unit_t radio = handler->radio;
+
+  if(handler->tx_count != 0 || !pktIsReceiveActive(radio))
+    return TIME_INFINITE;
+#if PKT_RX_USE_DUTY_CYCLE == TRUE
+  if(handler->rx_duty.asleep)
+    return TIME_INFINITE;
+#endif
+
+  const sysinterval_t sample = TIME_MS2I(PKT_RX_NOISE_SAMPLE_MS);
+  sysinterval_t elapsed = chVTTimeElapsedSinceX(noise->sampled);
+  if(noise->samples != 0 && elapsed < sample)
+    return sample - elapsed;
+  if(pktIsReceiveBusy(handler))
+    return sample;
+  if(pktLockRadioTransmit(radio, TIME_IMMEDIATE) != MSG_OK)
+    return sample;
+  uint16_t level = (uint16_t)pktLLDradioGetRSSI(radio) << 4;
+  noise->sampled = chVTGetSystemTime();
+  if(noise->samples++ == 0)
+    noise->floor = level;
+  else if(level < noise->floor)
+    noise->floor -= (noise->floor - level + 3) / 4;
+  else
+    noise->floor += (level - noise->floor + 31) / 32;
+
+  int16_t target = (noise->floor >> 4) + PKT_RX_NOISE_MARGIN;
+  if(target < PKT_RX_NOISE_MIN_SQUELCH)
+    target = PKT_RX_NOISE_MIN_SQUELCH;
+  if(target > PKT_RX_NOISE_MAX_SQUELCH)
+    target = PKT_RX_NOISE_MAX_SQUELCH;
+  int16_t delta = target - noise->squelch;
+  if(noise->squelch == 0 || delta > PKT_RX_NOISE_HYSTERESIS
+      || delta < -PKT_RX_NOISE_HYSTERESIS) {
+    noise->squelch = target;
+    noise->changes++;
+    /* Apply to the receive in progress. */
+    pktLLDradioSetSquelch(radio,
+        pktGetAdaptiveSquelch(radio, handler->radio_rx_config.squelch));
+  }
+  pktUnlockRadioTransmit(radio);
+  return sample;
+}
+#endif /* PKT_RX_USE_NOISE_FLOOR == TRUE */
+
+/**
+ * @brief   Tests if receive is waiting for a signal.
+ * @notes   The radio stays in receive while the MCU is in Stop mode.
+ *          The leading edge of CCA on the radio IRQ line wakes the MCU
+ *          and the CCA de-glitch time covers the clock restore.
+ * @notes   A duty cycle standby needs the radio manager timers so it is
+ *          not idle.
+ *
+ * @param[in] radio     radio unit ID.
+ *
+ * @return  idle status.
+ *
+ * @iclass
+ */
+bool pktIsReceiveIdleI(const radio_unit_t radio) {
+  packet_svc_t *handler = pktGetServiceObject(radio);
+  if(handler->state != PACKET_DECODE || handler->tx_count != 0)
+    return false;
+#if PKT_RX_USE_DUTY_CYCLE == TRUE
+  if(handler->rx_duty.asleep)
+    return false;
+#endif
+  if(handler->radio_rx_config.type != MOD_AFSK || pktIsReceiveBusy(handler))
+    return false;
+  return pktLLDradioReadCCA(radio) == PAL_LOW;
+}
+
+/**
+ * @brief   Gets the squelch level to use on the radio.
+ * @notes   Used for the receive squelch and the transmit CCA level.
+ * @notes   The adaptive level is used when above the configured level.
+ * @notes   A blind send level is not changed.
+ *
+ * @param[in] radio     radio unit ID.
+ * @param[in] level     configured squelch level.
+ *
+ * @return  squelch level.
+ *
+ * @api
+ */
+radio_squelch_t pktGetAdaptiveSquelch(const radio_unit_t radio,
+                                      const radio_squelch_t level) {
+#if PKT_RX_USE_NOISE_FLOOR == TRUE
+  if(level == PKT_SI446X_NO_CCA_RSSI)
+    return level;
+  packet_svc_t *handler = pktGetServiceObject(radio);
+  radio_squelch_t adaptive = handler->rx_noise.squelch;
+  return adaptive > level ? adaptive : level;
+#else
+  (void)radio;
+  return level;
+#endif
+}
+
+/**
+ * @brief   Checks if two sends can share a radio session.
+ *
+ * @param[in] a     pointer to a radio task object.
+ * @param[in] b     pointer to a radio task object.
+ *
+ * @return  true if the radio settings and priority are the same.
+ */
+static bool pktIsTransmitCompatible(const radio_task_object_t *a,
+                                    const radio_task_object_t *b) {
+  return a->type == b->type
+      && a->base_frequency == b->base_frequency
+      && a->step_hz == b->step_hz
+      && a->channel == b->channel
+      && a->tx_power == b->tx_power
+      && a->tx_speed == b->tx_speed
+      && a->tx_priority == b->tx_priority;
+}
+
+/**
+ * @brief   Adds a send to the TX worker pending list.
+ * @notes   The list is ordered by priority then by arrival.
+ * @notes   A resumed send goes ahead of the sends waiting at its priority.
+ *
+ * @param[in] handler   pointer to a @p packet service object.
+ * @param[in] rto       pointer to the radio task object.
+ * @param[in] resume    true if the send was preempted.
+ *
+ * @sclass
+ */
+static void pktInsertRadioTransmitS(packet_svc_t *handler,
+                                    radio_task_object_t *rto, bool resume) {
+  radio_task_object_t **link = &handler->tx_pending;
+  while(*link != NULL && ((*link)->tx_priority < rto->tx_priority
+      || (!resume && (*link)->tx_priority == rto->tx_priority)))
+    link = &(*link)->tx_next;
+  rto->tx_next = *link;
+  *link = rto;
+  chBSemSignalI(&handler->tx_wake);
+}
+
+/**
+ * @brief   Gets the time until a pending send is ready to run.
+ *
+ * @param[in] rto       pointer to the radio task object.
+ *
+ * @return  zero if ready else the remaining channel access deferral.
+ *
+ * @sclass
+ */
+static sysinterval_t pktGetTransmitDeferralS(const radio_task_object_t *rto) {
+  if(!rto->tx_csma)
+    return 0;
+  sysinterval_t elapsed = chVTTimeElapsedSinceX(rto->tx_csma_start);
+  return (elapsed >= rto->tx_csma_wait) ? 0 : (rto->tx_csma_wait - elapsed);
+}
+
+/**
+ * @brief   Gets the time until sends may start in the TDMA slot.
+ * @notes   Trackers sharing a frequency are given different slots of frames
+ *          in GPS set RTC time. No send starts in the guard time at the end
+ *          of the slot so the packet on air ends within the slot.
+ * @notes   Sends are not held without TDMA or before the RTC has been set.
+ *
+ * @return  zero if sends may start now else the time until the slot opens.
+ *
+ * @notapi
+ */
+static sysinterval_t pktGetTransmitSlotWait(void) {
+  if(conf_sram.tdma_slots == 0)
+    return 0;
+  return getSlotWait(conf_sram.tdma_slot, conf_sram.tdma_slots,
+                     conf_sram.tdma_slot_time,
+                     TIME_MS2I(PKT_TX_TDMA_GUARD_MS));
+}
+
+/**
+ * @brief   Takes the next send from the TX worker pending list.
+ * @notes   Sends deferred for channel access are passed over until due.
+ * @notes   No send is taken outside the TDMA slot of the tracker.
+ * @notes   Pending sends with the same radio settings join the session.
+ * @notes   Their packets are chained after those of the first send.
+ *
+ * @param[in] handler   pointer to a @p packet service object.
+ * @param[out] wait     time until the next deferred send is due.
+ *
+ * @return  pointer to the radio task object or NULL if none ready.
+ */
+static radio_task_object_t *pktTakeRadioTransmit(packet_svc_t *handler,
+                                                 sysinterval_t *wait) {
+  radio_task_object_t *joined = NULL;
+  radio_task_object_t **tail = &joined;
+
+  /* Outside the TDMA slot all sends wait for it to open. */
+  sysinterval_t slot = pktGetTransmitSlotWait();
+  if(slot != 0) {
+    *wait = slot;
+    return NULL;
+  }
+
+  *wait = TIME_INFINITE;
+  chSysLock();
+  radio_task_object_t **from = &handler->tx_pending;
+  while(*from != NULL) {
+    sysinterval_t due = pktGetTransmitDeferralS(*from);
+    if(due == 0)
+      break;
+    if(*wait == TIME_INFINITE || due < *wait)
+      *wait = due;
+    from = &(*from)->tx_next;
+  }
+  radio_task_object_t *rto = *from;
+  if(rto != NULL) {
+    *from = rto->tx_next;
+    rto->tx_next = NULL;
+    /* Unlink the compatible sends. Packets are chained outside the lock. */
+    radio_task_object_t **link = &handler->tx_pending;
+    while(*link != NULL) {
+      radio_task_object_t *next = *link;
+      if(!pktIsTransmitCompatible(rto, next)) {
+        link = &next->tx_next;
+        continue;
+      }
+      *link = next->tx_next;
+      next->tx_next = NULL;
+      *tail = next;
+      tail = &next->tx_next;
+    }
+  }
+  chSysUnlock();
+
+  if(rto == NULL || joined == NULL)
+    return rto;
+
+  /* Find the end of the session packet chain and joined sends. */
+  packet_t pp = rto->packet_out;
+  while(pp->nextp != NULL)
+    pp = pp->nextp;
+  radio_task_object_t **last = &rto->tx_joined;
+  while(*last != NULL)
+    last = &(*last)->tx_joined;
+
+  uint8_t n = 0;
+  while(joined != NULL) {
+    radio_task_object_t *next = joined->tx_next;
+    joined->tx_next = NULL;
+    pp->nextp = joined->packet_out;
+    while(pp->nextp != NULL)
+      pp = pp->nextp;
+    /* The session now owns the packets. */
+    joined->packet_out = NULL;
+    *last = joined;
+    last = &joined->tx_joined;
+    joined = next;
+    n++;
+  }
+  TRACE_INFO("RAD  > Radio %d joined %d sends to session %d",
+             handler->radio, n, rto->tx_seq_num);
+  return rto;
+}
+
+/**
+ * @brief   Radio transmit worker.
+ * @notes   One worker per radio runs all sends in priority order.
+ * @notes   Sends deferred for channel access let other sends run meanwhile.
+ * @notes   The worker takes the priority of each send while running it.
+ * @notes   A send preempted between packets is resumed after the
+ *          higher priority send(s).
+ *
+ * @param[in] arg pointer to a @p packet service object for this radio.
+ *
+ * @notapi
+ */
+static THD_FUNCTION(pktRadioTransmitWorker, arg) {
+  packet_svc_t *handler = arg;
+
+  while(true) {
+    sysinterval_t wait;
+    radio_task_object_t *rto = pktTakeRadioTransmit(handler, &wait);
+    if(rto == NULL) {
+      if(chThdShouldTerminateX())
+        break;
+      /* Wake on a new send or when a deferred send is due. */
+      (void)chBSemWaitTimeout(&handler->tx_wake, wait);
+      continue;
+    }
+    /* The radio lock queues waiters by priority. */
+    chThdSetPriority(PKT_TX_THREAD_PRIO(rto->tx_priority));
+    pclkAcquire();
+    msg_t msg = pktLLDradioTransmit(rto);
+    pclkRelease();
+    if(msg == MSG_OK && rto->packet_out != NULL) {
+      /*
+       * Preempted or deferred for channel access.
+       * Put back to resume after the higher priority send or when due.
+       */
+      chSysLock();
+      pktInsertRadioTransmitS(handler, rto, true);
+      chSysUnlock();
+      continue;
+    }
+    /* Save status in case a callback requires it. */
+    rto->result = msg;
+    pktLLDradioSendComplete(rto);
+  }
+  chThdExit(MSG_OK);
+}
+
+/**
+ * @brief   Create the radio transmit worker thread.
+ *
+ * @param[in] handler   pointer to a @p packet service object.
+ *
+ * @return  pointer to the worker thread or NULL if not created.
+ */
+static thread_t *pktRadioTransmitWorkerCreate(packet_svc_t *handler) {
+  handler->tx_pending = NULL;
+  chBSemObjectInit(&handler->tx_wake, true);
+  chsnprintf(handler->txwrk_name, sizeof(handler->txwrk_name),
+             "%s%02i", PKT_RADIO_TX_WORKER_PREFIX, handler->radio);
+  handler->tx_worker = mem_thread_create(MEM_REGION_THREADS,
+              THD_WORKING_AREA_SIZE(SI_TX_WORKER_WA_SIZE),
+              handler->txwrk_name,
+              PKT_TX_THREAD_PRIO(TX_PRIO_COMMAND),
+              pktRadioTransmitWorker,
+              handler);
+  return handler->tx_worker;
+}
+
+/**
+ * @brief   Release the radio transmit worker thread.
+ * @pre     There are no outstanding sends.
+ *
+ * @param[in] handler   pointer to a @p packet service object.
+ */
+static void pktRadioTransmitWorkerRelease(packet_svc_t *handler) {
+  if(handler->tx_worker == NULL)
+    return;
+  chThdTerminate(handler->tx_worker);
+  chBSemSignal(&handler->tx_wake);
+  chThdWait(handler->tx_worker);
+  handler->tx_worker = NULL;
+}
+
 /**
  * @brief   Process radio task requests.
  * @notes   Task objects posted to the queue are processed per radio.
@@ -71,6 +761,12 @@ THD_FUNCTION(pktRadioManager, arg) {
   /* Take radio out of shutdown and initialize base registers. */
   bool init = pktLLDradioInit(radio);
 
+  /* Start the transmit worker for this radio. */
+  if(init && pktRadioTransmitWorkerCreate(handler) == NULL) {
+    pktLLDradioShutdown(radio);
+    init = false;
+  }
+
   thread_t *initiator = chMsgWait();
   chMsgGet(initiator);
   if(!init) {
@@ -78,12 +774,38 @@ THD_FUNCTION(pktRadioManager, arg) {
     chThdExit(MSG_OK);
   }
   chMsgRelease(initiator, MSG_OK);
+  wdg_beat_t beat;
+  wdg_register(&beat, chRegGetThreadNameX(chThdGetSelfX()),
+               PKT_RADIO_MANAGER_BEAT);
+  /* Receive sampling may be late after Stop mode. */
+  allowLateWakeup();
   /* Run until close request and no outstanding TX tasks. */
   while(true) {
+    wdg_beat(&beat);
     /* Check for task requests. */
     radio_task_object_t *task_object;
-    (void)chFifoReceiveObjectTimeout(radio_queue,
-                         (void *)&task_object, TIME_INFINITE);
+    sysinterval_t wait = TIME_INFINITE;
+#if PKT_RX_USE_DUTY_CYCLE == TRUE
+    /* Wake for the next receive duty cycle transition. */
+    wait = pktUpdateReceiveDutyCycle(handler);
+#endif
+#if PKT_RX_USE_SCAN == TRUE
+    /* Wake for the next receive scan sample. */
+    sysinterval_t scan = pktUpdateReceiveScan(handler);
+    if(wait == TIME_INFINITE || scan < wait)
+      wait = scan;
+#endif
+#if PKT_RX_USE_NOISE_FLOOR == TRUE
+    /* Wake for the next noise floor sample. */
+    sysinterval_t noise = pktUpdateNoiseFloor(handler);
+    if(wait == TIME_INFINITE || noise < wait)
+      wait = noise;
+#endif
+    if(wait == TIME_INFINITE || wait > PKT_RADIO_MANAGER_BEAT)
+      wait = PKT_RADIO_MANAGER_BEAT;
+    if(chFifoReceiveObjectTimeout(radio_queue,
+                         (void *)&task_object, wait) != MSG_OK)
+      continue;
     /* Something to do. */
 
     /* Process command. */
@@ -95,8 +817,11 @@ THD_FUNCTION(pktRadioManager, arg) {
        * The task initiator waits with chThdWait(...).
        */
       if(handler->tx_count == 0) {
+        pktRadioTransmitWorkerRelease(handler);
         pktLLDradioShutdown(radio);
         chFactoryReleaseObjectsFIFO(handler->the_radio_fifo);
+        wdg_unregister(&beat);
+        cancelLateWakeup();
         chThdExit(MSG_OK);
         /* We never arrive here. */
       }
@@ -110,7 +835,15 @@ THD_FUNCTION(pktRadioManager, arg) {
     }
 
     case PKT_RADIO_RX_RSSI: {
-      /* TODO: Implement read RSSI radio task. */
+      /* The current signal strength is returned in the task result. */
+      pktLockRadioTransmit(radio, TIME_INFINITE);
+      task_object->result = (msg_t)pktLLDradioGetRSSI(radio);
+      pktUnlockRadioTransmit(radio);
+      break;
+    }
+
+    case PKT_RADIO_RX_DUTY: {
+      /* The duty cycle is applied at the top of the loop. */
       break;
     }
 
@@ -121,7 +854,14 @@ THD_FUNCTION(pktRadioManager, arg) {
         pktAddEventFlags(handler, (EVT_PKT_BUFFER_MGR_FAIL));
         break;
       }
-#if PKT_RX_RLS_USE_NO_FIFO != TRUE
+#if PKT_RX_USE_CALLBACK_POOL == TRUE
+      /* Create callback workers. */
+      if(!pktCallbackPoolCreate(radio)) {
+        pktAddEventFlags(handler, (EVT_PKT_CBK_MGR_FAIL));
+        pktIncomingBufferPoolRelease(handler);
+        break;
+      }
+#elif PKT_RX_RLS_USE_NO_FIFO != TRUE
       /* Create callback manager. */
       if(pktCallbackManagerCreate(radio) == NULL) {
         pktAddEventFlags(handler, (EVT_PKT_CBK_MGR_FAIL));
@@ -136,6 +876,10 @@ THD_FUNCTION(pktRadioManager, arg) {
 #endif
       /* Switch on modulation type. */
       switch(task_object->type) {
+#if PKT_RX_USE_2FSK == TRUE
+        /* 2FSK is received through the PWM decoder. */
+        case MOD_2FSK:
+#endif
         case MOD_AFSK: {
           /* TODO: abstract this into the LLD for the radio. */
           /* Create the AFSK decoder (includes PWM, filters, etc.). */
@@ -150,7 +894,10 @@ THD_FUNCTION(pktRadioManager, arg) {
         } /* End case PKT_RADIO_OPEN. */
 
         case MOD_NONE:
-        case MOD_2FSK: {
+#if PKT_RX_USE_2FSK != TRUE
+        case MOD_2FSK:
+#endif
+          {
           break;
         }
         break;
@@ -163,6 +910,10 @@ THD_FUNCTION(pktRadioManager, arg) {
     case PKT_RADIO_RX_START: {
       /* The function switches on mod type so no need for switch here. */
       switch(task_object->type) {
+#if PKT_RX_USE_2FSK == TRUE
+      /* 2FSK is received through the PWM decoder. */
+      case MOD_2FSK:
+#endif
       case MOD_AFSK: {
         pktLockRadioTransmit(radio, TIME_INFINITE);
         /* Enable receive. */
@@ -178,7 +929,10 @@ THD_FUNCTION(pktRadioManager, arg) {
         } /* End case MOD_AFSK. */
 
       case MOD_NONE:
-      case MOD_2FSK: {
+#if PKT_RX_USE_2FSK != TRUE
+      case MOD_2FSK:
+#endif
+        {
         break;
         }
       } /* End switch on task_object->type. */
@@ -187,7 +941,18 @@ THD_FUNCTION(pktRadioManager, arg) {
 
     case PKT_RADIO_RX_STOP: {
       switch(task_object->type) {
+#if PKT_RX_USE_2FSK == TRUE
+            /* 2FSK is received through the PWM decoder. */
+            case MOD_2FSK:
+#endif
             case MOD_AFSK: {
+#if PKT_RX_USE_DUTY_CYCLE == TRUE
+              if(handler->rx_duty.asleep) {
+                /* The decoder is already paused by the duty cycle. */
+                handler->rx_duty.asleep = false;
+                break;
+              }
+#endif
               /* TODO: Abstract acquire and release in LLD. */
               pktLockRadioTransmit(radio, TIME_INFINITE);
               pktLLDradioStopDecoder(radio);
@@ -196,7 +961,10 @@ THD_FUNCTION(pktRadioManager, arg) {
               } /* End case. */
 
             case MOD_NONE:
-            case MOD_2FSK: {
+#if PKT_RX_USE_2FSK != TRUE
+            case MOD_2FSK:
+#endif
+              {
               break;
               }
        } /* End switch. */
@@ -209,9 +977,14 @@ THD_FUNCTION(pktRadioManager, arg) {
       if(pktIsReceiveActive(radio)) {
         /* Pause the decoder. */
         pktLockRadioTransmit(radio, TIME_INFINITE);
+#if PKT_RX_FAST_TURNAROUND == TRUE
+        pktLLDradioHoldDecoding(radio);
+#else
         pktLLDradioPauseDecoding(radio);
+#endif
         pktUnlockRadioTransmit(radio);
       }
+      txlat_mark(task_object->packet_out, TXLAT_MANAGER, true);
       if(pktLLDradioSendPacket(task_object)) {
         /*
          * Keep count of active sends.
@@ -221,8 +994,8 @@ THD_FUNCTION(pktRadioManager, arg) {
 
         /* Send Successfully enqueued.
          * Unlike receive the task object is held by the TX until complete.
-         * This is non blocking as each radio transmit runs in a thread.
-         * The radio task object is released through a TX thread release task.
+         * This is non blocking as sends are run by the radio TX worker.
+         * The radio task object is released through a TX done task.
          */
         continue;
       }
@@ -248,7 +1021,14 @@ THD_FUNCTION(pktRadioManager, arg) {
       event_source_t *esp;
       thread_t *decoder = NULL;
       switch(task_object->type) {
+#if PKT_RX_USE_2FSK == TRUE
+      /* 2FSK is received through the PWM decoder. */
+      case MOD_2FSK:
+#endif
       case MOD_AFSK: {
+#if PKT_RX_USE_DUTY_CYCLE == TRUE
+        handler->rx_duty.asleep = false;
+#endif
         /* Stop receive. */
         pktLockRadioTransmit(radio, TIME_INFINITE);
         pktLLDradioDisableReceive(radio);
@@ -268,7 +1048,10 @@ THD_FUNCTION(pktRadioManager, arg) {
         }
 
       case MOD_NONE:
-      case MOD_2FSK: {
+#if PKT_RX_USE_2FSK != TRUE
+      case MOD_2FSK:
+#endif
+        {
         break;
         } /* End case DECODE_FSK. */
       } /* End switch on link_type. */
@@ -293,8 +1076,12 @@ THD_FUNCTION(pktRadioManager, arg) {
       chThdWait(decoder);
 
       /* Release packet services. */
+#if PKT_RX_USE_CALLBACK_POOL == TRUE
+      /* Let queued callbacks complete and stop the workers. */
+      pktCallbackPoolRelease(handler);
+#endif
       pktIncomingBufferPoolRelease(handler);
-#if PKT_RX_RLS_USE_NO_FIFO != TRUE
+#if PKT_RX_USE_CALLBACK_POOL != TRUE && PKT_RX_RLS_USE_NO_FIFO != TRUE
       pktCallbackManagerRelease(handler);
 #endif
 
@@ -306,9 +1093,12 @@ THD_FUNCTION(pktRadioManager, arg) {
       break;
       } /*end case close. */
 
-    case PKT_RADIO_TX_THREAD: {
-      /* Get thread exit code and free memory. */
-      msg_t send_msg = chThdWait(task_object->thread);
+    case PKT_RADIO_TX_DONE: {
+      /* Get the send result. */
+      msg_t send_msg = task_object->result;
+#if PKT_RX_FAST_TURNAROUND == TRUE
+      rtcnt_t tx_end = chSysGetRealtimeCounterX();
+#endif
 
       if(send_msg == MSG_TIMEOUT) {
         TRACE_ERROR("RAD  > Transmit timeout on radio %d", radio);
@@ -316,8 +1106,26 @@ THD_FUNCTION(pktRadioManager, arg) {
       if(send_msg == MSG_RESET) {
         TRACE_ERROR("RAD  > Transmit failed to start on radio %d", radio);
       }
+
+      /* Complete the sends that joined this radio session. */
+      radio_task_object_t *joined = task_object->tx_joined;
+      task_object->tx_joined = NULL;
+      while(joined != NULL) {
+        radio_task_object_t *next = joined->tx_joined;
+        joined->result = send_msg;
+        if(joined->callback != NULL)
+          joined->callback(joined);
+        chFifoReturnObject(radio_queue, joined);
+        handler->tx_count--;
+        joined = next;
+      }
       /* If no transmissions pending then enable RX or power down. */
       if(--handler->tx_count == 0) {
+#if PKT_RX_USE_DUTY_CYCLE == TRUE
+        /* Hold receive on for replies to the transmission. */
+        if(handler->rx_duty.echo != 0)
+          (void)pktStoreReceiveWindow(handler, 0, handler->rx_duty.echo);
+#endif
         /* Check at handler level is OK. No LLD required. */
         if(pktIsReceivePaused(radio)) {
           if(!pktLLDradioResumeReceive(radio)) {
@@ -327,14 +1135,25 @@ THD_FUNCTION(pktRadioManager, arg) {
           }
           /* TODO: Implement LLD since resume depends on radio and mod type. */
           pktLLDradioResumeDecoding(radio);
-        } else {
-          /* Enter standby state (low power). */
+#if PKT_RX_FAST_TURNAROUND == TRUE
+          pktAddReceiveTurnaround(handler, tx_end);
+#endif
+        }
+#if PKT_RADIO_LOW_VBAT_SHUTDOWN == TRUE
+        else if(pktIsRadioShutdownDue()) {
+          /* Battery is low. The next send initializes the radio again. */
+          TRACE_INFO("RAD  > Radio %d shut down on low battery", radio);
+          pktLLDradioShutdown(radio);
+        }
+#endif
+        else {
+          /* Enter standby state (low power) with registers kept. */
           TRACE_INFO("RAD  > Radio %d entering standby", radio);
           pktLLDradioStandby(radio);
         }
       } /* Else more TX tasks outstanding so let those complete. */
       break;
-    } /* End case PKT_RADIO_TX_THREAD */
+    } /* End case PKT_RADIO_TX_DONE */
 
     } /* End switch on command. */
     /* Perform radio task callback if specified. */
@@ -348,6 +1167,7 @@ THD_FUNCTION(pktRadioManager, arg) {
     chFifoReturnObject(radio_queue, (radio_task_object_t *)task_object);
   } /* End while should terminate(). */
   /* Thread has been terminated. */
+  wdg_unregister(&beat);
   chFactoryReleaseObjectsFIFO(handler->the_radio_fifo);
   chThdExit(MSG_OK);
 }
@@ -635,6 +1455,145 @@ void pktUnlockRadioTransmit(const radio_unit_t radio) {
 #endif
 }
 
+/**
+ * @brief   Lets a higher priority transmit use the radio.
+ * @notes   Called by a send thread between packets of a burst.
+ * @notes   If a higher priority send is waiting the radio is unlocked
+ *          and then locked again after that send has finished.
+ * @notes   Only the radio mutex queues by priority.
+ * @pre     The radio is locked by the calling thread.
+ *
+ * @param[in] radio    radio unit ID.
+ *
+ * @return              Status of the yield.
+ * @retval true         the radio was used by another send.
+ * @retval false        no higher priority send was waiting.
+ *
+ * @api
+ */
+bool pktYieldRadioTransmit(const radio_unit_t radio) {
+#if PKT_USE_RADIO_MUTEX == TRUE
+  packet_svc_t *handler = pktGetServiceObject(radio);
+  chSysLock();
+  /* Priority of this thread is raised by waiters so use the base priority. */
+  bool yield = chMtxQueueNotEmptyS(&handler->radio_mtx)
+      && handler->radio_mtx.queue.next->prio > chThdGetSelfX()->realprio;
+  chSysUnlock();
+  if(!yield)
+    return false;
+  pktUnlockRadioTransmit(radio);
+  (void)pktLockRadioTransmit(radio, TIME_INFINITE);
+  return true;
+#else
+  (void)radio;
+  return false;
+#endif
+}
+
+/**
+ * @brief   Queue a send to the radio transmit worker.
+ * @notes   Sends are run in priority order.
+ * @notes   Queued sends with the same radio settings share a radio session.
+ *
+ * @param[in] rto   radio task object pointer.
+ *
+ * @return  Status of the operation.
+ * @retval  true    the send was queued.
+ * @retval  false   the radio has no transmit worker.
+ *
+ * @api
+ */
+bool pktQueueRadioTransmit(radio_task_object_t *rto) {
+  packet_svc_t *handler = rto->handler;
+  if(handler->tx_worker == NULL)
+    return false;
+  chSysLock();
+  pktInsertRadioTransmitS(handler, rto, false);
+  chSchRescheduleS();
+  chSysUnlock();
+  return true;
+}
+
+/**
+ * @brief   Checks if a send should give up the radio between packets.
+ * @notes   A send also gives up the radio at the end of the TDMA slot and
+ *          resumes in the next slot.
+ *
+ * @param[in] rto   radio task object pointer of the running send.
+ *
+ * @return  true if a higher priority send is queued or the slot has ended.
+ *
+ * @api
+ */
+bool pktIsRadioTransmitPreempted(const radio_task_object_t *rto) {
+  if(pktGetTransmitSlotWait() != 0)
+    return true;
+  bool preempt = false;
+  chSysLock();
+  radio_task_object_t *next = rto->handler->tx_pending;
+  /* The list is priority ordered so stop at the same priority. */
+  while(next != NULL && next->tx_priority < rto->tx_priority) {
+    if(pktGetTransmitDeferralS(next) == 0) {
+      preempt = true;
+      break;
+    }
+    next = next->tx_next;
+  }
+  chSysUnlock();
+  return preempt;
+}
+
+/**
+ * @brief   Decides channel access for a send using p-persistent CSMA.
+ * @notes   On a clear channel the send starts with the persistence probability.
+ * @notes   Otherwise the send is deferred by a slot time.
+ * @notes   Once the maximum wait has passed the send starts regardless.
+ * @post    A deferred send has its next attempt time set.
+ *
+ * @param[in] rto   radio task object pointer of the send.
+ * @param[in] clear true if the channel was sensed clear.
+ *
+ * @return  true if the send can start now.
+ *
+ * @api
+ */
+bool pktCheckRadioChannelAccess(radio_task_object_t *rto, bool clear) {
+  radio_csma_t *csma = &rto->handler->tx_csma;
+
+  if(!rto->tx_csma) {
+    /* First attempt for this send. */
+    rto->tx_csma = true;
+    rto->tx_csma_start = chVTGetSystemTime();
+    rto->tx_csma_wait = 0;
+  }
+  sysinterval_t elapsed = chVTTimeElapsedSinceX(rto->tx_csma_start);
+  bool access;
+  if(elapsed >= csma->max_wait) {
+    TRACE_WARN("RAD  > No clear channel for send %d after %d ms",
+               rto->tx_seq_num, chTimeI2MS(elapsed));
+    csma->forced++;
+    access = true;
+  } else if(clear) {
+    /* Park-Miller minimal standard draw. Top byte is the persistence roll. */
+    csma->seed = (uint32_t)(((uint64_t)csma->seed * 48271U) % 0x7FFFFFFFU);
+    access = ((csma->seed >> 23) & 0xFF) <= csma->persist;
+    if(access)
+      csma->granted++;
+    else
+      csma->persisted++;
+  } else {
+    csma->busy++;
+    access = false;
+  }
+  if(access) {
+    /* A resumed session starts channel access afresh. */
+    rto->tx_csma = false;
+    return true;
+  }
+  rto->tx_csma_wait = elapsed + csma->slot;
+  return false;
+}
+
 /**
  * @brief   Return pointer to radio object array for this board.
  *
@@ -798,6 +1757,7 @@ radio_band_t *pktCheckAllowedFrequency(const radio_unit_t radio,
 /**
  * @brief   Select a radio operable on the required frequency.
  * @notes   Resolves special frequency codes to absolute frequencies.
+ * @notes   Transmit uses the offload radio when it is open and operable.
  *
  * @param[in] freq  Radio frequency or code in Hz.
  * @param[in] step  Step size for radio in Hz.
@@ -814,9 +1774,18 @@ radio_unit_t pktSelectRadioForFrequency(const radio_freq_t freq,
                                         const channel_hz_t step,
                                         const radio_ch_t chan,
                                         const radio_mode_t mode) {
+  /* Keep the other radios receiving if transmit can be offloaded. */
+  const radio_unit_t offload = PKT_TX_OFFLOAD_RADIO;
+  if(mode == RADIO_TX && offload != PKT_RADIO_NONE
+      && pktGetRadioData(offload) != NULL && pktIsTransmitOpen(offload)) {
+    radio_freq_t op_freq = pktComputeOperatingFrequency(offload, freq,
+                                                        step, chan, mode);
+    if(pktCheckAllowedFrequency(offload, op_freq))
+      return offload;
+  }
   /* Check for a radio able to operate on the resolved frequency. */
   const radio_config_t *radio_data = pktGetRadioList();
-  while(radio_data->unit != PKT_RADIO_NONE) {
+  for(; radio_data->unit != PKT_RADIO_NONE; radio_data++) {
     /* Resolve any special codes. */
     radio_freq_t op_freq = pktComputeOperatingFrequency(radio_data->unit,
                                                         freq,
@@ -865,6 +1834,15 @@ radio_freq_t pktComputeOperatingFrequency(const radio_unit_t radio,
                                           radio_ch_t chan,
                                           const radio_mode_t mode) {
 
+#if PKT_RX_USE_SCAN == TRUE
+  if(base_freq == FREQ_SCAN) {
+    /* The scanner resolves both receive and transmit. */
+    base_freq = pktGetScanFrequency(radio, mode);
+    step = 0;
+    chan = 0;
+  }
+#endif
+
   if((base_freq == FREQ_RX_APRS || base_freq == FREQ_SCAN)
                    && (mode == RADIO_TX || mode == RADIO_ALL)) {
     /* Get current RX frequency (or default) and use that. */
@@ -888,6 +1866,13 @@ radio_freq_t pktComputeOperatingFrequency(const radio_unit_t radio,
     chan = 0;
   }
 
+  if(base_freq == FREQ_RX_CMDC) {
+    /* Command and control uses a fixed frequency. */
+    base_freq = DEFAULT_CMDC_FREQ;
+    step = 0;
+    chan = 0;
+  }
+
   if(base_freq == FREQ_INVALID) { // Geofence not resolved
     base_freq = pktGetDefaultOperatingFrequency(radio);
     step = 0;
@@ -953,6 +1938,9 @@ void pktLLDradioStandby(const radio_unit_t radio) {
  */
 bool pktLLDradioSendPacket(radio_task_object_t *rto) {
   bool status;
+  rto->tx_next = NULL;
+  rto->tx_joined = NULL;
+  rto->tx_csma = false;
   /* TODO: Implement VMT to functions per radio type. */
   switch(rto->type) {
   case MOD_2FSK:
@@ -970,23 +1958,50 @@ bool pktLLDradioSendPacket(radio_task_object_t *rto) {
 }
 
 /**
- * @brief   Called by transmit threads to schedule release after completing.
- * @post    A thread release task is posted to the radio manager queue.
+ * @brief   Run a send on radio.
+ * @notes   This is the API interface to the radio LLD.
+ * @notes   Currently just map directly to 446x driver.
+ * @notes   Called from the radio TX worker and returns when the send ends.
+ * @post    Packets not sent due to preemption remain in the task object.
+ *
+ * @param[in] rto radio task object pointer.
+ *
+ * @return  status of the send.
+ *
+ * @notapi
+ */
+msg_t pktLLDradioTransmit(radio_task_object_t *rto) {
+  /* TODO: Implement VMT to functions per radio type. */
+  switch(rto->type) {
+  case MOD_2FSK:
+    return Si446x_feed2FSK(rto);
+
+  case MOD_AFSK:
+    return Si446x_feedAFSK(rto);
+
+  default:
+    break;
+  } /* End switch on task_object->type. */
+  pktReleaseBufferChain(rto->packet_out);
+  rto->packet_out = NULL;
+  return MSG_ERROR;
+}
+
+/**
+ * @brief   Called by the transmit worker to schedule release after completing.
+ * @post    A TX done task is posted to the radio manager queue.
  *
  * @param[in]   rto     reference to radio task object.
- * @param[in]   thread  thread reference of thread terminating.
  *
  * @api
  */
-void pktLLDradioSendComplete(radio_task_object_t *rto,
-                              thread_t *thread) {
+void pktLLDradioSendComplete(radio_task_object_t *rto) {
 
   packet_svc_t *handler = rto->handler;
 
   radio_unit_t radio = handler->radio;
   /* The handler and radio ID are set in returned object. */
-  rto->command = PKT_RADIO_TX_THREAD;
-  rto->thread = thread;
+  rto->command = PKT_RADIO_TX_DONE;
   /* Submit guaranteed to succeed by design. */
   pktSubmitRadioTask(radio, rto, rto->callback);
 }
@@ -1017,7 +2032,7 @@ bool pktLLDradioEnableReceive(const radio_unit_t radio,
                             rto->base_frequency,
                             rto->step_hz,
                             rto->channel,
-                            rto->squelch,
+                            pktGetAdaptiveSquelch(radio, rto->squelch),
                             rto->type);
 }
 
@@ -1052,7 +2067,8 @@ bool pktLLDradioResumeReceive(const radio_unit_t radio) {
   radio_freq_t freq = handler->radio_rx_config.base_frequency;
   channel_hz_t step = handler->radio_rx_config.step_hz;
   radio_ch_t chan = handler->radio_rx_config.channel;
-  radio_squelch_t rssi = handler->radio_rx_config.squelch;
+  radio_squelch_t rssi = pktGetAdaptiveSquelch(radio,
+                                   handler->radio_rx_config.squelch);
   mod_t mod = handler->radio_rx_config.type;
   bool result = Si4464_enableReceive(radio, freq, step, chan, rssi, mod);
   return result;
@@ -1075,6 +2091,37 @@ void pktLLDradioCaptureRSSI(const radio_unit_t radio) {
   handler->rx_strength = Si446x_getCurrentRSSI(radio);
 }
 
+/**
+ * @brief   Reads the current signal strength from the radio.
+ * @notes   This is the API interface to the radio LLD.
+ * @notes   Currently just map directly to 446x driver.
+ *
+ * @param[in] radio radio unit ID.
+ *
+ * @return  the signal strength.
+ *
+ * @notapi
+ */
+radio_signal_t pktLLDradioGetRSSI(const radio_unit_t radio) {
+  return Si446x_getCurrentRSSI(radio);
+}
+
+/**
+ * @brief   Sets the squelch level of the active receive.
+ * @notes   This is the API interface to the radio LLD.
+ * @notes   Currently just map directly to 446x driver.
+ * @pre     The radio is locked by the calling thread.
+ *
+ * @param[in] radio radio unit ID.
+ * @param[in] rssi  squelch level.
+ *
+ * @notapi
+ */
+void pktLLDradioSetSquelch(const radio_unit_t radio,
+                           const radio_squelch_t rssi) {
+  Si446x_setSquelch(radio, rssi);
+}
+
 /**
  *
  */
@@ -1096,9 +2143,28 @@ void pktLLDradioResumeDecoding(const radio_unit_t radio) {
    * - Lookup radio type from radio ID.
    * - Then call VMT dispatcher inside radio driver.
    */
+#if PKT_RX_FAST_TURNAROUND == TRUE
+  pktReleaseDecoder(radio);
+#else
   pktResumeDecoding(radio);
+#endif
 }
 
+#if PKT_RX_FAST_TURNAROUND == TRUE
+/**
+ * @brief   Holds decoding for a transmit.
+ * @notes   The radio keeps both modem setups so no reload is needed.
+ */
+void pktLLDradioHoldDecoding(const radio_unit_t radio) {
+  /*
+   * TODO: Implement as VMT inside radio driver (Si446x is only one at present).
+   * - Lookup radio type from radio ID.
+   * - Then call VMT dispatcher inside radio driver.
+   */
+  pktHoldDecoder(radio);
+}
+#endif
+
 /**
  *
  */
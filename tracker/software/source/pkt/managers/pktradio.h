@@ -24,16 +24,34 @@
 /* Thread working area size. */
 #define PKT_RADIO_MANAGER_WA_SIZE       4096
 
+/* Longest wait for a task so the manager can send its heartbeat. */
+#define PKT_RADIO_MANAGER_BEAT          TIME_S2I(10)
+
 #define PKT_RADIO_TASK_QUEUE_PREFIX     "radm_"
+#define PKT_RADIO_TX_WORKER_PREFIX      "radt_"
 
 /* The number of radio task object the FIFO has. */
 #define RADIO_TASK_QUEUE_MAX            10
 
 #define PKT_RADIO_MANAGER_TASK_KILL     TRUE
 
+/*
+ * Radio power between sends when receive is not active.
+ * The radio is left in standby with its registers kept so the next send
+ * needs no init (POWER_UP, patch upload and properties). Set TRUE to shut
+ * the radio down instead while the battery is below the GPS off voltage.
+ */
+#define PKT_RADIO_LOW_VBAT_SHUTDOWN     TRUE
+
 /* Set TRUE to use mutex instead of bsem. */
 #define PKT_USE_RADIO_MUTEX             TRUE
 
+/*
+ * Transmit thread priority for a priority class.
+ * The radio mutex queues waiting sends by thread priority.
+ */
+#define PKT_TX_THREAD_PRIO(p)           (NORMALPRIO - 10 - (tprio_t)(p))
+
 /*===========================================================================*/
 /* Module data structures and types.                                         */
 /*===========================================================================*/
@@ -50,9 +68,10 @@ typedef enum radioCommand {
   PKT_RADIO_RX_STOP,
   PKT_RADIO_TX_SEND,
   PKT_RADIO_RX_CLOSE,
-  PKT_RADIO_TX_THREAD,
+  PKT_RADIO_TX_DONE,
   PKT_RADIO_MGR_CLOSE,
-  PKT_RADIO_RX_RSSI
+  PKT_RADIO_RX_RSSI,
+  PKT_RADIO_RX_DUTY
 } radio_command_t;
 
 /**
@@ -117,6 +136,15 @@ struct radioTask {
   radio_pwr_t               tx_power;
   uint32_t                  tx_speed;
   uint8_t                   tx_seq_num;
+  tx_priority_t             tx_priority;
+  /* Link in the TX worker pending list. */
+  radio_task_object_t       *tx_next;
+  /* Sends joined to this one in a single radio session. */
+  radio_task_object_t       *tx_joined;
+  /* Channel access start and wait until the next attempt. */
+  bool                      tx_csma;
+  systime_t                 tx_csma_start;
+  sysinterval_t             tx_csma_wait;
 };
 
 /*===========================================================================*/
@@ -142,6 +170,7 @@ extern "C" {
   msg_t     		pktLockRadioTransmit(const radio_unit_t radio,
             		                const sysinterval_t timeout);
   void      		pktUnlockRadioTransmit(const radio_unit_t radio);
+  bool      		pktYieldRadioTransmit(const radio_unit_t radio);
   const radio_config_t *pktGetRadioList(void);
   uint8_t           pktGetNumRadios(void);
   radio_band_t 		*pktCheckAllowedFrequency(const radio_unit_t radio,
@@ -160,16 +189,28 @@ extern "C" {
   void      		pktLLDradioDisableReceive(const radio_unit_t radio);
   bool      		pktLLDradioResumeReceive(const radio_unit_t radio);
   bool      		pktLLDradioSendPacket(radio_task_object_t *rto);
+  msg_t     		pktLLDradioTransmit(radio_task_object_t *rto);
+  bool      		pktQueueRadioTransmit(radio_task_object_t *rto);
+  bool      		pktIsRadioTransmitPreempted(const radio_task_object_t *rto);
+  bool      		pktCheckRadioChannelAccess(radio_task_object_t *rto,
+            		                           bool clear);
   void      		pktLLDradioCaptureRSSI(const radio_unit_t radio);
+  radio_signal_t	pktLLDradioGetRSSI(const radio_unit_t radio);
+  void      		pktLLDradioSetSquelch(const radio_unit_t radio,
+            		                      const radio_squelch_t rssi);
+  radio_squelch_t	pktGetAdaptiveSquelch(const radio_unit_t radio,
+            		                      const radio_squelch_t level);
   bool      		pktLLDradioInit(const radio_unit_t radio);
   void      		pktLLDradioStandby(const radio_unit_t radio);
   void      		pktLLDradioShutdown(const radio_unit_t radio);
   void      		pktLLDradioPauseDecoding(const radio_unit_t radio);
   void      		pktLLDradioResumeDecoding(const radio_unit_t radio);
+#if PKT_RX_FAST_TURNAROUND == TRUE
+  void      		pktLLDradioHoldDecoding(const radio_unit_t radio);
+#endif
   void      		pktLLDradioStartDecoder(const radio_unit_t radio);
   void      		pktLLDradioStopDecoder(const radio_unit_t radio);
-  void      		pktLLDradioSendComplete(radio_task_object_t *rto,
-                                thread_t *thread);
+  void      		pktLLDradioSendComplete(radio_task_object_t *rto);
   ICUDriver         *pktLLDradioAttachPWM(const radio_unit_t radio);
   void              pktLLDradioDetachPWM(const radio_unit_t radio);
   const ICUConfig   *pktLLDradioStartPWM(const radio_unit_t radio,
@@ -181,6 +222,7 @@ extern "C" {
             	 	                        size_t size);
   const radio_config_t	*pktGetRadioData(radio_unit_t radio);
   uint8_t           pktLLDradioReadCCA(const radio_unit_t radio);
+  bool              pktIsReceiveIdleI(const radio_unit_t radio);
 #ifdef __cplusplus
 }
 #endif
@@ -8,6 +8,9 @@
 
 #include "pktconf.h"
 #include "portab.h"
+#include "stats.h"
+#include "memregion.h"
+#include "txlatency.h"
 
 /*===========================================================================*/
 /* Module local definitions.                                                 */
@@ -46,10 +49,58 @@ static memory_heap_t _ccm_heap;
 static guarded_memory_pool_t _ccm_pool;*/
 #endif
 
+/* Outstanding receive callbacks when one is added. */
+static STATS_DECL(pkt_stats_callbacks, "pkt rx callbacks");
+
+#if PKT_RX_FIX_BITS == TRUE
+/* Frames with bad CRC repaired, not repaired and not tried. */
+static STATS_DECL(pkt_stats_fix_one, "pkt rx fixed 1 bit");
+static STATS_DECL(pkt_stats_fix_two, "pkt rx fixed 2 bits");
+static STATS_DECL(pkt_stats_fix_failed, "pkt rx fix failed");
+static STATS_DECL(pkt_stats_fix_skipped, "pkt rx fix skipped");
+#endif
+
 /*===========================================================================*/
 /* Module local functions.                                                   */
 /*===========================================================================*/
 
+#if PKT_RX_FIX_BITS == TRUE
+/**
+ * @brief   Checks the header of a repaired frame.
+ * @notes   A bit guess can give a good CRC on a frame with more errors.
+ *          The header of such a frame is unlikely to be valid.
+ *
+ * @param[in] frame     pointer to the frame without FCS.
+ * @param[in] len       length of the frame.
+ *
+ * @return  true if the frame has valid AX.25 addresses and is a UI frame.
+ */
+static bool pktIsSaneUIFrame(const uint8_t *frame, uint16_t len) {
+  uint16_t i, j;
+  bool last = false;
+  for(i = 0; i < AX25_MAX_ADDRS * AX25_ADDR_LEN
+              && i + AX25_ADDR_LEN <= len; i += AX25_ADDR_LEN) {
+    for(j = 0; j < AX25_ADDR_LEN - 1; j++) {
+      uint8_t c = frame[i + j];
+      if(c & SSID_LAST_MASK)
+        return false;
+      c >>= 1;
+      if(!((c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == ' '))
+        return false;
+    }
+    last = (frame[i + AX25_ADDR_LEN - 1] & SSID_LAST_MASK) != 0;
+    if(last)
+      break;
+  }
+  /* Address field closed with at least source and destination. */
+  if(!last || i < (AX25_MIN_ADDRS - 1) * AX25_ADDR_LEN)
+    return false;
+  i += AX25_ADDR_LEN;
+  /* UI frame with either poll/final bit and a PID. */
+  return i + 2 <= len && (frame[i] & ~0x10) == AX25_UI_FRAME;
+}
+#endif
+
 /*===========================================================================*/
 /* Module exported functions.                                                */
 /*===========================================================================*/
@@ -107,6 +158,22 @@ bool pktSystemInit(void) {
   return true;
 }
 
+/**
+ * @brief   Allocates CPU only data in CCM.
+ * @notes   The main heap is used when the CCM heap is full.
+ * @notes   The memory must not be used for DMA when it is in CCM.
+ * @notes   Release with chHeapFree().
+ *
+ * @param[in] size  number of bytes to allocate.
+ *
+ * @return  pointer to the memory or NULL if both heaps are full.
+ *
+ * @api
+ */
+void *pktAllocCCM(size_t size) {
+  return mem_alloc(MEM_REGION_DSP, size, 0);
+}
+
 /**
  * @brief   Deinits the packet system.
  *
@@ -170,11 +237,44 @@ bool pktServiceCreate(const radio_unit_t radio) {
   /* Set service semaphore to idle state. */
   chBSemObjectInit(&handler->close_sem, false);
 
+  /* The transmit worker is started by the radio manager. */
+  handler->tx_worker = NULL;
+  handler->tx_pending = NULL;
+
+#if PKT_RX_USE_SCAN == TRUE
+  memset(&handler->rx_scan, 0, sizeof(radio_rx_scan_t));
+  handler->rx_scan.current = FREQ_INVALID;
+  handler->rx_scan.found = FREQ_INVALID;
+#endif
+
+#if PKT_RX_USE_NOISE_FLOOR == TRUE
+  memset(&handler->rx_noise, 0, sizeof(radio_noise_t));
+#endif
+
+  /* Set the default channel access. */
+  memset(&handler->tx_csma, 0, sizeof(radio_csma_t));
+  handler->tx_csma.persist = PKT_TX_CSMA_PERSIST;
+  handler->tx_csma.slot = TIME_MS2I(PKT_TX_CSMA_SLOT_MS);
+  handler->tx_csma.max_wait = TIME_MS2I(PKT_TX_CSMA_MAX_WAIT_MS);
+  handler->tx_csma.seed = (chSysGetRealtimeCounterX() % 0x7FFFFFFEU) + 1U;
+
 #if PKT_USE_RADIO_MUTEX == TRUE
   chMtxObjectInit(&handler->radio_mtx);
 #else
   /* Set radio semaphore to free state. */
   chBSemObjectInit(&handler->radio_sem, false);
+#endif
+#if PKT_RX_USE_DUTY_CYCLE == TRUE
+  /* Set the default receive duty cycle. */
+  memset(&handler->rx_duty, 0, sizeof(radio_rx_duty_t));
+  handler->rx_duty.on = TIME_MS2I(PKT_RX_DUTY_ON_MS);
+  handler->rx_duty.off = TIME_MS2I(PKT_RX_DUTY_OFF_MS);
+  handler->rx_duty.echo = TIME_MS2I(PKT_RX_ECHO_WINDOW_MS);
+  handler->rx_duty.epoch = chVTGetSystemTime();
+#endif
+#if PKT_RX_FAST_TURNAROUND == TRUE
+  handler->rx_hold = false;
+  memset(&handler->rx_turnaround, 0, sizeof(radio_turnaround_t));
 #endif
   /* Send request to create radio manager. */
   if (pktRadioManagerCreate(radio) == NULL)
@@ -400,6 +500,10 @@ void pktStartDecoder(const radio_unit_t radio) {
   event_source_t *esp;
 
   switch(handler->radio_rx_config.type) {
+#if PKT_RX_USE_2FSK == TRUE
+    /* 2FSK is received through the PWM decoder. */
+    case MOD_2FSK:
+#endif
     case MOD_AFSK: {
 
       esp = pktGetEventSource((AFSKDemodDriver *)handler->link_controller);
@@ -412,9 +516,11 @@ void pktStartDecoder(const radio_unit_t radio) {
       break;
     } /* End case. */
 
+#if PKT_RX_USE_2FSK != TRUE
     case MOD_2FSK: {
       return;
     }
+#endif
 
     default:
       return;
@@ -458,7 +564,7 @@ msg_t pktDisableDataReception(radio_unit_t radio) {
   if(handler == NULL)
     return MSG_RESET;
 
-  if(handler->state != PACKET_DECODE || handler->state != PACKET_PAUSE)
+  if(handler->state != PACKET_DECODE && handler->state != PACKET_PAUSE)
     return MSG_RESET;
 
   /* Stop the radio processing. */
@@ -489,7 +595,12 @@ void pktStopDecoder(radio_unit_t radio) {
 
   packet_svc_t *handler = pktGetServiceObject(radio);
 
+#if PKT_RX_FAST_TURNAROUND == TRUE
+  /* A held decoder is still running so is stopped in the normal way. */
+  if(!pktIsReceiveActive(radio) && !handler->rx_hold) {
+#else
   if(!pktIsReceiveActive(radio)) {
+#endif
     /* Wrong state. */
     chDbgAssert(false, "wrong state for decoder stop");
     return;
@@ -498,6 +609,10 @@ void pktStopDecoder(radio_unit_t radio) {
   event_source_t *esp;
 
   switch(handler->radio_rx_config.type) {
+#if PKT_RX_USE_2FSK == TRUE
+    /* 2FSK is received through the PWM decoder. */
+    case MOD_2FSK:
+#endif
     case MOD_AFSK: {
       esp = pktGetEventSource((AFSKDemodDriver *)handler->link_controller);
 
@@ -509,9 +624,11 @@ void pktStopDecoder(radio_unit_t radio) {
       break;
     } /* End case. */
 
+#if PKT_RX_USE_2FSK != TRUE
     case MOD_2FSK: {
       return;
     }
+#endif
 
     default:
       return;
@@ -527,9 +644,100 @@ void pktStopDecoder(radio_unit_t radio) {
     evt = chEvtGetAndClearFlags(&el);
   } while (evt != DEC_STOP_EXEC);
   pktUnregisterEventListener(esp, &el);
+#if PKT_RX_FAST_TURNAROUND == TRUE
+  handler->rx_hold = false;
+#endif
   handler->state = PACKET_PAUSE;
 }
 
+#if PKT_RX_FAST_TURNAROUND == TRUE
+/**
+ * @brief   Holds a packet decoder during transmit.
+ * @notes   The PWM stream is stopped but the decoder thread is not.
+ * @notes   No handshake with the decoder thread is needed.
+ * @pre     The packet channel must be running.
+ * @post    The packet channel is paused.
+ *
+ * @param[in]   radio unit ID.
+ *
+ * @api
+ */
+void pktHoldDecoder(const radio_unit_t radio) {
+
+  packet_svc_t *handler = pktGetServiceObject(radio);
+
+  if(!pktIsReceiveActive(radio)) {
+    /* Wrong state. */
+    chDbgAssert(false, "wrong state for decoder hold");
+    return;
+  }
+
+  switch(handler->radio_rx_config.type) {
+#if PKT_RX_USE_2FSK == TRUE
+    /* 2FSK is received through the PWM decoder. */
+    case MOD_2FSK:
+#endif
+    case MOD_AFSK: {
+      pktDisableRadioPWM(radio);
+      handler->rx_hold = true;
+      handler->state = PACKET_PAUSE;
+      return;
+    } /* End case. */
+
+#if PKT_RX_USE_2FSK != TRUE
+    case MOD_2FSK: {
+      return;
+    }
+#endif
+
+    default:
+      return;
+  } /* End switch. */
+}
+
+/**
+ * @brief   Releases a held packet decoder.
+ * @notes   A decoder that was stopped rather than held is started.
+ * @pre     The packet channel must be paused.
+ * @post    The packet channel is running.
+ *
+ * @param[in]   radio unit ID.
+ *
+ * @api
+ */
+void pktReleaseDecoder(const radio_unit_t radio) {
+
+  packet_svc_t *handler = pktGetServiceObject(radio);
+
+  if(!handler->rx_hold) {
+    pktStartDecoder(radio);
+    return;
+  }
+  /* The decoder resets on the next PWM stream. */
+  pktEnableRadioPWM(radio);
+  handler->rx_hold = false;
+  handler->state = PACKET_DECODE;
+}
+
+/**
+ * @brief   Records a receive turnaround time.
+ *
+ * @param[in] handler   pointer to a @p packet_svc_t structure.
+ * @param[in] start     realtime counter at transmit end.
+ *
+ * @api
+ */
+void pktAddReceiveTurnaround(packet_svc_t *handler, const rtcnt_t start) {
+  uint32_t us = RTC2US(STM32_SYSCLK, chSysGetRealtimeCounterX() - start);
+  radio_turnaround_t *ta = &handler->rx_turnaround;
+  ta->last_us = us;
+  if(us > ta->peak_us)
+    ta->peak_us = us;
+  ta->total_us += us;
+  ta->count++;
+}
+#endif /* PKT_RX_FAST_TURNAROUND == TRUE */
+
 /**
  * @brief   Closes a packet receive service.
  * @pre     The packet service must have been stopped.
@@ -572,10 +780,60 @@ msg_t pktCloseRadioReceive(radio_unit_t radio) {
   return MSG_OK;
 }
 
+/**
+ * @brief   Gets a batch of received buffers in poll mode.
+ * @details Waits for the first buffer then takes any further buffers
+ *          already posted without waiting.
+ * @notes   Each buffer is returned with @p pktReleaseDataBuffer().
+ * @pre     Data reception must be enabled without a callback.
+ *
+ * @param[in] handler   pointer to a @p packet handler object.
+ * @param[out] objects  array for the fetched buffer references.
+ * @param[in] n         maximum number of buffers to fetch.
+ * @param[in] timeout   the number of ticks to wait for the first buffer.
+ *                      the following special values are allowed:
+ *                      - @a TIME_IMMEDIATE immediate timeout.
+ *                      - @a TIME_INFINITE no timeout.
+ *
+ * @return              The number of buffers fetched.
+ * @retval 0            if no buffer was fetched within the timeout.
+ *
+ * @api
+ */
+size_t pktReceiveDataBufferBatchTimeout(packet_svc_t *handler,
+                                        pkt_data_object_t **objects,
+                                        size_t n,
+                                        sysinterval_t timeout) {
+  chDbgAssert(handler != NULL, "invalid handler reference");
+
+  if(n == 0 || handler->the_packet_fifo == NULL)
+    return 0;
+
+  objects_fifo_t *pkt_fifo = chFactoryGetObjectsFIFO(handler->the_packet_fifo);
+
+  chDbgAssert(pkt_fifo != NULL, "no packet FIFO");
+
+  /* Wait for the first buffer. */
+  if(chFifoReceiveObjectTimeout(pkt_fifo, (void *)&objects[0],
+                                timeout) != MSG_OK)
+    return 0;
+
+  /* Take the remainder of the burst in one lock. */
+  size_t i;
+  chSysLock();
+  for(i = 1; i < n; i++) {
+    if(chFifoReceiveObjectI(pkt_fifo, (void *)&objects[i]) != MSG_OK)
+      break;
+  }
+  chSysUnlock();
+  return i;
+}
+
 /**
  * @brief   Stores data in a packet channel buffer.
  * @notes   If the data is an HDLC value it will be escape encoded.
  * @post    The character is stored and the internal buffer index is updated.
+ * @post    The running CRC is updated.
  *
  * @param[in] pkt_buffer    pointer to a @p packet buffer object.
  * @param[in] data          the character to be stored
@@ -597,6 +855,8 @@ bool pktStoreBufferData(pkt_data_object_t *pkt_buffer, ax25char_t data) {
 #else
   pkt_buffer->buffer[pkt_buffer->packet_size++] = data;
 #endif
+  /* Accumulate the CRC so it is ready when the frame closes. */
+  pkt_buffer->crc = calc_crc16_update(pkt_buffer->crc, data);
   return true;
 }
 
@@ -626,12 +886,11 @@ eventflags_t pktDispatchReceivedBuffer(pkt_data_object_t *pkt_buffer) {
   handler->frame_count++;
   if(pktIsBufferValidAX25Frame(pkt_buffer)) {
     handler->valid_count++;
-    uint16_t magicCRC =
-        calc_crc16(pkt_buffer->buffer, 0,
-                   pkt_buffer->packet_size);
-    if(magicCRC == CRC_INCLUSIVE_CONSTANT)
+    /* The CRC was accumulated as the frame was stored. */
+    bool goodCRC = pktIsBufferGoodCRC(pkt_buffer);
+    if(goodCRC)
         handler->good_count++;
-    flags |= (magicCRC == CRC_INCLUSIVE_CONSTANT)
+    flags |= goodCRC
                 ? STA_PKT_FRAME_RDY
                 : STA_PKT_CRC_ERROR;
   } else {
@@ -650,6 +909,24 @@ eventflags_t pktDispatchReceivedBuffer(pkt_data_object_t *pkt_buffer) {
     /* Send the packet buffer to the FIFO queue. */
     chFifoSendObject(pkt_fifo, pkt_buffer);
   } else {
+#if PKT_RX_USE_CALLBACK_POOL == TRUE
+    /* Queue the buffer to the callback workers. */
+    chSysLock();
+    msg_t msg = chMBPostI(&handler->cb_queue, (msg_t)pkt_buffer);
+    if(msg == MSG_OK)
+      handler->cb_count++;
+    chSchRescheduleS();
+    chSysUnlock();
+
+    stats_sample(&pkt_stats_callbacks, handler->cb_count);
+    chDbgAssert(msg == MSG_OK, "callback queue full");
+
+    if(msg != MSG_OK) {
+      /* No room in queue. Release buffer. Broadcast event. */
+      chFifoReturnObject(pkt_fifo, pkt_buffer);
+      pktAddEventFlags(handler, EVT_PKT_FAILED_CB_THD);
+    }
+#else
     /* Schedule a callback. */
     thread_t *cb_thd = pktCreateBufferCallback(pkt_buffer);
 
@@ -662,11 +939,97 @@ eventflags_t pktDispatchReceivedBuffer(pkt_data_object_t *pkt_buffer) {
     } else {
       /* Increase outstanding callback count. */
       handler->cb_count++;
+      stats_sample(&pkt_stats_callbacks, handler->cb_count);
     }
+#endif /* PKT_RX_USE_CALLBACK_POOL != TRUE */
   }
   return flags;
 }
 
+#if PKT_RX_FIX_BITS == TRUE
+/**
+ * @brief   Repairs a received frame with bad CRC.
+ * @notes   Inverting data bit n changes the CRC register by a value which
+ *          depends only on the number of bits after n. Walking these
+ *          values from the end of the frame finds a single bit or two
+ *          adjacent bits which explain the CRC error, without computing
+ *          the CRC again per candidate.
+ * @notes   Skipped while other received frames wait for callbacks so a
+ *          busy channel does not delay good frames.
+ * @post    On success the bits are inverted in the buffer and the status
+ *          is changed from CRC error to frame ready.
+ *
+ * @param[in] pkt_buffer    pointer to a @p packet buffer object.
+ *
+ * @return  status of the repair.
+ * @retval  true if the frame was repaired.
+ * @retval  false if the frame was not repaired or is invalid.
+ *
+ * @api
+ */
+bool pktFixBufferBits(pkt_data_object_t *pkt_buffer) {
+
+  chDbgAssert(pkt_buffer != NULL, "no packet buffer");
+
+  if((pkt_buffer->status & (STA_PKT_INVALID_FRAME | STA_PKT_CRC_ERROR))
+      != STA_PKT_CRC_ERROR)
+    return false;
+
+  packet_svc_t *handler = pkt_buffer->handler;
+
+  /* The outstanding callbacks include this frame. */
+  if(handler->cb_count > PKT_RX_FIX_BITS_QUEUED + 1) {
+    stats_count(&pkt_stats_fix_skipped, 1);
+    return false;
+  }
+
+  uint8_t *frame = pkt_buffer->buffer;
+  int32_t bit = (int32_t)pkt_buffer->packet_size * 8 - 1;
+  uint16_t syndrome = pkt_buffer->crc ^ (uint16_t)~CRC_INCLUSIVE_CONSTANT;
+  uint16_t change = CRC16_REFLECTED_POLY;
+  uint16_t last = 0;
+  uint8_t width = 0;
+
+  /* Bits are sent LSB first so bit n is (n % 8) of byte (n / 8). */
+  for(; bit >= 0; bit--) {
+    if(change == syndrome) {
+      width = 1;
+      break;
+    }
+    if(last != 0 && (change ^ last) == syndrome) {
+      width = 2;
+      break;
+    }
+    last = change;
+    change = (change >> 1) ^ ((change & 1) ? CRC16_REFLECTED_POLY : 0);
+  }
+  if(width == 0) {
+    stats_count(&pkt_stats_fix_failed, 1);
+    return false;
+  }
+
+  uint8_t i;
+  for(i = 0; i < width; i++)
+    frame[(bit + i) / 8] ^= 1U << ((bit + i) % 8);
+
+  if(!pktIsSaneUIFrame(frame, pkt_buffer->packet_size - 2)) {
+    for(i = 0; i < width; i++)
+      frame[(bit + i) / 8] ^= 1U << ((bit + i) % 8);
+    stats_count(&pkt_stats_fix_failed, 1);
+    return false;
+  }
+
+  chSysLock();
+  pkt_buffer->crc = (uint16_t)~CRC_INCLUSIVE_CONSTANT;
+  pkt_buffer->status = (pkt_buffer->status & ~STA_PKT_CRC_ERROR)
+                          | STA_PKT_FRAME_RDY;
+  handler->good_count++;
+  chSysUnlock();
+  stats_count(width == 1 ? &pkt_stats_fix_one : &pkt_stats_fix_two, 1);
+  return true;
+}
+#endif
+
 /**
  * @brief   Create a callback processing thread.
  * @notes   Packet callbacks are processed by individual threads.
@@ -693,7 +1056,7 @@ thread_t *pktCreateBufferCallback(pkt_data_object_t *pkt_buffer) {
              PKT_CALLBACK_THD_PREFIX"%x", pkt_buffer);
 
   /* Start a callback dispatcher thread. */
-  thread_t *cb_thd = chThdCreateFromHeap(NULL,
+  thread_t *cb_thd = mem_thread_create(MEM_REGION_THREADS,
               THD_WORKING_AREA_SIZE(PKT_CALLBACK_WA_SIZE),
               pkt_buffer->cb_thd_name,
               NORMALPRIO - 20,
@@ -747,12 +1110,123 @@ THD_FUNCTION(pktCallback, arg) {
   pktReleaseDataBuffer(pkt_buffer);
 }
 
+#if PKT_RX_USE_CALLBACK_POOL == TRUE
+/**
+ * @brief   Run a callback worker thread.
+ * @notes   Workers take packet buffers from the callback queue in turn.
+ * @notes   The buffer is released after the callback and the worker continues.
+ * @notes   A NULL buffer in the queue stops the worker.
+ *
+ * @param[in] arg pointer to packet service handler object.
+ *
+ * @return  status (MSG_OK) on exit.
+ *
+ * @notapi
+ */
+THD_FUNCTION(pktCallbackWorker, arg) {
+  packet_svc_t *handler = arg;
+
+  chDbgAssert(handler != NULL, "invalid handler reference");
+
+  while(true) {
+    msg_t msg;
+    if(chMBFetchTimeout(&handler->cb_queue, &msg, TIME_INFINITE) != MSG_OK)
+      break;
+    pkt_data_object_t *pkt_buffer = (pkt_data_object_t *)msg;
+    if(pkt_buffer == NULL)
+      break;
+
+    chDbgAssert(pkt_buffer->cb_func != NULL, "no callback set");
+
+    pkt_buffer->cb_thread = chThdGetSelfX();
+
+    /* Perform the callback. */
+    pkt_buffer->cb_func(pkt_buffer);
+
+    /* Free the buffer and wait for the next. */
+    pktReleaseDataBuffer(pkt_buffer);
+  }
+  chThdExit(MSG_OK);
+}
+
+/**
+ * @brief   Create the callback worker threads.
+ * @notes   Workers are created when receive is opened.
+ *
+ * @param[in] radio     radio unit ID.
+ *
+ * @return  status of the operation.
+ * @retval  true if all workers were created.
+ * @retval  false if a worker could not be created (none are left running).
+ *
+ * @api
+ */
+bool pktCallbackPoolCreate(const radio_unit_t radio) {
+
+  packet_svc_t *handler = pktGetServiceObject(radio);
+
+  /* Create the callback worker thread name. */
+  chsnprintf(handler->cbwrk_name, sizeof(handler->cbwrk_name),
+             "%s%02i", PKT_CALLBACK_WORKER_PREFIX, radio);
+
+  /*
+   * Initialize the outstanding callback count.
+   */
+  handler->cb_count = 0;
+
+  chMBObjectInit(&handler->cb_queue, handler->cb_queue_buffer,
+                 NUMBER_RX_PKT_BUFFERS + PKT_RX_CALLBACK_WORKERS);
+
+  handler->cb_num_workers = 0;
+  uint8_t i;
+  for(i = 0; i < PKT_RX_CALLBACK_WORKERS; i++) {
+    thread_t *cbw = mem_thread_create(MEM_REGION_THREADS,
+                THD_WORKING_AREA_SIZE(PKT_CALLBACK_WA_SIZE),
+                handler->cbwrk_name,
+                NORMALPRIO - 20,
+                pktCallbackWorker,
+                handler);
+
+    chDbgAssert(cbw != NULL, "failed to create callback worker thread");
+
+    if(cbw == NULL) {
+      pktCallbackPoolRelease(handler);
+      return false;
+    }
+    handler->cb_workers[handler->cb_num_workers++] = cbw;
+  }
+  return true;
+}
+
+/**
+ * @brief   Release the callback worker threads.
+ * @notes   Callbacks already queued are completed first.
+ *
+ * @param[in] handler   pointer to a @p packet_svc_t structure.
+ *
+ * @api
+ */
+void pktCallbackPoolRelease(packet_svc_t *handler) {
+  uint8_t i;
+
+  /* Queue a stop for each worker behind any outstanding buffers. */
+  for(i = 0; i < handler->cb_num_workers; i++)
+    (void)chMBPostTimeout(&handler->cb_queue, (msg_t)NULL, TIME_INFINITE);
+
+  /* Wait for the workers to terminate and release. */
+  for(i = 0; i < handler->cb_num_workers; i++)
+    chThdWait(handler->cb_workers[i]);
+  handler->cb_num_workers = 0;
+}
+#endif /* PKT_RX_USE_CALLBACK_POOL == TRUE */
+
 #if PKT_RX_RLS_USE_NO_FIFO != TRUE
 /**
  * @brief   Process release of completed callbacks.
  * @notes   Release is initiated by posting the packet buffer to the queue.
  * @notes   The queue is used as a completion mechanism in callback mode.
  * @notes   In poll mode the received packet is posted to the consumer
+ * @notes   The thread only wakes on a posted release or a terminate request.
  *
  * @post    Call back thread has been released.
  * @post    Packet buffer object is returned to free pool.
@@ -769,7 +1243,6 @@ THD_FUNCTION(pktCallback, arg) {
 /* TODO: Deprecate and use radio manager thread for callback release? */
 THD_FUNCTION(pktCompletion, arg) {
   packet_svc_t *handler = arg;
-#define PKT_COMPLETION_THREAD_TIMER 100 /* 100 mS. */
 
   chDbgAssert(handler != NULL, "invalid handler reference");
 
@@ -777,27 +1250,24 @@ THD_FUNCTION(pktCompletion, arg) {
   objects_fifo_t *pkt_queue = chFactoryGetObjectsFIFO(pkt_factory);
   chDbgAssert(pkt_queue != NULL, "no packet fifo list");
 
-  /* TODO: Implement thread events to control start/stop. */
   while(true) {
-
-    /*
-     * Wait for a callback to be outstanding.
-     * If no callbacks outstanding check for termination request.
-     */
-    if(handler->cb_count == 0) {
-      if(chThdShouldTerminateX())
-        chThdExit(MSG_OK);
-      chThdSleep(TIME_MS2I(PKT_COMPLETION_THREAD_TIMER));
-      continue;
-    }
-    /* Wait for a buffer to be released. */
+    /* Get the next released buffer. */
     pkt_data_object_t *pkt_object;
 
     msg_t fmsg = chFifoReceiveObjectTimeout(pkt_queue,
                          (void *)&pkt_object,
-                         TIME_MS2I(PKT_COMPLETION_THREAD_TIMER));
-    if(fmsg == MSG_TIMEOUT)
+                         TIME_IMMEDIATE);
+    if(fmsg != MSG_OK) {
+      /*
+       * Nothing released.
+       * When no callbacks are outstanding check for termination request.
+       * Otherwise wait for a release or terminate event.
+       */
+      if(handler->cb_count == 0 && chThdShouldTerminateX())
+        chThdExit(MSG_OK);
+      (void)chEvtWaitAny(CBK_RELEASE_POSTED | CBK_TERMINATE);
       continue;
+    }
 
     /* Release the callback thread and recover heap. */
     chThdRelease(pkt_object->cb_thread);
@@ -836,7 +1306,7 @@ void pktCallbackManagerOpen(radio_unit_t radio) {
              "%s%02i", PKT_CALLBACK_TERMINATOR_PREFIX, radio);
 
   /* Start the callback thread terminator. */
-  thread_t *cbh = chThdCreateFromHeap(NULL,
+  thread_t *cbh = mem_thread_create(MEM_REGION_THREADS,
               THD_WORKING_AREA_SIZE(PKT_TERMINATOR_WA_SIZE),
               handler->cbend_name,
               NORMALPRIO - 30,
@@ -893,6 +1363,9 @@ dyn_objects_fifo_t *pktIncomingBufferPoolCreate(radio_unit_t radio) {
  */
 dyn_semaphore_t *pktInitBufferControl() {
 
+  /* Set up packet object allocation. */
+  ax25_pool_init();
+
   /* Check if the transmit packet buffer semaphore already exists.
    * Calling this twice is an error so assert if enabled.
    * Otherwise get a pointer to it and just return that.
@@ -944,11 +1417,13 @@ void pktDeinitBufferControl() {
 
 /*
  * Send shares a common pool of buffers.
+ * The buffer has capacity for at least frame_len bytes of frame.
  * @retval MSG_RESET    if the semaphore has been reset using @p chSemReset().
  * @retval MSG_TIMEOUT  if the semaphore has not been signaled or reset within
  *                      the specified timeout.
  */
-msg_t pktGetPacketBuffer(packet_t *pp, sysinterval_t timeout) {
+msg_t pktGetPacketBuffer(packet_t *pp, uint16_t frame_len,
+                         sysinterval_t timeout) {
 
   /* Check if the packet buffer semaphore already exists.
    * If so we get a pointer to it and get the semaphore.
@@ -976,8 +1451,8 @@ msg_t pktGetPacketBuffer(packet_t *pp, sysinterval_t timeout) {
   /* Allocate buffer.
    * If this returns null then all heap is consumed.
    */
-  *pp = ax25_new();
-  if(pp == NULL)
+  *pp = ax25_new(frame_len);
+  if(*pp == NULL)
    return MSG_TIMEOUT;
   return MSG_OK;
 }
@@ -986,6 +1461,17 @@ msg_t pktGetPacketBuffer(packet_t *pp, sysinterval_t timeout) {
  * A common pool of AX25 buffers used in TX and APRS.
  */
 void pktReleasePacketBuffer(packet_t pp) {
+  /* A view is released with its receive buffer. */
+  if(ax25_is_view(pp))
+    return;
+
+  /* The packet object is freed when its last holder releases it. */
+  if(!ax25_unref(pp))
+    return;
+
+  /* Close a latency record of the packet. */
+  txlat_release(pp);
+
   /* Check if the packet buffer semaphore exists.
    * If not this is a system error.
    */
@@ -1004,6 +1490,22 @@ void pktReleasePacketBuffer(packet_t pp) {
   chFactoryReleaseSemaphore(dyn_sem);
 }
 
+/*
+ * Get the number of buffers free in the common pool.
+ * Senders size bursts by this so receive keeps buffers.
+ */
+cnt_t pktGetFreePacketBuffers(void) {
+  dyn_semaphore_t *dyn_sem =
+      chFactoryFindSemaphore(PKT_SEND_BUFFER_SEM_NAME);
+  if(dyn_sem == NULL)
+    return 0;
+  chSysLock();
+  cnt_t free = chSemGetCounterI(chFactoryGetSemaphore(dyn_sem));
+  chSysUnlock();
+  chFactoryReleaseSemaphore(dyn_sem);
+  return (free < 0) ? 0 : free;
+}
+
 /*
  * Send shares a common pool of buffers.
  */
@@ -1045,7 +1547,7 @@ thread_t *pktCallbackManagerCreate(radio_unit_t radio) {
   handler->cb_count = 0;
 
   /* Start the callback thread terminator. */
-  thread_t *cbh = chThdCreateFromHeap(NULL,
+  thread_t *cbh = mem_thread_create(MEM_REGION_THREADS,
               THD_WORKING_AREA_SIZE(PKT_TERMINATOR_WA_SIZE),
               handler->cbend_name,
               NORMALPRIO - 30,
@@ -1074,6 +1576,7 @@ void pktCallbackManagerRelease(packet_svc_t *handler) {
 
   /* Tell the callback terminator it should exit. */
   chThdTerminate(handler->cb_terminator);
+  chEvtSignal(handler->cb_terminator, CBK_TERMINATE);
 
   /* Wait for it to terminate and release. */
   chThdWait(handler->cb_terminator);
@@ -1112,4 +1615,113 @@ packet_svc_t *pktGetServiceObject(radio_unit_t radio) {
   return handler;
 }
 
+#if PKT_RX_USE_DUTY_CYCLE == TRUE
+/**
+ * @brief   Sets the receive duty cycle of a radio.
+ * @notes   Setting on or off time to zero disables the periodic cycle.
+ * @notes   The echo window is opened after each transmit if non zero.
+ * @notes   The cycle restarts with the on period.
+ * @pre     The packet service must be created.
+ *
+ * @param[in] radio     radio unit ID.
+ * @param[in] on        receive on time.
+ * @param[in] off       receive standby time.
+ * @param[in] echo      receive window after transmit.
+ *
+ * @return              Status of the operation.
+ * @retval MSG_OK       if the duty cycle was set.
+ * @retval MSG_RESET    if the service was not in the correct state.
+ * @retval MSG_TIMEOUT  if the radio manager queue was full.
+ *
+ * @api
+ */
+msg_t pktSetReceiveDutyCycle(const radio_unit_t radio,
+                             const sysinterval_t on,
+                             const sysinterval_t off,
+                             const sysinterval_t echo) {
+  packet_svc_t *handler = pktGetServiceObject(radio);
+  if(handler == NULL || handler->state == PACKET_IDLE)
+    return MSG_RESET;
+
+  chSysLock();
+  handler->rx_duty.on = on;
+  handler->rx_duty.off = off;
+  handler->rx_duty.echo = echo;
+  handler->rx_duty.epoch = chVTGetSystemTimeX();
+  chSysUnlock();
+
+  /* Have the radio manager apply the cycle. */
+  radio_task_object_t rt = handler->radio_rx_config;
+  rt.command = PKT_RADIO_RX_DUTY;
+  return pktSendRadioCommand(radio, &rt, NULL);
+}
+
+/**
+ * @brief   Schedules a receive window on a radio.
+ * @notes   Receive is held on during the window regardless of duty cycle.
+ * @notes   Use for known transmit times such as a ground station schedule.
+ * @pre     The packet service must be created.
+ *
+ * @param[in] radio     radio unit ID.
+ * @param[in] delay     time from now to the window start.
+ * @param[in] duration  length of the window.
+ *
+ * @return              Status of the operation.
+ * @retval MSG_OK       if the window was scheduled.
+ * @retval MSG_RESET    if the service was not in the correct state.
+ * @retval MSG_TIMEOUT  if no window is free or the manager queue was full.
+ *
+ * @api
+ */
+msg_t pktAddReceiveWindow(const radio_unit_t radio,
+                          const sysinterval_t delay,
+                          const sysinterval_t duration) {
+  packet_svc_t *handler = pktGetServiceObject(radio);
+  if(handler == NULL || handler->state == PACKET_IDLE)
+    return MSG_RESET;
+
+  if(!pktStoreReceiveWindow(handler, delay, duration))
+    return MSG_TIMEOUT;
+
+  /* Have the radio manager reschedule. */
+  radio_task_object_t rt = handler->radio_rx_config;
+  rt.command = PKT_RADIO_RX_DUTY;
+  return pktSendRadioCommand(radio, &rt, NULL);
+}
+
+/**
+ * @brief   Stores a receive window in the duty cycle schedule.
+ *
+ * @param[in] handler   pointer to a @p packet_svc_t structure.
+ * @param[in] delay     time from now to the window start.
+ * @param[in] duration  length of the window.
+ *
+ * @return  status of the operation.
+ * @retval  true if the window was stored.
+ * @retval  false if no window is free.
+ *
+ * @api
+ */
+bool pktStoreReceiveWindow(packet_svc_t *handler,
+                          const sysinterval_t delay,
+                          const sysinterval_t duration) {
+  radio_rx_duty_t *duty = &handler->rx_duty;
+  bool stored = false;
+  chSysLock();
+  uint8_t i;
+  for(i = 0; i < PKT_RX_DUTY_WINDOWS; i++) {
+    if(duty->window[i].used)
+      continue;
+    duty->window[i].created = chVTGetSystemTimeX();
+    duty->window[i].delay = delay;
+    duty->window[i].duration = duration;
+    duty->window[i].used = true;
+    stored = true;
+    break;
+  }
+  chSysUnlock();
+  return stored;
+}
+#endif /* PKT_RX_USE_DUTY_CYCLE == TRUE */
+
 /** @} */
@@ -18,11 +18,13 @@
 #define PKT_FRAME_QUEUE_PREFIX          "pktr_"
 #define PKT_CALLBACK_TERMINATOR_PREFIX  "cbte_"
 #define PKT_CALLBACK_THD_PREFIX         "cb_"
+#define PKT_CALLBACK_WORKER_PREFIX      "cbw_"
 
 #define PKT_SEND_BUFFER_SEM_NAME        "pbsem"
 
 
-#define PKT_CALLBACK_WA_SIZE             (1024 * 10)
+/* Packet text and trace buffers of the callback are scratch buffers. */
+#define PKT_CALLBACK_WA_SIZE             (1024 * 8)
 #define PKT_TERMINATOR_WA_SIZE           (1024 * 1)
 
 /*===========================================================================*/
@@ -63,6 +65,19 @@ typedef struct packetBuffer pkt_data_object_t;
 /* Receive packet buffer callback. */
 typedef void (*pkt_buffer_cb_t)(pkt_data_object_t *pkt_buffer);
 
+/**
+ * @brief   Signal quality of a received frame.
+ * @notes   The tone level is a Q31 magnitude set by the QCORR decoder.
+ */
+typedef struct packetQuality {
+  /* Radio signal strength captured at CCA open. */
+  radio_signal_t            rssi;
+  /* Average magnitude of the dominant tone. */
+  uint32_t                  tone_level;
+  /* Percentage of tone transitions inside the PLL lock window. */
+  uint8_t                   pll_lock;
+} pkt_quality_t;
+
 typedef struct packetBuffer {
   struct pool_header        link; /* For safety keep clear - where pool stores its free link. */
   packet_svc_t              *handler;
@@ -73,6 +88,14 @@ typedef struct packetBuffer {
   volatile eventflags_t     status;
   size_t                    buffer_size;
   size_t                    packet_size;
+  /* Running CCITT-CRC16 of the stored data. */
+  uint16_t                  crc;
+  /* Signal quality of the received frame. */
+  pkt_quality_t             quality;
+#if PKT_RX_USE_PACKET_VIEW == TRUE
+  /* Read-only packet header over the received frame. */
+  packet_gen_t              view;
+#endif
 #if USE_CCM_HEAP_RX_BUFFERS == TRUE
   ax25char_t                *buffer;
 #else
@@ -80,6 +103,113 @@ typedef struct packetBuffer {
 #endif
 } pkt_data_object_t;
 
+#if PKT_RX_USE_DUTY_CYCLE == TRUE
+/**
+ * @brief   Scheduled receive window.
+ * @details Receive is held on for the duration after the delay.
+ * @notes   Times are relative to creation so system time wrap is handled.
+ */
+typedef struct radioRxWindow {
+  systime_t                 created;
+  sysinterval_t             delay;
+  sysinterval_t             duration;
+  bool                      used;
+} radio_rx_window_t;
+
+/**
+ * @brief   Receive duty cycle state.
+ * @notes   The cycle is disabled when either on or off time is zero.
+ */
+typedef struct radioRxDuty {
+  /* Periodic receive on and off times. */
+  sysinterval_t             on;
+  sysinterval_t             off;
+  /* Window opened after a transmit for replies and digipeats. */
+  sysinterval_t             echo;
+  /* Reference time for the periodic cycle. */
+  systime_t                 epoch;
+  /* Receive has been put in standby by the duty cycle. */
+  bool                      asleep;
+  radio_rx_window_t         window[PKT_RX_DUTY_WINDOWS];
+  /* Statistics counters. */
+  uint32_t                  sleeps;
+  uint32_t                  wakes;
+  uint32_t                  deferred;
+} radio_rx_duty_t;
+#endif
+
+#if PKT_RX_FAST_TURNAROUND == TRUE
+/**
+ * @brief   Receive turnaround statistics.
+ * @details Time from transmit thread exit to decoding resumed.
+ */
+typedef struct radioTurnaround {
+  uint32_t                  count;
+  uint32_t                  last_us;
+  uint32_t                  peak_us;
+  uint64_t                  total_us;
+} radio_turnaround_t;
+#endif
+
+#if PKT_RX_USE_SCAN == TRUE
+/**
+ * @brief   Receive frequency scan state.
+ * @details Receive on FREQ_SCAN steps through candidate APRS frequencies.
+ */
+typedef struct radioRxScan {
+  /* Candidate and frequency being listened to. */
+  uint8_t                   index;
+  radio_freq_t              current;
+  /* Last frequency with decoded frames. */
+  radio_freq_t              found;
+  /* Time the current frequency was tuned and the dwell from then. */
+  systime_t                 tuned;
+  sysinterval_t             dwell;
+  /* Good frame count at the last check. */
+  uint16_t                  good_count;
+  /* The scan is running on the current receive session. */
+  bool                      active;
+  /* Statistics counters. */
+  uint32_t                  hops;
+  uint32_t                  finds;
+} radio_rx_scan_t;
+#endif
+
+#if PKT_RX_USE_NOISE_FLOOR == TRUE
+/**
+ * @brief   Receive noise floor and adaptive squelch state.
+ * @details The floor is RSSI counts in 1/16 steps.
+ */
+typedef struct radioNoiseFloor {
+  /* Time of the last sample. */
+  systime_t                 sampled;
+  uint16_t                  floor;
+  /* Level applied to receive and CCA. Zero until the floor is known. */
+  radio_squelch_t           squelch;
+  /* Statistics counters. */
+  uint32_t                  samples;
+  uint32_t                  changes;
+} radio_noise_t;
+#endif
+
+/**
+ * @brief   Transmit channel access parameters and statistics.
+ * @details p-persistent CSMA in the model of KISS PERSIST and SLOTTIME.
+ */
+typedef struct radioCSMA {
+  /* Probability of sending on a clear slot is (persist + 1) / 256. */
+  uint8_t                   persist;
+  sysinterval_t             slot;
+  /* A send starts regardless after this wait. */
+  sysinterval_t             max_wait;
+  /* Pseudo random state for the persistence draw. */
+  uint32_t                  seed;
+  /* Statistics counters. */
+  uint32_t                  granted;
+  uint32_t                  busy;
+  uint32_t                  persisted;
+  uint32_t                  forced;
+} radio_csma_t;
 
 typedef struct packetHandlerData {
   /**
@@ -140,10 +270,56 @@ typedef struct packetHandlerData {
   radio_task_object_t       radio_tx_config;
 
   /**
-   * @brief Counter for active transmit threads.
+   * @brief Counter for active transmit tasks.
    */
   uint8_t                   tx_count;
 
+  /**
+   * @brief Transmit worker and its priority ordered list of sends.
+   */
+  thread_t                  *tx_worker;
+  radio_task_object_t       *tx_pending;
+  binary_semaphore_t        tx_wake;
+  char                      txwrk_name[CH_CFG_FACTORY_MAX_NAMES_LENGTH];
+
+  /**
+   * @brief Transmit channel access.
+   */
+  radio_csma_t              tx_csma;
+
+#if PKT_RX_USE_DUTY_CYCLE == TRUE
+  /**
+   * @brief Receive duty cycle.
+   */
+  radio_rx_duty_t           rx_duty;
+#endif
+
+#if PKT_RX_USE_SCAN == TRUE
+  /**
+   * @brief Receive frequency scan.
+   */
+  radio_rx_scan_t           rx_scan;
+#endif
+
+#if PKT_RX_USE_NOISE_FLOOR == TRUE
+  /**
+   * @brief Receive noise floor.
+   */
+  radio_noise_t             rx_noise;
+#endif
+
+#if PKT_RX_FAST_TURNAROUND == TRUE
+  /**
+   * @brief Decoder is held with the PWM stream stopped.
+   */
+  bool                      rx_hold;
+
+  /**
+   * @brief Receive turnaround after transmit.
+   */
+  radio_turnaround_t        rx_turnaround;
+#endif
+
   /**
    * @brief Pointer to link level protocol data.
    */
@@ -194,6 +370,19 @@ typedef struct packetHandlerData {
    */
   uint8_t                   cb_count;
 
+#if PKT_RX_USE_CALLBACK_POOL == TRUE
+  /**
+   * @brief Callback worker threads and their queue of packet buffers.
+   * @notes The queue has room for all buffers and a stop for each worker.
+   */
+  thread_t                  *cb_workers[PKT_RX_CALLBACK_WORKERS];
+  uint8_t                   cb_num_workers;
+  mailbox_t                 cb_queue;
+  msg_t                     cb_queue_buffer[NUMBER_RX_PKT_BUFFERS
+                                            + PKT_RX_CALLBACK_WORKERS];
+  char                      cbwrk_name[CH_CFG_FACTORY_MAX_NAMES_LENGTH];
+#endif
+
   /**
    * @brief Event source object.
    */
@@ -227,6 +416,7 @@ extern packet_svc_t RPKTD1;
 extern "C" {
 #endif
   bool pktSystemInit(void);
+  void *pktAllocCCM(size_t size);
   bool pktSystemDeinit(void);
   bool pktServiceCreate(const radio_unit_t radio);
   bool pktServiceRelease(const radio_unit_t radio);
@@ -241,9 +431,21 @@ extern "C" {
   void pktStartDecoder(const radio_unit_t radio);
   msg_t pktDisableDataReception(const radio_unit_t radio);
   void pktStopDecoder(const radio_unit_t radio);
+#if PKT_RX_FAST_TURNAROUND == TRUE
+  void pktHoldDecoder(const radio_unit_t radio);
+  void pktReleaseDecoder(const radio_unit_t radio);
+  void pktAddReceiveTurnaround(packet_svc_t *handler, const rtcnt_t start);
+#endif
   msg_t pktCloseRadioReceive(const radio_unit_t radio);
+  size_t pktReceiveDataBufferBatchTimeout(packet_svc_t *handler,
+                                          pkt_data_object_t **objects,
+                                          size_t n,
+                                          sysinterval_t timeout);
   bool  pktStoreBufferData(pkt_data_object_t *buffer, ax25char_t data);
   eventflags_t  pktDispatchReceivedBuffer(pkt_data_object_t *pkt_buffer);
+#if PKT_RX_FIX_BITS == TRUE
+  bool pktFixBufferBits(pkt_data_object_t *pkt_buffer);
+#endif
   thread_t *pktCreateBufferCallback(pkt_data_object_t *pkt_buffer);
   void pktCallback(void *arg);
   void pktCallbackManagerOpen(const radio_unit_t radio);
@@ -251,15 +453,34 @@ extern "C" {
   dyn_objects_fifo_t *pktIncomingBufferPoolCreate(const radio_unit_t radio);
   thread_t *pktCallbackManagerCreate(const radio_unit_t radio);
   void pktCallbackManagerRelease(packet_svc_t *handler);
+#if PKT_RX_USE_CALLBACK_POOL == TRUE
+  bool pktCallbackPoolCreate(const radio_unit_t radio);
+  void pktCallbackPoolRelease(packet_svc_t *handler);
+  void pktCallbackWorker(void *arg);
+#endif
   void pktIncomingBufferPoolRelease(packet_svc_t *handler);
   dyn_objects_fifo_t *pktCommonBufferPoolCreate(const radio_unit_t radio);
   void pktCommonBufferPoolRelease(const radio_unit_t radio);
   void pktReleaseBufferSemaphore(const radio_unit_t radio);
-  msg_t pktGetPacketBuffer(packet_t *pp, sysinterval_t timeout);
+  msg_t pktGetPacketBuffer(packet_t *pp, uint16_t frame_len,
+                           sysinterval_t timeout);
   void pktReleasePacketBuffer(packet_t pp);
+  cnt_t pktGetFreePacketBuffers(void);
   dyn_semaphore_t *pktInitBufferControl(void);
   void pktDeinitBufferControl(void);
   packet_svc_t *pktGetServiceObject(radio_unit_t radio);
+#if PKT_RX_USE_DUTY_CYCLE == TRUE
+  msg_t pktSetReceiveDutyCycle(const radio_unit_t radio,
+                               const sysinterval_t on,
+                               const sysinterval_t off,
+                               const sysinterval_t echo);
+  msg_t pktAddReceiveWindow(const radio_unit_t radio,
+                            const sysinterval_t delay,
+                            const sysinterval_t duration);
+  bool pktStoreReceiveWindow(packet_svc_t *handler,
+                             const sysinterval_t delay,
+                             const sysinterval_t duration);
+#endif
 #ifdef __cplusplus
 }
 #endif
@@ -295,7 +516,20 @@ extern "C" {
  *
  * @iclass
  */
-#define pktAddEventFlagsI(ip, flags) {                                       \
+#define pktAddEventFlagsI(ip, flags) pktAddEventArgI(ip, flags, 0)
+
+/**
+ * @brief   Adds status flags with an argument to the listeners's flags mask.
+ * @details The flags and argument are written to the packet event ring.
+ *
+ * @param[in] ip        pointer to a @p packet system event source
+ * @param[in] flags     condition flags to be added to the listener flags mask
+ * @param[in] arg       argument of the event
+ *
+ * @iclass
+ */
+#define pktAddEventArgI(ip, flags, arg) {                                    \
+    pktLogEventI(&(ip)->event, flags, arg);                                  \
     chEvtBroadcastFlagsI(&(ip)->event, flags);                               \
 }
 
@@ -322,7 +556,10 @@ extern "C" {
  * @iclass
  */
 #define pktAddEventFlags(ip, flags) {                                        \
-    chEvtBroadcastFlags(&(ip)->event, flags);                                \
+    chSysLock();                                                             \
+    pktAddEventArgI(ip, flags, 0);                                           \
+    chSchRescheduleS();                                                      \
+    chSysUnlock();                                                           \
 }
 
 
@@ -387,14 +624,15 @@ static inline pkt_data_object_t *pktTakeDataBuffer(packet_svc_t *handler,
     pkt_buffer->handler = handler;
     pkt_buffer->status = EVT_STATUS_CLEAR;
     pkt_buffer->packet_size = 0;
+    pkt_buffer->crc = CRC16_INIT_VALUE;
     pkt_buffer->buffer_size = PKT_RX_BUFFER_SIZE;
     pkt_buffer->cb_func = handler->usr_callback;
+    memset(&pkt_buffer->quality, 0, sizeof(pkt_quality_t));
 
     /* Save the pointer to the packet factory for use when releasing object. */
     pkt_buffer->pkt_factory = handler->the_packet_fifo;
 #if USE_CCM_HEAP_RX_BUFFERS == TRUE
-    extern memory_heap_t *ccm_heap;
-    pkt_buffer->buffer = chHeapAlloc(ccm_heap, PKT_RX_BUFFER_SIZE);
+    pkt_buffer->buffer = pktAllocCCM(PKT_RX_BUFFER_SIZE);
     if(pkt_buffer->buffer == NULL) {
       /* No heap available. */
       /* Return packet buffer object to free list. */
@@ -434,6 +672,11 @@ static inline void pktReleaseDataBuffer(pkt_data_object_t *object) {
   objects_fifo_t *pkt_fifo = chFactoryGetObjectsFIFO(pkt_factory);
   chDbgAssert(pkt_fifo != NULL, "no packet FIFO");
 
+#if PKT_RX_USE_PACKET_VIEW == TRUE
+  /* Any view of the frame is no longer valid. */
+  object->view.magic1 = 0;
+#endif
+
 #if USE_CCM_HEAP_RX_BUFFERS == TRUE
   /* Free the packet buffer in the heap now. */
   chHeapFree(object->buffer);
@@ -441,6 +684,15 @@ static inline void pktReleaseDataBuffer(pkt_data_object_t *object) {
 
   /* Is this a callback release? */
   if(object->cb_func != NULL) {
+#if PKT_RX_USE_CALLBACK_POOL == TRUE
+    /*
+     * Callback workers persist so just free the object.
+     * The worker then continues with the next queued buffer.
+     */
+    chSysLock();
+    object->handler->cb_count--;
+    chSysUnlock();
+#else
 #if PKT_RX_RLS_USE_NO_FIFO == TRUE
     extern void pktThdTerminateSelf(void);
     /*
@@ -463,8 +715,11 @@ static inline void pktReleaseDataBuffer(pkt_data_object_t *object) {
      */
     chSysLock();
     chFifoSendObjectI(pkt_fifo, object);
+    /* Wake the completion thread. */
+    chEvtSignalI(object->handler->cb_terminator, CBK_RELEASE_POSTED);
     chThdExitS(MSG_OK);
     /* We don't get to here. */
+#endif /* PKT_RX_USE_CALLBACK_POOL != TRUE */
   }
 
   /*
@@ -479,6 +734,7 @@ static inline void pktReleaseDataBuffer(pkt_data_object_t *object) {
 /**
  * @brief   Resets the buffer index of a packet buffer.
  * @details This macro resets the buffer count to zero.
+ * @post    The running CRC is restarted.
  *
  * @param[in]   object      pointer to the @p buffer to reset.
  *
@@ -486,6 +742,24 @@ static inline void pktReleaseDataBuffer(pkt_data_object_t *object) {
  */
 static inline void pktResetDataCount(pkt_data_object_t *object) {
   object->packet_size = 0;
+  object->crc = CRC16_INIT_VALUE;
+}
+
+/**
+ * @brief   Checks the running CRC of a packet buffer.
+ * @details The CRC is accumulated as each byte is stored.
+ *          A frame including its FCS has a fixed (magic) CRC result.
+ *
+ * @param[in]   object      pointer to the @p buffer to check.
+ *
+ * @return      status of the CRC.
+ * @retval      true if the CRC is good.
+ * @retval      false if the CRC is bad.
+ *
+ * @api
+ */
+static inline bool pktIsBufferGoodCRC(pkt_data_object_t *object) {
+  return object->crc == (uint16_t)~CRC_INCLUSIVE_CONSTANT;
 }
 
 /**
@@ -557,6 +831,31 @@ static inline bool pktGetAX25FrameStatus(pkt_data_object_t *object) {
   return (object->status & (STA_PKT_INVALID_FRAME | STA_PKT_CRC_ERROR)) == 0;
 }
 
+#if PKT_RX_USE_PACKET_VIEW == TRUE
+/**
+ * @brief   Gets a read-only packet view of a received frame.
+ * @notes   The frame is not copied so the view is valid until
+ *          the buffer is released with @p pktReleaseDataBuffer().
+ * @notes   Use @p ax25_dup() to get a packet which can be modified.
+ * @notes   Releasing the view with @p pktReleasePacketBuffer() does nothing.
+ *
+ * @param[in]   object    pointer to a @p packet buffer object.
+ *
+ * @return  pointer to the packet view.
+ * @retval  NULL if the frame is not valid.
+ *
+ * @api
+ */
+static inline packet_t pktGetDataBufferView(pkt_data_object_t *object) {
+  chDbgAssert(object != NULL, "no pointer to packet object buffer");
+  if(!pktGetAX25FrameStatus(object) || object->packet_size < 3)
+    return NULL;
+  /* Frame length excludes CRC. */
+  return ax25_view_frame(&object->view, object->buffer,
+                         object->packet_size - 2);
+}
+#endif
+
 /**
  * @brief   Gets current state of a packet service..
  *
@@ -62,7 +62,7 @@
 //#define STA_AX25_CRC_ERROR      EVENT_MASK(EVT_PRIORITY_BASE +  2)
 #define EVT_PKT_NO_BUFFER      EVENT_MASK(EVT_PRIORITY_BASE +  3)
 
-//#define EVT_AFSK_TERMINATED     EVENT_MASK(EVT_PRIORITY_BASE +  4)
+#define EVT_AFSK_DCD_DROP       EVENT_MASK(EVT_PRIORITY_BASE +  4)
 #define EVT_AFSK_START_FAIL     EVENT_MASK(EVT_PRIORITY_BASE +  5)
 //#define STA_AFSK_DECODE_RESET   EVENT_MASK(EVT_PRIORITY_BASE +  6)
 #define EVT_PWM_INVALID_SWAP    EVENT_MASK(EVT_PRIORITY_BASE +  7)
@@ -105,6 +105,10 @@
 #define DEC_COMMAND_CLOSE       EVENT_MASK(EVT_PRIORITY_BASE + 2)
 #define DEC_DIAG_OUT_END        EVENT_MASK(EVT_PRIORITY_BASE + 3)
 
+/* Callback completion thread event masks. */
+#define CBK_RELEASE_POSTED      EVENT_MASK(EVT_PRIORITY_BASE + 0)
+#define CBK_TERMINATE           EVENT_MASK(EVT_PRIORITY_BASE + 1)
+
 /* Console thread event masks. */
 #define CONSOLE_CHANNEL_EVT     EVENT_MASK(EVT_PRIORITY_BASE + 0)
 
@@ -140,12 +144,37 @@ typedef uint32_t            statusmask_t;    /**< Mask of status identifiers. */
 #define STA_AFSK_INVALID_SWAP       STATUS_MASK(9)
 #define STA_PWM_STREAM_TIMEOUT      STATUS_MASK(10)
 #define STA_PKT_NO_BUFFER           STATUS_MASK(11)
+#define STA_AFSK_DCD_DROP           STATUS_MASK(12)
+
+/**
+ * CCM placement.
+ * CCM is zero wait state and is not on the bus matrix so CPU access does
+ * not contend with DMA (camera, SPI, SDIO). DMA cannot reach CCM.
+ *  - In CCM: decoder and filter state, filter coefficients, the AFSK
+ *    driver objects, the PWM buffer pool, packet objects and receive
+ *    buffers. Heap data of this kind is allocated with pktAllocCCM().
+ *  - In SRAM: camera and SD buffers, anything passed to an SPI transfer
+ *    and the stacks of threads which use the radio SPI.
+ *    The AFSK decoder reads RSSI over SPI so its stack stays in SRAM.
+ */
 
 /**
  * Use this attribute to put variables in CCM.
+ * The variables are not initialized at startup.
  */
 #define useCCM  __attribute__((section(".ram4")))
 
+/**
+ * Use this attribute to put variables in CCM which are zeroed at startup.
+ */
+#define useCCMClear  __attribute__((section(".ram4_clear")))
+
+/**
+ * True if the address is in CCM and must not be used for DMA.
+ */
+#define pktIsCCM(p)  ((uint32_t)(p) >= 0x10000000U                           \
+                      && (uint32_t)(p) < 0x10010000U)
+
 #ifdef PKT_IS_TEST_PROJECT
 /* Define macro replacements for TRACE. */
 #define TRACE_DEBUG(format, args...) dbgPrintf(DBG_DEBUG, format, ##args)
@@ -167,19 +196,29 @@ typedef uint32_t            statusmask_t;    /**< Mask of status identifiers. */
 #include "pkttypes.h"
 #include "portab.h"
 #include "rxax25.h"
+#include "pcrc.h"
+#include "crc_calc.h"
+#include "fx25.h"
+#include "il2p.h"
 #include "pktservice.h"
 #include "pktradio.h"
 #include "dbguart.h"
 #include "dsp.h"
-#include "crc_calc.h"
 #include "rxpwm.h"
+#include "afskstats.h"
 #include "firfilter_q31.h"
+#include "firfilter_f32.h"
 #include "rxafsk.h"
+#include "rx2fsk.h"
 #include "corr_q31.h"
+#include "corr_f32.h"
+#include "sdft_f32.h"
+#include "period_disc.h"
 #include "rxhdlc.h"
 #include "txhdlc.h"
 #include "ihex_out.h"
 #include "ax25_dump.h"
+#include "pwmreplay.h"
 #include "si446x.h"
 #include "pktevt.h"
 #include "debug.h"
@@ -196,6 +235,46 @@ typedef uint32_t            statusmask_t;    /**< Mask of status identifiers. */
 #define PKT_SVC_USE_RADIO2 FALSE
 #endif
 
+#if !defined(PKT_TX_OFFLOAD_RADIO)
+#define PKT_TX_OFFLOAD_RADIO PKT_RADIO_NONE
+#endif
+
+#if !defined(PKT_TX_USE_FX25)
+#define PKT_TX_USE_FX25 FALSE
+#endif
+
+#if !defined(PKT_RX_USE_FX25)
+#define PKT_RX_USE_FX25 FALSE
+#endif
+
+#if !defined(PKT_TX_USE_IL2P)
+#define PKT_TX_USE_IL2P FALSE
+#endif
+
+#if !defined(PKT_RX_USE_IL2P)
+#define PKT_RX_USE_IL2P FALSE
+#endif
+
+#if !defined(PKT_RX_USE_SOFT_DCD)
+#define PKT_RX_USE_SOFT_DCD FALSE
+#endif
+
+#if !defined(PKT_RX_USE_DECODER_BOOST)
+#define PKT_RX_USE_DECODER_BOOST FALSE
+#endif
+
+#if !defined(PKT_RX_USE_PERIOD_DISC)
+#define PKT_RX_USE_PERIOD_DISC FALSE
+#endif
+
+#if !defined(PKT_RX_FIX_BITS)
+#define PKT_RX_FIX_BITS FALSE
+#endif
+
+#if !defined(PKT_RX_FIX_BITS_QUEUED)
+#define PKT_RX_FIX_BITS_QUEUED 0
+#endif
+
 /*===========================================================================*/
 /* External declarations.                                                    */
 /*===========================================================================*/
@@ -35,7 +35,8 @@ typedef uint8_t radio_squelch_t;
 
 typedef int8_t  radio_pwr_t;
 
-typedef int8_t  radio_signal_t;
+/* Radio signal strength. Same units as squelch for comparison. */
+typedef uint8_t radio_signal_t;
 
 /**
  * @brief   Definition of radio unit ID.
@@ -44,7 +45,8 @@ typedef int8_t  radio_signal_t;
  */
 typedef enum radioUnit {
   PKT_RADIO_NONE = 0,
-  PKT_RADIO_1
+  PKT_RADIO_1,
+  PKT_RADIO_2
 } radio_unit_t;
 
 typedef uint16_t    radio_part_t;
@@ -68,6 +70,14 @@ typedef enum radioMode {
   RADIO_ALL
 } radio_mode_t;
 
+/* Transmit priority classes. Lower value is higher priority. */
+typedef enum txPriority {
+  TX_PRIO_COMMAND = 0,
+  TX_PRIO_POSITION,
+  TX_PRIO_DIGIPEAT,
+  TX_PRIO_BULK
+} tx_priority_t;
+
 /* Forward declaration. */
 //typedef struct radioBand radio_band_t;
 typedef struct packetHandlerData pkt_service_t;
@@ -175,6 +175,9 @@
 #include "debug.h"
 #include "chprintf.h"
 #include "pkttypes.h"
+#include "pktconf.h"
+#include "stats.h"
+#include "memregion.h"
 
 
 /*
@@ -186,6 +189,50 @@
 static volatile int new_count = 0;
 static volatile int delete_count = 0;
 static volatile int last_seq_num = 0;
+static STATS_DECL(ax25_stats_live, "ax25 packets live");
+
+/* Size of a packet object with capacity for n bytes of frame. */
+#define AX25_PKT_OBJECT_SIZE(n)                                               \
+  MEM_ALIGN_NEXT(sizeof (struct TXpacket) + (n) + 1, PORT_NATURAL_ALIGN)
+
+static const uint16_t class_frame_size[AX25_PKT_CLASSES] = {
+	AX25_SMALL_PACKET_LEN,
+	AX25_MEDIUM_PACKET_LEN,
+	AX25_MAX_PACKET_LEN
+};
+
+static ax25_pool_stats_t pool_stats[AX25_PKT_CLASSES];
+
+#if USE_CCM_FOR_PKT_POOL == TRUE
+/*
+ * Fixed block pools of packet objects by size class.
+ * The semaphore gating pktGetPacketBuffer() has one count per object.
+ * If a class is empty the next larger class is used.
+ */
+static uint8_t small_objects[NUMBER_SMALL_PKT_BUFFERS
+                  * AX25_PKT_OBJECT_SIZE(AX25_SMALL_PACKET_LEN)]
+                  __attribute__((aligned(PORT_NATURAL_ALIGN))) useCCM;
+static uint8_t medium_objects[NUMBER_MEDIUM_PKT_BUFFERS
+                  * AX25_PKT_OBJECT_SIZE(AX25_MEDIUM_PACKET_LEN)]
+                  __attribute__((aligned(PORT_NATURAL_ALIGN))) useCCM;
+static uint8_t max_objects[NUMBER_MAX_PKT_BUFFERS
+                  * AX25_PKT_OBJECT_SIZE(AX25_MAX_PACKET_LEN)]
+                  __attribute__((aligned(PORT_NATURAL_ALIGN))) useCCM;
+
+static uint8_t * const class_objects[AX25_PKT_CLASSES] = {
+	small_objects,
+	medium_objects,
+	max_objects
+};
+
+static const uint16_t class_count[AX25_PKT_CLASSES] = {
+	NUMBER_SMALL_PKT_BUFFERS,
+	NUMBER_MEDIUM_PKT_BUFFERS,
+	NUMBER_MAX_PKT_BUFFERS
+};
+
+static memory_pool_t packet_pool[AX25_PKT_CLASSES];
+#endif
 
 #if AX25MEMDEBUG
 
@@ -210,6 +257,47 @@ int ax25memdebug_seq (packet_t this_p)
 
 #endif
 
+/*------------------------------------------------------------------------------
+ *
+ * Name:	ax25_pool_init
+ *
+ * Purpose:	Initialize packet object allocation and clear statistics.
+ *
+ * Description:	Called once at packet system start before any ax25_new.
+ *
+ *------------------------------------------------------------------------------*/
+
+void ax25_pool_init (void)
+{
+	int sc;
+
+	memset(pool_stats, 0, sizeof(pool_stats));
+	for (sc = 0; sc < AX25_PKT_CLASSES; sc++) {
+	  pool_stats[sc].frame_size = class_frame_size[sc];
+#if USE_CCM_FOR_PKT_POOL == TRUE
+	  chPoolObjectInit(&packet_pool[sc],
+	                   AX25_PKT_OBJECT_SIZE(class_frame_size[sc]), NULL);
+	  chPoolLoadArray(&packet_pool[sc], class_objects[sc], class_count[sc]);
+	  pool_stats[sc].size = class_count[sc];
+#endif
+	}
+}
+
+/*------------------------------------------------------------------------------
+ *
+ * Name:	ax25_get_pool_stats
+ *
+ * Purpose:	Get a consistent copy of the packet object statistics.
+ *
+ *------------------------------------------------------------------------------*/
+
+void ax25_get_pool_stats (ax25_pkt_class_t size_class, ax25_pool_stats_t *stats)
+{
+	chSysLock();
+	*stats = pool_stats[size_class];
+	chSysUnlock();
+}
+
 #define CLEAR_LAST_ADDR_FLAG  this_p->frame_data[this_p->num_addr*7-1] &= ~ SSID_LAST_MASK
 #define SET_LAST_ADDR_FLAG  this_p->frame_data[this_p->num_addr*7-1] |= SSID_LAST_MASK
 
@@ -220,13 +308,19 @@ int ax25memdebug_seq (packet_t this_p)
  * 
  * Purpose:	Allocate memory for a new packet object.
  *
+ * Inputs:	frame_len	- Frame capacity needed by the packet.
+ *
  * Returns:	Identifier for a new packet object.
  *		In the current implementation this happens to be a pointer.
  *
+ * Description:	The object is taken from the smallest size class
+ *		with capacity for the frame.
+ *
  *------------------------------------------------------------------------------*/
 
-packet_t ax25_new (void) {
+packet_t ax25_new (uint16_t frame_len) {
 	struct TXpacket *this_p;
+	int sc;
 
 
 #if DEBUG 
@@ -235,6 +329,7 @@ packet_t ax25_new (void) {
 
 	last_seq_num++;
 	new_count++;
+	stats_sample(&ax25_stats_live, new_count - delete_count);
 
 /*
  * check for memory leak.
@@ -251,22 +346,62 @@ packet_t ax25_new (void) {
 #endif
 	}
 
+	for (sc = 0; sc < AX25_PKT_CLASSES; sc++) {
+	  if (frame_len <= class_frame_size[sc]) {
+	    break;
+	  }
+	}
+	if (sc == AX25_PKT_CLASSES) {
+	  TRACE_ERROR ("PKT  > Frame length %d too large in ax25_new.", frame_len);
+	  return NULL;
+	}
+
+#if USE_CCM_FOR_PKT_POOL == TRUE
+    /* Use CCM packet pools. */
+	for (this_p = NULL; sc < AX25_PKT_CLASSES; sc++) {
+	  this_p = chPoolAlloc(&packet_pool[sc]);
+	  if (this_p != NULL) {
+	    break;
+	  }
+	  /* Class is empty so try the next larger. */
+	  chSysLock();
+	  pool_stats[sc].fails++;
+	  chSysUnlock();
+	}
+#else
 #if USE_CCM_HEAP_FOR_PKT == TRUE
     /* Use CCM heap. */
     extern memory_heap_t *ccm_heap;
-    this_p = chHeapAlloc(ccm_heap, sizeof (struct TXpacket));
+    this_p = chHeapAlloc(ccm_heap, AX25_PKT_OBJECT_SIZE(class_frame_size[sc]));
 #else /* USE_CCM_HEAP_FOR_PKT != TRUE */
     /* Use system heap. */
-    this_p = chHeapAlloc(NULL, sizeof (struct TXpacket));
+    this_p = chHeapAlloc(NULL, AX25_PKT_OBJECT_SIZE(class_frame_size[sc]));
 #endif /* USE_CCM_HEAP_FOR_PKT == TRUE */
+	if (this_p == NULL) {
+	  chSysLock();
+	  pool_stats[sc].fails++;
+	  chSysUnlock();
+	}
+#endif /* USE_CCM_FOR_PKT_POOL == TRUE */
 
 	if (this_p == NULL) {
 	  TRACE_ERROR ("PKT  > Can't allocate memory in ax25_new.");
       return NULL;
 	}
 
-	memset(this_p, 0, sizeof(struct TXpacket));
+	chSysLock();
+	pool_stats[sc].allocs++;
+	if (++pool_stats[sc].in_use > pool_stats[sc].peak) {
+	  pool_stats[sc].peak = pool_stats[sc].in_use;
+	}
+	chSysUnlock();
+
+	memset(this_p, 0, AX25_PKT_OBJECT_SIZE(class_frame_size[sc]));
 
+	this_p->size_class = sc;
+	this_p->frame_size = class_frame_size[sc];
+	this_p->frame_data = (unsigned char *)(this_p + 1);
+	this_p->refs = 1;
 	this_p->magic1 = MAGIC;
 	this_p->seq = last_seq_num;
 	this_p->magic2 = MAGIC;
@@ -299,6 +434,11 @@ void ax25_delete (packet_t this_p)
 	  return;
 	}
 
+	if (ax25_is_view (this_p)) {
+	  /* A view is released with the buffer holding its frame. */
+	  return;
+	}
+
 
 	delete_count++;
 
@@ -313,12 +453,58 @@ void ax25_delete (packet_t this_p)
 	}
 	
 	this_p->magic1 = 0;
-	this_p->magic1 = 0;
+	this_p->magic2 = 0;
+
+	int sc = this_p->size_class;
+#if USE_CCM_FOR_PKT_POOL == TRUE
+	chPoolFree(&packet_pool[sc], this_p);
+#else
 	chHeapFree(this_p);
+#endif
+
+	chSysLock();
+	pool_stats[sc].in_use--;
+	chSysUnlock();
 }
 
 
 		
+/*------------------------------------------------------------------------------
+ *
+ * Name:	ax25_text_frame_len
+ *
+ * Purpose:	Get the maximum frame length for a packet in monitor format.
+ *
+ * Description:	Each address takes 7 bytes plus control and PID.
+ *		The information part is no longer when converted.
+ *		Reserved bytes are added for data appended by the caller.
+ *
+ *------------------------------------------------------------------------------*/
+
+static uint16_t ax25_text_frame_len (char *monitor, uint16_t reserve)
+{
+	char *pinfo = strchr (monitor, ':');
+	char *p;
+	size_t len;
+	int n = 1;
+
+	if (pinfo == NULL) {
+	  /* Will be rejected when parsed. */
+	  return (AX25_MIN_PACKET_LEN);
+	}
+	for (p = monitor; p < pinfo; p++) {
+	  if (*p == '>' || *p == ',') {
+	    n++;
+	  }
+	}
+	if (n > AX25_MAX_ADDRS) {
+	  n = AX25_MAX_ADDRS;
+	}
+	len = n * AX25_ADDR_LEN + 2 + strlen (pinfo + 1) + reserve;
+	return (len > AX25_MAX_PACKET_LEN) ? AX25_MAX_PACKET_LEN : len;
+}
+
+
 /*------------------------------------------------------------------------------
  *
  * Name:	ax25_from_text
@@ -347,23 +533,35 @@ void ax25_delete (packet_t this_p)
  *			  We can just truncate the name because we will only
  *			  end up discarding it.    TODO:  check on this.
  *
+ *		reserve	- Frame capacity for information appended by the
+ *			  caller after the packet is parsed.
+ *
  * Returns:	Pointer to new packet object in the current implementation.
  *
  * Outputs:	Use the "get" functions to retrieve information in different ways.
  *
  *------------------------------------------------------------------------------*/
 
+/* Size of the copy of the monitor text. */
+#define AX25_TEXT_COPY_SIZE	512
+
 #if AX25MEMDEBUG
-packet_t ax25_from_text_debug (char *monitor, int strict, char *src_file, int src_line)
+packet_t ax25_from_text_reserve_debug (char *monitor, int strict, uint16_t reserve, char *src_file, int src_line)
 #else
-packet_t ax25_from_text (char *monitor, int strict)
+packet_t ax25_from_text_reserve (char *monitor, int strict, uint16_t reserve)
 #endif
 {
 
 /*
  * Tearing it apart is destructive so make our own copy first.
+ * The copies are scratch buffers to keep them off the caller stack.
  */
-	char stuff[512];
+	MEM_SCRATCH(char, stuff, AX25_TEXT_COPY_SIZE);
+	MEM_SCRATCH(char, info_part, AX25_MAX_INFO_LEN+1);
+	if (stuff == NULL || info_part == NULL) {
+      TRACE_ERROR("PKT  > No scratch buffer available");
+	  return NULL;
+	}
 
 	char *pinfo;
 	char *pa;
@@ -372,11 +570,11 @@ packet_t ax25_from_text (char *monitor, int strict)
 	int ssid_temp, heard_temp;
 	char atemp[AX25_MAX_ADDR_LEN];
 
-	char info_part[AX25_MAX_INFO_LEN+1];
 	uint16_t info_len;
 
 	packet_t this_p;
-	msg_t msg = pktGetPacketBuffer(&this_p, TIME_INFINITE);
+	msg_t msg = pktGetPacketBuffer(&this_p, ax25_text_frame_len(monitor, reserve),
+	                               TIME_INFINITE);
 	/* If the semaphore is reset then exit. */
 	if(msg == MSG_RESET || this_p == NULL) {
       TRACE_ERROR("PKT  > No packet buffer available");
@@ -394,7 +592,7 @@ packet_t ax25_from_text (char *monitor, int strict)
 	/* It is possible that will convert <0x00> to a nul character later. */
 	/* There we need to maintain a separate length and not use normal C string functions. */
 
-	strlcpy (stuff, monitor, sizeof(stuff));
+	strlcpy (stuff, monitor, AX25_TEXT_COPY_SIZE);
 
 /*
  * Initialize the packet structure with two addresses and control/pid
@@ -562,7 +760,7 @@ packet_t ax25_from_text (char *monitor, int strict)
  * Append the info part.  
  */
 	/* Check for buffer overflow here. */
-	if((this_p->frame_len + info_len) > AX25_MAX_PACKET_LEN) {
+	if((this_p->frame_len + info_len) > this_p->frame_size) {
 	  TRACE_ERROR ("PKT  > frame buffer overrun");
       pktReleasePacketBuffer(this_p);
       return (NULL);
@@ -574,6 +772,160 @@ packet_t ax25_from_text (char *monitor, int strict)
 }
 
 
+/*------------------------------------------------------------------------------
+ *
+ * Name:	ax25_encode_addr
+ * 
+ * Purpose:	Encode one address straight into the 7 byte frame format.
+ *
+ * Input:	ad	- Address with optional dash and substation id and
+ *			  optional * for a used digipeater.  Not terminated.
+ *
+ *		len	- Length of the address text.
+ *
+ *		flags	- H and last address bits to set.
+ *
+ * Outputs:	out	- 7 bytes of the address field.
+ *
+ * Returns:	True if the address is valid for sending over the air.
+ *
+ *------------------------------------------------------------------------------*/
+
+static bool ax25_encode_addr (unsigned char *out, const char *ad, size_t len, uint8_t flags)
+{
+	size_t i = 0;
+	int ssid = 0;
+
+	memset (out, ' ' << 1, 6);
+	while (i < len && ad[i] != '-' && ad[i] != '*') {
+	  if (i >= 6 || ! (isupper((unsigned char)ad[i]) || isdigit((unsigned char)ad[i]))) {
+	    return (false);
+	  }
+	  out[i] = ad[i] << 1;
+	  i++;
+	}
+	if (i == 0) {
+	  return (false);
+	}
+	if (i < len && ad[i] == '-') {
+	  size_t first = ++i;
+	  while (i < len && isdigit((unsigned char)ad[i]) && i - first < 2) {
+	    ssid = ssid * 10 + ad[i++] - '0';
+	  }
+	  if (i == first || ssid > 15) {
+	    return (false);
+	  }
+	}
+	if (i < len && ad[i] == '*') {
+	  flags |= SSID_H_MASK;
+	  i++;
+	}
+	if (i != len) {
+	  return (false);
+	}
+	out[6] = flags | SSID_RR_MASK | (ssid << SSID_SSID_SHIFT);
+	return (true);
+}
+
+
+/*------------------------------------------------------------------------------
+ *
+ * Name:	ax25_header_build
+ * 
+ * Purpose:	Encode the address, control and PID fields of a UI frame
+ *		so they can be reused by ax25_from_header.
+ *
+ * Input:	source	- Source address.
+ *
+ *		dest	- Destination address.
+ *
+ *		path	- Comma separated digipeater addresses.
+ *			  May be empty.
+ *
+ * Outputs:	hdr	- Encoded header.
+ *
+ * Returns:	True if all addresses are valid.
+ *
+ * Description:	The fields are written directly in binary.  There is no
+ *		monitor text to format and parse and no packet buffer
+ *		is taken.
+ *
+ *------------------------------------------------------------------------------*/
+
+bool ax25_header_build (ax25_header_t *hdr, const char *source, const char *dest, const char *path)
+{
+	int n = AX25_REPEATER_1;
+
+	if (! ax25_encode_addr (hdr->data + AX25_DESTINATION * 7, dest, strlen(dest), SSID_H_MASK)) {
+	  return (false);
+	}
+	if (! ax25_encode_addr (hdr->data + AX25_SOURCE * 7, source, strlen(source), SSID_H_MASK)) {
+	  return (false);
+	}
+	while (path != NULL && *path != '\0') {
+	  const char *end = strchr (path, ',');
+	  size_t len = (end != NULL) ? (size_t)(end - path) : strlen(path);
+	  if (len != 0) {
+	    if (n >= AX25_MAX_ADDRS || ! ax25_encode_addr (hdr->data + n * 7, path, len, 0)) {
+	      return (false);
+	    }
+	    n++;
+	  }
+	  path += (end != NULL) ? len + 1 : len;
+	}
+	hdr->data[n * 7 - 1] |= SSID_LAST_MASK;
+	hdr->data[n * 7] = AX25_UI_FRAME;
+	hdr->data[n * 7 + 1] = AX25_PID_NO_LAYER_3;
+	hdr->num_addr = n;
+	hdr->len = n * 7 + 2;
+	return (true);
+}
+
+
+/*------------------------------------------------------------------------------
+ *
+ * Name:	ax25_from_header
+ * 
+ * Purpose:	Build a frame from a pre-encoded header and information field.
+ *
+ * Input:	hdr	- Header from ax25_header_build.
+ *
+ *		info	- Information field.  Copied as is with no
+ *			  translation of <0xff> sequences.
+ *
+ *		info_len - Length of the information field.
+ *
+ *		reserve	- Frame capacity for information appended by the
+ *			  caller after the packet is built.
+ *
+ * Returns:	Pointer to new packet object or NULL if error.
+ *
+ *------------------------------------------------------------------------------*/
+
+packet_t ax25_from_header (const ax25_header_t *hdr, const unsigned char *info, uint16_t info_len, uint16_t reserve)
+{
+	packet_t this_p;
+	msg_t msg = pktGetPacketBuffer(&this_p, hdr->len + info_len + reserve,
+	                               TIME_INFINITE);
+	/* If the semaphore is reset then exit. */
+	if(msg == MSG_RESET || this_p == NULL) {
+	  TRACE_ERROR("PKT  > No packet buffer available");
+	  return NULL;
+	}
+	if((hdr->len + info_len) > this_p->frame_size) {
+	  TRACE_ERROR ("PKT  > frame buffer overrun");
+	  pktReleasePacketBuffer(this_p);
+	  return (NULL);
+	}
+	memcpy (this_p->frame_data, hdr->data, hdr->len);
+	memcpy (this_p->frame_data + hdr->len, info, info_len);
+	this_p->frame_len = hdr->len + info_len;
+	this_p->num_addr = hdr->num_addr;
+
+	return (this_p);
+}
+
+
 /*------------------------------------------------------------------------------
  *
  * Name:	ax25_from_frame
@@ -627,7 +979,11 @@ packet_t ax25_from_frame (unsigned char *fbuf, uint16_t flen)
 	  return (NULL);
 	}
 
-    msg_t msg = pktGetPacketBuffer(&this_p, TIME_INFINITE);
+    /* Leave room for a digipeater to insert an address. */
+    uint16_t size = flen + AX25_ADDR_LEN;
+    if (size > AX25_MAX_PACKET_LEN)
+      size = AX25_MAX_PACKET_LEN;
+    msg_t msg = pktGetPacketBuffer(&this_p, size, TIME_INFINITE);
     /* If the semaphore is reset then exit. */
     if(msg == MSG_RESET)
       return NULL;
@@ -655,6 +1011,54 @@ packet_t ax25_from_frame (unsigned char *fbuf, uint16_t flen)
 }
 
 
+/*------------------------------------------------------------------------------
+ *
+ * Name:	ax25_view_frame
+ *
+ * Purpose:	Make a read-only packet object over an HDLC frame without copying.
+ *
+ * Inputs:	view	- Object to hold the packet header.
+ *
+ *		fbuf	- Pointer to beginning of frame.
+ *
+ *		flen	- Length excluding the two FCS bytes.
+ *
+ * Returns:	Pointer to the view or NULL if error.
+ *
+ * Description:	The frame must remain valid while the view is used.
+ *		The first FCS byte is replaced by the \0 terminator
+ *		so the FCS must have been checked already.
+ *		The frame can not be extended so use ax25_dup to modify it.
+ *		ax25_delete of a view does nothing.
+ *
+ *------------------------------------------------------------------------------*/
+
+packet_t ax25_view_frame (packet_gen_t *view, unsigned char *fbuf, uint16_t flen)
+{
+	if (AX25_MIN_PACKET_LEN > flen || flen >= AX25_MAX_PACKET_LEN)
+	{
+	  TRACE_ERROR ("PKT  > Frame length %d not in allowable range of %d to %d.", flen, AX25_MIN_PACKET_LEN, AX25_MAX_PACKET_LEN);
+	  return (NULL);
+	}
+
+	memset(view, 0, sizeof(packet_gen_t));
+	view->magic1 = MAGIC;
+	view->magic2 = MAGIC;
+	view->size_class = AX25_PKT_VIEW;
+	view->frame_size = flen;
+	view->frame_data = fbuf;
+	view->frame_data[flen] = 0;
+	view->frame_len = flen;
+
+/* Find number of addresses. */
+
+	view->num_addr = (-1);
+	(void) ax25_get_num_addr (view);
+
+	return (view);
+}
+
+
 /*------------------------------------------------------------------------------
  *
  * Name:	ax25_dup
@@ -676,9 +1080,15 @@ packet_t ax25_dup (packet_t copy_from)
 #endif
 {
 	int save_seq;
+	uint8_t save_class;
+	uint16_t save_size;
 	packet_t this_p;
 
-	msg_t msg = pktGetPacketBuffer(&this_p, TIME_INFINITE);
+	/* The copy is usually made to digipeat so leave room to insert an address. */
+	uint16_t size = copy_from->frame_len + AX25_ADDR_LEN;
+	if (size > AX25_MAX_PACKET_LEN)
+	  size = AX25_MAX_PACKET_LEN;
+	msg_t msg = pktGetPacketBuffer(&this_p, size, TIME_INFINITE);
     /* If the semaphore is reset then exit. */
     if(msg == MSG_RESET)
       return NULL;
@@ -686,9 +1096,18 @@ packet_t ax25_dup (packet_t copy_from)
 		return NULL;
 
 	save_seq = this_p->seq;
+	save_class = this_p->size_class;
+	save_size = this_p->frame_size;
 
 	memcpy (this_p, copy_from, sizeof (struct TXpacket));
 	this_p->seq = save_seq;
+	this_p->size_class = save_class;
+	this_p->frame_size = save_size;
+	this_p->frame_data = (unsigned char *)(this_p + 1);
+	this_p->refs = 1;
+	this_p->submitted = 0;
+	this_p->nextp = NULL;
+	memcpy (this_p->frame_data, copy_from->frame_data, copy_from->frame_len + 1);
 
 #if AX25MEMDEBUG
 	if (ax25memdebug) {	
@@ -701,6 +1120,83 @@ packet_t ax25_dup (packet_t copy_from)
 }
 
 
+/*------------------------------------------------------------------------------
+ *
+ * Name:	ax25_ref
+ *
+ * Purpose:	Add a holder of a packet object.
+ *
+ * Returns:	The packet object.
+ *
+ * Description:	Each holder releases the packet with pktReleasePacketBuffer.
+ *		The object is freed by the last release.
+ *		A view can not be held.
+ *
+ *------------------------------------------------------------------------------*/
+
+packet_t ax25_ref (packet_t this_p)
+{
+	chDbgAssert(!ax25_is_view(this_p), "reference to a view");
+	chSysLock();
+	this_p->refs++;
+	chSysUnlock();
+	return (this_p);
+}
+
+
+/*------------------------------------------------------------------------------
+ *
+ * Name:	ax25_unref
+ *
+ * Purpose:	Remove a holder of a packet object.
+ *
+ * Returns:	true if this was the last holder and the object can be freed.
+ *
+ *------------------------------------------------------------------------------*/
+
+bool ax25_unref (packet_t this_p)
+{
+	chSysLock();
+	bool last = (this_p->refs <= 1);
+	if (!last) {
+	  this_p->refs--;
+	}
+	chSysUnlock();
+	return (last);
+}
+
+
+/*------------------------------------------------------------------------------
+ *
+ * Name:	ax25_cow
+ *
+ * Purpose:	Get a packet object which can be modified in place of another.
+ *
+ * Inputs:	this_p	- Existing packet object.
+ *
+ *		extra	- Bytes the frame may grow by (inserted addresses).
+ *
+ * Returns:	The packet object itself with another holder if the caller
+ *		is its only holder and it has room for extra bytes.
+ *		Otherwise a copy made by ax25_dup.  NULL if no copy was made.
+ *
+ * Description:	The existing packet must not be used after the call other
+ *		than to release it.  A view is always copied since the
+ *		receive buffer holding its frame is not kept.
+ *
+ *------------------------------------------------------------------------------*/
+
+packet_t ax25_cow (packet_t this_p, uint16_t extra)
+{
+	if (!ax25_is_view(this_p) && this_p->refs == 1
+	    && this_p->nextp == NULL
+	    && this_p->frame_len + extra <= this_p->frame_size) {
+	  return (ax25_ref(this_p));
+	}
+	return (ax25_dup(this_p));
+}
+
+
 /*------------------------------------------------------------------------------
  *
  * Name:	ax25_parse_addr
@@ -1043,6 +1539,11 @@ void ax25_insert_addr (packet_t this_p, int n, char *ad)
 	  return;
 	}
 
+	if (this_p->frame_len + AX25_ADDR_LEN > this_p->frame_size) {
+	  TRACE_ERROR("PKT  > No room to insert address");
+	  return;
+	}
+
 	CLEAR_LAST_ADDR_FLAG;
 
 	this_p->num_addr++;
@@ -1293,6 +1794,131 @@ void ax25_get_addr_with_ssid (packet_t this_p, int n, char *station)
 } /* end ax25_get_addr_with_ssid */
 
 
+/*------------------------------------------------------------------------------
+ *
+ * Name:	ax25_get_addr_key
+ *
+ * Purpose:	Return specified address in packed form for comparison.
+ *
+ * Inputs:	n	- Index of address.   Use the symbols
+ *			  AX25_DESTINATION, AX25_SOURCE, AX25_REPEATER1, etc.
+ *
+ * Returns:	Key of the address (see ax25_addr_key_t).
+ *		0 if there is no such address.  No address has key 0.
+ *
+ * Description:	The address is not formatted as text so this is the
+ *		way to compare addresses of received frames.
+ *
+ *------------------------------------------------------------------------------*/
+
+ax25_addr_key_t ax25_get_addr_key (packet_t this_p, int n)
+{
+	if (n < 0 || n >= this_p->num_addr) {
+	  return (0);
+	}
+
+	const unsigned char *addr = this_p->frame_data + n * AX25_ADDR_LEN;
+	ax25_addr_key_t key = (addr[6] & SSID_SSID_MASK) >> SSID_SSID_SHIFT;
+	int i;
+
+	for (i = 0; i < 6; i++) {
+	  key = (key << 8) | (addr[i] & 0xFE);
+	}
+	return (key);
+}
+
+
+/*------------------------------------------------------------------------------
+ *
+ * Name:	ax25_addr_key_from_text
+ *
+ * Purpose:	Pack an address given as text.
+ *
+ * Inputs:	addr	- Callsign with optional SSID, e.g. "WB2OSZ-15".
+ *
+ * Outputs:	key	- Key of the address as ax25_get_addr_key returns it
+ *			  for the same address in a frame.
+ *
+ * Returns:	True if the address has 1 to 6 characters and an SSID
+ *		of 0 to 15.
+ *
+ *------------------------------------------------------------------------------*/
+
+bool ax25_addr_key_from_text (const char *addr, ax25_addr_key_t *key)
+{
+	ax25_addr_key_t k = 0;
+	int i;
+
+	for (i = 0; i < 6 && addr[i] != '\0' && addr[i] != '-'; i++) {
+	  k |= AX25_KEY_CHAR(addr[i], i);
+	}
+	if (i == 0) {
+	  return (false);
+	}
+	for (; i < 6; i++) {
+	  k |= AX25_KEY_CHAR(' ', i);
+	}
+
+	const char *s = strchr (addr, '-');
+	if (s == NULL) {
+	  if (strlen (addr) > 6) {
+	    return (false);
+	  }
+	}
+	else {
+	  char *end;
+	  long ssid = strtol (s + 1, &end, 10);
+	  if (s - addr > 6 || end == s + 1 || *end != '\0' || ssid < 0 || ssid > 15) {
+	    return (false);
+	  }
+	  k |= (ax25_addr_key_t)ssid << 48;
+	}
+	*key = k;
+	return (true);
+}
+
+
+/*------------------------------------------------------------------------------
+ *
+ * Name:	ax25_addr_match_init
+ *
+ * Purpose:	Set up a match of an address or a callsign prefix.
+ *
+ * Inputs:	addr	- Callsign with optional SSID or a prefix.
+ *
+ *		prefix	- True to match callsigns starting with addr
+ *			  with any SSID, e.g. "WIDE" or "TRACE".
+ *
+ * Outputs:	match	- Match for ax25_addr_match.
+ *
+ * Returns:	True if addr is valid.  An invalid addr matches nothing.
+ *
+ *------------------------------------------------------------------------------*/
+
+bool ax25_addr_match_init (ax25_addr_match_t *match, const char *addr, bool prefix)
+{
+	/* Bits outside the mask so nothing matches. */
+	match->key = ~(ax25_addr_key_t)0;
+	match->mask = AX25_KEY_ALL_MASK;
+	if (!prefix) {
+	  return (ax25_addr_key_from_text (addr, &match->key));
+	}
+
+	size_t len = strlen (addr);
+	if (len == 0 || len > 6) {
+	  return (false);
+	}
+	ax25_addr_key_t key = 0;
+	size_t i;
+	for (i = 0; i < len; i++) {
+	  key |= AX25_KEY_CHAR(addr[i], i);
+	}
+	match->key = key;
+	match->mask = AX25_KEY_PREFIX_MASK(len);
+	return (true);
+}
+
+
 /*------------------------------------------------------------------------------
  *
  * Name:	ax25_get_addr_no_ssid
@@ -1790,6 +2416,28 @@ packet_t ax25_get_nextp (packet_t this_p)
 }
 
 
+/*------------------------------------------------------------------------------
+ *
+ * Name:	ax25_set_link
+ *
+ * Purpose:	Set the link framing of a packet and those queued after it.
+ *
+ * Inputs:	this_p		- First packet object.
+ *
+ *		link		- Framing as link_type_t.
+ *
+ * Description:	Frames are sent as AX.25 HDLC unless another framing is set.
+ *
+ *------------------------------------------------------------------------------*/
+
+void ax25_set_link (packet_t this_p, uint8_t link)
+{
+	for (; this_p != NULL; this_p = this_p->nextp) {
+	  this_p->link = link;
+	}
+}
+
+
 /*------------------------------------------------------------------------------
  *
  * Name:	ax25_set_release_time
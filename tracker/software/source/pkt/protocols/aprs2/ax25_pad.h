@@ -73,11 +73,19 @@
 #define AX25_PID_NO_LAYER_3 0xF0		/* protocol ID used for APRS */
 #define AX25_PID_SEGMENTATION_FRAGMENT 0x08
 #define AX25_PID_ESCAPE_CHARACTER 0xFF
+#define AX25_PID_SSDV_BINARY 0xF1		/* raw SSDV payload in a UI frame (not APRS) */
 
 #define AX25_MAX_APRS_MSG_LEN   67
 
 #define USE_CCM_HEAP_FOR_PKT    TRUE
 
+/* Allocate packet objects from a fixed block pool in CCM. */
+#define USE_CCM_FOR_PKT_POOL    TRUE
+
+/* Frame capacity of the smaller packet object size classes. */
+#define AX25_SMALL_PACKET_LEN   128U
+#define AX25_MEDIUM_PACKET_LEN  320U
+
 #include "pkttypes.h"
 
 typedef struct TXpacket {
@@ -85,9 +93,24 @@ typedef struct TXpacket {
     /* for error checking. */
 	int magic1;
 
+    /* Size class of the object and capacity of frame_data. */
+    /* A view is not allocated and has capacity only for its frame. */
+	uint8_t size_class;
+	uint16_t frame_size;
+
+    /* Holders of the object. It is freed when the last releases it. */
+    /* Zero for a view. */
+	uint8_t refs;
+
+    /* Link framing (link_type_t). AX.25 HDLC unless set by the sender. */
+	uint8_t link;
+
     /* unique sequence number for debugging. */
 	int seq;
 
+    /* Time the packet was posted to the radio, zero if not sent. */
+	systime_t submitted;
+
     /* Time stamp in format returned by dtime_now(). */
     /* When to release from the SATgate mode delay queue. */
 	//double release_time;
@@ -147,11 +170,13 @@ typedef struct TXpacket {
     /* For I & S frames:    8 or 128 if known.  0 if unknown. */
 	int         modulo;
 
-    /* Raw frame contents, without the CRC plus one byte if \0 appended. */
-	unsigned char frame_data[AX25_MAX_PACKET_LEN + 1];
-
-    /* Will get stomped on if above overflows. */
+    /* Will get stomped on if the header is overwritten. */
 	int magic2;
+
+    /* Raw frame contents, without the CRC plus one byte if \0 appended. */
+    /* Points to frame_size + 1 bytes following the object. */
+    /* For a view it points to the frame in a receive buffer. */
+	unsigned char *frame_data;
 } packet_gen_t;
 
 /*
@@ -161,9 +186,95 @@ typedef struct TXpacket {
  */
 typedef struct TXpacket *packet_t;
 
+/*
+ * Packet object size classes.
+ * An object is taken from the smallest class which holds the frame.
+ */
+typedef enum ax25_pkt_class_e {
+	AX25_PKT_SMALL = 0,
+	AX25_PKT_MEDIUM,
+	AX25_PKT_MAX,
+	AX25_PKT_CLASSES,
+	AX25_PKT_VIEW		/* Read-only view of a frame held elsewhere. */
+} ax25_pkt_class_t;
+
+/*
+ * Packet object allocation statistics for a size class.
+ * The size is zero if objects are allocated from a heap.
+ */
+typedef struct {
+	uint16_t frame_size;	/* Frame capacity of objects in the class. */
+	uint16_t size;		/* Objects in the pool. */
+	uint16_t in_use;	/* Objects currently allocated. */
+	uint16_t peak;		/* High-water mark of objects allocated. */
+	uint32_t allocs;	/* Total allocations. */
+	uint32_t fails;		/* Allocations which found no free object in the class. */
+} ax25_pool_stats_t;
+
+extern void ax25_pool_init (void);
+extern packet_t ax25_view_frame (packet_gen_t *view, unsigned char *fbuf, uint16_t flen);
+
+static inline bool ax25_is_view (packet_t this_p)
+{
+	return (this_p->size_class == AX25_PKT_VIEW);
+}
+extern void ax25_get_pool_stats (ax25_pkt_class_t size_class, ax25_pool_stats_t *stats);
+
+extern packet_t ax25_ref (packet_t this_p);
+extern bool ax25_unref (packet_t this_p);
+extern packet_t ax25_cow (packet_t this_p, uint16_t extra);
+
+/*
+ * Pre-encoded address, control and PID fields of a frame.
+ * Built once and reused for frames which differ only in the
+ * information field.
+ */
+typedef struct {
+	uint8_t num_addr;
+	uint8_t len;		/* Offset of the information field. */
+	unsigned char data[AX25_MAX_ADDRS * AX25_ADDR_LEN + 2];
+} ax25_header_t;
+
+extern bool ax25_header_build (ax25_header_t *hdr, const char *source, const char *dest, const char *path);
+extern packet_t ax25_from_header (const ax25_header_t *hdr, const unsigned char *info, uint16_t info_len, uint16_t reserve);
+
+/*
+ * Packed form of an address for comparison without formatting text.
+ * The six callsign bytes as sent (character shifted left one bit) are in
+ * bits 47-0 with the first character highest.  The SSID is in bits 51-48.
+ * The H, reserved and last address bits are not included.
+ */
+typedef uint64_t ax25_addr_key_t;
+
+#define AX25_KEY_CALL_MASK	0x0000FFFFFFFFFFFFULL
+#define AX25_KEY_ALL_MASK	0x000FFFFFFFFFFFFFULL
+
+/* Key bits of character c at position i of the callsign. */
+#define AX25_KEY_CHAR(c, i)	((ax25_addr_key_t)((uint8_t)(c) << 1) << (8 * (5 - (i))))
+
+/* Mask of the first n characters of the callsign. */
+#define AX25_KEY_PREFIX_MASK(n)	((((ax25_addr_key_t)1 << (8 * (n))) - 1) << (8 * (6 - (n))))
+
+/*
+ * Address or callsign prefix to match with ax25_addr_match.
+ */
+typedef struct {
+	ax25_addr_key_t key;
+	ax25_addr_key_t mask;
+} ax25_addr_match_t;
+
+extern ax25_addr_key_t ax25_get_addr_key (packet_t this_p, int n);
+extern bool ax25_addr_key_from_text (const char *addr, ax25_addr_key_t *key);
+extern bool ax25_addr_match_init (ax25_addr_match_t *match, const char *addr, bool prefix);
+
+static inline bool ax25_addr_match (const ax25_addr_match_t *match, ax25_addr_key_t key)
+{
+	return ((key & match->mask) == match->key);
+}
+
 typedef enum cmdres_e { cr_00 = 2, cr_cmd = 1, cr_res = 0, cr_11 = 3 } cmdres_t;
 
-extern packet_t ax25_new (void);
+extern packet_t ax25_new (uint16_t frame_len);
 
 
 /*
@@ -325,8 +436,8 @@ extern int ax25memdebug_get (void);
 extern int ax25memdebug_seq (packet_t this_p);
 
 
-extern packet_t ax25_from_text_debug (char *monitor, int strict, char *src_file, int src_line);
-#define ax25_from_text(m,s) ax25_from_text_debug(m,s,__FILE__,__LINE__)
+extern packet_t ax25_from_text_reserve_debug (char *monitor, int strict, uint16_t reserve, char *src_file, int src_line);
+#define ax25_from_text_reserve(m,s,r) ax25_from_text_reserve_debug(m,s,r,__FILE__,__LINE__)
 
 extern packet_t ax25_from_frame_debug (unsigned char *data, int len, char *src_file, int src_line);
 #define ax25_from_frame(d,l,a) ax25_from_frame_debug(d,l,a,__FILE__,__LINE__);
@@ -339,7 +450,7 @@ extern void ax25_delete_debug (packet_t pp, char *src_file, int src_line);
 
 #else
 
-extern packet_t ax25_from_text (char *monitor, int strict);
+extern packet_t ax25_from_text_reserve (char *monitor, int strict, uint16_t reserve);
 
 extern packet_t ax25_from_frame (unsigned char *data, uint16_t len);
 
@@ -348,11 +459,15 @@ extern packet_t ax25_dup (packet_t copy_from);
 extern void ax25_delete (packet_t pp);
 
 
-extern msg_t pktGetPacketBuffer(packet_t *pp, sysinterval_t timeout);
+extern msg_t pktGetPacketBuffer(packet_t *pp, uint16_t frame_len,
+                                sysinterval_t timeout);
 extern void pktReleasePacketBuffer(packet_t pp);
 
 #endif
 
+/* Parse a monitor format packet. */
+#define ax25_from_text(m,s) ax25_from_text_reserve(m,s,0)
+
 
 
 
@@ -393,6 +508,8 @@ extern int ax25_get_dti (packet_t this_p);
 
 extern packet_t ax25_get_nextp (packet_t this_p);
 
+extern void ax25_set_link (packet_t this_p, uint8_t link);
+
 extern void ax25_set_release_time (packet_t this_p, double release_time);
 extern double ax25_get_release_time (packet_t this_p);
 
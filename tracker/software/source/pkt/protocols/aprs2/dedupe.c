@@ -80,6 +80,8 @@
  *
  *		Typically, only a checksum is kept to reduce memory 
  *		requirements and amount of compution for comparisons.
+ *		The checksum and channel index an open addressed hash
+ *		table so a check does not scan every record.
  *		There is a very very small probability that two unrelated 
  *		packets will result in the same checksum, and the
  *		undesired dropping of the packet.
@@ -127,31 +129,70 @@
  /* Number of seconds to keep history information */
 static sysinterval_t history_time;
 
-#define HISTORY_MAX 25			/* Maximum number of transmission */
-					/* records to keep.  If we run out of */
-					/* room the oldest ones are overwritten */
-					/* before they expire. */
+#define HISTORY_MASK (DEDUPE_TABLE_SIZE - 1)
+
+#if (DEDUPE_TABLE_SIZE & HISTORY_MASK) != 0
+#error "DEDUPE_TABLE_SIZE must be a power of 2"
+#endif
 
-static int insert_next;			/* Index, in array below, where next */
-					/* item should be stored. */
-					
 static struct {
 
-	sysinterval_t time_stamp;		/* When the packet was transmitted. */
+	systime_t expiry;		/* When the record expires. */
 
 	unsigned short checksum;	/* Some sort of checksum for the */
 					/* source, destination, and information. */
 					/* is is not used anywhere else. */
 
-	short xmit_channel;		/* Radio channel number. */
+	bool used;			/* Slot holds a record. Expired records */
+					/* are removed when an insert passes. */
+
+	int xmit_channel;		/* Radio channel number. */
+
+} history[DEDUPE_TABLE_SIZE];
+
+/* The digipeater may run from more than one receive thread. */
+static MUTEX_DECL(history_mtx);
+
+
+static int dedupe_home (unsigned short crc, int chan) {
+	return (crc ^ ((unsigned)chan * 40503u)) & HISTORY_MASK;
+}
 
-} history[HISTORY_MAX];
+static bool dedupe_expired (int j) {
+	return !chVTIsSystemTimeWithinX(history[j].expiry - history_time,
+	                                history[j].expiry);
+}
+
+/*
+ * Remove a record. Later records of the probe sequence are shifted
+ * back so a lookup can stop at the first unused slot.
+ */
+static void dedupe_delete (int i) {
+	int j = i;
+	int n;
+
+	for (n=1; n<DEDUPE_TABLE_SIZE; n++) {
+	  j = (j + 1) & HISTORY_MASK;
+	  if (!history[j].used) {
+	    break;
+	  }
+	  int k = dedupe_home(history[j].checksum, history[j].xmit_channel);
+	  /* The record stays if its home is cyclically in (i, j]. */
+	  if (i <= j ? (i < k && k <= j) : (i < k || k <= j)) {
+	    continue;
+	  }
+	  history[i] = history[j];
+	  i = j;
+	}
+	history[i].used = false;
+}
 
 
 void dedupe_init (sysinterval_t ttl) {
+	chMtxLock(&history_mtx);
 	history_time = ttl;
-	insert_next = 0;
 	memset (history, 0, sizeof(history));
+	chMtxUnlock(&history_mtx);
 }
 
 
@@ -192,15 +233,42 @@ void dedupe_init (sysinterval_t ttl) {
  *------------------------------------------------------------------------------*/
 
 void dedupe_remember (packet_t pp, int chan) {
-	history[insert_next].time_stamp = chVTGetSystemTime();
-	history[insert_next].checksum = ax25_dedupe_crc(pp);
-	history[insert_next].xmit_channel = chan;
+	unsigned short crc = ax25_dedupe_crc(pp);
+	int j = dedupe_home(crc, chan);
+	int oldest = j;
+	int n;
 
-	insert_next++;
-	if (insert_next >= HISTORY_MAX) {
-	  insert_next = 0;
+	chMtxLock(&history_mtx);
+	for (n=0; n<DEDUPE_TABLE_SIZE; n++) {
+	  if (!history[j].used) {
+	    break;
+	  }
+	  if (dedupe_expired(j)) {
+	    /* Another record may be shifted into this slot. */
+	    dedupe_delete(j);
+	    continue;
+	  }
+	  if (history[j].checksum == crc && history[j].xmit_channel == chan) {
+	    break;
+	  }
+	  if (chTimeDiffX(history[oldest].expiry, history[j].expiry) > history_time) {
+	    oldest = j;		/* Expires earlier. */
+	  }
+	  j = (j + 1) & HISTORY_MASK;
+	}
+
+	/* If we run out of room the oldest record is overwritten */
+	/* before it expires. */
+	if (n >= DEDUPE_TABLE_SIZE) {
+	  j = oldest;
 	}
 
+	history[j].expiry = chTimeAddX(chVTGetSystemTime(), history_time);
+	history[j].checksum = crc;
+	history[j].xmit_channel = chan;
+	history[j].used = true;
+	chMtxUnlock(&history_mtx);
+
 	/* If we send something by digipeater, we don't */
 	/* want to do it again if it comes from APRS-IS. */
 	/* Not sure about the other way around. */
@@ -224,17 +292,22 @@ void dedupe_remember (packet_t pp, int chan) {
 
 int dedupe_check (packet_t pp, int chan) {
 	unsigned short crc = ax25_dedupe_crc(pp);
-	///sysinterval_t now = chVTGetSystemTime();
-	int j;
-
-	for (j=0; j<HISTORY_MAX; j++) {
-	  if (chVTTimeElapsedSinceX(history[j].time_stamp) > history_time &&
-	      history[j].checksum == crc && 
-	      history[j].xmit_channel == chan) {
-	    return 1;
+	int j = dedupe_home(crc, chan);
+	int n;
+	int found = 0;
+
+	chMtxLock(&history_mtx);
+	for (n=0; n<DEDUPE_TABLE_SIZE && history[j].used; n++) {
+	  if (history[j].checksum == crc &&
+	      history[j].xmit_channel == chan &&
+	      !dedupe_expired(j)) {
+	    found = 1;
+	    break;
 	  }
+	  j = (j + 1) & HISTORY_MASK;
 	}
-	return 0;
+	chMtxUnlock(&history_mtx);
+	return found;
 }
 
 
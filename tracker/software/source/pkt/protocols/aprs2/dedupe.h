@@ -4,6 +4,11 @@
 #include "ch.h"
 #include "hal.h"
 
+/* Records of recent transmissions. Must be a power of 2. */
+#ifndef DEDUPE_TABLE_SIZE
+#define DEDUPE_TABLE_SIZE	128
+#endif
+
 void dedupe_init(sysinterval_t ttl);
 void dedupe_remember(packet_t pp, int chan);
 int dedupe_check(packet_t pp, int chan);
@@ -73,6 +73,141 @@
 
 
 
+/*------------------------------------------------------------------------------
+ *
+ * Name:	digipeat_compile
+ * 
+ * Purpose:	Compile an address pattern for matching without the
+ *		regex engine.
+ *
+ * Input:	dp		- Pattern object to set up.
+ *
+ *		pattern		- Pattern string.  Must stay valid as it is
+ *				  used by the crx fallback.
+ *
+ * Returns:	True if the pattern was compiled.
+ *		False if the pattern is matched by the crx engine.
+ *
+ * Description:	Alternatives separated by '|' are made of literal
+ *		characters, '.' and sets like '[1-7]' or '[^0]'.
+ *		Each alternative matches a whole address with SSID,
+ *		e.g. "WIDE[1-7]-[1-7]" matches "WIDE2-1".
+ *		Every position of the address holds a bit for each
+ *		alternative which accepts the character there.  The
+ *		address is matched in one pass without backtracking.
+ *
+ *------------------------------------------------------------------------------*/
+
+bool digipeat_compile (digi_pattern_t *dp, char *pattern) {
+	char *p = pattern;
+	int alt = 0;
+	int pos = 0;
+
+	memset (dp, 0, sizeof(digi_pattern_t));
+	dp->source = pattern;
+
+	while (true) {
+	  uint64_t set = 0;
+
+	  if (*p == '|' || *p == '\0') {
+	    if (pos == 0) {
+	      return false;		/* Empty alternative. */
+	    }
+	    dp->len_alts[pos] |= 1 << alt;
+	    if (*p == '\0') {
+	      break;
+	    }
+	    if (++alt >= DIGI_PATTERN_ALTS) {
+	      return false;
+	    }
+	    pos = 0;
+	    p++;
+	    continue;
+	  }
+
+	  if (pos >= AX25_MAX_ADDR_LEN - 1) {
+	    return false;
+	  }
+
+	  if (*p == '.') {
+	    set = ~(uint64_t)0;
+	    p++;
+	  }
+	  else if (*p == '[') {
+	    bool invert = (p[1] == '^');
+	    p += invert ? 2 : 1;
+	    while (*p != ']') {
+	      unsigned from = (unsigned char)p[0] - 0x20u;
+	      unsigned to = from;
+	      if (*p == '\0' || *p == '\\' || from >= DIGI_PATTERN_CHARS) {
+	        return false;
+	      }
+	      if (p[1] == '-' && p[2] != ']' && p[2] != '\0') {
+	        to = (unsigned char)p[2] - 0x20u;
+	        if (p[2] == '\\' || to >= DIGI_PATTERN_CHARS) {
+	          return false;
+	        }
+	        p += 2;
+	      }
+	      for (; from <= to; from++) {
+	        set |= (uint64_t)1 << from;
+	      }
+	      p++;
+	    }
+	    if (invert) {
+	      set = ~set;
+	    }
+	    p++;
+	  }
+	  else if (strchr("()]{}*+?\\", *p) != NULL ||
+	           (unsigned char)*p - 0x20u >= DIGI_PATTERN_CHARS) {
+	    return false;		/* Left to the crx engine. */
+	  }
+	  else {
+	    set = (uint64_t)1 << ((unsigned char)*p - 0x20u);
+	    p++;
+	  }
+
+	  for (int c = 0; c < DIGI_PATTERN_CHARS; c++) {
+	    if (set & ((uint64_t)1 << c)) {
+	      dp->pos_alts[pos][c] |= 1 << alt;
+	    }
+	  }
+	  pos++;
+	}
+
+	dp->compiled = true;
+	return true;
+}
+
+
+/*
+ * Match an address against a pattern.
+ */
+static bool digipeat_pattern_match (digi_pattern_t *dp, char *addr) {
+	if (!dp->compiled) {
+	  int found_len;
+	  regex(dp->source, addr, &found_len);
+	  return found_len != 0;
+	}
+
+	uint8_t alts = (1 << DIGI_PATTERN_ALTS) - 1;
+	int pos;
+
+	for (pos = 0; addr[pos] != '\0'; pos++) {
+	  unsigned c = (unsigned char)addr[pos] - 0x20u;
+	  if (pos >= AX25_MAX_ADDR_LEN - 1 || c >= DIGI_PATTERN_CHARS) {
+	    return false;
+	  }
+	  alts &= dp->pos_alts[pos][c];
+	  if (alts == 0) {
+	    return false;
+	  }
+	}
+	return (alts & dp->len_alts[pos]) != 0;
+}
+
+
 /*------------------------------------------------------------------------------
  *
  * Name:	digipeat_match
@@ -92,6 +227,7 @@
  *
  *		alias		- Compiled pattern for my station aliases or 
  *				  "trapping" (repeating only once).
+ *				  See digipeat_compile().
  *
  *		wide		- Compiled pattern for normal WIDEn-n digipeating.
  *
@@ -104,9 +240,12 @@
  *		filter_str	- Filter expression string or NULL.
  *		
  * Returns:	Packet object for transmission or NULL.
- *		The original packet is not modified.  (with one exception, probably obsolete)
- *		We make a copy and return that modified copy!
- *		This is very important because we could digipeat from one channel to many.
+ *		A view or a packet with other holders is not modified.
+ *		We make a copy and return that modified copy.
+ *		A packet held only by the caller is modified in place
+ *		and returned with another holder (see ax25_cow) so the
+ *		caller must only release it.  To digipeat from one channel
+ *		to many hold the packet with ax25_ref so each gets a copy.
  *
  * Description:	The packet will be digipeated if the next unused digipeater
  *		field matches one of the following:
@@ -119,17 +258,17 @@
 				  
 
 packet_t digipeat_match (int from_chan, packet_t pp, char *mycall_rec,
-                         char *mycall_xmit, char *alias, char *wide,
+                         char *mycall_xmit, digi_pattern_t *alias,
+                         digi_pattern_t *wide,
                          int to_chan, enum preempt_e preempt,
                          char *filter_str) {
 	(void)from_chan;
 	(void)filter_str;
 
-	char source[AX25_MAX_ADDR_LEN];
+	ax25_addr_key_t mycall;
 	int ssid;
 	int r;
 	char repeater[AX25_MAX_ADDR_LEN];
-	int found_len;
 
 
 
@@ -144,7 +283,12 @@ packet_t digipeat_match (int from_chan, packet_t pp, char *mycall_rec,
 	  return (NULL);
 	}
 
-	ax25_get_addr_with_ssid(pp, r, repeater);
+/*
+ * My call is compared in packed form.  An invalid call matches nothing.
+ */
+	if (!ax25_addr_key_from_text(mycall_rec, &mycall)) {
+	  mycall = ~(ax25_addr_key_t)0;
+	}
 	ssid = ax25_get_ssid(pp, r);
 
 
@@ -158,10 +302,10 @@ packet_t digipeat_match (int from_chan, packet_t pp, char *mycall_rec,
  * correctly.  I would expect it only for testing purposes.
  */
 	
-	if (strcmp(repeater, mycall_rec) == 0) {
+	if (ax25_get_addr_key(pp, r) == mycall) {
 	  packet_t result;
 
-	  result = ax25_dup (pp);
+	  result = ax25_cow (pp, 0);
 	  if(result == NULL)
         return NULL;
 
@@ -177,8 +321,7 @@ packet_t digipeat_match (int from_chan, packet_t pp, char *mycall_rec,
  * Alternatively we might feed everything transmitted into
  * dedupe_remember rather than only frames out of digipeater.
  */
-	ax25_get_addr_with_ssid(pp, AX25_SOURCE, source);
-	if (strcmp(source, mycall_rec) == 0) {
+	if (ax25_get_addr_key(pp, AX25_SOURCE) == mycall) {
 	  return (NULL);
 	}
 
@@ -215,11 +358,11 @@ packet_t digipeat_match (int from_chan, packet_t pp, char *mycall_rec,
  * My call should be an implied member of this set.
  * In this implementation, we already caught it further up.
  */
-	regex(alias, repeater, &found_len);
-	if(found_len) {
+	ax25_get_addr_with_ssid(pp, r, repeater);
+	if (digipeat_pattern_match(alias, repeater)) {
 	  packet_t result;
 
-	  result = ax25_dup (pp);
+	  result = ax25_cow (pp, 0);
       if(result == NULL)
         return NULL;
 
@@ -238,16 +381,15 @@ packet_t digipeat_match (int from_chan, packet_t pp, char *mycall_rec,
 
 	  for (r2 = r+1; r2 < ax25_get_num_addr(pp); r2++) {
 	    char repeater2[AX25_MAX_ADDR_LEN];
+	    bool mine = (ax25_get_addr_key(pp, r2) == mycall);
 
-	    ax25_get_addr_with_ssid(pp, r2, repeater2);
-
-		regex(alias, repeater2, &found_len);
-
-	    if (strcmp(repeater2, mycall_rec) == 0 ||
-	      found_len != 0) {
+	    if (!mine) {
+	      ax25_get_addr_with_ssid(pp, r2, repeater2);
+	    }
+	    if (mine || digipeat_pattern_match(alias, repeater2)) {
 	      packet_t result;
 
-	      result = ax25_dup (pp);
+	      result = ax25_cow (pp, 0);
           if(result == NULL)
             return NULL;
 
@@ -287,8 +429,7 @@ packet_t digipeat_match (int from_chan, packet_t pp, char *mycall_rec,
 /*
  * For the wide pattern, we check the ssid and decrement it.
  */
-	regex(wide, repeater, &found_len);
-	if (found_len != 0) {
+	if (digipeat_pattern_match(wide, repeater)) {
 
 /*
  * If ssid == 1, we simply replace the repeater with my call and
@@ -303,7 +444,7 @@ packet_t digipeat_match (int from_chan, packet_t pp, char *mycall_rec,
 	  if (ssid == 1) {
 	    packet_t result;
 
-	    result = ax25_dup (pp);
+	    result = ax25_cow (pp, 0);
         if(result == NULL)
           return NULL;
 
@@ -315,7 +456,7 @@ packet_t digipeat_match (int from_chan, packet_t pp, char *mycall_rec,
 	  if (ssid >= 2 && ssid <= 7) {
 	    packet_t result;
 
-	    result = ax25_dup (pp);
+	    result = ax25_cow (pp, AX25_ADDR_LEN);
         if(result == NULL)
           return NULL;
 
@@ -7,7 +7,25 @@
 
 
 enum preempt_e { PREEMPT_OFF, PREEMPT_DROP, PREEMPT_MARK, PREEMPT_TRACE };
-packet_t digipeat_match (int from_chan, packet_t pp, char *mycall_rec, char *mycall_xmit, char *alias, char *wide, int to_chan, enum preempt_e preempt, char *filter_str);
+
+#define DIGI_PATTERN_ALTS	8	/* Alternatives of a compiled pattern */
+#define DIGI_PATTERN_CHARS	64	/* Characters 0x20 to 0x5F */
+
+/*
+ * Address pattern compiled for whole address matching.
+ * Patterns with other constructs than literals, '.', '[...]' and '|'
+ * are matched by the crx engine.
+ */
+typedef struct {
+	char *source;			/* Pattern for the crx fallback. */
+	bool compiled;
+	uint8_t len_alts[AX25_MAX_ADDR_LEN];	/* Alternatives by length. */
+	uint8_t pos_alts[AX25_MAX_ADDR_LEN - 1][DIGI_PATTERN_CHARS];
+					/* Alternatives by position and character. */
+} digi_pattern_t;
+
+bool digipeat_compile (digi_pattern_t *dp, char *pattern);
+packet_t digipeat_match (int from_chan, packet_t pp, char *mycall_rec, char *mycall_xmit, digi_pattern_t *alias, digi_pattern_t *wide, int to_chan, enum preempt_e preempt, char *filter_str);
 
 #endif 
 
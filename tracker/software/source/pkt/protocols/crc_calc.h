@@ -22,6 +22,17 @@
  */
 #define CRC_INCLUSIVE_CONSTANT    0x0F47
 
+/**
+ * @brief   Reflected CCITT-CRC16 polynomial.
+ * @notes   The CRC register change caused by inverting a bit of the data.
+ */
+#define CRC16_REFLECTED_POLY      0x8408
+
+/**
+ * @brief   Initial value for CCITT-CRC16 calculation.
+ */
+#define CRC16_INIT_VALUE          CRC16_X25_INIT
+
 /*===========================================================================*/
 /* External declarations.                                                    */
 /*===========================================================================*/
@@ -34,6 +45,26 @@ extern "C" {
 }
 #endif
 
+/*===========================================================================*/
+/* Module inline functions.                                                  */
+/*===========================================================================*/
+
+/**
+ * @brief   Adds a byte to a running CCITT-CRC16.
+ * @notes   Start with @p CRC16_INIT_VALUE.
+ * @notes   The final CRC is the complement of the running value.
+ *
+ * @param[in]   crc     the running CRC.
+ * @param[in]   data    the byte to add.
+ *
+ * @return      the updated running CRC.
+ *
+ * @api
+ */
+static inline uint16_t calc_crc16_update(uint16_t crc, ax25char_t data) {
+  return crc16_x25_byte(crc, data);
+}
+
 #endif /* PROTOCOLS_CRC_CALC_H_ */
 
 /** @} */
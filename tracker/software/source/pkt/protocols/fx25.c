@@ -0,0 +1,165 @@
+/*
+    Aerospace Decoder - Copyright (C) 2018 Bob Anderson (VK2GJ)
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include "pktconf.h"
+#include "rs8.h"
+
+/*
+ * Modes with 32 check bytes (tags 0x05 to 0x08) in order of block size.
+ * Tags are sent LSB first.
+ */
+static const fx25_mode_t fx25_modes[] = {
+  {0xDBF869BD2DBB1776ULL, 64, 32},
+  {0x1EB7B9CDBC09C00EULL, 96, 64},
+  {0xFF94DC634F1CFF4EULL, 160, 128},
+  {0x6E260B1AC5835FAEULL, 255, 223}
+};
+
+#define FX25_NUM_MODES  (sizeof(fx25_modes) / sizeof(fx25_modes[0]))
+
+/**
+ * @brief   Get the FX.25 mode for an HDLC frame.
+ *
+ * @param[in]   bits    size of the HDLC frame with flags and stuffed bits.
+ *
+ * @return  mode of the smallest block holding the frame.
+ * @retval  NULL if the frame does not fit the largest block.
+ *
+ * @api
+ */
+const fx25_mode_t *pktFX25GetMode(uint32_t bits) {
+  uint8_t i;
+  for(i = 0; i < FX25_NUM_MODES; i++) {
+    if(bits <= fx25_modes[i].data_size * 8U)
+      return &fx25_modes[i];
+  }
+  return NULL;
+}
+
+/**
+ * @brief   Reset FX.25 receive to tag search.
+ *
+ * @param[in]   rx      pointer to an @p fx25_rx_t structure.
+ *
+ * @api
+ */
+void pktFX25ResetReceive(fx25_rx_t *rx) {
+  rx->tag_bits = 0;
+  rx->mode = NULL;
+  rx->bit_index = 0;
+}
+
+/**
+ * @brief   Add a received bit to FX.25 receive.
+ * @notes   Bits are the HDLC bits before bit stuffing is removed.
+ * @notes   While searching the last 64 bits are correlated with the tags.
+ *          After a tag the bits of the block are collected.
+ *
+ * @param[in]   rx      pointer to an @p fx25_rx_t structure.
+ * @param[in]   bit     the received bit.
+ *
+ * @return  status of the block.
+ * @retval  true if a block has been collected.
+ * @retval  false if searching or collecting.
+ *
+ * @api
+ */
+bool pktFX25ReceiveBit(fx25_rx_t *rx, uint8_t bit) {
+  bit &= 1;
+  if(rx->mode != NULL) {
+    uint16_t i = rx->bit_index++;
+    if((i % 8) == 0)
+      rx->block[i / 8] = 0;
+    rx->block[i / 8] |= bit << (i % 8);
+    return rx->bit_index == rx->mode->block_size * 8U;
+  }
+  rx->tag_bits = (rx->tag_bits >> 1) | ((uint64_t)bit << 63);
+  uint8_t i;
+  for(i = 0; i < FX25_NUM_MODES; i++) {
+    if(__builtin_popcountll(rx->tag_bits ^ fx25_modes[i].tag)
+        <= FX25_TAG_ERRORS) {
+      rx->mode = &fx25_modes[i];
+      rx->bit_index = 0;
+      break;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief   Decode a collected FX.25 block.
+ * @details The block is corrected and the HDLC frame in its data part is
+ *          extracted in place at the start of the block.
+ * @post    The corrected field holds the number of symbols corrected.
+ *
+ * @param[in]   rx      pointer to an @p fx25_rx_t structure.
+ * @param[out]  crc     CRC of the frame including its FCS.
+ *
+ * @return  size of the frame including its FCS.
+ * @retval  -1 if the block can not be corrected or holds no frame.
+ *
+ * @api
+ */
+int32_t pktFX25DecodeBlock(fx25_rx_t *rx, uint16_t *crc) {
+  const fx25_mode_t *mode = rx->mode;
+  if(mode == NULL || rx->bit_index != mode->block_size * 8U)
+    return -1;
+
+  int errors = decode_rs_8(rx->block, NULL, 0,
+                           FX25_BLOCK_MAX - mode->block_size);
+  if(errors < 0)
+    return -1;
+  rx->corrected = errors;
+
+  /*
+   * Remove bit stuffing between the first flag and the next.
+   * Frame bytes are written behind the bits read.
+   */
+  uint8_t hdlc = 0;
+  uint8_t byte = 0;
+  uint8_t bits = 0;
+  bool open = false;
+  int32_t size = 0;
+  uint16_t c = CRC16_INIT_VALUE;
+  uint16_t i;
+  for(i = 0; i < mode->data_size * 8U; i++) {
+    uint8_t bit = (rx->block[i / 8] >> (i % 8)) & 0x1;
+    hdlc = (hdlc << 1) | bit;
+    if(hdlc == HDLC_FLAG) {
+      if(open && size >= PKT_MIN_FRAME) {
+        *crc = c;
+        return size;
+      }
+      /* Opening flag. */
+      open = true;
+      size = 0;
+      byte = 0;
+      bits = 0;
+      c = CRC16_INIT_VALUE;
+      continue;
+    }
+    if(!open)
+      continue;
+    /* Seven ones is an abort. */
+    if((hdlc & HDLC_RESET) == HDLC_RESET)
+      return -1;
+    /* Discard stuffed bit. */
+    if((hdlc & HDLC_RLL_MASK) == HDLC_RLL_BIT)
+      continue;
+    byte |= bit << bits;
+    if(++bits == 8) {
+      rx->block[size++] = byte;
+      c = calc_crc16_update(c, byte);
+      byte = 0;
+      bits = 0;
+    }
+  }
+  return -1;
+}
+
+/** @} */
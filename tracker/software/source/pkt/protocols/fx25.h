@@ -0,0 +1,81 @@
+/*
+    Aerospace Decoder - Copyright (C) 2018 Bob Anderson (VK2GJ)
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+/**
+ * @file    fx25.h
+ * @brief   FX.25 forward error correction framing.
+ * @details An FX.25 frame is a correlation tag followed by a Reed-Solomon
+ *          code block. The data part of the block holds the HDLC frame
+ *          with its flags and bit stuffing, padded with flags. Receivers
+ *          without FX.25 decode the HDLC frame inside the block.
+ * @notes   The blocks are coded by the RS(255,223) codec of rs8.c so only
+ *          the modes with 32 check bytes are used.
+ *
+ * @addtogroup protocols
+ * @{
+ */
+
+#ifndef PKT_PROTOCOLS_FX25_H_
+#define PKT_PROTOCOLS_FX25_H_
+
+/*===========================================================================*/
+/* Module constants.                                                         */
+/*===========================================================================*/
+
+#define FX25_TAG_SIZE           8U
+#define FX25_CHECK_SIZE         32U
+#define FX25_BLOCK_MAX          255U
+
+/* Tag bits which may be in error for a match. Tags differ in 32 bits. */
+#define FX25_TAG_ERRORS         4U
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   FX.25 mode of a correlation tag.
+ */
+typedef struct {
+  uint64_t                  tag;
+  uint8_t                   block_size;
+  uint8_t                   data_size;
+} fx25_mode_t;
+
+/**
+ * @brief   FX.25 receive state.
+ */
+typedef struct {
+  /* Last 64 bits received, first received in bit 0. */
+  uint64_t                  tag_bits;
+  /* Mode of the block being collected or NULL while searching. */
+  const fx25_mode_t         *mode;
+  uint16_t                  bit_index;
+  /* Symbols corrected in the last block decoded. */
+  uint8_t                   corrected;
+  uint8_t                   block[FX25_BLOCK_MAX];
+} fx25_rx_t;
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  const fx25_mode_t *pktFX25GetMode(uint32_t bits);
+  void pktFX25ResetReceive(fx25_rx_t *rx);
+  bool pktFX25ReceiveBit(fx25_rx_t *rx, uint8_t bit);
+  int32_t pktFX25DecodeBlock(fx25_rx_t *rx, uint16_t *crc);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PKT_PROTOCOLS_FX25_H_ */
+
+/** @} */
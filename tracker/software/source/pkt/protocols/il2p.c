@@ -0,0 +1,275 @@
+/*
+    Aerospace Decoder - Copyright (C) 2018 Bob Anderson (VK2GJ)
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include "pktconf.h"
+#include "rs8.h"
+
+/*
+ * Header layout.
+ * Bits 0-5 of bytes 0-5 and 6-11 are the destination and source callsign
+ * characters less 0x20. Byte 12 holds the destination SSID in its high
+ * nibble and the source SSID in its low nibble.
+ * Bit 6 of byte 0 is the UI flag and bit 6 of bytes 1-4 the PID code.
+ * Bit 7 of byte 1 is the header type and bit 7 of bytes 2-11 the payload
+ * count MSB first.
+ */
+#define IL2P_HDR_UI             0x40U
+#define IL2P_HDR_BIT6           0x40U
+#define IL2P_HDR_BIT7           0x80U
+#define IL2P_HDR_CHAR_MASK      0x3FU
+#define IL2P_HDR_COMPACT        1U
+#define IL2P_HDR_COUNT_BITS     10U
+
+/* PID code of PID 0xF0 (no layer 3). */
+#define IL2P_PID_NO_L3          0xFU
+
+/* AX.25 fields of a compact header frame. */
+#define IL2P_ADDR_LEN           7U
+#define IL2P_UI_CONTROL         0x03U
+#define IL2P_UI_PID             0xF0U
+
+/* Address flags of the frames built by ax25_from_text(). */
+#define IL2P_DEST_FLAGS         0xE0U
+#define IL2P_SOURCE_FLAGS       0xE1U
+#define IL2P_SSID_MASK          0x1EU
+
+/**
+ * @brief   Check if a frame can be sent with the compact header.
+ * @notes   The frame is a UI frame with two addresses as built by this
+ *          tracker so it is rebuilt unchanged on receive.
+ *
+ * @param[in]   frame   pointer to the AX.25 frame without FCS.
+ * @param[in]   len     length of the frame.
+ *
+ * @return  status of the check.
+ *
+ * @notapi
+ */
+static bool pktIL2PIsCompact(const uint8_t *frame, uint16_t len) {
+  if(len < IL2P_COMPACT_PREFIX
+      || len - IL2P_COMPACT_PREFIX > IL2P_PAYLOAD_MAX)
+    return false;
+  if((frame[6] & ~IL2P_SSID_MASK) != IL2P_DEST_FLAGS
+      || (frame[13] & ~IL2P_SSID_MASK) != IL2P_SOURCE_FLAGS)
+    return false;
+  if(frame[14] != IL2P_UI_CONTROL || frame[15] != IL2P_UI_PID)
+    return false;
+  uint8_t i;
+  for(i = 0; i < 2 * IL2P_ADDR_LEN; i++) {
+    if(i % IL2P_ADDR_LEN == 6)
+      continue;
+    if((frame[i] & 0x1) != 0 || (frame[i] >> 1) < 0x20
+        || (frame[i] >> 1) > 0x5F)
+      return false;
+  }
+  return true;
+}
+
+/**
+ * @brief   Build the IL2P header of a frame.
+ *
+ * @param[in]   frame   pointer to the AX.25 frame without FCS.
+ * @param[in]   len     length of the frame.
+ * @param[out]  header  buffer of @p IL2P_HEADER_SIZE bytes for the header.
+ *
+ * @return  offset of the payload in the frame.
+ * @retval  -1 if the frame is too large for IL2P.
+ *
+ * @api
+ */
+int32_t pktIL2PEncodeHeader(const uint8_t *frame, uint16_t len,
+                            uint8_t *header) {
+  memset(header, 0, IL2P_HEADER_SIZE);
+  uint16_t offset = 0;
+  if(pktIL2PIsCompact(frame, len)) {
+    uint8_t i;
+    for(i = 0; i < 6; i++) {
+      header[i] = ((frame[i] >> 1) - 0x20) & IL2P_HDR_CHAR_MASK;
+      header[i + 6] = ((frame[i + IL2P_ADDR_LEN] >> 1) - 0x20)
+          & IL2P_HDR_CHAR_MASK;
+    }
+    header[12] = ((frame[6] & IL2P_SSID_MASK) << 3)
+        | ((frame[13] & IL2P_SSID_MASK) >> 1);
+    header[0] |= IL2P_HDR_UI;
+    for(i = 0; i < 4; i++) {
+      if(IL2P_PID_NO_L3 & (0x8 >> i))
+        header[i + 1] |= IL2P_HDR_BIT6;
+    }
+    header[1] |= IL2P_HDR_BIT7;
+    offset = IL2P_COMPACT_PREFIX;
+  } else if(len > IL2P_PAYLOAD_MAX) {
+    return -1;
+  }
+  uint16_t count = len - offset;
+  uint8_t i;
+  for(i = 0; i < IL2P_HDR_COUNT_BITS; i++) {
+    if(count & (1U << (IL2P_HDR_COUNT_BITS - 1 - i)))
+      header[i + 2] |= IL2P_HDR_BIT7;
+  }
+  return offset;
+}
+
+/**
+ * @brief   Get the data size of a payload block.
+ * @notes   The payload is split into the fewest blocks of equal size.
+ *          The first blocks take one byte more of any remainder.
+ *
+ * @param[in]   count   size of the payload.
+ * @param[in]   block   index of the block.
+ *
+ * @return  size of the block data.
+ * @retval  zero if the payload has no such block.
+ *
+ * @api
+ */
+uint8_t pktIL2PBlockSize(uint16_t count, uint8_t block) {
+  uint16_t blocks = (count + IL2P_BLOCK_DATA_MAX - 1) / IL2P_BLOCK_DATA_MAX;
+  if(block >= blocks)
+    return 0;
+  return count / blocks + ((block < count % blocks) ? 1 : 0);
+}
+
+/**
+ * @brief   Get the stream size of an IL2P frame.
+ *
+ * @param[in]   count   size of the payload.
+ *
+ * @return  number of bytes including the sync word.
+ *
+ * @api
+ */
+uint16_t pktIL2PFrameSize(uint16_t count) {
+  uint16_t blocks = (count + IL2P_BLOCK_DATA_MAX - 1) / IL2P_BLOCK_DATA_MAX;
+  return IL2P_SYNC_SIZE + IL2P_HEADER_SIZE + IL2P_CHECK_SIZE
+      + count + blocks * IL2P_CHECK_SIZE;
+}
+
+/**
+ * @brief   Reset IL2P receive to sync search.
+ *
+ * @param[in]   rx      pointer to an @p il2p_rx_t structure.
+ *
+ * @api
+ */
+void pktIL2PResetReceive(il2p_rx_t *rx) {
+  rx->state = IL2P_RX_SEARCH;
+  rx->sync_bits = 0;
+  rx->bit_index = 0;
+}
+
+/**
+ * @brief   Add a received bit to IL2P receive.
+ * @notes   Bits are the HDLC bits before bit stuffing is removed.
+ * @notes   While searching the last 24 bits are correlated with the sync
+ *          word. After the sync word the bits of each block are collected.
+ *
+ * @param[in]   rx      pointer to an @p il2p_rx_t structure.
+ * @param[in]   bit     the received bit.
+ *
+ * @return  result of the bit.
+ * @retval  IL2P_BIT_SYNC if the sync word has been found.
+ * @retval  IL2P_BIT_BLOCK if a block has been collected.
+ * @retval  IL2P_BIT_NONE if searching or collecting.
+ *
+ * @api
+ */
+il2p_bit_t pktIL2PReceiveBit(il2p_rx_t *rx, uint8_t bit) {
+  bit &= 1;
+  switch(rx->state) {
+  case IL2P_RX_SEARCH:
+    rx->sync_bits = (rx->sync_bits >> 1) | ((uint32_t)bit << 23);
+    if(__builtin_popcount(rx->sync_bits ^ IL2P_SYNC_WORD)
+        > IL2P_SYNC_ERRORS)
+      return IL2P_BIT_NONE;
+    rx->state = IL2P_RX_HEADER;
+    rx->block_size = IL2P_HEADER_SIZE;
+    rx->bit_index = 0;
+    return IL2P_BIT_SYNC;
+
+  case IL2P_RX_HEADER:
+  case IL2P_RX_PAYLOAD: {
+    uint16_t i = rx->bit_index++;
+    if((i % 8) == 0)
+      rx->block[i / 8] = 0;
+    rx->block[i / 8] |= bit << (i % 8);
+    if(rx->bit_index == (rx->block_size + IL2P_CHECK_SIZE) * 8U)
+      return IL2P_BIT_BLOCK;
+    return IL2P_BIT_NONE;
+  }
+
+  default:
+    return IL2P_BIT_NONE;
+  }
+}
+
+/**
+ * @brief   Decode a collected IL2P block.
+ * @details The block is corrected and its part of the AX.25 frame is
+ *          written. A compact header writes the addresses, control and
+ *          PID fields. Payload blocks write the payload.
+ * @post    The next block is being collected or the state is done.
+ *
+ * @param[in]   rx      pointer to an @p il2p_rx_t structure.
+ * @param[out]  out     buffer for the frame bytes.
+ * @param[in]   room    size of the buffer.
+ *
+ * @return  number of frame bytes written.
+ * @retval  -1 if the block can not be corrected or does not fit.
+ *
+ * @api
+ */
+int32_t pktIL2PDecodeBlock(il2p_rx_t *rx, uint8_t *out, uint16_t room) {
+  if(rx->state != IL2P_RX_HEADER && rx->state != IL2P_RX_PAYLOAD)
+    return -1;
+  if(decode_rs_8(rx->block, NULL, 0, IL2P_BLOCK_MAX - IL2P_CHECK_SIZE
+                 - rx->block_size) < 0)
+    return -1;
+
+  int32_t size = 0;
+  if(rx->state == IL2P_RX_HEADER) {
+    uint8_t *h = rx->block;
+    uint8_t i;
+    rx->count = 0;
+    for(i = 0; i < IL2P_HDR_COUNT_BITS; i++)
+      rx->count = (rx->count << 1) | ((h[i + 2] & IL2P_HDR_BIT7) ? 1 : 0);
+    if((h[1] & IL2P_HDR_BIT7) >> 7 == IL2P_HDR_COMPACT) {
+      uint8_t pid = 0;
+      for(i = 0; i < 4; i++)
+        pid = (pid << 1) | ((h[i + 1] & IL2P_HDR_BIT6) ? 1 : 0);
+      if(!(h[0] & IL2P_HDR_UI) || pid != IL2P_PID_NO_L3
+          || room < IL2P_COMPACT_PREFIX)
+        return -1;
+      for(i = 0; i < 6; i++) {
+        out[i] = ((h[i] & IL2P_HDR_CHAR_MASK) + 0x20) << 1;
+        out[i + IL2P_ADDR_LEN] = ((h[i + 6] & IL2P_HDR_CHAR_MASK) + 0x20) << 1;
+      }
+      out[6] = IL2P_DEST_FLAGS | ((h[12] >> 3) & IL2P_SSID_MASK);
+      out[13] = IL2P_SOURCE_FLAGS | ((h[12] << 1) & IL2P_SSID_MASK);
+      out[14] = IL2P_UI_CONTROL;
+      out[15] = IL2P_UI_PID;
+      size = IL2P_COMPACT_PREFIX;
+    } else if(rx->count == 0) {
+      return -1;
+    }
+    rx->state = IL2P_RX_PAYLOAD;
+    rx->block_index = 0;
+  } else {
+    if(rx->block_size > room)
+      return -1;
+    memcpy(out, rx->block, rx->block_size);
+    size = rx->block_size;
+    rx->block_index++;
+  }
+  rx->block_size = pktIL2PBlockSize(rx->count, rx->block_index);
+  rx->bit_index = 0;
+  if(rx->block_size == 0)
+    rx->state = IL2P_RX_DONE;
+  return size;
+}
+
+/** @} */
@@ -0,0 +1,110 @@
+/*
+    Aerospace Decoder - Copyright (C) 2018 Bob Anderson (VK2GJ)
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+/**
+ * @file    il2p.h
+ * @brief   IL2P (Improved Layer 2 Protocol) framing.
+ * @details An IL2P frame is a sync word, a header block and the payload
+ *          in blocks of up to 223 bytes. Each block carries Reed-Solomon
+ *          check bytes. There is no bit stuffing and no FCS.
+ *          The compact header holds the callsigns and SSIDs of a UI frame
+ *          with two addresses and the payload is its information field.
+ *          Other frames use the transparent header and the whole frame
+ *          is the payload. Frames are rebuilt as AX.25 on receive.
+ * @notes   The blocks are coded by the RS(255,223) codec of rs8.c with 32
+ *          check bytes. Bytes are sent LSB first as in HDLC. This differs
+ *          from other IL2P implementations so only stations using this
+ *          framing decode it.
+ *
+ * @addtogroup protocols
+ * @{
+ */
+
+#ifndef PKT_PROTOCOLS_IL2P_H_
+#define PKT_PROTOCOLS_IL2P_H_
+
+/*===========================================================================*/
+/* Module constants.                                                         */
+/*===========================================================================*/
+
+/* Sync word sent LSB first. */
+#define IL2P_SYNC_WORD          0xF15E48U
+#define IL2P_SYNC_SIZE          3U
+#define IL2P_SYNC_MASK          0xFFFFFFU
+
+/* Sync bits which may be in error for a match. */
+#define IL2P_SYNC_ERRORS        1U
+
+#define IL2P_HEADER_SIZE        13U
+#define IL2P_CHECK_SIZE         32U
+#define IL2P_BLOCK_DATA_MAX     223U
+#define IL2P_BLOCK_MAX          255U
+#define IL2P_PAYLOAD_MAX        1023U
+
+/* Frame bytes before the information field of a compact header frame. */
+#define IL2P_COMPACT_PREFIX     16U
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   IL2P receive states.
+ */
+typedef enum {
+  IL2P_RX_SEARCH,
+  IL2P_RX_HEADER,
+  IL2P_RX_PAYLOAD,
+  IL2P_RX_DONE
+} il2p_rx_state_t;
+
+/**
+ * @brief   IL2P receive bit results.
+ */
+typedef enum {
+  IL2P_BIT_NONE,
+  IL2P_BIT_SYNC,
+  IL2P_BIT_BLOCK
+} il2p_bit_t;
+
+/**
+ * @brief   IL2P receive state.
+ */
+typedef struct {
+  il2p_rx_state_t           state;
+  /* Last 24 bits received, first received in bit 0. */
+  uint32_t                  sync_bits;
+  /* Payload count of the header and payload block being collected. */
+  uint16_t                  count;
+  uint8_t                   block_index;
+  uint8_t                   block_size;
+  uint16_t                  bit_index;
+  uint8_t                   block[IL2P_BLOCK_MAX];
+} il2p_rx_t;
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  int32_t pktIL2PEncodeHeader(const uint8_t *frame, uint16_t len,
+                              uint8_t *header);
+  uint8_t pktIL2PBlockSize(uint16_t count, uint8_t block);
+  uint16_t pktIL2PFrameSize(uint16_t count);
+  void pktIL2PResetReceive(il2p_rx_t *rx);
+  il2p_bit_t pktIL2PReceiveBit(il2p_rx_t *rx, uint8_t bit);
+  int32_t pktIL2PDecodeBlock(il2p_rx_t *rx, uint8_t *out, uint16_t room);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PKT_PROTOCOLS_IL2P_H_ */
+
+/** @} */
@@ -79,7 +79,7 @@ bool pktExtractHDLCfromAFSK(AFSKDemodDriver *myDriver) {
         pktAddEventFlags(myHandler, EVT_HDLC_RESET_RCVD);
         if(myHandler->active_packet_object->packet_size < PKT_MIN_FRAME) {
           /* No data payload stored yet so go back to sync search. */
-          myHandler->active_packet_object->packet_size = 0;
+          pktResetDataCount(myHandler->active_packet_object);
           myDriver->frame_state = FRAME_SEARCH;
           myHandler->sync_count--;
           break;
@@ -137,8 +137,8 @@ bool pktExtractHDLCfromAFSK(AFSKDemodDriver *myDriver) {
 
       myDriver->frame_state = FRAME_OPEN;
       myHandler->sync_count++;
-      /* Reset AX25 data indexes. */
-      myHandler->active_packet_object->packet_size = 0;
+      /* Reset AX25 data indexes and CRC. */
+      pktResetDataCount(myHandler->active_packet_object);
       myDriver->bit_index = 0;
 
       /*
@@ -154,4 +154,210 @@ bool pktExtractHDLCfromAFSK(AFSKDemodDriver *myDriver) {
   } /* End switch on frame state. */
 } /* End function. */
 
+#if AFSK_NUM_SLICERS > 1
+/**
+ * @brief   Extract HDLC from AFSK for an additional slicer.
+ * @post    The slicer HDLC state will be updated.
+ * @notes   Additional slicers store frames in their own buffer.
+ * @notes   No events or statistics are generated by additional slicers.
+ * @notes   Any HDLC reset or buffer overflow returns the slicer to search.
+ * @notes   A closed frame is left to the decoder to check and collect.
+ *
+ * @param[in]   slicer     pointer to an @p afsk_slicer_t structure.
+ *
+ * @api
+ */
+void pktExtractHDLCfromSlicer(afsk_slicer_t *slicer) {
+
+  /* Shift prior HDLC bits up before adding new bit. */
+  slicer->hdlc_bits <<= 1;
+  slicer->hdlc_bits &= 0xFE;
+  /* Same tone indicates a 1. */
+  if(slicer->tone_freq == slicer->prior_freq) {
+    slicer->hdlc_bits |= 1;
+  }
+  slicer->prior_freq = slicer->tone_freq;
+
+  switch(slicer->frame_state) {
+  case FRAME_OPEN: {
+    switch(slicer->hdlc_bits & HDLC_CODE_MASK) {
+      case HDLC_FLAG: {
+        slicer->bit_index = 0;
+        if(slicer->packet_size >= PKT_MIN_FRAME) {
+          slicer->frame_state = FRAME_CLOSE;
+          return;
+        }
+        /* Still in opening flags. */
+        slicer->packet_size = 0;
+        slicer->crc = CRC16_INIT_VALUE;
+        return;
+      }
+
+      case HDLC_RESET: {
+        slicer->packet_size = 0;
+        slicer->frame_state = FRAME_SEARCH;
+        return;
+      }
+
+      default: {
+        /* Discard stuffed bit. */
+        if((slicer->hdlc_bits & HDLC_RLL_MASK) == HDLC_RLL_BIT)
+          return;
+        slicer->current_byte &= 0x7F;
+        if((slicer->hdlc_bits & 0x01) == 1) {
+          slicer->current_byte |= 0x80;
+        }
+        if(++slicer->bit_index == 8U) {
+          slicer->bit_index = 0;
+          if(slicer->packet_size < sizeof(slicer->buffer)) {
+            slicer->buffer[slicer->packet_size++] = slicer->current_byte;
+            slicer->crc = calc_crc16_update(slicer->crc, slicer->current_byte);
+            return;
+          }
+          /* Buffer full so abandon this frame. */
+          slicer->packet_size = 0;
+          slicer->frame_state = FRAME_SEARCH;
+          return;
+        }
+        slicer->current_byte >>= 1;
+        return;
+      }
+    } /* End switch. */
+  }
+
+  case FRAME_SEARCH: {
+    if((slicer->hdlc_bits & HDLC_FRAME_MASK_B) == HDLC_FRAME_OPEN_B) {
+      slicer->frame_state = FRAME_OPEN;
+      slicer->packet_size = 0;
+      slicer->crc = CRC16_INIT_VALUE;
+      slicer->bit_index = 0;
+    }
+    return;
+  }
+
+  default:
+    return;
+  } /* End switch on frame state. */
+}
+#endif /* AFSK_NUM_SLICERS > 1 */
+
+#if PKT_RX_USE_FX25 == TRUE
+/**
+ * @brief   Extract an FX.25 frame from the HDLC bit stream.
+ * @notes   Runs after the primary HDLC extraction and slicers on the bit.
+ * @notes   The frame of a corrected block is used if no good frame has
+ *          been collected. A failed primary frame is dropped while a
+ *          block is being collected so the session waits for the block.
+ * @post    A corrected frame is copied to the active packet buffer.
+ *
+ * @param[in]   myDriver   pointer to an @p AFSKDemodDriver structure.
+ *
+ * @api
+ */
+void pktExtractFX25fromHDLC(AFSKDemodDriver *myDriver) {
+  packet_svc_t *myHandler = myDriver->packet_handler;
+  pkt_data_object_t *myPacket = myHandler->active_packet_object;
+  fx25_rx_t *fx25 = &myDriver->fx25;
+
+  bool collected = (myDriver->frame_state == FRAME_CLOSE)
+      && pktIsBufferGoodCRC(myPacket);
+
+  if(pktFX25ReceiveBit(fx25, myDriver->hdlc_bits & 0x1)) {
+    uint16_t crc;
+    int32_t size = collected ? -1 : pktFX25DecodeBlock(fx25, &crc);
+    if(size > 0 && (size_t)size <= myPacket->buffer_size
+        && crc == (uint16_t)~CRC_INCLUSIVE_CONSTANT) {
+      memcpy(myPacket->buffer, fx25->block, size);
+      myPacket->packet_size = size;
+      myPacket->crc = crc;
+      myDriver->frame_state = FRAME_CLOSE;
+    }
+    pktFX25ResetReceive(fx25);
+    return;
+  }
+  if(!collected && fx25->mode != NULL
+      && (myDriver->frame_state == FRAME_RESET
+      || myDriver->frame_state == FRAME_CLOSE)) {
+    pktResetDataCount(myPacket);
+    myDriver->frame_state = FRAME_SEARCH;
+  }
+}
+#endif /* PKT_RX_USE_FX25 == TRUE */
+
+#if PKT_RX_USE_IL2P == TRUE
+/**
+ * @brief   Extract an IL2P frame from the HDLC bit stream.
+ * @notes   Runs after the other extractions on the bit.
+ * @notes   The sync word takes the session unless HDLC is already inside
+ *          a frame. HDLC extraction then stops while the blocks are
+ *          collected and the decoded frame is built in the active packet
+ *          buffer. A block which can not be corrected ends the frame and
+ *          HDLC extraction resumes.
+ * @post    A decoded frame is closed with its FCS in the active packet
+ *          buffer.
+ *
+ * @param[in]   myDriver   pointer to an @p AFSKDemodDriver structure.
+ *
+ * @api
+ */
+void pktExtractIL2PfromHDLC(AFSKDemodDriver *myDriver) {
+  packet_svc_t *myHandler = myDriver->packet_handler;
+  pkt_data_object_t *myPacket = myHandler->active_packet_object;
+  il2p_rx_t *il2p = &myDriver->il2p;
+
+  switch(pktIL2PReceiveBit(il2p, myDriver->hdlc_bits & 0x1)) {
+  case IL2P_BIT_SYNC: {
+    /* HDLC has at most the sync word after the opening flag. */
+    if(myDriver->frame_state == FRAME_SEARCH
+        || (myDriver->frame_state == FRAME_OPEN
+        && myPacket->packet_size <= IL2P_SYNC_SIZE)) {
+      pktResetDataCount(myPacket);
+      myDriver->frame_state = FRAME_DATA;
+      return;
+    }
+    pktIL2PResetReceive(il2p);
+    return;
+  }
+
+  case IL2P_BIT_BLOCK: {
+    /* Another slicer may have closed a frame meanwhile. */
+    if(myDriver->frame_state != FRAME_DATA) {
+      pktIL2PResetReceive(il2p);
+      return;
+    }
+    uint8_t *out = myPacket->buffer + myPacket->packet_size;
+    int32_t size = pktIL2PDecodeBlock(il2p, out, myPacket->buffer_size
+                                      - myPacket->packet_size
+                                      - sizeof(uint16_t));
+    if(size < 0) {
+      pktResetDataCount(myPacket);
+      myDriver->frame_state = FRAME_SEARCH;
+      pktIL2PResetReceive(il2p);
+      return;
+    }
+    int32_t i;
+    for(i = 0; i < size; i++)
+      myPacket->crc = calc_crc16_update(myPacket->crc, out[i]);
+    myPacket->packet_size += size;
+    if(il2p->state != IL2P_RX_DONE)
+      return;
+    /* Add the FCS so the frame is checked as an HDLC frame. */
+    uint16_t fcs = ~myPacket->crc;
+    myPacket->buffer[myPacket->packet_size++] = fcs & 0xFF;
+    myPacket->crc = calc_crc16_update(myPacket->crc, fcs & 0xFF);
+    myPacket->buffer[myPacket->packet_size++] = fcs >> 8;
+    myPacket->crc = calc_crc16_update(myPacket->crc, fcs >> 8);
+    myDriver->frame_state = FRAME_CLOSE;
+    pktIL2PResetReceive(il2p);
+    return;
+  }
+
+  default:
+    if(il2p->state != IL2P_RX_SEARCH && myDriver->frame_state != FRAME_DATA)
+      pktIL2PResetReceive(il2p);
+    return;
+  }
+}
+#endif /* PKT_RX_USE_IL2P == TRUE */
+
 /** @} */
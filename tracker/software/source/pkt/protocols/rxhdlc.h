@@ -35,6 +35,15 @@
   extern "C" {
   #endif
     bool pktExtractHDLCfromAFSK(AFSKDemodDriver *myDriver);
+#if AFSK_NUM_SLICERS > 1
+    void pktExtractHDLCfromSlicer(afsk_slicer_t *slicer);
+#endif
+#if PKT_RX_USE_FX25 == TRUE
+    void pktExtractFX25fromHDLC(AFSKDemodDriver *myDriver);
+#endif
+#if PKT_RX_USE_IL2P == TRUE
+    void pktExtractIL2PfromHDLC(AFSKDemodDriver *myDriver);
+#endif
   #ifdef __cplusplus
   }
   #endif
@@ -7,6 +7,194 @@
 */
 
 #include "pktconf.h"
+#if PKT_TX_USE_FX25 == TRUE || PKT_TX_USE_IL2P == TRUE
+#include "rs8.h"
+#endif
+
+/**
+ * @brief   Count the RLL bits inserted in a frame and its CRC.
+ * @notes   A frame follows a flag so it starts without a run of ones.
+ *
+ * @param[in]   pp          packet object reference pointer.
+ *
+ * @return  number of inserted bits.
+ *
+ * @notapi
+ */
+static uint32_t pktStreamFrameRLL(packet_t pp) {
+  uint16_t crc = calc_crc16(pp->frame_data, 0, pp->frame_len);
+  uint8_t fcs[sizeof(uint16_t)] = {crc & 0xFF, crc >> 8};
+  uint32_t rll = 0;
+  uint8_t ones = 0;
+  for(uint16_t i = 0; i < pp->frame_len + sizeof(fcs); i++) {
+    uint8_t byte = (i < pp->frame_len) ? pp->frame_data[i]
+                                       : fcs[i - pp->frame_len];
+    for(uint8_t b = 0; b < 8; b++) {
+      if(ones == 5) {
+        rll++;
+        ones = 0;
+      }
+      ones = ((byte >> b) & 0x1) ? ones + 1 : 0;
+    }
+  }
+  return rll;
+}
+
+#if PKT_TX_USE_FX25 == TRUE
+/**
+ * @brief   Get the FX.25 mode to send a frame with.
+ * @notes   The block data holds the frame and CRC with its RLL inserted
+ *          bits and an opening and closing flag.
+ *
+ * @param[in]   pp          packet object reference pointer.
+ * @param[in]   rll         number of RLL bits inserted in the frame.
+ *
+ * @return  mode of the smallest block holding the frame.
+ * @retval  NULL if the frame is sent as plain HDLC.
+ *
+ * @notapi
+ */
+static const fx25_mode_t *pktStreamFrameFX25(packet_t pp, uint32_t rll) {
+  return pktFX25GetMode((pp->frame_len + sizeof(uint16_t)) * 8U + rll
+                        + 2U * 8U);
+}
+#endif
+
+/**
+ * @brief   Load a frame into an NRZI stream iterator.
+ *
+ * @param[in]   iterator    pointer to an @p iterator object.
+ * @param[in]   pp          packet object reference pointer.
+ *
+ * @notapi
+ */
+static void pktIteratorLoadFrame(tx_iterator_t *iterator, packet_t pp) {
+  iterator->data_buff = pp->frame_data;
+  iterator->data_size = pp->frame_len;
+  uint16_t crc = calc_crc16(pp->frame_data, 0, pp->frame_len);
+  iterator->crc[0] = crc & 0xFF;
+  iterator->crc[1] = crc >> 8;
+#if PKT_TX_USE_IL2P == TRUE
+  iterator->il2p = false;
+  if(pp->link == LINK_IL2P) {
+    int32_t offset = pktIL2PEncodeHeader(pp->frame_data, pp->frame_len,
+                                         iterator->il2p_header);
+    if(offset >= 0) {
+      iterator->il2p = true;
+      iterator->il2p_data = pp->frame_data + offset;
+      iterator->il2p_count = pp->frame_len - offset;
+      iterator->il2p_block = 0;
+#if PKT_TX_USE_FX25 == TRUE
+      iterator->fx25_mode = NULL;
+#endif
+      return;
+    }
+  }
+#endif
+#if PKT_TX_USE_FX25 == TRUE
+  iterator->fx25_mode = pktStreamFrameFX25(pp, pktStreamFrameRLL(pp));
+#endif
+}
+
+/**
+ * @brief   Get the stream size of a frame.
+ * @notes   A plain frame is the frame and its CRC. The RLL bits inserted
+ *          in it are added to the RLL count if requested.
+ * @notes   An FX.25 frame is the correlation tag and the block which
+ *          includes the flags around the frame.
+ * @notes   An IL2P frame is the sync word and the coded header and
+ *          payload blocks.
+ *
+ * @param[in]   pp          packet object reference pointer.
+ * @param[out]  rll         pointer to the RLL count to add to or NULL.
+ *
+ * @return  number of bytes.
+ *
+ * @api
+ */
+uint16_t pktStreamFrameSize(packet_t pp, uint32_t *rll) {
+#if PKT_TX_USE_IL2P == TRUE
+  if(pp->link == LINK_IL2P) {
+    uint8_t header[IL2P_HEADER_SIZE];
+    int32_t offset = pktIL2PEncodeHeader(pp->frame_data, pp->frame_len,
+                                         header);
+    if(offset >= 0)
+      return pktIL2PFrameSize(pp->frame_len - offset);
+  }
+#endif
+  uint32_t r = pktStreamFrameRLL(pp);
+#if PKT_TX_USE_FX25 == TRUE
+  const fx25_mode_t *mode = pktStreamFrameFX25(pp, r);
+  if(mode != NULL)
+    return FX25_TAG_SIZE + mode->block_size;
+#endif
+  if(rll != NULL)
+    *rll += r;
+  return pp->frame_len + sizeof(uint16_t);
+}
+
+/**
+ * @brief   Start the frame loaded in an NRZI stream iterator.
+ *
+ * @param[in]   iterator    pointer to an @p iterator object.
+ *
+ * @notapi
+ */
+static void pktIteratorStartFrame(tx_iterator_t *iterator) {
+  iterator->inp_index = 0;
+#if PKT_TX_USE_IL2P == TRUE
+  if(iterator->il2p) {
+    iterator->state = ITERATE_IL2P_SYNC;
+    iterator->hdlc_count = IL2P_SYNC_SIZE;
+    return;
+  }
+#endif
+#if PKT_TX_USE_FX25 == TRUE
+  if(iterator->fx25_mode != NULL) {
+    iterator->state = ITERATE_FX25_TAG;
+    iterator->hdlc_count = FX25_TAG_SIZE;
+    return;
+  }
+#endif
+  iterator->state = ITERATE_FRAME;
+}
+
+/**
+ * @brief   Continue an NRZI stream iterator after a frame.
+ * @notes   The next frame of a burst follows gap flags.
+ *
+ * @param[in]   iterator    pointer to an @p iterator object.
+ *
+ * @notapi
+ */
+static void pktIteratorEndFrame(tx_iterator_t *iterator) {
+  if(iterator->frames_left > 0) {
+    iterator->state = ITERATE_GAP;
+    iterator->hdlc_count = iterator->hdlc_gap;
+  } else {
+    iterator->state = ITERATE_CLOSE;
+    iterator->hdlc_count = iterator->hdlc_post;
+  }
+  iterator->hdlc_code = HDLC_FLAG;
+  iterator->inp_index = 0;
+}
+
+#if PKT_TX_USE_FX25 == TRUE || PKT_TX_USE_IL2P == TRUE
+/**
+ * @brief   Start Reed-Solomon coding of a block in an NRZI stream iterator.
+ * @notes   Bits written from now on are packed and coded into check bytes.
+ *
+ * @param[in]   iterator    pointer to an @p iterator object.
+ *
+ * @notapi
+ */
+static void pktIteratorStartCode(tx_iterator_t *iterator) {
+  iterator->rs_pack = true;
+  iterator->rs_bits = 0;
+  iterator->rs_byte = 0;
+  memset(iterator->rs_check, 0, sizeof(iterator->rs_check));
+}
+#endif
 
 /**
  * @brief   Initialize an NRZI stream iterator.
@@ -33,15 +221,63 @@ void pktStreamIteratorInit(tx_iterator_t *iterator,
   iterator->hdlc_post = post;
   iterator->hdlc_tail = tail;
   iterator->scramble = scramble;
-  iterator->data_buff = pp->frame_data;
-  iterator->data_size = pp->frame_len;
-  uint16_t crc = calc_crc16(pp->frame_data, 0, pp->frame_len);
-  iterator->crc[0] = crc & 0xFF;
-  iterator->crc[1] = crc >> 8;
+  pktIteratorLoadFrame(iterator, pp);
   iterator->no_write = false;
+  iterator->frames = 1;
   iterator->state = ITERATE_PREAMBLE;
 }
 
+/**
+ * @brief   Initialize an NRZI stream iterator for a burst of frames.
+ * @details Frames of the packet chain are streamed in one transmission.
+ *          The preamble, closing and tail are sent once and the frames are
+ *          separated by gap flags. Frames are added while the stream stays
+ *          within the limit. The first frame is always included.
+ * @post    The iterator is ready for use. The frames field holds the number
+ *          of packets of the chain in the burst.
+ *
+ * @param[in]   iterator    pointer to an @p iterator object.
+ * @param[in]   pp          first packet of the chain.
+ * @param[in]   pre         length of HDLC (flags) preamble
+ * @param[in]   gap         length of HDLC (flags) between frames
+ * @param[in]   post        length of HDLC (flags) closing
+ * @param[in]   tail        length of HDLC (0 data) tail flags
+ * @param[in]   scramble    determines if scrambling (whitening) is applied.
+ * @param[in]   limit       maximum stream size in bytes.
+ *
+ * @api
+ */
+void pktStreamIteratorInitBurst(tx_iterator_t *iterator,
+                                packet_t pp,
+                                uint8_t pre,
+                                uint8_t gap,
+                                uint8_t post,
+                                uint8_t tail,
+                                bool scramble,
+                                uint16_t limit) {
+  pktStreamIteratorInit(iterator, pp, pre, post, tail, scramble);
+  iterator->hdlc_gap = gap;
+  iterator->next = pp->nextp;
+
+  /*
+   * Stream bytes of the frames so far.
+   * The final tail covers the RLL inserted bits so they count twice.
+   */
+  uint32_t rll = 0;
+  uint32_t size = pre + post + tail + pktStreamFrameSize(pp, &rll);
+  for(packet_t np = pp->nextp; np != NULL
+      && iterator->frames < ITERATOR_MAX_FRAMES; np = np->nextp) {
+    uint32_t r = rll;
+    uint32_t s = size + gap + pktStreamFrameSize(np, &r);
+    if(s + 2 * ((r + 7) / 8) > limit)
+      break;
+    size = s;
+    rll = r;
+    iterator->frames++;
+  }
+  iterator->frames_left = iterator->frames - 1;
+}
+
 
 /**
  * @brief   Write NRZI stream data to buffer.
@@ -65,6 +301,18 @@ static bool pktIteratorWriteStreamBit(tx_iterator_t *iterator, uint8_t bit) {
   /* Mask to bit 0 only. */
   bit &= 1;
 
+#if PKT_TX_USE_FX25 == TRUE || PKT_TX_USE_IL2P == TRUE
+  /* Pack block data and code each byte into the check bytes. */
+  if(iterator->rs_pack) {
+    iterator->rs_byte |= bit << (iterator->rs_bits++ % 8);
+    if((iterator->rs_bits % 8) == 0) {
+      if(iterator->no_write == false)
+        encode_rs_8_byte(iterator->rs_byte, iterator->rs_check);
+      iterator->rs_byte = 0;
+    }
+  }
+#endif
+
   /* Keep track of HDLC for RLL detection. */
   iterator->hdlc_hist <<= 1;
   iterator->hdlc_hist |= bit;
@@ -136,6 +384,10 @@ static bool pktEncodeFrameData(tx_iterator_t *iterator) {
   do {
     /* Next apply RLL encoding for the packet data pay load. */
     if((iterator->hdlc_hist & HDLC_RLL_SEQUENCE) == HDLC_RLL_SEQUENCE) {
+#if PKT_TX_USE_FX25 == TRUE
+      /* Bits inserted in an FX.25 block take the place of padding. */
+      if(!iterator->rs_pack)
+#endif
       iterator->rll_count++;
       /* Insert RLL 0 to output stream. */
       if(pktIteratorWriteStreamBit(iterator, 0))
@@ -154,6 +406,34 @@ static bool pktEncodeFrameData(tx_iterator_t *iterator) {
   return false;
 }
 
+#if PKT_TX_USE_FX25 == TRUE || PKT_TX_USE_IL2P == TRUE
+/**
+ * @brief   Encode block byte.
+ * @pre     Iterator object initialized and buffer pointer set.
+ * @post    Data is written to the stream unless counting only is active.
+ * @notes   RLL encoding is not applied.
+ *
+ * @param[in]   iterator   pointer to an @p iterator object.
+ *
+ * @return  status.
+ * @retval  true indicates the requested quantity of bytes has been reached.
+ * @retval  false indicates the requested quantity of bytes not reached.
+ *
+ * @notapi
+ */
+static bool pktEncodeFrameBlock(tx_iterator_t *iterator) {
+  do {
+    uint8_t byte = iterator->data_buff[iterator->inp_index >> 3];
+    uint8_t bit = (byte >> (iterator->inp_index++ % 8)) & 0x1;
+    if((iterator->inp_index % 8) == 0)
+      iterator->data_size--;
+    if(pktIteratorWriteStreamBit(iterator, bit))
+      return true;
+  } while((iterator->inp_index % 8) != 0);
+  return false;
+}
+#endif
+
 /**
  * @brief   Encode frame stream for transmission.
  * @pre     The iterator has to be initialized before use.
@@ -162,6 +442,8 @@ static bool pktEncodeFrameData(tx_iterator_t *iterator) {
  * @notes   The calling function may request chunk sizes from 1 byte up.
  * @notes   A quantity of 0 will return the number of bytes pending only.
  * @notes   In this case no data is actually written to the stream.
+ * @notes   Every byte counted is written so the stream can be consumed
+ *          directly in chunks without a whole frame buffer.
  *
  * @param[in]   iterator   pointer to an @p iterator object.
  * @param[in]   stream     pointer to buffer to write stream data.
@@ -227,8 +509,7 @@ uint16_t pktStreamEncodingIterator(tx_iterator_t *iterator,
           /* True means the requested count has been reached. */
           return iterator->qty;
       } /* End while. */
-      iterator->inp_index = 0;
-      iterator->state = ITERATE_FRAME;
+      pktIteratorStartFrame(iterator);
       continue;
       } /* End case ITERATE_PREAMBLE. */
 
@@ -260,13 +541,173 @@ uint16_t pktStreamEncodingIterator(tx_iterator_t *iterator,
           /* True means the requested count has been reached. */
           return iterator->qty;
       }
-      /* Frame CRC consumed. */
-      iterator->state = ITERATE_CLOSE;
-      iterator->hdlc_count = iterator->hdlc_post;
+#if PKT_TX_USE_FX25 == TRUE
+      /* An FX.25 block is closed by its padding. */
+      if(iterator->fx25_mode != NULL) {
+        iterator->state = ITERATE_FX25_PAD;
+        iterator->inp_index = 0;
+        continue;
+      }
+#endif
+      /* Frame CRC consumed. Separate the next frame of a burst. */
+      pktIteratorEndFrame(iterator);
+      continue;
+      } /* End case ITERATE_CRC. */
+
+#if PKT_TX_USE_FX25 == TRUE
+    case ITERATE_FX25_TAG: {
+      /*
+       * Output the FX.25 correlation tag LSB first.
+       * RLL encoding is not used in FX.25 tags and blocks.
+       */
+      while(iterator->hdlc_count > 0) {
+        if((iterator->inp_index % 8) == 0)
+          iterator->hdlc_code = iterator->fx25_mode->tag
+              >> (8 * (FX25_TAG_SIZE - iterator->hdlc_count));
+        if(pktEncodeFrameHDLC(iterator))
+          /* True means the requested count has been reached. */
+          return iterator->qty;
+      } /* End while. */
+      /* The block data starts with the opening flag. */
+      iterator->state = ITERATE_FX25_OPEN;
       iterator->hdlc_code = HDLC_FLAG;
+      iterator->hdlc_count = 1;
       iterator->inp_index = 0;
+      pktIteratorStartCode(iterator);
       continue;
-      } /* End case ITERATE_CRC. */
+      } /* End case ITERATE_FX25_TAG. */
+
+    case ITERATE_FX25_OPEN: {
+      /*
+       * Output the opening flag of the frame in the block.
+       */
+      while(iterator->hdlc_count > 0) {
+        if(pktEncodeFrameHDLC(iterator))
+          /* True means the requested count has been reached. */
+          return iterator->qty;
+      } /* End while. */
+      iterator->state = ITERATE_FRAME;
+      iterator->inp_index = 0;
+      continue;
+      } /* End case ITERATE_FX25_OPEN. */
+
+    case ITERATE_FX25_PAD: {
+      /*
+       * Fill the block data with flag bits.
+       * The first flag closes the frame.
+       */
+      while(iterator->rs_bits < iterator->fx25_mode->data_size * 8U) {
+        uint8_t bit = (HDLC_FLAG >> (iterator->inp_index++ % 8)) & 0x1;
+        if(pktIteratorWriteStreamBit(iterator, bit))
+          /* True means the requested count has been reached. */
+          return iterator->qty;
+      } /* End while. */
+      iterator->rs_pack = false;
+      iterator->state = ITERATE_FX25_CHECK;
+      iterator->data_buff = iterator->rs_check;
+      iterator->data_size = sizeof(iterator->rs_check);
+      iterator->inp_index = 0;
+      continue;
+      } /* End case ITERATE_FX25_PAD. */
+
+    case ITERATE_FX25_CHECK: {
+      /*
+       * Output the check bytes of the block.
+       */
+      while(iterator->data_size > 0) {
+        if(pktEncodeFrameBlock(iterator))
+          /* True means the requested count has been reached. */
+          return iterator->qty;
+      } /* End while. */
+      pktIteratorEndFrame(iterator);
+      continue;
+      } /* End case ITERATE_FX25_CHECK. */
+#endif
+
+#if PKT_TX_USE_IL2P == TRUE
+    case ITERATE_IL2P_SYNC: {
+      /*
+       * Output the IL2P sync word LSB first.
+       * RLL encoding is not used in IL2P frames.
+       */
+      while(iterator->hdlc_count > 0) {
+        if((iterator->inp_index % 8) == 0)
+          iterator->hdlc_code = IL2P_SYNC_WORD
+              >> (8 * (IL2P_SYNC_SIZE - iterator->hdlc_count));
+        if(pktEncodeFrameHDLC(iterator))
+          /* True means the requested count has been reached. */
+          return iterator->qty;
+      } /* End while. */
+      iterator->state = ITERATE_IL2P_HEADER;
+      iterator->data_buff = iterator->il2p_header;
+      iterator->data_size = sizeof(iterator->il2p_header);
+      iterator->inp_index = 0;
+      pktIteratorStartCode(iterator);
+      continue;
+      } /* End case ITERATE_IL2P_SYNC. */
+
+    case ITERATE_IL2P_HEADER:
+    case ITERATE_IL2P_BLOCK: {
+      /*
+       * Output the header or a payload block.
+       */
+      while(iterator->data_size > 0) {
+        if(pktEncodeFrameBlock(iterator))
+          /* True means the requested count has been reached. */
+          return iterator->qty;
+      } /* End while. */
+      iterator->rs_pack = false;
+      iterator->state = ITERATE_IL2P_CHECK;
+      iterator->data_buff = iterator->rs_check;
+      iterator->data_size = sizeof(iterator->rs_check);
+      iterator->inp_index = 0;
+      continue;
+      } /* End case ITERATE_IL2P_BLOCK. */
+
+    case ITERATE_IL2P_CHECK: {
+      /*
+       * Output the check bytes of the block.
+       * Then the next payload block or the end of the frame.
+       */
+      while(iterator->data_size > 0) {
+        if(pktEncodeFrameBlock(iterator))
+          /* True means the requested count has been reached. */
+          return iterator->qty;
+      } /* End while. */
+      uint8_t size = pktIL2PBlockSize(iterator->il2p_count,
+                                      iterator->il2p_block++);
+      if(size == 0) {
+        pktIteratorEndFrame(iterator);
+        continue;
+      }
+      iterator->state = ITERATE_IL2P_BLOCK;
+      iterator->data_buff = iterator->il2p_data;
+      iterator->data_size = size;
+      iterator->il2p_data += size;
+      iterator->inp_index = 0;
+      pktIteratorStartCode(iterator);
+      continue;
+      } /* End case ITERATE_IL2P_CHECK. */
+#endif
+
+    case ITERATE_GAP: {
+      /*
+       * Output flags between frames of a burst.
+       * RLL encoding is not used as these are HDLC flags.
+       */
+      while(iterator->hdlc_count > 0) {
+        if(pktEncodeFrameHDLC(iterator))
+          /* True means the requested count has been reached. */
+          return iterator->qty;
+      } /* End while. */
+      /* Start the next frame. */
+      packet_t pp = iterator->next;
+      iterator->next = pp->nextp;
+      iterator->frames_left--;
+      pktIteratorLoadFrame(iterator, pp);
+      pktIteratorStartFrame(iterator);
+      continue;
+      } /* End case ITERATE_GAP. */
 
     case ITERATE_CLOSE: {
       /*
@@ -304,13 +745,17 @@ uint16_t pktStreamEncodingIterator(tx_iterator_t *iterator,
     } /* End case ITERATE_TAIL. */
 
     case ITERATE_FINAL: {
-      if(iterator->hdlc_count <= iterator->qty) {
-        iterator->state = ITERATE_END;
-        return (iterator->out_count + iterator->hdlc_count);
-      } else {
-        iterator->hdlc_count -= iterator->qty;
-        return iterator->qty;
-      }
+      /*
+       * Output tail zeros to cover RLL inserted bits.
+       * Writing these allows the stream to be consumed in chunks.
+       */
+      while(iterator->hdlc_count > 0) {
+        if(pktEncodeFrameHDLC(iterator))
+          /* True means the requested count has been reached. */
+          return iterator->qty;
+      } /* End while. */
+      iterator->state = ITERATE_END;
+      return iterator->out_count;
     } /* End case ITERATE_FINAL. */
     } /* End switch on state. */
   } /* End while. */
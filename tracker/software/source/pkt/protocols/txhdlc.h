@@ -26,6 +26,9 @@
 
 #define ITERATOR_MAX_QTY        0xFFFF
 
+/* Frames streamed in one burst at most. */
+#define ITERATOR_MAX_FRAMES     32
+
 /*===========================================================================*/
 /* Module data structures and types.                                         */
 /*===========================================================================*/
@@ -35,6 +38,15 @@ typedef enum {
   ITERATE_PREAMBLE,
   ITERATE_FRAME,
   ITERATE_CRC,
+  ITERATE_FX25_TAG,
+  ITERATE_FX25_OPEN,
+  ITERATE_FX25_PAD,
+  ITERATE_FX25_CHECK,
+  ITERATE_IL2P_SYNC,
+  ITERATE_IL2P_HEADER,
+  ITERATE_IL2P_BLOCK,
+  ITERATE_IL2P_CHECK,
+  ITERATE_GAP,
   ITERATE_CLOSE,
   ITERATE_TAIL,
   ITERATE_FINAL,
@@ -49,6 +61,10 @@ typedef struct {
   uint8_t   hdlc_count;
   uint8_t   hdlc_post;
   uint8_t   hdlc_tail;
+  uint8_t   hdlc_gap;
+  uint8_t   frames;
+  uint8_t   frames_left;
+  packet_t  next;
   uint8_t   *data_buff;
   uint16_t  data_size;
   uint8_t   *out_buff;
@@ -61,6 +77,25 @@ typedef struct {
   uint8_t   rll_count;
   bool      scramble;
   uint32_t  lfsr;
+#if PKT_TX_USE_FX25 == TRUE
+  /* FX.25 mode of the current frame or NULL for plain HDLC. */
+  const fx25_mode_t *fx25_mode;
+#endif
+#if PKT_TX_USE_IL2P == TRUE
+  /* IL2P frame and its header, payload and next payload block. */
+  bool      il2p;
+  uint8_t   il2p_header[IL2P_HEADER_SIZE];
+  uint8_t   *il2p_data;
+  uint16_t  il2p_count;
+  uint8_t   il2p_block;
+#endif
+#if PKT_TX_USE_FX25 == TRUE || PKT_TX_USE_IL2P == TRUE
+  /* Reed-Solomon coding of the block being sent. */
+  bool      rs_pack;
+  uint16_t  rs_bits;
+  uint8_t   rs_byte;
+  uint8_t   rs_check[FX25_CHECK_SIZE];
+#endif
 } tx_iterator_t;
 
 /*===========================================================================*/
@@ -72,12 +107,21 @@ extern "C" {
 #endif
   uint16_t pktStreamEncodingIterator(tx_iterator_t *iterator,
                                      uint8_t *stream, uint16_t qty);
+  uint16_t pktStreamFrameSize(packet_t pp, uint32_t *rll);
   void pktStreamIteratorInit(tx_iterator_t *iterator,
                              packet_t pp,
                              uint8_t pre,
                              uint8_t post,
                              uint8_t tail,
                              bool scramble);
+  void pktStreamIteratorInitBurst(tx_iterator_t *iterator,
+                                  packet_t pp,
+                                  uint8_t pre,
+                                  uint8_t gap,
+                                  uint8_t post,
+                                  uint8_t tail,
+                                  bool scramble,
+                                  uint16_t limit);
 #ifdef __cplusplus
 }
 #endif
@@ -19,175 +19,305 @@
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
+#include <strings.h>
+#include <ctype.h>
 #include "debug.h"
 #include "base91.h"
 #include "digipeater.h"
+#include "budget.h"
 #include "dedupe.h"
+#include "heard.h"
+#include "txpower.h"
+#include "relay.h"
+#include "aprsmsg.h"
 #include "radio.h"
-#include "flash.h"
+#include "confstore.h"
 #include "image.h"
 #include "beacon.h"
 #include "threads.h"
+#include "log.h"
+#include "stats.h"
+#include "tseries.h"
 
 #define METER_TO_FEET(m) (((m)*26876) / 8192)
 
-typedef struct {
-	sysinterval_t time;
-	char call[AX25_MAX_ADDR_LEN];
-} heard_t;
-
 
 static uint16_t msg_id;
 char alias_re[] = "WIDE[4-7]-[1-7]|CITYD";
 char wide_re[] = "WIDE[1-7]-[1-7]";
+static digi_pattern_t alias_pat;
+static digi_pattern_t wide_pat;
 enum preempt_e preempt = PREEMPT_OFF;
-static heard_t heard_list[APRS_HEARD_LIST_SIZE];
 static bool dedupe_initialized;
 
+/* Path aliases skipped to find the station heard directly. */
+static const ax25_addr_match_t wide_prefix = {
+	AX25_KEY_CHAR('W', 0) | AX25_KEY_CHAR('I', 1) | AX25_KEY_CHAR('D', 2)
+	| AX25_KEY_CHAR('E', 3),
+	AX25_KEY_PREFIX_MASK(4)
+};
+static const ax25_addr_match_t trace_prefix = {
+	AX25_KEY_CHAR('T', 0) | AX25_KEY_CHAR('R', 1) | AX25_KEY_CHAR('A', 2)
+	| AX25_KEY_CHAR('C', 3) | AX25_KEY_CHAR('E', 4),
+	AX25_KEY_PREFIX_MASK(5)
+};
+
+/* Digipeats held back in viscous mode. */
+typedef struct {
+	packet_t pp;
+	unsigned short crc;
+	systime_t release;
+} digi_hold_t;
+
+static digi_hold_t digi_hold[APRS_DIGI_HOLD_SIZE];
+static MUTEX_DECL(digi_hold_mtx);
+static BSEMAPHORE_DECL(digi_hold_sem, true);
+
+/*
+ * Digipeat airtime by source station.
+ * Each source has a share of the digipeat budget so one station can not
+ * use all of it. The least recently used source is replaced.
+ */
+typedef struct {
+	ax25_addr_key_t source;
+	int32_t tokens;		/* Airtime available in ms, negative if overdrawn */
+	systime_t refill;	/* Time up to which the bucket is filled */
+} digi_rate_t;
+
+static digi_rate_t digi_rate[APRS_DIGI_RATE_SOURCES];
+static MUTEX_DECL(digi_rate_mtx);
+static STATS_DECL(digi_stats_sent, "digi sent");
+static STATS_DECL(digi_stats_source, "digi source limited");
+static STATS_DECL(digi_stats_budget, "digi budget limited");
+
+/* Pre-encoded headers for the beacon, telemetry and image encoders. */
+typedef struct {
+	char call[AX25_MAX_ADDR_LEN];
+	char path[APRS_HEADER_PATH_LEN];
+	ax25_header_t hdr;
+} aprs_header_cache_t;
+
+static aprs_header_cache_t header_cache[APRS_HEADER_CACHE_SIZE];
+static uint8_t header_next;
+static MUTEX_DECL(header_mtx);
+static conf_watch_t header_watch;
+
+/* Config groups holding call signs and paths used for headers. */
+#define APRS_HEADER_CHANGES     (CONF_CHG_POS_PRI | CONF_CHG_POS_SEC        \
+                                 | CONF_CHG_IMG_PRI | CONF_CHG_IMG_SEC      \
+                                 | CONF_CHG_LOG | CONF_CHG_APRS_TX          \
+                                 | CONF_CHG_BASE)
+
+/*
+ * Table of configuration parameters.
+ * Sorted by name (ignoring case) for binary search.
+ * Values are checked against the range of the entry before they are set.
+ * A CONF_INT_DEFAULT entry also takes 0 to select the default.
+ * Times are given in milliseconds.
+ */
+#define CONF_TIME_MAX           86400000    /* One day */
+#define CONF_FREQ_MAX           1000000000
+#define CONF_SPEED_MAX          100000
+#define CONF_BUF_SIZE_MAX       (256*1024)
+
+#define CONF_INT(name, field, min, max, chg)                                  \
+  {TYPE_INT, name, sizeof(conf_sram.field), &conf_sram.field, min, max, chg}
+#define CONF_INT_DEFAULT(name, field, min, max, chg)                          \
+  {TYPE_INT_DEFAULT, name, sizeof(conf_sram.field), &conf_sram.field, min,  \
+   max, chg}
+#define CONF_TIME(name, field, chg)                                           \
+  {TYPE_TIME, name, sizeof(conf_sram.field), &conf_sram.field, 0,           \
+   CONF_TIME_MAX, chg}
+#define CONF_STR(name, field, chg)                                            \
+  {TYPE_STR, name, sizeof(conf_sram.field), &conf_sram.field, 0, 0, chg}
+
 const conf_command_t command_list[] = {
-	{TYPE_INT,  "pos_pri.active",                sizeof(conf_sram.pos_pri.beacon.active),                     &conf_sram.pos_pri.beacon.active                    },
-	{TYPE_TIME, "pos_pri.init_delay",            sizeof(conf_sram.pos_pri.beacon.init_delay),                 &conf_sram.pos_pri.beacon.init_delay                },
-	{TYPE_INT,  "pos_pri.sleep_conf.type",       sizeof(conf_sram.pos_pri.beacon.sleep_conf.type),            &conf_sram.pos_pri.beacon.sleep_conf.type           },
-	{TYPE_INT,  "pos_pri.sleep_conf.vbat_thres", sizeof(conf_sram.pos_pri.beacon.sleep_conf.vbat_thres),      &conf_sram.pos_pri.beacon.sleep_conf.vbat_thres     },
-	{TYPE_INT,  "pos_pri.sleep_conf.vsol_thres", sizeof(conf_sram.pos_pri.beacon.sleep_conf.vsol_thres),      &conf_sram.pos_pri.beacon.sleep_conf.vsol_thres     },
-	{TYPE_TIME, "pos_pri.cycle",                 sizeof(conf_sram.pos_pri.beacon.cycle),                      &conf_sram.pos_pri.beacon.cycle                     },
-	{TYPE_INT,  "pos_pri.pwr",                   sizeof(conf_sram.pos_pri.radio_conf.pwr),                    &conf_sram.pos_pri.radio_conf.pwr                   },
-	{TYPE_INT,  "pos_pri.freq",                  sizeof(conf_sram.pos_pri.radio_conf.freq),                   &conf_sram.pos_pri.radio_conf.freq                  },
-    {TYPE_INT,  "pos_pri.mod",                   sizeof(conf_sram.pos_pri.radio_conf.mod),                    &conf_sram.pos_pri.radio_conf.mod                   },
-    {TYPE_INT,  "pos_pri.cca",                   sizeof(conf_sram.pos_pri.radio_conf.cca),                    &conf_sram.pos_pri.radio_conf.cca                   },
-	{TYPE_STR,  "pos_pri.call",                  sizeof(conf_sram.pos_pri.call),                              &conf_sram.pos_pri.call                             },
-	{TYPE_STR,  "pos_pri.path",                  sizeof(conf_sram.pos_pri.path),                              &conf_sram.pos_pri.path                             },
-	{TYPE_INT,  "pos_pri.symbol",                sizeof(conf_sram.pos_pri.symbol),                            &conf_sram.pos_pri.symbol                           },
-    {TYPE_INT,  "pos_pri.aprs_msg",              sizeof(conf_sram.pos_pri.aprs_msg),                          &conf_sram.pos_pri.aprs_msg                         },
-
-	{TYPE_INT,  "pos_sec.active",                sizeof(conf_sram.pos_sec.beacon.active),                     &conf_sram.pos_sec.beacon.active                    },
-	{TYPE_TIME, "pos_sec.init_delay",            sizeof(conf_sram.pos_sec.beacon.init_delay),                 &conf_sram.pos_sec.beacon.init_delay                },
-	{TYPE_INT,  "pos_sec.sleep_conf.type",       sizeof(conf_sram.pos_sec.beacon.sleep_conf.type),            &conf_sram.pos_sec.beacon.sleep_conf.type           },
-	{TYPE_INT,  "pos_sec.sleep_conf.vbat_thres", sizeof(conf_sram.pos_sec.beacon.sleep_conf.vbat_thres),      &conf_sram.pos_sec.beacon.sleep_conf.vbat_thres     },
-	{TYPE_INT,  "pos_sec.sleep_conf.vsol_thres", sizeof(conf_sram.pos_sec.beacon.sleep_conf.vsol_thres),      &conf_sram.pos_sec.beacon.sleep_conf.vsol_thres     },
-	{TYPE_TIME, "pos_sec.cycle",                 sizeof(conf_sram.pos_sec.beacon.cycle),                      &conf_sram.pos_sec.beacon.cycle                     },
-	{TYPE_INT,  "pos_sec.pwr",                   sizeof(conf_sram.pos_sec.radio_conf.pwr),                    &conf_sram.pos_sec.radio_conf.pwr                   },
-	{TYPE_INT,  "pos_sec.freq",                  sizeof(conf_sram.pos_sec.radio_conf.freq),                   &conf_sram.pos_sec.radio_conf.freq                  },
-	{TYPE_INT,  "pos_sec.mod",                   sizeof(conf_sram.pos_sec.radio_conf.mod),                    &conf_sram.pos_sec.radio_conf.mod                   },
-    {TYPE_INT,  "pos_sec.cca",                   sizeof(conf_sram.pos_sec.radio_conf.cca),                    &conf_sram.pos_sec.radio_conf.cca                   },
-	{TYPE_STR,  "pos_sec.call",                  sizeof(conf_sram.pos_sec.call),                              &conf_sram.pos_sec.call                             },
-	{TYPE_STR,  "pos_sec.path",                  sizeof(conf_sram.pos_sec.path),                              &conf_sram.pos_sec.path                             },
-	{TYPE_INT,  "pos_sec.symbol",                sizeof(conf_sram.pos_sec.symbol),                            &conf_sram.pos_sec.symbol                           },
-    {TYPE_INT,  "pos_sec.aprs_msg",              sizeof(conf_sram.pos_sec.aprs_msg),                          &conf_sram.pos_sec.aprs_msg                         },
-
-	{TYPE_INT,  "img_pri.active",                sizeof(conf_sram.img_pri.svc_conf.active),                   &conf_sram.img_pri.svc_conf.active                  },
-	{TYPE_TIME, "img_pri.init_delay",            sizeof(conf_sram.img_pri.svc_conf.init_delay),               &conf_sram.img_pri.svc_conf.init_delay              },
-	{TYPE_TIME, "img_pri.send_spacing",          sizeof(conf_sram.img_pri.svc_conf.send_spacing),             &conf_sram.img_pri.svc_conf.send_spacing            },
-	{TYPE_INT,  "img_pri.sleep_conf.type",       sizeof(conf_sram.img_pri.svc_conf.sleep_conf.type),          &conf_sram.img_pri.svc_conf.sleep_conf.type         },
-	{TYPE_INT,  "img_pri.sleep_conf.vbat_thres", sizeof(conf_sram.img_pri.svc_conf.sleep_conf.vbat_thres),    &conf_sram.img_pri.svc_conf.sleep_conf.vbat_thres   },
-	{TYPE_INT,  "img_pri.sleep_conf.vsol_thres", sizeof(conf_sram.img_pri.svc_conf.sleep_conf.vsol_thres),    &conf_sram.img_pri.svc_conf.sleep_conf.vsol_thres   },
-	{TYPE_TIME, "img_pri.cycle",                 sizeof(conf_sram.img_pri.svc_conf.cycle),                    &conf_sram.img_pri.svc_conf.cycle                   },
-	{TYPE_INT,  "img_pri.pwr",                   sizeof(conf_sram.img_pri.radio_conf.pwr),                    &conf_sram.img_pri.radio_conf.pwr                   },
-    {TYPE_INT,  "img_pri.freq",                  sizeof(conf_sram.img_pri.radio_conf.freq),                   &conf_sram.img_pri.radio_conf.freq                  },
-	{TYPE_INT,  "img_pri.mod",                   sizeof(conf_sram.img_pri.radio_conf.mod),                    &conf_sram.img_pri.radio_conf.mod                   },
-    {TYPE_INT,  "img_pri.cca",                   sizeof(conf_sram.img_pri.radio_conf.cca),                    &conf_sram.img_pri.radio_conf.cca                   },
-	{TYPE_INT,  "img_pri.speed",                 sizeof(conf_sram.img_pri.radio_conf.speed),                  &conf_sram.img_pri.radio_conf.speed                 },
-	{TYPE_INT,  "img_pri.redundantTx",           sizeof(conf_sram.img_pri.redundantTx),                       &conf_sram.img_pri.redundantTx                      },
-	{TYPE_STR,  "img_pri.call",                  sizeof(conf_sram.img_pri.call),                              &conf_sram.img_pri.call                             },
-	{TYPE_STR,  "img_pri.path",                  sizeof(conf_sram.img_pri.path),                              &conf_sram.img_pri.path                             },
-	{TYPE_INT,  "img_pri.res",                   sizeof(conf_sram.img_pri.res),                               &conf_sram.img_pri.res                              },
-	{TYPE_INT,  "img_pri.quality",               sizeof(conf_sram.img_pri.quality),                           &conf_sram.img_pri.quality                          },
-	{TYPE_INT,  "img_pri.buf_size",              sizeof(conf_sram.img_pri.buf_size),                          &conf_sram.img_pri.buf_size                         },
-
-	{TYPE_INT,  "img_sec.active",                sizeof(conf_sram.img_sec.svc_conf.active),                   &conf_sram.img_sec.svc_conf.active                  },
-	{TYPE_TIME, "img_sec.init_delay",            sizeof(conf_sram.img_sec.svc_conf.init_delay),               &conf_sram.img_sec.svc_conf.init_delay              },
-	{TYPE_TIME, "img_sec.send_spacing",          sizeof(conf_sram.img_sec.svc_conf.send_spacing),             &conf_sram.img_sec.svc_conf.send_spacing            },
-	{TYPE_INT,  "img_sec.sleep_conf.type",       sizeof(conf_sram.img_sec.svc_conf.sleep_conf.type),          &conf_sram.img_sec.svc_conf.sleep_conf.type         },
-	{TYPE_INT,  "img_sec.sleep_conf.vbat_thres", sizeof(conf_sram.img_sec.svc_conf.sleep_conf.vbat_thres),    &conf_sram.img_sec.svc_conf.sleep_conf.vbat_thres   },
-	{TYPE_INT,  "img_sec.sleep_conf.vsol_thres", sizeof(conf_sram.img_sec.svc_conf.sleep_conf.vsol_thres),    &conf_sram.img_sec.svc_conf.sleep_conf.vsol_thres   },
-	{TYPE_TIME, "img_sec.cycle",                 sizeof(conf_sram.img_sec.svc_conf.cycle),                    &conf_sram.img_sec.svc_conf.cycle                   },
-	{TYPE_INT,  "img_sec.pwr",                   sizeof(conf_sram.img_sec.radio_conf.pwr),                    &conf_sram.img_sec.radio_conf.pwr                   },
-	{TYPE_INT,  "img_sec.freq",                  sizeof(conf_sram.img_sec.radio_conf.freq),                   &conf_sram.img_sec.radio_conf.freq                  },
-	{TYPE_INT,  "img_sec.mod",                   sizeof(conf_sram.img_sec.radio_conf.mod),                    &conf_sram.img_sec.radio_conf.mod                   },
-    {TYPE_INT,  "img_sec.cca",                   sizeof(conf_sram.img_sec.radio_conf.cca),                    &conf_sram.img_sec.radio_conf.cca                   },
-	{TYPE_INT,  "img_sec.speed",                 sizeof(conf_sram.img_sec.radio_conf.speed),                  &conf_sram.img_sec.radio_conf.speed                 },
-	{TYPE_INT,  "img_sec.redundantTx",           sizeof(conf_sram.img_sec.redundantTx),                       &conf_sram.img_sec.redundantTx                      },
-	{TYPE_STR,  "img_sec.call",                  sizeof(conf_sram.img_sec.call),                              &conf_sram.img_sec.call                             },
-	{TYPE_STR,  "img_sec.path",                  sizeof(conf_sram.img_sec.path),                              &conf_sram.img_sec.path                             },
-	{TYPE_INT,  "img_sec.res",                   sizeof(conf_sram.img_sec.res),                               &conf_sram.img_sec.res                              },
-	{TYPE_INT,  "img_sec.quality",               sizeof(conf_sram.img_sec.quality),                           &conf_sram.img_sec.quality                          },
-	{TYPE_INT,  "img_sec.buf_size",              sizeof(conf_sram.img_sec.buf_size),                          &conf_sram.img_sec.buf_size                         },
-
-	{TYPE_INT,  "log.active",                    sizeof(conf_sram.log.svc_conf.active),                       &conf_sram.log.svc_conf.active                      },
-	{TYPE_TIME, "log.init_delay",                sizeof(conf_sram.log.svc_conf.init_delay),                   &conf_sram.log.svc_conf.init_delay                  },
-	{TYPE_TIME, "log.send_spacing",              sizeof(conf_sram.log.svc_conf.send_spacing),                 &conf_sram.log.svc_conf.send_spacing                },
-	{TYPE_INT,  "log.sleep_conf.type",           sizeof(conf_sram.log.svc_conf.sleep_conf.type),              &conf_sram.log.svc_conf.sleep_conf.type             },
-	{TYPE_INT,  "log.sleep_conf.vbat_thres",     sizeof(conf_sram.log.svc_conf.sleep_conf.vbat_thres),        &conf_sram.log.svc_conf.sleep_conf.vbat_thres       },
-	{TYPE_INT,  "log.sleep_conf.vsol_thres",     sizeof(conf_sram.log.svc_conf.sleep_conf.vsol_thres),        &conf_sram.log.svc_conf.sleep_conf.vsol_thres       },
-	{TYPE_TIME, "log.cycle",                     sizeof(conf_sram.log.svc_conf.cycle),                        &conf_sram.log.svc_conf.cycle                       },
-	{TYPE_INT,  "log.pwr",                       sizeof(conf_sram.log.radio_conf.pwr),                        &conf_sram.log.radio_conf.pwr                       },
-	{TYPE_INT,  "log.freq",                      sizeof(conf_sram.log.radio_conf.freq),                       &conf_sram.log.radio_conf.freq                      },
-	{TYPE_INT,  "log.mod",                       sizeof(conf_sram.log.radio_conf.mod),                        &conf_sram.log.radio_conf.mod                       },
-    {TYPE_INT,  "log.cca",                       sizeof(conf_sram.log.radio_conf.cca),                        &conf_sram.log.radio_conf.cca                       },
-	{TYPE_INT,  "log.speed",                     sizeof(conf_sram.log.radio_conf.speed),                      &conf_sram.log.radio_conf.speed                     },
-	{TYPE_STR,  "log.call",                      sizeof(conf_sram.log.call),                                  &conf_sram.log.call                                 },
-	{TYPE_STR,  "log.path",                      sizeof(conf_sram.log.path),                                  &conf_sram.log.path                                 },
-	{TYPE_INT,  "log.density",                   sizeof(conf_sram.log.density),                               &conf_sram.log.density                              },
-
-	{TYPE_INT,  "aprs.rx.active",                sizeof(conf_sram.aprs.rx.svc_conf.active),                   &conf_sram.aprs.rx.svc_conf.active                  },
-	{TYPE_TIME, "aprs.rx.init_delay",            sizeof(conf_sram.aprs.rx.svc_conf.init_delay),               &conf_sram.aprs.rx.svc_conf.init_delay              },
-
-	{TYPE_INT,  "aprs.rx.freq",                  sizeof(conf_sram.aprs.rx.radio_conf.freq),                   &conf_sram.aprs.rx.radio_conf.freq                  },
-	{TYPE_INT,  "aprs.rx.mod",                   sizeof(conf_sram.aprs.rx.radio_conf.mod),                    &conf_sram.aprs.rx.radio_conf.mod                   },
-	{TYPE_INT,  "aprs.rx.speed",                 sizeof(conf_sram.aprs.rx.radio_conf.speed),                  &conf_sram.aprs.rx.radio_conf.speed                 },
-    {TYPE_STR,  "aprs.rx.call",                  sizeof(conf_sram.aprs.rx.call),                              &conf_sram.aprs.rx.call                             },
-
-    {TYPE_INT,  "aprs.digi",                     sizeof(conf_sram.aprs.digi),                                 &conf_sram.aprs.digi                                },
-	{TYPE_INT,  "aprs.tx.freq",                  sizeof(conf_sram.aprs.tx.radio_conf.freq),                   &conf_sram.aprs.tx.radio_conf.freq                  },
-    {TYPE_INT,  "aprs.tx.pwr",                   sizeof(conf_sram.aprs.tx.radio_conf.pwr),                    &conf_sram.aprs.tx.radio_conf.pwr                   },
-    {TYPE_INT,  "aprs.tx.mod",                   sizeof(conf_sram.aprs.tx.radio_conf.mod),                    &conf_sram.aprs.tx.radio_conf.mod                   },
-	{TYPE_INT,  "aprs.tx.cca",                   sizeof(conf_sram.aprs.tx.radio_conf.cca),                    &conf_sram.aprs.tx.radio_conf.cca                   },
-    {TYPE_STR,  "aprs.tx.call",                  sizeof(conf_sram.aprs.tx.call),                              &conf_sram.aprs.tx.call                             },
-    {TYPE_STR,  "aprs.tx.path",                  sizeof(conf_sram.aprs.tx.path),                              &conf_sram.aprs.tx.path                             },
-    {TYPE_INT,  "aprs.tx.symbol",                sizeof(conf_sram.aprs.tx.symbol),                            &conf_sram.aprs.tx.symbol                           },
-
-    {TYPE_INT,  "aprs.beacon",                   sizeof(conf_sram.aprs.tx.beacon.active),                     &conf_sram.aprs.tx.beacon.active                    },
-    {TYPE_INT,  "aprs.beacon.lat",               sizeof(conf_sram.aprs.tx.beacon.lat),                        &conf_sram.aprs.tx.beacon.lat                       },
-    {TYPE_INT,  "aprs.beacon.lon",               sizeof(conf_sram.aprs.tx.beacon.lon),                        &conf_sram.aprs.tx.beacon.lon                       },
-    {TYPE_INT,  "aprs.beacon.alt",               sizeof(conf_sram.aprs.tx.beacon.alt),                        &conf_sram.aprs.tx.beacon.alt                       },
-    {TYPE_INT,  "aprs.beacon.cycle",             sizeof(conf_sram.aprs.tx.beacon.cycle),                      &conf_sram.aprs.tx.beacon.cycle                     },
-
-    {TYPE_INT,  "keep_cam_switched_on",          sizeof(conf_sram.keep_cam_switched_on),                      &conf_sram.keep_cam_switched_on                     },
-	{TYPE_INT,  "gps_on_vbat",                   sizeof(conf_sram.gps_on_vbat),                               &conf_sram.gps_on_vbat                              },
-	{TYPE_INT,  "gps_off_vbat",                  sizeof(conf_sram.gps_off_vbat),                              &conf_sram.gps_off_vbat                             },
-	{TYPE_INT,  "gps_onper_vbat",                sizeof(conf_sram.gps_onper_vbat),                            &conf_sram.gps_onper_vbat                           },
-    {TYPE_INT,  "gps_pressure",                  sizeof(conf_sram.gps_pressure),                              &conf_sram.gps_pressure                             },
-    {TYPE_INT,  "gps_low_alt",                   sizeof(conf_sram.gps_low_alt),                               &conf_sram.gps_low_alt                              },
-    {TYPE_INT,  "gps_high_alt",                  sizeof(conf_sram.gps_high_alt),                              &conf_sram.gps_high_alt                             },
-
-    {TYPE_INT,  "default.freq",                  sizeof(conf_sram.freq),                                      &conf_sram.freq                                     },
-
-    {TYPE_INT,  "base.freq",                     sizeof(conf_sram.base.radio_conf.freq),                      &conf_sram.base.radio_conf.freq                     },
-    {TYPE_INT,  "base.pwr",                      sizeof(conf_sram.base.radio_conf.pwr),                       &conf_sram.base.radio_conf.pwr                      },
-    {TYPE_INT,  "base.mod",                      sizeof(conf_sram.base.radio_conf.mod),                       &conf_sram.base.radio_conf.mod                      },
-    {TYPE_INT,  "base.cca",                      sizeof(conf_sram.base.radio_conf.cca),                       &conf_sram.base.radio_conf.cca                      },
-    {TYPE_STR,  "base.call",                     sizeof(conf_sram.base.call),                                 &conf_sram.base.call                                },
-
-    {TYPE_TIME, "tel_enc_cycle",                 sizeof(conf_sram.tel_enc_cycle),                            &conf_sram.tel_enc_cycle                             },
-
-	{TYPE_NULL}
+	CONF_INT("aprs.beacon",                   aprs.tx.beacon.active,               0, 1, CONF_CHG_APRS_TX),
+	CONF_INT("aprs.beacon.alt",               aprs.tx.beacon.alt,                  -1000, 100000, CONF_CHG_APRS_TX),
+	CONF_TIME("aprs.beacon.cycle",            aprs.tx.beacon.cycle,                CONF_CHG_APRS_TX),
+	CONF_INT("aprs.beacon.lat",               aprs.tx.beacon.lat,                  -900000000, 900000000, CONF_CHG_APRS_TX),
+	CONF_INT("aprs.beacon.lon",               aprs.tx.beacon.lon,                  -1800000000, 1800000000, CONF_CHG_APRS_TX),
+	CONF_INT("aprs.digi",                     aprs.digi,                           0, 1, CONF_CHG_DIGI),
+	CONF_TIME("aprs.digi_hold",               aprs.digi_hold,                      CONF_CHG_DIGI),
+	CONF_STR("aprs.relay",                    aprs.relay,                          CONF_CHG_DIGI),
+	CONF_TIME("aprs.relay_hold",              aprs.relay_hold,                     CONF_CHG_DIGI),
+	CONF_INT("aprs.rx.active",                aprs.rx.svc_conf.active,             0, 1, CONF_CHG_APRS_RX),
+	CONF_STR("aprs.rx.call",                  aprs.rx.call,                        CONF_CHG_APRS_RX),
+	CONF_INT("aprs.rx.freq",                  aprs.rx.radio_conf.freq,             0, CONF_FREQ_MAX, CONF_CHG_APRS_RX),
+	CONF_TIME("aprs.rx.init_delay",           aprs.rx.svc_conf.init_delay,         CONF_CHG_APRS_RX),
+	CONF_INT("aprs.rx.mod",                   aprs.rx.radio_conf.mod,              MOD_NONE, MOD_2FSK, CONF_CHG_APRS_RX),
+	CONF_INT("aprs.rx.speed",                 aprs.rx.radio_conf.speed,            0, CONF_SPEED_MAX, CONF_CHG_APRS_RX),
+	CONF_STR("aprs.tx.call",                  aprs.tx.call,                        CONF_CHG_APRS_TX),
+	CONF_INT("aprs.tx.cca",                   aprs.tx.radio_conf.cca,              0, 0xFF, CONF_CHG_APRS_TX),
+	CONF_INT("aprs.tx.freq",                  aprs.tx.radio_conf.freq,             0, CONF_FREQ_MAX, CONF_CHG_APRS_TX),
+	CONF_INT("aprs.tx.mod",                   aprs.tx.radio_conf.mod,              MOD_NONE, MOD_2FSK, CONF_CHG_APRS_TX),
+	CONF_STR("aprs.tx.path",                  aprs.tx.path,                        CONF_CHG_APRS_TX),
+	CONF_INT("aprs.tx.pwr",                   aprs.tx.radio_conf.pwr,              0, 0x7F, CONF_CHG_APRS_TX),
+	CONF_INT("aprs.tx.symbol",                aprs.tx.symbol,                      0, 0xFFFF, CONF_CHG_APRS_TX),
+	CONF_STR("base.call",                     base.call,                           CONF_CHG_BASE),
+	CONF_INT("base.cca",                      base.radio_conf.cca,                 0, 0xFF, CONF_CHG_BASE),
+	CONF_INT("base.freq",                     base.radio_conf.freq,                0, CONF_FREQ_MAX, CONF_CHG_BASE),
+	CONF_INT("base.mod",                      base.radio_conf.mod,                 MOD_NONE, MOD_2FSK, CONF_CHG_BASE),
+	CONF_INT("base.pwr",                      base.radio_conf.pwr,                 0, 0x7F, CONF_CHG_BASE),
+	CONF_TIME("cam_standby",                  cam_standby,                         CONF_CHG_CAM),
+	CONF_INT("default.freq",                  freq,                                0, CONF_FREQ_MAX, CONF_CHG_GLOBAL),
+	CONF_INT("gps_high_alt",                  gps_high_alt,                        GPS_MODEL_AIRBORNE1G, GPS_MODEL_AIRBORNE4G, CONF_CHG_GPS),
+	CONF_INT("gps_low_alt",                   gps_low_alt,                         GPS_MODEL_PORTABLE, GPS_MODEL_SEA, CONF_CHG_GPS),
+	CONF_INT("gps_off_vbat",                  gps_off_vbat,                        0, 0xFFFF, CONF_CHG_GPS),
+	CONF_INT("gps_on_vbat",                   gps_on_vbat,                         0, 0xFFFF, CONF_CHG_GPS),
+	CONF_INT("gps_onper_vbat",                gps_onper_vbat,                      0, 0xFFFF, CONF_CHG_GPS),
+	CONF_INT("gps_pressure",                  gps_pressure,                        0, 200000, CONF_CHG_GPS),
+	CONF_INT("img_pri.active",                img_pri.svc_conf.active,             0, 1, CONF_CHG_IMG_PRI),
+	CONF_INT("img_pri.binary",                img_pri.binary,                      0, 1, CONF_CHG_IMG_PRI),
+	CONF_INT("img_pri.buf_size",              img_pri.buf_size,                    0, CONF_BUF_SIZE_MAX, CONF_CHG_IMG_PRI),
+	CONF_STR("img_pri.call",                  img_pri.call,                        CONF_CHG_IMG_PRI),
+	CONF_INT("img_pri.cca",                   img_pri.radio_conf.cca,              0, 0xFF, CONF_CHG_IMG_PRI),
+	CONF_TIME("img_pri.cycle",                img_pri.svc_conf.cycle,              CONF_CHG_IMG_PRI),
+	CONF_INT("img_pri.delta",                 img_pri.delta,                       0, 0xFF, CONF_CHG_IMG_PRI),
+	CONF_INT("img_pri.freq",                  img_pri.radio_conf.freq,             0, CONF_FREQ_MAX, CONF_CHG_IMG_PRI),
+	CONF_TIME("img_pri.init_delay",           img_pri.svc_conf.init_delay,         CONF_CHG_IMG_PRI),
+	CONF_INT("img_pri.link",                  img_pri.radio_conf.link,             LINK_AX25, LINK_IL2P, CONF_CHG_IMG_PRI),
+	CONF_INT("img_pri.max_packets",           img_pri.max_packets,                 0, 0xFFFF, CONF_CHG_IMG_PRI),
+	CONF_INT("img_pri.mod",                   img_pri.radio_conf.mod,              MOD_NONE, MOD_2FSK, CONF_CHG_IMG_PRI),
+	CONF_STR("img_pri.path",                  img_pri.path,                        CONF_CHG_IMG_PRI),
+	CONF_INT("img_pri.progressive",           img_pri.progressive,                 0, 1, CONF_CHG_IMG_PRI),
+	CONF_INT("img_pri.pwr",                   img_pri.radio_conf.pwr,              0, 0x7F, CONF_CHG_IMG_PRI),
+	CONF_INT("img_pri.quality",               img_pri.quality,                     0, 7, CONF_CHG_IMG_PRI),
+	CONF_INT("img_pri.redundantTx",           img_pri.redundantTx,                 0, 1, CONF_CHG_IMG_PRI),
+	CONF_INT("img_pri.res",                   img_pri.res,                         RES_NONE, RES_MAX - 1, CONF_CHG_IMG_PRI),
+	CONF_TIME("img_pri.send_spacing",         img_pri.svc_conf.send_spacing,       CONF_CHG_IMG_PRI),
+	CONF_INT("img_pri.sleep_conf.type",       img_pri.svc_conf.sleep_conf.type,    SLEEP_DISABLED, SLEEP_WHEN_CHARGING, CONF_CHG_IMG_PRI),
+	CONF_INT("img_pri.sleep_conf.vbat_thres", img_pri.svc_conf.sleep_conf.vbat_thres, 0, 0xFFFF, CONF_CHG_IMG_PRI),
+	CONF_INT("img_pri.sleep_conf.vsol_thres", img_pri.svc_conf.sleep_conf.vsol_thres, 0, 0xFFFF, CONF_CHG_IMG_PRI),
+	CONF_INT("img_pri.speed",                 img_pri.radio_conf.speed,            0, CONF_SPEED_MAX, CONF_CHG_IMG_PRI),
+	CONF_INT_DEFAULT("img_pri.ssdv_size",     img_pri.ssdv_size,                   IMG_SSDV_DATA_MIN, IMG_SSDV_DATA_MAX, CONF_CHG_IMG_PRI),
+	CONF_INT("img_sec.active",                img_sec.svc_conf.active,             0, 1, CONF_CHG_IMG_SEC),
+	CONF_INT("img_sec.binary",                img_sec.binary,                      0, 1, CONF_CHG_IMG_SEC),
+	CONF_INT("img_sec.buf_size",              img_sec.buf_size,                    0, CONF_BUF_SIZE_MAX, CONF_CHG_IMG_SEC),
+	CONF_STR("img_sec.call",                  img_sec.call,                        CONF_CHG_IMG_SEC),
+	CONF_INT("img_sec.cca",                   img_sec.radio_conf.cca,              0, 0xFF, CONF_CHG_IMG_SEC),
+	CONF_TIME("img_sec.cycle",                img_sec.svc_conf.cycle,              CONF_CHG_IMG_SEC),
+	CONF_INT("img_sec.delta",                 img_sec.delta,                       0, 0xFF, CONF_CHG_IMG_SEC),
+	CONF_INT("img_sec.freq",                  img_sec.radio_conf.freq,             0, CONF_FREQ_MAX, CONF_CHG_IMG_SEC),
+	CONF_TIME("img_sec.init_delay",           img_sec.svc_conf.init_delay,         CONF_CHG_IMG_SEC),
+	CONF_INT("img_sec.link",                  img_sec.radio_conf.link,             LINK_AX25, LINK_IL2P, CONF_CHG_IMG_SEC),
+	CONF_INT("img_sec.max_packets",           img_sec.max_packets,                 0, 0xFFFF, CONF_CHG_IMG_SEC),
+	CONF_INT("img_sec.mod",                   img_sec.radio_conf.mod,              MOD_NONE, MOD_2FSK, CONF_CHG_IMG_SEC),
+	CONF_STR("img_sec.path",                  img_sec.path,                        CONF_CHG_IMG_SEC),
+	CONF_INT("img_sec.progressive",           img_sec.progressive,                 0, 1, CONF_CHG_IMG_SEC),
+	CONF_INT("img_sec.pwr",                   img_sec.radio_conf.pwr,              0, 0x7F, CONF_CHG_IMG_SEC),
+	CONF_INT("img_sec.quality",               img_sec.quality,                     0, 7, CONF_CHG_IMG_SEC),
+	CONF_INT("img_sec.redundantTx",           img_sec.redundantTx,                 0, 1, CONF_CHG_IMG_SEC),
+	CONF_INT("img_sec.res",                   img_sec.res,                         RES_NONE, RES_MAX - 1, CONF_CHG_IMG_SEC),
+	CONF_TIME("img_sec.send_spacing",         img_sec.svc_conf.send_spacing,       CONF_CHG_IMG_SEC),
+	CONF_INT("img_sec.sleep_conf.type",       img_sec.svc_conf.sleep_conf.type,    SLEEP_DISABLED, SLEEP_WHEN_CHARGING, CONF_CHG_IMG_SEC),
+	CONF_INT("img_sec.sleep_conf.vbat_thres", img_sec.svc_conf.sleep_conf.vbat_thres, 0, 0xFFFF, CONF_CHG_IMG_SEC),
+	CONF_INT("img_sec.sleep_conf.vsol_thres", img_sec.svc_conf.sleep_conf.vsol_thres, 0, 0xFFFF, CONF_CHG_IMG_SEC),
+	CONF_INT("img_sec.speed",                 img_sec.radio_conf.speed,            0, CONF_SPEED_MAX, CONF_CHG_IMG_SEC),
+	CONF_INT_DEFAULT("img_sec.ssdv_size",     img_sec.ssdv_size,                   IMG_SSDV_DATA_MIN, IMG_SSDV_DATA_MAX, CONF_CHG_IMG_SEC),
+	CONF_INT("keep_cam_switched_on",          keep_cam_switched_on,                0, 1, CONF_CHG_CAM),
+	CONF_INT("log.active",                    log.svc_conf.active,                 0, 1, CONF_CHG_LOG),
+	CONF_INT("log.burst",                     log.burst,                           0, 0xFF, CONF_CHG_LOG),
+	CONF_STR("log.call",                      log.call,                            CONF_CHG_LOG),
+	CONF_INT("log.cca",                       log.radio_conf.cca,                  0, 0xFF, CONF_CHG_LOG),
+	CONF_TIME("log.cycle",                    log.svc_conf.cycle,                  CONF_CHG_LOG),
+	CONF_INT("log.density",                   log.density,                         0, 0xFF, CONF_CHG_LOG),
+	CONF_INT("log.freq",                      log.radio_conf.freq,                 0, CONF_FREQ_MAX, CONF_CHG_LOG),
+	CONF_TIME("log.init_delay",               log.svc_conf.init_delay,             CONF_CHG_LOG),
+	CONF_INT("log.link",                      log.radio_conf.link,                 LINK_AX25, LINK_IL2P, CONF_CHG_LOG),
+	CONF_INT("log.mod",                       log.radio_conf.mod,                  MOD_NONE, MOD_2FSK, CONF_CHG_LOG),
+	CONF_STR("log.path",                      log.path,                            CONF_CHG_LOG),
+	CONF_INT("log.pwr",                       log.radio_conf.pwr,                  0, 0x7F, CONF_CHG_LOG),
+	CONF_TIME("log.send_spacing",             log.svc_conf.send_spacing,           CONF_CHG_LOG),
+	CONF_INT("log.sleep_conf.type",           log.svc_conf.sleep_conf.type,        SLEEP_DISABLED, SLEEP_WHEN_CHARGING, CONF_CHG_LOG),
+	CONF_INT("log.sleep_conf.vbat_thres",     log.svc_conf.sleep_conf.vbat_thres,  0, 0xFFFF, CONF_CHG_LOG),
+	CONF_INT("log.sleep_conf.vsol_thres",     log.svc_conf.sleep_conf.vsol_thres,  0, 0xFFFF, CONF_CHG_LOG),
+	CONF_INT("log.speed",                     log.radio_conf.speed,                0, CONF_SPEED_MAX, CONF_CHG_LOG),
+	CONF_INT("pos_pri.accuracy",              pos_pri.beacon.accuracy,             0, 100000, CONF_CHG_POS_PRI),
+	CONF_INT("pos_pri.active",                pos_pri.beacon.active,               0, 1, CONF_CHG_POS_PRI),
+	CONF_INT("pos_pri.aprs_msg",              pos_pri.aprs_msg,                    0, 1, CONF_CHG_POS_PRI),
+	CONF_STR("pos_pri.call",                  pos_pri.call,                        CONF_CHG_POS_PRI),
+	CONF_INT("pos_pri.cca",                   pos_pri.radio_conf.cca,              0, 0xFF, CONF_CHG_POS_PRI),
+	CONF_INT("pos_pri.compact",               pos_pri.compact,                     0, 1, CONF_CHG_POS_PRI),
+	CONF_TIME("pos_pri.cycle",                pos_pri.beacon.cycle,                CONF_CHG_POS_PRI),
+	CONF_TIME("pos_pri.fast_cycle",           pos_pri.fast_cycle,                  CONF_CHG_POS_PRI),
+	CONF_INT("pos_pri.freq",                  pos_pri.radio_conf.freq,             0, CONF_FREQ_MAX, CONF_CHG_POS_PRI),
+	CONF_TIME("pos_pri.init_delay",           pos_pri.beacon.init_delay,           CONF_CHG_POS_PRI),
+	CONF_INT("pos_pri.mod",                   pos_pri.radio_conf.mod,              MOD_NONE, MOD_2FSK, CONF_CHG_POS_PRI),
+	CONF_STR("pos_pri.path",                  pos_pri.path,                        CONF_CHG_POS_PRI),
+	CONF_INT("pos_pri.pwr",                   pos_pri.radio_conf.pwr,              0, 0x7F, CONF_CHG_POS_PRI),
+	CONF_INT("pos_pri.sleep_conf.type",       pos_pri.beacon.sleep_conf.type,      SLEEP_DISABLED, SLEEP_WHEN_CHARGING, CONF_CHG_POS_PRI),
+	CONF_INT("pos_pri.sleep_conf.vbat_thres", pos_pri.beacon.sleep_conf.vbat_thres, 0, 0xFFFF, CONF_CHG_POS_PRI),
+	CONF_INT("pos_pri.sleep_conf.vsol_thres", pos_pri.beacon.sleep_conf.vsol_thres, 0, 0xFFFF, CONF_CHG_POS_PRI),
+	CONF_TIME("pos_pri.slow_cycle",           pos_pri.slow_cycle,                  CONF_CHG_POS_PRI),
+	CONF_INT("pos_pri.symbol",                pos_pri.symbol,                      0, 0xFFFF, CONF_CHG_POS_PRI),
+	CONF_INT("pos_sec.accuracy",              pos_sec.beacon.accuracy,             0, 100000, CONF_CHG_POS_SEC),
+	CONF_INT("pos_sec.active",                pos_sec.beacon.active,               0, 1, CONF_CHG_POS_SEC),
+	CONF_INT("pos_sec.aprs_msg",              pos_sec.aprs_msg,                    0, 1, CONF_CHG_POS_SEC),
+	CONF_STR("pos_sec.call",                  pos_sec.call,                        CONF_CHG_POS_SEC),
+	CONF_INT("pos_sec.cca",                   pos_sec.radio_conf.cca,              0, 0xFF, CONF_CHG_POS_SEC),
+	CONF_INT("pos_sec.compact",               pos_sec.compact,                     0, 1, CONF_CHG_POS_SEC),
+	CONF_TIME("pos_sec.cycle",                pos_sec.beacon.cycle,                CONF_CHG_POS_SEC),
+	CONF_TIME("pos_sec.fast_cycle",           pos_sec.fast_cycle,                  CONF_CHG_POS_SEC),
+	CONF_INT("pos_sec.freq",                  pos_sec.radio_conf.freq,             0, CONF_FREQ_MAX, CONF_CHG_POS_SEC),
+	CONF_TIME("pos_sec.init_delay",           pos_sec.beacon.init_delay,           CONF_CHG_POS_SEC),
+	CONF_INT("pos_sec.mod",                   pos_sec.radio_conf.mod,              MOD_NONE, MOD_2FSK, CONF_CHG_POS_SEC),
+	CONF_STR("pos_sec.path",                  pos_sec.path,                        CONF_CHG_POS_SEC),
+	CONF_INT("pos_sec.pwr",                   pos_sec.radio_conf.pwr,              0, 0x7F, CONF_CHG_POS_SEC),
+	CONF_INT("pos_sec.sleep_conf.type",       pos_sec.beacon.sleep_conf.type,      SLEEP_DISABLED, SLEEP_WHEN_CHARGING, CONF_CHG_POS_SEC),
+	CONF_INT("pos_sec.sleep_conf.vbat_thres", pos_sec.beacon.sleep_conf.vbat_thres, 0, 0xFFFF, CONF_CHG_POS_SEC),
+	CONF_INT("pos_sec.sleep_conf.vsol_thres", pos_sec.beacon.sleep_conf.vsol_thres, 0, 0xFFFF, CONF_CHG_POS_SEC),
+	CONF_TIME("pos_sec.slow_cycle",           pos_sec.slow_cycle,                  CONF_CHG_POS_SEC),
+	CONF_INT("pos_sec.symbol",                pos_sec.symbol,                      0, 0xFFFF, CONF_CHG_POS_SEC),
+	CONF_INT("rf_capture",                    rf_capture,                          0, 1, CONF_CHG_GLOBAL),
+	CONF_INT("rx_stop",                       rx_stop,                             0, 1, CONF_CHG_GLOBAL),
+	CONF_INT("tdma_slot",                     tdma_slot,                           0, 0xFF, CONF_CHG_GLOBAL),
+	CONF_TIME("tdma_slot_time",               tdma_slot_time,                      CONF_CHG_GLOBAL),
+	CONF_INT("tdma_slots",                    tdma_slots,                          0, 0xFF, CONF_CHG_GLOBAL),
+	CONF_TIME("tel_enc_cycle",                tel_enc_cycle,                       CONF_CHG_GLOBAL),
+	CONF_INT("tx_pwr_ctrl",                   tx_pwr_ctrl,                         0, 1, CONF_CHG_GLOBAL),
 };
 
+#define APRS_NUM_CONF_COMMANDS (sizeof(command_list) / sizeof(command_list[0]))
+
 /*
  * Table of commands that can be embedded in a message.
+ * Sorted by name for binary search.
+ * Deferred commands are run by the command thread so the receive
+ * callback does not wait for them.
  */
 const APRSCommand aprs_commands[] = {
-    {"?aprsd", aprs_send_aprsd_message},
-    {"?aprsh", aprs_send_aprsh_message},
-    {"?aprsp", aprs_transmit_telemetry_response},
-    {"?gpio", aprs_execute_gpio_command},
-    {"?reset", aprs_execute_system_reset},
-    {"?save", aprs_execute_config_save},
-    {"?img", aprs_execute_img_command},
-    {"?config", aprs_execute_config_command},
-    {NULL, NULL}
+    {"?aprsd", aprs_send_aprsd_message, false},
+    {"?aprsh", aprs_send_aprsh_message, false},
+    {"?aprsp", aprs_transmit_telemetry_response, true},
+    {"?config", aprs_execute_config_command, false},
+    {"?gpio", aprs_execute_gpio_command, false},
+    {"?img", aprs_execute_img_command, true},
+    {"?log", aprs_execute_log_command, false},
+    {"?reset", aprs_execute_system_reset, false},
+    {"?save", aprs_execute_config_save, true},
+    {NULL, NULL, false}
 };
 
+#define APRS_NUM_COMMANDS ((sizeof(aprs_commands) / sizeof(aprs_commands[0])) - 1)
+
+/*
+ * Command queued to the command thread.
+ * The arguments are copied as the received packet is released.
+ */
+typedef struct {
+  const APRSCommand *acp;
+  aprs_identity_t   identity;
+  int               argc;
+  char              *argv[APRS_MAX_MSG_ARGUMENTS];
+  char              args[AX25_MAX_APRS_MSG_LEN + 1];
+} aprs_cmd_work_t;
+
+static objects_fifo_t cmd_fifo;
+static aprs_cmd_work_t cmd_works[APRS_CMD_QUEUE_SIZE];
+static msg_t cmd_msgs[APRS_CMD_QUEUE_SIZE];
+static bool cmd_started;
+
 /**
  * @brief       parse arguments from a command string.
  *
@@ -240,18 +370,141 @@ static char *aprs_parse_arguments(char *str, char **saveptr) {
  * @retval      MSG_TIMEOUT if the command was not found in known commands.
  */
 static msg_t aprs_cmd_exec(const APRSCommand *acp,
-                          char *name,
                           aprs_identity_t *id,
                           int argc,
                           char *argv[]) {
+  if(acp == NULL)
+    return MSG_TIMEOUT;
+  return acp->ac_function(id, argc, argv);
+}
+
+/**
+ * @brief       Find a command in the APRS command table.
+ *
+ * @return      pointer to the command entry.
+ * @retval      NULL if the command was not found.
+ */
+static const APRSCommand *aprs_cmd_find(const char *name) {
+  if(name == NULL)
+    return NULL;
+
+  uint8_t low = 0;
+  uint8_t high = APRS_NUM_COMMANDS;
+  while(low < high) {
+    uint8_t mid = (low + high) / 2;
+    int cmp = strcmp(aprs_commands[mid].ac_name, name);
+    if(cmp == 0)
+      return &aprs_commands[mid];
+    if(cmp < 0)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return NULL;
+}
+
+/**
+ * @brief       Send the ACK or REJ for a message with an ID.
+ */
+static void aprs_cmd_respond(aprs_identity_t *id, msg_t msg) {
+  if(!id->num[0])
+    return;
+
+  /* Incoming message ID exists so an ACK or REJ has to be sent. */
+  char buf[16];
+  chsnprintf(buf, sizeof(buf), "%s%s",
+             (msg == MSG_OK || msg == MSG_TIMEOUT) ?
+                 "ack" : "rej", id->num);
+
+  /*
+   * Use the receiving node identity as sender.
+   *  Don't request acknowledgment.
+   */
+  packet_t pp = aprs_format_transmit_message(id->call, id->path,
+                                             id->src, buf, false);
+  if(pp == NULL) {
+    TRACE_WARN("RX   > No free packet objects");
+    return;
+  }
+  transmitOnRadio(pp,
+                  id->freq,
+                  0,
+                  0,
+                  id->pwr,
+                  id->mod,
+                  id->cca,
+                  TX_PRIO_COMMAND);
+}
+
+/**
+ * @brief       Run deferred commands and send their responses.
+ */
+static THD_FUNCTION(aprs_cmd_thd, arg) {
+  (void)arg;
+
+  while(true) {
+    aprs_cmd_work_t *work;
+    chFifoReceiveObjectTimeout(&cmd_fifo, (void **)&work, TIME_INFINITE);
+    msg_t msg = aprs_cmd_exec(work->acp, &work->identity,
+                              work->argc, work->argv);
+    aprs_cmd_respond(&work->identity, msg);
+    chFifoReturnObject(&cmd_fifo, work);
+  }
+}
+
+/**
+ * @brief       Start the thread which runs deferred commands.
+ */
+void aprs_start_command_thread(void) {
+  if(cmd_started)
+    return;
+
+  chFifoObjectInit(&cmd_fifo, sizeof(aprs_cmd_work_t),
+                   APRS_CMD_QUEUE_SIZE, sizeof(uint32_t),
+                   cmd_works, cmd_msgs);
+  thread_t *th = chThdCreateFromHeap(NULL,
+                                     THD_WORKING_AREA_SIZE(APRS_CMD_WA_SIZE),
+                                     "APRSCMD", LOWPRIO, aprs_cmd_thd, NULL);
+  if(!th) {
+    TRACE_ERROR("RX   > Could not start command thread (insufficient memory)");
+    return;
+  }
+  cmd_started = true;
+}
+
+/**
+ * @brief       Queue a command to the command thread.
+ *
+ * @return      true if the command was queued.
+ * @retval      false if the queue is full or the arguments do not fit.
+ */
+static bool aprs_cmd_defer(const APRSCommand *acp,
+                           aprs_identity_t *id,
+                           int argc,
+                           char *argv[]) {
+  if(!cmd_started)
+    return false;
+
+  aprs_cmd_work_t *work = chFifoTakeObjectTimeout(&cmd_fifo, TIME_IMMEDIATE);
+  if(work == NULL)
+    return false;
 
-  while (acp->ac_name != NULL) {
-    if (strcmp(acp->ac_name, name) == 0) {
-      return acp->ac_function(id, argc, argv);
+  size_t out = 0;
+  for(int i = 0; i < argc; i++) {
+    size_t len = strlen(argv[i]) + 1;
+    if(out + len > sizeof(work->args)) {
+      chFifoReturnObject(&cmd_fifo, work);
+      return false;
     }
-    acp++;
+    memcpy(&work->args[out], argv[i], len);
+    work->argv[i] = &work->args[out];
+    out += len;
   }
-  return MSG_TIMEOUT;
+  work->acp = acp;
+  work->identity = *id;
+  work->argc = argc;
+  chFifoSendObject(&cmd_fifo, work);
+  return true;
 }
 
 /**
@@ -284,6 +537,64 @@ void aprs_debug_getPacket(packet_t pp, char* buf, uint32_t len)
     }
 }
 
+/*
+ * Get the frame header for a source call sign and path.
+ * The header is encoded once and then reused until the entry is replaced.
+ * A changed configuration is a new call sign and path combination.
+ * The cache is emptied then so the old entries do not hold slots.
+ */
+static bool aprs_get_header(const char *callsign, const char *path,
+                            ax25_header_t *hdr) {
+  bool cache = strlen(callsign) < AX25_MAX_ADDR_LEN
+      && strlen(path) < APRS_HEADER_PATH_LEN;
+
+  chMtxLock(&header_mtx);
+  if(conf_get_changed(&header_watch, APRS_HEADER_CHANGES)) {
+    memset(header_cache, 0, sizeof(header_cache));
+    header_next = 0;
+  }
+  if(cache) {
+    for(uint8_t i = 0; i < APRS_HEADER_CACHE_SIZE; i++) {
+      aprs_header_cache_t *hc = &header_cache[i];
+      if(hc->hdr.len != 0 && strcmp(hc->call, callsign) == 0
+          && strcmp(hc->path, path) == 0) {
+        *hdr = hc->hdr;
+        chMtxUnlock(&header_mtx);
+        return true;
+      }
+    }
+  }
+
+  if(!ax25_header_build(hdr, callsign, APRS_DEVICE_CALLSIGN, path)) {
+    chMtxUnlock(&header_mtx);
+    TRACE_ERROR("APRS > Invalid address in %s via %s", callsign, path);
+    return false;
+  }
+
+  if(cache) {
+    aprs_header_cache_t *hc = &header_cache[header_next];
+    header_next = (header_next + 1) % APRS_HEADER_CACHE_SIZE;
+    strcpy(hc->call, callsign);
+    strcpy(hc->path, path);
+    hc->hdr = *hdr;
+  }
+  chMtxUnlock(&header_mtx);
+  return true;
+}
+
+/*
+ * Build a frame from the cached header and an information field.
+ * The information is copied as is so it is not parsed as monitor text.
+ */
+static packet_t aprs_encode_frame(const char *callsign, const char *path,
+                                  const uint8_t *info, uint16_t info_len,
+                                  uint16_t reserve) {
+  ax25_header_t hdr;
+  if(!aprs_get_header(callsign, path, &hdr))
+    return NULL;
+  return ax25_from_header(&hdr, info, info_len, reserve);
+}
+
 /**
  * @brief  Transmit APRS position packet.
  *
@@ -334,10 +645,7 @@ packet_t aprs_encode_stamped_position_and_telemetry(const char *callsign,
     /* RTC is not set so use dataPoint (it may have a valid date). */
     unixTimestamp2Date(&time, dataPoint->gps_time);
   char xmit[256];
-  uint32_t len = chsnprintf(xmit, sizeof(xmit), "%s>%s,%s:@%02d%02d%02dz",
-                            callsign,
-                            APRS_DEVICE_CALLSIGN,
-                            path,
+  uint32_t len = chsnprintf(xmit, sizeof(xmit), "@%02d%02d%02dz",
                             time.day,
                             time.hour,
                             time.minute);
@@ -389,9 +697,8 @@ packet_t aprs_encode_stamped_position_and_telemetry(const char *callsign,
   /* Digital bits second byte - set zero. */
   xmit[len+len2+27] = 33;
   xmit[len+len2+28] = '|';
-  xmit[len+len2+29] = 0;
 
-  return ax25_from_text(xmit, true);
+  return aprs_encode_frame(callsign, path, (uint8_t*)xmit, len+len2+29, 0);
 }
 
 /**
@@ -404,14 +711,16 @@ packet_t aprs_encode_stamped_position_and_telemetry(const char *callsign,
  * @notes  - Air pressure in Pascal
  * @notes  - Number of satellites being used
  * @notes  - Number of cycles where GPS has been lost (if applicable in cycle)
- * @notes  - The contents of the datapoint passed in
+ * @notes  - The contents of the datapoint passed in (extended only)
  * @notes  - State of GPIO port(s)
+ * @notes  Without extended only the compressed position and the |ss...|
+ * @notes  telemetry are sent. That is about 30 bytes of information.
  *
  * @param[in] callsign  origination call sign
  * @param[in] path      path to use
  * @param[in] symbol    symbol for originator
  * @param[in] dataPoint position data object
- * @param[in] extended  unused
+ * @param[in] extended  include the base91 encoded data point
  *
  * @return    encoded packet object pointer
  * @retval    NULL if encoding failed
@@ -420,7 +729,6 @@ packet_t aprs_encode_position_and_telemetry(const char *callsign,
                               const char *path, aprs_sym_t symbol,
                               dataPoint_t *dataPoint,
                               bool extended) {
-  (void)extended;
 	// Latitude
 	uint32_t y = 380926 * (90 - dataPoint->gps_lat/10000000.0);
 	uint32_t y3  = y   / 753571;
@@ -445,10 +753,8 @@ packet_t aprs_encode_position_and_telemetry(const char *callsign,
 	uint32_t a1r = a % 91;
 
 	char xmit[256];
-    uint32_t len = chsnprintf(xmit, sizeof(xmit), "%s>%s,%s:=",
-                              callsign,
-                              APRS_DEVICE_CALLSIGN,
-                              path);
+    uint32_t len = 0;
+    xmit[len++] = '=';
 
     uint8_t gpsFix = dataPoint->gps_state == GPS_LOCKED1
         || dataPoint->gps_state == GPS_LOCKED2
@@ -472,9 +778,11 @@ packet_t aprs_encode_position_and_telemetry(const char *callsign,
 	xmit[len+12] = ((gpsFix << 5) | (src << 3) | origin) + 33;
 
 	// Comments
-	uint32_t len2 = base91_encode((uint8_t*)dataPoint,
-	                              (uint8_t*)&xmit[len+13],
-	                              sizeof(dataPoint_t));
+	uint32_t len2 = 0;
+	if(extended)
+		len2 = base91_encode((uint8_t*)dataPoint,
+		                     (uint8_t*)&xmit[len+13],
+		                     sizeof(dataPoint_t));
 
 	xmit[len+len2+13] = '|';
 
@@ -504,9 +812,8 @@ packet_t aprs_encode_position_and_telemetry(const char *callsign,
     /* Digital bits second byte - set zero. */
     xmit[len+len2+27] = 33;
     xmit[len+len2+28] = '|';
-	xmit[len+len2+29] = 0;
 
-	return ax25_from_text(xmit, true);
+	return aprs_encode_frame(callsign, path, (uint8_t*)xmit, len+len2+29, 0);
 }
 
 /*
@@ -516,46 +823,141 @@ packet_t aprs_encode_data_packet(const char *callsign, const char *path,
                                  char packetType, uint8_t *data)
 {
 	char xmit[256];
-	chsnprintf(xmit, sizeof(xmit), "%s>%s,%s:{{%c%s", callsign,
-	           APRS_DEVICE_CALLSIGN, path, packetType, data);
+	uint32_t len = chsnprintf(xmit, sizeof(xmit), "{{%c%s", packetType, data);
+	if(len >= sizeof(xmit))
+		len = sizeof(xmit) - 1;
 
-	return ax25_from_text(xmit, true);
+	return aprs_encode_frame(callsign, path, (uint8_t*)xmit, len, 0);
+}
+
+/*
+ * Encode binary data as a base91 data packet.
+ * The data is encoded straight into the information field.
+ * So there is no intermediate text buffer and no parse of the data.
+ */
+packet_t aprs_encode_base91_packet(const char *callsign, const char *path,
+                                   char packetType, const uint8_t *data,
+                                   uint16_t length)
+{
+	uint8_t info[] = {'{', '{', packetType};
+
+	packet_t pp = aprs_encode_frame(callsign, path, info, sizeof(info),
+	                                BASE91LEN(length));
+	if(pp == NULL)
+		return NULL;
+	if(pp->frame_len + BASE91LEN(length) > pp->frame_size) {
+		pktReleasePacketBuffer(pp);
+		return NULL;
+	}
+	pp->frame_len += base91_encode_block(data,
+	                                     pp->frame_data + pp->frame_len,
+	                                     length);
+	return pp;
+}
+
+/*
+ * Encode binary data as a raw UI frame.
+ * The information field is the {{ marker and type followed by the data.
+ * The PID is not APRS so the frame is not gated or parsed as APRS.
+ * For links where APRS text compliance is not needed.
+ */
+packet_t aprs_encode_binary_packet(const char *callsign, const char *path,
+                                   char packetType, const uint8_t *data,
+                                   uint16_t length)
+{
+	uint8_t info[] = {'{', '{', packetType};
+
+	packet_t pp = aprs_encode_frame(callsign, path, info, sizeof(info),
+	                                length);
+	if(pp == NULL)
+		return NULL;
+	if(pp->frame_len + length > pp->frame_size) {
+		pktReleasePacketBuffer(pp);
+		return NULL;
+	}
+	pp->frame_data[ax25_get_pid_offset(pp)] = AX25_PID_SSDV_BINARY;
+	memcpy(pp->frame_data + pp->frame_len, data, length);
+	pp->frame_len += length;
+	return pp;
 }
 
 /**
- * @brief       Transmit message packet
+ * @brief       Format message packet with a given message number
  *
  * @param[in]   originator  call sign of originator of this message
  * @param[in    path        path for message
  * @param[in]   recipient   call sign of recipient
  * @param[in    text        text of the message
- * @param[in]   ack         true if message acknowledgment requested
+ * @param[in]   num         message number or NULL if no ack requested
  */
-packet_t aprs_format_transmit_message(const char *originator, const char *path,
-                             const char *recipient, const char *text,
-                             const bool ack) {
+packet_t aprs_format_numbered_message(const char *originator,
+                                      const char *path,
+                                      const char *recipient,
+                                      const char *text,
+                                      const char *num) {
 	char xmit[256];
+	uint32_t len;
 	if((strlen(text) > AX25_MAX_APRS_MSG_LEN)
 	    || (strpbrk(text, "|~{") != NULL))
 	  /* Invalid message. */
 	  return NULL;
-	if(!ack)
-		chsnprintf(xmit, sizeof(xmit), "%s>%s,%s::%-9s:%s",
-		                               originator,
-		                               APRS_DEVICE_CALLSIGN,
-                                       path,
+	if(num == NULL || num[0] == 0)
+		len = chsnprintf(xmit, sizeof(xmit), ":%-9s:%s",
                                        recipient,
                                        text);
 	else
-		chsnprintf(xmit, sizeof(xmit), "%s>%s,%s::%-9s:%s{%d",
-                                       originator,
-                                       APRS_DEVICE_CALLSIGN,
-                                       path,
+		len = chsnprintf(xmit, sizeof(xmit), ":%-9s:%s{%s",
                                        recipient,
                                        text,
-                                       ++msg_id);
+                                       num);
+	if(len >= sizeof(xmit))
+		len = sizeof(xmit) - 1;
 
-	return ax25_from_text(xmit, true);
+	return aprs_encode_frame(originator, path, (uint8_t*)xmit, len, 0);
+}
+
+/**
+ * @brief       Transmit message packet
+ * @notes       Use aprs_msg_send() for messages which are retried until acked.
+ *
+ * @param[in]   originator  call sign of originator of this message
+ * @param[in    path        path for message
+ * @param[in]   recipient   call sign of recipient
+ * @param[in    text        text of the message
+ * @param[in]   ack         true if message acknowledgment requested
+ */
+packet_t aprs_format_transmit_message(const char *originator, const char *path,
+                             const char *recipient, const char *text,
+                             const bool ack) {
+	char num[8] = {0};
+	if(ack)
+		chsnprintf(num, sizeof(num), "%d", ++msg_id);
+	return aprs_format_numbered_message(originator, path, recipient, text, num);
+}
+
+/*
+ * @brief       Format the text of an APRSD message
+ * @notes       Stations which do not fit in the message are left out.
+ *
+ * @param[out]  buf     text buffer
+ * @param[in]   size    size of the buffer
+ */
+static void aprs_format_directs(char *buf, size_t size) {
+	uint32_t out = chsnprintf(buf, size, "Directs=");
+	uint32_t empty = out;
+	heard_info_t list[APRS_HEARD_LIST_SIZE];
+	uint8_t cnt = heard_get_recent(list, APRS_HEARD_LIST_SIZE, TIME_S2I(600));
+	/* Most recently heard first so the oldest are cut if too long. */
+	for(uint8_t i = 0; i < cnt; i++) {
+		if(out + strlen(list[i].call) + 1 >= size)
+			break;
+		out += chsnprintf(&buf[out], size-out, "%s ", list[i].call);
+	}
+	if(out == empty) {
+      out += chsnprintf(&buf[out], size-out, "[none]");
+	} else {
+	  buf[out-1] = 0; // Remove last space
+	}
 }
 
 /*
@@ -569,21 +971,8 @@ packet_t aprs_format_transmit_message(const char *originator, const char *path,
 packet_t aprs_compose_aprsd_message(const char *originator,
                                     const char *path,
                                     const char *recipient) {
-	char buf[256] = "Directs=";
-	uint32_t out = strlen(buf);
-	uint32_t empty = out;
-	for(uint8_t i = 0; i < APRS_HEARD_LIST_SIZE; i++) {
-		if(heard_list[i].time
-		    && heard_list[i].time + TIME_S2I(600) >= chVTGetSystemTime()
-		    && heard_list[i].time <= chVTGetSystemTime())
-			out += chsnprintf(&buf[out], sizeof(buf)-out, "%s ",
-			                  heard_list[i].call);
-	}
-	if(out == empty) {
-      out += chsnprintf(&buf[out], sizeof(buf)-out, "[none]");
-	} else {
-	  buf[out-1] = 0; // Remove last space
-	}
+	char buf[AX25_MAX_APRS_MSG_LEN + 1];
+	aprs_format_directs(buf, sizeof(buf));
 
 	return aprs_format_transmit_message(originator, path, recipient, buf, false);
 }
@@ -604,18 +993,10 @@ msg_t aprs_send_aprsd_message(aprs_identity_t *id,
   (void)argc;
   (void)argv;
 
-  packet_t pp = aprs_compose_aprsd_message(id->call, id->path, id->src);
-  if(pp == NULL) {
-    TRACE_WARN("TX   > APRSD: No free packet objects or badly formed message");
-    return MSG_ERROR;
-  }
-  if(!transmitOnRadio(pp,
-                  id->freq,
-                  0,
-                  0,
-                  id->pwr,
-                  id->mod,
-                  id->cca)) {
+  char buf[AX25_MAX_APRS_MSG_LEN + 1];
+  aprs_format_directs(buf, sizeof(buf));
+  /* A request with a message number is answered with a retried message. */
+  if(aprs_msg_send(id, buf, id->num[0] != 0) != MSG_OK) {
     TRACE_ERROR("TX   > APRSD: Transmit failed");
     return MSG_ERROR;
   }
@@ -638,37 +1019,19 @@ msg_t aprs_send_aprsh_message(aprs_identity_t *id,
   if(argc != 1)
     return MSG_ERROR;
   char buf[AX25_MAX_APRS_MSG_LEN + 1];
-  uint32_t out = 0;
+  heard_info_t info;
   strupr(argv[0]);
-  for(uint8_t i = 0; i < APRS_HEARD_LIST_SIZE; i++) {
-    if(heard_list[i].time && (strncmp(heard_list[i].call, argv[0],
-                                      strlen(argv[0])) == 0)) {
-      /* Convert time to human readable form. */
-      time_secs_t diff = chTimeI2S(chVTTimeElapsedSinceX(heard_list[i].time));
-      out = chsnprintf(buf, sizeof(buf),
-                       "%s heard %02i:%02i ago",
-                        heard_list[i].call, diff/60, diff % 60);
-      break;
-    }
-    if(out == 0) {
-      out = chsnprintf(buf, sizeof(buf),
-                       "%s not heard", argv[0]);
-    }
+  if(heard_find_prefix(argv[0], &info)) {
+    /* Convert time to human readable form. */
+    time_secs_t diff = chTimeI2S(chVTTimeElapsedSinceX(info.time));
+    chsnprintf(buf, sizeof(buf),
+               "%s heard %02i:%02i ago, %d frames, RSSI %d",
+               info.call, diff/60, diff % 60, info.count, info.rssi);
+  } else {
+    chsnprintf(buf, sizeof(buf), "%s not heard", argv[0]);
   }
   TRACE_INFO("TX   > APRSH response: %s", buf);
-  packet_t pp = aprs_format_transmit_message(id->call, id->path, id->src,
-                                             buf, false);
-  if(pp == NULL) {
-    TRACE_WARN("TX   > APRSH: No free packet objects or badly formed message");
-    return MSG_ERROR;
-  }
-  if(!transmitOnRadio(pp,
-                  id->freq,
-                  0,
-                  0,
-                  id->pwr,
-                  id->mod,
-                  id->cca)) {
+  if(aprs_msg_send(id, buf, id->num[0] != 0) != MSG_OK) {
     TRACE_ERROR("TX   > APRSH: Transmit failed");
     return MSG_ERROR;
   }
@@ -829,15 +1192,59 @@ msg_t aprs_execute_gpio_command(aprs_identity_t *id,
               0,
               id->pwr,
               id->mod,
-              id->cca)) {
+              id->cca,
+              TX_PRIO_COMMAND)) {
     TRACE_ERROR("RX   > Transmit of GPIO status failed");
     return MSG_ERROR;
   }
   return MSG_OK;
 }
 
+/**
+* @brief       Send a telemetry summary of a time series window.
+* @notes       Each field is min/mean/max. Battery voltage (V) in mV,
+*              battery power (B) in mW, altitude (A) in m and temperature
+*              (T) in degC. Fields without samples are left out.
+*
+* @param[in]   id      aprs node identity
+* @param[in]   res     resolution of the window
+*
+* @return      result of the transmission
+*/
+static msg_t aprs_send_telemetry_summary(aprs_identity_t *id, ts_res_t res) {
+  static const struct {
+    ts_field_t  field;
+    char        tag;
+    int32_t     scale;
+  } fields[] = {
+    {TS_VBAT, 'V', 1},
+    {TS_PBAT, 'B', 1},
+    {TS_ALT, 'A', 1},
+    {TS_TEMP, 'T', 100}
+  };
+  char buf[AX25_MAX_APRS_MSG_LEN + 1];
+  int n = chsnprintf(buf, sizeof(buf), "%s", ts_res_name(res));
+  uint8_t i;
+  for(i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+    ts_stats_t s;
+    if(!ts_get(fields[i].field, res, &s) || n >= (int)sizeof(buf) - 1)
+      continue;
+    n += chsnprintf(&buf[n], sizeof(buf) - n, " %c%d/%d/%d", fields[i].tag,
+                    s.min / fields[i].scale, s.mean / fields[i].scale,
+                    s.max / fields[i].scale);
+  }
+  TRACE_INFO("TX   > APRSP response: %s", buf);
+  if(aprs_msg_send(id, buf, id->num[0] != 0) != MSG_OK) {
+    TRACE_ERROR("TX   > APRSP: Transmit failed");
+    return MSG_ERROR;
+  }
+  return MSG_OK;
+}
+
 /**
 * @brief       Request for telemetry beacon to be sent
+* @notes       With a resolution (1m, 10m or 1h) a summary of the telemetry
+*              over its window is sent as a message instead.
 *
 * @param[in]   id      aprs node identity
 * @param[in]   argc    number of parameters
@@ -849,10 +1256,14 @@ msg_t aprs_execute_gpio_command(aprs_identity_t *id,
 */
 msg_t aprs_transmit_telemetry_response(aprs_identity_t *id,
                                 int argc, char *argv[]) {
-  (void)argv;
-
-  if(argc != 0)
+  if(argc > 1)
     return MSG_ERROR;
+  if(argc == 1) {
+    ts_res_t res;
+    if(!ts_find_res(argv[0], &res))
+      return MSG_ERROR;
+    return aprs_send_telemetry_summary(id, res);
+  }
   /*
    * Start a run once beacon thread.
    * The identity data has a ref to the bcn_app_conf_t object of the call sign.
@@ -908,7 +1319,8 @@ msg_t aprs_execute_system_reset(aprs_identity_t *id,
                   0,
                   id->pwr,
                   id->mod,
-                  id->cca);
+                  id->cca,
+                  TX_PRIO_COMMAND);
 
   chThdSleep(TIME_S2I(10));
 
@@ -917,6 +1329,70 @@ msg_t aprs_execute_system_reset(aprs_identity_t *id,
   return MSG_OK;
 }
 
+/**
+ * @brief       Find a parameter in the configuration table.
+ *
+ * @return      pointer to the table entry.
+ * @retval      NULL if the parameter was not found.
+ */
+static const conf_command_t *aprs_config_find(const char *name) {
+  uint8_t low = 0;
+  uint8_t high = APRS_NUM_CONF_COMMANDS;
+  while(low < high) {
+    uint8_t mid = (low + high) / 2;
+    int cmp = strcasecmp(command_list[mid].name, name);
+    if(cmp == 0)
+      return &command_list[mid];
+    if(cmp < 0)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return NULL;
+}
+
+/**
+ * @brief       Check a value and set a configuration parameter.
+ *
+ * @return      true if the value was valid and has been set.
+ */
+static bool aprs_config_set(const conf_command_t *cc, const char *value) {
+  if(cc->type == TYPE_STR) {
+    /* Call signs and paths. The message text was converted to lower case. */
+    size_t len = strlen(value);
+    if(len == 0 || len >= cc->size)
+      return false;
+    char *str = (char*)cc->ptr;
+    for(size_t i = 0; i <= len; i++)
+      str[i] = toupper((unsigned char)value[i]);
+    return true;
+  }
+
+  char *end;
+  long v = strtol(value, &end, 0);
+  if(end == value || *end != 0)
+    return false;
+  if((v < cc->min || v > cc->max) && !(cc->type == TYPE_INT_DEFAULT && v == 0))
+    return false;
+
+  if(cc->type == TYPE_TIME) {
+    *((sysinterval_t*)cc->ptr) = TIME_MS2I(v);
+    return true;
+  }
+  switch(cc->size) {
+  case 1:
+    *((uint8_t*)cc->ptr) = v;
+    return true;
+  case 2:
+    *((uint16_t*)cc->ptr) = v;
+    return true;
+  case 4:
+    *((uint32_t*)cc->ptr) = v;
+    return true;
+  }
+  return false;
+}
+
 /*
  * @brief       Handle config command
  *
@@ -935,34 +1411,24 @@ msg_t aprs_execute_config_command(aprs_identity_t *id,
   if(argc != 2)
     return MSG_ERROR;
 
-  for(uint8_t i=0; command_list[i].type != TYPE_NULL; i++) {
-    if(!strncmp(argv[1], command_list[i].name,
-                strlen(command_list[i].name))) {
-
-      /* Parameter being changed is in argv[0], new value is in argv[1]. */
-      TRACE_INFO("RX   > Message: Configuration Command");
-      TRACE_INFO("RX   > %s => %s", argv[1], argv[1]);
-
-      if(command_list[i].type == TYPE_INT
-          && command_list[i].size == 1) {
-        *((uint8_t*)command_list[i].ptr) = atoi(argv[1]);
-      } else if(command_list[i].type == TYPE_INT
-          && command_list[i].size == 2) {
-        *((uint16_t*)command_list[i].ptr) = atoi(argv[1]);
-      } else if(command_list[i].type == TYPE_INT
-          && command_list[i].size == 4) {
-        *((uint32_t*)command_list[i].ptr) = atoi(argv[1]);
-      } else if(command_list[i].type == TYPE_TIME) {
-        *((sysinterval_t*)command_list[i].ptr) =
-            TIME_MS2I(atoi(argv[2]));
-      } else if(command_list[i].type == TYPE_STR) {
-        strncpy((char*)command_list[i].ptr, argv[1],
-                sizeof(command_list[i].size)-1);
-      }
-      return MSG_OK;
-    } /* Next parameter. */
-  } /* Parameter not found. */
-  return MSG_ERROR;
+  /* Parameter being changed is in argv[0], new value is in argv[1]. */
+  const conf_command_t *cc = aprs_config_find(argv[0]);
+  if(cc == NULL) {
+    TRACE_WARN("RX   > Unknown configuration parameter %s", argv[0]);
+    return MSG_ERROR;
+  }
+  TRACE_INFO("RX   > Message: Configuration Command");
+  TRACE_INFO("RX   > %s => %s", cc->name, argv[1]);
+  if(!aprs_config_set(cc, argv[1])) {
+    TRACE_WARN("RX   > Invalid value %s for %s", argv[1], cc->name);
+    return MSG_ERROR;
+  }
+  conf_set_changed(cc->changes);
+
+  /* Persist the change as a journal record. */
+  if(!conf_store_update(cc->ptr, cc->size))
+    TRACE_WARN("RX   > Configuration change not stored");
+  return MSG_OK;
 }
 
 /**
@@ -982,12 +1448,7 @@ msg_t aprs_execute_config_save(aprs_identity_t *id,
   (void)argv;
 
   TRACE_INFO("RX   > Message: Config Save");
-  conf_sram.magic = CONFIG_MAGIC_UPDATED;
-  flashSectorBegin(flashSectorAt(0x08060000));
-  flashErase(0x08060000, 0x20000);
-  flashWrite(0x08060000, (char*)&conf_sram, sizeof(conf_t));
-  flashSectorEnd(flashSectorAt(0x08060000));
-  return MSG_OK;
+  return conf_store_save() ? MSG_OK : MSG_ERROR;
 }
 
 /*
@@ -1028,18 +1489,9 @@ msg_t aprs_execute_img_command(aprs_identity_t *id,
     int c = 2;
     while(c <= argc) {
       uint32_t req = strtol(argv[c++], NULL, 16);
-      for(uint8_t i = 0; i < 16; i++) {
-        /* Find an empty repeat slot. */
-        if(!packetRepeats[i].n_done) {
-          packetRepeats[i].image_id = (req >> 16) & 0xFF;
-          packetRepeats[i].packet_id = req & 0xFFFF;
-          packetRepeats[i].n_done = true;
-
-          TRACE_INFO("RX   > ... Image %3d Packet %3d",
-                     packetRepeats[i].image_id,
-                     packetRepeats[i].packet_id);
-          break;
-        } /* Not an empty slot. */
+      if(image_add_repeat((req >> 16) & 0xFF, req & 0xFFFF)) {
+        TRACE_INFO("RX   > ... Image %3d Packet %3d",
+                   (req >> 16) & 0xFF, req & 0xFFFF);
       } /* No more slots. */
     } /* No more image IDs. */
     return MSG_OK;
@@ -1048,6 +1500,37 @@ msg_t aprs_execute_img_command(aprs_identity_t *id,
   return MSG_ERROR;
 }
 
+/*
+ * @brief       Handle Log command
+ * @notes       "ack <reset> <first> [<last>]" confirms log points received.
+ *
+ * @param[in]   id      aprs node identity
+ * @param[in]   argc    number of parameters
+ * @param[in]   argv    array of pointers to parameter strings
+ *
+ * @return      result of command
+ * @retval      MSG_OK if the command completed.
+ * @retval      MSG_ERROR if there was an error.
+ */
+msg_t aprs_execute_log_command(aprs_identity_t *id,
+                                 int argc, char *argv[]) {
+  (void)id;
+
+  if((argc == 3 || argc == 4) && !strcmp(argv[0], "ack")) {
+    uint16_t reset = strtoul(argv[1], NULL, 10);
+    uint32_t first = strtoul(argv[2], NULL, 10);
+    uint32_t last = argc == 4 ? strtoul(argv[3], NULL, 10) : first;
+    if(last < first)
+      return MSG_ERROR;
+    TRACE_INFO("RX   > Message: Log ack reset %d ID %d to %d",
+               reset, first, last);
+    logAcknowledgeRange(reset, first, last);
+    return MSG_OK;
+  }
+  /* Unknown parameter. */
+  return MSG_ERROR;
+}
+
 /*
  * @brief       Decode APRS content and check for message
  *
@@ -1191,6 +1674,11 @@ static bool aprs_decode_message(packet_t pp) {
   TRACE_INFO("RX   > Received message from %s (ID=%s): %s",
              src, msg_id_rx[0] == 0 ? "none" : msg_id_rx, astrng);
 
+  /* Ack or reject of a message sent by this device. */
+  if(aprs_msg_reply(src, astrng)) {
+    txpower_ack(dest);
+    return false;
+  }
 
   /* Filter out telemetry configuration and "Directs=" messages sent to ourselves. */
   char const *cfgs[] = {"parm.", "unit.", "eqns.", "bits.", "directs="};
@@ -1217,68 +1705,226 @@ static bool aprs_decode_message(packet_t pp) {
   }
 
   /* Parse and execute command. */
-  msg_t msg = aprs_cmd_exec(aprs_commands, cmd, &identity, n, args);
+  const APRSCommand *acp = aprs_cmd_find(cmd);
+  if(acp != NULL && acp->ac_deferred
+      && aprs_cmd_defer(acp, &identity, n, args)) {
+    /* The command thread sends the response. */
+    return false;
+  }
+
+  msg_t msg = aprs_cmd_exec(acp, &identity, n, args);
 
   if(msg == MSG_TIMEOUT) {
     TRACE_INFO("RX   > No command found in message");
   }
 
-  if(msg_id_rx[0]) {
-    /* Incoming message ID exists so an ACK or REJ has to be sent. */
-    char buf[16];
-    chsnprintf(buf, sizeof(buf), "%s%s",
-               (msg == MSG_OK || msg == MSG_TIMEOUT) ?
-                   "ack" : "rej", msg_id_rx);
+  aprs_cmd_respond(&identity, msg);
+  /* Flag that the APRS content should not be digipeated. */
+  return false;
+}
 
-    /*
-     * Use the receiving node identity as sender.
-     *  Don't request acknowledgment.
-     */
-    packet_t pp = aprs_format_transmit_message(identity.call,
-                                      identity.path,
-                                      identity.src, buf, false);
-    if(pp == NULL) {
-      TRACE_WARN("RX   > No free packet objects");
-      return false;
+/**
+ * Charge the airtime of a digipeat to its source.
+ * The bucket of a source holds its share of the digipeat budget and fills
+ * at that share of the budget rate.
+ * @return false if the source has used up its airtime
+ */
+static bool aprs_digipeat_rate(packet_t pp, uint32_t airtime) {
+  budget_bucket_t budget;
+  budget_get(BUDGET_DIGI, &budget);
+  int32_t size = budget.size * APRS_DIGI_SOURCE_SHARE / 100;
+  uint32_t window = BUDGET_SLOTS * chTimeI2S(BUDGET_SLOT_TIME);
+
+  ax25_addr_key_t source = ax25_get_addr_key(pp, AX25_SOURCE);
+  systime_t now = chVTGetSystemTime();
+  digi_rate_t *rate = NULL;
+  digi_rate_t *oldest = NULL;
+
+  chMtxLock(&digi_rate_mtx);
+  for(uint8_t i = 0; i < APRS_DIGI_RATE_SOURCES; i++) {
+    digi_rate_t *r = &digi_rate[i];
+    if(r->source == source) {
+      rate = r;
+      break;
     }
-    transmitOnRadio(pp,
-                    identity.freq,
-                    0,
-                    0,
-                    identity.pwr,
-                    identity.mod,
-                    identity.cca);
+    if(oldest == NULL || r->source == 0 || (oldest->source != 0
+        && chTimeDiffX(r->refill, now) > chTimeDiffX(oldest->refill, now)))
+      oldest = r;
   }
-  /* Flag that the APRS content should not be digipeated. */
-  return false;
+  if(rate == NULL) {
+    /* A new source starts with a full bucket. */
+    rate = oldest;
+    rate->source = source;
+    rate->tokens = size;
+    rate->refill = now;
+  } else {
+    /* Fill in whole seconds. */
+    uint32_t secs = chTimeI2S(chTimeDiffX(rate->refill, now));
+    rate->refill = chTimeAddX(rate->refill, TIME_S2I(secs));
+    if(rate->tokens < size) {
+      rate->tokens += (int64_t)size * secs / window;
+      if(rate->tokens > size)
+        rate->tokens = size;
+    }
+  }
+  bool allowed = rate->tokens > 0;
+  if(allowed)
+    rate->tokens -= (int32_t)airtime;
+  chMtxUnlock(&digi_rate_mtx);
+  return allowed;
 }
 
 /**
+ * Transmit a digipeat.
  * Transmit failure will release the packet memory.
  */
+static void aprs_digipeat_transmit(packet_t result) {
+  mod_t mod = conf_sram.aprs.tx.radio_conf.mod;
+  if(budget_available(BUDGET_DIGI) <= 0) {
+    TRACE_INFO("RX   > Airtime budget used up, digipeat dropped");
+    stats_count(&digi_stats_budget, 1);
+    pktReleaseBufferChain(result);
+    return;
+  }
+  if(!aprs_digipeat_rate(result, budget_airtime(result, mod, 0))) {
+    TRACE_INFO("RX   > Airtime of source used up, digipeat dropped");
+    stats_count(&digi_stats_source, 1);
+    pktReleaseBufferChain(result);
+    return;
+  }
+  stats_count(&digi_stats_sent, 1);
+  budget_charge(BUDGET_DIGI, result, mod, 0);
+  if(!transmitOnRadio(result,
+                  conf_sram.aprs.tx.radio_conf.freq,
+                  0,
+                  0,
+                  conf_sram.aprs.tx.radio_conf.pwr,
+                  conf_sram.aprs.tx.radio_conf.mod,
+                  conf_sram.aprs.tx.radio_conf.cca,
+                  TX_PRIO_DIGIPEAT)) {
+    TRACE_INFO("RX   > Failed to digipeat packet");
+  } /* TX failed. */
+}
+
+/**
+ * Transmit held digipeats when their hold time is over.
+ */
+static THD_FUNCTION(aprs_digi_thd, arg) {
+  (void)arg;
+
+  while(true) {
+    sysinterval_t wait = TIME_INFINITE;
+    packet_t due = NULL;
+
+    chMtxLock(&digi_hold_mtx);
+    for(uint8_t i = 0; i < APRS_DIGI_HOLD_SIZE; i++) {
+      if(digi_hold[i].pp == NULL)
+        continue;
+      sysinterval_t left = chTimeDiffX(chVTGetSystemTime(),
+                                       digi_hold[i].release);
+      /* Release times passed show as a long wait after wrap. */
+      if(left == 0 || left > conf_sram.aprs.digi_hold) {
+        due = digi_hold[i].pp;
+        digi_hold[i].pp = NULL;
+        break;
+      }
+      if(left < wait)
+        wait = left;
+    }
+    chMtxUnlock(&digi_hold_mtx);
+
+    if(due != NULL) {
+      aprs_digipeat_transmit(due);
+      continue;
+    }
+    /* A new digipeat may be held with an earlier release. */
+    (void)chBSemWaitTimeout(&digi_hold_sem, wait);
+  }
+}
+
+/**
+ * Hold a digipeat until its hold time is over.
+ * The digipeat is sent at once if the hold queue is full.
+ */
+static void aprs_digipeat_hold(packet_t result) {
+  chMtxLock(&digi_hold_mtx);
+  for(uint8_t i = 0; i < APRS_DIGI_HOLD_SIZE; i++) {
+    if(digi_hold[i].pp == NULL) {
+      digi_hold[i].pp = result;
+      digi_hold[i].crc = ax25_dedupe_crc(result);
+      digi_hold[i].release = chTimeAddX(chVTGetSystemTime(),
+                                        conf_sram.aprs.digi_hold);
+      chMtxUnlock(&digi_hold_mtx);
+      chBSemSignal(&digi_hold_sem);
+      return;
+    }
+  }
+  chMtxUnlock(&digi_hold_mtx);
+  aprs_digipeat_transmit(result);
+}
+
+/**
+ * Cancel a held digipeat if another digipeater repeated the frame.
+ * Source, destination and info are compared by the dedupe CRC.
+ */
+static bool aprs_digipeat_cancel(packet_t pp) {
+  if(ax25_get_heard(pp) < AX25_REPEATER_1)
+    return false; // Not repeated by a digipeater
+
+  unsigned short crc = ax25_dedupe_crc(pp);
+  packet_t held = NULL;
+  chMtxLock(&digi_hold_mtx);
+  for(uint8_t i = 0; i < APRS_DIGI_HOLD_SIZE; i++) {
+    if(digi_hold[i].pp != NULL && digi_hold[i].crc == crc) {
+      held = digi_hold[i].pp;
+      digi_hold[i].pp = NULL;
+      break;
+    }
+  }
+  chMtxUnlock(&digi_hold_mtx);
+
+  if(held == NULL)
+    return false;
+  TRACE_INFO("RX   > Held digipeat cancelled, repeated by other digipeater");
+  pktReleaseBufferObject(held);
+  return true;
+}
+
+/**
+ * Digipeat now or hold the digipeat in viscous mode.
+ */
 static void aprs_digipeat(packet_t pp) {
   if(!dedupe_initialized) {
     dedupe_init(TIME_S2I(10));
+    /* Patterns which can not be compiled are matched by crx. */
+    if(!digipeat_compile(&alias_pat, alias_re))
+      TRACE_WARN("RX   > Alias pattern %s matched by regex", alias_re);
+    if(!digipeat_compile(&wide_pat, wide_re))
+      TRACE_WARN("RX   > Wide pattern %s matched by regex", wide_re);
+    thread_t *th = chThdCreateFromHeap(NULL,
+                                       THD_WORKING_AREA_SIZE(APRS_DIGI_WA_SIZE),
+                                       "DIGI", LOWPRIO, aprs_digi_thd, NULL);
+    if(!th) {
+      TRACE_ERROR("RX   > Could not start digipeat hold thread (insufficient memory)");
+    }
     dedupe_initialized = true;
   }
 
+  /* A held frame is already remembered so later copies are dropped. */
+  if(aprs_digipeat_cancel(pp))
+    return;
+
   if(!dedupe_check(pp, 0)) { // Last identical packet older than 10 seconds
     packet_t result = digipeat_match(0, pp, conf_sram.aprs.rx.call,
-                                     conf_sram.aprs.tx.call, alias_re,
-                                     wide_re, 0, preempt, NULL);
+                                     conf_sram.aprs.tx.call, &alias_pat,
+                                     &wide_pat, 0, preempt, NULL);
     if(result != NULL) { // Should be digipeated
-      /* Remember the transmission. Frequency may be a code or absolute. */
-      dedupe_remember(result, conf_sram.aprs.tx.radio_conf.freq);
-      /* If transmit fails the packet buffer is released. */
-      if(!transmitOnRadio(result,
-                      conf_sram.aprs.tx.radio_conf.freq,
-                      0,
-                      0,
-                      conf_sram.aprs.tx.radio_conf.pwr,
-                      conf_sram.aprs.tx.radio_conf.mod,
-                      conf_sram.aprs.tx.radio_conf.cca)) {
-        TRACE_INFO("RX   > Failed to digipeat packet");
-      } /* TX failed. */
+      /* Remember the transmission on the channel the digipeater checks. */
+      dedupe_remember(result, 0);
+      if(conf_sram.aprs.digi_hold != 0)
+        aprs_digipeat_hold(result);
+      else
+        aprs_digipeat_transmit(result);
     } /* Should be digipeated. */
   } /* Duplicate check. */
 }
@@ -1308,39 +1954,26 @@ packet_t aprs_encode_telemetry_configuration(const char *originator,
 /*
  * 
  */
-void aprs_decode_packet(packet_t pp) {
-  // Get heard callsign
-  char call[AX25_MAX_ADDR_LEN];
-  int8_t v = -1;
-  do {
-    v++;
-    ax25_get_addr_with_ssid(pp, ax25_get_heard(pp)-v, call);
-  } while(((ax25_get_heard(pp) - v) >= AX25_SOURCE)
-      && (!strncmp("WIDE", call, 4) || !strncmp("TRACE", call, 5)));
+void aprs_decode_packet(packet_t pp, radio_signal_t rssi) {
+  // Get heard station skipping WIDE and TRACE aliases
+  int heard = ax25_get_heard(pp);
+  while(heard >= AX25_SOURCE) {
+    ax25_addr_key_t key = ax25_get_addr_key(pp, heard);
+    if(!ax25_addr_match(&wide_prefix, key)
+        && !ax25_addr_match(&trace_prefix, key))
+      break;
+    heard--;
+  }
 
   // Fill/Update direct list
-  sysinterval_t first_time = 0xFFFFFFFF;	// Timestamp of oldest heard list entry
-  uint8_t first_id = 0;					// ID of oldest heard list entry
-
-  for(uint8_t i=0; i <= APRS_HEARD_LIST_SIZE; i++) {
-    if(i < APRS_HEARD_LIST_SIZE) {
-      // Search for callsign in list
-      if(!strcmp(heard_list[i].call, call)) { // Callsign found in list
-        heard_list[i].time = chVTGetSystemTime(); // Update time the callsign was last heard
-        break;
-      }
+  if(heard >= AX25_SOURCE)
+    heard_update(pp, heard, rssi);
 
-      // Find oldest entry
-      if(first_time > heard_list[i].time) {
-        first_time = heard_list[i].time;
-        first_id = i;
-      }
-    } else { // Callsign not in list
-      // Overwrite old entry/ use empty entry
-      memcpy(heard_list[first_id].call, call, sizeof(heard_list[first_id].call));
-      heard_list[first_id].time = chVTGetSystemTime();
-    }
-  }
+  // Our own transmissions repeated by a digipeater confirm the TX power
+  txpower_heard(pp);
+
+  // Store fleet frames the ground may not have heard
+  relay_heard(pp);
 
   // Decode message packets
   unsigned char *pinfo;
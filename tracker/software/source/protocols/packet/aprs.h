@@ -54,10 +54,21 @@
 
 #define APRS_NUM_TELEM_GROUPS           4
 
-#define APRS_HEARD_LIST_SIZE            20
+#define APRS_HEARD_LIST_SIZE            20      // Stations listed in Directs
+
+#define APRS_DIGI_HOLD_SIZE             8
+#define APRS_DIGI_WA_SIZE               1024
+#define APRS_DIGI_RATE_SOURCES          16      // Sources with a digipeat airtime bucket
+#define APRS_DIGI_SOURCE_SHARE          25      // % of the digipeat airtime per source
 
 #define APRS_MAX_MSG_ARGUMENTS          10
 
+#define APRS_CMD_QUEUE_SIZE             4
+#define APRS_CMD_WA_SIZE                (4 * 1024)
+
+#define APRS_HEADER_CACHE_SIZE          4       // Pre-encoded frame headers
+#define APRS_HEADER_PATH_LEN            16
+
 typedef struct APRSIdentity {
   /* APRS parameters. */
   char              num[8];                  /**< @brief Message number.    */
@@ -84,6 +95,8 @@ typedef msg_t (*aprscmd_t)(aprs_identity_t *id, int argc, char *argv[]);
 typedef struct {
   const char        *ac_name;              /**< @brief Command name.       */
   aprscmd_t         ac_function;           /**< @brief Command function.   */
+  bool              ac_deferred;           /**< @brief Run by the command
+                                                       thread.             */
 } APRSCommand;
 
 
@@ -105,11 +118,21 @@ extern "C" {
   packet_t  aprs_format_transmit_message(const char *callsign, const char *path,
                                const char *receiver, const char *text,
                                const bool ack);
+  packet_t  aprs_format_numbered_message(const char *callsign, const char *path,
+                               const char *receiver, const char *text,
+                               const char *num);
   packet_t  aprs_encode_data_packet(const char *callsign, const char *path,
                                    char packetType, uint8_t *data);
+  packet_t  aprs_encode_base91_packet(const char *callsign, const char *path,
+                                   char packetType, const uint8_t *data,
+                                   uint16_t length);
+  packet_t  aprs_encode_binary_packet(const char *callsign, const char *path,
+                                   char packetType, const uint8_t *data,
+                                   uint16_t length);
   packet_t  aprs_compose_aprsd_message(const char *callsign, const char *path,
                                    const char *receiver);
-  void      aprs_decode_packet(packet_t pp);
+  void      aprs_decode_packet(packet_t pp, radio_signal_t rssi);
+  void      aprs_start_command_thread(void);
   msg_t     aprs_transmit_telemetry_response(aprs_identity_t *id,
                                   int argc, char *argv[]);
   msg_t     aprs_send_aprsd_message(aprs_identity_t *id,
@@ -126,6 +149,8 @@ extern "C" {
                                   int argc, char *argv[]);
   msg_t     aprs_execute_img_command(aprs_identity_t *id,
                                    int argc, char *argv[]);
+  msg_t     aprs_execute_log_command(aprs_identity_t *id,
+                                   int argc, char *argv[]);
   msg_t     aprs_execute_system_reset(aprs_identity_t *id,
                                   int argc, char *argv[]);
 #ifdef __cplusplus
@@ -0,0 +1,186 @@
+/**
+  * APRS messages sent with an ack request.
+  * A message is kept in the outstanding table until the addressee acks or
+  * rejects it. A virtual timer per message wakes the service thread which
+  * sends it again. The interval doubles after every try. The message is
+  * dropped after the last try.
+  */
+
+#include "ch.h"
+#include "hal.h"
+#include "aprsmsg.h"
+#include "debug.h"
+#include "radio.h"
+#include "chprintf.h"
+#include <string.h>
+
+typedef struct {
+	bool			used;
+	bool			due;		// Timer expired, send again
+	uint8_t			tries;		// Transmissions so far
+	char			num[6];		// Message number
+	sysinterval_t	interval;	// Time from the next try to the one after
+	aprs_identity_t	id;			// Addressee, path and radio parameters
+	char			text[AX25_MAX_APRS_MSG_LEN + 1];
+	virtual_timer_t	vt;
+} aprs_msg_t;
+
+static aprs_msg_t outstanding[APRS_MSG_OUTSTANDING];
+static uint16_t msg_num;
+static bool msg_started;
+static MUTEX_DECL(msg_mtx);
+static BSEMAPHORE_DECL(msg_sem, true);
+
+/**
+  * Retry timer of a message. Runs in ISR context so only flags the message.
+  */
+static void aprs_msg_timeout(void *arg) {
+	aprs_msg_t *mp = (aprs_msg_t *)arg;
+
+	chSysLockFromISR();
+	mp->due = true;
+	chBSemSignalI(&msg_sem);
+	chSysUnlockFromISR();
+}
+
+static bool aprs_msg_transmit(const aprs_identity_t *id, const char *text,
+							  const char *num) {
+	packet_t pp = aprs_format_numbered_message(id->call, id->path, id->src,
+											   text, num);
+	if(pp == NULL) {
+		TRACE_WARN("MSG  > No free packet objects or badly formed message");
+		return false;
+	}
+	/* Transmit failure releases the packet. */
+	return transmitOnRadio(pp, id->freq, 0, 0, id->pwr, id->mod, id->cca,
+						   TX_PRIO_COMMAND);
+}
+
+/**
+  * Service thread. Sends messages which are due and arms their next retry.
+  */
+static THD_FUNCTION(aprs_msg_thd, arg) {
+	(void)arg;
+
+	while(true) {
+		chBSemWait(&msg_sem);
+		for(uint8_t i = 0; i < APRS_MSG_OUTSTANDING; i++) {
+			aprs_msg_t *mp = &outstanding[i];
+			aprs_identity_t id;
+			char text[sizeof(mp->text)];
+			char num[sizeof(mp->num)];
+
+			chMtxLock(&msg_mtx);
+			chSysLock();
+			bool due = mp->used && mp->due;
+			mp->due = false;
+			chSysUnlock();
+			if(!due) {
+				chMtxUnlock(&msg_mtx);
+				continue;
+			}
+			if(mp->tries >= APRS_MSG_MAX_TRIES) {
+				TRACE_WARN("MSG  > No ack from %s for message %s",
+						   mp->id.src, mp->num);
+				mp->used = false;
+				chMtxUnlock(&msg_mtx);
+				continue;
+			}
+			mp->tries++;
+			id = mp->id;
+			strcpy(text, mp->text);
+			strcpy(num, mp->num);
+			chVTSet(&mp->vt, mp->interval, aprs_msg_timeout, mp);
+			mp->interval *= 2;
+			uint8_t tries = mp->tries;
+			chMtxUnlock(&msg_mtx);
+
+			TRACE_INFO("MSG  > Send message %s to %s (try %d)",
+					   num, id.src, tries);
+			if(!aprs_msg_transmit(&id, text, num))
+				TRACE_ERROR("MSG  > Transmit of message %s failed", num);
+		}
+	}
+}
+
+/**
+  * Start the message service thread.
+  */
+void aprs_msg_start(void) {
+	if(msg_started)
+		return;
+
+	for(uint8_t i = 0; i < APRS_MSG_OUTSTANDING; i++)
+		chVTObjectInit(&outstanding[i].vt);
+	thread_t *th = chThdCreateFromHeap(NULL,
+									   THD_WORKING_AREA_SIZE(APRS_MSG_WA_SIZE),
+									   "APRSMSG", LOWPRIO, aprs_msg_thd, NULL);
+	if(!th) {
+		TRACE_ERROR("MSG  > Could not start message thread (insufficient memory)");
+		return;
+	}
+	msg_started = true;
+}
+
+/**
+  * Send a message to the source of the identity.
+  * A reliable message requests an ack and is queued to the service thread.
+  * It is sent without an ack request if the outstanding table is full.
+  */
+msg_t aprs_msg_send(const aprs_identity_t *id, const char *text, bool reliable) {
+	if(reliable && msg_started) {
+		if(strlen(text) > AX25_MAX_APRS_MSG_LEN || strpbrk(text, "|~{") != NULL)
+			return MSG_ERROR;
+
+		chMtxLock(&msg_mtx);
+		for(uint8_t i = 0; i < APRS_MSG_OUTSTANDING; i++) {
+			aprs_msg_t *mp = &outstanding[i];
+			if(mp->used)
+				continue;
+			mp->id = *id;
+			strcpy(mp->text, text);
+			if(++msg_num == 0)
+				msg_num = 1;
+			chsnprintf(mp->num, sizeof(mp->num), "%d", msg_num);
+			mp->tries = 0;
+			mp->interval = APRS_MSG_RETRY_FIRST;
+			mp->due = true;
+			mp->used = true;
+			chMtxUnlock(&msg_mtx);
+			chBSemSignal(&msg_sem);
+			return MSG_OK;
+		}
+		chMtxUnlock(&msg_mtx);
+		TRACE_WARN("MSG  > Outstanding messages full, send without ack");
+	}
+
+	return aprs_msg_transmit(id, text, NULL) ? MSG_OK : MSG_ERROR;
+}
+
+/**
+  * Match an ack or rej received from src against outstanding messages.
+  * Returns true if the text is an ack or rej.
+  */
+bool aprs_msg_reply(const char *src, const char *text) {
+	bool ack = strncmp(text, "ack", 3) == 0;
+	if(!ack && strncmp(text, "rej", 3) != 0)
+		return false;
+
+	/* A reply-ack in the form ackNN}AA is matched on NN. */
+	const char *num = &text[3];
+	size_t len = strcspn(num, "} ");
+
+	chMtxLock(&msg_mtx);
+	for(uint8_t i = 0; i < APRS_MSG_OUTSTANDING; i++) {
+		aprs_msg_t *mp = &outstanding[i];
+		if(mp->used && strcmp(mp->id.src, src) == 0
+				&& strlen(mp->num) == len && strncmp(mp->num, num, len) == 0) {
+			chVTReset(&mp->vt);
+			mp->used = false;
+			TRACE_INFO("MSG  > Message %s %s by %s",
+					   mp->num, ack ? "acked" : "rejected", src);
+		}
+	}
+	chMtxUnlock(&msg_mtx);
+	return true;
+}
@@ -0,0 +1,17 @@
+#ifndef __APRSMSG_H__
+#define __APRSMSG_H__
+
+#include "ch.h"
+#include "hal.h"
+#include "aprs.h"
+
+#define APRS_MSG_OUTSTANDING	4				/* Messages awaiting an ack */
+#define APRS_MSG_RETRY_FIRST	TIME_S2I(30)	/* Doubled after every try */
+#define APRS_MSG_MAX_TRIES		5
+#define APRS_MSG_WA_SIZE		(2 * 1024)
+
+void aprs_msg_start(void);
+msg_t aprs_msg_send(const aprs_identity_t *id, const char *text, bool reliable);
+bool aprs_msg_reply(const char *src, const char *text);
+
+#endif
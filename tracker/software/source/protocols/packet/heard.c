@@ -0,0 +1,165 @@
+/**
+  * Stations heard directly.
+  * Stations are keyed by the packed address (ax25_get_addr_key()) and found
+  * through a hash table. The least recently heard station
+  * is replaced when the list is full.
+  */
+
+#include "ch.h"
+#include "hal.h"
+#include "heard.h"
+#include "chprintf.h"
+#include <string.h>
+
+#define HEARD_NONE				0xFF
+
+typedef struct {
+	uint64_t		key;		// Shifted callsign characters and SSID
+	systime_t		time;		// Time last heard
+	uint16_t		count;		// Frames heard
+	radio_signal_t	rssi;		// RSSI of the last frame
+	uint8_t			chain;		// Next station in the hash bucket
+	uint8_t			newer;		// Next more recently heard station
+	uint8_t			older;		// Next less recently heard station
+} heard_t;
+
+static heard_t heard[HEARD_LIST_SIZE];
+static uint8_t buckets[HEARD_HASH_SIZE];
+static uint8_t newest = HEARD_NONE;
+static uint8_t oldest = HEARD_NONE;
+static uint8_t num_heard;
+static bool heard_initialized;
+static MUTEX_DECL(heard_mtx);
+
+static void getCall(uint64_t key, char *call) {
+	uint8_t ssid = key >> 48;
+	uint8_t j = 0;
+	for(int8_t i = 5; i >= 0; i--) {
+		char c = (key >> (8 * i) & 0xFF) >> 1;
+		if(c == ' ')
+			break;
+		call[j++] = c;
+	}
+	if(ssid != 0)
+		chsnprintf(&call[j], AX25_MAX_ADDR_LEN - j, "-%d", ssid);
+	else
+		call[j] = '\0';
+}
+
+static uint8_t getBucket(uint64_t key) {
+	uint32_t h = (uint32_t)key ^ (uint32_t)(key >> 32);
+	return (h * 2654435761u) >> 24 & (HEARD_HASH_SIZE - 1);
+}
+
+static void getInfo(uint8_t i, heard_info_t *info) {
+	getCall(heard[i].key, info->call);
+	info->time = heard[i].time;
+	info->count = heard[i].count;
+	info->rssi = heard[i].rssi;
+}
+
+static void unlinkRecent(uint8_t i) {
+	if(heard[i].newer != HEARD_NONE)
+		heard[heard[i].newer].older = heard[i].older;
+	else
+		newest = heard[i].older;
+	if(heard[i].older != HEARD_NONE)
+		heard[heard[i].older].newer = heard[i].newer;
+	else
+		oldest = heard[i].newer;
+}
+
+static void linkNewest(uint8_t i) {
+	heard[i].newer = HEARD_NONE;
+	heard[i].older = newest;
+	if(newest != HEARD_NONE)
+		heard[newest].newer = i;
+	else
+		oldest = i;
+	newest = i;
+}
+
+static void unlinkBucket(uint8_t i) {
+	uint8_t *p = &buckets[getBucket(heard[i].key)];
+	while(*p != i)
+		p = &heard[*p].chain;
+	*p = heard[i].chain;
+}
+
+/**
+  * Update the station of address n in a received frame.
+  */
+void heard_update(packet_t pp, int n, radio_signal_t rssi) {
+	uint64_t key = ax25_get_addr_key(pp, n);
+	uint8_t b = getBucket(key);
+
+	chMtxLock(&heard_mtx);
+	if(!heard_initialized) {
+		memset(buckets, HEARD_NONE, sizeof(buckets));
+		heard_initialized = true;
+	}
+
+	uint8_t i = buckets[b];
+	while(i != HEARD_NONE && heard[i].key != key)
+		i = heard[i].chain;
+
+	if(i == HEARD_NONE) { // New station
+		if(num_heard < HEARD_LIST_SIZE) {
+			i = num_heard++;
+		} else { // Replace the least recently heard station
+			i = oldest;
+			unlinkBucket(i);
+			unlinkRecent(i);
+		}
+		heard[i].key = key;
+		heard[i].count = 0;
+		heard[i].chain = buckets[b];
+		buckets[b] = i;
+	} else {
+		unlinkRecent(i);
+	}
+	linkNewest(i);
+
+	heard[i].time = chVTGetSystemTime();
+	if(heard[i].count < 0xFFFF)
+		heard[i].count++;
+	heard[i].rssi = rssi;
+	chMtxUnlock(&heard_mtx);
+}
+
+/**
+  * Find the most recently heard station starting with a prefix.
+  */
+bool heard_find_prefix(const char *prefix, heard_info_t *info) {
+	size_t len = strlen(prefix);
+	bool found = false;
+
+	chMtxLock(&heard_mtx);
+	for(uint8_t i = newest; i != HEARD_NONE; i = heard[i].older) {
+		getInfo(i, info);
+		if(strncmp(info->call, prefix, len) == 0) {
+			found = true;
+			break;
+		}
+	}
+	chMtxUnlock(&heard_mtx);
+	return found;
+}
+
+/**
+  * Copy the stations heard within an age, most recently heard first.
+  * @return number of stations copied
+  */
+uint8_t heard_get_recent(heard_info_t *list, uint8_t max, sysinterval_t age) {
+	uint8_t cnt = 0;
+
+	chMtxLock(&heard_mtx);
+	for(uint8_t i = newest; i != HEARD_NONE && cnt < max; i = heard[i].older) {
+		if(chVTTimeElapsedSinceX(heard[i].time) > age)
+			break; // All further stations are older
+		getInfo(i, &list[cnt++]);
+	}
+	chMtxUnlock(&heard_mtx);
+	return cnt;
+}
+
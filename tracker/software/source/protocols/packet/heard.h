@@ -0,0 +1,24 @@
+#ifndef __HEARD_H__
+#define __HEARD_H__
+
+#include "ch.h"
+#include "hal.h"
+#include "pkttypes.h"
+#include "ax25_pad.h"
+
+#define HEARD_LIST_SIZE			64		/* Stations kept, at most 255 */
+#define HEARD_HASH_SIZE			128		/* Hash buckets, power of 2 */
+
+typedef struct {
+	char			call[AX25_MAX_ADDR_LEN];	// Callsign with SSID
+	systime_t		time;						// Time last heard
+	uint16_t		count;						// Frames heard
+	radio_signal_t	rssi;						// RSSI of the last frame
+} heard_info_t;
+
+void heard_update(packet_t pp, int n, radio_signal_t rssi);
+bool heard_find_prefix(const char *prefix, heard_info_t *info);
+uint8_t heard_get_recent(heard_info_t *list, uint8_t max, sysinterval_t age);
+
+#endif
+
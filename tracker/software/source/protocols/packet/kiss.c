@@ -0,0 +1,141 @@
+/**
+  * KISS TNC over a serial channel.
+  * Received frames are written to the host straight from the receive buffer
+  * with FEND and FESC escaped on the fly. Data frames from the host are
+  * unescaped into a frame buffer and transmitted on the APRS TX radio
+  * configuration. KISS parameter commands are ignored as the radio service
+  * handles channel access.
+  */
+
+#include "ch.h"
+#include "hal.h"
+#include "kiss.h"
+#include "config.h"
+#include "debug.h"
+#include "radio.h"
+#include "ax25_pad.h"
+#include <string.h>
+
+#define KISS_FEND				0xC0
+#define KISS_FESC				0xDB
+#define KISS_TFEND				0xDC
+#define KISS_TFESC				0xDD
+
+#define KISS_CMD_DATA			0x00	/* Low nibble, high nibble is port */
+#define KISS_CMD_RETURN			0xFF	/* Leave KISS mode */
+#define KISS_CMD_NONE			(-1)	/* Waiting for the command byte */
+
+static BaseChannel *kiss_chn;
+static MUTEX_DECL(kiss_mtx);
+static uint8_t kiss_frame[AX25_MAX_PACKET_LEN];
+
+static void kiss_write(BaseChannel *chn, const uint8_t *data, size_t len) {
+	if(len != 0)
+		chnWriteTimeout(chn, data, len, KISS_WRITE_TIMEOUT);
+}
+
+/**
+  * Send a received frame (without CRC) to the host if KISS mode is active.
+  * Runs of bytes which need no escape are written from the frame itself.
+  */
+void kiss_send_frame(const uint8_t *frame, size_t len) {
+	static const uint8_t start[] = {KISS_FEND, KISS_CMD_DATA};
+	static const uint8_t esc_fend[] = {KISS_FESC, KISS_TFEND};
+	static const uint8_t esc_fesc[] = {KISS_FESC, KISS_TFESC};
+
+	if(kiss_chn == NULL)
+		return;
+
+	chMtxLock(&kiss_mtx);
+	BaseChannel *chn = kiss_chn;
+	if(chn != NULL) {
+		kiss_write(chn, start, sizeof(start));
+		size_t run = 0;
+		for(size_t i = 0; i < len; i++) {
+			if(frame[i] != KISS_FEND && frame[i] != KISS_FESC)
+				continue;
+			kiss_write(chn, &frame[run], i - run);
+			kiss_write(chn, frame[i] == KISS_FEND ? esc_fend : esc_fesc, 2);
+			run = i + 1;
+		}
+		kiss_write(chn, &frame[run], len - run);
+		kiss_write(chn, start, 1);
+	}
+	chMtxUnlock(&kiss_mtx);
+}
+
+static void kiss_transmit(uint8_t *frame, uint16_t len) {
+	packet_t pp = ax25_from_frame(frame, len);
+	if(pp == NULL) {
+		TRACE_WARN("KISS > Invalid frame or no free packet objects");
+		return;
+	}
+	if(!transmitOnRadio(pp,
+						conf_sram.aprs.tx.radio_conf.freq,
+						0,
+						0,
+						conf_sram.aprs.tx.radio_conf.pwr,
+						conf_sram.aprs.tx.radio_conf.mod,
+						conf_sram.aprs.tx.radio_conf.cca,
+						TX_PRIO_COMMAND)) {
+		TRACE_ERROR("KISS > Transmit failed");
+	}
+}
+
+/**
+  * Run KISS mode on a channel until the host sends the return command,
+  * the channel is reset or the calling thread is terminated.
+  */
+void kiss_run(BaseChannel *chn) {
+	int16_t cmd = KISS_CMD_NONE;
+	uint16_t len = 0;
+	bool esc = false;
+	bool overrun = false;
+
+	chMtxLock(&kiss_mtx);
+	kiss_chn = chn;
+	chMtxUnlock(&kiss_mtx);
+
+	while(!chThdShouldTerminateX()) {
+		msg_t c = chnGetTimeout(chn, TIME_MS2I(100));
+		if(c == STM_TIMEOUT)
+			continue;
+		if(c == STM_RESET)
+			break;
+		if(c == KISS_FEND) {
+			if((cmd & 0x0F) == KISS_CMD_DATA && len != 0 && !overrun)
+				kiss_transmit(kiss_frame, len);
+			cmd = KISS_CMD_NONE;
+			len = 0;
+			esc = false;
+			overrun = false;
+			continue;
+		}
+		if(cmd == KISS_CMD_NONE) {
+			cmd = c;
+			if(cmd == KISS_CMD_RETURN)
+				break;
+			continue;
+		}
+		if((cmd & 0x0F) != KISS_CMD_DATA)
+			continue;
+		if(esc) {
+			esc = false;
+			if(c == KISS_TFEND)
+				c = KISS_FEND;
+			else if(c == KISS_TFESC)
+				c = KISS_FESC;
+		} else if(c == KISS_FESC) {
+			esc = true;
+			continue;
+		}
+		if(len < sizeof(kiss_frame))
+			kiss_frame[len++] = c;
+		else
+			overrun = true;
+	}
+
+	chMtxLock(&kiss_mtx);
+	kiss_chn = NULL;
+	chMtxUnlock(&kiss_mtx);
+}
@@ -0,0 +1,12 @@
+#ifndef __KISS_H__
+#define __KISS_H__
+
+#include "ch.h"
+#include "hal.h"
+
+#define KISS_WRITE_TIMEOUT		TIME_MS2I(100)	/* Host stopped reading */
+
+void kiss_run(BaseChannel *chn);
+void kiss_send_frame(const uint8_t *frame, size_t len);
+
+#endif
@@ -0,0 +1,205 @@
+/**
+  * Store and forward relay of fleet frames.
+  * Frames heard directly from the fleet call signs in aprs.relay are held
+  * in RAM for aprs.relay_hold. A frame heard repeated by a digipeater in
+  * that time has reached the ground network and is dropped. The others are
+  * sent again from this tracker with its call inserted as the repeater used
+  * so the rest of the path is still digipeated.
+  *
+  * Relays are sent at bulk priority through the radio manager so they take
+  * the TDMA slot of this tracker and give way to its own sends.
+  */
+
+#include "ch.h"
+#include "hal.h"
+#include "relay.h"
+#include "config.h"
+#include "radio.h"
+#include "budget.h"
+#include "stats.h"
+#include "debug.h"
+#include <string.h>
+
+typedef struct {
+	uint16_t		len;		// Frame length, 0 if the entry is free
+	unsigned short	crc;		// Dedupe CRC of the frame
+	systime_t		release;	// Time to relay the frame
+	uint8_t			frame[AX25_MAX_PACKET_LEN];
+} relay_entry_t;
+
+static relay_entry_t relay_store[RELAY_STORE_SIZE];
+static MUTEX_DECL(relay_mtx);
+static BSEMAPHORE_DECL(relay_sem, true);
+static bool relay_started;
+static STATS_DECL(relay_stats_stored, "relay stored");
+static STATS_DECL(relay_stats_heard, "relay heard by ground");
+static STATS_DECL(relay_stats_sent, "relay sent");
+static STATS_DECL(relay_stats_dropped, "relay dropped");
+
+/*
+ * Check if a source is one of the fleet call signs.
+ * Call signs are separated by commas or spaces. A call sign ending in *
+ * is a prefix matching any SSID.
+ */
+static bool relay_is_fleet(ax25_addr_key_t key) {
+	const char *list = conf_sram.aprs.relay;
+	while(*list != '\0') {
+		char call[AX25_MAX_ADDR_LEN];
+		uint8_t n = 0;
+		while(*list == ',' || *list == ' ')
+			list++;
+		while(*list != '\0' && *list != ',' && *list != ' ') {
+			if(n < sizeof(call) - 1)
+				call[n++] = *list;
+			list++;
+		}
+		if(n == 0)
+			continue;
+		bool prefix = call[n - 1] == '*';
+		call[prefix ? n - 1 : n] = '\0';
+		ax25_addr_match_t match;
+		if(ax25_addr_match_init(&match, call, prefix)
+				&& ax25_addr_match(&match, key))
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Send a stored frame with this tracker marked as the repeater used.
+ */
+static void relay_transmit(uint8_t *frame, uint16_t len) {
+	packet_t pp = ax25_from_frame(frame, len);
+	if(pp == NULL) {
+		TRACE_WARN("RLY  > No free packet objects");
+		stats_count(&relay_stats_dropped, 1);
+		return;
+	}
+	if(ax25_get_num_repeaters(pp) < AX25_MAX_REPEATERS) {
+		int r = ax25_get_heard(pp) + 1;
+		ax25_insert_addr(pp, r, conf_sram.aprs.tx.call);
+		ax25_set_h(pp, r);
+	}
+
+	mod_t mod = conf_sram.aprs.tx.radio_conf.mod;
+	if(budget_available(BUDGET_DIGI) <= 0) {
+		TRACE_INFO("RLY  > Airtime budget used up, relay dropped");
+		stats_count(&relay_stats_dropped, 1);
+		pktReleaseBufferChain(pp);
+		return;
+	}
+	budget_charge(BUDGET_DIGI, pp, mod, 0);
+	stats_count(&relay_stats_sent, 1);
+	if(!transmitOnRadio(pp,
+						conf_sram.aprs.tx.radio_conf.freq,
+						0,
+						0,
+						conf_sram.aprs.tx.radio_conf.pwr,
+						mod,
+						conf_sram.aprs.tx.radio_conf.cca,
+						TX_PRIO_BULK)) {
+		TRACE_INFO("RLY  > Failed to relay packet");
+	}
+}
+
+/*
+ * Relay stored frames when their hold time is over.
+ */
+static THD_FUNCTION(relay_thd, arg) {
+	(void)arg;
+	uint8_t frame[AX25_MAX_PACKET_LEN];
+
+	while(true) {
+		sysinterval_t wait = TIME_INFINITE;
+		uint16_t len = 0;
+
+		chMtxLock(&relay_mtx);
+		for(uint8_t i = 0; i < RELAY_STORE_SIZE; i++) {
+			relay_entry_t *e = &relay_store[i];
+			if(e->len == 0)
+				continue;
+			sysinterval_t left = chTimeDiffX(chVTGetSystemTime(), e->release);
+			/* Release times passed show as a long wait after wrap. */
+			if(left == 0 || left > conf_sram.aprs.relay_hold) {
+				len = e->len;
+				memcpy(frame, e->frame, len);
+				e->len = 0;
+				break;
+			}
+			if(left < wait)
+				wait = left;
+		}
+		chMtxUnlock(&relay_mtx);
+
+		if(len != 0) {
+			relay_transmit(frame, len);
+			continue;
+		}
+		/* A new frame may be stored with an earlier release. */
+		(void)chBSemWaitTimeout(&relay_sem, wait);
+	}
+}
+
+/**
+  * Store a frame heard directly from the fleet or drop a stored frame which
+  * a digipeater has repeated.
+  * Frames are compared by the dedupe CRC of source, destination and info.
+  */
+void relay_heard(packet_t pp) {
+	if(conf_sram.aprs.relay[0] == '\0')
+		return;
+
+	unsigned short crc = ax25_dedupe_crc(pp);
+	if(ax25_get_heard(pp) >= AX25_REPEATER_1) {
+		/* Heard by a digipeater, or relayed by another tracker. */
+		chMtxLock(&relay_mtx);
+		for(uint8_t i = 0; i < RELAY_STORE_SIZE; i++) {
+			if(relay_store[i].len != 0 && relay_store[i].crc == crc) {
+				relay_store[i].len = 0;
+				stats_count(&relay_stats_heard, 1);
+			}
+		}
+		chMtxUnlock(&relay_mtx);
+		return;
+	}
+
+	if(pp->frame_len >= AX25_MAX_PACKET_LEN
+			|| !relay_is_fleet(ax25_get_addr_key(pp, AX25_SOURCE)))
+		return;
+
+	systime_t now = chVTGetSystemTime();
+	chMtxLock(&relay_mtx);
+	relay_entry_t *e = NULL;
+	for(uint8_t i = 0; i < RELAY_STORE_SIZE; i++) {
+		relay_entry_t *s = &relay_store[i];
+		if(s->len != 0 && s->crc == crc) {
+			/* A copy of a frame already held. */
+			chMtxUnlock(&relay_mtx);
+			return;
+		}
+		/* A free entry or else the one due first is used. */
+		if(e == NULL || (e->len != 0 && (s->len == 0
+				|| chTimeDiffX(now, s->release) < chTimeDiffX(now, e->release))))
+			e = s;
+	}
+	if(e->len != 0)
+		stats_count(&relay_stats_dropped, 1);
+	memcpy(e->frame, pp->frame_data, pp->frame_len);
+	e->len = pp->frame_len;
+	e->crc = crc;
+	e->release = chTimeAddX(now, conf_sram.aprs.relay_hold);
+	stats_count(&relay_stats_stored, 1);
+	chMtxUnlock(&relay_mtx);
+
+	if(!relay_started) {
+		thread_t *th = chThdCreateFromHeap(NULL,
+										   THD_WORKING_AREA_SIZE(RELAY_WA_SIZE),
+										   "RELAY", LOWPRIO, relay_thd, NULL);
+		if(th == NULL) {
+			TRACE_ERROR("RLY  > Could not start relay thread (insufficient memory)");
+			return;
+		}
+		relay_started = true;
+	}
+	chBSemSignal(&relay_sem);
+}
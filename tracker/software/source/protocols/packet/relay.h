@@ -0,0 +1,13 @@
+#ifndef __RELAY_H__
+#define __RELAY_H__
+
+#include "ch.h"
+#include "hal.h"
+#include "ax25_pad.h"
+
+#define RELAY_STORE_SIZE		12		/* Frames held for relay */
+#define RELAY_WA_SIZE			1536	/* Holds a frame copied out of the store */
+
+void relay_heard(packet_t pp);
+
+#endif
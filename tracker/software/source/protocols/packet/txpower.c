@@ -0,0 +1,133 @@
+/**
+  * Transmit power from link feedback.
+  * Each station transmitting from this device has a power level. It is the
+  * source of the frames the device originates and the digipeater call of
+  * the frames it repeats. The power of a station steps down while its sends
+  * are confirmed and steps back up when sends go unconfirmed.
+  *
+  * A send is confirmed when it is heard again repeated by a digipeater or
+  * when a message to the station is acked. When no stations have been heard
+  * recently there is nobody to give feedback so the configured power is used.
+  */
+
+#include "ch.h"
+#include "hal.h"
+#include "txpower.h"
+#include "heard.h"
+#include "debug.h"
+
+typedef struct {
+	ax25_addr_key_t	key;		// Station, 0 if the entry is unused
+	systime_t		time;		// Time of the last send
+	uint8_t			level;		// Halvings of the configured power
+	uint8_t			sent;		// Sends since the last confirmation
+	uint8_t			confirms;	// Confirmations at this level
+} txpwr_station_t;
+
+static txpwr_station_t txpwr_stations[TXPWR_STATIONS];
+static MUTEX_DECL(txpwr_mtx);
+
+/*
+ * Find the entry of a station.
+ * Must be called with the mutex locked.
+ */
+static txpwr_station_t *txpwr_find(ax25_addr_key_t key) {
+	if(key == 0)
+		return NULL;
+	for(uint8_t i = 0; i < TXPWR_STATIONS; i++) {
+		if(txpwr_stations[i].key == key)
+			return &txpwr_stations[i];
+	}
+	return NULL;
+}
+
+/*
+ * Count a confirmation of the sends of a station.
+ * Must be called with the mutex locked.
+ */
+static void txpwr_confirm(txpwr_station_t *s) {
+	/* Echoes of one send are counted once. */
+	if(s == NULL || s->sent == 0)
+		return;
+	s->sent = 0;
+	if(++s->confirms >= TXPWR_CONFIRMS && s->level < TXPWR_STEPS) {
+		s->level++;
+		s->confirms = 0;
+		TRACE_INFO("RAD  > Transmissions confirmed, power level -%d",
+				   s->level);
+	}
+}
+
+/**
+  * Get the power of a send and count the send for its station.
+  * The power is the configured power halved for each level of the station.
+  */
+radio_pwr_t txpower_adjust(packet_t pp, radio_pwr_t pwr) {
+	int n = ax25_get_heard(pp);
+	if(n < AX25_SOURCE)
+		return pwr;
+	ax25_addr_key_t key = ax25_get_addr_key(pp, n);
+	heard_info_t info;
+	bool feedback = heard_get_recent(&info, 1, TXPWR_HEARD_AGE) != 0;
+	systime_t now = chVTGetSystemTime();
+
+	chMtxLock(&txpwr_mtx);
+	txpwr_station_t *s = txpwr_find(key);
+	if(s == NULL) {
+		/* The station which sent least recently is replaced. */
+		s = &txpwr_stations[0];
+		for(uint8_t i = 1; i < TXPWR_STATIONS && s->key != 0; i++) {
+			if(txpwr_stations[i].key == 0
+					|| now - txpwr_stations[i].time > now - s->time)
+				s = &txpwr_stations[i];
+		}
+		s->key = key;
+		s->level = 0;
+		s->sent = 0;
+		s->confirms = 0;
+	}
+	s->time = now;
+	if(!feedback) {
+		s->level = 0;
+		s->sent = 0;
+		s->confirms = 0;
+	} else if(++s->sent > TXPWR_MISSES) {
+		s->sent = 1;
+		s->confirms = 0;
+		if(s->level > 0) {
+			s->level--;
+			TRACE_INFO("RAD  > Transmissions not confirmed, power level -%d",
+					   s->level);
+		}
+	}
+	uint8_t level = s->level;
+	chMtxUnlock(&txpwr_mtx);
+
+	radio_pwr_t min = (pwr < TXPWR_MIN) ? pwr : TXPWR_MIN;
+	radio_pwr_t adjusted = pwr >> level;
+	return (adjusted < min) ? min : adjusted;
+}
+
+/**
+  * Confirm the sends of stations repeated in a received frame.
+  * Addresses before the last repeater used were heard by that repeater.
+  */
+void txpower_heard(packet_t pp) {
+	int heard = ax25_get_heard(pp);
+	chMtxLock(&txpwr_mtx);
+	for(int i = AX25_SOURCE; i < heard; i++)
+		txpwr_confirm(txpwr_find(ax25_get_addr_key(pp, i)));
+	chMtxUnlock(&txpwr_mtx);
+}
+
+/**
+  * Confirm the sends of a station which got an ack or reject of a message.
+  */
+void txpower_ack(const char *call) {
+	ax25_addr_key_t key;
+	if(!ax25_addr_key_from_text(call, &key))
+		return;
+	chMtxLock(&txpwr_mtx);
+	txpwr_confirm(txpwr_find(key));
+	chMtxUnlock(&txpwr_mtx);
+}
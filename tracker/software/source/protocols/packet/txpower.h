@@ -0,0 +1,20 @@
+#ifndef __TXPOWER_H__
+#define __TXPOWER_H__
+
+#include "ch.h"
+#include "hal.h"
+#include "pkttypes.h"
+#include "ax25_pad.h"
+
+#define TXPWR_STATIONS			8		/* Transmitting stations with a power level */
+#define TXPWR_STEPS				3		/* Halvings of the configured power at most */
+#define TXPWR_MIN				0x10	/* Power is not stepped below this */
+#define TXPWR_CONFIRMS			2		/* Confirmed sends to step the power down */
+#define TXPWR_MISSES			4		/* Unconfirmed sends to step the power up */
+#define TXPWR_HEARD_AGE			TIME_S2I(600)	/* Stations heard to give feedback */
+
+radio_pwr_t txpower_adjust(packet_t pp, radio_pwr_t pwr);
+void txpower_heard(packet_t pp);
+void txpower_ack(const char *call);
+
+#endif
@@ -73,6 +73,75 @@ static inline int mod255(int x)
 #define MIN(a,b) ((a) < (b) ? (a) : (b))
 #define A0       (NN) /* Special reserved value encoding zero in index form */
 
+#if RS8_FAST_ENCODE
+
+/* Products of each feedback value with the generator polynomial. Each
+ * row is the 32 parity bytes packed big endian into 8 words */
+static uint32_t GENMUL[256][NROOTS / 4];
+static uint8_t genmul_ready = 0;
+
+static void init_rs_8_genmul(void)
+{
+	int fb, m;
+	
+	for(fb = 0; fb < 256; fb++)
+	{
+		for(m = 0; m < NROOTS; m++)
+		{
+			uint8_t v = 0;
+			
+			if(fb != 0)
+				v = ALPHA_TO[mod255(INDEX_OF[fb] + GENPOLY[NROOTS - 1 - m])];
+			
+			if((m & 3) == 0) GENMUL[fb][m >> 2] = 0;
+			GENMUL[fb][m >> 2] |= (uint32_t) v << (24 - 8 * (m & 3));
+		}
+	}
+	
+	genmul_ready = 1;
+}
+
+/* Table driven version */
+void encode_rs_8(uint8_t *data, uint8_t *parity, int pad)
+{
+	uint32_t p[NROOTS / 4] = { 0 };
+	const uint32_t *g;
+	int i, k;
+	
+	if(!genmul_ready) init_rs_8_genmul();
+	
+	for(i = 0; i < NN - NROOTS - pad; i++)
+	{
+		g = GENMUL[data[i] ^ (p[0] >> 24)];
+		
+		/* Shift one byte and add the feedback terms */
+		for(k = 0; k < NROOTS / 4 - 1; k++)
+			p[k] = ((p[k] << 8) | (p[k + 1] >> 24)) ^ g[k];
+		p[k] = (p[k] << 8) ^ g[k];
+	}
+	
+	for(k = 0; k < NROOTS; k++)
+		parity[k] = p[k >> 2] >> (24 - 8 * (k & 3));
+}
+
+/* Encode one data byte into the parity of a block in progress. The parity
+ * starts cleared and is complete after the last data byte. A shortened
+ * block is encoded the same as its pad bytes are zero */
+void encode_rs_8_byte(uint8_t data, uint8_t *parity)
+{
+	const uint32_t *g;
+	int k;
+	
+	if(!genmul_ready) init_rs_8_genmul();
+	
+	g = GENMUL[data ^ parity[0]];
+	for(k = 0; k < NROOTS - 1; k++)
+		parity[k] = parity[k + 1] ^ (g[k >> 2] >> (24 - 8 * (k & 3)));
+	parity[k] = g[k >> 2] >> (24 - 8 * (k & 3));
+}
+
+#else
+
 /* Portable C version */
 void encode_rs_8(uint8_t *data, uint8_t *parity, int pad)
 {
@@ -99,6 +168,28 @@ void encode_rs_8(uint8_t *data, uint8_t *parity, int pad)
 	}
 }
 
+/* Encode one data byte into the parity of a block in progress */
+void encode_rs_8_byte(uint8_t data, uint8_t *parity)
+{
+	int j;
+	uint8_t feedback;
+	
+	feedback = INDEX_OF[data ^ parity[0]];
+	if(feedback != A0)
+	{
+		for(j = 1; j < NROOTS; j++)
+			parity[j] ^= ALPHA_TO[mod255(feedback + GENPOLY[NROOTS - j])];
+	}
+	
+	memmove(&parity[0], &parity[1], sizeof(uint8_t) * (NROOTS - 1));
+	if(feedback != A0)
+		parity[NROOTS - 1] = ALPHA_TO[mod255(feedback + GENPOLY[0])];
+	else
+		parity[NROOTS - 1] = 0;
+}
+
+#endif
+
 int decode_rs_8(uint8_t *data, int *eras_pos, int no_eras, int pad)
 {
 	int deg_lambda, el, deg_omega;
@@ -13,7 +13,13 @@ extern "C" {
 
 #include <stdint.h>
 
+/* Encode with a table of generator products and a 32-bit wide LFSR */
+#ifndef RS8_FAST_ENCODE
+#define RS8_FAST_ENCODE 1
+#endif
+
 extern void encode_rs_8(uint8_t *data, uint8_t *parity, int pad);
+extern void encode_rs_8_byte(uint8_t data, uint8_t *parity);
 extern int decode_rs_8(uint8_t *data, int *eras_pos, int no_eras, int pad);
 
 #ifdef __cplusplus
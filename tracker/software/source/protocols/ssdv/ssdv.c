@@ -18,10 +18,12 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include "ssdv.h"
 #include "rs8.h"
 #include "debug.h"
+#include "pcrc.h"
 
 /* Recognised JPEG markers */
 enum {
@@ -109,9 +111,26 @@ static const uint8_t std_dht11[179] = {
 0xF8,0xF9,0xFA,
 };
 
+static const uint8_t *const std_dht[2][2] = {
+	{ std_dht00, std_dht01 },
+	{ std_dht10, std_dht11 },
+};
+
+static const uint16_t std_dht_len[2][2] = {
+	{ sizeof(std_dht00), sizeof(std_dht01) },
+	{ sizeof(std_dht10), sizeof(std_dht11) },
+};
+
+/* Lookup tables for the standard Huffman tables, built on first use */
+static ssdv_dht_fast_t std_dht_fast[2][2][1 << DHT_FAST_BITS];
+static ssdv_dht_code_t std_dht_code[2][2][256];
+static volatile char std_dht_ready = 0;
+
 /* Helper for returning the current DHT table */
 #define SDHT (s->sdht[s->acpart ? 1 : 0][s->component ? 1 : 0])
 #define DDHT (s->ddht[s->acpart ? 1 : 0][s->component ? 1 : 0])
+#define SFAST (s->sfast[s->acpart ? 1 : 0][s->component ? 1 : 0])
+#define DCODE (s->dcode[s->acpart ? 1 : 0][s->component ? 1 : 0])
 
 /* Helpers for looking up the current DQT value */
 #define SDQT (s->sdqt[s->component ? 1 : 0][1 + s->acpart])
@@ -216,21 +235,8 @@ static void *dtblcpy(ssdv_t *s, const void *src, size_t n)
 
 static uint32_t crc32(void *data, size_t length)
 {
-	uint32_t crc, x;
-	uint8_t i, *d;
-	
-	for(d = data, crc = 0xFFFFFFFF; length; length--)
-	{
-		x = (crc ^ *(d++)) & 0xFF;
-		for(i = 8; i > 0; i--)
-		{
-			if(x & 1) x = (x >> 1) ^ 0xEDB88320;
-			else x >>= 1;
-		}
-		crc = (crc >> 8) ^ x;
-	}
-	
-	return(crc ^ 0xFFFFFFFF);
+	/* Done by the CRC unit rather than bit by bit. */
+	return(crc32_calc(data, length));
 }
 
 static uint32_t encode_callsign(char *callsign)
@@ -277,11 +283,92 @@ static char *decode_callsign(char *callsign, uint32_t code)
 	return(callsign);
 }
 
+static void jpeg_dht_build(const uint8_t *dht, ssdv_dht_fast_t *fast, ssdv_dht_code_t *codes)
+{
+	uint16_t code = 0, i, first, count;
+	uint8_t cw, n;
+	const uint8_t *ss = &dht[17];
+	
+	memset(fast, 0, sizeof(ssdv_dht_fast_t) << DHT_FAST_BITS);
+	memset(codes, 0, sizeof(ssdv_dht_code_t) * 256);
+	
+	for(cw = 1; cw <= 16; cw++)
+	{
+		for(n = dht[cw]; n > 0; n--)
+		{
+			/* The first code for a symbol is the one found by a search */
+			if(codes[*ss].width == 0)
+			{
+				codes[*ss].code = code;
+				codes[*ss].width = cw;
+			}
+			
+			/* Every index starting with a short code decodes to it */
+			if(cw <= DHT_FAST_BITS)
+			{
+				first = code << (DHT_FAST_BITS - cw);
+				count = 1 << (DHT_FAST_BITS - cw);
+				for(i = 0; i < count; i++)
+				{
+					fast[first + i].symbol = *ss;
+					fast[first + i].width = cw;
+				}
+			}
+			ss++; code++;
+		}
+		
+		code <<= 1;
+	}
+}
+
+static void jpeg_std_dht_init(void)
+{
+	uint8_t i, j;
+	
+	if(std_dht_ready) return;
+	
+	/* Building again from another thread writes the same values */
+	for(i = 0; i < 2; i++)
+		for(j = 0; j < 2; j++)
+			jpeg_dht_build(std_dht[i][j], std_dht_fast[i][j], std_dht_code[i][j]);
+	
+	std_dht_ready = 1;
+}
+
+static const ssdv_dht_fast_t *jpeg_std_dht_fast(const uint8_t *dht, uint8_t i, uint8_t j)
+{
+	/* The camera normally uses the standard tables */
+	if(memcmp(dht, std_dht[i][j], std_dht_len[i][j]) != 0) return(NULL);
+	return(std_dht_fast[i][j]);
+}
+
 static inline char jpeg_dht_lookup(ssdv_t *s, uint8_t *symbol, uint8_t *width)
 {
 	uint16_t code = 0;
 	uint8_t cw, n;
 	uint8_t *dht, *ss;
+	const ssdv_dht_fast_t *fast = SFAST;
+	
+	if(fast)
+	{
+		/* Index with the next bits, padded if not enough yet */
+		code = s->worklen >= DHT_FAST_BITS
+		     ? s->workbits >> (s->worklen - DHT_FAST_BITS)
+		     : s->workbits << (DHT_FAST_BITS - s->worklen);
+		fast = &fast[code & ((1 << DHT_FAST_BITS) - 1)];
+		code = 0;
+		
+		if(fast->width)
+		{
+			/* A longer code than the bits held needs more bits */
+			if(fast->width > s->worklen) return(SSDV_FEED_ME);
+			*symbol = fast->symbol;
+			*width = fast->width;
+			return(SSDV_OK);
+		}
+		
+		/* Codes longer than the table are searched for */
+	}
 	
 	/* Select the appropriate huffman table */
 	dht = SDHT;
@@ -317,6 +404,15 @@ static inline char jpeg_dht_lookup_symbol(ssdv_t *s, uint8_t symbol, uint16_t *b
 	uint16_t code = 0;
 	uint8_t cw, n;
 	uint8_t *dht, *ss;
+	const ssdv_dht_code_t *codes = DCODE;
+	
+	if(codes)
+	{
+		if(codes[symbol].width == 0) return(SSDV_ERROR);
+		*bits = codes[symbol].code;
+		*width = codes[symbol].width;
+		return(SSDV_OK);
+	}
 	
 	dht = DDHT;
 	ss = &dht[17];
@@ -419,6 +515,31 @@ static char ssdv_out_jpeg_int(ssdv_t *s, uint8_t rle, int value)
 	return(SSDV_OK);
 }
 
+static void ssdv_out_dc_only_eob(ssdv_t *s)
+{
+	/* A DC only block is ended after the DC value */
+	uint8_t acpart = s->acpart;
+	
+	s->acpart = 1;
+	ssdv_out_jpeg_int(s, 0, 0);
+	s->acpart = acpart;
+}
+
+static void ssdv_mcu_signature(ssdv_t *s)
+{
+	int v = (s->sig_acc / s->ycparts) >> 1;
+	
+	s->sig_acc = 0;
+	if(s->mcu_id >= s->sig_len) return;
+	
+	if(v < -128) v = -128;
+	if(v > 127) v = 127;
+	
+	if(s->sig_changed == NULL) s->sig[s->mcu_id] = v;
+	else if(abs(v - s->sig[s->mcu_id]) > s->sig_threshold)
+		s->sig_changed[s->mcu_id >> 3] |= 1 << (s->mcu_id & 7);
+}
+
 static char ssdv_process(ssdv_t *s)
 {
 	if(s->state == S_HUFF)
@@ -446,6 +567,8 @@ static char ssdv_process(ssdv_t *s)
 				}
 				else ssdv_out_jpeg_int(s, 0, 0);
 				
+				if(s->dc_only) ssdv_out_dc_only_eob(s);
+				
 				/* skip to the next AC part immediately */
 				s->acpart++;
 			}
@@ -462,13 +585,13 @@ static char ssdv_process(ssdv_t *s)
 			if(symbol == 0x00)
 			{
 				/* EOB -- all remaining AC parts are zero */
-				ssdv_out_jpeg_int(s, 0, 0);
+				if(!s->dc_only) ssdv_out_jpeg_int(s, 0, 0);
 				s->acpart = 64;
 			}
 			else if(symbol == 0xF0)
 			{
 				/* The next 16 AC parts are zero */
-				ssdv_out_jpeg_int(s, 15, 0);
+				if(!s->dc_only) ssdv_out_jpeg_int(s, 15, 0);
 				s->acpart += 16;
 			}
 			else
@@ -531,8 +654,10 @@ static char ssdv_process(ssdv_t *s)
 					s->adc[s->component] = i;
 				}
 			}
+			
+			if(s->dc_only) ssdv_out_dc_only_eob(s);
 		}
-		else /* AC */
+		else if(!s->dc_only) /* AC */
 		{
 			if((i = BADJ(i)))
 			{
@@ -570,9 +695,15 @@ static char ssdv_process(ssdv_t *s)
 	
 	if(s->acpart >= 64)
 	{
+		/* Sum the absolute Y DC values for the MCU signature */
+		if(s->sig != NULL && s->mode == S_ENCODING && s->component == 0)
+			s->sig_acc += s->dc[0];
+		
 		/* Reached the end of this MCU part */
 		if(++s->mcupart == s->ycparts + 2)
 		{
+			if(s->sig != NULL && s->mode == S_ENCODING) ssdv_mcu_signature(s);
+			
 			s->mcupart = 0;
 			s->mcu_id++;
 			
@@ -843,6 +974,12 @@ static char ssdv_have_marker_data(ssdv_t *s)
 			return(SSDV_ERROR);
 		}
 		
+		/* Use the lookup tables where the image has standard DHT tables */
+		s->sfast[0][0] = jpeg_std_dht_fast(s->sdht[0][0], 0, 0);
+		s->sfast[0][1] = jpeg_std_dht_fast(s->sdht[0][1], 0, 1);
+		s->sfast[1][0] = jpeg_std_dht_fast(s->sdht[1][0], 1, 0);
+		s->sfast[1][1] = jpeg_std_dht_fast(s->sdht[1][1], 1, 1);
+		
 		/* The SOS data is followed by the image data */
 		s->state = S_HUFF;
 		
@@ -919,6 +1056,30 @@ char ssdv_enc_init(ssdv_t *s, uint8_t type, char *callsign, uint8_t image_id, in
 	s->ddht[1][0] = dtblcpy(s, std_dht10, sizeof(std_dht10));
 	s->ddht[1][1] = dtblcpy(s, std_dht11, sizeof(std_dht11));
 	
+	/* The output tables are standard so always have lookup tables */
+	jpeg_std_dht_init();
+	s->dcode[0][0] = std_dht_code[0][0];
+	s->dcode[0][1] = std_dht_code[0][1];
+	s->dcode[1][0] = std_dht_code[1][0];
+	s->dcode[1][1] = std_dht_code[1][1];
+	
+	return(SSDV_OK);
+}
+
+/* Set the payload length of each packet. Packets are still SSDV_PKT_SIZE
+ * long with the CRC following the payload. The payload may take the
+ * padding of SSDV_TYPE_PADDING but not the RS codes of SSDV_TYPE_NORMAL.
+ * Call before ssdv_enc_set_buffer(). */
+char ssdv_enc_set_payload(ssdv_t *s, uint16_t length)
+{
+	uint16_t max = SSDV_PKT_SIZE - SSDV_PKT_SIZE_HEADER - SSDV_PKT_SIZE_CRC;
+	
+	if(s->type == SSDV_TYPE_NORMAL) max -= SSDV_PKT_SIZE_RSCODES;
+	if(length == 0 || length > max) return(SSDV_ERROR);
+	
+	s->pkt_size_payload = length;
+	s->pkt_size_crcdata = SSDV_PKT_SIZE_HEADER + length - 1;
+	
 	return(SSDV_OK);
 }
 
@@ -1030,6 +1191,19 @@ char ssdv_enc_get_packet(ssdv_t *s)
 					s->packet_mcu_offset = 0xFF;
 				}
 				
+				if(s->validate)
+				{
+					/* Only the image data is checked, no packet is built */
+					s->packet_id++;
+					if(r == SSDV_EOI)
+					{
+						s->state = S_EOI;
+						return(SSDV_EOI);
+					}
+					ssdv_enc_set_buffer(s, s->out);
+					continue;
+				}
+				
 				/* A packet is ready, create the headers */
 				s->out[0]   = 0x55;                /* Sync */
 				s->out[1]   = 0x66 + s->type;      /* Type */
@@ -1098,6 +1272,167 @@ char ssdv_enc_feed(ssdv_t *s, const uint8_t *buffer, size_t length)
 	return(SSDV_OK);
 }
 
+/* Feed the whole image in one buffer. The encoder reads the image
+ * directly and can be moved within it by ssdv_enc_seek(). */
+char ssdv_enc_set_image(ssdv_t *s, const uint8_t *image, size_t length)
+{
+	s->img     = image;
+	s->img_len = length;
+	return(ssdv_enc_feed(s, image, length));
+}
+
+/* Encode only the DC value of each block. The image is a low detail
+ * preview which needs a fraction of the packets of the full image */
+char ssdv_enc_set_dc_only(ssdv_t *s, char dc_only)
+{
+	s->dc_only = dc_only;
+	return(SSDV_OK);
+}
+
+/* Keep a signature of each MCU while encoding, the mean of its Y DC
+ * values halved. With changed NULL the signatures are stored in sig.
+ * Otherwise sig holds the signatures of an earlier image and the bit of
+ * each MCU in changed is set if its signature differs by more than
+ * threshold. MCUs past len are neither stored nor compared. */
+char ssdv_enc_set_signatures(ssdv_t *s, int8_t *sig, uint8_t *changed, uint16_t len, uint8_t threshold)
+{
+	s->sig = sig;
+	s->sig_changed = changed;
+	s->sig_len = len;
+	s->sig_threshold = threshold;
+	s->sig_acc = 0;
+	if(changed != NULL) memset(changed, 0, (len + 7) / 8);
+	return(SSDV_OK);
+}
+
+/* Extend the image set by ssdv_enc_set_image() as more of it arrives */
+char ssdv_enc_grow(ssdv_t *s, size_t length)
+{
+	if(s->img == NULL || length < s->img_len) return(SSDV_ERROR);
+	s->in_len += length - s->img_len;
+	s->img_len = length;
+	return(SSDV_OK);
+}
+
+/* The image set by ssdv_enc_set_image() has been copied to a new address */
+char ssdv_enc_move(ssdv_t *s, const uint8_t *image)
+{
+	if(s->img == NULL) return(SSDV_ERROR);
+	s->inp = image + (s->inp - s->img);
+	s->img = image;
+	return(SSDV_OK);
+}
+
+/* Move the input to an offset in the image set by ssdv_enc_set_image() */
+char ssdv_enc_seek(ssdv_t *s, size_t offset)
+{
+	if(s->img == NULL || offset > s->img_len) return(SSDV_ERROR);
+	return(ssdv_enc_feed(s, &s->img[offset], s->img_len - offset));
+}
+
+/* Check that an image can be encoded. The whole image is parsed in
+ * one call but packet headers, CRC and FEC are not built. Returns
+ * SSDV_OK if the end of the image is reached, SSDV_FEED_ME if the
+ * image is truncated or SSDV_ERROR if the image data is invalid.
+ * The number of packets the image encodes to is left in packet_id. */
+char ssdv_enc_validate(ssdv_t *s, const uint8_t *buffer, size_t length)
+{
+	uint8_t pkt[SSDV_PKT_SIZE];
+	char r;
+	
+	s->validate = 1;
+	ssdv_enc_set_buffer(s, pkt);
+	ssdv_enc_set_image(s, buffer, length);
+	r = ssdv_enc_get_packet(s);
+	s->validate = 0;
+	s->out = NULL;
+	
+	return(r == SSDV_EOI ? SSDV_OK : r);
+}
+
+/* Save the encoder state between packets. The image must have been
+ * set by ssdv_enc_set_image(). The tables are not saved as they do
+ * not change once the image headers are read. */
+char ssdv_enc_save(ssdv_t *s, ssdv_resume_t *r)
+{
+	uint8_t i;
+	
+	if(s->img == NULL) return(SSDV_ERROR);
+	if(s->state != S_HUFF && s->state != S_INT && s->state != S_MARKER) return(SSDV_ERROR);
+	if(s->out_len != 0 || s->in_skip > 0xFF) return(SSDV_ERROR);
+	
+	r->in_offset         = s->inp - s->img;
+	r->packet_id         = s->packet_id;
+	r->mcu_id            = s->mcu_id;
+	r->packet_mcu_id     = s->packet_mcu_id;
+	r->packet_mcu_offset = s->packet_mcu_offset;
+	r->in_skip           = s->in_skip;
+	r->worklen           = s->worklen;
+	r->outlen            = s->outlen;
+	r->workbits          = s->workbits;
+	r->outbits           = s->outbits;
+	r->reset_mcu         = s->reset_mcu;
+	r->marker            = s->marker;
+	r->marker_len        = s->marker_len;
+	r->state             = s->state;
+	r->component         = s->component;
+	r->mcupart           = s->mcupart;
+	r->acpart            = s->acpart;
+	r->acrle             = s->acrle;
+	r->accrle            = s->accrle;
+	r->needbits          = s->needbits;
+	r->out_stuff         = s->out_stuff;
+	for(i = 0; i < 3; i++)
+	{
+		r->dc[i]  = s->dc[i];
+		r->adc[i] = s->adc[i];
+	}
+	
+	return(SSDV_OK);
+}
+
+/* Restore a saved encoder state so the next packet is the saved one.
+ * The encoder must already have read the headers of the same image,
+ * which is done once the first packet has been produced. */
+char ssdv_enc_resume(ssdv_t *s, const ssdv_resume_t *r)
+{
+	uint8_t i;
+	
+	if(s->state != S_HUFF && s->state != S_INT && s->state != S_MARKER) return(SSDV_ERROR);
+	if(s->img == NULL || r->in_offset > s->img_len) return(SSDV_ERROR);
+	
+	s->packet_id         = r->packet_id;
+	s->mcu_id            = r->mcu_id;
+	s->packet_mcu_id     = r->packet_mcu_id;
+	s->packet_mcu_offset = r->packet_mcu_offset;
+	s->in_skip           = r->in_skip;
+	s->worklen           = r->worklen;
+	s->outlen            = r->outlen;
+	s->workbits          = r->workbits;
+	s->outbits           = r->outbits;
+	s->reset_mcu         = r->reset_mcu;
+	s->marker            = r->marker;
+	s->marker_len        = r->marker_len;
+	s->state             = r->state;
+	s->component         = r->component;
+	s->mcupart           = r->mcupart;
+	s->acpart            = r->acpart;
+	s->acrle             = r->acrle;
+	s->accrle            = r->accrle;
+	s->needbits          = r->needbits;
+	s->out_stuff         = r->out_stuff;
+	for(i = 0; i < 3; i++)
+	{
+		s->dc[i]  = r->dc[i];
+		s->adc[i] = r->adc[i];
+	}
+	
+	/* The output buffer is re-initialised by the next packet */
+	s->out_len = 0;
+	
+	return(ssdv_enc_seek(s, r->in_offset));
+}
+
 /*****************************************************************************/
 
 static void ssdv_write_marker(ssdv_t *s, uint16_t id, uint16_t length, const uint8_t *data)
@@ -1207,6 +1542,17 @@ char ssdv_dec_init(ssdv_t *s)
 	s->ddht[1][0] = dtblcpy(s, std_dht10, sizeof(std_dht10));
 	s->ddht[1][1] = dtblcpy(s, std_dht11, sizeof(std_dht11));
 	
+	/* Both sets of tables are standard so use the lookup tables */
+	jpeg_std_dht_init();
+	s->sfast[0][0] = std_dht_fast[0][0];
+	s->sfast[0][1] = std_dht_fast[0][1];
+	s->sfast[1][0] = std_dht_fast[1][0];
+	s->sfast[1][1] = std_dht_fast[1][1];
+	s->dcode[0][0] = std_dht_code[0][0];
+	s->dcode[0][1] = std_dht_code[0][1];
+	s->dcode[1][0] = std_dht_code[1][0];
+	s->dcode[1][1] = std_dht_code[1][1];
+	
 	return(SSDV_OK);
 }
 
@@ -43,11 +43,27 @@ extern "C" {
 
 #define SSDV_MAX_CALLSIGN (6) /* Maximum number of characters in a callsign */
 
+#define DHT_FAST_BITS (9) /* Width of the direct huffman decode table      */
+
 #define SSDV_TYPE_INVALID (0xFF)
 #define SSDV_TYPE_NORMAL  (0x00)
 #define SSDV_TYPE_NOFEC   (0x01)
 #define SSDV_TYPE_PADDING (0x02)
 
+/* Huffman decode entry for the next DHT_FAST_BITS bits, width 0 if longer */
+typedef struct
+{
+	uint8_t symbol;
+	uint8_t width;
+} ssdv_dht_fast_t;
+
+/* Huffman code for a symbol, width 0 if the symbol is not in the table */
+typedef struct
+{
+	uint16_t code;
+	uint8_t width;
+} ssdv_dht_code_t;
+
 typedef struct
 {
 	/* Packet type configuration */
@@ -73,6 +89,8 @@ typedef struct
 	const uint8_t *inp;/* Pointer to next input byte                    */
 	size_t in_len;     /* Number of input bytes remaining               */
 	size_t in_skip;    /* Number of input bytes to skip                 */
+	const uint8_t *img;/* Whole image buffer if set, else NULL          */
+	size_t img_len;    /* Length of the whole image buffer              */
 	
 	/* Source bits */
 	uint32_t workbits; /* Input bits currently being worked on          */
@@ -116,19 +134,58 @@ typedef struct
 	} mode;
 	uint32_t reset_mcu; /* MCU block to do absolute encoding            */
 	char needbits;      /* Number of bits needed to decode integer      */
+	char validate;      /* Flag to check the image without packets      */
+	char dc_only;       /* Flag to drop AC coefficients (preview)       */
+	
+	/* MCU signatures (mean Y DC / 2), see ssdv_enc_set_signatures() */
+	int8_t *sig;        /* Signature per MCU or NULL                    */
+	uint8_t *sig_changed; /* Changed bit per MCU, NULL to store sig    */
+	uint16_t sig_len;   /* Number of MCUs in sig                        */
+	uint8_t sig_threshold; /* Largest signature change not marked       */
+	int sig_acc;        /* Sum of Y DC values in the current MCU        */
 	
 	/* The input huffman and quantisation tables */
 	uint8_t stbls[TBL_LEN + HBUFF_LEN];
 	uint8_t *sdht[2][2], *sdqt[2];
 	uint16_t stbl_len;
+	const ssdv_dht_fast_t *sfast[2][2]; /* Decode tables if standard DHT */
 	
 	/* The same for output */
 	uint8_t dtbls[TBL_LEN];
 	uint8_t *ddht[2][2], *ddqt[2];
 	uint16_t dtbl_len;
+	const ssdv_dht_code_t *dcode[2][2]; /* Encode tables if standard DHT */
 	
 } ssdv_t;
 
+/* Encoder state at the start of a packet, used to resume encoding there */
+typedef struct
+{
+	uint32_t in_offset; /* Offset of the next input byte in the image   */
+	uint16_t packet_id;
+	uint16_t mcu_id;
+	uint16_t packet_mcu_id;
+	uint8_t  packet_mcu_offset;
+	uint8_t  in_skip;
+	uint8_t  worklen;
+	uint8_t  outlen;
+	uint32_t workbits;
+	uint32_t outbits;
+	uint32_t reset_mcu;
+	uint16_t marker;
+	uint16_t marker_len;
+	int16_t  dc[3];
+	int16_t  adc[3];
+	uint8_t  state;
+	uint8_t  component;
+	uint8_t  mcupart;
+	uint8_t  acpart;
+	uint8_t  acrle;
+	uint8_t  accrle;
+	char     needbits;
+	char     out_stuff;
+} ssdv_resume_t;
+
 typedef struct {
 	uint8_t  type;
 	uint32_t callsign;
@@ -147,9 +204,19 @@ typedef struct {
 
 /* Encoding */
 extern char ssdv_enc_init(ssdv_t *s, uint8_t type, char *callsign, uint8_t image_id, int8_t quality);
+extern char ssdv_enc_set_payload(ssdv_t *s, uint16_t length);
 extern char ssdv_enc_set_buffer(ssdv_t *s, uint8_t *buffer);
 extern char ssdv_enc_get_packet(ssdv_t *s);
 extern char ssdv_enc_feed(ssdv_t *s, const uint8_t *buffer, size_t length);
+extern char ssdv_enc_set_image(ssdv_t *s, const uint8_t *image, size_t length);
+extern char ssdv_enc_set_dc_only(ssdv_t *s, char dc_only);
+extern char ssdv_enc_set_signatures(ssdv_t *s, int8_t *sig, uint8_t *changed, uint16_t len, uint8_t threshold);
+extern char ssdv_enc_grow(ssdv_t *s, size_t length);
+extern char ssdv_enc_move(ssdv_t *s, const uint8_t *image);
+extern char ssdv_enc_seek(ssdv_t *s, size_t offset);
+extern char ssdv_enc_validate(ssdv_t *s, const uint8_t *buffer, size_t length);
+extern char ssdv_enc_save(ssdv_t *s, ssdv_resume_t *r);
+extern char ssdv_enc_resume(ssdv_t *s, const ssdv_resume_t *r);
 
 /* Decoding */
 extern char ssdv_dec_init(ssdv_t *s);
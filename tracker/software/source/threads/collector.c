@@ -13,6 +13,7 @@
 #include "debug.h"
 #include "config.h"
 #include "ublox.h"
+#include "pps.h"
 #include "bme280.h"
 #include "padc.h"
 #include "pac1720.h"
@@ -22,16 +23,53 @@
 #include "pi2c.h"
 #include "si446x.h"
 #include "pflash.h"
+#include "sd.h"
 #include "pkttypes.h"
+#include "estimator.h"
+#include "geofence.h"
+#include "tseries.h"
+#include "threads.h"
+#include <math.h>
+#include <stddef.h>
+
+/* The ground decoder reads data points by the layout in datapoint.h. */
+#define DATAPOINT_CHECK(name, type, offset)                                 \
+	_Static_assert(offsetof(dataPoint_t, name) == (offset)                  \
+				   && sizeof(((dataPoint_t *)0)->name) == sizeof(type),     \
+				   "dataPoint_t." #name " differs from datapoint.h");
+DATAPOINT_FIELDS(DATAPOINT_CHECK)
+_Static_assert(sizeof(dataPoint_t) == DATAPOINT_SIZE,
+			   "size of dataPoint_t differs from datapoint.h");
 
 /*===========================================================================*/
 /* Module local variables.                                                   */
 /*===========================================================================*/
 
-static dataPoint_t dataPoints[2];
-static dataPoint_t* lastDataPoint;
+/*
+ * Snapshot of a data point.
+ * The sequence is odd while the collector writes the snapshot (seqlock).
+ */
+typedef struct {
+	volatile uint32_t	seq;
+	dataPoint_t			point;
+	systime_t			sampled;	// Telemetry measured
+	systime_t			fixed;		// Position fixed, zero if none
+} dp_snapshot_t;
+
+static dp_snapshot_t snapshots[COLLECTOR_SNAPSHOTS];
+/* Zero until the last point is read from the log. */
+static dp_snapshot_t * volatile published = &snapshots[0];
+/* Beacons which set the collector cycle. */
+static bcn_app_conf_t *clients[COLLECTOR_MAX_CLIENTS];
+/* Cycle set by a motion adaptive client or zero for its beacon cycle. */
+static sysinterval_t client_cycles[COLLECTOR_MAX_CLIENTS];
 static bool threadStarted = false;
 static uint8_t bme280_error;
+/* Time of the position being collected. */
+static systime_t fix_time;
+
+/* BME280 handles keep the calibration data between cycles. */
+static bme280_t bme280_handle[3];
 
 /**
  * Array for looking up model name
@@ -55,9 +93,81 @@ const char *get_gps_state_name(uint8_t index) {
 
 /**
   * Returns most recent data point which is complete.
+  * The point is not changed until COLLECTOR_SNAPSHOTS - 1 newer points
+  * have been collected. Use getLastDataPointCopy() to keep the point.
   */
 dataPoint_t* getLastDataPoint(void) {
-	return lastDataPoint;
+	return &published->point;
+}
+
+/**
+  * Copies the most recent data point.
+  * The copy is made again if the collector reused the snapshot meanwhile.
+  */
+void getLastDataPointCopy(dataPoint_t* dp) {
+	getLastDataPointStamped(dp, NULL, NULL);
+}
+
+/**
+  * Copies the most recent data point with the system times the telemetry
+  * was measured and the position was fixed. A time is zero if unknown.
+  */
+void getLastDataPointStamped(dataPoint_t* dp, systime_t *sampled,
+							 systime_t *fixed) {
+	dp_snapshot_t *s;
+	uint32_t seq;
+	do {
+		s = published;
+		seq = s->seq;
+		__DMB();
+		*dp = s->point;
+		if(sampled != NULL)
+			*sampled = s->sampled;
+		if(fixed != NULL)
+			*fixed = s->fixed;
+		__DMB();
+	} while((seq & 1) || seq != s->seq);
+}
+
+/**
+  * Adds a beacon to the clients of the collector.
+  * The collector cycle is the shortest cycle of the clients.
+  * A fixed position is collected if all clients use a fixed position.
+  */
+void addCollectorClient(bcn_app_conf_t* config) {
+	chSysLock();
+	for(uint8_t i = 0; i < COLLECTOR_MAX_CLIENTS; i++) {
+		if(clients[i] == config)
+			break;
+		if(clients[i] == NULL) {
+			clients[i] = config;
+			break;
+		}
+	}
+	if(collector_thd != NULL)
+		chEvtSignalI(collector_thd, COLLECTOR_EVT_CLIENT);
+	chSchRescheduleS();
+	chSysUnlock();
+}
+
+/**
+  * Sets the cycle of a client which adapts its beacon cycle.
+  * A cycle of zero returns the client to its beacon cycle.
+  */
+void setCollectorClientCycle(bcn_app_conf_t* config, sysinterval_t cycle) {
+	chSysLock();
+	for(uint8_t i = 0; i < COLLECTOR_MAX_CLIENTS; i++) {
+		if(clients[i] == config) {
+			if(client_cycles[i] != cycle) {
+				client_cycles[i] = cycle;
+				if(collector_thd != NULL)
+					chEvtSignalI(collector_thd, COLLECTOR_EVT_CLIENT);
+				chSchRescheduleS();
+			}
+			break;
+		}
+	}
+	chSysUnlock();
 }
 
 /**
@@ -87,7 +197,7 @@ static void getPositionFallback(dataPoint_t* tp,
   tp->gps_lat = 0;
   tp->gps_lon = 0;
   tp->gps_alt = 0;
-  if(isPositionFromSV(ltp)) {
+  if(isPositionFromSV(ltp) || ltp->gps_state == GPS_PREDICTED) {
     tp->gps_lat = ltp->gps_lat;
     tp->gps_lon = ltp->gps_lon;
     tp->gps_alt = ltp->gps_alt;
@@ -100,6 +210,83 @@ static void getPositionFallback(dataPoint_t* tp,
     tp->gps_time = date2UnixTimestamp(&time);
 }
 
+/**
+ * @brief   Aid the GPS start with the prior position and the RTC time.
+ * @notes   The receiver starts searching from this so the fix is faster.
+ *
+ * @param[in]	ltp		pointer to prior @p datapoint structure
+ *
+ * @notapi
+ */
+static void aidGPS(dataPoint_t* ltp) {
+  ptime_t time;
+  getTime(&time);
+  if(time.year != RTC_BASE_YEAR) {
+    TRACE_INFO("COLL > Aid GPS with RTC time");
+    gps_send_time_aiding(&time, UBLOX_AID_TIME_ACC);
+  }
+  if(isPositionValid(ltp) && (ltp->gps_lat != 0 || ltp->gps_lon != 0)) {
+    TRACE_INFO("COLL > Aid GPS with last position");
+    gps_send_position_aiding(ltp->gps_lat, ltp->gps_lon, ltp->gps_alt,
+                             UBLOX_AID_POS_ACC);
+  }
+}
+
+/**
+ * @brief   Predict the position instead of a GPS acquisition.
+ * @notes   The GPS is switched off while the prediction is accurate enough.
+ * @notes   A geofence boundary within the uncertainty needs a GPS fix.
+ *
+ * @post    The provided data point (record) is updated if predicted.
+ *
+ * @param[in]   tp          pointer to current @p datapoint structure
+ * @param[in]   accuracy    accuracy required in m (0: no prediction)
+ *
+ * @return      prediction state
+ * @retval      true    if the predicted position is used.
+ * @retval      false   if a GPS acquisition is required.
+ * @notapi
+ */
+static bool predictPosition(dataPoint_t* tp, uint32_t accuracy) {
+  if(accuracy == 0)
+    return false;
+  ptime_t time;
+  getTime(&time);
+  if(time.year == RTC_BASE_YEAR)
+    return false;
+
+  dataPoint_t pp = *tp;
+  pp.gps_time = date2UnixTimestamp(&time);
+  uint32_t uncertainty;
+  if(!est_predict(&pp, &uncertainty) || uncertainty > accuracy)
+    return false;
+
+  int32_t dlat = uncertainty / EST_M_PER_LAT;
+  int32_t dlon = dlat / cosf((float)pp.gps_lat * 1e-7f * 3.14159265f / 180.0f);
+  uint32_t freq = getAPRSRegionFrequencyAt(pp.gps_lat, pp.gps_lon);
+  if(freq != getAPRSRegionFrequencyAt(pp.gps_lat + dlat, pp.gps_lon)
+      || freq != getAPRSRegionFrequencyAt(pp.gps_lat - dlat, pp.gps_lon)
+      || freq != getAPRSRegionFrequencyAt(pp.gps_lat, pp.gps_lon + dlon)
+      || freq != getAPRSRegionFrequencyAt(pp.gps_lat, pp.gps_lon - dlon)) {
+    TRACE_INFO("COLL > Geofence boundary within %dm of predicted position",
+               uncertainty);
+    return false;
+  }
+
+  TRACE_INFO("COLL > Position predicted within %dm, switch off GPS",
+             uncertainty);
+  GPS_Deinit();
+  tp->gps_time = pp.gps_time;
+  tp->gps_lat = pp.gps_lat;
+  tp->gps_lon = pp.gps_lon;
+  tp->gps_alt = pp.gps_alt;
+  tp->gps_sats = 0;
+  tp->gps_ttff = 0;
+  tp->gps_pdop = 0;
+  tp->gps_state = GPS_PREDICTED;
+  return true;
+}
+
 /**
  * @brief   Acquire GPS position and time data.
  * @notes	The GPS is switched on only if a service requires it.
@@ -145,6 +332,9 @@ static bool aquirePosition(dataPoint_t* tp, dataPoint_t* ltp,
     GPS_Deinit();
     return false;
   }
+  /* A GPS which was kept on needs no aiding. */
+  if(ltp->gps_state != GPS_LOCKED2 && ltp->gps_state != GPS_LOSS)
+    aidGPS(ltp);
   /* If a Pa pressure is set then GPS model depends on BME reading.
    * If BME is OK then stationary model will be used until Pa < airborne.
    * Then airborne model will be set.
@@ -159,14 +349,25 @@ static bool aquirePosition(dataPoint_t* tp, dataPoint_t* ltp,
    */
   uint32_t x = 0;
   gps_set_model(dynamic);
+  /*
+   * Have the GPS send each solution so the wait sleeps until it is ready.
+   * Polling is used if the GPS does not accept the output rate.
+   */
+  bool stream = gps_set_navpvt_rate(1);
   do {
     batt = stm32_get_vbat();
     if(++x % 30) gps_set_model(dynamic); // Set model periodically
-    chThdSleepMilliseconds(100);
-    gps_get_fix(&gpsFix);
+    if(stream) {
+      gps_wait_fix(&gpsFix, UBLOX_SOLUTION_TIMEOUT);
+    } else {
+      chThdSleepMilliseconds(100);
+      gps_get_fix(&gpsFix);
+    }
   } while(!isGPSLocked(&gpsFix)
       && batt >= conf_sram.gps_off_vbat
       && chVTIsSystemTimeWithin(start, start + timeout));
+  if(stream)
+    gps_set_navpvt_rate(0);
 
   if(batt < conf_sram.gps_off_vbat) {
     /*
@@ -192,6 +393,7 @@ static bool aquirePosition(dataPoint_t* tp, dataPoint_t* ltp,
     getPositionFallback(tp, ltp, GPS_LOSS);
     return false;
   }
+  fix_time = chVTGetSystemTime();
 
   /*
    * GPS locked successfully.
@@ -245,6 +447,8 @@ static bool aquirePosition(dataPoint_t* tp, dataPoint_t* ltp,
   }
   // Calibrate RTC
   setTime(&gpsFix.time);
+  // Label the timepulse which started the epoch of the fix
+  pps_set_second(date2UnixTimestamp(&gpsFix.time));
 
   // Take time from GPS
   tp->gps_time = date2UnixTimestamp(&gpsFix.time);
@@ -288,18 +492,72 @@ static void measureVoltage(dataPoint_t* tp)
  *
  * @api
  */
+/**
+ * @brief   Start a conversion of a BME280.
+ * @notes   The calibration data is read at the first use of the sensor.
+ *
+ * @param[in]   id   ID of the BME280
+ *
+ * @return  true if a conversion was started
+ */
+static bool startBME280(uint8_t id) {
+	bme280_t *handle = &bme280_handle[id];
+	if(!BME280_isAvailable(id))
+		return false;
+	if(!handle->initialized)
+		BME280_Init(handle, id);
+	if(BME280_startForced(handle))
+		return true;
+	/* Read calibration again in case the sensor was changed. */
+	handle->initialized = false;
+	return false;
+}
+
+/**
+ * @brief   Collect the result of a BME280 conversion.
+ *
+ * @param[in]   id      ID of the BME280
+ * @param[out]  press   pointer to pressure in Pa*10
+ * @param[out]  hum     pointer to rel. humidity in %
+ * @param[out]  temp    pointer to temperature in 0.01degC
+ *
+ * @return  true if the values were read
+ */
+static bool readBME280(uint8_t id, uint32_t *press, uint8_t *hum,
+                       int16_t *temp) {
+	bme280_t *handle = &bme280_handle[id];
+	if(!BME280_readData(handle)) {
+		handle->initialized = false;
+		return false;
+	}
+	*press = BME280_getPressure(handle);
+	*hum = BME280_getHumidity(handle);
+	*temp = BME280_getTemperature(handle);
+	return true;
+}
+
 void getSensors(dataPoint_t* tp) {
 	// Measure BME280
 	bme280_error = 0;
-	bme280_t handle;
+
+	/*
+	 * Conversions of all fitted sensors are started together and run in
+	 * the sensors. The results are collected after the conversion time.
+	 */
+	bool i1 = startBME280(BME280_I1);
+#if     ENABLE_EXTERNAL_I2C == TRUE
+#if     BME280_E1_IS_FITTED == TRUE
+	bool e1 = startBME280(BME280_E1);
+#endif
+#if     BME280_E2_IS_FITTED == TRUE
+	bool e2 = startBME280(BME280_E2);
+#endif
+#endif /*  ENABLE_EXTERNAL_I2C == TRUE */
+	chThdSleep(TIME_MS2I(BME280_MEASURE_TIME));
 
 	// Internal BME280
-	if(BME280_isAvailable(BME280_I1)) {
-		BME280_Init(&handle, BME280_I1);
-		tp->sen_i1_press = BME280_getPressure(&handle, 32);
-		tp->sen_i1_hum = BME280_getHumidity(&handle);
-		tp->sen_i1_temp = BME280_getTemperature(&handle);
-	} else { // No internal BME280 found
+	if(!i1 || !readBME280(BME280_I1, &tp->sen_i1_press, &tp->sen_i1_hum,
+	                       &tp->sen_i1_temp)) { // No internal BME280 found
 		TRACE_ERROR("COLL > Internal BME280 I1 not operational");
 		tp->sen_i1_press = 0;
 		tp->sen_i1_hum = 0;
@@ -310,12 +568,8 @@ void getSensors(dataPoint_t* tp) {
 #if     ENABLE_EXTERNAL_I2C == TRUE
 #if     BME280_E1_IS_FITTED == TRUE
 	// External BME280 Sensor 1
-	if(BME280_isAvailable(BME280_E1)) {
-		BME280_Init(&handle, BME280_E1);
-		tp->sen_e1_press = BME280_getPressure(&handle, 32);
-		tp->sen_e1_hum = BME280_getHumidity(&handle);
-		tp->sen_e1_temp = BME280_getTemperature(&handle);
-	} else { // No external BME280 found
+	if(!e1 || !readBME280(BME280_E1, &tp->sen_e1_press, &tp->sen_e1_hum,
+	                       &tp->sen_e1_temp)) { // No external BME280 found
 		TRACE_WARN("COLL > External BME280 E1 not operational");
 		tp->sen_e1_press = 0;
 		tp->sen_e1_hum = 0;
@@ -328,12 +582,8 @@ void getSensors(dataPoint_t* tp) {
 
 #if     BME280_E2_IS_FITTED == TRUE
 	// External BME280 Sensor 2
-	if(BME280_isAvailable(BME280_E2)) {
-		BME280_Init(&handle, BME280_E2);
-		tp->sen_e2_press = BME280_getPressure(&handle, 32);
-		tp->sen_e2_hum = BME280_getHumidity(&handle);
-		tp->sen_e2_temp = BME280_getTemperature(&handle);
-	} else { // No external BME280 found
+	if(!e2 || !readBME280(BME280_E2, &tp->sen_e2_press, &tp->sen_e2_hum,
+	                       &tp->sen_e2_temp)) { // No external BME280 found
 		TRACE_WARN("COLL > External BME280 E2 not operational");
 		tp->sen_e2_press = 0;
 		tp->sen_e2_hum = 0;
@@ -418,35 +668,79 @@ void setSystemStatus(dataPoint_t* tp) {
 /*===========================================================================*/
 
 /**
-  *
+ * @brief   Get the collection parameters from the clients.
+ *
+ * @param[out]  cycle       shortest cycle of the clients
+ * @param[out]  accuracy    lowest accuracy required by GPS clients
+ *
+ * @return  fixed position configuration
+ * @retval  NULL if the position is acquired by GPS
+ *
+ * @notapi
+ */
+static bcn_app_conf_t *getClientCycle(sysinterval_t *cycle,
+                                      uint32_t *accuracy) {
+  bcn_app_conf_t *fixed = NULL;
+  bool gps = false;
+  *cycle = TIME_S2I(60);
+  *accuracy = 0;
+  chSysLock();
+  for(uint8_t i = 0; i < COLLECTOR_MAX_CLIENTS && clients[i] != NULL; i++) {
+    sysinterval_t c = (client_cycles[i] != 0)
+        ? client_cycles[i] : clients[i]->beacon.cycle;
+    if(i == 0 || c < *cycle)
+      *cycle = c;
+    if(!clients[i]->beacon.fixed) {
+      if(!gps || clients[i]->beacon.accuracy < *accuracy)
+        *accuracy = clients[i]->beacon.accuracy;
+      gps = true;
+    } else if(fixed == NULL)
+      fixed = clients[i];
+  }
+  chSysUnlock();
+  return gps ? NULL : fixed;
+}
+
+/**
+  * Collects data points in the cycle of the clients.
+  * Each point is written to a free snapshot which is then published.
+  * Clients read the last published point without waiting.
   */
 THD_FUNCTION(collectorThread, arg) {
-  thread_t *caller = (thread_t *)arg;
+  (void)arg;
 
   uint32_t id = 0;
+  uint8_t slot = 0;
+
+  /*
+   * Power up the GPS before the log is read so it starts meanwhile.
+   * Not needed if all clients use a fixed position.
+   */
+  sysinterval_t cycle;
+  uint32_t accuracy;
+  bool gps_early = getClientCycle(&cycle, &accuracy) == NULL
+      && stm32_get_vbat() >= conf_sram.gps_on_vbat;
+  if(gps_early)
+    GPS_PowerUp();
 
   // Read time from RTC
   ptime_t time;
   getTime(&time);
-  dataPoints[0].gps_time = date2UnixTimestamp(&time);
-  dataPoints[1].gps_time = date2UnixTimestamp(&time);
-
-  lastDataPoint = &dataPoints[0];
-  //dataPoint_t *newDataPoint = lastDataPoint++;
+  dataPoint_t* ltp = &snapshots[0].point;
+  ltp->gps_time = date2UnixTimestamp(&time);
 
   // Get last data point from memory
   TRACE_INFO("COLL > Read last data point from flash memory");
   dataPoint_t* lastLogPoint = flash_getNewestLogEntry();
 
   if(lastLogPoint != NULL) { // If there is stored data point, then get it.
-    dataPoints[0].reset     = lastLogPoint->reset+1;
-    dataPoints[1].reset     = lastLogPoint->reset+1;
-    unixTimestamp2Date(&time, lastDataPoint->gps_time);
-    lastDataPoint->gps_lat  = lastLogPoint->gps_lat;
-    lastDataPoint->gps_lon  = lastLogPoint->gps_lon;
-    lastDataPoint->gps_alt  = lastLogPoint->gps_alt;
-    lastDataPoint->gps_sats = lastLogPoint->gps_sats;
-    lastDataPoint->gps_ttff = lastLogPoint->gps_ttff;
+    ltp->reset     = lastLogPoint->reset+1;
+    unixTimestamp2Date(&time, ltp->gps_time);
+    ltp->gps_lat  = lastLogPoint->gps_lat;
+    ltp->gps_lon  = lastLogPoint->gps_lon;
+    ltp->gps_alt  = lastLogPoint->gps_alt;
+    ltp->gps_sats = lastLogPoint->gps_sats;
+    ltp->gps_ttff = lastLogPoint->gps_ttff;
 
     TRACE_INFO(
         "COLL > Last data point (from memory)\r\n"
@@ -458,57 +752,87 @@ THD_FUNCTION(collectorThread, arg) {
         TRACE_TAB, lastLogPoint->reset, lastLogPoint->id,
         TRACE_TAB, time.year, time.month, time.day, time.hour,
         time.minute, time.day,
-        TRACE_TAB, lastDataPoint->gps_lat/10000000,
-          (lastDataPoint->gps_lat > 0
-              ? 1:-1)*lastDataPoint->gps_lat%10000000,
-              TRACE_TAB, lastDataPoint->gps_lon/10000000,
-          (lastDataPoint->gps_lon > 0
-              ? 1:-1)*lastDataPoint->gps_lon%10000000,
-              TRACE_TAB, lastDataPoint->gps_alt
+        TRACE_TAB, ltp->gps_lat/10000000,
+          (ltp->gps_lat > 0
+              ? 1:-1)*ltp->gps_lat%10000000,
+              TRACE_TAB, ltp->gps_lon/10000000,
+          (ltp->gps_lon > 0
+              ? 1:-1)*ltp->gps_lon%10000000,
+              TRACE_TAB, ltp->gps_alt
     );
-    lastDataPoint->gps_state = GPS_LOG; // Mark dataPoint as LOG packet
+    ltp->gps_state = GPS_LOG; // Mark dataPoint as LOG packet
   } else {
     TRACE_INFO("COLL > No data point found in flash memory");
     /* State indicates that no valid stored position is available. */
-    lastDataPoint->gps_lat = 0;
-    lastDataPoint->gps_lon = 0;
-    lastDataPoint->gps_alt = 0;
-    lastDataPoint->gps_ttff = 0;
-    lastDataPoint->gps_pdop = 0;
-    lastDataPoint->gps_sats = 0;
-    lastDataPoint->gps_state = GPS_OFF;
+    ltp->gps_lat = 0;
+    ltp->gps_lon = 0;
+    ltp->gps_alt = 0;
+    ltp->gps_ttff = 0;
+    ltp->gps_pdop = 0;
+    ltp->gps_sats = 0;
+    ltp->gps_state = GPS_OFF;
 
     // Measure telemetry
-    measureVoltage(lastDataPoint);
-    getSensors(lastDataPoint);
-    getGPIO(lastDataPoint);
-    setSystemStatus(lastDataPoint);
+    measureVoltage(ltp);
+    getSensors(ltp);
+    getGPIO(ltp);
+    setSystemStatus(ltp);
 
     // Write data point to Flash memory
-    flash_writeLogDataPoint(lastDataPoint);
+    flash_writeLogDataPoint(ltp);
   }
+  published = &snapshots[0];
   /* Now check if the controller has been reset (RTC not set). */
   getTime(&time);
-  /* Let initializer know if this is a normal or cold start (power loss). */
-  (void)chMsgSend(caller, time.year == RTC_BASE_YEAR ? MSG_RESET : MSG_OK);
+  if(time.year == RTC_BASE_YEAR) {
+    TRACE_INFO("COLL > Executed cold start");
+  } else {
+    TRACE_INFO("COLL > Executed warm start");
+  }
+  /* Beacons can use the last point now. */
+  boot_set_ready(BOOT_LOG);
 
   /*
    * Done with initialization now.
-   * lastDataPoint becomes the first history entry for the loop.
+   * The published point becomes the first history entry for the loop.
    */
+  systime_t start = chVTGetSystemTime();
+  bool first = true;
+  wdg_beat_t beat;
+  wdg_register(&beat, chRegGetThreadNameX(chThdGetSelfX()), TIME_S2I(60));
   while(true) { /* Primary loop. */
-    /* Wait for a request from a client. */
-    caller = chMsgWait();
-    /* Fetch the message. */
-    bcn_app_conf_t *config;
-    config = (bcn_app_conf_t *)chMsgGet(caller);
+    bcn_app_conf_t *fixed = getClientCycle(&cycle, &accuracy);
+    /* Wait for the cycle. A new client may change the cycle. */
+    if(!first && chVTIsSystemTimeWithin(start, start + cycle)) {
+      if(chEvtWaitAnyTimeout(COLLECTOR_EVT_CLIENT,
+              chTimeDiffX(chVTGetSystemTime(), start + cycle)) != 0)
+        continue;
+    }
+    first = false;
+    start = chVTGetSystemTime();
+    /* The GPS search may take another cycle (at least a minute). */
+    wdg_set_cycle(&beat, cycle + (cycle > TIME_S2I(60) ? cycle : TIME_S2I(60)));
+    wdg_beat(&beat);
 
-    TRACE_INFO("COLL > Respond to request for DATA COLLECTOR cycle");
+    TRACE_INFO("COLL > Do DATA COLLECTOR cycle");
 
-    dataPoint_t* tp  = &dataPoints[(id+1) % 2]; // Current data point (the one which is processed now)
-    dataPoint_t* ltp = &dataPoints[ id    % 2]; // Last data point
+    /*
+     * The prior point is copied as the published point is not changed.
+     * The new point is written to the next snapshot.
+     */
+    dataPoint_t prior = published->point;
+    ltp = &prior;
+    /* A position carried forward keeps the time of its fix. */
+    fix_time = published->fixed;
+    slot = (slot + 1) % COLLECTOR_SNAPSHOTS;
+    dp_snapshot_t *snap = &snapshots[slot];
+    snap->seq++;
+    __DMB();
+    dataPoint_t* tp = &snap->point; // Current data point (the one which is processed now)
+    *tp = prior;
 
     /* Gather telemetry and system status data. */
+    snap->sampled = chVTGetSystemTime();
     measureVoltage(tp);
     getSensors(tp);
     getGPIO(tp);
@@ -516,8 +840,8 @@ THD_FUNCTION(collectorThread, arg) {
 
     /* Set timeout based on cycle or minimum 1 minute. */
     sysinterval_t gps_wait_time =
-                                   config->beacon.cycle > TIME_S2I(60)
-                                   ? TIME_S2I(60) : config->beacon.cycle;
+                                   cycle > TIME_S2I(60)
+                                   ? TIME_S2I(60) : cycle;
 
     getTime(&time);
     if(time.year == RTC_BASE_YEAR) {
@@ -530,6 +854,7 @@ THD_FUNCTION(collectorThread, arg) {
 
       if(aquirePosition(tp, ltp, gps_wait_time)) {
         /* Acquisition succeeded. */
+        est_addFix(tp);
         if(ltp->gps_state == GPS_TIME) {
           /* Write the timestamp where RTC was calibrated. */
           ltp->gps_sats = 0;
@@ -544,22 +869,26 @@ THD_FUNCTION(collectorThread, arg) {
       }
     }
 
-    if(config->beacon.fixed) {
+    if(fixed != NULL) {
       /*
        * Use fixed position data.
        * Update set fixed position.
        * Set GPS time from RTC.
        */
-      TRACE_INFO("COLL > Using fixed location for %s", config->call);
-      tp->gps_alt = config->beacon.alt;
-      tp->gps_lat = config->beacon.lat;
-      tp->gps_lon = config->beacon.lon;
+      TRACE_INFO("COLL > Using fixed location for %s", fixed->call);
+      tp->gps_alt = fixed->beacon.alt;
+      tp->gps_lat = fixed->beacon.lat;
+      tp->gps_lon = fixed->beacon.lon;
       tp->gps_sats = 0;
       tp->gps_ttff = 0;
       tp->gps_pdop = 0;
       tp->gps_state = GPS_FIXED;
       getTime(&time);
       tp->gps_time = date2UnixTimestamp(&time);
+      fix_time = chVTGetSystemTime();
+    } else if(predictPosition(tp, accuracy)) {
+      TRACE_INFO("COLL > Using predicted position");
+      fix_time = chVTGetSystemTime();
     } else {
 
       /*
@@ -570,12 +899,19 @@ THD_FUNCTION(collectorThread, arg) {
       TRACE_INFO("COLL > Acquire position using GPS");
       if(aquirePosition(tp, ltp, gps_wait_time)) {
         TRACE_INFO("COLL > Acquired fresh GPS data");
+        est_addFix(tp);
       } else {
         /* Historical data has been carried forward. */
         TRACE_INFO("COLL > Unable to acquire fresh GPS data");
       }
     }
 
+    /* Switch off a GPS powered up at boot which was not used. */
+    extern bool gps_enabled;
+    if(gps_early && !gps_enabled)
+      GPS_Deinit();
+    gps_early = false;
+
     tp->id = ++id; // Serial ID
     extern uint8_t gps_model;
     // Trace data
@@ -589,25 +925,28 @@ THD_FUNCTION(collectorThread, arg) {
         "%s Sats %d TTFF %dsec\r\n"
         "%s ADC  Vbat=%d.%03dV Vsol=%d.%03dV Pbat=%dmW\r\n"
         "%s AIR  p=%d.%01dPa T=%d.%02ddegC phi=%d.%01d%%\r\n"
-        "%s IOP  IO1=%d IO2=%d IO3=%d IO4=%d\r\n"
-        "%s STN  %s",
+        "%s IOP  IO1=%d IO2=%d IO3=%d IO4=%d",
         tp->id,
         TRACE_TAB, time.year, time.month, time.day, time.hour, time.minute, time.day,
         TRACE_TAB, tp->gps_lat/10000000, (tp->gps_lat > 0 ? 1:-1)*(tp->gps_lat/100)%100000, tp->gps_lon/10000000, (tp->gps_lon > 0 ? 1:-1)*(tp->gps_lon/100)%100000, tp->gps_alt,
         TRACE_TAB, tp->gps_sats, tp->gps_ttff,
         TRACE_TAB, tp->adc_vbat/1000, (tp->adc_vbat%1000), tp->adc_vsol/1000, (tp->adc_vsol%1000), tp->pac_pbat,
         TRACE_TAB, tp->sen_i1_press/10, tp->sen_i1_press%10, tp->sen_i1_temp/100, tp->sen_i1_temp%100, tp->sen_i1_hum/10, tp->sen_i1_hum%10,
-        TRACE_TAB, tp->gpio & 1, (tp->gpio >> 1) & 1, (tp->gpio >> 2) & 1, (tp->gpio >> 3) & 1,
-        TRACE_TAB, config->call
+        TRACE_TAB, tp->gpio & 1, (tp->gpio >> 1) & 1, (tp->gpio >> 2) & 1, (tp->gpio >> 3) & 1
     );
 
     // Write data point to Flash memory
     flash_writeLogDataPoint(tp);
-
-    // Switch last data point
-    lastDataPoint = tp;
-    /* Reply to the calling thread. */
-    chMsgRelease(caller, (msg_t)tp);
+    // Archive data point to SD card if present
+    sdArchiveRecord(SD_ARCHIVE_LOG_FILE, tp, sizeof(dataPoint_t));
+    // Add data point to the time series in RAM
+    ts_add(tp);
+
+    /* Publish the new point. */
+    snap->fixed = fix_time;
+    __DMB();
+    snap->seq++;
+    published = snap;
   }
 }
 
@@ -618,27 +957,17 @@ void init_data_collector() {
   if(!threadStarted) {
 
     threadStarted = true;
+    pps_init();
     TRACE_INFO("COLL > Startup data collector thread");
     thread_t *th = chThdCreateFromHeap(NULL,
                                        THD_WORKING_AREA_SIZE(5*1024),
                                        "COL", LOWPRIO,
-                                       collectorThread, chThdGetSelfX());
+                                       collectorThread, NULL);
     collector_thd = th;
     if(!th) {
       // Print startup error, do not start watchdog for this thread
       TRACE_ERROR("COLL > Could not start"
           " thread (not enough memory available)");
-    } else {
-      /* Wait for collector to start. */
-      thread_t *tp = chMsgWait();
-      msg_t msg = chMsgGet(tp);
-      if(msg == MSG_RESET) {
-        TRACE_INFO("COLL > Executed cold start");
-      }
-      else {
-        TRACE_INFO("COLL > Executed warm start");
-      }
-      chMsgRelease(tp, MSG_OK);
     }
   }
 }
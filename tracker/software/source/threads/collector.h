@@ -5,6 +5,7 @@
 #include "hal.h"
 #include "ptime.h"
 #include "types.h"
+#include "datapoint.h"
 
 #define BME_STATUS_BITS         2
 #define BME_STATUS_MASK         0x3
@@ -27,6 +28,14 @@
 #define BME280_E1_IS_FITTED     FALSE
 #define BME280_E2_IS_FITTED     TRUE
 
+/*
+ * Data points are published as snapshots in a ring.
+ * A snapshot is reused after COLLECTOR_SNAPSHOTS - 1 newer points.
+ */
+#define COLLECTOR_SNAPSHOTS     4
+#define COLLECTOR_MAX_CLIENTS   4
+#define COLLECTOR_EVT_CLIENT    EVENT_MASK(0)
+
 /**
  * @brief   GPS states as array of strings.
  * @details Each element in an array initialized with this macro can be
@@ -34,7 +43,7 @@
  */
 #define GPS_STATE_NAMES                                                     \
   "LOCKED1", "LOCKED2", "LOSS", "LOWBATT1", "LOWBATT2", "LOG", "OFF",       \
-  "ERROR", "FIXED", "TIME"
+  "ERROR", "FIXED", "TIME", "PREDICTED"
 
 typedef enum {
 	GPS_LOCKED1,	// The GPS is locked, the GPS has been switched off
@@ -46,10 +55,11 @@ typedef enum {
 	GPS_OFF,		// There was no prior acquisition by GPS
 	GPS_ERROR,		// The GPS has a communication error
     GPS_FIXED,      // Fixed location data used from APRS location
-    GPS_TIME        // Time stamp of RTC on first getting GPS time
+    GPS_TIME,       // Time stamp of RTC on first getting GPS time
+    GPS_PREDICTED   // Position predicted from prior fixes, the GPS is switched off
 } gpsState_t;
 
-#define GPS_STATE_MAX   GPS_TIME
+#define GPS_STATE_MAX   GPS_PREDICTED
 
 typedef struct {
 	// Voltage and current measurement
@@ -110,6 +120,7 @@ typedef struct {
 
     uint8_t  gpio;    // GPIO states
 } dataPoint_t;
+/* Change DATAPOINT_FIELDS in datapoint.h along with dataPoint_t. */
 
 
 /*typedef struct telemRequest {
@@ -119,6 +130,11 @@ typedef struct {
 
 //void waitForNewDataPoint(void);
 dataPoint_t* getLastDataPoint(void);
+void getLastDataPointCopy(dataPoint_t* dp);
+void getLastDataPointStamped(dataPoint_t* dp, systime_t *sampled,
+                             systime_t *fixed);
+void addCollectorClient(bcn_app_conf_t* config);
+void setCollectorClientCycle(bcn_app_conf_t* config, sysinterval_t cycle);
 void getSensors(dataPoint_t* tp);
 void setSystemStatus(dataPoint_t* tp);
 void init_data_collector(void);
@@ -156,7 +172,8 @@ const char *get_gps_state_name(uint8_t index);
 #define isPositionValid(dp)   (dp->gps_state == GPS_LOCKED1                  \
                               || dp->gps_state == GPS_LOCKED2                \
                               || dp->gps_state == GPS_FIXED                  \
-                              || dp->gps_state == GPS_LOG)
+                              || dp->gps_state == GPS_LOG                    \
+                              || dp->gps_state == GPS_PREDICTED)
 
 /**
  * @brief   Is position from a satellite.
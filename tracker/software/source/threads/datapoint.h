@@ -0,0 +1,53 @@
+#ifndef __DATAPOINT_H__
+#define __DATAPOINT_H__
+
+/*
+ * Layout of dataPoint_t (collector.h) as sent in telemetry and log packets
+ * and held in the flash log. The ground decoder (host/dpdec.c) is built from
+ * this list and collector.c checks it against dataPoint_t, so a change of
+ * dataPoint_t does not build until the list is changed as well.
+ *
+ * X(name, type, offset) with the little endian type as stored. gpsState_t
+ * is a byte with the short enums of the AAPCS (arm-none-eabi).
+ */
+
+/* Layout version of dataPoint_t. Change it when dataPoint_t changes. */
+#define DATAPOINT_VERSION   1
+
+#define DATAPOINT_SIZE      76
+
+#define DATAPOINT_FIELDS(X)                                                 \
+	X(adc_vsol,         uint16_t,   0)                                      \
+	X(adc_vbat,         uint16_t,   2)                                      \
+	X(pac_vsol,         uint16_t,   4)                                      \
+	X(pac_vbat,         uint16_t,   6)                                      \
+	X(pac_pbat,         int16_t,    8)                                      \
+	X(pac_psol,         int16_t,    10)                                     \
+	X(light_intensity,  uint16_t,   12)                                     \
+	X(gps_state,        uint8_t,    14)                                     \
+	X(gps_sats,         uint8_t,    15)                                     \
+	X(gps_ttff,         uint8_t,    16)                                     \
+	X(gps_pdop,         uint8_t,    17)                                     \
+	X(gps_alt,          uint16_t,   18)                                     \
+	X(gps_lat,          int32_t,    20)                                     \
+	X(gps_lon,          int32_t,    24)                                     \
+	X(sen_i1_press,     uint32_t,   28)                                     \
+	X(sen_e1_press,     uint32_t,   32)                                     \
+	X(sen_e2_press,     uint32_t,   36)                                     \
+	X(sen_i1_temp,      int16_t,    40)                                     \
+	X(sen_e1_temp,      int16_t,    42)                                     \
+	X(sen_e2_temp,      int16_t,    44)                                     \
+	X(sen_i1_hum,       uint8_t,    46)                                     \
+	X(sen_e1_hum,       uint8_t,    47)                                     \
+	X(sen_e2_hum,       uint8_t,    48)                                     \
+	X(dummy2,           uint8_t,    49)                                     \
+	X(stm32_temp,       int16_t,    50)                                     \
+	X(si446x_temp,      int16_t,    52)                                     \
+	X(reset,            uint16_t,   54)                                     \
+	X(id,               uint32_t,   56)                                     \
+	X(gps_time,         uint32_t,   60)                                     \
+	X(sys_time,         uint32_t,   64)                                     \
+	X(sys_error,        uint32_t,   68)                                     \
+	X(gpio,             uint8_t,    72)
+
+#endif /* __DATAPOINT_H__ */
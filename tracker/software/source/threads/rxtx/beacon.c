@@ -11,158 +11,277 @@
 #include "chprintf.h"
 #include <string.h>
 #include <math.h>
-#include "watchdog.h"
+#include "scheduler.h"
+#include "budget.h"
+#include "txlatency.h"
 
 /*
- *
+ * Motion adaptive beacon cycle.
+ * With fast_cycle and slow_cycle set the cycle follows the vertical rate
+ * between data points. The rate is from the GPS altitude of successive
+ * fixes or from the pressure trend without a fix. From BCN_RATE_SLOW up
+ * to BCN_RATE_FAST m/s the cycle goes from slow_cycle down to fast_cycle.
+ * So ascent, burst and descent are reported often and a stable float is
+ * not. A cycle shorter than the beacon cycle needs airtime budget.
  */
-THD_FUNCTION(bcnThread, arg) {
-  bcn_app_conf_t* conf = (bcn_app_conf_t *)arg;
-
-  // Start data collector (if not running yet)
-  init_data_collector();
+#define BCN_RATE_SLOW           0.5f
+#define BCN_RATE_FAST           3.0f
+/* Pressure scale height in m for the rate from the pressure trend. */
+#define BCN_SCALE_HEIGHT        7400.0f
 
-  // Start position thread
-  TRACE_INFO("BCN  > Startup beacon thread");
+/*
+ * Periodic beacon run by the scheduler.
+ */
+typedef struct {
+  sched_job_t     job;
+  bcn_app_conf_t  *conf;
+  systime_t       last_conf_transmission;
+  /* Last data point of the motion adaptive cycle. */
+  systime_t       motion_sampled;
+  uint16_t        motion_alt;
+  uint32_t        motion_press;
+  bool            motion_gps;
+  /* Vertical rate in m/s, negative if unknown. */
+  float           motion_rate;
+} bcn_job_t;
 
-  // Set telemetry configuration transmission variables
-  // Each beacon send configuration data as the call signs may differ
-  sysinterval_t last_conf_transmission =
-      chVTGetSystemTime() - conf_sram.tel_enc_cycle;
-  sysinterval_t time = chVTGetSystemTime();
+/*
+ * Get the barometric pressure of a data point from the first sensor fitted.
+ */
+static uint32_t get_beacon_pressure(const dataPoint_t *dp) {
+  if(dp->sen_i1_press != 0)
+    return dp->sen_i1_press;
+  if(dp->sen_e1_press != 0)
+    return dp->sen_e1_press;
+  return dp->sen_e2_press;
+}
 
-  /* Now wait for our delay before starting. */
+/*
+ * Get the beacon cycle for the motion since the last data point.
+ */
+static sysinterval_t get_beacon_cycle(bcn_job_t *bj) {
+  bcn_app_conf_t *conf = bj->conf;
+  if(conf->fast_cycle == 0 || conf->slow_cycle == 0 || conf->beacon.fixed)
+    return conf->beacon.cycle;
 
-  chThdSleepUntil(chVTGetSystemTime() + conf->beacon.init_delay);
+  dataPoint_t dp;
+  systime_t sampled, fixed;
+  getLastDataPointStamped(&dp, &sampled, &fixed);
+  bool gps = dp.gps_state == GPS_LOCKED1 || dp.gps_state == GPS_LOCKED2;
+  uint32_t press = get_beacon_pressure(&dp);
+  if(sampled != 0 && sampled != bj->motion_sampled) {
+    if(bj->motion_sampled != 0) {
+      float dt = chTimeI2MS(chTimeDiffX(bj->motion_sampled, sampled))
+          / 1000.0f;
+      if(gps && bj->motion_gps)
+        bj->motion_rate = fabsf((float)dp.gps_alt - bj->motion_alt) / dt;
+      else if(press != 0 && bj->motion_press != 0)
+        bj->motion_rate = BCN_SCALE_HEIGHT
+            * fabsf((float)press - bj->motion_press)
+            / (bj->motion_press * dt);
+      else
+        bj->motion_rate = -1.0f;
+    }
+    bj->motion_sampled = sampled;
+    bj->motion_alt = dp.gps_alt;
+    bj->motion_press = press;
+    bj->motion_gps = gps;
+  }
+  if(bj->motion_rate < 0.0f)
+    return conf->beacon.cycle;
 
-  while(true) {
+  float f = (bj->motion_rate - BCN_RATE_SLOW)
+      / (BCN_RATE_FAST - BCN_RATE_SLOW);
+  f = fmaxf(0.0f, fminf(1.0f, f));
+  sysinterval_t cycle = conf->slow_cycle
+      - (sysinterval_t)(f * ((float)conf->slow_cycle - conf->fast_cycle));
+  if(cycle < conf->beacon.cycle && budget_available(BUDGET_BEACON) <= 0)
+    cycle = conf->beacon.cycle;
+  return cycle;
+}
 
-    char code_s[100];
-    pktDisplayFrequencyCode(conf->radio_conf.freq, code_s, sizeof(code_s));
-    TRACE_INFO("POS  > Do module BEACON cycle for %s on %s%s",
-               conf->call, code_s, conf->run_once ? " (?aprsp response)" : "");
-    /* TODO: Add a while loop here that checks remaining time in cycle.
-     * When within time then keep trying for GPS lock.
-     * The collector will keep the GPS on if battery is OK.
-     */
-    if(chVTIsSystemTimeWithinX(time, time + conf->beacon.cycle)) {
+/*
+ * Transmit one beacon cycle.
+ * The packets are queued back to back so the radio sends them in one
+ * session together with those of other jobs due at the same time.
+ */
+static void beacon_transmit(bcn_app_conf_t *conf,
+                            systime_t *last_conf_transmission) {
+  char code_s[100];
+  pktDisplayFrequencyCode(conf->radio_conf.freq, code_s, sizeof(code_s));
+  TRACE_INFO("POS  > Do module BEACON cycle for %s on %s%s",
+             conf->call, code_s, conf->run_once ? " (?aprsp response)" : "");
 
-    }
+  /*
+   * Get the last data point from the collector without waiting.
+   * A fixed location of this beacon replaces the collected position.
+   */
+  dataPoint_t dp;
+  dataPoint_t *dataPoint = &dp;
+  systime_t sampled, fixed;
+  getLastDataPointStamped(dataPoint, &sampled, &fixed);
+  if(conf->beacon.fixed) {
+    fixed = 0;
+    dataPoint->gps_alt = conf->beacon.alt;
+    dataPoint->gps_lat = conf->beacon.lat;
+    dataPoint->gps_lon = conf->beacon.lon;
+    dataPoint->gps_sats = 0;
+    dataPoint->gps_ttff = 0;
+    dataPoint->gps_pdop = 0;
+    dataPoint->gps_state = GPS_FIXED;
+  }
 
-    /*
-     *  Pass pointer to beacon config to the collector thread.
-     */
-    extern thread_t *collector_thd;
-    msg_t dpmsg = chMsgSend(collector_thd, (msg_t)conf);
-    if(dpmsg == MSG_TIMEOUT) {
+  if(p_sleep(&conf->beacon.sleep_conf))
+    return;
 
-    }
-    /* If not a timeout then this is a datapoint. */
-    dataPoint_t *dataPoint = (dataPoint_t *)dpmsg;
-
-    /* Continue here when collector responds. */
-    if(!p_sleep(&conf->beacon.sleep_conf)) {
-      // Telemetry encoding parameter transmissions
-      if(conf_sram.tel_enc_cycle != 0
-    		  && chVTTimeElapsedSinceX(last_conf_transmission)
-      	  	  	  >= conf_sram.tel_enc_cycle) {
-        TRACE_INFO("BCN  > Transmit telemetry configuration");
-
-        // Encode and transmit telemetry config packet
-        uint8_t type = 0;
-        do {
-          packet_t packet = aprs_encode_telemetry_configuration(
-              conf->call,
-              conf->path,
-              conf->call,
-              type);
-          if(packet == NULL) {
-            TRACE_WARN("BCN  > No free packet objects for"
-                " telemetry config transmission %d", type);
-          } else {
-            if(!transmitOnRadio(packet,
-                                conf->radio_conf.freq,
-                                0,
-                                0,
-                                conf->radio_conf.pwr,
-                                conf->radio_conf.mod,
-                                conf->radio_conf.cca)) {
-              /* Packet is released in transmitOnRadio. */
-              TRACE_ERROR("BCN  > Failed to transmit telemetry config");
-            }
-          }
-          chThdSleep(TIME_S2I(5));
-        } while(++type < APRS_NUM_TELEM_GROUPS);
-        last_conf_transmission += conf_sram.tel_enc_cycle;
-      }
+  /* The position is always sent. The other packets need airtime budget. */
+  bool budget = budget_available(BUDGET_BEACON) > 0;
+  if(!budget)
+    TRACE_INFO("BCN  > Airtime budget used up, send position only");
 
-      TRACE_INFO("BCN  > Transmit position and telemetry");
+  // Telemetry encoding parameter transmissions
+  if(budget && conf_sram.tel_enc_cycle != 0
+      && chVTTimeElapsedSinceX(*last_conf_transmission)
+          >= conf_sram.tel_enc_cycle) {
+    TRACE_INFO("BCN  > Transmit telemetry configuration");
 
-      // Encode/Transmit position packet
-      packet_t packet = aprs_encode_position_and_telemetry(conf->call,
-                                                           conf->path,
-                                                           conf->symbol,
-                                                           dataPoint, true);
+    // Encode and transmit telemetry config packet
+    uint8_t type = 0;
+    do {
+      packet_t packet = aprs_encode_telemetry_configuration(
+          conf->call,
+          conf->path,
+          conf->call,
+          type);
       if(packet == NULL) {
-        TRACE_ERROR("BCN  > No free packet objects"
-            " for position transmission");
+        TRACE_WARN("BCN  > No free packet objects for"
+            " telemetry config transmission %d", type);
       } else {
+        budget_charge(BUDGET_BEACON, packet, conf->radio_conf.mod, 0);
         if(!transmitOnRadio(packet,
                             conf->radio_conf.freq,
                             0,
                             0,
                             conf->radio_conf.pwr,
                             conf->radio_conf.mod,
-                            conf->radio_conf.cca)) {
-          TRACE_ERROR("BCN  > failed to transmit beacon data");
+                            conf->radio_conf.cca,
+                            TX_PRIO_POSITION)) {
+          /* Packet is released in transmitOnRadio. */
+          TRACE_ERROR("BCN  > Failed to transmit telemetry config");
         }
-        chThdSleep(TIME_S2I(5));
       }
+    } while(++type < APRS_NUM_TELEM_GROUPS);
+    *last_conf_transmission += conf_sram.tel_enc_cycle;
+  }
 
-      TRACE_INFO("BCN  > Transmit recently heard direct");
-      /*
-       * Encode/Transmit APRSD packet.
-       * This is a tracker originated message (not a reply to a request).
-       * The message will be addressed to the base station if set.
-       * Else send it to device identity.
-       */
-      char *call = conf_sram.base.enabled
-          ? conf_sram.base.call : conf->call;
-      char *path = conf_sram.base.enabled
-          ? conf_sram.base.path : conf->path;
-      /*
-       * Send message from this device.
-       * Use call sign and path as specified in base config.
-       * There is no acknowledgment requested.
-       */
-      packet = aprs_compose_aprsd_message(conf->call, path, call);
-      if(packet == NULL) {
-        TRACE_ERROR("BCN  > No free packet objects "
-            "or badly formed APRSD message");
-      } else {
-        if(!transmitOnRadio(packet,
-                            conf->radio_conf.freq,
-                            0,
-                            0,
-                            conf->radio_conf.pwr,
-                            conf->radio_conf.mod,
-                            conf->radio_conf.cca
-        )) {
-          TRACE_ERROR("BCN  > Failed to transmit APRSD data");
-        }
-        chThdSleep(TIME_S2I(5));
-      }
-    } /* psleep */
-    if(conf->run_once) {
-      chHeapFree(conf);
-      pktThdTerminateSelf();
+  TRACE_INFO("BCN  > Transmit position and telemetry");
+
+  // Encode/Transmit position packet
+  packet_t packet = aprs_encode_position_and_telemetry(conf->call,
+                                                       conf->path,
+                                                       conf->symbol,
+                                                       dataPoint,
+                                                       !conf->compact);
+  if(packet == NULL) {
+    TRACE_ERROR("BCN  > No free packet objects"
+        " for position transmission");
+  } else {
+    /* Trace the position through the send path (latency command). */
+    txlat_open(packet, sampled, fixed);
+    budget_charge(BUDGET_BEACON, packet, conf->radio_conf.mod, 0);
+    if(!transmitOnRadio(packet,
+                        conf->radio_conf.freq,
+                        0,
+                        0,
+                        conf->radio_conf.pwr,
+                        conf->radio_conf.mod,
+                        conf->radio_conf.cca,
+                        TX_PRIO_POSITION)) {
+      TRACE_ERROR("BCN  > failed to transmit beacon data");
+    }
+  }
+
+  if(!budget)
+    return;
+
+  TRACE_INFO("BCN  > Transmit recently heard direct");
+  /*
+   * Encode/Transmit APRSD packet.
+   * This is a tracker originated message (not a reply to a request).
+   * The message will be addressed to the base station if set.
+   * Else send it to device identity.
+   */
+  char *call = conf_sram.base.enabled
+      ? conf_sram.base.call : conf->call;
+  char *path = conf_sram.base.enabled
+      ? conf_sram.base.path : conf->path;
+  /*
+   * Send message from this device.
+   * Use call sign and path as specified in base config.
+   * There is no acknowledgment requested.
+   */
+  packet = aprs_compose_aprsd_message(conf->call, path, call);
+  if(packet == NULL) {
+    TRACE_ERROR("BCN  > No free packet objects "
+        "or badly formed APRSD message");
+  } else {
+    budget_charge(BUDGET_BEACON, packet, conf->radio_conf.mod, 0);
+    if(!transmitOnRadio(packet,
+                        conf->radio_conf.freq,
+                        0,
+                        0,
+                        conf->radio_conf.pwr,
+                        conf->radio_conf.mod,
+                        conf->radio_conf.cca,
+                        TX_PRIO_POSITION)) {
+      TRACE_ERROR("BCN  > Failed to transmit APRSD data");
     }
-    time = waitForTrigger(time, conf->beacon.cycle);
   }
 }
 
+static void beacon_job(sched_job_t *job) {
+  bcn_job_t *bj = (bcn_job_t *)job->arg;
+
+  /* The first beacon after boot needs the last data point. */
+  if(!boot_wait_ready(BOOT_LOG, BOOT_LOG_WAIT))
+    TRACE_WARN("BCN  > No data point from log");
+
+  /* The cycle may have been changed by config or motion. */
+  sysinterval_t cycle = get_beacon_cycle(bj);
+  if(cycle != job->cycle)
+    TRACE_INFO("BCN  > Cycle %d s for vertical rate %d cm/s",
+               chTimeI2S(cycle), (int)(bj->motion_rate * 100.0f));
+  job->cycle = cycle;
+  setCollectorClientCycle(bj->conf,
+                          (cycle != bj->conf->beacon.cycle) ? cycle : 0);
+  beacon_transmit(bj->conf, &bj->last_conf_transmission);
+}
+
+/*
+ * A request beacon runs once in its own thread.
+ */
+THD_FUNCTION(bcnThread, arg) {
+  bcn_app_conf_t* conf = (bcn_app_conf_t *)arg;
+
+  // Start data collector (if not running yet)
+  init_data_collector();
+
+  TRACE_INFO("BCN  > Startup beacon thread");
+  if(conf->beacon.init_delay) chThdSleep(conf->beacon.init_delay);
+  (void)boot_wait_ready(BOOT_LOG, BOOT_LOG_WAIT);
+
+  // Each beacon send configuration data as the call signs may differ
+  systime_t last_conf_transmission =
+      chVTGetSystemTime() - conf_sram.tel_enc_cycle;
+  beacon_transmit(conf, &last_conf_transmission);
+
+  chHeapFree(conf);
+  pktThdTerminateSelf();
+}
+
 /**
- *
+ * Start a run once beacon thread.
+ * The thread frees the configuration when done.
  */
 thread_t * start_beacon_thread(bcn_app_conf_t *conf, const char *name) {
   extern memory_heap_t *ccm_heap;
@@ -176,3 +295,31 @@ thread_t * start_beacon_thread(bcn_app_conf_t *conf, const char *name) {
   return th;
 }
 
+/**
+ * Add a periodic beacon to the scheduler.
+ */
+bool start_beacon_job(bcn_app_conf_t *conf, const char *name) {
+  extern memory_heap_t *ccm_heap;
+  bcn_job_t *bj = chHeapAlloc(ccm_heap, sizeof(bcn_job_t));
+  if(bj == NULL) {
+    TRACE_ERROR("BCN  > Could not start beacon %s (insufficient memory)",
+                name);
+    return false;
+  }
+
+  // Start data collector (if not running yet)
+  addCollectorClient(conf);
+  init_data_collector();
+
+  // Each beacon send configuration data as the call signs may differ
+  bj->conf = conf;
+  bj->last_conf_transmission = chVTGetSystemTime() - conf_sram.tel_enc_cycle;
+  bj->motion_sampled = 0;
+  bj->motion_rate = -1.0f;
+
+  TRACE_INFO("BCN  > Startup beacon %s", name);
+  sched_add(&bj->job, name, beacon_job, bj, conf->beacon.init_delay,
+            conf->beacon.cycle);
+  sched_init();
+  return true;
+}
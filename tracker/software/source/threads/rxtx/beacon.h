@@ -9,6 +9,7 @@
 extern "C" {
 #endif
   thread_t * start_beacon_thread(bcn_app_conf_t *conf, const char *name);
+  bool start_beacon_job(bcn_app_conf_t *conf, const char *name);
 #ifdef __cplusplus
 }
 #endif
@@ -18,6 +18,12 @@
 #include "sd.h"
 #include "collector.h"
 #include "image.h"
+#include "geofence.h"
+#include "budget.h"
+#include "pclock.h"
+#include "checkpoint.h"
+#include "memregion.h"
+#include "eprof.h"
 
 const uint8_t noCameraFound[] = {
      0xFF, 0xD8, 0xFF, 0xE0, 0x00, 0x10, 0x4A, 0x46, 0x49, 0x46, 0x00, 0x01, 0x01, 0x01, 0x00, 0x48,
@@ -809,48 +815,470 @@ const uint8_t noCameraFound[] = {
 	0xBD, 0xC0, 0x20, 0x00, 0x01, 0xFF, 0xD9
 };*/
 
-uint32_t gimage_id; // Global image ID (for all image threads)
 mutex_t camera_mtx;
 bool camera_mtx_init = false;
 
 static bool camInitialized = false;
+/* Switches the camera off when standby time expires. */
+static virtual_timer_t cam_standby_vt;
+
+/*
+ * Image state kept over a reset.
+ * The image ID continues so the ground decoder does not get a new image
+ * under an ID it already has. Repeat requests not yet served are kept.
+ */
+typedef struct {
+  uint32_t      image_id;   // Global image ID (for all image threads)
+  ssdv_packet_t repeats[IMG_REPEAT_SLOTS];
+} img_state_t;
+
+static CHECKPOINT_DATA img_state_t img_state;
+static CHECKPOINT_DATA checkpoint_t img_checkpoint;
+static MUTEX_DECL(img_state_mtx);
 
-ssdv_packet_t packetRepeats[16];
 bool reject_pri;
 bool reject_sec;
 
+/*
+ * Encoder resume points recorded during the first encode of an image.
+ * A point is kept every step packets so re-sends skip at most step - 1.
+ */
+#define IMG_SSDV_RESUME_POINTS  64
+
+typedef struct {
+  ssdv_resume_t point[IMG_SSDV_RESUME_POINTS];
+  uint16_t      step;
+  uint16_t      count;
+} ssdv_resume_index_t;
+
+/*
+ * Record the resume point for the next packet if one is due.
+ */
+/*
+ * Start with the state held over a reset or from image ID 0.
+ * Called at startup before image threads and the command handler run.
+ */
+void image_restore_state(void) {
+  chMtxLock(&img_state_mtx);
+  if(checkpoint_restore(&img_checkpoint, CHECKPOINT_ID_IMAGE, &img_state,
+                        sizeof(img_state))) {
+    TRACE_INFO("IMG  > Resume at image ID %d", img_state.image_id);
+  } else {
+    memset(&img_state, 0, sizeof(img_state));
+    checkpoint_save(&img_checkpoint, CHECKPOINT_ID_IMAGE, &img_state,
+                    sizeof(img_state));
+  }
+  chMtxUnlock(&img_state_mtx);
+}
+
+static uint32_t getNextImageId(void) {
+  chMtxLock(&img_state_mtx);
+  uint32_t id = img_state.image_id++;
+  checkpoint_save(&img_checkpoint, CHECKPOINT_ID_IMAGE, &img_state,
+                  sizeof(img_state));
+  chMtxUnlock(&img_state_mtx);
+  return id;
+}
+
+/*
+ * Queue a packet repeat request. Returns false if all slots are in use.
+ */
+bool image_add_repeat(uint8_t image_id, uint16_t packet_id) {
+  bool added = false;
+  chMtxLock(&img_state_mtx);
+  for(uint8_t i = 0; i < IMG_REPEAT_SLOTS; i++) {
+    /* Find an empty repeat slot. */
+    if(!img_state.repeats[i].n_done) {
+      img_state.repeats[i].image_id = image_id;
+      img_state.repeats[i].packet_id = packet_id;
+      img_state.repeats[i].n_done = true;
+      checkpoint_save(&img_checkpoint, CHECKPOINT_ID_IMAGE, &img_state,
+                      sizeof(img_state));
+      added = true;
+      break;
+    }
+  }
+  chMtxUnlock(&img_state_mtx);
+  return added;
+}
+
+static void clearRepeat(uint8_t i) {
+  chMtxLock(&img_state_mtx);
+  img_state.repeats[i].n_done = false;
+  checkpoint_save(&img_checkpoint, CHECKPOINT_ID_IMAGE, &img_state,
+                  sizeof(img_state));
+  chMtxUnlock(&img_state_mtx);
+}
+
+static void save_image_resume(ssdv_t *ssdv, ssdv_resume_index_t *index) {
+  if(ssdv->packet_id == 0 || ssdv->packet_id % index->step != 0)
+    return;
+  uint16_t n = ssdv->packet_id / index->step - 1;
+  if(n != index->count || n >= IMG_SSDV_RESUME_POINTS)
+    return;
+  if(ssdv_enc_save(ssdv, &index->point[n]) == SSDV_OK)
+    index->count++;
+}
+
+/*
+ * Get the closest resume point before a packet.
+ * Returns NULL if the packet is reached by encoding from the start.
+ */
+static const ssdv_resume_t *get_image_resume(const ssdv_resume_index_t *index,
+                                             uint16_t packet_id) {
+  if(index == NULL || index->count == 0 || packet_id < index->step)
+    return NULL;
+  uint16_t n = packet_id / index->step - 1;
+  if(n >= index->count)
+    n = index->count - 1;
+  return &index->point[n];
+}
+
+/*
+ * Cache of SSDV payloads of the image being sent.
+ * The cache uses capture buffer memory not taken by the image.
+ * Entries are indexed by packet ID so the cache holds the last packets.
+ * Payloads are held raw and base91 encoded when the packet is built.
+ */
+
+/*
+ * SSDV bytes sent in a frame.
+ * The sync byte, type and callsign are not sent. Nor is the CRC as the
+ * frame has its own check. So a frame holds the SSDV header from the
+ * image ID followed by the payload. The default fills the payload of
+ * SSDV_TYPE_PADDING. Larger sizes use the padding space of the packet
+ * for more image data on good links. Smaller sizes lose less of the
+ * image per lost frame on poor links.
+ */
+#define IMG_SSDV_HEADER_SIZE    (SSDV_PKT_SIZE_HEADER - 6)
+#define IMG_SSDV_DATA_SIZE      174
+
+_Static_assert(IMG_SSDV_DATA_MAX == SSDV_PKT_SIZE - 6 - SSDV_PKT_SIZE_CRC,
+               "IMG_SSDV_DATA_MAX does not match the SSDV packet");
+
+typedef struct {
+  uint16_t      packet_id;
+  bool          valid;
+  uint8_t       data[];
+} ssdv_cache_entry_t;
+
+/* Cache memory of an entry holding SSDV bytes of a frame. */
+#define IMG_SSDV_ENTRY_SIZE(n)  ((sizeof(ssdv_cache_entry_t) + (n)          \
+                                 + sizeof(uint32_t) - 1)                     \
+                                 & ~(sizeof(uint32_t) - 1))
+
+typedef struct {
+  uint8_t             *entries;
+  uint16_t            size;
+  uint16_t            data_size;
+  uint16_t            stride;
+} ssdv_cache_t;
+
+/*
+ * Get the SSDV bytes sent in a frame for an image thread.
+ */
+static uint16_t get_image_data_size(const img_app_conf_t *conf) {
+  if(conf->ssdv_size == 0)
+    return IMG_SSDV_DATA_SIZE;
+  return fmax(IMG_SSDV_DATA_MIN, fmin(conf->ssdv_size, IMG_SSDV_DATA_MAX));
+}
+
+/*
+ * Get the cache entry a packet is held in.
+ */
+static ssdv_cache_entry_t *get_image_cache_entry(const ssdv_cache_t *cache,
+                                                 uint16_t packet_id) {
+  return (ssdv_cache_entry_t *)(cache->entries
+      + (uint32_t)(packet_id % cache->size) * cache->stride);
+}
+
+/*
+ * Set up the payload cache in spare memory.
+ */
+static void init_image_cache(ssdv_cache_t *cache, uint8_t *spare,
+                             size_t spare_len, uint16_t data_size) {
+  /* Align the first entry. */
+  uintptr_t align = (-(uintptr_t)spare) & (sizeof(uint32_t) - 1);
+  spare_len = (spare == NULL || spare_len < align) ? 0 : spare_len - align;
+  cache->entries = spare + align;
+  cache->data_size = data_size;
+  cache->stride = IMG_SSDV_ENTRY_SIZE(data_size);
+  cache->size = fmin(spare_len / cache->stride, UINT16_MAX);
+  uint16_t i;
+  for(i = 0; i < cache->size; i++)
+    get_image_cache_entry(cache, i)->valid = false;
+  TRACE_INFO("IMG  > Image packet cache holds %i packets", cache->size);
+}
+
+/*
+ * Add a payload to the cache.
+ */
+static void cache_image_packet(ssdv_cache_t *cache, uint16_t packet_id,
+                               const uint8_t *data) {
+  if(cache->size == 0)
+    return;
+  ssdv_cache_entry_t *entry = get_image_cache_entry(cache, packet_id);
+  memcpy(entry->data, data, cache->data_size);
+  entry->packet_id = packet_id;
+  entry->valid = true;
+}
+
+/*
+ * Get a payload from the cache.
+ * Returns NULL if the packet is not cached.
+ */
+static const uint8_t *get_cached_image_packet(const ssdv_cache_t *cache,
+                                              uint16_t packet_id) {
+  if(cache->size == 0)
+    return NULL;
+  const ssdv_cache_entry_t *entry = get_image_cache_entry(cache, packet_id);
+  if(!entry->valid || entry->packet_id != packet_id)
+    return NULL;
+  return entry->data;
+}
+
+/*
+ * Build the packet for an SSDV payload.
+ * Binary mode sends the raw payload for links not gated to APRS-IS.
+ */
+static packet_t encode_image_packet(const img_app_conf_t *conf,
+                                    const uint8_t *data, uint16_t size) {
+  if(conf->binary)
+    return aprs_encode_binary_packet(conf->call, conf->path, 'I',
+                                     data, size);
+  return aprs_encode_base91_packet(conf->call, conf->path, 'I',
+                                   data, size);
+}
+
+/*
+ * Send the ID of the reference image a delta image is sent against.
+ */
+static bool transmit_image_reference(img_app_conf_t* conf,
+                                     uint8_t image_id, uint8_t ref_id) {
+  uint8_t data[] = {image_id, ref_id};
+  packet_t packet;
+  if(conf->binary)
+    packet = aprs_encode_binary_packet(conf->call, conf->path, 'D',
+                                       data, sizeof(data));
+  else
+    packet = aprs_encode_base91_packet(conf->call, conf->path, 'D',
+                                       data, sizeof(data));
+  if(packet == NULL)
+    return false;
+  ax25_set_link(packet, conf->radio_conf.link);
+  budget_charge(BUDGET_IMAGE, packet, conf->radio_conf.mod,
+                conf->radio_conf.speed);
+  return transmitOnRadioAtSpeed(packet,
+                                conf->radio_conf.freq,
+                                0,
+                                0,
+                                conf->radio_conf.pwr,
+                                conf->radio_conf.mod,
+                                conf->radio_conf.speed,
+                                conf->radio_conf.cca,
+                                TX_PRIO_BULK);
+}
+
+/*
+ * Send a run of cached packets as one chain.
+ * Returns false if a packet is not cached or could not be sent.
+ */
+static bool transmit_cached_packets(const ssdv_cache_t *cache,
+                                    img_app_conf_t* conf,
+                                    uint16_t first, uint16_t count) {
+  packet_t head = NULL;
+  packet_t previous = NULL;
+  uint16_t i;
+  for(i = 0; i < count; i++) {
+    const uint8_t *data = get_cached_image_packet(cache, first + i);
+    packet_t packet = NULL;
+    if(data != NULL)
+      packet = encode_image_packet(conf, data, cache->data_size);
+    if(packet == NULL) {
+      if(head != NULL)
+        pktReleaseBufferChain(head);
+      return false;
+    }
+    if(previous != NULL)
+      previous->nextp = packet;
+    else
+      head = packet;
+    previous = packet;
+  }
+  if(head == NULL)
+    return true;
+  ax25_set_link(head, conf->radio_conf.link);
+  budget_charge(BUDGET_IMAGE, head, conf->radio_conf.mod,
+                conf->radio_conf.speed);
+  /* Transmit on radio will release the packet chain on failure. */
+  return transmitOnRadioAtSpeed(head,
+                                conf->radio_conf.freq,
+                                0,
+                                0,
+                                conf->radio_conf.pwr,
+                                conf->radio_conf.mod,
+                                conf->radio_conf.speed,
+                                conf->radio_conf.cca,
+                                TX_PRIO_BULK);
+}
+
+/*
+ * Encoder of the image being sent.
+ * The encode can start while the image is captured.
+ * The first packets are then ready to send when capture completes.
+ */
+#define IMG_STREAM_PACKETS      16
+
+/*
+ * Delta images.
+ * An image is compared with the last image sent in full by the mean
+ * luminance of each MCU. Packets holding only MCUs changed by no more than
+ * img_xxx.delta are not sent. A 'D' data packet holds the image ID and the
+ * ID of its reference image so a ground station can fill the missing
+ * packets from the reference. After IMG_DELTA_REFRESH deltas the next
+ * image is sent in full. MCUs past IMG_DELTA_MAX_MCUS are always sent.
+ */
+#define IMG_DELTA_MAX_MCUS      4800
+#define IMG_DELTA_REFRESH       4
+
+typedef struct {
+  ssdv_t              ssdv;
+  uint8_t             pkt[SSDV_PKT_SIZE];
+  ssdv_resume_index_t resume;
+  uint8_t             early[IMG_STREAM_PACKETS][IMG_SSDV_DATA_MAX];
+  uint16_t            count;
+  bool                streamed;
+  bool                failed;
+  /* Set before a streamed capture. */
+  uint8_t             image_id;
+  uint8_t             quality;
+  uint32_t            capacity;
+  /* Encode the image as a DC only preview. */
+  bool                preview;
+  /* SSDV bytes sent in a frame. */
+  uint16_t            data_size;
+  /* Last MCU touched by each packet encoded during capture. */
+  uint16_t            early_mcu[IMG_STREAM_PACKETS];
+  /* Send only packets with changed MCUs. */
+  bool                delta;
+  uint8_t             changed[IMG_DELTA_MAX_MCUS / 8];
+} ssdv_encode_t;
+
+/*
+ * Start a new encode of an image.
+ * The expected size is the image length or the capture buffer size.
+ */
+static void init_image_encode(ssdv_encode_t *enc, uint8_t image_id,
+                              uint8_t quality, const uint8_t *image,
+                              uint32_t image_len, uint32_t expected) {
+  ssdv_enc_init(&enc->ssdv, SSDV_TYPE_PADDING, "N0CALL", image_id, quality);
+  ssdv_enc_set_payload(&enc->ssdv, enc->data_size - IMG_SSDV_HEADER_SIZE);
+  ssdv_enc_set_buffer(&enc->ssdv, enc->pkt);
+  ssdv_enc_set_dc_only(&enc->ssdv, enc->preview);
+  ssdv_enc_set_image(&enc->ssdv, image, image_len);
+  /* Space resume points to cover the expected number of packets. */
+  enc->resume.count = 0;
+  enc->resume.step = expected / (enc->ssdv.pkt_size_payload
+      * IMG_SSDV_RESUME_POINTS) + 1;
+  enc->count = 0;
+  enc->streamed = false;
+  enc->failed = false;
+}
+
+/*
+ * Encode packets from capture DMA segments as they complete.
+ * Called from the capture with camera resources locked.
+ * A fill of zero is the start of a capture and restarts the encode.
+ */
+static void stream_image_segment(void *arg, const uint8_t *buffer,
+                                 uint32_t filled) {
+  ssdv_encode_t *enc = arg;
+  if(filled == 0) {
+    init_image_encode(enc, enc->image_id, enc->quality, buffer, 0,
+                      enc->capacity);
+    enc->streamed = true;
+    return;
+  }
+  if(enc->failed)
+    return;
+  ssdv_enc_grow(&enc->ssdv, filled);
+  while(enc->count < IMG_STREAM_PACKETS) {
+    save_image_resume(&enc->ssdv, &enc->resume);
+    char c = ssdv_enc_get_packet(&enc->ssdv);
+    if(c == SSDV_FEED_ME || c == SSDV_EOI)
+      return;
+    if(c != SSDV_OK) {
+      /* The encode is done again once capture is complete. */
+      enc->failed = true;
+      return;
+    }
+    enc->early_mcu[enc->count] = enc->ssdv.mcu_id;
+    memcpy(enc->early[enc->count++], &enc->pkt[6], enc->data_size);
+  }
+}
+
+/*
+ * Check if any MCU from first to last changed in a delta image.
+ */
+static bool image_mcus_changed(const ssdv_encode_t *enc, uint16_t first,
+                               uint16_t last) {
+  uint16_t i;
+  for(i = first; i <= last; i++) {
+    if(i >= IMG_DELTA_MAX_MCUS || (enc->changed[i >> 3] & (1U << (i & 7))))
+      return true;
+  }
+  return false;
+}
+
+/*
+ * Re-send one image packet.
+ * The first packet is always encoded so the image headers are read.
+ * Encoding then resumes from the closest recorded point.
+ */
 static bool transmit_image_packet(const uint8_t *image,
                                   uint32_t image_len,
                                   img_app_conf_t* conf,
                                   uint8_t image_id,
-                                  uint16_t packet_id) {
+                                  uint16_t packet_id,
+                                  bool preview,
+                                  uint16_t data_size,
+                                  const ssdv_resume_index_t *index) {
 	ssdv_t ssdv;
 	uint8_t pkt[SSDV_PKT_SIZE];
-	uint8_t pkt_base91[256] = {0};
-	const uint8_t *b;
-	uint32_t bi = 0;
 	uint8_t c = SSDV_OK;
 	uint16_t i = 0;
+	const ssdv_resume_t *resume = get_image_resume(index, packet_id);
 
 	// Init SSDV (FEC at 2FSK, non FEC at APRS)
-	bi = 0;
 	ssdv_enc_init(&ssdv, SSDV_TYPE_PADDING, "N0CALL", image_id, conf->quality);
+	ssdv_enc_set_payload(&ssdv, data_size - IMG_SSDV_HEADER_SIZE);
 	ssdv_enc_set_buffer(&ssdv, pkt);
+	ssdv_enc_set_dc_only(&ssdv, preview);
+	ssdv_enc_set_image(&ssdv, image, image_len);
 
 	while(true)
 	{
-		while((c = ssdv_enc_get_packet(&ssdv)) == SSDV_FEED_ME)
+		if(i == 1 && resume != NULL)
 		{
-			b = &image[bi];
-			uint8_t r = bi < image_len-128 ? 128 : image_len - bi;
-			bi += r;
-
-			if(r <= 0)
+			// Headers are read so skip to the resume point
+			if(ssdv_enc_resume(&ssdv, resume) != SSDV_OK)
 			{
-				TRACE_ERROR("SSDV > Premature end of file");
+				TRACE_ERROR("SSDV > Unable to resume at packet %i",
+				            resume->packet_id);
 				return false;
 			}
-			ssdv_enc_feed(&ssdv, b, r);
+			i = resume->packet_id;
+			resume = NULL;
+		}
+
+		// The whole image is fed so more input means it is truncated
+		eprof_enter(EPROF_SSDV);
+		c = ssdv_enc_get_packet(&ssdv);
+		eprof_leave(EPROF_SSDV);
+		if(c == SSDV_FEED_ME)
+		{
+			TRACE_ERROR("SSDV > Premature end of file");
+			return false;
 		}
 
 		if(c == SSDV_EOI) {
@@ -861,23 +1289,26 @@ static bool transmit_image_packet(const uint8_t *image,
 
 		if(i == packet_id) {
 			// Sync byte, CRC and FEC of SSDV not transmitted (because its not necessary inside an APRS packet)
-			base91_encode(&pkt[6], pkt_base91, 174);
-			packet_t packet = aprs_encode_data_packet(conf->call, conf->path, 'I', pkt_base91);
+			packet_t packet = encode_image_packet(conf, &pkt[6], data_size);
             if(packet == NULL) {
               TRACE_WARN("IMG  > No free packet objects for transmission");
               return false;
             }
-            if(!transmitOnRadio(packet,
-                                conf->radio_conf.freq,
-                                0,
-                                0,
-                                conf->radio_conf.pwr,
-                                conf->radio_conf.mod,
-                                conf->radio_conf.cca)) {
+            ax25_set_link(packet, conf->radio_conf.link);
+            if(!transmitOnRadioAtSpeed(packet,
+                                       conf->radio_conf.freq,
+                                       0,
+                                       0,
+                                       conf->radio_conf.pwr,
+                                       conf->radio_conf.mod,
+                                       conf->radio_conf.speed,
+                                       conf->radio_conf.cca,
+                                       TX_PRIO_BULK)) {
 
               TRACE_ERROR("IMG  > Unable to send image packet on radio");
               return false;
             }
+            return true;
 		}
 
 		chThdSleep(TIME_MS2I(10)); // Leave other threads some time
@@ -886,109 +1317,208 @@ static bool transmit_image_packet(const uint8_t *image,
 	}
 }
 
+/*
+ * Image bursts.
+ * AFSK bursts share one preamble but are kept short as AFSK is slow.
+ * After each burst the length grows by a packet while the channel is clear
+ * and free packet buffers are plentiful. It halves when CCA found the
+ * channel busy or receive and other sends hold most of the buffers.
+ */
+#define IMG_BURST_AFSK_MAX      4
+#define IMG_BURST_FREE_LOW      ((int)NUMBER_COMMON_PKT_BUFFERS / 4)
+#define IMG_BURST_FREE_HIGH     ((int)NUMBER_COMMON_PKT_BUFFERS / 2)
+
+/*
+ * Get the longest image burst for the link.
+ * Redundant TX needs the cache to hold two bursts.
+ */
+static uint8_t get_image_burst_limit(const img_app_conf_t *conf,
+                                     bool redundant, uint16_t cache_size) {
+  uint8_t buffers = fmin((NUMBER_COMMON_PKT_BUFFERS / 2),
+                         MAX_BUFFERS_FOR_BURST_SEND);
+  uint8_t limit;
+  if(conf->radio_conf.mod == MOD_2FSK) {
+    /* Scale the burst to the link speed so burst airtime is the same. */
+    link_speed_t speed = (conf->radio_conf.speed == 0) ?
+        SI446X_2FSK_SPEED_DEFAULT : conf->radio_conf.speed;
+    limit = fmax(1, fmin(buffers, (buffers * speed) / SI446X_2FSK_SPEED_9600));
+  } else {
+    limit = fmin(buffers, IMG_BURST_AFSK_MAX);
+  }
+  /* Leave buffers for the redundant copy of the burst. */
+  if(redundant)
+    limit = fmax(1, fmin(limit / 2, cache_size / 2));
+  return limit;
+}
+
+/*
+ * Get the count of channel access attempts which found the channel busy
+ * on the radio sending on a frequency.
+ */
+static uint32_t get_image_channel_busy(radio_freq_t freq) {
+  radio_unit_t radio = pktSelectRadioForFrequency(freq, 0, 0, RADIO_TX);
+  if(radio == PKT_RADIO_NONE)
+    return 0;
+  packet_svc_t *handler = pktGetServiceObject(radio);
+  chSysLock();
+  uint32_t busy = handler->tx_csma.busy + handler->tx_csma.forced;
+  chSysUnlock();
+  return busy;
+}
+
 /*
  * Transmit image packets.
+ * Spare memory after the image is used to cache the encoded packets.
  * Return true if no SSDV encoding error or false on encoding error.
  */
 static bool transmit_image_packets(const uint8_t *image,
                                    uint32_t image_len,
                                    img_app_conf_t* conf,
-                                   uint8_t image_id) {
+                                   uint8_t image_id,
+                                   uint8_t *spare,
+                                   size_t spare_len,
+                                   ssdv_encode_t *enc) {
 
-  uint8_t pkt[SSDV_PKT_SIZE];
-  uint8_t pkt_base91[256] = {0};
+  ssdv_cache_t cache;
+  init_image_cache(&cache, spare, spare_len, enc->data_size);
 
-  /* FIXME: This doesn't work with burst mode packet sends. */
-  // Process redundant transmission from last cycle
-  if(strlen((char*)pkt_base91)
-      && conf->redundantTx) {
-    packet_t packet = aprs_encode_data_packet(conf->call, conf->path,
-                                              'I', pkt_base91);
-    if(packet == NULL) {
-      TRACE_ERROR("IMG  > No available packet for redundant"
-          " image transmission");
-    } else {
-      if(!transmitOnRadio(packet,
-                          conf->radio_conf.freq,
-                          0,
-                          0,
-                          conf->radio_conf.pwr,
-                          conf->radio_conf.mod,
-                          conf->radio_conf.cca)) {
-        /* Packet has been released by transmit. */
-        TRACE_ERROR("IMG  > Unable to send redundant image on radio");
-      }
-    }
-    chThdSleep(TIME_MS2I(10)); // Leave other threads some time
+  /* Redundant TX sends the prior burst again from the cache. */
+  bool redundant = conf->redundantTx;
+  if(redundant && cache.size < 2) {
+    TRACE_WARN("IMG  > No memory to cache packets for redundant TX");
+    redundant = false;
   }
+  uint16_t redundant_id = 0;
+  uint16_t redundant_count = 0;
 
-  /* Prepare for new image encode and send. */
-  ssdv_t ssdv;
-  const uint8_t *b;
-  uint32_t bi = 0;
+  /* Continue an encode started during capture or start a new one. */
+  ssdv_t *ssdv = &enc->ssdv;
   uint8_t c = SSDV_OK;
-
-  /* Initialize SSDV, output buffer and input buffer. */
-  ssdv_enc_init(&ssdv, SSDV_TYPE_PADDING, "N0CALL", image_id, conf->quality);
-  ssdv_enc_set_buffer(&ssdv, pkt);
-  ssdv_enc_feed(&ssdv, image, 0);
+  if(enc->streamed && !enc->failed) {
+    ssdv_enc_grow(ssdv, image_len);
+    TRACE_INFO("IMG  > %i packets encoded during capture", enc->count);
+  } else {
+    init_image_encode(enc, image_id, enc->quality, image, image_len,
+                      image_len);
+  }
+  uint16_t early = 0;
+  /* Airtime of a packet from the prior burst. */
+  uint32_t packet_airtime = 0;
+  /* Burst length adapted to the channel and buffer use. */
+  uint8_t limit = get_image_burst_limit(conf, redundant, cache.size);
+  uint8_t burst = limit;
+  uint32_t channel_busy = get_image_channel_busy(conf->radio_conf.freq);
+  /* First MCU touched by the next packet and packets not sent. */
+  uint16_t mcu_first = 0;
+  uint16_t skipped = 0;
 
   while(c != SSDV_EOI) {
 
-    /*
-     * Next encode packets.
-     * Packet burst send is available if redundant TX is not requested.
-     */
-    uint8_t buffers = fmin((NUMBER_COMMON_PKT_BUFFERS / 2),
-                           MAX_BUFFERS_FOR_BURST_SEND);
-    uint8_t chain = (conf->radio_conf.mod == MOD_2FSK
-        && !conf->redundantTx) ?
-        buffers : 1;
+    /* Next encode packets. Free buffers are kept for other use. */
+    cnt_t free = pktGetFreePacketBuffers();
+    uint8_t chain = fmax(1, fmin(burst,
+                                 free - (cnt_t)RESERVE_BUFFERS_FOR_INTERNAL));
+
+    /* Wait for airtime and send no more than the budget allows. */
+    int32_t available;
+    while((available = budget_available(BUDGET_IMAGE)) <= 0) {
+      TRACE_INFO("IMG  > Wait for airtime budget");
+      wdg_beat_self();
+      chThdSleep(BUDGET_WAIT);
+    }
+    if(packet_airtime != 0) {
+      uint32_t allowed = available / packet_airtime;
+      if(redundant)
+        allowed /= 2;
+      chain = fmax(1, fmin(chain, allowed));
+    }
+
+    /* Send the prior burst again. */
+    if(redundant && redundant_count > 0) {
+      if(!transmit_cached_packets(&cache, conf, redundant_id,
+                                  redundant_count)) {
+        TRACE_ERROR("IMG  > Unable to send redundant image on radio");
+      }
+      redundant_count = 0;
+    }
+
     TRACE_INFO("IMG  > Encode %i APRS/SSDV packet%s", chain,
                (chain > 1 ? " burst" : ""));
 
     /* Packet linking control. */
     packet_t head = NULL;
     packet_t previous = NULL;
+    uint16_t burst_id = (early < enc->count) ? early : ssdv->packet_id;
+    uint16_t burst_count = 0;
 
+    /* Encode at full clock. */
+    pclkAcquire();
     while(chain-- > 0) {
-      while((c = ssdv_enc_get_packet(&ssdv)) == SSDV_FEED_ME) {
-        b = &image[bi++];
-        if(bi > image_len) {
+      const uint8_t *data;
+      uint16_t mcu_last;
+      if(early < enc->count) {
+        /* Send the packets encoded during capture first. */
+        data = enc->early[early];
+        cache_image_packet(&cache, early, data);
+        mcu_last = enc->early_mcu[early];
+        early++;
+      } else {
+        save_image_resume(ssdv, &enc->resume);
+        eprof_enter(EPROF_SSDV);
+        c = ssdv_enc_get_packet(ssdv);
+        eprof_leave(EPROF_SSDV);
+        if(c == SSDV_FEED_ME) {
+          /* The whole image is fed so the image is truncated. */
           TRACE_ERROR("SSDV > Premature end of file");
           if(head != NULL) {
             pktReleaseBufferChain(head);
           }
+          pclkRelease();
           return false;
         }
-        ssdv_enc_feed(&ssdv, b, 1);
-      }
 
-      if(c == SSDV_EOI) {
-        TRACE_INFO("SSDV > ssdv_enc_get_packet returned EOI");
-        break;
-      } else if(c != SSDV_OK) {
-        TRACE_ERROR("SSDV > ssdv_enc_get_packet failed: %i", c);
-        if(head != NULL) {
-          pktReleaseBufferChain(head);
+        if(c == SSDV_EOI) {
+          TRACE_INFO("SSDV > ssdv_enc_get_packet returned EOI");
+          break;
+        } else if(c != SSDV_OK) {
+          TRACE_ERROR("SSDV > ssdv_enc_get_packet failed: %i", c);
+          if(head != NULL) {
+            pktReleaseBufferChain(head);
+          }
+          pclkRelease();
+          return false;
         }
-        return false;
+
+        /*
+         * Sync byte, CRC and FEC of SSDV not transmitted.
+         * Not necessary inside an APRS packet.
+         */
+        data = &enc->pkt[6];
+        cache_image_packet(&cache, ssdv->packet_id - 1, data);
+        mcu_last = ssdv->mcu_id;
       }
 
-      /*
-       * Sync byte, CRC and FEC of SSDV not transmitted.
-       * Not necessary inside an APRS packet.
-       */
-      base91_encode(&pkt[6], pkt_base91, 174);
+      /* The last packet is always sent so the image is ended. */
+      uint16_t first = mcu_first;
+      mcu_first = mcu_last;
+      if(enc->delta && mcu_last < ssdv->mcu_count
+          && !image_mcus_changed(enc, first, mcu_last)) {
+        skipped++;
+        /* A burst is a run of packets for the redundant copy. */
+        if(burst_count > 0)
+          break;
+        burst_id = (early < enc->count) ? early : ssdv->packet_id;
+        continue;
+      }
 
-      packet_t packet = aprs_encode_data_packet(conf->call, conf->path,
-                                                'I', pkt_base91);
+      packet_t packet = encode_image_packet(conf, data, enc->data_size);
       if(packet == NULL) {
         TRACE_ERROR("IMG  > No available packet for image transmission");
         /* Error so release any linked packets. */
         if(head != NULL) {
           pktReleaseBufferChain(head);
         }
+        pclkRelease();
         return false;
       }
       if(previous != NULL)
@@ -999,20 +1529,38 @@ static bool transmit_image_packets(const uint8_t *image,
         head = packet;
       /* Now set new packet as previous. */
       previous = packet;
+      burst_count++;
     } /* End while(chain-- > 0) */
+    pclkRelease();
 
     /* If we have some image packet(s) to transmit then do it. */
     if(head != NULL) {
-      if(!transmitOnRadio(head,
-                          conf->radio_conf.freq,
-                          0,
-                          0,
-                          conf->radio_conf.pwr,
-                          conf->radio_conf.mod,
-                          conf->radio_conf.cca)) {
+      ax25_set_link(head, conf->radio_conf.link);
+      packet_airtime = budget_charge(BUDGET_IMAGE, head,
+                                     conf->radio_conf.mod,
+                                     conf->radio_conf.speed) / burst_count;
+      if(!transmitOnRadioAtSpeed(head,
+                                 conf->radio_conf.freq,
+                                 0,
+                                 0,
+                                 conf->radio_conf.pwr,
+                                 conf->radio_conf.mod,
+                                 conf->radio_conf.speed,
+                                 conf->radio_conf.cca,
+                                 TX_PRIO_BULK)) {
         TRACE_ERROR("IMG  > Unable to send image on radio");
         /* Transmit on radio will release the packet chain. */
       } else {
+        redundant_id = burst_id;
+        redundant_count = burst_count;
+        /* Adapt the next burst to the channel and buffer use. */
+        uint32_t busy = get_image_channel_busy(conf->radio_conf.freq);
+        if(busy != channel_busy || free < IMG_BURST_FREE_LOW)
+          burst = fmax(1, burst / 2);
+        else if(free >= IMG_BURST_FREE_HIGH && burst < limit)
+          burst++;
+        channel_busy = busy;
+        wdg_beat_self();
         // Packet spacing (delay)
         if(conf->svc_conf.send_spacing)
           chThdSleep(conf->svc_conf.send_spacing);
@@ -1021,14 +1569,34 @@ static bool transmit_image_packets(const uint8_t *image,
       chThdSleep(TIME_MS2I(10)); // Leave other threads some time
   } /* End while(c!= SSDV_EOI) */
 
+  if(skipped > 0)
+    TRACE_INFO("IMG  > %i unchanged packets not sent", skipped);
+
+  /* Send the last burst again. */
+  if(redundant && redundant_count > 0) {
+    if(!transmit_cached_packets(&cache, conf, redundant_id,
+                                redundant_count)) {
+      TRACE_ERROR("IMG  > Unable to send redundant image on radio");
+    }
+  }
+
   // Repeat packets
-  for(uint8_t i=0; i<16; i++) {
-    if(packetRepeats[i].n_done && image_id == packetRepeats[i].image_id) {
-      if(!transmit_image_packet(image, image_len, conf,
-                                image_id, packetRepeats[i].packet_id)) {
+  for(uint8_t i=0; i<IMG_REPEAT_SLOTS; i++) {
+    if(img_state.repeats[i].n_done && image_id == img_state.repeats[i].image_id) {
+      uint16_t packet_id = img_state.repeats[i].packet_id;
+      if(get_cached_image_packet(&cache, packet_id) != NULL) {
+        /* Cached packets are sent without encoding. */
+        if(!transmit_cached_packets(&cache, conf, packet_id, 1)) {
+          TRACE_ERROR("IMG  > Failed re-send of image %i", image_id);
+        } else {
+          clearRepeat(i);
+        }
+      } else if(!transmit_image_packet(image, image_len, conf,
+                                image_id, packet_id, enc->preview,
+                                enc->data_size, &enc->resume)) {
         TRACE_ERROR("IMG  > Failed re-send of image %i", image_id);
       } else {
-        packetRepeats[i].n_done = false; // Set done
+        clearRepeat(i);
       }
     }
     chThdSleep(TIME_MS2I(10)); // Leave other threads some time
@@ -1058,53 +1626,56 @@ static bool analyze_image(uint8_t *image, uint32_t image_len) {
 #endif
 
   ssdv_t ssdv;
-  uint8_t pkt[SSDV_PKT_SIZE];
-  uint8_t *b;
-  uint32_t bi = 0;
-  uint32_t i = 0;
-  uint8_t c = SSDV_OK;
 
+  /* Parse the whole image. Packets are not built. */
   ssdv_enc_init(&ssdv, SSDV_TYPE_NOFEC, "", 0, 7);
-  ssdv_enc_set_buffer(&ssdv, pkt);
-
-  while(++i < image_len) {
-    while((c = ssdv_enc_get_packet(&ssdv)) == SSDV_FEED_ME) {
-      b = &image[bi++];
-      if(bi > image_len) {
-        TRACE_ERROR("CAM  > Error in image (Premature end of file %d)", i);
-        return false;
-      }
-      ssdv_enc_feed(&ssdv, b, 1);
-    }
-
-    if(c == SSDV_EOI) // End of image
-      return true;
+  char c = ssdv_enc_validate(&ssdv, image, image_len);
+  if(c == SSDV_FEED_ME) {
+    TRACE_ERROR("CAM  > Error in image (Premature end of file %d)",
+                image_len);
+    return false;
+  }
+  if(c != SSDV_OK) {
+    TRACE_ERROR("CAM  > Error in image (ssdv_enc_validate failed: %d %d)",
+                c, ssdv.mcu_id);
+    return false;
+  }
+  return true;
+}
 
-    if(c != SSDV_OK) {
-      TRACE_ERROR("CAM  > Error in image (ssdv_enc_get_packet failed: %d %d)", c, i);
-      return false;
-    }
-    chThdSleep(TIME_MS2I(5));
-  } /* End while. */
-  return false;
+/*
+ * Standby time expired so switch the camera off.
+ */
+static void cam_standby_cb(void *arg) {
+  (void)arg;
+  chSysLockFromISR();
+  OV5640_switchOffI();
+  camInitialized = false;
+  chSysUnlockFromISR();
 }
 
 /**
  *
  */
 uint32_t takePicture(uint8_t* buffer, uint32_t size,
-                     resolution_t res, bool enableJpegValidation) {
+                     resolution_t res, bool enableJpegValidation,
+                     ov5640_segment_cb_t segment, void *arg) {
 	uint32_t size_sampled = 0;
 
 	// Initialize mutex
-	if(!camera_mtx_init)
+	if(!camera_mtx_init) {
 		chMtxObjectInit(&camera_mtx);
+		chVTObjectInit(&cam_standby_vt);
+	}
 	camera_mtx_init = true;
 
 	// Lock camera
 	TRACE_INFO("IMG  > Lock camera");
 	chMtxLock(&camera_mtx);
 
+	/* The camera stays on (or in standby) while held. */
+	chVTReset(&cam_standby_vt);
+
 	// Detect camera
 	if(camInitialized || OV5640_isAvailable()) { // OV5640 available
 
@@ -1116,6 +1687,9 @@ uint32_t takePicture(uint8_t* buffer, uint32_t size,
         if(!camInitialized) {
             OV5640_init();
             camInitialized = true;
+        } else {
+            /* Registers are kept in standby. */
+            OV5640_wakeup();
         }
 		do {
 			// Init camera
@@ -1124,7 +1698,9 @@ uint32_t takePicture(uint8_t* buffer, uint32_t size,
 				camInitialized = true;
 			}*/
 			// Sample data from pseudo DCMI through DMA into RAM
-			size_sampled = OV5640_Snapshot2RAM(buffer, size, res);
+			eprof_enter(EPROF_CAMERA);
+			size_sampled = OV5640_Snapshot2RAM(buffer, size, res, segment, arg);
+			eprof_leave(EPROF_CAMERA);
             if(size_sampled == 0)
                 continue;
 			// Switch off camera
@@ -1142,6 +1718,9 @@ uint32_t takePicture(uint8_t* buffer, uint32_t size,
 			} else {
 				jpegValid = true;
 			}
+			/* The next power up starts from the exposure of a good image. */
+			if(jpegValid)
+				OV5640_saveExposure();
 		} while(!jpegValid && cntr--);
 
 	} else { // Camera not found
@@ -1149,8 +1728,13 @@ uint32_t takePicture(uint8_t* buffer, uint32_t size,
 		camInitialized = false;
 		TRACE_ERROR("IMG  > No camera found");
 	}
-    // Switch off camera
-    if(!conf_sram.keep_cam_switched_on) {
+    // Switch off camera or hold it in standby for the next picture
+    if(conf_sram.keep_cam_switched_on) {
+        /* Camera stays on. */
+    } else if(camInitialized && conf_sram.cam_standby > 0) {
+        OV5640_standby();
+        chVTSet(&cam_standby_vt, conf_sram.cam_standby, cam_standby_cb, NULL);
+    } else {
         OV5640_deinit();
         camInitialized = false;
     }
@@ -1161,6 +1745,260 @@ uint32_t takePicture(uint8_t* buffer, uint32_t size,
 	return size_sampled;
 }
 
+/*
+ * Light level below which a frame is treated as dark and sent DC only.
+ * The value is the OV5640 light meter reading (0 disables the check).
+ */
+#define IMG_ADAPT_DARK_LIGHT    0
+
+/*
+ * Get the number of packets an image encodes to.
+ * Returns 0 if the image can not be encoded.
+ */
+static uint16_t estimate_image_packets(const uint8_t *image,
+                                       uint32_t image_len,
+                                       uint8_t quality, bool dc_only,
+                                       uint16_t data_size) {
+  ssdv_t ssdv;
+
+  ssdv_enc_init(&ssdv, SSDV_TYPE_PADDING, "", 0, quality);
+  ssdv_enc_set_payload(&ssdv, data_size - IMG_SSDV_HEADER_SIZE);
+  ssdv_enc_set_dc_only(&ssdv, dc_only);
+  if(ssdv_enc_validate(&ssdv, image, image_len) != SSDV_OK)
+    return 0;
+  return ssdv.packet_id;
+}
+
+/*
+ * Select the SSDV quality so the image fits the packet budget.
+ * The quality is lowered from the configured level until it fits.
+ * Returns false if the image only fits (or is only sent) as DC only.
+ */
+static bool select_image_quality(const uint8_t *image, uint32_t image_len,
+                                 const img_app_conf_t *conf,
+                                 uint16_t data_size, uint8_t *quality) {
+  *quality = conf->quality;
+#if IMG_ADAPT_DARK_LIGHT > 0
+  if(OV5640_getLastLightIntensity() < IMG_ADAPT_DARK_LIGHT) {
+    TRACE_INFO("IMG  > Dark image (light %d) sent DC only",
+               OV5640_getLastLightIntensity());
+    *quality = 0;
+    return false;
+  }
+#endif
+  int8_t q;
+  for(q = conf->quality; q >= 0; q--) {
+    uint16_t n = estimate_image_packets(image, image_len, q, false,
+                                        data_size);
+    if(n > 0 && n <= conf->max_packets) {
+      TRACE_INFO("IMG  > Quality %d selected for %d packets (budget %d)",
+                 q, n, conf->max_packets);
+      *quality = q;
+      return true;
+    }
+  }
+  *quality = 0;
+  TRACE_INFO("IMG  > Image over budget of %d packets sent DC only (%d)",
+             conf->max_packets,
+             estimate_image_packets(image, image_len, 0, true, data_size));
+  return false;
+}
+
+/*
+ * Reference image of delta images.
+ * The signature of each MCU is its mean luminance.
+ */
+typedef struct {
+  int8_t              *sig;
+  resolution_t        res;
+  uint16_t            mcu_count;
+  uint8_t             ref_id;
+  uint8_t             deltas;
+  bool                valid;
+} img_delta_t;
+
+/*
+ * Select if an image is sent as a delta of the reference image.
+ * The MCUs changed from the reference are marked for the encode.
+ * Otherwise the image becomes the reference.
+ * Returns true if the image is sent as a delta.
+ */
+static bool select_image_delta(img_delta_t *delta, const uint8_t *image,
+                               uint32_t image_len,
+                               const img_app_conf_t *conf,
+                               resolution_t res, uint8_t image_id,
+                               ssdv_encode_t *enc) {
+  ssdv_t ssdv;
+
+  enc->delta = false;
+  if(conf->delta == 0 || delta->sig == NULL) {
+    delta->valid = false;
+    return false;
+  }
+  if(delta->valid && delta->res == res
+      && delta->deltas < IMG_DELTA_REFRESH) {
+    ssdv_enc_init(&ssdv, SSDV_TYPE_PADDING, "", 0, enc->quality);
+    ssdv_enc_set_signatures(&ssdv, delta->sig, enc->changed,
+                            IMG_DELTA_MAX_MCUS, conf->delta);
+    if(ssdv_enc_validate(&ssdv, image, image_len) == SSDV_OK
+        && ssdv.mcu_count == delta->mcu_count) {
+      delta->deltas++;
+      enc->delta = true;
+      return true;
+    }
+  }
+  delta->valid = false;
+  ssdv_enc_init(&ssdv, SSDV_TYPE_PADDING, "", 0, enc->quality);
+  ssdv_enc_set_signatures(&ssdv, delta->sig, NULL, IMG_DELTA_MAX_MCUS, 0);
+  if(ssdv_enc_validate(&ssdv, image, image_len) != SSDV_OK)
+    return false;
+  delta->res = res;
+  delta->mcu_count = ssdv.mcu_count;
+  delta->ref_id = image_id;
+  delta->deltas = 0;
+  delta->valid = true;
+  return false;
+}
+
+/*
+ * Get the next lower resolution used when an image is over budget.
+ */
+static resolution_t get_lower_resolution(resolution_t res) {
+  switch(res) {
+  case RES_MAX:
+  case RES_UXGA:
+    return RES_XGA;
+  case RES_XGA:
+    return RES_VGA;
+  case RES_VGA_ZOOMED:
+  case RES_VGA:
+    return RES_QVGA;
+  default:
+    return RES_QQVGA;
+  }
+}
+
+/* The capture DMA only uses whole segments of the buffer. */
+#define IMG_CAPTURE_SIZE(n)     ((n) - ((n) % DMA_SEGMENT_SIZE))
+
+/*
+ * Payloads cached once the image is moved from the capture buffer.
+ * Enough for the redundant copy of a burst and for packet repeats.
+ */
+#define IMG_SSDV_CACHE_PACKETS  (2 * MAX_BUFFERS_FOR_BURST_SEND + 16)
+
+/* Buffer size for an image and its packet cache. */
+#define IMG_COMPACT_SIZE(n, d)  ((n) + sizeof(uint32_t)                      \
+                                 + IMG_SSDV_CACHE_PACKETS                    \
+                                 * IMG_SSDV_ENTRY_SIZE(d))
+
+/*
+ * Time a captured image is offered to the other image thread.
+ * An image thread due within this time of a capture at its resolution
+ * encodes a copy of that image instead of powering up the camera.
+ */
+#define IMG_SHARE_TIME          TIME_S2I(120)
+
+/*
+ * Image offered to the other image thread.
+ * The image is held by the thread that captured it until it is sent.
+ */
+typedef struct {
+  const uint8_t   *image;
+  uint32_t        len;
+  resolution_t    res;
+  systime_t       time;
+} img_share_t;
+
+static img_share_t img_share;
+static MUTEX_DECL(img_share_mtx);
+
+/*
+ * Get the image length to the last EOI marker.
+ * The DMA count includes any data the camera sends after the EOI.
+ */
+static uint32_t get_image_length(const uint8_t *image, uint32_t size) {
+  uint32_t n;
+  for(n = size; n >= 2; n--) {
+    if(image[n - 2] == 0xFF && image[n - 1] == 0xD9)
+      return n;
+  }
+  return size;
+}
+
+/*
+ * Move the image into a buffer sized for the image and the packet cache.
+ * The capture buffer is freed so the image region has room for the capture
+ * of another image thread while the image is sent.
+ * The capture buffer is kept if there is no memory for the move.
+ */
+static uint8_t *compact_image_buffer(uint8_t *buffer, uint32_t image_len,
+                                     uint32_t *buf_len, ssdv_encode_t *enc) {
+  uint32_t len = IMG_COMPACT_SIZE(image_len, enc->data_size);
+  if(len >= *buf_len)
+    return buffer;
+  uint8_t *image = mem_alloc(MEM_REGION_IMAGE, len, 0);
+  if(image == NULL) {
+    TRACE_WARN("IMG  > No memory to move image from capture buffer");
+    return buffer;
+  }
+  memcpy(image, buffer, image_len);
+  chHeapFree(buffer);
+  /* The encode started during capture continues on the moved image. */
+  if(enc->streamed)
+    ssdv_enc_move(&enc->ssdv, image);
+  TRACE_INFO("IMG  > Capture buffer of %d bytes reduced to %d bytes",
+             *buf_len, len);
+  *buf_len = len;
+  return image;
+}
+
+/*
+ * Offer a captured image to the other image thread.
+ */
+static void share_image(const uint8_t *image, uint32_t image_len,
+                        resolution_t res) {
+  chMtxLock(&img_share_mtx);
+  img_share.image = image;
+  img_share.len = image_len;
+  img_share.res = res;
+  img_share.time = chVTGetSystemTime();
+  chMtxUnlock(&img_share_mtx);
+}
+
+/*
+ * Withdraw the offer of an image before its buffer is freed.
+ */
+static void unshare_image(const uint8_t *image) {
+  chMtxLock(&img_share_mtx);
+  if(img_share.image == image)
+    img_share.image = NULL;
+  chMtxUnlock(&img_share_mtx);
+}
+
+/*
+ * Copy a recent image captured by the other image thread at the same
+ * resolution into a buffer sized for the image and the packet cache.
+ * Returns NULL if there is no such image or no memory for the copy.
+ */
+static uint8_t *get_shared_image(resolution_t res, uint16_t data_size,
+                                 uint32_t *buf_len, uint32_t *image_len) {
+  uint8_t *buffer = NULL;
+  chMtxLock(&img_share_mtx);
+  if(img_share.image != NULL && img_share.res == res
+      && chVTTimeElapsedSinceX(img_share.time) < IMG_SHARE_TIME) {
+    uint32_t len = IMG_COMPACT_SIZE(img_share.len, data_size);
+    buffer = mem_alloc(MEM_REGION_IMAGE, len, 0);
+    if(buffer != NULL) {
+      memcpy(buffer, img_share.image, img_share.len);
+      *buf_len = len;
+      *image_len = img_share.len;
+    }
+  }
+  chMtxUnlock(&img_share_mtx);
+  return buffer;
+}
+
 /**
  *
  */
@@ -1173,8 +2011,18 @@ THD_FUNCTION(imgThread, arg) {
   // Create buffer
   //uint8_t buffer[conf->buf_size] __attribute__((aligned(DMA_FIFO_BURST_ALIGN)));
 
+  /* The resolution is lowered when images are over the packet budget. */
+  resolution_t res = conf->res;
+  /* Signatures of the reference image for delta images. */
+  img_delta_t delta = {0};
   sysinterval_t time = chVTGetSystemTime();
+  /* Sending an image beats after each packet as it may take many cycles. */
+  wdg_beat_t beat;
+  wdg_register(&beat, chRegGetThreadNameX(chThdGetSelfX()),
+               conf->svc_conf.cycle);
   while(true) {
+    wdg_set_cycle(&beat, conf->svc_conf.cycle);
+    wdg_beat(&beat);
     char code_s[100];
     pktDisplayFrequencyCode(conf->radio_conf.freq,
                                               code_s, sizeof(code_s));
@@ -1185,10 +2033,32 @@ THD_FUNCTION(imgThread, arg) {
       chThdSleep(TIME_S2I(60));
       continue;
     }
-    uint32_t my_image_id = gimage_id++;
-    /* Create image capture buffer. */
-    uint8_t *buffer = chHeapAllocAligned(NULL, conf->buf_size,
-                                         DMA_FIFO_BURST_ALIGN);
+    if(!isTransmitAllowed(conf->radio_conf.mod)) {
+      /* Nothing can be sent in this zone so skip capture and encoding. */
+      TRACE_INFO("IMG  > Transmit not allowed in geofence zone");
+      time = waitForTrigger(time, conf->svc_conf.cycle);
+      continue;
+    }
+    uint32_t my_image_id = getNextImageId();
+    if(conf->delta > 0 && delta.sig == NULL)
+      delta.sig = mem_alloc(MEM_REGION_IMAGE, IMG_DELTA_MAX_MCUS, 0);
+    if(conf->max_packets == 0 || res > conf->res)
+      res = conf->res;
+    /* A recent capture by the other image thread saves powering the camera. */
+    uint32_t buf_len;
+    uint32_t size_sampled = 0;
+    uint16_t data_size = get_image_data_size(conf);
+    uint8_t *buffer = get_shared_image(res, data_size, &buf_len,
+                                       &size_sampled);
+    bool shared = buffer != NULL;
+    if(shared) {
+      TRACE_INFO("IMG  > Image %i copied from the other image thread",
+                 my_image_id);
+    } else {
+      /* Create image capture buffer. */
+      buf_len = IMG_CAPTURE_SIZE(conf->buf_size);
+      buffer = mem_alloc(MEM_REGION_IMAGE, buf_len, DMA_FIFO_BURST_ALIGN);
+    }
     if(buffer == NULL) {
       /* Could not get a capture buffer. */
       TRACE_WARN("IMG  > Unable to get capture buffer for image %i",
@@ -1199,6 +2069,26 @@ THD_FUNCTION(imgThread, arg) {
       time = waitForTrigger(time, conf->svc_conf.cycle);
       continue;
     }
+    /* Create the SSDV encoder which is run during capture. */
+    ssdv_encode_t *enc = mem_alloc(MEM_REGION_IMAGE, sizeof(ssdv_encode_t), 0);
+    if(enc == NULL) {
+      TRACE_WARN("IMG  > Unable to get SSDV encoder for image %i",
+                 my_image_id);
+      chHeapFree(buffer);
+      /* Allow time for other threads. */
+      chThdSleep(TIME_MS2I(10));
+      /* Try again at next run time. */
+      time = waitForTrigger(time, conf->svc_conf.cycle);
+      continue;
+    }
+    enc->image_id = (uint8_t)my_image_id;
+    enc->quality = conf->quality;
+    enc->capacity = buf_len;
+    enc->streamed = false;
+    enc->data_size = data_size;
+    enc->delta = false;
+    /* The capture is encoded as the preview first. */
+    enc->preview = conf->progressive;
     /*
      * History... compiler bug
      * If size is > 65535 the compiled code wraps address around and kills CMM heap.
@@ -1209,18 +2099,30 @@ THD_FUNCTION(imgThread, arg) {
     for(uint32_t i = 0; i < size ; i++)
         buffer[i] = 0;*/
     /* Take picture. */
-    uint32_t size_sampled = takePicture(buffer, conf->buf_size,
-                                        conf->res, true);
+    if(!shared) {
+      /* Capture, analysis and the encode during capture at full clock. */
+      pclkAcquire();
+      size_sampled = takePicture(buffer, buf_len,
+                                 res, true,
+                                 stream_image_segment, enc);
+      pclkRelease();
+    }
     /* Nothing captured? */
     if(size_sampled == 0) {
       TRACE_INFO("IMG  > Encode/Transmit SSDV (camera error) ID=%d",
                  my_image_id);
+      enc->streamed = false;
+      enc->preview = false;
+      /* Only the packet cache is needed. */
+      buffer = compact_image_buffer(buffer, 0, &buf_len, enc);
       if(!transmit_image_packets(noCameraFound, sizeof(noCameraFound),
-                                 conf, (uint8_t)(my_image_id))) {
+                                 conf, (uint8_t)(my_image_id),
+                                 buffer, buf_len, enc)) {
         TRACE_ERROR("IMG  > Error in encoding dummy image %i"
             " - discarded", my_image_id);
       }
-      /* Return the buffer to the heap. */
+      /* Return the buffers to the heap. */
+      chHeapFree(enc);
       chHeapFree(buffer);
       /* Allow time for other threads. */
       chThdSleep(TIME_MS2I(10));
@@ -1229,38 +2131,103 @@ THD_FUNCTION(imgThread, arg) {
       continue;
     }
 
+    if(!shared) {
+      /* Free capture buffer memory not needed by the image. */
+      size_sampled = get_image_length(buffer, size_sampled);
+      buffer = compact_image_buffer(buffer, size_sampled, &buf_len, enc);
+      share_image(buffer, size_sampled, res);
+    }
+
     /* Find SOI in image buffer. */
     uint32_t soi = 0;
     bool soi_found = false;
+    binary_semaphore_t archived;
+    bool archiving = false;
     while(soi < (size_sampled - 1)) {
       if(buffer[soi] == 0xFF && buffer[soi + 1] == 0xD8) {
         /* Found an SOI. */
         soi_found = true;
         TRACE_INFO("IMG  > SOI at index %i of buffer", soi);
-        /* Write to SD if present. */
-        if(initSD()) {
-          char filename[32];
-          // Write picture to SD card
+        /*
+         * Archive to SD if present.
+         * The write is done by the archive thread during transmission.
+         */
+        char filename[SD_ARCHIVE_NAME_LEN];
+        chsnprintf(filename, sizeof(filename), "r%02xi%04x.jpg",
+                   getLastDataPoint()->reset % 0xFF,
+                   (my_image_id) % 0xFFFF);
+        chBSemObjectInit(&archived, true);
+        /* A shared image has been archived by the thread that took it. */
+        if(!shared)
+          archiving = sdArchiveFile(filename, &buffer[soi],
+                                    size_sampled - soi, &archived);
+        if(archiving)
           TRACE_INFO("IMG  > Save image to SD card");
 
-          chsnprintf(filename, sizeof(filename), "r%02xi%04x.jpg",
-                     getLastDataPoint()->reset % 0xFF,
-                     (my_image_id) % 0xFFFF);
-
-          writeBufferToFile(filename, &buffer[soi], size_sampled - soi);
-        } /* End initSD() */
+        /* Fit the image to the packet budget. */
+        bool dc_only = false;
+        if(conf->max_packets > 0) {
+          uint8_t quality;
+          pclkAcquire();
+          dc_only = !select_image_quality(buffer, size_sampled, conf,
+                                          data_size, &quality);
+          pclkRelease();
+          if(quality != enc->quality || (dc_only && !enc->preview)) {
+            /* The encode done during capture is not used. */
+            enc->quality = quality;
+            enc->streamed = false;
+          }
+          if(dc_only) {
+            enc->preview = true;
+            /* Capture at lower resolution next time. */
+            if(quality == 0)
+              res = get_lower_resolution(res);
+          } else if(quality == conf->quality) {
+            res = conf->res;
+          }
+        }
 
-        /* Transmit on radio. */
-        if(conf->radio_conf.mod == MOD_2FSK && conf->redundantTx) {
-          TRACE_WARN("IMG  > Redundant TX disables 2FSK burst send mode");
+        /* A progressive image sends a DC only preview first. */
+        if(enc->preview) {
+          TRACE_INFO("IMG  > Encode/Transmit SSDV preview ID=%d",
+                     my_image_id);
+          if(!transmit_image_packets(buffer, size_sampled, conf,
+                                     (uint8_t)(my_image_id),
+                                     &buffer[size_sampled],
+                                     buf_len - size_sampled, enc)) {
+            TRACE_ERROR("IMG  > Error in encoding preview image"
+                " %i - discarded", my_image_id);
+          }
+          /* The full image follows as the next image ID. */
+          my_image_id = getNextImageId();
+          enc->streamed = false;
+          enc->preview = false;
         }
 
         /* Encode and transmit picture. */
-        TRACE_INFO("IMG  > Encode/Transmit SSDV ID=%d", my_image_id);
-        if(!transmit_image_packets(buffer, size_sampled, conf,
-                                   (uint8_t)(my_image_id))) {
-          TRACE_ERROR("IMG  > Error in encoding snapshot image"
-              " %i - discarded", my_image_id);
+        if(!dc_only) {
+          pclkAcquire();
+          bool is_delta = select_image_delta(&delta, buffer, size_sampled,
+                                             conf, res,
+                                             (uint8_t)(my_image_id), enc);
+          pclkRelease();
+          if(is_delta) {
+            TRACE_INFO("IMG  > Image %i sent as delta of image %i",
+                       my_image_id, delta.ref_id);
+            if(!transmit_image_reference(conf, (uint8_t)(my_image_id),
+                                         delta.ref_id)) {
+              TRACE_ERROR("IMG  > Unable to send reference of image %i",
+                          my_image_id);
+            }
+          }
+          TRACE_INFO("IMG  > Encode/Transmit SSDV ID=%d", my_image_id);
+          if(!transmit_image_packets(buffer, size_sampled, conf,
+                                     (uint8_t)(my_image_id),
+                                     &buffer[size_sampled],
+                                     buf_len - size_sampled, enc)) {
+            TRACE_ERROR("IMG  > Error in encoding snapshot image"
+                " %i - discarded", my_image_id);
+          }
         }
       break;
       } /* End if SOI in buffer. */
@@ -1269,7 +2236,12 @@ THD_FUNCTION(imgThread, arg) {
     if(!soi_found) { /* No SOI found. */
     TRACE_INFO("IMG  > No SOI found in image");
     }
-    /* Return the buffer to the heap. */
+    /* The image is written in place so wait for the archive. */
+    if(archiving)
+      chBSemWait(&archived);
+    /* Return the buffers to the heap. */
+    unshare_image(buffer);
+    chHeapFree(enc);
     chHeapFree(buffer);
     /* Allow minimum time for other threads. */
     chThdSleep(TIME_MS2I(10));
@@ -4,6 +4,7 @@
 #include "ch.h"
 #include "hal.h"
 #include "types.h"
+#include "ov5640.h"
 
 typedef struct {
 	uint16_t packet_id;
@@ -11,14 +12,22 @@ typedef struct {
 	bool n_done;
 } ssdv_packet_t;
 
-extern ssdv_packet_t packetRepeats[16];
+#define IMG_REPEAT_SLOTS	16
+
+/* Range of the SSDV bytes sent in a frame (img_app_conf_t ssdv_size). */
+#define IMG_SSDV_DATA_MIN	64
+#define IMG_SSDV_DATA_MAX	246
+
 extern bool reject_pri;
 extern bool reject_sec;
 
+void image_restore_state(void);
+bool image_add_repeat(uint8_t image_id, uint16_t packet_id);
 void start_image_thread(img_app_conf_t *conf);
-uint32_t takePicture(uint8_t* buffer, uint32_t size, resolution_t resolution, bool enableJpegValidation);
+uint32_t takePicture(uint8_t* buffer, uint32_t size, resolution_t resolution,
+                     bool enableJpegValidation,
+                     ov5640_segment_cb_t segment, void *arg);
 extern mutex_t camera_mtx;
-extern uint32_t gimage_id;
 
 #endif
 
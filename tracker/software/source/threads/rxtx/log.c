@@ -14,76 +14,294 @@
 #include "radio.h"
 #include "log.h"
 #include "pflash.h"
+#include "geofence.h"
+#include "scheduler.h"
+#include "budget.h"
+#include <string.h>
 
-static uint16_t log_id = 0;
+/*
+ * Downlink scheduler.
+ * Points are numbered by the flash log and a bitmap over the newest
+ * LOG_SCHED_WINDOW numbers marks the points sent. The newest point is sent
+ * after each density new points. Other cycles fill the gaps at halving
+ * intervals so each transmission adds to the ground record. Points in
+ * ranges acknowledged by the ground are not sent.
+ */
+typedef struct {
+	uint16_t	reset;
+	uint32_t	first;
+	uint32_t	last;
+} log_ack_t;
 
-static dataPoint_t* getNextLogDataPoint(uint8_t density)
+static log_iter_t log_iter;
+static uint32_t log_sent[LOG_SCHED_WINDOW / 32];
+static bool log_sched_started = false;
+static uint32_t log_sched_end;		// End of the log range at the last cycle
+static uint32_t log_track_end;		// End of the log range at the last newest point sent
+
+static log_ack_t log_acks[LOG_SCHED_ACKS];
+static uint8_t log_acks_used = 0;
+static uint8_t log_ack_next = 0;
+static MUTEX_DECL(log_ack_mtx);
+
+#define LOG_SENT_WORD(n)	log_sent[((n) % LOG_SCHED_WINDOW) / 32]
+#define LOG_SENT_BIT(n)		(1UL << ((n) % 32))
+
+static bool isLogPointSent(uint32_t n)
 {
-	// Determine sector
-	dataPoint_t *tp;
-	uint32_t i = 0;
-	do {
-		if((tp = flash_getLogBuffer(log_id))) {
-			log_id += density;
-		} else {
-			log_id = 0;
-			tp = flash_getLogBuffer(0);
-		}
-	} while(LOG_IS_EMPTY(tp) && i++ < LOG_FLASH_SIZE / sizeof(dataPoint_t));
+	return (LOG_SENT_WORD(n) & LOG_SENT_BIT(n)) != 0;
+}
 
-	return LOG_IS_EMPTY(tp) ? NULL : tp;
+static void setLogPointSent(uint32_t n, bool sent)
+{
+	if(sent)
+		LOG_SENT_WORD(n) |= LOG_SENT_BIT(n);
+	else
+		LOG_SENT_WORD(n) &= ~LOG_SENT_BIT(n);
+}
+
+/*
+ * Record a range of log points confirmed by the ground.
+ * The oldest range is replaced when the table is full.
+ */
+void logAcknowledgeRange(uint16_t reset, uint32_t first, uint32_t last)
+{
+	chMtxLock(&log_ack_mtx);
+	log_acks[log_ack_next].reset = reset;
+	log_acks[log_ack_next].first = first;
+	log_acks[log_ack_next].last = last;
+	log_ack_next = (log_ack_next + 1) % LOG_SCHED_ACKS;
+	if(log_acks_used < LOG_SCHED_ACKS)
+		log_acks_used++;
+	chMtxUnlock(&log_ack_mtx);
+}
+
+static bool isLogPointAcknowledged(dataPoint_t *tp)
+{
+	bool acked = false;
+	chMtxLock(&log_ack_mtx);
+	for(uint8_t i = 0; i < log_acks_used && !acked; i++) {
+		acked = log_acks[i].reset == tp->reset
+		    && tp->id >= log_acks[i].first && tp->id <= log_acks[i].last;
+	}
+	chMtxUnlock(&log_ack_mtx);
+	return acked;
 }
 
-THD_FUNCTION(logThread, arg)
+/*
+ * Select the number of the next point to send.
+ * Returns false if all points in the window have been sent.
+ */
+static bool getNextLogPointNumber(uint8_t density, uint32_t first,
+                                  uint32_t end, uint32_t *number)
 {
-	log_app_conf_t* conf = (log_app_conf_t*)arg;
-
-	if(conf->svc_conf.init_delay) chThdSleep(conf->svc_conf.init_delay);
-	TRACE_INFO("LOG  > Startup logging thread");
-
-	sysinterval_t time = chVTGetSystemTime();
-	while(true)
-	{
-		TRACE_INFO("LOG  > Do module LOG cycle");
-
-		if(!p_sleep(&conf->svc_conf.sleep_conf))
-		{
-			// Get log from memory
-			dataPoint_t *log = getNextLogDataPoint(conf->density);
-
-			if(log) {
-				// Encode Base91
-				uint8_t pkt_base91[BASE91LEN(sizeof(dataPoint_t))];
-				base91_encode((uint8_t*)log, pkt_base91, sizeof(dataPoint_t));
-				// Encode and transmit log packet
-				packet_t packet = aprs_encode_data_packet(conf->call, conf->path, 'L', pkt_base91); // Encode packet
-	            if(packet == NULL) {
-	              TRACE_WARN("LOG  > No free packet objects for log transmission");
-	            } else {
-				// Transmit packet
-                  transmitOnRadio(packet,
-                                  conf->radio_conf.freq,
-                                  0,
-                                  0,
-                                  conf->radio_conf.pwr,
-                                  conf->radio_conf.mod,
-                                  conf->radio_conf.cca);
-	            }
-			} else {
-				TRACE_INFO("LOG  > No log point in memory");
+	uint32_t lo = end > LOG_SCHED_WINDOW ? end - LOG_SCHED_WINDOW : 0;
+	if(lo < first)
+		lo = first;
+	if(end == lo)
+		return false;
+
+	// Newest point
+	if(!isLogPointSent(end - 1) && end - log_track_end >= density) {
+		log_track_end = end;
+		*number = end - 1;
+		return true;
+	}
+
+	// Fill gaps at halving intervals, newest first
+	for(uint32_t stride = LOG_SCHED_WINDOW / 2; stride > 0; stride /= 2) {
+		for(uint32_t n = (end - 1) / stride * stride; n >= lo; n -= stride) {
+			if(!isLogPointSent(n)) {
+				*number = n;
+				return true;
 			}
+			if(n < stride)
+				break;
 		}
+	}
+	return false;
+}
 
-		time = waitForTrigger(time, conf->svc_conf.cycle);
+/*
+ * Returns the next point to send or NULL if there is nothing new.
+ * The point and its number are marked sent.
+ * The point is valid until the next call.
+ */
+static dataPoint_t* getNextLogDataPoint(uint8_t density, uint32_t *number)
+{
+	uint32_t first, end;
+	flash_getLogRange(&first, &end);
+
+	if(!log_sched_started || end < log_sched_end) {
+		memset(log_sent, 0, sizeof(log_sent));
+		log_sched_end = end;
+		log_track_end = 0;
+		log_sched_started = true;
+	}
+
+	// Clear the bits taken by new points
+	uint32_t n = end - log_sched_end > LOG_SCHED_WINDOW
+	    ? end - LOG_SCHED_WINDOW : log_sched_end;
+	for(; n < end; n++)
+		setLogPointSent(n, false);
+	log_sched_end = end;
+
+	if(density == 0)
+		density = 1;
+
+	for(uint8_t i = 0; i < LOG_SCHED_TRIES; i++) {
+		if(!getNextLogPointNumber(density, first, end, number))
+			return NULL;
+		setLogPointSent(*number, true);
+		dataPoint_t *tp = flash_seekLogEntry(&log_iter, *number);
+		if(tp != NULL && !isLogPointAcknowledged(tp))
+			return tp;
 	}
+	return NULL;
 }
 
-void start_logging_thread(log_app_conf_t *conf)
+/*
+ * Encode as many points as fit into a multi point log packet.
+ * The records are those of the flash log. The first record is a keyframe
+ * and the others are deltas from the record before.
+ * Returns NULL if there is no point to send.
+ */
+static packet_t encodeLogFrame(log_app_conf_t *conf, uint8_t density)
 {
-	thread_t *th = chThdCreateFromHeap(NULL, THD_WORKING_AREA_SIZE(6*1024), "LOG", LOWPRIO, logThread, conf);
-	if(!th) {
-		// Print startup error, do not start watchdog for this thread
-		TRACE_ERROR("LOG  > Could not startup thread (not enough memory available)");
+	uint8_t data[LOG_FRAME_DATA_SIZE];
+	uint16_t len = 0;
+	uint8_t n = 0;
+	dataPoint_t prev;
+	dataPoint_t *tp;
+	uint32_t number;
+
+	while((tp = getNextLogDataPoint(density, &number)) != NULL) {
+		uint8_t rec[LOG_REC_MAX_SIZE];
+		uint16_t rec_len = flash_encodeLogRecord(rec, tp, &prev, n == 0) - rec;
+		if(len + rec_len > sizeof(data)) {
+			// Point is sent in the next packet
+			setLogPointSent(number, false);
+			break;
+		}
+		memcpy(&data[len], rec, rec_len);
+		len += rec_len;
+		prev = *tp;
+		n++;
+	}
+	if(n == 0)
+		return NULL;
+
+	TRACE_INFO("LOG  > Encode %d log points in %d bytes", n, len);
+	packet_t packet = aprs_encode_base91_packet(conf->call, conf->path, 'M',
+	                                            data, len);
+	if(packet == NULL)
+		TRACE_WARN("LOG  > No free packet objects for log transmission");
+	return packet;
+}
+
+/*
+ * Encode a burst of multi point log packets linked as a chain.
+ */
+static packet_t encodeLogBurst(log_app_conf_t *conf, uint8_t burst,
+                               uint8_t density)
+{
+	packet_t head = NULL;
+	packet_t previous = NULL;
+	for(uint8_t i = 0; i < burst; i++) {
+		packet_t packet = encodeLogFrame(conf, density);
+		if(packet == NULL)
+			break;
+		if(previous != NULL)
+			/* Link the next packet into the chain. */
+			previous->nextp = packet;
+		else
+			/* This is the first packet. */
+			head = packet;
+		previous = packet;
 	}
+	return head;
 }
 
+/*
+ * Encode a single point log packet.
+ */
+static packet_t encodeLogPacket(log_app_conf_t *conf, uint8_t density)
+{
+	uint32_t number;
+	dataPoint_t *log = getNextLogDataPoint(density, &number);
+	if(log == NULL)
+		return NULL;
+
+	// Encode Base91 log packet
+	packet_t packet = aprs_encode_base91_packet(conf->call, conf->path, 'L',
+	                                            (uint8_t*)log, sizeof(dataPoint_t));
+	if(packet == NULL)
+		TRACE_WARN("LOG  > No free packet objects for log transmission");
+	return packet;
+}
+
+static sched_job_t log_job;
+
+static void logJob(sched_job_t *job)
+{
+	log_app_conf_t* conf = (log_app_conf_t*)job->arg;
+
+	/* The cycle may have been changed by config. */
+	job->cycle = conf->svc_conf.cycle;
+	TRACE_INFO("LOG  > Do module LOG cycle");
+
+	if(p_sleep(&conf->svc_conf.sleep_conf)
+	    // Log points are kept while they can not be sent
+	    || !isTransmitAllowed(conf->radio_conf.mod))
+		return;
+
+	uint16_t level = budget_get_level();
+	if(level == 0 || budget_available(BUDGET_LOG) <= 0) {
+		TRACE_INFO("LOG  > Airtime budget used up");
+		return;
+	}
+
+	/*
+	 * The burst grows and the newest points are sent more densely when
+	 * there is surplus energy. Both shrink as the energy level drops.
+	 */
+	uint32_t density = (uint32_t)conf->density * 100 / level;
+	if(density < 1)
+		density = 1;
+	if(density > UINT8_MAX)
+		density = UINT8_MAX;
+
+	// Get log from memory
+	packet_t packet = conf->burst > 0
+	    ? encodeLogBurst(conf, budget_scale(conf->burst,
+	                                        MAX_BUFFERS_FOR_BURST_SEND),
+	                     density)
+	    : encodeLogPacket(conf, density);
+	if(packet == NULL) {
+		TRACE_INFO("LOG  > No unsent log point in memory");
+		return;
+	}
+
+	// Transmit packet
+	ax25_set_link(packet, conf->radio_conf.link);
+	budget_charge(BUDGET_LOG, packet, conf->radio_conf.mod, 0);
+	transmitOnRadio(packet,
+	                conf->radio_conf.freq,
+	                0,
+	                0,
+	                conf->radio_conf.pwr,
+	                conf->radio_conf.mod,
+	                conf->radio_conf.cca,
+	                TX_PRIO_BULK);
+}
+
+/*
+ * Add the log downlink to the scheduler.
+ */
+void start_logging_job(log_app_conf_t *conf)
+{
+	TRACE_INFO("LOG  > Startup logging");
+	sched_add(&log_job, "LOG", logJob, conf, conf->svc_conf.init_delay,
+			  conf->svc_conf.cycle);
+	sched_init();
+}
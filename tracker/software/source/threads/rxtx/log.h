@@ -3,7 +3,15 @@
 
 #include "collector.h"
 
-void start_logging_thread(log_app_conf_t *conf);
+#define LOG_SCHED_WINDOW		16384	/* Newest points tracked as sent (power of 2) */
+#define LOG_SCHED_ACKS			8		/* Acknowledged ranges held */
+#define LOG_SCHED_TRIES			16		/* Points checked per cycle */
+
+/* Records in a multi point log packet. Base91 of the data fills the frame. */
+#define LOG_FRAME_DATA_SIZE		400
+
+void start_logging_job(log_app_conf_t *conf);
+void logAcknowledgeRange(uint16_t reset, uint32_t first, uint32_t last);
 
 #endif
 
@@ -7,10 +7,36 @@
 #include "aprs.h"
 #include "pktconf.h"
 #include "radio.h"
+#include "kiss.h"
+#include "threads.h"
+#include "txlatency.h"
+#include "txpower.h"
+#include "memregion.h"
+#include "rfcapture.h"
 
-static void processPacket(uint8_t *buf, uint32_t len) {
+/* Size of the text of a traced packet. */
+#define RADIO_TRACE_SIZE  1024
 
-  if(len < 3) {
+/*
+ * Output a packet as text.
+ * The text is in a scratch buffer so the callback and TX stacks are not
+ * sized for it.
+ */
+static void tracePacket(packet_t pp, bool tx) {
+  MEM_SCRATCH(char, buf, RADIO_TRACE_SIZE);
+  if(buf == NULL)
+    return;
+  aprs_debug_getPacket(pp, buf, RADIO_TRACE_SIZE);
+  if(tx) {
+    TRACE_INFO("TX   > %s", buf);
+  } else {
+    TRACE_MON("RX   > %s", buf);
+  }
+}
+
+static void processPacket(pkt_data_object_t *pkt_buff) {
+
+  if(pkt_buff->packet_size < 3) {
     /*
      *  Incoming packet was too short.
      *  Don't yet have a general packet so nothing to do.
@@ -18,11 +44,15 @@ static void processPacket(uint8_t *buf, uint32_t len) {
     TRACE_INFO("RX    > Packet dropped due to data length < 2");
     return;
   }
-  /* Remove CRC from frame. */
-  len -= 2;
-
-  /* Decode APRS frame. */
-  packet_t pp = ax25_from_frame(buf, len);
+  /* Raw frame to a KISS host from the receive buffer (CRC removed). */
+  kiss_send_frame(pkt_buff->buffer, pkt_buff->packet_size - 2);
+#if PKT_RX_USE_PACKET_VIEW == TRUE
+  /* Decode APRS frame in place. Anything modifying it makes a copy. */
+  packet_t pp = pktGetDataBufferView(pkt_buff);
+#else
+  /* Decode APRS frame with CRC removed. */
+  packet_t pp = ax25_from_frame(pkt_buff->buffer, pkt_buff->packet_size - 2);
+#endif
 
   if(pp == NULL) {
     TRACE_INFO("RX   > Error in packet - dropped");
@@ -37,12 +67,14 @@ static void processPacket(uint8_t *buf, uint32_t len) {
     return;
   }
   /* Output packet as text. */
-  char serial_buf[512];
-  aprs_debug_getPacket(pp, serial_buf, sizeof(serial_buf));
-  TRACE_MON("RX   > %s", serial_buf);
+  if(TRACE_ACTIVE(TRACE_LEVEL_MON))
+    tracePacket(pp, false);
+  const pkt_quality_t *quality = &pkt_buff->quality;
+  TRACE_INFO("RX   > RSSI %d, tone level %d, PLL lock %d%%",
+             quality->rssi, quality->tone_level, quality->pll_lock);
 
   if(pp->num_addr > 0) {
-    aprs_decode_packet(pp);
+    aprs_decode_packet(pp, quality->rssi);
   }
   else {
     TRACE_INFO("RX   > No addresses in packet - dropped");
@@ -51,14 +83,18 @@ static void processPacket(uint8_t *buf, uint32_t len) {
 }
 
 void mapCallback(pkt_data_object_t *pkt_buff) {
-  /* Packet buffer. */
-  ax25char_t *frame_buffer = pkt_buff->buffer;
-  ax25size_t frame_size = pkt_buff->packet_size;
-
-  if(pktGetAX25FrameStatus(pkt_buff)) {
+  bool good = pktGetAX25FrameStatus(pkt_buff);
+#if PKT_RX_FIX_BITS == TRUE
+  bool fixed = !good && pktFixBufferBits(pkt_buff);
+#else
+  bool fixed = false;
+#endif
+  /* Frames with a bad CRC are captured too for the decode yield. */
+  cap_rx(pkt_buff, good || fixed, fixed);
+  if(good || fixed) {
 
   /* Perform the callback. */
-  processPacket(frame_buffer, frame_size);
+  processPacket(pkt_buff);
   } else {
     TRACE_INFO("RX   > Frame has bad CRC - dropped");
   }
@@ -68,7 +104,7 @@ void mapCallback(pkt_data_object_t *pkt_buff) {
  */
 void start_aprs_threads(radio_unit_t radio, radio_freq_t base_freq,
                      channel_hz_t step,
-                     radio_ch_t chan, radio_squelch_t rssi) {
+                     radio_ch_t chan, mod_t mod, radio_squelch_t rssi) {
 
     if(base_freq == FREQ_RX_APRS) {
       TRACE_ERROR("RX   > Cannot specify FREQ_RX_APRS for receiver");
@@ -79,7 +115,7 @@ void start_aprs_threads(radio_unit_t radio, radio_freq_t base_freq,
      * TODO: The parameter should be channel not step.
      */
     msg_t omsg = pktOpenRadioReceive(radio,
-                         MOD_AFSK,
+                         mod,
                          base_freq,
                          step);
 
@@ -100,12 +136,40 @@ void start_aprs_threads(radio_unit_t radio, radio_freq_t base_freq,
 }
 
 /*
- *
+ * Transmit at the default link speed for the modulation.
  */
 bool transmitOnRadio(packet_t pp, const radio_freq_t base_freq,
                      const channel_hz_t step, radio_ch_t chan,
                      const radio_pwr_t pwr, const mod_t mod,
-                     const radio_squelch_t cca) {
+                     const radio_squelch_t cca, const tx_priority_t prio) {
+  return transmitOnRadioAtSpeed(pp, base_freq, step, chan, pwr, mod, 0,
+                                cca, prio);
+}
+
+/*
+ * Transmit at a link speed.
+ * A speed of zero selects the default for the modulation.
+ * The speed only applies to 2FSK. AFSK is always 1200 baud.
+ */
+bool transmitOnRadioAtSpeed(packet_t pp, const radio_freq_t base_freq,
+                            const channel_hz_t step, radio_ch_t chan,
+                            const radio_pwr_t pwr, const mod_t mod,
+                            const link_speed_t speed,
+                            const radio_squelch_t cca,
+                            const tx_priority_t prio) {
+  /* Apply the transmit rules of the geofence zone before using a radio. */
+  const geofence_zone_t *zone = getGeofenceZone();
+  if(!zone->tx || !(zone->mod & GEOFENCE_MOD(mod))) {
+    TRACE_INFO("RAD  > Transmit of %s not allowed in geofence zone",
+               getModulation(mod));
+    pktReleaseBufferChain(pp);
+    return false;
+  }
+  radio_pwr_t tx_pwr = (pwr > zone->pwr) ? zone->pwr : pwr;
+  /* Step the power down while transmissions are heard. */
+  if(conf_sram.tx_pwr_ctrl)
+    tx_pwr = txpower_adjust(pp, tx_pwr);
+
   /* Select a radio by frequency. */
   radio_unit_t radio = pktSelectRadioForFrequency(base_freq,
                                                   step,
@@ -122,6 +186,8 @@ bool transmitOnRadio(packet_t pp, const radio_freq_t base_freq,
     return false;
   }
 
+  /* Sends made during startup wait for the radio bring-up. */
+  (void)boot_wait_ready(BOOT_RADIO, BOOT_RADIO_WAIT);
   if(!pktIsTransmitOpen(radio)) {
     TRACE_WARN( "RAD  > Transmit is not open on radio");
     pktReleaseBufferChain(pp);
@@ -154,13 +220,11 @@ bool transmitOnRadio(packet_t pp, const radio_freq_t base_freq,
         " PWR %d, %s, CCA %d, data %d",
         (pp->nextp != NULL) ? "Burst" : "Packet",
             op_freq/1000000, (op_freq%1000000)/1000,
-            chan, pwr, getModulation(mod), cca, len
+            chan, tx_pwr, getModulation(mod), cca, len
     );
 
-    /* TODO: Check size of buf. */
-    char buf[1024];
-    aprs_debug_getPacket(pp, buf, sizeof(buf));
-    TRACE_INFO("TX   > %s", buf);
+    if(TRACE_ACTIVE(TRACE_LEVEL_INFO))
+      tracePacket(pp, true);
 
     /* The service object. */
     packet_svc_t *handler = pktGetServiceObject(radio);
@@ -174,14 +238,23 @@ bool transmitOnRadio(packet_t pp, const radio_freq_t base_freq,
     rt.base_frequency = op_freq;
     rt.step_hz = step;
     rt.channel = chan;
-    rt.tx_power = pwr;
-    rt.tx_speed = (mod == MOD_2FSK ? 9600 : 1200);
+    rt.tx_power = tx_pwr;
+    if(mod == MOD_2FSK)
+      rt.tx_speed = (speed == 0) ? SI446X_2FSK_SPEED_DEFAULT : speed;
+    else
+      rt.tx_speed = 1200;
     rt.squelch = cca;
     rt.packet_out = pp;
+    rt.tx_priority = prio;
 
     /* Update the task mirror. */
     handler->radio_tx_config = rt;
 
+    txlat_mark(pp, TXLAT_SUBMIT, true);
+    systime_t now = chVTGetSystemTime();
+    packet_t np;
+    for(np = pp; np != NULL; np = np->nextp)
+      np->submitted = now;
     msg_t msg = pktSendRadioCommand(radio, &rt, NULL);
     if(msg != MSG_OK) {
       TRACE_ERROR("RAD  > Failed to post radio task");
@@ -20,10 +20,14 @@
 #define APRS_FREQ_BRAZIL			145575000
 
 void start_aprs_threads(radio_unit_t radio, radio_freq_t freq, channel_hz_t step,
-                     radio_ch_t chan, radio_squelch_t rssi);
+                     radio_ch_t chan, mod_t mod, radio_squelch_t rssi);
 bool transmitOnRadio(packet_t pp, radio_freq_t freq, channel_hz_t step,
                      radio_ch_t chan, radio_pwr_t pwr, mod_t mod,
-                     radio_squelch_t rssi);
+                     radio_squelch_t rssi, tx_priority_t prio);
+bool transmitOnRadioAtSpeed(packet_t pp, radio_freq_t freq, channel_hz_t step,
+                            radio_ch_t chan, radio_pwr_t pwr, mod_t mod,
+                            link_speed_t speed, radio_squelch_t rssi,
+                            tx_priority_t prio);
 
 inline const char *getModulation(uint8_t key) {
     const char *val[] = {"NONE", "AFSK", "2FSK"};
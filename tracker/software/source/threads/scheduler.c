@@ -0,0 +1,160 @@
+#include "ch.h"
+#include "hal.h"
+#include "debug.h"
+#include "watchdog.h"
+#include "scheduler.h"
+
+static sched_job_t *sched_list;
+static thread_t *sched_thd;
+static BSEMAPHORE_DECL(sched_wake, true);
+
+/*
+ * Time until a job is due. Negative if the due time has passed.
+ */
+static int32_t sched_until(systime_t now, const sched_job_t *job) {
+	return (int32_t)chTimeDiffX(now, job->due);
+}
+
+/*
+ * Insert a job by due time. Jobs due at the same time keep their order.
+ */
+static void sched_insertS(sched_job_t *job) {
+	systime_t now = chVTGetSystemTimeX();
+	int32_t until = sched_until(now, job);
+	sched_job_t **pp;
+	for(pp = &sched_list; *pp != NULL; pp = &(*pp)->next) {
+		if(sched_until(now, *pp) > until)
+			break;
+	}
+	job->next = *pp;
+	*pp = job;
+	job->queued = true;
+}
+
+/*
+ * Add a job which runs after the delay and then once per cycle.
+ */
+void sched_add(sched_job_t *job, const char *name, sched_func_t func,
+			   void *arg, sysinterval_t delay, sysinterval_t cycle) {
+	job->name = name;
+	job->func = func;
+	job->arg = arg;
+	job->cycle = cycle;
+	job->runs = 0;
+	chSysLock();
+	job->due = chVTGetSystemTimeX() + delay;
+	sched_insertS(job);
+	chBSemSignalI(&sched_wake);
+	chSchRescheduleS();
+	chSysUnlock();
+}
+
+/*
+ * Remove a job. A job which is running is not put back.
+ */
+void sched_remove(sched_job_t *job) {
+	chSysLock();
+	if(job->queued) {
+		sched_job_t **pp;
+		for(pp = &sched_list; *pp != NULL; pp = &(*pp)->next) {
+			if(*pp == job) {
+				*pp = job->next;
+				break;
+			}
+		}
+		job->queued = false;
+	}
+	job->cycle = 0;
+	chSysUnlock();
+}
+
+/*
+ * Take the jobs due within the batch window off the list once the first
+ * job is due. Returns NULL and the time to wait if no job is due.
+ */
+static sched_job_t *sched_take_batch(sysinterval_t *wait) {
+	sched_job_t *batch = NULL;
+	sched_job_t **tail = &batch;
+	chSysLock();
+	systime_t now = chVTGetSystemTimeX();
+	*wait = SCHED_MAX_WAIT;
+	if(sched_list != NULL && sched_until(now, sched_list) > 0) {
+		if(sched_until(now, sched_list) < (int32_t)SCHED_MAX_WAIT)
+			*wait = sched_until(now, sched_list);
+		chSysUnlock();
+		return NULL;
+	}
+	while(sched_list != NULL
+		  && sched_until(now, sched_list) <= (int32_t)SCHED_BATCH_WINDOW) {
+		sched_job_t *job = sched_list;
+		sched_list = job->next;
+		job->next = NULL;
+		job->queued = false;
+		*tail = job;
+		tail = &job->next;
+	}
+	chSysUnlock();
+	return batch;
+}
+
+/*
+ * Put a job back one cycle after its last due time.
+ * Cycles which passed while the system was busy are skipped.
+ */
+static void sched_requeue(sched_job_t *job) {
+	chSysLock();
+	if(job->cycle != 0 && !job->queued) {
+		systime_t now = chVTGetSystemTimeX();
+		job->due += job->cycle;
+		if(sched_until(now, job) < 0)
+			job->due = now + job->cycle;
+		sched_insertS(job);
+	}
+	chSysUnlock();
+}
+
+THD_FUNCTION(schedThread, arg) {
+	(void)arg;
+
+	wdg_beat_t beat;
+	wdg_register(&beat, "SCHED", SCHED_MAX_WAIT);
+	while(true) {
+		wdg_beat(&beat);
+
+		sysinterval_t wait;
+		sched_job_t *job = sched_take_batch(&wait);
+		if(job == NULL) {
+			wdg_set_cycle(&beat, wait);
+			(void)chBSemWaitTimeout(&sched_wake, wait);
+			continue;
+		}
+
+		if(job->next != NULL)
+			TRACE_INFO("SCHD > Run jobs due within %d s together",
+					   chTimeI2S(SCHED_BATCH_WINDOW));
+		while(job != NULL) {
+			sched_job_t *next = job->next;
+			job->next = NULL;
+			job->runs++;
+			job->func(job);
+			wdg_beat(&beat);
+			sched_requeue(job);
+			job = next;
+		}
+	}
+}
+
+/*
+ * Start the scheduler thread. Jobs may be added before.
+ */
+void sched_init(void) {
+	if(sched_thd != NULL)
+		return;
+	TRACE_INFO("SCHD > Startup scheduler thread");
+	sched_thd = chThdCreateFromHeap(NULL, THD_WORKING_AREA_SIZE(SCHED_WA_SIZE),
+									"SCHED", LOWPRIO, schedThread, NULL);
+	if(!sched_thd) {
+		// Print startup error, do not start watchdog for this thread
+		TRACE_ERROR("SCHD > Could not startup thread (not enough memory available)");
+	}
+}
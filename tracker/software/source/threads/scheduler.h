@@ -0,0 +1,39 @@
+#ifndef __SCHEDULER_H__
+#define __SCHEDULER_H__
+
+#include "ch.h"
+#include "hal.h"
+
+#define SCHED_WA_SIZE			(6 * 1024)		/* Jobs run on the scheduler stack */
+#define SCHED_BATCH_WINDOW		TIME_S2I(30)	/* Jobs due within the window run together */
+#define SCHED_MAX_WAIT			TIME_S2I(600)	/* Longest wait between heartbeats */
+
+typedef struct sched_job sched_job_t;
+typedef void (*sched_func_t)(sched_job_t *job);
+
+/*
+ * Periodic job run by the scheduler thread.
+ * Jobs are kept in a list ordered by the time they are due. When the
+ * first job is due all jobs due within SCHED_BATCH_WINDOW run one after
+ * the other. Their transmissions are queued together so the radio sends
+ * them in one session.
+ * A job must not block for long as it delays the jobs after it.
+ * The job may change its cycle while it runs. A cycle of zero runs once.
+ */
+struct sched_job {
+	const char		*name;
+	sched_job_t		*next;
+	sched_func_t	func;
+	void			*arg;
+	systime_t		due;
+	sysinterval_t	cycle;
+	uint32_t		runs;
+	bool			queued;
+};
+
+void sched_init(void);
+void sched_add(sched_job_t *job, const char *name, sched_func_t func,
+			   void *arg, sysinterval_t delay, sysinterval_t cycle);
+void sched_remove(sched_job_t *job);
+
+#endif
@@ -13,25 +13,106 @@
 #include "radio.h"
 #include "ax25_pad.h"
 #include "flash.h"
+#include "sd.h"
+#include "padc.h"
+#include "aprs.h"
+#include "aprsmsg.h"
+#include "confstore.h"
+#include "threads.h"
+#include "debug.h"
 
 sysinterval_t watchdog_tracking;
 
+/*
+ * Startup runs as a set of stages which complete independently.
+ * A module waits only for the stages it needs, e.g. a beacon for the radio
+ * and the last data point, instead of the whole startup.
+ */
+static eventflags_t boot_stages;
+static _THREADS_QUEUE_DECL(boot_waiters);
+
+void boot_set_ready(eventflags_t stages)
+{
+	chSysLock();
+	boot_stages |= stages;
+	chThdDequeueAllI(&boot_waiters, MSG_OK);
+	chSchRescheduleS();
+	chSysUnlock();
+}
+
+/*
+ * Wait until all stages are complete.
+ * Returns false if the stages did not complete within the timeout.
+ */
+bool boot_wait_ready(eventflags_t stages, sysinterval_t timeout)
+{
+	systime_t start = chVTGetSystemTime();
+	chSysLock();
+	while((boot_stages & stages) != stages) {
+		sysinterval_t waited = chTimeDiffX(start, chVTGetSystemTimeX());
+		if(timeout != TIME_INFINITE && waited >= timeout) {
+			chSysUnlock();
+			return false;
+		}
+		(void)chThdEnqueueTimeoutS(&boot_waiters, timeout == TIME_INFINITE
+								   ? TIME_INFINITE : timeout - waited);
+	}
+	chSysUnlock();
+	return true;
+}
+
+/*
+ * Create a packet radio service for each radio on the board.
+ * Each radio has its own ICU and decoder so they receive concurrently.
+ */
+static THD_FUNCTION(radioStartThread, arg) {
+	(void)arg;
+
+	const radio_config_t *list = pktGetRadioList();
+	for(uint8_t i = 0; list[i].unit != PKT_RADIO_NONE; i++) {
+		radio_unit_t radio = list[i].unit;
+		while(!pktServiceCreate(radio)) {
+			TRACE_ERROR("MAIN > Unable to create packet radio %d services",
+						radio);
+			chThdSleep(TIME_S2I(10));
+		}
+
+		TRACE_INFO("MAIN > Started packet radio service for radio %d",
+				   radio);
+	}
+	boot_set_ready(BOOT_RADIO);
+	pktThdTerminateSelf();
+}
+
+void start_radio_services(void)
+{
+	thread_t *th = chThdCreateFromHeap(NULL, THD_WORKING_AREA_SIZE(1024),
+									   "RSTART", NORMALPRIO, radioStartThread,
+									   NULL);
+	chDbgAssert(th != NULL, "unable to start radio services");
+	(void)th;
+}
+
 void start_essential_threads(void)
 {
 	init_watchdog();				// Init watchdog
 	pac1720_init();					// Initialize current measurement
-	chThdSleep(TIME_MS2I(300));		// Wait for tracking manager to initialize
+	initADC();						// Start continuous voltage sampling
+	sdArchiveStart();				// Start SD card archive writer
 }
 
 void start_user_threads(void) {
-	// Copy 
-	memcpy(&conf_sram, &conf_flash_default, sizeof(conf_t));
+	// Load the stored config or the default
+	conf_store_load();
+
+	// Continue with the image IDs and repeat requests kept over a reset
+	image_restore_state();
 
-	/* TODO: Implement scheduler that will run threads based on schedule. */
+	/* Periodic beacons and the log run as jobs of the scheduler. */
 	if(conf_sram.pos_pri.beacon.active)
-	  start_beacon_thread(&conf_sram.pos_pri, "POS1");
+	  start_beacon_job(&conf_sram.pos_pri, "POS1");
 	if(conf_sram.pos_sec.beacon.active)
-	  start_beacon_thread(&conf_sram.pos_sec, "POS2");
+	  start_beacon_job(&conf_sram.pos_sec, "POS2");
 
 	if(conf_sram.img_pri.svc_conf.active)
 	  start_image_thread(&conf_sram.img_pri);
@@ -39,21 +120,39 @@ void start_user_threads(void) {
 	  start_image_thread(&conf_sram.img_sec);
 
 	if(conf_sram.log.svc_conf.active)
-	  start_logging_thread(&conf_sram.log);
+	  start_logging_job(&conf_sram.log);
 
     if(conf_sram.aprs.rx.svc_conf.active
         && conf_sram.aprs.digi
         && conf_sram.aprs.tx.beacon.active) {
-      start_beacon_thread(&conf_sram.aprs.tx, "BCN");
+      start_beacon_job(&conf_sram.aprs.tx, "BCN");
     }
 
 	if(conf_sram.aprs.rx.svc_conf.active) {
 	  chThdSleep(conf_sram.aprs.rx.svc_conf.init_delay);
+	  if(!boot_wait_ready(BOOT_RADIO, BOOT_RADIO_WAIT))
+	    TRACE_ERROR("MAIN > Radio not ready for receive");
+	  aprs_start_command_thread();
+	  aprs_msg_start();
 	  start_aprs_threads(PKT_RADIO_1,
 	                  conf_sram.aprs.rx.radio_conf.freq,
 	                  0,
 	                  0,
+	                  conf_sram.aprs.rx.radio_conf.mod,
 	                  conf_sram.aprs.rx.radio_conf.rssi);
+	  /*
+	   * A second radio receives command and control concurrently.
+	   * If it is the transmit offload radio (PKT_TX_OFFLOAD_RADIO) its
+	   * receive pauses for sends while radio 1 receives continuously.
+	   */
+	  if(pktGetNumRadios() > 1) {
+	    start_aprs_threads(PKT_RADIO_2,
+	                    FREQ_RX_CMDC,
+	                    0,
+	                    0,
+	                    MOD_AFSK,
+	                    conf_sram.aprs.rx.radio_conf.rssi);
+	  }
 	}
 }
 
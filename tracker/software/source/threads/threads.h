@@ -3,6 +3,16 @@
 
 #include "ch.h"
 
+/* Startup stages. Modules which depend on a stage wait for it. */
+#define BOOT_RADIO				EVENT_MASK(0)	/* Packet radio services created */
+#define BOOT_LOG				EVENT_MASK(1)	/* Last data point read from the log */
+
+#define BOOT_RADIO_WAIT			TIME_S2I(30)
+#define BOOT_LOG_WAIT			TIME_S2I(30)
+
+void boot_set_ready(eventflags_t stages);
+bool boot_wait_ready(eventflags_t stages, sysinterval_t timeout);
+void start_radio_services(void);
 void start_essential_threads(void);
 void start_user_threads(void);
 void pktThdTerminateSelf(void);
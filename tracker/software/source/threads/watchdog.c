@@ -2,6 +2,9 @@
 #include "hal.h"
 #include "debug.h"
 #include "portab.h"
+#include "sleep.h"
+#include "watchdog.h"
+#include <string.h>
 
 #ifndef DISABLE_HW_WATCHDOG
 // Hardware Watchdog configuration
@@ -11,40 +14,161 @@ static const WDGConfig wdgcfg = {
 };
 #endif
 
+static wdg_beat_t *wdg_list;
+static bool wdg_recovery;
+
 static void flash_led(void) {
 	palSetLine(LINE_IO_GREEN);
 	chThdSleep(TIME_MS2I(50));
 	palClearLine(LINE_IO_GREEN);
 }
 
+/*
+ * Add a heartbeat to the registry. The cycle starts now.
+ */
+void wdg_register(wdg_beat_t *b, const char *name, sysinterval_t cycle) {
+	memset(b, 0, sizeof(*b));
+	b->name = name;
+	b->thread = chThdGetSelfX();
+	b->cycle = cycle;
+	b->last = chVTGetSystemTime();
+	chSysLock();
+	b->next = wdg_list;
+	wdg_list = b;
+	chSysUnlock();
+}
+
+/*
+ * Remove a heartbeat before its thread terminates.
+ */
+void wdg_unregister(wdg_beat_t *b) {
+	chSysLock();
+	wdg_beat_t **pp;
+	for(pp = &wdg_list; *pp != NULL; pp = &(*pp)->next) {
+		if(*pp == b) {
+			*pp = b->next;
+			break;
+		}
+	}
+	chSysUnlock();
+}
+
+void wdg_beat(wdg_beat_t *b) {
+	chSysLock();
+	systime_t now = chVTGetSystemTimeX();
+	sysinterval_t since = chTimeDiffX(b->last, now);
+	if(since > b->cycle) {
+		b->late++;
+		if(since - b->cycle > b->late_max)
+			b->late_max = since - b->cycle;
+	}
+	b->last = now;
+	b->beats++;
+	b->missed = 0;
+	chSysUnlock();
+}
+
+/*
+ * Beat for the calling thread if it registered a heartbeat.
+ */
+void wdg_beat_self(void) {
+	thread_t *self = chThdGetSelfX();
+	wdg_beat_t *b;
+	chSysLock();
+	for(b = wdg_list; b != NULL && b->thread != self; b = b->next)
+		;
+	chSysUnlock();
+	if(b != NULL)
+		wdg_beat(b);
+}
+
+/*
+ * Change the cycle, for example after a config change.
+ */
+void wdg_set_cycle(wdg_beat_t *b, sysinterval_t cycle) {
+	chSysLock();
+	b->cycle = cycle;
+	chSysUnlock();
+}
+
+/*
+ * The system waits for the hardware watchdog reset.
+ * Stop mode must not reset the hardware watchdog then.
+ */
+bool wdg_recovering(void) {
+	return wdg_recovery;
+}
+
+wdg_beat_t *wdg_first(void) {
+	return wdg_list;
+}
+
+void wdg_get(const wdg_beat_t *b, wdg_beat_t *copy) {
+	chSysLock();
+	*copy = *b;
+	chSysUnlock();
+}
+
+/*
+ * Check the deadlines of all heartbeats.
+ * Returns false if a thread missed WDG_MAX_MISSES deadlines in a row.
+ */
+static bool wdg_check(void) {
+	bool healthy = true;
+	chSysLock();
+	systime_t now = chVTGetSystemTimeX();
+	for(wdg_beat_t *b = wdg_list; b != NULL; b = b->next) {
+		sysinterval_t margin = b->cycle > WDG_MIN_MARGIN ? b->cycle : WDG_MIN_MARGIN;
+		sysinterval_t since = chTimeDiffX(b->last, now);
+		/* Deadline n is at the cycle and n margins after the latest beat. */
+		if(since <= b->cycle + margin * (b->missed + 1))
+			continue;
+		b->missed++;
+		b->misses++;
+		if(b->missed >= WDG_MAX_MISSES)
+			healthy = false;
+		const char *name = b->name;
+		uint8_t missed = b->missed;
+		chSysUnlock();
+		TRACE_ERROR("WDG  > Thread %s missed deadline %d, no heartbeat for %d s",
+					name, missed, chTimeI2S(since));
+		chSysLock();
+	}
+	chSysUnlock();
+	return healthy;
+}
+
 THD_FUNCTION(wdgThread, arg) {
 	(void)arg;
 
 	// Setup LED
 	palSetLineMode(LINE_IO_GREEN, PAL_MODE_OUTPUT_PUSHPULL);
 
+	// Stop mode resets the hardware watchdog itself
+	allowLateWakeup();
+
 	uint8_t counter = 0;
 	while(true)
 	{
-		chThdSleep(TIME_MS2I(500));
-
-		bool healthy = true;
-		// FIXME: Watchdog without functionality at the moment
+		chThdSleep(WDG_CHECK_TIME);
 
-		/*for(uint8_t i=0; i<threads_cnt; i++) {
-			if(registered_threads[i]->wdg_timeout < chVTGetSystemTime())
-			{
-				TRACE_ERROR("WDG  > Thread %s not healty", registered_threads[i]->name);
-				healthy = false; // Threads reached timeout
-			}
-		}*/
+		/*
+		 * A thread which missed too many deadlines is taken as hung.
+		 * The hardware watchdog is no longer reset so it resets the
+		 * system. This does not change once it has started.
+		 */
+		if(!wdg_recovery && !wdg_check()) {
+			TRACE_ERROR("WDG  > Thread hung, system reset by hardware watchdog");
+			wdg_recovery = true;
+		}
+		bool healthy = !wdg_recovery;
 
 		if(healthy)
 #ifndef DISABLE_HW_WATCHDOG
 			wdgReset(&WDGD1);	// Reset hardware watchdog at no error
 #endif
 		// Switch LEDs
-		if(counter++ % (4*healthy) == 0)
+		if(counter++ % (healthy ? 4 : 1) == 0)
 		{
 			flash_led();
 		}
@@ -1,7 +1,42 @@
 #ifndef __WATCHDOG_H__
 #define __WATCHDOG_H__
 
+#include "ch.h"
+#include "hal.h"
+
+#define WDG_CHECK_TIME			TIME_MS2I(500)	/* Heartbeat check and hardware watchdog reset */
+#define WDG_MIN_MARGIN			TIME_S2I(60)	/* Least time a heartbeat may be overdue */
+#define WDG_MAX_MISSES			3				/* Missed deadlines in a row before recovery */
+
+/*
+ * Heartbeat of a thread.
+ * A thread declares the cycle of its loop and beats once per cycle.
+ * A deadline is missed when no beat came within the cycle and a margin.
+ * The margin is the cycle but at least WDG_MIN_MARGIN.
+ * Long running work may beat in between with wdg_beat_self().
+ */
+typedef struct wdg_beat {
+	const char		*name;
+	struct wdg_beat	*next;
+	thread_t		*thread;	/* Thread which registered the heartbeat */
+	sysinterval_t	cycle;
+	systime_t		last;		/* Time of the latest beat */
+	uint32_t		beats;
+	uint32_t		late;		/* Beats which came after the cycle */
+	sysinterval_t	late_max;	/* Largest lateness of a beat */
+	uint32_t		misses;		/* Missed deadlines in total */
+	uint8_t			missed;		/* Missed deadlines since the latest beat */
+} wdg_beat_t;
+
 void init_watchdog(void);
+void wdg_register(wdg_beat_t *b, const char *name, sysinterval_t cycle);
+void wdg_unregister(wdg_beat_t *b);
+void wdg_beat(wdg_beat_t *b);
+void wdg_beat_self(void);
+void wdg_set_cycle(wdg_beat_t *b, sysinterval_t cycle);
+wdg_beat_t *wdg_first(void);
+void wdg_get(const wdg_beat_t *b, wdg_beat_t *copy);
+bool wdg_recovering(void);
 
 #endif
 
@@ -33,6 +33,7 @@
  */
 
 #include "base91.h"
+#include <string.h>
 
 static char b64_table[] = {'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H',
                                 'I', 'J', 'K', 'L', 'M', 'N', 'O', 'P',
@@ -54,12 +55,6 @@ const unsigned char b91_table[91] = {
 	'>', '?', '@', '[', ']', '^', '_', '`', '{', '-', '}', '~', '"'
 };
 
-typedef struct {
-	uint64_t queue;
-	uint64_t nbits;
-	uint32_t val;
-} base91_t;
-
 void base64_encode(const uint8_t *in, uint8_t *out, uint16_t input_length) {
 	uint32_t i,j;
 	for(i=0, j=0; i<input_length;) {
@@ -81,68 +76,50 @@ void base64_encode(const uint8_t *in, uint8_t *out, uint16_t input_length) {
 	out[BASE64LEN(input_length)] = '\0';
 }
 
-void basE91_init(base91_t *b)
-{
-	b->queue = 0;
-	b->nbits = 0;
-	b->val = -1;
-}
-
-size_t basE91_encode(base91_t *b, const void *i, size_t len, void *o)
-{
-	const uint8_t *ib = i;
-	uint8_t *ob = o;
-	size_t n = 0;
-
-	while (len--) {
-		b->queue |= *ib++ << b->nbits;
-		b->nbits += 8;
-		if (b->nbits > 13) {	/* enough bits in queue */
-			uint32_t val = b->queue & 8191;
-
-			if (val > 88) {
-				b->queue >>= 13;
-				b->nbits -= 13;
+/*
+ * Encode a block with the bit queue in 32 bits.
+ * At most 21 bits are queued so the queue can not overflow.
+ * No terminator is written. Returns the number of characters.
+ */
+size_t base91_encode_block(const uint8_t *in, uint8_t *out,
+                           uint16_t input_length) {
+	uint32_t queue = 0;
+	uint32_t nbits = 0;
+	uint8_t *ob = out;
+
+	while(input_length--) {
+		queue |= (uint32_t)*in++ << nbits;
+		nbits += 8;
+		if(nbits > 13) {	/* enough bits in queue */
+			uint32_t val = queue & 8191;
+
+			if(val > 88) {
+				queue >>= 13;
+				nbits -= 13;
 			} else {	/* we can take 14 bits */
-				val = b->queue & 16383;
-				b->queue >>= 14;
-				b->nbits -= 14;
+				val = queue & 16383;
+				queue >>= 14;
+				nbits -= 14;
 			}
-			ob[n++] = b91_table[val % 91];
-			ob[n++] = b91_table[val / 91];
+			*ob++ = b91_table[val % 91];
+			*ob++ = b91_table[val / 91];
 		}
 	}
 
-	return n;
-}
-
-size_t basE91_encode_end(base91_t *b, void *o)
-{
-	uint8_t *ob = o;
-	size_t n = 0;
-
-	if (b->nbits) {
-		ob[n++] = b91_table[b->queue % 91];
-		if (b->nbits > 7 || b->queue > 90)
-			ob[n++] = b91_table[b->queue / 91];
+	if(nbits) {
+		*ob++ = b91_table[queue % 91];
+		if(nbits > 7 || queue > 90)
+			*ob++ = b91_table[queue / 91];
 	}
-	b->queue = 0;
-	b->nbits = 0;
-	b->val = -1;
 
-	return n;
+	return ob - out;
 }
 
 size_t base91_encode(const uint8_t *in, uint8_t *out, uint16_t input_length) {
-	base91_t handle;
+	size_t ototal = base91_encode_block(in, out, input_length);
 
-	uint32_t ototal = 0;
-	for(uint32_t i=0; i<(uint32_t)BASE91LEN(input_length); i++)
-		out[i] = 0;
-
-	basE91_init(&handle);
-	ototal += basE91_encode(&handle, in, input_length, out);
-	ototal += basE91_encode_end(&handle, out + ototal);
+	/* Clear the rest of the output as a string terminator. */
+	if(ototal < (size_t)BASE91LEN(input_length))
+		memset(out + ototal, 0, BASE91LEN(input_length) - ototal);
 	return ototal;
 }
-
@@ -10,5 +10,7 @@
 
 void base64_encode(const uint8_t *in, uint8_t *out, uint16_t input_length);
 size_t base91_encode(const uint8_t *in, uint8_t *out, uint16_t input_length);
+size_t base91_encode_block(const uint8_t *in, uint8_t *out,
+                           uint16_t input_length);
 
 #endif
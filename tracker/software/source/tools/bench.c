@@ -0,0 +1,170 @@
+/**
+  * Micro-benchmarks of the kernels which run on every packet.
+  * Each workload is a fixed size call on data made up at start so the
+  * cycle counts only change with the code, compiler flags, memory
+  * placement and clock. The filter uses the decoder pre-filter settings
+  * and has its state in CCM as the decoder does.
+  */
+
+#include "ch.h"
+#include "hal.h"
+#include "pktconf.h"
+#include "ax25_pad.h"
+#include "base91.h"
+#include "rs8.h"
+#include "geofence.h"
+#include "bench.h"
+
+#define BENCH_DATA_SIZE		256
+#define BENCH_RS_DATA		223		// Data bytes of an RS(255,223) block
+#define BENCH_RS_PARITY		32
+#define BENCH_QFIR_OUT		(PRE_FILTER_BLOCK_SIZE / AFSK_DECODE_DECIMATION)
+
+typedef struct {
+	const char	*name;
+	uint32_t	size;
+	const char	*unit;
+	bool		(*setup)(void);
+	void		(*run)(void);
+	void		(*teardown)(void);
+} bench_workload_t;
+
+static uint8_t bench_data[BENCH_DATA_SIZE];
+static uint8_t bench_text[BASE91LEN(BENCH_DATA_SIZE) + 1];
+static uint8_t bench_parity[BENCH_RS_PARITY];
+static uint8_t bench_fifo[Si446x_FIFO_COMBINED_SIZE];
+static packet_t bench_packet;
+
+static qfir_filter_t bench_filter;
+static arm_fir_instance_q31 bench_fir useCCM;
+static q31_t bench_fir_coeff[PRE_FILTER_NUM_TAPS] useCCM;
+static q31_t bench_fir_state[PRE_FILTER_BLOCK_SIZE + PRE_FILTER_NUM_TAPS - 1] useCCM;
+static q31_t bench_fir_in[PRE_FILTER_BLOCK_SIZE] useCCM;
+static q31_t bench_fir_out[BENCH_QFIR_OUT] useCCM;
+
+/* A 32 sided polygon of about the size of a country. The point is inside. */
+static const coord_t bench_polygon[] = {
+	{525000000, 164000000}, {528901806, 163423558}, {532653669, 161716386},
+	{536111405, 158944088}, {539142136, 155213203}, {541629392, 150667107},
+	{543477591, 145480503}, {544615706, 139852710}, {545000000, 134000000},
+	{544615706, 128147290}, {543477591, 122519497}, {541629392, 117332893},
+	{539142136, 112786797}, {536111405, 109055912}, {532653669, 106283614},
+	{528901806, 104576442}, {525000000, 104000000}, {521098194, 104576442},
+	{517346331, 106283614}, {513888595, 109055912}, {510857864, 112786797},
+	{508370608, 117332893}, {506522409, 122519497}, {505384294, 128147290},
+	{505000000, 134000000}, {505384294, 139852710}, {506522409, 145480503},
+	{508370608, 150667107}, {510857864, 155213203}, {513888595, 158944088},
+	{517346331, 161716386}, {521098194, 163423558}
+};
+#define BENCH_POLYGON_SIZE	(sizeof(bench_polygon) / sizeof(bench_polygon[0]))
+
+static volatile uint32_t bench_sink;
+
+static bool bench_qfir_setup(void) {
+	float32_t coeff[PRE_FILTER_NUM_TAPS];
+	gen_fir_bpf((float32_t)PRE_FILTER_LOW / (float32_t)FILTER_SAMPLE_RATE,
+				(float32_t)PRE_FILTER_HIGH / (float32_t)FILTER_SAMPLE_RATE,
+				coeff, PRE_FILTER_NUM_TAPS, TD_WINDOW_NONE);
+	create_qfir_decimator(&bench_filter, &bench_fir, PRE_FILTER_NUM_TAPS,
+						  bench_fir_coeff, bench_fir_state,
+						  PRE_FILTER_BLOCK_SIZE, AFSK_DECODE_DECIMATION,
+						  coeff);
+	for(uint32_t i = 0; i < PRE_FILTER_BLOCK_SIZE; i++)
+		bench_fir_in[i] = (q31_t)((uint32_t)bench_data[i] << 24);
+	return true;
+}
+
+static void bench_qfir(void) {
+	apply_qfir_filter(&bench_filter, bench_fir_in, bench_fir_out);
+}
+
+static void bench_crc16(void) {
+	bench_sink = calc_crc16(bench_data, 0, BENCH_DATA_SIZE);
+}
+
+static void bench_base91(void) {
+	bench_sink = base91_encode(bench_data, bench_text, BENCH_DATA_SIZE);
+}
+
+static void bench_rs8(void) {
+	encode_rs_8(bench_data, bench_parity, 0);
+}
+
+static void bench_polygon_test(void) {
+	bench_sink = isPointInPolygon(bench_polygon, BENCH_POLYGON_SIZE,
+								  524000000, 134000000);
+}
+
+static bool bench_upsample_setup(void) {
+	char text[] = "N0CALL-11>APECAN,WIDE1-1:!5230.00N/01324.00EO"
+				  "000/000/A=030000 Bench frame for the AFSK up-sampler";
+	bench_packet = ax25_from_text(text, true);
+	return bench_packet != NULL;
+}
+
+static void bench_upsample(void) {
+	bench_sink = Si446x_upsampleAFSK(bench_packet, bench_fifo,
+									 sizeof(bench_fifo));
+}
+
+static void bench_upsample_teardown(void) {
+	ax25_delete(bench_packet);
+	bench_packet = NULL;
+}
+
+static const bench_workload_t workloads[] = {
+	{"qfir",     PRE_FILTER_BLOCK_SIZE, "samples", bench_qfir_setup, bench_qfir, NULL},
+	{"crc16",    BENCH_DATA_SIZE, "bytes", NULL, bench_crc16, NULL},
+	{"base91",   BENCH_DATA_SIZE, "bytes", NULL, bench_base91, NULL},
+	{"rs8",      BENCH_RS_DATA, "bytes", NULL, bench_rs8, NULL},
+	{"polygon",  BENCH_POLYGON_SIZE, "edges", NULL, bench_polygon_test, NULL},
+	{"upsample", 1, "frame", bench_upsample_setup, bench_upsample,
+				 bench_upsample_teardown}
+};
+
+uint8_t bench_count(void) {
+	return sizeof(workloads) / sizeof(workloads[0]);
+}
+
+/**
+  * Run a workload a number of times.
+  * Returns false if there is no such workload or it could not be set up.
+  */
+bool bench_run(uint8_t n, uint32_t calls, bench_result_t *r) {
+	if(n >= bench_count())
+		return false;
+	const bench_workload_t *w = &workloads[n];
+
+	/* Same data on every run. */
+	uint32_t seed = 1;
+	for(uint32_t i = 0; i < BENCH_DATA_SIZE; i++) {
+		seed = seed * 1103515245 + 12345;
+		bench_data[i] = seed >> 24;
+	}
+
+	r->name = w->name;
+	r->size = w->size;
+	r->unit = w->unit;
+	r->calls = 0;
+	r->min = UINT32_MAX;
+	r->max = 0;
+	r->total = 0;
+	if(w->setup != NULL && !w->setup())
+		return false;
+
+	for(uint32_t i = 0; i < calls; i++) {
+		rtcnt_t start = chSysGetRealtimeCounterX();
+		w->run();
+		uint32_t cycles = chSysGetRealtimeCounterX() - start;
+		if(cycles < r->min)
+			r->min = cycles;
+		if(cycles > r->max)
+			r->max = cycles;
+		r->total += cycles;
+		r->calls++;
+	}
+
+	if(w->teardown != NULL)
+		w->teardown();
+	return true;
+}
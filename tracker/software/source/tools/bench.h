@@ -0,0 +1,24 @@
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include "ch.h"
+#include "hal.h"
+
+/*
+ * Cycles of a workload. Each call is timed on its own with the realtime
+ * counter so the minimum is the time without interrupts.
+ */
+typedef struct {
+	const char	*name;
+	uint32_t	size;		// Units of work per call
+	const char	*unit;
+	uint32_t	calls;
+	uint32_t	min;
+	uint32_t	max;
+	uint64_t	total;
+} bench_result_t;
+
+uint8_t bench_count(void);
+bool bench_run(uint8_t n, uint32_t calls, bench_result_t *r);
+
+#endif
@@ -0,0 +1,129 @@
+/**
+  * Energy attribution to the activities of the tracker.
+  * Subsystems mark the time they are active. Each power sample of the
+  * PAC1720 covers the interval since the previous one. Its energy is
+  * shared by the time each state was current in the interval, so a short
+  * activity gets its part of a longer sample. The PAC1720 is sampled
+  * faster while an activity is running.
+  *
+  * The power spent is the solar power less the battery charging power.
+  */
+
+#include "ch.h"
+#include "hal.h"
+#include "eprof.h"
+
+static uint8_t eprof_active[EPROF_STATES];		// Nesting count per state
+static eprof_state_t eprof_current = EPROF_IDLE;
+static systime_t eprof_since;
+static sysinterval_t eprof_span[EPROF_STATES];	// Time in the state this sample
+static eprof_total_t eprof_totals[EPROF_STATES];
+
+static const char *eprof_names[] = {EPROF_STATE_NAMES};
+
+/*
+ * Switch to the highest active state.
+ * Must be called with the system locked.
+ */
+static void eprof_update(void) {
+	eprof_state_t top = EPROF_IDLE;
+	for(uint8_t s = EPROF_STATES - 1; s > EPROF_IDLE; s--) {
+		if(eprof_active[s] != 0) {
+			top = (eprof_state_t)s;
+			break;
+		}
+	}
+	if(top == eprof_current)
+		return;
+	systime_t now = chVTGetSystemTimeX();
+	eprof_span[eprof_current] += chTimeDiffX(eprof_since, now);
+	eprof_since = now;
+	eprof_current = top;
+}
+
+/**
+  * Mark the start of an activity. Calls nest.
+  * May be called from any context.
+  */
+void eprof_enter(eprof_state_t state) {
+	if(state <= EPROF_IDLE || state >= EPROF_STATES)
+		return;
+	syssts_t sts = chSysGetStatusAndLockX();
+	if(eprof_active[state] < UINT8_MAX)
+		eprof_active[state]++;
+	eprof_update();
+	chSysRestoreStatusX(sts);
+}
+
+/**
+  * Mark the end of an activity.
+  * May be called from any context.
+  */
+void eprof_leave(eprof_state_t state) {
+	if(state <= EPROF_IDLE || state >= EPROF_STATES)
+		return;
+	syssts_t sts = chSysGetStatusAndLockX();
+	if(eprof_active[state] != 0)
+		eprof_active[state]--;
+	eprof_update();
+	chSysRestoreStatusX(sts);
+}
+
+/**
+  * Returns true while any activity is running.
+  */
+bool eprof_busy(void) {
+	return eprof_current != EPROF_IDLE;
+}
+
+/**
+  * Attribute a power sample to the states of its interval.
+  * Power is in 0.1mW over the given milliseconds.
+  */
+void eprof_sample(int32_t power, uint32_t ms) {
+	if(power < 0)
+		power = 0;
+	sysinterval_t span[EPROF_STATES];
+	uint64_t sum = 0;
+
+	chSysLock();
+	systime_t now = chVTGetSystemTimeX();
+	eprof_span[eprof_current] += chTimeDiffX(eprof_since, now);
+	eprof_since = now;
+	for(uint8_t s = 0; s < EPROF_STATES; s++) {
+		span[s] = eprof_span[s];
+		eprof_span[s] = 0;
+		sum += span[s];
+	}
+	chSysUnlock();
+
+	/* No time has passed since the last sample. */
+	if(sum == 0)
+		return;
+	for(uint8_t s = 0; s < EPROF_STATES; s++) {
+		if(span[s] == 0)
+			continue;
+		uint64_t part = (uint64_t)ms * span[s] / sum;
+		eprof_totals[s].time += part;
+		eprof_totals[s].energy += (uint64_t)power * part / 1000;
+	}
+}
+
+void eprof_get(eprof_state_t state, eprof_total_t *total) {
+	chSysLock();
+	*total = eprof_totals[state];
+	chSysUnlock();
+}
+
+void eprof_reset(void) {
+	chSysLock();
+	for(uint8_t s = 0; s < EPROF_STATES; s++) {
+		eprof_totals[s].time = 0;
+		eprof_totals[s].energy = 0;
+	}
+	chSysUnlock();
+}
+
+const char *eprof_state_name(eprof_state_t state) {
+	return state < EPROF_STATES ? eprof_names[state] : "?";
+}
@@ -0,0 +1,43 @@
+#ifndef __EPROF_H__
+#define __EPROF_H__
+
+#include "ch.h"
+#include "hal.h"
+
+/*
+ * Activity states the power is attributed to.
+ * With several activities at once the highest state takes the power.
+ */
+typedef enum {
+	EPROF_IDLE = 0,
+	EPROF_GPS,			// GPS powered, acquiring or tracking
+	EPROF_RX,			// AFSK decoder processing a signal
+	EPROF_SSDV,			// SSDV encoding of an image
+	EPROF_CAMERA,		// Image capture
+	EPROF_TX_BULK,		// Transmitter in use by priority class
+	EPROF_TX_DIGIPEAT,
+	EPROF_TX_POSITION,
+	EPROF_TX_COMMAND,
+	EPROF_STATES
+} eprof_state_t;
+
+#define EPROF_STATE_NAMES	"idle", "gps", "rx", "ssdv", "camera", \
+							"tx bulk", "tx digi", "tx pos", "tx cmd"
+
+/* State of a transmit priority class (TX_PRIO_COMMAND is 0). */
+#define EPROF_TX(prio)		((eprof_state_t)(EPROF_TX_COMMAND - (prio)))
+
+typedef struct {
+	uint64_t	time;		// Milliseconds in the state
+	uint64_t	energy;		// Energy in 0.1mJ
+} eprof_total_t;
+
+void eprof_enter(eprof_state_t state);
+void eprof_leave(eprof_state_t state);
+bool eprof_busy(void);
+void eprof_sample(int32_t power, uint32_t ms);
+void eprof_get(eprof_state_t state, eprof_total_t *total);
+void eprof_reset(void);
+const char *eprof_state_name(eprof_state_t state);
+
+#endif
@@ -0,0 +1,118 @@
+/**
+  * Dead reckoning position estimator.
+  * The drift velocity is taken from the last GPS fixes and the altitude
+  * from the BME280 pressure trend since the last fix. The uncertainty of
+  * the prediction grows with the age of the fix, the change of the drift
+  * velocity between fixes and the altitude change through wind shear.
+  */
+
+#include "ch.h"
+#include "hal.h"
+#include "estimator.h"
+#include "bme280.h"
+#include <math.h>
+
+typedef struct {
+	uint32_t	time;		// Unix time of the fix
+	int32_t		lat;		// Latitude in deg*10000000
+	int32_t		lon;		// Longitude in deg*10000000
+	int32_t		alt;		// GPS altitude in m
+	int32_t		balt;		// Barometric altitude in cm (0: BME280 failed)
+} est_fix_t;
+
+static est_fix_t fixes[EST_FIXES];
+static uint8_t num_fixes;
+
+/**
+  * Barometric altitude of a data point.
+  * @return altitude in cm or 0 if the internal BME280 failed
+  */
+static int32_t getBaroAltitude(const dataPoint_t *tp) {
+	if(tp->sen_i1_press == 0
+			|| (tp->sys_error & BMEI1_STATUS_MASK) != (BME_OK_VALUE << BMEI1_STATUS_SHIFT))
+		return 0;
+	int32_t alt = BME280_getAltitude(P_0, tp->sen_i1_press);
+	return alt != 0 ? alt : 1;
+}
+
+/**
+  * Drift velocity between two fixes in m/s.
+  */
+static void getVelocity(const est_fix_t *f0, const est_fix_t *f1,
+                        float *vn, float *ve) {
+	float dt = (float)(f1->time - f0->time);
+	float coslat = cosf((float)f1->lat * 1e-7f * 3.14159265f / 180.0f);
+	*vn = (float)(f1->lat - f0->lat) * EST_M_PER_LAT / dt;
+	*ve = (float)(f1->lon - f0->lon) * EST_M_PER_LAT * coslat / dt;
+}
+
+/**
+  * Adds a GPS fix.
+  * Fixes at the same time as the last fix replace it.
+  */
+void est_addFix(const dataPoint_t *tp) {
+	if(num_fixes > 0 && fixes[num_fixes - 1].time >= tp->gps_time)
+		num_fixes--;
+	if(num_fixes == EST_FIXES) {
+		for(uint8_t i = 1; i < EST_FIXES; i++)
+			fixes[i - 1] = fixes[i];
+		num_fixes--;
+	}
+	est_fix_t *f = &fixes[num_fixes++];
+	f->time = tp->gps_time;
+	f->lat = tp->gps_lat;
+	f->lon = tp->gps_lon;
+	f->alt = tp->gps_alt;
+	f->balt = getBaroAltitude(tp);
+}
+
+/**
+  * Forgets all fixes.
+  */
+void est_reset(void) {
+	num_fixes = 0;
+}
+
+/**
+  * Predicts the position at the time of a data point.
+  * The time and pressure of the data point must be set.
+  * @param tp data point which gets the predicted position
+  * @param uncertainty radius of the predicted position in m
+  * @return true if a prediction could be made
+  */
+bool est_predict(dataPoint_t *tp, uint32_t *uncertainty) {
+	if(num_fixes < 2)
+		return false;
+
+	const est_fix_t *last = &fixes[num_fixes - 1];
+	if(tp->gps_time <= last->time || tp->gps_time - last->time > EST_MAX_AGE)
+		return false;
+	int32_t balt = getBaroAltitude(tp);
+	if(balt == 0 || last->balt == 0)
+		return false;
+	float dt = (float)(tp->gps_time - last->time);
+
+	float vn, ve;
+	getVelocity(&fixes[num_fixes - 2], last, &vn, &ve);
+
+	/* The drift error is the velocity change between the last fixes. */
+	float drift = EST_MIN_DRIFT;
+	if(num_fixes >= 3) {
+		float vn0, ve0;
+		getVelocity(&fixes[num_fixes - 3], &fixes[num_fixes - 2], &vn0, &ve0);
+		drift += sqrtf((vn - vn0) * (vn - vn0) + (ve - ve0) * (ve - ve0));
+	}
+
+	/* Altitude change since the fix from the pressure trend. */
+	int32_t dz = (balt - last->balt) / 100;
+
+	float coslat = cosf((float)last->lat * 1e-7f * 3.14159265f / 180.0f);
+	tp->gps_lat = last->lat + (int32_t)(vn * dt / EST_M_PER_LAT);
+	tp->gps_lon = last->lon + (int32_t)(ve * dt / (EST_M_PER_LAT * coslat));
+	tp->gps_alt = last->alt + dz;
+
+	*uncertainty = EST_FIX_ACC + (uint32_t)(drift * dt
+	             + EST_WIND_SHEAR * fabsf((float)dz) * dt);
+	return true;
+}
+
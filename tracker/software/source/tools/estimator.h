@@ -0,0 +1,22 @@
+#ifndef __ESTIMATOR_H__
+#define __ESTIMATOR_H__
+
+#include "ch.h"
+#include "hal.h"
+#include "collector.h"
+
+#define EST_FIXES				3			/* GPS fixes kept for the estimate */
+#define EST_FIX_ACC				10			/* Accuracy of a GPS fix in m */
+#define EST_MIN_DRIFT			1.0f		/* Minimum drift speed error in m/s */
+#define EST_WIND_SHEAR			0.005f		/* Wind change per m altitude in 1/s */
+#define EST_MAX_AGE				(60 * 30)	/* Maximum age of a prediction in s */
+
+/* Meters per deg*10000000 of latitude. */
+#define EST_M_PER_LAT			0.0111319f
+
+void est_addFix(const dataPoint_t *tp);
+bool est_predict(dataPoint_t *tp, uint32_t *uncertainty);
+void est_reset(void);
+
+#endif
+
@@ -0,0 +1,160 @@
+# Generates geofence_grid.h which holds the bounding boxes of the geofence
+# polygons and a coarse lat/lon grid used by getAPRSRegionFrequencyAt().
+#
+# Polygons are read from geofence.c. A grid cell which no polygon edge
+# enters has a fixed answer (a polygon or none). Other cells refer to the
+# set of polygons which still have to be tested.
+#
+# The polygon order must match the fences[] table in geofence.c.
+# Run again (make geofence) whenever the polygons are changed.
+
+import re
+import sys
+
+SOURCE = 'geofence.c'
+OUTPUT = 'geofence_grid.h'
+
+# In order of precedence, as in the fences[] table.
+POLYGONS = ['america', 'china', 'japan', 'southkorea', 'southeastAsia',
+			'australia', 'newzealand', 'newzealand2', 'argentina', 'brazil']
+
+CELL = 50000000			# 5 degrees in deg*10000000
+ROWS = 1800000000 // CELL
+COLS = 3600000000 // CELL
+MARGIN = 10000			# Cell grown by 0.001 degrees for the edge test
+MIXED = 0x80
+
+def read_polygons(path):
+	src = open(path).read()
+	polys = {}
+	for m in re.finditer(r'static const coord_t (\w+)\[\] = \{(.*?)\n\};', src, re.S):
+		pts = re.findall(r'\{\s*(-?\d+)\s*,\s*(-?\d+)\s*\}', m.group(2))
+		polys[m.group(1)] = [(int(a), int(b)) for a, b in pts]
+	return polys
+
+def in_polygon(poly, lat, lon):
+	# Same test as isPointInPolygon() in geofence.c.
+	c = False
+	j = len(poly) - 1
+	for i in range(len(poly)):
+		ilat, ilon = poly[i]
+		jlat, jlon = poly[j]
+		if (ilat <= lat) != (jlat <= lat):
+			dlat = jlat - ilat
+			cross = (jlon - ilon) * (lat - ilat)
+			point = (lon - ilon) * dlat
+			if (point < cross) if dlat > 0 else (point > cross):
+				c = not c
+		j = i
+	return c
+
+def edge_enters(a, b, lat0, lat1, lon0, lon1):
+	# Liang-Barsky clip of the edge a-b against the cell.
+	t0, t1 = 0.0, 1.0
+	dlat = b[0] - a[0]
+	dlon = b[1] - a[1]
+	for p, q in ((-dlat, a[0] - lat0), (dlat, lat1 - a[0]),
+				 (-dlon, a[1] - lon0), (dlon, lon1 - a[1])):
+		if p == 0:
+			if q < 0:
+				return False
+			continue
+		t = q / p
+		if p < 0:
+			t0 = max(t0, t)
+		else:
+			t1 = min(t1, t)
+		if t0 > t1:
+			return False
+	return True
+
+def classify(poly, lat0, lat1, lon0, lon1):
+	# Returns None if the boundary enters the cell else True if inside.
+	for i in range(len(poly)):
+		if edge_enters(poly[i - 1], poly[i], lat0 - MARGIN, lat1 + MARGIN,
+					   lon0 - MARGIN, lon1 + MARGIN):
+			return None
+	return in_polygon(poly, (lat0 + lat1) // 2, (lon0 + lon1) // 2)
+
+def main():
+	polys = read_polygons(SOURCE)
+	for name in POLYGONS:
+		if name not in polys:
+			sys.exit('Polygon %s not found in %s' % (name, SOURCE))
+
+	grid = []
+	masks = []
+	for row in range(ROWS):
+		lat0 = row * CELL - 900000000
+		cells = []
+		for col in range(COLS):
+			lon0 = col * CELL - 1800000000
+			mask = 0
+			answer = 0
+			for n, name in enumerate(POLYGONS):
+				inside = classify(polys[name], lat0, lat0 + CELL, lon0, lon0 + CELL)
+				if inside is None:
+					mask |= 1 << n
+				elif inside:
+					if mask == 0:
+						answer = n + 1
+					else:
+						mask |= 1 << n
+					break
+			if mask == 0:
+				cells.append(answer)
+			else:
+				if mask not in masks:
+					masks.append(mask)
+				cells.append(MIXED | masks.index(mask))
+		grid.append(cells)
+	if len(masks) >= MIXED:
+		sys.exit('Too many polygon sets (%d)' % len(masks))
+
+	f = open(OUTPUT, 'w')
+	f.write('/**\n'
+		' * @file    geofence_grid.h\n'
+		' * @brief   Bounding boxes and grid index of the geofence polygons.\n'
+		' * @note    Generated by gen_geofence_grid.py. Do not edit.\n'
+		' */\n\n'
+		'#ifndef __GEOFENCE_GRID_H__\n'
+		'#define __GEOFENCE_GRID_H__\n\n')
+	f.write('#define GEOFENCE_NUM_POLYGONS   %d\n' % len(POLYGONS))
+	f.write('#define GEOFENCE_GRID_CELL      %d\n' % CELL)
+	f.write('#define GEOFENCE_GRID_ROWS      %d\n' % ROWS)
+	f.write('#define GEOFENCE_GRID_COLS      %d\n' % COLS)
+	f.write('#define GEOFENCE_GRID_MIXED     0x%02X\n\n' % MIXED)
+	f.write('typedef struct {\n'
+		'\tint32_t lat_min;\n'
+		'\tint32_t lat_max;\n'
+		'\tint32_t lon_min;\n'
+		'\tint32_t lon_max;\n'
+		'} geofence_bbox_t;\n\n')
+	f.write('static const geofence_bbox_t geofence_bbox[GEOFENCE_NUM_POLYGONS] = {\n')
+	for name in POLYGONS:
+		lats = [p[0] for p in polys[name]]
+		lons = [p[1] for p in polys[name]]
+		f.write('\t{%11d, %11d, %11d, %11d}, // %s\n'
+				% (min(lats), max(lats), min(lons), max(lons), name))
+	f.write('};\n\n')
+	f.write('/* Polygons to test in a mixed cell, bit n is polygon n. */\n')
+	f.write('static const uint16_t geofence_mixed[] = {\n')
+	for i in range(0, len(masks), 8):
+		f.write('\t' + ', '.join('0x%03X' % m for m in masks[i:i + 8]) + ',\n')
+	f.write('};\n\n')
+	f.write('/*\n'
+		' * Rows from latitude -90 and columns from longitude -180.\n'
+		' * 0 is outside all polygons, n is inside polygon n-1 and\n'
+		' * GEOFENCE_GRID_MIXED is set for an index into geofence_mixed.\n'
+		' */\n')
+	f.write('static const uint8_t geofence_grid[GEOFENCE_GRID_ROWS][GEOFENCE_GRID_COLS] = {\n')
+	for row, cells in enumerate(grid):
+		f.write('\t{ // %d\n' % (row * CELL // 10000000 - 90))
+		for i in range(0, COLS, 18):
+			f.write('\t\t' + ','.join('0x%02X' % c for c in cells[i:i + 18]) + ',\n')
+		f.write('\t},\n')
+	f.write('};\n\n')
+	f.write('#endif /* __GEOFENCE_GRID_H__ */\n')
+
+if __name__ == '__main__':
+	main()
@@ -7,6 +7,7 @@
 #include "geofence.h"
 #include "collector.h"
 #include "config.h"
+#include <math.h>
 
 static const coord_t america[] = {
 	// Latitude  Longitude (in deg*10000000)
@@ -594,104 +595,238 @@ static const coord_t brazil[] = {
 	{-364801770, -452864430}
 };
 
+/*
+ * Transmit rules of the zones.
+ * A restricted zone is added as a polygon with GEOFENCE_ZONE() ahead of
+ * the frequency regions it lies in.
+ */
+static const geofence_zone_t zone_open = {true, GEOFENCE_PWR_MAX, GEOFENCE_MOD_ALL};
+
+/*
+ * Polygons in order of precedence.
+ * Same order as POLYGONS in gen_geofence_grid.py.
+ */
+typedef struct {
+	const coord_t *poly;
+	uint32_t size;
+	uint32_t freq;
+	const geofence_zone_t *zone;
+} geofence_t;
+
+#define GEOFENCE_ZONE(p, f, z) {p, sizeof(p)/sizeof(p[0]), f, z}
+#define GEOFENCE(p, f) GEOFENCE_ZONE(p, f, &zone_open)
+
+static const geofence_t fences[] = {
+	GEOFENCE(america, FREQ_APRS_AMERICA),				// America 144.390 MHz
+	GEOFENCE(china, FREQ_APRS_CHINA),					// China 144.640 MHz
+	GEOFENCE(japan, FREQ_APRS_JAPAN),					// Japan 144.660 MHz
+	GEOFENCE(southkorea, FREQ_APRS_SOUTHKOREA),			// Southkorea 144.620 MHz
+	GEOFENCE(southeastAsia, FREQ_APRS_SOUTHEASTASIA),	// Southeast Asia 144.390 MHz
+	GEOFENCE(australia, FREQ_APRS_AUSTRALIA),			// Australia 145.175 MHz
+	GEOFENCE(newzealand, FREQ_APRS_NEWZEALAND),			// New Zealand 144.575 MHz
+	GEOFENCE(newzealand2, FREQ_APRS_NEWZEALAND),
+	GEOFENCE(argentina, FREQ_APRS_ARGENTINA),			// Argentina/Paraguay/Uruguay 144.930 MHz
+	GEOFENCE(brazil, FREQ_APRS_BRAZIL)					// Brazil 145.575 MHz
+};
+
+#include "geofence_grid.h"
+
+/* Region of the last position. */
+static struct {
+	bool valid;
+	int32_t lat;
+	int32_t lon;
+	uint32_t dist;		// Distance to the nearest border in deg*10000000
+	const geofence_t *region;
+} region_cache;
+static MUTEX_DECL(region_mtx);
+
 // http://stackoverflowcom/questions/924171/geo-fencing-point-inside-outside-polygon
 /**
   * Determines is location is located in polygon
+  * The crossing of each edge is compared by cross multiplication so there
+  * is no division. Products are 64 bit as a longitude difference times a
+  * latitude difference does not fit in 32 bits.
   * @param poly Polygon
   * @param lat Latitude
   * @param lat Longitude
   */
-static bool isPointInPolygon(const coord_t *poly, uint32_t size, int32_t lat, int32_t lon) {
+bool isPointInPolygon(const coord_t *poly, uint32_t size, int32_t lat, int32_t lon) {
 	bool c = false;
-	uint32_t j = size-1;
+	const coord_t *pj = &poly[size-1];
 
 	for(uint32_t i=0; i<size; i++) {
-		if((((poly[i].lat <= lat) && (lat < poly[j].lat)) || ((poly[j].lat <= lat) && (lat < poly[i].lat))) && (lon < (poly[j].lon - poly[i].lon) * (lat - poly[i].lat) / (poly[j].lat - poly[i].lat) + poly[i].lon))
-			c = !c;
-		j = i;
+		const coord_t *pi = &poly[i];
+		if((pi->lat <= lat) != (pj->lat <= lat)) {
+			int32_t dlat = pj->lat - pi->lat;
+			int64_t cross = ((int64_t)pj->lon - pi->lon) * (lat - pi->lat);
+			int64_t point = ((int64_t)lon - pi->lon) * dlat;
+			if(dlat > 0 ? point < cross : point > cross)
+				c = !c;
+		}
+		pj = pi;
 	}
 
 	return c;
 }
 
 /**
-  * Determines location of GPS point.
-  * @param lat Latitude in deg*10000000
-  * @param lat Longitude in deg*10000000
+  * Determines if a location is in polygon n of the fences.
+  * The bounding box is checked before the polygon.
   */
-static bool isPointInAmerica(int32_t lat, int32_t lon) {
-	return isPointInPolygon(america, sizeof(america)/sizeof(america[0]), lat, lon);
-}
-static bool isPointInChina(int32_t lat, int32_t lon) {
-	return isPointInPolygon(china, sizeof(china)/sizeof(china[0]), lat, lon);
-}
-static bool isPointInJapan(int32_t lat, int32_t lon) {
-	return isPointInPolygon(japan, sizeof(japan)/sizeof(japan[0]), lat, lon);
-}
-static bool isPointInSouthkorea(int32_t lat, int32_t lon) {
-	return isPointInPolygon(southkorea, sizeof(southkorea)/sizeof(southkorea[0]), lat, lon);
-}
-static bool isPointInSoutheastAsia(int32_t lat, int32_t lon) {
-	return isPointInPolygon(southeastAsia, sizeof(southeastAsia)/sizeof(southeastAsia[0]), lat, lon);
-}
-static bool isPointInAustralia(int32_t lat, int32_t lon) {
-	return isPointInPolygon(australia, sizeof(australia)/sizeof(australia[0]), lat, lon);
+static bool isPointInFence(uint8_t n, int32_t lat, int32_t lon) {
+	const geofence_bbox_t *box = &geofence_bbox[n];
+	if(lat < box->lat_min || lat > box->lat_max
+			|| lon < box->lon_min || lon > box->lon_max)
+		return false;
+	return isPointInPolygon(fences[n].poly, fences[n].size, lat, lon);
 }
-static bool isPointInNewZealand(int32_t lat, int32_t lon) {
-	return isPointInPolygon(newzealand, sizeof(newzealand)/sizeof(newzealand[0]), lat, lon)
-		|| isPointInPolygon(newzealand2, sizeof(newzealand2)/sizeof(newzealand2[0]), lat, lon);
-}
-static bool isPointInArgentina(int32_t lat, int32_t lon) { // Also includes Uruguay and Paraguay
-	return isPointInPolygon(argentina, sizeof(argentina)/sizeof(argentina[0]), lat, lon);
-}
-static bool isPointInBrazil(int32_t lat, int32_t lon) {
-	return isPointInPolygon(brazil, sizeof(brazil)/sizeof(brazil[0]), lat, lon);
+
+/**
+  * Distance from a location to the edge a-b in deg*10000000.
+  */
+static float getEdgeDistance(const coord_t *a, const coord_t *b, int32_t lat, int32_t lon) {
+	float dy = (float)b->lat - a->lat;
+	float dx = (float)b->lon - a->lon;
+	float py = (float)lat - a->lat;
+	float px = (float)lon - a->lon;
+	float len = dx * dx + dy * dy;
+	float t = len == 0.0f ? 0.0f : (px * dx + py * dy) / len;
+	t = t < 0.0f ? 0.0f : t > 1.0f ? 1.0f : t;
+	px -= t * dx;
+	py -= t * dy;
+	return sqrtf(px * px + py * py);
 }
 
-uint32_t getAPRSRegionFrequency() {
-	dataPoint_t *point = getLastDataPoint();
+/**
+  * Returns the region of a position or NULL if it is in none.
+  * The grid cell of the position gives the region or the few polygons
+  * which have to be tested.
+  * Optionally returns a distance the position can move without leaving
+  * the region. That is the distance to the cell border or to the nearest
+  * edge of the polygons in the cell.
+  */
+static const geofence_t *getRegionAt(int32_t lat, int32_t lon, uint32_t *dist) {
+	int32_t row = ((int64_t)lat + 900000000) / GEOFENCE_GRID_CELL;
+	int32_t col = ((int64_t)lon + 1800000000) / GEOFENCE_GRID_CELL;
+	row = row < 0 ? 0 : row >= GEOFENCE_GRID_ROWS ? GEOFENCE_GRID_ROWS - 1 : row;
+	col = col < 0 ? 0 : col >= GEOFENCE_GRID_COLS ? GEOFENCE_GRID_COLS - 1 : col;
+
+	uint8_t cell = geofence_grid[row][col];
+	uint16_t mask = (cell & GEOFENCE_GRID_MIXED)
+			? geofence_mixed[cell & ~GEOFENCE_GRID_MIXED] : 0;
+	const geofence_t *region = NULL;
+	if(!(cell & GEOFENCE_GRID_MIXED) && cell != 0)
+		region = &fences[cell - 1];
+	for(uint8_t n = 0; n < GEOFENCE_NUM_POLYGONS && region == NULL; n++) {
+		if((mask & (1 << n)) && isPointInFence(n, lat, lon))
+			region = &fences[n];
+	}
+	if(dist == NULL)
+		return region;
 
+	int64_t lat0 = (int64_t)row * GEOFENCE_GRID_CELL - 900000000;
+	int64_t lon0 = (int64_t)col * GEOFENCE_GRID_CELL - 1800000000;
+	float d = lat - lat0;
+	d = fminf(d, lat0 + GEOFENCE_GRID_CELL - lat);
+	d = fminf(d, lon - lon0);
+	d = fminf(d, lon0 + GEOFENCE_GRID_CELL - lon);
+	for(uint8_t n = 0; n < GEOFENCE_NUM_POLYGONS; n++) {
+		if(!(mask & (1 << n)))
+			continue;
+		const coord_t *poly = fences[n].poly;
+		uint32_t j = fences[n].size - 1;
+		for(uint32_t i = 0; i < fences[n].size; i++) {
+			d = fminf(d, getEdgeDistance(&poly[j], &poly[i], lat, lon));
+			j = i;
+		}
+	}
+	*dist = d < 0.0f ? 0 : (uint32_t)d;
+	return region;
+}
+
+/**
+  * Returns the APRS frequency of the region of a position.
+  * @param lat Latitude in deg*10000000
+  * @param lon Longitude in deg*10000000
+  */
+uint32_t getAPRSRegionFrequencyAt(int32_t lat, int32_t lon) {
 	// Position unknown
-	if(point == NULL || (point->gps_lat == 0 && point->gps_lon == 0))
+	if(lat == 0 && lon == 0)
 	  // Return code and let pktradio figure out what to do.
 	  return FREQ_INVALID;
-	
-	// America 144.390 MHz
-	if(isPointInAmerica(point->gps_lat, point->gps_lon))
-		return FREQ_APRS_AMERICA;
-
-	// China 144.640 MHz
-	if(isPointInChina(point->gps_lat, point->gps_lon))
-		return FREQ_APRS_CHINA;
-
-	// Japan 144.660 MHz
-	if(isPointInJapan(point->gps_lat, point->gps_lon))
-		return FREQ_APRS_JAPAN;
 
-	// Southkorea 144.620 MHz
-	if(isPointInSouthkorea(point->gps_lat, point->gps_lon))
-		return FREQ_APRS_SOUTHKOREA;
-
-	// Southkorea 144.620 MHz
-	if(isPointInSoutheastAsia(point->gps_lat, point->gps_lon))
-		return FREQ_APRS_SOUTHEASTASIA;
+	const geofence_t *region = getRegionAt(lat, lon, NULL);
+	return region != NULL ? region->freq : FREQ_INVALID;
+}
 
-	// Australia 145.175 MHz
-	if(isPointInAustralia(point->gps_lat, point->gps_lon))
-		return FREQ_APRS_AUSTRALIA;
+/**
+  * Returns the region of the last position or NULL if it is in none.
+  * The region is cached with the distance to the nearest border and only
+  * looked up again once the position has moved further than that.
+  * A new region is taken when the position is GEOFENCE_HYSTERESIS inside
+  * it so the frequency does not flap when moving along a border.
+  */
+static const geofence_t *getRegion(void) {
+	dataPoint_t *point = getLastDataPoint();
 
-	// Australia 144.575 MHz
-	if(isPointInNewZealand(point->gps_lat, point->gps_lon))
-		return FREQ_APRS_NEWZEALAND;
+	// Position unknown
+	if(point == NULL || (point->gps_lat == 0 && point->gps_lon == 0))
+	  return NULL;
 
-	// Argentina/Paraguay/Uruguay 144.930 MHz
-	if(isPointInArgentina(point->gps_lat, point->gps_lon))
-		return FREQ_APRS_ARGENTINA;
+	int32_t lat = point->gps_lat;
+	int32_t lon = point->gps_lon;
+	chMtxLock(&region_mtx);
+	float dlat = (float)lat - region_cache.lat;
+	float dlon = (float)lon - region_cache.lon;
+	if(!region_cache.valid
+			|| sqrtf(dlat * dlat + dlon * dlon) >= region_cache.dist) {
+		uint32_t dist;
+		const geofence_t *region = getRegionAt(lat, lon, &dist);
+		if(!region_cache.valid || region == region_cache.region
+				|| (dist >= GEOFENCE_HYSTERESIS
+				|| (region == getRegionAt(lat + GEOFENCE_HYSTERESIS, lon, NULL)
+				&& region == getRegionAt(lat - GEOFENCE_HYSTERESIS, lon, NULL)
+				&& region == getRegionAt(lat, lon + GEOFENCE_HYSTERESIS, NULL)
+				&& region == getRegionAt(lat, lon - GEOFENCE_HYSTERESIS, NULL)))) {
+			region_cache.region = region;
+		} else if(dist < GEOFENCE_HYSTERESIS / 8) {
+			/* Keep the region until the position is far enough inside. */
+			dist = GEOFENCE_HYSTERESIS / 8;
+		}
+		region_cache.lat = lat;
+		region_cache.lon = lon;
+		region_cache.dist = dist;
+		region_cache.valid = true;
+	}
+	const geofence_t *region = region_cache.region;
+	chMtxUnlock(&region_mtx);
+	return region;
+}
 
-	// Brazil 145.575 MHz
-	if(isPointInBrazil(point->gps_lat, point->gps_lon))
-		return FREQ_APRS_BRAZIL;
+/**
+  * Returns the APRS frequency of the region of the last position.
+  */
+uint32_t getAPRSRegionFrequency() {
+	const geofence_t *region = getRegion();
+	return region != NULL ? region->freq : FREQ_INVALID;
+}
 
-	return FREQ_INVALID;
+/**
+  * Returns the transmit rules of the region of the last position.
+  * Transmission is not restricted while the position is unknown.
+  */
+const geofence_zone_t *getGeofenceZone(void) {
+	const geofence_t *region = getRegion();
+	return region != NULL ? region->zone : &zone_open;
 }
 
+/**
+  * Determines if a modulation may be transmitted at the last position.
+  * Threads check this before encoding so no work is done for packets
+  * which would be dropped anyway.
+  */
+bool isTransmitAllowed(mod_t mod) {
+	const geofence_zone_t *zone = getGeofenceZone();
+	return zone->tx && (zone->mod & GEOFENCE_MOD(mod));
+}
@@ -17,12 +17,33 @@
 #define FREQ_APRS_ARGENTINA			144930000
 #define FREQ_APRS_BRAZIL			145575000
 
+// Distance a position must be inside a new region before it is taken (deg*10000000)
+#define GEOFENCE_HYSTERESIS			500000
+
+// Modulation bits of a geofence zone
+#define GEOFENCE_MOD(m)				(1 << (m))
+#define GEOFENCE_MOD_ALL			(GEOFENCE_MOD(MOD_AFSK) | GEOFENCE_MOD(MOD_2FSK))
+
+// Power of a geofence zone without power limit
+#define GEOFENCE_PWR_MAX			0x7F
+
 typedef struct {
 	int32_t lat;
 	int32_t lon;
 } coord_t;
 
+/* Transmit rules of a geofence region. */
+typedef struct {
+	bool		tx;		// Transmission allowed
+	radio_pwr_t	pwr;	// Maximum power
+	uint8_t		mod;	// Allowed modulations (GEOFENCE_MOD bits)
+} geofence_zone_t;
+
 uint32_t getAPRSRegionFrequency(void);
+uint32_t getAPRSRegionFrequencyAt(int32_t lat, int32_t lon);
+const geofence_zone_t *getGeofenceZone(void);
+bool isTransmitAllowed(mod_t mod);
+bool isPointInPolygon(const coord_t *poly, uint32_t size, int32_t lat, int32_t lon);
 
 #endif
 
@@ -0,0 +1,282 @@
+/**
+  * RF loopback self-test of the two radios of a board.
+  * The sending radio transmits frames of stepped lengths at stepped power
+  * levels, one at a time. The receiving radio is opened on the same
+  * frequency with its own callback on the packet service so each frame
+  * passes the complete TX, RF and RX chain. A frame not received within
+  * LOOP_RX_TIMEOUT of its end on air is counted as lost.
+  *
+  * The end of a frame on air is taken from the TX test record of the
+  * Si446x driver. CPU use is the time not spent in the idle thread.
+  */
+
+#include "ch.h"
+#include "hal.h"
+#include "pktconf.h"
+#include "loopback.h"
+#include "config.h"
+#include "aprs.h"
+#include "radio.h"
+#include "geofence.h"
+#include "threadprof.h"
+#include "rfcapture.h"
+#include <string.h>
+
+static const uint16_t loop_lengths[] = {LOOP_LENGTHS};
+static const radio_pwr_t loop_powers[] = {LOOP_POWERS};
+
+_Static_assert(sizeof(loop_lengths) / sizeof(loop_lengths[0])
+			   == LOOP_NUM_LENGTHS, "LOOP_NUM_LENGTHS does not match");
+_Static_assert(sizeof(loop_powers) / sizeof(loop_powers[0])
+			   == LOOP_NUM_POWERS, "LOOP_NUM_POWERS does not match");
+
+static const char *loop_status_names[] = {LOOP_STATUS_NAMES};
+
+static BSEMAPHORE_DECL(loop_tx_sem, true);
+static BSEMAPHORE_DECL(loop_rx_sem, true);
+static si446x_tx_test_t loop_tx_test;
+
+/* Frame being waited for and the receive results. Set under lock. */
+static uint16_t loop_expect;
+static rtcnt_t loop_rx_time;
+static bool loop_rx_fixed;
+static loop_result_t *loop_result;
+
+/*
+ * Receive callback of the packet service.
+ */
+static void loop_rx(pkt_data_object_t *pkt_buff) {
+	rtcnt_t now = chSysGetRealtimeCounterX();
+	bool good = pktGetAX25FrameStatus(pkt_buff);
+#if PKT_RX_FIX_BITS == TRUE
+	bool fixed = !good && pktFixBufferBits(pkt_buff);
+#else
+	bool fixed = false;
+#endif
+	cap_rx(pkt_buff, good || fixed, fixed);
+	if(!good && !fixed) {
+		chSysLock();
+		loop_result->bad++;
+		chSysUnlock();
+		return;
+	}
+
+#if PKT_RX_USE_PACKET_VIEW == TRUE
+	packet_t pp = pktGetDataBufferView(pkt_buff);
+#else
+	packet_t pp = ax25_from_frame(pkt_buff->buffer, pkt_buff->packet_size - 2);
+#endif
+	if(pp == NULL)
+		return;
+	uint8_t *info;
+	uint32_t ilen = ax25_get_info(pp, &info);
+	bool test = ilen >= 5 && info[0] == '{' && info[1] == '{' && info[2] == 'T';
+	uint16_t seq = test ? (info[3] << 8) | info[4] : 0;
+	pktReleasePacketBuffer(pp);
+
+	chSysLock();
+	if(test && seq == loop_expect && loop_rx_time == 0) {
+		loop_rx_time = now;
+		loop_rx_fixed = fixed;
+		chBSemSignalI(&loop_rx_sem);
+		chSchRescheduleS();
+	} else {
+		loop_result->strays++;
+	}
+	chSysUnlock();
+}
+
+/*
+ * Radio task callback of a send.
+ */
+static void loop_tx_done(radio_task_object_t *rt) {
+	(void)rt;
+	chBSemSignal(&loop_tx_sem);
+}
+
+/*
+ * Send a test frame and wait for it to be received.
+ * The data is the sequence number followed by bytes which do not repeat.
+ */
+static loop_status_t loop_frame(loop_step_t *s, uint16_t seq) {
+	loop_result_t *r = loop_result;
+	uint8_t data[2 + 256];
+	uint16_t len = s->len <= sizeof(data) ? s->len : sizeof(data);
+	uint32_t seed = seq + 1;
+	uint16_t i;
+	data[0] = seq >> 8;
+	data[1] = seq;
+	for(i = 2; i < len; i++) {
+		seed = seed * 1103515245 + 12345;
+		data[i] = seed >> 24;
+	}
+	packet_t pp = aprs_encode_binary_packet(conf_sram.aprs.tx.call, "", 'T',
+											data, len);
+	if(pp == NULL)
+		return LOOP_NO_PACKET;
+
+	packet_svc_t *handler = pktGetServiceObject(r->tx);
+	radio_task_object_t rt = handler->radio_tx_config;
+	rt.handler = handler;
+	rt.command = PKT_RADIO_TX_SEND;
+	rt.type = r->mod;
+	rt.base_frequency = r->freq;
+	rt.step_hz = 0;
+	rt.channel = 0;
+	rt.tx_power = s->pwr;
+	rt.tx_speed = (r->mod == MOD_2FSK) ? SI446X_2FSK_SPEED_DEFAULT : 1200;
+	rt.squelch = PKT_SI446X_NO_CCA_RSSI;
+	rt.packet_out = pp;
+	rt.tx_priority = TX_PRIO_COMMAND;
+	handler->radio_tx_config = rt;
+	pp->submitted = chVTGetSystemTime();
+
+	chSysLock();
+	loop_expect = seq;
+	loop_rx_time = 0;
+	chBSemResetI(&loop_tx_sem, true);
+	chBSemResetI(&loop_rx_sem, true);
+	chSysUnlock();
+
+	Si446x_startTXTest();
+	if(pktSendRadioCommand(r->tx, &rt, loop_tx_done) != MSG_OK) {
+		Si446x_getTXTest(&loop_tx_test, true);
+		pktReleaseBufferChain(pp);
+		return LOOP_NO_TX;
+	}
+	s->sent++;
+	(void)chBSemWaitTimeout(&loop_tx_sem, LOOP_TX_TIMEOUT);
+	Si446x_getTXTest(&loop_tx_test, true);
+	if(chBSemWaitTimeout(&loop_rx_sem, LOOP_RX_TIMEOUT) != MSG_OK)
+		return LOOP_OK;
+
+	s->received++;
+	if(loop_rx_fixed)
+		s->fixed++;
+	if(loop_tx_test.done == 0)
+		return LOOP_OK;
+	si446x_tx_test_frame_t *f = &loop_tx_test.frame[0];
+	s->air_total += f->air_us;
+	/* The callback can run before the feeder sees the end. */
+	int32_t lat = (int32_t)(loop_rx_time - f->end);
+	uint32_t us = lat > 0 ? RTC2US(STM32_SYSCLK, (uint32_t)lat) : 0;
+	s->lat_total += us;
+	if(us > s->lat_max)
+		s->lat_max = us;
+	return LOOP_OK;
+}
+
+/*
+ * Cycles of the idle and decoder threads.
+ */
+static void loop_cycles(thread_t *decoder, uint64_t *idle, uint64_t *dec) {
+	threadprof_t p;
+	threadprof_get(chSysGetIdleThreadX(), &p);
+	*idle = p.cycles;
+	*dec = 0;
+	if(decoder != NULL) {
+		threadprof_get(decoder, &p);
+		*dec = p.cycles;
+	}
+}
+
+/**
+  * Run the loopback test from radio tx to the other radio.
+  * Receive which was running on the receiving radio is restarted with its
+  * settings after the test.
+  */
+loop_status_t loop_run(radio_unit_t tx, mod_t mod, uint16_t frames,
+					   loop_result_t *r) {
+	memset(r, 0, sizeof(*r));
+	r->tx = tx;
+	r->mod = mod;
+	if(pktGetNumRadios() < 2)
+		return LOOP_NO_RADIO;
+	r->rx = (tx == PKT_RADIO_1) ? PKT_RADIO_2 : PKT_RADIO_1;
+#if PKT_RX_USE_2FSK != TRUE
+	if(mod == MOD_2FSK)
+		return LOOP_NO_MOD;
+#endif
+	if(!pktIsTransmitOpen(tx))
+		return LOOP_NO_TX;
+
+	const geofence_zone_t *zone = getGeofenceZone();
+	if(!zone->tx || !(zone->mod & GEOFENCE_MOD(mod)))
+		return LOOP_NOT_ALLOWED;
+
+	r->freq = pktComputeOperatingFrequency(tx, conf_sram.aprs.tx.radio_conf.freq,
+										   0, 0, RADIO_TX);
+	if(r->freq == FREQ_INVALID
+	   || pktComputeOperatingFrequency(r->rx, r->freq, 0, 0, RADIO_RX)
+		  == FREQ_INVALID)
+		return LOOP_NO_FREQ;
+
+	/* Stop receive of the receiving radio keeping its settings. */
+	packet_svc_t *handler = pktGetServiceObject(r->rx);
+	radio_task_object_t saved = handler->radio_rx_config;
+	packet_state_t state = pktGetServiceState(r->rx);
+	bool restart = (state == PACKET_DECODE || state == PACKET_PAUSE);
+	if(restart) {
+		pktDisableDataReception(r->rx);
+		pktCloseRadioReceive(r->rx);
+	}
+	if(pktOpenRadioReceive(r->rx, mod, r->freq, 0) != MSG_OK) {
+		if(restart)
+			start_aprs_threads(r->rx, saved.base_frequency, saved.step_hz,
+							   saved.channel, saved.type, saved.squelch);
+		return LOOP_NO_RX;
+	}
+	loop_result = r;
+	if(pktEnableDataReception(r->rx, 0, conf_sram.aprs.rx.radio_conf.rssi,
+							  loop_rx) != MSG_OK) {
+		pktCloseRadioReceive(r->rx);
+		if(restart)
+			start_aprs_threads(r->rx, saved.base_frequency, saved.step_hz,
+							   saved.channel, saved.type, saved.squelch);
+		return LOOP_NO_RX;
+	}
+
+	AFSKDemodDriver *driver = (AFSKDemodDriver *)handler->link_controller;
+	thread_t *decoder = (driver != NULL) ? driver->decoder_thd : NULL;
+	uint64_t idle, dec;
+	loop_cycles(decoder, &idle, &dec);
+	systime_t start = chVTGetSystemTime();
+
+	loop_status_t status = LOOP_OK;
+	uint16_t seq = 0;
+	uint8_t p, l;
+	for(p = 0; p < LOOP_NUM_POWERS && status == LOOP_OK; p++) {
+		radio_pwr_t pwr = (loop_powers[p] > zone->pwr) ? zone->pwr
+			: loop_powers[p];
+		for(l = 0; l < LOOP_NUM_LENGTHS && status == LOOP_OK; l++) {
+			loop_step_t *s = &r->step[p * LOOP_NUM_LENGTHS + l];
+			s->pwr = pwr;
+			s->len = loop_lengths[l];
+			uint16_t n;
+			for(n = 0; n < frames && status == LOOP_OK; n++)
+				status = loop_frame(s, seq++);
+		}
+	}
+
+	r->time_ms = TIME_I2MS(chVTTimeElapsedSinceX(start));
+	uint64_t idle_end, dec_end;
+	loop_cycles(decoder, &idle_end, &dec_end);
+	uint64_t total = (uint64_t)r->time_ms * (STM32_SYSCLK / 1000);
+	if(total != 0) {
+		uint64_t busy = idle_end - idle;
+		busy = busy < total ? total - busy : 0;
+		r->cpu = busy * 1000 / total;
+		r->decoder = (dec_end - dec) * 1000 / total;
+	}
+
+	pktDisableDataReception(r->rx);
+	pktCloseRadioReceive(r->rx);
+	if(restart)
+		start_aprs_threads(r->rx, saved.base_frequency, saved.step_hz,
+						   saved.channel, saved.type, saved.squelch);
+	return status;
+}
+
+const char *loop_status_name(loop_status_t status) {
+	return loop_status_names[status];
+}
@@ -0,0 +1,72 @@
+#ifndef __LOOPBACK_H__
+#define __LOOPBACK_H__
+
+#include "ch.h"
+#include "hal.h"
+#include "pktconf.h"
+
+#define LOOP_FRAMES				5			/* Frames of each length and power */
+#define LOOP_FRAMES_MAX			50
+#define LOOP_LENGTHS			16, 64, 128, 256	/* Data bytes of the frames */
+#define LOOP_POWERS				0x04, 0x14, 0x7F	/* PA levels, lowest first */
+#define LOOP_TX_TIMEOUT			TIME_S2I(10)	/* Send of a frame to TX done */
+#define LOOP_RX_TIMEOUT			TIME_MS2I(500)	/* TX done to the frame received */
+
+#define LOOP_NUM_LENGTHS		4
+#define LOOP_NUM_POWERS			3
+
+/*
+ * RF loopback between the two radios of a board.
+ * One radio sends test frames which the other receives through the packet
+ * service. Receive of the receiving radio is stopped for the test and
+ * restarted after it.
+ */
+typedef enum {
+	LOOP_OK = 0,
+	LOOP_NO_RADIO,		// The board has a single radio
+	LOOP_NO_TX,			// Transmit is not open on the sending radio
+	LOOP_NO_RX,			// Receive could not be opened on the other radio
+	LOOP_NO_MOD,		// Modulation is not received (PKT_RX_USE_2FSK)
+	LOOP_NO_FREQ,		// Test frequency is not valid for a radio
+	LOOP_NOT_ALLOWED,	// Transmit not allowed in the geofence zone
+	LOOP_NO_PACKET		// No free packet objects
+} loop_status_t;
+
+#define LOOP_STATUS_NAMES	"ok", "single radio", "transmit not open", \
+							"receive not opened", "modulation not received", \
+							"invalid frequency", "not allowed in zone", \
+							"no free packets"
+
+/*
+ * Frames of one length at one power.
+ * Latency is from the end of the frame on air to its receive callback.
+ */
+typedef struct {
+	radio_pwr_t	pwr;
+	uint16_t	len;		// Data bytes of the frames
+	uint16_t	sent;
+	uint16_t	received;	// Frames with a good CRC, repaired ones included
+	uint16_t	fixed;		// Received after bit repair
+	uint32_t	lat_total;	// Microseconds
+	uint32_t	lat_max;
+	uint32_t	air_total;	// Microseconds on air of the frames sent
+} loop_step_t;
+
+typedef struct {
+	radio_unit_t	tx;
+	radio_unit_t	rx;
+	mod_t			mod;
+	radio_freq_t	freq;
+	loop_step_t		step[LOOP_NUM_POWERS * LOOP_NUM_LENGTHS];
+	uint32_t		bad;		// Frames with a bad CRC
+	uint32_t		strays;		// Good frames which are not the frame sent
+	uint32_t		time_ms;
+	uint16_t		cpu;		// CPU use in 0.1% of the test time
+	uint16_t		decoder;	// Share of it in the decoder thread
+} loop_result_t;
+
+loop_status_t loop_run(radio_unit_t tx, mod_t mod, uint16_t frames,
+					   loop_result_t *r);
+const char *loop_status_name(loop_status_t status);
+
+#endif
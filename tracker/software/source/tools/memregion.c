@@ -0,0 +1,180 @@
+/**
+  * Heap regions of the subsystems.
+  * Thread stacks of the packet system and the shell are created and
+  * released whenever reception is opened and closed or a console connects.
+  * Between them long living objects are allocated from the main heap so
+  * after some hours the large aligned image capture buffer no longer finds
+  * a hole. Each region is a heap of its own. The main heap is only used
+  * when a region is full, which is counted so the sizes can be tuned.
+  */
+
+#include "ch.h"
+#include "hal.h"
+#include "memregion.h"
+
+typedef struct {
+	const char		*name;
+	memory_heap_t	*heap;
+	size_t			size;
+	size_t			largest_min;
+	uint32_t		allocs;
+	uint32_t		fallbacks;
+	uint32_t		fails;
+} region_t;
+
+static CH_HEAP_AREA(mem_threads_area, MEM_THREADS_SIZE);
+static CH_HEAP_AREA(mem_image_area, MEM_IMAGE_SIZE);
+static CH_HEAP_AREA(mem_scratch_area, MEM_SCRATCH_SIZE);
+static memory_heap_t mem_threads_heap;
+static memory_heap_t mem_image_heap;
+static memory_heap_t mem_scratch_heap;
+
+static region_t regions[MEM_REGION_NUM] = {
+	[MEM_REGION_THREADS]	= {.name = "threads"},
+	[MEM_REGION_IMAGE]		= {.name = "image"},
+	[MEM_REGION_DSP]		= {.name = "dsp"},
+	[MEM_REGION_SCRATCH]	= {.name = "scratch"}
+};
+
+/*
+ * The DSP region is the CCM heap created by pktSystemInit().
+ */
+static memory_heap_t *getHeap(mem_region_t r)
+{
+	if(r == MEM_REGION_DSP) {
+		extern memory_heap_t *ccm_heap;
+		if(ccm_heap != NULL && regions[r].size == 0) {
+			extern uint8_t __ram4_free__[];
+			extern uint8_t __ram4_end__[];
+			regions[r].size = __ram4_end__ - __ram4_free__;
+		}
+		return ccm_heap;
+	}
+	return regions[r].heap;
+}
+
+/*
+ * Update the counters after an allocation.
+ */
+static void account(mem_region_t r, memory_heap_t *heap, bool fallback,
+					bool fail)
+{
+	size_t largest = 0;
+	if(heap != NULL)
+		(void)chHeapStatus(heap, NULL, &largest);
+
+	chSysLock();
+	region_t *rp = &regions[r];
+	rp->allocs++;
+	if(fallback)
+		rp->fallbacks++;
+	if(fail)
+		rp->fails++;
+	if(heap != NULL && (rp->allocs == 1 || largest < rp->largest_min))
+		rp->largest_min = largest;
+	chSysUnlock();
+}
+
+/**
+  * Create the SRAM regions. Call before any thread uses them.
+  */
+void mem_init(void)
+{
+	chHeapObjectInit(&mem_threads_heap, mem_threads_area,
+					 sizeof(mem_threads_area));
+	regions[MEM_REGION_THREADS].heap = &mem_threads_heap;
+	regions[MEM_REGION_THREADS].size = sizeof(mem_threads_area);
+
+	chHeapObjectInit(&mem_image_heap, mem_image_area, sizeof(mem_image_area));
+	regions[MEM_REGION_IMAGE].heap = &mem_image_heap;
+	regions[MEM_REGION_IMAGE].size = sizeof(mem_image_area);
+
+	chHeapObjectInit(&mem_scratch_heap, mem_scratch_area,
+					 sizeof(mem_scratch_area));
+	regions[MEM_REGION_SCRATCH].heap = &mem_scratch_heap;
+	regions[MEM_REGION_SCRATCH].size = sizeof(mem_scratch_area);
+}
+
+/**
+  * Allocate from a region, or from the main heap if the region is full.
+  * An align of 0 uses the heap alignment. Release with chHeapFree().
+  * Returns NULL if neither heap has the memory.
+  */
+void *mem_alloc(mem_region_t region, size_t size, unsigned align)
+{
+	if(align == 0)
+		align = CH_HEAP_ALIGNMENT;
+
+	memory_heap_t *heap = getHeap(region);
+	void *p = NULL;
+	if(heap != NULL)
+		p = chHeapAllocAligned(heap, size, align);
+	bool fallback = p == NULL;
+	if(fallback)
+		p = chHeapAllocAligned(NULL, size, align);
+
+	account(region, heap, fallback, p == NULL);
+	return p;
+}
+
+/**
+  * Create a thread with its stack in a region, or in the main heap if the
+  * region is full. The stack is released to its heap when the thread is
+  * released, the same as for chThdCreateFromHeap().
+  */
+thread_t *mem_thread_create(mem_region_t region, size_t size, const char *name,
+							tprio_t prio, tfunc_t pf, void *arg)
+{
+	memory_heap_t *heap = getHeap(region);
+	thread_t *th = NULL;
+	if(heap != NULL)
+		th = chThdCreateFromHeap(heap, size, name, prio, pf, arg);
+	bool fallback = th == NULL;
+	if(fallback)
+		th = chThdCreateFromHeap(NULL, size, name, prio, pf, arg);
+
+	account(region, heap, fallback, th == NULL);
+	return th;
+}
+
+/**
+  * Allocate a scratch buffer. Declare it with MEM_SCRATCH() so it is
+  * released at the end of the scope.
+  */
+void *mem_scratch_get(size_t size)
+{
+	return mem_alloc(MEM_REGION_SCRATCH, size, 0);
+}
+
+/*
+ * Cleanup of a MEM_SCRATCH() variable, called with the address of the
+ * pointer.
+ */
+void mem_scratch_release(void *pp)
+{
+	void *p = *(void **)pp;
+	if(p != NULL)
+		chHeapFree(p);
+}
+
+void mem_get_stats(mem_region_t region, mem_region_stats_t *stats)
+{
+	memory_heap_t *heap = getHeap(region);
+	region_t *rp = &regions[region];
+
+	stats->name = rp->name;
+	stats->free = 0;
+	stats->largest = 0;
+	stats->fragments = 0;
+	if(heap != NULL)
+		stats->fragments = chHeapStatus(heap, &stats->free, &stats->largest);
+
+	chSysLock();
+	stats->size = heap != NULL ? rp->size : 0;
+	stats->largest_min = rp->largest_min;
+	stats->allocs = rp->allocs;
+	stats->fallbacks = rp->fallbacks;
+	stats->fails = rp->fails;
+	chSysUnlock();
+}
+
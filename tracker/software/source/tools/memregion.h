@@ -0,0 +1,56 @@
+#ifndef __MEMREGION_H__
+#define __MEMREGION_H__
+
+#include "ch.h"
+#include "hal.h"
+
+#define MEM_THREADS_SIZE		(28*1024)	/* Callback workers, decoder, TX worker, shell */
+#define MEM_IMAGE_SIZE			(64*1024)	/* Primary capture buffer and SSDV encoder */
+#define MEM_SCRATCH_SIZE		(4*1024)	/* Scratch buffers of packet and trace functions */
+
+/*
+ * Heap regions of the subsystems.
+ * Memory which is allocated and released repeatedly comes from the region
+ * of its subsystem so it can not fragment the main heap. A request which
+ * does not fit is served from the main heap and counted as a fallback.
+ * Packet objects have their own pools (see ax25_get_pool_stats()).
+ */
+typedef enum {
+	MEM_REGION_THREADS,		/* Stacks of threads started and stopped at run time (SRAM) */
+	MEM_REGION_IMAGE,		/* Image capture buffers (SRAM, DMA capable) */
+	MEM_REGION_DSP,			/* CPU only data, the CCM heap */
+	MEM_REGION_SCRATCH,		/* Large temporary buffers instead of stack arrays (SRAM) */
+	MEM_REGION_NUM
+} mem_region_t;
+
+typedef struct {
+	const char	*name;
+	size_t		size;			/* 0 if the region does not exist */
+	size_t		free;
+	size_t		largest;
+	size_t		largest_min;	/* Smallest largest free block after an allocation */
+	size_t		fragments;
+	uint32_t	allocs;
+	uint32_t	fallbacks;		/* Served from the main heap */
+	uint32_t	fails;
+} mem_region_stats_t;
+
+void mem_init(void);
+void *mem_alloc(mem_region_t region, size_t size, unsigned align);
+thread_t *mem_thread_create(mem_region_t region, size_t size, const char *name,
+							tprio_t prio, tfunc_t pf, void *arg);
+void mem_get_stats(mem_region_t region, mem_region_stats_t *stats);
+void *mem_scratch_get(size_t size);
+void mem_scratch_release(void *pp);
+
+/*
+ * Scratch buffer in place of a large array on the stack. The buffer is
+ * released when the variable goes out of scope so thread stacks need not
+ * be sized for it. The pointer is NULL if no heap has the memory.
+ */
+#define MEM_SCRATCH(type, name, size)										\
+	type *name __attribute__((cleanup(mem_scratch_release)))				\
+		= mem_scratch_get(size)
+
+#endif
+
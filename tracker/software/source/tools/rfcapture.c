@@ -0,0 +1,159 @@
+/**
+  * Capture of the RF traffic to the SD card.
+  * Every received frame is recorded with its CRC status and signal
+  * quality and every transmitted frame with its queue latency and
+  * airtime. Records are gathered in RAM and appended to the capture file
+  * by the SD archive thread when the buffer is full or the oldest record
+  * is CAP_FLUSH_TIME old. Without a card the records are counted as lost.
+  *
+  * The file format is in rfcapture.h.
+  */
+
+#include "ch.h"
+#include "hal.h"
+#include "pktconf.h"
+#include "rfcapture.h"
+#include "config.h"
+#include "collector.h"
+#include "ptime.h"
+#include "sd.h"
+#include <string.h>
+
+static MUTEX_DECL(cap_mtx);
+static uint8_t cap_buffer[CAP_BUFFER_SIZE];
+static uint16_t cap_len;
+static systime_t cap_first;		// Time of the first record in the buffer
+static cap_stats_t cap_stats;
+
+/*
+ * Start a buffer with a sync record.
+ * Called with the mutex locked.
+ */
+static void cap_sync(void) {
+	cap_header_t *h = (cap_header_t *)cap_buffer;
+	memset(h, 0, sizeof(*h));
+	h->type = CAP_SYNC;
+	h->time = TIME_I2MS(chVTGetSystemTime());
+	ptime_t time;
+	getTime(&time);
+	if(time.year != RTC_BASE_YEAR)
+		h->sync.unix_time = date2UnixTimestamp(&time);
+	h->sync.reset = getLastDataPoint()->reset;
+	cap_len = sizeof(*h);
+	cap_first = chVTGetSystemTime();
+}
+
+/*
+ * Queue the buffer to the SD card and empty it.
+ * Called with the mutex locked.
+ */
+static void cap_write(void) {
+	if(cap_len <= sizeof(cap_header_t)) {
+		cap_len = 0;
+		return;
+	}
+	uint32_t records = 0;
+	uint16_t i;
+	for(i = 0; i < cap_len; ) {
+		cap_header_t *h = (cap_header_t *)&cap_buffer[i];
+		if(h->type != CAP_SYNC)
+			records++;
+		i += sizeof(cap_header_t) + h->len;
+	}
+	/* The buffer is copied by the archive. */
+	if(sdArchiveRecord(CAP_FILE, cap_buffer, cap_len))
+		cap_stats.writes++;
+	else
+		cap_stats.lost += records;
+	cap_len = 0;
+}
+
+/*
+ * Add a record to the buffer. The frame is cut to CAP_FRAME_MAX.
+ * Called with the mutex locked.
+ */
+static void cap_add(cap_header_t *h, const uint8_t *frame, uint16_t len) {
+	if(len > CAP_FRAME_MAX) {
+		len = CAP_FRAME_MAX;
+		h->flags |= CAP_FLAG_TRUNCATED;
+	}
+	h->len = len;
+	h->time = TIME_I2MS(chVTGetSystemTime());
+	if(cap_len != 0 && (cap_len + sizeof(*h) + len > CAP_BUFFER_SIZE
+			|| chVTTimeElapsedSinceX(cap_first) >= CAP_FLUSH_TIME))
+		cap_write();
+	if(cap_len == 0)
+		cap_sync();
+	memcpy(&cap_buffer[cap_len], h, sizeof(*h));
+	memcpy(&cap_buffer[cap_len + sizeof(*h)], frame, len);
+	cap_len += sizeof(*h) + len;
+}
+
+/**
+  * Record a received frame.
+  * fixed is set if the CRC passed only after bit repair.
+  */
+void cap_rx(pkt_data_object_t *pkt_buff, bool crc_ok, bool fixed) {
+	if(!conf_sram.rf_capture)
+		return;
+
+	packet_svc_t *handler = pkt_buff->handler;
+	radio_task_object_t *rt = &handler->radio_rx_config;
+	cap_header_t h = {0};
+	h.type = CAP_RX;
+	h.flags = (crc_ok ? CAP_FLAG_CRC_OK : 0) | (fixed ? CAP_FLAG_FIXED : 0)
+			  | (rt->type == MOD_2FSK ? CAP_FLAG_2FSK : 0);
+	h.freq = pktComputeOperatingFrequency(handler->radio, rt->base_frequency,
+										  rt->step_hz, rt->channel, RADIO_RX);
+	h.rx.tone_level = pkt_buff->quality.tone_level;
+	h.rx.rssi = pkt_buff->quality.rssi;
+	h.rx.pll_lock = pkt_buff->quality.pll_lock;
+
+	chMtxLock(&cap_mtx);
+	cap_add(&h, pkt_buff->buffer, pkt_buff->packet_size);
+	cap_stats.rx++;
+	chMtxUnlock(&cap_mtx);
+}
+
+/**
+  * Record a transmitted frame of a burst which started at rf_start.
+  * The airtime is from the frame size without the preamble.
+  */
+void cap_tx(radio_task_object_t *rto, packet_t pp, uint8_t burst,
+			systime_t rf_start) {
+	if(!conf_sram.rf_capture)
+		return;
+
+	link_speed_t speed = rto->tx_speed != 0 ? rto->tx_speed : 1200;
+	cap_header_t h = {0};
+	h.type = CAP_TX;
+	h.flags = rto->type == MOD_2FSK ? CAP_FLAG_2FSK : 0;
+	h.freq = pktComputeOperatingFrequency(rto->handler->radio,
+										  rto->base_frequency, rto->step_hz,
+										  rto->channel, RADIO_TX);
+	if(pp->submitted != 0)
+		h.tx.queue = TIME_I2MS(chTimeDiffX(pp->submitted, rf_start));
+	h.tx.airtime = (uint32_t)pktStreamFrameSize(pp, NULL) * 8 * 1000 / speed;
+	h.tx.pwr = rto->tx_power;
+	h.tx.burst = burst;
+
+	chMtxLock(&cap_mtx);
+	cap_add(&h, pp->frame_data, pp->frame_len);
+	cap_stats.tx++;
+	chMtxUnlock(&cap_mtx);
+}
+
+/**
+  * Write out the records gathered.
+  */
+void cap_flush(void) {
+	chMtxLock(&cap_mtx);
+	cap_write();
+	chMtxUnlock(&cap_mtx);
+}
+
+void cap_get_stats(cap_stats_t *stats) {
+	chMtxLock(&cap_mtx);
+	*stats = cap_stats;
+	chMtxUnlock(&cap_mtx);
+}
@@ -0,0 +1,71 @@
+#ifndef __RFCAPTURE_H__
+#define __RFCAPTURE_H__
+
+#include "ch.h"
+#include "hal.h"
+#include "pktconf.h"
+
+#define CAP_FILE				"rfcap.bin"	/* Capture file on the SD card */
+#define CAP_BUFFER_SIZE			2048		/* Records gathered for one write */
+#define CAP_FLUSH_TIME			TIME_S2I(60)	/* Age of records written out */
+#define CAP_FRAME_MAX			336			/* Frame bytes kept in a record */
+
+/*
+ * Capture file format.
+ * Each record is a header followed by len bytes of the frame. Received
+ * frames include the FCS, transmitted frames do not. Each write starts
+ * with a sync record which ties the system time to the RTC.
+ * Values are little endian.
+ */
+typedef enum {
+	CAP_SYNC = 0,
+	CAP_RX,
+	CAP_TX
+} cap_type_t;
+
+#define CAP_FLAG_CRC_OK			0x01		/* RX frame passed the CRC check */
+#define CAP_FLAG_FIXED			0x02		/* RX frame CRC passed after bit repair */
+#define CAP_FLAG_2FSK			0x04		/* 2FSK, AFSK otherwise */
+#define CAP_FLAG_TRUNCATED		0x08		/* Frame longer than CAP_FRAME_MAX */
+
+typedef struct __attribute__((packed)) {
+	uint8_t		type;		// cap_type_t
+	uint8_t		flags;
+	uint16_t	len;		// Frame bytes after the header
+	uint32_t	time;		// System time in ms
+	uint32_t	freq;		// Operating frequency in Hz
+	union {
+		struct {
+			uint32_t	tone_level;	// Q31 magnitude of the dominant tone
+			uint8_t		rssi;
+			uint8_t		pll_lock;	// % of transitions in the PLL window
+			uint16_t	reserved;
+		} rx;
+		struct {
+			uint32_t	queue;		// ms from submit to the start of its burst
+			uint16_t	airtime;	// ms of the frame without preamble
+			int8_t		pwr;
+			uint8_t		burst;		// Position of the frame in its burst
+		} tx;
+		struct {
+			uint32_t	unix_time;	// RTC time, zero if not set
+			uint16_t	reset;		// Reset counter of the data points
+			uint16_t	reserved;
+		} sync;
+	};
+} cap_header_t;
+
+typedef struct {
+	uint32_t	rx;			// Records made
+	uint32_t	tx;
+	uint32_t	writes;		// Buffers queued to the SD card
+	uint32_t	lost;		// Records not written (no card or queue full)
+} cap_stats_t;
+
+void cap_rx(pkt_data_object_t *pkt_buff, bool crc_ok, bool fixed);
+void cap_tx(radio_task_object_t *rto, packet_t pp, uint8_t burst,
+			systime_t rf_start);
+void cap_flush(void);
+void cap_get_stats(cap_stats_t *stats);
+
+#endif
@@ -0,0 +1,99 @@
+/**
+  * Registry of performance counters and sampled values.
+  * Modules declare a stats_t with STATS_DECL() and update it. A stats_t
+  * is added to the registry with stats_register() or on its first update.
+  * Updates lock the system briefly so they may be used from any context.
+  */
+
+#include "ch.h"
+#include "hal.h"
+#include "stats.h"
+
+static stats_t *stats_list;
+
+/*
+ * Add a stats_t to the registry if it is not yet in it.
+ * Must be called with the system locked.
+ */
+static void stats_link(stats_t *s) {
+	if(s->linked)
+		return;
+	s->linked = true;
+	/* Keep the order of registration. */
+	stats_t **p = &stats_list;
+	while(*p != NULL)
+		p = &(*p)->next;
+	*p = s;
+}
+
+void stats_register(stats_t *s) {
+	syssts_t sts = chSysGetStatusAndLockX();
+	stats_link(s);
+	chSysRestoreStatusX(sts);
+}
+
+/**
+  * Add to a counter.
+  */
+void stats_count(stats_t *s, uint32_t n) {
+	syssts_t sts = chSysGetStatusAndLockX();
+	stats_link(s);
+	s->count += n;
+	chSysRestoreStatusX(sts);
+}
+
+/**
+  * Add a sample to a value.
+  */
+void stats_sample(stats_t *s, int32_t value) {
+	uint32_t u = value < 0 ? 0 : (uint32_t)value;
+	uint8_t bin = u == 0 ? 0 : 31 - __builtin_clz(u);
+	if(bin >= STATS_HIST_BINS)
+		bin = STATS_HIST_BINS - 1;
+
+	syssts_t sts = chSysGetStatusAndLockX();
+	stats_link(s);
+	if(s->count == 0 || value < s->min)
+		s->min = value;
+	if(s->count == 0 || value > s->max)
+		s->max = value;
+	s->value = value;
+	s->total += value;
+	s->count++;
+	s->hist[bin]++;
+	chSysRestoreStatusX(sts);
+}
+
+/**
+  * Get a consistent copy of a stats_t.
+  */
+void stats_get(const stats_t *s, stats_t *copy) {
+	syssts_t sts = chSysGetStatusAndLockX();
+	*copy = *s;
+	chSysRestoreStatusX(sts);
+}
+
+/**
+  * Clear all registered stats. They stay registered.
+  */
+void stats_reset(void) {
+	syssts_t sts = chSysGetStatusAndLockX();
+	for(stats_t *s = stats_list; s != NULL; s = s->next) {
+		s->count = 0;
+		s->value = 0;
+		s->min = 0;
+		s->max = 0;
+		s->total = 0;
+		for(uint8_t i = 0; i < STATS_HIST_BINS; i++)
+			s->hist[i] = 0;
+	}
+	chSysRestoreStatusX(sts);
+}
+
+/**
+  * First registered stats_t. Follow next for the others.
+  * Registered stats_t are never removed.
+  */
+stats_t *stats_first(void) {
+	return stats_list;
+}
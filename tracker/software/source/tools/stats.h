@@ -0,0 +1,35 @@
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include "ch.h"
+#include "hal.h"
+
+#define STATS_HIST_BINS			16			/* Bin k holds values from 2^k to 2^(k+1) - 1 */
+
+/*
+ * A counter or a sampled value.
+ * Counters only use count. Samples also keep the last value, the range,
+ * the total for the mean and a histogram.
+ */
+typedef struct stats {
+	const char		*name;
+	struct stats	*next;
+	bool			linked;
+	uint32_t		count;
+	int32_t			value;
+	int32_t			min;
+	int32_t			max;
+	int64_t			total;
+	uint32_t		hist[STATS_HIST_BINS];
+} stats_t;
+
+#define STATS_DECL(var, name)	stats_t var = {name, NULL, false, 0, 0, 0, 0, 0, {0}}
+
+void stats_register(stats_t *s);
+void stats_count(stats_t *s, uint32_t n);
+void stats_sample(stats_t *s, int32_t value);
+void stats_get(const stats_t *s, stats_t *copy);
+void stats_reset(void);
+stats_t *stats_first(void);
+
+#endif
@@ -0,0 +1,62 @@
+/**
+  * Per thread CPU time and stack high-water marks.
+  * The context switch hook in chconf.h adds the cycles since the last
+  * switch to the thread leaving the CPU. Stacks are filled with
+  * CH_DBG_STACK_FILL_VALUE when a thread is created (and by the startup
+  * code for the main stack) so the untouched part can be measured.
+  */
+
+#include "ch.h"
+#include "hal.h"
+#include "threadprof.h"
+
+uint32_t threadprof_switch_time;
+
+/*
+ * Scan a stack from its limit up to the first byte which was written.
+ */
+static uint32_t threadprof_stack_free(const uint8_t *base, const uint8_t *end) {
+	const uint8_t *p = base;
+	while(p < end && *p == CH_DBG_STACK_FILL_VALUE)
+		p++;
+	return p - base;
+}
+
+void threadprof_get(thread_t *tp, threadprof_t *p) {
+	const uint8_t *base = (const uint8_t*)tp->wabase;
+	const uint8_t *end;
+	if(tp == &ch.mainthread) {
+		extern uint8_t __main_thread_stack_end__[];
+		end = __main_thread_stack_end__;
+	} else {
+		/* The thread structure is at the top of its working area. */
+		end = (const uint8_t*)tp;
+	}
+	p->name = tp->name;
+	p->prio = tp->prio;
+	p->stack_size = end - base;
+	p->stack_used = p->stack_size - threadprof_stack_free(base, end);
+
+	syssts_t sts = chSysGetStatusAndLockX();
+	p->cycles = tp->cycles;
+	if(tp == chThdGetSelfX()) {
+		/* Add the time of the running slice. */
+		p->cycles += chSysGetRealtimeCounterX() - threadprof_switch_time;
+	}
+	chSysRestoreStatusX(sts);
+}
+
+/*
+ * Clear the CPU time of all threads.
+ */
+void threadprof_reset(void) {
+	thread_t *tp = chRegFirstThread();
+	while(tp != NULL) {
+		syssts_t sts = chSysGetStatusAndLockX();
+		tp->cycles = 0;
+		if(tp == chThdGetSelfX())
+			threadprof_switch_time = chSysGetRealtimeCounterX();
+		chSysRestoreStatusX(sts);
+		tp = chRegNextThread(tp);
+	}
+}
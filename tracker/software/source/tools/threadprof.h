@@ -0,0 +1,25 @@
+#ifndef __THREADPROF_H__
+#define __THREADPROF_H__
+
+#include "ch.h"
+#include "hal.h"
+
+/*
+ * CPU time and stack use of a thread.
+ * CPU time is counted in core cycles by the context switch hook in
+ * chconf.h. Interrupts are charged to the thread they interrupted.
+ */
+typedef struct {
+	const char	*name;
+	tprio_t		prio;
+	uint32_t	stack_size;
+	uint32_t	stack_used;		// High-water mark from the stack fill pattern
+	uint64_t	cycles;
+} threadprof_t;
+
+extern uint32_t threadprof_switch_time;
+
+void threadprof_get(thread_t *tp, threadprof_t *p);
+void threadprof_reset(void);
+
+#endif
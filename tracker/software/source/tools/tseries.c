@@ -0,0 +1,214 @@
+/**
+  * Time series of recent telemetry in RAM.
+  * Each data point is added to a bucket of a ring at each resolution.
+  * A bucket holds the min, max and sum of its samples per field. The
+  * window of a ring keeps the running aggregate of all its buckets, so a
+  * query needs no scan of the buckets or the flash log. A bucket leaving
+  * the window is taken out of the sum. The min and max are scanned again
+  * only if the bucket held them, at most once per bucket period.
+  *
+  * Buckets are placed by the system time in seconds as in sys_time of the
+  * data point. Buckets without a point are empty.
+  */
+
+#include "ch.h"
+#include "hal.h"
+#include "tseries.h"
+#include <string.h>
+#include <strings.h>
+
+typedef struct {
+	int32_t		min;
+	int32_t		max;
+	int32_t		sum;
+	uint16_t	count;
+} ts_bucket_t;
+
+typedef struct {
+	int64_t		sum;
+	uint32_t	count;
+	int32_t		min;
+	int32_t		max;
+} ts_window_t;
+
+typedef struct {
+	uint32_t	period;					// Seconds per bucket
+	uint8_t		size;					// Buckets in the ring
+	uint8_t		head;					// Bucket being filled
+	uint32_t	slot;					// Time of the head bucket in periods
+	ts_bucket_t	*buckets;				// Ring of each field in turn
+	ts_window_t	window[TS_FIELDS];
+} ts_ring_t;
+
+static ts_bucket_t ts_minute[TS_FIELDS][TS_MINUTE_BUCKETS];
+static ts_bucket_t ts_ten_minutes[TS_FIELDS][TS_TEN_MINUTE_BUCKETS];
+static ts_bucket_t ts_hour[TS_FIELDS][TS_HOUR_BUCKETS];
+
+static ts_ring_t ts_rings[TS_RESOLUTIONS] = {
+	[TS_MINUTE]			= {60, TS_MINUTE_BUCKETS, 0, 0, &ts_minute[0][0], {{0}}},
+	[TS_TEN_MINUTES]	= {600, TS_TEN_MINUTE_BUCKETS, 0, 0,
+						   &ts_ten_minutes[0][0], {{0}}},
+	[TS_HOUR]			= {3600, TS_HOUR_BUCKETS, 0, 0, &ts_hour[0][0], {{0}}}
+};
+
+static MUTEX_DECL(ts_mtx);
+
+static const char *ts_res_names[] = {TS_RES_NAMES};
+static const char *ts_field_names[] = {TS_FIELD_NAMES};
+
+static ts_bucket_t *ts_bucket(ts_ring_t *ring, ts_field_t field, uint8_t i) {
+	return &ring->buckets[field * ring->size + i];
+}
+
+/*
+ * Find the min and max of a window from its buckets.
+ */
+static void ts_rescan(ts_ring_t *ring, ts_field_t field) {
+	ts_window_t *w = &ring->window[field];
+	bool first = true;
+	for(uint8_t i = 0; i < ring->size; i++) {
+		ts_bucket_t *b = ts_bucket(ring, field, i);
+		if(b->count == 0)
+			continue;
+		if(first || b->min < w->min)
+			w->min = b->min;
+		if(first || b->max > w->max)
+			w->max = b->max;
+		first = false;
+	}
+}
+
+/*
+ * Move the head of a ring to the bucket of a time in seconds.
+ * Buckets passed over are emptied and leave the window.
+ * Called with the mutex locked.
+ */
+static void ts_advance(ts_ring_t *ring, uint32_t secs) {
+	uint32_t slot = secs / ring->period;
+	if(slot == ring->slot)
+		return;
+	/* A time before the head is a restart of the time base. */
+	uint32_t steps = slot > ring->slot ? slot - ring->slot : ring->size;
+	if(steps > ring->size)
+		steps = ring->size;
+	ring->slot = slot;
+
+	bool rescan[TS_FIELDS] = {false};
+	while(steps-- > 0) {
+		ring->head = (ring->head + 1) % ring->size;
+		for(uint8_t f = 0; f < TS_FIELDS; f++) {
+			ts_bucket_t *b = ts_bucket(ring, f, ring->head);
+			if(b->count == 0)
+				continue;
+			ts_window_t *w = &ring->window[f];
+			w->sum -= b->sum;
+			w->count -= b->count;
+			if(b->min == w->min || b->max == w->max)
+				rescan[f] = true;
+			b->count = 0;
+			b->sum = 0;
+		}
+	}
+	for(uint8_t f = 0; f < TS_FIELDS; f++) {
+		if(rescan[f] && ring->window[f].count != 0)
+			ts_rescan(ring, f);
+	}
+}
+
+static void ts_put(ts_ring_t *ring, ts_field_t field, int32_t value) {
+	ts_bucket_t *b = ts_bucket(ring, field, ring->head);
+	ts_window_t *w = &ring->window[field];
+	if(b->count == 0 || value < b->min)
+		b->min = value;
+	if(b->count == 0 || value > b->max)
+		b->max = value;
+	b->sum += value;
+	b->count++;
+	if(w->count == 0 || value < w->min)
+		w->min = value;
+	if(w->count == 0 || value > w->max)
+		w->max = value;
+	w->sum += value;
+	w->count++;
+}
+
+/**
+  * Add a data point to the time series.
+  */
+void ts_add(const dataPoint_t *tp) {
+	int32_t value[TS_FIELDS] = {
+		[TS_VBAT]	= tp->adc_vbat,
+		[TS_PBAT]	= tp->pac_pbat,
+		[TS_PSOL]	= tp->pac_psol,
+		[TS_ALT]	= tp->gps_alt,
+		[TS_PRESS]	= tp->sen_i1_press,
+		[TS_TEMP]	= tp->sen_i1_temp
+	};
+	bool valid[TS_FIELDS] = {
+		[TS_VBAT]	= true,
+		[TS_PBAT]	= true,
+		[TS_PSOL]	= true,
+		[TS_ALT]	= isPositionValid(tp),
+		[TS_PRESS]	= tp->sen_i1_press != 0,
+		[TS_TEMP]	= tp->sen_i1_press != 0
+	};
+
+	chMtxLock(&ts_mtx);
+	for(uint8_t r = 0; r < TS_RESOLUTIONS; r++) {
+		ts_ring_t *ring = &ts_rings[r];
+		ts_advance(ring, tp->sys_time);
+		for(uint8_t f = 0; f < TS_FIELDS; f++) {
+			if(valid[f])
+				ts_put(ring, f, value[f]);
+		}
+	}
+	chMtxUnlock(&ts_mtx);
+}
+
+/**
+  * Get the statistics of a field over the window of a resolution.
+  * Returns false if there is no sample in the window.
+  */
+bool ts_get(ts_field_t field, ts_res_t res, ts_stats_t *stats) {
+	ts_ring_t *ring = &ts_rings[res];
+	chMtxLock(&ts_mtx);
+	ts_advance(ring, TIME_I2S(chVTGetSystemTime()));
+	ts_window_t *w = &ring->window[field];
+	stats->count = w->count > 0xFFFF ? 0xFFFF : w->count;
+	stats->min = w->min;
+	stats->max = w->max;
+	stats->mean = w->count == 0 ? 0 : (int32_t)(w->sum / (int32_t)w->count);
+	chMtxUnlock(&ts_mtx);
+	return stats->count != 0;
+}
+
+void ts_reset(void) {
+	chMtxLock(&ts_mtx);
+	for(uint8_t r = 0; r < TS_RESOLUTIONS; r++) {
+		ts_ring_t *ring = &ts_rings[r];
+		memset(ring->buckets, 0, sizeof(ts_bucket_t) * TS_FIELDS * ring->size);
+		memset(ring->window, 0, sizeof(ring->window));
+	}
+	chMtxUnlock(&ts_mtx);
+}
+
+/**
+  * Find a resolution by its name.
+  */
+bool ts_find_res(const char *name, ts_res_t *res) {
+	for(uint8_t r = 0; r < TS_RESOLUTIONS; r++) {
+		if(strcasecmp(name, ts_res_names[r]) == 0) {
+			*res = (ts_res_t)r;
+			return true;
+		}
+	}
+	return false;
+}
+
+const char *ts_res_name(ts_res_t res) {
+	return ts_res_names[res];
+}
+
+const char *ts_field_name(ts_field_t field) {
+	return ts_field_names[field];
+}
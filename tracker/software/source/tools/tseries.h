@@ -0,0 +1,55 @@
+#ifndef __TSERIES_H__
+#define __TSERIES_H__
+
+#include "ch.h"
+#include "hal.h"
+#include "collector.h"
+
+/*
+ * Rings of telemetry buckets at three resolutions. The window of a ring
+ * is all of its buckets, the minute ring covers the airtime budget window.
+ */
+#define TS_MINUTE_BUCKETS		10			/* 10 minutes */
+#define TS_TEN_MINUTE_BUCKETS	36			/* 6 hours */
+#define TS_HOUR_BUCKETS			48			/* 2 days */
+
+typedef enum {
+	TS_MINUTE = 0,
+	TS_TEN_MINUTES,
+	TS_HOUR,
+	TS_RESOLUTIONS
+} ts_res_t;
+
+#define TS_RES_NAMES		"1m", "10m", "1h"
+
+/*
+ * Fields of the data points kept. Altitude needs a valid position and
+ * pressure and temperature the on board BME280.
+ */
+typedef enum {
+	TS_VBAT = 0,		// Battery voltage in mV
+	TS_PBAT,			// Battery power in mW
+	TS_PSOL,			// Solar power in mW
+	TS_ALT,				// Altitude in m
+	TS_PRESS,			// Air pressure in 0.1Pa
+	TS_TEMP,			// Temperature in 0.01degC
+	TS_FIELDS
+} ts_field_t;
+
+#define TS_FIELD_NAMES		"vbat", "pbat", "psol", "alt", "press", "temp"
+
+typedef struct {
+	uint16_t	count;		// Samples in the window, zero if none
+	int32_t		min;
+	int32_t		max;
+	int32_t		mean;
+} ts_stats_t;
+
+void ts_add(const dataPoint_t *tp);
+bool ts_get(ts_field_t field, ts_res_t res, ts_stats_t *stats);
+void ts_reset(void);
+bool ts_find_res(const char *name, ts_res_t *res);
+const char *ts_res_name(ts_res_t res);
+const char *ts_field_name(ts_field_t field);
+
+#endif
@@ -0,0 +1,194 @@
+/**
+  * Latency of positions from the sensors to the air.
+  * The beacon opens a record for its position packet with the times the
+  * collector sampled the point and got the GPS fix. Each stage of the send
+  * path stamps the record of the packet as it passes. The record is closed
+  * when the packet is released, it is kept if the packet reached the air.
+  *
+  * Records are found by the packet pointer. Packets without a record are
+  * passed by after a short scan.
+  */
+
+#include "ch.h"
+#include "hal.h"
+#include "pktconf.h"
+#include "txlatency.h"
+
+typedef struct {
+	packet_t	pp;						// Packet while open, NULL when closed
+	bool		done;					// Reached the air
+	uint8_t		stamped;				// Bit per stage
+	systime_t	time[TXLAT_STAGES];
+} txlat_record_t;
+
+static txlat_record_t txlat_records[TXLAT_RECORDS];
+static uint8_t txlat_next;
+static uint32_t txlat_drops;
+
+static const char *txlat_names[] = {TXLAT_STAGE_NAMES};
+
+/*
+ * Find the open record of a packet.
+ * Must be called with the system locked.
+ */
+static txlat_record_t *txlat_find(packet_t pp) {
+	for(uint8_t i = 0; i < TXLAT_RECORDS; i++) {
+		if(txlat_records[i].pp == pp)
+			return &txlat_records[i];
+	}
+	return NULL;
+}
+
+static void txlat_stamp(txlat_record_t *r, txlat_stage_t stage,
+						systime_t time) {
+	/* The first pass counts, a resumed send does not move the stage. */
+	if(r->stamped & (1 << stage))
+		return;
+	r->time[stage] = time;
+	r->stamped |= 1 << stage;
+}
+
+/**
+  * Open the record of a position packet just encoded.
+  * A time of zero means the stage did not happen.
+  */
+void txlat_open(packet_t pp, systime_t sampled, systime_t fixed) {
+	systime_t now = chVTGetSystemTime();
+	syssts_t sts = chSysGetStatusAndLockX();
+	/* The oldest record is reused, a packet still open there is lost. */
+	txlat_record_t *r = &txlat_records[txlat_next];
+	txlat_next = (txlat_next + 1) % TXLAT_RECORDS;
+	if(r->pp != NULL)
+		txlat_drops++;
+	r->pp = pp;
+	r->done = false;
+	r->stamped = 0;
+	if(sampled != 0)
+		txlat_stamp(r, TXLAT_SAMPLE, sampled);
+	if(fixed != 0)
+		txlat_stamp(r, TXLAT_FIX, fixed);
+	txlat_stamp(r, TXLAT_ENCODE, now);
+	chSysRestoreStatusX(sts);
+}
+
+/**
+  * Stamp a stage of a packet, and of the packets linked to it if chain.
+  */
+void txlat_mark(packet_t pp, txlat_stage_t stage, bool chain) {
+	systime_t now = chVTGetSystemTime();
+	while(pp != NULL) {
+		syssts_t sts = chSysGetStatusAndLockX();
+		txlat_record_t *r = txlat_find(pp);
+		if(r != NULL)
+			txlat_stamp(r, stage, now);
+		chSysRestoreStatusX(sts);
+		if(!chain)
+			break;
+		pp = pp->nextp;
+	}
+}
+
+/**
+  * Close the record of a packet which is released.
+  */
+void txlat_release(packet_t pp) {
+	syssts_t sts = chSysGetStatusAndLockX();
+	txlat_record_t *r = txlat_find(pp);
+	if(r != NULL) {
+		r->pp = NULL;
+		r->done = (r->stamped & (1 << TXLAT_RF)) != 0;
+		if(!r->done)
+			txlat_drops++;
+	}
+	chSysRestoreStatusX(sts);
+}
+
+/*
+ * Percentiles of the delays in milliseconds.
+ */
+static bool txlat_percentiles(uint32_t *v, uint8_t n, txlat_summary_t *s) {
+	s->count = n;
+	if(n == 0)
+		return false;
+	/* Insertion sort, there are only a few records. */
+	for(uint8_t i = 1; i < n; i++) {
+		uint32_t x = v[i];
+		uint8_t j = i;
+		for(; j > 0 && v[j - 1] > x; j--)
+			v[j] = v[j - 1];
+		v[j] = x;
+	}
+	s->p50 = v[(n - 1) * 50 / 100];
+	s->p90 = v[(n - 1) * 90 / 100];
+	s->max = v[n - 1];
+	return true;
+}
+
+/*
+ * Collect the delay of each packet which reached the air.
+ * The delay ends at stage and starts at from, or if from is TXLAT_STAGES
+ * at the last stage stamped before. The fix is not in the order of the
+ * stages as a position carried forward was fixed before the sample.
+ */
+static uint8_t txlat_collect(txlat_stage_t from, txlat_stage_t stage,
+							 uint32_t *v) {
+	uint8_t n = 0;
+	syssts_t sts = chSysGetStatusAndLockX();
+	for(uint8_t i = 0; i < TXLAT_RECORDS; i++) {
+		const txlat_record_t *r = &txlat_records[i];
+		if(!r->done || !(r->stamped & (1 << stage)))
+			continue;
+		int8_t start = from;
+		if(from == TXLAT_STAGES) {
+			for(start = stage - 1; start >= 0; start--) {
+				if(start != TXLAT_FIX && (r->stamped & (1 << start)))
+					break;
+			}
+		}
+		if(start < 0 || !(r->stamped & (1 << start)))
+			continue;
+		v[n++] = chTimeI2MS(chTimeDiffX(r->time[start], r->time[stage]));
+	}
+	chSysRestoreStatusX(sts);
+	return n;
+}
+
+/**
+  * Delay of a stage from the stage stamped before it (not the fix).
+  */
+bool txlat_summary(txlat_stage_t stage, txlat_summary_t *s) {
+	uint32_t v[TXLAT_RECORDS];
+	return txlat_percentiles(v, txlat_collect(TXLAT_STAGES, stage, v), s);
+}
+
+/**
+  * Age of the position when it went on air, counted from a stage.
+  */
+bool txlat_age(txlat_stage_t from, txlat_summary_t *s) {
+	uint32_t v[TXLAT_RECORDS];
+	return txlat_percentiles(v, txlat_collect(from, TXLAT_RF, v), s);
+}
+
+/**
+  * Packets released or overwritten before they reached the air.
+  */
+uint32_t txlat_dropped(void) {
+	return txlat_drops;
+}
+
+/**
+  * Clear the closed records. Open records are kept.
+  */
+void txlat_reset(void) {
+	syssts_t sts = chSysGetStatusAndLockX();
+	for(uint8_t i = 0; i < TXLAT_RECORDS; i++)
+		txlat_records[i].done = false;
+	txlat_drops = 0;
+	chSysRestoreStatusX(sts);
+}
+
+const char *txlat_stage_name(txlat_stage_t stage) {
+	if(stage >= TXLAT_STAGES)
+		return "?";
+	return txlat_names[stage];
+}
@@ -0,0 +1,47 @@
+#ifndef __TXLATENCY_H__
+#define __TXLATENCY_H__
+
+#include "ch.h"
+#include "hal.h"
+#include "ax25_pad.h"
+
+#define TXLAT_RECORDS			16			/* Packets kept for the percentiles */
+
+/*
+ * Stages of a position from the sensors to the air.
+ * A stage which did not happen for a packet (no GPS fix) is not stamped.
+ */
+typedef enum {
+	TXLAT_SAMPLE = 0,	// Telemetry measured by the collector
+	TXLAT_FIX,			// GPS lock of the position, not ordered with the sample
+	TXLAT_ENCODE,		// Position packet encoded by the beacon
+	TXLAT_SUBMIT,		// Posted to the radio manager by transmitOnRadio()
+	TXLAT_MANAGER,		// Handed to the TX worker by the radio manager
+	TXLAT_FEED,			// Picked up by the feeder in the TX worker
+	TXLAT_RF,			// Transmit started, first bit on air
+	TXLAT_STAGES
+} txlat_stage_t;
+
+#define TXLAT_STAGE_NAMES	"sample", "fix", "encode", "submit", "manager", \
+							"feed", "rf"
+
+/*
+ * Percentiles of a delay over the packets which reached the air.
+ */
+typedef struct {
+	uint8_t		count;
+	uint32_t	p50;		// Milliseconds
+	uint32_t	p90;
+	uint32_t	max;
+} txlat_summary_t;
+
+void txlat_open(packet_t pp, systime_t sampled, systime_t fixed);
+void txlat_mark(packet_t pp, txlat_stage_t stage, bool chain);
+void txlat_release(packet_t pp);
+bool txlat_summary(txlat_stage_t stage, txlat_summary_t *s);
+bool txlat_age(txlat_stage_t from, txlat_summary_t *s);
+uint32_t txlat_dropped(void);
+void txlat_reset(void);
+const char *txlat_stage_name(txlat_stage_t stage);
+
+#endif